@@ -11,32 +11,156 @@ CONFIG *= qt opengl warn_on shared thread create_prl rtti no_keywords
 
 QGL_HEADERS = \
 	  qglviewer.h \
+	  animationClock.h \
 	  camera.h \
 	  manipulatedFrame.h \
+	  manipulatedFrameGroup.h \
 	  manipulatedCameraFrame.h \
 	  frame.h \
+	  frameData.h \
+	  framePool.h \
+	  glStateCache.h \
+	  traceRecorder.h \
+	  poseInput.h \
+	  frustumCuller.h \
+	  drawList.h \
+	  geometryRecorder.h \
+	  depthCache.h \
 	  constraint.h \
+	  collisionConstraint.h \
+	  pathTable.h \
+	  frameRingBuffer.h \
+	  staticConstraint.h \
 	  keyFrameInterpolator.h \
+	  interpolationScheduler.h \
 	  mouseGrabber.h \
+	  modificationBatch.h \
 	  quaternion.h \
+	  sceneResources.h \
+	  cameraState.h \
+	  occlusionCuller.h \
+	  softwareOcclusionCuller.h \
+	  overlayLayer.h \
+	  stereoReprojector.h \
+	  rayPicker.h \
+	  sceneBounds.h \
+	  simulationThread.h \
+	  pointCloud.h \
+	  textureStreamer.h \
+	  mappedVertexBuffer.h \
+	  frameProfiler.h \
+	  frameSink.h \
+	  offscreenRenderer.h \
+	  renderTarget.h \
+	  bufferUploader.h \
+	  brickedVolume.h \
+	  taskScheduler.h \
+	  meshCache.h \
+	  lineRenderer.h \
+	  quantizedMesh.h \
+	  meshSequence.h \
+	  pointIndex.h \
+	  frameCapture.h \
+	  editableVertexBuffer.h \
+	  materialTextures.h \
+	  meshOptimizer.h \
+	  frameGraph.h \
+	  depthSorter.h \
+	  labelLayout.h \
+	  hotPathCounters.h \
+	  snapshotTileRenderer.h \
+	  clippingRegion.h \
+	  cameraReplicator.h \
+	  impostorCache.h \
+	  lodMesh.h \
+	  cascadedShadowMaps.h \
+	  pathRenderFarm.h \
+	  displayWall.h \
+	  renderThread.h \
+	  renderThreadGroup.h \
 	  vec.h \
 	  domUtils.h \
 	  config.h
 
 SOURCES = \
 	  qglviewer.cpp \
+	  animationClock.cpp \
 	  camera.cpp \
 	  manipulatedFrame.cpp \
+	  manipulatedFrameGroup.cpp \
 	  manipulatedCameraFrame.cpp \
 	  frame.cpp \
+	  frameData.cpp \
+	  framePool.cpp \
+	  glStateCache.cpp \
+	  traceRecorder.cpp \
+	  poseInput.cpp \
+	  frustumCuller.cpp \
+	  drawList.cpp \
+	  geometryRecorder.cpp \
+	  depthCache.cpp \
 	  saveSnapshot.cpp \
 	  constraint.cpp \
+	  collisionConstraint.cpp \
+	  pathTable.cpp \
+	  frameRingBuffer.cpp \
+	  coreProfileRenderer.cpp \
+	  glyphRenderer.cpp \
 	  keyFrameInterpolator.cpp \
+	  interpolationScheduler.cpp \
 	  mouseGrabber.cpp \
+	  modificationBatch.cpp \
 	  quaternion.cpp \
+	  textRenderer.cpp \
+	  sceneResources.cpp \
+	  cameraState.cpp \
+	  occlusionCuller.cpp \
+	  softwareOcclusionCuller.cpp \
+	  overlayLayer.cpp \
+	  stereoReprojector.cpp \
+	  temporalReprojector.cpp \
+	  rayPicker.cpp \
+	  sceneBounds.cpp \
+	  simulationThread.cpp \
+	  objectIdBuffer.cpp \
+	  pointCloud.cpp \
+	  textureStreamer.cpp \
+	  mappedVertexBuffer.cpp \
+	  frameProfiler.cpp \
+	  offscreenRenderer.cpp \
+	  renderTarget.cpp \
+	  bufferUploader.cpp \
+	  brickedVolume.cpp \
+	  taskScheduler.cpp \
+	  meshCache.cpp \
+	  lineRenderer.cpp \
+	  quantizedMesh.cpp \
+	  meshSequence.cpp \
+	  pointIndex.cpp \
+	  frameCapture.cpp \
+	  editableVertexBuffer.cpp \
+	  materialTextures.cpp \
+	  meshOptimizer.cpp \
+	  frameGraph.cpp \
+	  depthSorter.cpp \
+	  labelLayout.cpp \
+	  hotPathCounters.cpp \
+	  snapshotTileRenderer.cpp \
+	  clippingRegion.cpp \
+	  cameraReplicator.cpp \
+	  impostorCache.cpp \
+	  lodMesh.cpp \
+	  cascadedShadowMaps.cpp \
+	  pathRenderFarm.cpp \
+	  displayWall.cpp \
+	  renderThread.cpp \
+	  renderThreadGroup.cpp \
 	  vec.cpp
 
 HEADERS *= $${QGL_HEADERS}
+# Internal header, not installed
+HEADERS *= coreProfileRenderer.h glyphRenderer.h objectIdBuffer.h \
+           temporalReprojector.h textRenderer.h
 DISTFILES *= qglviewer-icon.xpm
 DESTDIR = $${PWD}
 
@@ -60,6 +184,19 @@ equals (QT_MAJOR_VERSION, 6) {
 # -----------------------------------
 FORMS *= ImageInterface.ui
 
+# -----------------------------------------------
+# --  S i n g l e   p r e c i s i o n   m o d e  --
+# -----------------------------------------------
+# Uncomment to store Vec, Quaternion, Frame and Camera values as float.
+# Applications must then also be compiled with this define (see config.h).
+# DEFINES *= QGLVIEWER_SINGLE_PRECISION
+
+# ---------------------------------------------
+# --  H o t   p a t h   c o u n t e r s  --
+# ---------------------------------------------
+# Uncomment to remove the HotPathCounters increments from the library.
+# DEFINES *= QGLVIEWER_NO_HOT_PATH_COUNTERS
+
 # ---------------------------------------------
 # --  V e c t o r i a l   R e n d e r i n g  --
 # ---------------------------------------------
@@ -72,14 +209,20 @@ contains( DEFINES, NO_VECTORIAL_RENDER ) {
   FORMS *= VRenderInterface.ui
 
   SOURCES *= \
+	VRender/Arena.cpp \
 	VRender/BackFaceCullingOptimizer.cpp \
 	VRender/BSPSortMethod.cpp \
+	VRender/DepthBucketSortMethod.cpp \
 	VRender/EPSExporter.cpp \
 	VRender/Exporter.cpp \
 	VRender/FIGExporter.cpp \
 	VRender/gpc.cpp \
+	VRender/HybridRasterizer.cpp \
+	VRender/IdBufferCuller.cpp \
 	VRender/ParserGL.cpp \
+	VRender/PDFExporter.cpp \
 	VRender/Primitive.cpp \
+	VRender/PrimitiveFilterOptimizer.cpp \
 	VRender/PrimitivePositioning.cpp \
 	VRender/TopologicalSortMethod.cpp \
 	VRender/VisibilityOptimizer.cpp \
@@ -89,9 +232,13 @@ contains( DEFINES, NO_VECTORIAL_RENDER ) {
 	VRender/VRender.cpp
 
   VRENDER_HEADERS = \
+	VRender/Arena.h \
 	VRender/AxisAlignedBox.h \
+	VRender/BSPTree.h \
 	VRender/Exporter.h \
 	VRender/gpc.h \
+	VRender/HybridRasterizer.h \
+	VRender/IdBufferCuller.h \
 	VRender/NVector3.h \
 	VRender/Optimizer.h \
 	VRender/ParserGL.h \
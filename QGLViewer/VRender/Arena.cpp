@@ -0,0 +1,135 @@
+#include <new>
+#include <stdlib.h>
+
+#include "Arena.h"
+
+using namespace vrender ;
+using namespace std ;
+
+thread_local Arena *Arena::_current = nullptr ;
+
+// Objects are prefixed by a header telling whether they come from an arena.
+// Its size keeps the objects aligned as operator new would.
+static const size_t HEADER_SIZE = alignof(max_align_t) > sizeof(size_t) ? alignof(max_align_t) : sizeof(size_t) ;
+static const size_t FROM_HEAP  = 0 ;
+static const size_t FROM_ARENA = 1 ;
+
+Arena::Arena(size_t block_size)
+	: _ptr(nullptr), _remaining(0), _block_size(block_size), _allocated_size(0)
+{
+}
+
+Arena::~Arena()
+{
+	release() ;
+}
+
+void *Arena::allocate(size_t size)
+{
+	size = (size + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE ;
+
+	// Big allocations get their own block, so that the current one is not wasted.
+
+	if(size > _block_size / 4)
+	{
+		char *block = static_cast<char *>(malloc(size)) ;
+		if(block == nullptr)
+			throw bad_alloc() ;
+		_blocks.push_back(block) ;
+		_allocated_size += size ;
+		return block ;
+	}
+
+	if(size > _remaining)
+	{
+		_ptr = static_cast<char *>(malloc(_block_size)) ;
+		if(_ptr == nullptr)
+			throw bad_alloc() ;
+		_blocks.push_back(_ptr) ;
+		_remaining = _block_size ;
+	}
+
+	void *p = _ptr ;
+	_ptr += size ;
+	_remaining -= size ;
+	_allocated_size += size ;
+	return p ;
+}
+
+void Arena::release()
+{
+	for(size_t i=0;i<_children.size();++i)
+		delete _children[i] ;
+
+	_children.clear() ;
+
+	for(size_t i=0;i<_blocks.size();++i)
+		free(_blocks[i]) ;
+
+	_blocks.clear() ;
+	_ptr = nullptr ;
+	_remaining = 0 ;
+	_allocated_size = 0 ;
+}
+
+size_t Arena::allocatedSize() const
+{
+	size_t size = _allocated_size ;
+
+	for(size_t i=0;i<_children.size();++i)
+		size += _children[i]->allocatedSize() ;
+
+	return size ;
+}
+
+Arena *Arena::createChild()
+{
+	_children.push_back(new Arena(_block_size)) ;
+	return _children.back() ;
+}
+
+Arena::Scope::Scope(Arena& arena)
+	: _previous(_current)
+{
+	_current = &arena ;
+}
+
+Arena::Scope::Scope(Arena *arena)
+	: _previous(_current)
+{
+	_current = arena ;
+}
+
+Arena::Scope::~Scope()
+{
+	_current = _previous ;
+}
+
+void *Arena::allocateObject(size_t size)
+{
+	char *p ;
+
+	if(_current != nullptr)
+	{
+		p = static_cast<char *>(_current->allocate(size + HEADER_SIZE)) ;
+		*reinterpret_cast<size_t *>(p) = FROM_ARENA ;
+	}
+	else
+	{
+		p = static_cast<char *>(::operator new(size + HEADER_SIZE)) ;
+		*reinterpret_cast<size_t *>(p) = FROM_HEAP ;
+	}
+
+	return p + HEADER_SIZE ;
+}
+
+void Arena::deallocateObject(void *p)
+{
+	if(p == nullptr)
+		return ;
+
+	char *base = static_cast<char *>(p) - HEADER_SIZE ;
+
+	if(*reinterpret_cast<size_t *>(base) == FROM_HEAP)
+		::operator delete(base) ;
+}
@@ -0,0 +1,74 @@
+#ifndef _VRENDER_ARENA_H
+#define _VRENDER_ARENA_H
+
+//  This class implements a monotonic memory pool. All the primitives and BSP
+// nodes allocated during an export are taken from large blocks, which are
+// released in one shot when the export is done.
+
+#include <cstddef>
+#include <vector>
+
+namespace vrender
+{
+	class Arena
+	{
+		public:
+			Arena(size_t block_size = 1 << 20) ;
+			~Arena() ;
+
+			void *allocate(size_t size) ;
+			void release() ;
+
+			//  An arena can only be used by one thread at a time. The worker
+			// threads of an export use child arenas instead, created by the
+			// thread that uses this one before the workers start. Children are
+			// released and deleted along with their parent.
+
+			Arena *createChild() ;
+
+			//  Includes the memory of the children.
+			size_t allocatedSize() const ;
+
+			//  Sets the arena used by allocateObject() in the current thread,
+			// until the Scope is destroyed. A null arena selects the heap, for
+			// objects that must outlive the current arena.
+
+			class Scope
+			{
+				public:
+					Scope(Arena& arena) ;
+					Scope(Arena *arena) ;
+					~Scope() ;
+				private:
+					Arena *_previous ;
+			};
+
+			//  To be used by class specific operator new/delete. Objects are taken
+			// from the current arena, or from the heap when there is none.
+			// deallocateObject() does nothing for arena objects: their memory is
+			// reclaimed by release().
+
+			static void *allocateObject(size_t size) ;
+			static void deallocateObject(void *p) ;
+
+			//  The arena used by allocateObject() in the current thread, or null
+			// for the heap.
+
+			static Arena *current() { return _current ; }
+
+		private:
+			Arena(const Arena&) ;
+			Arena& operator=(const Arena&) ;
+
+			static thread_local Arena *_current ;
+
+			std::vector<char *> _blocks ;
+			std::vector<Arena *> _children ;
+			char *_ptr ;
+			size_t _remaining ;
+			size_t _block_size ;
+			size_t _allocated_size ;
+	};
+}
+
+#endif
@@ -1,8 +1,19 @@
 #include "VRender.h"
 #include "Primitive.h"
 #include "SortMethod.h"
+#include "Exporter.h"
+#include "Arena.h"
+#include "BSPTree.h"
+#include "../taskScheduler.h"
 #include "math.h" // fabs
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <thread>
+
 using namespace vrender;
 using namespace std;
 
@@ -11,84 +22,61 @@ double LINE_EGALITY_EPS = 0.0001;
 
 typedef enum { BSP_CROSS_PLANE, BSP_UPPER, BSP_LOWER } BSPPosition;
 
-class BSPNode;
-
-class BSPTree
-{
-	public:
-		BSPTree();
-		~BSPTree();
-
-		void insert(Polygone *);
-		void insert(Segment *);
-		void insert(Point *);
-
-		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
-	private:
-		BSPNode *_root;
-        vector<Segment *> _segments;	// these are for storing segments and points when _root is null
-		vector<Point *> _points;
-};
+struct BSPBuildContext;
 
 void BSPSortMethod::sortPrimitives(std::vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
 {
-	// 1 - build BSP using polygons only
-
 	BSPTree tree;
-	Polygone *P;
-
-        unsigned int N = primitive_tab.size()/200 +1;
-	int nbinserted = 0;
-
-	vector<PtrPrimitive> segments_and_points;	// Store segments and points for pass 2, because polygons are deleted
-																// by the insertion and can not be dynamic_casted anymore.
-	for(unsigned int i=0;i<primitive_tab.size();++i,++nbinserted)
-	{
-        if((P = dynamic_cast<Polygone *>(primitive_tab[i])) != nullptr)
-			tree.insert(P);
-		else
-			segments_and_points.push_back(primitive_tab[i]);
-
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
-	}
-
-	// 2 - insert points and segments into the BSP
+	tree.build(primitive_tab,vparams);
 
-	Segment *S;
-	Point *p;
+	// 3 - refill the array with the content of the BSP
 
-	for(unsigned int j=0;j<segments_and_points.size();++j,++nbinserted)
-	{
-        if((S = dynamic_cast<Segment *>(segments_and_points[j])) != nullptr)
-			tree.insert(S);
-        else if((p = dynamic_cast<Point *>(segments_and_points[j])) != nullptr)
-			tree.insert(p);
+	primitive_tab.resize(0);
+	tree.recursFillPrimitiveArray(primitive_tab);
+}
 
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
-	}
+void BSPSortMethod::sortAndExportPrimitives(std::vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams,Exporter& exporter)
+{
+	BSPTree tree;
+	tree.build(primitive_tab,vparams);
 
-	// 3 - refill the array with the content of the BSP
+	// 3 - export the content of the BSP while traversing it. No sorted copy is
+	// made, and primitives are deleted as soon as they are written.
 
+	size_t nb_primitives = primitive_tab.size();
 	primitive_tab.resize(0);
-	tree.recursFillPrimitiveArray(primitive_tab);
+	tree.recursExportPrimitives(exporter,vparams,nb_primitives);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
+struct ExportProgress;
+
+namespace vrender
+{
 class BSPNode
 {
 	public:
 		BSPNode(Polygone *);
 		~BSPNode();
 
-		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
+		static void *operator new(size_t size) { return Arena::allocateObject(size); }
+		static void operator delete(void *p) { Arena::deallocateObject(p); }
+
+		void recursFillPrimitiveArray(vector<PtrPrimitive>&);
+		void recursExportPrimitives(Exporter&,ExportProgress&);
+		void fillBackToFrontArray(const double eye[4],vector<PtrPrimitive>&) const;
 
 		void insert(Polygone *);
 		void insert(Segment *);
 		void insert(Point *);
 
+		//  Builds a tree from all the polygons at once (see
+		// VRenderParams::OptimizeBSPSplits). The polygons are owned by the
+		// tree. nb_primitives is the total used to report the progress.
+
+		static BSPNode *build(vector<Polygone *>&,VRenderParams&,size_t nb_primitives);
+
 	private:
 		double a,b,c,d;
 
@@ -107,8 +95,12 @@ class BSPNode
 		void Classify(Segment *, Segment * &, Segment * &);
 		int  Classify(Point *);
 
-		void initEquation(const Polygone *P,double & a, double & b, double & c, double & d);
+		static void initEquation(const Polygone *P,double & a, double & b, double & c, double & d);
+
+		static BSPNode *build(vector<Polygone *>&,BSPBuildContext&,int parallel_depth);
+		static size_t choosePlane(const vector<Polygone *>&);
 };
+}
 
 BSPTree::BSPTree()
 {
@@ -116,28 +108,153 @@ BSPTree::BSPTree()
 }
 
 BSPTree::~BSPTree()
+{
+	clear();
+}
+
+bool BSPTree::isEmpty() const
+{
+	return (_root == nullptr) && _points.empty() && _segments.empty();
+}
+
+void BSPTree::clear()
 {
 	delete _root;
+	_root = nullptr;
+
+	for(unsigned int i=0;i<_points.size();++i) delete _points[i];
+	for(unsigned int j=0;j<_segments.size();++j) delete _segments[j];
+
+	_points.clear();
+	_segments.clear();
 }
 
 void BSPTree::insert(Point *P) 	{ if(_root == nullptr) _points.push_back(P) 	; else _root->insert(P); }
 void BSPTree::insert(Segment *S) { if(_root == nullptr) _segments.push_back(S); else _root->insert(S); }
 void BSPTree::insert(Polygone *P){ if(_root == nullptr) _root = new BSPNode(P); else _root->insert(P); }
 
-void BSPTree::recursFillPrimitiveArray(vector<PtrPrimitive>& tab) const
+void BSPTree::build(std::vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
+{
+	// 1 - build BSP using polygons only
+
+	Polygone *P;
+
+        unsigned int N = primitive_tab.size()/200 +1;
+	int nbinserted = 0;
+
+	vector<PtrPrimitive> segments_and_points;	// Store segments and points for pass 2, because polygons are deleted
+																// by the insertion and can not be dynamic_casted anymore.
+	if(_root == nullptr && vparams.isEnabled(VRenderParams::OptimizeBSPSplits))
+	{
+		vector<Polygone *> polygons;
+
+		for(unsigned int i=0;i<primitive_tab.size();++i)
+			if((P = dynamic_cast<Polygone *>(primitive_tab[i])) != nullptr)
+				polygons.push_back(P);
+			else
+				segments_and_points.push_back(primitive_tab[i]);
+
+		nbinserted = polygons.size();
+		_root = BSPNode::build(polygons,vparams,primitive_tab.size());
+	}
+	else
+	for(unsigned int i=0;i<primitive_tab.size();++i,++nbinserted)
+	{
+        if((P = dynamic_cast<Polygone *>(primitive_tab[i])) != nullptr)
+			insert(P);
+		else
+			segments_and_points.push_back(primitive_tab[i]);
+
+		if(nbinserted%N==0)
+			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
+	}
+
+	// 2 - insert points and segments into the BSP
+
+	Segment *S;
+	Point *p;
+
+	for(unsigned int j=0;j<segments_and_points.size();++j,++nbinserted)
+	{
+        if((S = dynamic_cast<Segment *>(segments_and_points[j])) != nullptr)
+			insert(S);
+        else if((p = dynamic_cast<Point *>(segments_and_points[j])) != nullptr)
+			insert(p);
+
+		if(nbinserted%N==0)
+			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
+	}
+}
+
+void BSPTree::recursFillPrimitiveArray(vector<PtrPrimitive>& tab)
 {
     if(_root != nullptr) _root->recursFillPrimitiveArray(tab);
 
 	for(unsigned int i=0;i<_points.size();++i) tab.push_back(_points[i]);
 	for(unsigned int j=0;j<_segments.size();++j) tab.push_back(_segments[j]);
+
+	_points.clear();
+	_segments.clear();
+}
+
+void BSPTree::fillBackToFrontArray(const double eye[4],vector<PtrPrimitive>& tab) const
+{
+    if(_root != nullptr) _root->fillBackToFrontArray(eye,tab);
+
+	for(unsigned int i=0;i<_points.size();++i) tab.push_back(_points[i]);
+	for(unsigned int j=0;j<_segments.size();++j) tab.push_back(_segments[j]);
+}
+
+// Progress of a streamed export. The number of primitives is only estimated,
+// since the BSP construction splits some of them.
+struct ExportProgress
+{
+	ExportProgress(VRenderParams& vp,size_t n)
+		: vparams(vp), message(QGLViewer::tr("Exporting to file %1").arg(vp.filename())), done(0), total(n), step(n/200+1) {}
+
+	VRenderParams& vparams;
+	const QString message;
+	size_t done,total,step;
+};
+
+// Same order as recursFillPrimitiveArray()
+static void exportAndDelete(Exporter& exporter,Primitive *P,ExportProgress& progress)
+{
+	exporter.exportPrimitive(P);
+	delete P;
+
+	if(++progress.done % progress.step == 0)
+		progress.vparams.progress(min(1.0f,progress.done/(float)progress.total),progress.message);
+}
+
+void BSPTree::recursExportPrimitives(Exporter& exporter,VRenderParams& vparams,size_t nb_primitives)
+{
+	ExportProgress progress(vparams,nb_primitives);
+
+	if(_root != nullptr) _root->recursExportPrimitives(exporter,progress);
+
+	for(unsigned int i=0;i<_points.size();++i) exportAndDelete(exporter,_points[i],progress);
+	for(unsigned int j=0;j<_segments.size();++j) exportAndDelete(exporter,_segments[j],progress);
+
+	_points.clear();
+	_segments.clear();
 }
 
 //----------------------------------------------------------------------------//
 
+// The primitives still stored in the node (see BSPTree::clear()) are deleted
+// along with it.
 BSPNode::~BSPNode()
 {
 	delete fils_moins;
 	delete fils_plus;
+
+	for(unsigned int i=0;i<seg_plus.size();++i) delete seg_plus[i];
+	for(unsigned int i=0;i<seg_moins.size();++i) delete seg_moins[i];
+	for(unsigned int i=0;i<pts_plus.size();++i) delete pts_plus[i];
+	for(unsigned int i=0;i<pts_moins.size();++i) delete pts_moins[i];
+
+	delete polygone;
 }
 
 int BSPNode::Classify(Point *P)
@@ -257,8 +374,8 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 
 void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 {
-	static int Signs[100];
-	static double Zvals[100];
+	int Signs[100];
+	double Zvals[100];
 
     moins_ = nullptr;
     plus_ = nullptr;
@@ -436,8 +553,12 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	//  Si les parents ne sont pas degeneres, plus et moins ne le
 	// sont pas non plus.
 
-	plus_  = new Polygone(Ps);
+	//  The first half is owned until the second one is built, so that it does
+	// not leak when the allocation of the second one throws.
+
+	unique_ptr<Polygone> plus_polygone(new Polygone(Ps));
 	moins_ = new Polygone(Ms);
+	plus_ = plus_polygone.release();
 
 	delete  P;
 }
@@ -467,7 +588,7 @@ void BSPNode::insert(Polygone *P)
 	}
 }
 
-void BSPNode::recursFillPrimitiveArray(vector<PtrPrimitive>& primitive_tab) const
+void BSPNode::recursFillPrimitiveArray(vector<PtrPrimitive>& primitive_tab)
 {
   if(fils_plus != nullptr)
     fils_plus->recursFillPrimitiveArray(primitive_tab);
@@ -487,6 +608,74 @@ void BSPNode::recursFillPrimitiveArray(vector<PtrPrimitive>& primitive_tab) cons
     primitive_tab.push_back(seg_moins[i2]);
   for(unsigned int j2=0;j2<pts_moins.size();++j2)
     primitive_tab.push_back(pts_moins[j2]);
+
+  seg_plus.clear();
+  pts_plus.clear();
+  seg_moins.clear();
+  pts_moins.clear();
+  polygone = nullptr;
+}
+
+//  The side of the plane that contains the eye is drawn last. In window
+// coordinates (eye = (0,0,1,0)) this is the same order as
+// recursFillPrimitiveArray(), since c is never negative.
+void BSPNode::fillBackToFrontArray(const double eye[4],vector<PtrPrimitive>& primitive_tab) const
+{
+  const bool plus_is_far = (a*eye[0] + b*eye[1] + c*eye[2] - d*eye[3] >= 0.0);
+
+  const BSPNode *far_node  = plus_is_far ? fils_plus  : fils_moins;
+  const BSPNode *near_node = plus_is_far ? fils_moins : fils_plus;
+  const vector<Segment *>& far_segs  = plus_is_far ? seg_plus  : seg_moins;
+  const vector<Segment *>& near_segs = plus_is_far ? seg_moins : seg_plus;
+  const vector<Point *>& far_pts  = plus_is_far ? pts_plus  : pts_moins;
+  const vector<Point *>& near_pts = plus_is_far ? pts_moins : pts_plus;
+
+  if(far_node != nullptr)
+    far_node->fillBackToFrontArray(eye,primitive_tab);
+
+  for(unsigned int i=0;i<far_segs.size();++i)
+    primitive_tab.push_back(far_segs[i]);
+  for(unsigned int j=0;j<far_pts.size();++j)
+    primitive_tab.push_back(far_pts[j]);
+
+  if(polygone != nullptr)
+    primitive_tab.push_back(polygone);
+
+  if(near_node != nullptr)
+    near_node->fillBackToFrontArray(eye,primitive_tab);
+
+  for(unsigned int i2=0;i2<near_segs.size();++i2)
+    primitive_tab.push_back(near_segs[i2]);
+  for(unsigned int j2=0;j2<near_pts.size();++j2)
+    primitive_tab.push_back(near_pts[j2]);
+}
+
+void BSPNode::recursExportPrimitives(Exporter& exporter,ExportProgress& progress)
+{
+  if(fils_plus != nullptr)
+    fils_plus->recursExportPrimitives(exporter,progress);
+
+  for(unsigned int i=0;i<seg_plus.size();++i)
+    exportAndDelete(exporter,seg_plus[i],progress);
+  for(unsigned int j=0;j<pts_plus.size();++j)
+    exportAndDelete(exporter,pts_plus[j],progress);
+
+  if(polygone != nullptr)
+    exportAndDelete(exporter,polygone,progress);
+
+  if(fils_moins != nullptr)
+    fils_moins->recursExportPrimitives(exporter,progress);
+
+  for(unsigned int i2=0;i2<seg_moins.size();++i2)
+    exportAndDelete(exporter,seg_moins[i2],progress);
+  for(unsigned int j2=0;j2<pts_moins.size();++j2)
+    exportAndDelete(exporter,pts_moins[j2],progress);
+
+  seg_plus.clear();
+  pts_plus.clear();
+  seg_moins.clear();
+  pts_moins.clear();
+  polygone = nullptr;
 }
 
 void BSPNode::insert(Point *P)
@@ -598,3 +787,238 @@ void BSPNode::initEquation(const Polygone *P,double & a, double & b, double & c,
 	c = n[2];
 }
 
+
+//----------------------------------------------------------------------------//
+//  Construction from all the polygons at once (VRenderParams::OptimizeBSPSplits)
+
+// Number of candidate planes tried for each node, and number of polygons
+// classified to estimate the cost of a candidate.
+static const size_t BSP_NB_CANDIDATES = 8;
+static const size_t BSP_NB_TESTED_POLYGONS = 128;
+
+// A split adds a polygon to the output and to both subtrees: it costs more than
+// an imbalance of one polygon between the subtrees.
+static const double BSP_SPLIT_COST = 8.0;
+
+// Smallest subtrees built on another thread (VRenderParams::ParallelBSPConstruction)
+static const size_t BSP_PARALLEL_MIN_POLYGONS = 2000;
+
+struct BSPBuildContext
+{
+	BSPBuildContext(VRenderParams& vp,size_t n)
+		: vparams(vp), caller(this_thread::get_id()), placed(0), reported(0), total(n), step(n/200+1) {}
+
+	//  Counts n more polygons placed in the tree. The progress function is
+	// only called by the thread that started the construction, the other ones
+	// only check whether the export was canceled.
+	void progress(size_t n)
+	{
+		const size_t p = (placed += n);
+
+		if(this_thread::get_id() != caller)
+		{
+			if(vparams.isCanceled())
+				throw VRenderCanceled();
+		}
+		else if(p >= reported + step)
+		{
+			reported = p;
+			vparams.progress(min(1.0f,p/(float)total), QGLViewer::tr("BSP Construction"));
+		}
+	}
+
+	VRenderParams& vparams;
+	thread::id caller;
+	atomic<size_t> placed;
+	size_t reported,total,step;
+};
+
+// Returns 1 or -1 when the polygon is on one side of the plane, and 0 when it
+// would be split. Coplanar polygons are on the negative side, as with
+// BSPNode::Classify().
+static int sideOfPlane(const Polygone *P,double a,double b,double c,double d)
+{
+	int Smin = 1;
+	int Smax = -1;
+
+	for(unsigned int i=0;i<P->nbVertices();i++)
+	{
+		double Z = P->vertex(i).x() * a + P->vertex(i).y() * b + P->vertex(i).z() * c - d;
+		int sign = (Z < -EGALITY_EPS) ? -1 : ((Z > EGALITY_EPS) ? 1 : 0);
+
+		Smin = min(Smin,sign);
+		Smax = max(Smax,sign);
+	}
+
+	if((Smin == -1)&&(Smax == 1))
+		return 0;
+
+	return ((Smin >= 0)&&(Smax == 1)) ? 1 : -1;
+}
+
+//  Returns the index of the polygon whose plane has the lowest cost, among
+// candidates evenly spread in the array. The cost is estimated on a sample of
+// the other polygons.
+size_t BSPNode::choosePlane(const vector<Polygone *>& polygons)
+{
+	const size_t n = polygons.size();
+	const size_t nb_candidates = min(n,BSP_NB_CANDIDATES);
+	const size_t nb_tested = min(n,BSP_NB_TESTED_POLYGONS);
+
+	size_t best = 0;
+	double best_cost = -1.0;
+
+	for(size_t i=0;i<nb_candidates;++i)
+	{
+		const size_t candidate = i*n/nb_candidates;
+
+		double a,b,c,d;
+		initEquation(polygons[candidate],a,b,c,d);
+
+		int nb_plus = 0, nb_moins = 0, nb_split = 0;
+
+		for(size_t j=0;j<nb_tested;++j)
+		{
+			const size_t k = j*n/nb_tested;
+
+			if(k == candidate)
+				continue;
+
+			switch(sideOfPlane(polygons[k],a,b,c,d))
+			{
+				case 1: ++nb_plus; break;
+				case -1: ++nb_moins; break;
+				default: ++nb_split;
+			}
+		}
+
+		const double cost = BSP_SPLIT_COST*nb_split + abs(nb_plus - nb_moins);
+
+		if((best_cost < 0.0)||(cost < best_cost))
+		{
+			best_cost = cost;
+			best = candidate;
+		}
+	}
+
+	return best;
+}
+
+BSPNode *BSPNode::build(vector<Polygone *>& polygons,VRenderParams& vparams,size_t nb_primitives)
+{
+	BSPBuildContext context(vparams,nb_primitives);
+
+	// About one subtree per thread of the qglviewer::TaskScheduler
+	int parallel_depth = 0;
+
+	if(vparams.isEnabled(VRenderParams::ParallelBSPConstruction))
+		for(int n=1;n<qglviewer::TaskScheduler::maxThreadCount();n*=2)
+			++parallel_depth;
+
+	return build(polygons,context,parallel_depth);
+}
+
+//  Deletes the polygons of a build() that throws, and empties the vector.
+static void deletePolygons(vector<Polygone *>& polygons)
+{
+	for(size_t i=0;i<polygons.size();++i)
+		delete polygons[i];
+
+	vector<Polygone *>().swap(polygons);
+}
+
+//  The subtrees are built concurrently, on the qglviewer::TaskScheduler
+// threads, while parallel_depth is positive. The plus subtree allocates its
+// nodes and split polygons in a child of the current arena.
+//
+//  The polygons are owned by the call, and polygons is empty when it returns.
+// When it throws, the polygons not yet stored in a node, including the split
+// halves of plus and moins, are deleted along with the subtrees.
+BSPNode *BSPNode::build(vector<Polygone *>& polygons,BSPBuildContext& context,int parallel_depth)
+{
+	if(polygons.empty())
+		return nullptr;
+
+	BSPNode *node = nullptr;
+	vector<Polygone *> plus, moins;
+
+	try
+	{
+		const size_t plane = choosePlane(polygons);
+		node = new BSPNode(polygons[plane]);
+		polygons[plane] = nullptr;
+
+		// The push_backs below can not throw once the polygon is classified
+		plus.reserve(polygons.size());
+		moins.reserve(polygons.size());
+
+		for(size_t i=0;i<polygons.size();++i)
+			if(i != plane)
+			{
+				Polygone *side_plus = nullptr, *side_moins = nullptr;
+
+				//  Either stores polygons[i] in a side, or deletes it once split.
+				node->Classify(polygons[i],side_moins,side_plus);
+				polygons[i] = nullptr;
+
+				if(side_plus != nullptr) plus.push_back(side_plus);
+				if(side_moins != nullptr) moins.push_back(side_moins);
+			}
+
+		vector<Polygone *>().swap(polygons);
+		context.progress(1);
+
+		if((parallel_depth > 0)&&(plus.size() >= BSP_PARALLEL_MIN_POLYGONS)&&(moins.size() >= BSP_PARALLEL_MIN_POLYGONS))
+		{
+			Arena *arena = (Arena::current() != nullptr) ? Arena::current()->createChild() : nullptr;
+
+			BSPNode *subtrees[2] = { nullptr, nullptr };
+			exception_ptr errors[2];
+
+			// Returns once both subtrees are built, or have thrown
+			qglviewer::TaskScheduler::parallelFor(2,[&](int first,int last)
+			{
+				for(int i=first;i<last;++i)
+					try
+					{
+						if(i == 0)
+							subtrees[0] = build(moins,context,parallel_depth-1);
+						else
+						{
+							Arena::Scope arena_scope(arena);
+							subtrees[1] = build(plus,context,parallel_depth-1);
+						}
+					}
+					catch(...)
+					{
+						errors[i] = current_exception();
+					}
+			});
+
+			if(errors[0] || errors[1])
+			{
+				delete subtrees[0];
+				delete subtrees[1];
+				rethrow_exception(errors[0] ? errors[0] : errors[1]);
+			}
+
+			node->fils_moins = subtrees[0];
+			node->fils_plus = subtrees[1];
+		}
+		else
+		{
+			node->fils_plus = build(plus,context,parallel_depth);
+			node->fils_moins = build(moins,context,parallel_depth);
+		}
+	}
+	catch(...)
+	{
+		deletePolygons(polygons);
+		deletePolygons(plus);
+		deletePolygons(moins);
+		delete node;
+		throw;
+	}
+
+	return node;
+}
@@ -0,0 +1,75 @@
+#ifndef _VRENDER_BSPTREE_H
+#define _VRENDER_BSPTREE_H
+
+//  Binary space partition of the primitives, used by BSPSortMethod. A BSPTree
+// can also be kept across exports of a static scene (see
+// VRenderParams::setBSPTree()): it is then built once from world coordinates
+// primitives, and only traversed for each new point of view. It only holds the
+// primitives that were inside the view frustum of the capture it was built
+// from.
+
+#include <vector>
+#include "Types.h"
+
+namespace vrender
+{
+	class BSPNode ;
+	class Exporter ;
+	class VRenderParams ;
+	class Point ;
+	class Segment ;
+	class Polygone ;
+
+	class BSPTree
+	{
+		public:
+			BSPTree() ;
+			~BSPTree() ;
+
+			//  Returns true when no primitive has been inserted since the
+			// creation of the tree or the last call to clear().
+
+			bool isEmpty() const ;
+
+			// Deletes all the nodes and the primitives they store.
+
+			void clear() ;
+
+			//  Inserts all the primitives of the array, polygons first. The tree
+			// owns the primitives, which may be split or deleted.
+
+			void build(std::vector<PtrPrimitive>&,VRenderParams&) ;
+
+			void insert(Polygone *) ;
+			void insert(Segment *) ;
+			void insert(Point *) ;
+
+			//  Moves the primitives of the tree to the array, in back to front
+			// order for window coordinates primitives. The tree is left empty.
+
+			void recursFillPrimitiveArray(std::vector<PtrPrimitive>&) ;
+
+			//  Same order, primitives are exported then deleted. The progress is
+			// reported to vparams, nb_primitives being the expected number of
+			// primitives.
+
+			void recursExportPrimitives(Exporter&,VRenderParams& vparams,size_t nb_primitives) ;
+
+			//  Appends the primitives of the tree to the array in back to front
+			// order, as seen from eye. eye is the homogeneous position of the
+			// view point, i.e. (0,0,1,0) transformed by the inverse of the
+			// window coordinates matrix. The tree keeps the primitives.
+
+			void fillBackToFrontArray(const double eye[4],std::vector<PtrPrimitive>&) const ;
+
+		private:
+			BSPTree(const BSPTree&) ;
+			BSPTree& operator=(const BSPTree&) ;
+
+			BSPNode *_root ;
+			std::vector<Segment *> _segments ;	// these are for storing segments and points when _root is null
+			std::vector<Point *> _points ;
+	};
+}
+
+#endif
@@ -9,12 +9,18 @@ using namespace vrender ;
 // Over-simplified algorithm to check wether a polygon is front-facing or not.
 // Only works for convex polygons.
 
-void BackFaceCullingOptimizer::optimize(std::vector<PtrPrimitive>& primitives_tab,VRenderParams&)
+void BackFaceCullingOptimizer::optimize(std::vector<PtrPrimitive>& primitives_tab,VRenderParams& vparams)
 {
 	Polygone *P ;
 	int nb_culled = 0 ;
 
+	size_t N = primitives_tab.size()/200 + 1 ;
+
 	for(size_t i=0;i<primitives_tab.size();++i)
+	{
+		if(i%N == 0)
+			vparams.progress(i/(float)primitives_tab.size(), QGLViewer::tr("Back face culling")) ;
+
 		if((P = dynamic_cast<Polygone *>(primitives_tab[i])) != nullptr)
 		{
 						for(unsigned int j=0;j<P->nbVertices();++j)
@@ -26,6 +32,7 @@ void BackFaceCullingOptimizer::optimize(std::vector<PtrPrimitive>& primitives_ta
 					break ;
 				}
 		}
+	}
 
 	// Rule out gaps. This avoids testing for null primitives later.
 
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <math.h>
+#include <queue>
+
+#include "VRender.h"
+#include "Primitive.h"
+#include "PrimitivePositioning.h"
+#include "AxisAlignedBox.h"
+#include "SortMethod.h"
+#include "Vector2.h"
+#include "../taskScheduler.h"
+
+using namespace std ;
+using namespace vrender ;
+
+//  The primitives are first sorted back to front on the depth of their
+// farthest point. This order is only wrong for primitives that overlap both
+// on screen and in depth: these neighbors are found with a uniform grid of
+// the screen, and their exact relative position gives the precedences that
+// reorder them locally.
+
+// Average number of primitives per depth bucket, and per grid cell.
+static const size_t PRIMITIVES_PER_BUCKET = 64 ;
+static const size_t PRIMITIVES_PER_CELL = 4 ;
+static const size_t MAX_GRID_SIZE = 1024 ;
+
+// Tasks (buckets or cells) processed by a thread at once.
+static const size_t TASKS_PER_CHUNK = 16 ;
+
+//  Calls task(i) for all i < nb_tasks, on the qglviewer::TaskScheduler
+// threads. Only the calling thread reports the progress, which is also where a
+// cancellation is noticed. The other threads then stop at their next chunk.
+
+static void runInParallel(size_t nb_tasks,const function<void(size_t)>& task,VRenderParams& vparams,const QString& message)
+{
+	atomic<size_t> next_task(0) ;
+	atomic<size_t> nb_done(0) ;
+	exception_ptr error ;
+	atomic<bool> failed(false) ;
+
+	auto worker = [&](bool report_progress)
+	{
+		try
+		{
+			for(size_t first;(first = next_task.fetch_add(TASKS_PER_CHUNK)) < nb_tasks && !failed && !vparams.isCanceled();)
+			{
+				for(size_t t=first;t<min(first+TASKS_PER_CHUNK,nb_tasks);++t)
+					task(t) ;
+
+				size_t done = nb_done.fetch_add(TASKS_PER_CHUNK) + TASKS_PER_CHUNK ;
+
+				if(report_progress)
+					vparams.progress(min(done,nb_tasks)/(float)nb_tasks, message) ;
+			}
+		}
+		catch(...)
+		{
+			if(!failed.exchange(true))
+				error = current_exception() ;
+		}
+	};
+
+	size_t nb_threads = qglviewer::TaskScheduler::maxThreadCount() ;
+	nb_threads = min(nb_threads,(nb_tasks+TASKS_PER_CHUNK-1)/TASKS_PER_CHUNK) ;
+
+	//  The first worker, which reports the progress, is run by this thread.
+	qglviewer::TaskScheduler::parallelFor(int(nb_threads),[&](int first,int last)
+	{
+		for(int t=first;t<last;++t)
+			worker(t == 0) ;
+	}) ;
+
+	if(failed)
+		rethrow_exception(error) ;
+
+	// Throws if the tasks were left unfinished by a cancellation
+	vparams.progress(1.0, message) ;
+}
+
+void DepthBucketSortMethod::sortPrimitives(vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
+{
+	const size_t n = primitive_tab.size() ;
+
+	if(n < 2)
+		return ;
+
+	vector<AxisAlignedBox_xyz> bboxes(n) ;
+	double zmin = primitive_tab[0]->bbox().maxi().z() ;
+	double zmax = zmin ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		bboxes[i] = primitive_tab[i]->bbox() ;
+		zmin = min(zmin,bboxes[i].maxi().z()) ;
+		zmax = max(zmax,bboxes[i].maxi().z()) ;
+	}
+
+	// 1 - depth sort. The primitives are distributed in buckets of farthest
+	// depth, which are then sorted independently. Ties are broken by the
+	// nearest depth and then by the drawing order, so that the result does
+	// not depend on the number of threads.
+
+	const size_t nb_buckets = n/PRIMITIVES_PER_BUCKET + 1 ;
+	const double scale = (zmax > zmin) ? (nb_buckets - 1e-3)/(zmax - zmin) : 0.0 ;
+
+	vector<size_t> bucket_start(nb_buckets+1,0) ;
+	vector<size_t> bucket_of(n) ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		//  Larger depths are farther, and go in the first buckets.
+		bucket_of[i] = min(nb_buckets-1,(size_t)((zmax - bboxes[i].maxi().z())*scale)) ;
+		++bucket_start[bucket_of[i]+1] ;
+	}
+
+	for(size_t b=0;b<nb_buckets;++b)
+		bucket_start[b+1] += bucket_start[b] ;
+
+	vector<size_t> order(n) ;
+	{
+		vector<size_t> next(bucket_start.begin(),bucket_start.end()-1) ;
+		for(size_t i=0;i<n;++i)
+			order[next[bucket_of[i]]++] = i ;
+	}
+
+	auto farther = [&bboxes](size_t a,size_t b)
+	{
+		if(bboxes[a].maxi().z() != bboxes[b].maxi().z()) return bboxes[a].maxi().z() > bboxes[b].maxi().z() ;
+		if(bboxes[a].mini().z() != bboxes[b].mini().z()) return bboxes[a].mini().z() > bboxes[b].mini().z() ;
+		return a < b ;
+	};
+
+	runInParallel(nb_buckets,[&](size_t b)
+	{
+		sort(order.begin()+bucket_start[b],order.begin()+bucket_start[b+1],farther) ;
+	},vparams,QGLViewer::tr("Depth sort")) ;
+
+	// 2 - screen grid. Each primitive is listed, in depth order, in the cells
+	// its bounding box covers.
+
+	AxisAlignedBox_xy BBox ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		BBox.include(Vector2(bboxes[i].mini().x(),bboxes[i].mini().y())) ;
+		BBox.include(Vector2(bboxes[i].maxi().x(),bboxes[i].maxi().y())) ;
+	}
+
+	const size_t grid_size = max((size_t)1,min(MAX_GRID_SIZE,(size_t)sqrt(n/(double)PRIMITIVES_PER_CELL))) ;
+	const double x0 = BBox.mini().x() ;
+	const double y0 = BBox.mini().y() ;
+	const double sx = (BBox.maxi().x() > x0) ? (grid_size - 1e-3)/(BBox.maxi().x() - x0) : 0.0 ;
+	const double sy = (BBox.maxi().y() > y0) ? (grid_size - 1e-3)/(BBox.maxi().y() - y0) : 0.0 ;
+
+	auto cellX = [&](double x) { return min(grid_size-1,(size_t)max(0.0,(x - x0)*sx)) ; } ;
+	auto cellY = [&](double y) { return min(grid_size-1,(size_t)max(0.0,(y - y0)*sy)) ; } ;
+
+	vector< vector<size_t> > cells(grid_size*grid_size) ;
+
+	for(size_t p=0;p<n;++p)
+	{
+		const AxisAlignedBox_xyz& B = bboxes[order[p]] ;
+
+		for(size_t cy=cellY(B.mini().y());cy<=cellY(B.maxi().y());++cy)
+			for(size_t cx=cellX(B.mini().x());cx<=cellX(B.maxi().x());++cx)
+				cells[cy*grid_size+cx].push_back(p) ;
+	}
+
+	// 3 - precedences between the neighbors of each cell, which are checked in
+	// parallel. A pair is only checked in the cell that contains the lower
+	// corner of the intersection of its bounding boxes. Along a cell list,
+	// farthest depths decrease: the primitives that overlap the depth range of
+	// the current one follow it.
+
+	vector< vector< pair<size_t,size_t> > > cell_edges(cells.size()) ;
+
+	runInParallel(cells.size(),[&](size_t c)
+	{
+		const vector<size_t>& cell = cells[c] ;
+
+		for(size_t i=0;i<cell.size();++i)
+		{
+			const AxisAlignedBox_xyz& Bi = bboxes[order[cell[i]]] ;
+
+			for(size_t j=i+1;j<cell.size() && bboxes[order[cell[j]]].maxi().z() > Bi.mini().z();++j)
+			{
+				const AxisAlignedBox_xyz& Bj = bboxes[order[cell[j]]] ;
+
+				size_t cx = cellX(max(Bi.mini().x(),Bj.mini().x())) ;
+				size_t cy = cellY(max(Bi.mini().y(),Bj.mini().y())) ;
+
+				if(cy*grid_size+cx != c)
+					continue ;
+
+				// Position of j as regard to i. Intersecting primitives are left
+				// in depth order.
+
+				int prp = PrimitivePositioning::computeRelativePosition(primitive_tab[order[cell[i]]],primitive_tab[order[cell[j]]]) ;
+
+				if(prp == PrimitivePositioning::Upper) cell_edges[c].push_back(make_pair(cell[i],cell[j])) ;
+				if(prp == PrimitivePositioning::Lower) cell_edges[c].push_back(make_pair(cell[j],cell[i])) ;
+			}
+		}
+	},vparams,QGLViewer::tr("Local fixups")) ;
+
+	cells.clear() ;
+
+	// 4 - local reordering: among the primitives whose predecessors are all
+	// rendered, the first one in depth order is rendered next. Cycles are
+	// broken by rendering the first remaining primitive.
+
+	vector< vector<size_t> > successors(n) ;
+	vector<size_t> nb_predecessors(n,0) ;
+	size_t nb_fixups = 0 ;
+
+	for(size_t c=0;c<cell_edges.size();++c)
+		for(size_t e=0;e<cell_edges[c].size();++e)
+		{
+			successors[cell_edges[c][e].first].push_back(cell_edges[c][e].second) ;
+			++nb_predecessors[cell_edges[c][e].second] ;
+
+			if(cell_edges[c][e].first > cell_edges[c][e].second)
+				++nb_fixups ;
+		}
+
+	cell_edges.clear() ;
+
+	vector<PtrPrimitive> new_pr_tab ;
+	new_pr_tab.reserve(n) ;
+
+	if(nb_fixups == 0)
+	{
+		for(size_t p=0;p<n;++p)
+			new_pr_tab.push_back(primitive_tab[order[p]]) ;
+	}
+	else
+	{
+		priority_queue< size_t,vector<size_t>,greater<size_t> > ready ;
+		vector<bool> rendered(n,false) ;
+		size_t first_remaining = 0 ;
+		size_t nb_cycles = 0 ;
+
+		for(size_t p=0;p<n;++p)
+			if(nb_predecessors[p] == 0)
+				ready.push(p) ;
+
+		while(new_pr_tab.size() < n)
+		{
+			size_t p ;
+
+			if(!ready.empty())
+			{
+				p = ready.top() ;
+				ready.pop() ;
+
+				if(rendered[p])
+					continue ;
+			}
+			else
+			{
+				while(rendered[first_remaining])
+					++first_remaining ;
+
+				p = first_remaining ;
+				++nb_cycles ;
+			}
+
+			rendered[p] = true ;
+			new_pr_tab.push_back(primitive_tab[order[p]]) ;
+
+			for(size_t k=0;k<successors[p].size();++k)
+				if(--nb_predecessors[successors[p][k]] == 0)
+					ready.push(successors[p][k]) ;
+		}
+#ifdef DEBUG_DBS
+		cout << "Depth bucket sort: " << nb_fixups << " fixups, " << nb_cycles << " cycles broken." << endl ;
+#endif
+	}
+
+	primitive_tab.swap(new_pr_tab) ;
+}
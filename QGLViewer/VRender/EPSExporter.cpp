@@ -1,18 +1,20 @@
 #include <stdio.h>
+#include <string.h>
 #include "Primitive.h"
 #include "Exporter.h"
 #include "math.h"
 
+#include <QByteArray>
+#include <QImage>
+
+#include <algorithm>
+
 using namespace vrender ;
 using namespace std ;
 
 const double EPSExporter::EPS_GOURAUD_THRESHOLD = 0.05 ;
 const char *EPSExporter::CREATOR = "VRender library - (c) Cyril Soler 2005" ;
 
-float EPSExporter::last_r = -1.0 ;
-float EPSExporter::last_g = -1.0 ;
-float EPSExporter::last_b = -1.0 ;
-
 EPSExporter::EPSExporter()
 {
 	last_r = -1 ;
@@ -20,7 +22,31 @@ EPSExporter::EPSExporter()
 	last_b = -1 ;
 }
 
-void EPSExporter::writeHeader(QTextStream& out) const
+Exporter *EPSExporter::createChunkExporter() const
+{
+	return new EPSExporter(*this) ;
+}
+
+Exporter *PSExporter::createChunkExporter() const
+{
+	return new PSExporter(*this) ;
+}
+
+//  Every primitive with vertices sets the color, or resets it to unknown: the
+// state only depends on the last one, which is formatted without output.
+
+void EPSExporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t first,size_t last)
+{
+	for(size_t i=last;i>first;--i)
+		if(primitive_tab[i-1] != nullptr && primitive_tab[i-1]->nbVertices() > 0)
+		{
+			OutputBuffer discarded(nullptr) ;
+			spewPrimitive(primitive_tab[i-1],discarded) ;
+			return ;
+		}
+}
+
+void EPSExporter::writeHeader(OutputBuffer& out) const
 {
 	/* Emit EPS header. */
 
@@ -29,6 +55,11 @@ void EPSExporter::writeHeader(QTextStream& out) const
 	out << "%%%%HiResBoundingBox: " << _xmin << " " << _ymin << " " << _xmax << " " << _ymax << "\n";
 
 	out << "%%%%Creator: " << CREATOR << " (using OpenGL feedback)\n";
+
+	// The images use the FlateDecode filter
+	if(_spewsImages)
+		out << "%%LanguageLevel: 3\n";
+
 	out << "%%EndComments\n\ngsave\n\n";
 
 	out << "%\n";
@@ -60,7 +91,7 @@ void EPSExporter::writeHeader(QTextStream& out) const
 	}
 }
 
-void EPSExporter::writeFooter(QTextStream& out) const
+void EPSExporter::writeFooter(OutputBuffer& out) const
 {
 	out << "grestore\n\n";
 
@@ -68,7 +99,7 @@ void EPSExporter::writeFooter(QTextStream& out) const
 	out << "% showpage\n";
 }
 
-void PSExporter::writeFooter(QTextStream& out) const
+void PSExporter::writeFooter(OutputBuffer& out) const
 {
 	out << "showpage\n";
 }
@@ -105,7 +136,7 @@ const char *EPSExporter::GOURAUD_TRIANGLE_EPS[] =
 	nullptr
 };
 
-void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
+void EPSExporter::spewPolygone(const Polygone *P, OutputBuffer& out)
 {
 	int nvertices;
 	GLfloat red, green, blue;
@@ -167,7 +198,7 @@ void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
 	}
 }
 
-void EPSExporter::spewSegment(const Segment *S, QTextStream& out)
+void EPSExporter::spewSegment(const Segment *S, OutputBuffer& out)
 {
   GLdouble dx, dy;
   GLfloat dr, dg, db, absR, absG, absB, colormax;
@@ -249,7 +280,7 @@ void EPSExporter::spewSegment(const Segment *S, QTextStream& out)
   out << P2.x() << " " << P2.y() << " lineto stroke\n";
 }
 
-void EPSExporter::spewPoint(const Point *P, QTextStream& out)
+void EPSExporter::spewPoint(const Point *P, OutputBuffer& out)
 {
 	const Feedback3DColor& p = Feedback3DColor(P->sommet3DColor(0)) ;
 
@@ -261,7 +292,7 @@ void EPSExporter::spewPoint(const Point *P, QTextStream& out)
 	out << p.x() << " " << p.y() << " " << (_pointSize / 2.0) << " 0 360 arc fill\n\n";
 }
 
-void EPSExporter::setColor(QTextStream& out, float red, float green, float blue)
+void EPSExporter::setColor(OutputBuffer& out, float red, float green, float blue)
 {
 	if(last_r != red || last_g != green || last_b != blue)
 		out << red << " " << green << " " << blue << " setrgbcolor\n";
@@ -271,3 +302,79 @@ void EPSExporter::setColor(QTextStream& out, float red, float green, float blue)
 	last_b = blue ;
 }
 
+
+//  ASCII85 encoding of data, 5 characters for each 4 bytes, in lines of at
+// most 75 characters.
+
+static void writeASCII85(const QByteArray& data,OutputBuffer& out)
+{
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.constData()) ;
+	const int size = data.size() ;
+	int column = 0 ;
+
+	for(int i=0;i<size;i+=4)
+	{
+		const int n = min(4,size-i) ;
+		unsigned long word = 0 ;
+
+		for(int k=0;k<4;++k)
+			word = (word << 8) | ((k < n)?bytes[i+k]:0) ;
+
+		char group[5] ;
+		int length = n+1 ;
+
+		if(word == 0 && n == 4)
+		{
+			group[0] = 'z' ;
+			length = 1 ;
+		}
+		else
+			for(int k=4;k>=0;--k)
+			{
+				group[k] = char('!' + word%85) ;
+				word /= 85 ;
+			}
+
+		if(column + length > 75)
+		{
+			out << '\n' ;
+			column = 0 ;
+		}
+
+		out.write(group,length) ;
+		column += length ;
+	}
+
+	out << "~>\n" ;
+}
+
+//  The image is compressed with FlateDecode, which needs PostScript level 3.
+
+void EPSExporter::spewImage(const QImage& image,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out)
+{
+	const int width = image.width() ;
+	const int height = image.height() ;
+
+	// Rows without their padding
+	QByteArray rows(3*width*height,'\0') ;
+
+	for(int y=0;y<height;++y)
+		memcpy(rows.data()+3*width*y,image.constScanLine(y),3*width) ;
+
+	// qCompress() output is a 4 bytes length followed by a zlib stream.
+
+	QByteArray data = qCompress(rows) ;
+	data.remove(0,4) ;
+
+	out << "gsave\n" ;
+	out << xmin << " " << ymin << " translate " << (xmax-xmin) << " " << (ymax-ymin) << " scale\n" ;
+	out << "/DeviceRGB setcolorspace\n" ;
+	out << "<< /ImageType 1 /Width " << width << " /Height " << height << " /BitsPerComponent 8\n" ;
+	out << "   /Decode [0 1 0 1 0 1] /ImageMatrix [" << width << " 0 0 " << (-height) << " 0 " << height << "]\n" ;
+	out << "   /DataSource currentfile /ASCII85Decode filter /FlateDecode filter\n" ;
+	out << ">> image\n" ;
+
+	writeASCII85(data,out) ;
+
+	out << "grestore\n" ;
+}
@@ -1,53 +1,468 @@
 #include "VRender.h"
 #include "Exporter.h"
+#include "HybridRasterizer.h"
 #include "../qglviewer.h"
+#include "../taskScheduler.h"
 
+#include <QBuffer>
 #include <QFile>
-#include <QMessageBox>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
 
 using namespace vrender ;
 using namespace std ;
 
+//////////////////////////////////////////////////////////////////////////////
+//                              OutputBuffer                                //
+//////////////////////////////////////////////////////////////////////////////
+
+OutputBuffer::OutputBuffer(QIODevice *device)
+	: _device(device), _size(0), _position(0)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+	flush() ;
+}
+
+void OutputBuffer::flush()
+{
+	if(_size > 0 && _device != nullptr)
+		_device->write(_buffer,_size) ;
+	_size = 0 ;
+}
+
+void OutputBuffer::write(const char *data,size_t size)
+{
+	_position += size ;
+
+	if(_size + size > BUFFER_SIZE)
+	{
+		flush() ;
+
+		if(size > BUFFER_SIZE)
+		{
+			if(_device != nullptr)
+				_device->write(data,size) ;
+			return ;
+		}
+	}
+
+	memcpy(_buffer+_size,data,size) ;
+	_size += size ;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const char *s)
+{
+	write(s,strlen(s)) ;
+	return *this ;
+}
+
+OutputBuffer& OutputBuffer::operator<<(char c)
+{
+	write(&c,1) ;
+	return *this ;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const QString& s)
+{
+	const QByteArray data = s.toUtf8() ;
+	write(data.constData(),data.size()) ;
+	return *this ;
+}
+
+// Writes the digits of n backwards, ending at end. Returns the first digit.
+static char *writeDigits(unsigned long long n,char *end,int min_digits = 1)
+{
+	char *p = end ;
+	do
+	{
+		*--p = char('0' + n%10) ;
+		n /= 10 ;
+	}
+	while(n > 0 || end - p < min_digits) ;
+
+	return p ;
+}
+
+OutputBuffer& OutputBuffer::operator<<(int i)
+{
+	char buf[16] ;
+	char *end = buf + sizeof(buf) ;
+	char *p = writeDigits(i < 0 ? 0ULL-(unsigned long long)i : (unsigned long long)i,end) ;
+	if(i < 0)
+		*--p = '-' ;
+
+	write(p,end-p) ;
+	return *this ;
+}
+
+OutputBuffer& OutputBuffer::operator<<(double v)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 } ;
+	static const double thresholds[] = { 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5 } ;
+
+	char buf[32] ;
+	const double a = fabs(v) ;
+
+	//  Same output as printf("%g"). Exotic values (very small or big, NaN) and
+	// the values close to a rounding tie use printf.
+
+	if(!(a >= 1e-4 && a < 1e6))
+	{
+		if(v == 0.0)
+			return *this << (signbit(v) ? "-0" : "0") ;
+
+		const int size = snprintf(buf,sizeof(buf),"%g",v) ;
+		write(buf,size) ;
+		return *this ;
+	}
+
+	// 6 significant digits: exponent e such that 10^e <= a < 10^(e+1)
+
+	int e = 5 ;
+	while(a < thresholds[e + 4])
+		--e ;
+
+	int decimals = 5 - e ;
+	const double x = a * powers[decimals] ;
+	unsigned long long scaled = (unsigned long long)x ;
+	const double remainder = x - double(scaled) ;
+
+	//  x is a rounded product, a few units in the last place away from the
+	// exact decimal value. This only changes the rounding when the remainder is
+	// that close to one half: printf, which rounds the exact value, decides.
+
+	if(fabs(remainder - 0.5) < 1e-6)
+	{
+		const int size = snprintf(buf,sizeof(buf),"%g",v) ;
+		write(buf,size) ;
+		return *this ;
+	}
+
+	if(remainder > 0.5)
+		++scaled ;
+
+	if(scaled >= 1000000ULL)	// Rounded up to the next power of ten
+	{
+		if(decimals == 0)
+		{
+			const int size = snprintf(buf,sizeof(buf),"%g",v) ;
+			write(buf,size) ;
+			return *this ;
+		}
+		--decimals ;
+		scaled /= 10 ;
+	}
+
+	const unsigned long long unit = (unsigned long long)powers[decimals] ;
+	unsigned long long fraction = scaled % unit ;
+
+	char *end = buf + sizeof(buf) ;
+	char *p = end ;
+
+	if(fraction > 0)
+	{
+		// Trailing zeros are not written
+		int digits = decimals ;
+		while(fraction % 10 == 0)
+		{
+			fraction /= 10 ;
+			--digits ;
+		}
+		p = writeDigits(fraction,p,digits) ;
+		*--p = '.' ;
+	}
+
+	p = writeDigits(scaled / unit,p) ;
+	if(v < 0.0)
+		*--p = '-' ;
+
+	write(p,end-p) ;
+	return *this ;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//                                Exporter                                  //
+//////////////////////////////////////////////////////////////////////////////
+
 Exporter::Exporter()
+	: _spewsImages(false), _file(nullptr), _out(nullptr)
 {
 	_xmin=_xmax=_ymin=_ymax=_zmin=_zmax = 0.0 ;
 	_pointSize=1 ;
+	_lineWidth=1 ;
 }
 
+Exporter::Exporter(const Exporter& e)
+	: _clearR(e._clearR), _clearG(e._clearG), _clearB(e._clearB),
+	  _pointSize(e._pointSize), _lineWidth(e._lineWidth),
+	  _xmin(e._xmin), _xmax(e._xmax), _ymin(e._ymin), _ymax(e._ymax), _zmin(e._zmin), _zmax(e._zmax),
+	  _clearBG(e._clearBG), _blackAndWhite(e._blackAndWhite),
+	  _spewsImages(e._spewsImages), _file(nullptr), _out(nullptr)
+{
+}
+
+Exporter::~Exporter()
+{
+	// An unfinished streaming export: no footer, writeFooter() is virtual.
+	delete _out ;
+	delete _file ;
+}
+
+// Primitives formatted by a worker thread at once, in a single buffer
+static const size_t EXPORT_CHUNK_SIZE = 4096 ;
+
 void Exporter::exportToFile(const QString& filename,
 							const vector<PtrPrimitive>& primitive_tab,
 							VRenderParams& vparams)
 {
-	QFile file(filename);
+	_spewsImages = vparams.isEnabled(VRenderParams::RasterizeDenseRegions) && canSpewImages() ;
+
+	beginExport(filename) ;
+
+	const QString message = QGLViewer::tr("Exporting to file %1").arg(filename) ;
 
-	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-		QMessageBox::warning(nullptr, QGLViewer::tr("Exporter error", "Message box window title"), QGLViewer::tr("Unable to open file %1.").arg(filename));
-		return;
+	if(_spewsImages)
+	{
+		exportHybrid(primitive_tab,vparams,message) ;
+		endExport() ;
+		return ;
 	}
 
-	QTextStream out(&file);
+	const size_t nb_threads = qglviewer::TaskScheduler::maxThreadCount() ;
+
+	// Copied after the header, which may initialize the formatting state
+	unique_ptr<Exporter> state ;
 
-	writeHeader(out) ;
+	if(nb_threads > 1 && primitive_tab.size() >= 2*EXPORT_CHUNK_SIZE)
+		state.reset(createChunkExporter()) ;
 
+	if(state != nullptr)
+		exportInChunks(primitive_tab,*state,vparams,message,nb_threads) ;
+	else
+	{
 		unsigned int N = primitive_tab.size()/200 + 1 ;
 
-	for(unsigned int i=0;i<primitive_tab.size();++i)
+		for(unsigned int i=0;i<primitive_tab.size();++i)
+		{
+			exportPrimitive(primitive_tab[i]) ;
+
+			if(i%N == 0)
+				vparams.progress(i/(float)primitive_tab.size(),message) ;
+		}
+	}
+
+	endExport() ;
+}
+
+//  Chunks are formatted by the qglviewer::TaskScheduler threads in their own
+// buffers, which are written in order. state is advanced over the chunks, so
+// that each one starts with the formatting state of a sequential export, and
+// the file is the same.
+
+void Exporter::exportInChunks(const vector<PtrPrimitive>& primitive_tab,Exporter& state,VRenderParams& vparams,const QString& message,size_t nb_threads)
+{
+	//  Batches of twice as many chunks as threads keep the workers busy, and
+	// bound the memory used by their buffers.
+
+	const size_t batch_size = 2*nb_threads*EXPORT_CHUNK_SIZE ;
+	size_t nb_written = 0 ;
+
+	for(size_t batch_first=0;batch_first<primitive_tab.size();batch_first+=batch_size)
+	{
+		const size_t batch_last = min(batch_first+batch_size,primitive_tab.size()) ;
+		const int nb_chunks = int((batch_last-batch_first+EXPORT_CHUNK_SIZE-1)/EXPORT_CHUNK_SIZE) ;
+
+		vector< unique_ptr<Exporter> > chunks(nb_chunks) ;
+		vector<QByteArray> data(nb_chunks) ;
+
+		for(int c=0;c<nb_chunks;++c)
+		{
+			const size_t first = batch_first + c*EXPORT_CHUNK_SIZE ;
+
+			chunks[c].reset(state.createChunkExporter()) ;
+			state.skipPrimitives(primitive_tab,first,min(first+EXPORT_CHUNK_SIZE,batch_last)) ;
+		}
+
+		exception_ptr error ;
+		atomic<bool> failed(false) ;
+
+		qglviewer::TaskScheduler::parallelFor(nb_chunks,[&](int first_chunk,int last_chunk)
+		{
+			try
+			{
+				for(int c=first_chunk;c<last_chunk;++c)
+				{
+					const size_t first = batch_first + c*EXPORT_CHUNK_SIZE ;
+					const size_t last = min(first+EXPORT_CHUNK_SIZE,batch_last) ;
+
+					QBuffer device(&data[c]) ;
+					device.open(QIODevice::WriteOnly) ;
+					{
+						OutputBuffer out(&device) ;
+
+						for(size_t i=first;i<last;++i)
+							chunks[c]->spewPrimitive(primitive_tab[i],out) ;
+					}
+					device.close() ;
+				}
+			}
+			catch(...)
+			{
+				if(!failed.exchange(true))
+					error = current_exception() ;
+			}
+		}) ;
+
+		if(failed)
+			rethrow_exception(error) ;
+
+		for(int c=0;c<nb_chunks;++c)
+		{
+			_out->write(data[c].constData(),data[c].size()) ;
+
+			nb_written = min(nb_written+EXPORT_CHUNK_SIZE,primitive_tab.size()) ;
+			vparams.progress(nb_written/(float)primitive_tab.size(),message) ;
+		}
+	}
+}
+
+//  The images of the dense regions are written between the vectorial
+// primitives, at the positions found by the HybridRasterizer.
+
+void Exporter::exportHybrid(const vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams,const QString& message)
+{
+	HybridRasterizer rasterizer(_xmin,_ymin,_xmax,_ymax) ;
+
+	rasterizer.setThreshold(vparams.rasterizationThreshold()) ;
+	rasterizer.setResolution(vparams.rasterResolution()) ;
+	rasterizer.setPointSize(_pointSize) ;
+	rasterizer.setLineWidth(_lineWidth) ;
+	rasterizer.setBlackAndWhite(_blackAndWhite) ;
+
+	if(_clearBG)
+		rasterizer.setBackgroundColor(_clearR,_clearG,_clearB) ;
+
+	rasterizer.rasterize(primitive_tab,vparams) ;
+
+	const vector<HybridRasterizer::Image>& images = rasterizer.images() ;
+	unsigned int N = primitive_tab.size()/200 + 1 ;
+	size_t next = 0 ;
+
+	for(size_t i=0;i<=primitive_tab.size();++i)
 	{
-		Point *p = dynamic_cast<Point *>(primitive_tab[i]) ;
-		Segment *s = dynamic_cast<Segment *>(primitive_tab[i]) ;
-		Polygone *P = dynamic_cast<Polygone *>(primitive_tab[i]) ;
+		for(;next < images.size() && images[next].before == i;++next)
+			spewImage(images[next].image,images[next].xmin,images[next].ymin,images[next].xmax,images[next].ymax,*_out) ;
+
+		if(i == primitive_tab.size())
+			break ;
 
-		if(p != nullptr) spewPoint(p,out) ;
-		if(s != nullptr) spewSegment(s,out) ;
-		if(P != nullptr) spewPolygone(P,out) ;
+		if(!rasterizer.isRasterized(i))
+			exportPrimitive(primitive_tab[i]) ;
 
 		if(i%N == 0)
-			vparams.progress(i/(float)primitive_tab.size(),QGLViewer::tr("Exporting to file %1").arg(filename)) ;
+			vparams.progress(i/(float)primitive_tab.size(),message) ;
 	}
+}
+
+//  Exports may run in a worker thread, where no message box can be shown: the
+// error is thrown, and reported by the caller of VectorialRender() or by the
+// future of VRenderBatch::addJob().
+
+void Exporter::beginExport(const QString& filename)
+{
+	endExport() ;
+
+	_file = new QFile(filename) ;
+
+	if (!_file->open(openMode())) {
+		delete _file ;
+		_file = nullptr ;
+		throw std::runtime_error(QGLViewer::tr("Unable to open file %1.").arg(filename).toStdString()) ;
+	}
+
+	_out = new OutputBuffer(_file) ;
+
+	writeHeader(*_out) ;
+}
+
+QIODevice::OpenMode Exporter::openMode() const
+{
+	return QIODevice::WriteOnly | QIODevice::Text ;
+}
+
+void Exporter::exportPrimitive(const Primitive *primitive)
+{
+	if(_out == nullptr)
+		return ;
+
+	spewPrimitive(primitive,*_out) ;
+}
+
+void Exporter::spewPrimitive(const Primitive *primitive,OutputBuffer& out)
+{
+	const Point *p = dynamic_cast<const Point *>(primitive) ;
+	const Segment *s = dynamic_cast<const Segment *>(primitive) ;
+	const Polygone *P = dynamic_cast<const Polygone *>(primitive) ;
+
+	if(p != nullptr) spewPoint(p,out) ;
+	if(s != nullptr) spewSegment(s,out) ;
+	if(P != nullptr) spewPolygone(P,out) ;
+}
+
+bool Exporter::canSpewImages() const
+{
+	return false ;
+}
+
+void Exporter::spewImage(const QImage&,float,float,float,float,OutputBuffer&)
+{
+}
+
+QString Exporter::fileName() const
+{
+	return (_file != nullptr)?_file->fileName():QString() ;
+}
+
+Exporter *Exporter::createChunkExporter() const
+{
+	return nullptr ;
+}
+
+//  Spews the primitives without output. Exporters that support the parallel
+// export should do better.
+
+void Exporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t first,size_t last)
+{
+	OutputBuffer discarded(nullptr) ;
+
+	for(size_t i=first;i<last;++i)
+		spewPrimitive(primitive_tab[i],discarded) ;
+}
+
+void Exporter::endExport()
+{
+	if(_out == nullptr)
+		return ;
+
+	writeFooter(*_out) ;
 
-	writeFooter(out) ;
+	delete _out ;
+	_out = nullptr ;
 
-	file.close();
+	_file->close();
+	delete _file ;
+	_file = nullptr ;
 }
 
 void Exporter::setBoundingBox(float xmin,float ymin,float xmax,float ymax)
@@ -1,37 +1,118 @@
 #ifndef _VRENDER_EXPORTER_H
 #define _VRENDER_EXPORTER_H
 
-// Set of classes for exporting in various formats, like EPS, XFig3.2, SVG.
+// Set of classes for exporting in various formats, like EPS, XFig3.2, PDF.
 
 #include "Primitive.h"
 
 #include "../config.h"
-#include <QTextStream>
+#include <QIODevice>
 #include <QString>
 
+class QBuffer ;
+class QFile ;
+class QImage ;
+
 namespace vrender
 {
+	//  Buffered text output used by the exporters. Numbers are formatted by hand
+	// (same output as QTextStream: 6 significant digits), which is much faster
+	// than going through QTextStream for every coordinate.
+
+	class OutputBuffer
+	{
+		public:
+			// A null device discards the output.
+			OutputBuffer(QIODevice *device) ;
+			~OutputBuffer() ;
+
+			OutputBuffer& operator<<(const char *) ;
+			OutputBuffer& operator<<(char) ;
+			OutputBuffer& operator<<(int) ;
+			OutputBuffer& operator<<(double) ;
+			OutputBuffer& operator<<(const QString&) ;
+
+			// Raw output, for binary data.
+
+			void write(const char *,size_t) ;
+			void flush() ;
+
+			// Number of bytes written since the creation of the buffer.
+
+			size_t position() const { return _position ; }
+
+		private:
+			OutputBuffer(const OutputBuffer&) ;
+			OutputBuffer& operator=(const OutputBuffer&) ;
+
+			static const size_t BUFFER_SIZE = 1 << 16 ;
+
+			QIODevice *_device ;
+			char _buffer[BUFFER_SIZE] ;
+			size_t _size ;
+			size_t _position ;
+	};
+
 	class VRenderParams ;
 	class Exporter
 	{
 		public:
 			Exporter() ;
-			virtual ~Exporter() {};
+			virtual ~Exporter() ;
 
 			virtual void exportToFile(const QString& filename,const std::vector<PtrPrimitive>&,VRenderParams&) ;
 
+			//  Streaming export: primitives are written one by one, in back to front
+			// order, as soon as the sort method emits them. beginExport() throws
+			// a std::runtime_error when the file cannot be opened.
+
+			void beginExport(const QString& filename) ;
+			void exportPrimitive(const Primitive *) ;
+			void endExport() ;
+
 			void setBoundingBox(float xmin,float ymin,float xmax,float ymax) ;
 			void setClearColor(float r,float g,float b) ;
 			void setClearBackground(bool b) ;
 			void setBlackAndWhite(bool b) ;
 
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) = 0 ;
-			virtual void spewSegment(const Segment *, QTextStream& out) = 0 ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) = 0 ;
+			// Copies the settings and the formatting state, but not the file.
+			Exporter(const Exporter&) ;
+
+			virtual void spewPoint(const Point *, OutputBuffer& out) = 0 ;
+			virtual void spewSegment(const Segment *, OutputBuffer& out) = 0 ;
+			virtual void spewPolygone(const Polygone *, OutputBuffer& out) = 0 ;
+
+			void spewPrimitive(const Primitive *, OutputBuffer& out) ;
+
+			virtual void writeHeader(OutputBuffer& out) const = 0 ;
+			virtual void writeFooter(OutputBuffer& out) const = 0 ;
+
+			// Mode used to open the file. Text by default.
 
-			virtual void writeHeader(QTextStream& out) const = 0 ;
-			virtual void writeFooter(QTextStream& out) const = 0 ;
+			virtual QIODevice::OpenMode openMode() const ;
+
+			//  Images of the dense regions, see VRenderParams::RasterizeDenseRegions.
+			// Exporters that support them return true and write the RGB888 image
+			// at the given corners, in the coordinates of the primitives.
+
+			virtual bool canSpewImages() const ;
+			virtual void spewImage(const QImage&,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out) ;
+
+			// Name of the file being exported.
+
+			QString fileName() const ;
+
+			//  Parallel export. Exporters that support it return a copy of
+			// themselves, which exportToFile() uses to format a chunk of
+			// consecutive primitives in a worker thread. The state an exporter
+			// keeps between two primitives (current color, depth...) is advanced
+			// over the previous chunks by skipPrimitives(), which must give the
+			// same state as spewing them, without the formatting cost. Returns
+			// nullptr by default: primitives are then formatted sequentially.
+
+			virtual Exporter *createChunkExporter() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t first,size_t last) ;
 
 			float _clearR,_clearG,_clearB ;
 			float _pointSize ;
@@ -40,6 +121,18 @@ namespace vrender
 			GLfloat _xmin,_xmax,_ymin,_ymax,_zmin,_zmax ;
 
 			bool _clearBG,_blackAndWhite ;
+
+			// Set before writeHeader(), when the dense regions may be spewed as images
+			bool _spewsImages ;
+
+		private:
+			Exporter& operator=(const Exporter&) ;
+
+			void exportInChunks(const std::vector<PtrPrimitive>&,Exporter& state,VRenderParams&,const QString& message,size_t nb_threads) ;
+			void exportHybrid(const std::vector<PtrPrimitive>&,VRenderParams&,const QString& message) ;
+
+			QFile *_file ;
+			OutputBuffer *_out ;
 	};
 
 	// Exports to encapsulated postscript.
@@ -51,23 +144,30 @@ namespace vrender
 			virtual ~EPSExporter() {};
 
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual void spewPoint(const Point *, OutputBuffer& out) ;
+			virtual void spewSegment(const Segment *, OutputBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, OutputBuffer& out) ;
 
-			virtual void writeHeader(QTextStream& out) const ;
-			virtual void writeFooter(QTextStream& out) const ;
+			virtual void writeHeader(OutputBuffer& out) const ;
+			virtual void writeFooter(OutputBuffer& out) const ;
+
+			virtual Exporter *createChunkExporter() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t first,size_t last) ;
+
+			virtual bool canSpewImages() const { return true ; }
+			virtual void spewImage(const QImage&,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out) ;
 
 		private:
-			void setColor(QTextStream& out,float,float,float) ;
+			void setColor(OutputBuffer& out,float,float,float) ;
 
 			static const double EPS_GOURAUD_THRESHOLD ;
 			static const char *GOURAUD_TRIANGLE_EPS[] ;
 			static const char *CREATOR ;
 
-			static float last_r ;
-			static float last_g ;
-			static float last_b ;
+			// Last color set in the output, -1 when unknown
+			float last_r ;
+			float last_g ;
+			float last_b ;
 	};
 
 	//  Exports to postscript. The only difference is the filename extension and
@@ -78,7 +178,9 @@ namespace vrender
 		public:
 			virtual ~PSExporter() {};
 		protected:
-			virtual void writeFooter(QTextStream& out) const ;
+			virtual void writeFooter(OutputBuffer& out) const ;
+
+			virtual Exporter *createChunkExporter() const ;
 	};
 
 	class FIGExporter: public Exporter
@@ -88,32 +190,93 @@ namespace vrender
 			virtual ~FIGExporter() {};
 
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual void spewPoint(const Point *, OutputBuffer& out) ;
+			virtual void spewSegment(const Segment *, OutputBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, OutputBuffer& out) ;
 
-			virtual void writeHeader(QTextStream& out) const ;
-			virtual void writeFooter(QTextStream& out) const ;
+			virtual void writeHeader(OutputBuffer& out) const ;
+			virtual void writeFooter(OutputBuffer& out) const ;
+
+			virtual Exporter *createChunkExporter() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t first,size_t last) ;
+
+			//  Images are saved as <file>-<n>.png next to the figure, which
+			// refers to them.
+
+			virtual bool canSpewImages() const { return true ; }
+			virtual void spewImage(const QImage&,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out) ;
 
 		private:
 			mutable int _sizeX ;
 			mutable int _sizeY ;
 			mutable int _depth ;
+			mutable int _nbImages ;
 
 			int FigCoordX(double) const ;
 			int FigCoordY(double) const ;
 			int FigGrayScaleIndex(float red, float green, float blue) const ;
 	};
+	//  Exports to a single page, compressed PDF 1.4 file. The page content is
+	// made of several FlateDecode streams: consecutive primitives of the same
+	// color are batched in a single path, coordinates are written as integers
+	// in 1/100 units, and smooth polygons are subdivided into flat triangles.
+
+	class PDFExporter: public Exporter
+	{
+		public:
+			PDFExporter() ;
+			virtual ~PDFExporter() ;
+
+		protected:
+			virtual void spewPoint(const Point *, OutputBuffer& out) ;
+			virtual void spewSegment(const Segment *, OutputBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, OutputBuffer& out) ;
+
+			virtual void writeHeader(OutputBuffer& out) const ;
+			virtual void writeFooter(OutputBuffer& out) const ;
+
+			virtual QIODevice::OpenMode openMode() const ;
+
+			virtual bool canSpewImages() const { return true ; }
+			virtual void spewImage(const QImage&,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out) ;
+
+		private:
+			enum BatchType { NoBatch, FillBatch, StrokeBatch, DotBatch } ;
+
+			void startBatch(BatchType,float,float,float) ;
+			void endBatch() const ;
+			void writeCoords(double x,double y) ;
+			void spewTriangle(const float v[3][5],int depth) ;
+
+			void beginObject(OutputBuffer& out) const ;
+			void flushContent(OutputBuffer& out) const ;
+
+			static const double PDF_GOURAUD_THRESHOLD ;
+			static const int PDF_MAX_SUBDIVISION ;
+			static const int PDF_STREAM_SIZE ;
+			static const char *CREATOR ;
+
+			mutable QBuffer *_contentDevice ;
+			mutable OutputBuffer *_content ;
+			mutable std::vector<size_t> _offsets ;		// byte offset of each object, for the xref table
+			mutable std::vector<int> _contentObjects ;
+			mutable std::vector<int> _imageObjects ;		// XObjects /Im1, /Im2...
+
+			mutable BatchType _batch ;
+			mutable float _batch_r,_batch_g,_batch_b ;
+			mutable double _currentWidth ;
+	};
+
 #ifdef A_FAIRE
 	class SVGExporter: public Exporter
 	{
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual void spewPoint(const Point *, OutputBuffer& out) ;
+			virtual void spewSegment(const Segment *, OutputBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, OutputBuffer& out) ;
 
-			virtual void writeHeader(QTextStream& out) const ;
-			virtual void writeFooter(QTextStream& out) const ;
+			virtual void writeHeader(OutputBuffer& out) const ;
+			virtual void writeFooter(OutputBuffer& out) const ;
 	};
 #endif
 }
@@ -1,6 +1,10 @@
 #include "Exporter.h"
 #include "math.h"
 
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+
 using namespace vrender ;
 using namespace std ;
 
@@ -43,20 +47,38 @@ FIGExporter::FIGExporter()
 {
 }
 
-void FIGExporter::writeHeader(QTextStream& out) const
+void FIGExporter::writeHeader(OutputBuffer& out) const
 {
 	out << "#FIG 3.2\nPortrait\nCenter\nInches\nLetter\n100.00\nSingle\n0\n1200 2\n";
 	_depth = 999 ;
+	_nbImages = 0 ;
 	_sizeX = int(0.5f + _xmax - _xmin) ;
 	_sizeY = int(0.5f + _ymax - _ymin) ;
 }
 
-void FIGExporter::writeFooter(QTextStream& out) const
+void FIGExporter::writeFooter(OutputBuffer& out) const
 {
 	Q_UNUSED(out);
 }
 
-void FIGExporter::spewPoint(const Point *P, QTextStream& out)
+Exporter *FIGExporter::createChunkExporter() const
+{
+	return new FIGExporter(*this) ;
+}
+
+// Same depth updates as the spew functions.
+void FIGExporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t first,size_t last)
+{
+	for(size_t i=first;i<last;++i)
+		if(primitive_tab[i] != nullptr)
+		{
+			if(primitive_tab[i]->nbVertices() > 0)
+				_depth-- ;
+			if(_depth > 0) _depth = 0 ;
+		}
+}
+
+void FIGExporter::spewPoint(const Point *P, OutputBuffer& out)
 {
 	out << "2 1 0 5 0 7 " << (_depth--) << " 0 -1 0.000 0 1 -1 0 0 1\n";
 
@@ -64,7 +86,7 @@ void FIGExporter::spewPoint(const Point *P, QTextStream& out)
 	if(_depth > 0) _depth = 0 ;
 }
 
-void FIGExporter::spewSegment(const Segment *S, QTextStream& out)
+void FIGExporter::spewSegment(const Segment *S, OutputBuffer& out)
 {
 	const Feedback3DColor& P1 = Feedback3DColor(S->sommet3DColor(0)) ;
 	const Feedback3DColor& P2 = Feedback3DColor(S->sommet3DColor(1)) ;
@@ -76,7 +98,28 @@ void FIGExporter::spewSegment(const Segment *S, QTextStream& out)
 	if(_depth > 0) _depth = 0 ;
 }
 
-void FIGExporter::spewPolygone(const Polygone *P, QTextStream& out)
+//  A picture object, whose file is given relatively to the figure.
+
+void FIGExporter::spewImage(const QImage& image,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out)
+{
+	const QFileInfo info(fileName()) ;
+	const QString name = info.completeBaseName() + "-" + QString::number(++_nbImages) + ".png" ;
+
+	if(!image.save(info.absoluteDir().filePath(name),"PNG"))
+		qWarning("FIGExporter::spewImage: unable to save %s",qPrintable(name)) ;
+
+	const int x0 = FigCoordX(xmin) ;
+	const int y0 = FigCoordY(ymin) ;
+	const int x1 = FigCoordX(xmax) ;
+	const int y1 = FigCoordY(ymax) ;
+
+	out << "2 5 0 1 0 -1 " << (_depth--) << " 0 -1 0.000 0 0 -1 0 0 5\n";
+	out << "\t0 " << name << "\n";
+	out << "\t " << x0 << " " << y1 << " " << x1 << " " << y1 << " " << x1 << " " << y0 << " " << x0 << " " << y0 << " " << x0 << " " << y1 << "\n";
+	if(_depth > 0) _depth = 0 ;
+}
+
+void FIGExporter::spewPolygone(const Polygone *P, OutputBuffer& out)
 {
 	int nvertices;
 	GLfloat red, green, blue;
@@ -0,0 +1,454 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "VRender.h"
+#include "Primitive.h"
+#include "AxisAlignedBox.h"
+#include "HybridRasterizer.h"
+#include "Vector3.h"
+#include "../qglviewer.h"
+#include "../taskScheduler.h"
+
+#include <QColor>
+
+using namespace std ;
+using namespace vrender ;
+
+const float HybridRasterizer::CELL_SIZE = 32.0f ;
+const int HybridRasterizer::MAX_REGION_IMAGES = 4 ;
+const int HybridRasterizer::MAX_IMAGE_SIZE = 4096 ;
+
+//  A rectangle of cells [i0,i1[ x [j0,j1[, and the primitives drawn in its
+// images, in back to front order. An image is taken before drawing
+// primitives[snapshots[k].first], and written before the primitive of index
+// snapshots[k].second.
+
+struct HybridRasterizer::Region
+{
+	int i0,j0,i1,j1 ;
+	vector<size_t> primitives ;
+	vector< pair<size_t,size_t> > snapshots ;
+	bool dirty ;	// primitives were rasterized since the last snapshot
+};
+
+//  The pixels of an image, and the transformation of the coordinates of the
+// primitives into pixel coordinates (y down).
+
+namespace
+{
+	struct Canvas
+	{
+		unsigned char *bits ;
+		int stride,width,height ;
+		float x0,y1,sx,sy ;
+	};
+
+	//  Each vertex is x,y in pixels and r,g,b. The pixels whose center is inside
+	// the triangle get the interpolated color.
+
+	void fillTriangle(const Canvas& c,const float v[3][5])
+	{
+		const float area = (v[1][0]-v[0][0])*(v[2][1]-v[0][1]) - (v[1][1]-v[0][1])*(v[2][0]-v[0][0]) ;
+
+		if(fabs(area) < 1e-12f)
+			return ;
+
+		const int px0 = max(0,int(floor(min(v[0][0],min(v[1][0],v[2][0]))))) ;
+		const int px1 = min(c.width-1,int(ceil(max(v[0][0],max(v[1][0],v[2][0]))))) ;
+		const int py0 = max(0,int(floor(min(v[0][1],min(v[1][1],v[2][1]))))) ;
+		const int py1 = min(c.height-1,int(ceil(max(v[0][1],max(v[1][1],v[2][1]))))) ;
+
+		for(int py=py0;py<=py1;++py)
+		{
+			unsigned char *row = c.bits + py*c.stride ;
+			const float y = py + 0.5f ;
+
+			for(int px=px0;px<=px1;++px)
+			{
+				const float x = px + 0.5f ;
+				float w[3] ;
+
+				for(int k=0;k<3;++k)
+				{
+					const float *a = v[(k+1)%3] ;
+					const float *b = v[(k+2)%3] ;
+					w[k] = ((b[0]-a[0])*(y-a[1]) - (b[1]-a[1])*(x-a[0])) / area ;
+				}
+
+				if(w[0] < 0.0f || w[1] < 0.0f || w[2] < 0.0f)
+					continue ;
+
+				for(int k=0;k<3;++k)
+				{
+					const float color = w[0]*v[0][2+k] + w[1]*v[1][2+k] + w[2]*v[2][2+k] ;
+					row[3*px+k] = (unsigned char)(255.0f*min(1.0f,max(0.0f,color)) + 0.5f) ;
+				}
+			}
+		}
+	}
+
+	void fillQuad(const Canvas& c,const float a[5],const float b[5],const float d[5],const float e[5])
+	{
+		float t[3][5] ;
+
+		copy(a,a+5,t[0]) ; copy(b,b+5,t[1]) ; copy(d,d+5,t[2]) ;
+		fillTriangle(c,t) ;
+		copy(d,d+5,t[0]) ; copy(b,b+5,t[1]) ; copy(e,e+5,t[2]) ;
+		fillTriangle(c,t) ;
+	}
+}
+
+HybridRasterizer::HybridRasterizer(float xmin,float ymin,float xmax,float ymax)
+	: _xmin(xmin), _ymin(ymin), _xmax(xmax), _ymax(ymax),
+	  _threshold(256.0f), _resolution(300.0f), _pointSize(1.0f), _lineWidth(1.0f),
+	  _blackAndWhite(false)
+{
+	_background[0] = _background[1] = _background[2] = 255 ;
+
+	_nx = max(1,int(ceil((_xmax-_xmin)/CELL_SIZE))) ;
+	_ny = max(1,int(ceil((_ymax-_ymin)/CELL_SIZE))) ;
+}
+
+void HybridRasterizer::setBackgroundColor(float r,float g,float b)
+{
+	const float color[3] = { r,g,b } ;
+
+	for(int k=0;k<3;++k)
+		_background[k] = (unsigned char)(255.0f*min(1.0f,max(0.0f,color[k])) + 0.5f) ;
+}
+
+//  Cells overlapped by the bounding box of p, clamped to the page.
+
+void HybridRasterizer::cellRange(const Primitive *p,int& i0,int& j0,int& i1,int& j1) const
+{
+	const AxisAlignedBox_xyz b = p->bbox() ;
+
+	i0 = min(_nx-1,max(0,int(floor((b.mini().x()-_xmin)/CELL_SIZE)))) ;
+	i1 = min(_nx-1,max(0,int(floor((b.maxi().x()-_xmin)/CELL_SIZE)))) ;
+	j0 = min(_ny-1,max(0,int(floor((b.mini().y()-_ymin)/CELL_SIZE)))) ;
+	j1 = min(_ny-1,max(0,int(floor((b.maxi().y()-_ymin)/CELL_SIZE)))) ;
+}
+
+//  Counts the polygons of each cell, and groups the connected dense cells in
+// bounding rectangles, merged until they do not overlap.
+
+void HybridRasterizer::findRegions(const vector<PtrPrimitive>& primitive_tab,vector<Region>& regions) const
+{
+	vector<int> count(_nx*_ny,0) ;
+
+	for(size_t p=0;p<primitive_tab.size();++p)
+		if(primitive_tab[p] != nullptr && primitive_tab[p]->nbVertices() >= 3)
+		{
+			int i0,j0,i1,j1 ;
+			cellRange(primitive_tab[p],i0,j0,i1,j1) ;
+
+			for(int j=j0;j<=j1;++j)
+				for(int i=i0;i<=i1;++i)
+					++count[j*_nx+i] ;
+		}
+
+	vector<bool> visited(_nx*_ny,false) ;
+	vector<int> stack ;
+
+	for(int c=0;c<_nx*_ny;++c)
+	{
+		if(visited[c] || count[c] <= _threshold)
+			continue ;
+
+		Region region ;
+		region.i0 = region.i1 = c % _nx ;
+		region.j0 = region.j1 = c / _nx ;
+		region.dirty = false ;
+
+		visited[c] = true ;
+		stack.push_back(c) ;
+
+		while(!stack.empty())
+		{
+			const int cell = stack.back() ;
+			stack.pop_back() ;
+
+			const int i = cell % _nx ;
+			const int j = cell / _nx ;
+
+			region.i0 = min(region.i0,i) ; region.i1 = max(region.i1,i) ;
+			region.j0 = min(region.j0,j) ; region.j1 = max(region.j1,j) ;
+
+			const int neighbors[4][2] = { {i-1,j}, {i+1,j}, {i,j-1}, {i,j+1} } ;
+
+			for(int k=0;k<4;++k)
+			{
+				const int ni = neighbors[k][0] ;
+				const int nj = neighbors[k][1] ;
+
+				if(ni < 0 || nj < 0 || ni >= _nx || nj >= _ny)
+					continue ;
+
+				const int n = nj*_nx+ni ;
+
+				if(!visited[n] && count[n] > _threshold)
+				{
+					visited[n] = true ;
+					stack.push_back(n) ;
+				}
+			}
+		}
+
+		++region.i1 ;
+		++region.j1 ;
+		regions.push_back(region) ;
+	}
+
+	for(bool merged=true;merged;)
+	{
+		merged = false ;
+
+		for(size_t a=0;a<regions.size() && !merged;++a)
+			for(size_t b=a+1;b<regions.size() && !merged;++b)
+				if(regions[a].i0 < regions[b].i1 && regions[b].i0 < regions[a].i1 &&
+					regions[a].j0 < regions[b].j1 && regions[b].j0 < regions[a].j1)
+				{
+					regions[a].i0 = min(regions[a].i0,regions[b].i0) ;
+					regions[a].j0 = min(regions[a].j0,regions[b].j0) ;
+					regions[a].i1 = max(regions[a].i1,regions[b].i1) ;
+					regions[a].j1 = max(regions[a].j1,regions[b].j1) ;
+					regions.erase(regions.begin()+b) ;
+					merged = true ;
+				}
+	}
+}
+
+void HybridRasterizer::rasterize(const vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
+{
+	const QString message = QGLViewer::tr("Rasterizing dense regions") ;
+	vparams.progress(0.0,message) ;
+
+	_rasterized.assign(primitive_tab.size(),false) ;
+	_images.clear() ;
+
+	vector<Region> regions ;
+	findRegions(primitive_tab,regions) ;
+
+	if(regions.empty())
+		return ;
+
+	vector<int> region_of_cell(_nx*_ny,-1) ;
+
+	for(size_t r=0;r<regions.size();++r)
+		for(int j=regions[r].j0;j<regions[r].j1;++j)
+			for(int i=regions[r].i0;i<regions[r].i1;++i)
+				region_of_cell[j*_nx+i] = int(r) ;
+
+	//  Decides which primitives are rasterized, and where the images of their
+	// regions are written, in back to front order.
+
+	vector<int> overlapped ;
+
+	for(size_t p=0;p<primitive_tab.size();++p)
+	{
+		const Primitive *primitive = primitive_tab[p] ;
+
+		if(primitive == nullptr || primitive->nbVertices() == 0)
+			continue ;
+
+		int i0,j0,i1,j1 ;
+		cellRange(primitive,i0,j0,i1,j1) ;
+
+		overlapped.clear() ;
+
+		for(int j=j0;j<=j1;++j)
+			for(int i=i0;i<=i1;++i)
+			{
+				const int r = region_of_cell[j*_nx+i] ;
+
+				if(r >= 0 && find(overlapped.begin(),overlapped.end(),r) == overlapped.end())
+					overlapped.push_back(r) ;
+			}
+
+		if(overlapped.empty())
+			continue ;
+
+		Region& first = regions[overlapped[0]] ;
+
+		const bool inside = overlapped.size() == 1 &&
+								  i0 >= first.i0 && i1 < first.i1 && j0 >= first.j0 && j1 < first.j1 ;
+
+		if(inside && (primitive->nbVertices() >= 3 || int(first.snapshots.size()) >= MAX_REGION_IMAGES))
+		{
+			_rasterized[p] = true ;
+			first.primitives.push_back(p) ;
+			first.dirty = true ;
+			continue ;
+		}
+
+		for(size_t k=0;k<overlapped.size();++k)
+		{
+			Region& region = regions[overlapped[k]] ;
+
+			if(region.dirty)
+			{
+				region.snapshots.push_back(make_pair(region.primitives.size(),p)) ;
+				region.dirty = false ;
+			}
+
+			region.primitives.push_back(p) ;
+		}
+	}
+
+	for(size_t r=0;r<regions.size();++r)
+		if(regions[r].dirty)
+			regions[r].snapshots.push_back(make_pair(regions[r].primitives.size(),primitive_tab.size())) ;
+
+	vector< vector<Image> > region_images(regions.size()) ;
+
+	qglviewer::TaskScheduler::parallelFor(int(regions.size()),[&](int first,int last)
+	{
+		for(int r=first;r<last;++r)
+			drawRegion(primitive_tab,regions[r],region_images[r]) ;
+	}) ;
+
+	for(size_t r=0;r<regions.size();++r)
+		_images.insert(_images.end(),region_images[r].begin(),region_images[r].end()) ;
+
+	stable_sort(_images.begin(),_images.end(),[](const Image& a,const Image& b) { return a.before < b.before ; }) ;
+
+	vparams.progress(1.0,message) ;
+}
+
+//  Draws the primitives of region with the painter's algorithm, and copies
+// the image at each snapshot.
+
+void HybridRasterizer::drawRegion(const vector<PtrPrimitive>& primitive_tab,const Region& region,vector<Image>& images) const
+{
+	const float x0 = _xmin + region.i0*CELL_SIZE ;
+	const float x1 = min(_xmax,_xmin + region.i1*CELL_SIZE) ;
+	const float y0 = _ymin + region.j0*CELL_SIZE ;
+	const float y1 = min(_ymax,_ymin + region.j1*CELL_SIZE) ;
+
+	// One unit of the page is a point, 1/72 inch
+	float scale = _resolution/72.0f ;
+	const float size = max(x1-x0,y1-y0)*scale ;
+
+	if(size > MAX_IMAGE_SIZE)
+		scale *= MAX_IMAGE_SIZE/size ;
+
+	const int width = max(1,int(ceil((x1-x0)*scale))) ;
+	const int height = max(1,int(ceil((y1-y0)*scale))) ;
+
+	QImage image(width,height,QImage::Format_RGB888) ;
+	image.fill(QColor(_background[0],_background[1],_background[2])) ;
+
+	Canvas canvas ;
+	canvas.stride = image.bytesPerLine() ;
+	canvas.width = width ;
+	canvas.height = height ;
+	canvas.x0 = x0 ;
+	canvas.y1 = y1 ;
+	canvas.sx = width/(x1-x0) ;
+	canvas.sy = height/(y1-y0) ;
+
+	size_t next = 0 ;
+
+	for(size_t k=0;k<=region.primitives.size();++k)
+	{
+		for(;next < region.snapshots.size() && region.snapshots[next].first == k;++next)
+		{
+			Image snapshot ;
+			snapshot.before = region.snapshots[next].second ;
+			snapshot.xmin = x0 ;
+			snapshot.ymin = y0 ;
+			snapshot.xmax = x1 ;
+			snapshot.ymax = y1 ;
+			snapshot.image = image ;
+			images.push_back(snapshot) ;
+		}
+
+		if(k == region.primitives.size())
+			break ;
+
+		// Detaches image from the last snapshot
+		canvas.bits = image.bits() ;
+
+		const Primitive *primitive = primitive_tab[region.primitives[k]] ;
+		const size_t nb_vertices = primitive->nbVertices() ;
+
+		float v[4][5] ;
+
+		for(size_t i=0;i<min(nb_vertices,size_t(2));++i)
+		{
+			const Feedback3DColor& f = primitive->sommet3DColor(i) ;
+
+			v[i][0] = float((f.x()-canvas.x0)*canvas.sx) ;
+			v[i][1] = float((canvas.y1-f.y())*canvas.sy) ;
+			v[i][2] = _blackAndWhite ? 0.0f : f.red() ;
+			v[i][3] = _blackAndWhite ? 0.0f : f.green() ;
+			v[i][4] = _blackAndWhite ? 0.0f : f.blue() ;
+		}
+
+		if(nb_vertices >= 3)
+		{
+			//  Triangle fan around the first vertex
+			float t[3][5] ;
+
+			for(size_t i=0;i<nb_vertices;++i)
+			{
+				const Feedback3DColor& f = primitive->sommet3DColor(i) ;
+				float *w = t[min(i,size_t(2))] ;
+
+				w[0] = float((f.x()-canvas.x0)*canvas.sx) ;
+				w[1] = float((canvas.y1-f.y())*canvas.sy) ;
+				w[2] = _blackAndWhite ? 1.0f : f.red() ;
+				w[3] = _blackAndWhite ? 1.0f : f.green() ;
+				w[4] = _blackAndWhite ? 1.0f : f.blue() ;
+
+				if(i >= 2)
+				{
+					fillTriangle(canvas,t) ;
+					copy(t[2],t[2]+5,t[1]) ;
+				}
+			}
+		}
+		else
+		{
+			if(nb_vertices == 1)
+				copy(v[0],v[0]+5,v[1]) ;
+
+			//  A segment is a quad of the line width, a point a square of the
+			// point size. Both are at least one pixel wide.
+
+			const float half = 0.5f*max(1.0f,((nb_vertices == 1)?_pointSize:_lineWidth)*canvas.sx) ;
+
+			float dx = v[1][0] - v[0][0] ;
+			float dy = v[1][1] - v[0][1] ;
+			const float length = sqrt(dx*dx + dy*dy) ;
+
+			if(length > 1e-6f)
+			{
+				dx *= half/length ;
+				dy *= half/length ;
+			}
+			else
+			{
+				// An axis aligned square around the point
+				dx = half ;
+				dy = 0.0f ;
+				v[0][0] -= half ;
+				v[1][0] += half ;
+			}
+
+			for(int k=0;k<5;++k)
+			{
+				v[2][k] = v[0][k] ;
+				v[3][k] = v[1][k] ;
+			}
+
+			v[0][0] -= dy ; v[0][1] += dx ;
+			v[2][0] += dy ; v[2][1] -= dx ;
+			v[1][0] -= dy ; v[1][1] += dx ;
+			v[3][0] += dy ; v[3][1] -= dx ;
+
+			fillQuad(canvas,v[0],v[2],v[1],v[3]) ;
+		}
+	}
+}
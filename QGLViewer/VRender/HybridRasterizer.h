@@ -0,0 +1,83 @@
+#ifndef _VRENDER_HYBRIDRASTERIZER_H
+#define _VRENDER_HYBRIDRASTERIZER_H
+
+//  Hybrid raster/vector export (VRenderParams::RasterizeDenseRegions). The page
+// is divided in square cells, and the cells covered by more than threshold
+// polygons are grouped in rectangular regions. The primitives that lie inside a
+// region are drawn in an image of the region instead of being written: the
+// file size is then bounded by the area of the regions, not by their number of
+// primitives.
+//
+//  The images are opaque, and also show the vectorial primitives that overlap
+// their region, so that the back to front order is kept: when a vectorial
+// primitive overlaps a region where primitives were rasterized since its last
+// image, a new image of the region is written just before it. Segments and
+// points stay vectorial, unless their region already has MAX_REGION_IMAGES
+// images.
+
+#include <QImage>
+#include <vector>
+#include "Types.h"
+
+namespace vrender
+{
+	class VRenderParams ;
+
+	class HybridRasterizer
+	{
+		public:
+			//  An image to write before the primitive of index before. Its
+			// corners are in the coordinates of the primitives.
+			struct Image
+			{
+				size_t before ;
+				float xmin,ymin,xmax,ymax ;
+				QImage image ;
+			};
+
+			HybridRasterizer(float xmin,float ymin,float xmax,float ymax) ;
+
+			//  Polygons per cell above which a cell is dense.
+			void setThreshold(float t) { _threshold = t ; }
+			//  Dots per inch of the images, one unit of the page being a point.
+			void setResolution(float dpi) { _resolution = dpi ; }
+			void setPointSize(float s) { _pointSize = s ; }
+			void setLineWidth(float w) { _lineWidth = w ; }
+			void setBlackAndWhite(bool b) { _blackAndWhite = b ; }
+			void setBackgroundColor(float r,float g,float b) ;
+
+			//  Finds the dense regions of the primitives, in back to front order,
+			// and draws their images.
+			void rasterize(const std::vector<PtrPrimitive>&,VRenderParams&) ;
+
+			//  Primitive i is in an image, and must not be written.
+			bool isRasterized(size_t i) const { return _rasterized[i] ; }
+			//  Sorted by increasing before.
+			const std::vector<Image>& images() const { return _images ; }
+
+		private:
+			struct Region ;
+
+			static const float CELL_SIZE ;
+			static const int MAX_REGION_IMAGES ;
+			static const int MAX_IMAGE_SIZE ;
+
+			void findRegions(const std::vector<PtrPrimitive>&,std::vector<Region>&) const ;
+			void drawRegion(const std::vector<PtrPrimitive>&,const Region&,std::vector<Image>&) const ;
+			void cellRange(const Primitive *,int& i0,int& j0,int& i1,int& j1) const ;
+
+			float _xmin,_ymin,_xmax,_ymax ;
+			float _threshold ;
+			float _resolution ;
+			float _pointSize ;
+			float _lineWidth ;
+			bool _blackAndWhite ;
+			unsigned char _background[3] ;
+
+			int _nx,_ny ;	// cells along x and y
+			std::vector<bool> _rasterized ;
+			std::vector<Image> _images ;
+	};
+}
+
+#endif
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <vector>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+#include "VRender.h"
+#include "Primitive.h"
+#include "IdBufferCuller.h"
+#include "../renderTarget.h"
+
+#ifndef GL_CURRENT_PROGRAM
+# define GL_CURRENT_PROGRAM 0x8B8D
+#endif
+
+using namespace std ;
+using namespace vrender ;
+
+// Colors are 24 bits identifiers, 0 is the background.
+static const unsigned int MAX_IDENTIFIER = 0xFFFFFF ;
+
+// Rows read back from the offscreen buffer at once.
+static const int ROWS_PER_READ = 256 ;
+
+static void setIdentifierColor(unsigned int id)
+{
+	glColor3ub(GLubyte(id & 0xFF),GLubyte((id >> 8) & 0xFF),GLubyte((id >> 16) & 0xFF)) ;
+}
+
+//  Walks the feedback buffer as ParserGL::parseFeedbackBuffer() does, so that
+// the identifiers are the indices of the parsed primitives, plus one. Only the
+// primitives of mode are drawn, which gives a single glBegin() per mode.
+
+void IdBufferCuller::drawPrimitives(const GLfloat *buffer,int size,GLenum mode)
+{
+	const size_t step = Feedback3DColor::sizeInBuffer() ;
+	const GLfloat *end = buffer + size ;
+	const GLfloat *loc = buffer ;
+	unsigned int id = 0 ;
+
+	glBegin(mode) ;
+
+	while(loc < end)
+	{
+		int token = int(0.5f + *loc) ;
+		loc++ ;
+
+		switch(token)
+		{
+			case GL_LINE_TOKEN:
+			case GL_LINE_RESET_TOKEN:
+				++id ;
+				if(mode == GL_LINES)
+				{
+					setIdentifierColor(id) ;
+					glVertex3fv(loc) ;
+					glVertex3fv(loc+step) ;
+				}
+				loc += 2*step ;
+				break ;
+
+			case GL_POLYGON_TOKEN:
+				{
+					int nvertices = int(0.5f + *loc) ;
+					loc++ ;
+					++id ;
+
+					//  Feedback polygons are convex, they are drawn as fans.
+
+					if(mode == GL_TRIANGLES)
+					{
+						setIdentifierColor(id) ;
+						for(int i=1;i+1<nvertices;++i)
+						{
+							glVertex3fv(loc) ;
+							glVertex3fv(loc+i*step) ;
+							glVertex3fv(loc+(i+1)*step) ;
+						}
+					}
+					loc += nvertices*step ;
+				}
+				break ;
+
+			case GL_POINT_TOKEN:
+				++id ;
+				if(mode == GL_POINTS)
+				{
+					setIdentifierColor(id) ;
+					glVertex3fv(loc) ;
+				}
+				loc += step ;
+				break ;
+
+			default:
+				break ;
+		}
+	}
+
+	glEnd() ;
+}
+
+bool IdBufferCuller::findVisiblePrimitives(	const GLfloat *buffer,int size,
+															const GLfloat viewport[4],int scale,
+															vector<bool>& visible)
+{
+	visible.clear() ;
+
+	QOpenGLContext *context = QOpenGLContext::currentContext() ;
+
+	if(context == nullptr || buffer == nullptr || viewport[2] <= 0.0f || viewport[3] <= 0.0f)
+		return false ;
+
+	// Number of primitives, which must fit in the colors
+
+	size_t nb_primitives = 0 ;
+	const size_t step = Feedback3DColor::sizeInBuffer() ;
+
+	for(const GLfloat *loc = buffer;loc < buffer+size;)
+	{
+		int token = int(0.5f + *loc) ;
+		loc++ ;
+
+		switch(token)
+		{
+			case GL_LINE_TOKEN:
+			case GL_LINE_RESET_TOKEN: loc += 2*step ; ++nb_primitives ; break ;
+			case GL_POLYGON_TOKEN: loc += 1 + int(0.5f + *loc)*step ; ++nb_primitives ; break ;
+			case GL_POINT_TOKEN: loc += step ; ++nb_primitives ; break ;
+			default: break ;
+		}
+	}
+
+	if(nb_primitives == 0 || nb_primitives > MAX_IDENTIFIER)
+		return false ;
+
+	// The supersampled buffer must fit in a texture
+
+	GLint max_size = 0 ;
+	GLint max_viewport[2] = { 0,0 } ;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size) ;
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport) ;
+	max_size = min(max_size,min(max_viewport[0],max_viewport[1])) ;
+
+	const int width = int(viewport[2]) ;
+	const int height = int(viewport[3]) ;
+
+	if(max(width,height) > max_size)
+		return false ;
+
+	scale = max(1,min(scale,max_size/max(width,height))) ;
+
+	qglviewer::RenderTarget target(QSize(scale*width,scale*height)) ;
+
+	if(!target.bind())
+	{
+		target.cleanupGL() ;
+		return false ;
+	}
+
+	QOpenGLFunctions *functions = context->functions() ;
+	GLint program = 0 ;
+
+	if(!context->isOpenGLES())
+	{
+		functions->glGetIntegerv(GL_CURRENT_PROGRAM, &program) ;
+		functions->glUseProgram(0) ;
+	}
+
+	glPushAttrib(GL_ALL_ATTRIB_BITS) ;
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT) ;
+
+	glDisable(GL_LIGHTING) ;
+	glDisable(GL_TEXTURE_2D) ;
+	glDisable(GL_BLEND) ;
+	glDisable(GL_FOG) ;
+	glDisable(GL_ALPHA_TEST) ;
+	glDisable(GL_DITHER) ;
+	glDisable(GL_CULL_FACE) ;
+	glDisable(GL_STENCIL_TEST) ;
+	glDisable(GL_SCISSOR_TEST) ;
+	glDisable(GL_COLOR_LOGIC_OP) ;
+	glDisable(GL_LINE_SMOOTH) ;
+	glDisable(GL_POINT_SMOOTH) ;
+	glDisable(GL_POLYGON_SMOOTH) ;
+	for(int i=0;i<6;++i)
+		glDisable(GL_CLIP_PLANE0+i) ;
+	glShadeModel(GL_FLAT) ;
+	glPolygonMode(GL_FRONT_AND_BACK,GL_FILL) ;
+	glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE) ;
+	glDepthMask(GL_TRUE) ;
+	glEnable(GL_DEPTH_TEST) ;
+	glDepthFunc(GL_LEQUAL) ;
+
+	glLineWidth(1.0f) ;
+	glPointSize(1.0f) ;
+
+	glViewport(0,0,scale*width,scale*height) ;
+	glClearColor(0.0f,0.0f,0.0f,0.0f) ;
+	glClearDepth(1.0) ;
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT) ;
+
+	//  The feedback buffer is in window coordinates: this projection maps them
+	// back to normalized device coordinates, with the current depth range.
+
+	GLfloat depth_range[2] ;
+	glGetFloatv(GL_DEPTH_RANGE, depth_range) ;
+
+	const GLfloat dz = (depth_range[1] != depth_range[0]) ? depth_range[1] - depth_range[0] : 1.0f ;
+	const GLfloat window_to_ndc[16] = {	2.0f/viewport[2],0.0f,0.0f,0.0f,
+													0.0f,2.0f/viewport[3],0.0f,0.0f,
+													0.0f,0.0f,2.0f/dz,0.0f,
+													-1.0f-2.0f*viewport[0]/viewport[2],-1.0f-2.0f*viewport[1]/viewport[3],-1.0f-2.0f*depth_range[0]/dz,1.0f } ;
+
+	glMatrixMode(GL_PROJECTION) ;
+	glPushMatrix() ;
+	glLoadMatrixf(window_to_ndc) ;
+	glMatrixMode(GL_MODELVIEW) ;
+	glPushMatrix() ;
+	glLoadIdentity() ;
+
+	//  Polygons are pushed back, so that the segments and points drawn over
+	// them are not hidden, as in the exported file.
+
+	glEnable(GL_POLYGON_OFFSET_FILL) ;
+	glPolygonOffset(1.0f,1.0f) ;
+	drawPrimitives(buffer,size,GL_TRIANGLES) ;
+	glDisable(GL_POLYGON_OFFSET_FILL) ;
+
+	drawPrimitives(buffer,size,GL_LINES) ;
+	drawPrimitives(buffer,size,GL_POINTS) ;
+
+	// Collects the identifiers that cover at least one pixel
+
+	visible.assign(nb_primitives,false) ;
+
+	glPixelStorei(GL_PACK_ALIGNMENT,4) ;
+	glPixelStorei(GL_PACK_ROW_LENGTH,0) ;
+
+	vector<GLubyte> rows(4*size_t(scale*width)*ROWS_PER_READ) ;
+
+	for(int y=0;y<scale*height;y+=ROWS_PER_READ)
+	{
+		const int nb_rows = min(ROWS_PER_READ,scale*height-y) ;
+		glReadPixels(0,y,scale*width,nb_rows,GL_RGBA,GL_UNSIGNED_BYTE,&rows[0]) ;
+
+		for(size_t p=0;p<size_t(scale*width)*nb_rows;++p)
+		{
+			const unsigned int id = rows[4*p] | (rows[4*p+1] << 8) | (rows[4*p+2] << 16) ;
+
+			if(id > 0 && id <= nb_primitives)
+				visible[id-1] = true ;
+		}
+	}
+
+	glMatrixMode(GL_PROJECTION) ;
+	glPopMatrix() ;
+	glMatrixMode(GL_MODELVIEW) ;
+	glPopMatrix() ;
+
+	glPopClientAttrib() ;
+	glPopAttrib() ;
+
+	if(!context->isOpenGLES())
+		functions->glUseProgram(GLuint(program)) ;
+
+	target.release() ;
+	target.cleanupGL() ;
+
+	return true ;
+}
@@ -0,0 +1,32 @@
+#ifndef _VRENDER_IDBUFFERCULLER_H
+#define _VRENDER_IDBUFFERCULLER_H
+
+//  Hidden primitives removal on the GPU (VRenderParams::CullHiddenFacesOnGPU).
+// The primitives of a feedback buffer are drawn again, each one with its own
+// color, in an offscreen buffer of scale times the viewport size. The
+// primitives whose color appears in at least one pixel are visible: the other
+// ones can be discarded by the parser, before they are sorted.
+
+#include <vector>
+#include "Types.h"
+
+namespace vrender
+{
+	class IdBufferCuller
+	{
+		public:
+			//  visible[i] is set for the i-th point, segment or polygon of buffer,
+			// in the order of ParserGL::parseFeedbackBuffer(). An OpenGL context
+			// must be current, and its state is restored. Returns false, and
+			// leaves visible empty, when the offscreen buffer cannot be used.
+
+			static bool findVisiblePrimitives(	const GLfloat *buffer,int size,
+															const GLfloat viewport[4],int scale,
+															std::vector<bool>& visible) ;
+
+		private:
+			static void drawPrimitives(const GLfloat *buffer,int size,GLenum mode) ;
+	};
+}
+
+#endif
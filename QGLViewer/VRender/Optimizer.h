@@ -36,6 +36,23 @@ namespace vrender
 			virtual ~PrimitiveSplitOptimizer() {} ;
 	};
 
+	//  Discards the primitives that are outside of the viewport or smaller
+	// than VRenderParams::minimumPrimitiveSize(), replaces the thinner polygons
+	// by segments, and merges the successive coplanar triangles of a strip or a
+	// fan (see VRenderParams::FilterPrimitives). The viewport is x, y, width
+	// and height, in window coordinates.
+
+	class PrimitiveFilterOptimizer: public Optimizer
+	{
+		public:
+			explicit PrimitiveFilterOptimizer(const GLfloat viewport[4]) ;
+			virtual void optimize(std::vector<PtrPrimitive>&,VRenderParams&) ;
+			virtual ~PrimitiveFilterOptimizer() {} ;
+
+		private:
+			GLfloat _viewport[4] ;
+	};
+
 	class BackFaceCullingOptimizer: public Optimizer
 	{
 		public:
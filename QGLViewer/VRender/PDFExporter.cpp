@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <math.h>
+#include <QBuffer>
+#include <QByteArray>
+#include <QImage>
+#include <string.h>
+#include "Primitive.h"
+#include "Exporter.h"
+
+using namespace vrender ;
+using namespace std ;
+
+const double PDFExporter::PDF_GOURAUD_THRESHOLD = 0.05 ;
+const int PDFExporter::PDF_MAX_SUBDIVISION = 5 ;
+const int PDFExporter::PDF_STREAM_SIZE = 1 << 20 ;
+const char *PDFExporter::CREATOR = "VRender library - (c) Cyril Soler 2005" ;
+
+// Coordinates are written in 1/100 units, see the cm operator in writeHeader().
+
+static int pdfCoord(double x)
+{
+	return int(floor(x*100.0 + 0.5)) ;
+}
+
+// Colors are rounded to 3 decimals, which is enough for 8 bits per component.
+
+static double pdfColor(float c)
+{
+	return floor(c*1000.0 + 0.5)/1000.0 ;
+}
+
+PDFExporter::PDFExporter()
+	: _contentDevice(nullptr), _content(nullptr), _batch(NoBatch)
+{
+	_batch_r = _batch_g = _batch_b = -1.0 ;
+	_currentWidth = 1.0 ;
+}
+
+PDFExporter::~PDFExporter()
+{
+	delete _content ;
+	delete _contentDevice ;
+}
+
+QIODevice::OpenMode PDFExporter::openMode() const
+{
+	// Offsets in the xref table must be exact: no end of line conversion.
+
+	return QIODevice::WriteOnly ;
+}
+
+void PDFExporter::writeHeader(OutputBuffer& out) const
+{
+	out << "%PDF-1.4\n" ;
+	out << "%\xe2\xe3\xcf\xd3\n" ;		// binary file marker
+
+	_offsets.clear() ;
+	_contentObjects.clear() ;
+	_imageObjects.clear() ;
+
+	delete _content ;
+	delete _contentDevice ;
+
+	_contentDevice = new QBuffer ;
+	_contentDevice->open(QIODevice::WriteOnly) ;
+	_content = new OutputBuffer(_contentDevice) ;
+
+	_batch = NoBatch ;
+	_currentWidth = 1.0 ;
+
+	*_content << "0.01 0 0 0.01 0 0 cm\n" ;
+	*_content << "1 J 1 j 100 w\n" ;
+
+	/* Clear the background like OpenGL had it. */
+
+	if(_clearBG)
+	{
+		*_content << pdfColor(_clearR) << " " << pdfColor(_clearG) << " " << pdfColor(_clearB) << " rg\n" ;
+		*_content << pdfCoord(_xmin) << " " << pdfCoord(_ymin) << " " << pdfCoord(_xmax-_xmin) << " " << pdfCoord(_ymax-_ymin) << " re f\n" ;
+	}
+}
+
+void PDFExporter::writeFooter(OutputBuffer& out) const
+{
+	flushContent(out) ;
+
+	delete _content ;
+	delete _contentDevice ;
+	_content = nullptr ;
+	_contentDevice = nullptr ;
+
+	const int nb_contents = int(_offsets.size()) ;
+	const int page = nb_contents+1 ;
+	const int pages = nb_contents+2 ;
+	const int catalog = nb_contents+3 ;
+	const int info = nb_contents+4 ;
+
+	beginObject(out) ;
+	out << "<< /Type /Page /Parent " << pages << " 0 R /MediaBox [" << _xmin << " " << _ymin << " " << _xmax << " " << _ymax << "]\n" ;
+	out << "/Resources << " ;
+
+	if(!_imageObjects.empty())
+	{
+		out << "/XObject <<" ;
+
+		for(size_t i=0;i<_imageObjects.size();++i)
+			out << " /Im" << int(i+1) << " " << _imageObjects[i] << " 0 R" ;
+
+		out << " >> " ;
+	}
+
+	out << ">> /Contents [" ;
+
+	for(size_t i=0;i<_contentObjects.size();++i)
+		out << " " << _contentObjects[i] << " 0 R" ;
+
+	out << " ] >>\nendobj\n" ;
+
+	beginObject(out) ;
+	out << "<< /Type /Pages /Kids [" << page << " 0 R] /Count 1 >>\nendobj\n" ;
+
+	beginObject(out) ;
+	out << "<< /Type /Catalog /Pages " << pages << " 0 R >>\nendobj\n" ;
+
+	beginObject(out) ;
+	out << "<< /Producer (" << CREATOR << " \\(using OpenGL feedback\\)) >>\nendobj\n" ;
+
+	// Cross reference table: each entry is exactly 20 bytes long.
+
+	const size_t xref = out.position() ;
+
+	out << "xref\n0 " << int(_offsets.size()+1) << "\n" ;
+	out << "0000000000 65535 f \n" ;
+
+	for(size_t i=0;i<_offsets.size();++i)
+	{
+		char entry[32] ;
+		snprintf(entry,sizeof(entry),"%010lu 00000 n \n",(unsigned long)_offsets[i]) ;
+		out << entry ;
+	}
+
+	out << "trailer\n<< /Size " << int(_offsets.size()+1) << " /Root " << catalog << " 0 R /Info " << info << " 0 R >>\n" ;
+
+	char start[32] ;
+	snprintf(start,sizeof(start),"%lu",(unsigned long)xref) ;
+	out << "startxref\n" << start << "\n%%EOF\n" ;
+}
+
+// Starts a new indirect object, numbered from 1 in the order of the calls.
+
+void PDFExporter::beginObject(OutputBuffer& out) const
+{
+	_offsets.push_back(out.position()) ;
+	out << int(_offsets.size()) << " 0 obj\n" ;
+}
+
+//  Compresses the pending page content into a new FlateDecode stream object.
+// Streams are only split between two batches, so that each path is complete.
+
+void PDFExporter::flushContent(OutputBuffer& out) const
+{
+	endBatch() ;
+	_content->flush() ;
+
+	if(_contentDevice->size() == 0)
+		return ;
+
+	// qCompress() output is a 4 bytes length followed by a zlib stream.
+
+	QByteArray data = qCompress(_contentDevice->buffer()) ;
+	data.remove(0,4) ;
+
+	beginObject(out) ;
+	out << "<< /Length " << int(data.size()) << " /Filter /FlateDecode >>\nstream\n" ;
+	out.write(data.constData(),data.size()) ;
+	out << "\nendstream\nendobj\n" ;
+
+	_contentObjects.push_back(int(_offsets.size())) ;
+
+	delete _content ;
+	_contentDevice->close() ;
+	_contentDevice->setData(QByteArray()) ;
+	_contentDevice->open(QIODevice::WriteOnly) ;
+	_content = new OutputBuffer(_contentDevice) ;
+}
+
+//  The image is an XObject of its own, drawn by the page content in the
+// rectangle of its corners.
+
+void PDFExporter::spewImage(const QImage& image,float xmin,float ymin,float xmax,float ymax,OutputBuffer& out)
+{
+	endBatch() ;
+
+	const int width = image.width() ;
+	const int height = image.height() ;
+
+	// Rows without their padding
+	QByteArray rows(3*width*height,'\0') ;
+
+	for(int y=0;y<height;++y)
+		memcpy(rows.data()+3*width*y,image.constScanLine(y),3*width) ;
+
+	QByteArray data = qCompress(rows) ;
+	data.remove(0,4) ;
+
+	beginObject(out) ;
+	out << "<< /Type /XObject /Subtype /Image /Width " << width << " /Height " << height ;
+	out << " /ColorSpace /DeviceRGB /BitsPerComponent 8 /Length " << int(data.size()) << " /Filter /FlateDecode >>\nstream\n" ;
+	out.write(data.constData(),data.size()) ;
+	out << "\nendstream\nendobj\n" ;
+
+	_imageObjects.push_back(int(_offsets.size())) ;
+
+	*_content << "q " << pdfCoord(xmax-xmin) << " 0 0 " << pdfCoord(ymax-ymin) << " " << pdfCoord(xmin) << " " << pdfCoord(ymin) ;
+	*_content << " cm /Im" << int(_imageObjects.size()) << " Do Q\n" ;
+}
+
+//  Consecutive primitives of the same type and color are written as sub paths
+// of a single path, which is painted once by endBatch().
+
+void PDFExporter::startBatch(BatchType type,float r,float g,float b)
+{
+	if(_batch == type && _batch_r == r && _batch_g == g && _batch_b == b)
+		return ;
+
+	endBatch() ;
+
+	if(type == FillBatch)
+		*_content << pdfColor(r) << " " << pdfColor(g) << " " << pdfColor(b) << " rg\n" ;
+	else
+	{
+		const double width = (type == DotBatch)?_pointSize:1.0 ;
+
+		if(width != _currentWidth)
+			*_content << pdfCoord(width) << " w\n" ;
+
+		_currentWidth = width ;
+
+		*_content << pdfColor(r) << " " << pdfColor(g) << " " << pdfColor(b) << " RG\n" ;
+	}
+
+	_batch = type ;
+	_batch_r = r ;
+	_batch_g = g ;
+	_batch_b = b ;
+}
+
+void PDFExporter::endBatch() const
+{
+	switch(_batch)
+	{
+		case FillBatch: *_content << "f\n" ;
+							 break ;
+		case StrokeBatch:
+		case DotBatch: *_content << "S\n" ;
+							break ;
+		default:
+							break ;
+	}
+
+	_batch = NoBatch ;
+}
+
+void PDFExporter::writeCoords(double x,double y)
+{
+	*_content << pdfCoord(x) << " " << pdfCoord(y) ;
+}
+
+//  Writes a flat triangle, or splits it in 4 when the colors of its vertices
+// differ too much. Each vertex is x,y,r,g,b.
+
+void PDFExporter::spewTriangle(const float v[3][5],int depth)
+{
+	float diff = 0.0 ;
+
+	for(int i=0;i<3;++i)
+		for(int c=2;c<5;++c)
+			diff = max(diff,(float)fabs(v[i][c] - v[(i+1)%3][c])) ;
+
+	if(diff < PDF_GOURAUD_THRESHOLD || depth >= PDF_MAX_SUBDIVISION)
+	{
+		startBatch(FillBatch,(v[0][2]+v[1][2]+v[2][2])/3.0f,(v[0][3]+v[1][3]+v[2][3])/3.0f,(v[0][4]+v[1][4]+v[2][4])/3.0f) ;
+
+		// Counter clockwise, see spewPolygone()
+
+		const bool ccw = (v[1][0]-v[0][0])*(v[2][1]-v[0][1]) - (v[1][1]-v[0][1])*(v[2][0]-v[0][0]) >= 0.0 ;
+		const int i1 = ccw?1:2 ;
+		const int i2 = ccw?2:1 ;
+
+		writeCoords(v[0][0],v[0][1]) ;   *_content << " m " ;
+		writeCoords(v[i1][0],v[i1][1]) ; *_content << " l " ;
+		writeCoords(v[i2][0],v[i2][1]) ; *_content << " l h\n" ;
+		return ;
+	}
+
+	float m[3][5] ;
+
+	for(int i=0;i<3;++i)
+		for(int c=0;c<5;++c)
+			m[i][c] = (v[i][c] + v[(i+1)%3][c])*0.5f ;
+
+	for(int i=0;i<3;++i)
+	{
+		float t[3][5] ;
+
+		for(int c=0;c<5;++c)
+		{
+			t[0][c] = v[i][c] ;
+			t[1][c] = m[i][c] ;
+			t[2][c] = m[(i+2)%3][c] ;
+		}
+
+		spewTriangle(t,depth+1) ;
+	}
+
+	spewTriangle(m,depth+1) ;
+}
+
+void PDFExporter::spewPolygone(const Polygone *P, OutputBuffer& out)
+{
+	const int nvertices = P->nbVertices() ;
+
+	if(nvertices == 0)
+		return ;
+
+	const Feedback3DColor& vertex = P->sommet3DColor(0) ;
+
+	bool smooth = false;
+
+	for(int i=1;i < nvertices && !smooth; i++)
+		if(fabs(vertex.red() - P->sommet3DColor(i).red()) > 0.01 || fabs(vertex.green() - P->sommet3DColor(i).green()) > 0.01 || fabs(vertex.blue() - P->sommet3DColor(i).blue()) > 0.01)
+			smooth = true;
+
+	if(smooth && !_blackAndWhite)
+	{
+		/* Smooth shaded polygon: triangle fan, subdivided into flat triangles. */
+
+		for (int j = 0; j < nvertices - 2; j++)
+		{
+			float v[3][5] ;
+			const int index[3] = { 0, j+1, j+2 } ;
+
+			for(int i=0;i<3;++i)
+			{
+				const Feedback3DColor& f = P->sommet3DColor(index[i]) ;
+
+				v[i][0] = f.x() ;
+				v[i][1] = f.y() ;
+				v[i][2] = f.red() ;
+				v[i][3] = f.green() ;
+				v[i][4] = f.blue() ;
+			}
+
+			spewTriangle(v,0) ;
+		}
+	}
+	else
+	{
+		/* Flat shaded polygon and white polygons; all vertex colors the same. */
+
+		if(_blackAndWhite)
+			startBatch(FillBatch,1.0,1.0,1.0) ;
+		else
+			startBatch(FillBatch,vertex.red(),vertex.green(),vertex.blue()) ;
+
+		//  Batched polygons are filled with the non zero winding rule: they must
+		// all have the same orientation, otherwise overlaps are holes.
+
+		double area = 0.0 ;
+
+		for(int i=0;i<nvertices;++i)
+		{
+			const Feedback3DColor& p = P->sommet3DColor(i) ;
+			const Feedback3DColor& q = P->sommet3DColor((i+1)%nvertices) ;
+
+			area += p.x()*q.y() - q.x()*p.y() ;
+		}
+
+		for(int i=0;i<nvertices;++i)
+		{
+			const Feedback3DColor& p = P->sommet3DColor((area >= 0.0)?i:(nvertices-1-i)) ;
+
+			writeCoords(p.x(),p.y()) ;
+			*_content << ((i == 0)?" m ":" l ") ;
+		}
+
+		*_content << "h\n" ;
+	}
+
+	if(_content->position() >= size_t(PDF_STREAM_SIZE))
+		flushContent(out) ;
+}
+
+void PDFExporter::spewSegment(const Segment *S, OutputBuffer& out)
+{
+	const Feedback3DColor& P1 = S->sommet3DColor(0) ;
+	const Feedback3DColor& P2 = S->sommet3DColor(1) ;
+
+	const GLfloat dr = P2.red()   - P1.red();
+	const GLfloat dg = P2.green() - P1.green();
+	const GLfloat db = P2.blue()  - P1.blue();
+
+	if(_blackAndWhite)
+	{
+		startBatch(StrokeBatch,0.0,0.0,0.0) ;
+
+		writeCoords(P1.x(),P1.y()) ; *_content << " m " ;
+		writeCoords(P2.x(),P2.y()) ; *_content << " l\n" ;
+	}
+	else if(dr != 0 || dg != 0 || db != 0)
+	{
+		/* Smooth shaded line: one sub segment per color step, as in EPSExporter. */
+
+		const GLdouble dx = P2.x() - P1.x();
+		const GLdouble dy = P2.y() - P1.y();
+		const GLdouble distance = sqrt(dx*dx + dy*dy);
+
+		const GLfloat colormax = max(fabs(dr), max(fabs(dg), fabs(db)));
+		const int steps = int(0.5f + max(1.0, colormax * distance * EPS_SMOOTH_LINE_FACTOR));
+
+		for(int i=0;i<steps;++i)
+		{
+			const double t0 = i/(double)steps ;
+			const double t1 = (i+1)/(double)steps ;
+			const float tc = float((i+0.5)/steps) ;
+
+			startBatch(StrokeBatch,P1.red()+tc*dr,P1.green()+tc*dg,P1.blue()+tc*db) ;
+
+			writeCoords(P1.x()+t0*dx,P1.y()+t0*dy) ; *_content << " m " ;
+			writeCoords(P1.x()+t1*dx,P1.y()+t1*dy) ; *_content << " l\n" ;
+		}
+	}
+	else
+	{
+		startBatch(StrokeBatch,P1.red(),P1.green(),P1.blue()) ;
+
+		writeCoords(P1.x(),P1.y()) ; *_content << " m " ;
+		writeCoords(P2.x(),P2.y()) ; *_content << " l\n" ;
+	}
+
+	if(_content->position() >= size_t(PDF_STREAM_SIZE))
+		flushContent(out) ;
+}
+
+void PDFExporter::spewPoint(const Point *P, OutputBuffer& out)
+{
+	const Feedback3DColor& p = P->sommet3DColor(0) ;
+
+	// A zero length segment with round caps is a disc of diameter _pointSize.
+
+	if(_blackAndWhite)
+		startBatch(DotBatch,0.0,0.0,0.0) ;
+	else
+		startBatch(DotBatch,p.red(),p.green(),p.blue()) ;
+
+	writeCoords(p.x(),p.y()) ; *_content << " m " ;
+	writeCoords(p.x(),p.y()) ; *_content << " l\n" ;
+
+	if(_content->position() >= size_t(PDF_STREAM_SIZE))
+		flushContent(out) ;
+}
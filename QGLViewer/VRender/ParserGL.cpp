@@ -1,9 +1,15 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <new>
 
 #include "VRender.h"
 #include "ParserGL.h"
+#include "../taskScheduler.h"
 
 using namespace vrender ;
 using namespace std;
@@ -11,27 +17,20 @@ using namespace std;
 class ParserUtils
 {
 	public:
-		static void NormalizeBufferCoordinates(GLint size, GLfloat * buffer, GLfloat MaxSize, GLfloat& zmin, GLfloat& zmax) ;
-
 		static PtrPrimitive checkPoint(Point *& P);
 		static PtrPrimitive checkSegment(Segment *& P);
 		static PtrPrimitive checkPolygon(Polygone *& P);
 
-		static void ComputeBufferBB(GLint size, GLfloat * buffer,
-				GLfloat & xmin, GLfloat & xmax,
-				GLfloat & ymin, GLfloat & ymax,
-				GLfloat & zmin, GLfloat & zmax) ;
-
-	private:
-		static void print3DcolorVertex(GLint size, GLint * count, GLfloat * buffer) ;
-		static void debug_printBuffer(GLint size, GLfloat *buffer) ;
-
 		static void NormalizePrimitiveCoordinates(GLfloat * & loc,GLfloat MaxSize,GLfloat zmin,GLfloat zmax) ;
 		static void ComputePrimitiveBB(	GLfloat * & loc,
 				GLfloat & xmin,GLfloat & xmax,
 				GLfloat & ymin,GLfloat & ymax,
 				GLfloat & zmin,GLfloat & zmax);
 
+	private:
+		static void print3DcolorVertex(GLint size, GLint * count, GLfloat * buffer) ;
+		static void debug_printBuffer(GLint size, GLfloat *buffer) ;
+
 		static const char *nameOfToken(int token);
 
 		static const double EGALITY_EPS ;
@@ -39,12 +38,314 @@ class ParserUtils
 
 const double ParserUtils::EGALITY_EPS = 0.00001 ;
 
+//  Welds the vertices of a feedback buffer: vertices with the same position
+// and color are stored once, and shared by all the primitives that use them.
+// The comparison is exact, so that the exported files are not changed. The
+// vertices are taken from the current arena, in blocks, and are reclaimed with
+// it.
+
+class VertexPool
+{
+	public:
+		VertexPool() : _table(1024,nullptr), _size(0), _block(nullptr), _block_remaining(0) {}
+
+		const Feedback3DColor *insert(GLfloat *loc) ;
+
+	private:
+		static size_t hash(const GLfloat *loc) ;
+		static bool isEqual(const Feedback3DColor *f,const GLfloat *loc) ;
+		void grow() ;
+
+		// Open addressing, with a power of two size
+		std::vector<const Feedback3DColor *> _table ;
+		size_t _size ;
+
+		Feedback3DColor *_block ;
+		size_t _block_remaining ;
+
+		static const size_t BLOCK_SIZE = 1024 ;
+};
+
+size_t VertexPool::hash(const GLfloat *loc)
+{
+	size_t h = 2166136261u ;
+
+	for(size_t i=0;i<Feedback3DColor::sizeInBuffer();++i)
+	{
+		unsigned int bits ;
+		memcpy(&bits,loc+i,sizeof(bits)) ;
+		h = (h ^ bits) * 16777619u ;
+	}
+
+	return h ^ (h >> 15) ;
+}
+
+// Compares the bits, so that -0 and 0 are distinct.
+bool VertexPool::isEqual(const Feedback3DColor *f,const GLfloat *loc)
+{
+	const GLfloat values[7] = { GLfloat(f->x()),GLfloat(f->y()),GLfloat(f->z()),f->red(),f->green(),f->blue(),f->alpha() } ;
+
+	return memcmp(values,loc,sizeof(values)) == 0 ;
+}
+
+void VertexPool::grow()
+{
+	std::vector<const Feedback3DColor *> table(2*_table.size(),nullptr) ;
+	const size_t mask = table.size()-1 ;
+
+	for(size_t i=0;i<_table.size();++i)
+		if(_table[i] != nullptr)
+		{
+			const GLfloat loc[7] = { GLfloat(_table[i]->x()),GLfloat(_table[i]->y()),GLfloat(_table[i]->z()),
+											 _table[i]->red(),_table[i]->green(),_table[i]->blue(),_table[i]->alpha() } ;
+			size_t j = hash(loc) & mask ;
+
+			while(table[j] != nullptr)
+				j = (j+1) & mask ;
+
+			table[j] = _table[i] ;
+		}
+
+	_table.swap(table) ;
+}
+
+const Feedback3DColor *VertexPool::insert(GLfloat *loc)
+{
+	const size_t mask = _table.size()-1 ;
+	size_t j = hash(loc) & mask ;
+
+	while(_table[j] != nullptr)
+	{
+		if(isEqual(_table[j],loc))
+			return _table[j] ;
+
+		j = (j+1) & mask ;
+	}
+
+	if(_block_remaining == 0)
+	{
+		_block = static_cast<Feedback3DColor *>(Arena::allocateObject(BLOCK_SIZE*sizeof(Feedback3DColor))) ;
+		_block_remaining = BLOCK_SIZE ;
+	}
+
+	Feedback3DColor *f = new(_block) Feedback3DColor(loc) ;
+	++_block ;
+	--_block_remaining ;
+
+	_table[j] = f ;
+
+	if(2*(++_size) > _table.size())
+		grow() ;
+
+	return f ;
+}
+
+//  Primitives processed by a thread at once, and size (in floats) of the
+// smallest buffer parsed in parallel.
+
+static const size_t PRIMITIVES_PER_CHUNK = 4096 ;
+static const int PARALLEL_MIN_BUFFER_SIZE = 1 << 20 ;
+
+//  Returns the token at loc, and moves loc to the next one, as the feedback
+// buffer walks of ParserUtils do.
+
+static int nextToken(GLfloat *& loc)
+{
+	const int token = int(0.5f + *loc) ;
+	loc++ ;
+
+	switch(token)
+	{
+		case GL_LINE_TOKEN:
+		case GL_LINE_RESET_TOKEN:
+			loc += 2*Feedback3DColor::sizeInBuffer() ;
+			break ;
+		case GL_POLYGON_TOKEN:
+			loc += 1 + int(0.5f + *loc)*Feedback3DColor::sizeInBuffer() ;
+			break ;
+		case GL_POINT_TOKEN:
+			loc += Feedback3DColor::sizeInBuffer() ;
+			break ;
+		default:
+			break ;
+	}
+
+	return token ;
+}
+
+//  The arenas of the threads that process nb_chunks chunks: the current one
+// for the calling thread, and children of it, created here, for the others.
+
+static vector<Arena *> chunkArenas(size_t nb_chunks)
+{
+	size_t nb_threads = qglviewer::TaskScheduler::maxThreadCount() ;
+	nb_threads = max(size_t(1),min(nb_threads,nb_chunks)) ;
+
+	vector<Arena *> arenas(nb_threads,Arena::current()) ;
+	for(size_t t=1;t<nb_threads;++t)
+		if(arenas[t] != nullptr)
+			arenas[t] = arenas[t]->createChild() ;
+
+	return arenas ;
+}
+
+//  Calls task(c) for all the chunks c < nb_chunks, with a worker per arena run
+// on the qglviewer::TaskScheduler threads. Only the calling thread reports the
+// progress, which is also where a cancellation is noticed. The other threads
+// then stop at their next chunk.
+
+static void runOnChunks(size_t nb_chunks,const vector<Arena *>& arenas,const function<void(size_t)>& task,VRenderParams& vparams,const QString& message)
+{
+	atomic<size_t> next_chunk(0) ;
+	atomic<size_t> nb_done(0) ;
+	exception_ptr error ;
+	atomic<bool> failed(false) ;
+
+	auto worker = [&](size_t t)
+	{
+		Arena::Scope arena_scope(arenas[t]) ;
+
+		try
+		{
+			for(size_t c;(c = next_chunk.fetch_add(1)) < nb_chunks && !failed && !vparams.isCanceled();)
+			{
+				task(c) ;
+				size_t done = nb_done.fetch_add(1) + 1 ;
+
+				if(t == 0)
+					vparams.progress(done/(float)nb_chunks, message) ;
+			}
+		}
+		catch(...)
+		{
+			if(!failed.exchange(true))
+				error = current_exception() ;
+		}
+	};
+
+	//  The first worker is run by this thread.
+	qglviewer::TaskScheduler::parallelFor(int(arenas.size()),[&](int first,int last)
+	{
+		for(int t=first;t<last;++t)
+			worker(size_t(t)) ;
+	}) ;
+
+	if(failed)
+		rethrow_exception(error) ;
+
+	// Throws if the chunks were left unfinished by a cancellation
+	vparams.progress(1.0, message) ;
+}
+
+//  The primitives built from a range of tokens, in buffer order, and their
+// statistics.
+
+struct ParsedChunk
+{
+	ParsedChunk() : nb_lines(0),nb_polys(0),nb_points(0),nb_degenerated_lines(0),nb_degenerated_polys(0),nb_degenerated_points(0) {}
+
+	std::vector<PtrPrimitive> primitives ;
+	int nb_lines ;
+	int nb_polys ;
+	int nb_points ;
+	int nb_degenerated_lines ;
+	int nb_degenerated_polys ;
+	int nb_degenerated_points ;
+	GLfloat bb[6] ;
+} ;
+
+//  Appends to chunk the primitive of the token at loc.
+
+static void parsePrimitive(GLfloat *loc,bool weld,VertexPool& pool,std::vector<const Feedback3DColor *>& shared_verts,ParsedChunk& chunk)
+{
+	const int token = int(0.5f + *loc) ;
+	loc++ ;
+
+	switch (token)
+	{
+		case GL_LINE_TOKEN:
+		case GL_LINE_RESET_TOKEN:
+			{
+				Segment *S ;
+
+				if(weld)
+					S = new Segment(pool.insert(loc),pool.insert(loc+Feedback3DColor::sizeInBuffer())) ;
+				else
+					S = new Segment(Feedback3DColor(loc),Feedback3DColor(loc+Feedback3DColor::sizeInBuffer())) ;
+
+				chunk.primitives.push_back(ParserUtils::checkSegment(S)) ;
+
+				if(S == nullptr)
+					chunk.nb_degenerated_lines++ ;
+
+				chunk.nb_lines++ ;
+			}
+			break;
+
+		case GL_POLYGON_TOKEN:
+			{
+				const int nvertices = int(0.5f + *loc) ;
+				loc++;
+
+				Polygone *P ;
+
+				if(weld)
+				{
+					shared_verts.clear() ;
+
+					for(int i=0;i<nvertices;++i)
+						shared_verts.push_back(pool.insert(loc)),loc+=Feedback3DColor::sizeInBuffer() ;
+
+					P = new Polygone(shared_verts) ;
+				}
+				else
+				{
+					std::vector<Feedback3DColor> verts ;
+
+					for(int i=0;i<nvertices;++i)
+						verts.push_back(Feedback3DColor(loc)),loc+=Feedback3DColor::sizeInBuffer() ;
+
+					P = new Polygone(verts) ;
+				}
+
+				chunk.primitives.push_back(ParserUtils::checkPolygon(P)) ;
+
+				if(P == nullptr)
+					chunk.nb_degenerated_polys++ ;
+
+				chunk.nb_polys++ ;
+			}
+			break ;
+
+		case GL_POINT_TOKEN:
+			{
+				Point *Pt = weld ? new Point(pool.insert(loc)) : new Point(Feedback3DColor(loc)) ;
+
+				chunk.primitives.push_back(Pt);//ParserUtils::checkPoint(Pt)) ;
+
+				if(Pt == nullptr)
+					chunk.nb_degenerated_points++ ;
+
+				chunk.nb_points++ ;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+//  The buffer is parsed in two phases. A sequential scan first records the
+// position of each primitive token. The bounding box, the depth normalization
+// and the construction of the primitives are then done by chunks of
+// consecutive tokens, in parallel for large buffers. The chunks are
+// concatenated in the buffer order, so that the sort methods get the same
+// primitives as with a sequential parsing. Vertices are welded within each
+// chunk only.
+
 void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 												std::vector<PtrPrimitive>& primitive_tab,
 												VRenderParams& vparams)
 {
-	int token;
-	int nvertices = 0 ;
 	nb_lines = 0 ;
 	nb_polys = 0 ;
 	nb_points = 0 ;
@@ -52,7 +353,41 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 	nb_degenerated_polys = 0 ;
 	nb_degenerated_points = 0 ;
 
-	// pre-treatment of coordinates so as to get something more consistent
+	// Phase 1: positions of the primitive tokens
+
+	std::vector<GLfloat *> tokens ;
+	GLfloat *end = buffer + size;
+
+	for(GLfloat *loc = buffer;loc < end;)
+	{
+		GLfloat *start = loc ;
+		const int token = nextToken(loc) ;
+
+		if(token == GL_LINE_TOKEN || token == GL_LINE_RESET_TOKEN || token == GL_POLYGON_TOKEN || token == GL_POINT_TOKEN)
+			tokens.push_back(start) ;
+	}
+
+	const size_t nb_tokens = tokens.size() ;
+	const size_t nb_chunks = (size < PARALLEL_MIN_BUFFER_SIZE) ? 1 : max(size_t(1),(nb_tokens + PRIMITIVES_PER_CHUNK - 1)/PRIMITIVES_PER_CHUNK) ;
+	const size_t chunk_size = (nb_tokens + nb_chunks - 1)/nb_chunks ;
+	std::vector<ParsedChunk> chunks(nb_chunks) ;
+	const vector<Arena *> arenas = chunkArenas(nb_chunks) ;
+	const QString message = QGLViewer::tr("Parsing feedback buffer.") ;
+
+	// Bounding box of the buffer
+
+	runOnChunks(nb_chunks,arenas,[&](size_t c)
+	{
+		GLfloat *bb = chunks[c].bb ;
+		bb[0] = bb[2] = bb[4] = FLT_MAX ;
+		bb[1] = bb[3] = bb[5] = -FLT_MAX ;
+
+		for(size_t i=c*chunk_size;i<min(nb_tokens,(c+1)*chunk_size);++i)
+		{
+			GLfloat *loc = tokens[i] ;
+			ParserUtils::ComputePrimitiveBB(loc,bb[0],bb[1],bb[2],bb[3],bb[4],bb[5]) ;
+		}
+	},vparams,message) ;
 
 	_xmin = FLT_MAX ;
 	_ymin = FLT_MAX ;
@@ -61,85 +396,204 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 	_ymax = -FLT_MAX ;
 	_zmax = -FLT_MAX ;
 
-	ParserUtils::ComputeBufferBB(size, buffer, _xmin,_xmax,_ymin,_ymax,_zmin,_zmax) ;
+	for(size_t c=0;c<nb_chunks;++c)
+	{
+		const GLfloat *bb = chunks[c].bb ;
+		_xmin = min(_xmin,bb[0]) ; _xmax = max(_xmax,bb[1]) ;
+		_ymin = min(_ymin,bb[2]) ; _ymax = max(_ymax,bb[3]) ;
+		_zmin = min(_zmin,bb[4]) ; _zmax = max(_zmax,bb[5]) ;
+	}
 
 #ifdef DEBUGEPSRENDER
 	printf("Buffer bounding box: %f %f %f %f %f %f\n",xmin,xmax,ymin,ymax,zmin,zmax) ;
 #endif
 	float Zdepth = max(_ymax-_ymin,_xmax-_xmin) ;
-	ParserUtils::NormalizeBufferCoordinates(size,buffer,Zdepth,_zmin,_zmax) ;
 
-	// now, read buffer
-	GLfloat *end = buffer + size;
+	if(_zmax != _zmin && Zdepth != 0.0f)
+	{
+		_depth_scale = (_zmax - _zmin) / Zdepth ;
+		_depth_offset = _zmin ;
+	}
+	else
+	{
+		_depth_scale = 1.0f ;
+		_depth_offset = 0.0f ;
+	}
 
-	GLfloat *loc = buffer ;
-	int next_step = 0 ;
-	int N = size/200 + 1 ;
+	// pre-treatment of coordinates so as to get something more consistent
 
-	while (loc < end)
+	if(_zmax != _zmin)
 	{
-		token = int(0.5f + *loc) ;
-		loc++;
+		runOnChunks(nb_chunks,arenas,[&](size_t c)
+		{
+			for(size_t i=c*chunk_size;i<min(nb_tokens,(c+1)*chunk_size);++i)
+			{
+				GLfloat *loc = tokens[i] ;
+				ParserUtils::NormalizePrimitiveCoordinates(loc,Zdepth,_zmin,_zmax) ;
+			}
+		},vparams,message) ;
 
-		if((end-loc)/N >= next_step)
-			vparams.progress((end-loc)/(float)size, QGLViewer::tr("Parsing feedback buffer.")), ++next_step ;
+		_zmin = 0.0 ;
+		_zmax = Zdepth ;
+	}
 
-		switch (token)
-		{
-			case GL_LINE_TOKEN:
-			case GL_LINE_RESET_TOKEN:
-				{
-					Segment *S = new Segment(Feedback3DColor(loc),Feedback3DColor(loc+Feedback3DColor::sizeInBuffer())) ;
+	//  Phase 2: the primitives. Shared vertices belong to the arena of the
+	// export. Without one, the primitives may outlive the parser, and keep
+	// their own copies. Hidden primitives are skipped.
 
-					primitive_tab.push_back(ParserUtils::checkSegment(S)) ;
+	const bool weld = (Arena::current() != nullptr) ;
 
-					if(S == nullptr)
-						nb_degenerated_lines++ ;
+	try
+	{
+		runOnChunks(nb_chunks,arenas,[&](size_t c)
+		{
+			ParsedChunk& chunk = chunks[c] ;
+			VertexPool pool ;
+			std::vector<const Feedback3DColor *> shared_verts ;
+
+			for(size_t i=c*chunk_size;i<min(nb_tokens,(c+1)*chunk_size);++i)
+				if(_visible_primitives == nullptr || i >= _visible_primitives->size() || (*_visible_primitives)[i])
+					parsePrimitive(tokens[i],weld,pool,shared_verts,chunk) ;
+		},vparams,message) ;
+	}
+	catch(...)
+	{
+		// Canceled or failed: the primitives of the finished chunks are not
+		// returned. Without arena, nothing else would delete them.
+		for(size_t c=0;c<nb_chunks;++c)
+			for(size_t i=0;i<chunks[c].primitives.size();++i)
+				delete chunks[c].primitives[i] ;
+		throw ;
+	}
 
-					nb_lines++ ;
-					loc += 2*Feedback3DColor::sizeInBuffer();
-				}
-				break;
+	size_t nb_primitives = primitive_tab.size() ;
+	for(size_t c=0;c<nb_chunks;++c)
+		nb_primitives += chunks[c].primitives.size() ;
+	primitive_tab.reserve(nb_primitives) ;
 
-			case GL_POLYGON_TOKEN:
-				{
-					nvertices = int(0.5f + *loc) ;
-					loc++;
+	for(size_t c=0;c<nb_chunks;++c)
+	{
+		const ParsedChunk& chunk = chunks[c] ;
+		primitive_tab.insert(primitive_tab.end(),chunk.primitives.begin(),chunk.primitives.end()) ;
+
+		nb_lines += chunk.nb_lines ;
+		nb_polys += chunk.nb_polys ;
+		nb_points += chunk.nb_points ;
+		nb_degenerated_lines += chunk.nb_degenerated_lines ;
+		nb_degenerated_polys += chunk.nb_degenerated_polys ;
+		nb_degenerated_points += chunk.nb_degenerated_points ;
+	}
+}
 
-					std::vector<Feedback3DColor> verts ;
+// Transforms the homogeneous point (x,y,z,1) by the column major matrix m.
+static void transformPoint(const GLdouble m[16],double x,double y,double z,double res[4])
+{
+	for(int i=0;i<4;++i)
+		res[i] = m[i]*x + m[4+i]*y + m[8+i]*z + m[12+i] ;
+}
 
-					for(int i=0;i<nvertices;++i)
-						verts.push_back(Feedback3DColor(loc)),loc+=Feedback3DColor::sizeInBuffer() ;
+void ParserGL::unprojectPrimitives(	const std::vector<PtrPrimitive>& primitive_tab,
+												const GLdouble inverse_matrix[16],
+												std::vector<PtrPrimitive>& world_tab) const
+{
+	std::vector<Feedback3DColor> verts ;
 
-					Polygone *P = new Polygone(verts) ;
+	for(size_t i=0;i<primitive_tab.size();++i)
+	{
+		PtrPrimitive P = primitive_tab[i] ;
 
-					primitive_tab.push_back(ParserUtils::checkPolygon(P)) ;
+		if(P == nullptr)
+			continue ;
 
-					if(P == nullptr)
-						nb_degenerated_polys++ ;
+		verts.clear() ;
 
-					nb_polys++ ;
-				}
+		for(size_t j=0;j<P->nbVertices();++j)
+		{
+			const Feedback3DColor& f(P->sommet3DColor(j)) ;
+			double w[4] ;
+			transformPoint(inverse_matrix,f.x(),f.y(),f.z()*_depth_scale + _depth_offset,w) ;
+
+			if(w[3] == 0.0)
 				break ;
 
-			case GL_POINT_TOKEN:
-				{
-					Point *Pt = new Point(Feedback3DColor(loc)) ;
+			GLfloat loc[7] = { GLfloat(w[0]/w[3]),GLfloat(w[1]/w[3]),GLfloat(w[2]/w[3]),
+									 f.red(),f.green(),f.blue(),f.alpha() } ;
+			verts.push_back(Feedback3DColor(loc)) ;
+		}
 
-					primitive_tab.push_back(Pt);//ParserUtils::checkPoint(Pt)) ;
+		if(verts.size() != P->nbVertices())
+			continue ;
 
-					if(Pt == nullptr)
-						nb_degenerated_points++ ;
+		if(dynamic_cast<Polygone *>(P) != nullptr)
+			world_tab.push_back(new Polygone(verts)) ;
+		else if(dynamic_cast<Segment *>(P) != nullptr)
+			world_tab.push_back(new Segment(verts[0],verts[1])) ;
+		else
+			world_tab.push_back(new Point(verts[0])) ;
+	}
+}
 
-					nb_points++ ;
-					loc += Feedback3DColor::sizeInBuffer();
-				}
-				break;
-			default:
-				break;
+// Appends the projection of the vertex to buffer. Returns false if it is behind the eye.
+static bool pushProjectedVertex(const GLdouble matrix[16],const Feedback3DColor& f,std::vector<GLfloat>& buffer)
+{
+	double w[4] ;
+	transformPoint(matrix,f.x(),f.y(),f.z(),w) ;
+
+	if(w[3] <= 0.0)
+		return false ;
+
+	buffer.push_back(GLfloat(w[0]/w[3])) ;
+	buffer.push_back(GLfloat(w[1]/w[3])) ;
+	buffer.push_back(GLfloat(w[2]/w[3])) ;
+	buffer.push_back(f.red()) ;
+	buffer.push_back(f.green()) ;
+	buffer.push_back(f.blue()) ;
+	buffer.push_back(f.alpha()) ;
+
+	return true ;
+}
+
+void ParserGL::projectPrimitives(	const std::vector<PtrPrimitive>& world_tab,
+												const GLdouble matrix[16],
+												std::vector<GLfloat>& buffer)
+{
+	buffer.clear() ;
+
+	for(size_t i=0;i<world_tab.size();++i)
+	{
+		PtrPrimitive P = world_tab[i] ;
+		size_t start = buffer.size() ;
+		bool visible = true ;
+
+		if(dynamic_cast<Polygone *>(P) != nullptr)
+		{
+			// Polygons of the BSP are convex: a fan gives the triangles expected by the parser.
+
+			for(size_t j=1;j+1<P->nbVertices() && visible;++j)
+			{
+				buffer.push_back(GLfloat(GL_POLYGON_TOKEN)) ;
+				buffer.push_back(3.0f) ;
+
+				visible = 	pushProjectedVertex(matrix,P->sommet3DColor(0),buffer)
+							&& pushProjectedVertex(matrix,P->sommet3DColor(j),buffer)
+							&& pushProjectedVertex(matrix,P->sommet3DColor(j+1),buffer) ;
+			}
+		}
+		else if(P->nbVertices() == 2)
+		{
+			buffer.push_back(GLfloat(GL_LINE_TOKEN)) ;
+			visible = 	pushProjectedVertex(matrix,P->sommet3DColor(0),buffer)
+						&& pushProjectedVertex(matrix,P->sommet3DColor(1),buffer) ;
+		}
+		else
+		{
+			buffer.push_back(GLfloat(GL_POINT_TOKEN)) ;
+			visible = pushProjectedVertex(matrix,P->sommet3DColor(0),buffer) ;
 		}
-	}
 
+		if(!visible)
+			buffer.resize(start) ;
+	}
 }
 
 // Traitement des cas degeneres. Renvoie false si le polygone est degenere.
@@ -154,7 +608,7 @@ PtrPrimitive ParserUtils::checkSegment(Segment *& P)
 {
 	if((P->vertex(0) - P->vertex(1)).infNorm() < EGALITY_EPS)
 	{
-		Point *pp = new Point(P->sommet3DColor(0)) ;
+		Point *pp = P->sharesVertices() ? new Point(&P->sommet3DColor(0)) : new Point(P->sommet3DColor(0)) ;
 		delete P ;
 		P = nullptr ;
 
@@ -170,6 +624,7 @@ PtrPrimitive ParserUtils::checkPolygon(Polygone *& P)
 	{
 		cout << "unexpected case: Polygon with " << P->nbVertices() << " vertices !" << endl ;
 		delete P ;
+		P = nullptr ;
 		return nullptr ;
 	}
 
@@ -182,14 +637,20 @@ PtrPrimitive ParserUtils::checkPolygon(Polygone *& P)
 		for(size_t i=0;i<n;++i)
 			if( (P->vertex(i) - P->vertex((i+1)%n)).norm() > EGALITY_EPS)
 			{
-				Segment *pp = new Segment(P->sommet3DColor((i+1)%n),P->sommet3DColor((i+2)%n)) ;
+				Segment *pp ;
+
+				if(P->sharesVertices())
+					pp = new Segment(&P->sommet3DColor((i+1)%n),&P->sommet3DColor((i+2)%n)) ;
+				else
+					pp = new Segment(P->sommet3DColor((i+1)%n),P->sommet3DColor((i+2)%n)) ;
+
 				delete P ;
 				P = nullptr ;
 
 				return checkSegment(pp) ;
 			}
 
-		Point *pp = new Point(P->sommet3DColor(0)) ;
+		Point *pp = P->sharesVertices() ? new Point(&P->sommet3DColor(0)) : new Point(P->sommet3DColor(0)) ;
 		delete P ;
 		P = nullptr ;
 
@@ -377,42 +838,6 @@ void ParserUtils::ComputePrimitiveBB(GLfloat * & loc,GLfloat & xmin,GLfloat & xm
 	}
 }
 
-void ParserUtils::NormalizeBufferCoordinates(GLint size, GLfloat * buffer, GLfloat MaxSize, GLfloat& zmin,GLfloat& zmax)
-{
-	GLfloat *loc, *end;
-
-	if(zmax == zmin)
-	{
-#ifdef DEBUGEPSRENDER
-		printf("Warning: zmin = zmax in NormalizePrimitiveCoordinates\n") ;
-#endif
-		return ;
-	}
-
-	loc = buffer;
-	end = buffer + size;
-
-	while (loc < end)
-		NormalizePrimitiveCoordinates(loc,MaxSize,zmin,zmax);
-
-	zmin = 0.0 ;
-	zmax = MaxSize ;
-}
-
-void ParserUtils::ComputeBufferBB(GLint size, GLfloat * buffer,
-		     GLfloat & xmin, GLfloat & xmax,
-		     GLfloat & ymin, GLfloat & ymax,
-		     GLfloat & zmin, GLfloat & zmax)
-{
-	GLfloat *loc, *end;
-
-	loc = buffer;
-	end = buffer + size;
-
-	while (loc < end)
-		ComputePrimitiveBB(loc,xmin,xmax,ymin,ymax,zmin,zmax);
-}
-
 typedef struct _DepthIndex {
   GLfloat *ptr;
   GLfloat depth;
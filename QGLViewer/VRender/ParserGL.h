@@ -12,12 +12,37 @@ namespace vrender
 	class ParserGL
 	{
 		public:
+			ParserGL() : _visible_primitives(nullptr) {}
+
 			void parseFeedbackBuffer(	GLfloat *,
 												int size,
 												std::vector<PtrPrimitive>& primitive_tab,
 												VRenderParams& vparams) ;
 			void printStats() const ;
 
+			//  When set, the i-th point, segment or polygon of the next parsed
+			// buffers is skipped if (*visible)[i] is false (see IdBufferCuller).
+
+			void setVisiblePrimitives(const std::vector<bool> *visible) { _visible_primitives = visible ; }
+
+			//  Appends to world_tab copies of the primitives, which come from the
+			// last parsed buffer, transformed back to world coordinates.
+			// inverse_matrix is the inverse of the window coordinates matrix
+			// (viewport * projection * modelview, column major).
+
+			void unprojectPrimitives(	const std::vector<PtrPrimitive>& primitive_tab,
+												const GLdouble inverse_matrix[16],
+												std::vector<PtrPrimitive>& world_tab) const ;
+
+			//  Fills buffer with the primitives of world_tab transformed by matrix,
+			// in the feedback buffer format parsed by parseFeedbackBuffer().
+			// Polygons are split in triangles, and primitives that have a vertex
+			// behind the eye are skipped.
+
+			static void projectPrimitives(	const std::vector<PtrPrimitive>& world_tab,
+													const GLdouble matrix[16],
+													std::vector<GLfloat>& buffer) ;
+
 			inline GLfloat xmin() const { return _xmin ; }
 			inline GLfloat ymin() const { return _ymin ; }
 			inline GLfloat zmin() const { return _zmin ; }
@@ -38,6 +63,12 @@ namespace vrender
 			GLfloat _xmax ;
 			GLfloat _ymax ;
 			GLfloat _zmax ;
+
+			const std::vector<bool> *_visible_primitives ;
+
+			// Window depth of a normalized z: zwindow = z*_depth_scale + _depth_offset
+			GLfloat _depth_scale ;
+			GLfloat _depth_offset ;
 	};
 }
 
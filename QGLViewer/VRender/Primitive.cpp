@@ -1,5 +1,6 @@
 #include <math.h>
 #include <assert.h>
+#include <new>
 #include "Primitive.h"
 #include "Types.h"
 
@@ -7,62 +8,115 @@ using namespace vrender ;
 using namespace std ;
 
 
+Primitive::~Primitive()
+{
+	for(size_t i=0;i<_nb_copies;++i)
+		_copies[i].~Feedback3DColor() ;
+
+	Arena::deallocateObject(_copies) ;
+}
+
+const Feedback3DColor *Primitive::copyVertices(const Feedback3DColor *f,size_t n)
+{
+	assert(_copies == nullptr) ;
+
+	_copies = static_cast<Feedback3DColor *>(Arena::allocateObject(n*sizeof(Feedback3DColor))) ;
+
+	for(;_nb_copies<n;++_nb_copies)
+		new(_copies+_nb_copies) Feedback3DColor(f[_nb_copies]) ;
+
+	return _copies ;
+}
+
 Point::Point(const Feedback3DColor& f)
-	: _position_and_color(f)
+	: _position_and_color(copyVertices(&f,1))
 {
 }
 
 const Vector3& Point::vertex(size_t) const
 {
-	return _position_and_color.pos() ;
+	return _position_and_color->pos() ;
 }
 
 const Feedback3DColor& Point::sommet3DColor(size_t) const
 {
-	return _position_and_color ;
+	return *_position_and_color ;
+}
+
+Segment::Segment(const Feedback3DColor & p1, const Feedback3DColor & p2)
+{
+	const Feedback3DColor f[2] = { p1,p2 } ;
+	P1 = copyVertices(f,2) ;
+	P2 = P1+1 ;
 }
 
 const Feedback3DColor& Segment::sommet3DColor(size_t i) const
 {
-	return ( (i&1)==0 )?P1:P2 ;
+	return ( (i&1)==0 )?*P1:*P2 ;
 }
 
 AxisAlignedBox_xyz Point::bbox() const
 {
-	return AxisAlignedBox_xyz(_position_and_color.pos(),_position_and_color.pos()) ;
+	return AxisAlignedBox_xyz(_position_and_color->pos(),_position_and_color->pos()) ;
 }
 
 const Vector3& Segment::vertex(size_t i) const
 {
-	return ( (i&1)==0 )?P1.pos():P2.pos() ;
+	return ( (i&1)==0 )?P1->pos():P2->pos() ;
 }
 
 AxisAlignedBox_xyz Segment::bbox() const
 {
-	AxisAlignedBox_xyz B(P1.pos());
-	B.include(P2.pos()) ;
+	AxisAlignedBox_xyz B(P1->pos());
+	B.include(P2->pos()) ;
 
 	return B ;
 }
 
 const Feedback3DColor& Polygone::sommet3DColor(size_t i) const
 {
-	return _vertices[i % nbVertices()] ;
+	return *_vertices[i % nbVertices()] ;
 }
 
 const Vector3& Polygone::vertex(size_t i) const
 {
-	return _vertices[i % nbVertices()].pos() ;
+	return _vertices[i % nbVertices()]->pos() ;
 }
 
 
 Polygone::Polygone(const vector<Feedback3DColor>& fc)
-	: _vertices(fc)
+	: _nb_vertices(fc.size())
+{
+	const Feedback3DColor *copies = copyVertices(&fc[0],fc.size()) ;
+
+	_vertices = static_cast<const Feedback3DColor **>(Arena::allocateObject(_nb_vertices*sizeof(Feedback3DColor *))) ;
+
+	for(size_t i=0;i<_nb_vertices;i++)
+	{
+		_vertices[i] = copies+i ;
+		_bbox.include(copies[i].pos()) ;
+	}
+
+	initNormal() ;
+}
+
+Polygone::Polygone(const vector<const Feedback3DColor *>& fc)
+	: _nb_vertices(fc.size())
 {
+	_vertices = static_cast<const Feedback3DColor **>(Arena::allocateObject(_nb_vertices*sizeof(Feedback3DColor *))) ;
+
+	for(size_t i=0;i<_nb_vertices;i++)
+	{
+		_vertices[i] = fc[i] ;
+		_bbox.include(fc[i]->pos()) ;
+	}
+
 	initNormal() ;
+}
 
-	for(size_t i=0;i<fc.size();i++)
-		_bbox.include(fc[i].pos()) ;
+Polygone::~Polygone()
+{
+	Arena::deallocateObject(_vertices) ;
 }
 
 AxisAlignedBox_xyz Polygone::bbox() const
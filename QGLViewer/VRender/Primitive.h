@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "AxisAlignedBox.h"
+#include "Arena.h"
 #include "Vector3.h"
 #include "NVector3.h"
 #include "Types.h"
@@ -73,11 +74,20 @@ namespace vrender
 
 	// A primitive is an entity
 	//
+	//  The vertices of a primitive are either shared with other primitives, or
+	// copied when it is created from Feedback3DColor values. Shared vertices
+	// (see ParserGL) belong to the current export Arena, and must outlive the
+	// primitives that use them.
+
 	class Primitive
 	{
 	public:
-		virtual ~Primitive() {}
+		Primitive() : _copies(nullptr), _nb_copies(0) {}
+		virtual ~Primitive() ;
 
+		// Primitives are taken from the current export Arena (see VectorialRender()).
+		static void *operator new(size_t size) { return Arena::allocateObject(size) ; }
+		static void operator delete(void *p) { Arena::deallocateObject(p) ; }
 
 		virtual const Feedback3DColor& sommet3DColor(size_t) const =0 ;
 
@@ -98,15 +108,28 @@ namespace vrender
 		virtual AxisAlignedBox_xyz bbox() const = 0 ;
 		virtual size_t nbVertices() const = 0 ;
 
+		// True when the vertices are not owned by this primitive.
+		bool sharesVertices() const { return _copies == nullptr ; }
+
 		protected:
+		// Copies the n vertices of f in storage released with the primitive.
+		const Feedback3DColor *copyVertices(const Feedback3DColor *f,size_t n) ;
 
 		int _vibility ;
+
+		private:
+		Primitive(const Primitive&) ;
+		Primitive& operator=(const Primitive&) ;
+
+		Feedback3DColor *_copies ;
+		size_t _nb_copies ;
 	} ;
 
 	class Point: public Primitive
 	{
 	public:
 		Point(const Feedback3DColor& f);
+		Point(const Feedback3DColor *f) : _position_and_color(f) {}
 		virtual ~Point() {}
 
 		virtual const Vector3& vertex(size_t) const ;
@@ -115,13 +138,14 @@ namespace vrender
 		virtual AxisAlignedBox_xyz bbox() const ;
 
 		private:
-		Feedback3DColor _position_and_color ;
+		const Feedback3DColor *_position_and_color ;
 	};
 
 	class Segment: public Primitive
 	{
 	public:
-		Segment(const Feedback3DColor & p1, const Feedback3DColor & p2): P1(p1), P2(p2) {}
+		Segment(const Feedback3DColor & p1, const Feedback3DColor & p2) ;
+		Segment(const Feedback3DColor *p1, const Feedback3DColor *p2): P1(p1), P2(p2) {}
 		virtual ~Segment() {}
 		virtual size_t nbVertices() const { return 2 ; }
 		virtual const Vector3& vertex(size_t) const ;
@@ -132,8 +156,8 @@ namespace vrender
 #endif
 
 		protected:
-		Feedback3DColor P1 ;
-		Feedback3DColor P2 ;
+		const Feedback3DColor *P1 ;
+		const Feedback3DColor *P2 ;
 	} ;
 
 
@@ -141,7 +165,8 @@ namespace vrender
 	{
 	public:
 		Polygone(const std::vector<Feedback3DColor>&) ;
-		virtual ~Polygone() {}
+		Polygone(const std::vector<const Feedback3DColor *>&) ;
+		virtual ~Polygone() ;
 #ifdef A_FAIRE
 		virtual int IsAPolygon() { return 1 ; }
 		virtual void Split(const Vector3&,FLOAT,Primitive * &,Primitive * &) ;
@@ -149,7 +174,7 @@ namespace vrender
 #endif
 		virtual const Feedback3DColor& sommet3DColor(size_t) const ;
 		virtual const Vector3& vertex(size_t) const ;
-		virtual size_t nbVertices() const { return _vertices.size() ; }
+		virtual size_t nbVertices() const { return _nb_vertices ; }
 		virtual AxisAlignedBox_xyz bbox() const ;
 		double equation(const Vector3& p) const ;
 		const NVector3& normal() const { return _normal ; }
@@ -162,7 +187,8 @@ namespace vrender
 		void CheckInfoForPositionOperators() ;
 
 		AxisAlignedBox_xyz _bbox ;
-		std::vector<Feedback3DColor> _vertices ;
+		const Feedback3DColor **_vertices ;	// from the current export Arena
+		size_t _nb_vertices ;
 		// std::vector<FLOAT> _sommetsProjetes ;
 		// Vector3 N,M,L ;
 		double anglefactor ;		//  Determine a quel point un polygone est plat.
@@ -0,0 +1,263 @@
+#include <vector>
+#include <math.h>
+#include "VRender.h"
+#include "Optimizer.h"
+#include "Primitive.h"
+
+using namespace std ;
+using namespace vrender ;
+
+//  Relative distance of a vertex to the plane of a polygon under which both
+// are considered coplanar.
+
+static const double COPLANARITY_EPS = 1e-7 ;
+
+PrimitiveFilterOptimizer::PrimitiveFilterOptimizer(const GLfloat viewport[4])
+{
+	for(int i=0;i<4;++i)
+		_viewport[i] = viewport[i] ;
+}
+
+static bool samePosition(const Feedback3DColor& f1,const Feedback3DColor& f2)
+{
+	return f1.x() == f2.x() && f1.y() == f2.y() && f1.z() == f2.z() ;
+}
+
+static bool sameColor(const Feedback3DColor& f1,const Feedback3DColor& f2)
+{
+	return f1.red() == f2.red() && f1.green() == f2.green()
+		&& f1.blue() == f2.blue() && f1.alpha() == f2.alpha() ;
+}
+
+static double cross2D(const Feedback3DColor& a,const Feedback3DColor& b,const Feedback3DColor& c)
+{
+	return (b.x() - a.x())*(c.y() - b.y()) - (b.y() - a.y())*(c.x() - b.x()) ;
+}
+
+//  Convex in window coordinates: all the turns have the same sign. Aligned
+// vertices are accepted.
+
+static bool isConvex(const vector<const Feedback3DColor *>& v)
+{
+	bool pos = false ;
+	bool neg = false ;
+
+	for(size_t i=0;i<v.size();++i)
+	{
+		double c = cross2D(*v[i],*v[(i+1)%v.size()],*v[(i+2)%v.size()]) ;
+
+		pos = pos || c > 0.0 ;
+		neg = neg || c < 0.0 ;
+	}
+
+	return !(pos && neg) ;
+}
+
+//  Returns the Segment that replaces P when it is thinner than min_size
+// pixels (twice its area over its longest edge), or nullptr.
+
+static Segment *slimPolygon(const Polygone *P,double min_size)
+{
+	double area = 0.0 ;
+	double longest = 0.0 ;
+
+	for(size_t i=0;i<P->nbVertices();++i)
+	{
+		const Vector3& v1 = P->vertex(i) ;
+		const Vector3& v2 = P->vertex(i+1) ;
+
+		area += v1.x()*v2.y() - v2.x()*v1.y() ;
+		longest = max(longest,sqrt((v2.x()-v1.x())*(v2.x()-v1.x()) + (v2.y()-v1.y())*(v2.y()-v1.y()))) ;
+	}
+
+	if(longest == 0.0 || fabs(area) >= min_size*longest)
+		return nullptr ;
+
+	//  The segment joins the two farthest vertices.
+
+	size_t i1 = 0 ;
+	size_t i2 = 1 ;
+	double d2 = -1.0 ;
+
+	for(size_t i=0;i<P->nbVertices();++i)
+		for(size_t j=i+1;j<P->nbVertices();++j)
+		{
+			double dx = P->vertex(j).x() - P->vertex(i).x() ;
+			double dy = P->vertex(j).y() - P->vertex(i).y() ;
+
+			if(dx*dx + dy*dy > d2)
+			{
+				d2 = dx*dx + dy*dy ;
+				i1 = i ;
+				i2 = j ;
+			}
+		}
+
+	if(P->sharesVertices())
+		return new Segment(&P->sommet3DColor(i1),&P->sommet3DColor(i2)) ;
+	else
+		return new Segment(P->sommet3DColor(i1),P->sommet3DColor(i2)) ;
+}
+
+//  Inserts in v the vertex of the triangle T that is not on an edge of v,
+// when T shares this edge (in the opposite direction, for the same
+// orientation). Returns false when T is not adjacent to v.
+
+static bool addAdjacentTriangle(vector<const Feedback3DColor *>& v,const Polygone *T)
+{
+	for(size_t e=0;e<v.size();++e)
+		for(size_t k=0;k<3;++k)
+			if(samePosition(T->sommet3DColor(k),*v[(e+1)%v.size()]) && samePosition(T->sommet3DColor(k+1),*v[e]))
+			{
+				v.insert(v.begin()+e+1,&T->sommet3DColor(k+2)) ;
+				return true ;
+			}
+
+	return false ;
+}
+
+void PrimitiveFilterOptimizer::optimize(std::vector<PtrPrimitive>& primitives_tab,VRenderParams& vparams)
+{
+	const double min_size = vparams.minimumPrimitiveSize() ;
+	const double xmin = _viewport[0] ;
+	const double ymin = _viewport[1] ;
+	const double xmax = _viewport[0] + _viewport[2] ;
+	const double ymax = _viewport[1] + _viewport[3] ;
+
+	int nb_clipped = 0 ;
+	int nb_culled = 0 ;
+	int nb_slimmed = 0 ;
+	int nb_merged = 0 ;
+
+	size_t N = primitives_tab.size()/200 + 1 ;
+
+	//  1 - Primitives outside of the viewport, or too small to be seen.
+
+	for(size_t i=0;i<primitives_tab.size();++i)
+	{
+		if(i%N == 0)
+			vparams.progress(i/(float)primitives_tab.size(), QGLViewer::tr("Filtering primitives")) ;
+
+		AxisAlignedBox_xyz B = primitives_tab[i]->bbox() ;
+
+		if(B.maxi().x() < xmin || B.mini().x() > xmax || B.maxi().y() < ymin || B.mini().y() > ymax)
+		{
+			delete primitives_tab[i] ;
+			primitives_tab[i] = nullptr ;
+			++nb_clipped ;
+			continue ;
+		}
+
+		if(dynamic_cast<Point *>(primitives_tab[i]) != nullptr)
+			continue ;
+
+		if(B.maxi().x() - B.mini().x() < min_size && B.maxi().y() - B.mini().y() < min_size)
+		{
+			delete primitives_tab[i] ;
+			primitives_tab[i] = nullptr ;
+			++nb_culled ;
+			continue ;
+		}
+
+		Polygone *P = dynamic_cast<Polygone *>(primitives_tab[i]) ;
+		Segment *S ;
+
+		if(P != nullptr && (S = slimPolygon(P,min_size)) != nullptr)
+		{
+			delete primitives_tab[i] ;
+			primitives_tab[i] = S ;
+			++nb_slimmed ;
+		}
+	}
+
+	// Rule out gaps. This avoids testing for null primitives later.
+
+	size_t j=0 ;
+	for(size_t k=0;k<primitives_tab.size();++k)
+		if(primitives_tab[k] != nullptr)
+			primitives_tab[j++] = primitives_tab[k] ;
+
+	primitives_tab.resize(j) ;
+
+	//  2 - Successive coplanar triangles of the same color that share an edge,
+	// as issued by triangle strips and fans, are merged in a convex polygon.
+
+	vector<PtrPrimitive> merged_tab ;
+	merged_tab.reserve(primitives_tab.size()) ;
+
+	for(size_t i=0;i<primitives_tab.size();)
+	{
+		Polygone *P = dynamic_cast<Polygone *>(primitives_tab[i]) ;
+		bool uniform = (P != nullptr) ;
+
+		for(size_t k=1;uniform && k<P->nbVertices();++k)
+			uniform = sameColor(P->sommet3DColor(k),P->sommet3DColor(0)) ;
+
+		if(!uniform)
+		{
+			merged_tab.push_back(primitives_tab[i++]) ;
+			continue ;
+		}
+
+		vector<const Feedback3DColor *> v ;
+		for(size_t k=0;k<P->nbVertices();++k)
+			v.push_back(&P->sommet3DColor(k)) ;
+
+		bool shared = P->sharesVertices() ;
+		const double eps = COPLANARITY_EPS*(1.0 + fabs(P->c())) ;
+		size_t last = i+1 ;
+
+		for(;last<primitives_tab.size();++last)
+		{
+			Polygone *T = dynamic_cast<Polygone *>(primitives_tab[last]) ;
+
+			if(T == nullptr || T->nbVertices() != 3)
+				break ;
+
+			bool same = true ;
+			for(size_t k=0;same && k<3;++k)
+				same = sameColor(T->sommet3DColor(k),*v[0]) && fabs(P->equation(T->vertex(k))) <= eps ;
+
+			vector<const Feedback3DColor *> w(v) ;
+
+			if(!same || !addAdjacentTriangle(w,T) || !isConvex(w))
+				break ;
+
+			v.swap(w) ;
+			shared = shared && T->sharesVertices() ;
+		}
+
+		if(last == i+1)
+		{
+			merged_tab.push_back(primitives_tab[i++]) ;
+			continue ;
+		}
+
+		Polygone *M ;
+
+		if(shared)
+			M = new Polygone(v) ;
+		else
+		{
+			vector<Feedback3DColor> copies ;
+			for(size_t k=0;k<v.size();++k)
+				copies.push_back(*v[k]) ;
+
+			M = new Polygone(copies) ;
+		}
+
+		for(size_t k=i;k<last;++k)
+			delete primitives_tab[k] ;
+
+		merged_tab.push_back(M) ;
+		nb_merged += (int)(last-i-1) ;
+		i = last ;
+	}
+
+	primitives_tab.swap(merged_tab) ;
+
+#ifdef DEBUG_FILTER
+	cout << "Primitive filter: " << nb_clipped << " outside of the viewport, " << nb_culled << " too small, "
+		  << nb_slimmed << " replaced by segments, " << nb_merged << " merged." << endl ;
+#endif
+}
@@ -122,13 +122,181 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P,const Segmen
 	return res ;
 }
 
+// Returns the orientation (1 or -1) of a convex polygon in the XY plane, or 0
+// if the polygon is not convex (or flat).
+
+static int convexOrientation_XY(const Polygone *P)
+{
+	int orientation = 0 ;
+
+	for(size_t i=0;i<P->nbVertices();++i)
+	{
+		const Vector3& a = P->vertex(i) ;
+		const Vector3& b = P->vertex(i+1) ;
+		const Vector3& c = P->vertex(i+2) ;
+
+		const double z = (b.x()-a.x())*(c.y()-b.y()) - (b.y()-a.y())*(c.x()-b.x()) ;
+
+		if(z == 0.0)
+			continue ;
+
+		const int s = (z > 0.0)?1:-1 ;
+
+		if(orientation == 0)
+			orientation = s ;
+		else if(s != orientation)
+			return 0 ;
+	}
+
+	return orientation ;
+}
+
+// Returns true if one edge of P is a separating axis of P and Q in the XY
+// plane. Polygons which overlap by less than I_EPS are separated.
+
+static bool separatedByEdge_XY(const Polygone *P,const Polygone *Q,double I_EPS)
+{
+	for(size_t i=0;i<P->nbVertices();++i)
+	{
+		const Vector3& a = P->vertex(i) ;
+		const Vector3& b = P->vertex(i+1) ;
+
+		double nx = a.y()-b.y() ;
+		double ny = b.x()-a.x() ;
+		const double n = sqrt(nx*nx+ny*ny) ;
+
+		if(n == 0.0)
+			continue ;
+
+		nx /= n ;
+		ny /= n ;
+
+		double pmin = FLT_MAX, pmax = -FLT_MAX ;
+		double qmin = FLT_MAX, qmax = -FLT_MAX ;
+
+		for(size_t j=0;j<P->nbVertices();++j)
+		{
+			const double d = nx*P->vertex(j).x() + ny*P->vertex(j).y() ;
+			pmin = std::min(pmin,d) ;
+			pmax = std::max(pmax,d) ;
+		}
+
+		for(size_t j=0;j<Q->nbVertices();++j)
+		{
+			const double d = nx*Q->vertex(j).x() + ny*Q->vertex(j).y() ;
+			qmin = std::min(qmin,d) ;
+			qmax = std::max(qmax,d) ;
+		}
+
+		if(pmax <= qmin + I_EPS || qmax <= pmin + I_EPS)
+			return true ;
+	}
+
+	return false ;
+}
+
+//  Clips the convex polygon P1 by the convex polygon P2 of orientation
+// orientation2 (Sutherland-Hodgman). The result has at most n1+n2 vertices and
+// is written to out, using tmp as a temporary buffer. Both buffers have
+// capacity vertices. Returns false if rounding errors made it overflow.
+
+static bool clipConvex_XY(const Polygone *P1,const Polygone *P2,int orientation2,gpc_vertex *out,gpc_vertex *tmp,size_t capacity,size_t& nb_vertices)
+{
+	// The last clipping edge writes to out.
+
+	gpc_vertex *src = ((P2->nbVertices() % 2) == 0)?out:tmp ;
+	gpc_vertex *dst = ((P2->nbVertices() % 2) == 0)?tmp:out ;
+	size_t n = P1->nbVertices() ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		src[i].x = P1->vertex(i).x() ;
+		src[i].y = P1->vertex(i).y() ;
+	}
+
+	for(size_t j=0;j<P2->nbVertices() && n > 0;++j)
+	{
+		const Vector3& a = P2->vertex(j) ;
+		const Vector3& b = P2->vertex(j+1) ;
+		const double ex = b.x()-a.x() ;
+		const double ey = b.y()-a.y() ;
+
+		size_t m = 0 ;
+
+		for(size_t i=0;i<n;++i)
+		{
+			const gpc_vertex& p = src[i] ;
+			const gpc_vertex& q = src[(i+1)%n] ;
+
+			const double dp = orientation2*(ex*(p.y-a.y()) - ey*(p.x-a.x())) ;
+			const double dq = orientation2*(ex*(q.y-a.y()) - ey*(q.x-a.x())) ;
+
+			if(m+2 > capacity)
+				return false ;
+
+			if(dp >= 0.0)
+				dst[m++] = p ;
+
+			if((dp >= 0.0) != (dq >= 0.0))
+			{
+				const double t = dp/(dp-dq) ;
+
+				dst[m].x = p.x + t*(q.x-p.x) ;
+				dst[m].y = p.y + t*(q.y-p.y) ;
+				++m ;
+			}
+		}
+
+		std::swap(src,dst) ;
+		n = m ;
+	}
+
+	nb_vertices = n ;
+	return true ;
+}
+
 // Computes the relative position of a polygon toward a convex polygon.
 
 int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polygone *P2)
 {
-	// 1 - use gpc to conservatively check for intersection. This works fine because
-	//    gpc produces a null intersection for polygons sharing an edge, which
-	//    is exactly what we need.
+	// 1 - Convex polygons (the usual case): separating axis test, then direct
+	//    clipping. Polygons sharing an edge are separated, like with gpc below.
+
+	const int orientation1 = convexOrientation_XY(P1) ;
+	const int orientation2 = convexOrientation_XY(P2) ;
+
+	if(orientation1 != 0 && orientation2 != 0)
+	{
+		if(separatedByEdge_XY(P1,P2,_EPS) || separatedByEdge_XY(P2,P1,_EPS))
+			return Independent ;
+
+		static const size_t STACK_SIZE = 32 ;
+		const size_t capacity = std::max(STACK_SIZE,2*(P1->nbVertices() + P2->nbVertices())) ;
+
+		gpc_vertex stack_buffer[2*STACK_SIZE] ;
+		std::vector<gpc_vertex> heap_buffer ;
+		gpc_vertex *buffer = stack_buffer ;
+
+		if(capacity > STACK_SIZE)
+		{
+			heap_buffer.resize(2*capacity) ;
+			buffer = &heap_buffer[0] ;
+		}
+
+		size_t n ;
+
+		if(clipConvex_XY(P1,P2,orientation2,buffer,buffer+capacity,capacity,n))
+		{
+			if(n < 3)
+				return Independent ;
+
+			return computeRelativePosition(P1,P2,buffer,long(n)) ;
+		}
+	}
+
+	// 2 - Non convex polygons (or clipping failure): use gpc to conservatively check for
+	//    intersection. This works fine because gpc produces a null
+	//    intersection for polygons sharing an edge, which is exactly what we need.
 
 	gpc_polygon gpc_int ;
 
@@ -156,30 +324,49 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polyg
 		// throw runtime_error("Intersection with more than 1 contour ! Non convex polygons ?") ;
 	  }
 
-	// 2 - polygons are not independent. Compute their relative position.
-	//    For this, we project the vertices of the 2D intersection onto the
-	//   support plane of each polygon. The epsilon-signs of each point toward
-	//   both planes give the relative position of the polygons.
+	try
+	{
+		res = computeRelativePosition(P1,P2,gpc_int.contour[0].vertex,gpc_int.contour[0].num_vertices) ;
+	}
+	catch(exception&)
+	{
+		gpc_free_polygon(&gpc_int) ;
+		throw ;
+	}
 
-	for(long i=0;i<gpc_int.contour[0].num_vertices && (res < (Upper | Lower));++i)
+	gpc_free_polygon(&gpc_int) ;
+	return res ;
+}
+
+//  Polygons are not independent, and their 2D intersection is the polygon
+// of vertices intersection. Computes their relative position.
+//  For this, we project the vertices of the 2D intersection onto the
+// support plane of each polygon. The epsilon-signs of each point toward
+// both planes give the relative position of the polygons.
+
+int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polygone *P2,const gpc_vertex *intersection,long nb_vertices)
+{
+	int res = Independent ;
+
+	for(long i=0;i<nb_vertices && (res < (Upper | Lower));++i)
 	{
 		if(P1->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 		if(P2->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 
 		// project point onto support planes
 
-		double f1 = P1->normal().x() * gpc_int.contour[0].vertex[i].x + P1->normal().y() * gpc_int.contour[0].vertex[i].y - P1->c() ;
-		double f2 = P2->normal().x() * gpc_int.contour[0].vertex[i].x + P2->normal().y() * gpc_int.contour[0].vertex[i].y - P2->c() ;
+		double f1 = P1->normal().x() * intersection[i].x + P1->normal().y() * intersection[i].y - P1->c() ;
+		double f2 = P2->normal().x() * intersection[i].x + P2->normal().y() * intersection[i].y - P2->c() ;
 
-		Vector3 v1(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f1/P1->normal().z()) ;
-		Vector3 v2(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f2/P2->normal().z()) ;
+		Vector3 v1(intersection[i].x,intersection[i].y, -f1/P1->normal().z()) ;
+		Vector3 v2(intersection[i].x,intersection[i].y, -f2/P2->normal().z()) ;
 
 		if(P1->equation(v2) < -_EPS) res |= Lower ;
 		if(P1->equation(v2) >  _EPS) res |= Upper ;
 		if(P2->equation(v1) < -_EPS) res |= Upper ;
 		if(P2->equation(v1) >  _EPS) res |= Lower ;
 	}
-	gpc_free_polygon(&gpc_int) ;
+
 	return res ;
 }
 
@@ -34,6 +34,7 @@ namespace vrender
 			static int computeRelativePosition(const Polygone  *p1,const Segment   *p2) ;
 			static int computeRelativePosition(const Polygone  *p1,const Point     *p2) ;
 			static int computeRelativePosition(const Segment   *p1,const Segment   *p2) ;
+			static int computeRelativePosition(const Polygone  *p1,const Polygone  *p2,const gpc_vertex *intersection,long nb_vertices) ;
 
 			//  2D intersection/positioning methods. Parameter I_EPS may be positive of negative
 			// depending on the wanted degree of conservativeness of the result.
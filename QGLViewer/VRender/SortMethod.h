@@ -8,6 +8,7 @@ namespace vrender
 {
 	// Class which implements the sorting of the primitives. An object of
 	class VRenderParams ;
+	class Exporter ;
 	class SortMethod
 	{
 		public:
@@ -16,6 +17,12 @@ namespace vrender
 
 			virtual void sortPrimitives(std::vector<PtrPrimitive>&,VRenderParams&) = 0 ;
 
+			//  Sorts the primitives and sends them to the exporter in back to front
+			// order. The primitives that remain in the array must be deleted by the
+			// caller. Default sorts the whole array, then exports it.
+
+			virtual void sortAndExportPrimitives(std::vector<PtrPrimitive>&,VRenderParams&,Exporter&) ;
+
 			void SetZDepth(FLOAT s) { zSize = s ; }
 			FLOAT ZDepth() const { return zSize ; }
 
@@ -39,6 +46,7 @@ namespace vrender
 			virtual ~BSPSortMethod() {}
 
 			virtual void sortPrimitives(std::vector<PtrPrimitive>&,VRenderParams&) ;
+			virtual void sortAndExportPrimitives(std::vector<PtrPrimitive>&,VRenderParams&,Exporter&) ;
 	};
 
 	class TopologicalSortMethod: public SortMethod
@@ -53,6 +61,20 @@ namespace vrender
 		private:
 			bool _break_cycles ;
 	};
+
+	//  Depth sort followed by local fixups between the primitives that overlap
+	// on screen and in depth. Nearly linear, and correct on scenes without
+	// intersecting primitives or precedence cycles, which are left in depth
+	// order.
+
+	class DepthBucketSortMethod: public SortMethod
+	{
+		public:
+			DepthBucketSortMethod() {}
+			virtual ~DepthBucketSortMethod() {}
+
+			virtual void sortPrimitives(std::vector<PtrPrimitive>&,VRenderParams&) ;
+	};
 }
 
 #endif
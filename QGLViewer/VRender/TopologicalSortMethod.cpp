@@ -1,5 +1,8 @@
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
 #include <climits>
+#include <exception>
 
 #include "VRender.h"
 #include "Primitive.h"
@@ -7,6 +10,7 @@
 #include "AxisAlignedBox.h"
 #include "SortMethod.h"
 #include "Vector2.h"
+#include "../taskScheduler.h"
 
 using namespace std ;
 using namespace vrender ;
@@ -18,12 +22,16 @@ namespace vrender
 class TopologicalSortUtils
 {
 	public:
-		static void buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab, vector< vector<size_t> >& precedence_graph) ;
+		static void buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab, vector< vector<size_t> >& precedence_graph,VRenderParams& vparams) ;
 
-		static void recursFindNeighbors(	const vector<PtrPrimitive>& primitive_tab,
-													const vector<size_t>& pindices,
-													vector< vector<size_t> >& precedence_graph,
-													const AxisAlignedBox_xy&,int) ;
+		static void recursFindCells(	const vector<PtrPrimitive>& primitive_tab,
+												const vector<size_t>& pindices,
+												vector< vector<size_t> >& cells,
+												const AxisAlignedBox_xy&,int) ;
+
+		static void findCellNeighbors(	const vector<PtrPrimitive>& primitive_tab,
+													const vector<size_t>& cell,
+													vector< pair<size_t,size_t> >& edges) ;
 
 		static void checkAndAddEdgeToGraph(size_t a,size_t b,vector< vector<size_t> >& precedence_graph) ;
 		static void suppressPrecedence(size_t a,size_t b,vector< vector<size_t> >& precedence_graph) ;
@@ -76,7 +84,7 @@ void TopologicalSortMethod::sortPrimitives(vector<PtrPrimitive>& primitive_tab,V
 	cout << endl ;
 #endif
 	vector< vector<size_t> > precedence_graph(primitive_tab.size());
-	TopologicalSortUtils::buildPrecedenceGraph(primitive_tab,precedence_graph) ;
+	TopologicalSortUtils::buildPrecedenceGraph(primitive_tab,precedence_graph,vparams) ;
 
 #ifdef DEBUG_TS
 	TopologicalSortUtils::printPrecedenceGraph(precedence_graph,primitive_tab) ;
@@ -115,7 +123,8 @@ void TopologicalSortUtils::printPrecedenceGraph(const vector< vector<size_t> >&
 #endif
 
 void TopologicalSortUtils::buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab,
-																vector< vector<size_t> >& precedence_graph)
+																vector< vector<size_t> >& precedence_graph,
+																VRenderParams& vparams)
 {
 	// The precedence graph is constructed by first conservatively determining which
 	// primitives can possibly intersect using a quadtree. Candidate pairs of
@@ -135,20 +144,81 @@ void TopologicalSortUtils::buildPrecedenceGraph(vector<PtrPrimitive>& primitive_
 		BBox.include(Vector2(primitive_tab[i]->bbox().maxi().x(),primitive_tab[i]->bbox().maxi().y())) ;
 	}
 
-	// 1 - recursively find pairs.
+	// 1 - recursively subdivide the quadtree into cells of candidate primitives.
 
 	vector<size_t> pindices(primitive_tab.size()) ;
 	for(size_t j=0;j<pindices.size();++j)
 		pindices[j] = j ;
 
-	recursFindNeighbors(primitive_tab, pindices, precedence_graph, BBox,0) ;
+	vector< vector<size_t> > cells ;
+	recursFindCells(primitive_tab, pindices, cells, BBox,0) ;
+
+	// 2 - check the pairs of each cell. Cells are independent and are dispatched
+	// to all cores, each cell filling its own edge list. Threads pick the next
+	// chunk of cells as soon as they are done, which balances uneven cells.
+
+	static const size_t CELLS_PER_TASK = 16 ;
+
+	vector< vector< pair<size_t,size_t> > > cell_edges(cells.size()) ;
+	atomic<size_t> next_cell(0) ;
+	atomic<size_t> nb_done(0) ;
+	exception_ptr error ;
+	atomic<bool> failed(false) ;
+
+	//  Only the calling thread reports the progress, which is also where a
+	// cancellation is noticed. The other threads then stop at their next chunk.
+
+	auto worker = [&](bool report_progress)
+	{
+		try
+		{
+			for(size_t first;(first = next_cell.fetch_add(CELLS_PER_TASK)) < cells.size() && !failed && !vparams.isCanceled();)
+			{
+				for(size_t c=first;c<min(first+CELLS_PER_TASK,cells.size());++c)
+					findCellNeighbors(primitive_tab,cells[c],cell_edges[c]) ;
+
+				size_t done = nb_done.fetch_add(CELLS_PER_TASK) + CELLS_PER_TASK ;
+
+				if(report_progress)
+					vparams.progress(min(done,cells.size())/(float)cells.size(), QGLViewer::tr("Precedence graph")) ;
+			}
+		}
+		catch(...)
+		{
+			if(!failed.exchange(true))
+				error = current_exception() ;
+		}
+	};
+
+	size_t nb_threads = qglviewer::TaskScheduler::maxThreadCount() ;
+	nb_threads = min(nb_threads,(cells.size()+CELLS_PER_TASK-1)/CELLS_PER_TASK) ;
+
+	//  The first worker, which reports the progress, is run by this thread.
+	qglviewer::TaskScheduler::parallelFor(int(nb_threads),[&](int first,int last)
+	{
+		for(int t=first;t<last;++t)
+			worker(t == 0) ;
+	}) ;
+
+	if(failed)
+		rethrow_exception(error) ;
+
+	// Throws if the cells were left unfinished by a cancellation
+	vparams.progress(1.0, QGLViewer::tr("Precedence graph")) ;
+
+	// 3 - merge the edges in cell order, which gives the same graph as a
+	// sequential traversal.
+
+	for(size_t c=0;c<cell_edges.size();++c)
+		for(size_t e=0;e<cell_edges[c].size();++e)
+			checkAndAddEdgeToGraph(cell_edges[c][e].first,cell_edges[c][e].second,precedence_graph) ;
 }
 
-void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primitive_tab,
-																const vector<size_t>& pindices,
-																vector< vector<size_t> >& precedence_graph,
-																const AxisAlignedBox_xy& bbox,
-																int depth)
+void TopologicalSortUtils::recursFindCells(const vector<PtrPrimitive>& primitive_tab,
+														const vector<size_t>& pindices,
+														vector< vector<size_t> >& cells,
+														const AxisAlignedBox_xy& bbox,
+														int depth)
 {
 	static const size_t MAX_PRIMITIVES_IN_CELL = 5 ;
 
@@ -188,10 +258,10 @@ void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primi
 		if(p_indices_min_min.size() < pindices.size() && p_indices_max_min.size() < pindices.size()
 				&& p_indices_min_max.size() < pindices.size() && p_indices_max_max.size() < pindices.size())
 		{
-			recursFindNeighbors(primitive_tab,p_indices_min_min,precedence_graph,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(ymin,yMean)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_min_max,precedence_graph,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(yMean,ymax)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_max_min,precedence_graph,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(ymin,yMean)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_max_max,precedence_graph,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(yMean,ymax)),depth+1) ;
+			recursFindCells(primitive_tab,p_indices_min_min,cells,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(ymin,yMean)),depth+1) ;
+			recursFindCells(primitive_tab,p_indices_min_max,cells,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(yMean,ymax)),depth+1) ;
+			recursFindCells(primitive_tab,p_indices_max_min,cells,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(ymin,yMean)),depth+1) ;
+			recursFindCells(primitive_tab,p_indices_max_max,cells,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(yMean,ymax)),depth+1) ;
 			return ;
 		}
 	}
@@ -199,6 +269,16 @@ void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primi
 	// No refinment either because it could not be possible, or because the number of primitives is below
 	// the predefined limit.
 
+	if(pindices.size() > 1)
+		cells.push_back(pindices) ;
+}
+
+void TopologicalSortUtils::findCellNeighbors(const vector<PtrPrimitive>& primitive_tab,
+															const vector<size_t>& pindices,
+															vector< pair<size_t,size_t> >& edges)
+{
+	// Only reads the primitives: may be called concurrently on different cells.
+
 	for(size_t i=0;i<pindices.size();++i)
 		for(size_t j=i+1;j<pindices.size();++j)
 		{
@@ -206,8 +286,8 @@ void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primi
 
 			int prp = PrimitivePositioning::computeRelativePosition(	primitive_tab[pindices[i]], primitive_tab[pindices[j]]) ;
 
-			if(prp & PrimitivePositioning::Upper) checkAndAddEdgeToGraph(pindices[j],pindices[i],precedence_graph) ;
-			if(prp & PrimitivePositioning::Lower) checkAndAddEdgeToGraph(pindices[i],pindices[j],precedence_graph) ;
+			if(prp & PrimitivePositioning::Upper) edges.push_back(make_pair(pindices[j],pindices[i])) ;
+			if(prp & PrimitivePositioning::Lower) edges.push_back(make_pair(pindices[i],pindices[j])) ;
 		}
 }
 
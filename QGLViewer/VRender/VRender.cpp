@@ -1,4 +1,6 @@
 #include <qglobal.h>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 
 #ifdef Q_OS_WIN32
 # include <windows.h>
@@ -15,116 +17,478 @@
 #include <vector>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <chrono>
+#include <future>
 
 #include "VRender.h"
 #include "ParserGL.h"
 #include "Exporter.h"
 #include "SortMethod.h"
 #include "Optimizer.h"
+#include "Arena.h"
+#include "BSPTree.h"
+#include "IdBufferCuller.h"
+#include "../taskScheduler.h"
+#include "../traceRecorder.h"
 
 using namespace vrender ;
 using namespace std ;
 
-void vrender::VectorialRender(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
+// Returns the column major matrix that transforms world coordinates into the
+// window coordinates of the feedback buffer.
+static void getWindowMatrix(GLdouble matrix[16])
 {
-	GLfloat *feedbackBuffer = nullptr ;
-	SortMethod *sort_method = nullptr ;
-	Exporter *exporter = nullptr ;
+	GLdouble modelview[16],projection[16],depth_range[2] ;
+	GLint viewport[4] ;
 
-	try
-	{
-		GLint returned = -1 ;
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview) ;
+	glGetDoublev(GL_PROJECTION_MATRIX, projection) ;
+	glGetDoublev(GL_DEPTH_RANGE, depth_range) ;
+	glGetIntegerv(GL_VIEWPORT, viewport) ;
 
-		vparams.error() = 0 ;
+	GLdouble window[16] = { viewport[2]/2.0,0.0,0.0,0.0,
+									0.0,viewport[3]/2.0,0.0,0.0,
+									0.0,0.0,(depth_range[1]-depth_range[0])/2.0,0.0,
+									viewport[0]+viewport[2]/2.0,viewport[1]+viewport[3]/2.0,(depth_range[1]+depth_range[0])/2.0,1.0 } ;
 
-		int nb_renders = 0 ;
+	GLdouble tmp[16] ;
 
-		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+		{
+			tmp[4*j+i] = 0.0 ;
+			for(int k=0;k<4;++k)
+				tmp[4*j+i] += projection[4*k+i]*modelview[4*j+k] ;
+		}
 
-		while(returned < 0)
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
 		{
-			if(feedbackBuffer != nullptr)
-				delete[] feedbackBuffer ;
+			matrix[4*j+i] = 0.0 ;
+			for(int k=0;k<4;++k)
+				matrix[4*j+i] += window[4*k+i]*tmp[4*j+k] ;
+		}
+}
+
+// Gauss-Jordan inversion with partial pivoting. Returns false if m is singular.
+static bool invertMatrix(const GLdouble m[16],GLdouble inv[16])
+{
+	double a[4][8] ;
+
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+		{
+			a[i][j] = m[4*j+i] ;
+			a[i][j+4] = (i == j) ? 1.0 : 0.0 ;
+		}
 
-			feedbackBuffer = new GLfloat[vparams.size()] ;
+	for(int c=0;c<4;++c)
+	{
+		int pivot = c ;
+
+		for(int r=c+1;r<4;++r)
+			if(fabs(a[r][c]) > fabs(a[pivot][c]))
+				pivot = r ;
+
+		if(a[pivot][c] == 0.0)
+			return false ;
+
+		if(pivot != c)
+			for(int j=0;j<8;++j)
+				swap(a[c][j],a[pivot][j]) ;
+
+		double p = a[c][c] ;
+		for(int j=0;j<8;++j)
+			a[c][j] /= p ;
+
+		for(int r=0;r<4;++r)
+			if(r != c)
+			{
+				double f = a[r][c] ;
+				for(int j=0;j<8;++j)
+					a[r][j] -= f*a[c][j] ;
+			}
+	}
 
-			if(feedbackBuffer == nullptr)
-				throw std::runtime_error("Out of memory during feedback buffer allocation.") ;
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			inv[4*j+i] = a[i][j+4] ;
 
-			glFeedbackBuffer(vparams.size(), GL_3D_COLOR, feedbackBuffer);
-			glRenderMode(GL_FEEDBACK);
-			render_callback(callback_params);
-			returned = glRenderMode(GL_RENDER);
+	return true ;
+}
 
-			nb_renders++ ;
+//  OpenGL state needed by the stages that follow the capture. It is read in the
+// rendering thread, so that these stages can run on a worker thread (see
+// VRenderParams::ProcessInBackground).
 
-			if(returned < 0)
-				vparams.size() *= 2 ;
-		}
+struct CaptureState
+{
+	GLfloat viewport[4] ;
+	GLfloat clearColor[4] ;
+	GLfloat lineWidth ;
+	GLfloat pointSize ;
 
-#ifdef A_VOIR
-		if(SortMethod != EPS_DONT_SORT)
-		{
-			GLint depth_bits ;
-			glGetIntegerv(GL_DEPTH_BITS, &depth_bits) ;
+	GLdouble matrix[16] ;	// Only read when a BSPTree is kept across exports
 
-			EGALITY_EPS 		= 2.0/(1 << depth_bits) ;
-			LINE_EGALITY_EPS 	= 2.0/(1 << depth_bits) ;
-		}
+	std::vector<bool> visible_primitives ;	// Empty when all are kept
+} ;
+
+static void readCaptureState(CaptureState& state,bool with_matrix)
+{
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, state.clearColor);
+	glGetFloatv(GL_LINE_WIDTH, &state.lineWidth);
+	glGetFloatv(GL_POINT_SIZE, &state.pointSize);
+	glGetFloatv(GL_VIEWPORT, state.viewport);
+
+	if(with_matrix)
+		getWindowMatrix(state.matrix) ;
+
+	state.lineWidth /= (float)max(state.viewport[2] - state.viewport[0],state.viewport[3]-state.viewport[1]) ;
+}
+
+//  Fills state.visible_primitives with an IdBufferCuller, when it is enabled.
+// The primitives of a BSPTree are all kept, since it is used for other views.
+
+static void readVisibility(const GLfloat *feedbackBuffer,GLint returned,const BSPTree *bsp_tree,
+									VRenderParams& vparams,CaptureState& state)
+{
+	state.visible_primitives.clear() ;
+
+	if(vparams.isEnabled(VRenderParams::CullHiddenFacesOnGPU) && feedbackBuffer != nullptr && bsp_tree == nullptr)
+	{
+		QGLVIEWER_TRACE_SCOPE("VRender","idBuffer") ;
+		IdBufferCuller::findVisiblePrimitives(feedbackBuffer,returned,state.viewport,vparams.idBufferScale(),state.visible_primitives) ;
+	}
+}
+
+#ifndef GL_PRIMITIVES_GENERATED
+# define GL_PRIMITIVES_GENERATED 0x8C87
 #endif
-		if (returned > vparams.size())
-			vparams.size() = returned;
-#ifdef _VRENDER_DEBUG
-		cout << "Size = " << vparams.size() << ", returned=" << returned << endl ;
+#ifndef GL_QUERY_RESULT
+# define GL_QUERY_RESULT 0x8866
 #endif
 
-		//  On a un beau feedback buffer tout plein de saloperies. Faut aller
-		// defricher tout ca. Ouaiiiis !
+// Feedback values of a primitive in the worst case: a triangle clipped by the
+// six frustum planes (a 9 vertices polygon) with its token and vertex count.
+static const int FEEDBACK_VALUES_PER_PRIMITIVE = 2 + 9*7 ;
 
-		vector<PtrPrimitive> primitive_tab ;
+//  Renders the scene once without writing the frame buffer, and returns a
+// feedback buffer size large enough for the primitives it generates, as
+// counted by a GL_PRIMITIVES_GENERATED query. Returns -1 when the query is not
+// supported (OpenGL 3.0 is required).
 
-		ParserGL parserGL ;
-		parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+static int countFeedbackSize(RenderCB render_callback,void *callback_params)
+{
+	QOpenGLContext *context = QOpenGLContext::currentContext() ;
+
+	if(context == nullptr || context->isOpenGLES() || context->format().version() < qMakePair(3,0))
+		return -1 ;
+
+	QGLVIEWER_TRACE_SCOPE("VRender","countPrimitives") ;
+
+	QOpenGLExtraFunctions *f = context->extraFunctions() ;
+
+	GLuint query = 0 ;
+	f->glGenQueries(1,&query) ;
+
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT) ;
+	glColorMask(GL_FALSE,GL_FALSE,GL_FALSE,GL_FALSE) ;
+	glDepthMask(GL_FALSE) ;
+	glStencilMask(0) ;
+
+	f->glBeginQuery(GL_PRIMITIVES_GENERATED,query) ;
+	render_callback(callback_params) ;
+	f->glEndQuery(GL_PRIMITIVES_GENERATED) ;
+
+	glPopAttrib() ;
+
+	GLuint nb_primitives = 0 ;
+	f->glGetQueryObjectuiv(query,GL_QUERY_RESULT,&nb_primitives) ;
+	f->glDeleteQueries(1,&query) ;
+
+	// Some room for the tokens that are not primitives, such as glPassThrough()
+	const double size = double(nb_primitives) * FEEDBACK_VALUES_PER_PRIMITIVE * 1.125 + 4096.0 ;
+
+	return (size < INT_MAX) ? int(size) : INT_MAX ;
+}
+
+//  Renders the scene in feedback mode, in a buffer which is grown until it is
+// large enough. Returns the number of values written in feedbackBuffer. size
+// is the size of the first buffer, and is updated for the next captures. The
+// primitives that face away are kept when keep_back_faces is true, for a BSP
+// that is used from other points of view.
 
+static GLint captureFeedback(RenderCB render_callback,void *callback_params,int& size,GLfloat *& feedbackBuffer,
+									  bool keep_back_faces)
+{
+	QGLVIEWER_TRACE_SCOPE("VRender","capture") ;
+
+	if(keep_back_faces)
+	{
+		glPushAttrib(GL_ENABLE_BIT) ;
+		glDisable(GL_CULL_FACE) ;
+	}
+
+	struct RestoreCulling
+	{
+		bool restore ;
+		~RestoreCulling() { if(restore) glPopAttrib() ; }
+	} restore_culling = { keep_back_faces } ;
+
+	GLint returned = -1 ;
+
+	int nb_renders = 0 ;
+
+	while(returned < 0)
+	{
 		if(feedbackBuffer != nullptr)
-		{
 			delete[] feedbackBuffer ;
-			feedbackBuffer = nullptr ;
+
+		feedbackBuffer = new GLfloat[size] ;
+
+		if(feedbackBuffer == nullptr)
+			throw std::runtime_error("Out of memory during feedback buffer allocation.") ;
+
+		glFeedbackBuffer(size, GL_3D_COLOR, feedbackBuffer);
+		glRenderMode(GL_FEEDBACK);
+		render_callback(callback_params);
+		returned = glRenderMode(GL_RENDER);
+
+		nb_renders++ ;
+
+		//  The number of values needed is not known when the buffer
+		// overflows, and each retry renders the whole scene again. After
+		// the first overflow, the buffer is sized from the number of
+		// primitives of the scene, so that a single retry is usually
+		// needed. Otherwise (no query, or too many values per primitive)
+		// it is grown aggressively to keep the number of renders low. Its
+		// size is kept for the next exports.
+
+		if(returned < 0 && nb_renders == 1)
+		{
+			const int counted_size = countFeedbackSize(render_callback,callback_params) ;
+
+			if(counted_size > size)
+			{
+				size = counted_size ;
+				continue ;
+			}
 		}
 
-		if(vparams.isEnabled(VRenderParams::OptimizeBackFaceCulling))
+		if(returned < 0)
 		{
-			BackFaceCullingOptimizer bfopt ;
-			bfopt.optimize(primitive_tab,vparams) ;
+			if(size > INT_MAX / 4)
+			{
+				if(size == INT_MAX)
+					throw std::runtime_error("Feedback buffer overflow: the scene is too large.") ;
+
+				size = INT_MAX ;
+			}
+			else
+				size *= 4 ;
 		}
+	}
+
+#ifdef A_VOIR
+	if(SortMethod != EPS_DONT_SORT)
+	{
+		GLint depth_bits ;
+		glGetIntegerv(GL_DEPTH_BITS, &depth_bits) ;
+
+		EGALITY_EPS 		= 2.0/(1 << depth_bits) ;
+		LINE_EGALITY_EPS 	= 2.0/(1 << depth_bits) ;
+	}
+#endif
+	if (returned > size)
+		size = returned;
+#ifdef _VRENDER_DEBUG
+	cout << "Size = " << size << ", returned=" << returned << endl ;
+#endif
+
+	return returned ;
+}
+
+//  Everything that follows the capture: parsing, optimizations, sorting and
+// export. No OpenGL call is made here. feedbackBuffer is deleted as soon as it
+// is parsed, exporter and sort_method are left to the caller.
+
+static void processCapture(	GLfloat *& feedbackBuffer,GLint returned,
+										const CaptureState& state,BSPTree *bsp_tree,
+										VRenderParams& vparams,
+										Exporter *& exporter,SortMethod *& sort_method)
+{
+	QGLVIEWER_TRACE_SCOPE("VRender","process") ;
+
+	vector<PtrPrimitive> primitive_tab ;
+
+	ParserGL parserGL ;
+
+	//  On a un beau feedback buffer tout plein de saloperies. Faut aller
+	// defricher tout ca. Ouaiiiis !
 
-		// Lance la methode de sorting
+	if(feedbackBuffer != nullptr)
+	{
+		QGLVIEWER_TRACE_SCOPE("VRender","parse") ;
+
+		if(!state.visible_primitives.empty())
+			parserGL.setVisiblePrimitives(&state.visible_primitives) ;
+
+		parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+		parserGL.setVisiblePrimitives(nullptr) ;
+
+		delete[] feedbackBuffer ;
+		feedbackBuffer = nullptr ;
+	}
+
+	//  With a BSP kept across exports, the sort is done once in world
+	// coordinates. Primitives are then projected for each view in back to
+	// front order, and must not be sorted again.
+
+	if(bsp_tree != nullptr)
+	{
+		GLdouble inverse_matrix[16] ;
 
-		switch(vparams.sortMethod())
+		if(!invertMatrix(state.matrix,inverse_matrix))
+			throw std::runtime_error("Singular projection matrix.") ;
+
+		if(bsp_tree->isEmpty())
 		{
-		case VRenderParams::AdvancedTopologicalSort:
-		case VRenderParams::TopologicalSort: {
-			TopologicalSortMethod *tsm = new TopologicalSortMethod() ;
-			tsm->setBreakCycles(vparams.sortMethod() == VRenderParams::AdvancedTopologicalSort) ;
-			sort_method = tsm ;
-											 }
-											 break ;
-
-		case VRenderParams::BSPSort: 				sort_method = new BSPSortMethod() ;
-			break ;
-
-		case VRenderParams::NoSorting: 			sort_method = new DontSortMethod() ;
-			break ;
-		default:
-			throw std::runtime_error("Unknown sorting method.") ;
+			//  The world coordinates primitives and the BSP nodes belong to
+			// the tree, and must outlive the arena of this export.
+
+			Arena::Scope heap_scope(nullptr) ;
+			QGLVIEWER_TRACE_SCOPE("VRender","buildBSP") ;
+
+			vector<PtrPrimitive> world_tab ;
+			parserGL.unprojectPrimitives(primitive_tab,inverse_matrix,world_tab) ;
+			bsp_tree->build(world_tab,vparams) ;
 		}
 
-		sort_method->sortPrimitives(primitive_tab,vparams) ;
+		for(size_t i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+
+		primitive_tab.clear() ;
+
+		// The eye is the image of the point at infinity of the window depth axis.
+
+		double eye[4] = { inverse_matrix[8],inverse_matrix[9],inverse_matrix[10],inverse_matrix[11] } ;
+
+		vector<PtrPrimitive> world_tab ;
+		bsp_tree->fillBackToFrontArray(eye,world_tab) ;
+
+		vector<GLfloat> buffer ;
+		ParserGL::projectPrimitives(world_tab,state.matrix,buffer) ;
+		parserGL.parseFeedbackBuffer(buffer.data(),int(buffer.size()),primitive_tab,vparams) ;
+	}
+
+	if(vparams.isEnabled(VRenderParams::FilterPrimitives))
+	{
+		QGLVIEWER_TRACE_SCOPE("VRender","filterPrimitives") ;
+		PrimitiveFilterOptimizer fopt(state.viewport) ;
+		fopt.optimize(primitive_tab,vparams) ;
+	}
+
+	if(vparams.isEnabled(VRenderParams::OptimizeBackFaceCulling))
+	{
+		QGLVIEWER_TRACE_SCOPE("VRender","backFaceCulling") ;
+		BackFaceCullingOptimizer bfopt ;
+		bfopt.optimize(primitive_tab,vparams) ;
+	}
+
+	// Ecrit le fichier
+
+	switch(vparams.format())
+	{
+	case VRenderParams::EPS: exporter = new EPSExporter() ;
+		break ;
+	case VRenderParams::PS:  exporter = new PSExporter() ;
+		break ;
+	case VRenderParams::XFIG:exporter = new FIGExporter() ;
+		break ;
+	case VRenderParams::PDF: exporter = new PDFExporter() ;
+		break ;
+#ifdef A_FAIRE
+	case VRenderParams::SVG: exporter = new SVGExporter() ;
+		break ;
+#endif
+	default:
+		throw std::runtime_error("Sorry, this output format is not handled now. Only EPS, PS, XFIG and PDF are currently supported.") ;
+	}
+
+	// sets background and black & white options
+
+	const GLfloat *viewport = state.viewport ;
+	const GLfloat *clearColor = state.clearColor ;
+
+	// Sets which bounding box to use.
+
+	if(vparams.isEnabled(VRenderParams::TightenBoundingBox))
+		exporter->setBoundingBox(parserGL.xmin(),parserGL.ymin(),parserGL.xmax(),parserGL.ymax()) ;
+	else
+		exporter->setBoundingBox(viewport[0],viewport[1],viewport[0]+viewport[2],viewport[1]+viewport[3]) ;
+
+	exporter->setBlackAndWhite(vparams.isEnabled(VRenderParams::RenderBlackAndWhite)) ;
+	exporter->setClearBackground(vparams.isEnabled(VRenderParams::AddBackground)) ;
+	exporter->setClearColor(clearColor[0],clearColor[1],clearColor[2]) ;
+
+	// Lance la methode de sorting
+
+	switch(vparams.sortMethod())
+	{
+	case VRenderParams::AdvancedTopologicalSort:
+	case VRenderParams::TopologicalSort: {
+		TopologicalSortMethod *tsm = new TopologicalSortMethod() ;
+		tsm->setBreakCycles(vparams.sortMethod() == VRenderParams::AdvancedTopologicalSort) ;
+		sort_method = tsm ;
+										 }
+										 break ;
+
+	case VRenderParams::BSPSort:
+		if(bsp_tree != nullptr)
+			sort_method = new DontSortMethod() ;
+		else
+			sort_method = new BSPSortMethod() ;
+		break ;
+
+	case VRenderParams::DepthBucketSort:	sort_method = new DepthBucketSortMethod() ;
+		break ;
+
+	case VRenderParams::NoSorting: 			sort_method = new DontSortMethod() ;
+		break ;
+	default:
+		throw std::runtime_error("Unknown sorting method.") ;
+	}
+
+	//  Without hidden faces culling and rasterization of the dense regions,
+	// which need all the sorted primitives, the sort method directly streams
+	// the primitives to the file in back to front order.
+
+	if(!vparams.isEnabled(VRenderParams::CullHiddenFaces) && !vparams.isEnabled(VRenderParams::RasterizeDenseRegions))
+	{
+		exporter->beginExport(vparams.filename()) ;
+
+		QGLVIEWER_TRACE_SCOPE("VRender","sortAndExport") ;
+		sort_method->sortAndExportPrimitives(primitive_tab,vparams,*exporter) ;
+		exporter->endExport() ;
+
+		// The streamed progress stops short of the end, as the chunks of the
+		// non streaming export reach it
+		vparams.progress(1.0, QGLViewer::tr("Exporting to file %1").arg(vparams.filename())) ;
+	}
+	else
+	{
+		{
+			QGLVIEWER_TRACE_SCOPE("VRender","sort") ;
+			sort_method->sortPrimitives(primitive_tab,vparams) ;
+		}
 
 		// Lance les optimisations. L'ordre est important.
 
 		if(vparams.isEnabled(VRenderParams::CullHiddenFaces))
 		{
+			QGLVIEWER_TRACE_SCOPE("VRender","cullHiddenFaces") ;
 			VisibilityOptimizer vopt ;
 			vopt.optimize(primitive_tab,vparams) ;
 		}
@@ -136,84 +500,368 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 			psopt.optimize(primitive_tab) ;
 		}
 #endif
-		// Ecrit le fichier
+		QGLVIEWER_TRACE_SCOPE("VRender","export") ;
+		exporter->exportToFile(vparams.filename(),primitive_tab,vparams) ;
+	}
 
-		switch(vparams.format())
-		{
-		case VRenderParams::EPS: exporter = new EPSExporter() ;
-			break ;
-		case VRenderParams::PS:  exporter = new PSExporter() ;
-			break ;
-		case VRenderParams::XFIG:exporter = new FIGExporter() ;
-			break ;
-#ifdef A_FAIRE
-		case VRenderParams::SVG: exporter = new SVGExporter() ;
-			break ;
-#endif
-		default:
-			throw std::runtime_error("Sorry, this output format is not handled now. Only EPS and PS are currently supported.") ;
-		}
+	// deletes primitives. Only their destructors are run here, their memory
+	// belongs to the arena.
 
-		// sets background and black & white options
+	for(unsigned int i=0;i<primitive_tab.size();++i)
+		delete primitive_tab[i] ;
+}
 
-		GLfloat viewport[4],clearColor[4],lineWidth,pointSize ;
+void vrender::VectorialRender(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
+{
+	GLfloat *feedbackBuffer = nullptr ;
+	SortMethod *sort_method = nullptr ;
+	Exporter *exporter = nullptr ;
 
-		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
-		glGetFloatv(GL_LINE_WIDTH, &lineWidth);
-		glGetFloatv(GL_POINT_SIZE, &pointSize);
-		glGetFloatv(GL_VIEWPORT, viewport);
+	// Owns all the primitives and BSP nodes of this export. Its memory is
+	// released in one shot when this function returns, even on error.
+	Arena arena ;
 
-		lineWidth /= (float)max(viewport[2] - viewport[0],viewport[3]-viewport[1]) ;
+	try
+	{
+		Arena::Scope arena_scope(arena) ;
 
-		// Sets which bounding box to use.
+		vparams.error() = 0 ;
+		vparams._canceled = false ;
 
-		if(vparams.isEnabled(VRenderParams::TightenBoundingBox))
-			exporter->setBoundingBox(parserGL.xmin(),parserGL.ymin(),parserGL.xmax(),parserGL.ymax()) ;
-		else
-			exporter->setBoundingBox(viewport[0],viewport[1],viewport[0]+viewport[2],viewport[1]+viewport[3]) ;
+		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
 
-		exporter->setBlackAndWhite(vparams.isEnabled(VRenderParams::RenderBlackAndWhite)) ;
-		exporter->setClearBackground(vparams.isEnabled(VRenderParams::AddBackground)) ;
-		exporter->setClearColor(clearColor[0],clearColor[1],clearColor[2]) ;
+		BSPTree *bsp_tree = (vparams.sortMethod() == VRenderParams::BSPSort) ? vparams.bspTree() : nullptr ;
 
-		exporter->exportToFile(vparams.filename(),primitive_tab,vparams) ;
+		GLint returned = -1 ;
 
-		// deletes primitives
+		if(bsp_tree == nullptr || bsp_tree->isEmpty())
+			returned = captureFeedback(render_callback,callback_params,vparams.size(),feedbackBuffer,bsp_tree != nullptr) ;
 
-		for(unsigned int i=0;i<primitive_tab.size();++i)
-			delete primitive_tab[i] ;
+		CaptureState state ;
+		readCaptureState(state,bsp_tree != nullptr) ;
+		readVisibility(feedbackBuffer,returned,bsp_tree,vparams,state) ;
+
+		if(vparams.isEnabled(VRenderParams::ProcessInBackground))
+		{
+			//  The worker reports its progress through vparams, and this thread
+			// forwards it to the progress function, which can then safely update
+			// the user interface. Exceptions are rethrown by get().
+
+			vparams._defer_progress = true ;
+
+			future<void> worker = async(launch::async,[&]()
+			{
+				Arena::Scope worker_arena_scope(arena) ;
+				processCapture(feedbackBuffer,returned,state,bsp_tree,vparams,exporter,sort_method) ;
+			}) ;
+
+			while(worker.wait_for(chrono::milliseconds(50)) != future_status::ready)
+				vparams.flushProgress() ;
+
+			vparams._defer_progress = false ;
+			vparams.flushProgress() ;
+
+			worker.get() ;
+		}
+		else
+			processCapture(feedbackBuffer,returned,state,bsp_tree,vparams,exporter,sort_method) ;
 
 		if(exporter != nullptr) delete exporter ;
 		if(sort_method != nullptr) delete sort_method ;
 	}
-	catch(exception& e)
+	catch(exception&)
 	{
-		cout << "Render aborted: " << e.what() << endl ;
+		// Reported once, by the caller
+		vparams._defer_progress = false ;
 
 		if(exporter != nullptr) delete exporter ;
 		if(sort_method != nullptr) delete sort_method ;
 		if(feedbackBuffer != nullptr) delete[] feedbackBuffer ;
 
-		throw e ;
+		throw ;
+	}
+}
+
+//  A scene captured by VRenderBatch::addJob(), waiting for a worker. The arena
+// owns the primitives of this export only, so that jobs never share memory.
+
+struct VRenderBatch::Job
+{
+	Job() : feedbackBuffer(nullptr), returned(-1), bsp_tree(nullptr), vparams(nullptr), done(false) {}
+	~Job() { delete[] feedbackBuffer ; }
+
+	Arena arena ;
+	GLfloat *feedbackBuffer ;
+	GLint returned ;
+	CaptureState state ;
+	BSPTree *bsp_tree ;
+	VRenderParams *vparams ;
+	promise<void> result ;
+	atomic<bool> done ;
+} ;
+
+static void processJob(GLfloat *& feedbackBuffer,GLint returned,const CaptureState& state,
+							  BSPTree *bsp_tree,VRenderParams& vparams,Arena& arena,promise<void>& result)
+{
+	SortMethod *sort_method = nullptr ;
+	Exporter *exporter = nullptr ;
+
+	try
+	{
+		Arena::Scope arena_scope(arena) ;
+		processCapture(feedbackBuffer,returned,state,bsp_tree,vparams,exporter,sort_method) ;
+
+		delete exporter ;
+		delete sort_method ;
+		result.set_value() ;
+	}
+	catch(exception&)
+	{
+		// Reported by the future, in the thread that gets it
+		delete exporter ;
+		delete sort_method ;
+		result.set_exception(current_exception()) ;
+	}
+
+	// The primitives are not needed anymore, their memory can be reused
+	arena.release() ;
+}
+
+VRenderBatch::VRenderBatch(int nb_threads)
+	: _stopping(false)
+{
+	if(nb_threads <= 0)
+		nb_threads = qglviewer::TaskScheduler::maxThreadCount() ;
+
+	for(int i=0;i<nb_threads;++i)
+		_workers.push_back(thread(&VRenderBatch::workerLoop,this)) ;
+}
+
+VRenderBatch::~VRenderBatch()
+{
+	waitForAll() ;
+
+	{
+		lock_guard<mutex> lock(_mutex) ;
+		_stopping = true ;
+	}
+	_job_added.notify_all() ;
+
+	for(size_t i=0;i<_workers.size();++i)
+		_workers[i].join() ;
+}
+
+//  Captures the scene and queues the rest of the export. The returned future
+// is ready when the file is written, and holds the exception of a failed or
+// canceled export.
+
+future<void> VRenderBatch::addJob(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
+{
+	waitForJobs(2*_workers.size()-1) ;
+
+	shared_ptr<Job> job = make_shared<Job>() ;
+	future<void> result = job->result.get_future() ;
+
+	job->vparams = &vparams ;
+	vparams.error() = 0 ;
+	vparams._canceled = false ;
+
+	try
+	{
+		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
+
+		job->bsp_tree = (vparams.sortMethod() == VRenderParams::BSPSort) ? vparams.bspTree() : nullptr ;
+
+		if(job->bsp_tree == nullptr || job->bsp_tree->isEmpty())
+			job->returned = captureFeedback(render_callback,callback_params,vparams.size(),job->feedbackBuffer,job->bsp_tree != nullptr) ;
+
+		readCaptureState(job->state,job->bsp_tree != nullptr) ;
+		readVisibility(job->feedbackBuffer,job->returned,job->bsp_tree,vparams,job->state) ;
+	}
+	catch(exception&)
+	{
+		job->result.set_exception(current_exception()) ;
+		return result ;
+	}
+
+	//  The next jobs that share this BSPTree need it to be built
+
+	if(job->bsp_tree != nullptr && job->bsp_tree->isEmpty())
+	{
+		processJob(job->feedbackBuffer,job->returned,job->state,job->bsp_tree,vparams,job->arena,job->result) ;
+		return result ;
+	}
+
+	vparams._defer_progress = true ;
+
+	{
+		lock_guard<mutex> lock(_mutex) ;
+		_queue.push_back(job) ;
+		_jobs.push_back(job) ;
+	}
+	_job_added.notify_one() ;
+
+	return result ;
+}
+
+//  Waits until all the jobs are done, while calling their progress functions.
+
+void VRenderBatch::waitForAll()
+{
+	waitForJobs(0) ;
+}
+
+//  Calls the progress functions of the pending jobs until at most nb_pending
+// of them are not done. The jobs that are done are forgotten.
+
+void VRenderBatch::waitForJobs(size_t nb_pending)
+{
+	for(;;)
+	{
+		vector<shared_ptr<Job> > jobs ;
+		{
+			lock_guard<mutex> lock(_mutex) ;
+			jobs = _jobs ;
+		}
+
+		size_t nb_running = 0 ;
+
+		for(size_t i=0;i<jobs.size();++i)
+		{
+			const bool done = jobs[i]->done ;
+
+			//  A job that is done does not report its progress anymore, this
+			// flush is its last one.
+
+			jobs[i]->vparams->flushProgress() ;
+
+			if(done)
+				jobs[i]->vparams->_defer_progress = false ;
+			else
+				++nb_running ;
+		}
+
+		{
+			unique_lock<mutex> lock(_mutex) ;
+
+			for(size_t i=0;i<_jobs.size();)
+				if(_jobs[i]->done && !_jobs[i]->vparams->_defer_progress)
+					_jobs.erase(_jobs.begin()+i) ;
+				else
+					++i ;
+
+			if(nb_running <= nb_pending)
+				return ;
+
+			_job_done.wait_for(lock,chrono::milliseconds(50)) ;
+		}
+	}
+}
+
+void VRenderBatch::workerLoop()
+{
+	for(;;)
+	{
+		shared_ptr<Job> job ;
+		{
+			unique_lock<mutex> lock(_mutex) ;
+			_job_added.wait(lock,[this]() { return _stopping || !_queue.empty() ; }) ;
+
+			if(_queue.empty())
+				return ;
+
+			job = _queue.front() ;
+			_queue.pop_front() ;
+		}
+
+		processJob(job->feedbackBuffer,job->returned,job->state,job->bsp_tree,*job->vparams,job->arena,job->result) ;
+
+		{
+			lock_guard<mutex> lock(_mutex) ;
+			job->done = true ;
+		}
+		_job_done.notify_all() ;
+	}
+}
+
+void SortMethod::sortAndExportPrimitives(vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams,Exporter& exporter)
+{
+	sortPrimitives(primitive_tab,vparams) ;
+
+	const QString message = QGLViewer::tr("Exporting to file %1").arg(vparams.filename()) ;
+	size_t N = primitive_tab.size()/200 + 1 ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+	{
+		exporter.exportPrimitive(primitive_tab[i]) ;
+
+		if(i%N == 0)
+			vparams.progress(i/(float)primitive_tab.size(),message) ;
 	}
 }
 
 VRenderParams::VRenderParams()
+	: _canceled(false)
 {
 	_options = 0 ;
+	_minimum_primitive_size = 0.5f ;
+	_id_buffer_scale = 2 ;
+	_rasterization_threshold = 256.0f ;
+	_raster_resolution = 300.0f ;
 	_format = EPS ;
 	_filename = "" ;
 	_progress_function = nullptr ;
 	_sortMethod = BSPSort ;
+	_bsp_tree = nullptr ;
+	_defer_progress = false ;
+	_progress_pending = false ;
+	_pending_progress = 0.0f ;
 }
 
 VRenderParams::~VRenderParams()
 {}
 
+//  Called by all the stages of the export. This is where a cancellation is
+// noticed, which aborts the export with a VRenderCanceled exception.
 
 void VRenderParams::progress(float f, const QString& progress_string)
 {
-	_progress_function(f,progress_string) ;
+	if(_canceled)
+		throw VRenderCanceled() ;
+
+	if(_progress_function == nullptr)
+		return ;
+
+	if(_defer_progress)
+	{
+		lock_guard<mutex> lock(_progress_mutex) ;
+
+		_pending_progress = f ;
+		_pending_message = progress_string ;
+		_progress_pending = true ;
+	}
+	else
+		_progress_function(f,progress_string) ;
+}
+
+void VRenderParams::flushProgress()
+{
+	float f ;
+	QString message ;
+
+	{
+		lock_guard<mutex> lock(_progress_mutex) ;
+
+		if(!_progress_pending)
+			return ;
+
+		f = _pending_progress ;
+		message = _pending_message ;
+		_progress_pending = false ;
+	}
+
+	if(_progress_function != nullptr)
+		_progress_function(f,message) ;
 }
 
 void VRenderParams::setFilename(const QString& filename)
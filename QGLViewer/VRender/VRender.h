@@ -5,30 +5,174 @@
 #include <QTextStream>
 #include <QString>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 #include "../qglviewer.h"
 
 namespace vrender
 {
 	class VRenderParams ;
+	class BSPTree ;
 	typedef void (*RenderCB)(void *) ;
 	typedef void (*ProgressFunction)(float,const QString&) ;
 
+	//  Errors, including a file that cannot be opened, are thrown as
+	// std::exception (VRenderCanceled after VRenderParams::cancel()), and
+	// left to the caller to report: the export may run in a worker thread
+	// (see VRenderParams::ProcessInBackground).
+
 	void VectorialRender(RenderCB DrawFunc, void *callback_params, VRenderParams& render_params) ;
 
+	// Thrown by VectorialRender() when the export is canceled (see VRenderParams::cancel()).
+
+	class VRenderCanceled: public std::runtime_error
+	{
+		public:
+			VRenderCanceled() : std::runtime_error("Vectorial rendering canceled.") {}
+	};
+
+	//  Exports many scenes concurrently. Each addJob() renders its scene in
+	// feedback mode on the calling thread, which must have the OpenGL context
+	// current, and returns as soon as it is captured. The parsing, optimizing,
+	// sorting and writing of the file are then done by a pool of worker
+	// threads, while the next scenes are captured:
+	//
+	//		vrender::VRenderBatch batch ;
+	//		std::vector<std::future<void> > results ;
+	//		for(int i=0;i<nb_figures;++i)
+	//		{
+	//			setupFigure(i) ;
+	//			results.push_back(batch.addJob(drawFigure,&figures[i],params[i])) ;
+	//		}
+	//		batch.waitForAll() ;
+	//		for(size_t i=0;i<results.size();++i)
+	//			results[i].get() ;	// rethrows the error of job i, if any
+	//
+	//  Errors are only reported through these futures, nothing is printed nor
+	// shown: a file that cannot be opened, for instance, is a std::exception
+	// thrown by get(), which the GUI thread can then display.
+	//
+	//  Each job needs its own VRenderParams, which must not be modified nor
+	// destroyed before the job is done. Their progress functions are called
+	// on the calling thread, by addJob() and waitForAll(). The
+	// ProcessInBackground option is ignored.
+	//
+	//  The first job that uses an empty BSPTree (see VRenderParams::setBSPTree())
+	// builds it, and is hence entirely processed by addJob(): the next jobs can
+	// then share the tree. At most twice as many jobs as worker threads are
+	// pending, addJob() waits for the workers otherwise, so that the memory of
+	// the captured scenes is bounded.
+
+	class VRenderBatch
+	{
+		public:
+			//  nb_threads is the number of worker threads, the maximum number of
+			// threads of qglviewer::TaskScheduler when 0.
+			explicit VRenderBatch(int nb_threads = 0) ;
+			//  Waits for all the jobs.
+			~VRenderBatch() ;
+
+			std::future<void> addJob(RenderCB render_callback, void *callback_params, VRenderParams& render_params) ;
+			void waitForAll() ;
+
+			int numberOfThreads() const { return int(_workers.size()) ; }
+
+		private:
+			struct Job ;
+
+			VRenderBatch(const VRenderBatch&) ;
+			VRenderBatch& operator=(const VRenderBatch&) ;
+
+			void workerLoop() ;
+			void waitForJobs(size_t nb_pending) ;
+
+			std::vector<std::thread> _workers ;
+			std::mutex _mutex ;
+			std::condition_variable _job_added ;
+			std::condition_variable _job_done ;
+			std::deque<std::shared_ptr<Job> > _queue ;	// not started yet
+			std::vector<std::shared_ptr<Job> > _jobs ;	// not flushed yet
+			bool _stopping ;
+	};
+
 	class VRenderParams
 	{
 		public:
 			VRenderParams() ;
 			~VRenderParams() ;
 
-			enum VRenderSortMethod { NoSorting, BSPSort, TopologicalSort, AdvancedTopologicalSort };
-			enum VRenderFormat     { EPS, PS, XFIG, SVG };
+			enum VRenderSortMethod { NoSorting, BSPSort, TopologicalSort, AdvancedTopologicalSort, DepthBucketSort };
+			enum VRenderFormat     { EPS, PS, XFIG, SVG, PDF };
 
 			enum VRenderOption {	CullHiddenFaces         = 0x1,
 						OptimizeBackFaceCulling = 0x4,
 						RenderBlackAndWhite     = 0x8,
 						AddBackground           = 0x10,
-						TightenBoundingBox      = 0x20 } ;
+						TightenBoundingBox      = 0x20,
+						ProcessInBackground     = 0x40,
+						OptimizeBSPSplits       = 0x80,
+						ParallelBSPConstruction = 0x100,
+						FilterPrimitives        = 0x200,
+						CullHiddenFacesOnGPU    = 0x400,
+						RasterizeDenseRegions   = 0x800 } ;
+
+			//  By default, the BSPSort method uses the polygons in their drawing
+			// order as splitting planes. With OptimizeBSPSplits, each plane is
+			// chosen among a few candidates, to minimize the number of split
+			// polygons while keeping the tree balanced: the export is smaller,
+			// and faster on large CAD-like scenes. ParallelBSPConstruction also
+			// builds the large subtrees of this balanced tree on several
+			// threads.
+
+			//  DepthBucketSort sorts the primitives on their depth, and only
+			// reorders the primitives that overlap both on screen and in depth,
+			// from their exact relative positions. It is much faster than
+			// TopologicalSort, and gives the same result on scenes with no
+			// intersecting primitives.
+
+			//  FilterPrimitives discards the parsed primitives that do not change
+			// the image, before they are sorted: those outside of the viewport,
+			// and those smaller than minimumPrimitiveSize() pixels along both
+			// axes. Polygons thinner than this size are replaced by a segment, and
+			// successive coplanar triangles of the same color that share an edge
+			// are merged in a convex polygon.
+
+			float minimumPrimitiveSize() const { return _minimum_primitive_size ; }
+			void setMinimumPrimitiveSize(float s) { _minimum_primitive_size = s ; }
+
+			//  CullHiddenFacesOnGPU draws the captured primitives again with
+			// unique colors, in an offscreen buffer of idBufferScale() times the
+			// viewport size, and discards the ones that cover no pixel before
+			// they are sorted. This is much faster than CullHiddenFaces on dense
+			// occluded scenes, and exact up to the sampling of the buffer: a
+			// primitive that is only visible between its pixels is lost. It is
+			// not used with a BSPTree kept across exports.
+
+			int idBufferScale() const { return _id_buffer_scale ; }
+			void setIdBufferScale(int s) { _id_buffer_scale = s ; }
+
+			//  RasterizeDenseRegions draws the regions of the page covered by more
+			// than rasterizationThreshold() polygons per 32x32 cell in images of
+			// rasterResolution() dots per inch, embedded in the file, while the
+			// sparse regions, the segments and the points stay vectorial. The size
+			// of the file is then bounded on very dense meshes. It is used by the
+			// EPS, PS and PDF formats, and by XFIG, whose images are written as
+			// PNG files next to the figure. The primitives are then sorted before
+			// being exported, instead of being streamed to the file.
+
+			float rasterizationThreshold() const { return _rasterization_threshold ; }
+			void setRasterizationThreshold(float t) { _rasterization_threshold = t ; }
+
+			float rasterResolution() const { return _raster_resolution ; }
+			void setRasterResolution(float dpi) { _raster_resolution = dpi ; }
 
 			int sortMethod()    { return _sortMethod; }
 			void setSortMethod(VRenderParams::VRenderSortMethod s) { _sortMethod = s ; }
@@ -44,6 +188,44 @@ namespace vrender
 
 			void setProgressFunction(ProgressFunction pf) { _progress_function = pf ; }
 
+			//  Asks the running export to stop. This can be called from any thread,
+			// or from the progress function. The export checks it each time it
+			// reports its progress, and then throws a VRenderCanceled exception.
+			// The flag is reset when VectorialRender() starts.
+			//
+			//  With the ProcessInBackground option, everything that follows the
+			// capture of the scene runs on a worker thread, while the calling
+			// thread only calls the progress function. A progress function that
+			// processes the application events then keeps the interface responsive.
+
+			void cancel() { _canceled = true ; }
+			bool isCanceled() const { return _canceled ; }
+
+			//  Reports the progress of the current stage of the export, and throws
+			// VRenderCanceled when cancel() was called.
+
+			void progress(float,const QString&) ;
+
+			//  When a BSPTree is set and the sort method is BSPSort, the BSP is
+			// built in world coordinates on the first export, and kept in the
+			// tree. The next exports do not call the render callback: they use
+			// the current OpenGL modelview, projection and viewport to traverse
+			// the tree and project its primitives. This is meant for exporting a
+			// static scene from many points of view. Call BSPTree::clear() when
+			// the scene changes. The tree is not owned by the VRenderParams.
+			//
+			//  The tree only holds what the first export captured: OpenGL clips
+			// the feedback primitives to the view frustum of that export. Make
+			// the first view see the whole scene (e.g. from a distant camera,
+			// with clipping planes that enclose the scene), or clear() the tree
+			// when a later view looks at a part that was off screen. Face
+			// culling is disabled during that capture, so that the faces seen
+			// from behind are kept, unless the render callback enables it
+			// itself.
+
+			void setBSPTree(BSPTree *tree) { _bsp_tree = tree ; }
+			BSPTree *bspTree() { return _bsp_tree ; }
+
 		private:
 			int _error;
 			VRenderSortMethod _sortMethod;
@@ -52,14 +234,32 @@ namespace vrender
 			ProgressFunction _progress_function ;
 
 			unsigned int _options; // _DrawMode; _ClearBG; _TightenBB;
+			float _minimum_primitive_size ;
+			int _id_buffer_scale ;
+			float _rasterization_threshold ;
+			float _raster_resolution ;
 			QString _filename;
 
+			BSPTree *_bsp_tree ;
+
+			std::atomic<bool> _canceled ;
+
+			//  When the export runs on a worker thread, progress() only records its
+			// arguments, and flushProgress() calls the progress function.
+			bool _defer_progress ;
+			std::mutex _progress_mutex ;
+			bool _progress_pending ;
+			float _pending_progress ;
+			QString _pending_message ;
+
 			friend void VectorialRender(	RenderCB render_callback,
 							void *callback_params,
 							VRenderParams& vparams);
+			friend class VRenderBatch ;
 			friend class ParserGL ;
 			friend class Exporter ;
 			friend class BSPSortMethod ;
+			friend class BSPTree ;
 			friend class VisibilityOptimizer ;
 			friend class TopologicalSortMethod ;
 			friend class TopologicalSortUtils ;
@@ -67,7 +267,7 @@ namespace vrender
 			int& error() { return _error ; }
 			int& size()  { static int size=1000000; return size ; }
 
-			void progress(float,const QString&) ;
+			void flushProgress() ;
 	};
 }
 #endif
@@ -1,4 +1,6 @@
 #include <vector>
+#include <algorithm>
+#include <float.h>
 #include "VRender.h"
 #include "Optimizer.h"
 #include "Primitive.h"
@@ -51,10 +53,76 @@ void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParam
 
         // Ca serait pas mal mieux avec une interface c++...
 
-        gpc_polygon cumulated_union ;
-        cumulated_union.num_contours = 0 ;
-        cumulated_union.hole = nullptr ;
-        cumulated_union.contour = nullptr ;
+        // The union of the already processed primitives is split along a
+        // regular grid of screen tiles. Each primitive is only compared to the
+        // union of the tiles it overlaps, which keeps the contours handled by gpc
+        // small, and tiles that are entirely covered reject primitives without
+        // any clipping.
+
+        double gminx =  FLT_MAX ;
+        double gminy =  FLT_MAX ;
+        double gmaxx = -FLT_MAX ;
+        double gmaxy = -FLT_MAX ;
+        size_t nb_polys = 0 ;
+
+        for(size_t i=0;i<primitives.size();++i)
+                if(primitives[i] != nullptr && primitives[i]->nbVertices() > 1)
+                {
+                        for(size_t j=0;j<primitives[i]->nbVertices();++j)
+                        {
+                                gminx = min(gminx,primitives[i]->vertex(j).x()) ;
+                                gminy = min(gminy,primitives[i]->vertex(j).y()) ;
+                                gmaxx = max(gmaxx,primitives[i]->vertex(j).x()) ;
+                                gmaxy = max(gmaxy,primitives[i]->vertex(j).y()) ;
+                        }
+                        ++nb_polys ;
+                }
+
+        if(nb_polys == 0)
+                return ;
+
+        // Segments are thickened below, so that the grid must be slightly larger
+        // than the vertices bounding box.
+
+        double margin = 0.01 + 0.01*max(gmaxx-gminx,gmaxy-gminy) ;
+        gminx -= margin ;
+        gminy -= margin ;
+        gmaxx += margin ;
+        gmaxy += margin ;
+
+        const int nb_tiles = max(1,min(64,int(sqrt(double(nb_polys))/4))) ;
+        const double tile_w = (gmaxx-gminx)/nb_tiles ;
+        const double tile_h = (gmaxy-gminy)/nb_tiles ;
+
+        vector<gpc_polygon> tile_rect(nb_tiles*nb_tiles) ;
+        vector<gpc_polygon> tile_union(nb_tiles*nb_tiles) ;
+        vector<bool> tile_covered(nb_tiles*nb_tiles,false) ;
+
+        for(int ty=0;ty<nb_tiles;++ty)
+                for(int tx=0;tx<nb_tiles;++tx)
+                {
+                        gpc_polygon& rect(tile_rect[ty*nb_tiles+tx]) ;
+                        rect.num_contours = 0 ;
+                        rect.hole = nullptr ;
+                        rect.contour = nullptr ;
+
+                        gpc_vertex rect_verts[4] ;
+                        rect_verts[0].x = gminx + tx*tile_w ;     rect_verts[0].y = gminy + ty*tile_h ;
+                        rect_verts[1].x = gminx + (tx+1)*tile_w ; rect_verts[1].y = gminy + ty*tile_h ;
+                        rect_verts[2].x = gminx + (tx+1)*tile_w ; rect_verts[2].y = gminy + (ty+1)*tile_h ;
+                        rect_verts[3].x = gminx + tx*tile_w ;     rect_verts[3].y = gminy + (ty+1)*tile_h ;
+
+                        gpc_vertex_list rect_list ;
+                        rect_list.num_vertices = 4 ;
+                        rect_list.vertex = rect_verts ;
+                        gpc_add_contour(&rect,&rect_list,false) ;
+
+                        gpc_polygon& u(tile_union[ty*nb_tiles+tx]) ;
+                        u.num_contours = 0 ;
+                        u.hole = nullptr ;
+                        u.contour = nullptr ;
+                }
+
         size_t nboptimised = 0 ;
 
         for(size_t pindex = primitives.size() - 1; long(pindex) >= 0;--pindex,++nboptimised)
@@ -83,7 +151,6 @@ void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParam
                                 try
                                 {
                                         PtrPrimitive p(primitives[pindex]) ;
-                                        gpc_polygon difference ;
                                         gpc_polygon new_poly ;
                                         gpc_polygon new_poly_reduced ;
                                         new_poly.num_contours = 0 ;
@@ -95,79 +162,110 @@ void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParam
 
                                         // 1 - creates a gpc_polygon corresponding to the current primitive
 
-                                        gpc_vertex_list *new_poly_verts = new gpc_vertex_list ;
-                                        gpc_vertex_list *new_poly_reduced_verts = new gpc_vertex_list ;
+                                        size_t nv = (p->nbVertices() == 2)?4:p->nbVertices() ;
+                                        vector<gpc_vertex> new_poly_vertices(nv) ;
+                                        vector<gpc_vertex> new_poly_reduced_vertices(nv) ;
+
+                                        gpc_vertex_list new_poly_verts ;
+                                        gpc_vertex_list new_poly_reduced_verts ;
+                                        new_poly_verts.num_vertices = nv ;
+                                        new_poly_verts.vertex = &new_poly_vertices[0] ;
+                                        new_poly_reduced_verts.num_vertices = nv ;
+                                        new_poly_reduced_verts.vertex = &new_poly_reduced_vertices[0] ;
 
                                         double mx = 0.0 ;
                                         double my = 0.0 ;
 
                                         if(p->nbVertices() == 2)
                                         {
-                                                new_poly_verts->num_vertices = 4 ;
-                                                new_poly_verts->vertex = new gpc_vertex[4] ;
-                                                new_poly_reduced_verts->num_vertices = 4 ;
-                                                new_poly_reduced_verts->vertex = new gpc_vertex[4] ;
-
                                                 double deps = 0.001 ;
                                                 double du = p->vertex(1).y()-p->vertex(0).y() ;
                                                 double dv = p->vertex(1).x()-p->vertex(0).x() ;
                                                 double n = sqrt(du*du+dv*dv) ;
                                                 du *= deps/n ;
                                                 dv *= deps/n ;
-                                                new_poly_verts->vertex[0].x = p->vertex(0).x() + du ;
-                                                new_poly_verts->vertex[0].y = p->vertex(0).y() + dv ;
-                                                new_poly_verts->vertex[1].x = p->vertex(1).x() + du ;
-                                                new_poly_verts->vertex[1].y = p->vertex(1).y() + dv ;
-                                                new_poly_verts->vertex[2].x = p->vertex(1).x() - du ;
-                                                new_poly_verts->vertex[2].y = p->vertex(1).y() - dv ;
-                                                new_poly_verts->vertex[3].x = p->vertex(0).x() - du ;
-                                                new_poly_verts->vertex[3].y = p->vertex(0).y() - dv ;
-
-                                                new_poly_reduced_verts->vertex[0].x = p->vertex(0).x() + du ;
-                                                new_poly_reduced_verts->vertex[0].y = p->vertex(0).y() + dv ;
-                                                new_poly_reduced_verts->vertex[1].x = p->vertex(1).x() + du ;
-                                                new_poly_reduced_verts->vertex[1].y = p->vertex(1).y() + dv ;
-                                                new_poly_reduced_verts->vertex[2].x = p->vertex(1).x() - du ;
-                                                new_poly_reduced_verts->vertex[2].y = p->vertex(1).y() - dv ;
-                                                new_poly_reduced_verts->vertex[3].x = p->vertex(0).x() - du ;
-                                                new_poly_reduced_verts->vertex[3].y = p->vertex(0).y() - dv ;
+                                                new_poly_vertices[0].x = p->vertex(0).x() + du ;
+                                                new_poly_vertices[0].y = p->vertex(0).y() + dv ;
+                                                new_poly_vertices[1].x = p->vertex(1).x() + du ;
+                                                new_poly_vertices[1].y = p->vertex(1).y() + dv ;
+                                                new_poly_vertices[2].x = p->vertex(1).x() - du ;
+                                                new_poly_vertices[2].y = p->vertex(1).y() - dv ;
+                                                new_poly_vertices[3].x = p->vertex(0).x() - du ;
+                                                new_poly_vertices[3].y = p->vertex(0).y() - dv ;
+
+                                                new_poly_reduced_vertices = new_poly_vertices ;
+                                                new_poly_reduced_verts.vertex = &new_poly_reduced_vertices[0] ;
                                         }
                                         else
                                         {
-                                                new_poly_verts->num_vertices = p->nbVertices() ;
-                                                new_poly_verts->vertex = new gpc_vertex[p->nbVertices()] ;
-
                                                 for(size_t i=0;i<p->nbVertices();++i)
                                                 {
-                                                        new_poly_verts->vertex[i].x = p->vertex(i).x() ;
-                                                        new_poly_verts->vertex[i].y = p->vertex(i).y() ;
+                                                        new_poly_vertices[i].x = p->vertex(i).x() ;
+                                                        new_poly_vertices[i].y = p->vertex(i).y() ;
                                                         mx += p->vertex(i).x() ;
                                                         my += p->vertex(i).y() ;
                                                 }
                                                 mx /= p->nbVertices() ;
                                                 my /= p->nbVertices() ;
 
-                                                new_poly_reduced_verts->num_vertices = p->nbVertices() ;
-                                                new_poly_reduced_verts->vertex = new gpc_vertex[p->nbVertices()] ;
-
                                                 for(size_t j=0;j<p->nbVertices();++j)
                                                 {
-                                                        new_poly_reduced_verts->vertex[j].x = mx + (p->vertex(j).x() - mx)*0.999 ;
-                                                        new_poly_reduced_verts->vertex[j].y = my + (p->vertex(j).y() - my)*0.999 ;
+                                                        new_poly_reduced_vertices[j].x = mx + (p->vertex(j).x() - mx)*0.999 ;
+                                                        new_poly_reduced_vertices[j].y = my + (p->vertex(j).y() - my)*0.999 ;
                                                 }
                                         }
-                                        gpc_add_contour(&new_poly,new_poly_verts,false) ;
-                                        gpc_add_contour(&new_poly_reduced,new_poly_reduced_verts,false) ;
 
-                                        // 2 - computes the difference between this polygon, and the union of the
-                                        // 	preceeding ones.
+                                        // 2 - finds the tiles overlapped by the bounding box of the polygon.
 
-                                        gpc_polygon_clip(GPC_DIFF,&new_poly_reduced,&cumulated_union,&difference) ;
+                                        double pminx = FLT_MAX, pminy = FLT_MAX, pmaxx = -FLT_MAX, pmaxy = -FLT_MAX ;
+                                        for(size_t i=0;i<nv;++i)
+                                        {
+                                                pminx = min(pminx,new_poly_vertices[i].x) ;
+                                                pminy = min(pminy,new_poly_vertices[i].y) ;
+                                                pmaxx = max(pmaxx,new_poly_vertices[i].x) ;
+                                                pmaxy = max(pmaxy,new_poly_vertices[i].y) ;
+                                        }
 
-                                        // 3 - checks the difference. If void, the primitive is not visible: skip it
-                                        // 	and go to next primitive.
+                                        int tx0 = max(0,min(nb_tiles-1,int(floor((pminx-gminx)/tile_w)))) ;
+                                        int tx1 = max(0,min(nb_tiles-1,int(floor((pmaxx-gminx)/tile_w)))) ;
+                                        int ty0 = max(0,min(nb_tiles-1,int(floor((pminy-gminy)/tile_h)))) ;
+                                        int ty1 = max(0,min(nb_tiles-1,int(floor((pmaxy-gminy)/tile_h)))) ;
 
-                                        if(difference.num_contours == 0)
+                                        // 3 - computes the difference between this polygon, and the union of the
+                                        // 	preceeding ones, tile by tile. Covered tiles are skipped, and the
+                                        // 	first non void difference means that the primitive is visible.
+
+                                        bool visible = false ;
+                                        gpc_add_contour(&new_poly_reduced,&new_poly_reduced_verts,false) ;
+
+                                        for(int ty=ty0;ty<=ty1 && !visible;++ty)
+                                                for(int tx=tx0;tx<=tx1 && !visible;++tx)
+                                                {
+                                                        int t = ty*nb_tiles+tx ;
+
+                                                        if(tile_covered[t])
+                                                                continue ;
+
+                                                        gpc_polygon part ;
+                                                        gpc_polygon difference ;
+
+                                                        gpc_polygon_clip(GPC_INT,&new_poly_reduced,&tile_rect[t],&part) ;
+
+                                                        if(part.num_contours > 0)
+                                                        {
+                                                                gpc_polygon_clip(GPC_DIFF,&part,&tile_union[t],&difference) ;
+                                                                visible = (difference.num_contours > 0) ;
+                                                                gpc_free_polygon(&difference) ;
+                                                        }
+                                                        gpc_free_polygon(&part) ;
+                                                }
+
+                                        gpc_free_polygon(&new_poly_reduced) ;
+
+                                        // 4 - If void, the primitive is not visible: skip it and go to next
+                                        // 	primitive.
+
+                                        if(!visible)
                                         {
                                                 ++nb_culled ;
                                                 delete p ;
@@ -175,37 +273,54 @@ void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParam
                                                 continue ;
                                         }
 
-                                        // 4 - The primitive is visible. Let's add it to the cumulated union of
-                                        // 	primitives.
+                                        // 5 - The primitive is visible. Let's add it to the cumulated union of
+                                        // 	the tiles it overlaps.
 
                                         if(p->nbVertices() > 2)
                                         {
-                                                gpc_polygon cumulated_union_tmp ;
-                                                cumulated_union_tmp.num_contours = 0 ;
-                                                cumulated_union_tmp.hole = nullptr ;
-                                                cumulated_union_tmp.contour = nullptr ;
-
-                                                gpc_polygon_clip(GPC_UNION,&new_poly,&cumulated_union,&cumulated_union_tmp) ;
-
-                                                gpc_free_polygon(&cumulated_union) ;
-                                                cumulated_union = cumulated_union_tmp ;
+                                                gpc_add_contour(&new_poly,&new_poly_verts,false) ;
+
+                                                for(int ty=ty0;ty<=ty1;++ty)
+                                                        for(int tx=tx0;tx<=tx1;++tx)
+                                                        {
+                                                                int t = ty*nb_tiles+tx ;
+
+                                                                if(tile_covered[t])
+                                                                        continue ;
+
+                                                                gpc_polygon part ;
+                                                                gpc_polygon_clip(GPC_INT,&new_poly,&tile_rect[t],&part) ;
+
+                                                                if(part.num_contours > 0)
+                                                                {
+                                                                        gpc_polygon union_tmp ;
+                                                                        gpc_polygon_clip(GPC_UNION,&part,&tile_union[t],&union_tmp) ;
+                                                                        gpc_free_polygon(&tile_union[t]) ;
+                                                                        tile_union[t] = union_tmp ;
+
+                                                                        gpc_polygon uncovered ;
+                                                                        gpc_polygon_clip(GPC_DIFF,&tile_rect[t],&tile_union[t],&uncovered) ;
+                                                                        tile_covered[t] = (uncovered.num_contours == 0) ;
+                                                                        gpc_free_polygon(&uncovered) ;
+                                                                }
+                                                                gpc_free_polygon(&part) ;
+                                                        }
+
+                                                gpc_free_polygon(&new_poly) ;
                                         }
-
-                                        gpc_free_polygon(&new_poly) ;
-                                        gpc_free_polygon(&new_poly_reduced) ;
-                                        gpc_free_polygon(&difference) ;
 #ifdef DEBUG_EPSRENDER__SHOW1
                                         glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT) ;
 
                                         glColor3f(1.0,0.0,0.0) ;
 
-                                        for(unsigned long i=0;i<cumulated_union.num_contours;++i)
-                                        {
-                                                glBegin(GL_LINE_LOOP) ;
-                                                for(unsigned long j=0;j<cumulated_union.contour[i].num_vertices;++j)
-                                                        glVertex2f(cumulated_union.contour[i].vertex[j].x,cumulated_union.contour[i].vertex[j].y) ;
-                                                glEnd() ;
-                                        }
+                                        for(size_t t=0;t<tile_union.size();++t)
+                                                for(unsigned long i=0;i<tile_union[t].num_contours;++i)
+                                                {
+                                                        glBegin(GL_LINE_LOOP) ;
+                                                        for(long j=0;j<tile_union[t].contour[i].num_vertices;++j)
+                                                                glVertex2f(tile_union[t].contour[i].vertex[j].x,tile_union[t].contour[i].vertex[j].y) ;
+                                                        glEnd() ;
+                                                }
 
                                         glFlush() ;
                                         glXSwapBuffers(glXGetCurrentDisplay(),glXGetCurrentDrawable()) ;
@@ -225,7 +340,11 @@ void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParam
         cout << nb_culled << " primitives culled over " << primitives.size() << "." << endl ;
 #endif
 
-        gpc_free_polygon(&cumulated_union) ;
+        for(size_t t=0;t<tile_rect.size();++t)
+        {
+                gpc_free_polygon(&tile_rect[t]) ;
+                gpc_free_polygon(&tile_union[t]) ;
+        }
 }
 
 
@@ -0,0 +1,76 @@
+#include "animationClock.h"
+
+#include <QCoreApplication>
+#include <QPointer>
+
+using namespace qglviewer;
+
+/*! Creates an AnimationClock, with a default period() of 16 milliseconds.
+The clock is not active until an object is start()ed. */
+AnimationClock::AnimationClock(QObject *parent)
+    : QObject(parent), period_(16), elapsed_(0) {
+  // Coarse timers may be off by 5%, which is visible at 60Hz
+  timer_.setTimerType(Qt::PreciseTimer);
+  connect(&timer_, SIGNAL(timeout()), SLOT(update()));
+}
+
+/*! Returns an application wide AnimationClock, created on first call and
+deleted with the \c QCoreApplication. Set it as the QGLViewer::animationClock()
+of several viewers to synchronize their animations. */
+AnimationClock *AnimationClock::applicationClock() {
+  static QPointer<AnimationClock> clock;
+  if (!clock)
+    clock = new AnimationClock(QCoreApplication::instance());
+  return clock;
+}
+
+/*! Sets the period(), in milliseconds. Negative values are ignored. */
+void AnimationClock::setPeriod(int period) {
+  if (period < 0)
+    return;
+
+  period_ = period;
+  if (timer_.isActive())
+    timer_.start(period_);
+}
+
+/*! Declares that \p animated needs the clock tick(). The clock becomes
+active, and the elapsed() time of the first tick() is measured from this
+call.
+
+Calling start() several times with the same object has the same effect as
+calling it once. A destroyed object is automatically stop()ped. */
+void AnimationClock::start(QObject *animated) {
+  if (!animated || started_.contains(animated))
+    return;
+
+  started_.insert(animated);
+  connect(animated, SIGNAL(destroyed(QObject *)), SLOT(remove(QObject *)));
+
+  if (!timer_.isActive()) {
+    time_.start();
+    timer_.start(period_);
+  }
+}
+
+/*! Declares that \p animated no longer needs the clock tick(). The clock
+stops when no object is started. */
+void AnimationClock::stop(QObject *animated) {
+  if (!started_.contains(animated))
+    return;
+
+  disconnect(animated, SIGNAL(destroyed(QObject *)), this,
+             SLOT(remove(QObject *)));
+  remove(animated);
+}
+
+void AnimationClock::remove(QObject *animated) {
+  started_.remove(animated);
+  if (started_.isEmpty())
+    timer_.stop();
+}
+
+void AnimationClock::update() {
+  elapsed_ = int(time_.restart());
+  Q_EMIT tick(elapsed_);
+}
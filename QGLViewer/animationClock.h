@@ -0,0 +1,86 @@
+#ifndef QGLVIEWER_ANIMATION_CLOCK_H
+#define QGLVIEWER_ANIMATION_CLOCK_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include "config.h"
+
+namespace qglviewer {
+/*! \brief A single timer that drives all the animations of a viewer.
+  \class AnimationClock animationClock.h QGLViewer/animationClock.h
+
+  A spinning ManipulatedFrame, a flying ManipulatedCameraFrame, a playing
+  KeyFrameInterpolator and the QGLViewer animation loop each used to have their
+  own timer. These timers fire independently, and each of them triggers a
+  redraw: several animations result in irregular and redundant repaints.
+
+  When they are attached to an AnimationClock (see
+  ManipulatedFrame::setAnimationClock(),
+  KeyFrameInterpolator::setAnimationClock() and
+  QGLViewer::setAnimationClock()), these objects are instead all advanced
+  by the same tick() signal, emitted every period() milliseconds. They all use
+  the same elapsed() time, measured since the previous tick, and the redraws
+  they request from the same tick are merged into a single repaint.
+
+  Each QGLViewer has its own clock (see QGLViewer::animationClock()), to which
+  its camera and manipulatedFrame() are attached. Use applicationClock() to
+  share a clock between several viewers:
+  \code
+  viewer1->setAnimationClock(AnimationClock::applicationClock());
+  viewer2->setAnimationClock(AnimationClock::applicationClock());
+  \endcode
+
+  The timer only runs when at least one attached object is animated: the
+  objects call start() when their motion starts and stop() when it ends. */
+class QGLVIEWER_EXPORT AnimationClock : public QObject {
+  Q_OBJECT
+
+public:
+  AnimationClock(QObject *parent = nullptr);
+
+  static AnimationClock *applicationClock();
+
+  /*! Returns the tick() period, in milliseconds. Default value is 16
+  milliseconds, about 60 ticks per second. */
+  int period() const { return period_; }
+  /*! Returns the time elapsed between the last two tick(), in milliseconds.
+  This is the value sent by tick(). */
+  int elapsed() const { return elapsed_; }
+  /*! Returns \c true when the clock is ticking, i.e. when at least one
+  object isStarted(). */
+  bool isActive() const { return timer_.isActive(); }
+
+  void start(QObject *animated);
+  void stop(QObject *animated);
+  /*! Returns \c true when \p animated was start()ed and not stop()ped. */
+  bool isStarted(QObject *animated) const {
+    return started_.contains(animated);
+  }
+
+public Q_SLOTS:
+  void setPeriod(int period);
+
+Q_SIGNALS:
+  /*! Emitted every period() milliseconds while the clock isActive().
+  \p elapsed is the time since the previous tick, in milliseconds. All the
+  attached objects are advanced by this same duration. */
+  void tick(int elapsed);
+
+private Q_SLOTS:
+  void update();
+  void remove(QObject *animated);
+
+private:
+  QTimer timer_;
+  QElapsedTimer time_;
+  QSet<QObject *> started_;
+  int period_;
+  int elapsed_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_ANIMATION_CLOCK_H
@@ -0,0 +1,1054 @@
+#include "brickedVolume.h"
+#include "camera.h"
+#include "domUtils.h"
+
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QMatrix4x4>
+#include <QMutexLocker>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#ifndef GL_TEXTURE_3D
+#define GL_TEXTURE_3D 0x806F
+#endif
+#ifndef GL_TEXTURE_BINDING_3D
+#define GL_TEXTURE_BINDING_3D 0x806A
+#endif
+#ifndef GL_TEXTURE_WRAP_R
+#define GL_TEXTURE_WRAP_R 0x8072
+#endif
+#ifndef GL_MAX_3D_TEXTURE_SIZE
+#define GL_MAX_3D_TEXTURE_SIZE 0x8073
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_RGBA8UI
+#define GL_RGBA8UI 0x8D7C
+#endif
+#ifndef GL_RGBA_INTEGER
+#define GL_RGBA_INTEGER 0x8D99
+#endif
+
+using namespace qglviewer;
+
+// Bricks read simultaneously: more requests would delay the nearest ones
+static const int maximumNbLoading = 8;
+// Bytes uploaded per draw(), so that a burst of loads does not stall a frame
+static const qint64 maximumUploadSize = 16 << 20;
+// Slots along each axis of the pool, addressed by the 8 bit page table
+static const int maximumPoolSize = 256;
+
+// The 12 triangles of the unit cube, counter clockwise seen from outside.
+// Bit 0 of a corner index is its x coordinate, bit 1 y and bit 2 z.
+static const char *vertexShaderSource =
+    "uniform mat4 modelViewProjection;\n"
+    "uniform vec3 boxMin;\n"
+    "uniform vec3 boxSize;\n"
+    "uniform vec3 dimensions;\n"
+    "out vec3 voxelPosition;\n"
+    "\n"
+    "const int corners[36] = int[36](0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5,\n"
+    "                                0, 1, 5, 0, 5, 4, 2, 6, 7, 2, 7, 3,\n"
+    "                                0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6);\n"
+    "\n"
+    "void main() {\n"
+    "  int corner = corners[gl_VertexID];\n"
+    "  vec3 unit = vec3(float(corner & 1), float((corner >> 1) & 1),\n"
+    "                   float((corner >> 2) & 1));\n"
+    "  voxelPosition = unit * dimensions;\n"
+    "  vec3 position = boxMin + unit * boxSize;\n"
+    "  gl_Position = modelViewProjection * vec4(position, 1.0);\n"
+    "}\n";
+
+// Marches the ray of the back face fragment, in voxel coordinates. The alpha
+// of the page table entry is 0 for the bricks that must be skipped. With a
+// sceneDepth texture, the ray ends at the unprojected scene depth.
+static const char *fragmentShaderSource =
+    "uniform highp sampler3D pool;\n"
+    "uniform highp usampler3D pageTable;\n"
+    "uniform highp sampler2D transferFunction;\n"
+    "uniform highp sampler2D sceneDepth;\n"
+    "uniform bool hasSceneDepth;\n"
+    "uniform bool clipControl;\n"
+    "uniform vec4 viewport;\n"
+    "uniform mat4 inverseModelViewProjection;\n"
+    "uniform vec3 boxMin;\n"
+    "uniform vec3 boxSize;\n"
+    "uniform vec3 dimensions;\n"
+    "uniform float brickSize;\n"
+    "uniform vec3 poolTexelSize;\n"
+    "uniform vec2 transferFunctionRange;\n"
+    "uniform bool perspective;\n"
+    "uniform vec3 eye;\n"
+    "uniform vec3 viewDirection;\n"
+    "uniform float stepSize;\n"
+    "uniform float termination;\n"
+    "uniform int maxSteps;\n"
+    "in vec3 voxelPosition;\n"
+    "out vec4 fragColor;\n"
+    "\n"
+    "void main() {\n"
+    "  vec3 direction = normalize(perspective ? voxelPosition - eye\n"
+    "                                         : viewDirection);\n"
+    "  vec3 origin = perspective ? eye\n"
+    "                            : voxelPosition - direction *\n"
+    "                              dot(voxelPosition - eye, direction);\n"
+    "  vec3 invDirection =\n"
+    "      1.0 / mix(direction, vec3(1.0e-6), equal(direction, vec3(0.0)));\n"
+    "\n"
+    "  vec3 t0 = -origin * invDirection;\n"
+    "  vec3 t1 = (dimensions - origin) * invDirection;\n"
+    "  vec3 tMin = min(t0, t1);\n"
+    "  vec3 tMax = max(t0, t1);\n"
+    "  float t = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));\n"
+    "  float tEnd = min(min(tMax.x, tMax.y), tMax.z);\n"
+    "  if (hasSceneDepth) {\n"
+    "    vec2 uv = (gl_FragCoord.xy - viewport.xy) / viewport.zw;\n"
+    "    float depth = texture(sceneDepth, uv).r;\n"
+    "    vec4 ndc = vec4(2.0 * uv - 1.0,\n"
+    "                    clipControl ? depth : 2.0 * depth - 1.0, 1.0);\n"
+    "    vec4 world = inverseModelViewProjection * ndc;\n"
+    "    // The infinite far plane of a reversed depth is not an end\n"
+    "    if (world.w != 0.0) {\n"
+    "      vec3 scene = (world.xyz / world.w - boxMin) / boxSize *\n"
+    "                   dimensions;\n"
+    "      tEnd = min(tEnd, dot(scene - origin, direction));\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  ivec3 nbBricks = textureSize(pageTable, 0);\n"
+    "  vec3 exitSide = step(0.0, direction) * brickSize;\n"
+    "  vec4 color = vec4(0.0);\n"
+    "  for (int i = 0; (i < maxSteps) && (t < tEnd); ++i) {\n"
+    "    vec3 p = origin + t * direction;\n"
+    "    ivec3 brick = ivec3(floor(p / brickSize));\n"
+    "    brick = clamp(brick, ivec3(0), nbBricks - 1);\n"
+    "    uvec4 entry = texelFetch(pageTable, brick, 0);\n"
+    "    vec3 corner = vec3(brick) * brickSize;\n"
+    "    if (entry.a == 0u) {\n"
+    "      // Empty space skipping: jump to the exit of the brick\n"
+    "      vec3 exits = (corner + exitSide - origin) * invDirection;\n"
+    "      t = max(min(min(exits.x, exits.y), exits.z), t) + 0.01;\n"
+    "      continue;\n"
+    "    }\n"
+    "\n"
+    "    // Pool texel, after the one voxel border of the slot\n"
+    "    vec3 texel = vec3(entry.xyz) * (brickSize + 2.0) + p - corner + 1.0;\n"
+    "    float value = texture(pool, texel * poolTexelSize).r;\n"
+    "    vec4 voxel = texture(transferFunction,\n"
+    "                         vec2(value * transferFunctionRange.x +\n"
+    "                              transferFunctionRange.y, 0.5));\n"
+    "    // The transfer function opacities are given for one voxel\n"
+    "    float alpha = 1.0 - pow(1.0 - voxel.a, stepSize);\n"
+    "    color += (1.0 - color.a) * vec4(voxel.rgb * alpha, alpha);\n"
+    "    if (color.a >= termination)\n"
+    "      break;\n"
+    "    t += stepSize;\n"
+    "  }\n"
+    "\n"
+    "  if (color.a == 0.0)\n"
+    "    discard;\n"
+    "  fragColor = color;\n"
+    "}\n";
+
+/*! Creates an empty BrickedVolume. Use load() to open a volume. */
+BrickedVolume::BrickedVolume(QObject *parent)
+    : QObject(parent), brickSize_(0), bitsPerVoxel_(8),
+      transferFunctionIsDirty_(true), stepRate_(2.0),
+      interactionStepRate_(0.5), terminationOpacity_(0.98),
+      gpuMemoryBudget_(qint64(512) << 20), frame_(0), nbDrawnBricks_(0),
+      nbMissingBricks_(0), loaderThreadPool_(nullptr), nbLoading_(0),
+      reduceTo8Bits_(false), context_(nullptr), functions_(nullptr),
+      program_(nullptr), vao_(nullptr), isSupported_(false), poolTexture_(0),
+      pageTableTexture_(0), transferFunctionTexture_(0),
+      pageTableIsDirty_(false) {
+  for (int k = 0; k < 3; ++k)
+    dimensions_[k] = gridSize_[k] = poolSize_[k] = 0;
+
+  QVector<QRgb> ramp(256);
+  for (int i = 0; i < ramp.size(); ++i)
+    ramp[i] = qRgba(i, i, i, i);
+  setTransferFunction(ramp);
+}
+
+/*! Destructor. Waits for the loader threads. The OpenGL resources are only
+released when the context used by draw() is current. Call cleanupGL() before
+otherwise. */
+BrickedVolume::~BrickedVolume() {
+  if (loaderThreadPool_) {
+    loaderThreadPool_->clear();
+    loaderThreadPool_->waitForDone();
+  }
+  delete loaderThreadPool_;
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Volume                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Reads the \c volume.xml description of the volume stored in \p directory
+(see the on-disk format in the class documentation), and builds its occupancy
+hierarchy. No voxel is read: the bricks are loaded on demand by draw().
+
+Returns \c false (and the BrickedVolume is empty) when the description file
+cannot be read or is invalid. */
+bool BrickedVolume::load(const QString &directory) {
+  clear();
+
+  QFile file(QDir(directory).filePath("volume.xml"));
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning("BrickedVolume::load: Unable to open %s",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  QDomDocument document;
+  if (!document.setContent(&file)) {
+    qWarning("BrickedVolume::load: %s is not a valid XML file",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  const QDomElement root = document.documentElement();
+  if (root.tagName() != "BrickedVolume") {
+    qWarning("BrickedVolume::load: %s is not a volume description",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  dimensions_[0] = DomUtils::intFromDom(root, "width", 0);
+  dimensions_[1] = DomUtils::intFromDom(root, "height", 0);
+  dimensions_[2] = DomUtils::intFromDom(root, "depth", 0);
+  brickSize_ = DomUtils::intFromDom(root, "brickSize", 0);
+  bitsPerVoxel_ = DomUtils::intFromDom(root, "bitsPerVoxel", 8);
+  if ((dimensions_[0] <= 0) || (dimensions_[1] <= 0) ||
+      (dimensions_[2] <= 0) || (brickSize_ <= 0) ||
+      ((bitsPerVoxel_ != 8) && (bitsPerVoxel_ != 16))) {
+    qWarning("BrickedVolume::load: Invalid dimensions, brick size or voxel "
+             "size in %s",
+             qPrintable(file.fileName()));
+    clear();
+    return false;
+  }
+
+  int nbGridBricks = 1;
+  for (int k = 0; k < 3; ++k) {
+    gridSize_[k] = (dimensions_[k] + brickSize_ - 1) / brickSize_;
+    nbGridBricks *= gridSize_[k];
+  }
+  gridBricks_.fill(-1, nbGridBricks);
+
+  const qreal maxValue = (1 << bitsPerVoxel_) - 1;
+  QDomElement child = root.firstChild().toElement();
+  while (!child.isNull()) {
+    if (child.tagName() == "BoundingBoxMin")
+      min_ = Vec(child);
+    else if (child.tagName() == "BoundingBoxMax")
+      max_ = Vec(child);
+    else if (child.tagName() == "Brick") {
+      Brick brick;
+      brick.x = DomUtils::intFromDom(child, "x", -1);
+      brick.y = DomUtils::intFromDom(child, "y", -1);
+      brick.z = DomUtils::intFromDom(child, "z", -1);
+      if ((brick.x < 0) || (brick.x >= gridSize_[0]) || (brick.y < 0) ||
+          (brick.y >= gridSize_[1]) || (brick.z < 0) ||
+          (brick.z >= gridSize_[2]) ||
+          (gridBricks_[cellIndex(0, brick.x, brick.y, brick.z)] >= 0)) {
+        qWarning("BrickedVolume::load: Invalid or duplicated brick %d %d %d",
+                 brick.x, brick.y, brick.z);
+        clear();
+        return false;
+      }
+      brick.min = DomUtils::qrealFromDom(child, "min", 0.0) / maxValue;
+      brick.max = DomUtils::qrealFromDom(child, "max", maxValue) / maxValue;
+      brick.state = ON_DISK;
+      brick.slot = -1;
+      brick.lastDrawnFrame = 0;
+
+      gridBricks_[cellIndex(0, brick.x, brick.y, brick.z)] = bricks_.size();
+      bricks_.append(brick);
+    }
+    child = child.nextSibling().toElement();
+  }
+
+  if (bricks_.isEmpty()) {
+    qWarning("BrickedVolume::load: No brick in %s",
+             qPrintable(file.fileName()));
+    clear();
+    return false;
+  }
+
+  buildHierarchy();
+  directory_ = directory;
+  return true;
+}
+
+/*! Removes all the bricks. Waits for the running loads. The OpenGL resources
+are released: the viewer's context must be current when the volume was
+drawn. */
+void BrickedVolume::clear() {
+  if (loaderThreadPool_) {
+    loaderThreadPool_->clear();
+    loaderThreadPool_->waitForDone();
+  }
+  cleanupGL();
+
+  bricks_.clear();
+  gridBricks_.clear();
+  levels_.clear();
+  directory_.clear();
+  min_ = max_ = Vec();
+  for (int k = 0; k < 3; ++k)
+    dimensions_[k] = gridSize_[k] = 0;
+  brickSize_ = 0;
+  nbDrawnBricks_ = nbMissingBricks_ = 0;
+  nbLoading_ = 0;
+  inMemoryBricks_.clear();
+
+  QMutexLocker locker(&loadedMutex_);
+  loadedBricks_.clear();
+  loadedData_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Occupancy hierarchy                             //
+////////////////////////////////////////////////////////////////////////////////
+
+// Number of cells of level along axis
+int BrickedVolume::levelSize(int level, int axis) const {
+  return (gridSize_[axis] + (1 << level) - 1) >> level;
+}
+
+int BrickedVolume::cellIndex(int level, int x, int y, int z) const {
+  return x + levelSize(level, 0) * (y + levelSize(level, 1) * z);
+}
+
+// Level 0 holds the value ranges of the bricks, and each level the union of
+// the ranges of the eight cells below, up to a single root cell
+void BrickedVolume::buildHierarchy() {
+  const Cell empty = {1.0f, 0.0f};
+  levels_.clear();
+  levels_.append(QVector<Cell>(gridBricks_.size(), empty));
+  for (const Brick &brick : bricks_) {
+    Cell &cell = levels_[0][cellIndex(0, brick.x, brick.y, brick.z)];
+    cell.min = float(brick.min);
+    cell.max = float(brick.max);
+  }
+
+  int level = 0;
+  while ((levelSize(level, 0) > 1) || (levelSize(level, 1) > 1) ||
+         (levelSize(level, 2) > 1)) {
+    ++level;
+    QVector<Cell> cells(levelSize(level, 0) * levelSize(level, 1) *
+                            levelSize(level, 2),
+                        empty);
+    for (int z = 0; z < levelSize(level - 1, 2); ++z)
+      for (int y = 0; y < levelSize(level - 1, 1); ++y)
+        for (int x = 0; x < levelSize(level - 1, 0); ++x) {
+          const Cell &below = levels_[level - 1][cellIndex(level - 1, x, y, z)];
+          Cell &cell = cells[cellIndex(level, x / 2, y / 2, z / 2)];
+          cell.min = qMin(cell.min, below.min);
+          cell.max = qMax(cell.max, below.max);
+        }
+    levels_.append(cells);
+  }
+}
+
+// Same test as FrustumCuller: the box is outside of one of the planes
+static bool isCulled(const Vec &min, const Vec &max,
+                     const GLdouble planes[6][4]) {
+  const Vec center = (min + max) / 2.0;
+  const Vec extent = (max - min) / 2.0;
+  for (int i = 0; i < 6; ++i) {
+    const GLdouble *p = planes[i];
+    const qreal distance =
+        p[0] * center.x + p[1] * center.y + p[2] * center.z - p[3];
+    const qreal radius = fabs(p[0]) * extent.x +
+                         fabs(p[1]) * extent.y +
+                         fabs(p[2]) * extent.z;
+    if (distance > radius)
+      return true;
+  }
+  return false;
+}
+
+// Appends to selected the visible and non transparent bricks of a cell
+void BrickedVolume::selectCell(int level, int x, int y, int z,
+                               const Camera *camera,
+                               const GLdouble planes[6][4],
+                               QVector<Selection> &selected) const {
+  const Cell &cell = levels_[level][cellIndex(level, x, y, z)];
+  if ((cell.min > cell.max) || isTransparent(cell.min, cell.max))
+    return;
+
+  const int cellVoxels = brickSize_ << level;
+  const int position[3] = {x, y, z};
+  Vec min, max;
+  for (int k = 0; k < 3; ++k) {
+    const qreal scale = (max_[k] - min_[k]) / dimensions_[k];
+    min[k] = min_[k] + scale * qMin(position[k] * cellVoxels, dimensions_[k]);
+    max[k] = min_[k] +
+             scale * qMin((position[k] + 1) * cellVoxels, dimensions_[k]);
+  }
+  if (isCulled(min, max, planes))
+    return;
+
+  if (level == 0) {
+    const Vec eye = camera->position();
+    Vec closest;
+    for (int k = 0; k < 3; ++k)
+      closest[k] = qBound(qreal(min[k]), eye[k], qreal(max[k]));
+    const int brick = gridBricks_[cellIndex(0, x, y, z)];
+    selected.append({brick, (closest - eye).norm()});
+    return;
+  }
+
+  for (int c = 0; c < 8; ++c) {
+    const int cx = 2 * x + ((c >> 2) & 1);
+    const int cy = 2 * y + ((c >> 1) & 1);
+    const int cz = 2 * z + (c & 1);
+    if ((cx < levelSize(level - 1, 0)) && (cy < levelSize(level - 1, 1)) &&
+        (cz < levelSize(level - 1, 2)))
+      selectCell(level - 1, cx, cy, cz, camera, planes, selected);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Transfer function                              //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the transferFunction(), which must have at least two entries. The
+colors are not premultiplied by their alpha.
+
+The bricks whose range of values becomes transparent are no longer drawn nor
+loaded, and the ones that become visible are loaded by the next draw(). */
+void BrickedVolume::setTransferFunction(const QVector<QRgb> &colors) {
+  if (colors.size() < 2) {
+    qWarning("BrickedVolume::setTransferFunction: At least two colors are "
+             "needed");
+    return;
+  }
+
+  transferFunction_ = colors;
+  opacitySums_.resize(colors.size() + 1);
+  opacitySums_[0] = 0;
+  for (int i = 0; i < colors.size(); ++i)
+    opacitySums_[i + 1] = opacitySums_[i] + qAlpha(colors[i]);
+  transferFunctionIsDirty_ = true;
+}
+
+/*! Returns \c true when all the normalized values of the [\p min, \p max]
+range are fully transparent for the transferFunction(). The bricks and the
+cells of the occupancy hierarchy whose range is transparent are skipped. */
+bool BrickedVolume::isTransparent(qreal min, qreal max) const {
+  // The entries around the range are interpolated by the values it contains
+  const int last = transferFunction_.size() - 1;
+  const int first = qBound(0, int(floor(min * last)), last);
+  const int end = qBound(0, int(ceil(max * last)), last) + 1;
+  return (first >= end) || (opacitySums_[end] == opacitySums_[first]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Rendering quality                             //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the stepRate(), in samples per voxel. */
+void BrickedVolume::setStepRate(qreal rate) {
+  stepRate_ = qMax(rate, qreal(0.05));
+}
+
+/*! Sets the interactionStepRate(), in samples per voxel. */
+void BrickedVolume::setInteractionStepRate(qreal rate) {
+  interactionStepRate_ = qMax(rate, qreal(0.05));
+}
+
+/*! Sets the terminationOpacity(). Values smaller than 1.0 trade a slight
+darkening of the back of the volume for an earlier end of the rays. */
+void BrickedVolume::setTerminationOpacity(qreal opacity) {
+  terminationOpacity_ = qBound(qreal(0.5), opacity, qreal(1.0));
+}
+
+/*! Sets the gpuMemoryBudget(), in bytes. */
+void BrickedVolume::setGpuMemoryBudget(qint64 budget) {
+  gpuMemoryBudget_ = qMax(budget, qint64(0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Loader threads                               //
+////////////////////////////////////////////////////////////////////////////////
+
+// Starts the loads of the nearest wanted bricks, as long as the pool has room
+// for them
+void BrickedVolume::requestLoads(QVector<Selection> &wanted) {
+  if ((nbLoading_ >= maximumNbLoading) || wanted.isEmpty())
+    return;
+
+  // The slots that are free or hold bricks that this frame does not draw
+  int nbAvailableSlots = -nbLoading_ - inMemoryBricks_.size();
+  for (int brick : slots_)
+    if ((brick < 0) || (bricks_[brick].lastDrawnFrame != frame_))
+      ++nbAvailableSlots;
+  if (nbAvailableSlots <= 0)
+    return;
+
+  std::sort(wanted.begin(), wanted.end());
+
+  if (!loaderThreadPool_) {
+    loaderThreadPool_ = new QThreadPool();
+    loaderThreadPool_->setMaxThreadCount(2);
+  }
+
+  for (int i = 0; (i < wanted.size()) && (nbLoading_ < maximumNbLoading) &&
+                  (nbAvailableSlots > 0);
+       ++i, --nbAvailableSlots) {
+    const int index = wanted[i].brick;
+    Brick &brick = bricks_[index];
+    brick.state = LOADING;
+    ++nbLoading_;
+
+    const QString fileName = QDir(directory_).filePath(
+        QString("%1_%2_%3.raw").arg(brick.x).arg(brick.y).arg(brick.z));
+    loaderThreadPool_->start(QRunnable::create(
+        [this, index, fileName]() { loadBrick(index, fileName); }));
+  }
+}
+
+// Reads the voxels of a brick. Called in a loader thread.
+void BrickedVolume::loadBrick(int index, const QString &fileName) {
+  const qint64 nbVoxels = qint64(brickSize_ + 2) * (brickSize_ + 2) *
+                          (brickSize_ + 2);
+  const qint64 size = nbVoxels * (bitsPerVoxel_ / 8);
+  QByteArray data;
+  QFile file(fileName);
+  if (file.open(QIODevice::ReadOnly))
+    data = file.read(size);
+  if (data.size() != size) {
+    qWarning("BrickedVolume: Unable to read %lld voxels from %s", nbVoxels,
+             qPrintable(fileName));
+    data.clear();
+  } else if (bitsPerVoxel_ == 16) {
+    char *voxels = data.data();
+    if (reduceTo8Bits_) {
+      // The most significant byte of each little endian value
+      for (qint64 i = 0; i < nbVoxels; ++i)
+        voxels[i] = voxels[2 * i + 1];
+      data.resize(int(nbVoxels));
+    }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    else
+      for (qint64 i = 0; i < nbVoxels; ++i)
+        std::swap(voxels[2 * i], voxels[2 * i + 1]);
+#endif
+  }
+
+  {
+    QMutexLocker locker(&loadedMutex_);
+    loadedBricks_.append(index);
+    loadedData_.append(data);
+  }
+  Q_EMIT brickLoaded();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Brick pool                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+// Creates the shader program and the textures with the current context
+bool BrickedVolume::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("BrickedVolume::draw: No current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return isSupported_;
+  if (context_) {
+    qWarning("BrickedVolume::draw: OpenGL context changed, bricks are "
+             "reloaded");
+    program_ = nullptr;
+    vao_ = nullptr;
+    poolTexture_ = pageTableTexture_ = transferFunctionTexture_ = 0;
+    functions_ = nullptr;
+    cleanupGL();
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  isSupported_ = false;
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("BrickedVolume::draw: Requires OpenGL 3.3 or OpenGL ES 3.0");
+    return false;
+  }
+
+  vao_ = new QOpenGLVertexArrayObject();
+  if (!vao_->create()) {
+    qWarning("BrickedVolume::draw: Vertex array objects are not supported");
+    return false;
+  }
+
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision highp float;\n"
+                                : "#version 330\n";
+  program_ = new QOpenGLShaderProgram();
+  // The linked program may come from the program binary cache
+  if (!program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Vertex, header + vertexShaderSource) ||
+      !program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource) ||
+      !program_->link()) {
+    qWarning("BrickedVolume::draw: Unable to build shaders: %s",
+             qPrintable(program_->log()));
+    return false;
+  }
+
+  // Set before the first load is requested
+  reduceTo8Bits_ = context->isOpenGLES();
+  createPool();
+  isSupported_ = !slots_.isEmpty();
+  return isSupported_;
+}
+
+// Creates the pool, the page table and the transfer function textures. The
+// pool holds as many bricks as the gpuMemoryBudget() allows, and at most all
+// of them.
+void BrickedVolume::createPool() {
+  QOpenGLExtraFunctions *f = functions_;
+  const int slotSize = brickSize_ + 2;
+  const bool shorts = (bitsPerVoxel_ == 16) && !reduceTo8Bits_;
+  const qint64 slotBytes = qint64(slotSize) * slotSize * slotSize *
+                           (shorts ? 2 : 1);
+
+  GLint maxTextureSize = 0;
+  f->glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize);
+  const int maxSlots = qMin(int(maxTextureSize) / slotSize, maximumPoolSize);
+  if (maxSlots <= 0) {
+    qWarning("BrickedVolume::draw: Bricks of %d voxels exceed the maximum 3D "
+             "texture size",
+             brickSize_);
+    return;
+  }
+
+  const qint64 nbSlots =
+      qBound(qint64(1), gpuMemoryBudget_ / slotBytes, qint64(bricks_.size()));
+  poolSize_[0] = qMin(maxSlots, int(ceil(std::cbrt(double(nbSlots)))));
+  poolSize_[1] = qMin(
+      maxSlots, int(ceil(sqrt(ceil(double(nbSlots) / poolSize_[0])))));
+  poolSize_[2] = qMin(maxSlots, int(ceil(double(nbSlots) /
+                                         (poolSize_[0] * poolSize_[1]))));
+  slots_.fill(-1, poolSize_[0] * poolSize_[1] * poolSize_[2]);
+
+  GLint previousTexture = 0;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_3D, &previousTexture);
+
+  f->glGenTextures(1, &poolTexture_);
+  f->glBindTexture(GL_TEXTURE_3D, poolTexture_);
+  f->glTexImage3D(GL_TEXTURE_3D, 0, shorts ? GL_R16 : GL_R8,
+                  poolSize_[0] * slotSize, poolSize_[1] * slotSize,
+                  poolSize_[2] * slotSize, 0, GL_RED,
+                  shorts ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, nullptr);
+  // The borders of the slots make the linear interpolation seamless
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  pageTable_.fill(0, 4 * gridBricks_.size());
+  f->glGenTextures(1, &pageTableTexture_);
+  f->glBindTexture(GL_TEXTURE_3D, pageTableTexture_);
+  f->glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, gridSize_[0], gridSize_[1],
+                  gridSize_[2], 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                  pageTable_.constData());
+  // Integer textures cannot be filtered
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  f->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  f->glBindTexture(GL_TEXTURE_3D, GLuint(previousTexture));
+
+  f->glGenTextures(1, &transferFunctionTexture_);
+  transferFunctionIsDirty_ = true;
+  pageTableIsDirty_ = false;
+}
+
+// Returns a slot for a brick: a free one, or the least recently drawn one
+// that this frame does not draw, whose brick is evicted. Returns -1 when all
+// the slots are used by this frame.
+int BrickedVolume::freeSlot() {
+  int slot = -1;
+  for (int s = 0; s < slots_.size(); ++s) {
+    const int brick = slots_[s];
+    if (brick < 0)
+      return s;
+    const unsigned int lastDrawnFrame = bricks_[brick].lastDrawnFrame;
+    if ((lastDrawnFrame != frame_) &&
+        ((slot < 0) ||
+         (lastDrawnFrame < bricks_[slots_[slot]].lastDrawnFrame)))
+      slot = s;
+  }
+
+  if (slot >= 0) {
+    Brick &evicted = bricks_[slots_[slot]];
+    evicted.state = ON_DISK;
+    evicted.slot = -1;
+    slots_[slot] = -1;
+    pageTableIsDirty_ = true;
+  }
+  return slot;
+}
+
+// Collects the bricks read by the loader threads, and uploads some of them in
+// the pool
+void BrickedVolume::uploadBricks() {
+  {
+    QMutexLocker locker(&loadedMutex_);
+    for (int i = 0; i < loadedBricks_.size(); ++i) {
+      Brick &brick = bricks_[loadedBricks_[i]];
+      --nbLoading_;
+      if (loadedData_[i].isEmpty())
+        brick.state = FAILED;
+      else {
+        brick.state = IN_MEMORY;
+        brick.data = loadedData_[i];
+        inMemoryBricks_.append(loadedBricks_[i]);
+      }
+    }
+    loadedBricks_.clear();
+    loadedData_.clear();
+  }
+  if (inMemoryBricks_.isEmpty())
+    return;
+
+  QOpenGLExtraFunctions *f = functions_;
+  GLint previousTexture = 0, previousAlignment = 4;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_3D, &previousTexture);
+  f->glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+  f->glBindTexture(GL_TEXTURE_3D, poolTexture_);
+  f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  const int slotSize = brickSize_ + 2;
+  const bool shorts = (bitsPerVoxel_ == 16) && !reduceTo8Bits_;
+  qint64 uploaded = 0;
+  int i = 0;
+  for (; (i < inMemoryBricks_.size()) && (uploaded < maximumUploadSize); ++i) {
+    const int index = inMemoryBricks_[i];
+    Brick &brick = bricks_[index];
+    const int slot = freeSlot();
+    if (slot < 0) {
+      // The pool is full of visible bricks: read it again when needed
+      brick.state = ON_DISK;
+      brick.data.clear();
+      continue;
+    }
+
+    const int x = slot % poolSize_[0];
+    const int y = (slot / poolSize_[0]) % poolSize_[1];
+    const int z = slot / (poolSize_[0] * poolSize_[1]);
+    f->glTexSubImage3D(GL_TEXTURE_3D, 0, x * slotSize, y * slotSize,
+                       z * slotSize, slotSize, slotSize, slotSize, GL_RED,
+                       shorts ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+                       brick.data.constData());
+
+    uploaded += brick.data.size();
+    brick.data.clear();
+    brick.state = RESIDENT;
+    brick.slot = slot;
+    slots_[slot] = index;
+    pageTableIsDirty_ = true;
+  }
+  inMemoryBricks_.remove(0, i);
+
+  f->glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+  f->glBindTexture(GL_TEXTURE_3D, GLuint(previousTexture));
+}
+
+// Uploads the page table: the slot of the resident bricks, whose alpha is
+// set when they are not transparent
+void BrickedVolume::updatePageTable() {
+  pageTable_.fill(0);
+  for (const Brick &brick : bricks_) {
+    if ((brick.state != RESIDENT) || isTransparent(brick.min, brick.max))
+      continue;
+    uchar *entry = pageTable_.data() +
+                   4 * cellIndex(0, brick.x, brick.y, brick.z);
+    entry[0] = uchar(brick.slot % poolSize_[0]);
+    entry[1] = uchar((brick.slot / poolSize_[0]) % poolSize_[1]);
+    entry[2] = uchar(brick.slot / (poolSize_[0] * poolSize_[1]));
+    entry[3] = 1;
+  }
+
+  QOpenGLExtraFunctions *f = functions_;
+  GLint previousTexture = 0, previousAlignment = 4;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_3D, &previousTexture);
+  f->glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+  f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  f->glBindTexture(GL_TEXTURE_3D, pageTableTexture_);
+  f->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, gridSize_[0], gridSize_[1],
+                     gridSize_[2], GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                     pageTable_.constData());
+  f->glBindTexture(GL_TEXTURE_3D, GLuint(previousTexture));
+  f->glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+  pageTableIsDirty_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Ray casts the bricks of the volume that are visible from \p camera, and
+requests the loading of the missing ones, the nearest first. Call this method
+at the end of your viewer's draw() (and fastDraw()) with its camera(), and \c
+QGLViewer::qualityIsReduced() as \p reducedQuality, which replaces the
+stepRate() by the interactionStepRate().
+
+The volume is composited over the current framebuffer, with premultiplied
+alpha blending. The depth buffer is neither tested nor written, so that the
+camera can be inside of the volume. Give the depth texture of the opaque
+objects as \p sceneDepthTexture (such as the
+qglviewer::RenderTarget::depthTexture() they were drawn in) to end the rays at
+these objects, which then correctly hide or intersect the volume. Without it
+(the default 0), the volume is drawn over the whole framebuffer, in front of
+all the opaque objects. The texture must cover the current viewport, and can
+be attached to the bound framebuffer since the depth is not written. The
+OpenGL state is restored. */
+void BrickedVolume::draw(const Camera *camera, bool reducedQuality,
+                         GLuint sceneDepthTexture) {
+  if (!isLoaded() || !initializeGL())
+    return;
+
+  ++frame_;
+  GLdouble planes[6][4];
+  camera->getFrustumPlanesCoefficients(planes);
+  QVector<Selection> selected;
+  const int root = levels_.size() - 1;
+  selectCell(root, 0, 0, 0, camera, planes, selected);
+  for (const Selection &selection : selected)
+    bricks_[selection.brick].lastDrawnFrame = frame_;
+
+  uploadBricks();
+
+  QVector<Selection> wanted;
+  nbDrawnBricks_ = 0;
+  for (const Selection &selection : selected) {
+    const State state = bricks_[selection.brick].state;
+    if (state == RESIDENT)
+      ++nbDrawnBricks_;
+    else if (state == ON_DISK)
+      wanted.append(selection);
+  }
+  nbMissingBricks_ = selected.size() - nbDrawnBricks_;
+  requestLoads(wanted);
+
+  QOpenGLExtraFunctions *f = functions_;
+  GLint previousTexture = 0;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  if (transferFunctionIsDirty_) {
+    QVector<uchar> rgba(4 * transferFunction_.size());
+    for (int i = 0; i < transferFunction_.size(); ++i) {
+      const QRgb color = transferFunction_[i];
+      rgba[4 * i] = uchar(qRed(color));
+      rgba[4 * i + 1] = uchar(qGreen(color));
+      rgba[4 * i + 2] = uchar(qBlue(color));
+      rgba[4 * i + 3] = uchar(qAlpha(color));
+    }
+    f->glBindTexture(GL_TEXTURE_2D, transferFunctionTexture_);
+    f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, transferFunction_.size(), 1, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, rgba.constData());
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    transferFunctionIsDirty_ = false;
+    // The transparent bricks changed
+    pageTableIsDirty_ = true;
+  }
+  if (pageTableIsDirty_)
+    updatePageTable();
+
+  if (!inMemoryBricks_.isEmpty())
+    Q_EMIT brickLoaded(); // uploads postponed by maximumUploadSize
+  if (nbDrawnBricks_ == 0) {
+    f->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+    return;
+  }
+
+  // Voxel coordinates of the eye and of the view direction
+  const Vec eye = camera->position();
+  const Vec viewDirection = camera->viewDirection();
+  QVector3D voxelEye, voxelDirection;
+  for (int k = 0; k < 3; ++k) {
+    const qreal scale = dimensions_[k] / (max_[k] - min_[k]);
+    voxelEye[k] = float((eye[k] - min_[k]) * scale);
+    voxelDirection[k] = float(viewDirection[k] * scale);
+  }
+  const qreal rate = reducedQuality ? interactionStepRate_ : stepRate_;
+  const int slotSize = brickSize_ + 2;
+  const qreal diagonal = sqrt(qreal(dimensions_[0]) * dimensions_[0] +
+                              qreal(dimensions_[1]) * dimensions_[1] +
+                              qreal(dimensions_[2]) * dimensions_[2]);
+  // The samples of the longest ray, and one jump per crossed brick
+  const int maxSteps = int(ceil(diagonal * rate)) + gridSize_[0] +
+                       gridSize_[1] + gridSize_[2];
+  GLfloat m[16];
+  camera->getModelViewProjectionMatrix(m);
+
+  const GLboolean depthTest = f->glIsEnabled(GL_DEPTH_TEST);
+  const GLboolean blend = f->glIsEnabled(GL_BLEND);
+  const GLboolean cullFace = f->glIsEnabled(GL_CULL_FACE);
+  GLboolean depthMask = GL_TRUE;
+  f->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+  GLint cullFaceMode = GL_BACK, frontFace = GL_CCW;
+  f->glGetIntegerv(GL_CULL_FACE_MODE, &cullFaceMode);
+  f->glGetIntegerv(GL_FRONT_FACE, &frontFace);
+  GLint blendFunc[4] = {GL_ONE, GL_ZERO, GL_ONE, GL_ZERO};
+  f->glGetIntegerv(GL_BLEND_SRC_RGB, &blendFunc[0]);
+  f->glGetIntegerv(GL_BLEND_DST_RGB, &blendFunc[1]);
+  f->glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendFunc[2]);
+  f->glGetIntegerv(GL_BLEND_DST_ALPHA, &blendFunc[3]);
+
+  // The back faces of the box, so that the camera may be inside of it
+  f->glDisable(GL_DEPTH_TEST);
+  f->glDepthMask(GL_FALSE);
+  f->glEnable(GL_CULL_FACE);
+  f->glCullFace(GL_FRONT);
+  f->glFrontFace(GL_CCW);
+  f->glEnable(GL_BLEND);
+  f->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+  GLint viewport[4];
+  f->glGetIntegerv(GL_VIEWPORT, viewport);
+  if (sceneDepthTexture) {
+    f->glActiveTexture(GL_TEXTURE3);
+    f->glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+  }
+  f->glActiveTexture(GL_TEXTURE2);
+  f->glBindTexture(GL_TEXTURE_3D, poolTexture_);
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_3D, pageTableTexture_);
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, transferFunctionTexture_);
+
+  const int nbColors = transferFunction_.size();
+  program_->bind();
+  program_->setUniformValue("transferFunction", 0);
+  program_->setUniformValue("pageTable", 1);
+  program_->setUniformValue("pool", 2);
+  program_->setUniformValue("sceneDepth", 3);
+  program_->setUniformValue("hasSceneDepth", sceneDepthTexture != 0);
+  // The NDC depth range of the projection, see Camera::reverseZIsEnabled()
+  program_->setUniformValue("clipControl", camera->clipControlIsUsed_);
+  program_->setUniformValue("viewport",
+                            QVector4D(viewport[0], viewport[1], viewport[2],
+                                      viewport[3]));
+  const QMatrix4x4 modelViewProjection = QMatrix4x4(m).transposed();
+  program_->setUniformValue("modelViewProjection", modelViewProjection);
+  program_->setUniformValue("inverseModelViewProjection",
+                            modelViewProjection.inverted());
+  program_->setUniformValue("boxMin", QVector3D(min_.x, min_.y, min_.z));
+  program_->setUniformValue(
+      "boxSize", QVector3D(max_.x - min_.x, max_.y - min_.y, max_.z - min_.z));
+  program_->setUniformValue(
+      "dimensions", QVector3D(dimensions_[0], dimensions_[1], dimensions_[2]));
+  program_->setUniformValue("brickSize", GLfloat(brickSize_));
+  program_->setUniformValue(
+      "poolTexelSize", QVector3D(1.0f / (poolSize_[0] * slotSize),
+                                 1.0f / (poolSize_[1] * slotSize),
+                                 1.0f / (poolSize_[2] * slotSize)));
+  // Maps the values on the texel centers of the first and last colors
+  program_->setUniformValue("transferFunctionRange",
+                            GLfloat(nbColors - 1) / nbColors,
+                            0.5f / nbColors);
+  program_->setUniformValue("perspective",
+                            camera->type() == Camera::PERSPECTIVE);
+  program_->setUniformValue("eye", voxelEye);
+  program_->setUniformValue("viewDirection", voxelDirection);
+  program_->setUniformValue("stepSize", GLfloat(1.0 / rate));
+  program_->setUniformValue("termination", GLfloat(terminationOpacity_));
+  program_->setUniformValue("maxSteps", maxSteps);
+
+  vao_->bind();
+  f->glDrawArrays(GL_TRIANGLES, 0, 36);
+  vao_->release();
+  program_->release();
+
+  if (sceneDepthTexture) {
+    f->glActiveTexture(GL_TEXTURE3);
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  f->glActiveTexture(GL_TEXTURE2);
+  f->glBindTexture(GL_TEXTURE_3D, 0);
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_3D, 0);
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+  f->glBlendFuncSeparate(GLenum(blendFunc[0]), GLenum(blendFunc[1]),
+                         GLenum(blendFunc[2]), GLenum(blendFunc[3]));
+  f->glCullFace(GLenum(cullFaceMode));
+  f->glFrontFace(GLenum(frontFace));
+  f->glDepthMask(depthMask);
+  if (depthTest)
+    f->glEnable(GL_DEPTH_TEST);
+  if (!blend)
+    f->glDisable(GL_BLEND);
+  if (!cullFace)
+    f->glDisable(GL_CULL_FACE);
+}
+
+/*! Releases the brick pool, the page table and the shader program. The bricks
+will be read again from disk when needed. The context used by draw() must be
+current. */
+void BrickedVolume::cleanupGL() {
+  if (functions_) {
+    const GLuint textures[3] = {poolTexture_, pageTableTexture_,
+                                transferFunctionTexture_};
+    functions_->glDeleteTextures(3, textures);
+  }
+  if (vao_)
+    vao_->destroy();
+  delete vao_;
+  vao_ = nullptr;
+  delete program_;
+  program_ = nullptr;
+  poolTexture_ = pageTableTexture_ = transferFunctionTexture_ = 0;
+
+  for (Brick &brick : bricks_)
+    if (brick.state == RESIDENT) {
+      brick.state = ON_DISK;
+      brick.slot = -1;
+    }
+  slots_.clear();
+  pageTable_.clear();
+  pageTableIsDirty_ = false;
+  transferFunctionIsDirty_ = true;
+  isSupported_ = false;
+  functions_ = nullptr;
+  context_ = nullptr;
+}
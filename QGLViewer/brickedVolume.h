@@ -0,0 +1,271 @@
+#ifndef QGLVIEWER_BRICKED_VOLUME_H
+#define QGLVIEWER_BRICKED_VOLUME_H
+
+#include "vec.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QRgb>
+#include <QString>
+#include <QVector>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+class QOpenGLVertexArrayObject;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Streams and ray casts a large scalar volume stored as bricks.
+  \class BrickedVolume brickedVolume.h QGLViewer/brickedVolume.h
+
+  A CT scan or a seismic cube rarely fits in a single 3D texture, and most of
+  its voxels are usually transparent. A BrickedVolume splits the volume in
+  cubic bricks, only keeps in GPU memory the visible bricks that are not
+  empty, and ray casts them in a single pass:
+  \code
+  // In your viewer's init()
+  volume = new qglviewer::BrickedVolume(this);
+  volume->load("/data/ct");
+  volume->setTransferFunction(colors);
+  connect(volume, SIGNAL(brickLoaded()), SLOT(update()));
+  setSceneBoundingBox(volume->boundingBoxMin(), volume->boundingBoxMax());
+
+  // At the end of draw(), after the opaque objects, drawn in renderTarget()
+  volume->draw(camera(), qualityIsReduced(), renderTarget()->depthTexture());
+  \endcode
+
+  The minimum and maximum values of the bricks form an occupancy hierarchy
+  (a min/max octree on the grid of bricks). draw() traverses it from its
+  root, and prunes the cells that are outside of the camera frustum, or whose
+  range of values is transparent for the transferFunction(). The remaining
+  bricks are read by background threads, the nearest to the camera first, and
+  uploaded in a brick pool (a 3D texture atlas) whose size is given by
+  gpuMemoryBudget(). The least recently drawn bricks are replaced when it is
+  full. brickLoaded() is emitted when a brick can be drawn: the space of the
+  missing bricks is left empty in the meantime.
+
+  The fragment shader marches the rays front to back, in a page table that
+  gives the pool slot of each brick. Rays jump over the empty and transparent
+  bricks in one step, and stop once they are opaque (early ray termination).
+  The samples are spaced by 1 / stepRate() voxels, which is replaced by the
+  interactionStepRate() in motion.
+
+  <h3>On-disk format</h3>
+
+  The load() directory contains a \c volume.xml description file:
+  \code
+  <BrickedVolume width="512" height="512" depth="1024" brickSize="32"
+                 bitsPerVoxel="16">
+    <BoundingBoxMin x="0" y="0" z="0"/>
+    <BoundingBoxMax x="0.25" y="0.25" z="0.5"/>
+    <Brick x="3" y="0" z="12" min="220" max="3410"/>
+    ...
+  </BrickedVolume>
+  \endcode
+  \c width, \c height and \c depth are the dimensions of the volume in voxels,
+  mapped on the bounding box. \c x, \c y and \c z are the indices of a brick in
+  the grid of bricks, and \c min and \c max the range of its voxel values.
+  Bricks that are not listed are empty: they are never drawn.
+
+  The voxels of each listed brick are stored in the \c <x>_<y>_<z>.raw file,
+  as \c (brickSize+2)^3 unsigned little endian values of \c bitsPerVoxel (8
+  or 16) bits, X being the fastest varying index. They include a one voxel
+  border copied from the neighbor bricks (or the nearest voxel on the volume
+  boundary), so that the interpolation is continuous across bricks. Values
+  are normalized to [0,1] for the transferFunction().
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. 16 bit voxels are reduced to 8 bits
+  with OpenGL ES. All the OpenGL methods require the viewer's context to be
+  current: call cleanupGL() before it is destroyed. */
+class QGLVIEWER_EXPORT BrickedVolume : public QObject {
+  Q_OBJECT
+
+public:
+  explicit BrickedVolume(QObject *parent = nullptr);
+  virtual ~BrickedVolume();
+
+  /*! @name Volume */
+  //@{
+public:
+  bool load(const QString &directory);
+  void clear();
+
+  /*! Returns \c true when a volume was successfully load()ed. */
+  bool isLoaded() const { return !bricks_.isEmpty(); }
+  /*! Returns the directory given to load(). */
+  QString directory() const { return directory_; }
+  /*! Returns the lower corner of the volume bounding box. */
+  Vec boundingBoxMin() const { return min_; }
+  /*! Returns the upper corner of the volume bounding box. */
+  Vec boundingBoxMax() const { return max_; }
+  /*! Returns the number of voxels of the volume along \p axis (0, 1 or 2).
+  */
+  int nbVoxels(int axis) const { return dimensions_[axis]; }
+  /*! Returns the size, in voxels, of the edges of the bricks. */
+  int brickSize() const { return brickSize_; }
+  /*! Returns the number of non empty bricks listed in the description file.
+  */
+  int nbBricks() const { return bricks_.size(); }
+  //@}
+
+  /*! @name Transfer function */
+  //@{
+public:
+  /*! Returns the colors and opacities of the voxel values. The entries
+  uniformly sample the [0,1] range of values, and are linearly interpolated.
+  Default is a grey ramp whose opacity grows with the value. */
+  QVector<QRgb> transferFunction() const { return transferFunction_; }
+  void setTransferFunction(const QVector<QRgb> &colors);
+
+  bool isTransparent(qreal min, qreal max) const;
+  //@}
+
+  /*! @name Rendering quality */
+  //@{
+public:
+  /*! Returns the number of samples per voxel along the rays. Default value
+  is 2.0. */
+  qreal stepRate() const { return stepRate_; }
+  void setStepRate(qreal rate);
+  /*! Returns the stepRate() used when draw() is called with \c
+  reducedQuality. Default value is 0.5. */
+  qreal interactionStepRate() const { return interactionStepRate_; }
+  void setInteractionStepRate(qreal rate);
+
+  /*! Returns the opacity above which a ray is terminated. Default value is
+  0.98. */
+  qreal terminationOpacity() const { return terminationOpacity_; }
+  void setTerminationOpacity(qreal opacity);
+
+  /*! Returns the maximum size, in bytes, of the brick pool. Default value is
+  512 MiB. Applied by the next draw() that creates the pool, after load() or
+  cleanupGL(). */
+  qint64 gpuMemoryBudget() const { return gpuMemoryBudget_; }
+  void setGpuMemoryBudget(qint64 budget);
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  void draw(const Camera *camera, bool reducedQuality = false,
+            GLuint sceneDepthTexture = 0);
+  void cleanupGL();
+
+  /*! Returns the number of bricks marched by the last draw(): the visible,
+  non transparent and resident ones. */
+  int nbDrawnBricks() const { return nbDrawnBricks_; }
+  /*! Returns the number of visible and non transparent bricks of the last
+  draw() that were not in the brick pool yet. */
+  int nbMissingBricks() const { return nbMissingBricks_; }
+  /*! Returns the number of bricks the brick pool can hold, 0 before the first
+  draw(). */
+  int nbPoolSlots() const { return slots_.size(); }
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted when the voxels of a brick were read from disk, possibly
+  from a loader thread. The next draw() will use them: connect this signal to
+  your viewer's \c update() slot. */
+  void brickLoaded();
+
+private:
+  Q_DISABLE_COPY(BrickedVolume)
+
+  enum State { ON_DISK, LOADING, IN_MEMORY, RESIDENT, FAILED };
+
+  struct Brick {
+    int x, y, z;
+    qreal min, max; // normalized values
+    State state;
+    QByteArray data; // IN_MEMORY voxels, waiting for the upload
+    int slot;        // in the pool when RESIDENT
+    unsigned int lastDrawnFrame;
+  };
+
+  // A cell of the occupancy hierarchy, which covers 2^level bricks along
+  // each axis. Empty cells have min > max.
+  struct Cell {
+    float min, max;
+  };
+
+  // A visible brick, with its distance to the camera
+  struct Selection {
+    int brick;
+    qreal distance;
+    bool operator<(const Selection &other) const {
+      return distance < other.distance;
+    }
+  };
+
+  int levelSize(int level, int axis) const;
+  int cellIndex(int level, int x, int y, int z) const;
+  void buildHierarchy();
+  void selectCell(int level, int x, int y, int z, const Camera *camera,
+                  const GLdouble planes[6][4],
+                  QVector<Selection> &selected) const;
+  void requestLoads(QVector<Selection> &wanted);
+  void loadBrick(int index, const QString &fileName);
+
+  bool initializeGL();
+  void createPool();
+  void uploadBricks();
+  int freeSlot();
+  void updatePageTable();
+
+  QString directory_;
+  QVector<Brick> bricks_;
+  Vec min_, max_;
+  int dimensions_[3];
+  int brickSize_;
+  int bitsPerVoxel_;
+  int gridSize_[3]; // bricks along each axis
+
+  // O c c u p a n c y   h i e r a r c h y
+  QVector<QVector<Cell> > levels_; // level 0 is the grid of bricks
+  QVector<int> gridBricks_;        // brick index of each grid cell, or -1
+
+  QVector<QRgb> transferFunction_;
+  QVector<int> opacitySums_; // prefix sums of the transfer function alphas
+  bool transferFunctionIsDirty_;
+
+  qreal stepRate_;
+  qreal interactionStepRate_;
+  qreal terminationOpacity_;
+  qint64 gpuMemoryBudget_;
+
+  unsigned int frame_;
+  int nbDrawnBricks_;
+  int nbMissingBricks_;
+
+  // L o a d e r   t h r e a d s
+  QThreadPool *loaderThreadPool_;
+  int nbLoading_;
+  bool reduceTo8Bits_; // set by initializeGL(), read by the loader threads
+  // Protected by loadedMutex_: bricks read by the loader threads
+  QMutex loadedMutex_;
+  QVector<int> loadedBricks_;
+  QVector<QByteArray> loadedData_;
+  QVector<int> inMemoryBricks_; // waiting for their upload, in load order
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  QOpenGLShaderProgram *program_;
+  QOpenGLVertexArrayObject *vao_;
+  bool isSupported_;
+  GLuint poolTexture_;
+  GLuint pageTableTexture_;
+  GLuint transferFunctionTexture_;
+  int poolSize_[3];          // slots along each axis
+  QVector<int> slots_;       // brick of each pool slot, or -1
+  QVector<uchar> pageTable_; // RGBA: slot coordinates and drawn flag
+  bool pageTableIsDirty_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_BRICKED_VOLUME_H
@@ -0,0 +1,241 @@
+#include "bufferUploader.h"
+
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QThread>
+
+using namespace qglviewer;
+
+/*! Creates a BufferUploader. Must be called in the GUI thread. The thread is
+started by start(). */
+BufferUploader::BufferUploader(QObject *parent)
+    : QObject(parent), thread_(nullptr), ownerThread_(nullptr), quit_(false),
+      lastUpload_(0), surface_(nullptr), context_(nullptr) {}
+
+/*! Destructor. Calls stop(). The buffers are only deleted by cleanupGL(). */
+BufferUploader::~BufferUploader() { stop(); }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Thread                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates the OpenGL context of the worker thread, sharing its objects with
+\p shareContext, and starts the thread. Must be called in the GUI thread.
+Returns \c false when the context could not be created, or does not support
+fences.
+
+Called by QGLViewer::bufferUploader() with the viewer's context. */
+bool BufferUploader::start(QOpenGLContext *shareContext) {
+  if (isRunning())
+    return true;
+  if (!shareContext) {
+    qWarning("BufferUploader::start: No OpenGL context to share with");
+    return false;
+  }
+
+  const QSurfaceFormat format = shareContext->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (shareContext->isOpenGLES() ? 30 : 32)) {
+    qWarning("BufferUploader::start: Requires OpenGL 3.2 or OpenGL ES 3.0");
+    return false;
+  }
+
+  // The surface must be created in the GUI thread
+  surface_ = new QOffscreenSurface();
+  surface_->setFormat(format);
+  surface_->create();
+
+  context_ = new QOpenGLContext();
+  context_->setFormat(format);
+  context_->setShareContext(shareContext);
+  if (!surface_->isValid() || !context_->create()) {
+    qWarning("BufferUploader::start: Unable to create a shared OpenGL context");
+    delete context_;
+    delete surface_;
+    context_ = nullptr;
+    surface_ = nullptr;
+    return false;
+  }
+
+  quit_ = false;
+  ownerThread_ = QThread::currentThread();
+  thread_ = QThread::create([this]() { run(); });
+  context_->moveToThread(thread_);
+  thread_->start();
+  return true;
+}
+
+/*! Stops the thread, once its current upload is completed. The submitted
+uploads that were not started are left pending, and started again by the next
+start(). Must be called in the GUI thread. */
+void BufferUploader::stop() {
+  if (!isRunning())
+    return;
+
+  {
+    QMutexLocker locker(&mutex_);
+    quit_ = true;
+    condition_.wakeAll();
+  }
+  thread_->wait();
+  delete thread_;
+  thread_ = nullptr;
+
+  delete context_;
+  context_ = nullptr;
+  delete surface_;
+  surface_ = nullptr;
+}
+
+// The worker thread loop: uploads the queued data, until stop().
+void BufferUploader::run() {
+  if (!context_->makeCurrent(surface_))
+    qWarning("BufferUploader: Unable to make the context current");
+  else {
+    QOpenGLExtraFunctions *f = context_->extraFunctions();
+    Q_FOREVER {
+      int upload;
+      QByteArray data;
+      GLenum usage;
+      {
+        QMutexLocker locker(&mutex_);
+        while (queue_.isEmpty() && !quit_)
+          condition_.wait(&mutex_);
+        if (quit_)
+          break;
+        upload = queue_.takeFirst();
+        data = uploads_[upload].data;
+        usage = uploads_[upload].usage;
+      }
+
+      // Buffers have no type: the copy target binds any of them
+      GLuint buffer = 0;
+      f->glGenBuffers(1, &buffer);
+      f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      f->glBufferData(GL_COPY_WRITE_BUFFER, data.size(), data.constData(),
+                      usage);
+      f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      GLsync fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      // The other contexts only see the fence once it is flushed
+      f->glFlush();
+
+      bool released = false;
+      {
+        QMutexLocker locker(&mutex_);
+        QHash<int, Upload>::iterator it = uploads_.find(upload);
+        if (it == uploads_.end())
+          released = true;
+        else {
+          it->buffer = buffer;
+          it->fence = fence;
+          it->data = QByteArray();
+        }
+      }
+      if (released) {
+        f->glDeleteSync(fence);
+        f->glDeleteBuffers(1, &buffer);
+      } else
+        Q_EMIT uploaded(upload);
+    }
+    context_->doneCurrent();
+  }
+
+  // So that stop() can delete it
+  context_->moveToThread(ownerThread_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Uploads                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Queues the upload of \p data in a new buffer object, created with the
+given \p usage. Returns immediately, with the identifier of the upload, never
+0. \p data is not copied (it is implicitly shared) until the worker thread
+uploads it. */
+int BufferUploader::submit(const QByteArray &data, GLenum usage) {
+  QMutexLocker locker(&mutex_);
+  const int upload = ++lastUpload_;
+  Upload &u = uploads_[upload];
+  u.data = data;
+  u.usage = usage;
+  u.buffer = 0;
+  u.fence = nullptr;
+  u.isReady = false;
+  queue_.append(upload);
+  condition_.wakeOne();
+  return upload;
+}
+
+/*! Returns \c true when the buffer() of \p upload contains its data. Does not
+wait: returns \c false while the upload is queued, or not completed by the
+GPU. */
+bool BufferUploader::isReady(int upload) {
+  QMutexLocker locker(&mutex_);
+  QHash<int, Upload>::iterator it = uploads_.find(upload);
+  if (it == uploads_.end())
+    return false;
+  if (it->isReady)
+    return true;
+  if (!it->fence)
+    return false;
+
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  if (f->glClientWaitSync(it->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    return false;
+  f->glDeleteSync(it->fence);
+  it->fence = nullptr;
+  it->isReady = true;
+  return true;
+}
+
+/*! Returns the buffer object of \p upload once it isReady(), and 0 before. */
+GLuint BufferUploader::buffer(int upload) {
+  if (!isReady(upload))
+    return 0;
+  QMutexLocker locker(&mutex_);
+  return uploads_.value(upload).buffer;
+}
+
+/*! Returns the number of submitted uploads that are not isReady() yet. */
+int BufferUploader::nbPendingUploads() const {
+  QMutexLocker locker(&mutex_);
+  int nb = 0;
+  for (QHash<int, Upload>::const_iterator it = uploads_.constBegin(),
+                                          end = uploads_.constEnd();
+       it != end; ++it)
+    if (!it->isReady)
+      ++nb;
+  return nb;
+}
+
+/*! Deletes the buffer of \p upload, or cancels it when it is not uploaded yet.
+Unknown identifiers, such as 0, are ignored. */
+void BufferUploader::release(int upload) {
+  QMutexLocker locker(&mutex_);
+  QHash<int, Upload>::iterator it = uploads_.find(upload);
+  if (it == uploads_.end())
+    return;
+  queue_.removeOne(upload);
+  if (it->buffer) {
+    QOpenGLExtraFunctions *f =
+        QOpenGLContext::currentContext()->extraFunctions();
+    if (it->fence)
+      f->glDeleteSync(it->fence);
+    f->glDeleteBuffers(1, &it->buffer);
+  }
+  // An upload in progress is deleted by the worker thread
+  uploads_.erase(it);
+}
+
+/*! Releases all the uploads. Called by the QGLViewer destructor. */
+void BufferUploader::cleanupGL() {
+  QList<int> uploads;
+  {
+    QMutexLocker locker(&mutex_);
+    uploads = uploads_.keys();
+  }
+  for (int upload : uploads)
+    release(upload);
+}
@@ -0,0 +1,118 @@
+#ifndef QGLVIEWER_BUFFER_UPLOADER_H
+#define QGLVIEWER_BUFFER_UPLOADER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+#include "config.h"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QThread;
+
+namespace qglviewer {
+/*! \brief Uploads vertex buffers in a worker thread, with an OpenGL context
+  shared with the viewer's one.
+  \class BufferUploader bufferUploader.h QGLViewer/bufferUploader.h
+
+  A large \c glBufferData() in init() or draw() blocks the GUI thread during
+  the transfer. The data given to submit() is instead uploaded by a worker
+  thread, in a buffer object of the viewer's share group. submit() returns
+  immediately with an upload identifier, and draw() keeps drawing the previous
+  data until isReady() tells that the upload is completed, as signaled by a
+  fence:
+  \code
+  void Viewer::loadMesh(const QByteArray &vertices) {
+    pendingUpload_ = bufferUploader()->submit(vertices);
+  }
+
+  void Viewer::draw() {
+    qglviewer::BufferUploader *uploader = bufferUploader();
+    if (pendingUpload_ && uploader->isReady(pendingUpload_)) {
+      uploader->release(meshUpload_); // the previous mesh
+      meshUpload_ = pendingUpload_;
+      pendingUpload_ = 0;
+      createVertexArray(uploader->buffer(meshUpload_));
+    }
+    drawMesh();
+  }
+  \endcode
+
+  QGLViewer::bufferUploader() creates and starts the uploader of a viewer, and
+  connects uploaded() to its update(). The buffers are \c glBufferData()
+  copies of the submitted data, which is released once uploaded. Vertex array
+  objects are not shared between contexts: create them in the viewer's
+  context, once the buffer isReady().
+
+  Requires OpenGL 3.2 or OpenGL ES 3.0, for fences. submit() may be called
+  from any thread. isReady(), release() and cleanupGL() must be called with a
+  context of the share group current, typically in the viewer's draw(). */
+class QGLVIEWER_EXPORT BufferUploader : public QObject {
+  Q_OBJECT
+
+public:
+  explicit BufferUploader(QObject *parent = nullptr);
+  virtual ~BufferUploader();
+
+  /*! @name Thread */
+  //@{
+public:
+  bool start(QOpenGLContext *shareContext);
+  void stop();
+  /*! Returns \c true between start() and stop(). */
+  bool isRunning() const { return thread_ != nullptr; }
+  //@}
+
+  /*! @name Uploads */
+  //@{
+public:
+  int submit(const QByteArray &data, GLenum usage = GL_STATIC_DRAW);
+  bool isReady(int upload);
+  GLuint buffer(int upload);
+  int nbPendingUploads() const;
+  void release(int upload);
+  void cleanupGL();
+
+Q_SIGNALS:
+  /*! Signal emitted in the worker thread when the commands of the \p upload
+  are issued. isReady() becomes \c true once the GPU executed them.
+  QGLViewer::bufferUploader() connects it to QGLViewer::update(). */
+  void uploaded(int upload);
+  //@}
+
+private:
+  Q_DISABLE_COPY(BufferUploader)
+
+  struct Upload {
+    QByteArray data; // until uploaded
+    GLenum usage;
+    GLuint buffer; // 0 until uploaded
+    GLsync fence;  // until isReady() saw it signaled
+    bool isReady;
+  };
+
+  void run();
+
+  QThread *thread_;
+  QThread *ownerThread_; // where the context is moved back by run()
+
+  // Protected by mutex_
+  mutable QMutex mutex_;
+  QWaitCondition condition_;
+  bool quit_;
+  int lastUpload_;
+  QHash<int, Upload> uploads_;
+  QList<int> queue_; // submitted, not uploaded yet
+
+  // O p e n G L
+  QOffscreenSurface *surface_;
+  QOpenGLContext *context_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_BUFFER_UPLOADER_H
@@ -1,7 +1,29 @@
 #include "camera.h"
+#include "depthCache.h"
 #include "domUtils.h"
+#include "glStateCache.h"
+#include "hotPathCounters.h"
+#include "lineRenderer.h"
 #include "manipulatedCameraFrame.h"
 #include "qglviewer.h"
+#include "traceRecorder.h"
+
+#include <QDataStream>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+
+#include <atomic>
+#include <cstring>
+
+#ifndef GL_LOWER_LEFT
+#define GL_LOWER_LEFT 0x8CA1
+#endif
+#ifndef GL_NEGATIVE_ONE_TO_ONE
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#endif
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
 
 using namespace std;
 using namespace qglviewer;
@@ -14,8 +36,15 @@ using namespace qglviewer;
  See IODistance(), physicalDistanceToScreen(), physicalScreenWidth() and
  focusDistance() documentations for default stereo parameter values. */
 Camera::Camera()
-    : frame_(nullptr), fieldOfView_(M_PI / 4.0), modelViewMatrixIsUpToDate_(false),
-      projectionMatrixIsUpToDate_(false) {
+    : frame_(nullptr), tile_(0.0, 0.0, 1.0, 1.0), fieldOfView_(M_PI / 4.0),
+      modelViewMatrixIsUpToDate_(false),
+      projectionMatrixIsUpToDate_(false), screenMatrixIsUpToDate_(false),
+      floatingOriginIsEnabled_(false), floatingOriginThreshold_(1.0e4),
+      reverseZ_(false), clipControlIsUsed_(false), depthStateIsReversed_(false),
+      depthReadBuffer_(nullptr), pointUnderPixelIsPending_(false),
+      depthCache_(nullptr), clippingPlanesAreFittedToDepth_(false),
+      depthFittingMargin_(0.1), fittedPlanesAreValid_(false),
+      publishedState_(nullptr), publicationCount_(0), motionTime_(-1) {
   // #CONNECTION# Camera copy constructor
   interpolationKfi_ = new KeyFrameInterpolator;
   // Requires the interpolationKfi_
@@ -43,6 +72,7 @@ Camera::Camera()
 
   // Dummy values
   setScreenWidthAndHeight(600, 400);
+  setScreenOffset(0, 0);
 
   // Stereo parameters
   setIODistance(0.062);
@@ -69,10 +99,20 @@ Camera::Camera()
 Camera::~Camera() {
   delete frame_;
   delete interpolationKfi_;
+  delete depthReadBuffer_;
 }
 
 /*! Copy constructor. Performs a deep copy using operator=(). */
-Camera::Camera(const Camera &camera) : QObject(), frame_(nullptr) {
+Camera::Camera(const Camera &camera)
+    : QObject(), frame_(nullptr), tile_(0.0, 0.0, 1.0, 1.0),
+      screenMatrixIsUpToDate_(false), floatingOriginIsEnabled_(false),
+      floatingOriginThreshold_(1.0e4), reverseZ_(false),
+      clipControlIsUsed_(false),
+      depthStateIsReversed_(false), depthReadBuffer_(nullptr),
+      pointUnderPixelIsPending_(false), depthCache_(nullptr),
+      clippingPlanesAreFittedToDepth_(false), depthFittingMargin_(0.1),
+      fittedPlanesAreValid_(false), publishedState_(nullptr),
+      publicationCount_(0), motionTime_(-1) {
   // #CONNECTION# Camera constructor
   interpolationKfi_ = new KeyFrameInterpolator;
   // Requires the interpolationKfi_
@@ -103,12 +143,20 @@ Camera::Camera(const Camera &camera) : QObject(), frame_(nullptr) {
  The same applies to sceneCenter() and sceneRadius(), if needed. */
 Camera &Camera::operator=(const Camera &camera) {
   setScreenWidthAndHeight(camera.screenWidth(), camera.screenHeight());
+  setScreenOffset(camera.screenOffsetX(), camera.screenOffsetY());
+  setTile(camera.tile());
   setFieldOfView(camera.fieldOfView());
   setSceneRadius(camera.sceneRadius());
   setSceneCenter(camera.sceneCenter());
   setZNearCoefficient(camera.zNearCoefficient());
   setZClippingCoefficient(camera.zClippingCoefficient());
+  setReverseZIsEnabled(camera.reverseZIsEnabled());
+  setClippingPlanesFittedToDepth(camera.clippingPlanesAreFittedToDepth());
+  setDepthFittingMargin(camera.depthFittingMargin());
   setType(camera.type());
+  setFloatingOriginThreshold(camera.floatingOriginThreshold());
+  setFloatingOriginEnabled(camera.floatingOriginIsEnabled());
+  setRenderOrigin(camera.renderOrigin());
 
   // Stereo parameters
   setIODistance(camera.IODistance());
@@ -151,6 +199,18 @@ void Camera::setScreenWidthAndHeight(int width, int height) {
   projectionMatrixIsUpToDate_ = false;
 }
 
+/*! Sets the tile() of the whole view displayed by the Camera screen. Empty
+tiles are ignored. */
+void Camera::setTile(const QRectF &tile) {
+  const QRectF normalized = tile.normalized();
+  if (normalized.isEmpty()) {
+    qWarning("Camera::setTile: Empty tile ignored");
+    return;
+  }
+  tile_ = normalized;
+  projectionMatrixIsUpToDate_ = false;
+}
+
 /*! Sets the screen's pixel ratio.
 
 See QScreen::devicePixelRatio() for a definition.
@@ -181,7 +241,8 @@ void Camera::setDevicePixelRatio(qreal ratio) {
  \endcode
 
  See also the zFar(), zClippingCoefficient() and zNearCoefficient()
- documentations.
+ documentations. When clippingPlanesAreFittedToDepth(), the zNear() may be
+ moved further, see fitClippingPlanesToDepth().
 
  If you need a completely different zNear computation, overload the zNear() and
  zFar() methods in a new class that publicly inherits from Camera and use
@@ -213,6 +274,9 @@ qreal Camera::zNear() const {
       z = 0.0;
       break;
     }
+
+  if (fittedPlanesAreValid_)
+    z = qMax(z, fittedZNear_);
   return z;
 }
 
@@ -225,7 +289,11 @@ distanceToSceneCenter() + zClippingCoefficient()*sceneRadius(); \endcode
 
 See the zNear() documentation for details. */
 qreal Camera::zFar() const {
-  return distanceToSceneCenter() + zClippingCoefficient() * sceneRadius();
+  const qreal z =
+      distanceToSceneCenter() + zClippingCoefficient() * sceneRadius();
+  if (fittedPlanesAreValid_ && (fittedZFar_ < z) && (fittedZFar_ > zNear()))
+    return fittedZFar_;
+  return z;
 }
 
 /*! Sets the vertical fieldOfView() of the Camera (in radians).
@@ -284,6 +352,8 @@ void Camera::setFrame(ManipulatedCameraFrame *const mcf) {
 
   frame_ = mcf;
   interpolationKfi_->setFrame(frame());
+  if (animationClock_)
+    frame_->setAnimationClock(animationClock_);
 
   connect(frame_, SIGNAL(modified()), this, SLOT(onFrameModified()));
   onFrameModified();
@@ -344,6 +414,7 @@ void Camera::getOrthoWidthHeight(GLdouble &halfWidth,
 void Camera::computeProjectionMatrix() const {
   if (projectionMatrixIsUpToDate_)
     return;
+  QGLVIEWER_COUNT(PROJECTION_MATRIX);
 
   const qreal ZNear = zNear();
   const qreal ZFar = zFar();
@@ -354,9 +425,15 @@ void Camera::computeProjectionMatrix() const {
     const qreal f = 1.0 / tan(fieldOfView() / 2.0);
     projectionMatrix_[0] = f / aspectRatio();
     projectionMatrix_[5] = f;
-    projectionMatrix_[10] = (ZNear + ZFar) / (ZNear - ZFar);
+    if (reverseZIsEnabled()) {
+      // Infinite far plane, window depth is ZNear / distance
+      projectionMatrix_[10] = clipControlIsUsed_ ? 0.0 : 1.0;
+      projectionMatrix_[14] = clipControlIsUsed_ ? ZNear : 2.0 * ZNear;
+    } else {
+      projectionMatrix_[10] = (ZNear + ZFar) / (ZNear - ZFar);
+      projectionMatrix_[14] = 2.0 * ZNear * ZFar / (ZNear - ZFar);
+    }
     projectionMatrix_[11] = -1.0;
-    projectionMatrix_[14] = 2.0 * ZNear * ZFar / (ZNear - ZFar);
     projectionMatrix_[15] = 0.0;
     // same as gluPerspective( 180.0*fieldOfView()/M_PI, aspectRatio(), zNear(),
     // zFar() );
@@ -367,16 +444,40 @@ void Camera::computeProjectionMatrix() const {
     getOrthoWidthHeight(w, h);
     projectionMatrix_[0] = 1.0 / w;
     projectionMatrix_[5] = 1.0 / h;
-    projectionMatrix_[10] = -2.0 / (ZFar - ZNear);
+    if (reverseZIsEnabled()) {
+      // zNear() and zFar() are swapped
+      projectionMatrix_[10] = (clipControlIsUsed_ ? 1.0 : 2.0) / (ZFar - ZNear);
+      projectionMatrix_[14] =
+          (clipControlIsUsed_ ? ZFar : ZFar + ZNear) / (ZFar - ZNear);
+    } else {
+      projectionMatrix_[10] = -2.0 / (ZFar - ZNear);
+      projectionMatrix_[14] = -(ZFar + ZNear) / (ZFar - ZNear);
+    }
     projectionMatrix_[11] = 0.0;
-    projectionMatrix_[14] = -(ZFar + ZNear) / (ZFar - ZNear);
     projectionMatrix_[15] = 1.0;
     // same as glOrtho( -w, w, -h, h, zNear(), zFar() );
     break;
   }
   }
 
+  projectionMatrix_[8] = projectionMatrix_[9] = 0.0;
+  projectionMatrix_[12] = projectionMatrix_[13] = 0.0;
+  if (tile_ != QRectF(0.0, 0.0, 1.0, 1.0)) {
+    // Off-axis tile: its normalized device coordinates are scaled and
+    // translated to [-1,1], with the y axis going up
+    const qreal sx = 1.0 / tile_.width();
+    const qreal sy = 1.0 / tile_.height();
+    const qreal tx = (1.0 - tile_.left() - tile_.right()) * sx;
+    const qreal ty = (tile_.top() + tile_.bottom() - 1.0) * sy;
+    for (int c = 0; c < 4; ++c) {
+      GLdouble *const column = projectionMatrix_ + 4 * c;
+      column[0] = sx * column[0] + tx * column[3];
+      column[1] = sy * column[1] + ty * column[3];
+    }
+  }
+
   projectionMatrixIsUpToDate_ = true;
+  screenMatrixIsUpToDate_ = false;
 }
 
 /*! Computes the modelView matrix associated with the Camera's position() and
@@ -395,6 +496,7 @@ void Camera::computeProjectionMatrix() const {
 void Camera::computeModelViewMatrix() const {
   if (modelViewMatrixIsUpToDate_)
     return;
+  QGLVIEWER_COUNT(MODEL_VIEW_MATRIX);
 
   const Quaternion q = frame()->orientation();
 
@@ -434,6 +536,7 @@ void Camera::computeModelViewMatrix() const {
   modelViewMatrix_[15] = 1.0;
 
   modelViewMatrixIsUpToDate_ = true;
+  screenMatrixIsUpToDate_ = false;
 }
 
 /*! Loads the OpenGL \c GL_PROJECTION matrix with the Camera projection matrix.
@@ -470,6 +573,59 @@ void Camera::loadProjectionMatrix(bool reset) const {
   glMultMatrixd(projectionMatrix_);
 }
 
+/*! Sets the OpenGL depth state that matches reverseZIsEnabled().
+
+ When reverseZIsEnabled(), the depth buffer clear value is set to 0.0, the
+ depth test to \c GL_GREATER and, when \c glClipControl is available, the
+ depth range to \c GL_ZERO_TO_ONE. The default OpenGL values are restored when
+ the reversed mapping is disabled. Nothing is changed otherwise, so that your
+ own depth test settings are preserved.
+
+ This method is called by QGLViewer::preDraw() before the buffers are cleared.
+ The projection matrix depends on the availability of \c glClipControl, which
+ is only known after a first call. An OpenGL context must be current. */
+void Camera::loadDepthState() const {
+  if (!reverseZIsEnabled() && !depthStateIsReversed_)
+    return;
+
+  typedef void(QOPENGLF_APIENTRYP ClipControl)(GLenum origin, GLenum depth);
+  ClipControl clipControl = nullptr;
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (context)
+    clipControl = reinterpret_cast<ClipControl>(
+        context->getProcAddress("glClipControl"));
+
+  if (reverseZIsEnabled()) {
+    glClearDepth(0.0);
+    glDepthFunc(GL_GREATER);
+    if (clipControl)
+      clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+  } else {
+    glClearDepth(1.0);
+    glDepthFunc(GL_LESS);
+    if (clipControl)
+      clipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+  }
+  depthStateIsReversed_ = reverseZIsEnabled();
+
+  const bool clipControlIsUsed = reverseZIsEnabled() && (clipControl != nullptr);
+  if (clipControlIsUsed != clipControlIsUsed_) {
+    clipControlIsUsed_ = clipControlIsUsed;
+    projectionMatrixIsUpToDate_ = false;
+  }
+}
+
+// gluProject() and gluUnProject() map the [-1,1] normalized depth to [0,1].
+// Converts a window depth to or from this convention when glClipControl is
+// used, since the normalized depth is then already in [0,1].
+qreal Camera::toGluDepth(qreal depth) const {
+  return clipControlIsUsed_ ? (depth + 1.0) / 2.0 : depth;
+}
+
+qreal Camera::fromGluDepth(qreal depth) const {
+  return clipControlIsUsed_ ? 2.0 * depth - 1.0 : depth;
+}
+
 /*! Loads the OpenGL \c GL_MODELVIEW matrix with the modelView matrix
  corresponding to the Camera.
 
@@ -509,6 +665,107 @@ void Camera::loadModelViewMatrix(bool reset) const {
     glMultMatrixd(modelViewMatrix_);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//                            Floating origin                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the renderOrigin(). Emits renderOriginChanged() when it is modified.
+
+With floatingOriginIsEnabled(), the origin is moved again as soon as the
+camera is farther than floatingOriginThreshold() from it. */
+void Camera::setRenderOrigin(const Vec &origin) {
+  if (origin == renderOrigin_)
+    return;
+  renderOrigin_ = origin;
+  Q_EMIT renderOriginChanged();
+}
+
+/*! Enables or disables the floating origin: the renderOrigin() then follows
+the camera, so that the coordinates relative to it remain small wherever the
+camera goes. The origin is immediately moved to the camera position() when it
+is too far. See floatingOriginIsEnabled(). */
+void Camera::setFloatingOriginEnabled(bool enabled) {
+  floatingOriginIsEnabled_ = enabled;
+  updateFloatingOrigin();
+}
+
+// Moves the floating origin to the camera when it is too far. The origin
+// stays in place otherwise, so that the relative vertex data of the
+// application remain valid.
+void Camera::updateFloatingOrigin() {
+  if (floatingOriginIsEnabled_ && frame() &&
+      ((position() - renderOrigin_).norm() > floatingOriginThreshold_))
+    setRenderOrigin(position());
+}
+
+// Fills t with a - b expressed in the camera coordinate system. Unlike the
+// Vec arithmetic, which rounds to Real, everything is computed in double.
+void Camera::rotateDifference(const Vec &a, const Vec &b, GLdouble t[3]) const {
+  computeModelViewMatrix();
+  GLdouble d[3];
+  for (int i = 0; i < 3; ++i)
+    d[i] = double(a[i]) - double(b[i]);
+  for (int i = 0; i < 3; ++i)
+    t[i] = modelViewMatrix_[i] * d[0] + modelViewMatrix_[4 + i] * d[1] +
+           modelViewMatrix_[8 + i] * d[2];
+}
+
+/*! Fills \p m with the modelView matrix of the points given relative to the
+renderOrigin(): a vertex \c v of world coordinates \c w is drawn at \c
+v=w-renderOrigin().
+
+The translation is computed in double from the camera position() relative to
+the origin, so that this matrix and the vertices remain precise in \c float
+even with huge world coordinates. With \c QGLVIEWER_SINGLE_PRECISION, the
+position() and the renderOrigin() are themselves stored in \c float, which
+bounds this precision. See also getFrameModelViewMatrix(). */
+void Camera::getRelativeModelViewMatrix(GLdouble m[16]) const {
+  computeModelViewMatrix();
+  for (int i = 0; i < 12; ++i)
+    m[i] = modelViewMatrix_[i];
+
+  GLdouble t[3];
+  rotateDifference(position(), renderOrigin_, t);
+  m[12] = -t[0];
+  m[13] = -t[1];
+  m[14] = -t[2];
+  m[15] = 1.0;
+}
+
+/*! \c GLfloat version of getRelativeModelViewMatrix(). The matrix is computed
+in double and then converted. */
+void Camera::getRelativeModelViewMatrix(GLfloat m[16]) const {
+  GLdouble mat[16];
+  getRelativeModelViewMatrix(mat);
+  for (int i = 0; i < 16; ++i)
+    m[i] = float(mat[i]);
+}
+
+/*! Fills \p m with the modelView matrix of an object whose local
+coordinates system is \p frame: the product of the camera modelView
+matrix and of the \p frame Frame::worldMatrix().
+
+Only the position of \p frame relative to the camera is used, computed in
+double: the result is precise in \c float wherever the object and the camera
+are (within the \c float storage of their positions with \c
+QGLVIEWER_SINGLE_PRECISION), and is directly given to a shader or to \c
+glLoadMatrixf():
+\code
+GLfloat m[16];
+camera()->getFrameModelViewMatrix(*building->frame(), m);
+glUniformMatrix4fv(modelViewLocation, 1, GL_FALSE, m);
+\endcode */
+void Camera::getFrameModelViewMatrix(const Frame &frame, GLfloat m[16]) const {
+  const Quaternion q = orientation().inverse() * frame.orientation();
+  GLdouble mat[16];
+  q.getMatrix(mat);
+
+  rotateDifference(frame.position(), position(), mat + 12);
+
+  for (int i = 0; i < 16; ++i)
+    m[i] = float(mat[i]);
+}
+
 /*! Same as loadProjectionMatrix() but for a stereo setup.
 
  Only the Camera::PERSPECTIVE type() is supported for stereo mode. See
@@ -524,45 +781,66 @@ void Camera::loadModelViewMatrix(bool reset) const {
  href="../examples/contribs.html#anaglyph">anaglyph</a> examples for an
  illustration.
 
- To retrieve this matrix, use a code like:
- \code
- glMatrixMode(GL_PROJECTION);
- glPushMatrix();
- loadProjectionMatrixStereo(left_or_right);
- glGetDoublev(GL_PROJECTION_MATRIX, m);
- glPopMatrix();
- \endcode
- Note that getProjectionMatrix() always returns the mono-vision matrix.
+ Use getProjectionMatrixStereo() to retrieve this matrix. Note that
+ getProjectionMatrix() always returns the mono-vision matrix.
 
  \attention glMatrixMode is set to \c GL_PROJECTION. */
 void Camera::loadProjectionMatrixStereo(bool leftBuffer) const {
-  qreal left, right, bottom, top;
-  qreal screenHalfWidth, halfWidth, side, shift, delta;
-
+  GLdouble m[16];
+  getProjectionMatrixStereo(m, leftBuffer);
   glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
+  glLoadMatrixd(m);
+}
+
+/*! Fills \p m with the projection matrix loaded by
+loadProjectionMatrixStereo(), without modifying the OpenGL state.
+
+The identity matrix is returned with the Camera::ORTHOGRAPHIC type(), which
+is not supported in stereo. See also getStereoMatrices(). */
+void Camera::getProjectionMatrixStereo(GLdouble m[16], bool leftBuffer) const {
+  for (unsigned short i = 0; i < 16; ++i)
+    m[i] = ((i % 5) == 0) ? 1.0 : 0.0;
 
   switch (type()) {
-  case Camera::PERSPECTIVE:
+  case Camera::PERSPECTIVE: {
     // compute half width of screen,
     // corresponding to zero parallax plane to deduce decay of cameras
-    screenHalfWidth = focusDistance() * tan(horizontalFieldOfView() / 2.0);
-    shift = screenHalfWidth * IODistance() / physicalScreenWidth();
+    const qreal screenHalfWidth =
+        focusDistance() * tan(horizontalFieldOfView() / 2.0);
+    const qreal shift = screenHalfWidth * IODistance() / physicalScreenWidth();
     // should be * current y  / y total
     // to take into account that the window doesn't cover the entire screen
 
     // compute half width of "view" at znear and the delta corresponding to
     // the shifted camera to deduce what to set for asymmetric frustums
-    halfWidth = zNear() * tan(horizontalFieldOfView() / 2.0);
-    delta = shift * zNear() / focusDistance();
-    side = leftBuffer ? -1.0 : 1.0;
-
-    left = -halfWidth + side * delta;
-    right = halfWidth + side * delta;
-    top = halfWidth / aspectRatio();
-    bottom = -top;
-    glFrustum(left, right, bottom, top, zNear(), zFar());
+    const qreal halfWidth = zNear() * tan(horizontalFieldOfView() / 2.0);
+    const qreal delta = shift * zNear() / focusDistance();
+    const qreal side = leftBuffer ? -1.0 : 1.0;
+
+    const qreal left = -halfWidth + side * delta;
+    const qreal right = halfWidth + side * delta;
+    const qreal top = halfWidth / aspectRatio();
+    const qreal bottom = -top;
+    const qreal ZNear = zNear();
+    const qreal ZFar = zFar();
+
+    // Same matrix as glFrustum(left, right, bottom, top, ZNear, ZFar)
+    m[0] = 2.0 * ZNear / (right - left);
+    m[5] = 2.0 * ZNear / (top - bottom);
+    m[8] = (right + left) / (right - left);
+    m[9] = (top + bottom) / (top - bottom);
+    if (reverseZIsEnabled()) {
+      // Infinite far plane, see computeProjectionMatrix()
+      m[10] = clipControlIsUsed_ ? 0.0 : 1.0;
+      m[14] = clipControlIsUsed_ ? ZNear : 2.0 * ZNear;
+    } else {
+      m[10] = (ZNear + ZFar) / (ZNear - ZFar);
+      m[14] = 2.0 * ZNear * ZFar / (ZNear - ZFar);
+    }
+    m[11] = -1.0;
+    m[15] = 0.0;
     break;
+  }
 
   case Camera::ORTHOGRAPHIC:
     qWarning("Camera::setProjectionMatrixStereo: Stereo not available with "
@@ -583,7 +861,7 @@ void Camera::loadProjectionMatrixStereo(bool leftBuffer) const {
  When \p leftBuffer is \c true, computes the modelView matrix associated to the
  left eye (right eye otherwise).
 
- loadProjectionMatrixStereo() explains how to retrieve to resulting matrix.
+ Use getModelViewMatrixStereo() to retrieve the resulting matrix.
 
  See the <a href="../examples/stereoViewer.html">stereoViewer</a> and the <a
  href="../examples/contribs.html#anaglyph">anaglyph</a> examples for an
@@ -594,17 +872,52 @@ void Camera::loadModelViewMatrixStereo(bool leftBuffer) const {
   // WARNING: makeCurrent must be called by every calling method
   glMatrixMode(GL_MODELVIEW);
 
+  GLdouble m[16];
+  getModelViewMatrixStereo(m, leftBuffer);
+  glLoadMatrixd(m);
+}
+
+/*! Fills \p m with the modelView matrix loaded by loadModelViewMatrixStereo(),
+without modifying the OpenGL state. The mono-vision modelView matrix (see
+getModelViewMatrix()) is left unchanged. */
+void Camera::getModelViewMatrixStereo(GLdouble m[16], bool leftBuffer) const {
   qreal halfWidth = focusDistance() * tan(horizontalFieldOfView() / 2.0);
   qreal shift =
       halfWidth * IODistance() /
       physicalScreenWidth(); // * current window width / full screen width
 
-  computeModelViewMatrix();
+  getModelViewMatrix(m);
   if (leftBuffer)
-    modelViewMatrix_[12] -= shift;
+    m[12] -= shift;
   else
-    modelViewMatrix_[12] += shift;
-  glLoadMatrixd(modelViewMatrix_);
+    m[12] += shift;
+}
+
+/*! Fills \p modelView and \p projection with the stereo matrices of both
+eyes: the left eye matrices (see getModelViewMatrixStereo() and
+getProjectionMatrixStereo()) are followed by the right eye ones.
+
+These arrays can directly be given to \c glUniformMatrix4fv() with a \c count
+of 2, so that a single instanced draw call renders both eyes:
+\code
+uniform mat4 modelView[2];
+uniform mat4 projection[2];
+...
+int eye = gl_InstanceID % 2; // or gl_ViewID_OVR with GL_OVR_multiview
+gl_Position = projection[eye] * modelView[eye] * vertex;
+\endcode
+See QGLViewer::stereoIsSinglePass(). */
+void Camera::getStereoMatrices(GLfloat modelView[32],
+                               GLfloat projection[32]) const {
+  GLdouble mv[16], proj[16];
+  for (int eye = 0; eye < 2; ++eye) {
+    getModelViewMatrixStereo(mv, eye == 0);
+    getProjectionMatrixStereo(proj, eye == 0);
+    for (unsigned short i = 0; i < 16; ++i) {
+      modelView[16 * eye + i] = float(mv[i]);
+      projection[16 * eye + i] = float(proj[i]);
+    }
+  }
 }
 
 /*! Fills \p m with the Camera projection matrix values.
@@ -672,22 +985,140 @@ void Camera::getModelViewMatrix(GLfloat m[16]) const {
 
 /*! Fills \p m with the product of the ModelView and Projection matrices.
 
-  Calls getModelViewMatrix() and getProjectionMatrix() and then fills \p m with
-  the product of these two matrices. */
+  The product of the getModelViewMatrix() and getProjectionMatrix() matrices is
+  cached, and only computed again when one of them is modified. */
 void Camera::getModelViewProjectionMatrix(GLdouble m[16]) const {
-  GLdouble mv[16];
-  GLdouble proj[16];
-  getModelViewMatrix(mv);
-  getProjectionMatrix(proj);
+  computeScreenMatrix();
+  for (unsigned short i = 0; i < 16; ++i)
+    m[i] = modelViewProjectionMatrix_[i];
+}
+
+// Converts the column-major OpenGL projection (or model view projection)
+// matrix m to clipSpace. The depth rows are rescaled from [-1,1] to [0,1], and
+// the y row is negated for Vulkan.
+static void convertToClipSpace(GLdouble m[16], Camera::ClipSpace clipSpace,
+                               bool depthIsZeroToOne) {
+  if (clipSpace == Camera::OPENGL_CLIP_SPACE)
+    return;
 
-  for (unsigned short i = 0; i < 4; ++i) {
+  if (!depthIsZeroToOne)
+    // z' = (z + w) / 2
+    for (int c = 0; c < 4; ++c)
+      m[4 * c + 2] = 0.5 * (m[4 * c + 2] + m[4 * c + 3]);
+
+  if (clipSpace == Camera::VULKAN_CLIP_SPACE)
+    for (int c = 0; c < 4; ++c)
+      m[4 * c + 1] = -m[4 * c + 1];
+}
+
+/*! Fills \p m with the projection matrix of the Camera, expressed with the
+normalized device coordinates conventions of \p clipSpace.
+
+Use this method to render the scene with an other graphics API than OpenGL
+(through \c QRhi, Vulkan, Metal or Direct3D), from the same Camera. With \c
+OPENGL_CLIP_SPACE, this is the same as getProjectionMatrix(). The depth values
+and reverseZIsEnabled() semantic are preserved: the depth of the background
+is 1.0, or 0.0 with reverseZIsEnabled().
+
+The result is given in \e column-major order, as with getProjectionMatrix().
+Transpose it for the row-major conventions of Direct3D. */
+void Camera::getProjectionMatrix(GLdouble m[16], ClipSpace clipSpace) const {
+  getProjectionMatrix(m);
+  convertToClipSpace(m, clipSpace, reverseZIsEnabled() && clipControlIsUsed_);
+}
+
+/*! Same as getModelViewProjectionMatrix(), with the getProjectionMatrix(
+GLdouble[16], ClipSpace) conventions of \p clipSpace. */
+void Camera::getModelViewProjectionMatrix(GLdouble m[16],
+                                          ClipSpace clipSpace) const {
+  getModelViewProjectionMatrix(m);
+  convertToClipSpace(m, clipSpace, reverseZIsEnabled() && clipControlIsUsed_);
+}
+
+// Inverts the column-major m into inv, using cofactors. Returns false (and
+// leaves inv unchanged) when m is singular.
+static bool invertMatrix(const GLdouble m[16], GLdouble inv[16]) {
+  GLdouble r[16];
+  r[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+         m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+  r[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+         m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+  r[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+         m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+  r[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+          m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+  r[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+         m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+  r[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+         m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+  r[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+         m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+  r[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+          m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+  r[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+         m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+  r[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+         m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+  r[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+          m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+  r[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+          m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+  r[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+         m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+  r[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+         m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+  r[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+          m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+  r[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+          m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+  const GLdouble det = m[0] * r[0] + m[1] * r[4] + m[2] * r[8] + m[3] * r[12];
+  if (det == 0.0)
+    return false;
+
+  for (unsigned short i = 0; i < 16; ++i)
+    inv[i] = r[i] / det;
+  return true;
+}
+
+// Updates the cached modelViewProjectionMatrix_, its product with the viewport
+// transformation (screenMatrix_) and the inverse of the latter. Only recomputed
+// when computeModelViewMatrix() or computeProjectionMatrix() modified a matrix.
+void Camera::computeScreenMatrix() const {
+  computeModelViewMatrix();
+  computeProjectionMatrix();
+  if (screenMatrixIsUpToDate_)
+    return;
+
+  GLdouble *const mvp = modelViewProjectionMatrix_;
+  for (unsigned short i = 0; i < 4; ++i)
     for (unsigned short j = 0; j < 4; ++j) {
       qreal sum = 0.0;
       for (unsigned short k = 0; k < 4; ++k)
-        sum += proj[i + 4 * k] * mv[k + 4 * j];
-      m[i + 4 * j] = sum;
+        sum += projectionMatrix_[i + 4 * k] * modelViewMatrix_[k + 4 * j];
+      mvp[i + 4 * j] = sum;
     }
+
+  // Same viewport as getViewport(): y axis is flipped. The [-1,1] normalized
+  // depth is mapped to [0,1], unless glClipControl already does it.
+  const qreal halfWidth = screenWidth() / 2.0;
+  const qreal halfHeight = screenHeight() / 2.0;
+  const qreal depthScale = clipControlIsUsed_ ? 1.0 : 0.5;
+  const qreal depthOffset = clipControlIsUsed_ ? 0.0 : 0.5;
+  for (unsigned short j = 0; j < 4; ++j) {
+    const GLdouble *const col = mvp + 4 * j;
+    GLdouble *const res = screenMatrix_ + 4 * j;
+    res[0] = halfWidth * (col[0] + col[3]);
+    res[1] = halfHeight * (col[3] - col[1]);
+    res[2] = depthScale * col[2] + depthOffset * col[3];
+    res[3] = col[3];
   }
+
+  if (!invertMatrix(screenMatrix_, inverseScreenMatrix_))
+    for (unsigned short i = 0; i < 16; ++i)
+      inverseScreenMatrix_[i] = 0.0;
+
+  screenMatrixIsUpToDate_ = true;
 }
 
 /*! Overloaded getModelViewProjectionMatrix(GLdouble m[16]) method using a \c
@@ -942,6 +1373,7 @@ void Camera::interpolateToFitScene() {
 
   See also interpolateToFitScene() and interpolateToZoomOnPixel(). */
 void Camera::interpolateTo(const Frame &fr, qreal duration) {
+  TraceRecorder::addInstantEvent("camera", "interpolateTo");
   if (interpolationKfi_->interpolationIsStarted())
     interpolationKfi_->stopInterpolation();
 
@@ -970,18 +1402,166 @@ void Camera::interpolateTo(const Frame &fr, qreal duration) {
 
  \note The precision of the z-Buffer highly depends on how the zNear() and
  zFar() values are fitted to your scene. Loose boundaries will result in
- imprecision along the viewing direction. */
+ imprecision along the viewing direction. See reverseZIsEnabled() for a nearly
+ uniform precision, where the background depth is 0.0 instead of 1.0.
+
+ When a valid depthCache() is set, the depth is read from this cache instead,
+ without any OpenGL call. The matrices of the cached frame are then used. */
 Vec Camera::pointUnderPixel(const QPoint &pixel, bool &found) const {
+  QGLVIEWER_TRACE_SCOPE("camera", "pointUnderPixel");
+  if (depthCache_ && depthCache_->isValid())
+    return depthCache_->pointUnderPixel(pixel, found);
+
   float depth;
   // Qt uses upper corner for its origin while GL uses the lower corner.
-  glReadPixels(pixel.x() * devicePixelRatio_, devicePixelRatio_ * (screenHeight() - pixel.y()) - 1,
-    1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-  found = static_cast<double>(depth) < 1.0;
+  glReadPixels(devicePixelRatio_ * (screenOffsetX() + pixel.x()),
+               devicePixelRatio_ * (screenOffsetY() + screenHeight() - pixel.y()) - 1,
+               1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
+  // The background depth is 0.0 with a reversed depth mapping
+  found = reverseZIsEnabled() ? static_cast<double>(depth) > 0.0
+                              : static_cast<double>(depth) < 1.0;
   Vec point(pixel.x(), pixel.y(), static_cast<double>(depth));
   point = unprojectedCoordinatesOf(point);
   return point;
 }
 
+/*! Asynchronous version of pointUnderPixel().
+
+The depth of \p pixel is read into a pixel buffer object, which does not stall
+the OpenGL pipeline. The result is retrieved by retrievePointUnderPixel(), which
+emits the pointUnderPixelRetrieved() signal. QGLViewer::paintGL() automatically
+calls retrievePointUnderPixel() at the beginning of the next frame, so that you
+typically just have to connect the signal and call QGLViewer::update():
+\code
+connect(camera(), SIGNAL(pointUnderPixelRetrieved(const QPoint&, const qglviewer::Vec&, bool)),
+        SLOT(pointFound(const QPoint&, const qglviewer::Vec&, bool)));
+
+void Viewer::mouseDoubleClickEvent(QMouseEvent* e)
+{
+  makeCurrent();
+  camera()->requestPointUnderPixel(e->pos());
+  update();
+}
+\endcode
+
+The current modelview and projection matrices are saved, so that the point is
+unprojected with the matrices of the frame that was actually read, even if the
+Camera moved in the meantime.
+
+A pending request is retrieved (and its signal emitted) before a new one is
+queued. An OpenGL context must be current when this method is called. */
+void Camera::requestPointUnderPixel(const QPoint &pixel) {
+  if (hasPendingPointUnderPixel())
+    retrievePointUnderPixel();
+
+  if (!depthReadBuffer_) {
+    depthReadBuffer_ = new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+    depthReadBuffer_->setUsagePattern(QOpenGLBuffer::StreamRead);
+    if (!depthReadBuffer_->create()) {
+      qWarning("Camera::requestPointUnderPixel: unable to create pixel buffer "
+               "object");
+      delete depthReadBuffer_;
+      depthReadBuffer_ = nullptr;
+      return;
+    }
+    depthReadBuffer_->bind();
+    depthReadBuffer_->allocate(sizeof(float));
+  } else
+    depthReadBuffer_->bind();
+
+  // Qt uses upper corner for its origin while GL uses the lower corner.
+  // With a bound pixel pack buffer, glReadPixels returns immediately.
+  glReadPixels(devicePixelRatio_ * (screenOffsetX() + pixel.x()),
+               devicePixelRatio_ * (screenOffsetY() + screenHeight() - pixel.y()) - 1,
+               1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  depthReadBuffer_->release();
+
+  computeModelViewMatrix();
+  computeProjectionMatrix();
+  for (int i = 0; i < 16; ++i) {
+    pendingModelViewMatrix_[i] = modelViewMatrix_[i];
+    pendingProjectionMatrix_[i] = projectionMatrix_[i];
+  }
+  pendingPixel_ = pixel;
+  pointUnderPixelIsPending_ = true;
+}
+
+/*! Retrieves the result of the last requestPointUnderPixel() and emits
+pointUnderPixelRetrieved().
+
+Does nothing if hasPendingPointUnderPixel() is \c false. This method is
+automatically called by QGLViewer::paintGL(), i.e. one frame after the request,
+when the read back is completed and does not stall the pipeline any more. An
+OpenGL context must be current when this method is called. */
+void Camera::retrievePointUnderPixel() {
+  if (!hasPendingPointUnderPixel())
+    return;
+  QGLVIEWER_TRACE_SCOPE("camera", "retrievePointUnderPixel");
+  pointUnderPixelIsPending_ = false;
+
+  float depth = 1.0f;
+  depthReadBuffer_->bind();
+  depthReadBuffer_->read(0, &depth, sizeof(float));
+  depthReadBuffer_->release();
+
+  const bool found = reverseZIsEnabled() ? static_cast<double>(depth) > 0.0
+                                         : static_cast<double>(depth) < 1.0;
+  GLdouble x, y, z;
+  static GLint viewport[4];
+  getViewport(viewport);
+  gluUnProject(pendingPixel_.x(), pendingPixel_.y(),
+               toGluDepth(static_cast<double>(depth)),
+               pendingModelViewMatrix_, pendingProjectionMatrix_, viewport, &x,
+               &y, &z);
+  Q_EMIT pointUnderPixelRetrieved(pendingPixel_, Vec(x, y, z), found);
+}
+
+/*! Sets clippingPlanesAreFittedToDepth(). The sceneRadius() planes are used
+until the next fitClippingPlanesToDepth(). */
+void Camera::setClippingPlanesFittedToDepth(bool fitted) {
+  clippingPlanesAreFittedToDepth_ = fitted;
+  if (!fitted && fittedPlanesAreValid_) {
+    fittedPlanesAreValid_ = false;
+    projectionMatrixIsUpToDate_ = false;
+  }
+}
+
+/*! Sets the depthFittingMargin(), clamped to [0, 1]. Applies to the next
+fitClippingPlanesToDepth(). */
+void Camera::setDepthFittingMargin(qreal margin) {
+  depthFittingMargin_ = qBound(qreal(0.0), margin, qreal(1.0));
+}
+
+/*! Fits zNear() and zFar() to the DepthCache::distanceRange() of the
+depthCache(), when clippingPlanesAreFittedToDepth(). Falls back to the
+sceneRadius() planes when the cache is stale (captured from another view), not
+valid or empty, or when \p sceneIsStill is \c false: the objects may then have
+moved since the capture. Returns fittedClippingPlanesAreUsed().
+
+Called by QGLViewer::paintGL(), after the depthCache() retrieval. The fitted
+planes never extend the sceneRadius() ones. */
+bool Camera::fitClippingPlanesToDepth(bool sceneIsStill) {
+  QGLVIEWER_TRACE_SCOPE("camera", "fitClippingPlanesToDepth");
+  qreal zMin, zMax;
+  const bool valid = clippingPlanesAreFittedToDepth_ && sceneIsStill &&
+                     depthCache_ &&
+                     depthCache_->distanceRange(this, zMin, zMax);
+  if (valid) {
+    const qreal zNear = (1.0 - depthFittingMargin_) * zMin;
+    const qreal zFar = (1.0 + depthFittingMargin_) * zMax;
+    if (!fittedPlanesAreValid_ || (zNear != fittedZNear_) ||
+        (zFar != fittedZFar_)) {
+      fittedZNear_ = zNear;
+      fittedZFar_ = zFar;
+      projectionMatrixIsUpToDate_ = false;
+    }
+  } else if (fittedPlanesAreValid_)
+    projectionMatrixIsUpToDate_ = false;
+
+  fittedPlanesAreValid_ = valid;
+  return valid;
+}
+
 /*! Moves the Camera so that the entire scene is visible.
 
  Simply calls fitSphere() on a sphere defined by sceneCenter() and
@@ -1548,9 +2128,9 @@ void Camera::getViewport(GLint viewport[4]) const {
  before calling this method. Call computeModelViewMatrix() and
  computeProjectionMatrix() to do so.
 
- If you call this method several times with no change in the matrices, consider
- precomputing the projection times modelview matrix to save computation time if
- required (\c P x \c M in the \c gluProject man page).
+ The product of the modelView, projection and viewport matrices is cached, so
+ that this method is a single matrix-vector product as long as the Camera is
+ not modified. It can hence be used to project large sets of points.
 
  Here is the code corresponding to what this method does (kindly submitted by
  Robert W. Kuhn) : \code Vec project(Vec point)
@@ -1600,19 +2180,14 @@ void Camera::getViewport(GLint viewport[4]) const {
  \endcode
  */
 Vec Camera::projectedCoordinatesOf(const Vec &src, const Frame *frame) const {
-  GLdouble x, y, z;
-  static GLint viewport[4];
-  getViewport(viewport);
-
-  if (frame) {
-    const Vec tmp = frame->inverseCoordinatesOf(src);
-    gluProject(tmp.x, tmp.y, tmp.z, modelViewMatrix_, projectionMatrix_,
-               viewport, &x, &y, &z);
-  } else
-    gluProject(src.x, src.y, src.z, modelViewMatrix_, projectionMatrix_,
-               viewport, &x, &y, &z);
-
-  return Vec(x, y, z);
+  computeScreenMatrix();
+  const Vec p = frame ? frame->inverseCoordinatesOf(src) : src;
+  const GLdouble *const m = screenMatrix_;
+  const qreal w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+  return Vec(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+             m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+             m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]) /
+         w;
 }
 
 /*! Returns the world unprojected coordinates of a point \p src defined in the
@@ -1624,7 +2199,8 @@ Vec Camera::projectedCoordinatesOf(const Vec &src, const Frame *frame) const {
  not a linear interpolation between zNear and zFar. /code src.z = zFar() /
  (zFar() - zNear()) * (1.0 - zNear() / z); /endcode Where z is the distance from
  the point you project to the camera, along the viewDirection(). See the \c
- gluUnProject man page for details.
+ gluUnProject man page for details. When reverseZIsEnabled(), \p src.z ranges
+ in ]0..1] instead, and is simply zNear() / z with a Camera::PERSPECTIVE type().
 
  The result is expressed in the \p frame coordinate system. When \p frame is \c
  nullptr (default), the result is expressed in the world coordinates system. The
@@ -1643,20 +2219,22 @@ Vec Camera::projectedCoordinatesOf(const Vec &src, const Frame *frame) const {
  before calling this method (use computeModelViewMatrix(),
  computeProjectionMatrix()). See also setScreenWidthAndHeight().
 
- This method is not computationally optimized. If you call it several times with
- no change in the matrices, you should buffer the entire inverse projection
- matrix (modelview, projection and then viewport) to speed-up the queries. See
- the \c gluUnProject man page for details. */
+ The inverse of the entire projection matrix (modelview, projection and then
+ viewport) is cached, so that this method is a single matrix-vector product as
+ long as the Camera is not modified. See the \c gluUnProject man page for
+ details. */
 Vec Camera::unprojectedCoordinatesOf(const Vec &src, const Frame *frame) const {
-  GLdouble x, y, z;
-  static GLint viewport[4];
-  getViewport(viewport);
-  gluUnProject(src.x, src.y, src.z, modelViewMatrix_, projectionMatrix_,
-               viewport, &x, &y, &z);
+  computeScreenMatrix();
+  const GLdouble *const m = inverseScreenMatrix_;
+  const qreal w = m[3] * src.x + m[7] * src.y + m[11] * src.z + m[15];
+  const Vec res = Vec(m[0] * src.x + m[4] * src.y + m[8] * src.z + m[12],
+                      m[1] * src.x + m[5] * src.y + m[9] * src.z + m[13],
+                      m[2] * src.x + m[6] * src.y + m[10] * src.z + m[14]) /
+                  w;
   if (frame)
-    return frame->coordinatesOf(Vec(x, y, z));
+    return frame->coordinatesOf(res);
   else
-    return Vec(x, y, z);
+    return res;
 }
 
 /*! Same as projectedCoordinatesOf(), but with \c qreal parameters (\p src and
@@ -1677,6 +2255,190 @@ void Camera::getUnprojectedCoordinatesOf(const qreal src[3], qreal res[3],
     res[i] = r[i];
 }
 
+/*! Batch version of projectedCoordinatesOf(), applied to \p nbPoints points.
+
+ \p src and \p res are arrays of \p nbPoints contiguous (x,y,z) coordinates
+ (they can be identical pointers). The full \p frame to screen transformation is
+ composed once and then applied to each point, which is much faster than
+ calling projectedCoordinatesOf() in a loop. Results are identical, except for
+ points located in the camera plane (null homogeneous coordinate), whose
+ coordinates are not modified.
+
+ Same as projectedCoordinatesOf(), this method uses the matrices that were set
+ by the last loadModelViewMatrix() and loadProjectionMatrix() calls. */
+void Camera::getProjectedCoordinatesOf(const qreal *src, qreal *res,
+                                       int nbPoints, const Frame *frame) const {
+  GLdouble m[16];
+  for (unsigned short i = 0; i < 4; ++i)
+    for (unsigned short j = 0; j < 4; ++j) {
+      qreal sum = 0.0;
+      for (unsigned short k = 0; k < 4; ++k)
+        sum += projectionMatrix_[i + 4 * k] * modelViewMatrix_[k + 4 * j];
+      m[i + 4 * j] = sum;
+    }
+
+  if (frame) {
+    // Append the frame to world transformation
+    const GLdouble *fm = frame->worldMatrix();
+    GLdouble mvp[16];
+    for (int i = 0; i < 16; ++i)
+      mvp[i] = m[i];
+    for (unsigned short i = 0; i < 4; ++i)
+      for (unsigned short j = 0; j < 4; ++j) {
+        qreal sum = 0.0;
+        for (unsigned short k = 0; k < 4; ++k)
+          sum += mvp[i + 4 * k] * fm[k + 4 * j];
+        m[i + 4 * j] = sum;
+      }
+  }
+
+  static GLint viewport[4];
+  getViewport(viewport);
+  const qreal vx = viewport[0], vy = viewport[1];
+  const qreal vw = viewport[2], vh = viewport[3];
+
+  for (int i = 0; i < nbPoints; ++i) {
+    const qreal x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+    const qreal w = m[3] * x + m[7] * y + m[11] * z + m[15];
+    if (w == 0.0)
+      continue;
+    const qreal invW = 1.0 / w;
+    const qreal px = (m[0] * x + m[4] * y + m[8] * z + m[12]) * invW;
+    const qreal py = (m[1] * x + m[5] * y + m[9] * z + m[13]) * invW;
+    const qreal pz = (m[2] * x + m[6] * y + m[10] * z + m[14]) * invW;
+    res[3 * i] = vx + vw * (px * 0.5 + 0.5);
+    res[3 * i + 1] = vy + vh * (py * 0.5 + 0.5);
+    res[3 * i + 2] = pz * 0.5 + 0.5;
+  }
+}
+
+// Fills scales with the number of pixels per OpenGL unit of each bounding
+// sphere, evaluated at its point closest to the Camera: the inverse of
+// pixelGLRatio(). The trigonometry is only evaluated once.
+void Camera::getScreenSpaceScales(const qreal *centers, const qreal *radii,
+                                  qreal *scales, int nbObjects) const {
+  switch (type()) {
+  case Camera::PERSPECTIVE: {
+    const qreal k = screenHeight() / (2.0 * tan(fieldOfView() / 2.0));
+    const Vec pos = position();
+    const Vec dir = viewDirection();
+    const qreal posDir = pos * dir;
+    // Spheres that intersect the near plane use its distance
+    const qreal minDepth = zNear();
+    for (int i = 0; i < nbObjects; ++i) {
+      const qreal depth = dir.x * centers[3 * i] + dir.y * centers[3 * i + 1] +
+                          dir.z * centers[3 * i + 2] - posDir - radii[i];
+      scales[i] = k / qMax(depth, minDepth);
+    }
+    break;
+  }
+  case Camera::ORTHOGRAPHIC: {
+    GLdouble w, h;
+    getOrthoWidthHeight(w, h);
+    const qreal k = screenHeight() / (2.0 * h);
+    for (int i = 0; i < nbObjects; ++i)
+      scales[i] = k;
+    break;
+  }
+  }
+}
+
+/*! Batch screen space error evaluation, for levels of detail schemes.
+
+ \p centers is an array of \p nbObjects contiguous (x,y,z) bounding sphere
+ centers, in the world coordinate system. \p radii and \p geometricErrors give
+ the radius and the geometric error (in OpenGL units) of each object. \p
+ screenErrors is filled with the projected size of these errors, in pixels.
+
+ The error is projected at the point of the bounding sphere that is the closest
+ to the Camera, along the viewDirection(). This is the same as \c
+ geometricErrors[i] / pixelGLRatio(), but the trigonometry is only evaluated
+ once and the loop is easily vectorized by the compiler. \p geometricErrors and
+ \p screenErrors can be identical pointers.
+
+ See also getLevelsOfDetail(). */
+void Camera::getScreenSpaceErrors(const qreal *centers, const qreal *radii,
+                                  const qreal *geometricErrors,
+                                  qreal *screenErrors, int nbObjects) const {
+  getScreenSpaceScales(centers, radii, screenErrors, nbObjects);
+  for (int i = 0; i < nbObjects; ++i)
+    screenErrors[i] *= geometricErrors[i];
+}
+
+// Selects the coarsest levels whose screen error is below threshold, and
+// returns their total triangle count (0 without triangleCounts).
+static qint64 selectLevels(const qreal *scales, const qreal *geometricErrors,
+                           int nbLevels, qreal threshold, int *levels,
+                           int nbObjects, const int *triangleCounts) {
+  qint64 triangles = 0;
+  for (int i = 0; i < nbObjects; ++i) {
+    // Comparing geometric errors avoids a product per level
+    const qreal maxError = threshold / scales[i];
+    const qreal *const errors = geometricErrors + nbLevels * i;
+    int level = 0;
+    while ((level + 1 < nbLevels) && (errors[level + 1] <= maxError))
+      ++level;
+    levels[i] = level;
+    if (triangleCounts)
+      triangles += triangleCounts[nbLevels * i + level];
+  }
+  return triangles;
+}
+
+/*! Selects a level of detail for each of the \p nbObjects objects.
+
+ Each object has \p nbLevels levels, from the finest (0) to the coarsest (\p
+ nbLevels - 1). \p geometricErrors holds \p nbLevels errors per object, which
+ increase with the level. \p centers and \p radii are defined as in
+ getScreenSpaceErrors().
+
+ \p levels is filled with the coarsest level of each object whose screen space
+ error does not exceed \p maximumScreenError pixels (0 when no level is precise
+ enough).
+
+ When \p triangleCounts (\p nbLevels counts per object) is provided and \p
+ triangleBudget is positive, the error threshold is increased when needed, so
+ that the total number of triangles of the selected levels fits in the budget.
+ The smaller threshold is found by dichotomy. The coarsest levels are used
+ when even they exceed the budget.
+
+ Returns the screen space error threshold that was actually used. */
+qreal Camera::getLevelsOfDetail(const qreal *centers, const qreal *radii,
+                                const qreal *geometricErrors, int nbLevels,
+                                qreal maximumScreenError, int *levels,
+                                int nbObjects, const int *triangleCounts,
+                                int triangleBudget) const {
+  if ((nbObjects <= 0) || (nbLevels <= 0))
+    return maximumScreenError;
+
+  QVector<qreal> scales(nbObjects);
+  getScreenSpaceScales(centers, radii, scales.data(), nbObjects);
+
+  const qint64 triangles =
+      selectLevels(scales.constData(), geometricErrors, nbLevels,
+                   maximumScreenError, levels, nbObjects, triangleCounts);
+  if (!triangleCounts || (triangleBudget <= 0) || (triangles <= triangleBudget))
+    return maximumScreenError;
+
+  // Largest screen error of the coarsest levels: all of them are selected
+  qreal high = maximumScreenError;
+  for (int i = 0; i < nbObjects; ++i)
+    high = qMax(high, geometricErrors[nbLevels * i + nbLevels - 1] * scales[i]);
+
+  qreal low = maximumScreenError;
+  for (int iter = 0; iter < 24; ++iter) {
+    const qreal middle = (low + high) / 2.0;
+    if (selectLevels(scales.constData(), geometricErrors, nbLevels, middle,
+                     levels, nbObjects, triangleCounts) <= triangleBudget)
+      high = middle;
+    else
+      low = middle;
+  }
+  selectLevels(scales.constData(), geometricErrors, nbLevels, high, levels,
+               nbObjects, triangleCounts);
+  return high;
+}
+
 /////////////////////////////////////  KFI
 ////////////////////////////////////////////
 
@@ -1711,9 +2473,11 @@ KeyFrameInterpolator *Camera::keyFrameInterpolator(unsigned int i) const {
  */
 void Camera::setKeyFrameInterpolator(unsigned int i,
                                      KeyFrameInterpolator *const kfi) {
-  if (kfi)
+  if (kfi) {
     kfi_[i] = kfi;
-  else
+    if (animationClock_)
+      kfi->setAnimationClock(animationClock_);
+  } else
     kfi_.remove(i);
 }
 
@@ -1803,6 +2567,23 @@ void Camera::drawAllPaths() {
     (it.value())->drawPath(3, 5, sceneRadius());
 }
 
+/*! Sets the animationClock() of the Camera frame(), of the interpolation used
+by interpolateTo(), interpolateToFitScene() and interpolateToZoomOnPixel(), and
+of all the keyFrameInterpolator() paths. The paths added later with
+setKeyFrameInterpolator() or addKeyFrameToPath() also use \p clock.
+
+Use \c nullptr to make them use their own timers again. */
+void Camera::setAnimationClock(AnimationClock *clock) {
+  animationClock_ = clock;
+  frame()->setAnimationClock(clock);
+  interpolationKfi_->setAnimationClock(clock);
+  for (QMap<unsigned int, KeyFrameInterpolator *>::ConstIterator
+           it = kfi_.begin(),
+           end = kfi_.end();
+       it != end; ++it)
+    it.value()->setAnimationClock(clock);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 /*! Returns an XML \c QDomElement that represents the Camera.
@@ -1841,6 +2622,7 @@ QDomElement Camera::domElement(const QString &name,
                          QString::number(zNearCoefficient()));
   paramNode.setAttribute("zClippingCoefficient",
                          QString::number(zClippingCoefficient()));
+  DomUtils::setBoolAttribute(paramNode, "reverseZ", reverseZIsEnabled());
   paramNode.setAttribute("orthoCoef", QString::number(orthoCoef_));
   paramNode.setAttribute("sceneRadius", QString::number(sceneRadius()));
   paramNode.appendChild(sceneCenter().domElement("SceneCenter", document));
@@ -1918,6 +2700,7 @@ void Camera::initFromDOMElement(const QDomElement &element) {
           DomUtils::qrealFromDom(child, "zNearCoefficient", 0.005));
       setZClippingCoefficient(
           DomUtils::qrealFromDom(child, "zClippingCoefficient", sqrt(3.0)));
+      setReverseZIsEnabled(DomUtils::boolFromDom(child, "reverseZ", false));
       orthoCoef_ =
           DomUtils::qrealFromDom(child, "orthoCoef", tan(fieldOfView() / 2.0));
       setSceneRadius(
@@ -1964,6 +2747,88 @@ void Camera::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the Camera state in \p stream. Compact binary equivalent of
+ domElement(), used by QGLViewer::saveStateToFile() when
+ QGLViewer::stateFileIsBinary().
+
+ The same values are saved: Camera parameters, frame() state (see
+ ManipulatedCameraFrame::writeBinary()) and keyFrameInterpolator() paths. Use
+ readBinary() to restore the Camera state. */
+void Camera::writeBinary(QDataStream &stream) const {
+  stream << double(fieldOfView()) << double(zNearCoefficient())
+         << double(zClippingCoefficient()) << reverseZIsEnabled()
+         << double(orthoCoef_) << double(sceneRadius()) << sceneCenter()
+         << qint32(type());
+
+  stream << double(IODistance()) << double(focusDistance())
+         << double(physicalScreenWidth());
+
+  frame()->writeBinary(stream);
+
+  // KeyFrame paths
+  stream << qint32(kfi_.count());
+  for (QMap<unsigned int, KeyFrameInterpolator *>::ConstIterator
+           it = kfi_.begin(),
+           end = kfi_.end();
+       it != end; ++it) {
+    stream << quint32(it.key());
+    it.value()->writeBinary(stream);
+  }
+}
+
+/*! Restores the Camera state from a \p stream written by writeBinary().
+
+ As with initFromDOMElement(), the frame() pointer is not modified, and the
+ original keyFrameInterpolator() are deleted. Reading stops at the first
+ corrupted value, leaving the remaining values unchanged. */
+void Camera::readBinary(QDataStream &stream) {
+  QMutableMapIterator<unsigned int, KeyFrameInterpolator *> it(kfi_);
+  while (it.hasNext()) {
+    it.next();
+    deletePath(it.key());
+  }
+
+  double fov, zNearCoef, zClippingCoef, orthoCoef, radius;
+  bool reverseZ;
+  Vec center;
+  qint32 cameraType;
+  stream >> fov >> zNearCoef >> zClippingCoef >> reverseZ >> orthoCoef >>
+      radius >> center >> cameraType;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setFieldOfView(fov);
+  setZNearCoefficient(zNearCoef);
+  setZClippingCoefficient(zClippingCoef);
+  setReverseZIsEnabled(reverseZ);
+  orthoCoef_ = orthoCoef;
+  setSceneRadius(radius);
+  setSceneCenter(center);
+  setType(cameraType == ORTHOGRAPHIC ? ORTHOGRAPHIC : PERSPECTIVE);
+
+  double IODist, focusDist, physScreenWidth;
+  stream >> IODist >> focusDist >> physScreenWidth;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setIODistance(IODist);
+  setFocusDistance(focusDist);
+  setPhysicalScreenWidth(physScreenWidth);
+
+  frame()->readBinary(stream);
+
+  qint32 nbPaths = 0;
+  stream >> nbPaths;
+  for (qint32 i = 0; i < nbPaths && stream.status() == QDataStream::Ok; ++i) {
+    quint32 index;
+    stream >> index;
+    if (stream.status() != QDataStream::Ok)
+      break;
+    setKeyFrameInterpolator(index, new KeyFrameInterpolator(frame()));
+    keyFrameInterpolator(index)->readBinary(stream);
+  }
+}
+
 /*! Gives the coefficients of a 3D half-line passing through the Camera eye and
  pixel (x,y).
 
@@ -2020,7 +2885,9 @@ illustration.
 Note that the current \c glColor and \c glPolygonMode are used to draw the near
 and far planes. See the <a href="../examples/frustumCulling.html">frustumCulling
 example</a> for an example of semi-transparent plane drawing. Similarly, the
-current \c glLineWidth and \c glColor is used to draw the frustum outline.
+current \c glLineWidth and \c glColor is used to draw the frustum outline,
+with the LineRenderer::current() renderer when there is one (see
+QGLViewer::drawGrid()).
 
 When \p drawFarPlane is \c false, only the near plane is drawn. \p scale can be
 used to scale the drawing: a value of 1.0 (default) will draw the Camera's
@@ -2039,29 +2906,7 @@ void Camera::draw(bool drawFarPlane, qreal scale) const {
 
   // 0 is the upper left coordinates of the near corner, 1 for the far one
   Vec points[2];
-
-  points[0].z = scale * zNear();
-  points[1].z = scale * zFar();
-
-  switch (type()) {
-  case Camera::PERSPECTIVE: {
-    points[0].y = points[0].z * tan(fieldOfView() / 2.0);
-    points[0].x = points[0].y * aspectRatio();
-
-    const qreal ratio = points[1].z / points[0].z;
-
-    points[1].y = ratio * points[0].y;
-    points[1].x = ratio * points[0].x;
-    break;
-  }
-  case Camera::ORTHOGRAPHIC: {
-    GLdouble hw, hh;
-    getOrthoWidthHeight(hw, hh);
-    points[0].x = points[1].x = scale * qreal(hw);
-    points[0].y = points[1].y = scale * qreal(hh);
-    break;
-  }
-  }
+  getFrustumCorners(points[0], points[1], scale);
 
   const int farIndex = drawFarPlane ? 1 : 0;
 
@@ -2099,37 +2944,80 @@ void Camera::draw(bool drawFarPlane, qreal scale) const {
   glEnd();
 
   // Frustum lines
+  QVector<Vec> lines;
   switch (type()) {
   case Camera::PERSPECTIVE:
-    glBegin(GL_LINES);
-    glVertex3d(0.0, 0.0, 0.0);
-    glVertex3d(points[farIndex].x, points[farIndex].y, -points[farIndex].z);
-    glVertex3d(0.0, 0.0, 0.0);
-    glVertex3d(-points[farIndex].x, points[farIndex].y, -points[farIndex].z);
-    glVertex3d(0.0, 0.0, 0.0);
-    glVertex3d(-points[farIndex].x, -points[farIndex].y, -points[farIndex].z);
-    glVertex3d(0.0, 0.0, 0.0);
-    glVertex3d(points[farIndex].x, -points[farIndex].y, -points[farIndex].z);
-    glEnd();
+    for (int c = 0; c < 4; ++c) {
+      const qreal x = (c == 0 || c == 3) ? 1.0 : -1.0;
+      const qreal y = (c < 2) ? 1.0 : -1.0;
+      lines << Vec(0.0, 0.0, 0.0)
+            << Vec(x * points[farIndex].x, y * points[farIndex].y,
+                   -points[farIndex].z);
+    }
     break;
   case Camera::ORTHOGRAPHIC:
-    if (drawFarPlane) {
-      glBegin(GL_LINES);
-      glVertex3d(points[0].x, points[0].y, -points[0].z);
-      glVertex3d(points[1].x, points[1].y, -points[1].z);
-      glVertex3d(-points[0].x, points[0].y, -points[0].z);
-      glVertex3d(-points[1].x, points[1].y, -points[1].z);
-      glVertex3d(-points[0].x, -points[0].y, -points[0].z);
-      glVertex3d(-points[1].x, -points[1].y, -points[1].z);
-      glVertex3d(points[0].x, -points[0].y, -points[0].z);
-      glVertex3d(points[1].x, -points[1].y, -points[1].z);
-      glEnd();
-    }
+    if (drawFarPlane)
+      for (int c = 0; c < 4; ++c) {
+        const qreal x = (c == 0 || c == 3) ? 1.0 : -1.0;
+        const qreal y = (c < 2) ? 1.0 : -1.0;
+        lines << Vec(x * points[0].x, y * points[0].y, -points[0].z)
+              << Vec(x * points[1].x, y * points[1].y, -points[1].z);
+      }
+  }
+
+  LineRenderer *const renderer = LineRenderer::current();
+  if (renderer) {
+    GLfloat color[4];
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    renderer->clear();
+    renderer->addLines(lines, GLStateCache::current()->lineWidth(),
+                       QColor::fromRgbF(color[0], color[1], color[2],
+                                        color[3]));
+    renderer->draw();
+  } else if (!lines.isEmpty()) {
+    glBegin(GL_LINES);
+    for (const Vec &point : lines)
+      glVertex3d(point.x, point.y, point.z);
+    glEnd();
   }
 
   glPopMatrix();
 }
 
+/*! Sets \p nearCorner and \p farCorner to the upper right corners of the near
+and far planes of the Camera frustum, as drawn by draw() with the same \p
+scale.
+
+The corners are expressed in the Camera coordinate system, with a \e positive
+\c z set to the (scaled) zNear() and zFar() distances: the actual corner is
+located at (\c x, \c y, -\c z). The other corners are obtained by symmetry.
+Used by QGLViewer::drawCameras(). */
+void Camera::getFrustumCorners(Vec &nearCorner, Vec &farCorner,
+                               qreal scale) const {
+  nearCorner.z = scale * zNear();
+  farCorner.z = scale * zFar();
+
+  switch (type()) {
+  case Camera::PERSPECTIVE: {
+    nearCorner.y = nearCorner.z * tan(fieldOfView() / 2.0);
+    nearCorner.x = nearCorner.y * aspectRatio();
+
+    const qreal ratio = farCorner.z / nearCorner.z;
+
+    farCorner.y = ratio * nearCorner.y;
+    farCorner.x = ratio * nearCorner.x;
+    break;
+  }
+  case Camera::ORTHOGRAPHIC: {
+    GLdouble hw, hh;
+    getOrthoWidthHeight(hw, hh);
+    nearCorner.x = farCorner.x = scale * qreal(hw);
+    nearCorner.y = farCorner.y = scale * qreal(hh);
+    break;
+  }
+  }
+}
+
 /*! Returns the 6 plane equations of the Camera frustum.
 
 The six 4-component vectors of \p coef respectively correspond to the left,
@@ -2234,7 +3122,196 @@ void Camera::getFrustumPlanesCoefficients(GLdouble coef[6][4]) const {
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//                            Thread safe state                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns a CameraState filled with the current Camera parameters.
+
+This method computes the Camera matrices when needed and must hence be called
+from the thread that uses the Camera (usually the GUI thread). Use
+publishedState() from the other threads. */
+CameraState Camera::currentState() const {
+  CameraState state;
+  getModelViewMatrix(state.modelViewMatrix);
+  getProjectionMatrix(state.projectionMatrix);
+  getModelViewProjectionMatrix(state.modelViewProjectionMatrix);
+  getFrustumPlanesCoefficients(state.frustumPlanes);
+  getViewport(state.viewport);
+
+  const Vec pos = position();
+  const Vec dir = viewDirection();
+  const Quaternion q = orientation();
+  for (int i = 0; i < 3; ++i) {
+    state.position[i] = pos[i];
+    state.viewDirection[i] = dir[i];
+  }
+  for (int i = 0; i < 4; ++i)
+    state.orientation[i] = q[i];
+
+  state.fieldOfView = fieldOfView();
+  state.zNear = zNear();
+  state.zFar = zFar();
+  state.screenWidth = screenWidth();
+  state.screenHeight = screenHeight();
+  state.frame = publicationCount_ + 1;
+  return state;
+}
+
+/*! Publishes the currentState(), so that publishedState() returns it.
+
+QGLViewer::preDraw() calls this method at each frame. Must be called from the
+thread that uses the Camera. */
+void Camera::publishState() {
+  const CameraState state = currentState();
+  PublishedState &slot = publishedStates_[publicationCount_ % 4];
+
+  // Readers of this slot detect the odd sequence number and retry
+  slot.sequence.fetchAndAddRelaxed(1);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&slot.state, &state, sizeof(CameraState));
+  slot.sequence.fetchAndAddRelease(1);
+
+  ++publicationCount_;
+  publishedState_.storeRelease(&slot);
+}
+
+/*! Returns a copy of the last state published by publishState(). The returned
+CameraState is not valid (see CameraState::isValid()) until the first
+publishState() call.
+
+This method can be called from any thread without any lock: the state is
+copied, and the copy is simply restarted in the unlikely case where the Camera
+published several states in the meantime. The Camera must not be deleted
+while it is used by other threads. */
+CameraState Camera::publishedState() const {
+  for (;;) {
+    const PublishedState *const slot = publishedState_.loadAcquire();
+    if (!slot)
+      return CameraState();
+
+    const int sequence = slot->sequence.loadAcquire();
+    if (sequence & 1)
+      continue;
+
+    CameraState state;
+    std::memcpy(&state, &slot->state, sizeof(CameraState));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.loadAcquire() == sequence)
+      return state;
+  }
+}
+
+// Samples closer in time are merged, so that the setPosition() and
+// setOrientation() of a same displacement do not give infinite velocities
+static const qint64 minimumMotionInterval = 10;
+// The Camera is considered as stopped after this delay without modification
+static const qint64 maximumMotionInterval = 250;
+
 void Camera::onFrameModified() {
   projectionMatrixIsUpToDate_ = false;
   modelViewMatrixIsUpToDate_ = false;
+  // The depths of the previous frame no longer apply
+  fittedPlanesAreValid_ = false;
+  updateFloatingOrigin();
+
+  // Velocity estimation, see predictedStates()
+  if (!motionTimer_.isValid())
+    motionTimer_.start();
+  const qint64 time = motionTimer_.elapsed();
+  if ((motionTime_ >= 0) && (time - motionTime_ < minimumMotionInterval))
+    return;
+
+  const Vec position = frame()->position();
+  const Quaternion orientation = frame()->orientation();
+  if ((motionTime_ < 0) || (time - motionTime_ > maximumMotionInterval)) {
+    linearVelocity_ = Vec();
+    angularVelocity_ = Vec();
+  } else {
+    const qreal dt = (time - motionTime_) / 1000.0;
+    Vec axis;
+    qreal angle;
+    (orientation * motionOrientation_.inverse()).getAxisAngle(axis, angle);
+    if (angle > M_PI)
+      angle -= 2.0 * M_PI;
+
+    // Smoothed, the modifications are not evenly spaced in time
+    linearVelocity_ =
+        0.5 * (linearVelocity_ + (position - motionPosition_) / dt);
+    angularVelocity_ = 0.5 * (angularVelocity_ + (angle / dt) * axis);
+  }
+
+  motionTime_ = time;
+  motionPosition_ = position;
+  motionOrientation_ = orientation;
+}
+
+// Returns true when the frame() was modified recently
+bool Camera::isMoving() const {
+  return (motionTime_ >= 0) &&
+         (motionTimer_.elapsed() - motionTime_ <= maximumMotionInterval);
+}
+
+/*! Returns \p nbStates predictions of the Camera state, evenly spaced in time
+over the next \p duration seconds: the \c i-th state is the one expected
+\c duration*(i+1)/nbStates seconds from now.
+
+Streaming data loaders can use the CameraState::frustumPlanes and
+CameraState::position of these states to prefetch the tiles or meshes that
+will soon be visible:
+\code
+for (const qglviewer::CameraState &state : camera()->predictedStates(2.0, 8))
+  for (Tile *tile : tiles)
+    if (state.sphereIsVisible(tile->center, tile->radius))
+      loader->prefetch(tile);
+\endcode
+
+When one of the keyFrameInterpolator() paths (or the interpolateTo()
+animation) is being played, the states are sampled on its spline with
+KeyFrameInterpolator::predictedPositionAndOrientation(). Otherwise, the frame()
+motion is extrapolated with the linearVelocity() and angularVelocity()
+estimated from its recent modifications (mouse or keyboard manipulation,
+flying). All the states are identical to currentState() when the Camera does
+not move.
+
+The other parameters (field of view, screen size, scene radius) are those of
+the Camera. Must be called from the thread that uses the Camera. */
+QVector<CameraState> Camera::predictedStates(qreal duration,
+                                             int nbStates) const {
+  QVector<CameraState> states;
+  if (nbStates <= 0)
+    return states;
+
+  KeyFrameInterpolator *path = nullptr;
+  if (interpolationKfi_->interpolationIsStarted())
+    path = interpolationKfi_;
+  for (KeyFrameInterpolator *kfi : kfi_)
+    if (!path && kfi && kfi->interpolationIsStarted() &&
+        (kfi->frame() == frame()))
+      path = kfi;
+
+  const Vec linear = linearVelocity();
+  const Vec angular = angularVelocity();
+  const qreal angularSpeed = angular.norm();
+
+  // The predicted frames are applied to a copy, which computes the matrices
+  Camera camera(*this);
+  states.reserve(nbStates);
+  for (int i = 0; i < nbStates; ++i) {
+    const qreal delay = duration * (i + 1) / nbStates;
+    Vec position = this->position();
+    Quaternion orientation = this->orientation();
+    if (!path || !path->predictedPositionAndOrientation(delay, position,
+                                                        orientation)) {
+      position += delay * linear;
+      if (angularSpeed > 0.0)
+        orientation =
+            Quaternion(angular / angularSpeed, angularSpeed * delay) *
+            orientation;
+    }
+
+    camera.frame()->setPositionAndOrientation(position, orientation);
+    states.append(camera.currentState());
+  }
+  return states;
 }
@@ -1,12 +1,21 @@
 #ifndef QGLVIEWER_CAMERA_H
 #define QGLVIEWER_CAMERA_H
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
 #include <QMap>
+#include <QPointer>
+#include <QRectF>
+#include <QVector>
+#include "cameraState.h"
 #include "keyFrameInterpolator.h"
 class QGLViewer;
+class QOpenGLBuffer;
 
 namespace qglviewer {
 
+class DepthCache;
 class ManipulatedCameraFrame;
 
 /*! \brief A perspective or orthographic camera.
@@ -71,6 +80,11 @@ class ManipulatedCameraFrame;
 class QGLVIEWER_EXPORT Camera : public QObject {
 #ifndef DOXYGEN
   friend class ::QGLViewer;
+  friend class DepthCache;
+  friend class DisplayWall;
+  friend class CameraReplicator;
+  friend class BrickedVolume;
+  friend class RayPicker;
 #endif
 
   Q_OBJECT
@@ -168,10 +182,23 @@ public:
 
   When the Camera is attached to a QGLViewer, these values and hence the
   aspectRatio() are automatically fitted to the viewer's window aspect ratio
-  using setScreenWidthAndHeight(). */
+  using setScreenWidthAndHeight().
+
+  With a tile() smaller than the whole view, this is the aspect ratio of the
+  whole view, made of screens of the screenWidth() and screenHeight() size. */
   qreal aspectRatio() const {
-    return screenWidth_ / static_cast<qreal>(screenHeight_);
+    return (screenWidth_ * tile_.height()) / (screenHeight_ * tile_.width());
   }
+  /*! Returns the part of the whole view displayed by the Camera screen, in
+  normalized coordinates: (0,0) is the upper left corner of the view and (1,1)
+  its lower right corner. Default value is the whole view, (0,0,1,1).
+
+  A smaller tile makes the projection matrix off-axis: the screen then only
+  displays the tile part of the frustum, as one of the screens of a display
+  wall (see DisplayWall). The aspectRatio() and fieldOfView() are those of the
+  whole view. The frustum planes (see getFrustumPlanesCoefficients()) also
+  remain those of the whole view. Set using setTile(). */
+  QRectF tile() const { return tile_; }
   /*! Returns the width (in pixels) of the Camera screen.
 
   Set using setScreenWidthAndHeight(). This value is automatically fitted to the
@@ -193,6 +220,18 @@ public:
   This value is automatically fitted to the QGLViewer's screen pixel ratio when the
   Camera is attached to a QGLViewer. See also QWindow::devicePixelRatio() */
   qreal devicePixelRatio() const { return devicePixelRatio_; }
+  /*! Returns the horizontal position, in pixels, of the lower left corner of the
+  Camera screen in its OpenGL window. Default value is 0.
+
+  The offset differs from zero when several Cameras share the window of a
+  QGLViewer (see QGLViewer::addViewport()). It is only used to read the depth
+  buffer in pointUnderPixel() and requestPointUnderPixel(): the pixel
+  coordinates of the Camera methods, as those of getViewport(), remain relative
+  to the upper left corner of the Camera screen. Set using setScreenOffset(). */
+  int screenOffsetX() const { return screenOffsetX_; }
+  /*! Same as screenOffsetX(), for the vertical position (OpenGL convention,
+  from the bottom of the window). */
+  int screenOffsetY() const { return screenOffsetY_; }
 
   void getViewport(GLint viewport[4]) const;
   qreal pixelGLRatio(const Vec &position) const;
@@ -242,6 +281,31 @@ public:
                                    GLdouble &halfHeight) const;
   void getFrustumPlanesCoefficients(GLdouble coef[6][4]) const;
 
+  /*! Returns \c true when the Camera uses a reversed depth mapping: the near
+  plane is mapped to a depth of 1.0 and the far plane to 0.0. Default value is
+  \c false.
+
+  With a Camera::PERSPECTIVE type(), the far plane is also sent to infinity:
+  zFar() is ignored by the projection matrix and nothing is clipped behind the
+  scene. Since the floating point precision is much higher close to 0.0, the
+  depth precision is then nearly uniform along the view direction, and the
+  sceneRadius() no longer needs to be tightly fitted to the scene. With a
+  Camera::ORTHOGRAPHIC type(), zNear() and zFar() are simply swapped.
+
+  The OpenGL depth state must match this mapping: loadDepthState() (called by
+  QGLViewer::preDraw()) clears the depth buffer to 0.0 and uses a \c
+  GL_GREATER depth test. The \c glClipControl \c GL_ZERO_TO_ONE depth range is
+  used when available (OpenGL 4.5 or \c GL_ARB_clip_control), so that the depth
+  values are not rescaled in [-1,1]. The QOpenGLWidget default framebuffer
+  usually has a 24 bits fixed point depth buffer: render in a framebuffer
+  object with a \c GL_DEPTH_COMPONENT32F attachment to benefit from the full
+  precision.
+
+  pointUnderPixel(), projectedCoordinatesOf() and unprojectedCoordinatesOf()
+  use the same convention: the depth of the background is 0.0. Note that
+  getFrustumPlanesCoefficients() still places its far plane at zFar(). */
+  bool reverseZIsEnabled() const { return reverseZ_; }
+
 public Q_SLOTS:
   void setType(Type type);
 
@@ -277,6 +341,12 @@ public Q_SLOTS:
   }
 
   void setScreenWidthAndHeight(int width, int height);
+  void setTile(const QRectF &tile);
+  /*! Sets the screenOffsetX() and screenOffsetY() values. */
+  void setScreenOffset(int x, int y) {
+    screenOffsetX_ = x;
+    screenOffsetY_ = y;
+  }
   void setDevicePixelRatio(qreal ratio);
 
   /*! Sets the zNearCoefficient() value. */
@@ -289,6 +359,11 @@ public Q_SLOTS:
     zClippingCoef_ = coef;
     projectionMatrixIsUpToDate_ = false;
   }
+  /*! Sets the reverseZIsEnabled() value. */
+  void setReverseZIsEnabled(bool enabled) {
+    reverseZ_ = enabled;
+    projectionMatrixIsUpToDate_ = false;
+  }
   //@}
 
   /*! @name Scene radius and center */
@@ -377,6 +452,17 @@ public Q_SLOTS:
   virtual void drawAllPaths();
   //@}
 
+  /*! @name Animation clock */
+  //@{
+public:
+  /*! Returns the AnimationClock of the frame() and of the
+  keyFrameInterpolator() paths, or \c nullptr (default) when they use their own timers. Set by
+  QGLViewer::setCamera() to the QGLViewer::animationClock(). */
+  AnimationClock *animationClock() const { return animationClock_; }
+public Q_SLOTS:
+  void setAnimationClock(AnimationClock *clock);
+  //@}
+
   /*! @name OpenGL matrices */
   //@{
 public:
@@ -384,9 +470,13 @@ public:
   virtual void loadModelViewMatrix(bool reset = true) const;
   void computeProjectionMatrix() const;
   void computeModelViewMatrix() const;
+  void loadDepthState() const;
 
   virtual void loadProjectionMatrixStereo(bool leftBuffer = true) const;
   virtual void loadModelViewMatrixStereo(bool leftBuffer = true) const;
+  void getProjectionMatrixStereo(GLdouble m[16], bool leftBuffer = true) const;
+  void getModelViewMatrixStereo(GLdouble m[16], bool leftBuffer = true) const;
+  void getStereoMatrices(GLfloat modelView[32], GLfloat projection[32]) const;
 
   void getProjectionMatrix(GLfloat m[16]) const;
   void getProjectionMatrix(GLdouble m[16]) const;
@@ -396,8 +486,79 @@ public:
 
   void getModelViewProjectionMatrix(GLfloat m[16]) const;
   void getModelViewProjectionMatrix(GLdouble m[16]) const;
+
+  /*! Defines the normalized device coordinates conventions of the graphics
+  APIs. See getProjectionMatrix(GLdouble[16], ClipSpace).
+
+  \c OPENGL_CLIP_SPACE is the convention of getProjectionMatrix(): depths in
+  [-1,1] (or [0,1] when the \c glClipControl of reverseZIsEnabled() is used)
+  and y pointing up. \c DIRECT3D_CLIP_SPACE (also used by Metal) has depths in
+  [0,1] and y pointing up. \c VULKAN_CLIP_SPACE has depths in [0,1] and y
+  pointing down. */
+  enum ClipSpace { OPENGL_CLIP_SPACE, DIRECT3D_CLIP_SPACE, VULKAN_CLIP_SPACE };
+
+  void getProjectionMatrix(GLdouble m[16], ClipSpace clipSpace) const;
+  void getModelViewProjectionMatrix(GLdouble m[16], ClipSpace clipSpace) const;
 //@}
 
+  /*! @name Floating origin */
+  //@{
+public:
+  /*! Returns the world point that getRelativeModelViewMatrix() uses as
+  origin. Default value is (0,0,0). Vertices given relative to this point
+  remain small, and hence precise in \c float, with georeferenced coordinates
+  (around 1e6 or 1e7).
+
+  Set using setRenderOrigin(), or automatically moved with the camera when
+  floatingOriginIsEnabled(). */
+  Vec renderOrigin() const { return renderOrigin_; }
+  void setRenderOrigin(const Vec &origin);
+  /*! Returns \c true when the renderOrigin() is moved to the camera
+  position() each time the camera gets farther than floatingOriginThreshold()
+  from it. Default value is \c false. */
+  bool floatingOriginIsEnabled() const { return floatingOriginIsEnabled_; }
+  void setFloatingOriginEnabled(bool enabled);
+  /*! Returns the distance to the renderOrigin() beyond which the floating
+  origin is moved to the camera. Default value is 10000 scene units. Larger
+  values rebase less often, at the price of larger relative coordinates. */
+  qreal floatingOriginThreshold() const { return floatingOriginThreshold_; }
+  /*! Sets the floatingOriginThreshold(). */
+  void setFloatingOriginThreshold(qreal threshold) {
+    floatingOriginThreshold_ = threshold;
+  }
+
+  void getRelativeModelViewMatrix(GLdouble m[16]) const;
+  void getRelativeModelViewMatrix(GLfloat m[16]) const;
+  void getFrameModelViewMatrix(const Frame &frame, GLfloat m[16]) const;
+
+Q_SIGNALS:
+  /*! Signal emitted when the renderOrigin() changes. Vertex data stored
+  relative to the previous origin must be updated. */
+  void renderOriginChanged();
+  //@}
+
+  /*! @name Thread safe state */
+  //@{
+public:
+  CameraState currentState() const;
+  void publishState();
+  CameraState publishedState() const;
+//@}
+
+  /*! @name Motion prediction */
+  //@{
+public:
+  QVector<CameraState> predictedStates(qreal duration, int nbStates) const;
+  /*! Returns the velocity of the frame() position, in scene units per second,
+  estimated from its recent modifications. Null when the Camera did not move
+  for a quarter of a second. See predictedStates(). */
+  Vec linearVelocity() const { return isMoving() ? linearVelocity_ : Vec(); }
+  /*! Returns the rotation speed of the frame(), in world coordinates: its
+  direction is the rotation axis and its norm the angular speed, in radians per
+  second. See linearVelocity(). */
+  Vec angularVelocity() const { return isMoving() ? angularVelocity_ : Vec(); }
+  //@}
+
 /*! @name Drawing */
 //@{
 #ifndef DOXYGEN
@@ -405,6 +566,8 @@ public:
                          qreal fieldOfView = qreal(M_PI) / 4.0);
 #endif
   virtual void draw(bool drawFarPlane = true, qreal scale = 1.0) const;
+  void getFrustumCorners(Vec &nearCorner, Vec &farCorner,
+                         qreal scale = 1.0) const;
   //@}
 
   /*! @name World to Camera coordinate systems conversions */
@@ -425,8 +588,83 @@ public:
                                  const Frame *frame = nullptr) const;
   void getUnprojectedCoordinatesOf(const qreal src[3], qreal res[3],
                                    const Frame *frame = nullptr) const;
+  void getProjectedCoordinatesOf(const qreal *src, qreal *res, int nbPoints,
+                                 const Frame *frame = nullptr) const;
   void convertClickToLine(const QPoint &pixel, Vec &orig, Vec &dir) const;
   Vec pointUnderPixel(const QPoint &pixel, bool &found) const;
+
+  void getScreenSpaceErrors(const qreal *centers, const qreal *radii,
+                            const qreal *geometricErrors, qreal *screenErrors,
+                            int nbObjects) const;
+  qreal getLevelsOfDetail(const qreal *centers, const qreal *radii,
+                          const qreal *geometricErrors, int nbLevels,
+                          qreal maximumScreenError, int *levels, int nbObjects,
+                          const int *triangleCounts = nullptr,
+                          int triangleBudget = 0) const;
+
+  /*! Returns \c true when a requestPointUnderPixel() was queued and its result
+  has not been retrieved yet. See retrievePointUnderPixel(). */
+  bool hasPendingPointUnderPixel() const { return pointUnderPixelIsPending_; }
+
+  /*! Returns the DepthCache used by pointUnderPixel(). Default value is \c
+  nullptr. Set by QGLViewer::setDepthCacheIsEnabled(). */
+  const DepthCache *depthCache() const { return depthCache_; }
+  /*! Sets the depthCache(). When it DepthCache::isValid(), pointUnderPixel()
+  reads the cached depths instead of the OpenGL depth buffer. The \p cache is
+  not owned by the Camera. */
+  void setDepthCache(const DepthCache *cache) { depthCache_ = cache; }
+public Q_SLOTS:
+  void requestPointUnderPixel(const QPoint &pixel);
+  void retrievePointUnderPixel();
+Q_SIGNALS:
+  /*! Signal emitted by retrievePointUnderPixel() when the depth read queued by
+  requestPointUnderPixel() is available.
+
+  \p point is the world coordinates of the point under \p pixel, with the same
+  semantic as pointUnderPixel(). \p found is \c false when no point was
+  found under \p pixel (background pixel). */
+  void pointUnderPixelRetrieved(const QPoint &pixel, const qglviewer::Vec &point,
+                                bool found);
+  //@}
+
+  /*! @name Depth fitted clipping planes */
+  //@{
+public:
+  /*! Returns \c true when zNear() and zFar() are tightened around the depths
+  of the previous frame. Default value is \c false.
+
+  zNear() and zFar() enclose the sceneRadius() sphere, which is loose for many
+  scenes: the depth precision is poor and the frustum culling conservative.
+  When this mode is enabled, fitClippingPlanesToDepth() reads the distance
+  range of the depthCache() (see DepthCache::distanceRange()) and moves the
+  planes to this range, enlarged by depthFittingMargin(). It is called by
+  QGLViewer::paintGL() at the beginning of each frame: use
+  QGLViewer::setDepthCacheIsEnabled() to provide the depths.
+
+  The fitted planes are only used while the view is the one of the captured
+  frame: as soon as the Camera moves or when the cache is not valid, the
+  sceneRadius() planes are used again. The viewer also uses them while
+  QGLViewer::animationIsStarted() and for the frame that follows a
+  QGLViewer::invalidateScene(), since the objects may then have moved out of
+  the captured range. Objects moved without any of these calls may be clipped
+  until the camera moves. */
+  bool clippingPlanesAreFittedToDepth() const {
+    return clippingPlanesAreFittedToDepth_;
+  }
+  /*! Returns the relative margin added around the depth range by
+  fitClippingPlanesToDepth(): the near (resp. far) plane is set at (1 -
+  margin) (resp. (1 + margin)) times the smallest (resp. largest) distance.
+  Default value is 0.1. */
+  qreal depthFittingMargin() const { return depthFittingMargin_; }
+  /*! Returns \c true when the current zNear() and zFar() use the fitted depth
+  range, \c false when they use the sceneRadius() sphere. */
+  bool fittedClippingPlanesAreUsed() const { return fittedPlanesAreValid_; }
+
+  bool fitClippingPlanesToDepth(bool sceneIsStill = true);
+
+public Q_SLOTS:
+  void setClippingPlanesFittedToDepth(bool fitted = true);
+  void setDepthFittingMargin(qreal margin);
   //@}
 
   /*! @name Fly speed */
@@ -511,8 +749,16 @@ public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
   //@}
 
+  /*! @name Binary representation */
+  //@{
+public:
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
+  //@}
+
 private Q_SLOTS:
   void onFrameModified();
+  bool isMoving() const;
 
 private:
   // F r a m e
@@ -520,6 +766,8 @@ private:
 
   // C a m e r a   p a r a m e t e r s
   int screenWidth_, screenHeight_; // size of the window, in pixels
+  int screenOffsetX_, screenOffsetY_; // in the OpenGL window, lower left
+  QRectF tile_; // of the whole view, normalized
   qreal fieldOfView_;              // in radians
   Vec sceneCenter_;
   qreal sceneRadius_; // OpenGL units
@@ -532,6 +780,27 @@ private:
   mutable bool modelViewMatrixIsUpToDate_;
   mutable GLdouble projectionMatrix_[16]; // Buffered projection matrix.
   mutable bool projectionMatrixIsUpToDate_;
+  mutable GLdouble modelViewProjectionMatrix_[16]; // Buffered products,
+  mutable GLdouble screenMatrix_[16];              // with the viewport,
+  mutable GLdouble inverseScreenMatrix_[16];       // and its inverse.
+  mutable bool screenMatrixIsUpToDate_;
+  void computeScreenMatrix() const;
+  void getScreenSpaceScales(const qreal *centers, const qreal *radii,
+                            qreal *scales, int nbObjects) const;
+
+  // F l o a t i n g   o r i g i n
+  Vec renderOrigin_;
+  bool floatingOriginIsEnabled_;
+  qreal floatingOriginThreshold_;
+  void updateFloatingOrigin();
+  void rotateDifference(const Vec &a, const Vec &b, GLdouble t[3]) const;
+
+  // R e v e r s e   Z
+  bool reverseZ_;
+  mutable bool clipControlIsUsed_;   // depth range is [0,1] in NDC
+  mutable bool depthStateIsReversed_; // as set by the last loadDepthState()
+  qreal toGluDepth(qreal depth) const;
+  qreal fromGluDepth(qreal depth) const;
 
   // S t e r e o   p a r a m e t e r s
   qreal IODistance_;          // inter-ocular distance, in meters
@@ -541,6 +810,40 @@ private:
   // P o i n t s   o f   V i e w s   a n d   K e y F r a m e s
   QMap<unsigned int, KeyFrameInterpolator *> kfi_;
   KeyFrameInterpolator *interpolationKfi_;
+  QPointer<AnimationClock> animationClock_;
+
+  // A s y n c h r o n o u s   p o i n t U n d e r P i x e l
+  QOpenGLBuffer *depthReadBuffer_;
+  bool pointUnderPixelIsPending_;
+  QPoint pendingPixel_;
+  GLdouble pendingModelViewMatrix_[16];
+  GLdouble pendingProjectionMatrix_[16];
+  const DepthCache *depthCache_;
+
+  // D e p t h   f i t t e d   c l i p p i n g   p l a n e s
+  bool clippingPlanesAreFittedToDepth_;
+  qreal depthFittingMargin_;
+  bool fittedPlanesAreValid_;
+  qreal fittedZNear_, fittedZFar_;
+
+  // P u b l i s h e d   s t a t e s
+  // Ring of states, each one protected by a sequence number, odd while it is
+  // being written.
+  struct PublishedState {
+    QAtomicInt sequence;
+    CameraState state;
+  };
+  PublishedState publishedStates_[4];
+  QAtomicPointer<PublishedState> publishedState_;
+  quint64 publicationCount_;
+
+  // M o t i o n   e s t i m a t i o n
+  QElapsedTimer motionTimer_;
+  qint64 motionTime_; // of the last sample, in ms, -1 before the first one
+  Vec motionPosition_;
+  Quaternion motionOrientation_;
+  Vec linearVelocity_;
+  Vec angularVelocity_;
 };
 
 } // namespace qglviewer
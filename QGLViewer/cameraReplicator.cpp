@@ -0,0 +1,481 @@
+#include "cameraReplicator.h"
+#include "camera.h"
+#include "manipulatedCameraFrame.h"
+
+#include <QIODevice>
+#include <QTimer>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+
+using namespace qglviewer;
+
+namespace {
+// Bits of the field mask of a message, in the order of the message fields
+enum Field {
+  POSITION = 1 << 0,
+  ORIENTATION = 1 << 1,
+  PIVOT_POINT = 1 << 2,
+  SCENE_CENTER = 1 << 3,
+  SCENE_RADIUS = 1 << 4,
+  TYPE = 1 << 5,
+  FIELD_OF_VIEW = 1 << 6,
+  Z_NEAR_COEF = 1 << 7,
+  Z_CLIPPING_COEF = 1 << 8,
+  ORTHO_COEF = 1 << 9,
+  REVERSE_Z = 1 << 10,
+  ALL_FIELDS = (1 << 11) - 1,
+  KEY_STATE = 1 << 15 // all the fields are present
+};
+
+// The three smallest quaternion components are in [-1/sqrt(2), 1/sqrt(2)]
+const double orientationScale = 32767.0 * 1.4142135623730951;
+
+// L i t t l e   e n d i a n   e n c o d i n g
+
+void appendUInt8(QByteArray &message, quint8 value) {
+  message.append(char(value));
+}
+
+void appendUInt16(QByteArray &message, quint16 value) {
+  uchar bytes[2];
+  qToLittleEndian(value, bytes);
+  message.append(reinterpret_cast<const char *>(bytes), 2);
+}
+
+void appendFloat(QByteArray &message, float value) {
+  quint32 bits;
+  std::memcpy(&bits, &value, 4);
+  uchar bytes[4];
+  qToLittleEndian(bits, bytes);
+  message.append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+void appendDouble(QByteArray &message, double value) {
+  quint64 bits;
+  std::memcpy(&bits, &value, 8);
+  uchar bytes[8];
+  qToLittleEndian(bits, bytes);
+  message.append(reinterpret_cast<const char *>(bytes), 8);
+}
+
+// Reads the fields of a message, valid is false after a read past its end
+class MessageReader {
+public:
+  explicit MessageReader(const QByteArray &message)
+      : data_(reinterpret_cast<const uchar *>(message.constData())),
+        size_(message.size()), offset_(0), valid_(true) {}
+
+  bool isValid() const { return valid_; }
+  bool atEnd() const { return offset_ == size_; }
+
+  quint8 readUInt8() {
+    const uchar *bytes = take(1);
+    return bytes ? bytes[0] : 0;
+  }
+
+  quint16 readUInt16() {
+    const uchar *bytes = take(2);
+    return bytes ? qFromLittleEndian<quint16>(bytes) : 0;
+  }
+
+  float readFloat() {
+    const uchar *bytes = take(4);
+    const quint32 bits = bytes ? qFromLittleEndian<quint32>(bytes) : 0;
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+  }
+
+  double readDouble() {
+    const uchar *bytes = take(8);
+    const quint64 bits = bytes ? qFromLittleEndian<quint64>(bytes) : 0;
+    double value;
+    std::memcpy(&value, &bits, 8);
+    return value;
+  }
+
+private:
+  const uchar *take(int size) {
+    if (!valid_ || (offset_ + size > size_)) {
+      valid_ = false;
+      return nullptr;
+    }
+    const uchar *bytes = data_ + offset_;
+    offset_ += size;
+    return bytes;
+  }
+
+  const uchar *data_;
+  int size_, offset_;
+  bool valid_;
+};
+
+bool equal(const float *a, const float *b) {
+  return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]);
+}
+} // namespace
+
+/*! Creates a CameraReplicator of \p camera with the given \p role. Its
+connections are set using addReplica() or setPresenter(). \p camera is not
+owned by the CameraReplicator. */
+CameraReplicator::CameraReplicator(Role role, Camera *camera, QObject *parent)
+    : QObject(parent), role_(role), camera_(camera), keyStateInterval_(120),
+      sequenceNumber_(0), nbMessagesSinceKeyState_(0), nbLostMessages_(0),
+      nbBytesSent_(0), stateIsValid_(false) {
+  std::memset(&state_, 0, sizeof(State));
+  // Coalesces the frame modifications of an event loop iteration
+  sendTimer_ = new QTimer(this);
+  sendTimer_->setSingleShot(true);
+  sendTimer_->setInterval(0);
+  connect(sendTimer_, SIGNAL(timeout()), SLOT(sendState()));
+  if ((role_ == PRESENTER) && camera)
+    connect(camera->frame(), SIGNAL(modified()), SLOT(scheduleSend()));
+}
+
+/*! Virtual destructor. The connections are not closed. */
+CameraReplicator::~CameraReplicator() {}
+
+/*! Returns the Camera sent by the PRESENTER, or set by the REPLICA. Set at
+construction. Note that a PRESENTER follows the Camera::frame() it had at
+construction. */
+Camera *CameraReplicator::camera() const { return camera_; }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Connections                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p device, an open connection to a REPLICA, to the PRESENTER. The
+pending changes are first sent to the other replicas, and \p device then
+receives all the fields of the current state. \p device is not owned by the
+CameraReplicator: it is silently removed when it is destroyed. */
+void CameraReplicator::addReplica(QIODevice *device) {
+  if (role_ != PRESENTER) {
+    qWarning("CameraReplicator::addReplica: Only a PRESENTER has replicas");
+    return;
+  }
+  if (!device || !camera_)
+    return;
+  for (int i = 0; i < replicas_.size(); ++i)
+    if (replicas_[i] == device)
+      return;
+
+  sendState();
+  // The new replica starts with the last sequence number, without a gap
+  const QByteArray key =
+      message(sequenceNumber_, ALL_FIELDS | KEY_STATE, state_);
+  device->write(key);
+  nbBytesSent_ += key.size();
+  replicas_.append(device);
+}
+
+/*! Removes \p device from the replicas of the PRESENTER. */
+void CameraReplicator::removeReplica(QIODevice *device) {
+  for (int i = 0; i < replicas_.size(); ++i)
+    if (replicas_[i] == device) {
+      replicas_.remove(i);
+      return;
+    }
+}
+
+/*! Sets \p device, an open connection to the PRESENTER, as the presenter() of
+this REPLICA. The messages are applied to the camera() as soon as they are
+read, starting with the first one that contains all the fields. \p device is
+not owned by the CameraReplicator. */
+void CameraReplicator::setPresenter(QIODevice *device) {
+  if (role_ != REPLICA) {
+    qWarning("CameraReplicator::setPresenter: Only a REPLICA has a presenter");
+    return;
+  }
+  if (presenter_)
+    disconnect(presenter_, SIGNAL(readyRead()), this, SLOT(readPresenter()));
+  presenter_ = device;
+  buffer_.clear();
+  stateIsValid_ = false;
+  if (device) {
+    connect(device, SIGNAL(readyRead()), this, SLOT(readPresenter()));
+    readPresenter();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Protocol                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+void CameraReplicator::scheduleSend() {
+  if (!sendTimer_->isActive())
+    sendTimer_->start();
+}
+
+/*! Sends the fields of the camera() state that changed since the previous
+message to the replicas. Nothing is sent when the quantized state did not
+change. Automatically called when the Camera::frame() is modified: call it
+after changing the other Camera parameters. Does nothing for a REPLICA. */
+void CameraReplicator::sendState() {
+  sendTimer_->stop();
+  if ((role_ != PRESENTER) || !camera_)
+    return;
+  // Destroyed connections
+  for (int i = replicas_.size() - 1; i >= 0; --i)
+    if (!replicas_[i])
+      replicas_.remove(i);
+
+  State current;
+  quantize(camera_, current);
+  int fields = stateIsValid_ ? changedFields(state_, current) : ALL_FIELDS;
+  state_ = current;
+  stateIsValid_ = true;
+  // Replicas added later receive the state in addReplica()
+  if ((fields == 0) || replicas_.isEmpty())
+    return;
+
+  if (++nbMessagesSinceKeyState_ >= keyStateInterval_) {
+    fields = ALL_FIELDS | KEY_STATE;
+    nbMessagesSinceKeyState_ = 0;
+  }
+  ++sequenceNumber_;
+  const QByteArray packet = message(sequenceNumber_, fields, state_);
+  for (int i = 0; i < replicas_.size(); ++i)
+    replicas_[i]->write(packet);
+  nbBytesSent_ += qint64(packet.size()) * replicas_.size();
+}
+
+void CameraReplicator::quantize(const Camera *camera, State &state) {
+  std::memset(&state, 0, sizeof(State));
+  const Vec center = camera->sceneCenter();
+  const Vec position = camera->position() - center;
+  const Vec pivotPoint = camera->pivotPoint() - center;
+  for (int i = 0; i < 3; ++i) {
+    state.position[i] = float(position[i]);
+    state.pivotPoint[i] = float(pivotPoint[i]);
+    state.center[i] = double(center[i]);
+  }
+
+  // Smallest three: the largest component is made positive and deduced from
+  // the others, since the quaternion is normalized
+  const Quaternion q = camera->orientation();
+  int largest = 0;
+  for (int i = 1; i < 4; ++i)
+    if (qAbs(q[i]) > qAbs(q[largest]))
+      largest = i;
+  const double sign = (q[largest] < 0.0) ? -1.0 : 1.0;
+  state.largestComponent = quint8(largest);
+  for (int i = 0, j = 0; i < 4; ++i) {
+    if (i == largest)
+      continue;
+    const double value = qBound(-32767.0, sign * q[i] * orientationScale,
+                                32767.0);
+    state.orientation[j++] = qint16(qRound(value));
+  }
+
+  state.radius = double(camera->sceneRadius());
+  state.type = quint8(camera->type());
+  state.fieldOfView = float(camera->fieldOfView());
+  state.zNearCoef = float(camera->zNearCoefficient());
+  state.zClippingCoef = float(camera->zClippingCoefficient());
+  state.orthoCoef = float(camera->orthoCoef_);
+  state.reverseZ = camera->reverseZIsEnabled() ? 1 : 0;
+}
+
+int CameraReplicator::changedFields(const State &previous,
+                                    const State &current) {
+  int fields = 0;
+  const bool centerChanged = (previous.center[0] != current.center[0]) ||
+                             (previous.center[1] != current.center[1]) ||
+                             (previous.center[2] != current.center[2]);
+  // The points are relative to the center: they are sent with it
+  if (centerChanged)
+    fields |= SCENE_CENTER | POSITION | PIVOT_POINT;
+  if (!equal(previous.position, current.position))
+    fields |= POSITION;
+  if ((previous.largestComponent != current.largestComponent) ||
+      (previous.orientation[0] != current.orientation[0]) ||
+      (previous.orientation[1] != current.orientation[1]) ||
+      (previous.orientation[2] != current.orientation[2]))
+    fields |= ORIENTATION;
+  if (!equal(previous.pivotPoint, current.pivotPoint))
+    fields |= PIVOT_POINT;
+  if (previous.radius != current.radius)
+    fields |= SCENE_RADIUS;
+  if (previous.type != current.type)
+    fields |= TYPE;
+  if (previous.fieldOfView != current.fieldOfView)
+    fields |= FIELD_OF_VIEW;
+  if (previous.zNearCoef != current.zNearCoef)
+    fields |= Z_NEAR_COEF;
+  if (previous.zClippingCoef != current.zClippingCoef)
+    fields |= Z_CLIPPING_COEF;
+  if (previous.orthoCoef != current.orthoCoef)
+    fields |= ORTHO_COEF;
+  if (previous.reverseZ != current.reverseZ)
+    fields |= REVERSE_Z;
+  return fields;
+}
+
+// The message is prefixed by its size in bytes, which is at most 85
+QByteArray CameraReplicator::message(quint16 sequence, int fields,
+                                     const State &state) {
+  QByteArray message;
+  appendUInt8(message, 0);
+  appendUInt16(message, sequence);
+  appendUInt16(message, quint16(fields));
+  if (fields & POSITION)
+    for (int i = 0; i < 3; ++i)
+      appendFloat(message, state.position[i]);
+  if (fields & ORIENTATION) {
+    appendUInt8(message, state.largestComponent);
+    for (int i = 0; i < 3; ++i)
+      appendUInt16(message, quint16(state.orientation[i]));
+  }
+  if (fields & PIVOT_POINT)
+    for (int i = 0; i < 3; ++i)
+      appendFloat(message, state.pivotPoint[i]);
+  if (fields & SCENE_CENTER)
+    for (int i = 0; i < 3; ++i)
+      appendDouble(message, state.center[i]);
+  if (fields & SCENE_RADIUS)
+    appendDouble(message, state.radius);
+  if (fields & TYPE)
+    appendUInt8(message, state.type);
+  if (fields & FIELD_OF_VIEW)
+    appendFloat(message, state.fieldOfView);
+  if (fields & Z_NEAR_COEF)
+    appendFloat(message, state.zNearCoef);
+  if (fields & Z_CLIPPING_COEF)
+    appendFloat(message, state.zClippingCoef);
+  if (fields & ORTHO_COEF)
+    appendFloat(message, state.orthoCoef);
+  if (fields & REVERSE_Z)
+    appendUInt8(message, state.reverseZ);
+  message[0] = char(message.size() - 1);
+  return message;
+}
+
+void CameraReplicator::readPresenter() {
+  if (!presenter_)
+    return;
+  buffer_.append(presenter_->readAll());
+
+  bool applied = false;
+  int offset = 0;
+  while (offset < buffer_.size()) {
+    const int size = quint8(buffer_[offset]);
+    if (buffer_.size() - offset - 1 < size)
+      break;
+    if (readMessage(buffer_.mid(offset + 1, size)))
+      applied = true;
+    offset += 1 + size;
+  }
+  buffer_.remove(0, offset);
+
+  if (applied)
+    Q_EMIT stateApplied();
+}
+
+// Updates state_ with message and applies it to the camera. Returns false
+// when the message is ignored.
+bool CameraReplicator::readMessage(const QByteArray &message) {
+  MessageReader in(message);
+  const quint16 sequence = in.readUInt16();
+  const int fields = in.readUInt16();
+  if (!in.isValid())
+    return false;
+
+  if (!stateIsValid_) {
+    // Deltas are meaningless until all the fields are known
+    if (!(fields & KEY_STATE))
+      return false;
+  } else {
+    const quint16 step = quint16(sequence - sequenceNumber_);
+    // Duplicated or late message
+    if ((step == 0) || (step >= 0x8000))
+      return false;
+    nbLostMessages_ += step - 1;
+  }
+
+  State state = state_;
+  if (fields & POSITION)
+    for (int i = 0; i < 3; ++i)
+      state.position[i] = in.readFloat();
+  if (fields & ORIENTATION) {
+    state.largestComponent = in.readUInt8() & 3;
+    for (int i = 0; i < 3; ++i)
+      state.orientation[i] = qint16(in.readUInt16());
+  }
+  if (fields & PIVOT_POINT)
+    for (int i = 0; i < 3; ++i)
+      state.pivotPoint[i] = in.readFloat();
+  if (fields & SCENE_CENTER)
+    for (int i = 0; i < 3; ++i)
+      state.center[i] = in.readDouble();
+  if (fields & SCENE_RADIUS)
+    state.radius = in.readDouble();
+  if (fields & TYPE)
+    state.type = in.readUInt8();
+  if (fields & FIELD_OF_VIEW)
+    state.fieldOfView = in.readFloat();
+  if (fields & Z_NEAR_COEF)
+    state.zNearCoef = in.readFloat();
+  if (fields & Z_CLIPPING_COEF)
+    state.zClippingCoef = in.readFloat();
+  if (fields & ORTHO_COEF)
+    state.orthoCoef = in.readFloat();
+  if (fields & REVERSE_Z)
+    state.reverseZ = in.readUInt8();
+  if (!in.isValid() || !in.atEnd()) {
+    qWarning("CameraReplicator::readMessage: Invalid message");
+    return false;
+  }
+
+  state_ = state;
+  stateIsValid_ = true;
+  sequenceNumber_ = sequence;
+  if (camera_)
+    apply(fields);
+  return true;
+}
+
+// The order matters: setType() and setPivotPoint() may change orthoCoef_
+void CameraReplicator::apply(int fields) {
+  const Vec center(state_.center[0], state_.center[1], state_.center[2]);
+  if (fields & SCENE_RADIUS)
+    camera_->setSceneRadius(state_.radius);
+  if (fields & SCENE_CENTER)
+    camera_->setSceneCenter(center);
+  if (fields & PIVOT_POINT)
+    camera_->setPivotPoint(center + Vec(state_.pivotPoint[0],
+                                        state_.pivotPoint[1],
+                                        state_.pivotPoint[2]));
+  if (fields & TYPE)
+    camera_->setType(Camera::Type(state_.type));
+  if (fields & FIELD_OF_VIEW)
+    camera_->setFieldOfView(state_.fieldOfView);
+  if (fields & Z_NEAR_COEF)
+    camera_->setZNearCoefficient(state_.zNearCoef);
+  if (fields & Z_CLIPPING_COEF)
+    camera_->setZClippingCoefficient(state_.zClippingCoef);
+  if (fields & REVERSE_Z)
+    camera_->setReverseZIsEnabled(state_.reverseZ != 0);
+  if (fields & ORTHO_COEF) {
+    camera_->orthoCoef_ = state_.orthoCoef;
+    camera_->projectionMatrixIsUpToDate_ = false;
+  }
+
+  if (!(fields & (POSITION | ORIENTATION)))
+    return;
+  const Vec position =
+      center + Vec(state_.position[0], state_.position[1], state_.position[2]);
+  double q[4];
+  double sum = 0.0;
+  for (int i = 0, j = 0; i < 4; ++i) {
+    if (i == state_.largestComponent)
+      continue;
+    q[i] = state_.orientation[j++] / orientationScale;
+    sum += q[i] * q[i];
+  }
+  q[state_.largestComponent] = sqrt(qMax(0.0, 1.0 - sum));
+  Quaternion orientation(q[0], q[1], q[2], q[3]);
+  orientation.normalize();
+  camera_->frame()->setPositionAndOrientation(position, orientation);
+}
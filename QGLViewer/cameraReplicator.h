@@ -0,0 +1,166 @@
+#ifndef QGLVIEWER_CAMERA_REPLICATOR_H
+#define QGLVIEWER_CAMERA_REPLICATOR_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+#include "config.h"
+
+class QIODevice;
+class QTimer;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Replicates a Camera on remote viewers with a compact binary
+  protocol.
+  \class CameraReplicator cameraReplicator.h QGLViewer/cameraReplicator.h
+
+  Sending Camera::domElement() to the viewers that follow a presenter costs a
+  few kilobytes of XML per motion, which is easily the largest part of the
+  traffic when dozens of clients are connected. A CameraReplicator instead
+  sends a few bytes per Camera change: each message only contains the fields
+  that changed since the previous one, quantized.
+
+  The PRESENTER sends the state of its camera() when its Camera::frame() is
+  modified (once per event loop iteration) and when sendState() is called. The
+  REPLICA applies each received message to its camera() and emits
+  stateApplied():
+  \code
+  // Presenter
+  qglviewer::CameraReplicator *replicator = new qglviewer::CameraReplicator(
+      qglviewer::CameraReplicator::PRESENTER, viewer->camera(), viewer);
+  connect(&server, &QTcpServer::newConnection, [&]() {
+    QTcpSocket *socket = server.nextPendingConnection();
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    replicator->addReplica(socket);
+  });
+
+  // Replica
+  qglviewer::CameraReplicator *replicator = new qglviewer::CameraReplicator(
+      qglviewer::CameraReplicator::REPLICA, viewer->camera(), viewer);
+  replicator->setPresenter(socket);
+  connect(replicator, SIGNAL(stateApplied()), viewer, SLOT(update()));
+  \endcode
+
+  A message is made of a one byte size, a 16 bits sequence number and a 16 bits
+  mask of the fields it contains. The position and the Camera::pivotPoint() are
+  sent as single precision offsets from the Camera::sceneCenter(), and the
+  orientation with its three smallest components on 16 bits, which is accurate
+  to 5e-5 radians. The scene center and radius are sent in double precision. A
+  typical motion message is 24 bytes long.
+
+  The fields carry absolute values: a lost message, with a datagram device,
+  only delays the fields that did not change in the next messages. Every
+  keyStateInterval() messages and when a replica is added, a message with all
+  the fields is sent. The Camera parameters that do not emit a signal when
+  they are changed (Camera::setFieldOfView(), Camera::setSceneRadius()...) are
+  sent with the next message: call sendState() after changing them. */
+class QGLVIEWER_EXPORT CameraReplicator : public QObject {
+  Q_OBJECT
+
+public:
+  /*! The role of the CameraReplicator. */
+  enum Role {
+    PRESENTER, /*!< Sends its camera() state to the replicas. */
+    REPLICA    /*!< Applies the state of the presenter to its camera(). */
+  };
+
+  CameraReplicator(Role role, Camera *camera, QObject *parent = nullptr);
+  virtual ~CameraReplicator();
+
+  /*! Returns the Role of the CameraReplicator, set at construction. */
+  Role role() const { return role_; }
+  Camera *camera() const;
+
+  /*! @name Connections */
+  //@{
+public:
+  void addReplica(QIODevice *device);
+  void removeReplica(QIODevice *device);
+  /*! Returns the number of replicas connected to the PRESENTER. */
+  int nbReplicas() const { return replicas_.size(); }
+  void setPresenter(QIODevice *device);
+  /*! Returns the connection of a REPLICA to its presenter. Set using
+  setPresenter(). */
+  QIODevice *presenter() const { return presenter_; }
+  //@}
+
+  /*! @name Protocol */
+  //@{
+public:
+  /*! Returns the number of messages between two messages that contain all
+  the fields. Default value is 120. */
+  int keyStateInterval() const { return keyStateInterval_; }
+  /*! Sets the keyStateInterval(). */
+  void setKeyStateInterval(int interval) {
+    keyStateInterval_ = qMax(1, interval);
+  }
+
+  /*! Returns the sequence number of the last message sent by the presenter,
+  or received by the replica. */
+  quint16 sequenceNumber() const { return sequenceNumber_; }
+  /*! Returns the number of messages the REPLICA did not receive, detected
+  with the sequence numbers. */
+  int nbLostMessages() const { return nbLostMessages_; }
+  /*! Returns the number of bytes sent by the PRESENTER, to all its replicas.
+   */
+  qint64 nbBytesSent() const { return nbBytesSent_; }
+
+public Q_SLOTS:
+  void sendState();
+
+Q_SIGNALS:
+  /*! Signal emitted by a REPLICA when a message was applied to its camera().
+  Connect it to your viewer's \c update() slot. */
+  void stateApplied();
+  //@}
+
+private Q_SLOTS:
+  void scheduleSend();
+  void readPresenter();
+
+private:
+  Q_DISABLE_COPY(CameraReplicator)
+
+  // The quantized Camera state, as it is sent
+  struct State {
+    float position[3]; // relative to center
+    quint8 largestComponent;
+    qint16 orientation[3];
+    float pivotPoint[3]; // relative to center
+    double center[3];
+    double radius;
+    quint8 type;
+    float fieldOfView, zNearCoef, zClippingCoef, orthoCoef;
+    quint8 reverseZ;
+  };
+
+  static void quantize(const Camera *camera, State &state);
+  static QByteArray message(quint16 sequence, int fields, const State &state);
+  static int changedFields(const State &previous, const State &current);
+  bool readMessage(const QByteArray &message);
+  void apply(int fields);
+
+  const Role role_;
+  QPointer<Camera> camera_;
+  QVector<QPointer<QIODevice> > replicas_;
+  QPointer<QIODevice> presenter_;
+  QByteArray buffer_; // received bytes that were not processed yet
+  QTimer *sendTimer_;
+  int keyStateInterval_;
+
+  quint16 sequenceNumber_;
+  int nbMessagesSinceKeyState_;
+  int nbLostMessages_;
+  qint64 nbBytesSent_;
+  // Last state sent by the presenter, or received by the replica
+  State state_;
+  bool stateIsValid_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CAMERA_REPLICATOR_H
@@ -0,0 +1,32 @@
+#include "cameraState.h"
+
+using namespace qglviewer;
+
+/*! Same as Camera::projectedCoordinatesOf(), using the matrices of this state:
+x and y are in pixels, (0,0) being the upper left corner of the window. The
+depth is computed as with gluProject(), even when Camera::reverseZIsEnabled()
+uses \c glClipControl. */
+Vec CameraState::projectedCoordinatesOf(const Vec &src) const {
+  const GLdouble *const m = modelViewProjectionMatrix;
+  const qreal x = m[0] * src.x + m[4] * src.y + m[8] * src.z + m[12];
+  const qreal y = m[1] * src.x + m[5] * src.y + m[9] * src.z + m[13];
+  const qreal z = m[2] * src.x + m[6] * src.y + m[10] * src.z + m[14];
+  const qreal w = m[3] * src.x + m[7] * src.y + m[11] * src.z + m[15];
+
+  // Same viewport transformation as gluProject()
+  return Vec(viewport[0] + viewport[2] * (x / w + 1.0) / 2.0,
+             viewport[1] + viewport[3] * (y / w + 1.0) / 2.0,
+             (z / w + 1.0) / 2.0);
+}
+
+/*! Returns \c true when the sphere of \p center and \p radius intersects the
+frustumPlanes. Conservative: a sphere close to a frustum corner may be reported
+visible. */
+bool CameraState::sphereIsVisible(const Vec &center, qreal radius) const {
+  for (int i = 0; i < 6; ++i)
+    if (frustumPlanes[i][0] * center.x + frustumPlanes[i][1] * center.y +
+            frustumPlanes[i][2] * center.z - frustumPlanes[i][3] >
+        radius)
+      return false;
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef QGLVIEWER_CAMERA_STATE_H
+#define QGLVIEWER_CAMERA_STATE_H
+
+#include "vec.h"
+
+namespace qglviewer {
+/*! \brief An immutable copy of the Camera parameters, that can be read from
+  any thread.
+  \class CameraState cameraState.h QGLViewer/cameraState.h
+
+  Camera is a QObject whose matrices are lazily computed by its const methods:
+  it cannot be read from a worker thread while the GUI thread uses it. A
+  CameraState is a plain, trivially copyable value instead. It is filled by
+  Camera::currentState() and published once per frame by
+  Camera::publishState() (called by QGLViewer::preDraw()). Worker threads
+  retrieve a coherent copy of the last published state without any lock using
+  Camera::publishedState():
+  \code
+  // In a worker thread (visibility, levels of detail...)
+  const qglviewer::CameraState state = viewer->camera()->publishedState();
+  if (state.isValid())
+    for (int i = 0; i < nbObjects; ++i)
+      visible[i] = state.sphereIsVisible(center[i], radius[i]);
+  \endcode
+
+  The frustumPlanes can also be given to FrustumCuller::computeVisibleObjects().
+  All the matrices are given in \e column-major order, as with
+  Camera::getModelViewMatrix(). */
+struct QGLVIEWER_EXPORT CameraState {
+  /*! Returns \c true when the state was filled by Camera::currentState().
+  Camera::publishedState() returns an invalid state until the first
+  Camera::publishState(). */
+  bool isValid() const { return frame != 0; }
+
+  Vec projectedCoordinatesOf(const Vec &src) const;
+  bool sphereIsVisible(const Vec &center, qreal radius) const;
+
+  /*! Camera::getModelViewMatrix() */
+  GLdouble modelViewMatrix[16];
+  /*! Camera::getProjectionMatrix() */
+  GLdouble projectionMatrix[16];
+  /*! Camera::getModelViewProjectionMatrix() */
+  GLdouble modelViewProjectionMatrix[16];
+  /*! Camera::getFrustumPlanesCoefficients() */
+  GLdouble frustumPlanes[6][4];
+  /*! Camera::getViewport() */
+  GLint viewport[4];
+
+  /*! Camera::position(). Use \c Vec(state.position) to get a Vec. */
+  qreal position[3];
+  /*! Camera::orientation() quaternion coefficients. */
+  qreal orientation[4];
+  /*! Camera::viewDirection() */
+  qreal viewDirection[3];
+
+  qreal fieldOfView;
+  qreal zNear;
+  qreal zFar;
+  int screenWidth;
+  int screenHeight;
+
+  /*! Number of Camera::publishState() calls when this state was published. 0
+  for an invalid state. */
+  quint64 frame;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CAMERA_STATE_H
@@ -0,0 +1,532 @@
+#include "cascadedShadowMaps.h"
+#include "camera.h"
+#include "frame.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <cmath>
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_TEXTURE_COMPARE_MODE
+#define GL_TEXTURE_COMPARE_MODE 0x884C
+#endif
+#ifndef GL_TEXTURE_COMPARE_FUNC
+#define GL_TEXTURE_COMPARE_FUNC 0x884D
+#endif
+#ifndef GL_COMPARE_REF_TO_TEXTURE
+#define GL_COMPARE_REF_TO_TEXTURE 0x884E
+#endif
+#ifndef GL_CLIP_DEPTH_MODE
+#define GL_CLIP_DEPTH_MODE 0x935D
+#endif
+#ifndef GL_NEGATIVE_ONE_TO_ONE
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#endif
+#ifndef GL_LOWER_LEFT
+#define GL_LOWER_LEFT 0x8CA1
+#endif
+#ifndef GL_CLIP_ORIGIN
+#define GL_CLIP_ORIGIN 0x935C
+#endif
+
+using namespace qglviewer;
+
+/*! Creates CascadedShadowMaps for a light shining along -Z. No OpenGL
+resource is created before the first update(). */
+CascadedShadowMaps::CascadedShadowMaps(QObject *parent)
+    : QObject(parent), lightDirection_(0.0, 0.0, -1.0), nbCascades_(3),
+      resolution_(2048), splitLambda_(0.75), maximumDistance_(0.0),
+      cacheMargin_(0.25), currentCascade_(-1), nbStaticRedraws_(0),
+      context_(nullptr), functions_(nullptr), isSupported_(false),
+      allocatedResolution_(0) {}
+
+/*! Destructor. The OpenGL resources are only released when the context used
+by update() is current. Call cleanupGL() before otherwise. */
+CascadedShadowMaps::~CascadedShadowMaps() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Light                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the normalized direction of the light rays, in the world
+coordinate system. Given by the lightFrame() when it is set. */
+Vec CascadedShadowMaps::lightDirection() const {
+  const Vec direction = lightFrame_
+                            ? lightFrame_->inverseTransformOf(Vec(0, 0, -1))
+                            : lightDirection_;
+  return direction.unit();
+}
+
+/*! Sets the lightDirection(), used when there is no lightFrame(). The static
+maps are drawn again by the next update(). */
+void CascadedShadowMaps::setLightDirection(const Vec &direction) {
+  if (direction.squaredNorm() == 0.0) {
+    qWarning("CascadedShadowMaps::setLightDirection: null direction ignored");
+    return;
+  }
+  lightDirection_ = direction;
+  invalidate();
+}
+
+/*! Sets the lightFrame(). Its Frame::modified() signal invalidate()s the static
+maps. Use \c nullptr to use the lightDirection() again. */
+void CascadedShadowMaps::setLightFrame(const Frame *frame) {
+  if (lightFrame_)
+    disconnect(lightFrame_, SIGNAL(modified()), this, SLOT(invalidate()));
+  lightFrame_ = frame;
+  if (frame)
+    connect(frame, SIGNAL(modified()), SLOT(invalidate()));
+  invalidate();
+}
+
+// An orthonormal light basis, such that right ^ up = -direction as for a
+// camera
+void CascadedShadowMaps::lightBasis(Vec &right, Vec &up,
+                                    Vec &direction) const {
+  direction = lightDirection();
+  const Vec back = -direction;
+  const Vec vertical =
+      (fabs(direction.y) < 0.99) ? Vec(0.0, 1.0, 0.0) : Vec(1.0, 0.0, 0.0);
+  right = (vertical ^ back).unit();
+  up = back ^ right;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Cascades                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the nbCascades(), between 1 and 8. Applied by the next update(). */
+void CascadedShadowMaps::setNbCascades(int nb) {
+  nbCascades_ = qBound(1, nb, 8);
+}
+
+/*! Sets the resolution() of the shadow maps. Applied by the next update(). */
+void CascadedShadowMaps::setResolution(int resolution) {
+  resolution_ = qMax(16, resolution);
+}
+
+/*! Sets the splitLambda(), clamped to [0,1]. */
+void CascadedShadowMaps::setSplitLambda(qreal lambda) {
+  splitLambda_ = qBound(qreal(0.0), lambda, qreal(1.0));
+}
+
+/*! Sets the maximumDistance(). */
+void CascadedShadowMaps::setMaximumDistance(qreal distance) {
+  maximumDistance_ = qMax(qreal(0.0), distance);
+}
+
+/*! Sets the cacheMargin(). Larger margins draw the static casters less often,
+but reduce the shadow resolution. The static maps are drawn again by the next
+update(). */
+void CascadedShadowMaps::setCacheMargin(qreal margin) {
+  cacheMargin_ = qMax(qreal(0.0), margin);
+  invalidate();
+}
+
+/*! Returns the distance, along the camera view direction, where \p cascade
+ends and the next one starts, as fitted by the last update(). Fragments
+closer than splitDistance(0) use the first cascade. */
+qreal CascadedShadowMaps::splitDistance(int cascade) const {
+  return cascades_.value(cascade).farDistance;
+}
+
+/*! Fills \p m with the world to light clip coordinates matrix of \p cascade,
+in OpenGL order. This is the \c GL_PROJECTION matrix loaded while its casters
+are drawn. */
+void CascadedShadowMaps::getCascadeMatrix(int cascade, GLdouble m[16]) const {
+  if ((cascade < 0) || (cascade >= cascades_.size())) {
+    qWarning("CascadedShadowMaps::getCascadeMatrix: invalid cascade %d",
+             cascade);
+    for (int i = 0; i < 16; ++i)
+      m[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    return;
+  }
+  for (int i = 0; i < 16; ++i)
+    m[i] = cascades_[cascade].matrix[i];
+}
+
+/*! Same as getCascadeMatrix(), but maps the world coordinates of a point to
+the texture coordinates and depth of its depthTexture() lookup, in [0,1]. */
+void CascadedShadowMaps::getShadowMatrix(int cascade, GLdouble m[16]) const {
+  getCascadeMatrix(cascade, m);
+  // Column major: m[4*column + row]
+  for (int column = 0; column < 4; ++column)
+    for (int row = 0; row < 3; ++row)
+      m[4 * column + row] = 0.5 * (m[4 * column + row] + m[4 * column + 3]);
+}
+
+/*! Returns the depth texture of \p cascade, with the static and dynamic
+casters. Returns 0 before the first update(). */
+GLuint CascadedShadowMaps::depthTexture(int cascade) const {
+  if ((cascade < 0) || (cascade >= cascades_.size()))
+    return 0;
+  const Cascade &c = cascades_[cascade];
+  return (drawDynamicCasters_ && c.texture) ? c.texture : c.staticTexture;
+}
+
+// Splits the camera frustum, and keeps the region of each static map when it
+// still contains the bounding sphere of its slice
+void CascadedShadowMaps::fitCascades(const Camera *camera) {
+  Vec right, up, direction;
+  lightBasis(right, up, direction);
+
+  const qreal zNear = camera->zNear();
+  qreal zFar = camera->zFar();
+  if (maximumDistance_ > 0.0)
+    zFar = qMin(zFar, maximumDistance_);
+  zFar = qMax(zFar, 1.001 * zNear);
+
+  const bool perspective = (camera->type() == Camera::PERSPECTIVE);
+  GLdouble orthoHalfWidth = 0.0, orthoHalfHeight = 0.0;
+  if (!perspective)
+    camera->getOrthoWidthHeight(orthoHalfWidth, orthoHalfHeight);
+  const qreal tanY = tan(camera->fieldOfView() / 2.0);
+  const qreal tanX = tanY * camera->aspectRatio();
+
+  // The light depth range also includes the casters of the whole scene
+  const qreal sceneZ = direction * camera->sceneCenter();
+  const qreal sceneRadius = camera->sceneRadius();
+
+  const int nb = cascades_.size();
+  qreal previous = zNear;
+  for (int i = 0; i < nb; ++i) {
+    Cascade &c = cascades_[i];
+    const qreal ratio = qreal(i + 1) / nb;
+    const qreal uniform = zNear + (zFar - zNear) * ratio;
+    const qreal logarithmic = zNear * pow(zFar / zNear, ratio);
+    c.farDistance = splitLambda_ * logarithmic + (1.0 - splitLambda_) * uniform;
+
+    // Slice corners, and their bounding sphere
+    Vec corners[8];
+    Vec center;
+    for (int k = 0; k < 8; ++k) {
+      const qreal distance = (k < 4) ? previous : c.farDistance;
+      const qreal halfWidth = perspective ? distance * tanX : orthoHalfWidth;
+      const qreal halfHeight = perspective ? distance * tanY : orthoHalfHeight;
+      const Vec point((k & 1) ? halfWidth : -halfWidth,
+                      (k & 2) ? halfHeight : -halfHeight, -distance);
+      corners[k] = camera->worldCoordinatesOf(point);
+      center += corners[k] / 8.0;
+    }
+    qreal radius = 0.0;
+    for (int k = 0; k < 8; ++k)
+      radius = qMax(radius, (corners[k] - center).norm());
+    previous = c.farDistance;
+
+    const Vec light(right * center, up * center, direction * center);
+    const qreal zMin = qMin(light.z - radius, sceneZ - sceneRadius);
+    const qreal zMax = qMax(light.z + radius, sceneZ + sceneRadius);
+    if (c.isValid && (fabs(light.x - c.center.x) + radius <= c.halfSize) &&
+        (fabs(light.y - c.center.y) + radius <= c.halfSize) &&
+        (c.halfSize <= radius * (1.0 + 2.0 * cacheMargin_)) &&
+        (zMin >= c.zMin) && (zMax <= c.zMax))
+      continue;
+
+    // New region, snapped on the texels to avoid shimmering edges
+    c.isValid = false;
+    c.halfSize = radius * (1.0 + cacheMargin_);
+    const qreal texel = 2.0 * c.halfSize / resolution_;
+    c.center = Vec(texel * floor(light.x / texel),
+                   texel * floor(light.y / texel), light.z);
+    c.zMin = zMin - cacheMargin_ * radius;
+    c.zMax = zMax + cacheMargin_ * radius;
+
+    // Orthographic projection in the light basis, column major
+    const qreal depth = c.zMax - c.zMin;
+    const Vec rows[3] = {right / c.halfSize, up / c.halfSize,
+                         direction * (2.0 / depth)};
+    const qreal offsets[3] = {-c.center.x / c.halfSize,
+                              -c.center.y / c.halfSize,
+                              -(c.zMax + c.zMin) / depth};
+    for (int row = 0; row < 3; ++row) {
+      for (int column = 0; column < 3; ++column)
+        c.matrix[4 * column + row] = rows[row][column];
+      c.matrix[12 + row] = offsets[row];
+    }
+    c.matrix[3] = c.matrix[7] = c.matrix[11] = 0.0;
+    c.matrix[15] = 1.0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Shadow casters                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers \p frame as moving static casters: its Frame::modified() signal
+invalidate()s the static maps. Use removeStaticCaster() before \p frame is
+deleted. */
+void CascadedShadowMaps::addStaticCaster(const Frame *frame) {
+  if (frame)
+    connect(frame, SIGNAL(modified()), SLOT(invalidate()),
+            Qt::UniqueConnection);
+}
+
+/*! Unregisters \p frame, see addStaticCaster(). */
+void CascadedShadowMaps::removeStaticCaster(const Frame *frame) {
+  if (frame && (frame != lightFrame_))
+    disconnect(frame, SIGNAL(modified()), this, SLOT(invalidate()));
+}
+
+/*! Draws the static maps again at the next update(). Call this method when the
+static casters are modified for another reason than a Frame::modified() of a
+registered caster. */
+void CascadedShadowMaps::invalidate() {
+  for (Cascade &c : cascades_)
+    c.isValid = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Rendering                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+bool CascadedShadowMaps::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("CascadedShadowMaps::update: No current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return isSupported_;
+  if (context_) {
+    qWarning("CascadedShadowMaps::update: OpenGL context changed, shadow maps "
+             "are lost");
+    cascades_.clear();
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  allocatedResolution_ = 0;
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  isSupported_ = (version >= 30);
+  if (!isSupported_)
+    qWarning("CascadedShadowMaps::update: Requires OpenGL 3.0 or OpenGL ES "
+             "3.0");
+  return isSupported_;
+}
+
+GLuint CascadedShadowMaps::createDepthTexture() const {
+  GLint previousTexture = 0;
+  functions_->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  GLuint texture = 0;
+  functions_->glGenTextures(1, &texture);
+  functions_->glBindTexture(GL_TEXTURE_2D, texture);
+  functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24,
+                           resolution_, resolution_, 0, GL_DEPTH_COMPONENT,
+                           GL_UNSIGNED_INT, nullptr);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
+                              GL_COMPARE_REF_TO_TEXTURE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC,
+                              GL_LEQUAL);
+  functions_->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+  return texture;
+}
+
+// A depth only framebuffer. The caller restores the current framebuffer.
+GLuint CascadedShadowMaps::createFramebuffer(GLuint texture) const {
+  GLuint framebuffer = 0;
+  functions_->glGenFramebuffers(1, &framebuffer);
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  functions_->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                     GL_TEXTURE_2D, texture, 0);
+  const GLenum none = GL_NONE;
+  functions_->glDrawBuffers(1, &none);
+  functions_->glReadBuffer(GL_NONE);
+  const GLenum status = functions_->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+    qWarning("CascadedShadowMaps::update: incomplete framebuffer object "
+             "(0x%x)",
+             status);
+  return framebuffer;
+}
+
+// Creates the static maps of nbCascades_ cascades. The dynamic ones are
+// created when first needed.
+void CascadedShadowMaps::allocateCascades() {
+  releaseCascades();
+  cascades_.resize(nbCascades_);
+  for (Cascade &c : cascades_) {
+    c.farDistance = 0.0;
+    c.halfSize = c.zMin = c.zMax = 0.0;
+    c.isValid = false;
+    for (int i = 0; i < 16; ++i)
+      c.matrix[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    c.staticTexture = createDepthTexture();
+    c.staticFramebuffer = createFramebuffer(c.staticTexture);
+    c.texture = c.framebuffer = 0;
+  }
+  allocatedResolution_ = resolution_;
+}
+
+void CascadedShadowMaps::releaseCascades() {
+  if (functions_)
+    for (const Cascade &c : cascades_) {
+      const GLuint textures[2] = {c.staticTexture, c.texture};
+      const GLuint framebuffers[2] = {c.staticFramebuffer, c.framebuffer};
+      functions_->glDeleteTextures(2, textures);
+      functions_->glDeleteFramebuffers(2, framebuffers);
+    }
+  cascades_.clear();
+  allocatedResolution_ = 0;
+}
+
+void CascadedShadowMaps::drawCasters(const Cascade &cascade,
+                                     GLuint framebuffer, bool fixedFunction,
+                                     const std::function<void()> &draw) {
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  if (fixedFunction) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixd(cascade.matrix);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+  }
+  draw();
+}
+
+/*! Fits the cascades to the \p camera frustum, draws the static casters in the
+static maps that are no longer valid, and the dynamic casters over them.
+
+Call this method before the objects that receive the shadows are drawn,
+typically at the beginning of your viewer's draw(). The current framebuffer,
+viewport, matrices and depth state are restored. */
+void CascadedShadowMaps::update(const Camera *camera) {
+  if (!camera || !initializeGL())
+    return;
+  if ((cascades_.size() != nbCascades_) ||
+      (allocatedResolution_ != resolution_))
+    allocateCascades();
+
+  fitCascades(camera);
+
+  const bool fixedFunction = !context_->isOpenGLES() &&
+                             (context_->format().profile() !=
+                              QSurfaceFormat::CoreProfile);
+
+  // Saved state
+  GLint previousFramebuffer = 0;
+  GLint viewport[4];
+  GLboolean colorMask[4];
+  GLboolean depthMask = GL_TRUE;
+  GLint depthFunc = GL_LESS;
+  GLfloat clearDepth = 1.0f;
+  GLfloat offsetFactor = 0.0f, offsetUnits = 0.0f;
+  functions_->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  functions_->glGetIntegerv(GL_VIEWPORT, viewport);
+  functions_->glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+  functions_->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+  functions_->glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+  functions_->glGetFloatv(GL_DEPTH_CLEAR_VALUE, &clearDepth);
+  functions_->glGetFloatv(GL_POLYGON_OFFSET_FACTOR, &offsetFactor);
+  functions_->glGetFloatv(GL_POLYGON_OFFSET_UNITS, &offsetUnits);
+  const GLboolean depthTest = functions_->glIsEnabled(GL_DEPTH_TEST);
+  const GLboolean polygonOffset =
+      functions_->glIsEnabled(GL_POLYGON_OFFSET_FILL);
+
+  // The cascade matrices map depths to [-1,1], also with a reversed Z camera
+  typedef void(QOPENGLF_APIENTRYP ClipControl)(GLenum origin, GLenum depth);
+  ClipControl clipControl = nullptr;
+  const QSurfaceFormat format = context_->format();
+  if (!context_->isOpenGLES() &&
+      ((10 * format.majorVersion() + format.minorVersion() >= 45) ||
+       context_->hasExtension("GL_ARB_clip_control")))
+    clipControl = reinterpret_cast<ClipControl>(
+        context_->getProcAddress("glClipControl"));
+  GLint clipOrigin = GL_LOWER_LEFT, clipDepth = GL_NEGATIVE_ONE_TO_ONE;
+  if (clipControl) {
+    functions_->glGetIntegerv(GL_CLIP_ORIGIN, &clipOrigin);
+    functions_->glGetIntegerv(GL_CLIP_DEPTH_MODE, &clipDepth);
+    clipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+  }
+
+  if (fixedFunction) {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+  }
+
+  functions_->glViewport(0, 0, resolution_, resolution_);
+  functions_->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  functions_->glDepthMask(GL_TRUE);
+  functions_->glDepthFunc(GL_LESS);
+  functions_->glClearDepthf(1.0f);
+  functions_->glEnable(GL_DEPTH_TEST);
+  // Slope scaled bias against shadow acne
+  functions_->glEnable(GL_POLYGON_OFFSET_FILL);
+  functions_->glPolygonOffset(2.0f, 4.0f);
+
+  nbStaticRedraws_ = 0;
+  for (int i = 0; i < cascades_.size(); ++i) {
+    Cascade &c = cascades_[i];
+    currentCascade_ = i;
+    if (!c.isValid) {
+      functions_->glBindFramebuffer(GL_FRAMEBUFFER, c.staticFramebuffer);
+      functions_->glClear(GL_DEPTH_BUFFER_BIT);
+      if (drawStaticCasters_)
+        drawCasters(c, c.staticFramebuffer, fixedFunction,
+                    drawStaticCasters_);
+      c.isValid = true;
+      ++nbStaticRedraws_;
+    }
+
+    if (drawDynamicCasters_) {
+      if (!c.texture) {
+        c.texture = createDepthTexture();
+        c.framebuffer = createFramebuffer(c.texture);
+      }
+      // Copy of the static map, then the dynamic casters
+      functions_->glBindFramebuffer(GL_READ_FRAMEBUFFER, c.staticFramebuffer);
+      functions_->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, c.framebuffer);
+      functions_->glBlitFramebuffer(0, 0, resolution_, resolution_, 0, 0,
+                                    resolution_, resolution_,
+                                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+      drawCasters(c, c.framebuffer, fixedFunction, drawDynamicCasters_);
+    }
+  }
+  currentCascade_ = -1;
+
+  if (fixedFunction) {
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+  }
+  if (clipControl)
+    clipControl(GLenum(clipOrigin), GLenum(clipDepth));
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+  functions_->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  functions_->glColorMask(colorMask[0], colorMask[1], colorMask[2],
+                          colorMask[3]);
+  functions_->glDepthMask(depthMask);
+  functions_->glDepthFunc(GLenum(depthFunc));
+  functions_->glClearDepthf(clearDepth);
+  functions_->glPolygonOffset(offsetFactor, offsetUnits);
+  if (!depthTest)
+    functions_->glDisable(GL_DEPTH_TEST);
+  if (!polygonOffset)
+    functions_->glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+/*! Deletes the shadow maps. The context used by update() must be current.
+They are created again by the next update(). */
+void CascadedShadowMaps::cleanupGL() {
+  releaseCascades();
+  functions_ = nullptr;
+  context_ = nullptr;
+  isSupported_ = false;
+}
@@ -0,0 +1,196 @@
+#ifndef QGLVIEWER_CASCADED_SHADOW_MAPS_H
+#define QGLVIEWER_CASCADED_SHADOW_MAPS_H
+
+#include "vec.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+#include <functional>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+class Camera;
+class Frame;
+
+/*! \brief Shadow maps of a directional light, fitted to the Camera frustum
+  and cached for the static shadow casters.
+  \class CascadedShadowMaps cascadedShadowMaps.h
+  QGLViewer/cascadedShadowMaps.h
+
+  The camera frustum, from Camera::zNear() to Camera::zFar(), is split in
+  nbCascades() slices, each one covered by its own shadow map. The nearest
+  slices are the shortest, so that the shadow resolution follows the screen
+  resolution. Each map fits the bounding sphere of the corners of its slice,
+  seen from the light.
+
+  Most shadow casters usually do not move: they are drawn once in a cached
+  static map per cascade, which is only drawn again when a registered static
+  caster Frame emits Frame::modified(), when the light moves, or when the
+  camera slice leaves the (slightly enlarged, see cacheMargin()) region that
+  the map covers. The dynamic casters are drawn at each update(), over a copy
+  of the static map:
+  \code
+  // In your viewer's init()
+  shadows = new qglviewer::CascadedShadowMaps(this);
+  shadows->setLightDirection(qglviewer::Vec(-1, -1, -2));
+  shadows->setStaticCasters([this]() { drawBuildings(); });
+  shadows->setDynamicCasters([this]() { drawCharacters(); });
+  shadows->addStaticCaster(crane->frame());
+
+  // At the beginning of draw()
+  shadows->update(camera());
+  for (int i = 0; i < shadows->nbCascades(); ++i) {
+    GLdouble m[16];
+    shadows->getShadowMatrix(i, m);
+    // Bind shadows->depthTexture(i), use m and shadows->splitDistance(i)
+    // in your shader
+  }
+  \endcode
+
+  The casters are drawn with the light projection loaded in the \c
+  GL_PROJECTION matrix and an identity \c GL_MODELVIEW matrix, so that they
+  only have to apply their own transformations. With a core profile context,
+  use getCascadeMatrix() of the currentCascade() instead.
+
+  The depthTexture()s are \c GL_DEPTH_COMPONENT24 textures with \c
+  GL_COMPARE_REF_TO_TEXTURE and linear filtering: read them with a \c
+  sampler2DShadow for hardware filtered comparisons.
+
+  Requires OpenGL 3.0 or OpenGL ES 3.0. All the OpenGL methods require the
+  viewer's context to be current: call cleanupGL() before it is destroyed. */
+class QGLVIEWER_EXPORT CascadedShadowMaps : public QObject {
+  Q_OBJECT
+
+public:
+  explicit CascadedShadowMaps(QObject *parent = nullptr);
+  virtual ~CascadedShadowMaps();
+
+  /*! @name Light */
+  //@{
+public:
+  Vec lightDirection() const;
+  void setLightDirection(const Vec &direction);
+  /*! Returns the Frame whose negative Z axis gives the lightDirection(), or
+  \c nullptr (default). */
+  const Frame *lightFrame() const { return lightFrame_; }
+  void setLightFrame(const Frame *frame);
+  //@}
+
+  /*! @name Cascades */
+  //@{
+public:
+  /*! Returns the number of shadow maps. Default value is 3. */
+  int nbCascades() const { return nbCascades_; }
+  void setNbCascades(int nb);
+  /*! Returns the width and height of the shadow maps, in texels. Default
+  value is 2048. */
+  int resolution() const { return resolution_; }
+  void setResolution(int resolution);
+
+  /*! Returns the blend between a logarithmic (1.0) and a uniform (0.0)
+  distribution of the splitDistance()s. Default value is 0.75. */
+  qreal splitLambda() const { return splitLambda_; }
+  void setSplitLambda(qreal lambda);
+  /*! Returns the distance to the camera beyond which there is no shadow, or
+  0.0 (default) to use Camera::zFar(). */
+  qreal maximumDistance() const { return maximumDistance_; }
+  void setMaximumDistance(qreal distance);
+  /*! Returns the fraction by which the static maps are enlarged around their
+  slice, so that small camera motions do not draw them again. Default value
+  is 0.25. */
+  qreal cacheMargin() const { return cacheMargin_; }
+  void setCacheMargin(qreal margin);
+
+  qreal splitDistance(int cascade) const;
+  void getCascadeMatrix(int cascade, GLdouble m[16]) const;
+  void getShadowMatrix(int cascade, GLdouble m[16]) const;
+  GLuint depthTexture(int cascade) const;
+  //@}
+
+  /*! @name Shadow casters */
+  //@{
+public:
+  /*! Sets the function that draws the static casters in the current
+  cascade. */
+  void setStaticCasters(const std::function<void()> &draw) {
+    drawStaticCasters_ = draw;
+    invalidate();
+  }
+  /*! Sets the function that draws the dynamic casters in the current
+  cascade, at each update(). */
+  void setDynamicCasters(const std::function<void()> &draw) {
+    drawDynamicCasters_ = draw;
+  }
+  void addStaticCaster(const Frame *frame);
+  void removeStaticCaster(const Frame *frame);
+  /*! Returns the cascade whose map is being drawn by the casters functions, or
+  -1 outside of update(). */
+  int currentCascade() const { return currentCascade_; }
+
+public Q_SLOTS:
+  void invalidate();
+  //@}
+
+  /*! @name Rendering */
+  //@{
+public:
+  void update(const Camera *camera);
+  void cleanupGL();
+  /*! Returns the number of static maps drawn by the last update(), 0 when
+  they were all up to date. */
+  int nbStaticRedraws() const { return nbStaticRedraws_; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(CascadedShadowMaps)
+
+  struct Cascade {
+    qreal farDistance; // split, along the camera view direction
+    // Region of the static map, in light coordinates
+    Vec center;
+    qreal halfSize;
+    qreal zMin, zMax;
+    bool isValid; // static map is up to date
+    GLdouble matrix[16];
+    GLuint staticTexture, staticFramebuffer;
+    GLuint texture, framebuffer; // static map and dynamic casters
+  };
+
+  bool initializeGL();
+  void allocateCascades();
+  void releaseCascades();
+  GLuint createDepthTexture() const;
+  GLuint createFramebuffer(GLuint texture) const;
+  void lightBasis(Vec &right, Vec &up, Vec &direction) const;
+  void fitCascades(const Camera *camera);
+  void drawCasters(const Cascade &cascade, GLuint framebuffer,
+                   bool fixedFunction, const std::function<void()> &draw);
+
+  Vec lightDirection_;
+  QPointer<const Frame> lightFrame_;
+  std::function<void()> drawStaticCasters_;
+  std::function<void()> drawDynamicCasters_;
+
+  QVector<Cascade> cascades_; // allocated by update()
+  int nbCascades_;
+  int resolution_;
+  qreal splitLambda_;
+  qreal maximumDistance_;
+  qreal cacheMargin_;
+  int currentCascade_;
+  int nbStaticRedraws_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  bool isSupported_;
+  int allocatedResolution_; // of the cascades_ textures
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CASCADED_SHADOW_MAPS_H
@@ -0,0 +1,224 @@
+#include "clippingRegion.h"
+#include "frame.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector4D>
+
+using namespace qglviewer;
+
+/*! Creates a ClippingRegion without planes, which clips nothing. */
+ClippingRegion::ClippingRegion() { clear(); }
+
+bool ClippingRegion::isValidIndex(int index, const char *method) const {
+  if ((index < 0) || (index >= maximumNumberOfPlanes())) {
+    qWarning("ClippingRegion::%s: Invalid plane index %d", method, index);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Planes                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the plane \p index, in [0, maximumNumberOfPlanes()[, to the plane that
+contains \p point, in world coordinates. The half-space \p normal points to is
+kept. A previous plane at this \p index is replaced. */
+void ClippingRegion::setPlane(int index, const Vec &point, const Vec &normal) {
+  if (!isValidIndex(index, "setPlane"))
+    return;
+  if (normal.squaredNorm() < 1E-10) {
+    qWarning("ClippingRegion::setPlane: Null plane normal");
+    return;
+  }
+  Plane &plane = planes_[index];
+  plane.used = true;
+  plane.point = point;
+  plane.normal = normal.unit();
+  plane.frame = nullptr;
+}
+
+/*! Sets the plane \p index to the XY plane of \p frame, which keeps the
+positive Z half-space of the \p frame. The plane follows the \p frame when it
+is moved. \p frame is not owned by the ClippingRegion: remove the plane before
+it is deleted. */
+void ClippingRegion::setPlane(int index, const Frame *frame) {
+  if (!isValidIndex(index, "setPlane"))
+    return;
+  if (!frame) {
+    removePlane(index);
+    return;
+  }
+  Plane &plane = planes_[index];
+  plane.used = true;
+  plane.frame = frame;
+}
+
+/*! Removes the plane \p index, which no longer clips. */
+void ClippingRegion::removePlane(int index) {
+  if (!isValidIndex(index, "removePlane"))
+    return;
+  planes_[index].used = false;
+  planes_[index].frame = nullptr;
+}
+
+/*! Removes all the planes. */
+void ClippingRegion::clear() {
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i) {
+    planes_[i].used = false;
+    planes_[i].frame = nullptr;
+  }
+}
+
+/*! Returns \c true when the plane \p index was set by setPlane(). */
+bool ClippingRegion::hasPlane(int index) const {
+  return (index >= 0) && (index < maximumNumberOfPlanes()) &&
+         planes_[index].used;
+}
+
+/*! Returns the number of planes set by setPlane(). */
+int ClippingRegion::nbPlanes() const {
+  int nb = 0;
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i)
+    if (planes_[i].used)
+      ++nb;
+  return nb;
+}
+
+/*! Fills \p equation with the world coordinates equation of the plane \p
+index, in the \c glClipPlane() convention: the points such that \c a*x + b*y +
+c*z + d >= 0 are kept. The plane must exist (see hasPlane()). */
+void ClippingRegion::getPlaneEquation(int index, GLdouble equation[4]) const {
+  if (!isValidIndex(index, "getPlaneEquation"))
+    return;
+  const Plane &plane = planes_[index];
+  Vec point = plane.point, normal = plane.normal;
+  if (plane.frame) {
+    point = plane.frame->position();
+    normal = plane.frame->inverseTransformOf(Vec(0.0, 0.0, 1.0)).unit();
+  }
+  equation[0] = GLdouble(normal.x);
+  equation[1] = GLdouble(normal.y);
+  equation[2] = GLdouble(normal.z);
+  equation[3] = GLdouble(-(normal * point));
+}
+
+/*! Fills the first nbPlanes() vectors of \p coef, which must have
+maximumNumberOfPlanes() vectors, with the equations of the planes, and returns
+their number.
+
+The equations use the Camera::getFrustumPlanesCoefficients() convention
+expected by FrustumCuller::computeVisibleObjects(): normals point outwards, and
+the points such that \c a*x + b*y + c*z > d are clipped. */
+int ClippingRegion::getPlanesCoefficients(GLdouble coef[][4]) const {
+  int nb = 0;
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i) {
+    if (!planes_[i].used)
+      continue;
+    GLdouble equation[4];
+    getPlaneEquation(i, equation);
+    coef[nb][0] = -equation[0];
+    coef[nb][1] = -equation[1];
+    coef[nb][2] = -equation[2];
+    coef[nb][3] = equation[3];
+    ++nb;
+  }
+  return nb;
+}
+
+/*! Returns \c true when the sphere of \p center and \p radius, in world
+coordinates, is entirely clipped by one of the planes. */
+bool ClippingRegion::isClipped(const Vec &center, qreal radius) const {
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i) {
+    if (!planes_[i].used)
+      continue;
+    GLdouble equation[4];
+    getPlaneEquation(i, equation);
+    if (equation[0] * center.x + equation[1] * center.y +
+            equation[2] * center.z + equation[3] < -radius)
+      return true;
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   OpenGL                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Enables the clip distances of the planes, and disables the other ones.
+Called by QGLViewer::preDraw() when the ClippingRegion is the
+QGLViewer::clippingRegion().
+
+In a compatibility profile context, the plane equations are set with \c
+glClipPlane(), which transforms them by the current modelview matrix: it must
+be the Camera one, loaded by Camera::loadModelViewMatrix(). In a core profile
+context, the planes are given to the vertex shaders by setUniforms(). */
+void ClippingRegion::enable() const {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context)
+    return;
+  const bool fixedFunction =
+      context->format().profile() != QSurfaceFormat::CoreProfile;
+  QOpenGLFunctions *functions = context->functions();
+  // GL_CLIP_DISTANCEi and GL_CLIP_PLANEi are the same capabilities
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i)
+    if (planes_[i].used) {
+      if (fixedFunction) {
+        GLdouble equation[4];
+        getPlaneEquation(i, equation);
+        glClipPlane(GL_CLIP_PLANE0 + i, equation);
+      }
+      functions->glEnable(GL_CLIP_PLANE0 + i);
+    } else
+      functions->glDisable(GL_CLIP_PLANE0 + i);
+}
+
+/*! Disables all the clip distances. Called by QGLViewer::postDraw(), so that
+the visual hints are not clipped. */
+void ClippingRegion::disable() const {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context)
+    return;
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i)
+    context->functions()->glDisable(GL_CLIP_PLANE0 + i);
+}
+
+/*! Sets the \c vec4 array uniform \p name of \p program, which must be bound,
+to the plane equations used by vertexShaderCode(). The missing planes have an
+equation that clips nothing. Call it whenever a plane is modified. */
+void ClippingRegion::setUniforms(QOpenGLShaderProgram *program,
+                                 const char *name) const {
+  QVector4D equations[8];
+  for (int i = 0; i < maximumNumberOfPlanes(); ++i) {
+    if (!planes_[i].used) {
+      equations[i] = QVector4D(0.0f, 0.0f, 0.0f, 1.0f);
+      continue;
+    }
+    GLdouble equation[4];
+    getPlaneEquation(i, equation);
+    equations[i] = QVector4D(float(equation[0]), float(equation[1]),
+                             float(equation[2]), float(equation[3]));
+  }
+  program->setUniformValueArray(name, equations, maximumNumberOfPlanes());
+}
+
+/*! Returns the GLSL declarations that compute the clip distances in a core
+profile vertex shader: the \c qglClipPlanes uniform, set by setUniforms(), and
+the \c qglClip(vec4 worldPosition) function, which sets \c gl_ClipDistance.
+Requires GLSL 1.30 or later. */
+const char *ClippingRegion::vertexShaderCode() {
+  // gl_ClipDistance is sized by its constant indices
+  return "uniform vec4 qglClipPlanes[8];\n"
+         "void qglClip(vec4 worldPosition) {\n"
+         "  gl_ClipDistance[0] = dot(qglClipPlanes[0], worldPosition);\n"
+         "  gl_ClipDistance[1] = dot(qglClipPlanes[1], worldPosition);\n"
+         "  gl_ClipDistance[2] = dot(qglClipPlanes[2], worldPosition);\n"
+         "  gl_ClipDistance[3] = dot(qglClipPlanes[3], worldPosition);\n"
+         "  gl_ClipDistance[4] = dot(qglClipPlanes[4], worldPosition);\n"
+         "  gl_ClipDistance[5] = dot(qglClipPlanes[5], worldPosition);\n"
+         "  gl_ClipDistance[6] = dot(qglClipPlanes[6], worldPosition);\n"
+         "  gl_ClipDistance[7] = dot(qglClipPlanes[7], worldPosition);\n"
+         "}\n";
+}
@@ -0,0 +1,101 @@
+#ifndef QGLVIEWER_CLIPPING_REGION_H
+#define QGLVIEWER_CLIPPING_REGION_H
+
+#include "vec.h"
+
+class QOpenGLShaderProgram;
+
+namespace qglviewer {
+class Frame;
+
+/*! \brief A set of user clipping planes, applied by the OpenGL clip
+  distances and by the FrustumCuller.
+  \class ClippingRegion clippingRegion.h QGLViewer/clippingRegion.h
+
+  A ClippingRegion is the intersection of up to maximumNumberOfPlanes()
+  half-spaces, each defined by a plane in world coordinates, or by the XY plane
+  of a Frame that can be moved with the mouse. Each plane keeps the half-space
+  its normal points to. Give it to QGLViewer::setClippingRegion(): preDraw()
+  then enables the clipping planes for draw(), and postDraw() disables them:
+  \code
+  void Viewer::init() {
+    setManipulatedFrame(new ManipulatedFrame());
+    region_.setPlane(0, manipulatedFrame());
+    setClippingRegion(&region_);
+  }
+
+  void Viewer::draw() {
+    culler_.computeVisibleObjects(camera(), region_, visible_);
+    for (int i = 0; i < visible_.size(); ++i)
+      object[visible_[i]].draw();
+  }
+  \endcode
+
+  The FrustumCuller::computeVisibleObjects() overload that takes a
+  ClippingRegion rejects the objects that are entirely clipped, so that they
+  are not even submitted. isClipped() tests a single bounding sphere.
+
+  In a compatibility profile context, enable() sets the plane equations with \c
+  glClipPlane(), and the fixed function pipeline clips the primitives. In a
+  core profile context, the vertex shaders compute the clip distances: add
+  vertexShaderCode() to their source, call \c qglClip() with the world position
+  of the vertex, and set the plane uniforms with setUniforms():
+  \code
+  program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+      QByteArray("#version 330 core\n") +
+      qglviewer::ClippingRegion::vertexShaderCode() + vertexShaderSource);
+  // In the vertex shader main(): qglClip(worldPosition);
+
+  program.bind();
+  region_.setUniforms(&program);
+  \endcode */
+class QGLVIEWER_EXPORT ClippingRegion {
+public:
+  ClippingRegion();
+
+  /*! @name Planes */
+  //@{
+public:
+  /*! Returns the maximum number of planes, 8, which is the minimum number of
+  clip distances of all the OpenGL implementations. */
+  static int maximumNumberOfPlanes() { return 8; }
+
+  void setPlane(int index, const Vec &point, const Vec &normal);
+  void setPlane(int index, const Frame *frame);
+  void removePlane(int index);
+  void clear();
+
+  bool hasPlane(int index) const;
+  int nbPlanes() const;
+
+  void getPlaneEquation(int index, GLdouble equation[4]) const;
+  int getPlanesCoefficients(GLdouble coef[][4]) const;
+  bool isClipped(const Vec &center, qreal radius) const;
+  //@}
+
+  /*! @name OpenGL */
+  //@{
+public:
+  void enable() const;
+  void disable() const;
+
+  void setUniforms(QOpenGLShaderProgram *program,
+                   const char *name = "qglClipPlanes") const;
+  static const char *vertexShaderCode();
+  //@}
+
+private:
+  struct Plane {
+    bool used;
+    Vec point, normal; // normal is normalized, unused with a frame
+    const Frame *frame; // not owned, nullptr for a fixed plane
+  };
+
+  bool isValidIndex(int index, const char *method) const;
+
+  Plane planes_[8];
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CLIPPING_REGION_H
@@ -0,0 +1,475 @@
+#include "collisionConstraint.h"
+#include "frame.h"
+#include "taskScheduler.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace qglviewer;
+
+// Cells along each axis of a brick, which stores one more sample per axis so
+// that the interpolation of a cell only reads one brick
+static const int brickCells = 8;
+static const int brickSamples = brickCells + 1;
+static const int samplesPerBrick = brickSamples * brickSamples * brickSamples;
+// Bricks coordinates are packed on 21 bits each in the hash keys
+static const int brickOffset = 1 << 20;
+// Triangles processed between two tests of an abort request
+static const int abortCheckPeriod = 4096;
+// Substeps of a translation, each at most half the collision radius long: a
+// longer translation is shortened
+static const int maximumNbSteps = 64;
+// Projections on the surface of the collision sphere per substep
+static const int maximumNbProjections = 4;
+
+static quint64 brickKey(int i, int j, int k) {
+  return (quint64(i + brickOffset) << 42) | (quint64(j + brickOffset) << 21) |
+         quint64(k + brickOffset);
+}
+
+// Distance from p to the triangle (a, b, c), from its closest point found in
+// the Voronoi regions of the vertices, edges and face
+static qreal pointTriangleDistance(const Vec &p, const Vec &a, const Vec &b,
+                                   const Vec &c) {
+  const Vec ab = b - a;
+  const Vec ac = c - a;
+  const Vec ap = p - a;
+  const qreal d1 = ab * ap;
+  const qreal d2 = ac * ap;
+  if ((d1 <= 0.0) && (d2 <= 0.0))
+    return ap.norm();
+
+  const Vec bp = p - b;
+  const qreal d3 = ab * bp;
+  const qreal d4 = ac * bp;
+  if ((d3 >= 0.0) && (d4 <= d3))
+    return bp.norm();
+
+  const qreal vc = d1 * d4 - d3 * d2;
+  if ((vc <= 0.0) && (d1 >= 0.0) && (d3 <= 0.0))
+    return (p - (a + d1 / (d1 - d3) * ab)).norm();
+
+  const Vec cp = p - c;
+  const qreal d5 = ab * cp;
+  const qreal d6 = ac * cp;
+  if ((d6 >= 0.0) && (d5 <= d6))
+    return cp.norm();
+
+  const qreal vb = d5 * d2 - d1 * d6;
+  if ((vb <= 0.0) && (d2 >= 0.0) && (d6 <= 0.0))
+    return (p - (a + d2 / (d2 - d6) * ac)).norm();
+
+  const qreal va = d3 * d6 - d5 * d4;
+  if ((va <= 0.0) && ((d4 - d3) >= 0.0) && ((d5 - d6) >= 0.0))
+    return (p - (b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b))).norm();
+
+  const qreal denominator = 1.0 / (va + vb + vc);
+  return (p - (a + vb * denominator * ab + vc * denominator * ac)).norm();
+}
+
+static Vec triangleVertex(const float *triangle, int vertex) {
+  return Vec(triangle[3 * vertex], triangle[3 * vertex + 1],
+             triangle[3 * vertex + 2]);
+}
+
+CollisionConstraint::CollisionConstraint()
+    : cellSize_(0.0), radius_(0.0), bakedRadius_(0.0),
+      threadPool_(nullptr), revision_(0), volume_(nullptr), baking_(false) {}
+
+/*! Aborts the running bake(). */
+CollisionConstraint::~CollisionConstraint() {
+  revision_.ref();
+  if (threadPool_)
+    threadPool_->waitForDone();
+  delete threadPool_;
+  delete volume_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                         S c e n e   t r i a n g l e s                      //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds the triangle (\p a, \p b, \p c), in world coordinates. It is taken
+into account by the next bake(). */
+void CollisionConstraint::addTriangle(const Vec &a, const Vec &b,
+                                      const Vec &c) {
+  const Vec vertices[3] = {a, b, c};
+  for (int v = 0; v < 3; ++v)
+    for (int i = 0; i < 3; ++i)
+      triangles_.append(float(vertices[v][i]));
+}
+
+/*! Adds the \p nbIndices / 3 triangles of an indexed mesh, whose \p vertices
+are \p nbVertices xyz triplets, as in a MeshCache. Out of range indices are
+ignored, with a warning. */
+void CollisionConstraint::addTriangles(const float *vertices, int nbVertices,
+                                       const unsigned int *indices,
+                                       int nbIndices) {
+  triangles_.reserve(triangles_.size() + 3 * (nbIndices - nbIndices % 3));
+  bool warned = false;
+  for (int t = 0; t + 2 < nbIndices; t += 3) {
+    if ((indices[t] >= uint(nbVertices)) ||
+        (indices[t + 1] >= uint(nbVertices)) ||
+        (indices[t + 2] >= uint(nbVertices))) {
+      if (!warned)
+        qWarning("CollisionConstraint::addTriangles: index out of range");
+      warned = true;
+      continue;
+    }
+    for (int v = 0; v < 3; ++v)
+      for (int i = 0; i < 3; ++i)
+        triangles_.append(vertices[3 * indices[t + v] + i]);
+  }
+}
+
+/*! Removes all the triangles. The baked volume is kept until the next bake().
+ */
+void CollisionConstraint::clear() { triangles_.clear(); }
+
+////////////////////////////////////////////////////////////////////////////////
+//                        D i s t a n c e   v o l u m e                       //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Samples the distance to the triangles on a background thread. A bake()
+started before is aborted. The constraint uses the previous volume (if any)
+until this one is completed.
+
+The distance is only stored up to slightly more than the collisionRadius()
+from the triangles. Increasing the collisionRadius() above this value hence
+starts a new bake(). */
+void CollisionConstraint::bake() {
+  revision_.ref();
+  const int revision = revision_.loadRelaxed();
+
+  if (triangles_.isEmpty()) {
+    QMutexLocker locker(&mutex_);
+    delete volume_;
+    volume_ = nullptr;
+    baking_ = false;
+    return;
+  }
+
+  Vec min(triangleVertex(triangles_.constData(), 0));
+  Vec max = min;
+  for (int i = 0; i < triangles_.size(); i += 3)
+    for (int j = 0; j < 3; ++j) {
+      min[j] = std::min(qreal(min[j]), qreal(triangles_[i + j]));
+      max[j] = std::max(qreal(max[j]), qreal(triangles_[i + j]));
+    }
+
+  qreal cellSize = cellSize_;
+  if (cellSize <= 0.0)
+    cellSize = (max - min).norm() / 256.0;
+  if (cellSize <= 0.0)
+    cellSize = 1.0;
+
+  bakedRadius_ = radius_;
+  const qreal band = effectiveRadius(cellSize) + 2.0 * cellSize;
+
+  if (!threadPool_) {
+    threadPool_ = new QThreadPool();
+    threadPool_->setMaxThreadCount(1);
+  }
+
+  {
+    QMutexLocker locker(&mutex_);
+    baking_ = true;
+  }
+
+  const QVector<float> triangles = triangles_;
+  threadPool_->start(
+      QRunnable::create([this, triangles, cellSize, band, revision]() {
+        Volume *volume =
+            buildVolume(triangles, cellSize, band, revision_, revision);
+        QMutexLocker locker(&mutex_);
+        if (revision_.loadRelaxed() == revision) {
+          std::swap(volume_, volume);
+          baking_ = false;
+        }
+        delete volume;
+      }));
+}
+
+/*! Returns \c true while a bake() is running. */
+bool CollisionConstraint::isBaking() const {
+  QMutexLocker locker(&mutex_);
+  return baking_;
+}
+
+/*! Blocks until the running bake() is completed. */
+void CollisionConstraint::waitForBake() {
+  if (threadPool_)
+    threadPool_->waitForDone();
+}
+
+/*! Sets the cellSize(). A negative or null value restores the automatic size.
+ */
+void CollisionConstraint::setCellSize(qreal size) {
+  cellSize_ = std::max(size, qreal(0.0));
+}
+
+/*! Returns the number of bricks of the baked volume, 0 before the first
+bake() is completed. */
+int CollisionConstraint::nbBricks() const {
+  QMutexLocker locker(&mutex_);
+  return volume_ ? volume_->bricks.size() : 0;
+}
+
+// Allocates the bricks that are closer to a triangle than band, each with the
+// list of these triangles, and samples them in parallel. Returns nullptr when
+// revision no longer is expected.
+CollisionConstraint::Volume *
+CollisionConstraint::buildVolume(const QVector<float> &triangles,
+                                 qreal cellSize, qreal band,
+                                 const QAtomicInt &revision, int expected) {
+  Volume *volume = new Volume();
+  volume->cellSize = cellSize;
+  volume->band = band;
+
+  Vec min(triangleVertex(triangles.constData(), 0));
+  for (int i = 0; i < triangles.size(); i += 3)
+    for (int j = 0; j < 3; ++j)
+      min[j] = std::min(qreal(min[j]), qreal(triangles[i + j]));
+  volume->origin = min - Vec(band, band, band);
+
+  const qreal brickSize = brickCells * cellSize;
+  QVector<int> brickCoordinates; // 3 per brick
+  QVector<QVector<int>> brickTriangles;
+
+  const int nbTriangles = triangles.size() / 9;
+  for (int t = 0; t < nbTriangles; ++t) {
+    if ((t % abortCheckPeriod == 0) && (revision.loadRelaxed() != expected)) {
+      delete volume;
+      return nullptr;
+    }
+
+    const float *triangle = triangles.constData() + 9 * t;
+    int first[3], last[3];
+    for (int j = 0; j < 3; ++j) {
+      const qreal low =
+          std::min(triangle[j], std::min(triangle[3 + j], triangle[6 + j]));
+      const qreal high =
+          std::max(triangle[j], std::max(triangle[3 + j], triangle[6 + j]));
+      first[j] = int(std::floor((low - band - volume->origin[j]) / brickSize));
+      last[j] = int(std::floor((high + band - volume->origin[j]) / brickSize));
+    }
+
+    for (int k = first[2]; k <= last[2]; ++k)
+      for (int j = first[1]; j <= last[1]; ++j)
+        for (int i = first[0]; i <= last[0]; ++i) {
+          const quint64 key = brickKey(i, j, k);
+          QHash<quint64, int>::const_iterator it =
+              volume->bricks.constFind(key);
+          int brick;
+          if (it == volume->bricks.constEnd()) {
+            brick = brickTriangles.size();
+            volume->bricks.insert(key, brick * samplesPerBrick);
+            brickCoordinates << i << j << k;
+            brickTriangles.append(QVector<int>());
+          } else
+            brick = it.value() / samplesPerBrick;
+          brickTriangles[brick].append(t);
+        }
+  }
+
+  volume->samples.resize(brickTriangles.size() * samplesPerBrick);
+  float *samples = volume->samples.data();
+
+  TaskScheduler::parallelFor(brickTriangles.size(), [&](int first, int last) {
+    for (int b = first; b < last; ++b) {
+      if (revision.loadRelaxed() != expected)
+        return;
+
+      const QVector<int> &list = brickTriangles[b];
+      const Vec corner =
+          volume->origin + brickSize * Vec(brickCoordinates[3 * b],
+                                           brickCoordinates[3 * b + 1],
+                                           brickCoordinates[3 * b + 2]);
+      float *brick = samples + b * samplesPerBrick;
+
+      for (int k = 0; k < brickSamples; ++k)
+        for (int j = 0; j < brickSamples; ++j)
+          for (int i = 0; i < brickSamples; ++i) {
+            const Vec p = corner + cellSize * Vec(i, j, k);
+            qreal d = band;
+            for (int t = 0; t < list.size(); ++t) {
+              const float *triangle = triangles.constData() + 9 * list[t];
+              d = std::min(d, pointTriangleDistance(
+                                  p, triangleVertex(triangle, 0),
+                                  triangleVertex(triangle, 1),
+                                  triangleVertex(triangle, 2)));
+            }
+            brick[(k * brickSamples + j) * brickSamples + i] = float(d);
+          }
+    }
+  });
+
+  if (revision.loadRelaxed() != expected) {
+    delete volume;
+    return nullptr;
+  }
+  return volume;
+}
+
+// Trilinear interpolation of the samples of the cell of position, band
+// outside of the bricks
+qreal CollisionConstraint::sample(const Volume &volume, const Vec &position) {
+  const Vec cell = (position - volume.origin) / volume.cellSize;
+  int brick[3], index[3];
+  qreal t[3];
+  for (int j = 0; j < 3; ++j) {
+    if (std::fabs(cell[j]) >= brickCells * (brickOffset - 1))
+      return volume.band;
+    brick[j] = int(std::floor(cell[j] / brickCells));
+    const qreal local = cell[j] - brick[j] * brickCells;
+    index[j] = std::min(int(local), brickCells - 1);
+    t[j] = local - index[j];
+  }
+
+  QHash<quint64, int>::const_iterator it =
+      volume.bricks.constFind(brickKey(brick[0], brick[1], brick[2]));
+  if (it == volume.bricks.constEnd())
+    return volume.band;
+
+  const float *s = volume.samples.constData() + it.value() +
+                   (index[2] * brickSamples + index[1]) * brickSamples +
+                   index[0];
+  const int dy = brickSamples;
+  const int dz = brickSamples * brickSamples;
+
+  const qreal x00 = s[0] + t[0] * (s[1] - s[0]);
+  const qreal x10 = s[dy] + t[0] * (s[dy + 1] - s[dy]);
+  const qreal x01 = s[dz] + t[0] * (s[dz + 1] - s[dz]);
+  const qreal x11 = s[dz + dy] + t[0] * (s[dz + dy + 1] - s[dz + dy]);
+  const qreal y0 = x00 + t[1] * (x10 - x00);
+  const qreal y1 = x01 + t[1] * (x11 - x01);
+  return y0 + t[2] * (y1 - y0);
+}
+
+// Central differences, half a cell apart
+Vec CollisionConstraint::sampleGradient(const Volume &volume,
+                                        const Vec &position) {
+  const qreal h = 0.5 * volume.cellSize;
+  Vec gradient;
+  for (int j = 0; j < 3; ++j) {
+    Vec offset;
+    offset[j] = h;
+    gradient[j] = (sample(volume, position + offset) -
+                   sample(volume, position - offset)) /
+                  (2.0 * h);
+  }
+  return gradient;
+}
+
+/*! Returns the distance from \p position (in world coordinates) to the closest
+triangle. The value is only accurate up to the size of a cell, and is clamped
+slightly above the collisionRadius().
+
+Returns the largest \c qreal value before the first bake() is completed. */
+qreal CollisionConstraint::distance(const Vec &position) const {
+  QMutexLocker locker(&mutex_);
+  if (!volume_)
+    return std::numeric_limits<qreal>::max();
+  return sample(*volume_, position);
+}
+
+/*! Returns the gradient of distance() at \p position, which points away from
+the closest triangle with a norm close to 1, and is null far from the
+triangles. */
+Vec CollisionConstraint::gradient(const Vec &position) const {
+  QMutexLocker locker(&mutex_);
+  if (!volume_)
+    return Vec();
+  return sampleGradient(*volume_, position);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              C o l l i s i o n                             //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the collisionRadius(). Starts a new bake() when \p radius is larger
+than the one of the last bake(), since the volume does not store the distances
+this far from the triangles. */
+void CollisionConstraint::setCollisionRadius(qreal radius) {
+  radius_ = std::max(radius, qreal(0.0));
+  if ((radius_ > bakedRadius_) && !triangles_.isEmpty() &&
+      (isBaking() || (nbBricks() > 0)))
+    bake();
+}
+
+qreal CollisionConstraint::effectiveRadius(qreal cellSize) const {
+  return std::max(radius_, cellSize);
+}
+
+/*! Reduces \p translation so that the sphere of collisionRadius() centered on
+the \p frame position does not enter the triangles. The part of the
+translation that is tangent to a hit surface is kept: the Frame slides along
+the walls. A Frame that already intersects a triangle can only move away from
+it.
+
+The translation is checked in substeps of at most half the collisionRadius()
+(or of the cell size of the distance field, when larger), so as not to cross
+thin walls. A translation longer than 32 of these radii is hence shortened to
+that length. */
+void CollisionConstraint::constrainTranslation(Vec &translation,
+                                               Frame *const frame) {
+  QMutexLocker locker(&mutex_);
+  if (!volume_)
+    return;
+
+  Vec world = translation;
+  if (frame->referenceFrame())
+    world = frame->referenceFrame()->inverseTransformOf(translation);
+
+  const Vec from = frame->position();
+  world = slide(from, from + world) - from;
+
+  if (frame->referenceFrame())
+    translation = frame->referenceFrame()->transformOf(world);
+  else
+    translation = world;
+}
+
+// Moves from from towards to in substeps, at most maximumNbSteps half radius
+// long ones. A substep that enters the collision sphere is projected back on
+// its surface along the gradient, and cancelled (with the following ones) when
+// this fails, in a corner.
+Vec CollisionConstraint::slide(const Vec &from, const Vec &to) const {
+  const Volume &volume = *volume_;
+  const qreal radius = effectiveRadius(volume.cellSize);
+  Vec motion = to - from;
+  const qreal maximumLength = 0.5 * radius * maximumNbSteps;
+  const qreal length = motion.norm();
+  if (length > maximumLength)
+    motion *= maximumLength / length;
+  const int nbSteps = qBound(
+      1, int(std::ceil(2.0 * motion.norm() / radius)), maximumNbSteps);
+
+  Vec position = from;
+  qreal d = sample(volume, position);
+  for (int s = 0; s < nbSteps; ++s) {
+    Vec next = position + motion / nbSteps;
+    qreal dNext = sample(volume, next);
+
+    for (int p = 0;
+         (p < maximumNbProjections) && (dNext < radius) && (dNext < d); ++p) {
+      const Vec gradient = sampleGradient(volume, next);
+      const qreal norm = gradient.norm();
+      if (norm < 1e-8)
+        break;
+      next += (radius - dNext) / norm * gradient;
+      dNext = sample(volume, next);
+    }
+
+    if ((dNext < radius) && (dNext < d))
+      break;
+    position = next;
+    d = dNext;
+  }
+  return position;
+}
@@ -0,0 +1,133 @@
+#ifndef QGLVIEWER_COLLISION_CONSTRAINT_H
+#define QGLVIEWER_COLLISION_CONSTRAINT_H
+
+#include "constraint.h"
+#include "vec.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+class QThreadPool;
+
+namespace qglviewer {
+
+/*! \brief A Constraint that prevents a Frame from going through the triangles
+  of a scene.
+  \class CollisionConstraint collisionConstraint.h
+  QGLViewer/collisionConstraint.h
+
+  The Frame is a sphere of collisionRadius(), that slides along the triangles
+  it hits. This is typically used to keep the camera out of the walls when it
+  flies or walks (QGLViewer::MOVE_FORWARD, QGLViewer::MOVE_BACKWARD and
+  QGLViewer::DRIVE mouse actions):
+  \code
+  // In your viewer's init()
+  collision_ = new qglviewer::CollisionConstraint();
+  for (int i = 0; i < nbTriangles; ++i)
+    collision_->addTriangle(a[i], b[i], c[i]);
+  collision_->setCollisionRadius(0.2);
+  collision_->bake();
+  camera()->frame()->setConstraint(collision_);
+  \endcode
+
+  Ray casting the triangles at each mouse event is too slow for large scenes.
+  bake() instead samples the distance to the triangles on a grid of cellSize(),
+  in a background thread. Only the bricks of 8x8x8 cells near a triangle are
+  stored, in a hash table: distance() is then a constant time lookup and
+  trilinear interpolation, whatever the number of triangles.
+
+  The distance is unsigned: the triangles do not need to form closed objects,
+  and the Frame is stopped on both sides of a wall. The triangle coordinates
+  are expressed in the world coordinate system.
+
+  The constraint is not applied until the first bake() is completed (see
+  isBaking()). Later bakes keep the previous volume until the new one is
+  ready. */
+class QGLVIEWER_EXPORT CollisionConstraint : public Constraint {
+public:
+  CollisionConstraint();
+  virtual ~CollisionConstraint();
+
+  /*! @name Scene triangles */
+  //@{
+public:
+  void addTriangle(const Vec &a, const Vec &b, const Vec &c);
+  void addTriangles(const float *vertices, int nbVertices,
+                    const unsigned int *indices, int nbIndices);
+  void clear();
+
+  /*! Returns the number of triangles added since the last clear(). */
+  int nbTriangles() const { return triangles_.size() / 9; }
+  //@}
+
+  /*! @name Distance volume */
+  //@{
+public:
+  void bake();
+  bool isBaking() const;
+  void waitForBake();
+
+  /*! Returns the size of the cells of the distance volume. Default value is 0,
+  meaning one 256th of the diagonal of the bounding box of the triangles. The
+  new value is used by the next bake(). */
+  qreal cellSize() const { return cellSize_; }
+  void setCellSize(qreal size);
+
+  qreal distance(const Vec &position) const;
+  Vec gradient(const Vec &position) const;
+
+  /*! Returns the number of bricks of the baked volume. Each one uses 2916
+  bytes. */
+  int nbBricks() const;
+  //@}
+
+  /*! @name Collision */
+  //@{
+public:
+  /*! Returns the radius of the sphere that represents the Frame. Default
+  value is 0. The sphere is at least one cellSize() wide, so that the Frame
+  center can not cross a triangle between two samples of the volume. */
+  qreal collisionRadius() const { return radius_; }
+  void setCollisionRadius(qreal radius);
+
+  virtual void constrainTranslation(Vec &translation, Frame *const frame);
+  //@}
+
+private:
+  Q_DISABLE_COPY(CollisionConstraint)
+
+  // Distances sampled at the corners of the cells of the bricks
+  struct Volume {
+    Vec origin;
+    qreal cellSize;
+    qreal band; // distance returned far from the triangles
+    QHash<quint64, int> bricks; // brick coordinates to first sample
+    QVector<float> samples;
+  };
+
+  static Volume *buildVolume(const QVector<float> &triangles, qreal cellSize,
+                             qreal band, const QAtomicInt &revision,
+                             int expected);
+  static qreal sample(const Volume &volume, const Vec &position);
+  static Vec sampleGradient(const Volume &volume, const Vec &position);
+  qreal effectiveRadius(qreal cellSize) const;
+  Vec slide(const Vec &from, const Vec &to) const;
+
+  QVector<float> triangles_; // 9 coordinates per triangle
+  qreal cellSize_;
+  qreal radius_;
+  qreal bakedRadius_; // collisionRadius() of the last bake()
+
+  QThreadPool *threadPool_;
+  QAtomicInt revision_;
+  // Protected by mutex_
+  mutable QMutex mutex_;
+  Volume *volume_; // nullptr before the first bake
+  bool baking_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_COLLISION_CONSTRAINT_H
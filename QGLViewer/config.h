@@ -56,6 +56,38 @@ Error : libQGLViewer requires a minimum Qt version of 5.4 Error
 # include <GL/glu.h>
 #endif
 
+// Storage type of the math core (Vec, Quaternion, and hence Frame and Camera).
+// Define QGLVIEWER_SINGLE_PRECISION (QGLVIEWER_SINGLE_PRECISION CMake option)
+// to use float instead of qreal: this halves the memory footprint of Frame
+// hierarchies. The API still uses qreal values, which are converted.
+namespace qglviewer {
+#ifdef QGLVIEWER_SINGLE_PRECISION
+typedef float Real;
+#else
+typedef qreal Real;
+#endif
+} // namespace qglviewer
+
+// SIMD kernels for the hot Quaternion operations (product, rotation,
+// normalization). Uncomment (or define in your build system) to enable. Only
+// used with double precision qreal on SSE2 capable architectures. Changes the
+// alignment (and hence the binary interface) of Quaternion.
+// #define QGLVIEWER_USE_SIMD
+#if defined(QGLVIEWER_USE_SIMD) && !defined(QT_COORD_TYPE) &&                 \
+    !defined(QGLVIEWER_SINGLE_PRECISION) &&                                    \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define QGLVIEWER_SIMD_SSE2
+# define QGLVIEWER_SIMD_ALIGN alignas(16)
+# include <emmintrin.h>
+#else
+# define QGLVIEWER_SIMD_ALIGN
+#endif
+
+// Counters of the library hot paths (see HotPathCounters). Uncomment (or define
+// in your build system) to remove them from the library.
+// #define QGLVIEWER_NO_HOT_PATH_COUNTERS
+
 // Container classes interfaces changed a lot in Qt.
 // Compatibility patches are all grouped here.
 #include <QList>
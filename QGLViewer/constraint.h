@@ -56,6 +56,8 @@ class Camera;
 
   Classical axial and plane Constraints are provided for convenience: see the
   LocalConstraint, WorldConstraint and CameraConstraint classes' documentations.
+  The StaticConstraint template provides the same constraints, with types
+  fixed at compile time, for Frames that are updated at a high frequency.
 
   Try the <a href="../examples/constrainedFrame.html">constrainedFrame</a> and
   <a href="../examples/constrainedCamera.html">constrainedCamera</a> examples
@@ -0,0 +1,406 @@
+#include "coreProfileRenderer.h"
+#include "frameRingBuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QtMath>
+
+#include <cstring>
+
+using namespace qglviewer;
+
+// Attribute locations, bound before the program is linked.
+static const GLuint vertexLocation = 0;
+static const GLuint normalLocation = 1;
+
+static const char *vertexShaderSource =
+    "in vec3 vertex;\n"
+    "in vec3 normal;\n"
+    "uniform mat4 mvpMatrix;\n"
+    "uniform mat3 normalMatrix;\n"
+    "uniform vec4 color;\n"
+    "uniform bool lit;\n"
+    "out vec4 vertexColor;\n"
+    "void main() {\n"
+    "  gl_Position = mvpMatrix * vec4(vertex, 1.0);\n"
+    "  if (lit) {\n"
+    "    // Default GL_LIGHT0 head light, with the default global ambient\n"
+    "    float diffuse = abs(normalize(normalMatrix * normal).z);\n"
+    "    vertexColor = vec4(min(color.rgb * (0.2 + diffuse), 1.0), color.a);\n"
+    "  } else\n"
+    "    vertexColor = color;\n"
+    "}\n";
+
+static const char *fragmentShaderSource =
+    "in vec4 vertexColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = vertexColor; }\n";
+
+// A triangle that covers the viewport, generated from gl_VertexID
+static const char *textureVertexShaderSource =
+    "out vec2 texCoord;\n"
+    "void main() {\n"
+    "  texCoord = vec2(float((gl_VertexID << 1) & 2), "
+    "float(gl_VertexID & 2));\n"
+    "  gl_Position = vec4(2.0 * texCoord - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *textureFragmentShaderSource =
+    "uniform sampler2D screenTexture;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = texture(screenTexture, texCoord); }\n";
+
+// Same as the QGLViewer::drawArrow() default value.
+static const int arrowSubdivisions = 12;
+
+// Appends to data the triangles (position and normal) of a Z aligned
+// truncated cone, in the way gluCylinder() would draw it (no caps).
+static void addTruncatedCone(QVector<GLfloat> &data, float baseRadius,
+                             float topRadius, float zBase, float zTop) {
+  const float slope = (baseRadius - topRadius) / (zTop - zBase);
+  for (int i = 0; i < arrowSubdivisions; ++i) {
+    const float a[2] = {float(2.0 * M_PI * i / arrowSubdivisions),
+                        float(2.0 * M_PI * (i + 1) / arrowSubdivisions)};
+    float corner[4][6];
+    for (int c = 0; c < 4; ++c) {
+      const float angle = a[(c == 1 || c == 2) ? 1 : 0];
+      const float radius = (c < 2) ? baseRadius : topRadius;
+      const float n = 1.0f / std::sqrt(1.0f + slope * slope);
+      corner[c][0] = radius * std::cos(angle);
+      corner[c][1] = radius * std::sin(angle);
+      corner[c][2] = (c < 2) ? zBase : zTop;
+      corner[c][3] = n * std::cos(angle);
+      corner[c][4] = n * std::sin(angle);
+      corner[c][5] = n * slope;
+    }
+    static const int triangles[6] = {0, 1, 2, 0, 2, 3};
+    for (int t = 0; t < 6; ++t)
+      for (int k = 0; k < 6; ++k)
+        data.append(corner[triangles[t]][k]);
+  }
+}
+
+/*! Creates an uninitialized renderer. Call initialize() once the OpenGL
+context is current. */
+CoreProfileRenderer::CoreProfileRenderer()
+    : mvpMatrixLocation_(-1), normalMatrixLocation_(-1), colorLocation_(-1),
+      litLocation_(-1), gridSubdivisions_(-1), gridVertexCount_(0),
+      axisLinesVertexCount_(0), arrowVertexCount_(0), ringBuffer_(nullptr) {
+  screenVBO_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+}
+
+/*! Releases the OpenGL resources. The context that was current when
+initialize() was called must be current. */
+CoreProfileRenderer::~CoreProfileRenderer() {
+  gridVAO_.destroy();
+  axisLinesVAO_.destroy();
+  arrowVAO_.destroy();
+  screenVAO_.destroy();
+  textureVAO_.destroy();
+  gridVBO_.destroy();
+  axisLinesVBO_.destroy();
+  arrowVBO_.destroy();
+  screenVBO_.destroy();
+}
+
+/*! Creates the shader program, the vertex array objects and the static
+geometry. Returns \c false (and isInitialized() remains \c false) if the current
+context does not support them, in which case QGLViewer falls back to the fixed
+function pipeline. */
+bool CoreProfileRenderer::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("CoreProfileRenderer::initialize: No current OpenGL context");
+    return false;
+  }
+
+  if (!gridVAO_.create() || !axisLinesVAO_.create() || !arrowVAO_.create() ||
+      !screenVAO_.create() || !textureVAO_.create()) {
+    qWarning("CoreProfileRenderer::initialize: Vertex array objects are not "
+             "supported");
+    return false;
+  }
+
+  if (!gridVBO_.create() || !axisLinesVBO_.create() || !arrowVBO_.create() ||
+      !screenVBO_.create()) {
+    qWarning("CoreProfileRenderer::initialize: Unable to create vertex buffers");
+    return false;
+  }
+
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision mediump float;\n"
+                                : "#version 330 core\n";
+  // Compiled by link(), unless the program binary cache has them
+  if (!program_.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                 header + vertexShaderSource) ||
+      !program_.addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource)) {
+    qWarning("CoreProfileRenderer::initialize: Unable to compile shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  program_.bindAttributeLocation("vertex", vertexLocation);
+  program_.bindAttributeLocation("normal", normalLocation);
+
+  setupVertexArray(gridVAO_, gridVBO_, 3, false);
+  setupVertexArray(axisLinesVAO_, axisLinesVBO_, 3, false);
+  setupVertexArray(arrowVAO_, arrowVBO_, 3, true);
+  setupVertexArray(screenVAO_, screenVBO_, 2, false);
+  buildAxis();
+
+  if (!program_.link()) {
+    qWarning("CoreProfileRenderer::initialize: Unable to link shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  mvpMatrixLocation_ = program_.uniformLocation("mvpMatrix");
+  normalMatrixLocation_ = program_.uniformLocation("normalMatrix");
+  colorLocation_ = program_.uniformLocation("color");
+  litLocation_ = program_.uniformLocation("lit");
+
+  // The texture program has no attribute: textureVAO_ stays empty
+  if (!textureProgram_.addCacheableShaderFromSourceCode(
+          QOpenGLShader::Vertex, header + textureVertexShaderSource) ||
+      !textureProgram_.addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + textureFragmentShaderSource) ||
+      !textureProgram_.link()) {
+    qWarning("CoreProfileRenderer::initialize: Unable to build the texture "
+             "shaders: %s",
+             qPrintable(textureProgram_.log()));
+    return false;
+  }
+  return true;
+}
+
+/*! Records in \p vao the attribute layout of \p vbo: \p tupleSize position
+floats, optionally followed by three normal floats. */
+void CoreProfileRenderer::setupVertexArray(QOpenGLVertexArrayObject &vao,
+                                           QOpenGLBuffer &vbo, int tupleSize,
+                                           bool withNormals) {
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  QOpenGLVertexArrayObject::Binder binder(&vao);
+  vbo.bind();
+  const int stride = (tupleSize + (withNormals ? 3 : 0)) * sizeof(GLfloat);
+  f->glEnableVertexAttribArray(vertexLocation);
+  f->glVertexAttribPointer(vertexLocation, tupleSize, GL_FLOAT, GL_FALSE,
+                           stride, nullptr);
+  if (withNormals) {
+    f->glEnableVertexAttribArray(normalLocation);
+    f->glVertexAttribPointer(
+        normalLocation, 3, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const void *>(tupleSize * sizeof(GLfloat)));
+  }
+  vbo.release();
+}
+
+/*! Fills the grid buffer with a unit size grid (see QGLViewer::drawGrid()). */
+void CoreProfileRenderer::buildGrid(int nbSubdivisions) {
+  QVector<GLfloat> data;
+  data.reserve(12 * (nbSubdivisions + 1));
+  for (int i = 0; i <= nbSubdivisions; ++i) {
+    const GLfloat pos = 2.0f * i / nbSubdivisions - 1.0f;
+    const GLfloat segments[12] = {pos,  -1.0f, 0.0f, pos,  1.0f, 0.0f,
+                                  -1.0f, pos,  0.0f, 1.0f, pos,  0.0f};
+    for (int k = 0; k < 12; ++k)
+      data.append(segments[k]);
+  }
+
+  gridVBO_.bind();
+  gridVBO_.allocate(data.constData(), int(data.size() * sizeof(GLfloat)));
+  gridVBO_.release();
+  gridVertexCount_ = data.size() / 3;
+  gridSubdivisions_ = nbSubdivisions;
+}
+
+/*! Fills the axis buffers with a unit length axis. The X, Y and Z characters
+and the arrow proportions are those of QGLViewer::drawAxis(). */
+void CoreProfileRenderer::buildAxis() {
+  QVector<GLfloat> lines;
+  addAxisCharacters(lines);
+
+  axisLinesVBO_.bind();
+  axisLinesVBO_.allocate(lines.constData(),
+                         int(lines.size() * sizeof(GLfloat)));
+  axisLinesVBO_.release();
+  axisLinesVertexCount_ = lines.size() / 3;
+
+  QVector<GLfloat> arrow;
+  addAxisArrow(arrow);
+
+  arrowVBO_.bind();
+  arrowVBO_.allocate(arrow.constData(), int(arrow.size() * sizeof(GLfloat)));
+  arrowVBO_.release();
+  arrowVertexCount_ = arrow.size() / 6;
+}
+
+/*! Appends to \p data the \c GL_LINES positions of the X, Y and Z characters
+of a unit length QGLViewer::drawAxis(). Also used by the GlyphRenderer. */
+void CoreProfileRenderer::addAxisCharacters(QVector<GLfloat> &data) {
+  const GLfloat charWidth = 1.0f / 40.0f;
+  const GLfloat charHeight = 1.0f / 30.0f;
+  const GLfloat charShift = 1.04f;
+
+  const GLfloat lines[] = {
+      // The X
+      charShift, charWidth, -charHeight, charShift, -charWidth, charHeight,
+      charShift, -charWidth, -charHeight, charShift, charWidth, charHeight,
+      // The Y
+      charWidth, charShift, charHeight, 0.0f, charShift, 0.0f, -charWidth,
+      charShift, charHeight, 0.0f, charShift, 0.0f, 0.0f, charShift, 0.0f,
+      0.0f, charShift, -charHeight,
+      // The Z
+      -charWidth, charHeight, charShift, charWidth, charHeight, charShift,
+      charWidth, charHeight, charShift, -charWidth, -charHeight, charShift,
+      -charWidth, -charHeight, charShift, charWidth, -charHeight, charShift};
+
+  for (const GLfloat coordinate : lines)
+    data.append(coordinate);
+}
+
+/*! Appends to \p data the triangles (position and normal) of a unit length Z
+arrow with the proportions of the QGLViewer::drawAxis() arrows. Also used by
+the GlyphRenderer. */
+void CoreProfileRenderer::addAxisArrow(QVector<GLfloat> &data) {
+  // See QGLViewer::drawArrow(), with radius = 0.01 * length
+  const float radius = 0.01f;
+  const float head = 2.5f * radius + 0.1f;
+  const float coneRadiusCoef = 4.0f - 5.0f * head;
+
+  data.reserve(data.size() + 2 * arrowSubdivisions * 6 * 6);
+  addTruncatedCone(data, radius, radius, 0.0f, 1.0f - head / coneRadiusCoef);
+  addTruncatedCone(data, coneRadiusCoef * radius, 0.0f, 1.0f - head, 1.0f);
+}
+
+void CoreProfileRenderer::setUniforms(const QMatrix4x4 &mvp,
+                                      const QMatrix3x3 &normalMatrix,
+                                      const QColor &color, bool lit) {
+  program_.setUniformValue(mvpMatrixLocation_, mvp);
+  program_.setUniformValue(normalMatrixLocation_, normalMatrix);
+  program_.setUniformValue(colorLocation_, color);
+  program_.setUniformValue(litLocation_, GLint(lit ? 1 : 0));
+}
+
+/*! Core-profile equivalent of QGLViewer::drawGrid(). \p mvp is the
+projection times modelView matrix of the grid coordinate system. The grid buffer
+is only rebuilt when \p nbSubdivisions changes. */
+void CoreProfileRenderer::drawGrid(const QMatrix4x4 &mvp, float size,
+                                   int nbSubdivisions, const QColor &color) {
+  if (nbSubdivisions != gridSubdivisions_)
+    buildGrid(nbSubdivisions);
+
+  QMatrix4x4 scaled = mvp;
+  scaled.scale(size);
+
+  program_.bind();
+  setUniforms(scaled, QMatrix3x3(), color, false);
+  QOpenGLVertexArrayObject::Binder binder(&gridVAO_);
+  QOpenGLContext::currentContext()->functions()->glDrawArrays(
+      GL_LINES, 0, gridVertexCount_);
+  program_.release();
+}
+
+/*! Core-profile equivalent of QGLViewer::drawAxis(). The X, Y and Z characters
+use \p color, the arrows use the same light red, green and blue colors. */
+void CoreProfileRenderer::drawAxis(const QMatrix4x4 &modelView,
+                                   const QMatrix4x4 &projection, float length,
+                                   const QColor &color) {
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  QMatrix4x4 scaled = modelView;
+  scaled.scale(length);
+
+  program_.bind();
+  setUniforms(projection * scaled, QMatrix3x3(), color, false);
+  axisLinesVAO_.bind();
+  f->glDrawArrays(GL_LINES, 0, axisLinesVertexCount_);
+  axisLinesVAO_.release();
+
+  // Z arrow, then X and Y arrows with the QGLViewer::drawAxis() rotations
+  static const float rotations[3][4] = {
+      {0.0f, 0.0f, 0.0f, 1.0f},
+      {90.0f, 0.0f, 1.0f, 0.0f},
+      {-90.0f, 1.0f, 0.0f, 0.0f}};
+  const QColor colors[3] = {QColor::fromRgbF(0.7, 0.7, 1.0),
+                            QColor::fromRgbF(1.0, 0.7, 0.7),
+                            QColor::fromRgbF(0.7, 1.0, 0.7)};
+
+  arrowVAO_.bind();
+  for (int i = 0; i < 3; ++i) {
+    QMatrix4x4 arrow = scaled;
+    arrow.rotate(rotations[i][0], rotations[i][1], rotations[i][2],
+                 rotations[i][3]);
+    setUniforms(projection * arrow, arrow.normalMatrix(), colors[i], true);
+    f->glDrawArrays(GL_TRIANGLES, 0, arrowVertexCount_);
+  }
+  arrowVAO_.release();
+  program_.release();
+}
+
+/*! Draws \p points, expressed in screen coordinates (see
+QGLViewer::startScreenCoordinatesSystem()) of a \p width x \p height window,
+using the \p mode primitive (\c GL_LINES, \c GL_LINE_LOOP...). */
+void CoreProfileRenderer::drawScreenLines(const QVector<QVector2D> &points,
+                                          GLenum mode, const QColor &color,
+                                          int width, int height) {
+  if (points.isEmpty())
+    return;
+
+  QMatrix4x4 projection;
+  projection.ortho(0.0f, float(width), float(height), 0.0f, -1.0f, 1.0f);
+
+  const int size = int(points.size() * sizeof(QVector2D));
+  FrameRingBuffer::Allocation allocation;
+  if (ringBuffer_)
+    allocation = ringBuffer_->allocate(size);
+
+  program_.bind();
+  setUniforms(projection, QMatrix3x3(), color, false);
+  QOpenGLVertexArrayObject::Binder binder(&screenVAO_);
+  // The vertex attribute follows the buffer used by this draw
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  if (allocation.isValid()) {
+    memcpy(allocation.data, points.constData(), size);
+    f->glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+    f->glVertexAttribPointer(vertexLocation, 2, GL_FLOAT, GL_FALSE, 0,
+                             allocation.pointer());
+  } else {
+    screenVBO_.bind();
+    screenVBO_.allocate(points.constData(), size);
+    f->glVertexAttribPointer(vertexLocation, 2, GL_FLOAT, GL_FALSE, 0,
+                             nullptr);
+  }
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+  QOpenGLContext::currentContext()->functions()->glDrawArrays(mode, 0,
+                                                              points.size());
+  program_.release();
+}
+
+/*! Core-profile equivalent of the textured quad of QGLViewer, drawn over the
+whole viewport: \p texture (a \c GL_TEXTURE_2D) replaces the color buffer,
+with a linear filter. The depth test is disabled during the draw. */
+void CoreProfileRenderer::drawScreenTexture(GLuint texture) {
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  const bool depthTest = f->glIsEnabled(GL_DEPTH_TEST);
+  const bool blend = f->glIsEnabled(GL_BLEND);
+  f->glDisable(GL_DEPTH_TEST);
+  f->glDisable(GL_BLEND);
+
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, texture);
+  f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  textureProgram_.bind();
+  textureProgram_.setUniformValue("screenTexture", 0);
+  QOpenGLVertexArrayObject::Binder binder(&textureVAO_);
+  f->glDrawArrays(GL_TRIANGLES, 0, 3);
+  textureProgram_.release();
+  f->glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (depthTest)
+    f->glEnable(GL_DEPTH_TEST);
+  if (blend)
+    f->glEnable(GL_BLEND);
+}
@@ -0,0 +1,93 @@
+#ifndef QGLVIEWER_CORE_PROFILE_RENDERER_H
+#define QGLVIEWER_CORE_PROFILE_RENDERER_H
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QVector2D>
+#include <QVector>
+
+namespace qglviewer {
+class FrameRingBuffer;
+
+/*! \brief Draws the QGLViewer visual hints with a core-profile pipeline.
+  \class CoreProfileRenderer coreProfileRenderer.h
+
+  This internal class is used by QGLViewer when
+  QGLViewer::visualHintsUseCoreProfile() is \c true. It replaces the immediate
+  mode and \c GLUquadric calls of QGLViewer::drawGrid(), QGLViewer::drawAxis()
+  and QGLViewer::drawVisualHints() by vertex buffers and vertex array objects
+  that are built once, and drawn with a tiny shader program. drawScreenTexture()
+  displays the offscreen frames (render thread, dynamic resolution) in a
+  \c QSurfaceFormat::CoreProfile context.
+
+  The grid and axis geometries are built for a unit size and scaled by the
+  transformation matrix. Screen-space hints are streamed in the viewer's
+  FrameRingBuffer (see setFrameRingBuffer()), or in a dynamic buffer.
+
+  All the methods, including the destructor, require the viewer's OpenGL
+  context to be current. */
+class CoreProfileRenderer {
+public:
+  CoreProfileRenderer();
+  ~CoreProfileRenderer();
+
+  bool initialize();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return program_.isLinked(); }
+
+  /*! Makes the screen-space hints allocated in \p ring, nullptr to use a
+  dynamic buffer. */
+  void setFrameRingBuffer(FrameRingBuffer *ring) { ringBuffer_ = ring; }
+
+  void drawGrid(const QMatrix4x4 &mvp, float size, int nbSubdivisions,
+                const QColor &color);
+  void drawAxis(const QMatrix4x4 &modelView, const QMatrix4x4 &projection,
+                float length, const QColor &color);
+  void drawScreenLines(const QVector<QVector2D> &points, GLenum mode,
+                       const QColor &color, int width, int height);
+  void drawScreenTexture(GLuint texture);
+
+  static void addAxisCharacters(QVector<GLfloat> &data);
+  static void addAxisArrow(QVector<GLfloat> &data);
+
+private:
+  void setupVertexArray(QOpenGLVertexArrayObject &vao, QOpenGLBuffer &vbo,
+                        int tupleSize, bool withNormals);
+  void buildGrid(int nbSubdivisions);
+  void buildAxis();
+  void setUniforms(const QMatrix4x4 &mvp, const QMatrix3x3 &normalMatrix,
+                   const QColor &color, bool lit);
+
+  QOpenGLShaderProgram program_;
+  int mvpMatrixLocation_;
+  int normalMatrixLocation_;
+  int colorLocation_;
+  int litLocation_;
+
+  QOpenGLVertexArrayObject gridVAO_;
+  QOpenGLBuffer gridVBO_;
+  int gridSubdivisions_;
+  int gridVertexCount_;
+
+  QOpenGLVertexArrayObject axisLinesVAO_;
+  QOpenGLBuffer axisLinesVBO_;
+  int axisLinesVertexCount_;
+
+  QOpenGLVertexArrayObject arrowVAO_;
+  QOpenGLBuffer arrowVBO_;
+  int arrowVertexCount_;
+
+  QOpenGLVertexArrayObject screenVAO_;
+  QOpenGLBuffer screenVBO_;
+  FrameRingBuffer *ringBuffer_;
+
+  QOpenGLShaderProgram textureProgram_;
+  QOpenGLVertexArrayObject textureVAO_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CORE_PROFILE_RENDERER_H
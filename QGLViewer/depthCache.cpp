@@ -0,0 +1,326 @@
+#include "depthCache.h"
+#include "camera.h"
+
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+
+using namespace qglviewer;
+
+/*! Creates an empty DepthCache, with a reduction() of 1. It isValid() after
+the first capture() and retrieve(). */
+DepthCache::DepthCache()
+    : reduction_(1), isValid_(false), depthRangeIsUpToDate_(false),
+      hasForeground_(false), bufferIndex_(0), resolveFbo_(nullptr),
+      reducedFbo_(nullptr) {
+  for (int i = 0; i < 2; ++i) {
+    buffers_[i] = nullptr;
+    isPending_[i] = false;
+  }
+  state_.size = QSize();
+  state_.reverseZ = false;
+}
+
+/*! Destructor. The OpenGL resources should have been released by
+cleanupGL(). */
+DepthCache::~DepthCache() {
+  if (QOpenGLContext::currentContext())
+    cleanupGL();
+}
+
+/*! Sets the reduction(). Values smaller than 1 are replaced by 1. Applies to
+the next capture(). */
+void DepthCache::setReduction(int reduction) {
+  reduction_ = qMax(reduction, 1);
+}
+
+/*! Releases the pixel buffer and framebuffer objects. Pending captures are
+lost, but the retrieved depths remain valid. */
+void DepthCache::cleanupGL() {
+  for (int i = 0; i < 2; ++i) {
+    delete buffers_[i];
+    buffers_[i] = nullptr;
+    isPending_[i] = false;
+  }
+  delete resolveFbo_;
+  resolveFbo_ = nullptr;
+  delete reducedFbo_;
+  reducedFbo_ = nullptr;
+}
+
+/*! Returns the number of bytes of the pixel buffer and framebuffer objects.
+See QGLViewer::memoryUsage(). */
+qint64 DepthCache::memoryUsage() const {
+  qint64 bytes = 0;
+  // Allocated with the size of their last capture
+  for (int i = 0; i < 2; ++i)
+    if (buffers_[i] && pending_[i].size.isValid())
+      bytes += qint64(sizeof(float)) * pending_[i].size.width() *
+               pending_[i].size.height();
+  // Color and combined depth stencil attachments of 32 bits per pixel
+  const QOpenGLFramebufferObject *const fbos[2] = {resolveFbo_, reducedFbo_};
+  for (const QOpenGLFramebufferObject *fbo : fbos)
+    if (fbo)
+      bytes += 8 * qint64(fbo->width()) * fbo->height();
+  return bytes;
+}
+
+/*! The queries return the background until the next retrieve(). Use this
+when the scene was modified since the last capture(). */
+void DepthCache::invalidate() { isValid_ = false; }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Capture                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// (Re)creates the depth framebuffer objects used by capture()
+bool DepthCache::updateFramebufferObjects(const QSize &fullSize,
+                                          const QSize &size,
+                                          bool multisampled) {
+  // Same attachment as the QOpenGLWidget framebuffer, as required by the blit
+  QOpenGLFramebufferObjectFormat format;
+  format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+
+  if (multisampled && (!resolveFbo_ || (resolveFbo_->size() != fullSize))) {
+    delete resolveFbo_;
+    resolveFbo_ = new QOpenGLFramebufferObject(fullSize, format);
+  }
+  if ((reduction_ > 1) && (!reducedFbo_ || (reducedFbo_->size() != size))) {
+    delete reducedFbo_;
+    reducedFbo_ = new QOpenGLFramebufferObject(size, format);
+  }
+
+  if ((multisampled && !resolveFbo_->isValid()) ||
+      ((reduction_ > 1) && !reducedFbo_->isValid())) {
+    qWarning("DepthCache::capture: unable to create framebuffer objects");
+    return false;
+  }
+  return true;
+}
+
+/*! Reads the depth buffer of the region of \p camera, in a pixel buffer
+object. The framebuffer where \p camera has drawn must be bound. Called by
+QGLViewer::paintGL() at the end of each frame when
+QGLViewer::depthCacheIsEnabled().
+
+The read back is asynchronous: the depths are only available after the next
+retrieve(). The matrices of \p camera are saved with them, so that the queries
+use those of the captured frame. An OpenGL context must be current. */
+void DepthCache::capture(const Camera *camera) {
+  const qreal ratio = camera->devicePixelRatio();
+  const QRect region(int(ratio * camera->screenOffsetX()),
+                     int(ratio * camera->screenOffsetY()),
+                     int(ratio * camera->screenWidth()),
+                     int(ratio * camera->screenHeight()));
+  if (region.isEmpty())
+    return;
+
+  const QSize size((region.width() + reduction_ - 1) / reduction_,
+                   (region.height() + reduction_ - 1) / reduction_);
+
+  // Multisampled depths are resolved before they can be read or scaled
+  GLint samples = 0;
+  glGetIntegerv(GL_SAMPLES, &samples);
+  const bool multisampled = samples > 0;
+  const bool blit = multisampled || (reduction_ > 1);
+  if (blit && !updateFramebufferObjects(region.size(), size, multisampled))
+    return;
+
+  QOpenGLBuffer *&buffer = buffers_[bufferIndex_];
+  if (!buffer) {
+    buffer = new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+    buffer->setUsagePattern(QOpenGLBuffer::StreamRead);
+    if (!buffer->create()) {
+      qWarning("DepthCache::capture: unable to create pixel buffer object");
+      delete buffer;
+      buffer = nullptr;
+      return;
+    }
+  }
+
+  QOpenGLFramebufferObject *source = nullptr; // the bound framebuffer
+  QRect sourceRect = region;
+  if (multisampled) {
+    const QRect rect(QPoint(0, 0), region.size());
+    QOpenGLFramebufferObject::blitFramebuffer(resolveFbo_, rect, source,
+                                              sourceRect, GL_DEPTH_BUFFER_BIT,
+                                              GL_NEAREST);
+    source = resolveFbo_;
+    sourceRect = rect;
+  }
+  if (reduction_ > 1) {
+    const QRect rect(QPoint(0, 0), size);
+    QOpenGLFramebufferObject::blitFramebuffer(reducedFbo_, rect, source,
+                                              sourceRect, GL_DEPTH_BUFFER_BIT,
+                                              GL_NEAREST);
+    source = reducedFbo_;
+    sourceRect = rect;
+  }
+
+  if (source)
+    source->bind();
+  buffer->bind();
+  const int bytes = size.width() * size.height() * int(sizeof(float));
+  if (buffer->size() != bytes)
+    buffer->allocate(bytes);
+  // With a bound pixel pack buffer, glReadPixels returns immediately
+  glReadPixels(sourceRect.x(), sourceRect.y(), size.width(), size.height(),
+               GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  buffer->release();
+  if (source)
+    source->release();
+
+  Capture &pending = pending_[bufferIndex_];
+  pending.size = size;
+  pending.reduction = reduction_;
+  pending.devicePixelRatio = ratio;
+  pending.screenHeight = camera->screenHeight();
+  pending.reverseZ = camera->reverseZIsEnabled();
+  pending.clipControl = camera->clipControlIsUsed_;
+  camera->getModelViewMatrix(pending.modelView);
+  camera->getProjectionMatrix(pending.projection);
+  camera->getViewport(pending.viewport);
+  isPending_[bufferIndex_] = true;
+  bufferIndex_ = 1 - bufferIndex_;
+}
+
+/*! Copies the depths of the last capture() in memory. Older captures that
+were not retrieved are discarded. Does nothing when there is no pending
+capture.
+
+Called by QGLViewer::paintGL() at the beginning of each frame, one frame after
+the capture(), when the read back is completed. An OpenGL context must be
+current. */
+void DepthCache::retrieve() {
+  const int index = 1 - bufferIndex_;
+  isPending_[bufferIndex_] = false;
+  if (!isPending_[index])
+    return;
+  isPending_[index] = false;
+
+  state_ = pending_[index];
+  depths_.resize(state_.size.width() * state_.size.height());
+  buffers_[index]->bind();
+  buffers_[index]->read(0, depths_.data(),
+                        depths_.size() * int(sizeof(float)));
+  buffers_[index]->release();
+  isValid_ = true;
+  depthRangeIsUpToDate_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Queries                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the cached depth of \p pixel, with the same semantic as the depth
+read by Camera::pointUnderPixel(). \p pixel is expressed in the captured
+Camera coordinates, with an origin in the upper left corner.
+
+\p found is \c false when the pixel is a background pixel, when it is outside
+of the captured region or when the cache is not isValid(). The background depth
+(1.0, or 0.0 with Camera::reverseZIsEnabled()) is then returned. */
+float DepthCache::depth(const QPoint &pixel, bool &found) const {
+  const float background = state_.reverseZ ? 0.0f : 1.0f;
+  found = false;
+  if (!isValid_)
+    return background;
+
+  // Qt uses upper corner for its origin while GL uses the lower corner.
+  const int x = int(state_.devicePixelRatio * pixel.x());
+  const int y =
+      int(state_.devicePixelRatio * (state_.screenHeight - pixel.y())) - 1;
+  if ((x < 0) || (y < 0))
+    return background;
+  const int i = x / state_.reduction;
+  const int j = y / state_.reduction;
+  if ((i >= state_.size.width()) || (j >= state_.size.height()))
+    return background;
+
+  const float depth = depths_[j * state_.size.width() + i];
+  found = state_.reverseZ ? depth > 0.0f : depth < 1.0f;
+  return depth;
+}
+
+/*! Same as Camera::pointUnderPixel(), but uses the cached depth() and the
+Camera matrices of the captured frame. No OpenGL call is made. */
+Vec DepthCache::pointUnderPixel(const QPoint &pixel, bool &found) const {
+  const float z = depth(pixel, found);
+  return unprojectedCoordinatesOf(
+      Vec(pixel.x(), pixel.y(), static_cast<double>(z)));
+}
+
+/*! Same as Camera::unprojectedCoordinatesOf() (with a \c nullptr frame), with
+the Camera matrices of the captured frame. */
+Vec DepthCache::unprojectedCoordinatesOf(const Vec &src) const {
+  if (!isValid_)
+    return Vec();
+
+  // See Camera::toGluDepth()
+  const qreal z = state_.clipControl ? (src.z + 1.0) / 2.0 : src.z;
+  GLdouble x, y, zw;
+  gluUnProject(src.x, src.y, z, state_.modelView, state_.projection,
+               state_.viewport, &x, &y, &zw);
+  return Vec(x, y, zw);
+}
+
+// Distance to the captured camera plane of a point of window depth depth
+qreal DepthCache::distanceOf(float depth) const {
+  const Vec p = unprojectedCoordinatesOf(
+      Vec(state_.viewport[0] + state_.viewport[2] / 2.0,
+          state_.viewport[1] + state_.viewport[3] / 2.0, qreal(depth)));
+  const GLdouble *m = state_.modelView;
+  return -(m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+}
+
+/*! Sets \p zMin and \p zMax to the smallest and largest distances to the
+camera plane (as in Camera::zNear()) of the points of the cached depth
+buffer. Background pixels are ignored.
+
+Returns \c false, leaving \p zMin and \p zMax unchanged, when the cache is
+not isValid(), when it contains only background pixels, or when the view of \p
+camera (position, orientation and field of view) differs from the captured
+one. Used by Camera::fitClippingPlanesToDepth().
+
+The depths are scanned once per retrieve(). With a reduction() larger than 1,
+thin objects may be missed. */
+bool DepthCache::distanceRange(const Camera *camera, qreal &zMin,
+                               qreal &zMax) const {
+  if (!isValid_)
+    return false;
+
+  // The captured view must be the current one
+  GLdouble modelView[16];
+  camera->getModelViewMatrix(modelView);
+  for (int i = 0; i < 16; ++i)
+    if (modelView[i] != state_.modelView[i])
+      return false;
+  GLdouble projection[16];
+  camera->getProjectionMatrix(projection);
+  if ((projection[0] != state_.projection[0]) ||
+      (projection[5] != state_.projection[5]))
+    return false;
+
+  if (!depthRangeIsUpToDate_) {
+    const float background = state_.reverseZ ? 0.0f : 1.0f;
+    float minDepth = 1.0f, maxDepth = 0.0f;
+    hasForeground_ = false;
+    for (QVector<float>::const_iterator it = depths_.begin(),
+                                        end = depths_.end();
+         it != end; ++it)
+      if (*it != background) {
+        minDepth = qMin(minDepth, *it);
+        maxDepth = qMax(maxDepth, *it);
+        hasForeground_ = true;
+      }
+    // Depths decrease with the distance when reverseZ
+    nearestDepth_ = state_.reverseZ ? maxDepth : minDepth;
+    farthestDepth_ = state_.reverseZ ? minDepth : maxDepth;
+    depthRangeIsUpToDate_ = true;
+  }
+  if (!hasForeground_)
+    return false;
+
+  zMin = distanceOf(nearestDepth_);
+  zMax = distanceOf(farthestDepth_);
+  return true;
+}
@@ -0,0 +1,122 @@
+#ifndef QGLVIEWER_DEPTH_CACHE_H
+#define QGLVIEWER_DEPTH_CACHE_H
+
+#include <QPoint>
+#include <QSize>
+#include <QVector>
+
+#include "vec.h"
+
+class QOpenGLBuffer;
+class QOpenGLFramebufferObject;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief A copy of the depth buffer in memory, that answers the depth queries
+  of any number of pixels without OpenGL.
+  \class DepthCache depthCache.h QGLViewer/depthCache.h
+
+  Camera::pointUnderPixel() reads the depth of a single pixel with a
+  synchronous \c glReadPixels, which waits for the end of the frame. Hover
+  feedback, tooltips or Camera::setPivotPointFromPixel() then stall the
+  pipeline at each query.
+
+  A DepthCache instead reads the whole depth buffer once per frame, in a pixel
+  buffer object: capture() is called at the end of the frame, and retrieve()
+  copies its result in memory at the beginning of the next frame, when the read
+  back is completed. depth(), pointUnderPixel() and unprojectedCoordinatesOf()
+  then only access this memory, with the matrices of the captured frame.
+
+  Use QGLViewer::setDepthCacheIsEnabled() to let the viewer call these methods,
+  and to make its Camera::pointUnderPixel() use the cache (see
+  Camera::setDepthCache()).
+
+  Use setReduction() to capture a smaller depth buffer, with one depth every
+  reduction() pixels in each direction. This divides the read back size by the
+  square of reduction(), at the price of precision on the object edges.
+
+  The OpenGL methods (capture(), retrieve() and cleanupGL()) must be called
+  with the same context current. Call cleanupGL() with this context current
+  before the DepthCache is destroyed. */
+class QGLVIEWER_EXPORT DepthCache {
+public:
+  DepthCache();
+  ~DepthCache();
+
+  /*! @name Resolution */
+  //@{
+public:
+  /*! Returns the number of pixels, in each direction, represented by a cached
+  depth. Default value is 1, the depth buffer resolution. */
+  int reduction() const { return reduction_; }
+  void setReduction(int reduction);
+  /*! Returns the size of the cached depth buffer, i.e. the size of the
+  captured region, in device pixels, divided by reduction(). */
+  QSize size() const { return state_.size; }
+  //@}
+
+  /*! @name Capture */
+  //@{
+public:
+  void capture(const Camera *camera);
+  void retrieve();
+  /*! Returns \c true when a depth buffer was retrieve()d and not
+  invalidate()d since. The queries return the background otherwise. */
+  bool isValid() const { return isValid_; }
+  void invalidate();
+  void cleanupGL();
+  qint64 memoryUsage() const;
+  //@}
+
+  /*! @name Queries */
+  //@{
+public:
+  float depth(const QPoint &pixel, bool &found) const;
+  Vec pointUnderPixel(const QPoint &pixel, bool &found) const;
+  Vec unprojectedCoordinatesOf(const Vec &src) const;
+  bool distanceRange(const Camera *camera, qreal &zMin, qreal &zMax) const;
+  //@}
+
+private:
+  Q_DISABLE_COPY(DepthCache)
+
+  // The state of a captured frame
+  struct Capture {
+    QSize size; // of the cached depths
+    int reduction;
+    qreal devicePixelRatio;
+    int screenHeight; // of the camera, in pixels
+    bool reverseZ;    // the background depth is 0.0
+    bool clipControl; // see Camera::toGluDepth()
+    GLdouble modelView[16];
+    GLdouble projection[16];
+    GLint viewport[4];
+  };
+
+  bool updateFramebufferObjects(const QSize &fullSize, const QSize &size,
+                                bool multisampled);
+  qreal distanceOf(float depth) const;
+
+  int reduction_;
+  bool isValid_;
+  QVector<float> depths_; // state_.size, in OpenGL bottom up row order
+  Capture state_;         // of depths_
+
+  // Extreme non background depths, computed by the first distanceRange()
+  mutable bool depthRangeIsUpToDate_;
+  mutable bool hasForeground_;
+  mutable float nearestDepth_, farthestDepth_;
+
+  // O p e n G L
+  QOpenGLBuffer *buffers_[2];
+  Capture pending_[2];
+  bool isPending_[2];
+  int bufferIndex_; // of the next capture()
+  QOpenGLFramebufferObject *resolveFbo_; // multisampled depth buffers
+  QOpenGLFramebufferObject *reducedFbo_; // when reduction() > 1
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_DEPTH_CACHE_H
@@ -0,0 +1,236 @@
+#include "depthSorter.h"
+#include "camera.h"
+#include "taskScheduler.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QGLVIEWER_DEPTH_SORTER_SSE2
+#endif
+
+using namespace qglviewer;
+
+// The radix sort processes 8 bits of the keys per pass
+static const int radixBits = 8;
+static const int radixSize = 1 << radixBits;
+// Points per task of the parallel passes
+static const int minimumChunkSize = 16384;
+
+// Maps a float on an unsigned integer with the same order: the sign bit is
+// flipped for positive values, and all the bits for negative ones
+static inline quint32 sortableKey(float value) {
+  quint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+/*! Creates a DepthSorter. */
+DepthSorter::DepthSorter()
+    : coherenceAngle_(0.05), lastSortWasRefined_(false),
+      hasPreviousSort_(false) {}
+
+/*! Returns the indices of the \p nbPositions points of \p positions, ordered
+from the farthest to the nearest one along the \p camera view direction (for
+an orthographic camera as for a perspective one).
+
+Each point is made of three \c float world coordinates. \p stride is the
+distance, in bytes, between two successive points: use the size of your
+vertex or particle structure when the positions are interleaved with other
+attributes.
+
+The returned array is the order(), valid until the next sort(). */
+const QVector<quint32> &DepthSorter::sort(const Camera *camera,
+                                          const float *positions,
+                                          int nbPositions, int stride) {
+  if (!camera || !positions || (nbPositions <= 0)) {
+    invalidate();
+    return order_;
+  }
+
+  GLdouble modelView[16];
+  camera->getModelViewMatrix(modelView);
+  keys_.resize(nbPositions);
+  computeKeys(modelView, positions, nbPositions, stride);
+
+  const Vec viewDirection = camera->viewDirection();
+  const qreal angle = acos(qBound(
+      qreal(-1.0), qreal(viewDirection * previousViewDirection_), qreal(1.0)));
+  lastSortWasRefined_ = hasPreviousSort_ &&
+                        (order_.size() == nbPositions) &&
+                        (angle <= coherenceAngle_) && refine();
+  if (!lastSortWasRefined_)
+    radixSort();
+
+  hasPreviousSort_ = true;
+  previousViewDirection_ = viewDirection;
+  return order_;
+}
+
+/*! Clears the order(). The next sort() uses the radix sort. Call this method
+when the set of points given to sort() changes. */
+void DepthSorter::invalidate() {
+  order_.clear();
+  hasPreviousSort_ = false;
+  lastSortWasRefined_ = false;
+}
+
+// keys_[i] is the sortable view depth of point i. The camera looks along -Z:
+// the farthest points have the smallest Z, and hence the smallest keys.
+void DepthSorter::computeKeys(const GLdouble modelView[16],
+                              const float *positions, int nbPositions,
+                              int stride) {
+  // Third row of the column major matrix
+  const float a = float(modelView[2]), b = float(modelView[6]);
+  const float c = float(modelView[10]), d = float(modelView[14]);
+  const char *const data = reinterpret_cast<const char *>(positions);
+  quint32 *const keys = keys_.data();
+
+  TaskScheduler::parallelFor(
+      nbPositions,
+      [=](int begin, int end) {
+        int i = begin;
+#ifdef QGLVIEWER_DEPTH_SORTER_SSE2
+        const __m128 ma = _mm_set1_ps(a), mb = _mm_set1_ps(b);
+        const __m128 mc = _mm_set1_ps(c), md = _mm_set1_ps(d);
+        const __m128i signBit = _mm_set1_epi32(int(0x80000000u));
+        for (; i + 4 <= end; i += 4) {
+          const float *p0 =
+              reinterpret_cast<const float *>(data + qint64(i) * stride);
+          const float *p1 =
+              reinterpret_cast<const float *>(data + qint64(i + 1) * stride);
+          const float *p2 =
+              reinterpret_cast<const float *>(data + qint64(i + 2) * stride);
+          const float *p3 =
+              reinterpret_cast<const float *>(data + qint64(i + 3) * stride);
+          const __m128 x = _mm_set_ps(p3[0], p2[0], p1[0], p0[0]);
+          const __m128 y = _mm_set_ps(p3[1], p2[1], p1[1], p0[1]);
+          const __m128 z = _mm_set_ps(p3[2], p2[2], p1[2], p0[2]);
+          const __m128 depth = _mm_add_ps(
+              _mm_add_ps(_mm_mul_ps(ma, x), _mm_mul_ps(mb, y)),
+              _mm_add_ps(_mm_mul_ps(mc, z), md));
+          // sortableKey() on the four depths
+          const __m128i bits = _mm_castps_si128(depth);
+          const __m128i flip =
+              _mm_or_si128(_mm_srai_epi32(bits, 31), signBit);
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(keys + i),
+                           _mm_xor_si128(bits, flip));
+        }
+#endif
+        for (; i < end; ++i) {
+          const float *p =
+              reinterpret_cast<const float *>(data + qint64(i) * stride);
+          keys[i] = sortableKey(a * p[0] + b * p[1] + c * p[2] + d);
+        }
+      },
+      minimumChunkSize);
+}
+
+// Insertion sort of the previous order with the new keys. Gives up (and
+// returns false) after more moves than points, when the order changed too
+// much for the insertion sort to be faster than the radix sort.
+bool DepthSorter::refine() {
+  const int nb = order_.size();
+  QVector<quint32> &sortedKeys = sortedKeys_[0];
+  sortedKeys.resize(nb);
+  quint32 *const k = sortedKeys.data();
+  quint32 *const o = order_.data();
+  const quint32 *const keys = keys_.constData();
+  TaskScheduler::parallelFor(
+      nb,
+      [=](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+          k[i] = keys[o[i]];
+      },
+      minimumChunkSize);
+
+  qint64 nbMoves = 0;
+  for (int i = 1; i < nb; ++i) {
+    const quint32 key = k[i], index = o[i];
+    int j = i;
+    for (; (j > 0) && (k[j - 1] > key); --j) {
+      k[j] = k[j - 1];
+      o[j] = o[j - 1];
+      ++nbMoves;
+    }
+    // order_ remains a permutation when giving up
+    k[j] = key;
+    o[j] = index;
+    if (nbMoves > nb)
+      return false;
+  }
+  return true;
+}
+
+// Least significant digit first radix sort of the keys_, with the identity
+// as initial order. Each pass counts the digits of each chunk of keys in
+// parallel, and then scatters the chunks in parallel at their stable
+// positions. Passes where all the keys have the same digit are skipped.
+void DepthSorter::radixSort() {
+  const int nb = keys_.size();
+  const int nbChunks = qBound(1, nb / minimumChunkSize,
+                              4 * TaskScheduler::maxThreadCount());
+  sortedKeys_[0] = keys_;
+  sortedKeys_[1].resize(nb);
+  order_.resize(nb);
+  sortedIndices_.resize(nb);
+
+  quint32 *const initialOrder = order_.data();
+  TaskScheduler::parallelFor(
+      nb,
+      [=](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+          initialOrder[i] = quint32(i);
+      },
+      minimumChunkSize);
+
+  QVector<int> counts(nbChunks * radixSize);
+  for (int shift = 0; shift < 32; shift += radixBits) {
+    const quint32 *const keys = sortedKeys_[0].constData();
+    const quint32 *const indices = order_.constData();
+    quint32 *const outKeys = sortedKeys_[1].data();
+    quint32 *const outIndices = sortedIndices_.data();
+    int *const c = counts.data();
+
+    counts.fill(0);
+    TaskScheduler::parallelFor(nbChunks, [=](int first, int last) {
+      for (int chunk = first; chunk < last; ++chunk) {
+        int *const count = c + chunk * radixSize;
+        const int end = int(qint64(chunk + 1) * nb / nbChunks);
+        for (int i = int(qint64(chunk) * nb / nbChunks); i < end; ++i)
+          ++count[(keys[i] >> shift) & (radixSize - 1)];
+      }
+    });
+
+    // Offsets, by digit and then by chunk for a stable sort
+    bool isSorted = false;
+    int offset = 0;
+    for (int digit = 0; digit < radixSize; ++digit) {
+      const int first = offset;
+      for (int chunk = 0; chunk < nbChunks; ++chunk) {
+        const int count = c[chunk * radixSize + digit];
+        c[chunk * radixSize + digit] = offset;
+        offset += count;
+      }
+      isSorted = isSorted || (offset - first == nb);
+    }
+    if (isSorted)
+      continue;
+
+    TaskScheduler::parallelFor(nbChunks, [=](int first, int last) {
+      for (int chunk = first; chunk < last; ++chunk) {
+        int *const position = c + chunk * radixSize;
+        const int end = int(qint64(chunk + 1) * nb / nbChunks);
+        for (int i = int(qint64(chunk) * nb / nbChunks); i < end; ++i) {
+          const int p = position[(keys[i] >> shift) & (radixSize - 1)]++;
+          outKeys[p] = keys[i];
+          outIndices[p] = indices[i];
+        }
+      }
+    });
+    sortedKeys_[0].swap(sortedKeys_[1]);
+    order_.swap(sortedIndices_);
+  }
+}
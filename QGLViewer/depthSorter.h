@@ -0,0 +1,91 @@
+#ifndef QGLVIEWER_DEPTH_SORTER_H
+#define QGLVIEWER_DEPTH_SORTER_H
+
+#include "vec.h"
+
+#include <QVector>
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Sorts points back to front, for the blending of transparent
+  objects.
+  \class DepthSorter depthSorter.h QGLViewer/depthSorter.h
+
+  Transparent particles, splats or billboards must be drawn from the farthest
+  to the nearest one at each frame. Sorting them with \c std::sort() on their
+  Camera::cameraCoordinatesOf() is too slow for hundreds of thousands of
+  points. sort() instead computes all the view depths with the
+  Camera::getModelViewMatrix() (four points at a time with SSE2), and orders
+  them with a parallel radix sort on the TaskScheduler threads:
+  \code
+  void Viewer::draw() {
+    const QVector<quint32> &order =
+        sorter_.sort(camera(), &particles_[0].x, nbParticles_,
+                     sizeof(Particle));
+    // Use order as the index buffer of the particles, or
+    for (quint32 i : order)
+      drawParticle(particles_[i]);
+  }
+  \endcode
+
+  When the camera barely moved since the previous sort() (see
+  coherenceAngle()), the previous order is almost sorted: it is refined by an
+  insertion sort, which stops and falls back to the radix sort when it does
+  too many moves. sort() is hence cheap for a still or slowly moving camera,
+  even when the points move.
+
+  The order is only valid for the positions given to the last sort(): a
+  DepthSorter should be used for a single set of points. */
+class QGLVIEWER_EXPORT DepthSorter {
+public:
+  DepthSorter();
+
+  /*! @name Sorting */
+  //@{
+public:
+  const QVector<quint32> &sort(const Camera *camera, const float *positions,
+                               int nbPositions,
+                               int stride = 3 * sizeof(float));
+  /*! Returns the indices of the positions given to the last sort(), from the
+  farthest to the nearest one. */
+  const QVector<quint32> &order() const { return order_; }
+  void invalidate();
+  //@}
+
+  /*! @name Temporal coherence */
+  //@{
+public:
+  /*! Returns the maximum angle, in radians, between the camera view
+  directions of two successive sort()s for the previous order to be refined
+  rather than sorted again. Default value is 0.05 (about 3 degrees). Use 0.0
+  to always use the radix sort. */
+  qreal coherenceAngle() const { return coherenceAngle_; }
+  /*! Sets the coherenceAngle(). */
+  void setCoherenceAngle(qreal angle) { coherenceAngle_ = angle; }
+  /*! Returns \c true when the last sort() refined the previous order, \c
+  false when it used the radix sort. */
+  bool lastSortWasRefined() const { return lastSortWasRefined_; }
+  //@}
+
+private:
+  void computeKeys(const GLdouble modelView[16], const float *positions,
+                   int nbPositions, int stride);
+  bool refine();
+  void radixSort();
+
+  QVector<quint32> order_;
+  QVector<quint32> keys_; // sortable view depths, of each position
+  // Radix sort buffers
+  QVector<quint32> sortedKeys_[2];
+  QVector<quint32> sortedIndices_;
+
+  qreal coherenceAngle_;
+  bool lastSortWasRefined_;
+  bool hasPreviousSort_;
+  Vec previousViewDirection_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_DEPTH_SORTER_H
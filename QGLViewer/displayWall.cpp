@@ -0,0 +1,322 @@
+#include "displayWall.h"
+#include "camera.h"
+#include "manipulatedCameraFrame.h"
+#include "qglviewer.h"
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+using namespace qglviewer;
+
+namespace {
+// Message types, followed by the frame number
+enum MessageType {
+  FRAME_MESSAGE, // master to slaves: the Camera view and the user data
+  READY_MESSAGE, // slave to master: the frame is drawn
+  SWAP_MESSAGE   // master to slaves: all the frames are drawn
+};
+
+void setStreamFormat(QDataStream &stream) {
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+// Messages are prefixed by their size in bytes
+void sendMessage(QIODevice *device, const QByteArray &message) {
+  QByteArray packet;
+  QDataStream out(&packet, QIODevice::WriteOnly);
+  setStreamFormat(out);
+  out << quint32(message.size());
+  packet.append(message);
+  device->write(packet);
+}
+
+QByteArray shortMessage(int type, quint64 frame) {
+  QByteArray message;
+  QDataStream out(&message, QIODevice::WriteOnly);
+  setStreamFormat(out);
+  out << quint8(type) << frame;
+  return message;
+}
+
+// Removes the first complete message of buffer, false if there is none yet
+bool takeMessage(QByteArray &buffer, QByteArray &message) {
+  if (buffer.size() < 4)
+    return false;
+  QDataStream in(buffer);
+  setStreamFormat(in);
+  quint32 size;
+  in >> size;
+  if (quint32(buffer.size() - 4) < size)
+    return false;
+  message = buffer.mid(4, int(size));
+  buffer.remove(0, 4 + int(size));
+  return true;
+}
+
+void messageHeader(const QByteArray &message, int &type, quint64 &frame) {
+  QDataStream in(message);
+  setStreamFormat(in);
+  quint8 t;
+  in >> t >> frame;
+  type = t;
+}
+} // namespace
+
+/*! Creates a DisplayWall node with the given \p role. Its connections are set
+using addSlave() or setMaster(), and it is used once given to
+QGLViewer::setDisplayWall(). */
+DisplayWall::DisplayWall(Role role, QObject *parent)
+    : QObject(parent), role_(role), barrierTimeout_(1000), frameNumber_(0),
+      pendingFrame_(0) {}
+
+/*! Virtual destructor. The viewer() no longer uses this DisplayWall. The
+connections are not closed. */
+DisplayWall::~DisplayWall() {
+  if (viewer_ && (viewer_->displayWall() == this))
+    viewer_->setDisplayWall(nullptr);
+}
+
+/*! Returns the QGLViewer whose frames are synchronized, set by
+QGLViewer::setDisplayWall(). */
+QGLViewer *DisplayWall::viewer() const { return viewer_; }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Nodes                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p device, an open connection to a SLAVE, to the MASTER. It receives
+the next frames. \p device is not owned by the DisplayWall: it is silently
+removed when it is destroyed. */
+void DisplayWall::addSlave(QIODevice *device) {
+  if (role_ != MASTER) {
+    qWarning("DisplayWall::addSlave: Only a MASTER has slaves");
+    return;
+  }
+  if (!device)
+    return;
+  for (int i = 0; i < slaves_.size(); ++i)
+    if (slaves_[i].device == device)
+      return;
+
+  Node node;
+  node.device = device;
+  slaves_.append(node);
+}
+
+/*! Removes \p device from the slaves of the MASTER. */
+void DisplayWall::removeSlave(QIODevice *device) {
+  for (int i = 0; i < slaves_.size(); ++i)
+    if (slaves_[i].device == device) {
+      slaves_.remove(i);
+      return;
+    }
+}
+
+/*! Sets \p device, an open connection to the MASTER, as the master() of this
+SLAVE. The received frames are applied to the viewer() Camera as soon as they
+are read, and the viewer() is updated. \p device is not owned by the
+DisplayWall. */
+void DisplayWall::setMaster(QIODevice *device) {
+  if (role_ != SLAVE) {
+    qWarning("DisplayWall::setMaster: Only a SLAVE has a master");
+    return;
+  }
+  if (master_.device)
+    disconnect(master_.device, SIGNAL(readyRead()), this, SLOT(readMaster()));
+  master_.device = device;
+  master_.buffer.clear();
+  pendingFrame_ = 0;
+  if (device) {
+    connect(device, SIGNAL(readyRead()), this, SLOT(readMaster()));
+    readMaster();
+  }
+}
+
+void DisplayWall::readMaster() {
+  if (!master_.device)
+    return;
+  master_.buffer.append(master_.device->readAll());
+
+  QByteArray message;
+  while (takeMessage(master_.buffer, message)) {
+    int type;
+    quint64 frame;
+    messageHeader(message, type, frame);
+    // A SWAP_MESSAGE only arrives here when the barrier timed out
+    if (type == FRAME_MESSAGE)
+      processFrameMessage(message);
+  }
+}
+
+void DisplayWall::processFrameMessage(const QByteArray &message) {
+  QDataStream in(message);
+  setStreamFormat(in);
+  quint8 type;
+  quint64 frame;
+  QByteArray userData;
+  in >> type >> frame;
+  if (viewer_)
+    readView(in, viewer_->camera());
+  in >> userData;
+
+  frameNumber_ = frame;
+  pendingFrame_ = frame;
+  Q_EMIT userDataReceived(userData);
+  if (viewer_)
+    viewer_->update();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Synchronization                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Called by the viewer() at the beginning of its QGLViewer::paintGL(), once
+its Camera is set for the frame. A MASTER sends the Camera view and the
+setUserData() to its slaves. Does nothing for a SLAVE. */
+void DisplayWall::beginFrame() {
+  if ((role_ != MASTER) || !viewer_)
+    return;
+  // Destroyed connections
+  for (int i = slaves_.size() - 1; i >= 0; --i)
+    if (!slaves_[i].device)
+      slaves_.remove(i);
+  if (slaves_.isEmpty())
+    return;
+
+  ++frameNumber_;
+  QByteArray message;
+  QDataStream out(&message, QIODevice::WriteOnly);
+  setStreamFormat(out);
+  out << quint8(FRAME_MESSAGE) << frameNumber_;
+  writeView(out, viewer_->camera());
+  out << userData_;
+  userData_.clear();
+
+  for (int i = 0; i < slaves_.size(); ++i)
+    sendMessage(slaves_[i].device, message);
+}
+
+/*! Called by the viewer() at the end of its QGLViewer::paintGL(), before its
+frame is presented. This is the barrier of the wall.
+
+A SLAVE that drew a frame received from its master waits for its completion,
+tells the master, and waits for the master's answer. A MASTER waits until all
+its slaves drew the frame sent by beginFrame() and then tells them to present
+it. Each wait lasts at most barrierTimeout(). */
+void DisplayWall::endFrame() {
+  if (role_ == MASTER) {
+    if (slaves_.isEmpty())
+      return;
+    for (int i = slaves_.size() - 1; i >= 0; --i)
+      if (!waitForMessage(slaves_[i], READY_MESSAGE, frameNumber_)) {
+        QIODevice *device = slaves_[i].device;
+        slaves_.remove(i);
+        if (device)
+          Q_EMIT slaveLost(device);
+      }
+
+    const QByteArray swap = shortMessage(SWAP_MESSAGE, frameNumber_);
+    for (int i = 0; i < slaves_.size(); ++i) {
+      sendMessage(slaves_[i].device, swap);
+      slaves_[i].device->waitForBytesWritten(barrierTimeout_);
+    }
+    return;
+  }
+
+  if (!master_.device || (pendingFrame_ == 0))
+    return;
+  // The frame is drawn before it is reported
+  if (QOpenGLContext::currentContext())
+    QOpenGLContext::currentContext()->functions()->glFinish();
+  sendMessage(master_.device, shortMessage(READY_MESSAGE, pendingFrame_));
+  master_.device->waitForBytesWritten(barrierTimeout_);
+  waitForMessage(master_, SWAP_MESSAGE, pendingFrame_);
+  pendingFrame_ = 0;
+  // A next frame may already be in the buffer, with no readyRead() to come
+  QMetaObject::invokeMethod(this, "readMaster", Qt::QueuedConnection);
+}
+
+// Blocks until a message of type and frame is read from node, at most
+// barrierTimeout(). Older messages are skipped. Returns false on timeout.
+bool DisplayWall::waitForMessage(Node &node, int type, quint64 frame) {
+  QElapsedTimer timer;
+  timer.start();
+  while (node.device) {
+    QByteArray message;
+    // Only the messages before the expected one are removed from the buffer,
+    // so that the next FRAME_MESSAGE is left to readMaster()
+    while (takeMessage(node.buffer, message)) {
+      int messageType;
+      quint64 messageFrame;
+      messageHeader(message, messageType, messageFrame);
+      if ((messageType == type) && (messageFrame == frame))
+        return true;
+    }
+
+    const int remaining = barrierTimeout_ - int(timer.elapsed());
+    if ((remaining <= 0) || !node.device->isOpen())
+      return false;
+    if (node.device->bytesAvailable() == 0)
+      node.device->waitForReadyRead(remaining);
+    node.buffer.append(node.device->readAll());
+  }
+  return false;
+}
+
+// The Camera parameters that define its projection and its pose. The order of
+// readView() matters: setType() and setPivotPoint() may change orthoCoef_.
+void DisplayWall::writeView(QDataStream &stream, const Camera *camera) {
+  stream << qint32(camera->type()) << double(camera->fieldOfView())
+         << double(camera->zNearCoefficient())
+         << double(camera->zClippingCoefficient())
+         << camera->reverseZIsEnabled() << double(camera->sceneRadius())
+         << camera->sceneCenter() << camera->pivotPoint()
+         << double(camera->orthoCoef_) << camera->position()
+         << camera->orientation();
+}
+
+void DisplayWall::readView(QDataStream &stream, Camera *camera) {
+  qint32 type;
+  double fieldOfView, zNearCoef, zClippingCoef, sceneRadius, orthoCoef;
+  bool reverseZ;
+  Vec sceneCenter, pivotPoint, position;
+  Quaternion orientation;
+  stream >> type >> fieldOfView >> zNearCoef >> zClippingCoef >> reverseZ >>
+      sceneRadius >> sceneCenter >> pivotPoint >> orthoCoef >> position >>
+      orientation;
+  if (stream.status() != QDataStream::Ok) {
+    qWarning("DisplayWall::readView: Invalid frame message");
+    return;
+  }
+
+  camera->setSceneRadius(sceneRadius);
+  camera->setSceneCenter(sceneCenter);
+  camera->setPivotPoint(pivotPoint);
+  camera->setType(Camera::Type(type));
+  camera->setFieldOfView(fieldOfView);
+  camera->setZNearCoefficient(zNearCoef);
+  camera->setZClippingCoefficient(zClippingCoef);
+  camera->setReverseZIsEnabled(reverseZ);
+  camera->orthoCoef_ = orthoCoef;
+  camera->projectionMatrixIsUpToDate_ = false;
+  camera->frame()->setPositionAndOrientation(position, orientation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Application data                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets data sent by the MASTER with its next frame. The slaves receive it in
+userDataReceived(), before they draw this frame. The data is sent once: call
+this method before each frame for a continuously changing state. */
+void DisplayWall::setUserData(const QByteArray &data) {
+  if (role_ != MASTER) {
+    qWarning("DisplayWall::setUserData: Only a MASTER sends user data");
+    return;
+  }
+  userData_ = data;
+}
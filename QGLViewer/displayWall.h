@@ -0,0 +1,154 @@
+#ifndef QGLVIEWER_DISPLAY_WALL_H
+#define QGLVIEWER_DISPLAY_WALL_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+#include "config.h"
+
+class QGLViewer;
+class QIODevice;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Synchronizes the viewers of a display wall, each displaying a tile
+  of the same Camera.
+  \class DisplayWall displayWall.h QGLViewer/displayWall.h
+
+  A display wall is made of several screens, driven by different processes or
+  computers. Each screen shows a Camera::tile() of the whole view: its viewer
+  renders the off-axis part of the frustum of the shared Camera at the native
+  resolution of the screen.
+
+  The MASTER viewer is the one the user interacts with. At the beginning of
+  each of its frames, it sends its Camera view to the SLAVE viewers, which
+  apply it and draw their tile. The frames are then presented together: each
+  slave reports that its frame is drawn and waits, before returning from its
+  QGLViewer::paintGL(), until the master received all the reports. A frame of
+  the wall hence takes as long as its slowest tile.
+
+  The processes communicate through any QIODevice, typically \c QTcpSocket
+  connections, which are created by the application:
+  \code
+  // Master
+  QTcpServer server;
+  server.listen(QHostAddress::Any, 4242);
+  qglviewer::DisplayWall *wall =
+      new qglviewer::DisplayWall(qglviewer::DisplayWall::MASTER, viewer);
+  viewer->setDisplayWall(wall);
+  connect(&server, &QTcpServer::newConnection, [&]() {
+    wall->addSlave(server.nextPendingConnection());
+  });
+
+  // Slave, displaying the right half of the wall
+  QTcpSocket *socket = new QTcpSocket(viewer);
+  socket->connectToHost(masterName, 4242);
+  qglviewer::DisplayWall *wall =
+      new qglviewer::DisplayWall(qglviewer::DisplayWall::SLAVE, viewer);
+  wall->setMaster(socket);
+  viewer->setDisplayWall(wall);
+  viewer->camera()->setTile(QRectF(0.5, 0.0, 0.5, 1.0));
+  \endcode
+
+  The whole wall must have the aspect ratio of the union of its tiles: the
+  screens of the tiles must have the same pixel size, proportional to the tile
+  size. The Camera parameters and pose are sent, not the scene: use
+  setUserData() and userDataReceived() to send the application state (the
+  animation time, the selection...) with each frame. The swaps are
+  synchronized by the barrier, not by the display hardware: use a swap
+  interval of 1 on all the nodes, and a fast network. */
+class QGLVIEWER_EXPORT DisplayWall : public QObject {
+  Q_OBJECT
+
+public:
+  /*! The role of the viewer in the wall. */
+  enum Role {
+    MASTER, /*!< Sends its Camera view to the slaves. */
+    SLAVE   /*!< Displays the Camera view of the master. */
+  };
+
+  explicit DisplayWall(Role role, QObject *parent = nullptr);
+  virtual ~DisplayWall();
+
+  /*! Returns the Role of the viewer, set at construction. */
+  Role role() const { return role_; }
+  QGLViewer *viewer() const;
+
+  /*! @name Nodes */
+  //@{
+public:
+  void addSlave(QIODevice *device);
+  void removeSlave(QIODevice *device);
+  /*! Returns the number of slaves connected to the MASTER. */
+  int nbSlaves() const { return slaves_.size(); }
+  void setMaster(QIODevice *device);
+  /*! Returns the connection of a SLAVE to its master. Set using setMaster(). */
+  QIODevice *master() const { return master_.device; }
+  //@}
+
+  /*! @name Synchronization */
+  //@{
+public:
+  /*! Returns the maximum time, in milliseconds, a node waits for the others at
+  the end of a frame. A slave that does not answer in time is removed (see
+  slaveLost()). Default value is 1000 ms. */
+  int barrierTimeout() const { return barrierTimeout_; }
+  /*! Sets the barrierTimeout(), in milliseconds. */
+  void setBarrierTimeout(int msecs) { barrierTimeout_ = qMax(1, msecs); }
+  /*! Returns the number of the last frame sent by the master, or received by
+  the slave. */
+  quint64 frameNumber() const { return frameNumber_; }
+
+  void beginFrame();
+  void endFrame();
+
+Q_SIGNALS:
+  /*! Signal emitted by the MASTER when a slave is removed, because it did not
+  reach the barrier in barrierTimeout(). Delete or close \p device. */
+  void slaveLost(QIODevice *device);
+  //@}
+
+  /*! @name Application data */
+  //@{
+public:
+  void setUserData(const QByteArray &data);
+
+Q_SIGNALS:
+  /*! Signal emitted by a SLAVE when a frame is received, with the data given
+  to setUserData() by the master, before the frame is drawn. */
+  void userDataReceived(const QByteArray &data);
+  //@}
+
+private Q_SLOTS:
+  void readMaster();
+
+private:
+  friend class ::QGLViewer;
+
+  // A connection, and its received bytes that were not processed yet
+  struct Node {
+    QPointer<QIODevice> device;
+    QByteArray buffer;
+  };
+
+  bool waitForMessage(Node &node, int type, quint64 frame);
+  void processFrameMessage(const QByteArray &message);
+  static void writeView(QDataStream &stream, const Camera *camera);
+  static void readView(QDataStream &stream, Camera *camera);
+
+  const Role role_;
+  QPointer<QGLViewer> viewer_;
+  QVector<Node> slaves_;
+  Node master_;
+  int barrierTimeout_;
+  quint64 frameNumber_;
+  quint64 pendingFrame_; // received by the slave, not drawn yet
+  QByteArray userData_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_DISPLAY_WALL_H
@@ -0,0 +1,269 @@
+#include "drawList.h"
+#include "camera.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+using namespace qglviewer;
+
+typedef void(QOPENGLF_APIENTRYP MultiDrawElementsIndirect)(
+    GLenum mode, GLenum type, const void *indirect, GLsizei drawcount,
+    GLsizei stride);
+typedef void(QOPENGLF_APIENTRYP MultiDrawElementsBaseVertex)(
+    GLenum mode, const GLsizei *count, GLenum type, const void *const *indices,
+    GLsizei drawcount, const GLint *basevertex);
+
+/*! Creates an empty DrawList. No OpenGL resource is created before the first
+draw(). */
+DrawList::DrawList()
+    : commandsAreUploaded_(false), initialized_(false), context_(nullptr),
+      functions_(nullptr), multiDrawIndirect_(nullptr),
+      multiDrawBaseVertex_(nullptr), commandBuffer_(0), commandBufferSize_(0),
+      baseVertexWarned_(false) {}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+draw() is current. Call cleanupGL() before otherwise. */
+DrawList::~DrawList() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Objects                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an object and returns its id. Its bounding box is defined by its
+\p min and \p max corners. Its \p nbIndices indices start at index \p
+firstIndex (not in bytes) of the bound index buffer, and \p baseVertex is added
+to each of them.
+
+The object is not visible before the next cull() or setAllObjectsVisible().
+Ids of removed objects (see removeObject()) are reused. */
+int DrawList::addObject(const Vec &min, const Vec &max, int firstIndex,
+                        int nbIndices, int baseVertex) {
+  const int id = culler_.addBox(min, max);
+  if (id >= ranges_.size())
+    ranges_.resize(id + 1);
+  Range &range = ranges_[id];
+  range.firstIndex = qMax(0, firstIndex);
+  range.nbIndices = qMax(0, nbIndices);
+  range.baseVertex = baseVertex;
+  range.used = true;
+  return id;
+}
+
+/*! Moves or resizes the bounding box of the object \p id. */
+void DrawList::setObjectBox(int id, const Vec &min, const Vec &max) {
+  if (!isValidId(id, "setObjectBox"))
+    return;
+  culler_.setBox(id, min, max);
+}
+
+/*! Changes the index range of the object \p id. See addObject(). Applies to
+the next cull(). */
+void DrawList::setObjectRange(int id, int firstIndex, int nbIndices,
+                              int baseVertex) {
+  if (!isValidId(id, "setObjectRange"))
+    return;
+  Range &range = ranges_[id];
+  range.firstIndex = qMax(0, firstIndex);
+  range.nbIndices = qMax(0, nbIndices);
+  range.baseVertex = baseVertex;
+}
+
+/*! Unregisters the object \p id. It is no longer drawn after the next
+cull(). */
+void DrawList::removeObject(int id) {
+  if (!isValidId(id, "removeObject"))
+    return;
+  culler_.removeObject(id);
+  ranges_[id].used = false;
+}
+
+/*! Unregisters all the objects. Nothing is drawn by draw() until new objects
+are added and culled. */
+void DrawList::clear() {
+  culler_.clear();
+  ranges_.clear();
+  visible_.clear();
+  updateCommands();
+}
+
+bool DrawList::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= ranges_.size()) || !ranges_.at(id).used) {
+    qWarning("DrawList::%s: Invalid object id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Culling                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Finds the objects whose bounding box intersects the \p camera frustum, and
+writes their draw commands. Returns the number of visible objects. */
+int DrawList::cull(const Camera *camera) {
+  GLdouble coef[6][4];
+  camera->getFrustumPlanesCoefficients(coef);
+  return cull(coef);
+}
+
+/*! Same as cull(const Camera*), with the planes given by
+Camera::getFrustumPlanesCoefficients(). Use it for other culling volumes
+(shadow map frustums, viewports...). */
+int DrawList::cull(const GLdouble coef[6][4]) {
+  culler_.computeVisibleObjects(coef, visible_);
+  updateCommands();
+  return visible_.size();
+}
+
+/*! Makes all the objects visible, in id order, without any culling. */
+void DrawList::setAllObjectsVisible() {
+  visible_.clear();
+  visible_.reserve(nbObjects());
+  for (int id = 0; id < ranges_.size(); ++id)
+    if (ranges_.at(id).used)
+      visible_.append(id);
+  updateCommands();
+}
+
+// Fills commands_ from visible_. Empty ranges are skipped.
+void DrawList::updateCommands() {
+  commands_.clear();
+  commands_.reserve(visible_.size());
+  for (QVector<int>::const_iterator it = visible_.begin(), end = visible_.end();
+       it != end; ++it) {
+    const Range &range = ranges_.at(*it);
+    if (range.nbIndices == 0)
+      continue;
+    Command command;
+    command.count = GLuint(range.nbIndices);
+    command.instanceCount = 1;
+    command.firstIndex = GLuint(range.firstIndex);
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = GLuint(*it);
+    commands_.append(command);
+  }
+  commandsAreUploaded_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// Resolves the multi draw functions of the current context
+void DrawList::initializeGL() {
+  initialized_ = true;
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("DrawList::draw: No current OpenGL context");
+    return;
+  }
+  context_ = context;
+  functions_ = context->extraFunctions();
+
+  if (context->isOpenGLES())
+    return;
+  const QPair<int, int> version = context->format().version();
+  if ((version >= qMakePair(4, 3)) ||
+      context->hasExtension("GL_ARB_multi_draw_indirect"))
+    multiDrawIndirect_ = context->getProcAddress("glMultiDrawElementsIndirect");
+  if ((version >= qMakePair(3, 2)) ||
+      context->hasExtension("GL_ARB_draw_elements_base_vertex"))
+    multiDrawBaseVertex_ =
+        context->getProcAddress("glMultiDrawElementsBaseVertex");
+}
+
+/*! Draws the visibleObjects() as \p mode primitives (\c GL_TRIANGLES...). The
+vertex arrays and the \c GL_ELEMENT_ARRAY_BUFFER of the objects must be bound,
+and \p indexType is the type of its indices (\c GL_UNSIGNED_INT, \c
+GL_UNSIGNED_SHORT or \c GL_UNSIGNED_BYTE).
+
+The draw commands are uploaded in an indirect buffer after each cull(). */
+void DrawList::draw(GLenum mode, GLenum indexType) {
+  if (!initialized_)
+    initializeGL();
+  if (!functions_ || commands_.isEmpty())
+    return;
+
+  if (multiDrawIndirect_) {
+    if (!commandsAreUploaded_) {
+      if (!commandBuffer_)
+        functions_->glGenBuffers(1, &commandBuffer_);
+      functions_->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer_);
+      const int size = commands_.size() * int(sizeof(Command));
+      // Orphans the previous commands, possibly still read by the GPU
+      if (size > commandBufferSize_) {
+        commandBufferSize_ = size;
+        functions_->glBufferData(GL_DRAW_INDIRECT_BUFFER, size,
+                                 commands_.constData(), GL_STREAM_DRAW);
+      } else {
+        functions_->glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBufferSize_,
+                                 nullptr, GL_STREAM_DRAW);
+        functions_->glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size,
+                                    commands_.constData());
+      }
+      commandsAreUploaded_ = true;
+    } else
+      functions_->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer_);
+
+    reinterpret_cast<MultiDrawElementsIndirect>(multiDrawIndirect_)(
+        mode, indexType, nullptr, GLsizei(commands_.size()), 0);
+    functions_->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return;
+  }
+
+  // Byte offsets of the ranges in the index buffer
+  const int indexSize = (indexType == GL_UNSIGNED_BYTE)    ? 1
+                        : (indexType == GL_UNSIGNED_SHORT) ? 2
+                                                           : 4;
+  const int nb = commands_.size();
+  counts_.resize(nb);
+  offsets_.resize(nb);
+  baseVertices_.resize(nb);
+  bool hasBaseVertex = false;
+  for (int i = 0; i < nb; ++i) {
+    const Command &command = commands_.at(i);
+    counts_[i] = GLsizei(command.count);
+    offsets_[i] = reinterpret_cast<const void *>(
+        quintptr(command.firstIndex) * quintptr(indexSize));
+    baseVertices_[i] = command.baseVertex;
+    hasBaseVertex = hasBaseVertex || (command.baseVertex != 0);
+  }
+
+  if (multiDrawBaseVertex_) {
+    reinterpret_cast<MultiDrawElementsBaseVertex>(multiDrawBaseVertex_)(
+        mode, counts_.constData(), indexType, offsets_.constData(), nb,
+        baseVertices_.constData());
+    return;
+  }
+
+  if (hasBaseVertex && !baseVertexWarned_) {
+    qWarning("DrawList::draw: Base vertices are not supported by this OpenGL "
+             "context and are ignored");
+    baseVertexWarned_ = true;
+  }
+  for (int i = 0; i < nb; ++i)
+    functions_->glDrawElements(mode, counts_.at(i), indexType,
+                               offsets_.at(i));
+}
+
+/*! Releases the indirect command buffer. The context used by draw() must be
+current. The functions are resolved again by the next draw(). */
+void DrawList::cleanupGL() {
+  if (functions_ && commandBuffer_)
+    functions_->glDeleteBuffers(1, &commandBuffer_);
+  commandBuffer_ = 0;
+  commandBufferSize_ = 0;
+  commandsAreUploaded_ = false;
+  functions_ = nullptr;
+  multiDrawIndirect_ = nullptr;
+  multiDrawBaseVertex_ = nullptr;
+  context_ = nullptr;
+  initialized_ = false;
+}
@@ -0,0 +1,147 @@
+#ifndef QGLVIEWER_DRAW_LIST_H
+#define QGLVIEWER_DRAW_LIST_H
+
+#include "frustumCuller.h"
+
+#include <QVector>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Draws the visible objects of a shared index buffer with a handful of
+  OpenGL calls.
+  \class DrawList drawList.h QGLViewer/drawList.h
+
+  Scenes made of many small objects are usually drawn with one \c
+  glDrawElements() call per visible object, and their frame time is then
+  dominated by the driver overhead. When the objects are stored in shared
+  vertex and index buffers, a DrawList registers the index range and the
+  bounding box of each object with addObject(). cull() tests the boxes against
+  the Camera frustum with a FrustumCuller hierarchy and writes one indirect
+  draw command per visible object. draw() then renders them, with your vertex
+  array and index buffer bound, in a single \c glMultiDrawElementsIndirect()
+  call:
+  \code
+  void Viewer::init() {
+    // All the meshes are stored in vao_, indices in a GL_ELEMENT_ARRAY_BUFFER
+    for (int i = 0; i < nbMeshes; ++i)
+      drawList_.addObject(mesh[i].min, mesh[i].max, mesh[i].firstIndex,
+                          mesh[i].nbIndices, mesh[i].baseVertex);
+  }
+
+  void Viewer::draw() {
+    drawList_.cull(camera());
+    vao_.bind();
+    drawList_.draw(GL_TRIANGLES, GL_UNSIGNED_INT);
+    vao_.release();
+  }
+  \endcode
+
+  The \c baseInstance of the command of an object is its id: an instanced
+  vertex attribute (with a divisor of 1) or \c gl_BaseInstance in a shader
+  hence retrieves per-object data (transformation, material...) from a
+  buffer indexed by object id.
+
+  The indirect draw requires OpenGL 4.3 or the \c GL_ARB_multi_draw_indirect
+  extension. Otherwise, draw() uses a single \c glMultiDrawElementsBaseVertex()
+  call (OpenGL 3.2 or \c GL_ARB_draw_elements_base_vertex), or one \c
+  glDrawElements() per visible object as a last resort, without the base
+  vertex and base instance. The culling always runs on the CPU: the hierarchy
+  culls hundreds of thousands of objects in a fraction of a millisecond, and
+  works in compatibility contexts without compute shaders.
+
+  The OpenGL methods (draw() and cleanupGL()) must be called with the same
+  context current. Call cleanupGL() with this context current before the
+  DrawList is destroyed. */
+class QGLVIEWER_EXPORT DrawList {
+public:
+  DrawList();
+  ~DrawList();
+
+  /*! @name Objects */
+  //@{
+public:
+  int addObject(const Vec &min, const Vec &max, int firstIndex, int nbIndices,
+                int baseVertex = 0);
+  void setObjectBox(int id, const Vec &min, const Vec &max);
+  void setObjectRange(int id, int firstIndex, int nbIndices,
+                      int baseVertex = 0);
+  void removeObject(int id);
+  void clear();
+
+  /*! Returns the number of registered objects. */
+  int nbObjects() const { return culler_.nbObjects(); }
+  //@}
+
+  /*! @name Culling */
+  //@{
+public:
+  int cull(const Camera *camera);
+  int cull(const GLdouble coef[6][4]);
+  void setAllObjectsVisible();
+
+  /*! Returns the ids of the objects drawn by draw(), as found by the last
+  cull(). */
+  const QVector<int> &visibleObjects() const { return visible_; }
+  /*! Returns the FrustumCuller used by cull(). Its objects are managed by the
+  DrawList: only change its FrustumCuller::maximumLeafSize(). */
+  FrustumCuller &frustumCuller() { return culler_; }
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  void draw(GLenum mode, GLenum indexType = GL_UNSIGNED_INT);
+  /*! Returns \c true when draw() uses \c glMultiDrawElementsIndirect(). Only
+  meaningful after the first draw(). */
+  bool usesIndirectDraw() const { return multiDrawIndirect_ != nullptr; }
+  void cleanupGL();
+  //@}
+
+private:
+  Q_DISABLE_COPY(DrawList)
+
+  // The layout of a DrawElementsIndirectCommand
+  struct Command {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  struct Range {
+    int firstIndex, nbIndices, baseVertex;
+    bool used;
+  };
+
+  bool isValidId(int id, const char *method) const;
+  void updateCommands();
+  void initializeGL();
+
+  FrustumCuller culler_;
+  QVector<Range> ranges_; // indexed by object id
+  QVector<int> visible_;
+  QVector<Command> commands_;
+  bool commandsAreUploaded_;
+
+  // O p e n G L
+  bool initialized_;
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  QFunctionPointer multiDrawIndirect_;   // nullptr when not supported
+  QFunctionPointer multiDrawBaseVertex_; // idem
+  GLuint commandBuffer_;
+  int commandBufferSize_; // in bytes
+  QVector<GLsizei> counts_;
+  QVector<const void *> offsets_;
+  QVector<GLint> baseVertices_;
+  bool baseVertexWarned_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_DRAW_LIST_H
@@ -0,0 +1,256 @@
+#include "editableVertexBuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#endif
+
+using namespace qglviewer;
+
+/*! Creates an empty EditableVertexBuffer. Use create() to allocate it. */
+EditableVertexBuffer::EditableVertexBuffer()
+    : mergeDistance_(256), lastUploadSize_(0), context_(nullptr),
+      functions_(nullptr), buffer_(0), staging_(0), mapped_(nullptr),
+      stagingSize_(3 * 1024 * 1024), regionSize_(0), region_(0) {
+  for (int i = 0; i < nbRegions; ++i)
+    fences_[i] = nullptr;
+}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+create() is current. Call cleanupGL() before otherwise. */
+EditableVertexBuffer::~EditableVertexBuffer() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Creates the OpenGL buffer with the given \p usage, and uploads \p data in
+it. data() is a copy of \p data. An OpenGL context must be current. The
+previous content of the buffer is lost.
+
+Returns \c false when no context is current or when \p data is empty. */
+bool EditableVertexBuffer::create(const QByteArray &data, GLenum usage) {
+  cleanupGL();
+
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context || data.isEmpty()) {
+    qWarning("EditableVertexBuffer::create: empty data or no current OpenGL "
+             "context");
+    return false;
+  }
+  context_ = context;
+  functions_ = context->extraFunctions();
+  data_ = data;
+  // Detached now, so that data() does not copy it later
+  data_.detach();
+
+  functions_->glGenBuffers(1, &buffer_);
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+  functions_->glBufferData(GL_ARRAY_BUFFER, data_.size(), data_.constData(),
+                           usage);
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  typedef void(QOPENGLF_APIENTRYP BufferStorage)(
+      GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+  BufferStorage bufferStorage = nullptr;
+  if (!context->isOpenGLES() &&
+      ((context->format().version() >= qMakePair(4, 4)) ||
+       context->hasExtension("GL_ARB_buffer_storage")))
+    bufferStorage = reinterpret_cast<BufferStorage>(
+        context->getProcAddress("glBufferStorage"));
+
+  // The staging buffer is never larger than the vertex buffer
+  regionSize_ = (qMin(stagingSize_ / nbRegions, data_.size()) + 255) & ~255;
+  if (bufferStorage && (regionSize_ > 0)) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    functions_->glGenBuffers(1, &staging_);
+    functions_->glBindBuffer(GL_COPY_READ_BUFFER, staging_);
+    bufferStorage(GL_COPY_READ_BUFFER, nbRegions * regionSize_, nullptr,
+                  flags);
+    mapped_ = static_cast<char *>(functions_->glMapBufferRange(
+        GL_COPY_READ_BUFFER, 0, nbRegions * regionSize_, flags));
+    functions_->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if (!mapped_) {
+      qWarning("EditableVertexBuffer::create: unable to map the staging "
+               "buffer, using glBufferSubData()");
+      functions_->glDeleteBuffers(1, &staging_);
+      staging_ = 0;
+    }
+  }
+
+  region_ = 0;
+  ranges_.clear();
+  lastUploadSize_ = 0;
+  return true;
+}
+
+/*! Releases the OpenGL buffers. The context used by create() must be current.
+size() is then 0 until the next create(). */
+void EditableVertexBuffer::cleanupGL() {
+  if (functions_) {
+    for (int i = 0; i < nbRegions; ++i)
+      if (fences_[i])
+        functions_->glDeleteSync(fences_[i]);
+    // Deleting the buffer also unmaps it
+    if (staging_)
+      functions_->glDeleteBuffers(1, &staging_);
+    if (buffer_)
+      functions_->glDeleteBuffers(1, &buffer_);
+  }
+
+  for (int i = 0; i < nbRegions; ++i)
+    fences_[i] = nullptr;
+  buffer_ = staging_ = 0;
+  mapped_ = nullptr;
+  data_.clear();
+  ranges_.clear();
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+/*! Sets the stagingSize(), in bytes. Only the next create() is affected. */
+void EditableVertexBuffer::setStagingSize(int size) {
+  stagingSize_ = qMax(size, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Edition                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Tells that the \p size bytes of data() starting at \p offset were modified.
+They are uploaded by the next upload(). The range is clamped to the buffer.
+
+The range is merged with the modified ranges that overlap it, or are less than
+mergeDistance() bytes apart. */
+void EditableVertexBuffer::markModified(int offset, int size) {
+  int begin = qMax(offset, 0);
+  int end = qMin(offset + size, data_.size());
+  if ((size <= 0) || (begin >= end))
+    return;
+
+  // The first range that ends close enough to begin
+  const int distance = mergeDistance_;
+  QVector<Range>::iterator first = std::lower_bound(
+      ranges_.begin(), ranges_.end(), begin,
+      [distance](const Range &r, int b) { return r.end + distance < b; });
+  QVector<Range>::iterator last = first;
+  while ((last != ranges_.end()) && (last->begin <= end + distance)) {
+    begin = qMin(begin, last->begin);
+    end = qMax(end, last->end);
+    ++last;
+  }
+
+  Range range;
+  range.begin = begin;
+  range.end = end;
+  if (first == last)
+    ranges_.insert(first, range);
+  else {
+    *first = range;
+    ranges_.erase(first + 1, last);
+  }
+}
+
+/*! Copies the \p size bytes of \p data at \p offset in data(), and marks them
+modified. \p data must fit in the buffer. */
+void EditableVertexBuffer::write(int offset, const void *data, int size) {
+  if ((offset < 0) || (size < 0) || (offset + size > data_.size())) {
+    qWarning("EditableVertexBuffer::write: range out of the buffer");
+    return;
+  }
+  memcpy(data_.data() + offset, data, size);
+  markModified(offset, size);
+}
+
+/*! Returns the number of bytes that upload() will copy, merged gaps
+included. */
+int EditableVertexBuffer::nbModifiedBytes() const {
+  int nb = 0;
+  for (int i = 0; i < ranges_.size(); ++i)
+    nb += ranges_[i].end - ranges_[i].begin;
+  return nb;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Upload                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Uploads the ranges modified since the previous upload() to the buffer().
+Does nothing when nothing was modified. Call it in \c draw(), before the
+buffer is used.
+
+With a staging buffer, the ranges are written in its next region, and copied
+by the GPU. This only waits when this region is still read by the copies of
+three uploads ago. */
+void EditableVertexBuffer::upload() {
+  lastUploadSize_ = 0;
+  if (ranges_.isEmpty() || !functions_)
+    return;
+
+  // Copies are 16 bytes aligned in the staging buffer
+  int stagingBytes = 0;
+  for (int i = 0; i < ranges_.size(); ++i)
+    stagingBytes += (ranges_[i].end - ranges_[i].begin + 15) & ~15;
+
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+  if (mapped_ && (stagingBytes <= regionSize_)) {
+    waitForRegion(region_);
+    const int regionOffset = region_ * regionSize_;
+    int offset = 0;
+    functions_->glBindBuffer(GL_COPY_READ_BUFFER, staging_);
+    for (int i = 0; i < ranges_.size(); ++i) {
+      const Range &r = ranges_[i];
+      const int size = r.end - r.begin;
+      memcpy(mapped_ + regionOffset + offset, data_.constData() + r.begin,
+             size);
+      functions_->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER,
+                                      regionOffset + offset, r.begin, size);
+      offset += (size + 15) & ~15;
+      lastUploadSize_ += size;
+    }
+    functions_->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    fences_[region_] =
+        functions_->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region_ = (region_ + 1) % nbRegions;
+  } else
+    for (int i = 0; i < ranges_.size(); ++i) {
+      const Range &r = ranges_[i];
+      functions_->glBufferSubData(GL_ARRAY_BUFFER, r.begin, r.end - r.begin,
+                                  data_.constData() + r.begin);
+      lastUploadSize_ += r.end - r.begin;
+    }
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, 0);
+  ranges_.clear();
+}
+
+// Blocks until the copies that read region are completed. Usually immediate,
+// the region having been used three uploads ago.
+void EditableVertexBuffer::waitForRegion(int region) {
+  if (!fences_[region])
+    return;
+
+  GLenum status = GL_TIMEOUT_EXPIRED;
+  while (status == GL_TIMEOUT_EXPIRED)
+    status = functions_->glClientWaitSync(
+        fences_[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 second
+  if (status == GL_WAIT_FAILED)
+    qWarning("EditableVertexBuffer::upload: wait for OpenGL failed");
+
+  functions_->glDeleteSync(fences_[region]);
+  fences_[region] = nullptr;
+}
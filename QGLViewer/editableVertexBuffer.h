@@ -0,0 +1,151 @@
+#ifndef QGLVIEWER_EDITABLE_VERTEX_BUFFER_H
+#define QGLVIEWER_EDITABLE_VERTEX_BUFFER_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+/*! \brief A vertex buffer with a copy in memory, of which only the modified
+  ranges are uploaded.
+  \class EditableVertexBuffer editableVertexBuffer.h
+  QGLViewer/editableVertexBuffer.h
+
+  Editing a few vertices of a large mesh (a vertex dragged with a
+  ManipulatedFrame for instance) should not upload the whole vertex buffer
+  again. An EditableVertexBuffer keeps a copy of the buffer content in
+  memory. The application modifies this data() and tells which bytes were
+  changed with markModified(). The modified ranges are merged, and upload()
+  only sends these ranges to the OpenGL buffer, once per frame:
+  \code
+  void Viewer::init() {
+    vertices_.create(meshVertices);
+    connect(&vertexFrame_, SIGNAL(manipulated()), SLOT(moveVertex()));
+  }
+
+  void Viewer::moveVertex() {
+    const qglviewer::Vec p = vertexFrame_.position();
+    GLfloat *v = reinterpret_cast<GLfloat *>(vertices_.data()) + 3 * selected_;
+    v[0] = p.x;
+    v[1] = p.y;
+    v[2] = p.z;
+    vertices_.markModified(3 * selected_ * sizeof(GLfloat),
+                           3 * sizeof(GLfloat));
+  }
+
+  void Viewer::draw() {
+    vertices_.upload();
+    glBindBuffer(GL_ARRAY_BUFFER, vertices_.buffer());
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, nullptr);
+    glDrawElements(GL_TRIANGLES, nbIndices, GL_UNSIGNED_INT, indices);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  \endcode
+
+  The modified ranges that are less than mergeDistance() bytes apart are
+  merged, so that many small edits result in a few copies. With OpenGL 4.4 or
+  the \c GL_ARB_buffer_storage extension, the ranges are written in a
+  persistently mapped staging buffer, and copied by the GPU in the vertex
+  buffer: upload() never waits for the draws that use the buffer. The staging
+  buffer is divided into three regions, protected by fences, used in turn as a
+  ring. The uploads larger than a region, and all the uploads without buffer
+  storage, are done with \c glBufferSubData().
+
+  The OpenGL methods (create(), upload() and cleanupGL()) must be called with
+  the same context current. Call cleanupGL() with this context current before
+  the EditableVertexBuffer is destroyed. */
+class QGLVIEWER_EXPORT EditableVertexBuffer {
+public:
+  EditableVertexBuffer();
+  ~EditableVertexBuffer();
+
+  /*! @name Creation */
+  //@{
+public:
+  bool create(const QByteArray &data, GLenum usage = GL_DYNAMIC_DRAW);
+  void cleanupGL();
+
+  /*! Returns the size of the buffer, in bytes. Returns 0 before create(). */
+  int size() const { return data_.size(); }
+  /*! Returns the OpenGL buffer object, to bind as a \c GL_ARRAY_BUFFER. Call
+  upload() first. */
+  GLuint buffer() const { return buffer_; }
+  /*! Returns \c true when the modified ranges are copied through a
+  persistently mapped staging buffer. */
+  bool usesStagingBuffer() const { return mapped_ != nullptr; }
+
+  /*! Returns the size of the staging buffer, in bytes. The largest upload
+  done through the staging buffer is a third of it. Default value is 3 MB. */
+  int stagingSize() const { return stagingSize_; }
+  void setStagingSize(int size);
+  //@}
+
+  /*! @name Edition */
+  //@{
+public:
+  /*! Returns the content of the buffer. Call markModified() after modifying
+  it. The pointer is invalidated by create() and cleanupGL(). */
+  char *data() { return data_.data(); }
+  /*! Returns the content of the buffer. */
+  const char *constData() const { return data_.constData(); }
+
+  void markModified(int offset, int size);
+  void write(int offset, const void *data, int size);
+
+  /*! Returns the number of ranges that upload() will copy. */
+  int nbModifiedRanges() const { return ranges_.size(); }
+  int nbModifiedBytes() const;
+
+  /*! Returns the distance, in bytes, under which two modified ranges are
+  merged in a single copy. Default value is 256. */
+  int mergeDistance() const { return mergeDistance_; }
+  /*! Sets the mergeDistance(). Only the next markModified() are affected. */
+  void setMergeDistance(int distance) { mergeDistance_ = qMax(distance, 0); }
+  //@}
+
+  /*! @name Upload */
+  //@{
+public:
+  void upload();
+  /*! Returns the number of bytes copied by the last upload(). */
+  int lastUploadSize() const { return lastUploadSize_; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(EditableVertexBuffer)
+
+  struct Range {
+    int begin;
+    int end;
+  };
+
+  void waitForRegion(int region);
+
+  static const int nbRegions = 3;
+
+  QByteArray data_;
+  QVector<Range> ranges_; // sorted, separated by more than mergeDistance_
+  int mergeDistance_;
+  int lastUploadSize_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  GLuint buffer_;
+  GLuint staging_;
+  char *mapped_; // nullptr without staging buffer
+  GLsync fences_[nbRegions];
+  int stagingSize_;
+  int regionSize_;
+  int region_; // the next one to write
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_EDITABLE_VERTEX_BUFFER_H
@@ -1,7 +1,14 @@
 #include "frame.h"
 #include "domUtils.h"
+#include "frameData.h"
+#include "hotPathCounters.h"
+#include "modificationBatch.h"
+#include "traceRecorder.h"
 #include <math.h>
 
+#include <QAtomicInt>
+#include <QDataStream>
+
 using namespace qglviewer;
 using namespace std;
 
@@ -9,7 +16,42 @@ using namespace std;
 
   Its position() is (0,0,0) and it has an identity orientation() Quaternion. The
   referenceFrame() and the constraint() are \c nullptr. */
-Frame::Frame() : constraint_(nullptr), referenceFrame_(nullptr) {}
+Frame::Frame()
+    : constraint_(nullptr), referenceFrame_(nullptr),
+      worldTransformIsUpToDate_(false) {}
+
+/*! Virtual destructor.
+
+  The Frame is removed from its referenceFrame() children. Frames that use this
+  Frame as their referenceFrame() are reset to the world coordinate system
+  (their referenceFrame() is set to \c nullptr). */
+Frame::~Frame() {
+  ModificationBatch::forget(this);
+  if (referenceFrame_)
+    referenceFrame_->children_.removeOne(this);
+  Q_FOREACH (Frame *child, children_) {
+    child->referenceFrame_ = nullptr;
+    child->invalidateWorldTransform();
+  }
+}
+
+static QAtomicInt frameModifications;
+
+// Emits modified(), unless a ModificationBatch defers it
+void Frame::emitModified() {
+  frameModifications.fetchAndAddRelaxed(1);
+  if (!ModificationBatch::deferModified(this)) {
+    TraceRecorder::addInstantEvent("frame", "modified");
+    QGLVIEWER_COUNT(FRAME_MODIFIED);
+    Q_EMIT modified();
+  }
+}
+
+/*! Returns the number of modifications of all the Frames since the start of
+the application, including the ones whose modified() signal is deferred by a
+ModificationBatch. The count wraps around. Compare two values to know whether a
+Frame was modified in between, as QGLViewer::isIdle() does. */
+int Frame::nbModifications() { return frameModifications.loadRelaxed(); }
 
 /*! Creates a Frame with a position() and an orientation().
 
@@ -19,7 +61,8 @@ Frame::Frame() : constraint_(nullptr), referenceFrame_(nullptr) {}
  The Frame is defined in the world coordinate system (its referenceFrame() is \c
  nullptr). It has a \c nullptr associated constraint(). */
 Frame::Frame(const Vec &position, const Quaternion &orientation)
-    : t_(position), q_(orientation), constraint_(nullptr), referenceFrame_(nullptr) {}
+    : t_(position), q_(orientation), constraint_(nullptr),
+      referenceFrame_(nullptr), worldTransformIsUpToDate_(false) {}
 
 /*! Equal operator.
 
@@ -39,7 +82,40 @@ Frame &Frame::operator=(const Frame &frame) {
 
   The translation() and rotation() as well as constraint() and referenceFrame()
   pointers are copied. */
-Frame::Frame(const Frame &frame) : QObject() { (*this) = frame; }
+Frame::Frame(const Frame &frame)
+    : QObject(), constraint_(nullptr), referenceFrame_(nullptr),
+      worldTransformIsUpToDate_(false) {
+  (*this) = frame;
+}
+
+// Marks the cached world transform of the Frame and of all its descendants as
+// out of date. A Frame is only up to date when its ancestors are, hence the
+// early exit.
+void Frame::invalidateWorldTransform() const {
+  if (!worldTransformIsUpToDate_)
+    return;
+  worldTransformIsUpToDate_ = false;
+  Q_FOREACH (const Frame *child, children_)
+    child->invalidateWorldTransform();
+}
+
+// Lazily computes the world position and orientation of the Frame, from the
+// (recursively cached) values of its referenceFrame().
+void Frame::updateWorldTransform() const {
+  if (worldTransformIsUpToDate_)
+    return;
+
+  if (referenceFrame_) {
+    referenceFrame_->updateWorldTransform();
+    worldOrientation_ = referenceFrame_->worldOrientation_ * q_;
+    worldPosition_ = referenceFrame_->worldOrientation_.rotate(t_) +
+                     referenceFrame_->worldPosition_;
+  } else {
+    worldOrientation_ = q_;
+    worldPosition_ = t_;
+  }
+  worldTransformIsUpToDate_ = true;
+}
 
 /////////////////////////////// MATRICES //////////////////////////////////////
 
@@ -174,10 +250,13 @@ const GLdouble *Frame::worldMatrix() const {
   // This test is done for efficiency reasons (creates lots of temp objects
   // otherwise).
   if (referenceFrame()) {
-    static Frame fr;
-    fr.setTranslation(position());
-    fr.setRotation(orientation());
-    return fr.matrix();
+    static GLdouble m[4][4];
+    updateWorldTransform();
+    worldOrientation_.getMatrix(m);
+    m[3][0] = worldPosition_[0];
+    m[3][1] = worldPosition_[1];
+    m[3][2] = worldPosition_[2];
+    return (const GLdouble *)(m);
   } else
     return matrix();
 }
@@ -199,6 +278,25 @@ void Frame::getWorldMatrix(GLdouble m[16]) const {
     m[i] = mat[i];
 }
 
+/*! Fills \p m with the worldMatrix(), translated by -\p origin and converted
+to \c GLfloat. The translation is computed in double, so that \p m is precise
+with huge world coordinates. Use with Camera::getRelativeModelViewMatrix() and
+a Camera::renderOrigin() \p origin.
+
+With \c QGLVIEWER_SINGLE_PRECISION, position() and \p origin are stored in
+\c float: their difference is still exact, but their own precision is only
+the one of \c float. */
+void Frame::getRelativeWorldMatrix(const Vec &origin, GLfloat m[16]) const {
+  GLdouble mat[16];
+  orientation().getMatrix(mat);
+  const Vec p = position();
+  // Vec arithmetic would round the difference to Real
+  for (int i = 0; i < 3; ++i)
+    mat[12 + i] = double(p[i]) - double(origin[i]);
+  for (int i = 0; i < 16; ++i)
+    m[i] = float(mat[i]);
+}
+
 /*! This is an overloaded method provided for convenience. Same as
  * setFromMatrix(). */
 void Frame::setFromMatrix(const GLdouble m[4][4]) {
@@ -215,7 +313,8 @@ void Frame::setFromMatrix(const GLdouble m[4][4]) {
       rot[i][j] = m[j][i] / m[3][3];
   }
   q_.setFromRotationMatrix(rot);
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Sets the Frame from an OpenGL matrix representation (rotation in the upper
@@ -251,6 +350,33 @@ void Frame::setFromMatrix(const GLdouble m[16]) {
   setFromMatrix(mat);
 }
 
+/*! Calls setFromMatrix() on each of the \p nb \p frames, with the matrix of
+ the same index in \p matrices, which holds \p nb OpenGL matrices one after
+ the other (16 values each).
+
+ The matrices are decomposed all at once by FrameData::fromMatrices(), which is
+ much faster than a loop over setFromMatrix() when thousands of Frames are
+ imported from an external system. The modified() signals are emitted at the
+ end, once per Frame, as with a ModificationBatch: the connected slots see all
+ the frames updated. A matrix with a null homogeneous coefficient leaves its
+ Frame unchanged. */
+void Frame::setFromMatrices(Frame *const frames[], const GLdouble *matrices,
+                            int nb) {
+  QVector<FrameData> data(nb);
+  for (int i = 0; i < nb; ++i)
+    data[i] = FrameData(*frames[i]);
+  FrameData::fromMatrices(matrices, nb, data.data());
+
+  ModificationBatch batch;
+  for (int i = 0; i < nb; ++i) {
+    Frame *const frame = frames[i];
+    frame->t_ = data[i].translation();
+    frame->q_ = data[i].rotation();
+    frame->invalidateWorldTransform();
+    frame->emitModified();
+  }
+}
+
 //////////////////// SET AND GET LOCAL TRANSLATION AND ROTATION
 //////////////////////////////////
 
@@ -306,7 +432,8 @@ void Frame::translate(Vec &t) {
   if (constraint())
     constraint()->constrainTranslation(t, this);
   t_ += t;
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Same as translate(const Vec&) but with \c qreal parameters. */
@@ -346,7 +473,8 @@ void Frame::rotate(Quaternion &q) {
     constraint()->constrainRotation(q, this);
   q_ *= q;
   q_.normalize(); // Prevents numerical drift
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Same as rotate(Quaternion&) but with \c qreal Quaternion parameters. */
@@ -390,7 +518,8 @@ void Frame::rotateAroundPoint(Quaternion &rotation, const Vec &point) {
   if (constraint())
     constraint()->constrainTranslation(trans, this);
   t_ += trans;
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Same as rotateAroundPoint(), but with a \c const \p rotation Quaternion.
@@ -436,7 +565,8 @@ void Frame::setPositionAndOrientation(const Vec &position,
     t_ = position;
     q_ = orientation;
   }
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Same as successive calls to setTranslation() and then setRotation().
@@ -448,7 +578,8 @@ void Frame::setTranslationAndRotation(const Vec &translation,
                                       const Quaternion &rotation) {
   t_ = translation;
   q_ = rotation;
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! \p x, \p y and \p z are set to the position() of the Frame. */
@@ -495,22 +626,21 @@ void Frame::getOrientation(qreal &q0, qreal &q1, qreal &q2, qreal &q3) const {
 /*! Returns the position of the Frame, defined in the world coordinate system.
    See also orientation(), setPosition() and translation(). */
 Vec Frame::position() const {
-  if (referenceFrame_)
-    return inverseCoordinatesOf(Vec(0.0, 0.0, 0.0));
-  else
+  if (referenceFrame_) {
+    updateWorldTransform();
+    return worldPosition_;
+  } else
     return t_;
 }
 
 /*! Returns the orientation of the Frame, defined in the world coordinate
   system. See also position(), setOrientation() and rotation(). */
 Quaternion Frame::orientation() const {
-  Quaternion res = rotation();
-  const Frame *fr = referenceFrame();
-  while (fr != nullptr) {
-    res = fr->rotation() * res;
-    fr = fr->referenceFrame();
-  }
-  return res;
+  if (referenceFrame_) {
+    updateWorldTransform();
+    return worldOrientation_;
+  } else
+    return q_;
 }
 
 ////////////////////// C o n s t r a i n t   V e r s i o n s
@@ -545,6 +675,7 @@ void Frame::setRotationWithConstraint(Quaternion &rotation) {
 
   setRotation(this->rotation() * deltaQ);
   q_.normalize();
+  invalidateWorldTransform();
   rotation = this->rotation();
 }
 
@@ -570,7 +701,8 @@ void Frame::setTranslationAndRotationWithConstraint(Vec &translation,
   translation = this->translation();
   rotation = this->rotation();
 
-  Q_EMIT modified();
+  invalidateWorldTransform();
+  emitModified();
 }
 
 /*! Same as setPosition(), but \p position is modified so that the potential
@@ -626,9 +758,17 @@ void Frame::setReferenceFrame(const Frame *const refFrame) {
     qWarning("Frame::setReferenceFrame would create a loop in Frame hierarchy");
   else {
     bool identical = (referenceFrame_ == refFrame);
+    if (!identical) {
+      if (referenceFrame_)
+        referenceFrame_->children_.removeOne(this);
+      if (refFrame)
+        refFrame->children_.append(this);
+    }
     referenceFrame_ = refFrame;
-    if (!identical)
-      Q_EMIT modified();
+    if (!identical) {
+      invalidateWorldTransform();
+      emitModified();
+    }
   }
 }
 
@@ -656,9 +796,10 @@ bool Frame::settingAsReferenceFrameWillCreateALoop(const Frame *const frame) {
  See the <a href="../examples/frameTransform.html">frameTransform example</a>
  for an illustration. */
 Vec Frame::coordinatesOf(const Vec &src) const {
-  if (referenceFrame())
-    return localCoordinatesOf(referenceFrame()->coordinatesOf(src));
-  else
+  if (referenceFrame()) {
+    updateWorldTransform();
+    return worldOrientation_.inverseRotate(src - worldPosition_);
+  } else
     return localCoordinatesOf(src);
 }
 
@@ -668,13 +809,11 @@ Vec Frame::coordinatesOf(const Vec &src) const {
   coordinatesOf() performs the inverse convertion. Use inverseTransformOf() to
   transform 3D vectors instead of 3D coordinates. */
 Vec Frame::inverseCoordinatesOf(const Vec &src) const {
-  const Frame *fr = this;
-  Vec res = src;
-  while (fr != nullptr) {
-    res = fr->localInverseCoordinatesOf(res);
-    fr = fr->referenceFrame();
-  }
-  return res;
+  if (referenceFrame()) {
+    updateWorldTransform();
+    return worldOrientation_.rotate(src) + worldPosition_;
+  } else
+    return localInverseCoordinatesOf(src);
 }
 
 /*! Returns the Frame coordinates of a point \p src defined in the
@@ -775,6 +914,70 @@ void Frame::getCoordinatesOfFrom(const qreal src[3], qreal res[3],
     res[i] = r[i];
 }
 
+////// Batch versions
+
+// Applies res = m * src + t to nb contiguous (x,y,z) triplets. The loop has no
+// dependency between iterations and is vectorized by the compiler.
+static void transformTriplets(const qreal m[3][3], const qreal t[3],
+                              const qreal *src, qreal *res, int nb) {
+  const qreal m00 = m[0][0], m01 = m[0][1], m02 = m[0][2];
+  const qreal m10 = m[1][0], m11 = m[1][1], m12 = m[1][2];
+  const qreal m20 = m[2][0], m21 = m[2][1], m22 = m[2][2];
+  const qreal t0 = t[0], t1 = t[1], t2 = t[2];
+  for (int i = 0; i < nb; ++i) {
+    const qreal x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+    res[3 * i] = m00 * x + m01 * y + m02 * z + t0;
+    res[3 * i + 1] = m10 * x + m11 * y + m12 * z + t1;
+    res[3 * i + 2] = m20 * x + m21 * y + m22 * z + t2;
+  }
+}
+
+/*! Batch version of coordinatesOf(), applied to \p nbPoints points.
+
+  \p src and \p res are arrays of \p nbPoints contiguous (x,y,z) coordinates
+  (they can be identical pointers). The world to Frame transformation is
+  computed once, which is much faster than calling coordinatesOf() on each
+  point. */
+void Frame::getCoordinatesOf(const qreal *src, qreal *res,
+                             int nbPoints) const {
+  const Quaternion o = orientation();
+  const Vec p = o.inverseRotate(position());
+  qreal m[3][3];
+  o.getInverseRotationMatrix(m);
+  const qreal t[3] = {-p.x, -p.y, -p.z};
+  transformTriplets(m, t, src, res, nbPoints);
+}
+
+/*! Batch version of inverseCoordinatesOf(), applied to \p nbPoints points.
+  See getCoordinatesOf(const qreal*, qreal*, int). */
+void Frame::getInverseCoordinatesOf(const qreal *src, qreal *res,
+                                    int nbPoints) const {
+  const Vec p = position();
+  qreal m[3][3];
+  orientation().getRotationMatrix(m);
+  const qreal t[3] = {p.x, p.y, p.z};
+  transformTriplets(m, t, src, res, nbPoints);
+}
+
+/*! Batch version of transformOf(), applied to \p nbVectors vectors.
+  See getCoordinatesOf(const qreal*, qreal*, int). */
+void Frame::getTransformOf(const qreal *src, qreal *res, int nbVectors) const {
+  qreal m[3][3];
+  orientation().getInverseRotationMatrix(m);
+  const qreal t[3] = {0.0, 0.0, 0.0};
+  transformTriplets(m, t, src, res, nbVectors);
+}
+
+/*! Batch version of inverseTransformOf(), applied to \p nbVectors vectors.
+  See getCoordinatesOf(const qreal*, qreal*, int). */
+void Frame::getInverseTransformOf(const qreal *src, qreal *res,
+                                  int nbVectors) const {
+  qreal m[3][3];
+  orientation().getRotationMatrix(m);
+  const qreal t[3] = {0.0, 0.0, 0.0};
+  transformTriplets(m, t, src, res, nbVectors);
+}
+
 ///////////////////////// FRAME TRANSFORMATIONS OF VECTORS
 /////////////////////////////////
 
@@ -788,9 +991,10 @@ void Frame::getCoordinatesOfFrom(const qreal src[3], qreal res[3],
  See the <a href="../examples/frameTransform.html">frameTransform example</a>
  for an illustration. */
 Vec Frame::transformOf(const Vec &src) const {
-  if (referenceFrame())
-    return localTransformOf(referenceFrame()->transformOf(src));
-  else
+  if (referenceFrame()) {
+    updateWorldTransform();
+    return worldOrientation_.inverseRotate(src);
+  } else
     return localTransformOf(src);
 }
 
@@ -800,13 +1004,11 @@ Vec Frame::transformOf(const Vec &src) const {
   transformOf() performs the inverse transformation. Use inverseCoordinatesOf()
   to transform 3D coordinates instead of 3D vectors. */
 Vec Frame::inverseTransformOf(const Vec &src) const {
-  const Frame *fr = this;
-  Vec res = src;
-  while (fr != nullptr) {
-    res = fr->localInverseTransformOf(res);
-    fr = fr->referenceFrame();
-  }
-  return res;
+  if (referenceFrame()) {
+    updateWorldTransform();
+    return worldOrientation_.rotate(src);
+  } else
+    return localInverseTransformOf(src);
 }
 
 /*! Returns the Frame transform of a vector \p src defined in the
@@ -966,6 +1168,29 @@ void Frame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the Frame state in \p stream. Compact binary equivalent of
+ domElement(), used by QGLViewer::saveStateToFile() when
+ QGLViewer::stateFileIsBinary().
+
+ The position() and orientation() are written, as doubles when the \c
+ QDataStream::floatingPointPrecision() is \c QDataStream::DoublePrecision. Use
+ readBinary() to restore the Frame state. */
+void Frame::writeBinary(QDataStream &stream) const {
+  stream << position() << orientation();
+}
+
+/*! Restores the Frame state from a \p stream written by writeBinary().
+
+ The Frame is not modified when \p stream is corrupted or truncated. As with
+ initFromDOMElement(), constraint() and referenceFrame() are left unchanged. */
+void Frame::readBinary(QDataStream &stream) {
+  Vec pos;
+  Quaternion ori;
+  stream >> pos >> ori;
+  if (stream.status() == QDataStream::Ok)
+    setPositionAndOrientation(pos, ori.normalized());
+}
+
 /////////////////////////////////   ALIGN   /////////////////////////////////
 
 /*! Aligns the Frame with \p frame, so that two of their axis are parallel.
@@ -79,6 +79,17 @@ namespace qglviewer {
   coordinatesOfFrom()... which allow coordinates (or vector) conversions from a
   Frame to any other one (including the world coordinate system).
 
+  The world position() and orientation() of each Frame are cached, and only
+  computed again after a modification of the Frame or of one of its ancestors.
+  This cache is filled by the first query, including the \c const ones
+  (position(), orientation(), coordinatesOf(), inverseCoordinatesOf(),
+  transformOf(), inverseTransformOf(), worldMatrix()...), which hence modify
+  the Frame and its ancestors: these methods are \e not safe to call
+  concurrently from several threads on Frames that share an ancestor. Query
+  each Frame once from a single thread before the concurrent reads, or use the
+  local translation() and rotation(), or a FrameData copy, in the other
+  threads.
+
   However, one must note that this hierarchical representation is internal to
   the Frame classes. When the Frames represent OpenGL coordinates system, one
   should map this hierarchical representation to the OpenGL GL_MODELVIEW matrix
@@ -108,6 +119,9 @@ namespace qglviewer {
   convertion, so that a Frame (and hence an object) can be manipulated in the
   scene with the mouse.
 
+  A Frame is a QObject. Use a FrameData, a plain value with the same local
+  coordinate conversions, to store large numbers of transformations.
+
   \nosubgrouping */
 class QGLVIEWER_EXPORT Frame : public QObject {
   Q_OBJECT
@@ -115,8 +129,7 @@ class QGLVIEWER_EXPORT Frame : public QObject {
 public:
   Frame();
 
-  /*! Virtual destructor. Empty. */
-  virtual ~Frame() {}
+  virtual ~Frame();
 
   Frame(const Frame &frame);
   Frame &operator=(const Frame &frame);
@@ -147,7 +160,10 @@ Q_SIGNALS:
 
   \note Note that this signal might be emitted even if the Frame is not actually
   modified, for instance after a translate(Vec(0,0,0)) or a
-  setPosition(position()). */
+  setPosition(position()).
+
+  Use a ModificationBatch to emit this signal only once after a series of
+  modifications. */
   void modified();
 
   /*! This signal is emitted when the Frame is interpolated by a
@@ -160,6 +176,9 @@ Q_SIGNALS:
   (identical, but independent of the interpolated Frame). */
   void interpolated();
 
+public:
+  static int nbModifications();
+
 public:
   /*! @name World coordinates position and orientation */
   //@{
@@ -196,7 +215,8 @@ public:
   of the Frame. */
   void setTranslation(const Vec &translation) {
     t_ = translation;
-    Q_EMIT modified();
+    invalidateWorldTransform();
+    emitModified();
   }
   void setTranslation(qreal x, qreal y, qreal z);
   void setTranslationWithConstraint(Vec &translation);
@@ -213,7 +233,8 @@ public:
    setRotationWithConstraint() instead. */
   void setRotation(const Quaternion &rotation) {
     q_ = rotation;
-    Q_EMIT modified();
+    invalidateWorldTransform();
+    emitModified();
   }
   void setRotation(qreal q0, qreal q1, qreal q2, qreal q3);
   void setRotationWithConstraint(Quaternion &rotation);
@@ -314,6 +335,10 @@ public:
                           const Frame *const in) const;
   void getCoordinatesOfFrom(const qreal src[3], qreal res[3],
                             const Frame *const from) const;
+
+  void getCoordinatesOf(const qreal *src, qreal *res, int nbPoints) const;
+  void getInverseCoordinatesOf(const qreal *src, qreal *res,
+                               int nbPoints) const;
   //@}
 
   /*! @name Coordinate system transformation of vectors */
@@ -358,6 +383,10 @@ public:
                         const Frame *const in) const;
   void getTransformOfFrom(const qreal src[3], qreal res[3],
                           const Frame *const from) const;
+
+  void getTransformOf(const qreal *src, qreal *res, int nbVectors) const;
+  void getInverseTransformOf(const qreal *src, qreal *res,
+                             int nbVectors) const;
   //@}
 
   /*! @name Constraint on the displacement */
@@ -387,9 +416,12 @@ public:
   const GLdouble *worldMatrix() const;
   void getWorldMatrix(GLdouble m[4][4]) const;
   void getWorldMatrix(GLdouble m[16]) const;
+  void getRelativeWorldMatrix(const Vec &origin, GLfloat m[16]) const;
 
   void setFromMatrix(const GLdouble m[4][4]);
   void setFromMatrix(const GLdouble m[16]);
+  static void setFromMatrices(Frame *const frames[], const GLdouble *matrices,
+                              int nb);
   //@}
 
   /*! @name Inversion of the transformation */
@@ -420,6 +452,13 @@ public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
   //@}
 
+  /*! @name Binary representation */
+  //@{
+public:
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
+  //@}
+
 private:
   // P o s i t i o n   a n d   o r i e n t a t i o n
   Vec t_;
@@ -430,6 +469,16 @@ private:
 
   // F r a m e   c o m p o s i t i o n
   const Frame *referenceFrame_;
+  mutable QList<Frame *> children_;
+
+  void emitModified();
+
+  // W o r l d   t r a n s f o r m   c a c h e
+  void invalidateWorldTransform() const;
+  void updateWorldTransform() const;
+  mutable Vec worldPosition_;
+  mutable Quaternion worldOrientation_;
+  mutable bool worldTransformIsUpToDate_;
 };
 
 } // namespace qglviewer
@@ -0,0 +1,1455 @@
+#include "frameCapture.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <climits>
+#include <cstring>
+
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#endif
+#ifndef GL_COPY_WRITE_BUFFER
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+#ifndef GL_UNIFORM_BUFFER_BINDING
+#define GL_UNIFORM_BUFFER_BINDING 0x8A28
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+#ifndef GL_READ_FRAMEBUFFER_BINDING
+#define GL_READ_FRAMEBUFFER_BINDING 0x8CAA
+#endif
+#ifndef GL_VERTEX_ARRAY_BINDING
+#define GL_VERTEX_ARRAY_BINDING 0x85B5
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_INTEGER
+#define GL_VERTEX_ATTRIB_ARRAY_INTEGER 0x88FD
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_SAMPLER_3D
+#define GL_SAMPLER_3D 0x8B5F
+#endif
+#ifndef GL_SAMPLER_2D_SHADOW
+#define GL_SAMPLER_2D_SHADOW 0x8B62
+#endif
+#ifndef GL_SAMPLER_2D_ARRAY
+#define GL_SAMPLER_2D_ARRAY 0x8DC1
+#endif
+#ifndef GL_VERTEX_ARRAY_BUFFER_BINDING
+#define GL_VERTEX_ARRAY_BUFFER_BINDING 0x8896
+#endif
+#ifndef GL_NORMAL_ARRAY_BUFFER_BINDING
+#define GL_NORMAL_ARRAY_BUFFER_BINDING 0x8897
+#endif
+#ifndef GL_COLOR_ARRAY_BUFFER_BINDING
+#define GL_COLOR_ARRAY_BUFFER_BINDING 0x8898
+#endif
+#ifndef GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING
+#define GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING 0x889A
+#endif
+
+using namespace qglviewer;
+
+namespace {
+// Capture files start with this magic number ("QGLC") and format version
+const quint32 captureMagic = 0x51474C43;
+const quint16 captureVersion = 1;
+
+// The attributes and client arrays use the first stream buffers
+const int maxVertexAttribs = 16;
+const int clientArrayStream = maxVertexAttribs;
+const int indexStream = clientArrayStream + 4;
+const int maxTextureUnits = 8;
+
+enum Opcode {
+  CREATE_BUFFER,         // buffer, usage | content
+  CREATE_TEXTURE,        // texture, width, height, filters, wraps | RGBA8
+  CREATE_PROGRAM,        // program | shader sources, attribute locations
+  BUFFER_DATA,           // buffer, usage | content
+  BUFFER_SUB_DATA,       // buffer, offset | content
+  USE_PROGRAM,           // program
+  UNIFORM,               // type, name length | name, values
+  BIND_VERTEX_ARRAY,     // vertex array
+  VERTEX_ATTRIB,         // index, size, type, flags, stride, buffer, offset
+  DISABLE_VERTEX_ATTRIB, // index
+  ELEMENT_BUFFER,        // buffer
+  CLIENT_ARRAY,          // array, size, type, stride, buffer, offset
+  DISABLE_CLIENT_ARRAY,  // array
+  BIND_TEXTURE,          // unit, texture
+  ENABLE,                // capability, enabled
+  VIEWPORT,              // x, y, width, height
+  SCISSOR,               // x, y, width, height
+  BLEND_FUNC,            // source and destination RGB and alpha factors
+  DEPTH_FUNC,            // function, mask
+  CULL_FACE,             // mode
+  CLEAR_COLOR,           // red, green, blue, alpha
+  LINE_WIDTH,            // width
+  LOAD_MATRIX,           // matrix mode | 16 floats
+  COLOR,                 // red, green, blue, alpha
+  CLEAR,                 // mask
+  DRAW_ARRAYS,           // mode, first, count
+  DRAW_ELEMENTS          // mode, count, type, offset | client memory indices
+};
+
+// Categories of the recorded states, see isModified()
+enum StateKey {
+  PROGRAM_KEY,
+  UNIFORM_KEY,
+  VERTEX_ARRAY_KEY,
+  ATTRIB_KEY,
+  ELEMENT_BUFFER_KEY,
+  CLIENT_ARRAY_KEY,
+  TEXTURE_KEY,
+  ENABLE_KEY,
+  VIEWPORT_KEY,
+  SCISSOR_KEY,
+  BLEND_FUNC_KEY,
+  DEPTH_FUNC_KEY,
+  CULL_FACE_KEY,
+  CLEAR_COLOR_KEY,
+  LINE_WIDTH_KEY,
+  MATRIX_KEY,
+  COLOR_KEY
+};
+
+quint64 key(StateKey category, quint32 object = 0, quint32 index = 0) {
+  return (quint64(category) << 56) | (quint64(object) << 24) |
+         (index & 0xFFFFFF);
+}
+
+quint32 bits(GLfloat value) {
+  quint32 b;
+  memcpy(&b, &value, sizeof(b));
+  return b;
+}
+
+GLfloat value(quint32 bits) {
+  GLfloat v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+int typeSize(GLenum type) {
+  switch (type) {
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return 1;
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+// Number of components of a uniform type, 0 when it is not recorded
+int uniformComponents(GLenum type, bool &integer) {
+  integer = false;
+  switch (type) {
+  case GL_FLOAT:
+    return 1;
+  case GL_FLOAT_VEC2:
+    return 2;
+  case GL_FLOAT_VEC3:
+    return 3;
+  case GL_FLOAT_VEC4:
+  case GL_FLOAT_MAT2:
+    return 4;
+  case GL_FLOAT_MAT3:
+    return 9;
+  case GL_FLOAT_MAT4:
+    return 16;
+  default:
+    break;
+  }
+  integer = true;
+  switch (type) {
+  case GL_INT:
+  case GL_BOOL:
+  case GL_SAMPLER_2D:
+  case GL_SAMPLER_CUBE:
+  case GL_SAMPLER_3D:
+  case GL_SAMPLER_2D_SHADOW:
+  case GL_SAMPLER_2D_ARRAY:
+    return 1;
+  case GL_INT_VEC2:
+  case GL_BOOL_VEC2:
+    return 2;
+  case GL_INT_VEC3:
+  case GL_BOOL_VEC3:
+    return 3;
+  case GL_INT_VEC4:
+  case GL_BOOL_VEC4:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// The binding query of a buffer target, 0 when not recorded
+GLenum bufferBinding(GLenum target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return GL_ARRAY_BUFFER_BINDING;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+  case GL_COPY_READ_BUFFER:
+  case GL_COPY_WRITE_BUFFER:
+    return target;
+  case GL_UNIFORM_BUFFER:
+    return GL_UNIFORM_BUFFER_BINDING;
+  default:
+    return 0;
+  }
+}
+
+// The bytes of a client memory array used by the vertices of range
+QByteArray clientData(const void *pointer, int size, GLenum type,
+                      GLsizei stride, const GLint *range) {
+  if (!pointer || !range || (range[1] < 0))
+    return QByteArray("");
+  const int elementSize = size * typeSize(type);
+  const int step = stride ? stride : elementSize;
+  return QByteArray(static_cast<const char *>(pointer),
+                    range[1] * step + elementSize);
+}
+
+const void *bufferOffset(quint32 offset) {
+  return reinterpret_cast<const void *>(quintptr(offset));
+}
+
+} // namespace
+
+/*! Creates an empty FrameCapture. */
+FrameCapture::FrameCapture()
+    : capturing_(false), isOpenGLES_(false), isCoreProfile_(false),
+      version_(0), captureContext_(nullptr), context_(nullptr),
+      functions_(nullptr), replayProgram_(0), defaultVertexArray_(0) {}
+
+/*! Destructor. The replay OpenGL objects are only deleted when the context
+used by prepareReplay() is current. Call cleanupGL() before otherwise. */
+FrameCapture::~FrameCapture() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Capture                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Starts the capture of a frame, with the current OpenGL context. The
+previous capture is cleared. Returns \c false when no context is current, or
+when it is older than OpenGL 3.0 or OpenGL ES 3.0.
+
+The states are recorded by the first draw call: they can be set before or
+after beginCapture(). */
+bool FrameCapture::beginCapture() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("FrameCapture::beginCapture: No current OpenGL context");
+    return false;
+  }
+  const QSurfaceFormat format = context->format();
+  if (format.version() < qMakePair(3, 0)) {
+    qWarning("FrameCapture::beginCapture: Requires OpenGL 3.0 or OpenGL ES "
+             "3.0");
+    return false;
+  }
+
+  clear();
+  captureContext_ = context;
+  isOpenGLES_ = context->isOpenGLES();
+  isCoreProfile_ = (format.profile() == QSurfaceFormat::CoreProfile);
+  version_ = 10 * format.majorVersion() + format.minorVersion();
+  GLint viewport[4];
+  context->functions()->glGetIntegerv(GL_VIEWPORT, viewport);
+  viewportSize_ = QSize(viewport[2], viewport[3]);
+  capturing_ = true;
+  return true;
+}
+
+/*! Stops the capture. The recorded frame can then be save()d, or replayed. */
+void FrameCapture::endCapture() {
+  capturing_ = false;
+  captureContext_ = nullptr;
+  recordedState_.clear();
+  buffers_.clear();
+  knownTextures_.clear();
+  knownPrograms_.clear();
+}
+
+/*! Starts a new range of commands, named \p name. The replay measures the GPU
+time of each range. Ignored when not isCapturing(). */
+void FrameCapture::marker(const QString &name) {
+  if (!capturing_)
+    return;
+  if (!ranges_.isEmpty() && (ranges_.last().begin == frame_.size()))
+    ranges_.last().name = name;
+  else {
+    Range range;
+    range.name = name;
+    range.begin = frame_.size();
+    ranges_.append(range);
+  }
+}
+
+/*! Removes the recorded frame. Call cleanupGL() first when it was prepared
+for a replay. */
+void FrameCapture::clear() {
+  endCapture();
+  setup_.clear();
+  frame_.clear();
+  blobs_.clear();
+  ranges_.clear();
+  viewportSize_ = QSize();
+}
+
+/*! Returns the size of the buffers, textures, programs and client memory
+arrays recorded with the commands, in bytes. */
+qint64 FrameCapture::dataSize() const {
+  qint64 size = 0;
+  for (int i = 0; i < blobs_.size(); ++i)
+    size += blobs_[i].size();
+  return size;
+}
+
+/*! Returns the number of commands of \p range. */
+int FrameCapture::rangeSize(int range) const {
+  const int end =
+      (range + 1 < ranges_.size()) ? ranges_[range + 1].begin : frame_.size();
+  return end - ranges_[range].begin;
+}
+
+// Appends a command to the frame, or to the setup when setup is true. data is
+// stored when not null.
+void FrameCapture::record(quint32 opcode, const quint32 *args, int nbArgs,
+                          const QByteArray &data, bool setup) {
+  Command command;
+  command.opcode = opcode;
+  for (int i = 0; i < 8; ++i)
+    command.args[i] = (i < nbArgs) ? args[i] : 0;
+  command.blob = -1;
+  if (!data.isNull()) {
+    command.blob = blobs_.size();
+    blobs_.append(data);
+  }
+
+  if (setup)
+    setup_.append(command);
+  else {
+    if (ranges_.isEmpty())
+      marker("frame");
+    frame_.append(command);
+  }
+}
+
+// Returns true when value differs from the last one recorded for key, which
+// is then updated.
+bool FrameCapture::isModified(quint64 key, const void *value, int size) {
+  const QByteArray v(static_cast<const char *>(value), size);
+  QHash<quint64, QByteArray>::iterator it = recordedState_.find(key);
+  if ((it != recordedState_.end()) && (*it == v))
+    return false;
+  recordedState_.insert(key, v);
+  return true;
+}
+
+// Records the states that changed since the previous draw call. clientRange
+// is the range of the vertices used by the draw call, for the client memory
+// arrays, or nullptr.
+void FrameCapture::recordState(const GLint *clientRange) {
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+
+  GLint program = 0;
+  f->glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  if (program)
+    recordProgram(program);
+  if (isModified(key(PROGRAM_KEY), &program, sizeof(program))) {
+    const quint32 args[] = {quint32(program)};
+    record(USE_PROGRAM, args, 1);
+  }
+  if (program)
+    recordUniforms(program);
+
+  GLint vertexArray = 0;
+  f->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+  if (isModified(key(VERTEX_ARRAY_KEY), &vertexArray, sizeof(vertexArray))) {
+    const quint32 args[] = {quint32(vertexArray)};
+    record(BIND_VERTEX_ARRAY, args, 1);
+  }
+  recordVertexAttribs(vertexArray, clientRange);
+  GLint elementBuffer = 0;
+  f->glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+  if (elementBuffer)
+    recordBuffer(elementBuffer);
+  if (isModified(key(ELEMENT_BUFFER_KEY, vertexArray), &elementBuffer,
+                 sizeof(elementBuffer))) {
+    const quint32 args[] = {quint32(elementBuffer)};
+    record(ELEMENT_BUFFER, args, 1);
+  }
+
+#ifndef QT_OPENGL_ES_2
+  if (!isOpenGLES_ && !isCoreProfile_)
+    recordFixedPipeline(clientRange);
+#endif
+
+  // Textures of the first units
+  GLint activeTexture = GL_TEXTURE0, nbUnits = 0;
+  f->glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+  f->glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &nbUnits);
+  for (int unit = 0; unit < qMin(int(nbUnits), maxTextureUnits); ++unit) {
+    f->glActiveTexture(GL_TEXTURE0 + unit);
+    GLint texture = 0;
+    f->glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+    if (texture)
+      recordTexture(texture);
+    if (isModified(key(TEXTURE_KEY, 0, unit), &texture, sizeof(texture))) {
+      const quint32 args[] = {quint32(unit), quint32(texture)};
+      record(BIND_TEXTURE, args, 2);
+    }
+  }
+  f->glActiveTexture(activeTexture);
+
+  static const GLenum capabilities[] = {GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE,
+                                        GL_SCISSOR_TEST,
+                                        GL_POLYGON_OFFSET_FILL};
+  for (GLenum capability : capabilities) {
+    const GLint enabled = f->glIsEnabled(capability) ? 1 : 0;
+    if (isModified(key(ENABLE_KEY, 0, capability), &enabled, sizeof(enabled))) {
+      const quint32 args[] = {capability, quint32(enabled)};
+      record(ENABLE, args, 2);
+    }
+  }
+
+  GLint box[4];
+  f->glGetIntegerv(GL_VIEWPORT, box);
+  if (isModified(key(VIEWPORT_KEY), box, sizeof(box))) {
+    const quint32 args[] = {quint32(box[0]), quint32(box[1]), quint32(box[2]),
+                            quint32(box[3])};
+    record(VIEWPORT, args, 4);
+  }
+  f->glGetIntegerv(GL_SCISSOR_BOX, box);
+  if (isModified(key(SCISSOR_KEY), box, sizeof(box))) {
+    const quint32 args[] = {quint32(box[0]), quint32(box[1]), quint32(box[2]),
+                            quint32(box[3])};
+    record(SCISSOR, args, 4);
+  }
+
+  GLint blend[4];
+  f->glGetIntegerv(GL_BLEND_SRC_RGB, &blend[0]);
+  f->glGetIntegerv(GL_BLEND_DST_RGB, &blend[1]);
+  f->glGetIntegerv(GL_BLEND_SRC_ALPHA, &blend[2]);
+  f->glGetIntegerv(GL_BLEND_DST_ALPHA, &blend[3]);
+  if (isModified(key(BLEND_FUNC_KEY), blend, sizeof(blend))) {
+    const quint32 args[] = {quint32(blend[0]), quint32(blend[1]),
+                            quint32(blend[2]), quint32(blend[3])};
+    record(BLEND_FUNC, args, 4);
+  }
+
+  GLint depth[2];
+  GLboolean depthMask = GL_TRUE;
+  f->glGetIntegerv(GL_DEPTH_FUNC, &depth[0]);
+  f->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+  depth[1] = depthMask ? 1 : 0;
+  if (isModified(key(DEPTH_FUNC_KEY), depth, sizeof(depth))) {
+    const quint32 args[] = {quint32(depth[0]), quint32(depth[1])};
+    record(DEPTH_FUNC, args, 2);
+  }
+
+  GLint cullFace = GL_BACK;
+  f->glGetIntegerv(GL_CULL_FACE_MODE, &cullFace);
+  if (isModified(key(CULL_FACE_KEY), &cullFace, sizeof(cullFace))) {
+    const quint32 args[] = {quint32(cullFace)};
+    record(CULL_FACE, args, 1);
+  }
+
+  GLfloat color[4];
+  f->glGetFloatv(GL_COLOR_CLEAR_VALUE, color);
+  if (isModified(key(CLEAR_COLOR_KEY), color, sizeof(color))) {
+    const quint32 args[] = {bits(color[0]), bits(color[1]), bits(color[2]),
+                            bits(color[3])};
+    record(CLEAR_COLOR, args, 4);
+  }
+
+  GLfloat lineWidth = 1.0f;
+  f->glGetFloatv(GL_LINE_WIDTH, &lineWidth);
+  if (isModified(key(LINE_WIDTH_KEY), &lineWidth, sizeof(lineWidth))) {
+    const quint32 args[] = {bits(lineWidth)};
+    record(LINE_WIDTH, args, 1);
+  }
+}
+
+// Records the creation of program the first time it is used: the sources of
+// its shaders and the locations of its attributes.
+void FrameCapture::recordProgram(GLuint program) {
+  if (knownPrograms_.contains(program))
+    return;
+  knownPrograms_.insert(program, true);
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+
+  GLint nbShaders = 0;
+  f->glGetProgramiv(program, GL_ATTACHED_SHADERS, &nbShaders);
+  if (nbShaders == 0)
+    qWarning("FrameCapture: program %u has no attached shader, it is not "
+             "replayed",
+             program);
+  QVector<GLuint> shaders(nbShaders);
+  f->glGetAttachedShaders(program, nbShaders, nullptr, shaders.data());
+
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << qint32(nbShaders);
+  for (int i = 0; i < nbShaders; ++i) {
+    GLint type = 0, length = 0;
+    f->glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+    f->glGetShaderiv(shaders[i], GL_SHADER_SOURCE_LENGTH, &length);
+    QByteArray source(qMax(int(length), 1), '\0');
+    f->glGetShaderSource(shaders[i], source.size(), nullptr, source.data());
+    source.truncate(int(qstrlen(source.constData())));
+    stream << quint32(type) << source;
+  }
+
+  GLint nbAttributes = 0, maxLength = 0;
+  f->glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &nbAttributes);
+  f->glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+  QList<QByteArray> names;
+  QList<qint32> locations;
+  QByteArray name(qMax(int(maxLength), 1), '\0');
+  for (int i = 0; i < nbAttributes; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    f->glGetActiveAttrib(program, i, name.size(), &length, &size, &type,
+                         name.data());
+    const QByteArray attribute(name.constData(), length);
+    const GLint location =
+        f->glGetAttribLocation(program, attribute.constData());
+    if ((location >= 0) && !attribute.startsWith("gl_")) {
+      names.append(attribute);
+      locations.append(location);
+    }
+  }
+  stream << qint32(names.size());
+  for (int i = 0; i < names.size(); ++i)
+    stream << names[i] << locations[i];
+
+  const quint32 args[] = {program};
+  record(CREATE_PROGRAM, args, 1, data, true);
+}
+
+// Records the uniform values of program that changed since they were last
+// recorded
+void FrameCapture::recordUniforms(GLuint program) {
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+  GLint nbUniforms = 0, maxLength = 0;
+  f->glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nbUniforms);
+  f->glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  QByteArray name(qMax(int(maxLength), 1), '\0');
+
+  for (int i = 0; i < nbUniforms; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    f->glGetActiveUniform(program, i, name.size(), &length, &size, &type,
+                          name.data());
+    bool integer;
+    const int nbComponents = uniformComponents(type, integer);
+    if (nbComponents == 0)
+      continue;
+    QByteArray base(name.constData(), length);
+    if (base.endsWith("[0]"))
+      base.chop(3);
+
+    for (int element = 0; element < size; ++element) {
+      const QByteArray uniform =
+          (size > 1) ? base + '[' + QByteArray::number(element) + ']' : base;
+      const GLint location =
+          f->glGetUniformLocation(program, uniform.constData());
+      // Uniform block members have no location
+      if (location < 0)
+        continue;
+
+      union {
+        GLfloat f[16];
+        GLint i[16];
+      } values;
+      if (integer)
+        f->glGetUniformiv(program, location, values.i);
+      else
+        f->glGetUniformfv(program, location, values.f);
+      const int valuesSize = nbComponents * 4;
+      if (!isModified(key(UNIFORM_KEY, program, location), &values,
+                      valuesSize))
+        continue;
+
+      QByteArray data = uniform;
+      data.append(reinterpret_cast<const char *>(&values), valuesSize);
+      const quint32 args[] = {type, quint32(uniform.size())};
+      record(UNIFORM, args, 2, data);
+    }
+  }
+}
+
+// Records the vertex attribute arrays of vertexArray that changed. The client
+// memory arrays are recorded at each draw call, their content may have
+// changed.
+void FrameCapture::recordVertexAttribs(GLuint vertexArray,
+                                       const GLint *clientRange) {
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+  GLint nbAttribs = 0;
+  f->glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &nbAttribs);
+
+  for (int i = 0; i < qMin(int(nbAttribs), maxVertexAttribs); ++i) {
+    const quint64 k = key(ATTRIB_KEY, vertexArray, i);
+    GLint enabled = 0;
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+    if (!enabled) {
+      if (isModified(k, &enabled, sizeof(enabled))) {
+        const quint32 args[] = {quint32(i)};
+        record(DISABLE_VERTEX_ATTRIB, args, 1);
+      }
+      continue;
+    }
+
+    GLint size = 4, type = GL_FLOAT, normalized = 0, integer = 0, stride = 0,
+          buffer = 0;
+    void *pointer = nullptr;
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &integer);
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+    f->glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+    f->glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+
+    const quint32 flags = (normalized ? 1 : 0) | (integer ? 2 : 0);
+    const quint32 args[] = {quint32(i),    quint32(size),
+                            quint32(type), flags,
+                            quint32(stride), quint32(buffer),
+                            buffer ? quint32(quintptr(pointer)) : 0};
+    if (buffer) {
+      recordBuffer(buffer);
+      if (isModified(k, args, sizeof(args)))
+        record(VERTEX_ATTRIB, args, 7);
+    } else {
+      recordedState_.remove(k);
+      record(VERTEX_ATTRIB, args, 7,
+             clientData(pointer, size, type, stride, clientRange));
+    }
+  }
+}
+
+#ifndef QT_OPENGL_ES_2
+// Records the fixed pipeline states that changed: capabilities, matrices,
+// current color and vertex arrays.
+void FrameCapture::recordFixedPipeline(const GLint *clientRange) {
+  static const GLenum capabilities[] = {GL_LIGHTING, GL_LIGHT0,
+                                        GL_COLOR_MATERIAL, GL_TEXTURE_2D,
+                                        GL_NORMALIZE};
+  for (GLenum capability : capabilities) {
+    const GLint enabled = glIsEnabled(capability) ? 1 : 0;
+    if (isModified(key(ENABLE_KEY, 0, capability), &enabled, sizeof(enabled))) {
+      const quint32 args[] = {capability, quint32(enabled)};
+      record(ENABLE, args, 2);
+    }
+  }
+
+  static const GLenum matrices[][2] = {{GL_PROJECTION, GL_PROJECTION_MATRIX},
+                                       {GL_MODELVIEW, GL_MODELVIEW_MATRIX}};
+  for (int i = 0; i < 2; ++i) {
+    GLfloat matrix[16];
+    glGetFloatv(matrices[i][1], matrix);
+    if (isModified(key(MATRIX_KEY, 0, i), matrix, sizeof(matrix))) {
+      const quint32 args[] = {matrices[i][0]};
+      record(LOAD_MATRIX, args, 1,
+             QByteArray(reinterpret_cast<const char *>(matrix),
+                        sizeof(matrix)));
+    }
+  }
+
+  GLfloat color[4];
+  glGetFloatv(GL_CURRENT_COLOR, color);
+  if (isModified(key(COLOR_KEY), color, sizeof(color))) {
+    const quint32 args[] = {bits(color[0]), bits(color[1]), bits(color[2]),
+                            bits(color[3])};
+    record(COLOR, args, 4);
+  }
+
+  // Array, size (0 when fixed), type, stride, buffer and pointer queries
+  static const GLenum arrays[][6] = {
+      {GL_VERTEX_ARRAY, GL_VERTEX_ARRAY_SIZE, GL_VERTEX_ARRAY_TYPE,
+       GL_VERTEX_ARRAY_STRIDE, GL_VERTEX_ARRAY_BUFFER_BINDING,
+       GL_VERTEX_ARRAY_POINTER},
+      {GL_NORMAL_ARRAY, 0, GL_NORMAL_ARRAY_TYPE, GL_NORMAL_ARRAY_STRIDE,
+       GL_NORMAL_ARRAY_BUFFER_BINDING, GL_NORMAL_ARRAY_POINTER},
+      {GL_COLOR_ARRAY, GL_COLOR_ARRAY_SIZE, GL_COLOR_ARRAY_TYPE,
+       GL_COLOR_ARRAY_STRIDE, GL_COLOR_ARRAY_BUFFER_BINDING,
+       GL_COLOR_ARRAY_POINTER},
+      {GL_TEXTURE_COORD_ARRAY, GL_TEXTURE_COORD_ARRAY_SIZE,
+       GL_TEXTURE_COORD_ARRAY_TYPE, GL_TEXTURE_COORD_ARRAY_STRIDE,
+       GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING, GL_TEXTURE_COORD_ARRAY_POINTER}};
+  for (int i = 0; i < 4; ++i) {
+    const quint64 k = key(CLIENT_ARRAY_KEY, 0, i);
+    const GLint enabled = glIsEnabled(arrays[i][0]) ? 1 : 0;
+    if (!enabled) {
+      if (isModified(k, &enabled, sizeof(enabled))) {
+        const quint32 args[] = {arrays[i][0]};
+        record(DISABLE_CLIENT_ARRAY, args, 1);
+      }
+      continue;
+    }
+
+    GLint size = 3, type = GL_FLOAT, stride = 0, buffer = 0;
+    GLvoid *pointer = nullptr;
+    if (arrays[i][1])
+      glGetIntegerv(arrays[i][1], &size);
+    glGetIntegerv(arrays[i][2], &type);
+    glGetIntegerv(arrays[i][3], &stride);
+    glGetIntegerv(arrays[i][4], &buffer);
+    glGetPointerv(arrays[i][5], &pointer);
+
+    const quint32 args[] = {arrays[i][0],    quint32(size),   quint32(type),
+                            quint32(stride), quint32(buffer),
+                            buffer ? quint32(quintptr(pointer)) : 0};
+    if (buffer) {
+      recordBuffer(buffer);
+      if (isModified(k, args, sizeof(args)))
+        record(CLIENT_ARRAY, args, 6);
+    } else {
+      recordedState_.remove(k);
+      record(CLIENT_ARRAY, args, 6,
+             clientData(pointer, size, type, stride, clientRange));
+    }
+  }
+}
+#else
+void FrameCapture::recordFixedPipeline(const GLint *) {}
+#endif
+
+// Records the creation of buffer with its current content, the first time it
+// is used.
+void FrameCapture::recordBuffer(GLuint buffer) {
+  if (buffers_.contains(buffer))
+    return;
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+
+  GLint previous = 0, size = 0, usage = GL_STATIC_DRAW;
+  f->glGetIntegerv(GL_COPY_READ_BUFFER, &previous);
+  f->glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  f->glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+  f->glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_USAGE, &usage);
+  QByteArray data(size, '\0');
+  if (size > 0) {
+    const void *mapped =
+        f->glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped) {
+      memcpy(data.data(), mapped, size);
+      f->glUnmapBuffer(GL_COPY_READ_BUFFER);
+    } else
+      qWarning("FrameCapture: unable to read buffer %u", buffer);
+  }
+  f->glBindBuffer(GL_COPY_READ_BUFFER, previous);
+
+  buffers_.insert(buffer, data);
+  const quint32 args[] = {buffer, quint32(usage)};
+  record(CREATE_BUFFER, args, 2, data, true);
+}
+
+// Records the creation of texture, bound to the active unit, with the current
+// content of its first level, the first time it is used.
+void FrameCapture::recordTexture(GLuint texture) {
+  if (knownTextures_.contains(texture))
+    return;
+  knownTextures_.insert(texture, true);
+  QOpenGLExtraFunctions *f = captureContext_->extraFunctions();
+
+  GLint width = 0, height = 0;
+  f->glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+  f->glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+  GLint parameters[4] = {GL_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT};
+  f->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &parameters[0]);
+  f->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &parameters[1]);
+  f->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &parameters[2]);
+  f->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &parameters[3]);
+
+  // Read back through a framebuffer, the only way with OpenGL ES
+  QByteArray pixels;
+  if ((width > 0) && (height > 0)) {
+    GLint previous = 0, alignment = 4;
+    GLuint framebuffer = 0;
+    f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+    f->glGenFramebuffers(1, &framebuffer);
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_TEXTURE_2D, texture, 0);
+    if (f->glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) ==
+        GL_FRAMEBUFFER_COMPLETE) {
+      pixels.resize(4 * width * height);
+      f->glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+      f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      f->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                      pixels.data());
+      f->glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    } else
+      qWarning("FrameCapture: unable to read texture %u", texture);
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+    f->glDeleteFramebuffers(1, &framebuffer);
+  }
+
+  const quint32 args[] = {texture,
+                          quint32(width),
+                          quint32(height),
+                          quint32(parameters[0]),
+                          quint32(parameters[1]),
+                          quint32(parameters[2]),
+                          quint32(parameters[3])};
+  record(CREATE_TEXTURE, args, 7, pixels, true);
+}
+
+// Computes the range of the count indices of type, either in client memory or
+// at offset indices of the bound element buffer. Returns false when they could
+// not be read.
+bool FrameCapture::indexRange(GLsizei count, GLenum type, const void *indices,
+                              GLint *range) {
+  GLint elementBuffer = 0;
+  captureContext_->functions()->glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING,
+                                              &elementBuffer);
+  const char *data = static_cast<const char *>(indices);
+  if (elementBuffer) {
+    recordBuffer(elementBuffer);
+    const QByteArray &content = buffers_[elementBuffer];
+    const quintptr offset = quintptr(indices);
+    if (offset + quintptr(count) * typeSize(type) > quintptr(content.size()))
+      return false;
+    data = content.constData() + offset;
+  }
+  if (!data)
+    return false;
+
+  range[0] = INT_MAX;
+  range[1] = -1;
+  for (GLsizei i = 0; i < count; ++i) {
+    GLint index;
+    if (type == GL_UNSIGNED_BYTE)
+      index = reinterpret_cast<const GLubyte *>(data)[i];
+    else if (type == GL_UNSIGNED_SHORT)
+      index = reinterpret_cast<const GLushort *>(data)[i];
+    else
+      index = GLint(reinterpret_cast<const GLuint *>(data)[i]);
+    range[0] = qMin(range[0], index);
+    range[1] = qMax(range[1], index);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Recorded OpenGL calls                           //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Calls \c glClear(\p mask), and records it when isCapturing(). */
+void FrameCapture::clear(GLbitfield mask) {
+  if (capturing_) {
+    recordState(nullptr);
+    const quint32 args[] = {mask};
+    record(CLEAR, args, 1);
+  }
+  QOpenGLContext::currentContext()->functions()->glClear(mask);
+}
+
+/*! Calls \c glDrawArrays(), and records it with the states it uses when
+isCapturing(). */
+void FrameCapture::drawArrays(GLenum mode, GLint first, GLsizei count) {
+  if (capturing_) {
+    const GLint range[2] = {first, first + count - 1};
+    recordState(range);
+    const quint32 args[] = {mode, quint32(first), quint32(count)};
+    record(DRAW_ARRAYS, args, 3);
+  }
+  QOpenGLContext::currentContext()->functions()->glDrawArrays(mode, first,
+                                                             count);
+}
+
+/*! Calls \c glDrawElements(), and records it with the states it uses when
+isCapturing(). \p indices is an offset in the bound \c GL_ELEMENT_ARRAY_BUFFER,
+or a pointer to the indices when none is bound. */
+void FrameCapture::drawElements(GLenum mode, GLsizei count, GLenum type,
+                                const void *indices) {
+  if (capturing_) {
+    GLint range[2];
+    const bool known = indexRange(count, type, indices, range);
+    recordState(known ? range : nullptr);
+
+    GLint elementBuffer = 0;
+    captureContext_->functions()->glGetIntegerv(
+        GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+    const quint32 args[] = {mode, quint32(count), type,
+                            elementBuffer ? quint32(quintptr(indices)) : 0};
+    if (elementBuffer)
+      record(DRAW_ELEMENTS, args, 4);
+    else
+      record(DRAW_ELEMENTS, args, 4,
+             QByteArray(static_cast<const char *>(indices),
+                        indices ? count * typeSize(type) : 0));
+  }
+  QOpenGLContext::currentContext()->functions()->glDrawElements(mode, count,
+                                                               type, indices);
+}
+
+/*! Calls \c glBufferData(), and records the new content of the buffer bound
+to \p target when isCapturing(). */
+void FrameCapture::bufferData(GLenum target, GLsizeiptr size, const void *data,
+                              GLenum usage) {
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  if (capturing_) {
+    GLint buffer = 0;
+    if (bufferBinding(target))
+      f->glGetIntegerv(bufferBinding(target), &buffer);
+    else
+      qWarning("FrameCapture::bufferData: target 0x%x is not recorded",
+               target);
+    if (buffer) {
+      const QByteArray content =
+          data ? QByteArray(static_cast<const char *>(data), int(size))
+               : QByteArray(int(size), '\0');
+      if (!buffers_.contains(buffer)) {
+        // Its previous content does not matter
+        const quint32 args[] = {quint32(buffer), usage};
+        record(CREATE_BUFFER, args, 2, QByteArray(""), true);
+      }
+      buffers_.insert(buffer, content);
+      const quint32 args[] = {quint32(buffer), usage};
+      record(BUFFER_DATA, args, 2, content);
+    }
+  }
+  f->glBufferData(target, size, data, usage);
+}
+
+/*! Calls \c glBufferSubData(), and records the modified range of the buffer
+bound to \p target when isCapturing(). */
+void FrameCapture::bufferSubData(GLenum target, GLintptr offset,
+                                 GLsizeiptr size, const void *data) {
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  if (capturing_) {
+    GLint buffer = 0;
+    if (bufferBinding(target))
+      f->glGetIntegerv(bufferBinding(target), &buffer);
+    else
+      qWarning("FrameCapture::bufferSubData: target 0x%x is not recorded",
+               target);
+    if (buffer) {
+      recordBuffer(buffer);
+      QByteArray &content = buffers_[buffer];
+      if (offset + size <= content.size())
+        memcpy(content.data() + offset, data, size);
+      const quint32 args[] = {quint32(buffer), quint32(offset)};
+      record(BUFFER_SUB_DATA, args, 2,
+             QByteArray(static_cast<const char *>(data), int(size)));
+    }
+  }
+  f->glBufferSubData(target, offset, size, data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Files                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Saves the recorded frame in \p fileName. Returns \c false when the file
+could not be written. */
+bool FrameCapture::save(const QString &fileName) const {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning("FrameCapture::save: unable to open %s",
+             fileName.toLatin1().constData());
+    return false;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << captureMagic << captureVersion;
+  stream << isOpenGLES_ << isCoreProfile_ << qint32(version_)
+         << viewportSize_;
+  const QVector<Command> *commands[] = {&setup_, &frame_};
+  for (const QVector<Command> *c : commands) {
+    stream << qint32(c->size());
+    for (int i = 0; i < c->size(); ++i) {
+      stream << (*c)[i].opcode;
+      for (int j = 0; j < 8; ++j)
+        stream << (*c)[i].args[j];
+      stream << (*c)[i].blob;
+    }
+  }
+  stream << qint32(blobs_.size());
+  for (int i = 0; i < blobs_.size(); ++i)
+    stream << blobs_[i];
+  stream << qint32(ranges_.size());
+  for (int i = 0; i < ranges_.size(); ++i)
+    stream << ranges_[i].name << qint32(ranges_[i].begin);
+  return stream.status() == QDataStream::Ok;
+}
+
+/*! Loads a frame saved by save(), to replay it. The current frame is cleared.
+Returns \c false when \p fileName is not a valid capture file. */
+bool FrameCapture::load(const QString &fileName) {
+  clear();
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning("FrameCapture::load: unable to open %s",
+             fileName.toLatin1().constData());
+    return false;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_0);
+  quint32 magic = 0;
+  quint16 version = 0;
+  stream >> magic >> version;
+  if ((magic != captureMagic) || (version != captureVersion)) {
+    qWarning("FrameCapture::load: %s is not a frame capture file",
+             fileName.toLatin1().constData());
+    return false;
+  }
+
+  qint32 glVersion = 0;
+  stream >> isOpenGLES_ >> isCoreProfile_ >> glVersion >> viewportSize_;
+  version_ = glVersion;
+  QVector<Command> *commands[] = {&setup_, &frame_};
+  for (QVector<Command> *c : commands) {
+    qint32 nb = 0;
+    stream >> nb;
+    if (stream.status() != QDataStream::Ok)
+      break;
+    c->resize(qMax(nb, 0));
+    for (int i = 0; i < c->size(); ++i) {
+      stream >> (*c)[i].opcode;
+      for (int j = 0; j < 8; ++j)
+        stream >> (*c)[i].args[j];
+      stream >> (*c)[i].blob;
+    }
+  }
+  qint32 nb = 0;
+  stream >> nb;
+  blobs_.resize(qMax(nb, 0));
+  for (int i = 0; i < blobs_.size(); ++i)
+    stream >> blobs_[i];
+  stream >> nb;
+  ranges_.resize(qMax(nb, 0));
+  for (int i = 0; i < ranges_.size(); ++i) {
+    qint32 begin = 0;
+    stream >> ranges_[i].name >> begin;
+    ranges_[i].begin = qBound(0, int(begin), frame_.size());
+  }
+
+  bool valid = (stream.status() == QDataStream::Ok);
+  const QVector<Command> *all[] = {&setup_, &frame_};
+  for (const QVector<Command> *c : all)
+    for (int i = 0; valid && (i < c->size()); ++i)
+      valid = ((*c)[i].blob < blobs_.size());
+  if (!valid) {
+    qWarning("FrameCapture::load: %s is corrupted",
+             fileName.toLatin1().constData());
+    clear();
+  }
+  return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Replay                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates the buffers, textures and programs used by the frame, with the
+current OpenGL context. Call it once before replay() or replayRange(), which
+must be called with this context current.
+
+Returns \c false when no context is current, or when it is not of the kind of
+the capture context (see isOpenGLES()). */
+bool FrameCapture::prepareReplay() {
+  cleanupGL();
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("FrameCapture::prepareReplay: No current OpenGL context");
+    return false;
+  }
+  if ((context->isOpenGLES() != isOpenGLES_) ||
+      (context->format().version() < qMakePair(3, 0))) {
+    qWarning("FrameCapture::prepareReplay: the frame was captured with an "
+             "OpenGL%s %d.%d context",
+             isOpenGLES_ ? " ES" : "", version_ / 10, version_ % 10);
+    return false;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  // Uniform locations cached by a previous replay
+  for (int i = 0; i < frame_.size(); ++i)
+    if (frame_[i].opcode == UNIFORM)
+      frame_[i].args[6] = frame_[i].args[7] = 0;
+  // Vertex array 0 can not be used by a core profile
+  if (context->format().profile() == QSurfaceFormat::CoreProfile) {
+    functions_->glGenVertexArrays(1, &defaultVertexArray_);
+    functions_->glBindVertexArray(defaultVertexArray_);
+  }
+  for (int i = 0; i < setup_.size(); ++i)
+    execute(setup_[i]);
+  return true;
+}
+
+/*! Issues all the recorded commands of the frame. Same as replayRange() for
+all the ranges. */
+void FrameCapture::replay() {
+  for (int i = 0; i < ranges_.size(); ++i)
+    replayRange(i);
+}
+
+/*! Issues the recorded commands of \p range. The ranges must be replayed in
+order, since each one uses the states set by the previous ones. */
+void FrameCapture::replayRange(int range) {
+  if (!functions_) {
+    qWarning("FrameCapture::replayRange: call prepareReplay() first");
+    return;
+  }
+  const int begin = ranges_[range].begin;
+  for (int i = begin; i < begin + rangeSize(range); ++i)
+    execute(frame_[i]);
+}
+
+/*! Deletes the OpenGL objects created by prepareReplay(). The context used by
+prepareReplay() must be current. */
+void FrameCapture::cleanupGL() {
+  if (functions_) {
+    for (GLuint buffer : replayBuffers_)
+      functions_->glDeleteBuffers(1, &buffer);
+    for (GLuint texture : replayTextures_)
+      functions_->glDeleteTextures(1, &texture);
+    for (GLuint program : replayPrograms_)
+      functions_->glDeleteProgram(program);
+    for (GLuint vertexArray : replayVertexArrays_)
+      functions_->glDeleteVertexArrays(1, &vertexArray);
+    for (GLuint buffer : streamBuffers_)
+      if (buffer)
+        functions_->glDeleteBuffers(1, &buffer);
+    if (defaultVertexArray_)
+      functions_->glDeleteVertexArrays(1, &defaultVertexArray_);
+  }
+
+  replayBuffers_.clear();
+  replayTextures_.clear();
+  replayPrograms_.clear();
+  replayVertexArrays_.clear();
+  streamBuffers_.clear();
+  replayProgram_ = 0;
+  defaultVertexArray_ = 0;
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+// Uploads data in stream buffer index, which is left bound to target
+GLuint FrameCapture::streamBuffer(int index, const QByteArray &data,
+                                  GLenum target) {
+  if (streamBuffers_.size() <= index)
+    streamBuffers_.resize(index + 1);
+  if (!streamBuffers_[index])
+    functions_->glGenBuffers(1, &streamBuffers_[index]);
+  functions_->glBindBuffer(target, streamBuffers_[index]);
+  functions_->glBufferData(target, data.size(), data.constData(),
+                           GL_STREAM_DRAW);
+  return streamBuffers_[index];
+}
+
+// Issues a recorded command. The uniform commands cache their location.
+void FrameCapture::execute(Command &command) {
+  QOpenGLExtraFunctions *f = functions_;
+  const quint32 *a = command.args;
+  const QByteArray data =
+      (command.blob >= 0) ? blobs_[command.blob] : QByteArray();
+
+  switch (command.opcode) {
+  case CREATE_BUFFER: {
+    GLuint buffer = 0;
+    f->glGenBuffers(1, &buffer);
+    replayBuffers_.insert(a[0], buffer);
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    f->glBufferData(GL_COPY_WRITE_BUFFER, data.size(), data.constData(),
+                    a[1]);
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    break;
+  }
+  case CREATE_TEXTURE: {
+    GLuint texture = 0;
+    f->glGenTextures(1, &texture);
+    replayTextures_.insert(a[0], texture);
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, a[1], a[2], 0, GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    data.isEmpty() ? nullptr : data.constData());
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, a[3]);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, a[4]);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, a[5]);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, a[6]);
+    if ((a[3] != GL_NEAREST) && (a[3] != GL_LINEAR) && (a[1] > 0))
+      f->glGenerateMipmap(GL_TEXTURE_2D);
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+    break;
+  }
+  case CREATE_PROGRAM: {
+    const GLuint program = f->glCreateProgram();
+    replayPrograms_.insert(a[0], program);
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    qint32 nb = 0;
+    stream >> nb;
+    for (int i = 0; i < nb; ++i) {
+      quint32 type = 0;
+      QByteArray source;
+      stream >> type >> source;
+      const GLuint shader = f->glCreateShader(type);
+      const char *sourceData = source.constData();
+      f->glShaderSource(shader, 1, &sourceData, nullptr);
+      f->glCompileShader(shader);
+      f->glAttachShader(program, shader);
+      // Deleted with the program
+      f->glDeleteShader(shader);
+    }
+    stream >> nb;
+    for (int i = 0; i < nb; ++i) {
+      QByteArray name;
+      qint32 location = 0;
+      stream >> name >> location;
+      f->glBindAttribLocation(program, location, name.constData());
+    }
+    f->glLinkProgram(program);
+    GLint linked = GL_FALSE;
+    f->glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+      qWarning("FrameCapture: unable to link program %u", a[0]);
+    break;
+  }
+  case BUFFER_DATA:
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, replayBuffers_.value(a[0]));
+    f->glBufferData(GL_COPY_WRITE_BUFFER, data.size(), data.constData(),
+                    a[1]);
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    break;
+  case BUFFER_SUB_DATA:
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, replayBuffers_.value(a[0]));
+    f->glBufferSubData(GL_COPY_WRITE_BUFFER, a[1], data.size(),
+                       data.constData());
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    break;
+  case USE_PROGRAM:
+    f->glUseProgram(replayPrograms_.value(a[0]));
+    replayProgram_ = a[0];
+    break;
+  case UNIFORM: {
+    const GLuint program = replayPrograms_.value(replayProgram_);
+    if (!program)
+      break;
+    // Locations may differ from the capture ones
+    if (command.args[6] != program) {
+      command.args[6] = program;
+      command.args[7] = quint32(f->glGetUniformLocation(
+          program, data.left(int(a[1])).constData()));
+    }
+    const GLint location = GLint(command.args[7]);
+    if (location < 0)
+      break;
+    // Copied, the values are not aligned after the name
+    union {
+      GLfloat f[16];
+      GLint i[16];
+    } values;
+    memcpy(&values, data.constData() + a[1],
+           qBound(0, data.size() - int(a[1]), int(sizeof(values))));
+    const GLfloat *v = values.f;
+    const GLint *i = values.i;
+    switch (a[0]) {
+    case GL_FLOAT:
+      f->glUniform1fv(location, 1, v);
+      break;
+    case GL_FLOAT_VEC2:
+      f->glUniform2fv(location, 1, v);
+      break;
+    case GL_FLOAT_VEC3:
+      f->glUniform3fv(location, 1, v);
+      break;
+    case GL_FLOAT_VEC4:
+      f->glUniform4fv(location, 1, v);
+      break;
+    case GL_FLOAT_MAT2:
+      f->glUniformMatrix2fv(location, 1, GL_FALSE, v);
+      break;
+    case GL_FLOAT_MAT3:
+      f->glUniformMatrix3fv(location, 1, GL_FALSE, v);
+      break;
+    case GL_FLOAT_MAT4:
+      f->glUniformMatrix4fv(location, 1, GL_FALSE, v);
+      break;
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:
+      f->glUniform2iv(location, 1, i);
+      break;
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:
+      f->glUniform3iv(location, 1, i);
+      break;
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:
+      f->glUniform4iv(location, 1, i);
+      break;
+    default: // int, bool and samplers
+      f->glUniform1iv(location, 1, i);
+      break;
+    }
+    break;
+  }
+  case BIND_VERTEX_ARRAY: {
+    GLuint vertexArray = defaultVertexArray_;
+    if (a[0]) {
+      // Vertex arrays have no content: their attributes are recorded
+      vertexArray = replayVertexArrays_.value(a[0]);
+      if (!vertexArray) {
+        f->glGenVertexArrays(1, &vertexArray);
+        replayVertexArrays_.insert(a[0], vertexArray);
+      }
+    }
+    f->glBindVertexArray(vertexArray);
+    break;
+  }
+  case VERTEX_ATTRIB:
+    if (a[5])
+      f->glBindBuffer(GL_ARRAY_BUFFER, replayBuffers_.value(a[5]));
+    else
+      streamBuffer(a[0], data, GL_ARRAY_BUFFER);
+    if (a[3] & 2)
+      f->glVertexAttribIPointer(a[0], a[1], a[2], a[4], bufferOffset(a[6]));
+    else
+      f->glVertexAttribPointer(a[0], a[1], a[2],
+                               (a[3] & 1) ? GL_TRUE : GL_FALSE, a[4],
+                               bufferOffset(a[6]));
+    f->glEnableVertexAttribArray(a[0]);
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    break;
+  case DISABLE_VERTEX_ATTRIB:
+    f->glDisableVertexAttribArray(a[0]);
+    break;
+  case ELEMENT_BUFFER:
+    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, replayBuffers_.value(a[0]));
+    break;
+#ifndef QT_OPENGL_ES_2
+  case CLIENT_ARRAY: {
+    int stream = clientArrayStream;
+    switch (a[0]) {
+    case GL_NORMAL_ARRAY:
+      stream += 1;
+      break;
+    case GL_COLOR_ARRAY:
+      stream += 2;
+      break;
+    case GL_TEXTURE_COORD_ARRAY:
+      stream += 3;
+      break;
+    default:
+      break;
+    }
+    if (a[4])
+      f->glBindBuffer(GL_ARRAY_BUFFER, replayBuffers_.value(a[4]));
+    else
+      streamBuffer(stream, data, GL_ARRAY_BUFFER);
+    const void *pointer = bufferOffset(a[5]);
+    switch (a[0]) {
+    case GL_VERTEX_ARRAY:
+      glVertexPointer(a[1], a[2], a[3], pointer);
+      break;
+    case GL_NORMAL_ARRAY:
+      glNormalPointer(a[2], a[3], pointer);
+      break;
+    case GL_COLOR_ARRAY:
+      glColorPointer(a[1], a[2], a[3], pointer);
+      break;
+    default:
+      glTexCoordPointer(a[1], a[2], a[3], pointer);
+      break;
+    }
+    glEnableClientState(a[0]);
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    break;
+  }
+  case DISABLE_CLIENT_ARRAY:
+    glDisableClientState(a[0]);
+    break;
+  case LOAD_MATRIX:
+    glMatrixMode(a[0]);
+    glLoadMatrixf(reinterpret_cast<const GLfloat *>(data.constData()));
+    glMatrixMode(GL_MODELVIEW);
+    break;
+  case COLOR:
+    glColor4f(value(a[0]), value(a[1]), value(a[2]), value(a[3]));
+    break;
+#endif
+  case BIND_TEXTURE:
+    f->glActiveTexture(GL_TEXTURE0 + a[0]);
+    f->glBindTexture(GL_TEXTURE_2D, replayTextures_.value(a[1]));
+    f->glActiveTexture(GL_TEXTURE0);
+    break;
+  case ENABLE:
+    if (a[1])
+      f->glEnable(a[0]);
+    else
+      f->glDisable(a[0]);
+    break;
+  case VIEWPORT:
+    f->glViewport(a[0], a[1], a[2], a[3]);
+    break;
+  case SCISSOR:
+    f->glScissor(a[0], a[1], a[2], a[3]);
+    break;
+  case BLEND_FUNC:
+    f->glBlendFuncSeparate(a[0], a[1], a[2], a[3]);
+    break;
+  case DEPTH_FUNC:
+    f->glDepthFunc(a[0]);
+    f->glDepthMask(a[1] ? GL_TRUE : GL_FALSE);
+    break;
+  case CULL_FACE:
+    f->glCullFace(a[0]);
+    break;
+  case CLEAR_COLOR:
+    f->glClearColor(value(a[0]), value(a[1]), value(a[2]), value(a[3]));
+    break;
+  case LINE_WIDTH:
+    f->glLineWidth(value(a[0]));
+    break;
+  case CLEAR:
+    f->glClear(a[0]);
+    break;
+  case DRAW_ARRAYS:
+    f->glDrawArrays(a[0], GLint(a[1]), GLsizei(a[2]));
+    break;
+  case DRAW_ELEMENTS:
+    if (command.blob >= 0) {
+      // Client memory indices, drawn from a buffer
+      GLint elementBuffer = 0;
+      f->glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+      streamBuffer(indexStream, data, GL_ELEMENT_ARRAY_BUFFER);
+      f->glDrawElements(a[0], GLsizei(a[1]), a[2], nullptr);
+      f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    } else
+      f->glDrawElements(a[0], GLsizei(a[1]), a[2], bufferOffset(a[3]));
+    break;
+  default:
+    break;
+  }
+}
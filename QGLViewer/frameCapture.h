@@ -0,0 +1,191 @@
+#ifndef QGLVIEWER_FRAME_CAPTURE_H
+#define QGLVIEWER_FRAME_CAPTURE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+/*! \brief Records the OpenGL commands of a frame, to replay them without the
+  application.
+  \class FrameCapture frameCapture.h QGLViewer/frameCapture.h
+
+  Profiling draw() in the application mixes the cost of the OpenGL commands
+  with the one of the code that issues them. A FrameCapture records the
+  commands of one frame, with the data they use, in a file that the \c
+  frameReplay benchmark replays in a loop, reporting the GPU time of each
+  range of commands.
+
+  OpenGL has no portable way to intercept the calls of an application: the
+  draw calls and the buffer updates must be issued through the FrameCapture,
+  which forwards them to OpenGL and records them while isCapturing(). The
+  other states (bound program and its uniform values, vertex attribute
+  arrays, bound textures of the first units, enabled capabilities, viewport,
+  blending, depth test, and the matrices and current color of the fixed
+  pipeline) are read back from OpenGL at each recorded draw call, and only
+  their changes are recorded. The buffers, textures and programs that a draw
+  call uses are read back the first time they are used, so that they can be
+  created again by the replay. So that the costs can be told apart, marker()
+  splits the frame in named ranges:
+  \code
+  void Viewer::draw() {
+    qglviewer::FrameCapture *capture = frameCapture();
+    capture->marker("terrain");
+    terrainProgram_.bind();
+    terrainVao_.bind();
+    capture->drawElements(GL_TRIANGLES, nbTerrainIndices, GL_UNSIGNED_INT);
+    capture->marker("trees");
+    ...
+  }
+  \endcode
+
+  QGLViewer::captureFrame() records the draw() and postDraw() of the next
+  frame in a file. When nothing is captured, the FrameCapture methods only
+  forward the calls to OpenGL: the instrumented drawing code costs a test per
+  call.
+
+  Immediate mode (\c glBegin()), display lists, client memory arrays of the
+  fixed pipeline states other than the above (lights, materials...), buffer
+  and texture updates done directly with OpenGL after their first use,
+  uniform blocks and textures other than \c GL_TEXTURE_2D are not recorded.
+  The QGLViewer visual hints, drawn directly with OpenGL, are not recorded.
+
+  Capture and replay require OpenGL 3.0 or OpenGL ES 3.0. The replay must use
+  a context of the same kind (see isOpenGLES() and isCoreProfile()). */
+class QGLVIEWER_EXPORT FrameCapture {
+public:
+  FrameCapture();
+  ~FrameCapture();
+
+  /*! @name Capture */
+  //@{
+public:
+  bool beginCapture();
+  void endCapture();
+  /*! Returns \c true between beginCapture() and endCapture(). */
+  bool isCapturing() const { return capturing_; }
+
+  void marker(const QString &name);
+  void clear();
+
+  bool save(const QString &fileName) const;
+  bool load(const QString &fileName);
+
+  /*! Returns the number of commands recorded in the frame, the creation of the
+  objects excluded. */
+  int nbCommands() const { return frame_.size(); }
+  /*! Returns the size of the data recorded with the commands, in bytes. */
+  qint64 dataSize() const;
+
+  /*! Returns the size of the viewport when the capture began. */
+  QSize viewportSize() const { return viewportSize_; }
+  /*! Returns \c true when the capture was done with an OpenGL ES context. */
+  bool isOpenGLES() const { return isOpenGLES_; }
+  /*! Returns \c true when the capture was done with a core profile context. */
+  bool isCoreProfile() const { return isCoreProfile_; }
+  /*! Returns the OpenGL version of the capture context, as \c 10 * major +
+  minor. */
+  int openGLVersion() const { return version_; }
+  //@}
+
+  /*! @name Recorded OpenGL calls */
+  //@{
+public:
+  void clear(GLbitfield mask);
+  void drawArrays(GLenum mode, GLint first, GLsizei count);
+  void drawElements(GLenum mode, GLsizei count, GLenum type,
+                    const void *indices = nullptr);
+  void bufferData(GLenum target, GLsizeiptr size, const void *data,
+                  GLenum usage);
+  void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
+                     const void *data);
+  //@}
+
+  /*! @name Replay */
+  //@{
+public:
+  bool prepareReplay();
+  void replay();
+  void replayRange(int range);
+  void cleanupGL();
+
+  /*! Returns the number of ranges of the frame. The commands before the first
+  marker() are in a range named \c "frame", when there are any. */
+  int nbRanges() const { return ranges_.size(); }
+  /*! Returns the name given to marker() for range \p range. */
+  QString rangeName(int range) const { return ranges_[range].name; }
+  /*! Returns the number of commands of range \p range. */
+  int rangeSize(int range) const;
+  //@}
+
+private:
+  Q_DISABLE_COPY(FrameCapture)
+
+  struct Command {
+    quint32 opcode;
+    quint32 args[8];
+    qint32 blob; // index in blobs_, -1 without data
+  };
+
+  struct Range {
+    QString name;
+    int begin; // command index in frame_
+  };
+
+  // C a p t u r e
+  void record(quint32 opcode, const quint32 *args, int nbArgs,
+              const QByteArray &data = QByteArray(), bool setup = false);
+  bool isModified(quint64 key, const void *value, int size);
+  void recordState(const GLint *clientRange);
+  void recordProgram(GLuint program);
+  void recordUniforms(GLuint program);
+  void recordVertexAttribs(GLuint vertexArray, const GLint *clientRange);
+  void recordFixedPipeline(const GLint *clientRange);
+  void recordBuffer(GLuint buffer);
+  void recordTexture(GLuint texture);
+  bool indexRange(GLsizei count, GLenum type, const void *indices,
+                  GLint *range);
+
+  // R e p l a y
+  void execute(Command &command);
+  GLuint streamBuffer(int index, const QByteArray &data, GLenum target);
+
+  bool capturing_;
+  QVector<Command> setup_; // creation of the objects used by the frame
+  QVector<Command> frame_;
+  QVector<QByteArray> blobs_;
+  QVector<Range> ranges_;
+  QSize viewportSize_;
+  bool isOpenGLES_;
+  bool isCoreProfile_;
+  int version_;
+
+  // Capture state
+  QOpenGLContext *captureContext_;
+  QHash<quint64, QByteArray> recordedState_;
+  QHash<GLuint, QByteArray> buffers_;  // recorded content of the buffers
+  QHash<GLuint, bool> knownTextures_;  // created by setup_
+  QHash<GLuint, bool> knownPrograms_;  // idem
+
+  // Replay state
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  QHash<GLuint, GLuint> replayBuffers_; // capture name -> replay name
+  QHash<GLuint, GLuint> replayTextures_;
+  QHash<GLuint, GLuint> replayPrograms_;
+  QHash<GLuint, GLuint> replayVertexArrays_;
+  QVector<GLuint> streamBuffers_; // client memory data
+  GLuint replayProgram_;          // capture name of the bound program
+  GLuint defaultVertexArray_;     // core profile, for vertex array 0
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_CAPTURE_H
@@ -0,0 +1,317 @@
+#include "frameData.h"
+#include "frame.h"
+
+#include <cmath>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QGLVIEWER_FRAME_DATA_SSE2
+#endif
+
+using namespace qglviewer;
+
+static_assert(std::is_trivially_copyable<FrameData>::value,
+              "FrameData must remain storable in contiguous arrays");
+
+/*! Creates an identity FrameData: null translation() and rotation(). */
+FrameData::FrameData() {
+  t_[0] = t_[1] = t_[2] = 0.0;
+  q_[0] = q_[1] = q_[2] = 0.0;
+  q_[3] = 1.0;
+}
+
+/*! Creates a FrameData with the given \p translation and \p rotation. */
+FrameData::FrameData(const Vec &translation, const Quaternion &rotation) {
+  setTranslation(translation);
+  setRotation(rotation);
+}
+
+/*! Creates a FrameData with the Frame::translation() and Frame::rotation() of
+  \p frame.
+
+  Only the local transformation of \p frame is copied. Use
+  FrameData(frame.position(), frame.orientation()) to get its world
+  transformation instead. */
+FrameData::FrameData(const Frame &frame) {
+  setTranslation(frame.translation());
+  setRotation(frame.rotation());
+}
+
+/*! Returns a Frame with the translation() and rotation() of the FrameData,
+  and with a \c nullptr referenceFrame() and constraint(). */
+Frame FrameData::toFrame() const { return Frame(translation(), rotation()); }
+
+/*! Sets the Frame::translation() and Frame::rotation() of \p frame to the
+  ones of the FrameData. The Frame::constraint() of \p frame is ignored, and its
+  Frame::referenceFrame() is unchanged. \p frame emits its Frame::modified()
+  signal. */
+void FrameData::setFrame(Frame &frame) const {
+  frame.setTranslationAndRotation(translation(), rotation());
+}
+
+/*! Sets the translation() of the FrameData. */
+void FrameData::setTranslation(const Vec &translation) {
+  t_[0] = translation.x;
+  t_[1] = translation.y;
+  t_[2] = translation.z;
+}
+
+/*! Sets the rotation() of the FrameData. */
+void FrameData::setRotation(const Quaternion &rotation) {
+  for (int i = 0; i < 4; ++i)
+    q_[i] = rotation[i];
+}
+
+/*! Translates the FrameData by \p t, defined in the parent coordinate system.
+  Same as Frame::translate() without constraint. */
+void FrameData::translate(const Vec &t) { setTranslation(translation() + t); }
+
+/*! Rotates the FrameData by \p q, defined in the FrameData coordinate system.
+  Same as Frame::rotate() without constraint. */
+void FrameData::rotate(const Quaternion &q) {
+  Quaternion r = rotation() * q;
+  r.normalize(); // Prevents numerical drift
+  setRotation(r);
+}
+
+/*! Rotates the FrameData by \p rotation, defined in the FrameData coordinate
+  system, around \p point, defined in the parent coordinate system. Same as
+  Frame::rotateAroundPoint() without constraint and referenceFrame(). */
+void FrameData::rotateAroundPoint(const Quaternion &rotation,
+                                  const Vec &point) {
+  rotate(rotation);
+  const Quaternion r(inverseTransformOf(rotation.axis()), rotation.angle());
+  setTranslation(point + r.rotate(translation() - point));
+}
+
+/*! Returns the FrameData coordinates of a point \p src defined in the parent
+  coordinate system. Same as Frame::localCoordinatesOf(). */
+Vec FrameData::coordinatesOf(const Vec &src) const {
+  return rotation().inverseRotate(src - translation());
+}
+
+/*! Returns the parent coordinates of a point \p src defined in the FrameData
+  coordinate system. Same as Frame::localInverseCoordinatesOf(). */
+Vec FrameData::inverseCoordinatesOf(const Vec &src) const {
+  return rotation().rotate(src) + translation();
+}
+
+/*! Returns the FrameData transform of a vector \p src defined in the parent
+  coordinate system. Same as Frame::localTransformOf(). */
+Vec FrameData::transformOf(const Vec &src) const {
+  return rotation().inverseRotate(src);
+}
+
+/*! Returns the parent transform of a vector \p src defined in the FrameData
+  coordinate system. Same as Frame::localInverseTransformOf(). */
+Vec FrameData::inverseTransformOf(const Vec &src) const {
+  return rotation().rotate(src);
+}
+
+/*! Returns the composition of the FrameData with \p local, a FrameData
+  defined in its coordinate system.
+
+  When \c parent is the FrameData of the reference frame of \c child, \c
+  parent * \c child is the transformation of \c child in the coordinate system
+  of the parent of \c parent:
+  \code
+  (parent * child).inverseCoordinatesOf(p) ==
+      parent.inverseCoordinatesOf(child.inverseCoordinatesOf(p))
+  \endcode */
+FrameData FrameData::operator*(const FrameData &local) const {
+  return FrameData(inverseCoordinatesOf(local.translation()),
+                   rotation() * local.rotation());
+}
+
+/*! Returns the inverse transformation. Same as Frame::inverse(). */
+FrameData FrameData::inverse() const {
+  const Quaternion q = rotation();
+  return FrameData(-(q.inverseRotate(translation())), q.inverse());
+}
+
+/*! Returns the 4x4 OpenGL transformation matrix of the FrameData, in the same
+  format as Frame::matrix().
+
+  The result is only valid until the next call to matrix(). Use getMatrix()
+  in threaded code. */
+const GLdouble *FrameData::matrix() const {
+  static GLdouble m[4][4];
+  getMatrix(m);
+  return (const GLdouble *)(m);
+}
+
+/*! \c GLdouble[4][4] version of matrix(). */
+void FrameData::getMatrix(GLdouble m[4][4]) const {
+  rotation().getMatrix(m);
+
+  m[3][0] = t_[0];
+  m[3][1] = t_[1];
+  m[3][2] = t_[2];
+}
+
+/*! \c GLdouble[16] version of matrix(). */
+void FrameData::getMatrix(GLdouble m[16]) const {
+  rotation().getMatrix(m);
+
+  m[12] = t_[0];
+  m[13] = t_[1];
+  m[14] = t_[2];
+}
+
+/*! Sets the FrameData from an OpenGL 4x4 matrix. See Frame::setFromMatrix()
+  for the matrix format and the handling of scaling and homogeneous
+  coefficients. */
+void FrameData::setFromMatrix(const GLdouble m[4][4]) {
+  Frame frame;
+  frame.setFromMatrix(m);
+  *this = FrameData(frame);
+}
+
+/*! \c GLdouble[16] version of setFromMatrix(). */
+void FrameData::setFromMatrix(const GLdouble m[16]) {
+  Frame frame;
+  frame.setFromMatrix(m);
+  *this = FrameData(frame);
+}
+
+// The rotation of the OpenGL matrix m, already divided by its homogeneous
+// coefficient, as the unnormalized quaternion v / sqrt(largest), where
+// largest is the largest of 4w^2, 4x^2, 4y^2 and 4z^2. Same choice as
+// Quaternion::setFromRotationMatrix(), without its threshold on the trace.
+static void decompose(const GLdouble m[16], GLdouble scale, GLdouble q[4]) {
+  const GLdouble r00 = m[0] * scale, r11 = m[5] * scale, r22 = m[10] * scale;
+  const GLdouble w2 = 1.0 + r00 + r11 + r22, x2 = 1.0 + r00 - r11 - r22;
+  const GLdouble y2 = 1.0 - r00 + r11 - r22, z2 = 1.0 - r00 - r11 + r22;
+  const GLdouble a = (m[6] - m[9]) * scale, b = (m[8] - m[2]) * scale;
+  const GLdouble c = (m[1] - m[4]) * scale, d = (m[4] + m[1]) * scale;
+  const GLdouble e = (m[8] + m[2]) * scale, f = (m[9] + m[6]) * scale;
+
+  GLdouble largest;
+  if ((w2 >= x2) && (w2 >= y2) && (w2 >= z2)) {
+    q[0] = a, q[1] = b, q[2] = c, q[3] = largest = w2;
+  } else if ((x2 >= y2) && (x2 >= z2)) {
+    q[0] = largest = x2, q[1] = d, q[2] = e, q[3] = a;
+  } else if (y2 >= z2) {
+    q[0] = d, q[1] = largest = y2, q[2] = f, q[3] = b;
+  } else {
+    q[0] = e, q[1] = f, q[2] = largest = z2, q[3] = c;
+  }
+
+  const GLdouble s = 0.5 / sqrt(largest);
+  for (int i = 0; i < 4; ++i)
+    q[i] *= s;
+}
+
+#ifdef QGLVIEWER_FRAME_DATA_SSE2
+// Selects a where mask is set, b elsewhere
+static inline __m128d select(__m128d mask, __m128d a, __m128d b) {
+  return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+// decompose() on two matrices at once. The four cases are computed, and
+// selected with masks.
+static void decompose2(const GLdouble *m0, const GLdouble *m1,
+                       __m128d scale, GLdouble q0[4], GLdouble q1[4]) {
+#define QGLVIEWER_LOAD(i) _mm_mul_pd(_mm_set_pd(m1[i], m0[i]), scale)
+  const __m128d r00 = QGLVIEWER_LOAD(0), r11 = QGLVIEWER_LOAD(5);
+  const __m128d r22 = QGLVIEWER_LOAD(10);
+  const __m128d r01 = QGLVIEWER_LOAD(4), r10 = QGLVIEWER_LOAD(1);
+  const __m128d r02 = QGLVIEWER_LOAD(8), r20 = QGLVIEWER_LOAD(2);
+  const __m128d r12 = QGLVIEWER_LOAD(9), r21 = QGLVIEWER_LOAD(6);
+#undef QGLVIEWER_LOAD
+
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d w2 = _mm_add_pd(_mm_add_pd(one, r00), _mm_add_pd(r11, r22));
+  const __m128d x2 = _mm_sub_pd(_mm_add_pd(one, r00), _mm_add_pd(r11, r22));
+  const __m128d y2 = _mm_sub_pd(_mm_add_pd(one, r11), _mm_add_pd(r00, r22));
+  const __m128d z2 = _mm_sub_pd(_mm_add_pd(one, r22), _mm_add_pd(r00, r11));
+  const __m128d a = _mm_sub_pd(r21, r12), b = _mm_sub_pd(r02, r20);
+  const __m128d c = _mm_sub_pd(r10, r01), d = _mm_add_pd(r01, r10);
+  const __m128d e = _mm_add_pd(r02, r20), f = _mm_add_pd(r12, r21);
+
+  // Same priorities as the comparisons of decompose()
+  const __m128d isW = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(w2, x2),
+                                            _mm_cmpge_pd(w2, y2)),
+                                 _mm_cmpge_pd(w2, z2));
+  const __m128d isX = _mm_andnot_pd(
+      isW, _mm_and_pd(_mm_cmpge_pd(x2, y2), _mm_cmpge_pd(x2, z2)));
+  const __m128d isY =
+      _mm_andnot_pd(_mm_or_pd(isW, isX), _mm_cmpge_pd(y2, z2));
+
+  const __m128d largest =
+      select(isW, w2, select(isX, x2, select(isY, y2, z2)));
+  const __m128d s = _mm_div_pd(_mm_set1_pd(0.5), _mm_sqrt_pd(largest));
+  __m128d q[4];
+  q[0] = select(isW, a, select(isX, x2, select(isY, d, e)));
+  q[1] = select(isW, b, select(isX, d, select(isY, y2, f)));
+  q[2] = select(isW, c, select(isX, e, select(isY, f, z2)));
+  q[3] = select(isW, w2, select(isX, a, select(isY, b, c)));
+
+  for (int i = 0; i < 4; ++i) {
+    const __m128d v = _mm_mul_pd(q[i], s);
+    _mm_storel_pd(q0 + i, v);
+    _mm_storeh_pd(q1 + i, v);
+  }
+}
+#endif
+
+/*! Sets the \p nb FrameData of \p result from the \p nb OpenGL matrices
+  stored one after the other in \p matrices (16 values each), as
+  setFromMatrix() would.
+
+  All the matrices are decomposed in a single loop, two at a time with SSE2
+  instructions when they are available, without the Frame that
+  setFromMatrix() creates. The rotations may differ from the
+  Quaternion::setFromRotationMatrix() ones by rounding errors. A matrix with a
+  null homogeneous coefficient leaves its FrameData unchanged.
+
+  Used by Frame::setFromMatrices() and FramePool::setLocalTransforms(). */
+void FrameData::fromMatrices(const GLdouble *matrices, int nb,
+                             FrameData *result) {
+  bool warned = false;
+  int i = 0;
+#ifdef QGLVIEWER_FRAME_DATA_SSE2
+  for (; i + 2 <= nb; i += 2) {
+    const GLdouble *const m0 = matrices + 16 * i;
+    const GLdouble *const m1 = m0 + 16;
+    if ((fabs(m0[15]) < 1E-8) || (fabs(m1[15]) < 1E-8)) {
+      fromMatrix(m0, result[i], warned);
+      fromMatrix(m1, result[i + 1], warned);
+      continue;
+    }
+    GLdouble q[2][4];
+    decompose2(m0, m1, _mm_set_pd(1.0 / m1[15], 1.0 / m0[15]), q[0], q[1]);
+    result[i].set(m0, q[0]);
+    result[i + 1].set(m1, q[1]);
+  }
+#endif
+  for (; i < nb; ++i)
+    fromMatrix(matrices + 16 * i, result[i], warned);
+}
+
+// Sets the translation of m and the rotation q, normalized
+void FrameData::set(const GLdouble m[16], const GLdouble q[4]) {
+  for (int k = 0; k < 3; ++k)
+    t_[k] = Real(m[12 + k] / m[15]);
+  const GLdouble n =
+      1.0 / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  for (int k = 0; k < 4; ++k)
+    q_[k] = Real(q[k] * n);
+}
+
+// Scalar version of fromMatrices(), on a single matrix. Warns once per call
+// to fromMatrices().
+void FrameData::fromMatrix(const GLdouble m[16], FrameData &result,
+                           bool &warned) {
+  if (fabs(m[15]) < 1E-8) {
+    if (!warned)
+      qWarning("FrameData::fromMatrices: Null homogeneous coefficient");
+    warned = true;
+    return;
+  }
+  GLdouble q[4];
+  decompose(m, 1.0 / m[15], q);
+  result.set(m, q);
+}
@@ -0,0 +1,101 @@
+#ifndef QGLVIEWER_FRAME_DATA_H
+#define QGLVIEWER_FRAME_DATA_H
+
+#include "quaternion.h"
+
+namespace qglviewer {
+class Frame;
+
+/*! \brief A plain value rigid transformation, with the coordinate conversions
+  of a Frame.
+  \class FrameData frameData.h QGLViewer/frameData.h
+
+  A FrameData stores a translation() and a rotation(), as seven Real values and
+  nothing else: it is not a QObject, has no signal, no constraint and no
+  referenceFrame(). It is trivially copyable, which makes it possible to store
+  millions of transformations, for instance the instances of a scene, in a
+  contiguous array:
+  \code
+  QVector<FrameData> instances(nbInstances);
+  for (int i = 0; i < nbInstances; ++i) {
+    glPushMatrix();
+    glMultMatrixd(instances[i].matrix());
+    drawInstance(i);
+    glPopMatrix();
+  }
+  \endcode
+
+  The FrameData is defined with respect to an implicit parent coordinate
+  system. Its methods perform the same conversions as the \e local methods of
+  Frame: coordinatesOf() is Frame::localCoordinatesOf(), transformOf() is
+  Frame::localTransformOf()... Use operator*() to compose a FrameData with the
+  one of its parent, or a FramePool to evaluate a whole hierarchy of them.
+
+  Convert explicitly to a Frame, with toFrame() or setFrame(), when signals or
+  a constraint are needed, and back with the FrameData(const Frame&)
+  constructor. */
+class QGLVIEWER_EXPORT FrameData {
+public:
+  FrameData();
+  FrameData(const Vec &translation, const Quaternion &rotation);
+  explicit FrameData(const Frame &frame);
+
+  /*! @name Conversion to Frame */
+  //@{
+  Frame toFrame() const;
+  void setFrame(Frame &frame) const;
+  //@}
+
+  /*! @name Translation and rotation */
+  //@{
+  /*! Returns the translation of the FrameData. Same as Frame::translation(). */
+  Vec translation() const { return Vec(t_[0], t_[1], t_[2]); }
+  /*! Returns the rotation of the FrameData. Same as Frame::rotation(). */
+  Quaternion rotation() const { return Quaternion(q_[0], q_[1], q_[2], q_[3]); }
+  void setTranslation(const Vec &translation);
+  void setRotation(const Quaternion &rotation);
+
+  void translate(const Vec &t);
+  void rotate(const Quaternion &q);
+  void rotateAroundPoint(const Quaternion &rotation, const Vec &point);
+  //@}
+
+  /*! @name Coordinate system transformations */
+  //@{
+  Vec coordinatesOf(const Vec &src) const;
+  Vec inverseCoordinatesOf(const Vec &src) const;
+  Vec transformOf(const Vec &src) const;
+  Vec inverseTransformOf(const Vec &src) const;
+  //@}
+
+  /*! @name Composition and inversion */
+  //@{
+  FrameData operator*(const FrameData &local) const;
+  FrameData inverse() const;
+  //@}
+
+  /*! @name Associated matrices */
+  //@{
+  const GLdouble *matrix() const;
+  void getMatrix(GLdouble m[4][4]) const;
+  void getMatrix(GLdouble m[16]) const;
+
+  void setFromMatrix(const GLdouble m[4][4]);
+  void setFromMatrix(const GLdouble m[16]);
+
+  static void fromMatrices(const GLdouble *matrices, int nb,
+                           FrameData *result);
+  //@}
+
+private:
+  void set(const GLdouble m[16], const GLdouble q[4]);
+  static void fromMatrix(const GLdouble m[16], FrameData &result,
+                         bool &warned);
+
+  Real t_[3];
+  Real q_[4];
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_DATA_H
@@ -0,0 +1,349 @@
+#include "frameGraph.h"
+#include "renderTarget.h"
+
+#include <climits>
+
+using namespace qglviewer;
+
+/*! Creates an empty FrameGraph. */
+FrameGraph::FrameGraph() : isCompiled_(false), nbExecutedPasses_(0) {}
+
+/*! Destructor. The RenderTargets are only released when the context they were
+used with is current. Call cleanupGL() before otherwise. */
+FrameGraph::~FrameGraph() { qDeleteAll(renderTargets_); }
+
+int FrameGraph::passIndex(const QString &name) const {
+  for (int i = 0; i < passes_.size(); ++i)
+    if (passes_[i].name == name)
+      return i;
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Passes                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds a pass named \p name, executed during \p stage after the previously
+added passes of this stage. \p execute draws the pass, in the \p output
+target when it is not null, and in the current framebuffer otherwise.
+
+Each target is drawn by a single pass: does nothing (and displays a warning)
+when \p name or \p output is already used by another pass. */
+void FrameGraph::addPass(const QString &name, Stage stage,
+                         const std::function<void()> &execute,
+                         const QString &output) {
+  if (passIndex(name) >= 0) {
+    qWarning("FrameGraph::addPass: a pass is already named %s",
+             qPrintable(name));
+    return;
+  }
+  if (!output.isNull())
+    for (const Pass &pass : passes_)
+      if (pass.output == output) {
+        qWarning("FrameGraph::addPass: %s is already drawn by %s",
+                 qPrintable(output), qPrintable(pass.name));
+        return;
+      }
+
+  Pass pass;
+  pass.name = name;
+  pass.stage = stage;
+  pass.execute = execute;
+  pass.output = output;
+  pass.isEnabled = true;
+  pass.isExecuted = false;
+
+  // After the last pass of its stage
+  int index = passes_.size();
+  if (stage == PRE_DRAW)
+    while ((index > 0) && (passes_[index - 1].stage == POST_DRAW))
+      --index;
+  passes_.insert(index, pass);
+
+  if (!output.isNull() && !targets_.contains(output)) {
+    Target target;
+    target.isPersistent = false;
+    target.renderTarget = -1;
+    targets_.insert(output, target);
+  }
+  isCompiled_ = false;
+}
+
+/*! Declares that the pass \p pass reads the \p target drawn by a previous
+pass. \p pass is culled when \p target is not drawn. */
+void FrameGraph::addInput(const QString &pass, const QString &target) {
+  const int index = passIndex(pass);
+  if (index < 0) {
+    qWarning("FrameGraph::addInput: no pass named %s", qPrintable(pass));
+    return;
+  }
+  if (!passes_[index].inputs.contains(target))
+    passes_[index].inputs.append(target);
+  isCompiled_ = false;
+}
+
+/*! Removes the pass \p name. The passes that read its output are then
+culled. */
+void FrameGraph::removePass(const QString &name) {
+  const int index = passIndex(name);
+  if (index < 0)
+    return;
+  const QString output = passes_[index].output;
+  passes_.remove(index);
+  // Keeps the size and persistence of the targets that are still read
+  if (!output.isNull() && (targets_.value(output).size.isEmpty()) &&
+      !targets_.value(output).isPersistent)
+    targets_.remove(output);
+  isCompiled_ = false;
+}
+
+/*! Removes all the passes and targets. The RenderTargets are deleted by the
+next execute(), or by cleanupGL(). */
+void FrameGraph::clear() {
+  passes_.clear();
+  targets_.clear();
+  isCompiled_ = false;
+}
+
+/*! Enables or disables the pass \p name. A disabled pass is culled, as are the
+passes that read its output, and the passes whose output is only read by
+culled passes. All passes are enabled by default. */
+void FrameGraph::setPassEnabled(const QString &name, bool enabled) {
+  const int index = passIndex(name);
+  if ((index >= 0) && (passes_[index].isEnabled != enabled)) {
+    passes_[index].isEnabled = enabled;
+    isCompiled_ = false;
+  }
+}
+
+/*! Returns \c true when the pass \p name is enabled. See setPassEnabled(). */
+bool FrameGraph::isPassEnabled(const QString &name) const {
+  const int index = passIndex(name);
+  return (index >= 0) && passes_[index].isEnabled;
+}
+
+/*! Returns the names of the passes, in execution order. */
+QStringList FrameGraph::passes() const {
+  QStringList names;
+  for (const Pass &pass : passes_)
+    names.append(pass.name);
+  return names;
+}
+
+/*! Returns \c true when the pass \p name was not executed by the last
+compiled frame, because it is disabled or not needed. */
+bool FrameGraph::isPassCulled(const QString &name) const {
+  const int index = passIndex(name);
+  return (index < 0) || !isCompiled_ || !passes_[index].isExecuted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Targets                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the size, in pixels, of \p target. Default is an empty size, which
+means the viewport size given to execute(). */
+void FrameGraph::setTargetSize(const QString &target, const QSize &size) {
+  if (!targets_.contains(target)) {
+    Target t;
+    t.isPersistent = false;
+    t.renderTarget = -1;
+    targets_.insert(target, t);
+  }
+  targets_[target].size = size;
+  isCompiled_ = false;
+}
+
+/*! Returns the size of \p target set by setTargetSize(). */
+QSize FrameGraph::targetSize(const QString &target) const {
+  return targets_.value(target).size;
+}
+
+/*! Makes \p target persistent: its pass is never culled, and its RenderTarget
+is not shared with the other targets, so that its textures remain valid after
+the frame (to read them with \c glReadPixels() in a mouse event handler, for
+instance). Targets are not persistent by default. */
+void FrameGraph::setTargetPersistent(const QString &target, bool persistent) {
+  if (!targets_.contains(target)) {
+    Target t;
+    t.renderTarget = -1;
+    targets_.insert(target, t);
+  }
+  targets_[target].isPersistent = persistent;
+  isCompiled_ = false;
+}
+
+/*! Returns \c true when \p target is persistent. See setTargetPersistent(). */
+bool FrameGraph::isTargetPersistent(const QString &target) const {
+  return targets_.value(target).isPersistent;
+}
+
+/*! Returns the color texture of \p target, or 0 when it is not drawn by the
+current frame. See RenderTarget::colorTexture(). */
+GLuint FrameGraph::colorTexture(const QString &target) const {
+  const int index =
+      isCompiled_ ? targets_.value(target, Target{QSize(), false, -1})
+                        .renderTarget
+                  : -1;
+  return (index >= 0) ? renderTargets_[index]->colorTexture() : 0;
+}
+
+/*! Returns the depth texture of \p target, or 0 when it is not drawn by the
+current frame. See RenderTarget::depthTexture(). */
+GLuint FrameGraph::depthTexture(const QString &target) const {
+  const int index =
+      isCompiled_ ? targets_.value(target, Target{QSize(), false, -1})
+                        .renderTarget
+                  : -1;
+  return (index >= 0) ? renderTargets_[index]->depthTexture() : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Execution                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+// Culls the passes and assigns a RenderTarget to each drawn target. Targets
+// share a RenderTarget of their size when their lifetimes (from the pass that
+// draws them to the last pass that reads them) do not overlap.
+void FrameGraph::compile(const QSize &viewportSize) {
+  const int nbPasses = passes_.size();
+
+  // Forward: passes whose inputs are all drawn by previous passes
+  QHash<QString, int> producers;
+  QVector<bool> isAlive(nbPasses);
+  for (int i = 0; i < nbPasses; ++i) {
+    const Pass &pass = passes_[i];
+    isAlive[i] = pass.isEnabled;
+    for (const QString &input : pass.inputs)
+      isAlive[i] = isAlive[i] && producers.contains(input);
+    if (isAlive[i] && !pass.output.isNull())
+      producers.insert(pass.output, i);
+  }
+
+  // The outputs of the PRE_DRAW passes are read by draw(), which happens
+  // just before the first POST_DRAW pass
+  int firstPostDraw = 0;
+  while ((firstPostDraw < nbPasses) &&
+         (passes_[firstPostDraw].stage == PRE_DRAW))
+    ++firstPostDraw;
+
+  // Backward: passes whose output is read, persistent, drawn before draw(),
+  // or the framebuffer. lastUses gives the last executed pass that reads each
+  // target.
+  QHash<QString, int> lastUses;
+  for (QHash<QString, Target>::const_iterator it = targets_.constBegin();
+       it != targets_.constEnd(); ++it)
+    if (it.value().isPersistent)
+      lastUses.insert(it.key(), INT_MAX);
+  nbExecutedPasses_ = 0;
+  for (int i = nbPasses - 1; i >= 0; --i) {
+    Pass &pass = passes_[i];
+    pass.isExecuted = isAlive[i] &&
+                      (pass.output.isNull() || (pass.stage == PRE_DRAW) ||
+                       lastUses.contains(pass.output));
+    if (!pass.isExecuted)
+      continue;
+    ++nbExecutedPasses_;
+    for (const QString &input : pass.inputs)
+      if (!lastUses.contains(input))
+        lastUses.insert(input, i);
+  }
+
+  // Assignment, in execution order. freeAfter gives the last pass that reads
+  // the current target of each RenderTarget.
+  QVector<QSize> sizes;
+  QVector<int> freeAfter;
+  for (QHash<QString, Target>::iterator it = targets_.begin();
+       it != targets_.end(); ++it)
+    it.value().renderTarget = -1;
+  for (int i = 0; i < nbPasses; ++i) {
+    const Pass &pass = passes_[i];
+    if (!pass.isExecuted || pass.output.isNull())
+      continue;
+    Target &target = targets_[pass.output];
+    const QSize size = target.size.isEmpty() ? viewportSize : target.size;
+    int lastUse = qMax(lastUses.value(pass.output, i), i);
+    if (pass.stage == PRE_DRAW)
+      lastUse = qMax(lastUse, firstPostDraw - 1);
+    int index = -1;
+    if (!target.isPersistent)
+      for (int r = 0; (index < 0) && (r < sizes.size()); ++r)
+        if ((sizes[r] == size) && (freeAfter[r] < i))
+          index = r;
+    if (index < 0) {
+      index = sizes.size();
+      sizes.append(size);
+      freeAfter.append(0);
+    }
+    freeAfter[index] = lastUse;
+    target.renderTarget = index;
+  }
+
+  // Keeps the existing RenderTargets of the same size, so that they are not
+  // reallocated
+  QVector<RenderTarget *> previous = renderTargets_;
+  renderTargets_.fill(nullptr, sizes.size());
+  for (int r = 0; r < sizes.size(); ++r)
+    for (int p = 0; p < previous.size(); ++p)
+      if (previous[p] && (previous[p]->size() == sizes[r])) {
+        renderTargets_[r] = previous[p];
+        previous[p] = nullptr;
+        break;
+      }
+  for (int r = 0; r < sizes.size(); ++r)
+    if (!renderTargets_[r]) {
+      for (int p = 0; !renderTargets_[r] && (p < previous.size()); ++p)
+        if (previous[p]) {
+          renderTargets_[r] = previous[p];
+          previous[p] = nullptr;
+        }
+      if (!renderTargets_[r])
+        renderTargets_[r] = new RenderTarget();
+      renderTargets_[r]->setSize(sizes[r]);
+    }
+  for (RenderTarget *renderTarget : previous)
+    if (renderTarget) {
+      renderTarget->cleanupGL();
+      delete renderTarget;
+    }
+
+  compiledViewportSize_ = viewportSize;
+  isCompiled_ = true;
+}
+
+/*! Executes the passes of \p stage that are not culled. \p viewportSize is
+the size of the targets that have no targetSize(), in pixels.
+
+Called by QGLViewer::preDraw() and QGLViewer::postDraw() for the
+QGLViewer::frameGraph(). The graph is compiled when it was modified, or when
+\p viewportSize changed. */
+void FrameGraph::execute(Stage stage, const QSize &viewportSize) {
+  if (!isCompiled_ || (viewportSize != compiledViewportSize_))
+    compile(viewportSize);
+
+  for (const Pass &pass : passes_) {
+    if ((pass.stage != stage) || !pass.isExecuted)
+      continue;
+    if (pass.output.isNull())
+      pass.execute();
+    else {
+      RenderTarget *target =
+          renderTargets_[targets_.value(pass.output).renderTarget];
+      if (target->bind()) {
+        pass.execute();
+        target->release();
+      }
+    }
+  }
+}
+
+/*! Deletes the RenderTargets. The context they were used with must be
+current. They are created again by the next execute(). */
+void FrameGraph::cleanupGL() {
+  for (RenderTarget *renderTarget : renderTargets_) {
+    renderTarget->cleanupGL();
+    delete renderTarget;
+  }
+  renderTargets_.clear();
+  isCompiled_ = false;
+}
@@ -0,0 +1,160 @@
+#ifndef QGLVIEWER_FRAME_GRAPH_H
+#define QGLVIEWER_FRAME_GRAPH_H
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+#include "config.h"
+
+namespace qglviewer {
+class RenderTarget;
+
+/*! \brief Schedules the render passes of a frame, and shares their
+  intermediate render targets.
+  \class FrameGraph frameGraph.h QGLViewer/frameGraph.h
+
+  A viewer that draws a shadow map, an object identifier buffer and a blurred
+  overlay usually keeps one framebuffer per effect, allocated for the whole
+  viewer lifetime. With a FrameGraph, each pass instead declares the target it
+  draws in and the targets it reads. The graph then only allocates as many
+  RenderTarget as the passes use simultaneously: a target that is no longer
+  read by the next passes is reused by the following outputs of the same
+  size. Passes whose output is not read are culled, as are the passes that
+  are disabled with setPassEnabled(). The output of a PRE_DRAW pass is read by
+  draw(), which the graph cannot see, and is hence always kept:
+  \code
+  // In your viewer's init()
+  qglviewer::FrameGraph *graph = frameGraph();
+  graph->addPass("shadow", qglviewer::FrameGraph::PRE_DRAW,
+                 [this]() { drawShadowCasters(); }, "shadowMap");
+  graph->setTargetSize("shadowMap", QSize(2048, 2048));
+  graph->addPass("ids", qglviewer::FrameGraph::POST_DRAW,
+                 [this]() { drawObjectIds(); }, "ids");
+  graph->addPass("hover", qglviewer::FrameGraph::POST_DRAW,
+                 [this]() { highlightHoveredObject(); });
+  graph->addInput("hover", "ids");
+
+  // draw() uses graph->colorTexture("shadowMap") for its shadows: the
+  // "shadow" PRE_DRAW pass is not culled although no pass reads its output
+
+  // The ids are no longer drawn when hover picking is disabled
+  graph->setPassEnabled("hover", hoverPickingIsEnabled);
+  \endcode
+
+  The PRE_DRAW passes are executed at the beginning of QGLViewer::preDraw(),
+  and the POST_DRAW ones at the beginning of QGLViewer::postDraw(). passes()
+  lists all the PRE_DRAW passes first, and the passes of a stage in the order
+  of their addPass(). A pass with an output draws between the
+  RenderTarget::bind() and RenderTarget::release() of its target, which it
+  should clear. A pass without output draws in the current framebuffer (the
+  viewer's frame for a POST_DRAW pass) and is never culled, except when one
+  of its inputs is not drawn.
+
+  The colorTexture() and depthTexture() of a target are valid from the pass
+  that draws it to the last pass that reads it (at least until the end of
+  draw() for the output of a PRE_DRAW pass), and during the whole frame
+  for the persistent targets (see setTargetPersistent()). Passes restore the
+  OpenGL state they modify.
+
+  Modify the graph outside of the frame drawing (in an event handler rather
+  than in draw()): the targets drawn by the PRE_DRAW passes of the current
+  frame may otherwise be lost by the new compilation.
+
+  The graph is compiled again by the next execute() after any change of its
+  passes, and the RenderTargets that are no longer needed are then deleted.
+  All the OpenGL methods must be called with the viewer's context current:
+  call cleanupGL() before it is destroyed. */
+class QGLVIEWER_EXPORT FrameGraph {
+public:
+  /*! Where the passes are executed during a QGLViewer frame. */
+  enum Stage {
+    PRE_DRAW, /*!< In QGLViewer::preDraw(), before the scene is drawn. */
+    POST_DRAW /*!< In QGLViewer::postDraw(), after the scene is drawn. */
+  };
+
+  FrameGraph();
+  ~FrameGraph();
+
+  /*! @name Passes */
+  //@{
+public:
+  void addPass(const QString &name, Stage stage,
+               const std::function<void()> &execute,
+               const QString &output = QString());
+  void addInput(const QString &pass, const QString &target);
+  void removePass(const QString &name);
+  void clear();
+
+  void setPassEnabled(const QString &name, bool enabled);
+  bool isPassEnabled(const QString &name) const;
+
+  QStringList passes() const;
+  bool isPassCulled(const QString &name) const;
+  //@}
+
+  /*! @name Targets */
+  //@{
+public:
+  void setTargetSize(const QString &target, const QSize &size);
+  QSize targetSize(const QString &target) const;
+  void setTargetPersistent(const QString &target, bool persistent);
+  bool isTargetPersistent(const QString &target) const;
+
+  GLuint colorTexture(const QString &target) const;
+  GLuint depthTexture(const QString &target) const;
+  //@}
+
+  /*! @name Execution */
+  //@{
+public:
+  void execute(Stage stage, const QSize &viewportSize);
+  void cleanupGL();
+
+  /*! Returns the number of passes executed by the last compiled frame. */
+  int nbExecutedPasses() const { return nbExecutedPasses_; }
+  /*! Returns the number of RenderTargets allocated for the targets of the
+  executed passes, which is smaller than the number of targets when some of
+  them are aliased. */
+  int nbRenderTargets() const { return renderTargets_.size(); }
+  //@}
+
+private:
+  Q_DISABLE_COPY(FrameGraph)
+
+  struct Pass {
+    QString name;
+    Stage stage;
+    std::function<void()> execute;
+    QString output; // null when drawing in the current framebuffer
+    QStringList inputs;
+    bool isEnabled;
+    bool isExecuted; // set by compile()
+  };
+
+  struct Target {
+    QSize size;     // empty for the viewport size
+    bool isPersistent;
+    int renderTarget; // assigned by compile(), or -1
+  };
+
+  int passIndex(const QString &name) const;
+  void compile(const QSize &viewportSize);
+
+  QVector<Pass> passes_; // PRE_DRAW ones first
+  QHash<QString, Target> targets_;
+  bool isCompiled_;
+  QSize compiledViewportSize_;
+  int nbExecutedPasses_;
+
+  // O p e n G L
+  QVector<RenderTarget *> renderTargets_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_GRAPH_H
@@ -0,0 +1,337 @@
+#include "framePool.h"
+#include "taskScheduler.h"
+
+
+#include <algorithm>
+
+using namespace qglviewer;
+
+/*! Creates an empty FramePool. */
+FramePool::FramePool()
+    : isSorted_(true), parallelEvaluation_(false) {}
+
+/*! Destructor. */
+FramePool::~FramePool() {}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Hierarchy                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds a frame to the pool and returns its index.
+
+\p local is its local transformation, defined in the coordinate system of
+frame \p parent, or in the world coordinate system when \p parent is -1
+(default). An invalid \p parent is replaced by -1. */
+int FramePool::addFrame(const FrameData &local, int parent) {
+  if ((parent < -1) || (parent >= nbFrames())) {
+    qWarning("FramePool::addFrame: invalid parent %d", parent);
+    parent = -1;
+  }
+
+  const int id = nbFrames();
+  parent_.append(parent);
+  slot_.append(id_.size());
+  id_.append(id);
+  parentSlot_.append(parent == -1 ? -1 : slot_[parent]);
+
+  const Vec t = local.translation();
+  const Quaternion q = local.rotation();
+  for (int i = 0; i < 3; ++i) {
+    t_[i].append(t[i]);
+    worldT_[i].append(t[i]);
+  }
+  for (int i = 0; i < 4; ++i) {
+    q_[i].append(q[i]);
+    worldQ_[i].append(q[i]);
+  }
+  worldMatrices_.resize(16 * nbFrames());
+  local.getMatrix(worldMatrices_.data() + 16 * slot_[id]);
+
+  isSorted_ = false;
+  return id;
+}
+
+/*! Removes all the frames of the pool. */
+void FramePool::clear() {
+  parent_.clear();
+  slot_.clear();
+  id_.clear();
+  parentSlot_.clear();
+  levelBegin_.clear();
+  for (int i = 0; i < 3; ++i) {
+    t_[i].clear();
+    worldT_[i].clear();
+  }
+  for (int i = 0; i < 4; ++i) {
+    q_[i].clear();
+    worldQ_[i].clear();
+  }
+  worldMatrices_.clear();
+  isSorted_ = true;
+}
+
+/*! Sets the parent() of frame \p id. Use -1 to define it in the world
+coordinate system.
+
+Its local transformation is unchanged: the frame moves with its new parent.
+Creating a loop in the hierarchy is not allowed, and the parent is then left
+unchanged. */
+void FramePool::setParent(int id, int parent) {
+  if ((parent < -1) || (parent >= nbFrames())) {
+    qWarning("FramePool::setParent: invalid parent %d", parent);
+    return;
+  }
+
+  for (int p = parent; p != -1; p = parent_[p])
+    if (p == id) {
+      qWarning("FramePool::setParent would create a loop in the hierarchy");
+      return;
+    }
+
+  if (parent_[id] == parent)
+    return;
+
+  parent_[id] = parent;
+  parentSlot_[slot_[id]] = (parent == -1) ? -1 : slot_[parent];
+  isSorted_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                           Local transformations                            //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the local transformation of frame \p id, with respect to its
+parent(). */
+FrameData FramePool::localTransform(int id) const {
+  const int s = slot_[id];
+  return FrameData(Vec(t_[0][s], t_[1][s], t_[2][s]),
+                   Quaternion(q_[0][s], q_[1][s], q_[2][s], q_[3][s]));
+}
+
+/*! Sets the local transformation of frame \p id, with respect to its
+parent(). The world transformations are only updated by
+updateWorldTransforms(). */
+void FramePool::setLocalTransform(int id, const FrameData &local) {
+  const int s = slot_[id];
+  const Vec t = local.translation();
+  const Quaternion q = local.rotation();
+  for (int i = 0; i < 3; ++i)
+    t_[i][s] = t[i];
+  for (int i = 0; i < 4; ++i)
+    q_[i][s] = q[i];
+}
+
+/*! Sets the local transformations of the \p nb frames of \p ids from the
+\p nb OpenGL matrices stored one after the other in \p matrices (16 values
+each, see Frame::setFromMatrix()). When \p ids is \c nullptr, the frames 0 to
+\p nb-1 are set.
+
+The matrices are decomposed all at once by FrameData::fromMatrices(), and
+directly stored in the arrays of the pool. A matrix with a null homogeneous
+coefficient leaves its frame unchanged. */
+void FramePool::setLocalTransforms(const int ids[], const GLdouble *matrices,
+                                   int nb) {
+  QVector<FrameData> local(nb);
+  for (int i = 0; i < nb; ++i)
+    local[i] = localTransform(ids ? ids[i] : i);
+  FrameData::fromMatrices(matrices, nb, local.data());
+  for (int i = 0; i < nb; ++i)
+    setLocalTransform(ids ? ids[i] : i, local[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                           World transformations                            //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the world transformation of frame \p id, as computed by the last
+updateWorldTransforms(). */
+FrameData FramePool::worldTransform(int id) const {
+  const int s = slot_[id];
+  return FrameData(
+      Vec(worldT_[0][s], worldT_[1][s], worldT_[2][s]),
+      Quaternion(worldQ_[0][s], worldQ_[1][s], worldQ_[2][s], worldQ_[3][s]));
+}
+
+/*! Sets the parallelEvaluation() value. */
+void FramePool::setParallelEvaluation(bool parallel) {
+  parallelEvaluation_ = parallel;
+}
+
+// Reorders the slots by increasing depth. Frames of the same depth keep their
+// id order.
+void FramePool::sortByDepth() {
+  const int nb = nbFrames();
+
+  // Depths are computed in id order, a parent having a smaller id unless it
+  // was changed by setParent().
+  QVector<int> depth(nb, -1);
+  QVector<int> chain;
+  int nbLevels = 0;
+  for (int id = 0; id < nb; ++id) {
+    int f = id;
+    while (f != -1 && depth[f] == -1) {
+      chain.append(f);
+      f = parent_[f];
+    }
+    int d = (f == -1) ? -1 : depth[f];
+    while (!chain.isEmpty()) {
+      depth[chain.last()] = ++d;
+      chain.removeLast();
+    }
+    nbLevels = qMax(nbLevels, depth[id] + 1);
+  }
+
+  // Counting sort
+  levelBegin_.fill(0, nbLevels + 1);
+  for (int id = 0; id < nb; ++id)
+    ++levelBegin_[depth[id] + 1];
+  for (int d = 0; d < nbLevels; ++d)
+    levelBegin_[d + 1] += levelBegin_[d];
+
+  QVector<int> next = levelBegin_;
+  const QVector<int> oldSlot = slot_;
+  for (int id = 0; id < nb; ++id) {
+    slot_[id] = next[depth[id]]++;
+    id_[slot_[id]] = id;
+  }
+  for (int s = 0; s < nb; ++s) {
+    const int p = parent_[id_[s]];
+    parentSlot_[s] = (p == -1) ? -1 : slot_[p];
+  }
+
+  // The local transformations follow their frames
+  for (int i = 0; i < 7; ++i) {
+    QVector<Real> &local = (i < 3) ? t_[i] : q_[i - 3];
+    const QVector<Real> old = local;
+    for (int id = 0; id < nb; ++id)
+      local[slot_[id]] = old[oldSlot[id]];
+  }
+
+  isSorted_ = true;
+}
+
+// Calls evaluate on [begin, end), split between the TaskScheduler threads when
+// the range is large enough.
+void FramePool::run(int begin, int end, void (FramePool::*evaluate)(int, int)) {
+  if (!parallelEvaluation_) {
+    (this->*evaluate)(begin, end);
+    return;
+  }
+
+  // Minimum number of frames evaluated by a thread. Composition is cheap, only
+  // large levels are worth the synchronization.
+  const int minChunkSize = 2048;
+  TaskScheduler::parallelFor(
+      end - begin,
+      [this, evaluate, begin](int b, int e) {
+        (this->*evaluate)(begin + b, begin + e);
+      },
+      minChunkSize);
+}
+
+void FramePool::copyRoots(int begin, int end) {
+  for (int i = 0; i < 3; ++i)
+    std::copy(t_[i].constData() + begin, t_[i].constData() + end,
+              worldT_[i].data() + begin);
+  for (int i = 0; i < 4; ++i)
+    std::copy(q_[i].constData() + begin, q_[i].constData() + end,
+              worldQ_[i].data() + begin);
+}
+
+// world = parentWorld * local, for the slots of [begin, end) whose parents are
+// in a previous level. Same computation as FrameData::operator*(), on the
+// arrays.
+void FramePool::composeWithParents(int begin, int end) {
+  const int *const ps = parentSlot_.constData();
+  const Real *const tx = t_[0].constData();
+  const Real *const ty = t_[1].constData();
+  const Real *const tz = t_[2].constData();
+  const Real *const qx = q_[0].constData();
+  const Real *const qy = q_[1].constData();
+  const Real *const qz = q_[2].constData();
+  const Real *const qw = q_[3].constData();
+  Real *const wtx = worldT_[0].data();
+  Real *const wty = worldT_[1].data();
+  Real *const wtz = worldT_[2].data();
+  Real *const wqx = worldQ_[0].data();
+  Real *const wqy = worldQ_[1].data();
+  Real *const wqz = worldQ_[2].data();
+  Real *const wqw = worldQ_[3].data();
+
+  for (int s = begin; s < end; ++s) {
+    const int p = ps[s];
+    const Real ux = wqx[p], uy = wqy[p], uz = wqz[p], w = wqw[p];
+
+    // Translation: parent rotation applied to the local translation, as in
+    // Quaternion::rotate()
+    const Real vx = tx[s], vy = ty[s], vz = tz[s];
+    const Real cx = 2.0 * (uy * vz - uz * vy);
+    const Real cy = 2.0 * (uz * vx - ux * vz);
+    const Real cz = 2.0 * (ux * vy - uy * vx);
+    wtx[s] = wtx[p] + vx + w * cx + uy * cz - uz * cy;
+    wty[s] = wty[p] + vy + w * cy + uz * cx - ux * cz;
+    wtz[s] = wtz[p] + vz + w * cz + ux * cy - uy * cx;
+
+    // Rotation: parent rotation * local rotation
+    const Real bx = qx[s], by = qy[s], bz = qz[s], bw = qw[s];
+    wqx[s] = w * bx + bw * ux + uy * bz - uz * by;
+    wqy[s] = w * by + bw * uy + uz * bx - ux * bz;
+    wqz[s] = w * bz + bw * uz + ux * by - uy * bx;
+    wqw[s] = w * bw - ux * bx - uy * by - uz * bz;
+  }
+}
+
+// Same matrix as FrameData::getMatrix()
+void FramePool::computeMatrices(int begin, int end) {
+  const QVector<Real> *const t = worldT_, *const q = worldQ_;
+  for (int s = begin; s < end; ++s) {
+    const Real x = q[0].at(s), y = q[1].at(s), z = q[2].at(s), w = q[3].at(s);
+    const Real q00 = 2.0 * x * x, q11 = 2.0 * y * y, q22 = 2.0 * z * z;
+    const Real q01 = 2.0 * x * y, q02 = 2.0 * x * z, q03 = 2.0 * x * w;
+    const Real q12 = 2.0 * y * z, q13 = 2.0 * y * w, q23 = 2.0 * z * w;
+
+    GLdouble *const m = worldMatrices_.data() + 16 * s;
+    m[0] = 1.0 - q11 - q22;
+    m[1] = q01 + q23;
+    m[2] = q02 - q13;
+    m[3] = 0.0;
+
+    m[4] = q01 - q23;
+    m[5] = 1.0 - q22 - q00;
+    m[6] = q12 + q03;
+    m[7] = 0.0;
+
+    m[8] = q02 + q13;
+    m[9] = q12 - q03;
+    m[10] = 1.0 - q11 - q00;
+    m[11] = 0.0;
+
+    m[12] = t[0].at(s);
+    m[13] = t[1].at(s);
+    m[14] = t[2].at(s);
+    m[15] = 1.0;
+  }
+}
+
+/*! Computes the world transformations of all the frames, from their local
+transformations.
+
+The frames are first sorted by depth if the hierarchy was modified. The levels
+are then evaluated in order, each one from the results of the previous one,
+and all the worldMatrix() are finally computed. Levels and matrices are split
+between threads when parallelEvaluation() is \c true and they are large
+enough. */
+void FramePool::updateWorldTransforms() {
+  if (!isSorted_)
+    sortByDepth();
+
+  const int nbLevels = levelBegin_.size() - 1;
+  if (nbLevels <= 0)
+    return;
+
+  run(levelBegin_[0], levelBegin_[1], &FramePool::copyRoots);
+  for (int d = 1; d < nbLevels; ++d)
+    run(levelBegin_[d], levelBegin_[d + 1], &FramePool::composeWithParents);
+
+  run(0, nbFrames(), &FramePool::computeMatrices);
+}
@@ -0,0 +1,126 @@
+#ifndef QGLVIEWER_FRAME_POOL_H
+#define QGLVIEWER_FRAME_POOL_H
+
+#include <QVector>
+
+#include "frameData.h"
+
+
+namespace qglviewer {
+/*! \brief A hierarchy of many rigid transformations, evaluated in one pass.
+  \class FramePool framePool.h QGLViewer/framePool.h
+
+  A Frame hierarchy computes the world transformation of a Frame by walking up
+  its Frame::referenceFrame() chain, each time it is needed. With thousands of
+  Frames, for instance the bones of many skeletons, the same parents are
+  composed over and over, and the Frames are scattered in memory.
+
+  A FramePool stores the local transformation (a FrameData) and the parent of
+  each of its frames, identified by the index returned by addFrame(). It
+  computes all the world transformations at once, in updateWorldTransforms():
+  \code
+  FramePool pool;
+  int root = pool.addFrame(FrameData(Vec(0.0, 0.0, 1.0), Quaternion()));
+  int child = pool.addFrame(FrameData(Vec(1.0, 0.0, 0.0), Quaternion()), root);
+
+  // At each animation step
+  pool.setLocalTransform(child, newChildTransform);
+  pool.updateWorldTransforms();
+
+  // In draw()
+  glPushMatrix();
+  glMultMatrixd(pool.worldMatrix(child));
+  drawChild();
+  glPopMatrix();
+  \endcode
+
+  The translations, rotations and parents are stored in separate arrays, and
+  the frames are sorted by depth in the hierarchy: the frames of a level are
+  contiguous and only depend on the previous level. Each level is hence
+  composed with a simple loop that the compiler can vectorize, and the large
+  levels are split between threads when parallelEvaluation() is \c true.
+
+  The frames are sorted again when the hierarchy is modified (addFrame(),
+  setParent()), at the next updateWorldTransforms(). Modifying the local
+  transformations does not change the order. */
+class QGLVIEWER_EXPORT FramePool {
+public:
+  FramePool();
+  ~FramePool();
+
+private:
+  Q_DISABLE_COPY(FramePool)
+
+  /*! @name Hierarchy */
+  //@{
+public:
+  int addFrame(const FrameData &local = FrameData(), int parent = -1);
+  void clear();
+
+  /*! Returns the number of frames of the pool. Frame indices range from 0 to
+  nbFrames()-1. */
+  int nbFrames() const { return parent_.size(); }
+  /*! Returns the index of the parent of frame \p id, or -1 when it is defined
+  in the world coordinate system. */
+  int parent(int id) const { return parent_[id]; }
+  void setParent(int id, int parent);
+  //@}
+
+  /*! @name Local transformations */
+  //@{
+public:
+  FrameData localTransform(int id) const;
+  void setLocalTransform(int id, const FrameData &local);
+  void setLocalTransforms(const int ids[], const GLdouble *matrices, int nb);
+  //@}
+
+  /*! @name World transformations */
+  //@{
+public:
+  void updateWorldTransforms();
+
+  FrameData worldTransform(int id) const;
+  /*! Returns the OpenGL matrix of the world transformation of frame \p id,
+  in the same format as Frame::worldMatrix().
+
+  The matrix is the one computed by the last updateWorldTransforms(). The
+  pointer is invalidated by addFrame(), setParent() and clear(). */
+  const GLdouble *worldMatrix(int id) const {
+    return worldMatrices_.constData() + 16 * slot_[id];
+  }
+
+  /*! Returns \c true when the large levels of the hierarchy are evaluated in
+  parallel, over the TaskScheduler threads. Default value is \c false. */
+  bool parallelEvaluation() const { return parallelEvaluation_; }
+  void setParallelEvaluation(bool parallel = true);
+  //@}
+
+private:
+  void sortByDepth();
+  void run(int begin, int end, void (FramePool::*evaluate)(int, int));
+  void copyRoots(int begin, int end);
+  void composeWithParents(int begin, int end);
+  void computeMatrices(int begin, int end);
+
+  // Indexed by frame id
+  QVector<int> parent_;
+  QVector<int> slot_;
+
+  // Indexed by slot. Once sorted, the frames of depth d occupy the slots
+  // [levelBegin_[d], levelBegin_[d+1]).
+  QVector<int> id_;
+  QVector<int> parentSlot_;
+  QVector<int> levelBegin_;
+  bool isSorted_;
+
+  // Local and world transformations, one array per coordinate
+  QVector<Real> t_[3], q_[4];
+  QVector<Real> worldT_[3], worldQ_[4];
+  QVector<GLdouble> worldMatrices_;
+
+  bool parallelEvaluation_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_POOL_H
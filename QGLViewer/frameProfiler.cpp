@@ -0,0 +1,425 @@
+#include "frameProfiler.h"
+#include "traceRecorder.h"
+
+#include <QOpenGLContext>
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLTimerQuery>
+#endif
+
+using namespace qglviewer;
+
+/*! Creates a disabled FrameProfiler. No OpenGL call is made before
+beginFrame(). */
+FrameProfiler::FrameProfiler(QObject *parent)
+    : QObject(parent), enabled_(false), historySize_(120), frameStart_(-1),
+      stageStart_(0), stage_(-1), inFrame_(false), swapStart_(0),
+      tracedStage_(-1), tracedStageStart_(0), selectionTime_(0.0),
+      frameCount_(0), nextTiming_(0), context_(nullptr),
+      timerQueriesAreSupported_(false), frameQuery_(nullptr) {
+  qRegisterMetaType<FrameTiming>("qglviewer::FrameTiming");
+  timer_.start();
+  for (int i = 0; i < HotPathCounters::NB_COUNTERS; ++i) {
+    previousCounts_[i] = HotPathCounters::value(HotPathCounters::Counter(i));
+    lastCounts_[i] = 0;
+    thresholds_[i] = 0;
+  }
+}
+
+/*! Destructor. The timer queries are children of the FrameProfiler: call
+cleanupGL() before, with the OpenGL context current. */
+FrameProfiler::~FrameProfiler() {}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Frame records                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the records of the recent frames, the oldest first. Only complete
+records are returned (see frameTimingAvailable()). */
+QVector<FrameTiming> FrameProfiler::frameTimings() const {
+  QVector<FrameTiming> timings;
+  timings.reserve(timings_.size());
+  for (int i = 0; i < timings_.size(); ++i)
+    timings.append(timings_[(nextTiming_ + i) % timings_.size()]);
+  return timings;
+}
+
+/*! Sets the isEnabled() value. Records under measure are discarded when the
+profiler is disabled. */
+void FrameProfiler::setEnabled(bool enabled) {
+  if (enabled == enabled_)
+    return;
+  enabled_ = enabled;
+  if (!enabled) {
+    for (int i = 0; i < pending_.size(); ++i)
+      if (pending_[i].begin)
+        freeQueries_ << pending_[i].begin << pending_[i].end;
+    pending_.clear();
+    if (frameQuery_)
+      freeQueries_.append(frameQuery_);
+    frameQuery_ = nullptr;
+    stage_ = -1;
+    frameStart_ = -1;
+    selectionTime_ = 0.0;
+  } else {
+    // The events that happened while disabled are not counted
+    for (int i = 0; i < HotPathCounters::NB_COUNTERS; ++i)
+      previousCounts_[i] = HotPathCounters::value(HotPathCounters::Counter(i));
+  }
+}
+
+/*! Sets the historySize(). The oldest records are discarded if needed.
+Values smaller than 1 are replaced by 1. */
+void FrameProfiler::setHistorySize(int size) {
+  const QVector<FrameTiming> timings = frameTimings();
+  historySize_ = qMax(size, 1);
+  timings_ = timings.mid(qMax(0, timings.size() - historySize_));
+  nextTiming_ = 0;
+}
+
+/*! Discards all the frameTimings(). */
+void FrameProfiler::clear() {
+  timings_.clear();
+  nextTiming_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Measures                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Starts the measure of a new frame, in the FrameTiming::DRAW stage. Called at
+the beginning of QGLViewer::paintGL(), with the OpenGL context current.
+
+The GPU times of the previous frames that are available are retrieved, without
+waiting for the others. */
+void FrameProfiler::beginFrame() {
+  traceStage(FrameTiming::DRAW);
+  if (enabled_ && (stage_ >= 0))
+    endFrame();
+  inFrame_ = true;
+  if (!enabled_)
+    return;
+
+  // A frame may have been painted without being swapped
+  for (int i = 0; i < pending_.size(); ++i)
+    pending_[i].isSwapped = true;
+
+  retrieveGpuTimes();
+  publishCompleteTimings();
+
+  const qint64 now = timer_.nsecsElapsed();
+  for (int i = 0; i < FrameTiming::NB_STAGES; ++i)
+    current_.cpuTime[i] = 0.0;
+  current_.cpuTime[FrameTiming::SELECTION] = selectionTime_;
+  selectionTime_ = 0.0;
+  current_.frame = ++frameCount_;
+  current_.gpuTime = -1.0;
+  current_.frameInterval = (frameStart_ < 0) ? 0.0 : (now - frameStart_) / 1.0e6;
+  frameStart_ = now;
+  stageStart_ = now;
+  stage_ = FrameTiming::DRAW;
+
+  frameQuery_ = timerQuery();
+#ifndef QT_OPENGL_ES_2
+  if (frameQuery_)
+    frameQuery_->recordTimestamp();
+#endif
+}
+
+// Adds the time elapsed since stageStart_ to the current stage.
+void FrameProfiler::closeStage() {
+  const qint64 now = timer_.nsecsElapsed();
+  current_.cpuTime[stage_] += (now - stageStart_) / 1.0e6;
+  stageStart_ = now;
+}
+
+// Records the traced stage in the TraceRecorder, and starts stage (-1 at the
+// end of the frame). Independent of isEnabled().
+void FrameProfiler::traceStage(int stage) {
+  static const char *const stageNames[FrameTiming::NB_STAGES] = {
+      "preDraw", "draw", "postDraw", "selection", "swap"};
+  if (!TraceRecorder::isEnabled()) {
+    tracedStage_ = -1;
+    return;
+  }
+  const qint64 now = TraceRecorder::now();
+  if (tracedStage_ >= 0)
+    TraceRecorder::addCompleteEvent("frame", stageNames[tracedStage_],
+                                    tracedStageStart_, now);
+  tracedStage_ = stage;
+  tracedStageStart_ = now;
+}
+
+/*! Ends the current stage of the frame, and starts \p stage. Does nothing
+outside of a beginFrame() / endFrame() block. */
+void FrameProfiler::beginStage(FrameTiming::Stage stage) {
+  traceStage(stage);
+  if (stage_ < 0)
+    return;
+  closeStage();
+  stage_ = stage;
+}
+
+/*! Ends the measure of the frame. Called at the end of QGLViewer::paintGL(),
+with the OpenGL context current. The FrameTiming::SWAP stage lasts until
+frameSwapped() is called.
+
+An endFrame() without a matching beginFrame() is ignored, with a warning. */
+void FrameProfiler::endFrame() {
+  traceStage(-1);
+  if (!inFrame_) {
+    qWarning("FrameProfiler::endFrame: no matching beginFrame()");
+    return;
+  }
+  inFrame_ = false;
+  if (stage_ < 0)
+    return;
+  closeStage();
+  stage_ = -1;
+
+  for (int i = 0; i < HotPathCounters::NB_COUNTERS; ++i) {
+    const quint32 value = HotPathCounters::value(HotPathCounters::Counter(i));
+    current_.counts[i] = value - previousCounts_[i];
+    previousCounts_[i] = value;
+    lastCounts_[i] = current_.counts[i];
+  }
+
+  PendingTiming pending;
+  pending.timing = current_;
+  pending.begin = frameQuery_;
+  pending.end = frameQuery_ ? timerQuery() : nullptr;
+#ifndef QT_OPENGL_ES_2
+  if (pending.end)
+    pending.end->recordTimestamp();
+#endif
+  if (pending.begin && !pending.end) {
+    freeQueries_.append(pending.begin);
+    pending.begin = nullptr;
+  }
+  pending.isSwapped = false;
+  pending_.append(pending);
+  frameQuery_ = nullptr;
+  swapStart_ = timer_.nsecsElapsed();
+
+  for (int i = 0; i < HotPathCounters::NB_COUNTERS; ++i)
+    if ((thresholds_[i] > 0) && (lastCounts_[i] > thresholds_[i]))
+      Q_EMIT counterThresholdExceeded(i, lastCounts_[i]);
+}
+
+/*! Sets the counterThreshold() of \p counter. */
+void FrameProfiler::setCounterThreshold(HotPathCounters::Counter counter,
+                                        quint32 threshold) {
+  thresholds_[counter] = threshold;
+}
+
+/*! Adds \p time milliseconds to \p stage. Used by QGLViewer::select() for the
+FrameTiming::SELECTION stage: outside of a frame, the time is added to the
+next one. */
+void FrameProfiler::addStageTime(FrameTiming::Stage stage, qreal time) {
+  if (!enabled_)
+    return;
+  if (stage_ >= 0)
+    current_.cpuTime[stage] += time;
+  else if (stage == FrameTiming::SELECTION)
+    selectionTime_ += time;
+}
+
+/*! Ends the FrameTiming::SWAP stage of the last frame. Connected to the \c
+frameSwapped() signal of the QGLViewer. */
+void FrameProfiler::frameSwapped() {
+  if (!enabled_ || pending_.isEmpty() || pending_.last().isSwapped)
+    return;
+  pending_.last().timing.cpuTime[FrameTiming::SWAP] =
+      (timer_.nsecsElapsed() - swapStart_) / 1.0e6;
+  pending_.last().isSwapped = true;
+  publishCompleteTimings();
+}
+
+/*! Completes and publishes all the pending records, waiting for their GPU
+times. Used by QGLViewer::runBenchmark(), whose frames are not swapped. The
+OpenGL context used by beginFrame() must be current. */
+void FrameProfiler::flush() {
+  if (!enabled_)
+    return;
+  if (stage_ >= 0)
+    endFrame();
+  for (int i = 0; i < pending_.size(); ++i)
+    pending_[i].isSwapped = true;
+  retrieveGpuTimes(true);
+  publishCompleteTimings();
+}
+
+// Retrieves the GPU time of the pending records whose queries are available
+// (or of all of them when wait is true), in order. Requires the context to be
+// current.
+void FrameProfiler::retrieveGpuTimes(bool wait) {
+#ifndef QT_OPENGL_ES_2
+  if (QOpenGLContext::currentContext() != context_)
+    return;
+  for (int i = 0; i < pending_.size(); ++i) {
+    PendingTiming &pending = pending_[i];
+    if (!pending.begin)
+      continue;
+    if (!wait && !pending.end->isResultAvailable())
+      break;
+    const GLuint64 begin = pending.begin->waitForResult();
+    const GLuint64 end = pending.end->waitForResult();
+    pending.timing.gpuTime = (end - begin) / 1.0e6;
+    freeQueries_ << pending.begin << pending.end;
+    pending.begin = nullptr;
+    pending.end = nullptr;
+  }
+#endif
+}
+
+// Emits and stores the records that were swapped and whose GPU time is known.
+void FrameProfiler::publishCompleteTimings() {
+  while (!pending_.isEmpty() && pending_.first().isSwapped &&
+         !pending_.first().begin) {
+    const FrameTiming timing = pending_.takeFirst().timing;
+    if (timings_.size() < historySize_)
+      timings_.append(timing);
+    else {
+      timings_[nextTiming_] = timing;
+      nextTiming_ = (nextTiming_ + 1) % timings_.size();
+    }
+    Q_EMIT frameTimingAvailable(timing);
+  }
+}
+
+// Returns a timer query of the current context, or nullptr when timer queries
+// are not supported.
+QOpenGLTimerQuery *FrameProfiler::timerQuery() {
+#ifndef QT_OPENGL_ES_2
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (context != context_) {
+    // Queries of a previous context are forgotten
+    freeQueries_.clear();
+    for (int i = 0; i < pending_.size(); ++i)
+      pending_[i].begin = pending_[i].end = nullptr;
+    context_ = context;
+    timerQueriesAreSupported_ =
+        context && !context->isOpenGLES() &&
+        ((context->format().version() >= qMakePair(3, 3)) ||
+         context->hasExtension("GL_ARB_timer_query"));
+  }
+  if (!timerQueriesAreSupported_)
+    return nullptr;
+
+  if (!freeQueries_.isEmpty())
+    return freeQueries_.takeLast();
+
+  QOpenGLTimerQuery *query = new QOpenGLTimerQuery(this);
+  if (!query->create()) {
+    delete query;
+    timerQueriesAreSupported_ = false;
+    return nullptr;
+  }
+  return query;
+#else
+  return nullptr;
+#endif
+}
+
+/*! Releases the timer queries. The OpenGL context used by beginFrame() must be
+current. The pending records no longer wait for their GPU time. */
+void FrameProfiler::cleanupGL() {
+  QList<QOpenGLTimerQuery *> queries = freeQueries_;
+  for (int i = 0; i < pending_.size(); ++i)
+    if (pending_[i].begin) {
+      queries << pending_[i].begin << pending_[i].end;
+      pending_[i].begin = pending_[i].end = nullptr;
+    }
+  if (frameQuery_)
+    queries.append(frameQuery_);
+  frameQuery_ = nullptr;
+  qDeleteAll(queries);
+  freeQueries_.clear();
+  context_ = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Display                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Draws a graph of the frameTimings() in the lower left corner of a viewer of
+\p width x \p height pixels, using the fixed pipeline. Called by
+QGLViewer::postDraw() when QGLViewer::frameTimingGraphIsDisplayed().
+
+The total CPU time of each frame is drawn in yellow, its GPU time in green and
+its frame interval in gray. The horizontal lines are 60 Hz and 30 Hz frame
+times. The OpenGL state and matrices are preserved. */
+void FrameProfiler::drawGraph(int width, int height) const {
+  const QVector<FrameTiming> timings = frameTimings();
+  const qreal graphWidth = qMin(240, width - 20);
+  const qreal graphHeight = 60.0;
+  const qreal left = 10.0;
+  const qreal bottom = height - 10.0;
+
+  // From 0 to 1000/30 ms or more
+  qreal maxTime = 1000.0 / 30.0;
+  for (int i = 0; i < timings.size(); ++i)
+    maxTime = qMax(maxTime, qMax(timings[i].totalCpuTime(), timings[i].gpuTime));
+
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT |
+               GL_LINE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_TEXTURE_2D);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glLineWidth(1.0);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, width, height, 0, -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor4f(0.0f, 0.0f, 0.0f, 0.5f);
+  glBegin(GL_QUADS);
+  glVertex2d(left, bottom);
+  glVertex2d(left + graphWidth, bottom);
+  glVertex2d(left + graphWidth, bottom - graphHeight);
+  glVertex2d(left, bottom - graphHeight);
+  glEnd();
+
+  glColor4f(1.0f, 1.0f, 1.0f, 0.3f);
+  glBegin(GL_LINES);
+  for (int hz = 30; hz <= 60; hz += 30) {
+    const qreal y = bottom - graphHeight * (1000.0 / hz) / maxTime;
+    glVertex2d(left, y);
+    glVertex2d(left + graphWidth, y);
+  }
+  glEnd();
+
+  const qreal step = graphWidth / qMax(historySize_ - 1, 1);
+  for (int curve = 0; curve < 3; ++curve) {
+    if (curve == 0)
+      glColor4f(0.6f, 0.6f, 0.6f, 1.0f);
+    else if (curve == 1)
+      glColor4f(1.0f, 0.9f, 0.2f, 1.0f);
+    else
+      glColor4f(0.3f, 1.0f, 0.3f, 1.0f);
+
+    glBegin(GL_LINE_STRIP);
+    for (int i = 0; i < timings.size(); ++i) {
+      const FrameTiming &t = timings[i];
+      const qreal time = (curve == 0)   ? t.frameInterval
+                         : (curve == 1) ? t.totalCpuTime()
+                                        : t.gpuTime;
+      if (time < 0.0)
+        continue;
+      glVertex2d(left + step * (historySize_ - timings.size() + i),
+                 bottom - graphHeight * qMin(time / maxTime, 1.0));
+    }
+    glEnd();
+  }
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glPopAttrib();
+}
@@ -0,0 +1,197 @@
+#ifndef QGLVIEWER_FRAME_PROFILER_H
+#define QGLVIEWER_FRAME_PROFILER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+#include "config.h"
+#include "hotPathCounters.h"
+
+class QOpenGLContext;
+class QOpenGLTimerQuery;
+
+namespace qglviewer {
+/*! \brief The timing record of a frame drawn by a QGLViewer.
+  \class FrameTiming frameProfiler.h QGLViewer/frameProfiler.h
+
+  All times are expressed in milliseconds. See FrameProfiler. */
+struct QGLVIEWER_EXPORT FrameTiming {
+  /*! The CPU stages of a frame. \c SELECTION accumulates the
+  QGLViewer::select() calls since the previous frame. \c SWAP is the time
+  between the end of QGLViewer::paintGL() and the \c frameSwapped() signal of
+  the widget. */
+  enum Stage { PRE_DRAW, DRAW, POST_DRAW, SELECTION, SWAP, NB_STAGES };
+
+  /*! Index of the frame, incremented by each FrameProfiler::beginFrame(). */
+  quint64 frame;
+  /*! CPU time spent in each Stage. */
+  qreal cpuTime[NB_STAGES];
+  /*! GPU time between the beginning and the end of QGLViewer::paintGL(),
+  measured with \c GL_TIMESTAMP queries. -1.0 when not available. */
+  qreal gpuTime;
+  /*! Time elapsed since the beginning of the previous frame. */
+  qreal frameInterval;
+  /*! Number of events of each HotPathCounters::Counter since the end of the
+  previous frame. The events between two frames (mouse moves, selections)
+  hence belong to the next frame. */
+  quint32 counts[HotPathCounters::NB_COUNTERS];
+
+  /*! Returns the sum of the cpuTime of all the stages. */
+  qreal totalCpuTime() const {
+    qreal total = 0.0;
+    for (int i = 0; i < NB_STAGES; ++i)
+      total += cpuTime[i];
+    return total;
+  }
+};
+
+/*! \brief Measures the CPU and GPU time of the QGLViewer frames.
+  \class FrameProfiler frameProfiler.h QGLViewer/frameProfiler.h
+
+  Each QGLViewer has a FrameProfiler (see QGLViewer::frameProfiler()), which is
+  disabled by default. Once enabled with setEnabled(), the viewer measures the
+  CPU time of each FrameTiming::Stage of its frames. The GPU time of the frame
+  is measured with \c GL_TIMESTAMP queries (OpenGL 3.3 or \c
+  GL_ARB_timer_query), which are read back a few frames later, without
+  stalling the pipeline.
+
+  Complete records are stored in frameTimings(), which keeps the
+  historySize() most recent frames, and are sent by the frameTimingAvailable()
+  signal:
+  \code
+  viewer->frameProfiler()->setEnabled(true);
+  connect(viewer->frameProfiler(),
+          SIGNAL(frameTimingAvailable(const qglviewer::FrameTiming&)),
+          telemetry, SLOT(record(const qglviewer::FrameTiming&)));
+  \endcode
+
+  QGLViewer::setFrameTimingGraphIsDisplayed() displays a graph of the recent
+  frames (see drawGraph()). */
+class QGLVIEWER_EXPORT FrameProfiler : public QObject {
+  Q_OBJECT
+
+public:
+  FrameProfiler(QObject *parent = nullptr);
+  virtual ~FrameProfiler();
+
+  /*! @name Frame records */
+  //@{
+public:
+  /*! Returns \c true when the frames are measured. Default value is \c
+  false. */
+  bool isEnabled() const { return enabled_; }
+  QVector<FrameTiming> frameTimings() const;
+  /*! Returns the maximum number of records kept in frameTimings(). Default
+  value is 120. */
+  int historySize() const { return historySize_; }
+
+public Q_SLOTS:
+  void setEnabled(bool enabled = true);
+  void setHistorySize(int size);
+  void clear();
+
+Q_SIGNALS:
+  /*! Signal emitted when the record of a frame is complete, i.e. after its
+  swap and once its GPU time is available. */
+  void frameTimingAvailable(const qglviewer::FrameTiming &timing);
+  //@}
+
+  /*! @name Measures */
+  //@{
+public:
+  void beginFrame();
+  void beginStage(FrameTiming::Stage stage);
+  void endFrame();
+  void addStageTime(FrameTiming::Stage stage, qreal time);
+  void flush();
+  void cleanupGL();
+
+public Q_SLOTS:
+  void frameSwapped();
+  //@}
+
+  /*! @name Hot path counters */
+  //@{
+public:
+  /*! Returns the number of \p counter events of the last frame ended by
+  endFrame(). Available before the frameTimingAvailable() signal of this
+  frame. */
+  quint32 lastFrameCount(HotPathCounters::Counter counter) const {
+    return lastCounts_[counter];
+  }
+  /*! Returns the number of \p counter events per frame above which
+  counterThresholdExceeded() is emitted. Default value is 0, which disables
+  the warning. */
+  quint32 counterThreshold(HotPathCounters::Counter counter) const {
+    return thresholds_[counter];
+  }
+  void setCounterThreshold(HotPathCounters::Counter counter,
+                           quint32 threshold);
+
+Q_SIGNALS:
+  /*! Signal emitted by endFrame() when the \p count of events of a
+  HotPathCounters::Counter \p counter in the frame is above its
+  counterThreshold(). */
+  void counterThresholdExceeded(int counter, quint32 count);
+  //@}
+
+  /*! @name Display */
+  //@{
+public:
+  virtual void drawGraph(int width, int height) const;
+  //@}
+
+private:
+  struct PendingTiming {
+    FrameTiming timing;
+    QOpenGLTimerQuery *begin, *end; // nullptr without timer queries
+    bool isSwapped;
+  };
+
+  void closeStage();
+  void traceStage(int stage);
+  void retrieveGpuTimes(bool wait = false);
+  void publishCompleteTimings();
+  QOpenGLTimerQuery *timerQuery();
+
+  bool enabled_;
+  int historySize_;
+
+  // Current frame
+  QElapsedTimer timer_;
+  qint64 frameStart_; // ns, -1 before the first frame
+  qint64 stageStart_;
+  int stage_; // -1 outside of a frame
+  bool inFrame_; // between beginFrame() and endFrame(), even when disabled
+  qint64 swapStart_;
+  FrameTiming current_;
+  int tracedStage_; // TraceRecorder event being measured, -1 when none
+  qint64 tracedStageStart_;
+  qreal selectionTime_; // since the previous frame
+  quint64 frameCount_;
+
+  // H o t   p a t h   c o u n t e r s
+  quint32 previousCounts_[HotPathCounters::NB_COUNTERS];
+  quint32 lastCounts_[HotPathCounters::NB_COUNTERS];
+  quint32 thresholds_[HotPathCounters::NB_COUNTERS];
+
+  // Records waiting for their swap or GPU time
+  QList<PendingTiming> pending_;
+  QVector<FrameTiming> timings_; // ring
+  int nextTiming_;
+
+  // G P U   t i m e r s
+  QOpenGLContext *context_;
+  bool timerQueriesAreSupported_;
+  QList<QOpenGLTimerQuery *> freeQueries_;
+  QOpenGLTimerQuery *frameQuery_; // begin query of the current frame
+};
+
+} // namespace qglviewer
+
+Q_DECLARE_METATYPE(qglviewer::FrameTiming)
+
+#endif // QGLVIEWER_FRAME_PROFILER_H
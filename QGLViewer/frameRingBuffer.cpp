@@ -0,0 +1,215 @@
+#include "frameRingBuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+using namespace qglviewer;
+
+// Frames are aligned for any vertex attribute type
+static const int frameAlignment = 256;
+
+/*! Creates an uninitialized FrameRingBuffer. Call initialize() once the OpenGL
+context is current. */
+FrameRingBuffer::FrameRingBuffer()
+    : context_(nullptr), functions_(nullptr), bufferStorage_(nullptr),
+      buffer_(0), mapped_(nullptr), frameSize_(1 << 20), nextFrameSize_(0),
+      currentFrame_(0), allocated_(0), requested_(0), inFrame_(false) {
+  for (int i = 0; i < nbFrames; ++i)
+    fences_[i] = nullptr;
+}
+
+/*! Destructor. The buffer is only released when the context used by
+initialize() is current. Call cleanupGL() before otherwise. */
+FrameRingBuffer::~FrameRingBuffer() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Creation                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Checks that the current context supports persistent mappings. The buffer
+itself is created by the first beginFrame(). Returns \c false (and
+isInitialized() remains \c false) when no context is current or when OpenGL
+4.4 or \c GL_ARB_buffer_storage is missing. */
+bool FrameRingBuffer::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("FrameRingBuffer::initialize: No current OpenGL context");
+    return false;
+  }
+  if (context->isOpenGLES() ||
+      ((context->format().version() < qMakePair(4, 4)) &&
+       !context->hasExtension("GL_ARB_buffer_storage")))
+    return false;
+
+  bufferStorage_ = reinterpret_cast<BufferStorage>(
+      context->getProcAddress("glBufferStorage"));
+  if (!bufferStorage_)
+    return false;
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  return true;
+}
+
+/*! Releases the buffer. The context used by initialize() must be current.
+isInitialized() is then \c false until the next initialize(). */
+void FrameRingBuffer::cleanupGL() {
+  releaseStorage();
+  functions_ = nullptr;
+  bufferStorage_ = nullptr;
+  context_ = nullptr;
+  inFrame_ = false;
+  allocated_ = 0;
+  requested_ = 0;
+}
+
+/*! Sets frameSize(). The buffer is created again, with the new size, by the
+next beginFrame(): the current allocations remain valid until endFrame(). */
+void FrameRingBuffer::setFrameSize(int size) {
+  size = (qMax(size, 1) + frameAlignment - 1) & ~(frameAlignment - 1);
+  if (buffer_)
+    nextFrameSize_ = (size != frameSize_) ? size : 0;
+  else
+    frameSize_ = size;
+}
+
+// Creates the buffer and maps its nbFrames frames
+bool FrameRingBuffer::createStorage() {
+  const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const GLsizeiptr size = GLsizeiptr(nbFrames) * frameSize_;
+
+  functions_->glGenBuffers(1, &buffer_);
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+  bufferStorage_(GL_ARRAY_BUFFER, size, nullptr, flags);
+  mapped_ = static_cast<char *>(
+      functions_->glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (!mapped_) {
+    qWarning("FrameRingBuffer::beginFrame: unable to map the buffer");
+    functions_->glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+    return false;
+  }
+  return true;
+}
+
+// Deletes the buffer, once the GPU no longer reads any of its frames
+void FrameRingBuffer::releaseStorage() {
+  if (!functions_)
+    return;
+
+  for (int i = 0; i < nbFrames; ++i)
+    waitForFrame(i);
+  // Deleting the buffer also unmaps it
+  if (buffer_)
+    functions_->glDeleteBuffers(1, &buffer_);
+  buffer_ = 0;
+  mapped_ = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Frames                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Starts a new frame: the allocations of the previous ones are no longer
+valid. The first call creates the buffer, and a frame that overflowed the
+previous frameSize() makes it grow. Waits until the GPU finished reading the
+frame that is reused, which was drawn two frames ago. */
+void FrameRingBuffer::beginFrame() {
+  if (!functions_ || inFrame_)
+    return;
+
+  if (nextFrameSize_ > 0) {
+    releaseStorage();
+    frameSize_ = nextFrameSize_;
+    nextFrameSize_ = 0;
+  }
+  // Not retried at each frame
+  if (!buffer_ && !createStorage()) {
+    cleanupGL();
+    return;
+  }
+
+  currentFrame_ = (currentFrame_ + 1) % nbFrames;
+  waitForFrame(currentFrame_);
+  allocated_ = 0;
+  requested_ = 0;
+  inFrame_ = true;
+}
+
+/*! Ends the current frame. The draw calls that read its allocations must have
+been issued: a fence is inserted after them. */
+void FrameRingBuffer::endFrame() {
+  if (!inFrame_)
+    return;
+
+  // Commands complete in order: the fence covers all the draws of the frame
+  if (allocated_ > 0)
+    fences_[currentFrame_] =
+        functions_->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  inFrame_ = false;
+}
+
+/*! Returns \p size bytes of the current frame, whose offset is a multiple of
+\p alignment (a power of two). The memory is write only, and must be written
+before the draw calls that read it are issued.
+
+The returned Allocation is invalid outside of beginFrame() and endFrame(), or
+when the frame is full. In that case, the next frames are large enough to
+hold all the allocations of this one. */
+FrameRingBuffer::Allocation FrameRingBuffer::allocate(int size,
+                                                      int alignment) {
+  Allocation allocation;
+  if (!inFrame_ || (size <= 0))
+    return allocation;
+
+  // Where the allocation would end if none of the frame had failed
+  requested_ = ((requested_ + alignment - 1) & ~(alignment - 1)) + size;
+
+  const int offset = (allocated_ + alignment - 1) & ~(alignment - 1);
+  if (offset + size > frameSize_) {
+    int grown = qMax(frameSize_, nextFrameSize_);
+    while (grown < requested_)
+      grown *= 2;
+    nextFrameSize_ = grown;
+    return allocation;
+  }
+
+  allocated_ = offset + size;
+  allocation.buffer = buffer_;
+  allocation.offset = currentFrame_ * frameSize_ + offset;
+  allocation.data = mapped_ + allocation.offset;
+  allocation.size = size;
+  return allocation;
+}
+
+// Blocks until the draws that read frame are completed
+void FrameRingBuffer::waitForFrame(int frame) {
+  if (!fences_[frame])
+    return;
+
+  GLenum status = GL_TIMEOUT_EXPIRED;
+  while (status == GL_TIMEOUT_EXPIRED)
+    status = functions_->glClientWaitSync(
+        fences_[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 second
+  if (status == GL_WAIT_FAILED)
+    qWarning("FrameRingBuffer::beginFrame: wait for OpenGL failed");
+
+  functions_->glDeleteSync(fences_[frame]);
+  fences_[frame] = nullptr;
+}
@@ -0,0 +1,144 @@
+#ifndef QGLVIEWER_FRAME_RING_BUFFER_H
+#define QGLVIEWER_FRAME_RING_BUFFER_H
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+/*! \brief A persistently mapped vertex buffer from which the vertices that
+  change at each frame are allocated.
+  \class FrameRingBuffer frameRingBuffer.h QGLViewer/frameRingBuffer.h
+
+  Vertices that are regenerated at each frame (particles, text quads,
+  instance transformations...) are usually sent with a \c glBufferData() per
+  draw call, which makes the driver allocate or orphan a buffer each time, and
+  possibly wait for the GPU. A FrameRingBuffer is a single buffer, mapped once
+  in the application memory, and divided into three frames. allocate() returns
+  the next bytes of the current frame, where the vertices are written
+  directly, and the buffer and offset to give to the OpenGL array functions:
+  \code
+  void Viewer::draw() {
+    qglviewer::FrameRingBuffer *ring = frameRingBuffer();
+    qglviewer::FrameRingBuffer::Allocation vertices;
+    if (ring)
+      vertices = ring->allocate(nbParticles * 3 * sizeof(GLfloat));
+    if (vertices.isValid()) {
+      GLfloat *v = static_cast<GLfloat *>(vertices.data);
+      for (int i = 0; i < nbParticles; ++i)
+        particle_[i].getPosition(v + 3 * i);
+      glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+      glVertexPointer(3, GL_FLOAT, 0, vertices.pointer());
+      glDrawArrays(GL_POINTS, 0, nbParticles);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    } else
+      drawParticlesWithoutBuffer();
+  }
+  \endcode
+
+  QGLViewer::frameRingBuffer() returns the ring buffer of a viewer, shared by
+  its batched renderers (the instanced axes and cameras, the core profile
+  visual hints, the batched texts and the wide lines of the helpers, see
+  LineRenderer::setFrameRingBuffer()). The viewer calls beginFrame() and
+  endFrame() around each \c paintGL(): the allocations are only valid in
+  between, and are reused two frames later. A fence ensures that the GPU no
+  longer reads a frame when beginFrame() hands it out again, which usually
+  does not wait since three frames are in flight.
+
+  When a frame needs more than frameSize() bytes, allocate() returns an invalid
+  Allocation, and the next beginFrame() doubles the size of the frames until
+  they hold all the allocations requested by this frame. Callers
+  must then send their vertices the usual way, as shown above.
+
+  Requires OpenGL 4.4 or the \c GL_ARB_buffer_storage extension (initialize()
+  fails otherwise). All the methods must be called with the context of
+  initialize() current. */
+class QGLVIEWER_EXPORT FrameRingBuffer {
+public:
+  /*! A part of the current frame of the buffer, returned by allocate(). */
+  struct Allocation {
+    Allocation() : data(nullptr), buffer(0), offset(0), size(0) {}
+
+    /*! Returns \c false when allocate() failed. */
+    bool isValid() const { return data != nullptr; }
+    /*! Returns the offset as a pointer, as expected by \c glVertexPointer()
+    or \c glVertexAttribPointer() when buffer is bound. */
+    const void *pointer() const {
+      return reinterpret_cast<const void *>(static_cast<quintptr>(offset));
+    }
+
+    void *data;    //!< Where the vertices are written
+    GLuint buffer; //!< The \c GL_ARRAY_BUFFER to bind
+    int offset;    //!< Of data in buffer, in bytes
+    int size;      //!< In bytes
+  };
+
+  FrameRingBuffer();
+  ~FrameRingBuffer();
+
+  /*! @name Creation */
+  //@{
+public:
+  bool initialize();
+  void cleanupGL();
+
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return functions_ != nullptr; }
+
+  /*! Returns the number of bytes that can be allocated in each frame.
+  Default value is 1 MB. Doubled by the next beginFrame() when a frame needs
+  more. */
+  int frameSize() const { return frameSize_; }
+  void setFrameSize(int size);
+  /*! Returns the number of bytes of the buffer, which holds three frames. 0
+  before the first beginFrame(). See QGLViewer::memoryUsage(). */
+  qint64 memoryUsage() const {
+    return buffer_ ? qint64(nbFrames) * frameSize_ : 0;
+  }
+  //@}
+
+  /*! @name Frames */
+  //@{
+public:
+  void beginFrame();
+  void endFrame();
+  /*! Returns \c true between beginFrame() and endFrame(). */
+  bool isInFrame() const { return inFrame_; }
+
+  Allocation allocate(int size, int alignment = 16);
+  /*! Returns the number of bytes allocated since beginFrame(). */
+  int allocatedSize() const { return allocated_; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(FrameRingBuffer)
+
+  bool createStorage();
+  void releaseStorage();
+  void waitForFrame(int frame);
+
+  static const int nbFrames = 3;
+
+  typedef void(QOPENGLF_APIENTRYP BufferStorage)(GLenum target,
+                                                 GLsizeiptr size,
+                                                 const void *data,
+                                                 GLbitfield flags);
+
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  BufferStorage bufferStorage_;
+  GLuint buffer_;
+  char *mapped_;
+  GLsync fences_[nbFrames];
+  int frameSize_;
+  int nextFrameSize_; // applied by the next beginFrame(), 0 if unchanged
+  int currentFrame_;
+  int allocated_;
+  int requested_; // by the allocations of the frame, including failed ones
+  bool inFrame_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_RING_BUFFER_H
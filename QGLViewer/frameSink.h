@@ -0,0 +1,69 @@
+#ifndef QGLVIEWER_FRAME_SINK_H
+#define QGLVIEWER_FRAME_SINK_H
+
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+#include "config.h"
+
+namespace qglviewer {
+/*! \brief Receives the frames drawn by a QGLViewer, without intermediate copy.
+  \class FrameSink frameSink.h QGLViewer/frameSink.h
+
+  Attach a FrameSink to a viewer with QGLViewer::setFrameSink() to stream its
+  frames (to a video encoder or to a remote display for instance). At the end
+  of each QGLViewer::paintGL(), the frame buffer is read back in a pixel buffer
+  object, without waiting for the transfer. At the next frame, this buffer is
+  mapped and its pixels are directly given to processFrame(): a frame is hence
+  received one frame after it was drawn, and no \c QImage is created.
+
+  Implement processFrame() to consume the frames:
+  \code
+  class Streamer : public qglviewer::FrameSink {
+  public:
+    virtual void processFrame(const uchar *pixels, const QSize &size,
+                              int bytesPerLine,
+                              const QVector<QRect> &dirtyRectangles) {
+      for (int i = 0; i < dirtyRectangles.size(); ++i)
+        encoder.updateTile(pixels, bytesPerLine, dirtyRectangles[i]);
+    }
+  };
+  \endcode
+
+  The frame is split in tiles of tileSize() pixels, and \p dirtyRectangles
+  lists the tiles that changed since the previous frame, so that an encoder
+  can skip the unchanged ones. Changes are detected with a hash of the tiles:
+  the complete frame is listed when its size changed, and for the first
+  frame. */
+class QGLVIEWER_EXPORT FrameSink {
+public:
+  virtual ~FrameSink() {}
+
+  /*! Called by the QGLViewer with the pixels of its previous frame.
+
+  \p pixels is the mapped pixel buffer object. It is only valid during this
+  call: copy the needed data before returning. Pixels are stored as 4 bytes
+  RGBA values, with \p bytesPerLine bytes per row, and the rows are stored bottom
+  up (the OpenGL convention): the first row of \p pixels is the bottom row of
+  the frame. \p size is expressed in device pixels.
+
+  \p dirtyRectangles are expressed in device pixels, with the origin in the
+  upper left corner of the frame (the Qt convention). They do not overlap.
+
+  This method is called during QGLViewer::paintGL(), with the OpenGL context
+  current. It should return quickly, since the display waits for it. */
+  virtual void processFrame(const uchar *pixels, const QSize &size,
+                            int bytesPerLine,
+                            const QVector<QRect> &dirtyRectangles) = 0;
+
+  /*! Returns the size (in device pixels) of the square tiles used to compute
+  the \c dirtyRectangles of processFrame(). Default value is 64. Return 0 to
+  disable the detection of the changes: the complete frame is then always
+  listed. */
+  virtual int tileSize() const { return 64; }
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_SINK_H
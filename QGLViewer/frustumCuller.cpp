@@ -0,0 +1,302 @@
+#include "frustumCuller.h"
+#include "camera.h"
+#include "clippingRegion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace qglviewer;
+
+/*! Creates an empty FrustumCuller. */
+FrustumCuller::FrustumCuller()
+    : maximumLeafSize_(8), hierarchyIsUpToDate_(true) {}
+
+////////////////////////////////////////////////////////////////////////////////
+//                           Registered objects                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an axis aligned box, defined by its \p min and \p max corners, and
+returns its id. Ids of removed objects (see removeObject()) are reused. */
+int FrustumCuller::addBox(const Vec &min, const Vec &max) {
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = objects_.size();
+    objects_.append(Volume());
+    used_.append(true);
+  } else {
+    id = freeIds_.takeLast();
+    used_[id] = true;
+  }
+  setVolume(objects_[id], min, max, -1.0);
+  hierarchyIsUpToDate_ = false;
+  return id;
+}
+
+/*! Registers a sphere and returns its id. Spheres are tested with their exact
+distance to the frustum planes. See also addBox(). */
+int FrustumCuller::addSphere(const Vec &center, qreal radius) {
+  const Vec r(radius, radius, radius);
+  const int id = addBox(center - r, center + r);
+  objects_[id].radius = radius;
+  return id;
+}
+
+/*! Moves or resizes the object \p id, which becomes an axis aligned box. */
+void FrustumCuller::setBox(int id, const Vec &min, const Vec &max) {
+  if (!isValidId(id, "setBox"))
+    return;
+  setVolume(objects_[id], min, max, -1.0);
+  hierarchyIsUpToDate_ = false;
+}
+
+/*! Moves or resizes the object \p id, which becomes a sphere. */
+void FrustumCuller::setSphere(int id, const Vec &center, qreal radius) {
+  if (!isValidId(id, "setSphere"))
+    return;
+  const Vec r(radius, radius, radius);
+  setVolume(objects_[id], center - r, center + r, radius);
+  hierarchyIsUpToDate_ = false;
+}
+
+/*! Unregisters the object \p id. Its id may be returned by the next addBox()
+or addSphere() call. */
+void FrustumCuller::removeObject(int id) {
+  if (!isValidId(id, "removeObject"))
+    return;
+  used_[id] = false;
+  freeIds_.append(id);
+  hierarchyIsUpToDate_ = false;
+}
+
+/*! Unregisters all the objects. */
+void FrustumCuller::clear() {
+  objects_.clear();
+  used_.clear();
+  freeIds_.clear();
+  nodes_.clear();
+  order_.clear();
+  hierarchyIsUpToDate_ = true;
+}
+
+/*! Sets the maximumLeafSize() of the hierarchy, which is rebuilt on the next
+computeVisibleObjects() call. Smaller values make the hierarchy deeper. */
+void FrustumCuller::setMaximumLeafSize(int size) {
+  maximumLeafSize_ = std::max(1, size);
+  hierarchyIsUpToDate_ = false;
+}
+
+bool FrustumCuller::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= objects_.size()) || !used_[id]) {
+    qWarning("FrustumCuller::%s: Invalid object id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+void FrustumCuller::setVolume(Volume &volume, const Vec &min, const Vec &max,
+                              qreal radius) {
+  for (int i = 0; i < 3; ++i) {
+    volume.center[i] = (min[i] + max[i]) / 2.0;
+    volume.extent[i] = std::fabs(max[i] - min[i]) / 2.0;
+  }
+  volume.radius = radius;
+  volume.lastPlane = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Hierarchy                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+void FrustumCuller::buildHierarchy() {
+  nodes_.clear();
+  order_.clear();
+  order_.reserve(nbObjects());
+  for (int i = 0; i < objects_.size(); ++i)
+    if (used_[i])
+      order_.append(i);
+
+  nodes_.reserve(2 * (order_.size() / maximumLeafSize_ + 1));
+  if (!order_.isEmpty())
+    buildNode(0, order_.size());
+
+  hierarchyIsUpToDate_ = true;
+}
+
+// Builds the node of the order_[first..first+count[ objects and returns its
+// index. Objects are split in two halves along the largest axis of their
+// centers' bounding box.
+int FrustumCuller::buildNode(int first, int count) {
+  const int index = nodes_.size();
+  nodes_.append(Node());
+
+  const Real big = std::numeric_limits<Real>::max();
+  Real min[3] = {big, big, big}, max[3] = {-big, -big, -big};
+  Real centerMin[3] = {big, big, big}, centerMax[3] = {-big, -big, -big};
+  for (int o = first; o < first + count; ++o) {
+    const Volume &v = objects_[order_[o]];
+    for (int i = 0; i < 3; ++i) {
+      min[i] = std::min(min[i], v.center[i] - v.extent[i]);
+      max[i] = std::max(max[i], v.center[i] + v.extent[i]);
+      centerMin[i] = std::min(centerMin[i], v.center[i]);
+      centerMax[i] = std::max(centerMax[i], v.center[i]);
+    }
+  }
+
+  Node node;
+  for (int i = 0; i < 3; ++i) {
+    node.volume.center[i] = (min[i] + max[i]) / 2.0;
+    node.volume.extent[i] = (max[i] - min[i]) / 2.0;
+  }
+  node.volume.radius = -1.0;
+  node.volume.lastPlane = -1;
+  node.first = first;
+  node.count = count;
+  node.right = -1;
+
+  if (count > maximumLeafSize_) {
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+      if (centerMax[i] - centerMin[i] > centerMax[axis] - centerMin[axis])
+        axis = i;
+
+    const int half = count / 2;
+    std::nth_element(order_.begin() + first, order_.begin() + first + half,
+                     order_.begin() + first + count, [this, axis](int a, int b) {
+                       return objects_[a].center[axis] <
+                              objects_[b].center[axis];
+                     });
+
+    // Left child is index+1
+    buildNode(first, half);
+    node.right = buildNode(first + half, count - half);
+  }
+
+  nodes_[index] = node;
+  return index;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Culling                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Fills \p visible with the ids of the objects that intersect the \p camera
+frustum. \p visible is cleared first, and its memory is reused between calls.
+*/
+void FrustumCuller::computeVisibleObjects(const Camera *camera,
+                                          QVector<int> &visible) {
+  GLdouble coef[6][4];
+  camera->getFrustumPlanesCoefficients(coef);
+  computeVisibleObjects(coef, visible);
+}
+
+/*! Same as computeVisibleObjects(), with explicit planes as returned by
+Camera::getFrustumPlanesCoefficients(). Plane normals are pointing outwards and
+must be normalized. */
+void FrustumCuller::computeVisibleObjects(const GLdouble coef[6][4],
+                                          QVector<int> &visible) {
+  computeVisibleObjects(coef, 6, visible);
+}
+
+/*! Same as computeVisibleObjects(), with the planes of \p region in addition
+to the \p camera frustum ones: the objects that are entirely clipped by \p
+region are not reported. See ClippingRegion::getPlanesCoefficients(). */
+void FrustumCuller::computeVisibleObjects(const Camera *camera,
+                                          const ClippingRegion &region,
+                                          QVector<int> &visible) {
+  GLdouble coef[14][4];
+  camera->getFrustumPlanesCoefficients(coef);
+  const int nbPlanes = 6 + region.getPlanesCoefficients(coef + 6);
+  computeVisibleObjects(coef, nbPlanes, visible);
+}
+
+/*! Same as computeVisibleObjects(), with \p nbPlanes explicit planes, at most
+32, in the Camera::getFrustumPlanesCoefficients() convention. Plane normals are
+pointing outwards and must be normalized. */
+void FrustumCuller::computeVisibleObjects(const GLdouble coef[][4],
+                                          int nbPlanes,
+                                          QVector<int> &visible) {
+  visible.clear();
+  if (nbPlanes > 32) {
+    qWarning("FrustumCuller::computeVisibleObjects: At most 32 planes are "
+             "supported");
+    nbPlanes = 32;
+  }
+  if (!hierarchyIsUpToDate_)
+    buildHierarchy();
+  if (nodes_.isEmpty())
+    return;
+
+  Real planes[32][4];
+  for (int i = 0; i < nbPlanes; ++i)
+    for (int j = 0; j < 4; ++j)
+      planes[i][j] = Real(coef[i][j]);
+
+  const unsigned int planeMask =
+      (nbPlanes >= 32) ? ~0u : ((1u << qMax(nbPlanes, 0)) - 1u);
+  cullNode(0, planes, nbPlanes, planeMask, visible);
+}
+
+// Returns true if volume is outside one of the planeMask planes. Planes that
+// entirely contain volume are removed from planeMask.
+bool FrustumCuller::cullVolume(Volume &volume, const Real planes[][4],
+                               int nbPlanes, unsigned int &planeMask) {
+  // Plane coherency: the plane that rejected this volume in the previous frame
+  // is tested first, since it probably still does.
+  const int last = volume.lastPlane;
+  for (int n = -1; n < nbPlanes; ++n) {
+    const int i = (n < 0) ? last : n;
+    if ((i < 0) || (i >= nbPlanes) || ((n >= 0) && (i == last)) ||
+        !(planeMask & (1u << i)))
+      continue;
+
+    const Real *p = planes[i];
+    const Real *c = volume.center;
+    const Real *e = volume.extent;
+    const Real distance = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] - p[3];
+    const Real radius =
+        (volume.radius >= 0.0)
+            ? volume.radius
+            : std::fabs(p[0]) * e[0] + std::fabs(p[1]) * e[1] +
+                  std::fabs(p[2]) * e[2];
+
+    if (distance > radius) {
+      volume.lastPlane = i;
+      return true;
+    }
+    if (distance <= -radius)
+      planeMask &= ~(1u << i);
+  }
+  return false;
+}
+
+void FrustumCuller::cullNode(int index, const Real planes[][4], int nbPlanes,
+                             unsigned int planeMask, QVector<int> &visible) {
+  Node &node = nodes_[index];
+  if (cullVolume(node.volume, planes, nbPlanes, planeMask))
+    return;
+
+  // Entirely inside the frustum
+  if (planeMask == 0) {
+    appendObjects(node, visible);
+    return;
+  }
+
+  if (node.right < 0) {
+    for (int o = node.first; o < node.first + node.count; ++o) {
+      unsigned int objectMask = planeMask;
+      if (!cullVolume(objects_[order_[o]], planes, nbPlanes, objectMask))
+        visible.append(order_[o]);
+    }
+  } else {
+    const int right = node.right;
+    cullNode(index + 1, planes, nbPlanes, planeMask, visible);
+    cullNode(right, planes, nbPlanes, planeMask, visible);
+  }
+}
+
+void FrustumCuller::appendObjects(const Node &node,
+                                  QVector<int> &visible) const {
+  for (int o = node.first; o < node.first + node.count; ++o)
+    visible.append(order_[o]);
+}
@@ -0,0 +1,121 @@
+#ifndef QGLVIEWER_FRUSTUM_CULLER_H
+#define QGLVIEWER_FRUSTUM_CULLER_H
+
+#include "vec.h"
+
+#include <QVector>
+
+namespace qglviewer {
+class Camera;
+class ClippingRegion;
+
+/*! \brief A bounding volume hierarchy that culls objects against a Camera
+  frustum.
+  \class FrustumCuller frustumCuller.h QGLViewer/frustumCuller.h
+
+  Register the bounding volumes of your objects with addBox() or addSphere(),
+  which return an object id. computeVisibleObjects() then fills a list with the
+  ids of the objects that intersect the Camera frustum (see
+  Camera::getFrustumPlanesCoefficients()):
+  \code
+  // In your viewer's init()
+  for (int i = 0; i < nbObjects; ++i)
+    culler.addBox(object[i].min, object[i].max);
+
+  // In draw()
+  culler.computeVisibleObjects(camera(), visible);
+  for (int i = 0; i < visible.size(); ++i)
+    object[visible[i]].draw();
+  \endcode
+
+  The hierarchy is a binary tree of axis aligned boxes, built lazily from the
+  registered objects. Each node is tested against the frustum planes with a
+  single dot product and a single absolute dot product per plane. A plane that
+  entirely contains a node is no longer tested for its sub-tree, and a
+  sub-tree that is inside all the planes is output without any further test.
+
+  Consecutive frames usually reject the same nodes with the same plane: the
+  index of the last rejecting plane is cached in each node and tested first on
+  the next call.
+
+  The planes of a ClippingRegion can be added to the frustum ones: the objects
+  that are entirely clipped are then rejected as well.
+
+  Adding, moving (setBox(), setSphere()) or removing an object invalidates the
+  hierarchy, which is rebuilt on the next computeVisibleObjects() call. The
+  culling is conservative: an object may be reported visible when its volume is
+  close to a frustum corner. */
+class QGLVIEWER_EXPORT FrustumCuller {
+public:
+  FrustumCuller();
+
+  /*! @name Registered objects */
+  //@{
+public:
+  int addBox(const Vec &min, const Vec &max);
+  int addSphere(const Vec &center, qreal radius);
+  void setBox(int id, const Vec &min, const Vec &max);
+  void setSphere(int id, const Vec &center, qreal radius);
+  void removeObject(int id);
+  void clear();
+
+  /*! Returns the number of registered objects. */
+  int nbObjects() const { return objects_.size() - freeIds_.size(); }
+  //@}
+
+  /*! @name Culling */
+  //@{
+public:
+  void computeVisibleObjects(const Camera *camera, QVector<int> &visible);
+  void computeVisibleObjects(const GLdouble coef[6][4], QVector<int> &visible);
+  void computeVisibleObjects(const Camera *camera, const ClippingRegion &region,
+                             QVector<int> &visible);
+  void computeVisibleObjects(const GLdouble coef[][4], int nbPlanes,
+                             QVector<int> &visible);
+
+  /*! Returns the maximum number of objects stored in a leaf of the hierarchy.
+  Default value is 8. */
+  int maximumLeafSize() const { return maximumLeafSize_; }
+  void setMaximumLeafSize(int size);
+  //@}
+
+private:
+  struct Volume {
+    Real center[3];
+    Real extent[3];
+    // Negative for boxes
+    Real radius;
+    // Index of the plane that last rejected this volume
+    int lastPlane;
+  };
+
+  struct Node {
+    Volume volume;
+    // Range of the node objects in order_
+    int first, count;
+    // The left child is the next node. -1 for leaves
+    int right;
+  };
+
+  bool isValidId(int id, const char *method) const;
+  void setVolume(Volume &volume, const Vec &min, const Vec &max, qreal radius);
+  void buildHierarchy();
+  int buildNode(int first, int count);
+  static bool cullVolume(Volume &volume, const Real planes[][4], int nbPlanes,
+                         unsigned int &planeMask);
+  void cullNode(int index, const Real planes[][4], int nbPlanes,
+                unsigned int planeMask, QVector<int> &visible);
+  void appendObjects(const Node &node, QVector<int> &visible) const;
+
+  QVector<Volume> objects_;
+  QVector<bool> used_;
+  QVector<int> freeIds_;
+  QVector<Node> nodes_;
+  QVector<int> order_;
+  int maximumLeafSize_;
+  bool hierarchyIsUpToDate_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRUSTUM_CULLER_H
@@ -0,0 +1,404 @@
+#include "geometryRecorder.h"
+
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLVertexArrayObject>
+
+#include <cstddef>
+
+// Compatibility profile primitives, missing from OpenGL ES headers
+#ifndef GL_QUADS
+#define GL_QUADS 0x0007
+#endif
+#ifndef GL_QUAD_STRIP
+#define GL_QUAD_STRIP 0x0008
+#endif
+#ifndef GL_POLYGON
+#define GL_POLYGON 0x0009
+#endif
+
+using namespace qglviewer;
+
+/*! Creates an empty GeometryRecorder, with an identity transformation, a white
+current color, a (0,0,1) current normal and (0,0) texture coordinates. No
+OpenGL resource is created before the first draw(). */
+GeometryRecorder::GeometryRecorder()
+    : recording_(false), mode_(GL_POINTS), attributes_(0),
+      context_(nullptr) {
+  for (int i = 0; i < 3; ++i) {
+    current_.position[i] = 0.0f;
+    current_.normal[i] = (i == 2) ? 1.0f : 0.0f;
+  }
+  for (int i = 0; i < 4; ++i)
+    current_.color[i] = 1.0f;
+  current_.texCoord[0] = current_.texCoord[1] = 0.0f;
+}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+draw() is current. Call cleanupGL() before otherwise. */
+GeometryRecorder::~GeometryRecorder() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Recording                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Starts a primitive, as \c glBegin() does. \p mode is one of the \c
+glBegin() modes, from \c GL_POINTS to \c GL_POLYGON. The primitive is recorded
+by the matching end(). */
+void GeometryRecorder::begin(GLenum mode) {
+  if (recording_) {
+    qWarning("GeometryRecorder::begin: Called twice without end()");
+    return;
+  }
+  recording_ = true;
+  mode_ = mode;
+  primitive_.clear();
+}
+
+/*! Adds a vertex to the current primitive, with the current normal(), color()
+and texCoord(). The position is transformed by the current transformation (see
+multMatrix()). Ignored outside of begin() and end(). */
+void GeometryRecorder::vertex(qreal x, qreal y, qreal z) {
+  if (!recording_)
+    return;
+  const QVector3D p = matrix_.map(QVector3D(float(x), float(y), float(z)));
+  current_.position[0] = p.x();
+  current_.position[1] = p.y();
+  current_.position[2] = p.z();
+  primitive_.append(current_);
+}
+
+/*! Sets the current normal, transformed by the current transformation as \c
+glNormal3d() does. It is not normalized. */
+void GeometryRecorder::normal(qreal x, qreal y, qreal z) {
+  const QVector3D n = QVector3D(float(x), float(y), float(z));
+  const QMatrix3x3 m = matrix_.normalMatrix();
+  for (int i = 0; i < 3; ++i)
+    current_.normal[i] = m(i, 0) * n.x() + m(i, 1) * n.y() + m(i, 2) * n.z();
+  attributes_ |= NORMAL;
+}
+
+/*! Sets the current color, as \c glColor4f() does. */
+void GeometryRecorder::color(float r, float g, float b, float a) {
+  current_.color[0] = r;
+  current_.color[1] = g;
+  current_.color[2] = b;
+  current_.color[3] = a;
+  attributes_ |= COLOR;
+}
+
+/*! Sets the current texture coordinates, as \c glTexCoord2f() does. */
+void GeometryRecorder::texCoord(float s, float t) {
+  current_.texCoord[0] = s;
+  current_.texCoord[1] = t;
+  attributes_ |= TEX_COORD;
+}
+
+/*! Ends the primitive started by begin(). Its vertices are converted to
+independent points, lines or triangles and added to the group of the
+primitives with the same type and attributes. Incomplete primitives are
+ignored, as in OpenGL. */
+void GeometryRecorder::end() {
+  if (!recording_) {
+    qWarning("GeometryRecorder::end: Called without begin()");
+    return;
+  }
+  recording_ = false;
+
+  const QVector<Vertex> &v = primitive_;
+  const int n = v.size();
+  GLenum mode;
+  QVector<int> indices;
+  switch (mode_) {
+  case GL_POINTS:
+    mode = GL_POINTS;
+    for (int i = 0; i < n; ++i)
+      indices << i;
+    break;
+  case GL_LINES:
+    mode = GL_LINES;
+    for (int i = 0; i + 1 < n; i += 2)
+      indices << i << i + 1;
+    break;
+  case GL_LINE_STRIP:
+  case GL_LINE_LOOP:
+    mode = GL_LINES;
+    for (int i = 0; i + 1 < n; ++i)
+      indices << i << i + 1;
+    if ((mode_ == GL_LINE_LOOP) && (n > 2))
+      indices << n - 1 << 0;
+    break;
+  case GL_TRIANGLES:
+    mode = GL_TRIANGLES;
+    for (int i = 0; i + 2 < n; i += 3)
+      indices << i << i + 1 << i + 2;
+    break;
+  case GL_TRIANGLE_STRIP:
+    mode = GL_TRIANGLES;
+    // Odd triangles are flipped to keep the strip orientation
+    for (int i = 0; i + 2 < n; ++i)
+      if (i % 2 == 0)
+        indices << i << i + 1 << i + 2;
+      else
+        indices << i + 1 << i << i + 2;
+    break;
+  case GL_QUADS:
+    mode = GL_TRIANGLES;
+    for (int i = 0; i + 3 < n; i += 4)
+      indices << i << i + 1 << i + 2 << i << i + 2 << i + 3;
+    break;
+  case GL_QUAD_STRIP:
+    mode = GL_TRIANGLES;
+    // Quad i is made of the vertices 2i, 2i+1, 2i+3 and 2i+2
+    for (int i = 0; i + 3 < n; i += 2)
+      indices << i << i + 1 << i + 3 << i << i + 3 << i + 2;
+    break;
+  case GL_TRIANGLE_FAN:
+  case GL_POLYGON:
+    mode = GL_TRIANGLES;
+    for (int i = 1; i + 1 < n; ++i)
+      indices << 0 << i << i + 1;
+    break;
+  default:
+    qWarning("GeometryRecorder::end: Invalid primitive mode 0x%x",
+             unsigned(mode_));
+    primitive_.clear();
+    return;
+  }
+
+  if (!indices.isEmpty()) {
+    Group &g = group(mode, attributes_);
+    g.vertices.reserve(g.vertices.size() + indices.size());
+    for (QVector<int>::const_iterator it = indices.begin(),
+                                      end = indices.end();
+         it != end; ++it)
+      g.vertices.append(v.at(*it));
+    g.isUploaded = false;
+  }
+  primitive_.clear();
+}
+
+// The group of the primitives of mode with these attributes, created if needed
+GeometryRecorder::Group &GeometryRecorder::group(GLenum mode, int attributes) {
+  for (int i = 0; i < groups_.size(); ++i)
+    if ((groups_[i].mode == mode) && (groups_[i].attributes == attributes))
+      return groups_[i];
+
+  Group g;
+  g.mode = mode;
+  g.attributes = attributes;
+  g.buffer = nullptr;
+  g.vao = nullptr;
+  g.isUploaded = false;
+  groups_.append(g);
+  return groups_.last();
+}
+
+/*! Removes all the recorded primitives. The transformation and the current
+attributes are not modified. The vertex buffers are released by the next
+draw() or cleanupGL(). */
+void GeometryRecorder::clear() {
+  for (int i = 0; i < groups_.size(); ++i) {
+    groups_[i].vertices.clear();
+    groups_[i].isUploaded = false;
+  }
+  primitive_.clear();
+  recording_ = false;
+  attributes_ = 0;
+}
+
+/*! Returns the number of recorded vertices, once converted to independent
+primitives (a quad has 6 vertices). */
+int GeometryRecorder::nbVertices() const {
+  int nb = 0;
+  for (int i = 0; i < groups_.size(); ++i)
+    nb += groups_.at(i).vertices.size();
+  return nb;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Transformations                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Saves the current transformation, as \c glPushMatrix() does. */
+void GeometryRecorder::pushMatrix() { matrixStack_.append(matrix_); }
+
+/*! Restores the transformation saved by the last pushMatrix(). */
+void GeometryRecorder::popMatrix() {
+  if (matrixStack_.isEmpty()) {
+    qWarning("GeometryRecorder::popMatrix: Empty matrix stack");
+    return;
+  }
+  matrix_ = matrixStack_.takeLast();
+}
+
+/*! Resets the current transformation to identity. */
+void GeometryRecorder::loadIdentity() { matrix_.setToIdentity(); }
+
+/*! Multiplies the current transformation by \p m, in OpenGL column major order,
+as \c glMultMatrixd() does. Use it with Frame::matrix(). */
+void GeometryRecorder::multMatrix(const GLdouble m[16]) {
+  QMatrix4x4 matrix;
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      matrix(i, j) = float(m[4 * j + i]);
+  matrix_ *= matrix;
+}
+
+/*! Translates the current transformation, as \c glTranslated() does. */
+void GeometryRecorder::translate(qreal x, qreal y, qreal z) {
+  matrix_.translate(float(x), float(y), float(z));
+}
+
+/*! Rotates the current transformation by \p angle degrees around the (\p x, \p
+y, \p z) axis, as \c glRotated() does. */
+void GeometryRecorder::rotate(qreal angle, qreal x, qreal y, qreal z) {
+  matrix_.rotate(float(angle), float(x), float(y), float(z));
+}
+
+/*! Scales the current transformation, as \c glScaled() does. */
+void GeometryRecorder::scale(qreal x, qreal y, qreal z) {
+  matrix_.scale(float(x), float(y), float(z));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Replay                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// Copies the vertices of group in its vertex buffer. In a core profile, the
+// generic attributes are set in its vertex array object.
+void GeometryRecorder::upload(Group &group, bool coreProfile) {
+  if (!group.buffer) {
+    group.buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    group.buffer->create();
+  }
+  if (coreProfile && !group.vao) {
+    group.vao = new QOpenGLVertexArrayObject();
+    group.vao->create();
+  }
+
+  if (group.vao)
+    group.vao->bind();
+  group.buffer->bind();
+  group.buffer->allocate(group.vertices.constData(),
+                         group.vertices.size() * int(sizeof(Vertex)));
+
+  if (group.vao) {
+    QOpenGLFunctions *f = context_->functions();
+    const GLsizei stride = sizeof(Vertex);
+    f->glEnableVertexAttribArray(0);
+    f->glVertexAttribPointer(
+        0, 3, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const void *>(offsetof(Vertex, position)));
+    const struct {
+      int attribute, size;
+      size_t offset;
+    } attributes[] = {{NORMAL, 3, offsetof(Vertex, normal)},
+                      {COLOR, 4, offsetof(Vertex, color)},
+                      {TEX_COORD, 2, offsetof(Vertex, texCoord)}};
+    for (int i = 0; i < 3; ++i) {
+      const GLuint location = GLuint(i + 1);
+      if (group.attributes & attributes[i].attribute) {
+        f->glEnableVertexAttribArray(location);
+        f->glVertexAttribPointer(
+            location, attributes[i].size, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const void *>(attributes[i].offset));
+      } else
+        f->glDisableVertexAttribArray(location);
+    }
+    group.vao->release();
+  }
+  group.buffer->release();
+  group.isUploaded = true;
+}
+
+// Releases the OpenGL resources of group
+void GeometryRecorder::release(Group &group) {
+  if (group.vao)
+    group.vao->destroy();
+  delete group.vao;
+  group.vao = nullptr;
+  if (group.buffer)
+    group.buffer->destroy();
+  delete group.buffer;
+  group.buffer = nullptr;
+  group.isUploaded = false;
+}
+
+/*! Draws the recorded primitives, with one \c glDrawArrays() call per group
+(see nbGroups()). The vertex buffers are uploaded by the first draw() after a
+modification. The current OpenGL states and matrices apply.
+
+In a compatibility context, the client array states and the current color are
+preserved. In a core profile context, bind a shader program that reads the
+generic vertex attributes 0 to 3 (see the class documentation) first. */
+void GeometryRecorder::draw() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("GeometryRecorder::draw: No current OpenGL context");
+    return;
+  }
+  context_ = context;
+  const bool coreProfile =
+      context->format().profile() == QSurfaceFormat::CoreProfile;
+
+  // Groups emptied by clear() release their buffers
+  for (int i = groups_.size() - 1; i >= 0; --i)
+    if (groups_[i].vertices.isEmpty()) {
+      release(groups_[i]);
+      groups_.remove(i);
+    }
+
+  for (int i = 0; i < groups_.size(); ++i) {
+    Group &g = groups_[i];
+    if (!g.isUploaded)
+      upload(g, coreProfile);
+
+    if (coreProfile) {
+      g.vao->bind();
+      context->functions()->glDrawArrays(g.mode, 0, g.vertices.size());
+      g.vao->release();
+      continue;
+    }
+
+    const GLsizei stride = sizeof(Vertex);
+    glPushAttrib(GL_CURRENT_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    g.buffer->bind();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride,
+                    reinterpret_cast<const void *>(offsetof(Vertex, position)));
+    if (g.attributes & NORMAL) {
+      glEnableClientState(GL_NORMAL_ARRAY);
+      glNormalPointer(GL_FLOAT, stride,
+                      reinterpret_cast<const void *>(offsetof(Vertex, normal)));
+    }
+    if (g.attributes & COLOR) {
+      glEnableClientState(GL_COLOR_ARRAY);
+      glColorPointer(4, GL_FLOAT, stride,
+                     reinterpret_cast<const void *>(offsetof(Vertex, color)));
+    }
+    if (g.attributes & TEX_COORD) {
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+      glTexCoordPointer(
+          2, GL_FLOAT, stride,
+          reinterpret_cast<const void *>(offsetof(Vertex, texCoord)));
+    }
+    glDrawArrays(g.mode, 0, g.vertices.size());
+    g.buffer->release();
+    glPopClientAttrib();
+    glPopAttrib();
+  }
+}
+
+/*! Releases the vertex buffers. The context used by draw() must be current.
+The recorded primitives are kept, and uploaded again by the next draw(). */
+void GeometryRecorder::cleanupGL() {
+  for (int i = 0; i < groups_.size(); ++i)
+    release(groups_[i]);
+  context_ = nullptr;
+}
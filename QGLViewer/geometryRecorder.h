@@ -0,0 +1,161 @@
+#ifndef QGLVIEWER_GEOMETRY_RECORDER_H
+#define QGLVIEWER_GEOMETRY_RECORDER_H
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QVector>
+
+#include "vec.h"
+
+class QOpenGLBuffer;
+class QOpenGLContext;
+class QOpenGLVertexArrayObject;
+
+namespace qglviewer {
+
+/*! \brief Records immediate mode style geometry once, and draws it from vertex
+  buffers.
+  \class GeometryRecorder geometryRecorder.h QGLViewer/geometryRecorder.h
+
+  Display lists (\c glNewList(), \c glCallList()) and immediate mode drawing
+  (\c glBegin(), \c glVertex()...) are slow, and not available in a core
+  profile context. A GeometryRecorder provides the same calls, with the same
+  semantic: the existing drawing code is converted by replacing the \c gl
+  prefix of its calls by the recorder, and is only executed once:
+  \code
+  void Viewer::init() {
+    recorder_.begin(GL_QUAD_STRIP);
+    for (int i = 0; i <= 50; ++i) {
+      const qreal angle = 2.0 * M_PI * i / 50.0;
+      recorder_.color(QColor::fromHsvF(i / 50.0, 1.0, 1.0));
+      recorder_.normal(cos(angle), sin(angle), 0.0);
+      recorder_.vertex(cos(angle), sin(angle), 0.0);
+      recorder_.vertex(cos(angle), sin(angle), 1.0);
+    }
+    recorder_.end();
+  }
+
+  void Viewer::draw() { recorder_.draw(); }
+  \endcode
+
+  The recorded primitives are converted to points, lines and triangles, and
+  grouped by primitive type and by set of specified attributes (a primitive
+  specifies a color, a normal or texture coordinates when they were given
+  before its end()). Each group is stored in an interleaved vertex buffer, and
+  drawn with a single call: nbGroups() is usually 1 to 3, whatever the number
+  of recorded primitives.
+
+  The transformations (translate(), rotate(), multMatrix(), pushMatrix()...)
+  are applied to the recorded vertices and normals, as the \c GL_MODELVIEW
+  matrix would. Other OpenGL states (line width, material, enabled lighting...)
+  are not recorded: they are the ones set when draw() is called, and
+  primitives that need different states should use different recorders.
+
+  In a compatibility context, draw() uses the fixed pipeline vertex, normal,
+  color and texture coordinate arrays. In a core profile context, they are
+  bound to the generic vertex attributes 0 (position), 1 (normal), 2 (color)
+  and 3 (texture coordinates) of your shader program, which must be bound.
+
+  The OpenGL methods (draw() and cleanupGL()) must be called with the same
+  context current. Call cleanupGL() with this context current before the
+  GeometryRecorder is destroyed. */
+class QGLVIEWER_EXPORT GeometryRecorder {
+public:
+  GeometryRecorder();
+  ~GeometryRecorder();
+
+  /*! @name Recording */
+  //@{
+public:
+  void begin(GLenum mode);
+  void end();
+
+  void vertex(qreal x, qreal y, qreal z = 0.0);
+  /*! Same as vertex(), with a Vec. */
+  void vertex(const Vec &v) { vertex(v.x, v.y, v.z); }
+  void normal(qreal x, qreal y, qreal z);
+  /*! Same as normal(), with a Vec. */
+  void normal(const Vec &n) { normal(n.x, n.y, n.z); }
+  void color(float r, float g, float b, float a = 1.0f);
+  /*! Same as color(), with a QColor. */
+  void color(const QColor &c) {
+    color(float(c.redF()), float(c.greenF()), float(c.blueF()),
+          float(c.alphaF()));
+  }
+  void texCoord(float s, float t);
+
+  void clear();
+  /*! Returns \c true when no primitive was recorded since the last
+  clear(). */
+  bool isEmpty() const { return nbVertices() == 0; }
+  int nbVertices() const;
+  //@}
+
+  /*! @name Transformations */
+  //@{
+public:
+  void pushMatrix();
+  void popMatrix();
+  void loadIdentity();
+  void multMatrix(const GLdouble m[16]);
+  void translate(qreal x, qreal y, qreal z);
+  void rotate(qreal angle, qreal x, qreal y, qreal z);
+  void scale(qreal x, qreal y, qreal z);
+  //@}
+
+  /*! @name Replay */
+  //@{
+public:
+  void draw();
+  /*! Returns the number of vertex buffers, and hence of draw calls, used by
+  draw(). */
+  int nbGroups() const { return groups_.size(); }
+  void cleanupGL();
+  //@}
+
+private:
+  Q_DISABLE_COPY(GeometryRecorder)
+
+  // Attributes given for a primitive
+  enum Attribute { NORMAL = 1, COLOR = 2, TEX_COORD = 4 };
+
+  // Interleaved position, normal, color and texture coordinates
+  struct Vertex {
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat color[4];
+    GLfloat texCoord[2];
+  };
+
+  struct Group {
+    GLenum mode; // GL_POINTS, GL_LINES or GL_TRIANGLES
+    int attributes;
+    QVector<Vertex> vertices;
+    QOpenGLBuffer *buffer;
+    QOpenGLVertexArrayObject *vao; // core profile only
+    bool isUploaded;
+  };
+
+  Group &group(GLenum mode, int attributes);
+  void upload(Group &group, bool coreProfile);
+  void release(Group &group);
+
+  // Current primitive and attributes
+  bool recording_;
+  GLenum mode_;
+  QVector<Vertex> primitive_;
+  Vertex current_;
+  int attributes_;
+
+  QMatrix4x4 matrix_;
+  QVector<QMatrix4x4> matrixStack_;
+
+  QVector<Group> groups_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_GEOMETRY_RECORDER_H
@@ -0,0 +1,194 @@
+#include "glStateCache.h"
+#include "hotPathCounters.h"
+
+using namespace qglviewer;
+
+// Cache of the QGLViewer being painted in this thread, see setCurrent()
+static thread_local GLStateCache *currentCache = nullptr;
+
+/*! Creates a GLStateCache where no state is known. */
+GLStateCache::GLStateCache() : nbSkippedChanges_(0), nbQueries_(0) {
+  invalidate();
+}
+
+/*! Returns the cache of the QGLViewer whose QGLViewer::paintGL() is running in
+this thread. Otherwise, returns a cache that is invalidated at each call, and
+which hence only skips the changes made through the same pointer.
+
+Never returns \c nullptr: drawing helpers can always use it. */
+GLStateCache *GLStateCache::current() {
+  if (currentCache)
+    return currentCache;
+  static thread_local GLStateCache uncached;
+  uncached.invalidate();
+  return &uncached;
+}
+
+/*! Makes \p cache the current() one of this thread, and returns the previous
+one (\c nullptr if none). Called by QGLViewer::paintGL(). */
+GLStateCache *GLStateCache::setCurrent(GLStateCache *cache) {
+  GLStateCache *const previous = currentCache;
+  currentCache = cache;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Capabilities                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Same as \c glEnable(cap), skipped when \p cap is known to be enabled. */
+void GLStateCache::enable(GLenum cap) { setEnabled(cap, true); }
+
+/*! Same as \c glDisable(cap), skipped when \p cap is known to be disabled. */
+void GLStateCache::disable(GLenum cap) { setEnabled(cap, false); }
+
+/*! Enables or disables \p cap, unless it is known to be in this state. */
+void GLStateCache::setEnabled(GLenum cap, bool enabled) {
+  QHash<GLenum, bool>::iterator it = state_.caps.find(cap);
+  if ((it != state_.caps.end()) && (it.value() == enabled)) {
+    ++nbSkippedChanges_;
+    return;
+  }
+
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  state_.caps[cap] = enabled;
+}
+
+/*! Same as \c glIsEnabled(cap). Only the first call queries OpenGL, until the
+next invalidate(). */
+bool GLStateCache::isEnabled(GLenum cap) {
+  QHash<GLenum, bool>::const_iterator it = state_.caps.constFind(cap);
+  if (it != state_.caps.constEnd())
+    return it.value();
+
+  ++nbQueries_;
+  const bool enabled = glIsEnabled(cap) == GL_TRUE;
+  state_.caps.insert(cap, enabled);
+  return enabled;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Other states                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Same as \c glLineWidth(width), skipped when \p width is already set. */
+void GLStateCache::setLineWidth(GLfloat width) {
+  if (state_.lineWidth == width) {
+    ++nbSkippedChanges_;
+    return;
+  }
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glLineWidth(width);
+  state_.lineWidth = width;
+}
+
+/*! Returns the current \c glLineWidth, queried only when it is not known. */
+GLfloat GLStateCache::lineWidth() {
+  if (state_.lineWidth < 0.0f) {
+    ++nbQueries_;
+    glGetFloatv(GL_LINE_WIDTH, &state_.lineWidth);
+  }
+  return state_.lineWidth;
+}
+
+/*! Same as \c glPointSize(size), skipped when \p size is already set. */
+void GLStateCache::setPointSize(GLfloat size) {
+  if (state_.pointSize == size) {
+    ++nbSkippedChanges_;
+    return;
+  }
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glPointSize(size);
+  state_.pointSize = size;
+}
+
+/*! Same as \c glDepthMask(enabled), skipped when already set. */
+void GLStateCache::setDepthMask(bool enabled) {
+  if (state_.depthMask == int(enabled)) {
+    ++nbSkippedChanges_;
+    return;
+  }
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+  state_.depthMask = int(enabled);
+}
+
+/*! Same as \c glBlendFunc(source, destination), skipped when already set. */
+void GLStateCache::setBlendFunc(GLenum source, GLenum destination) {
+  if (state_.blendFuncIsKnown && (state_.blendSource == source) &&
+      (state_.blendDestination == destination)) {
+    ++nbSkippedChanges_;
+    return;
+  }
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glBlendFunc(source, destination);
+  state_.blendFuncIsKnown = true;
+  state_.blendSource = source;
+  state_.blendDestination = destination;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Attribute stack                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Same as \c glPushAttrib(mask). The recorded values are saved, and restored
+by the matching popAttrib(). Not available in a core profile context. */
+void GLStateCache::pushAttrib(GLbitfield mask) {
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glPushAttrib(mask);
+  SavedState saved;
+  saved.mask = mask;
+  saved.state = state_;
+  stack_.append(saved);
+}
+
+/*! Same as \c glPopAttrib(). The recorded values of the states restored by
+OpenGL are restored. The capabilities are forgotten when \c GL_ENABLE_BIT was
+not in the pushAttrib() mask, since other attribute groups also include some
+of them. */
+void GLStateCache::popAttrib() {
+  if (stack_.isEmpty()) {
+    qWarning("GLStateCache::popAttrib: Empty attribute stack");
+    return;
+  }
+  QGLVIEWER_COUNT(GL_STATE_CHANGE);
+  glPopAttrib();
+
+  const SavedState saved = stack_.takeLast();
+  if (saved.mask & GL_ENABLE_BIT)
+    state_.caps = saved.state.caps;
+  else
+    state_.caps.clear();
+  if (saved.mask & GL_LINE_BIT)
+    state_.lineWidth = saved.state.lineWidth;
+  if (saved.mask & GL_POINT_BIT)
+    state_.pointSize = saved.state.pointSize;
+  if (saved.mask & GL_DEPTH_BUFFER_BIT)
+    state_.depthMask = saved.state.depthMask;
+  if (saved.mask & GL_COLOR_BUFFER_BIT) {
+    state_.blendFuncIsKnown = saved.state.blendFuncIsKnown;
+    state_.blendSource = saved.state.blendSource;
+    state_.blendDestination = saved.state.blendDestination;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Synchronization                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Forgets all the recorded values, which are queried or set again by the next
+calls. Call this method after OpenGL calls that modify the recorded states
+without the cache (including a \c QPainter on the OpenGL widget). The
+attribute stack is preserved. */
+void GLStateCache::invalidate() {
+  state_.caps.clear();
+  state_.lineWidth = -1.0f;
+  state_.pointSize = -1.0f;
+  state_.depthMask = -1;
+  state_.blendFuncIsKnown = false;
+  state_.blendSource = state_.blendDestination = 0;
+}
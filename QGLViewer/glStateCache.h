@@ -0,0 +1,119 @@
+#ifndef QGLVIEWER_GL_STATE_CACHE_H
+#define QGLVIEWER_GL_STATE_CACHE_H
+
+#include <QHash>
+#include <QVector>
+
+#include "config.h"
+
+namespace qglviewer {
+/*! \brief Shadows a part of the OpenGL state to skip redundant changes and
+  queries.
+  \class GLStateCache glStateCache.h QGLViewer/glStateCache.h
+
+  The drawing helpers of the viewer (QGLViewer::postDraw(),
+  QGLViewer::drawAxis(), QGLViewer::drawGrid(), QGLViewer::drawLight()...)
+  save and restore the states they modify, which requires \c glGet queries,
+  and set the same states over and over. A \c glGet is a pipeline
+  synchronization on some drivers, and each redundant \c glEnable() has a
+  validation cost.
+
+  A GLStateCache records the states set through it: the enabled capabilities
+  (see enable() and isEnabled()), the line width, the point size, the depth
+  mask and the blending function. A change to the recorded value is skipped,
+  and a state that is not known yet is queried once. pushAttrib() and
+  popAttrib() save and restore the recorded values along with the OpenGL
+  state.
+
+  Each QGLViewer has its own cache (see QGLViewer::glStateCache()), which is
+  current() during its QGLViewer::postDraw(). When draw() only modifies the
+  recorded states through the cache, enable QGLViewer::glStateIsTracked(): the
+  cache is then current() during the whole QGLViewer::paintGL(), and the
+  states set by draw() are known by postDraw():
+  \code
+  void Viewer::draw() {
+    GLStateCache *state = GLStateCache::current();
+    state->disable(GL_LIGHTING);
+    state->setLineWidth(2.0f);
+    drawWireframes();
+    state->enable(GL_LIGHTING);
+    drawSolids();
+  }
+  \endcode
+
+  The cache is only valid if the recorded states are not modified behind its
+  back. The viewer invalidate()s it at the beginning of each frame, after each
+  \c QPainter use, and before postDraw() unless QGLViewer::glStateIsTracked().
+  Call invalidate() after your own direct calls to the recorded states. */
+class QGLVIEWER_EXPORT GLStateCache {
+public:
+  GLStateCache();
+
+  static GLStateCache *current();
+  static GLStateCache *setCurrent(GLStateCache *cache);
+
+  /*! @name Capabilities */
+  //@{
+public:
+  void enable(GLenum cap);
+  void disable(GLenum cap);
+  void setEnabled(GLenum cap, bool enabled);
+  bool isEnabled(GLenum cap);
+  //@}
+
+  /*! @name Other states */
+  //@{
+public:
+  void setLineWidth(GLfloat width);
+  GLfloat lineWidth();
+  void setPointSize(GLfloat size);
+  void setDepthMask(bool enabled);
+  void setBlendFunc(GLenum source, GLenum destination);
+  //@}
+
+  /*! @name Attribute stack */
+  //@{
+public:
+  void pushAttrib(GLbitfield mask);
+  void popAttrib();
+  //@}
+
+  /*! @name Synchronization */
+  //@{
+public:
+  void invalidate();
+  /*! Returns the number of state changes skipped since the last
+  resetStatistics(), because the recorded value was already set. */
+  int nbSkippedChanges() const { return nbSkippedChanges_; }
+  /*! Returns the number of \c glGet queries made since the last
+  resetStatistics(). */
+  int nbQueries() const { return nbQueries_; }
+  /*! Resets nbSkippedChanges() and nbQueries() to 0. */
+  void resetStatistics() { nbSkippedChanges_ = nbQueries_ = 0; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(GLStateCache)
+
+  // Recorded values. Absent capabilities and negative values are unknown.
+  struct State {
+    QHash<GLenum, bool> caps;
+    GLfloat lineWidth, pointSize;
+    int depthMask;
+    bool blendFuncIsKnown;
+    GLenum blendSource, blendDestination;
+  };
+
+  struct SavedState {
+    GLbitfield mask;
+    State state;
+  };
+
+  State state_;
+  QVector<SavedState> stack_;
+  int nbSkippedChanges_, nbQueries_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_GL_STATE_CACHE_H
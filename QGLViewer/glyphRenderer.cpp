@@ -0,0 +1,408 @@
+#include "glyphRenderer.h"
+#include "camera.h"
+#include "coreProfileRenderer.h"
+#include "manipulatedCameraFrame.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+
+using namespace qglviewer;
+
+// Attribute locations, bound before the program is linked. The instance
+// matrix uses four consecutive locations.
+static const GLuint vertexLocation = 0;
+static const GLuint normalLocation = 1;
+static const GLuint instanceMatrixLocation = 2;
+static const GLuint instanceCornersLocation = 6;
+
+// Floats per instance: a matrix, and the four frustum points of the cameras
+static const int axisInstanceSize = 16;
+static const int frustumInstanceSize = 16 + 4 * 3;
+
+static const char *vertexShaderSource =
+    "in vec3 vertex;\n"
+    "in vec3 normal;\n"
+    "in mat4 instanceMatrix;\n"
+    "in vec3 instanceNear;\n"
+    "in vec3 instanceFar;\n"
+    "in vec3 instanceLineStart;\n"
+    "in vec3 instanceLineEnd;\n"
+    "uniform mat4 modelViewMatrix;\n"
+    "uniform mat4 projectionMatrix;\n"
+    "uniform bool frustum;\n"
+    "uniform vec4 color;\n"
+    "uniform bool lit;\n"
+    "out vec4 vertexColor;\n"
+    "void main() {\n"
+    "  vec3 position = vertex;\n"
+    "  if (frustum) {\n"
+    "    // vertex.z selects the instance corner that scales vertex.xy\n"
+    "    vec3 corners[4] = vec3[4](instanceNear, instanceFar,\n"
+    "                              instanceLineStart, instanceLineEnd);\n"
+    "    vec3 corner = corners[int(vertex.z + 0.5)];\n"
+    "    position = vec3(vertex.xy * corner.xy, -corner.z);\n"
+    "  }\n"
+    "  mat4 modelView = modelViewMatrix * instanceMatrix;\n"
+    "  gl_Position = projectionMatrix * modelView * vec4(position, 1.0);\n"
+    "  if (lit) {\n"
+    "    // Default GL_LIGHT0 head light, with the default global ambient\n"
+    "    float diffuse = abs(normalize(mat3(modelView) * normal).z);\n"
+    "    vertexColor = vec4(min(color.rgb * (0.2 + diffuse), 1.0), color.a);\n"
+    "  } else\n"
+    "    vertexColor = color;\n"
+    "}\n";
+
+static const char *fragmentShaderSource =
+    "in vec4 vertexColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = vertexColor; }\n";
+
+// Appends a position and a normal to data
+static void addVertex(QVector<GLfloat> &data, float x, float y, float z,
+                      float nx = 0.0f, float ny = 0.0f, float nz = 0.0f) {
+  data << x << y << z << nx << ny << nz;
+}
+
+/*! Creates an uninitialized renderer. Call initialize() once the OpenGL
+context is current. */
+GlyphRenderer::GlyphRenderer()
+    : modelViewMatrixLocation_(-1), projectionMatrixLocation_(-1),
+      frustumLocation_(-1), colorLocation_(-1), litLocation_(-1),
+      axisLinesVertexCount_(0), arrowVertexCount_(0), nearPlaneFirst_(0),
+      farPlaneFirst_(0), planeVertexCount_(0), arrowFirst_(0),
+      frustumArrowVertexCount_(0), linesFirst_(0), linesVertexCount_(0),
+      ringBuffer_(nullptr) {
+  axisInstanceVBO_.setUsagePattern(QOpenGLBuffer::StreamDraw);
+  frustumInstanceVBO_.setUsagePattern(QOpenGLBuffer::StreamDraw);
+}
+
+/*! Releases the OpenGL resources. The context that was current when
+initialize() was called must be current. */
+GlyphRenderer::~GlyphRenderer() {
+  axisVAO_.destroy();
+  frustumVAO_.destroy();
+  axisVBO_.destroy();
+  axisInstanceVBO_.destroy();
+  frustumVBO_.destroy();
+  frustumInstanceVBO_.destroy();
+}
+
+/*! Creates the shader program, the vertex array objects and the glyph meshes.
+Returns \c false (and isInitialized() remains \c false) if the current context
+does not support instanced rendering, in which case QGLViewer draws the glyphs
+one by one. */
+bool GlyphRenderer::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("GlyphRenderer::initialize: No current OpenGL context");
+    return false;
+  }
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("GlyphRenderer::initialize: Instanced rendering requires OpenGL "
+             "3.3 or OpenGL ES 3.0");
+    return false;
+  }
+
+  if (!axisVAO_.create() || !frustumVAO_.create()) {
+    qWarning("GlyphRenderer::initialize: Vertex array objects are not "
+             "supported");
+    return false;
+  }
+
+  if (!axisVBO_.create() || !axisInstanceVBO_.create() ||
+      !frustumVBO_.create() || !frustumInstanceVBO_.create()) {
+    qWarning("GlyphRenderer::initialize: Unable to create vertex buffers");
+    return false;
+  }
+
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision mediump float;\n"
+                                : "#version 330\n";
+  // Compiled by link(), unless the program binary cache has them
+  if (!program_.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                 header + vertexShaderSource) ||
+      !program_.addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource)) {
+    qWarning("GlyphRenderer::initialize: Unable to compile shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  program_.bindAttributeLocation("vertex", vertexLocation);
+  program_.bindAttributeLocation("normal", normalLocation);
+  program_.bindAttributeLocation("instanceMatrix", instanceMatrixLocation);
+  program_.bindAttributeLocation("instanceNear", instanceCornersLocation);
+  program_.bindAttributeLocation("instanceFar", instanceCornersLocation + 1);
+  program_.bindAttributeLocation("instanceLineStart",
+                                 instanceCornersLocation + 2);
+  program_.bindAttributeLocation("instanceLineEnd",
+                                 instanceCornersLocation + 3);
+
+  buildAxis();
+  buildFrustum();
+  setupVertexArray(axisVAO_, axisVBO_);
+  setupVertexArray(frustumVAO_, frustumVBO_);
+
+  if (!program_.link()) {
+    qWarning("GlyphRenderer::initialize: Unable to link shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  modelViewMatrixLocation_ = program_.uniformLocation("modelViewMatrix");
+  projectionMatrixLocation_ = program_.uniformLocation("projectionMatrix");
+  frustumLocation_ = program_.uniformLocation("frustum");
+  colorLocation_ = program_.uniformLocation("color");
+  litLocation_ = program_.uniformLocation("lit");
+  return true;
+}
+
+/*! Records in \p vao the attribute layout of the \p vbo mesh (position and
+normal). The instance attributes are set by bindInstances(), since their
+buffer and offset change at each draw. */
+void GlyphRenderer::setupVertexArray(QOpenGLVertexArrayObject &vao,
+                                     QOpenGLBuffer &vbo) {
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  QOpenGLVertexArrayObject::Binder binder(&vao);
+
+  vbo.bind();
+  const int stride = 6 * sizeof(GLfloat);
+  f->glEnableVertexAttribArray(vertexLocation);
+  f->glVertexAttribPointer(vertexLocation, 3, GL_FLOAT, GL_FALSE, stride,
+                           nullptr);
+  f->glEnableVertexAttribArray(normalLocation);
+  f->glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, stride,
+                           reinterpret_cast<const void *>(3 * sizeof(GLfloat)));
+  vbo.release();
+}
+
+/*! Returns where the \p nbFloats instance floats of the next draw are
+written: in the frame ring buffer when there is room, in instances_
+otherwise. */
+GLfloat *GlyphRenderer::instanceData(int nbFloats) {
+  instanceAllocation_ = FrameRingBuffer::Allocation();
+  if (ringBuffer_)
+    instanceAllocation_ =
+        ringBuffer_->allocate(int(nbFloats * sizeof(GLfloat)));
+  if (instanceAllocation_.isValid())
+    return static_cast<GLfloat *>(instanceAllocation_.data);
+
+  instances_.resize(nbFloats);
+  return instances_.data();
+}
+
+/*! Points the instance attributes of the bound vertex array object at the
+instances written in instanceData(), of \p instanceSize floats each (a
+matrix, optionally followed by the four frustum points). Those of instances_
+are first uploaded in \p instances. */
+void GlyphRenderer::bindInstances(QOpenGLBuffer &instances, int instanceSize) {
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  quintptr offset = 0;
+  if (instanceAllocation_.isValid()) {
+    f->glBindBuffer(GL_ARRAY_BUFFER, instanceAllocation_.buffer);
+    offset = quintptr(instanceAllocation_.offset);
+  } else {
+    instances.bind();
+    instances.allocate(instances_.constData(),
+                       int(instances_.size() * sizeof(GLfloat)));
+  }
+
+  const int instanceStride = instanceSize * sizeof(GLfloat);
+  for (int c = 0; c < 4; ++c) {
+    const GLuint location = instanceMatrixLocation + c;
+    f->glEnableVertexAttribArray(location);
+    f->glVertexAttribPointer(
+        location, 4, GL_FLOAT, GL_FALSE, instanceStride,
+        reinterpret_cast<const void *>(offset + 4 * c * sizeof(GLfloat)));
+    f->glVertexAttribDivisor(location, 1);
+  }
+  for (int p = 0; 16 + 3 * p < instanceSize; ++p) {
+    const GLuint location = instanceCornersLocation + p;
+    f->glEnableVertexAttribArray(location);
+    f->glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, instanceStride,
+                             reinterpret_cast<const void *>(
+                                 offset + (16 + 3 * p) * sizeof(GLfloat)));
+    f->glVertexAttribDivisor(location, 1);
+  }
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*! Fills the axis buffer with the X, Y and Z characters of a unit length axis,
+followed by its Z, X and Y arrows (see QGLViewer::drawAxis()). */
+void GlyphRenderer::buildAxis() {
+  QVector<GLfloat> lines;
+  CoreProfileRenderer::addAxisCharacters(lines);
+  QVector<GLfloat> data;
+  for (int i = 0; i < lines.size(); i += 3)
+    addVertex(data, lines[i], lines[i + 1], lines[i + 2]);
+  axisLinesVertexCount_ = lines.size() / 3;
+
+  QVector<GLfloat> arrow;
+  CoreProfileRenderer::addAxisArrow(arrow);
+  arrowVertexCount_ = arrow.size() / 6;
+
+  // The QGLViewer::drawAxis() rotations of the Z, X and Y arrows
+  QMatrix4x4 rotations[3];
+  rotations[1].rotate(90.0f, 0.0f, 1.0f, 0.0f);
+  rotations[2].rotate(-90.0f, 1.0f, 0.0f, 0.0f);
+  for (const QMatrix4x4 &rotation : rotations)
+    for (int i = 0; i < arrow.size(); i += 6) {
+      const QVector3D position =
+          rotation.map(QVector3D(arrow[i], arrow[i + 1], arrow[i + 2]));
+      const QVector3D normal = rotation.mapVector(
+          QVector3D(arrow[i + 3], arrow[i + 4], arrow[i + 5]));
+      addVertex(data, position.x(), position.y(), position.z(), normal.x(),
+                normal.y(), normal.z());
+    }
+
+  axisVBO_.bind();
+  axisVBO_.allocate(data.constData(), int(data.size() * sizeof(GLfloat)));
+  axisVBO_.release();
+}
+
+/*! Fills the frustum buffer with the meshes drawn by Camera::draw(). Vertex x
+and y are multiplied by those of the instance corner selected by z: 0 for the
+near corner, 1 for the far one, 2 and 3 for the ends of the frustum lines. */
+void GlyphRenderer::buildFrustum() {
+  QVector<GLfloat> data;
+
+  // Near and far planes, as two triangles each
+  static const float quad[6][2] = {{1.0f, 1.0f},  {-1.0f, 1.0f},
+                                   {-1.0f, -1.0f}, {1.0f, 1.0f},
+                                   {-1.0f, -1.0f}, {1.0f, -1.0f}};
+  for (int plane = 0; plane < 2; ++plane)
+    for (int v = 0; v < 6; ++v)
+      addVertex(data, quad[v][0], quad[v][1], float(plane), 0.0f, 0.0f,
+                (plane == 0) ? 1.0f : -1.0f);
+  nearPlaneFirst_ = 0;
+  farPlaneFirst_ = 6;
+  planeVertexCount_ = 6;
+
+  // Up arrow, on the near plane: base and head
+  arrowFirst_ = data.size() / 6;
+  static const float arrow[9][2] = {
+      {-0.3f, 1.0f}, {0.3f, 1.0f},  {0.3f, 1.2f},   {-0.3f, 1.0f}, {0.3f, 1.2f},
+      {-0.3f, 1.2f}, {0.0f, 1.5f}, {-0.5f, 1.2f}, {0.5f, 1.2f}};
+  for (int v = 0; v < 9; ++v)
+    addVertex(data, arrow[v][0], arrow[v][1], 0.0f, 0.0f, 0.0f, 1.0f);
+  frustumArrowVertexCount_ = 9;
+
+  // Frustum lines, between the line start and end corners
+  linesFirst_ = data.size() / 6;
+  for (int v = 0; v < 4; ++v) {
+    const float x = (v == 0 || v == 3) ? 1.0f : -1.0f;
+    const float y = (v < 2) ? 1.0f : -1.0f;
+    addVertex(data, x, y, 2.0f);
+    addVertex(data, x, y, 3.0f);
+  }
+  linesVertexCount_ = 8;
+
+  frustumVBO_.bind();
+  frustumVBO_.allocate(data.constData(), int(data.size() * sizeof(GLfloat)));
+  frustumVBO_.release();
+}
+
+void GlyphRenderer::setUniforms(const QMatrix4x4 &modelView,
+                                const QMatrix4x4 &projection, bool frustum,
+                                const QColor &color, bool lit) {
+  program_.setUniformValue(modelViewMatrixLocation_, modelView);
+  program_.setUniformValue(projectionMatrixLocation_, projection);
+  program_.setUniformValue(frustumLocation_, GLint(frustum ? 1 : 0));
+  program_.setUniformValue(colorLocation_, color);
+  program_.setUniformValue(litLocation_, GLint(lit ? 1 : 0));
+}
+
+void GlyphRenderer::draw(GLenum mode, int first, int count, int nbInstances) {
+  QOpenGLContext::currentContext()->extraFunctions()->glDrawArraysInstanced(
+      mode, first, count, nbInstances);
+}
+
+/*! Instanced equivalent of QGLViewer::drawAxis() for each of the \p matrices,
+which are expressed in the \p modelView coordinate system. The X, Y and Z
+characters use \p color, the arrows use the light red, green and blue colors
+of QGLViewer::drawAxis(), \p lit with a head light. */
+void GlyphRenderer::drawAxes(const QMatrix4x4 &modelView,
+                             const QMatrix4x4 &projection,
+                             const QVector<QMatrix4x4> &matrices, float length,
+                             const QColor &color, bool lit) {
+  if (matrices.isEmpty())
+    return;
+
+  GLfloat *instance = instanceData(axisInstanceSize * matrices.size());
+  for (const QMatrix4x4 &matrix : matrices) {
+    QMatrix4x4 scaled = matrix;
+    scaled.scale(length);
+    std::copy(scaled.constData(), scaled.constData() + 16, instance);
+    instance += axisInstanceSize;
+  }
+
+  const QColor colors[3] = {QColor::fromRgbF(0.7, 0.7, 1.0),
+                            QColor::fromRgbF(1.0, 0.7, 0.7),
+                            QColor::fromRgbF(0.7, 1.0, 0.7)};
+
+  program_.bind();
+  QOpenGLVertexArrayObject::Binder binder(&axisVAO_);
+  bindInstances(axisInstanceVBO_, axisInstanceSize);
+  setUniforms(modelView, projection, false, color, false);
+  draw(GL_LINES, 0, axisLinesVertexCount_, matrices.size());
+  for (int i = 0; i < 3; ++i) {
+    setUniforms(modelView, projection, false, colors[i], lit);
+    draw(GL_TRIANGLES, axisLinesVertexCount_ + i * arrowVertexCount_,
+         arrowVertexCount_, matrices.size());
+  }
+  program_.release();
+}
+
+/*! Instanced equivalent of Camera::draw() for each of the \p cameras, drawn
+in the \p modelView (world) coordinate system. The planes and the up arrow are
+\p lit, the frustum lines are not. All the glyphs use \p color. */
+void GlyphRenderer::drawCameras(const QMatrix4x4 &modelView,
+                                const QMatrix4x4 &projection,
+                                const QVector<const Camera *> &cameras,
+                                bool drawFarPlane, float scale,
+                                const QColor &color, bool lit) {
+  if (cameras.isEmpty())
+    return;
+
+  GLfloat *instance = instanceData(frustumInstanceSize * cameras.size());
+  for (const Camera *camera : cameras) {
+    const GLdouble *matrix = camera->frame()->worldMatrix();
+    for (int i = 0; i < 16; ++i)
+      instance[i] = GLfloat(matrix[i]);
+
+    Vec corners[4];
+    camera->getFrustumCorners(corners[0], corners[1], scale);
+    // Lines from the eye to the far corners in perspective, between the
+    // near and far corners in orthographic (where they collapse without far
+    // plane)
+    const int farIndex = drawFarPlane ? 1 : 0;
+    if (camera->type() == Camera::PERSPECTIVE) {
+      corners[2] = Vec(0.0, 0.0, 0.0);
+      corners[3] = corners[farIndex];
+    } else {
+      corners[2] = corners[0];
+      corners[3] = corners[farIndex];
+    }
+    for (int c = 0; c < 4; ++c)
+      for (int k = 0; k < 3; ++k)
+        instance[16 + 3 * c + k] = GLfloat(corners[c][k]);
+    instance += frustumInstanceSize;
+  }
+
+  program_.bind();
+  QOpenGLVertexArrayObject::Binder binder(&frustumVAO_);
+  bindInstances(frustumInstanceVBO_, frustumInstanceSize);
+  setUniforms(modelView, projection, true, color, lit);
+  draw(GL_TRIANGLES, nearPlaneFirst_, planeVertexCount_, cameras.size());
+  if (drawFarPlane)
+    draw(GL_TRIANGLES, farPlaneFirst_, planeVertexCount_, cameras.size());
+  draw(GL_TRIANGLES, arrowFirst_, frustumArrowVertexCount_, cameras.size());
+  setUniforms(modelView, projection, true, color, false);
+  draw(GL_LINES, linesFirst_, linesVertexCount_, cameras.size());
+  program_.release();
+}
@@ -0,0 +1,93 @@
+#ifndef QGLVIEWER_GLYPH_RENDERER_H
+#define QGLVIEWER_GLYPH_RENDERER_H
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QVector>
+
+#include "frameRingBuffer.h"
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Draws many axes and camera glyphs with instanced draw calls.
+  \class GlyphRenderer glyphRenderer.h
+
+  This internal class is used by QGLViewer::drawAxes() and
+  QGLViewer::drawCameras(). The arrow and frustum meshes are built once in
+  vertex buffers. The transformation of each glyph is streamed in an instance
+  buffer, and all the glyphs are drawn by a few \c glDrawArraysInstanced
+  calls, whatever their number. The instances are written in the viewer's
+  FrameRingBuffer when one is set (see setFrameRingBuffer()), and in their own
+  stream buffer otherwise.
+
+  The frustum mesh is expressed in units of the near and far corners (see
+  Camera::getFrustumCorners()), which are given per instance, so that cameras
+  with different fields of view and types share the same mesh.
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. All the methods, including the
+  destructor, require the viewer's OpenGL context to be current. */
+class GlyphRenderer {
+public:
+  GlyphRenderer();
+  ~GlyphRenderer();
+
+  bool initialize();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return program_.isLinked(); }
+
+  /*! Makes the instances allocated in \p ring, nullptr to use a stream
+  buffer. */
+  void setFrameRingBuffer(FrameRingBuffer *ring) { ringBuffer_ = ring; }
+
+  void drawAxes(const QMatrix4x4 &modelView, const QMatrix4x4 &projection,
+                const QVector<QMatrix4x4> &matrices, float length,
+                const QColor &color, bool lit);
+  void drawCameras(const QMatrix4x4 &modelView, const QMatrix4x4 &projection,
+                   const QVector<const Camera *> &cameras, bool drawFarPlane,
+                   float scale, const QColor &color, bool lit);
+
+private:
+  void setupVertexArray(QOpenGLVertexArrayObject &vao, QOpenGLBuffer &vbo);
+  GLfloat *instanceData(int nbFloats);
+  void bindInstances(QOpenGLBuffer &instances, int instanceSize);
+  void buildAxis();
+  void buildFrustum();
+  void setUniforms(const QMatrix4x4 &modelView, const QMatrix4x4 &projection,
+                   bool frustum, const QColor &color, bool lit);
+  void draw(GLenum mode, int first, int count, int nbInstances);
+
+  QOpenGLShaderProgram program_;
+  int modelViewMatrixLocation_;
+  int projectionMatrixLocation_;
+  int frustumLocation_;
+  int colorLocation_;
+  int litLocation_;
+
+  // Per vertex position and normal, per instance matrix (and frustum corners)
+  QOpenGLVertexArrayObject axisVAO_;
+  QOpenGLBuffer axisVBO_;
+  QOpenGLBuffer axisInstanceVBO_;
+  int axisLinesVertexCount_; // followed by the three arrows
+  int arrowVertexCount_;
+
+  QOpenGLVertexArrayObject frustumVAO_;
+  QOpenGLBuffer frustumVBO_;
+  QOpenGLBuffer frustumInstanceVBO_;
+  // Ranges of the frustumVBO_ vertices
+  int nearPlaneFirst_, farPlaneFirst_, planeVertexCount_;
+  int arrowFirst_, frustumArrowVertexCount_;
+  int linesFirst_, linesVertexCount_;
+
+  FrameRingBuffer *ringBuffer_;
+  // Instances of the current draw, unless they are in instances_
+  FrameRingBuffer::Allocation instanceAllocation_;
+  QVector<GLfloat> instances_; // reused upload buffer
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_GLYPH_RENDERER_H
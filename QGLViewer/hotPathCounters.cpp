@@ -0,0 +1,25 @@
+#include "hotPathCounters.h"
+
+using namespace qglviewer;
+
+QAtomicInt HotPathCounters::counters_[HotPathCounters::NB_COUNTERS];
+
+/*! Returns a short name of \p counter, used by the QGLViewer display. */
+const char *HotPathCounters::name(Counter counter) {
+  switch (counter) {
+  case FRAME_MODIFIED:
+    return "modified";
+  case MODEL_VIEW_MATRIX:
+    return "modelView";
+  case PROJECTION_MATRIX:
+    return "projection";
+  case MOUSE_GRABBER_TEST:
+    return "grabberTests";
+  case SELECTION:
+    return "selections";
+  case GL_STATE_CHANGE:
+    return "glStates";
+  default:
+    return "";
+  }
+}
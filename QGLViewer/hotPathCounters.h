@@ -0,0 +1,66 @@
+#ifndef QGLVIEWER_HOT_PATH_COUNTERS_H
+#define QGLVIEWER_HOT_PATH_COUNTERS_H
+
+#include <QAtomicInt>
+
+#include "config.h"
+
+namespace qglviewer {
+/*! \brief Counts the calls of the hot paths of the library.
+  \class HotPathCounters hotPathCounters.h QGLViewer/hotPathCounters.h
+
+  A slow viewer is often caused by a storm of Frame::modified() signals,
+  camera matrices computed again and again, or too many MouseGrabber tests.
+  The library counts these events in global counters, read with value().
+
+  The FrameProfiler of each viewer turns them into per frame counts, stored
+  in FrameTiming::counts. A warning signal is emitted when a count is above
+  its FrameProfiler::counterThreshold(), and
+  QGLViewer::setHotPathCountersAreDisplayed() displays the counts of the last
+  frame under the frame rate.
+
+  Each event costs a relaxed atomic increment. Define \c
+  QGLVIEWER_NO_HOT_PATH_COUNTERS when compiling the library (see config.h) to
+  remove them: all the counts are then zero.
+
+  All the methods are static and thread safe. */
+class QGLVIEWER_EXPORT HotPathCounters {
+public:
+  /*! The counted events. */
+  enum Counter {
+    FRAME_MODIFIED,     /*!< Frame::modified() signals emitted. */
+    MODEL_VIEW_MATRIX,  /*!< Camera model view matrix computations. */
+    PROJECTION_MATRIX,  /*!< Camera projection matrix computations. */
+    MOUSE_GRABBER_TEST, /*!< MouseGrabber::checkIfGrabsMouse() calls. */
+    SELECTION,          /*!< QGLViewer::select() calls. */
+    GL_STATE_CHANGE,    /*!< OpenGL state changes issued by the GLStateCache. */
+    NB_COUNTERS
+  };
+
+  /*! Returns the number of \p counter events since the application start,
+  modulo 2^32: use the difference of two values. */
+  static quint32 value(Counter counter) {
+    return quint32(counters_[counter].loadRelaxed());
+  }
+  /*! Counts a \p counter event. Use the QGLVIEWER_COUNT() macro instead, which
+  is removed by \c QGLVIEWER_NO_HOT_PATH_COUNTERS. */
+  static void increment(Counter counter) {
+    counters_[counter].fetchAndAddRelaxed(1);
+  }
+  static const char *name(Counter counter);
+
+private:
+  static QAtomicInt counters_[NB_COUNTERS];
+};
+
+} // namespace qglviewer
+
+/*! Counts a qglviewer::HotPathCounters event, given by its Counter name. */
+#ifdef QGLVIEWER_NO_HOT_PATH_COUNTERS
+#define QGLVIEWER_COUNT(counter)
+#else
+#define QGLVIEWER_COUNT(counter)                                              \
+  qglviewer::HotPathCounters::increment(qglviewer::HotPathCounters::counter)
+#endif
+
+#endif // QGLVIEWER_HOT_PATH_COUNTERS_H
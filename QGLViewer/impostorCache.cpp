@@ -0,0 +1,572 @@
+#include "impostorCache.h"
+#include "camera.h"
+
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+using namespace qglviewer;
+
+// Width and height of the atlas textures, in texels
+static const int pageSize = 2048;
+// Bytes of an atlas texture, or of the shared depth buffer
+static const qint64 pageBytes = qint64(4) * pageSize * pageSize;
+// Size of the smallest impostors, in texels
+static const int minimumImpostorSize = 16;
+
+// The level of the blocks of size in the Page free lists
+static int levelOf(int size) {
+  int level = 0;
+  while ((pageSize >> level) > size)
+    ++level;
+  return level;
+}
+
+// A unit vector orthogonal to direction, as close as possible to up
+static Vec orthogonalUp(const Vec &direction, const Vec &up,
+                        const Vec &fallback) {
+  Vec u = up - (up * direction) * direction;
+  if (u.squaredNorm() < 1e-12)
+    u = fallback - (fallback * direction) * direction;
+  return u.unit();
+}
+
+static qreal angleBetween(const Vec &a, const Vec &b) {
+  return std::acos(qBound(qreal(-1.0), a * b, qreal(1.0)));
+}
+
+/*! Creates an empty ImpostorCache. No OpenGL resource is created before the
+first update(). */
+ImpostorCache::ImpostorCache()
+    : maximumImpostorSize_(128), angleThreshold_(3.0),
+      regenerationBudget_(1.0), memoryBudget_(qint64(64) << 20), frame_(0),
+      nbImpostors_(0), nbRegenerations_(0), context_(nullptr),
+      functions_(nullptr), isSupported_(false), depthBuffer_(0) {}
+
+/*! Destructor. The OpenGL resources are only released when the context used
+by update() is current. Call cleanupGL() before otherwise. */
+ImpostorCache::~ImpostorCache() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Objects                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an object and returns its id. \p center and \p radius define its
+bounding sphere, in world coordinates. \p draw draws the object with the
+current matrices, in the world coordinate system: it is called by draw() when
+no impostor is used, and by update() to render the impostor.
+
+\p draw must restore the matrices it modifies. Ids of removed objects (see
+removeObject()) are reused. */
+int ImpostorCache::addObject(const Vec &center, qreal radius,
+                             const std::function<void()> &draw) {
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = objects_.size();
+    objects_.append(Object());
+  } else
+    id = freeIds_.takeLast();
+
+  Object &object = objects_[id];
+  object.center = center;
+  object.radius = radius;
+  object.draw = draw;
+  object.used = true;
+  object.isImpostor = false;
+  object.page = -1;
+  object.size = 0;
+  object.isValid = false;
+  object.lastUsedFrame = 0;
+  return id;
+}
+
+/*! Moves the bounding sphere of the object \p id. Its impostor is
+regenerated when needed, see update(). */
+void ImpostorCache::setObjectSphere(int id, const Vec &center, qreal radius) {
+  if (!isValidId(id, "setObjectSphere"))
+    return;
+  Object &object = objects_[id];
+  if (radius != object.radius)
+    object.isValid = false;
+  object.center = center;
+  object.radius = radius;
+}
+
+/*! Regenerates the impostor of the object \p id at the next update(), for
+instance when its shape or its orientation changed. The outdated impostor is
+drawn until then. */
+void ImpostorCache::invalidate(int id) {
+  if (isValidId(id, "invalidate"))
+    objects_[id].isValid = false;
+}
+
+/*! invalidate()s all the impostors, for instance when the lights changed. */
+void ImpostorCache::invalidateAll() {
+  for (Object &object : objects_)
+    object.isValid = false;
+}
+
+/*! Unregisters the object \p id and frees its impostor. */
+void ImpostorCache::removeObject(int id) {
+  if (!isValidId(id, "removeObject"))
+    return;
+  Object &object = objects_[id];
+  release(object);
+  object.used = false;
+  object.draw = std::function<void()>();
+  freeIds_.append(id);
+}
+
+/*! Unregisters all the objects. The atlas textures are kept. */
+void ImpostorCache::clear() {
+  for (Object &object : objects_)
+    release(object);
+  objects_.clear();
+  freeIds_.clear();
+  nbImpostors_ = 0;
+}
+
+bool ImpostorCache::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= objects_.size()) || !objects_[id].used) {
+    qWarning("ImpostorCache::%s: Invalid object id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Impostors                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the maximumImpostorSize(), rounded up to a power of two between 16
+and 2048. The impostors are regenerated. */
+void ImpostorCache::setMaximumImpostorSize(int size) {
+  int s = minimumImpostorSize;
+  while ((s < size) && (s < pageSize))
+    s *= 2;
+  maximumImpostorSize_ = s;
+  invalidateAll();
+}
+
+// Finds a free block of size, in an existing page, a new page or in the
+// blocks of evicted impostors
+bool ImpostorCache::allocate(int size, int &page, QPoint &origin) {
+  for (;;) {
+    for (int p = 0; p < pages_.size(); ++p)
+      if (allocateInPage(size, pages_[p], origin)) {
+        page = p;
+        return true;
+      }
+    if (pages_.isEmpty() || (memoryUsage() + pageBytes <= memoryBudget_)) {
+      if (!addPage())
+        return false;
+    } else if (!evictLeastRecentlyUsed())
+      return false;
+  }
+}
+
+// Splits the smallest free block that contains a block of size
+bool ImpostorCache::allocateInPage(int size, Page &page, QPoint &origin) {
+  const int level = levelOf(size);
+  int l = level;
+  while ((l >= 0) && page.freeBlocks[l].isEmpty())
+    --l;
+  if (l < 0)
+    return false;
+
+  origin = page.freeBlocks[l].takeLast();
+  for (; l < level; ++l) {
+    const int half = pageSize >> (l + 1);
+    page.freeBlocks[l + 1].append(origin + QPoint(half, 0));
+    page.freeBlocks[l + 1].append(origin + QPoint(0, half));
+    page.freeBlocks[l + 1].append(origin + QPoint(half, half));
+  }
+  return true;
+}
+
+// Frees a block, merged with its three siblings when they are free
+void ImpostorCache::freeBlock(int size, Page &page, QPoint origin) {
+  for (int level = levelOf(size); level > 0; --level, size *= 2) {
+    QVector<QPoint> &blocks = page.freeBlocks[level];
+    const QPoint parent(origin.x() & ~(2 * size - 1),
+                        origin.y() & ~(2 * size - 1));
+    int siblings[3];
+    int nbSiblings = 0;
+    for (int i = 0; i < 4; ++i) {
+      const QPoint sibling = parent + QPoint((i & 1) * size, (i >> 1) * size);
+      if (sibling == origin)
+        continue;
+      const int index = blocks.indexOf(sibling);
+      if (index < 0)
+        break;
+      siblings[nbSiblings++] = index;
+    }
+    if (nbSiblings < 3) {
+      blocks.append(origin);
+      return;
+    }
+    std::sort(siblings, siblings + 3);
+    for (int i = 2; i >= 0; --i)
+      blocks.remove(siblings[i]);
+    origin = parent;
+  }
+  page.freeBlocks[0].append(origin);
+}
+
+void ImpostorCache::release(Object &object) {
+  if (object.page < 0)
+    return;
+  if (object.page < pages_.size())
+    freeBlock(object.size, pages_[object.page], object.origin);
+  object.page = -1;
+  object.isImpostor = false;
+}
+
+// Frees the impostor of the object that was drawn the longest time ago, and
+// not by the current frame
+bool ImpostorCache::evictLeastRecentlyUsed() {
+  Object *oldest = nullptr;
+  for (Object &object : objects_)
+    if (object.used && (object.page >= 0) &&
+        (object.lastUsedFrame != frame_) &&
+        (!oldest || (object.lastUsedFrame < oldest->lastUsedFrame)))
+      oldest = &object;
+  if (!oldest)
+    return false;
+  release(*oldest);
+  return true;
+}
+
+/*! Returns the size, in bytes, of the atlas textures and of their depth
+buffer. */
+qint64 ImpostorCache::memoryUsage() const {
+  return pages_.isEmpty() ? 0 : (pages_.size() + 1) * pageBytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Rendering                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+bool ImpostorCache::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("ImpostorCache::update: No current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return isSupported_;
+  if (context_) {
+    qWarning("ImpostorCache::update: OpenGL context changed, impostors are "
+             "lost");
+    pages_.clear();
+    depthBuffer_ = 0;
+    for (Object &object : objects_)
+      object.page = -1;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  isSupported_ = !context->isOpenGLES() &&
+                 (format.profile() != QSurfaceFormat::CoreProfile) &&
+                 ((version >= 30) ||
+                  context->hasExtension("GL_ARB_framebuffer_object"));
+  if (!isSupported_)
+    qWarning("ImpostorCache::update: Requires a compatibility profile with "
+             "framebuffer objects");
+  return isSupported_;
+}
+
+// Creates an atlas texture, and the depth buffer used to render in it
+bool ImpostorCache::addPage() {
+  if (!depthBuffer_) {
+    functions_->glGenRenderbuffers(1, &depthBuffer_);
+    functions_->glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer_);
+    functions_->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                                      pageSize, pageSize);
+    functions_->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  }
+
+  Page page;
+  functions_->glGenTextures(1, &page.texture);
+  functions_->glBindTexture(GL_TEXTURE_2D, page.texture);
+  functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, pageSize, pageSize, 0,
+                           GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glBindTexture(GL_TEXTURE_2D, 0);
+
+  GLint previousFramebuffer = 0;
+  functions_->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  functions_->glGenFramebuffers(1, &page.framebuffer);
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, page.framebuffer);
+  functions_->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                     GL_TEXTURE_2D, page.texture, 0);
+  functions_->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                        GL_RENDERBUFFER, depthBuffer_);
+  const GLenum status = functions_->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    qWarning("ImpostorCache::update: incomplete framebuffer object (0x%x)",
+             status);
+    functions_->glDeleteFramebuffers(1, &page.framebuffer);
+    functions_->glDeleteTextures(1, &page.texture);
+    return false;
+  }
+
+  page.freeBlocks.resize(levelOf(minimumImpostorSize) + 1);
+  page.freeBlocks[0].append(QPoint(0, 0));
+  pages_.append(page);
+  return true;
+}
+
+// Draws object in its block, seen along direction. The caller saves the state.
+void ImpostorCache::render(Object &object, const Vec &direction,
+                           const Vec &up) {
+  const Page &page = pages_[object.page];
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, page.framebuffer);
+  glViewport(object.origin.x(), object.origin.y(), object.size, object.size);
+  glScissor(object.origin.x(), object.origin.y(), object.size, object.size);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  // Orthographic view of the bounding sphere, from a point located at twice
+  // its radius
+  const qreal r = object.radius;
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(-r, r, -r, r, r, 3.0 * r);
+
+  const Vec right = (direction ^ up).unit();
+  const Vec eye = object.center - 2.0 * r * direction;
+  const GLdouble m[16] = {right.x, up.x, -direction.x, 0.0,
+                          right.y, up.y, -direction.y, 0.0,
+                          right.z, up.z, -direction.z, 0.0,
+                          -(right * eye), -(up * eye), direction * eye, 1.0};
+  glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixd(m);
+
+  object.draw();
+  object.direction = direction;
+  object.up = up;
+}
+
+/*! Selects the objects drawn with an impostor by the \p camera, and renders
+the missing or outdated impostors, within the regenerationBudget().
+
+Call this method in your viewer's draw(), before draw(). The current
+framebuffer, viewport, matrices and OpenGL attributes are restored. */
+void ImpostorCache::update(const Camera *camera) {
+  ++frame_;
+  nbImpostors_ = 0;
+  nbRegenerations_ = 0;
+  for (Object &object : objects_)
+    object.isImpostor = false;
+  if (!camera || !initializeGL())
+    return;
+
+  cameraPosition_ = camera->position();
+  cameraUp_ = camera->upVector();
+  cameraRight_ = camera->rightVector();
+  const qreal threshold = angleThreshold_ * M_PI / 180.0;
+
+  // 1 - objects seen small enough, and their impostors to render
+  struct Regeneration {
+    int id;
+    qreal priority;
+    int size;
+    Vec direction, up;
+    bool operator<(const Regeneration &other) const {
+      return priority > other.priority; // Most urgent first
+    }
+  };
+  QVector<Regeneration> regenerations;
+
+  for (int id = 0; id < objects_.size(); ++id) {
+    Object &object = objects_[id];
+    if (!object.used || (object.radius <= 0.0))
+      continue;
+    const Vec toObject = object.center - cameraPosition_;
+    const qreal distance = toObject.norm();
+    if (distance <= object.radius)
+      continue;
+    const qreal ratio = camera->pixelGLRatio(object.center);
+    const qreal diameter =
+        (ratio > 0.0) ? 2.0 * object.radius / ratio : maximumImpostorSize_;
+    if (diameter > maximumImpostorSize_)
+      continue;
+
+    Regeneration r;
+    r.id = id;
+    r.size = minimumImpostorSize;
+    while (r.size < diameter)
+      r.size *= 2;
+    r.direction = toObject / distance;
+    r.up = orthogonalUp(r.direction, cameraUp_, cameraRight_);
+
+    if (object.page >= 0) {
+      // An outdated impostor is drawn until it is regenerated
+      object.isImpostor = true;
+      object.lastUsedFrame = frame_;
+      r.priority = qMax(angleBetween(r.direction, object.direction),
+                        angleBetween(r.up, object.up));
+      if (!object.isValid || (r.size != object.size))
+        r.priority = qMax(r.priority, threshold) + M_PI;
+      else if (r.priority <= threshold)
+        continue;
+    } else
+      // Drawn with its geometry until then
+      r.priority = 4.0 * M_PI;
+    regenerations.append(r);
+  }
+
+  // 2 - renders them, most urgent first, within the budget
+  if (!regenerations.isEmpty()) {
+    std::sort(regenerations.begin(), regenerations.end());
+
+    GLint previousFramebuffer = 0;
+    functions_->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glPushAttrib(GL_VIEWPORT_BIT | GL_SCISSOR_BIT | GL_COLOR_BUFFER_BIT |
+                 GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearDepth(1.0);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (const Regeneration &r : regenerations) {
+      if ((nbRegenerations_ > 0) &&
+          (timer.nsecsElapsed() > regenerationBudget_ * 1e6))
+        break;
+      Object &object = objects_[r.id];
+      if ((object.page >= 0) && (object.size != r.size))
+        release(object);
+      if ((object.page < 0) && !allocate(r.size, object.page, object.origin))
+        continue;
+      object.size = r.size;
+      render(object, r.direction, r.up);
+      object.isValid = true;
+      object.isImpostor = true;
+      object.lastUsedFrame = frame_;
+      ++nbRegenerations_;
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glPopAttrib();
+    functions_->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+  }
+
+  for (const Object &object : objects_)
+    if (object.isImpostor)
+      ++nbImpostors_;
+}
+
+/*! Draws the objects selected by the last update(): the impostors on camera
+facing quads, and the other objects with their function. The camera matrices
+must be loaded. */
+void ImpostorCache::draw() const {
+  for (const Object &object : objects_)
+    if (object.used && !object.isImpostor)
+      object.draw();
+  if (nbImpostors_ == 0)
+    return;
+
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT |
+               GL_TEXTURE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_BLEND);
+  glEnable(GL_TEXTURE_2D);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.5f);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+  for (int p = 0; p < pages_.size(); ++p) {
+    glBindTexture(GL_TEXTURE_2D, pages_[p].texture);
+    glBegin(GL_QUADS);
+    for (const Object &object : objects_) {
+      if (!object.isImpostor || (object.page != p))
+        continue;
+      const Vec direction = (object.center - cameraPosition_).unit();
+      const Vec up = orthogonalUp(direction, cameraUp_, cameraRight_);
+      const Vec right = object.radius * (direction ^ up).unit();
+      const Vec u = object.radius * up;
+      // Half a texel inside the block, which edges are not cleared by the
+      // neighbor impostors
+      const GLfloat s0 = (object.origin.x() + 0.5f) / pageSize;
+      const GLfloat t0 = (object.origin.y() + 0.5f) / pageSize;
+      const GLfloat s1 = (object.origin.x() + object.size - 0.5f) / pageSize;
+      const GLfloat t1 = (object.origin.y() + object.size - 0.5f) / pageSize;
+      glTexCoord2f(s0, t0);
+      glVertex3fv(object.center - right - u);
+      glTexCoord2f(s1, t0);
+      glVertex3fv(object.center + right - u);
+      glTexCoord2f(s1, t1);
+      glVertex3fv(object.center + right + u);
+      glTexCoord2f(s0, t1);
+      glVertex3fv(object.center - right + u);
+    }
+    glEnd();
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glPopAttrib();
+}
+
+/*! Returns \c true when the object \p id is drawn with its impostor by draw(),
+as decided by the last update(). */
+bool ImpostorCache::isImpostor(int id) const {
+  return (id >= 0) && (id < objects_.size()) && objects_[id].used &&
+         objects_[id].isImpostor;
+}
+
+/*! Deletes the atlas textures. The context used by update() must be current.
+The impostors are rendered again by the next update()s. */
+void ImpostorCache::cleanupGL() {
+  if (functions_) {
+    for (const Page &page : pages_) {
+      functions_->glDeleteFramebuffers(1, &page.framebuffer);
+      functions_->glDeleteTextures(1, &page.texture);
+    }
+    if (depthBuffer_)
+      functions_->glDeleteRenderbuffers(1, &depthBuffer_);
+  }
+  pages_.clear();
+  depthBuffer_ = 0;
+  for (Object &object : objects_) {
+    object.page = -1;
+    object.isImpostor = false;
+  }
+  nbImpostors_ = 0;
+  functions_ = nullptr;
+  context_ = nullptr;
+  isSupported_ = false;
+}
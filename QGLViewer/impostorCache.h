@@ -0,0 +1,189 @@
+#ifndef QGLVIEWER_IMPOSTOR_CACHE_H
+#define QGLVIEWER_IMPOSTOR_CACHE_H
+
+#include "vec.h"
+
+#include <QPoint>
+#include <QVector>
+
+#include <functional>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Replaces distant objects by cached billboard images of themselves.
+  \class ImpostorCache impostorCache.h QGLViewer/impostorCache.h
+
+  A detailed object that covers a few dozen pixels on screen costs as much
+  geometry as when it fills the window. An ImpostorCache renders such objects
+  once in a small texture, seen from the current camera position, and then
+  draws this texture on a camera facing quad (an impostor) instead of the
+  object, as long as the view does not change too much:
+  \code
+  // In your viewer's init()
+  for (int i = 0; i < nbTrees; ++i)
+    impostors_.addObject(tree[i].center, tree[i].radius,
+                         [this, i]() { drawTree(i); });
+
+  void Viewer::draw() {
+    impostors_.update(camera());
+    impostors_.draw();
+  }
+  \endcode
+
+  Each object is given by its bounding sphere, in world coordinates, and a
+  function that draws it with the current matrices. update() uses an impostor
+  for the objects which projected diameter is smaller than
+  maximumImpostorSize() pixels. An impostor is regenerated when the direction
+  from the camera to the object rotates by more than angleThreshold(), when the
+  camera rolls by more than this angle, or when the distance to the object
+  changes the resolution of the impostor. Objects that are closer, as well as
+  those which impostor is not generated yet, are drawn by draw() with their
+  function.
+
+  Regenerations are amortized over successive frames: each update() renders
+  the missing impostors first, then the most outdated ones, until
+  regenerationBudget() milliseconds are spent. Outdated impostors are still
+  drawn until they are regenerated.
+
+  The impostors are packed in 2048x2048 atlas textures, with power of two
+  sizes from 16 to maximumImpostorSize() pixels. When the atlases reach the
+  memoryBudget(), the least recently drawn impostors are evicted.
+
+  The objects are drawn in an orthographic projection of their bounding
+  sphere, and draw() renders the impostors with an alpha test, without
+  lighting. A compatibility profile with framebuffer objects (OpenGL 3.0 or
+  \c GL_ARB_framebuffer_object) is required: otherwise no impostor is used.
+  All the OpenGL methods must be called with the same context current. Call
+  cleanupGL() with this context current before the ImpostorCache is
+  destroyed. */
+class QGLVIEWER_EXPORT ImpostorCache {
+public:
+  ImpostorCache();
+  ~ImpostorCache();
+
+  /*! @name Objects */
+  //@{
+public:
+  int addObject(const Vec &center, qreal radius,
+                const std::function<void()> &draw);
+  void setObjectSphere(int id, const Vec &center, qreal radius);
+  void invalidate(int id);
+  void invalidateAll();
+  void removeObject(int id);
+  void clear();
+
+  /*! Returns the number of registered objects. */
+  int nbObjects() const { return objects_.size() - freeIds_.size(); }
+  //@}
+
+  /*! @name Impostors */
+  //@{
+public:
+  /*! Returns the largest projected diameter, in pixels, of an object drawn
+  with an impostor. Default value is 128. */
+  int maximumImpostorSize() const { return maximumImpostorSize_; }
+  void setMaximumImpostorSize(int size);
+  /*! Returns the rotation of the view, in degrees, that makes an impostor
+  outdated. Default value is 3.0. */
+  qreal angleThreshold() const { return angleThreshold_; }
+  /*! Sets the angleThreshold(). */
+  void setAngleThreshold(qreal angle) {
+    angleThreshold_ = qMax(angle, qreal(0.0));
+  }
+  /*! Returns the time, in milliseconds, spent by update() in regenerations.
+  Default value is 1.0. At least one impostor is rendered per update(). */
+  qreal regenerationBudget() const { return regenerationBudget_; }
+  /*! Sets the regenerationBudget(). */
+  void setRegenerationBudget(qreal budget) {
+    regenerationBudget_ = qMax(budget, qreal(0.0));
+  }
+  /*! Returns the maximum size, in bytes, of the atlas textures. Default
+  value is 64 MiB. At least one atlas is allocated. */
+  qint64 memoryBudget() const { return memoryBudget_; }
+  /*! Sets the memoryBudget(). Takes effect at the next update(). */
+  void setMemoryBudget(qint64 budget) {
+    memoryBudget_ = qMax(budget, qint64(0));
+  }
+  //@}
+
+  /*! @name Rendering */
+  //@{
+public:
+  void update(const Camera *camera);
+  void draw() const;
+  void cleanupGL();
+
+  bool isImpostor(int id) const;
+  /*! Returns the number of objects drawn with an impostor after the last
+  update(). */
+  int nbImpostors() const { return nbImpostors_; }
+  /*! Returns the number of impostors rendered by the last update(). */
+  int nbRegenerations() const { return nbRegenerations_; }
+  /*! Returns the size, in bytes, of the allocated atlas textures. */
+  qint64 memoryUsage() const;
+  //@}
+
+private:
+  Q_DISABLE_COPY(ImpostorCache)
+
+  struct Object {
+    Vec center;
+    qreal radius;
+    std::function<void()> draw;
+    bool used;
+    bool isImpostor; // drawn as an impostor by draw()
+    // Location of the impostor in its atlas, page is -1 without impostor
+    int page;
+    QPoint origin;
+    int size;
+    bool isValid; // false after invalidate()
+    // View of the impostor, in world coordinates
+    Vec direction, up;
+    unsigned int lastUsedFrame;
+  };
+
+  // An atlas texture, allocated by blocks of power of two sizes
+  struct Page {
+    GLuint texture, framebuffer;
+    // Free blocks, per size: index 0 is the whole page
+    QVector<QVector<QPoint> > freeBlocks;
+  };
+
+  bool isValidId(int id, const char *method) const;
+  bool initializeGL();
+  bool allocate(int size, int &page, QPoint &origin);
+  static bool allocateInPage(int size, Page &page, QPoint &origin);
+  static void freeBlock(int size, Page &page, QPoint origin);
+  void release(Object &object);
+  bool evictLeastRecentlyUsed();
+  bool addPage();
+  void render(Object &object, const Vec &direction, const Vec &up);
+
+  QVector<Object> objects_;
+  QVector<int> freeIds_;
+  int maximumImpostorSize_;
+  qreal angleThreshold_;
+  qreal regenerationBudget_;
+  qint64 memoryBudget_;
+
+  unsigned int frame_;
+  int nbImpostors_;
+  int nbRegenerations_;
+  // Camera basis of the last update(), used by draw()
+  Vec cameraPosition_, cameraUp_, cameraRight_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  bool isSupported_;
+  QVector<Page> pages_;
+  GLuint depthBuffer_; // shared by the pages
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_IMPOSTOR_CACHE_H
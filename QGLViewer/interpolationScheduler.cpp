@@ -0,0 +1,141 @@
+#include "interpolationScheduler.h"
+#include "keyFrameInterpolator.h"
+#include "taskScheduler.h"
+
+
+using namespace qglviewer;
+
+/*! Creates an empty InterpolationScheduler, with a default period() of 40
+milliseconds. */
+InterpolationScheduler::InterpolationScheduler(QObject *parent)
+    : QObject(parent), period_(40), parallelEvaluation_(false) {
+  connect(&timer_, SIGNAL(timeout()), SLOT(update()));
+}
+
+/*! Virtual destructor. The KeyFrameInterpolators are removed (see
+removeInterpolator()), but not deleted. */
+InterpolationScheduler::~InterpolationScheduler() {
+  while (!interpolators_.isEmpty())
+    removeInterpolator(interpolators_.last());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                         Scheduled interpolators                            //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p interpolator to the scheduler, which will drive its interpolation
+from now on. A started \p interpolator continues its interpolation.
+
+A KeyFrameInterpolator belongs to at most one scheduler: it is first removed
+from its previous one. \c nullptr pointers are silently ignored. */
+void InterpolationScheduler::addInterpolator(
+    KeyFrameInterpolator *interpolator) {
+  if (!interpolator || (interpolator->scheduler_ == this))
+    return;
+
+  if (interpolator->scheduler_)
+    interpolator->scheduler_->removeInterpolator(interpolator);
+
+  interpolators_.append(interpolator);
+  interpolator->scheduler_ = this;
+
+  if (interpolator->interpolationIsStarted()) {
+    interpolator->stopUpdates();
+    start();
+  }
+}
+
+/*! Removes \p interpolator from the scheduler. A started \p interpolator
+continues its interpolation with its own timer, or its
+KeyFrameInterpolator::animationClock(). */
+void InterpolationScheduler::removeInterpolator(
+    KeyFrameInterpolator *interpolator) {
+  if (!interpolator || (interpolator->scheduler_ != this))
+    return;
+
+  interpolators_.removeOne(interpolator);
+  interpolator->scheduler_ = nullptr;
+
+  if (interpolator->interpolationIsStarted())
+    interpolator->startUpdates();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Update parameters                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the period(). Negative values are ignored. */
+void InterpolationScheduler::setPeriod(int period) {
+  if (period < 0)
+    return;
+
+  period_ = period;
+  if (timer_.isActive())
+    timer_.start(period_);
+}
+
+/*! Sets the parallelEvaluation() value. */
+void InterpolationScheduler::setParallelEvaluation(bool parallel) {
+  parallelEvaluation_ = parallel;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Update                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+// Called by KeyFrameInterpolator::startInterpolation()
+void InterpolationScheduler::start() {
+  if (!timer_.isActive())
+    timer_.start(period_);
+}
+
+void InterpolationScheduler::evaluate(int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    KeyFrameInterpolator *const kfi = started_[i];
+    State &state = states_[i];
+    state.isValid = kfi->computeAtTime(kfi->interpolationTime(),
+                                       state.position, state.orientation);
+  }
+}
+
+void InterpolationScheduler::update() {
+  started_.clear();
+  Q_FOREACH (KeyFrameInterpolator *kfi, interpolators_)
+    if (kfi->interpolationIsStarted())
+      started_.append(kfi);
+
+  if (started_.isEmpty()) {
+    timer_.stop();
+    return;
+  }
+
+  // 1 - Evaluation. Interpolators are independent, and their Frames are not
+  // modified.
+  const int nb = started_.size();
+  states_.resize(nb);
+
+  // Minimum number of interpolators evaluated by a thread
+  const int minChunkSize = 64;
+  if (parallelEvaluation_) {
+    // Reading the keyFrame Frames writes their cached world transform, which
+    // the other threads may share
+    for (int i = 0; i < nb; ++i)
+      started_[i]->updateFrameValues();
+    TaskScheduler::parallelFor(
+        nb, [this](int begin, int end) { evaluate(begin, end); },
+        minChunkSize);
+  } else
+    evaluate(0, nb);
+
+  // 2 - The Frames are modified in this thread, since they emit signals.
+  for (int i = 0; i < nb; ++i)
+    if (states_[i].isValid)
+      started_[i]->frame()->setPositionAndOrientationWithConstraint(
+          states_[i].position, states_[i].orientation);
+
+  // 3 - Next interpolation times. May stop some interpolators.
+  for (int i = 0; i < nb; ++i)
+    started_[i]->advanceInterpolationTime(period());
+
+  Q_EMIT interpolated();
+}
@@ -0,0 +1,119 @@
+#ifndef QGLVIEWER_INTERPOLATION_SCHEDULER_H
+#define QGLVIEWER_INTERPOLATION_SCHEDULER_H
+
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include "quaternion.h"
+
+
+namespace qglviewer {
+class KeyFrameInterpolator;
+
+/*! \brief Plays many KeyFrameInterpolator with a single timer.
+  \class InterpolationScheduler interpolationScheduler.h
+  QGLViewer/interpolationScheduler.h
+
+  Each KeyFrameInterpolator normally owns a timer, and emits its own
+  KeyFrameInterpolator::interpolated() signal at each update. With thousands of
+  animated objects, this means thousands of timer events and signal emissions
+  per period.
+
+  The KeyFrameInterpolators added to an InterpolationScheduler (see
+  addInterpolator()) no longer use their own timer. Once they are started
+  (KeyFrameInterpolator::startInterpolation()), they are all updated by the
+  scheduler timer, every period() milliseconds, and a single interpolated()
+  signal is emitted per update:
+  \code
+  // In your viewer's init()
+  scheduler = new InterpolationScheduler(this);
+  connect(scheduler, SIGNAL(interpolated()), SLOT(update()));
+  for (int i = 0; i < nbObjects; ++i) {
+    scheduler->addInterpolator(object[i].kfi);
+    object[i].kfi->startInterpolation();
+  }
+  \endcode
+
+  At each update, the interpolated states of all the started
+  KeyFrameInterpolators are first computed, in parallel when
+  parallelEvaluation() is \c true, since they are independent. They are then
+  applied to their KeyFrameInterpolator::frame(), in the scheduler thread.
+
+  The KeyFrameInterpolator::interpolationPeriod() is replaced by the
+  scheduler period(). The KeyFrameInterpolator::interpolated() signal is
+  only emitted when the first or last keyFrame is reached. The
+  KeyFrameInterpolator::interpolateAtTime() method is not used at each
+  update, and overloading it has no effect on scheduled interpolations.
+
+  With parallelEvaluation(), the keyFrames defined by a pointer to a Frame (see
+  KeyFrameInterpolator::addKeyFrame()) are read by the scheduler thread before
+  the parallel evaluation, since reading a Frame position() fills its world
+  transform cache (see Frame). The threads only use the values read then. */
+class QGLVIEWER_EXPORT InterpolationScheduler : public QObject {
+  Q_OBJECT
+
+public:
+  InterpolationScheduler(QObject *parent = nullptr);
+  virtual ~InterpolationScheduler();
+
+Q_SIGNALS:
+  /*! This signal is emitted once per update, after all the started
+  KeyFrameInterpolators have been updated. Connect it to your
+  QGLViewer::update() slot. */
+  void interpolated();
+
+  /*! @name Scheduled interpolators */
+  //@{
+public:
+  void addInterpolator(KeyFrameInterpolator *interpolator);
+  void removeInterpolator(KeyFrameInterpolator *interpolator);
+  /*! Returns the number of KeyFrameInterpolators of the scheduler. */
+  int numberOfInterpolators() const { return interpolators_.size(); }
+  //@}
+
+  /*! @name Update parameters */
+  //@{
+public:
+  /*! Returns the update period, expressed in milliseconds. Default value is
+  40 milliseconds. */
+  int period() const { return period_; }
+  /*! Returns \c true when the KeyFrameInterpolators are evaluated in
+  parallel, over the TaskScheduler threads. Default value is \c false.
+
+  Only large numbers of KeyFrameInterpolators are split between threads. */
+  bool parallelEvaluation() const { return parallelEvaluation_; }
+
+public Q_SLOTS:
+  void setPeriod(int period);
+  void setParallelEvaluation(bool parallel = true);
+  //@}
+
+private Q_SLOTS:
+  void update();
+
+private:
+  friend class KeyFrameInterpolator;
+
+  void start();
+  void evaluate(int begin, int end);
+
+  struct State {
+    Vec position;
+    Quaternion orientation;
+    bool isValid;
+  };
+
+  QList<KeyFrameInterpolator *> interpolators_;
+  QVector<KeyFrameInterpolator *> started_;
+  QVector<State> states_;
+
+  QTimer timer_;
+  int period_;
+  bool parallelEvaluation_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_INTERPOLATION_SCHEDULER_H
@@ -1,5 +1,19 @@
 #include "domUtils.h"
+#include "glStateCache.h"
+#include "interpolationScheduler.h"
+#include "lineRenderer.h"
+#include "modificationBatch.h"
 #include "qglviewer.h" // for QGLViewer::drawAxis and Camera::drawCamera
+#include "traceRecorder.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
 
 using namespace qglviewer;
 using namespace std;
@@ -14,20 +28,37 @@ KeyFrameInterpolator::KeyFrameInterpolator(Frame *frame)
     : frame_(nullptr), period_(40), interpolationTime_(0.0),
       interpolationSpeed_(1.0), interpolationStarted_(false),
       closedPath_(false), loopInterpolation_(false), pathIsValid_(false),
-      valuesAreValid_(true), currentFrameValid_(false)
+      valuesAreValid_(true), firstModifiedKeyFrame_(-1),
+      lastModifiedKeyFrame_(-1), frameKeyFramesAreValid_(false),
+      currentFrameValid_(false),
+      bakedInterpolation_(false), bakedSamplesPerSegment_(30),
+      bakedSamplesAreValid_(false), constantSpeedInterpolation_(false),
+      arcLengthsAreValid_(false), slerpPrecision_(Quaternion::EXACT_SLERP),
+      scheduler_(nullptr),
+      pathBufferIsValid_(false), pathBufferNbFrames_(0), pathBufferScale_(0.0),
+      pathStripSize_(0), cameraLinesSize_(0), cameraTrianglesSize_(0),
+      pathVBO_(nullptr), mappedFile_(nullptr), mappedKeyFrames_(nullptr),
+      nbMappedKeyFrames_(0), pathLines_(nullptr), pathLinesAreValid_(false),
+      pathLinesMask_(0)
 // #CONNECTION# Values cut pasted initFromDOMElement()
 {
   setFrame(frame);
   for (int i = 0; i < 4; ++i)
-    currentFrame_[i] = new QMutableListIterator<KeyFrame *>(keyFrame_);
+    currentFrame_[i] = 0;
+  recordingPositionTolerance_ = 0.0;
+  recordingAngularTolerance_ = 0.0;
   connect(&timer_, SIGNAL(timeout()), SLOT(update()));
 }
 
-/*! Virtual destructor. Clears the keyFrame path. */
+/*! Virtual destructor. Clears the keyFrame path and removes the
+KeyFrameInterpolator from its scheduler(). */
 KeyFrameInterpolator::~KeyFrameInterpolator() {
+  ModificationBatch::forget(this);
+  if (scheduler_)
+    scheduler_->removeInterpolator(this);
   deletePath();
-  for (int i = 0; i < 4; ++i)
-    delete currentFrame_[i];
+  delete pathVBO_;
+  delete pathLines_;
 }
 
 /*! Sets the frame() associated to the KeyFrameInterpolator. */
@@ -49,40 +80,76 @@ void KeyFrameInterpolator::setFrame(Frame *const frame) {
   This internal method is called by a timer when interpolationIsStarted(). It
   can be used for debugging purpose. stopInterpolation() is called when
   interpolationTime() reaches firstTime() or lastTime(), unless
-  loopInterpolation() is \c true. */
+  loopInterpolation() is \c true.
+
+  The InterpolationScheduler::period() replaces interpolationPeriod() when the
+  KeyFrameInterpolator has a scheduler(). */
 void KeyFrameInterpolator::update() {
+  QGLVIEWER_TRACE_SCOPE("interpolation", "update");
   interpolateAtTime(interpolationTime());
+  advanceInterpolationTime(scheduler_ ? scheduler_->period()
+                                      : interpolationPeriod());
+}
 
-  interpolationTime_ += interpolationSpeed() * interpolationPeriod() / 1000.0;
+// Adds period*interpolationSpeed() to interpolationTime() and handles the
+// path ends. Also used by InterpolationScheduler::update().
+void KeyFrameInterpolator::advanceInterpolationTime(int period) {
+  if (numberOfKeyFrames() == 0)
+    return;
+
+  interpolationTime_ += interpolationSpeed() * period / 1000.0;
 
-  if (interpolationTime() > keyFrame_.last()->time()) {
+  if (interpolationTime() > lastTime()) {
     if (loopInterpolation())
-      setInterpolationTime(keyFrame_.first()->time() + interpolationTime_ -
-                           keyFrame_.last()->time());
+      setInterpolationTime(firstTime() + interpolationTime_ - lastTime());
     else {
       // Make sure last KeyFrame is reached and displayed
-      interpolateAtTime(keyFrame_.last()->time());
+      interpolateAtTime(lastTime());
       stopInterpolation();
     }
     Q_EMIT endReached();
-  } else if (interpolationTime() < keyFrame_.first()->time()) {
+  } else if (interpolationTime() < firstTime()) {
     if (loopInterpolation())
-      setInterpolationTime(keyFrame_.last()->time() -
-                           keyFrame_.first()->time() + interpolationTime_);
+      setInterpolationTime(lastTime() - firstTime() + interpolationTime_);
     else {
       // Make sure first KeyFrame is reached and displayed
-      interpolateAtTime(keyFrame_.first()->time());
+      interpolateAtTime(firstTime());
       stopInterpolation();
     }
     Q_EMIT endReached();
   }
 }
 
+/*! Sets the bakedInterpolation() value. */
+void KeyFrameInterpolator::setBakedInterpolation(bool baked) {
+  bakedInterpolation_ = baked;
+  pathIsValid_ = false;
+}
+
+/*! Sets the slerpPrecision() value. The baked samples and the drawn path are
+recomputed the next time they are used. */
+void KeyFrameInterpolator::setSlerpPrecision(
+    Quaternion::SlerpPrecision precision) {
+  slerpPrecision_ = precision;
+  bakedSamplesAreValid_ = false;
+  pathIsValid_ = false;
+}
+
+/*! Sets the bakedSamplesPerSegment() value. \p samples is clamped to 1. The
+samples are recomputed the next time the path is used. */
+void KeyFrameInterpolator::setBakedSamplesPerSegment(int samples) {
+  bakedSamplesPerSegment_ = qMax(1, samples);
+  bakedSamplesAreValid_ = false;
+  pathIsValid_ = false;
+}
+
 /*! Starts the interpolation process.
 
   A timer is started with an interpolationPeriod() period that updates the
   frame()'s position and orientation. interpolationIsStarted() will return \c
-  true until stopInterpolation() or toggleInterpolation() is called.
+  true until stopInterpolation() or toggleInterpolation() is called. When the
+  KeyFrameInterpolator has a scheduler() or an animationClock(), its timer is
+  used instead.
 
   If \p period is positive, it is set as the new interpolationPeriod(). The
   previous interpolationPeriod() is used otherwise (default).
@@ -107,26 +174,73 @@ void KeyFrameInterpolator::startInterpolation(int period) {
   if (period >= 0)
     setInterpolationPeriod(period);
 
-  if (!keyFrame_.isEmpty()) {
-    if ((interpolationSpeed() > 0.0) &&
-        (interpolationTime() >= keyFrame_.last()->time()))
-      setInterpolationTime(keyFrame_.first()->time());
-    if ((interpolationSpeed() < 0.0) &&
-        (interpolationTime() <= keyFrame_.first()->time()))
-      setInterpolationTime(keyFrame_.last()->time());
-    timer_.start(interpolationPeriod());
+  if (numberOfKeyFrames() > 0) {
+    if ((interpolationSpeed() > 0.0) && (interpolationTime() >= lastTime()))
+      setInterpolationTime(firstTime());
+    if ((interpolationSpeed() < 0.0) && (interpolationTime() <= firstTime()))
+      setInterpolationTime(lastTime());
+    startUpdates();
     interpolationStarted_ = true;
-    update();
+    // The clock advances the time of the first tick
+    if (animationClock_ && !scheduler_)
+      interpolateAtTime(interpolationTime());
+    else
+      update();
   }
 }
 
 /*! Stops an interpolation started with startInterpolation(). See
  * interpolationIsStarted() and toggleInterpolation(). */
 void KeyFrameInterpolator::stopInterpolation() {
-  timer_.stop();
+  stopUpdates();
   interpolationStarted_ = false;
 }
 
+/*! Sets the animationClock(). Use \c nullptr to use the KeyFrameInterpolator
+own timer instead. A started interpolation continues with the new clock. */
+void KeyFrameInterpolator::setAnimationClock(AnimationClock *clock) {
+  if (clock == animationClock_)
+    return;
+
+  if (interpolationIsStarted())
+    stopUpdates();
+  if (animationClock_)
+    disconnect(animationClock_, SIGNAL(tick(int)), this, SLOT(advance(int)));
+
+  animationClock_ = clock;
+
+  if (clock)
+    connect(clock, SIGNAL(tick(int)), SLOT(advance(int)));
+  if (interpolationIsStarted())
+    startUpdates();
+}
+
+// Starts the scheduler, clock or timer that updates the interpolation
+void KeyFrameInterpolator::startUpdates() {
+  if (scheduler_)
+    scheduler_->start();
+  else if (animationClock_)
+    animationClock_->start(this);
+  else
+    timer_.start(interpolationPeriod());
+}
+
+// Stops the own timer or clock updates. The scheduler stops by itself.
+void KeyFrameInterpolator::stopUpdates() {
+  timer_.stop();
+  if (animationClock_)
+    animationClock_->stop(this);
+}
+
+// Same as update(), with the elapsed time of the animationClock() tick
+void KeyFrameInterpolator::advance(int elapsed) {
+  if (!interpolationIsStarted() || scheduler_)
+    return;
+
+  interpolateAtTime(interpolationTime());
+  advanceInterpolationTime(elapsed);
+}
+
 /*! Stops the interpolation and resets interpolationTime() to the firstTime().
 
 If desired, call interpolateAtTime() after this method to actually move the
@@ -145,24 +259,25 @@ void KeyFrameInterpolator::resetInterpolation() {
   edited, even during the interpolation. See the <a
   href="../examples/keyFrames.html">keyFrames example</a> for an illustration.
 
-  \c nullptr \p frame pointers are silently ignored. The keyFrameTime() has to be
-  monotonously increasing over keyFrames.
+  \c nullptr \p frame pointers are silently ignored. The keyFrame is inserted
+  after the keyFrames whose keyFrameTime() is smaller or equal to \p time,
+  with a binary search. When \p frame is modified, only the values of this
+  keyFrame and the tangents of its neighbors are updated.
 
   Use addKeyFrame(const Frame&, qreal) to add keyFrame by values. */
 void KeyFrameInterpolator::addKeyFrame(const Frame *const frame, qreal time) {
   if (!frame)
     return;
 
+  materializeMappedPath();
+
   if (keyFrame_.isEmpty())
     interpolationTime_ = time;
 
-  if ((!keyFrame_.isEmpty()) && (keyFrame_.last()->time() > time))
-    qWarning(
-        "Error in KeyFrameInterpolator::addKeyFrame: time is not monotone");
-  else
-    keyFrame_.append(new KeyFrame(frame, time));
+  insertKeyFrame(KeyFrame(frame, time));
+  // Pointed keyFrames are never simplified
+  recordedKeyFrames_.clear();
   connect(frame, SIGNAL(modified()), SLOT(invalidateValues()));
-  valuesAreValid_ = false;
   pathIsValid_ = false;
   currentFrameValid_ = false;
   resetInterpolation();
@@ -175,18 +290,21 @@ void KeyFrameInterpolator::addKeyFrame(const Frame *const frame, qreal time) {
   when \p frame is modified, you need to pass a \e pointer to the Frame instead
   (see addKeyFrame(const Frame*, qreal)).
 
-  The keyFrameTime() have to be monotonously increasing over keyFrames. */
+  The keyFrame is inserted at its \p time, as with addKeyFrame(const Frame*,
+  qreal). When it is appended to the path, the previous keyFrame may be removed
+  by the online simplification, see setRecordingTolerances(). */
 void KeyFrameInterpolator::addKeyFrame(const Frame &frame, qreal time) {
+  materializeMappedPath();
+
   if (keyFrame_.isEmpty())
     interpolationTime_ = time;
 
-  if ((!keyFrame_.isEmpty()) && (keyFrame_.last()->time() > time))
-    qWarning(
-        "Error in KeyFrameInterpolator::addKeyFrame: time is not monotone");
+  const bool appended = keyFrame_.isEmpty() || (time >= lastTime());
+  insertKeyFrame(KeyFrame(frame, time));
+  if (appended)
+    simplifyRecordedPath();
   else
-    keyFrame_.append(new KeyFrame(frame, time));
-
-  valuesAreValid_ = false;
+    recordedKeyFrames_.clear();
   pathIsValid_ = false;
   currentFrameValid_ = false;
   resetInterpolation();
@@ -199,7 +317,7 @@ void KeyFrameInterpolator::addKeyFrame(const Frame &frame, qreal time) {
  previous keyFrame). */
 void KeyFrameInterpolator::addKeyFrame(const Frame *const frame) {
   qreal time;
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     time = 0.0;
   else
     time = lastTime() + 1.0;
@@ -214,27 +332,266 @@ void KeyFrameInterpolator::addKeyFrame(const Frame *const frame) {
  there is no previous keyFrame). */
 void KeyFrameInterpolator::addKeyFrame(const Frame &frame) {
   qreal time;
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     time = 0.0;
   else
-    time = keyFrame_.last()->time() + 1.0;
+    time = lastTime() + 1.0;
 
   addKeyFrame(frame, time);
 }
 
-/*! Removes all keyFrames from the path. The numberOfKeyFrames() is set to 0. */
+/*! Removes all keyFrames from the path. The numberOfKeyFrames() is set to 0.
+A mapped path (see mapPath()) is unmapped. */
 void KeyFrameInterpolator::deletePath() {
   stopInterpolation();
-  qDeleteAll(keyFrame_);
+  unmapPath();
   keyFrame_.clear();
+  recordedKeyFrames_.clear();
+  pathIsValid_ = false;
+  invalidateKeyFrameValues();
+  currentFrameValid_ = false;
+}
+
+/*! Removes the keyFrames that can be interpolated from their neighbors, and
+returns the number of removed keyFrames.
+
+The remaining path deviates from each removed keyFrame by less than \p
+positionTolerance (distance between the positions) and \p angularTolerance
+(angle between the orientations, in radians). The deviation is measured at the
+keyFrameTime() of the removed keyFrame, on the linear interpolation between the
+kept keyFrames, which the spline interpolation closely follows. A null or
+negative tolerance ignores the corresponding deviation.
+
+The keyFrames are selected with the Douglas-Peucker algorithm: the farthest
+keyFrame of each interval is kept, until all the keyFrames of the interval are
+within tolerance. The first and last keyFrames, and the keyFrames given as
+pointers (see addKeyFrame(const Frame*, qreal)), are always kept.
+
+Typically used on a path recorded with Camera::addKeyFrameToPath(), whose
+keyFrames are nearly collinear. See also setRecordingTolerances() to simplify
+the path while it is recorded. */
+int KeyFrameInterpolator::simplifyPath(qreal positionTolerance,
+                                       qreal angularTolerance) {
+  materializeMappedPath();
+  recordedKeyFrames_.clear();
+  const int nb = keyFrame_.size();
+  if ((nb < 3) || ((positionTolerance <= 0.0) && (angularTolerance <= 0.0)))
+    return 0;
+
+  QVector<bool> kept(nb, false);
+  QVector<QPair<int, int>> intervals;
+  int previous = 0;
+  kept[0] = true;
+  for (int i = 1; i < nb; ++i)
+    if ((i == nb - 1) || keyFrame_.at(i).frame()) {
+      kept[i] = true;
+      intervals.append(qMakePair(previous, i));
+      previous = i;
+    }
+
+  while (!intervals.isEmpty()) {
+    const QPair<int, int> interval = intervals.takeLast();
+    const KeyFrame &first = keyFrame_.at(interval.first);
+    const KeyFrame &last = keyFrame_.at(interval.second);
+    int farthest = -1;
+    qreal maxDeviation = 1.0;
+    for (int i = interval.first + 1; i < interval.second; ++i) {
+      const qreal deviation =
+          keyFrameDeviation(first, last, keyFrame_.at(i), positionTolerance,
+                            angularTolerance);
+      if (deviation > maxDeviation) {
+        maxDeviation = deviation;
+        farthest = i;
+      }
+    }
+    if (farthest >= 0) {
+      kept[farthest] = true;
+      intervals.append(qMakePair(interval.first, farthest));
+      intervals.append(qMakePair(farthest, interval.second));
+    }
+  }
+
+  QVector<KeyFrame> keyFrames;
+  for (int i = 0; i < nb; ++i)
+    if (kept[i])
+      keyFrames.append(keyFrame_.at(i));
+  const int nbRemoved = nb - keyFrames.size();
+  if (nbRemoved > 0) {
+    keyFrame_ = keyFrames;
+    pathIsValid_ = false;
+    invalidateKeyFrameValues();
+    currentFrameValid_ = false;
+  }
+  return nbRemoved;
+}
+
+/*! Sets the recordingPositionTolerance() and recordingAngularTolerance().
+
+When one of them is positive, the path is simplified while it is recorded: each
+time a keyFrame is appended by value (addKeyFrame(const Frame&, qreal), and
+hence Camera::addKeyFrameToPath()), the previous one is removed when the path
+without it, and without the keyFrames already removed since the last kept one,
+stays within these tolerances (see simplifyPath()). A flythrough recorded at a
+high rate then only keeps the keyFrames where the trajectory bends. */
+void KeyFrameInterpolator::setRecordingTolerances(qreal positionTolerance,
+                                                  qreal angularTolerance) {
+  recordingPositionTolerance_ = positionTolerance;
+  recordingAngularTolerance_ = angularTolerance;
+  recordedKeyFrames_.clear();
+}
+
+// Inserts keyFrame after the keyFrames with a smaller or equal time, found with
+// a binary search. When the values were valid, only the inserted keyFrame and
+// its neighbors will be updated.
+void KeyFrameInterpolator::insertKeyFrame(const KeyFrame &keyFrame) {
+  const int index = int(
+      std::upper_bound(keyFrame_.constBegin(), keyFrame_.constEnd(),
+                       keyFrame.time(),
+                       [](qreal time, const KeyFrame &kf) {
+                         return time < kf.time();
+                       }) -
+      keyFrame_.constBegin());
+  keyFrame_.insert(index, keyFrame);
+  frameKeyFramesAreValid_ = false;
+
+  // The recorded range follows the shifted keyFrames
+  if (firstModifiedKeyFrame_ >= index)
+    ++firstModifiedKeyFrame_;
+  if (lastModifiedKeyFrame_ >= index)
+    ++lastModifiedKeyFrame_;
+  keyFrameModified(index);
+}
+
+// Removes the keyFrame at index. Its neighbors will be updated.
+void KeyFrameInterpolator::removeKeyFrame(int index) {
+  keyFrame_.remove(index);
+  frameKeyFramesAreValid_ = false;
   pathIsValid_ = false;
-  valuesAreValid_ = false;
   currentFrameValid_ = false;
+  if (keyFrame_.isEmpty()) {
+    invalidateKeyFrameValues();
+    return;
+  }
+
+  // The recorded range follows the shifted keyFrames
+  if (firstModifiedKeyFrame_ > index)
+    --firstModifiedKeyFrame_;
+  if (lastModifiedKeyFrame_ >= index)
+    --lastModifiedKeyFrame_;
+  if (index > 0)
+    keyFrameModified(index - 1);
+  keyFrameModified(qMin(index, keyFrame_.size() - 1));
 }
 
-static void drawCamera(qreal scale) {
-  glDisable(GL_LIGHTING);
+// Returns the deviation of keyFrame from the linear interpolation between first
+// and last at its time, relative to the tolerances: larger than 1.0 when it is
+// out of tolerance.
+qreal KeyFrameInterpolator::keyFrameDeviation(const KeyFrame &first,
+                                              const KeyFrame &last,
+                                              const KeyFrame &keyFrame,
+                                              qreal positionTolerance,
+                                              qreal angularTolerance) {
+  const qreal interval = last.time() - first.time();
+  const qreal alpha =
+      (interval > 0.0) ? (keyFrame.time() - first.time()) / interval : 0.0;
+
+  qreal deviation = 0.0;
+  if (positionTolerance > 0.0) {
+    const Vec position =
+        (1.0 - alpha) * first.position() + alpha * last.position();
+    deviation = (keyFrame.position() - position).norm() / positionTolerance;
+  }
+  if (angularTolerance > 0.0) {
+    const Quaternion orientation =
+        Quaternion::slerp(first.orientation(), last.orientation(), alpha);
+    const qreal cosine =
+        qMin(qAbs(Quaternion::dot(orientation, keyFrame.orientation())),
+             qreal(1.0));
+    deviation = qMax(deviation, 2.0 * acos(cosine) / angularTolerance);
+  }
+  return deviation;
+}
+
+// Online simplification, called when a keyFrame is appended by value: the
+// previous keyFrame is removed when the keyFrames between the last kept one
+// and the appended one stay within the recording tolerances.
+void KeyFrameInterpolator::simplifyRecordedPath() {
+  const int nb = keyFrame_.size();
+  if (((recordingPositionTolerance() <= 0.0) &&
+       (recordingAngularTolerance() <= 0.0)) ||
+      (nb < 3) || keyFrame_.at(nb - 2).frame()) {
+    recordedKeyFrames_.clear();
+    return;
+  }
+
+  const KeyFrame &first = keyFrame_.at(nb - 3);
+  const KeyFrame &last = keyFrame_.at(nb - 1);
+  const KeyFrame candidate = keyFrame_.at(nb - 2);
+  bool removable = keyFrameDeviation(first, last, candidate,
+                                     recordingPositionTolerance(),
+                                     recordingAngularTolerance()) <= 1.0;
+  for (int i = 0; removable && (i < recordedKeyFrames_.size()); ++i)
+    removable = keyFrameDeviation(first, last, recordedKeyFrames_.at(i),
+                                  recordingPositionTolerance(),
+                                  recordingAngularTolerance()) <= 1.0;
+
+  if (removable) {
+    recordedKeyFrames_.append(candidate);
+    removeKeyFrame(nb - 2);
+  } else
+    // The candidate is kept, and starts a new interval
+    recordedKeyFrames_.clear();
+}
+
+// All the keyFrame values will be updated
+void KeyFrameInterpolator::invalidateKeyFrameValues() {
+  valuesAreValid_ = false;
+  firstModifiedKeyFrame_ = -1;
+  lastModifiedKeyFrame_ = -1;
+  frameKeyFramesAreValid_ = false;
+}
 
+// Adds index to the range of the modified keyFrames, unless all of them are
+// already invalid
+void KeyFrameInterpolator::keyFrameModified(int index) {
+  if (valuesAreValid_) {
+    firstModifiedKeyFrame_ = index;
+    lastModifiedKeyFrame_ = index;
+  } else if (firstModifiedKeyFrame_ >= 0) {
+    firstModifiedKeyFrame_ = qMin(firstModifiedKeyFrame_, index);
+    lastModifiedKeyFrame_ = qMax(lastModifiedKeyFrame_, index);
+  }
+  valuesAreValid_ = false;
+}
+
+// Called when a Frame given to addKeyFrame(const Frame*) is modified. Only the
+// keyFrames that point to it are invalidated.
+void KeyFrameInterpolator::invalidateValues() {
+  const Frame *const fr = qobject_cast<const Frame *>(sender());
+  if (fr && !pathIsMapped()) {
+    if (!frameKeyFramesAreValid_) {
+      frameKeyFrames_.clear();
+      for (int i = 0; i < keyFrame_.size(); ++i)
+        if (keyFrame_.at(i).frame())
+          frameKeyFrames_.insert(keyFrame_.at(i).frame(), i);
+      frameKeyFramesAreValid_ = true;
+    }
+    QMultiHash<const Frame *, int>::const_iterator it =
+        frameKeyFrames_.constFind(fr);
+    while ((it != frameKeyFrames_.constEnd()) && (it.key() == fr)) {
+      keyFrameModified(it.value());
+      ++it;
+    }
+  } else
+    invalidateKeyFrameValues();
+  pathIsValid_ = false;
+  splineCacheIsValid_ = false;
+}
+
+// Appends the camera representation of drawPath(), in world coordinates.
+// Lines are given by pairs of vertices, filled parts by triangles.
+static void addCamera(const Frame &fr, qreal scale, QVector<float> &lines,
+                      QVector<float> &triangles) {
   const qreal halfHeight = scale * 0.07;
   const qreal halfWidth = halfHeight * 1.3;
   const qreal dist = halfHeight / tan(qreal(M_PI) / 8.0);
@@ -244,39 +601,34 @@ static void drawCamera(qreal scale) {
   const qreal arrowHalfWidth = 0.5 * halfWidth;
   const qreal baseHalfWidth = 0.3 * halfWidth;
 
+  const Vec eye(0.0, 0.0, 0.0);
+  const Vec a(-halfWidth, halfHeight, -dist);
+  const Vec b(-halfWidth, -halfHeight, -dist);
+  const Vec c(halfWidth, -halfHeight, -dist);
+  const Vec d(halfWidth, halfHeight, -dist);
+
   // Frustum outline
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  glBegin(GL_LINE_STRIP);
-  glVertex3d(-halfWidth, halfHeight, -dist);
-  glVertex3d(-halfWidth, -halfHeight, -dist);
-  glVertex3d(0.0, 0.0, 0.0);
-  glVertex3d(halfWidth, -halfHeight, -dist);
-  glVertex3d(-halfWidth, -halfHeight, -dist);
-  glEnd();
-  glBegin(GL_LINE_STRIP);
-  glVertex3d(halfWidth, -halfHeight, -dist);
-  glVertex3d(halfWidth, halfHeight, -dist);
-  glVertex3d(0.0, 0.0, 0.0);
-  glVertex3d(-halfWidth, halfHeight, -dist);
-  glVertex3d(halfWidth, halfHeight, -dist);
-  glEnd();
-
-  // Up arrow
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  // Base
-  glBegin(GL_QUADS);
-  glVertex3d(-baseHalfWidth, halfHeight, -dist);
-  glVertex3d(baseHalfWidth, halfHeight, -dist);
-  glVertex3d(baseHalfWidth, baseHeight, -dist);
-  glVertex3d(-baseHalfWidth, baseHeight, -dist);
-  glEnd();
-
-  // Arrow
-  glBegin(GL_TRIANGLES);
-  glVertex3d(0.0, arrowHeight, -dist);
-  glVertex3d(-arrowHalfWidth, baseHeight, -dist);
-  glVertex3d(arrowHalfWidth, baseHeight, -dist);
-  glEnd();
+  const Vec outline[16] = {a, b, b, eye, eye, c, c, b,
+                           c, d, d, eye, eye, a, a, d};
+  for (int i = 0; i < 16; ++i) {
+    const Vec v = fr.inverseCoordinatesOf(outline[i]);
+    lines << float(v.x) << float(v.y) << float(v.z);
+  }
+
+  // Up arrow: base quad and arrow
+  const Vec arrow[9] = {Vec(-baseHalfWidth, halfHeight, -dist),
+                        Vec(baseHalfWidth, halfHeight, -dist),
+                        Vec(baseHalfWidth, baseHeight, -dist),
+                        Vec(-baseHalfWidth, halfHeight, -dist),
+                        Vec(baseHalfWidth, baseHeight, -dist),
+                        Vec(-baseHalfWidth, baseHeight, -dist),
+                        Vec(0.0, arrowHeight, -dist),
+                        Vec(-arrowHalfWidth, baseHeight, -dist),
+                        Vec(arrowHalfWidth, baseHeight, -dist)};
+  for (int i = 0; i < 9; ++i) {
+    const Vec v = fr.inverseCoordinatesOf(arrow[i]);
+    triangles << float(v.x) << float(v.y) << float(v.z);
+  }
 }
 
 /*! Draws the path used to interpolate the frame().
@@ -303,8 +655,22 @@ static void drawCamera(qreal scale) {
   See the <a href="../examples/keyFrames.html">keyFrames example</a> for an
   illustration.
 
+  When bakedInterpolation() is \c true, the path is made of the baked samples,
+  and bakedSamplesPerSegment() replaces the maximum value of \p nbFrames.
+
   The color of the path is the current \c glColor().
 
+  The path and camera vertices are computed once and kept in a vertex buffer
+  object, which is only updated when the keyFrames are modified or when \p
+  nbFrames or \p scale change. The path is then drawn with a few \c
+  glDrawArrays() calls. During QGLViewer::paintGL() (when there is a
+  LineRenderer::current() renderer), the lines are drawn by a LineRenderer of
+  the interpolator instead: anti-aliased, and 2 pixels wide even where the
+  implementation limits the line width. Its segments are also only updated
+  with the vertex buffer, or when the color changes. In the other contexts
+  than the one of its first drawPath(), the segments are given to the
+  LineRenderer::current() renderer at each call.
+
   \attention The OpenGL state is modified by this method: GL_LIGHTING is
   disabled and line width set to 2. Use this code to preserve your current
   OpenGL state: \code glPushAttrib(GL_ALL_ATTRIB_BITS);
@@ -312,28 +678,48 @@ static void drawCamera(qreal scale) {
   glPopAttrib();
   \endcode */
 void KeyFrameInterpolator::drawPath(int mask, int nbFrames, qreal scale) {
-  const int nbSteps = 30;
+  const int nbSteps = bakedInterpolation() ? bakedSamplesPerSegment() : 30;
   if (!pathIsValid_) {
     path_.clear();
 
-    if (keyFrame_.isEmpty())
+    if (numberOfKeyFrames() == 0)
       return;
 
-    if (!valuesAreValid_)
+    if (pathIsMapped() && bakedInterpolation())
+      materializeMappedPath();
+
+    if (!pathIsMapped() && !valuesAreValid_)
       updateModifiedFrameValues();
 
-    if (keyFrame_.first() == keyFrame_.last())
-      path_.push_back(Frame(keyFrame_.first()->position(),
-                            keyFrame_.first()->orientation()));
+    if (pathIsMapped()) {
+      // Same sampling as below, directly from the mapped keyFrames
+      Vec pos;
+      Quaternion q;
+      for (int i = 0; i + 1 < nbMappedKeyFrames_; ++i)
+        for (int step = 0; step < nbSteps; ++step) {
+          interpolateMappedSegment(mappedKeyFrames_[i], mappedKeyFrames_[i + 1],
+                                   step / static_cast<qreal>(nbSteps),
+                                   slerpPrecision_, pos, q);
+          path_.push_back(Frame(pos, q));
+        }
+      path_.push_back(keyFrame(nbMappedKeyFrames_ - 1));
+    } else if (bakedInterpolation()) {
+      if (!bakedSamplesAreValid_)
+        updateBakedSamples();
+      for (int i = 0; i < bakedTimes_.size(); ++i)
+        path_.push_back(Frame(bakedPositions_[i], bakedOrientations_[i]));
+    } else if (keyFrame_.size() == 1)
+      path_.push_back(Frame(keyFrame_.first().position(),
+                            keyFrame_.first().orientation()));
     else {
       static Frame fr;
-      KeyFrame *kf_[4];
-      kf_[0] = keyFrame_.first();
+      const KeyFrame *kf_[4];
+      kf_[0] = &keyFrame_.first();
       kf_[1] = kf_[0];
       int index = 1;
-      kf_[2] = (index < keyFrame_.size()) ? keyFrame_.at(index) : nullptr;
+      kf_[2] = (index < keyFrame_.size()) ? &keyFrame_.at(index) : nullptr;
       index++;
-      kf_[3] = (index < keyFrame_.size()) ? keyFrame_.at(index) : nullptr;
+      kf_[3] = (index < keyFrame_.size()) ? &keyFrame_.at(index) : nullptr;
 
       while (kf_[2]) {
         Vec diff = kf_[2]->position() - kf_[1]->position();
@@ -346,9 +732,9 @@ void KeyFrameInterpolator::drawPath(int mask, int nbFrames, qreal scale) {
           qreal alpha = step / static_cast<qreal>(nbSteps);
           fr.setPosition(kf_[1]->position() +
                          alpha * (kf_[1]->tgP() + alpha * (v1 + alpha * v2)));
-          fr.setOrientation(Quaternion::squad(kf_[1]->orientation(),
-                                              kf_[1]->tgQ(), kf_[2]->tgQ(),
-                                              kf_[2]->orientation(), alpha));
+          fr.setOrientation(Quaternion::squad(
+              kf_[1]->orientation(), kf_[1]->tgQ(), kf_[2]->tgQ(),
+              kf_[2]->orientation(), alpha, slerpPrecision_));
           path_.push_back(fr);
         }
 
@@ -357,69 +743,361 @@ void KeyFrameInterpolator::drawPath(int mask, int nbFrames, qreal scale) {
         kf_[1] = kf_[2];
         kf_[2] = kf_[3];
         index++;
-        kf_[3] = (index < keyFrame_.size()) ? keyFrame_.at(index) : nullptr;
+        kf_[3] = (index < keyFrame_.size()) ? &keyFrame_.at(index) : nullptr;
       }
       // Add last KeyFrame
       path_.push_back(Frame(kf_[1]->position(), kf_[1]->orientation()));
     }
     pathIsValid_ = true;
+    pathBufferIsValid_ = false;
   }
 
   if (mask) {
-    glDisable(GL_LIGHTING);
-    glLineWidth(2);
+    if (nbFrames > nbSteps)
+      nbFrames = nbSteps;
 
-    if (mask & 1) {
-      glBegin(GL_LINE_STRIP);
-      Q_FOREACH (Frame fr, path_)
-        glVertex3fv(fr.position());
-      glEnd();
+    const bool cameras = (mask & 2) != 0;
+    if (!pathBufferIsValid_ ||
+        (cameras &&
+         ((pathBufferNbFrames_ != nbFrames) || (pathBufferScale_ != scale))))
+      updatePathBuffer(nbFrames, scale, cameras);
+
+    glDisable(GL_LIGHTING);
+    GLStateCache::current()->setLineWidth(2.0f);
+
+    // Client memory is used when the buffer is not available in this context
+    const bool useVBO = pathVBO_ && pathVBO_->isCreated() && pathVBO_->bind();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, useVBO ? nullptr : pathVertices_.constData());
+
+    // The wide lines of the LineRenderer, when there is one. The retained
+    // pathLines_ are only updated with the path buffer, or when the color
+    // changes. In another context, the segments are given to the current()
+    // renderer at each call.
+    LineRenderer *lines = LineRenderer::current();
+    if (lines) {
+      GLfloat color[4];
+      glGetFloatv(GL_CURRENT_COLOR, color);
+      const QColor lineColor =
+          QColor::fromRgbF(color[0], color[1], color[2], color[3]);
+      LineRenderer *const retained = pathLineRenderer();
+      if (retained) {
+        lines = retained;
+        if (!pathLinesAreValid_ || (pathLinesMask_ != (mask & 3)) ||
+            (pathLinesColor_ != lineColor)) {
+          addPathLines(lines, mask, lineColor);
+          pathLinesAreValid_ = true;
+          pathLinesMask_ = mask & 3;
+          pathLinesColor_ = lineColor;
+        }
+      } else
+        addPathLines(lines, mask, lineColor);
+      lines->draw();
+    } else if (mask & 1)
+      glDrawArrays(GL_LINE_STRIP, 0, pathStripSize_);
+    if (cameras) {
+      if (!lines)
+        glDrawArrays(GL_LINES, pathStripSize_, cameraLinesSize_);
+      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      glDrawArrays(GL_TRIANGLES, pathStripSize_ + cameraLinesSize_,
+                   cameraTrianglesSize_);
     }
-    if (mask & 6) {
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if (useVBO)
+      pathVBO_->release();
+
+    if (mask & 4) {
       int count = 0;
-      if (nbFrames > nbSteps)
-        nbFrames = nbSteps;
       qreal goal = 0.0;
       Q_FOREACH (Frame fr, path_)
         if ((count++) >= goal) {
           goal += nbSteps / static_cast<qreal>(nbFrames);
           glPushMatrix();
           glMultMatrixd(fr.matrix());
-          if (mask & 2)
-            drawCamera(scale);
-          if (mask & 4)
-            QGLViewer::drawAxis(scale / 10.0);
+          QGLViewer::drawAxis(scale / 10.0);
           glPopMatrix();
         }
     }
   }
 }
 
+// Fills pathVertices_ with the path line strip, followed by the camera lines
+// and triangles when cameras is true, and uploads them to pathVBO_. The
+// cameras are sampled along path_ as in drawPath().
+void KeyFrameInterpolator::updatePathBuffer(int nbFrames, qreal scale,
+                                            bool cameras) {
+  const int nbSteps = bakedInterpolation() ? bakedSamplesPerSegment() : 30;
+
+  pathVertices_.clear();
+  Q_FOREACH (Frame fr, path_) {
+    const Vec p = fr.position();
+    pathVertices_ << float(p.x) << float(p.y) << float(p.z);
+  }
+
+  QVector<float> lines, triangles;
+  if (cameras) {
+    int count = 0;
+    qreal goal = 0.0;
+    Q_FOREACH (Frame fr, path_)
+      if ((count++) >= goal) {
+        goal += nbSteps / static_cast<qreal>(nbFrames);
+        addCamera(fr, scale, lines, triangles);
+      }
+  }
+
+  pathStripSize_ = pathVertices_.size() / 3;
+  cameraLinesSize_ = lines.size() / 3;
+  cameraTrianglesSize_ = triangles.size() / 3;
+  pathVertices_ << lines << triangles;
+
+  pathBufferNbFrames_ = cameras ? nbFrames : 0;
+  pathBufferScale_ = scale;
+  pathBufferIsValid_ = true;
+  pathLinesAreValid_ = false;
+
+  if (!pathVBO_) {
+    pathVBO_ = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    pathVBO_->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    if (!pathVBO_->create())
+      qWarning("KeyFrameInterpolator::drawPath: unable to create vertex "
+               "buffer object, using client memory");
+  }
+
+  if (pathVBO_->isCreated() && pathVBO_->bind()) {
+    pathVBO_->allocate(pathVertices_.constData(),
+                       int(pathVertices_.size() * sizeof(float)));
+    pathVBO_->release();
+  }
+}
+
+// Returns the retained LineRenderer of the path, created in the current
+// context by the first call. nullptr when it cannot be used in this context.
+LineRenderer *KeyFrameInterpolator::pathLineRenderer() {
+  if (!pathLines_) {
+    pathLines_ = new LineRenderer();
+    if (!pathLines_->initialize()) {
+      delete pathLines_;
+      pathLines_ = nullptr;
+      return nullptr;
+    }
+  }
+  return (pathLines_->context() == QOpenGLContext::currentContext())
+             ? pathLines_
+             : nullptr;
+}
+
+// Replaces the segments of lines with the path line strip (mask & 1) and the
+// camera lines (mask & 2) of the path buffer, 2 pixels wide
+void KeyFrameInterpolator::addPathLines(LineRenderer *lines, int mask,
+                                        const QColor &color) const {
+  const float *v = pathVertices_.constData();
+  lines->clear();
+  if (mask & 1)
+    for (int i = 0; i + 1 < pathStripSize_; ++i)
+      lines->addSegment(Vec(v[3 * i], v[3 * i + 1], v[3 * i + 2]),
+                        Vec(v[3 * i + 3], v[3 * i + 4], v[3 * i + 5]), 2.0f,
+                        color);
+  if (mask & 2)
+    for (int i = pathStripSize_; i + 1 < pathStripSize_ + cameraLinesSize_;
+         i += 2)
+      lines->addSegment(Vec(v[3 * i], v[3 * i + 1], v[3 * i + 2]),
+                        Vec(v[3 * i + 3], v[3 * i + 4], v[3 * i + 5]), 2.0f,
+                        color);
+}
+
+// Updates the values of the modified keyFrames (all of them, unless only some
+// were recorded by keyFrameModified()) and the tangents of their neighbors.
 void KeyFrameInterpolator::updateModifiedFrameValues() {
-  Quaternion prevQ = keyFrame_.first()->orientation();
-  KeyFrame *kf;
-  for (int i = 0; i < keyFrame_.size(); ++i) {
-    kf = keyFrame_.at(i);
-    if (kf->frame())
-      kf->updateValuesFromPointer();
-    kf->flipOrientationIfNeeded(prevQ);
-    prevQ = kf->orientation();
-  }
-
-  KeyFrame *prev = keyFrame_.first();
-  kf = keyFrame_.first();
-  int index = 1;
-  while (kf) {
-    KeyFrame *next = (index < keyFrame_.size()) ? keyFrame_.at(index) : nullptr;
-    index++;
-    if (next)
-      kf->computeTangent(prev, next);
-    else
-      kf->computeTangent(prev, kf);
-    prev = kf;
-    kf = next;
+  QGLVIEWER_TRACE_SCOPE("interpolation", "updateModifiedFrameValues");
+  const int nb = keyFrame_.size();
+  const bool partial = firstModifiedKeyFrame_ >= 0;
+  const int first = partial ? firstModifiedKeyFrame_ : 0;
+  int last = partial ? lastModifiedKeyFrame_ : nb - 1;
+
+  // An orientation flip propagates to the next keyFrames, until one of them
+  // is not flipped
+  for (int i = first; i < nb; ++i) {
+    KeyFrame &kf = keyFrame_[i];
+    if ((i <= last) && kf.frame())
+      kf.updateValuesFromPointer();
+    const bool flipped = (i > 0) && kf.flipOrientationIfNeeded(
+                                        keyFrame_.at(i - 1).orientation());
+    if (i > last) {
+      if (!flipped)
+        break;
+      last = i;
+    }
   }
+
+  // Tangents depend on the previous and next keyFrames
+  const int firstTangent = qMax(first - 1, 0);
+  const int lastTangent = qMin(last + 1, nb - 1);
+  for (int i = firstTangent; i <= lastTangent; ++i)
+    keyFrame_[i].computeTangent(&keyFrame_.at(qMax(i - 1, 0)),
+                                &keyFrame_.at(qMin(i + 1, nb - 1)));
+
+  // Only the segments between the updated keyFrames are baked again
+  const int nbSamples = (nb - 1) * bakedSamplesPerSegment() + 1;
+  if (partial && bakedSamplesAreValid_ && (bakedTimes_.size() == nbSamples)) {
+    for (int i = qMax(firstTangent - 1, 0); i <= qMin(lastTangent, nb - 2); ++i)
+      bakeSegment(i);
+    if (lastTangent == nb - 1) {
+      bakedPositions_.last() = keyFrame_.last().position();
+      bakedOrientations_.last() = keyFrame_.last().orientation();
+    }
+  } else
+    bakedSamplesAreValid_ = false;
+
+  firstModifiedKeyFrame_ = -1;
+  lastModifiedKeyFrame_ = -1;
   valuesAreValid_ = true;
+  arcLengthsAreValid_ = false;
+}
+
+// Samples the spline of each keyFrame interval at bakedSamplesPerSegment()
+// regularly spaced times. Same computations as in interpolateAtTime().
+void KeyFrameInterpolator::updateBakedSamples() {
+  const int nbSamples = (keyFrame_.size() - 1) * bakedSamplesPerSegment() + 1;
+  bakedTimes_.resize(nbSamples);
+  bakedPositions_.resize(nbSamples);
+  bakedOrientations_.resize(nbSamples);
+
+  for (int i = 0; i + 1 < keyFrame_.size(); ++i)
+    bakeSegment(i);
+
+  // Add last KeyFrame
+  bakedTimes_.last() = keyFrame_.last().time();
+  bakedPositions_.last() = keyFrame_.last().position();
+  bakedOrientations_.last() = keyFrame_.last().orientation();
+
+  bakedSamplesAreValid_ = true;
+}
+
+// Samples the spline between the keyFrames index and index+1
+void KeyFrameInterpolator::bakeSegment(int index) {
+  const int nbSteps = bakedSamplesPerSegment();
+  const KeyFrame &kf1 = keyFrame_.at(index);
+  const KeyFrame &kf2 = keyFrame_.at(index + 1);
+
+  Vec diff = kf2.position() - kf1.position();
+  Vec v1 = 3.0 * diff - 2.0 * kf1.tgP() - kf2.tgP();
+  Vec v2 = -2.0 * diff + kf1.tgP() + kf2.tgP();
+
+  for (int step = 0; step < nbSteps; ++step) {
+    const int sample = index * nbSteps + step;
+    qreal alpha = step / static_cast<qreal>(nbSteps);
+    bakedTimes_[sample] = kf1.time() + alpha * (kf2.time() - kf1.time());
+    bakedPositions_[sample] =
+        kf1.position() + alpha * (kf1.tgP() + alpha * (v1 + alpha * v2));
+    bakedOrientations_[sample] =
+        Quaternion::squad(kf1.orientation(), kf1.tgQ(), kf2.tgQ(),
+                          kf2.orientation(), alpha, slerpPrecision_);
+  }
+}
+
+// Linear interpolation of the position and normalized linear interpolation of
+// the orientation between the two baked samples that surround time.
+void KeyFrameInterpolator::interpolateBakedSamples(
+    qreal time, Vec &position, Quaternion &orientation) const {
+  const int last = bakedTimes_.size() - 1;
+
+  if ((last == 0) || (time <= bakedTimes_.first())) {
+    position = bakedPositions_.first();
+    orientation = bakedOrientations_.first();
+    return;
+  }
+
+  if (time >= bakedTimes_[last]) {
+    position = bakedPositions_[last];
+    orientation = bakedOrientations_[last];
+    return;
+  }
+
+  // First sample after time, in 1..last
+  const int i = int(std::upper_bound(bakedTimes_.constBegin(),
+                                     bakedTimes_.constEnd(), time) -
+                    bakedTimes_.constBegin());
+
+  const qreal dt = bakedTimes_[i] - bakedTimes_[i - 1];
+  const qreal alpha = (dt > 0.0) ? (time - bakedTimes_[i - 1]) / dt : 1.0;
+
+  position =
+      (1.0 - alpha) * bakedPositions_[i - 1] + alpha * bakedPositions_[i];
+
+  const Quaternion &q1 = bakedOrientations_[i - 1];
+  const Quaternion &q2 = bakedOrientations_[i];
+  const qreal a2 = (Quaternion::dot(q1, q2) < 0.0) ? -alpha : alpha;
+  orientation = Quaternion(
+      (1.0 - alpha) * q1[0] + a2 * q2[0], (1.0 - alpha) * q1[1] + a2 * q2[1],
+      (1.0 - alpha) * q1[2] + a2 * q2[2], (1.0 - alpha) * q1[3] + a2 * q2[3]);
+  orientation.normalize();
+}
+
+// Cumulative length of the path, sampled along each spline segment. The
+// segments are the same cubic Hermite curves as in updateSplineCache().
+void KeyFrameInterpolator::updateArcLengths() {
+  const int nbSteps = 64;
+  const int nbSamples = (keyFrame_.size() - 1) * nbSteps + 1;
+
+  arcLengthTimes_.clear();
+  arcLengths_.clear();
+  arcLengthTimes_.reserve(nbSamples);
+  arcLengths_.reserve(nbSamples);
+
+  arcLengthTimes_.append(keyFrame_.first().time());
+  arcLengths_.append(0.0);
+
+  qreal length = 0.0;
+  for (int i = 0; i + 1 < keyFrame_.size(); ++i) {
+    const KeyFrame *const kf1 = &keyFrame_.at(i);
+    const KeyFrame *const kf2 = &keyFrame_.at(i + 1);
+
+    Vec diff = kf2->position() - kf1->position();
+    Vec v1 = 3.0 * diff - 2.0 * kf1->tgP() - kf2->tgP();
+    Vec v2 = -2.0 * diff + kf1->tgP() + kf2->tgP();
+
+    Vec prev = kf1->position();
+    for (int step = 1; step <= nbSteps; ++step) {
+      qreal alpha = step / static_cast<qreal>(nbSteps);
+      Vec pos = kf1->position() +
+                alpha * (kf1->tgP() + alpha * (v1 + alpha * v2));
+      length += (pos - prev).norm();
+      prev = pos;
+
+      arcLengthTimes_.append(kf1->time() +
+                             alpha * (kf2->time() - kf1->time()));
+      arcLengths_.append(length);
+    }
+  }
+
+  arcLengthsAreValid_ = true;
+}
+
+// Returns the keyFrame time at which the fraction of the path length traveled
+// equals the fraction of the duration() elapsed at time.
+qreal KeyFrameInterpolator::constantSpeedTime(qreal time) const {
+  const qreal totalLength = arcLengths_.last();
+  if ((totalLength <= 0.0) || (duration() <= 0.0))
+    return time;
+
+  const qreal fraction = (time - firstTime()) / duration();
+  if (fraction <= 0.0)
+    return firstTime();
+  if (fraction >= 1.0)
+    return lastTime();
+
+  const qreal length = fraction * totalLength;
+
+  // First sample after length, in 1..size-1
+  const int i = int(std::upper_bound(arcLengths_.constBegin(),
+                                     arcLengths_.constEnd(), length) -
+                    arcLengths_.constBegin());
+
+  const qreal dl = arcLengths_[i] - arcLengths_[i - 1];
+  const qreal alpha = (dl > 0.0) ? (length - arcLengths_[i - 1]) / dl : 0.0;
+  return arcLengthTimes_[i - 1] +
+         alpha * (arcLengthTimes_[i] - arcLengthTimes_[i - 1]);
 }
 
 /*! Returns the Frame associated with the keyFrame at index \p index.
@@ -431,8 +1109,15 @@ void KeyFrameInterpolator::updateModifiedFrameValues() {
  addKeyFrame(const Frame* const)), the \e current pointed Frame state is
  returned. */
 Frame KeyFrameInterpolator::keyFrame(int index) const {
-  const KeyFrame *const kf = keyFrame_.at(index);
-  return Frame(kf->position(), kf->orientation());
+  if (pathIsMapped()) {
+    const MappedKeyFrame &kf = mappedKeyFrames_[index];
+    return Frame(Vec(kf.position[0], kf.position[1], kf.position[2]),
+                 Quaternion(kf.orientation[0], kf.orientation[1],
+                            kf.orientation[2], kf.orientation[3]));
+  }
+
+  const KeyFrame &kf = keyFrame_.at(index);
+  return Frame(kf.position(), kf.orientation());
 }
 
 /*! Returns the time corresponding to the \p index keyFrame.
@@ -440,7 +1125,9 @@ Frame KeyFrameInterpolator::keyFrame(int index) const {
  See also keyFrame(). \p index has to be in the range 0..numberOfKeyFrames()-1.
  */
 qreal KeyFrameInterpolator::keyFrameTime(int index) const {
-  return keyFrame_.at(index)->time();
+  if (pathIsMapped())
+    return mappedKeyFrames_[index].time;
+  return keyFrame_.at(index).time();
 }
 
 /*! Returns the duration of the KeyFrameInterpolator path, expressed in seconds.
@@ -456,10 +1143,10 @@ qreal KeyFrameInterpolator::duration() const {
 Returns 0.0 if the path is empty. See also lastTime(), duration() and
 keyFrameTime(). */
 qreal KeyFrameInterpolator::firstTime() const {
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     return 0.0;
   else
-    return keyFrame_.first()->time();
+    return keyFrameTime(0);
 }
 
 /*! Returns the time corresponding to the last keyFrame, expressed in seconds.
@@ -467,69 +1154,66 @@ qreal KeyFrameInterpolator::firstTime() const {
 Returns 0.0 if the path is empty. See also firstTime(), duration() and
 keyFrameTime(). */
 qreal KeyFrameInterpolator::lastTime() const {
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     return 0.0;
   else
-    return keyFrame_.last()->time();
+    return keyFrameTime(numberOfKeyFrames() - 1);
 }
 
 void KeyFrameInterpolator::updateCurrentKeyFrameForTime(qreal time) {
   // Assertion: times are sorted in monotone order.
   // Assertion: keyFrame_ is not empty
+  const int last = keyFrame_.size() - 1;
 
   // TODO: Special case for loops when closed path is implemented !!
   if (!currentFrameValid_)
-    // Recompute everything from scrach
-    currentFrame_[1]->toFront();
-
-  while (currentFrame_[1]->peekNext()->time() > time) {
+    // Last keyFrame before time, found with a binary search
+    currentFrame_[1] = qMax(
+        int(std::upper_bound(keyFrame_.constBegin(), keyFrame_.constEnd(), time,
+                             [](qreal t, const KeyFrame &kf) {
+                               return t < kf.time();
+                             }) -
+            keyFrame_.constBegin()) -
+            1,
+        0);
+
+  while (keyFrame_.at(currentFrame_[1]).time() > time) {
     currentFrameValid_ = false;
-    if (!currentFrame_[1]->hasPrevious())
+    if (currentFrame_[1] == 0)
       break;
-    currentFrame_[1]->previous();
+    --currentFrame_[1];
   }
 
   if (!currentFrameValid_)
-    *currentFrame_[2] = *currentFrame_[1];
+    currentFrame_[2] = currentFrame_[1];
 
-  while (currentFrame_[2]->peekNext()->time() < time) {
+  while (keyFrame_.at(currentFrame_[2]).time() < time) {
     currentFrameValid_ = false;
-    if (!currentFrame_[2]->hasNext())
+    if (currentFrame_[2] == last)
       break;
-    currentFrame_[2]->next();
+    ++currentFrame_[2];
   }
 
   if (!currentFrameValid_) {
-    *currentFrame_[1] = *currentFrame_[2];
-    if ((currentFrame_[1]->hasPrevious()) &&
-        (time < currentFrame_[2]->peekNext()->time()))
-      currentFrame_[1]->previous();
+    currentFrame_[1] = currentFrame_[2];
+    if ((currentFrame_[1] > 0) &&
+        (time < keyFrame_.at(currentFrame_[2]).time()))
+      --currentFrame_[1];
 
-    *currentFrame_[0] = *currentFrame_[1];
-    if (currentFrame_[0]->hasPrevious())
-      currentFrame_[0]->previous();
-
-    *currentFrame_[3] = *currentFrame_[2];
-    if (currentFrame_[3]->hasNext())
-      currentFrame_[3]->next();
+    currentFrame_[0] = qMax(currentFrame_[1] - 1, 0);
+    currentFrame_[3] = qMin(currentFrame_[2] + 1, last);
 
     currentFrameValid_ = true;
     splineCacheIsValid_ = false;
   }
-
-  // cout << "Time = " << time << " : " << currentFrame_[0]->peekNext()->time()
-  // << " , " << currentFrame_[1]->peekNext()->time() << " , " <<
-  // currentFrame_[2]->peekNext()->time() << " , " <<
-  // currentFrame_[3]->peekNext()->time() << endl;
 }
 
 void KeyFrameInterpolator::updateSplineCache() {
-  Vec delta = currentFrame_[2]->peekNext()->position() -
-              currentFrame_[1]->peekNext()->position();
-  v1 = 3.0 * delta - 2.0 * currentFrame_[1]->peekNext()->tgP() -
-       currentFrame_[2]->peekNext()->tgP();
-  v2 = -2.0 * delta + currentFrame_[1]->peekNext()->tgP() +
-       currentFrame_[2]->peekNext()->tgP();
+  const KeyFrame &kf1 = keyFrame_.at(currentFrame_[1]);
+  const KeyFrame &kf2 = keyFrame_.at(currentFrame_[2]);
+  Vec delta = kf2.position() - kf1.position();
+  v1 = 3.0 * delta - 2.0 * kf1.tgP() - kf2.tgP();
+  v2 = -2.0 * delta + kf1.tgP() + kf2.tgP();
   splineCacheIsValid_ = true;
 }
 
@@ -539,43 +1223,275 @@ void KeyFrameInterpolator::updateSplineCache() {
   If you simply want to change interpolationTime() but not the frame() state,
   use setInterpolationTime() instead.
 
+  When constantSpeedInterpolation() is \c true, \p time is first mapped to
+  the time at which the frame() has traveled the same fraction of the path
+  length.
+
+  When bakedInterpolation() is \c true, the frame() state is interpolated
+  between the baked samples, and \p time is clamped to the firstTime() -
+  lastTime() interval.
+
   Emits the interpolated() signal and makes the frame() emit the
   Frame::interpolated() signal. */
 void KeyFrameInterpolator::interpolateAtTime(qreal time) {
   setInterpolationTime(time);
 
-  if ((keyFrame_.isEmpty()) || (!frame()))
+  Vec pos;
+  Quaternion q;
+  if (!computeAtTime(time, pos, q))
     return;
 
+  frame()->setPositionAndOrientationWithConstraint(pos, q);
+
+  if (!ModificationBatch::deferInterpolated(this))
+    Q_EMIT interpolated();
+}
+
+/*! Computes the \p position and \p orientation that interpolateAtTime() will
+give to the frame() \p delay seconds after the current interpolationTime(),
+when the interpolation is played at interpolationSpeed(). The frame() is not
+modified.
+
+The predicted time wraps around the path when loopInterpolation(), and is
+clamped to the first or last keyFrame otherwise. Returns \c false when there is
+no frame() or no keyFrame.
+
+Used by Camera::predictedStates() to let data loaders prefetch what the camera
+is about to see. Must be called from the thread that interpolates. */
+bool KeyFrameInterpolator::predictedPositionAndOrientation(
+    qreal delay, Vec &position, Quaternion &orientation) {
+  if ((numberOfKeyFrames() == 0) || (!frame()))
+    return false;
+
+  qreal time = interpolationTime() + interpolationSpeed() * delay;
+  const qreal length = duration();
+  if (loopInterpolation() && (length > 0.0)) {
+    time = fmod(time - firstTime(), length);
+    if (time < 0.0)
+      time += length;
+    time += firstTime();
+  } else
+    time = qBound(firstTime(), time, lastTime());
+
+  return computeAtTime(time, position, orientation);
+}
+
+/*! Computes the positions and orientations that interpolateAtTime() would
+give to the frame() at the \p nb \p times, and stores them in \p positions and
+\p orientations (arrays of \p nb values).
+
+Neither the frame() nor the interpolationTime() are modified, and no signal is
+emitted: use this method to draw motion trails or onion skins, or to sample
+motion blur, without moving the frame(). The \p times should be sorted in
+increasing order: the keyFrame intervals are then swept once, and the spline
+coefficients of each interval are computed once for all the times it
+contains. Unsorted times give the same results, more slowly.
+
+Returns \c false when there is no keyFrame. Must be called from the thread
+that interpolates. */
+bool KeyFrameInterpolator::getInterpolatedStates(const qreal *times, int nb,
+                                                 Vec *positions,
+                                                 Quaternion *orientations) {
+  if (numberOfKeyFrames() == 0)
+    return false;
+
+  if (pathIsMapped()) {
+    // The baked samples and arc lengths are computed from the KeyFrames
+    if (bakedInterpolation() || constantSpeedInterpolation())
+      materializeMappedPath();
+    else {
+      for (int i = 0; i < nb; ++i)
+        computeAtMappedTime(times[i], positions[i], orientations[i]);
+      return true;
+    }
+  }
+
   if (!valuesAreValid_)
     updateModifiedFrameValues();
 
+  QVector<qreal> mappedTimes;
+  if (constantSpeedInterpolation()) {
+    if (!arcLengthsAreValid_)
+      updateArcLengths();
+    mappedTimes.resize(nb);
+    for (int i = 0; i < nb; ++i)
+      mappedTimes[i] = constantSpeedTime(times[i]);
+    times = mappedTimes.constData();
+  }
+
+  if (bakedInterpolation()) {
+    if (!bakedSamplesAreValid_)
+      updateBakedSamples();
+    for (int i = 0; i < nb; ++i)
+      interpolateBakedSamples(times[i], positions[i], orientations[i]);
+    return true;
+  }
+
+  const int last = keyFrame_.size() - 1;
+  int index = 0; // last keyFrame before times[i]
+  for (int i = 0; i < nb;) {
+    const qreal time = times[i];
+    if (time < keyFrame_.at(index).time())
+      index = qMax(
+          int(std::upper_bound(keyFrame_.constBegin(), keyFrame_.constEnd(),
+                               time,
+                               [](qreal t, const KeyFrame &kf) {
+                                 return t < kf.time();
+                               }) -
+              keyFrame_.constBegin()) -
+              1,
+          0);
+    while ((index < last) && (keyFrame_.at(index + 1).time() <= time))
+      ++index;
+
+    // Before the first keyFrame, after the last one or on a keyFrame
+    const KeyFrame &kf1 = keyFrame_.at(index);
+    if ((index == last) || (time <= kf1.time())) {
+      positions[i] = kf1.position();
+      orientations[i] = kf1.orientation();
+      ++i;
+      continue;
+    }
+
+    // Times inside the interval
+    const KeyFrame &kf2 = keyFrame_.at(index + 1);
+    int end = i + 1;
+    while ((end < nb) && (times[end] > kf1.time()) &&
+           (times[end] < kf2.time()))
+      ++end;
+    interpolateSegment(kf1, kf2, times + i, end - i, positions + i,
+                       orientations + i, slerpPrecision_);
+    i = end;
+  }
+  return true;
+}
+
+// The terms of Quaternion::slerp(a, b, t, allowFlip) that do not depend on t
+struct SlerpCoefficients {
+  SlerpCoefficients(const Quaternion &a, const Quaternion &b, bool allowFlip) {
+    const qreal cosAngle = Quaternion::dot(a, b);
+    isLinear = (1.0 - fabs(cosAngle)) < 0.01;
+    angle = isLinear ? 0.0 : acos(fabs(cosAngle));
+    sinAngle = isLinear ? 1.0 : sin(angle);
+    sign = (allowFlip && (cosAngle < 0.0)) ? -1.0 : 1.0;
+  }
+
+  Quaternion slerp(const Quaternion &a, const Quaternion &b, qreal t) const {
+    const qreal c1 =
+        sign * (isLinear ? 1.0 - t : sin(angle * (1.0 - t)) / sinAngle);
+    const qreal c2 = isLinear ? t : sin(angle * t) / sinAngle;
+    return Quaternion(c1 * a[0] + c2 * b[0], c1 * a[1] + c2 * b[1],
+                      c1 * a[2] + c2 * b[2], c1 * a[3] + c2 * b[3]);
+  }
+
+  bool isLinear;
+  qreal angle, sinAngle, sign;
+};
+
+// Same computations as computeAtTime() for times strictly between the kf1 and
+// kf2 times, with the Hermite coefficients and the angles of the first two
+// slerps of Quaternion::squad() computed once. The approximate precisions have
+// no such terms.
+void KeyFrameInterpolator::interpolateSegment(
+    const KeyFrame &kf1, const KeyFrame &kf2, const qreal *times, int nb,
+    Vec *positions, Quaternion *orientations,
+    Quaternion::SlerpPrecision precision) {
+  const Vec p1 = kf1.position();
+  const Vec tg1 = kf1.tgP();
+  const Vec diff = kf2.position() - p1;
+  const Vec v1 = 3.0 * diff - 2.0 * tg1 - kf2.tgP();
+  const Vec v2 = -2.0 * diff + tg1 + kf2.tgP();
+
+  const Quaternion q1 = kf1.orientation(), q2 = kf2.orientation();
+  const Quaternion tgQ1 = kf1.tgQ(), tgQ2 = kf2.tgQ();
+  const qreal t1 = kf1.time();
+  const qreal dt = kf2.time() - t1;
+  if (precision != Quaternion::EXACT_SLERP) {
+    for (int i = 0; i < nb; ++i) {
+      const qreal alpha = (times[i] - t1) / dt;
+      positions[i] = p1 + alpha * (tg1 + alpha * (v1 + alpha * v2));
+      orientations[i] = Quaternion::squad(q1, tgQ1, tgQ2, q2, alpha, precision);
+    }
+    return;
+  }
+
+  const SlerpCoefficients orientationSlerp(q1, q2, true);
+  const SlerpCoefficients tangentSlerp(tgQ1, tgQ2, false);
+  for (int i = 0; i < nb; ++i) {
+    const qreal alpha = (times[i] - t1) / dt;
+    positions[i] = p1 + alpha * (tg1 + alpha * (v1 + alpha * v2));
+    orientations[i] = Quaternion::slerp(
+        orientationSlerp.slerp(q1, q2, alpha),
+        tangentSlerp.slerp(tgQ1, tgQ2, alpha), 2.0 * alpha * (1.0 - alpha),
+        false);
+  }
+}
+
+// Computes the frame() state at time, without modifying the frame(). Returns
+// false when there is nothing to interpolate. Only modifies the cached
+// values of this KeyFrameInterpolator, which lets the InterpolationScheduler
+// evaluate independent interpolators in parallel.
+// Reads the keyFrames defined by a Frame pointer, if they were modified. Frame
+// world queries fill the cache of the Frame and of its ancestors, which may be
+// shared with other interpolators: the InterpolationScheduler calls this
+// method in its own thread, before the parallel computeAtTime() calls.
+void KeyFrameInterpolator::updateFrameValues() {
+  if (!pathIsMapped() && !keyFrame_.isEmpty() && !valuesAreValid_)
+    updateModifiedFrameValues();
+}
+
+bool KeyFrameInterpolator::computeAtTime(qreal time, Vec &position,
+                                         Quaternion &orientation) {
+  if ((numberOfKeyFrames() == 0) || (!frame()))
+    return false;
+
+  if (pathIsMapped()) {
+    // The baked samples and arc lengths are computed from the KeyFrames
+    if (bakedInterpolation() || constantSpeedInterpolation())
+      materializeMappedPath();
+    else {
+      computeAtMappedTime(time, position, orientation);
+      return true;
+    }
+  }
+
+  if (!valuesAreValid_)
+    updateModifiedFrameValues();
+
+  if (constantSpeedInterpolation()) {
+    if (!arcLengthsAreValid_)
+      updateArcLengths();
+    time = constantSpeedTime(time);
+  }
+
+  if (bakedInterpolation()) {
+    if (!bakedSamplesAreValid_)
+      updateBakedSamples();
+
+    interpolateBakedSamples(time, position, orientation);
+    return true;
+  }
+
   updateCurrentKeyFrameForTime(time);
 
   if (!splineCacheIsValid_)
     updateSplineCache();
 
+  const KeyFrame &kf1 = keyFrame_.at(currentFrame_[1]);
+  const KeyFrame &kf2 = keyFrame_.at(currentFrame_[2]);
   qreal alpha;
-  qreal dt = currentFrame_[2]->peekNext()->time() -
-             currentFrame_[1]->peekNext()->time();
+  qreal dt = kf2.time() - kf1.time();
   if (dt == 0.0)
     alpha = 0.0;
   else
-    alpha = (time - currentFrame_[1]->peekNext()->time()) / dt;
+    alpha = (time - kf1.time()) / dt;
 
   // Linear interpolation - debug
-  // Vec pos = alpha*(currentFrame_[2]->peekNext()->position()) +
-  // (1.0-alpha)*(currentFrame_[1]->peekNext()->position());
-  Vec pos =
-      currentFrame_[1]->peekNext()->position() +
-      alpha * (currentFrame_[1]->peekNext()->tgP() + alpha * (v1 + alpha * v2));
-  Quaternion q = Quaternion::squad(
-      currentFrame_[1]->peekNext()->orientation(),
-      currentFrame_[1]->peekNext()->tgQ(), currentFrame_[2]->peekNext()->tgQ(),
-      currentFrame_[2]->peekNext()->orientation(), alpha);
-  frame()->setPositionAndOrientationWithConstraint(pos, q);
-
-  Q_EMIT interpolated();
+  // Vec pos = alpha*(kf2.position()) + (1.0-alpha)*(kf1.position());
+  position = kf1.position() + alpha * (kf1.tgP() + alpha * (v1 + alpha * v2));
+  orientation = Quaternion::squad(kf1.orientation(), kf1.tgQ(), kf2.tgQ(),
+                                  kf2.orientation(), alpha, slerpPrecision_);
+  return true;
 }
 
 /*! Returns an XML \c QDomElement that represents the KeyFrameInterpolator.
@@ -598,21 +1514,21 @@ void KeyFrameInterpolator::interpolateAtTime(qreal time) {
 QDomElement KeyFrameInterpolator::domElement(const QString &name,
                                              QDomDocument &document) const {
   QDomElement de = document.createElement(name);
-  int count = 0;
-  Q_FOREACH (KeyFrame *kf, keyFrame_) {
-    Frame fr(kf->position(), kf->orientation());
-    QDomElement kfNode = fr.domElement("KeyFrame", document);
-    kfNode.setAttribute("index", QString::number(count));
-    kfNode.setAttribute("time", QString::number(kf->time()));
+  for (int i = 0; i < numberOfKeyFrames(); ++i) {
+    QDomElement kfNode = keyFrame(i).domElement("KeyFrame", document);
+    kfNode.setAttribute("index", QString::number(i));
+    kfNode.setAttribute("time", QString::number(keyFrameTime(i)));
     de.appendChild(kfNode);
-    ++count;
   }
-  de.setAttribute("nbKF", QString::number(keyFrame_.count()));
+  de.setAttribute("nbKF", QString::number(numberOfKeyFrames()));
   de.setAttribute("time", QString::number(interpolationTime()));
   de.setAttribute("speed", QString::number(interpolationSpeed()));
   de.setAttribute("period", QString::number(interpolationPeriod()));
   DomUtils::setBoolAttribute(de, "closedPath", closedPath());
   DomUtils::setBoolAttribute(de, "loop", loopInterpolation());
+  DomUtils::setBoolAttribute(de, "baked", bakedInterpolation());
+  de.setAttribute("bakedSamples", QString::number(bakedSamplesPerSegment()));
+  DomUtils::setBoolAttribute(de, "constantSpeed", constantSpeedInterpolation());
   return de;
 }
 
@@ -626,8 +1542,9 @@ QDomElement KeyFrameInterpolator::domElement(const QString &name,
 
  See also Camera::initFromDOMElement() and Frame::initFromDOMElement(). */
 void KeyFrameInterpolator::initFromDOMElement(const QDomElement &element) {
-  qDeleteAll(keyFrame_);
+  unmapPath();
   keyFrame_.clear();
+  invalidateKeyFrameValues();
   QDomElement child = element.firstChild().toElement();
   while (!child.isNull()) {
     if (child.tagName() == "KeyFrame") {
@@ -646,15 +1563,290 @@ void KeyFrameInterpolator::initFromDOMElement(const QDomElement &element) {
   setInterpolationPeriod(DomUtils::intFromDom(element, "period", 40));
   setClosedPath(DomUtils::boolFromDom(element, "closedPath", false));
   setLoopInterpolation(DomUtils::boolFromDom(element, "loop", false));
+  setBakedInterpolation(DomUtils::boolFromDom(element, "baked", false));
+  setBakedSamplesPerSegment(DomUtils::intFromDom(element, "bakedSamples", 30));
+  setConstantSpeedInterpolation(
+      DomUtils::boolFromDom(element, "constantSpeed", false));
 
   // setFrame(nullptr);
   pathIsValid_ = false;
-  valuesAreValid_ = false;
+  invalidateKeyFrameValues();
+  currentFrameValid_ = false;
+
+  stopInterpolation();
+}
+
+/*! Writes the KeyFrameInterpolator parameters and keyFrames in \p stream.
+ Compact binary equivalent of domElement(), used by Camera::writeBinary().
+
+ As with domElement(), a keyFrame defined by a pointer to a Frame is written
+ with its current value. Use readBinary() to restore the KeyFrameInterpolator
+ state. */
+void KeyFrameInterpolator::writeBinary(QDataStream &stream) const {
+  stream << qint32(numberOfKeyFrames());
+  for (int i = 0; i < numberOfKeyFrames(); ++i) {
+    const Frame fr = keyFrame(i);
+    stream << fr.position() << fr.orientation() << double(keyFrameTime(i));
+  }
+
+  stream << double(interpolationTime()) << double(interpolationSpeed())
+         << qint32(interpolationPeriod()) << closedPath() << loopInterpolation()
+         << bakedInterpolation() << qint32(bakedSamplesPerSegment())
+         << constantSpeedInterpolation();
+}
+
+/*! Restores the KeyFrameInterpolator state from a \p stream written by
+ writeBinary().
+
+ As with initFromDOMElement(), the frame() pointer is left unchanged. The
+ original keyFrames are removed, even when \p stream is corrupted. */
+void KeyFrameInterpolator::readBinary(QDataStream &stream) {
+  unmapPath();
+  keyFrame_.clear();
+  invalidateKeyFrameValues();
+
+  qint32 nbKeyFrames = 0;
+  stream >> nbKeyFrames;
+  for (qint32 i = 0; i < nbKeyFrames && stream.status() == QDataStream::Ok;
+       ++i) {
+    Vec pos;
+    Quaternion ori;
+    double time;
+    stream >> pos >> ori >> time;
+    if (stream.status() == QDataStream::Ok)
+      addKeyFrame(Frame(pos, ori.normalized()), time);
+  }
+
+  double time, speed;
+  qint32 period, bakedSamples;
+  bool closed, loop, baked, constantSpeed;
+  stream >> time >> speed >> period >> closed >> loop >> baked >>
+      bakedSamples >> constantSpeed;
+  if (stream.status() == QDataStream::Ok) {
+    setInterpolationTime(time);
+    setInterpolationSpeed(speed);
+    setInterpolationPeriod(period);
+    setClosedPath(closed);
+    setLoopInterpolation(loop);
+    setBakedInterpolation(baked);
+    setBakedSamplesPerSegment(bakedSamples);
+    setConstantSpeedInterpolation(constantSpeed);
+  }
+
+  pathIsValid_ = false;
+  invalidateKeyFrameValues();
   currentFrameValid_ = false;
 
   stopInterpolation();
 }
 
+#ifndef DOXYGEN
+// A mapped path file is a MappedPathHeader followed by nbKeyFrames
+// MappedKeyFrame, with their precomputed tangents, so that the path can be
+// interpolated without any parsing. Values are in native byte order.
+struct KeyFrameInterpolator::MappedKeyFrame {
+  double time;
+  double position[3];
+  double orientation[4];
+  double tgP[3];
+  double tgQ[4];
+};
+#endif
+
+struct MappedPathHeader {
+  char magic[8];
+  quint32 version; // Also detects files written with another byte order
+  quint32 nbKeyFrames;
+};
+
+static const char mappedPathMagic[8] = {'Q', 'G', 'L', 'V', 'P', 'A', 'T', 'H'};
+static const quint32 mappedPathVersion = 1;
+
+static Vec mappedVec(const double v[3]) { return Vec(v[0], v[1], v[2]); }
+
+static Quaternion mappedQuaternion(const double q[4]) {
+  return Quaternion(q[0], q[1], q[2], q[3]);
+}
+
+/*! Saves the keyFrames of the path in \p fileName, in a flat binary format
+ that mapPath() can read without parsing. Returns \c false (and displays a
+ warning) when the file cannot be written.
+
+ The file contains the keyFrameTime(), the keyFrame() (a keyFrame defined by a
+ pointer to a Frame is saved with its current value) and the spline tangents of
+ each keyFrame, in native byte order. The interpolation parameters are not
+ saved: use domElement() or writeBinary() for a complete state.
+
+ A mapped path is materialized (see pathIsMapped()) by this method. */
+bool KeyFrameInterpolator::saveMappedPath(const QString &fileName) {
+  // Writing the mapped file would also invalidate the mapping
+  materializeMappedPath();
+  if (!keyFrame_.isEmpty() && !valuesAreValid_)
+    updateModifiedFrameValues();
+
+  MappedPathHeader header;
+  memcpy(header.magic, mappedPathMagic, sizeof(header.magic));
+  header.version = mappedPathVersion;
+  header.nbKeyFrames = quint32(keyFrame_.size());
+
+  QVector<MappedKeyFrame> keyFrames(keyFrame_.size());
+  for (int i = 0; i < keyFrame_.size(); ++i) {
+    const KeyFrame *const kf = &keyFrame_.at(i);
+    MappedKeyFrame &mkf = keyFrames[i];
+    mkf.time = kf->time();
+    for (int j = 0; j < 3; ++j) {
+      mkf.position[j] = kf->position()[j];
+      mkf.tgP[j] = kf->tgP()[j];
+    }
+    for (int j = 0; j < 4; ++j) {
+      mkf.orientation[j] = kf->orientation()[j];
+      mkf.tgQ[j] = kf->tgQ()[j];
+    }
+  }
+
+  QFile f(fileName);
+  const qint64 size = qint64(keyFrames.size()) * sizeof(MappedKeyFrame);
+  if (!f.open(QIODevice::WriteOnly) ||
+      (f.write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+       qint64(sizeof(header))) ||
+      (f.write(reinterpret_cast<const char *>(keyFrames.constData()), size) !=
+       size)) {
+    qWarning("KeyFrameInterpolator::saveMappedPath: unable to write %s: %s",
+             fileName.toLocal8Bit().constData(),
+             f.errorString().toLocal8Bit().constData());
+    return false;
+  }
+  return true;
+}
+
+/*! Replaces the path by the keyFrames of \p fileName, a file created by
+ saveMappedPath(). Returns \c false (and displays a warning) when \p fileName
+ is not a valid path file, in which case the path is not modified.
+
+ The file is memory-mapped and read-only: no KeyFrame is created, and
+ interpolateAtTime() evaluates the spline directly from the mapped values.
+ Browsing a large library of paths hence only costs the mapping of their files.
+
+ The path is materialized, i.e. the keyFrames are copied and the file is
+ unmapped, when it is edited (addKeyFrame()) or when it is needed by
+ bakedInterpolation() or constantSpeedInterpolation(). deletePath() unmaps the
+ file. See pathIsMapped().
+
+ The interpolation parameters are left unchanged, except for
+ interpolationTime() which is set to firstTime().
+
+ \attention The file should not be modified while it is mapped. */
+bool KeyFrameInterpolator::mapPath(const QString &fileName) {
+  QFile *file = new QFile(fileName);
+  const uchar *data = nullptr;
+  if (file->open(QIODevice::ReadOnly) &&
+      (file->size() >= qint64(sizeof(MappedPathHeader))))
+    data = file->map(0, file->size());
+
+  const MappedPathHeader *const header =
+      reinterpret_cast<const MappedPathHeader *>(data);
+  if (!header ||
+      (memcmp(header->magic, mappedPathMagic, sizeof(header->magic)) != 0) ||
+      (header->version != mappedPathVersion) ||
+      (header->nbKeyFrames > quint32(INT_MAX / sizeof(MappedKeyFrame))) ||
+      (file->size() != qint64(sizeof(MappedPathHeader) +
+                              header->nbKeyFrames * sizeof(MappedKeyFrame)))) {
+    qWarning("KeyFrameInterpolator::mapPath: %s is not a valid path file",
+             fileName.toLocal8Bit().constData());
+    delete file; // Also unmaps the file
+    return false;
+  }
+
+  deletePath();
+  mappedFile_ = file;
+  mappedKeyFrames_ =
+      reinterpret_cast<const MappedKeyFrame *>(data + sizeof(MappedPathHeader));
+  nbMappedKeyFrames_ = int(header->nbKeyFrames);
+  setInterpolationTime(firstTime());
+  return true;
+}
+
+// Releases the mapped file, without materializing its keyFrames.
+void KeyFrameInterpolator::unmapPath() {
+  if (!mappedFile_)
+    return;
+
+  delete mappedFile_;
+  mappedFile_ = nullptr;
+  mappedKeyFrames_ = nullptr;
+  nbMappedKeyFrames_ = 0;
+  pathIsValid_ = false;
+  currentFrameValid_ = false;
+  bakedSamplesAreValid_ = false;
+  arcLengthsAreValid_ = false;
+}
+
+// Creates the KeyFrames of a mapped path and unmaps it, before an edition.
+void KeyFrameInterpolator::materializeMappedPath() {
+  if (!pathIsMapped())
+    return;
+
+  keyFrame_.reserve(nbMappedKeyFrames_);
+  for (int i = 0; i < nbMappedKeyFrames_; ++i)
+    keyFrame_.append(KeyFrame(keyFrame(i), keyFrameTime(i)));
+  unmapPath();
+  invalidateKeyFrameValues();
+}
+
+// Same as the spline evaluation of computeAtTime(), from the mapped keyFrames.
+void KeyFrameInterpolator::computeAtMappedTime(qreal time, Vec &position,
+                                               Quaternion &orientation) const {
+  const MappedKeyFrame *const kf = mappedKeyFrames_;
+  const int last = nbMappedKeyFrames_ - 1;
+
+  if ((last == 0) || (time <= kf[0].time)) {
+    position = mappedVec(kf[0].position);
+    orientation = mappedQuaternion(kf[0].orientation);
+    return;
+  }
+
+  if (time >= kf[last].time) {
+    position = mappedVec(kf[last].position);
+    orientation = mappedQuaternion(kf[last].orientation);
+    return;
+  }
+
+  // First keyFrame after time, in 1..last
+  int first = 1, end = last;
+  while (first < end) {
+    const int middle = (first + end) / 2;
+    if (kf[middle].time > time)
+      end = middle;
+    else
+      first = middle + 1;
+  }
+
+  const qreal dt = kf[first].time - kf[first - 1].time;
+  const qreal alpha = (dt > 0.0) ? (time - kf[first - 1].time) / dt : 0.0;
+  interpolateMappedSegment(kf[first - 1], kf[first], alpha, slerpPrecision_,
+                           position, orientation);
+}
+
+// Hermite spline of the position and squad of the orientation between two
+// mapped keyFrames, as in computeAtTime().
+void KeyFrameInterpolator::interpolateMappedSegment(
+    const MappedKeyFrame &kf1, const MappedKeyFrame &kf2, qreal alpha,
+    Quaternion::SlerpPrecision precision, Vec &position,
+    Quaternion &orientation) {
+  const Vec p1 = mappedVec(kf1.position);
+  const Vec tg1 = mappedVec(kf1.tgP);
+  const Vec tg2 = mappedVec(kf2.tgP);
+  const Vec diff = mappedVec(kf2.position) - p1;
+  const Vec v1 = 3.0 * diff - 2.0 * tg1 - tg2;
+  const Vec v2 = -2.0 * diff + tg1 + tg2;
+
+  position = p1 + alpha * (tg1 + alpha * (v1 + alpha * v2));
+  orientation = Quaternion::squad(
+      mappedQuaternion(kf1.orientation), mappedQuaternion(kf1.tgQ),
+      mappedQuaternion(kf2.tgQ), mappedQuaternion(kf2.orientation), alpha,
+      precision);
+}
+
 #ifndef DOXYGEN
 
 //////////// KeyFrame private class implementation /////////
@@ -680,10 +1872,14 @@ void KeyFrameInterpolator::KeyFrame::computeTangent(
   tgQ_ = Quaternion::squadTangent(prev->orientation(), q_, next->orientation());
 }
 
-void KeyFrameInterpolator::KeyFrame::flipOrientationIfNeeded(
+// Returns true when the orientation was negated
+bool KeyFrameInterpolator::KeyFrame::flipOrientationIfNeeded(
     const Quaternion &prev) {
-  if (Quaternion::dot(prev, q_) < 0.0)
+  if (Quaternion::dot(prev, q_) < 0.0) {
     q_.negate();
+    return true;
+  }
+  return false;
 }
 
 #endif // DOXYGEN
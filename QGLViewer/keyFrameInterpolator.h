@@ -1,13 +1,21 @@
 #ifndef QGLVIEWER_KEY_FRAME_INTERPOLATOR_H
 #define QGLVIEWER_KEY_FRAME_INTERPOLATOR_H
 
+#include <QColor>
+#include <QHash>
 #include <QObject>
+#include <QPointer>
 #include <QTimer>
+#include <QVector>
 
+#include "animationClock.h"
 #include "quaternion.h"
 // Not actually needed, but some bad compilers (Microsoft VS6) complain.
 #include "frame.h"
 
+class QFile;
+class QOpenGLBuffer;
+
 // If you compiler complains about incomplete type, uncomment the next line
 // #include "frame.h"
 // and comment "class Frame;" 3 lines below
@@ -15,6 +23,8 @@
 namespace qglviewer {
 class Camera;
 class Frame;
+class InterpolationScheduler;
+class LineRenderer;
 /*! \brief A keyFrame Catmull-Rom Frame interpolator.
   \class KeyFrameInterpolator keyFrameInterpolator.h
   QGLViewer/keyFrameInterpolator.h
@@ -54,9 +64,12 @@ class Frame;
   The keyFrames are defined by a Frame and a time, expressed in seconds. The
   Frame can be provided as a const reference or as a pointer to a Frame (see the
   addKeyFrame() methods). In the latter case, the path will automatically be
-  updated when the Frame is modified (using the Frame::modified() signal).
+  updated when the Frame is modified (using the Frame::modified() signal). Only
+  the modified keyFrames and their neighbors are then updated, so that editing
+  a long path remains interactive.
 
-  The time has to be monotonously increasing over keyFrames. When
+  The keyFrames are sorted by time: addKeyFrame() inserts a keyFrame at its
+  time, after the keyFrames with the same time. When
   interpolationSpeed() equals 1.0 (default value), these times correspond to
   actual user's seconds during interpolation (provided that your main loop is
   fast enough). The interpolation is then real-time: the keyFrames will be
@@ -129,7 +142,10 @@ Q_SIGNALS:
 
   Note that the QGLViewer::camera() Camera::keyFrameInterpolator() created using
   QGLViewer::pathKey() have their interpolated() signals automatically connected
-  to the QGLViewer::update() slot. */
+  to the QGLViewer::update() slot.
+
+  Inside a ModificationBatch, this signal is emitted only once, at the end of
+  the batch. */
   void interpolated();
 
   /*! This signal is emitted when the interpolation reaches the first (when
@@ -149,6 +165,20 @@ public Q_SLOTS:
   void addKeyFrame(const Frame *const frame, qreal time);
 
   void deletePath();
+
+public:
+  int simplifyPath(qreal positionTolerance, qreal angularTolerance);
+  /*! Returns the position tolerance of the online simplification of the
+  recorded paths. Default value is 0.0. See setRecordingTolerances(). */
+  qreal recordingPositionTolerance() const {
+    return recordingPositionTolerance_;
+  }
+  /*! Returns the angular tolerance (in radians) of the online simplification
+  of the recorded paths. Default value is 0.0. See setRecordingTolerances(). */
+  qreal recordingAngularTolerance() const { return recordingAngularTolerance_; }
+
+public Q_SLOTS:
+  void setRecordingTolerances(qreal positionTolerance, qreal angularTolerance);
   //@}
 
   /*! @name Associated Frame */
@@ -175,7 +205,9 @@ public:
   qreal keyFrameTime(int index) const;
   /*! Returns the number of keyFrames used by the interpolation. Use
    * addKeyFrame() to add new keyFrames. */
-  int numberOfKeyFrames() const { return keyFrame_.count(); }
+  int numberOfKeyFrames() const {
+    return mappedKeyFrames_ ? nbMappedKeyFrames_ : keyFrame_.count();
+  }
   qreal duration() const;
   qreal firstTime() const;
   qreal lastTime() const;
@@ -205,7 +237,11 @@ public:
 
   This period (multiplied by interpolationSpeed()) is added to the
   interpolationTime() at each update, and the frame() state is modified
-  accordingly (see interpolateAtTime()). Default value is 40 milliseconds. */
+  accordingly (see interpolateAtTime()). Default value is 40 milliseconds.
+
+  Ignored when the KeyFrameInterpolator has a scheduler(), whose
+  InterpolationScheduler::period() is used instead, or an animationClock(),
+  whose AnimationClock::elapsed() time is used instead. */
   int interpolationPeriod() const { return period_; }
   /*! Returns \c true when the interpolation is played in an infinite loop.
 
@@ -218,6 +254,51 @@ public:
 
   In both cases, the endReached() signal is emitted. */
   bool loopInterpolation() const { return loopInterpolation_; }
+
+  /*! Returns \c true when the interpolation uses a precomputed table of
+  samples of the path. Default value is \c false.
+
+  The spline is then evaluated only once, at bakedSamplesPerSegment() samples
+  between each pair of successive keyFrames, when the path is first used after
+  a keyFrame modification. interpolateAtTime() simply looks for the samples
+  that surround the time (with a binary search) and linearly interpolates the
+  position and orientation between them. This is much faster than the
+  evaluation of the spline and of Quaternion::squad(), which is useful when
+  many KeyFrameInterpolators are played at the same time. drawPath() also
+  uses these samples.
+
+  The interpolated path is slightly different from the exact spline: increase
+  bakedSamplesPerSegment() if needed. */
+  bool bakedInterpolation() const { return bakedInterpolation_; }
+
+  /*! Returns the number of samples per keyFrame interval used when
+  bakedInterpolation() is \c true. Default value is 30. */
+  int bakedSamplesPerSegment() const { return bakedSamplesPerSegment_; }
+
+  /*! Returns \c true when the frame() moves at a constant speed along the
+  path. Default value is \c false.
+
+  The interpolation time is then mapped to the time at which the same fraction
+  of the path length is reached: the frame() travels the whole path between
+  firstTime() and lastTime(), but the keyFrames are no longer reached at their
+  keyFrameTime(). The orientation follows the position.
+
+  The cumulative length of the path is computed once from the spline
+  segments, and the mapping is a binary search in this table. This is
+  especially useful to create fly-through movies. */
+  bool constantSpeedInterpolation() const {
+    return constantSpeedInterpolation_;
+  }
+  /*! Returns the precision of the orientation interpolation. Default value
+  is Quaternion::EXACT_SLERP.
+
+  The approximate Quaternion::SlerpPrecision modes replace the \c acos() and
+  \c sin() of each Quaternion::squad() by a few multiplications, with a
+  documented maximum angular error. This is useful when thousands of
+  KeyFrameInterpolators are evaluated at each frame (see
+  getInterpolatedStates() and InterpolationScheduler). The baked samples of
+  bakedInterpolation() are also computed with this precision. */
+  Quaternion::SlerpPrecision slerpPrecision() const { return slerpPrecision_; }
 #ifndef DOXYGEN
   /*! Whether or not (default) the path defined by the keyFrames is a closed
   loop. When \c true, the last and the first KeyFrame are linked by a new spline
@@ -241,6 +322,13 @@ public Q_SLOTS:
   void setInterpolationPeriod(int period) { period_ = period; }
   /*! Sets the loopInterpolation() value. */
   void setLoopInterpolation(bool loop = true) { loopInterpolation_ = loop; }
+  void setBakedInterpolation(bool baked = true);
+  void setBakedSamplesPerSegment(int samples);
+  /*! Sets the constantSpeedInterpolation() value. */
+  void setConstantSpeedInterpolation(bool constantSpeed = true) {
+    constantSpeedInterpolation_ = constantSpeed;
+  }
+  void setSlerpPrecision(Quaternion::SlerpPrecision precision);
 #ifndef DOXYGEN
   /*! Sets the closedPath() value. \attention The closed path feature is not yet
    * implemented. */
@@ -255,7 +343,23 @@ public:
   startInterpolation(), stopInterpolation() or toggleInterpolation() to modify
   this state. */
   bool interpolationIsStarted() const { return interpolationStarted_; }
+  bool predictedPositionAndOrientation(qreal delay, Vec &position,
+                                       Quaternion &orientation);
+  bool getInterpolatedStates(const qreal *times, int nb, Vec *positions,
+                             Quaternion *orientations);
+  /*! Returns the InterpolationScheduler that drives the interpolation, or \c
+  nullptr (default) when the KeyFrameInterpolator uses its own timer. See
+  InterpolationScheduler::addInterpolator(). */
+  InterpolationScheduler *scheduler() const { return scheduler_; }
+  /*! Returns the AnimationClock that drives the interpolation, or \c nullptr
+  (default) when the KeyFrameInterpolator uses its own timer.
+
+  At each AnimationClock::tick(), interpolationTime() is advanced by the
+  elapsed time (multiplied by interpolationSpeed()), which replaces
+  interpolationPeriod(). A scheduler() takes precedence over the clock. */
+  AnimationClock *animationClock() const { return animationClock_; }
 public Q_SLOTS:
+  void setAnimationClock(AnimationClock *clock);
   void startInterpolation(int period = -1);
   void stopInterpolation();
   void resetInterpolation();
@@ -284,28 +388,84 @@ public:
   virtual void initFromDOMElement(const QDomElement &element);
   //@}
 
+  /*! @name Binary representation */
+  //@{
+public:
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
+  //@}
+
+  /*! @name Mapped path files */
+  //@{
+public:
+  bool saveMappedPath(const QString &fileName);
+  bool mapPath(const QString &fileName);
+  /*! Returns \c true when the keyFrames are read from a file mapped with
+  mapPath(). The path is materialized (and the file unmapped) when it is
+  edited. */
+  bool pathIsMapped() const { return mappedKeyFrames_ != nullptr; }
+  //@}
+
 private Q_SLOTS:
   virtual void update();
-  virtual void invalidateValues() {
-    valuesAreValid_ = false;
-    pathIsValid_ = false;
-    splineCacheIsValid_ = false;
-  }
+  void advance(int elapsed);
+  virtual void invalidateValues();
 
 private:
+  friend class InterpolationScheduler;
+
   // Copy constructor and opertor= are declared private and undefined
   // Prevents everyone from trying to use them
   // KeyFrameInterpolator(const KeyFrameInterpolator& kfi);
   // KeyFrameInterpolator& operator=(const KeyFrameInterpolator& kfi);
 
+  class KeyFrame;
+  void insertKeyFrame(const KeyFrame &keyFrame);
+  void removeKeyFrame(int index);
+  static qreal keyFrameDeviation(const KeyFrame &first, const KeyFrame &last,
+                                 const KeyFrame &keyFrame,
+                                 qreal positionTolerance,
+                                 qreal angularTolerance);
+  void simplifyRecordedPath();
+  void invalidateKeyFrameValues();
+  void keyFrameModified(int index);
   void updateCurrentKeyFrameForTime(qreal time);
   void updateModifiedFrameValues();
   void updateSplineCache();
+  void updateBakedSamples();
+  void bakeSegment(int index);
+  void interpolateBakedSamples(qreal time, Vec &position,
+                               Quaternion &orientation) const;
+  void updateArcLengths();
+  qreal constantSpeedTime(qreal time) const;
+  void updatePathBuffer(int nbFrames, qreal scale, bool cameras);
+  LineRenderer *pathLineRenderer();
+  void addPathLines(LineRenderer *lines, int mask, const QColor &color) const;
+  bool computeAtTime(qreal time, Vec &position, Quaternion &orientation);
+  void updateFrameValues();
+  static void interpolateSegment(const KeyFrame &kf1, const KeyFrame &kf2,
+                                 const qreal *times, int nb, Vec *positions,
+                                 Quaternion *orientations,
+                                 Quaternion::SlerpPrecision precision);
+  void advanceInterpolationTime(int period);
+  void startUpdates();
+  void stopUpdates();
+
+  struct MappedKeyFrame;
+  void unmapPath();
+  void materializeMappedPath();
+  void computeAtMappedTime(qreal time, Vec &position,
+                           Quaternion &orientation) const;
+  static void interpolateMappedSegment(const MappedKeyFrame &kf1,
+                                       const MappedKeyFrame &kf2, qreal alpha,
+                                       Quaternion::SlerpPrecision precision,
+                                       Vec &position, Quaternion &orientation);
 
 #ifndef DOXYGEN
   // Internal private KeyFrame representation
   class KeyFrame {
   public:
+    KeyFrame() : time_(0.0), frame_(nullptr) {}
     KeyFrame(const Frame &fr, qreal t);
     KeyFrame(const Frame *fr, qreal t);
 
@@ -316,22 +476,27 @@ private:
     qreal time() const { return time_; }
     const Frame *frame() const { return frame_; }
     void updateValuesFromPointer();
-    void flipOrientationIfNeeded(const Quaternion &prev);
+    bool flipOrientationIfNeeded(const Quaternion &prev);
     void computeTangent(const KeyFrame *const prev, const KeyFrame *const next);
 
   private:
     Vec p_, tgP_;
     Quaternion q_, tgQ_;
     qreal time_;
-    const Frame *const frame_;
+    const Frame *frame_;
   };
 #endif
 
   // K e y F r a m e s
-  mutable QList<KeyFrame *> keyFrame_;
-  QMutableListIterator<KeyFrame *> *currentFrame_[4];
+  QVector<KeyFrame> keyFrame_; // sorted by time
+  int currentFrame_[4];        // indices in keyFrame_
   QList<Frame> path_;
 
+  // M a p p e d   p a t h
+  QFile *mappedFile_;
+  const MappedKeyFrame *mappedKeyFrames_; // nullptr when not mapped
+  int nbMappedKeyFrames_;
+
   // A s s o c i a t e d   f r a m e
   Frame *frame_;
 
@@ -346,12 +511,57 @@ private:
   bool closedPath_;
   bool loopInterpolation_;
 
+  // P a t h   s i m p l i f i c a t i o n
+  qreal recordingPositionTolerance_, recordingAngularTolerance_;
+  // Removed since the last kept recorded keyFrame, see simplifyRecordedPath()
+  QVector<KeyFrame> recordedKeyFrames_;
+
   // C a c h e d   v a l u e s   a n d   f l a g s
   bool pathIsValid_;
   bool valuesAreValid_;
+  // Range of the keyFrames to update when only some of them were modified,
+  // -1 when all the values are invalid
+  int firstModifiedKeyFrame_, lastModifiedKeyFrame_;
+  QMultiHash<const Frame *, int> frameKeyFrames_; // pointed Frame indices
+  bool frameKeyFramesAreValid_;
   bool currentFrameValid_;
   bool splineCacheIsValid_;
   Vec v1, v2;
+
+  // B a k e d   s a m p l e s
+  bool bakedInterpolation_;
+  int bakedSamplesPerSegment_;
+  bool bakedSamplesAreValid_;
+  QVector<qreal> bakedTimes_;
+  QVector<Vec> bakedPositions_;
+  QVector<Quaternion> bakedOrientations_;
+
+  // A r c   l e n g t h s
+  bool constantSpeedInterpolation_;
+  bool arcLengthsAreValid_;
+  QVector<qreal> arcLengthTimes_;
+  QVector<qreal> arcLengths_;
+
+  // O r i e n t a t i o n   i n t e r p o l a t i o n
+  Quaternion::SlerpPrecision slerpPrecision_;
+
+  // S c h e d u l e r   a n d   c l o c k
+  InterpolationScheduler *scheduler_;
+  QPointer<AnimationClock> animationClock_;
+
+  // P a t h   b u f f e r
+  bool pathBufferIsValid_;
+  int pathBufferNbFrames_; // 0 when the cameras are not in the buffer
+  qreal pathBufferScale_;
+  int pathStripSize_, cameraLinesSize_, cameraTrianglesSize_;
+  QVector<float> pathVertices_;
+  QOpenGLBuffer *pathVBO_;
+  // Retained wide lines of the path buffer, in the context of the first
+  // drawPath() with a LineRenderer::current()
+  LineRenderer *pathLines_;
+  bool pathLinesAreValid_;
+  int pathLinesMask_;
+  QColor pathLinesColor_;
 };
 
 } // namespace qglviewer
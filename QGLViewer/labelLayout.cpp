@@ -0,0 +1,222 @@
+#include "labelLayout.h"
+#include "camera.h"
+#include "qglviewer.h"
+#include "taskScheduler.h"
+
+#include <QFontMetricsF>
+#include <QRectF>
+#include <algorithm>
+#include <cmath>
+
+using namespace qglviewer;
+
+// Side of the cells of the overlap grid, in pixels
+static const qreal cellSize = 64.0;
+// Anchors projected per task
+static const int minimumChunkSize = 4096;
+// Number of corners where a label can be placed around its anchor
+static const int nbCorners = 4;
+
+/*! Creates an empty LabelLayout. */
+LabelLayout::LabelLayout() : margin_(3.0) { setFont(QFont()); }
+
+/*! Adds a label that displays \p text next to the \p anchor point, given in
+world coordinates. Returns the index of the label, used by setAnchor() and
+isPlaced().
+
+Labels of higher \p priority are placed first, and are hence displayed when
+they overlap labels of lower priority. An invalid \p color (default) uses the
+current OpenGL color, as QGLViewer::drawText() does. */
+int LabelLayout::addLabel(const Vec &anchor, const QString &text, int priority,
+                          const QColor &color) {
+  Label label;
+  label.anchor = anchor;
+  label.text = text;
+  label.priority = priority;
+  label.color = color;
+  label.corner = -1;
+  measure(label);
+  labels_.append(label);
+  return labels_.size() - 1;
+}
+
+/*! Moves the anchor of the label of index \p index. Takes effect at the next
+layout(). */
+void LabelLayout::setAnchor(int index, const Vec &anchor) {
+  if ((index < 0) || (index >= labels_.size())) {
+    qWarning("LabelLayout::setAnchor: invalid label index %d", index);
+    return;
+  }
+  labels_[index].anchor = anchor;
+}
+
+/*! Changes the text of the label of index \p index. Takes effect at the next
+layout(). */
+void LabelLayout::setText(int index, const QString &text) {
+  if ((index < 0) || (index >= labels_.size())) {
+    qWarning("LabelLayout::setText: invalid label index %d", index);
+    return;
+  }
+  labels_[index].text = text;
+  measure(labels_[index]);
+}
+
+/*! Removes all the labels. */
+void LabelLayout::clear() {
+  labels_.clear();
+  placed_.clear();
+}
+
+/*! Sets the font() of all the labels. Their sizes are measured again. */
+void LabelLayout::setFont(const QFont &font) {
+  font_ = font;
+  const QFontMetricsF metrics(font_);
+  ascent_ = metrics.ascent();
+  descent_ = metrics.descent();
+  for (Label &label : labels_)
+    measure(label);
+}
+
+void LabelLayout::measure(Label &label) const {
+  label.width = QFontMetricsF(font_).horizontalAdvance(label.text);
+}
+
+/*! Returns \c true when the label of index \p index is displayed by the last
+layout(). */
+bool LabelLayout::isPlaced(int index) const {
+  return (index >= 0) && (index < labels_.size()) &&
+         (labels_[index].corner >= 0);
+}
+
+/*! Computes the labels displayed by the \p camera, and their positions.
+Call this method at each frame before draw(), or only when the camera or the
+anchors moved.
+
+Labels whose anchor is behind the camera or outside of the screen are hidden.
+The other ones are placed as detailed in the class documentation. */
+void LabelLayout::layout(const Camera *camera) {
+  placed_.clear();
+  if (!camera)
+    return;
+
+  const int nb = labels_.size();
+  const qreal width = camera->screenWidth();
+  const qreal height = camera->screenHeight();
+  GLdouble mvp[16];
+  camera->getModelViewProjectionMatrix(mvp);
+
+  // 1 - projections of the anchors. Hidden anchors get a negative depth.
+  projections_.resize(nb);
+  depths_.resize(nb);
+  const Label *const labels = labels_.constData();
+  QPointF *const projections = projections_.data();
+  float *const depths = depths_.data();
+  TaskScheduler::parallelFor(
+      nb,
+      [=](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+          const Vec &p = labels[i].anchor;
+          const qreal w = mvp[3] * p.x + mvp[7] * p.y + mvp[11] * p.z + mvp[15];
+          const qreal x = mvp[0] * p.x + mvp[4] * p.y + mvp[8] * p.z + mvp[12];
+          const qreal y = mvp[1] * p.x + mvp[5] * p.y + mvp[9] * p.z + mvp[13];
+          if ((w <= 0.0) || (std::fabs(x) > w) || (std::fabs(y) > w)) {
+            depths[i] = -1.0f;
+            continue;
+          }
+          projections[i] = QPointF((1.0 + x / w) * 0.5 * width,
+                                   (1.0 - y / w) * 0.5 * height);
+          depths[i] = float(w);
+        }
+      },
+      minimumChunkSize);
+
+  // 2 - placement order: priority, then the labels placed by the previous
+  // layout(), then the nearest ones first
+  candidates_.clear();
+  for (int i = 0; i < nb; ++i) {
+    if (depths_[i] >= 0.0f)
+      candidates_.append(i);
+    else
+      labels_[i].corner = -1;
+  }
+
+  std::sort(candidates_.begin(), candidates_.end(), [this](int a, int b) {
+    const Label &la = labels_[a], &lb = labels_[b];
+    if (la.priority != lb.priority)
+      return la.priority > lb.priority;
+    if ((la.corner >= 0) != (lb.corner >= 0))
+      return la.corner >= 0;
+    if (depths_[a] != depths_[b])
+      return depths_[a] < depths_[b];
+    return a < b;
+  });
+
+  // 3 - greedy placement. Each grid cell lists the placed rectangles it
+  // intersects.
+  const int nbCellsX = qMax(1, int(std::ceil(width / cellSize)));
+  const int nbCellsY = qMax(1, int(std::ceil(height / cellSize)));
+  QVector<QVector<int> > cells(nbCellsX * nbCellsY);
+  QVector<QRectF> rects;
+  const QRectF screen(0.0, 0.0, width, height);
+  const qreal textHeight = ascent_ + descent_;
+
+  for (int i : candidates_) {
+    Label &label = labels_[i];
+    const QPointF &a = projections_[i];
+    // The previous corner is tried first
+    const int firstCorner = qMax(0, label.corner);
+    label.corner = -1;
+
+    for (int k = 0; (k < nbCorners) && (label.corner < 0); ++k) {
+      const int corner = (firstCorner + k) % nbCorners;
+      const qreal left =
+          (corner % 2 == 0) ? a.x() + margin_ : a.x() - margin_ - label.width;
+      const qreal top =
+          (corner < 2) ? a.y() - margin_ - textHeight : a.y() + margin_;
+      const QRectF rect(left, top, label.width, textHeight);
+      if (!screen.contains(rect))
+        continue;
+
+      const int x0 = qBound(0, int(rect.left() / cellSize), nbCellsX - 1);
+      const int x1 = qBound(0, int(rect.right() / cellSize), nbCellsX - 1);
+      const int y0 = qBound(0, int(rect.top() / cellSize), nbCellsY - 1);
+      const int y1 = qBound(0, int(rect.bottom() / cellSize), nbCellsY - 1);
+
+      bool overlaps = false;
+      for (int y = y0; (y <= y1) && !overlaps; ++y)
+        for (int x = x0; (x <= x1) && !overlaps; ++x)
+          for (int r : cells[y * nbCellsX + x])
+            if (rects[r].intersects(rect)) {
+              overlaps = true;
+              break;
+            }
+      if (overlaps)
+        continue;
+
+      for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+          cells[y * nbCellsX + x].append(rects.size());
+      rects.append(rect);
+
+      label.corner = corner;
+      label.position = QPointF(left, top + ascent_);
+      placed_.append(i);
+    }
+  }
+}
+
+/*! Draws the labels placed by the last layout() with QGLViewer::drawText().
+Call this method in your QGLViewer::draw() method, after layout().
+
+The viewer should use QGLViewer::setTextIsBatched(), so that all the labels
+are drawn with a single draw call. */
+void LabelLayout::draw(QGLViewer *viewer) const {
+  if (!viewer)
+    return;
+
+  for (int i : placed_) {
+    const Label &label = labels_[i];
+    viewer->drawText(qRound(label.position.x()), qRound(label.position.y()),
+                     label.text, font_, label.color);
+  }
+}
@@ -0,0 +1,117 @@
+#ifndef QGLVIEWER_LABEL_LAYOUT_H
+#define QGLVIEWER_LABEL_LAYOUT_H
+
+#include "vec.h"
+
+#include <QColor>
+#include <QFont>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+class QGLViewer;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Places thousands of 3D labels on screen without overlaps.
+  \class LabelLayout labelLayout.h QGLViewer/labelLayout.h
+
+  Drawing a text at each of many 3D points with QGLViewer::renderText()
+  produces an unreadable mess of overlapping labels. A LabelLayout instead
+  selects, at each frame, the labels that can be displayed, and where to
+  display them around their anchor point:
+  \code
+  // Once, in init()
+  for (const City &city : cities_)
+    labels_.addLabel(city.position, city.name, city.population);
+  setTextIsBatched(true);
+
+  void Viewer::draw() {
+    // Draw the scene
+    labels_.layout(camera());
+    labels_.draw(this);
+  }
+  \endcode
+
+  layout() projects all the anchors with the
+  Camera::getModelViewProjectionMatrix() on the TaskScheduler threads. The
+  visible labels are then placed by decreasing priority: each one is tried in
+  the four corners around its anchor, and is hidden when they all overlap an
+  already placed label, or leave the screen. Overlaps are only tested with the
+  labels of the same cells of a screen space grid, so that the layout time is
+  nearly linear in the number of labels.
+
+  Placements are coherent from one frame to the next: among labels of the same
+  priority, the ones that were displayed are placed first, in the same corner
+  when possible. Labels hence do not blink or jump while the camera moves.
+
+  draw() uses QGLViewer::drawText(). Enable QGLViewer::setTextIsBatched() so
+  that all the labels are drawn with the glyph atlas in a single draw call. */
+class QGLVIEWER_EXPORT LabelLayout {
+public:
+  LabelLayout();
+
+  /*! @name Labels */
+  //@{
+public:
+  int addLabel(const Vec &anchor, const QString &text, int priority = 0,
+               const QColor &color = QColor());
+  void setAnchor(int index, const Vec &anchor);
+  void setText(int index, const QString &text);
+  void clear();
+  /*! Returns the number of labels added with addLabel(). */
+  int nbLabels() const { return labels_.size(); }
+
+  /*! Returns the font used to measure and draw the labels. Default is \c
+  QFont(). */
+  QFont font() const { return font_; }
+  void setFont(const QFont &font);
+  /*! Returns the distance, in pixels, between the anchor point and the
+  corner of its label. Default value is 3. */
+  qreal margin() const { return margin_; }
+  /*! Sets the margin(). */
+  void setMargin(qreal margin) { margin_ = margin; }
+  //@}
+
+  /*! @name Placement */
+  //@{
+public:
+  void layout(const Camera *camera);
+  /*! Returns the number of labels displayed by the last layout(). */
+  int nbPlacedLabels() const { return placed_.size(); }
+  bool isPlaced(int index) const;
+  void draw(QGLViewer *viewer) const;
+  //@}
+
+private:
+  struct Label {
+    Vec anchor;
+    QString text;
+    int priority;
+    QColor color;
+    qreal width; // of the text, in pixels
+    // Corner used by the last layout(), -1 when hidden
+    int corner;
+    // Text baseline origin, in screen pixels
+    QPointF position;
+  };
+
+  void measure(Label &label) const;
+
+  QVector<Label> labels_;
+  QVector<int> placed_; // indices of the labels displayed, in placement order
+
+  // Projected anchors of the last layout()
+  QVector<QPointF> projections_;
+  QVector<float> depths_;
+  QVector<int> candidates_;
+
+  QFont font_;
+  qreal ascent_, descent_;
+  qreal margin_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_LABEL_LAYOUT_H
@@ -0,0 +1,408 @@
+#include "lineRenderer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QVector2D>
+
+#include <stddef.h>
+#include <string.h>
+
+using namespace qglviewer;
+
+// Attribute locations, bound before the program is linked.
+static const GLuint cornerLocation = 0;
+static const GLuint fromLocation = 1;
+static const GLuint toLocation = 2;
+static const GLuint widthLocation = 3;
+static const GLuint colorLocation = 4;
+
+static thread_local LineRenderer *currentRenderer = nullptr;
+
+// corner.x selects the end of the segment, corner.y its side. The quad is
+// extended by the half width (square caps, which cover the joints of the line
+// strips) and by the anti-aliasing pixel. The distances to the segment, in
+// pixels, are multiplied by w so that their interpolation is linear in screen
+// space.
+static const char *vertexShaderSource =
+    "in vec2 corner;\n"
+    "in vec3 segmentFrom;\n"
+    "in vec3 segmentTo;\n"
+    "in float segmentWidth;\n"
+    "in vec4 segmentColor;\n"
+    "uniform mat4 mvpMatrix;\n"
+    "uniform vec2 viewportSize;\n"
+    "uniform bool antialiased;\n"
+    "out vec4 vertexColor;\n"
+    "out vec3 edge;\n"
+    "flat out vec2 extent;\n"
+    "void main() {\n"
+    "  vec4 p0 = mvpMatrix * vec4(segmentFrom, 1.0);\n"
+    "  vec4 p1 = mvpMatrix * vec4(segmentTo, 1.0);\n"
+    "  // Clipped by the near plane, so that both ends have a positive w\n"
+    "  float d0 = p0.z + p0.w;\n"
+    "  float d1 = p1.z + p1.w;\n"
+    "  if (d0 < 0.0 && d1 < 0.0) {\n"
+    "    gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+    "    return;\n"
+    "  }\n"
+    "  if (d0 < 0.0)\n"
+    "    p0 = mix(p0, p1, d0 / (d0 - d1));\n"
+    "  else if (d1 < 0.0)\n"
+    "    p1 = mix(p1, p0, d1 / (d1 - d0));\n"
+    "  vec2 s0 = 0.5 * viewportSize * p0.xy / p0.w;\n"
+    "  vec2 s1 = 0.5 * viewportSize * p1.xy / p1.w;\n"
+    "  float len = length(s1 - s0);\n"
+    "  vec2 direction = (len > 1.0e-4) ? (s1 - s0) / len : vec2(1.0, 0.0);\n"
+    "  vec2 normal = vec2(-direction.y, direction.x);\n"
+    "  // Thinner segments are 1 pixel wide, with a lower opacity\n"
+    "  float halfWidth = 0.5 * max(segmentWidth, 1.0);\n"
+    "  float radius = halfWidth + (antialiased ? 1.0 : 0.0);\n"
+    "  vec4 p = (corner.x < 0.5) ? p0 : p1;\n"
+    "  vec2 offset =\n"
+    "      radius * (corner.y * normal + (2.0 * corner.x - 1.0) * direction);\n"
+    "  gl_Position = p + vec4(2.0 * offset / viewportSize * p.w, 0.0, 0.0);\n"
+    "  float along = corner.x * (len + 2.0 * radius) - radius;\n"
+    "  edge = p.w * vec3(corner.y * radius, along, 1.0);\n"
+    "  extent = vec2(halfWidth, len);\n"
+    "  vertexColor = segmentColor;\n"
+    "  vertexColor.a *= clamp(segmentWidth, 0.0, 1.0);\n"
+    "}\n";
+
+// The coverage decreases over the pixel that straddles the segment edge
+static const char *fragmentShaderSource =
+    "in vec4 vertexColor;\n"
+    "in vec3 edge;\n"
+    "flat in vec2 extent;\n"
+    "uniform bool antialiased;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "  vec2 e = edge.xy / edge.z;\n"
+    "  float distance = max(abs(e.x), max(-e.y, e.y - extent.y));\n"
+    "  float coverage = antialiased\n"
+    "                       ? clamp(extent.x + 0.5 - distance, 0.0, 1.0)\n"
+    "                       : float(distance <= extent.x);\n"
+    "  if (coverage <= 0.0)\n"
+    "    discard;\n"
+    "  fragColor = vec4(vertexColor.rgb, vertexColor.a * coverage);\n"
+    "}\n";
+
+/*! Creates an empty, uninitialized renderer. Call initialize() once the
+OpenGL context is current. */
+LineRenderer::LineRenderer()
+    : modified_(false), antialiased_(true), ringBuffer_(nullptr),
+      context_(nullptr), mvpMatrixLocation_(-1), viewportSizeLocation_(-1),
+      antialiasedLocation_(-1) {
+  segmentVBO_.setUsagePattern(QOpenGLBuffer::StaticDraw);
+}
+
+/*! Destructor. The OpenGL resources are only released when the context() is
+current. Call cleanupGL() before otherwise. */
+LineRenderer::~LineRenderer() {
+  if (currentRenderer == this)
+    currentRenderer = nullptr;
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Returns the LineRenderer of this thread that the QGLViewer helpers
+(QGLViewer::drawGrid(), qglviewer::Camera::draw()...) use, \c nullptr if none.
+
+QGLViewer::paintGL() makes its own LineRenderer current, when the context
+supports it. The helpers clear() it before adding their segments, which are
+written in the QGLViewer::frameRingBuffer() when there is one: use your own
+LineRenderer for the batches that should persist between frames. */
+LineRenderer *LineRenderer::current() { return currentRenderer; }
+
+/*! Makes \p renderer the current() one of this thread, and returns the
+previous one (\c nullptr if none). Called by QGLViewer::paintGL(). */
+LineRenderer *LineRenderer::setCurrent(LineRenderer *renderer) {
+  LineRenderer *const previous = currentRenderer;
+  currentRenderer = renderer;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Creation                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates the shader program and the vertex buffers. Returns \c false (and
+isInitialized() remains \c false) if the current context does not support
+instanced rendering. */
+bool LineRenderer::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("LineRenderer::initialize: No current OpenGL context");
+    return false;
+  }
+  if (isInitialized())
+    return true;
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("LineRenderer::initialize: Instanced rendering requires OpenGL "
+             "3.3 or OpenGL ES 3.0");
+    return false;
+  }
+
+  if (!vao_.create()) {
+    qWarning("LineRenderer::initialize: Vertex array objects are not "
+             "supported");
+    return false;
+  }
+  if (!cornerVBO_.create() || !segmentVBO_.create()) {
+    qWarning("LineRenderer::initialize: Unable to create vertex buffers");
+    return false;
+  }
+
+  // Screen-space distances need more than mediump precision
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision highp float;\n"
+                                : "#version 330\n";
+  // Compiled by link(), unless the program binary cache has them
+  if (!program_.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                 header + vertexShaderSource) ||
+      !program_.addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource)) {
+    qWarning("LineRenderer::initialize: Unable to compile shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  program_.bindAttributeLocation("corner", cornerLocation);
+  program_.bindAttributeLocation("segmentFrom", fromLocation);
+  program_.bindAttributeLocation("segmentTo", toLocation);
+  program_.bindAttributeLocation("segmentWidth", widthLocation);
+  program_.bindAttributeLocation("segmentColor", colorLocation);
+
+  static const GLfloat corners[4][2] = {
+      {0.0f, -1.0f}, {0.0f, 1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}};
+  cornerVBO_.bind();
+  cornerVBO_.allocate(corners, sizeof(corners));
+
+  QOpenGLExtraFunctions *f = context->extraFunctions();
+  vao_.bind();
+  f->glEnableVertexAttribArray(cornerLocation);
+  f->glVertexAttribPointer(cornerLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  cornerVBO_.release();
+  // The segment attributes are set by bindSegments()
+  vao_.release();
+
+  if (!program_.link()) {
+    qWarning("LineRenderer::initialize: Unable to link shaders: %s",
+             qPrintable(program_.log()));
+    return false;
+  }
+
+  mvpMatrixLocation_ = program_.uniformLocation("mvpMatrix");
+  viewportSizeLocation_ = program_.uniformLocation("viewportSize");
+  antialiasedLocation_ = program_.uniformLocation("antialiased");
+  context_ = context;
+  // The segments added before are uploaded by the next draw()
+  modified_ = true;
+  return true;
+}
+
+/*! Points the segment attributes of the bound vertex array object at the
+segments written at \p offset in \p buffer: segmentVBO_, or the ring buffer,
+which changes at each draw(). */
+void LineRenderer::bindSegments(GLuint buffer, quintptr offset) {
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  const GLsizei stride = sizeof(Segment);
+  const struct {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    size_t offset;
+  } attributes[4] = {{fromLocation, 3, GL_FLOAT, offsetof(Segment, from)},
+                     {toLocation, 3, GL_FLOAT, offsetof(Segment, to)},
+                     {widthLocation, 1, GL_FLOAT, offsetof(Segment, width)},
+                     {colorLocation, 4, GL_UNSIGNED_BYTE,
+                      offsetof(Segment, color)}};
+  for (const auto &attribute : attributes) {
+    f->glEnableVertexAttribArray(attribute.location);
+    f->glVertexAttribPointer(
+        attribute.location, attribute.size, attribute.type,
+        attribute.type == GL_UNSIGNED_BYTE, stride,
+        reinterpret_cast<const void *>(offset + attribute.offset));
+    f->glVertexAttribDivisor(attribute.location, 1);
+  }
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*! Releases the OpenGL resources. The context that was current when
+initialize() was called must be current. The segments are kept: initialize()
+and draw() can be called again. */
+void LineRenderer::cleanupGL() {
+  context_ = nullptr;
+  program_.removeAllShaders();
+  vao_.destroy();
+  cornerVBO_.destroy();
+  segmentVBO_.destroy();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Segments                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Removes all the segments. */
+void LineRenderer::clear() {
+  segments_.clear();
+  modified_ = true;
+}
+
+/*! Reserves memory for \p nbSegments segments, to avoid reallocations when
+they are added one by one. */
+void LineRenderer::reserve(int nbSegments) { segments_.reserve(nbSegments); }
+
+/*! Adds a segment from \p from to \p to, \p width pixels wide. The
+coordinates are those of the matrix given to draw(). Segments thinner than a
+pixel are drawn 1 pixel wide, with a proportionally lower opacity. */
+void LineRenderer::addSegment(const Vec &from, const Vec &to, float width,
+                              const QColor &color) {
+  Segment segment;
+  for (int i = 0; i < 3; ++i) {
+    segment.from[i] = GLfloat(from[i]);
+    segment.to[i] = GLfloat(to[i]);
+  }
+  segment.width = width;
+  segment.color[0] = GLubyte(color.red());
+  segment.color[1] = GLubyte(color.green());
+  segment.color[2] = GLubyte(color.blue());
+  segment.color[3] = GLubyte(color.alpha());
+  segments_.append(segment);
+  modified_ = true;
+}
+
+/*! Adds a segment for each pair of \p points, the way \c GL_LINES would draw
+them. */
+void LineRenderer::addLines(const QVector<Vec> &points, float width,
+                            const QColor &color) {
+  reserve(segments_.size() + points.size() / 2);
+  for (int i = 0; i + 1 < points.size(); i += 2)
+    addSegment(points[i], points[i + 1], width, color);
+}
+
+/*! Adds the segments between consecutive \p points, the way \c GL_LINE_STRIP
+would draw them (\c GL_LINE_LOOP when \p closed is \c true). */
+void LineRenderer::addLineStrip(const QVector<Vec> &points, float width,
+                                const QColor &color, bool closed) {
+  reserve(segments_.size() + points.size());
+  for (int i = 0; i + 1 < points.size(); ++i)
+    addSegment(points[i], points[i + 1], width, color);
+  if (closed && points.size() > 2)
+    addSegment(points.last(), points.first(), width, color);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Draws all the segments with a single draw call. \p mvp is the projection
+times modelView matrix of the segment coordinates, \p viewportSize the size of
+the viewport, in pixels, which gives the widths their meaning.
+
+The segments modified since the previous draw() are uploaded first, or all of
+them are written in the setFrameRingBuffer() when there is one. The depth
+test applies. When isAntialiased(), blending is enabled during the draw, and
+then restored. Does nothing if isInitialized() is \c false. */
+void LineRenderer::draw(const QMatrix4x4 &mvp, const QSize &viewportSize) {
+  if (!isInitialized() || segments_.isEmpty() || viewportSize.isEmpty())
+    return;
+
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  const int size = int(segments_.size() * sizeof(Segment));
+  // The segments of the previous frames are no longer in the ring buffer
+  FrameRingBuffer::Allocation allocation;
+  if (ringBuffer_)
+    allocation = ringBuffer_->allocate(size);
+  if (allocation.isValid()) {
+    memcpy(allocation.data, segments_.constData(), size);
+    // segmentVBO_ is no longer up to date
+    modified_ = true;
+  } else if (modified_) {
+    segmentVBO_.bind();
+    segmentVBO_.allocate(segments_.constData(), size);
+    segmentVBO_.release();
+    modified_ = false;
+  }
+
+  GLboolean blend = GL_FALSE;
+  GLint blendFunc[4] = {GL_ONE, GL_ZERO, GL_ONE, GL_ZERO};
+  if (antialiased_) {
+    blend = f->glIsEnabled(GL_BLEND);
+    f->glGetIntegerv(GL_BLEND_SRC_RGB, &blendFunc[0]);
+    f->glGetIntegerv(GL_BLEND_DST_RGB, &blendFunc[1]);
+    f->glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendFunc[2]);
+    f->glGetIntegerv(GL_BLEND_DST_ALPHA, &blendFunc[3]);
+    f->glEnable(GL_BLEND);
+    f->glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+                           GL_ONE_MINUS_SRC_ALPHA);
+  }
+
+  program_.bind();
+  program_.setUniformValue(mvpMatrixLocation_, mvp);
+  program_.setUniformValue(viewportSizeLocation_,
+                           QVector2D(viewportSize.width(),
+                                     viewportSize.height()));
+  program_.setUniformValue(antialiasedLocation_, GLint(antialiased_ ? 1 : 0));
+  vao_.bind();
+  if (allocation.isValid())
+    bindSegments(allocation.buffer, quintptr(allocation.offset));
+  else
+    bindSegments(segmentVBO_.bufferId(), 0);
+  f->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, segments_.size());
+  vao_.release();
+  program_.release();
+
+  if (antialiased_) {
+    f->glBlendFuncSeparate(blendFunc[0], blendFunc[1], blendFunc[2],
+                           blendFunc[3]);
+    if (!blend)
+      f->glDisable(GL_BLEND);
+  }
+}
+
+/*! Draws the segments with the current \c GL_MODELVIEW and \c GL_PROJECTION
+matrices, in the current viewport.
+
+When isInitialized() is \c false, the segments are drawn with \c GL_LINES and
+\c glLineWidth() instead, without anti-aliasing. The current color and line
+width are then modified. Not available with OpenGL ES. */
+void LineRenderer::draw() {
+#ifndef QT_OPENGL_ES_2
+  if (segments_.isEmpty())
+    return;
+
+  if (!isInitialized()) {
+    // glLineWidth() is not allowed between glBegin() and glEnd()
+    GLfloat width = -1.0f;
+    for (const Segment &segment : segments_) {
+      if (segment.width != width) {
+        if (width >= 0.0f)
+          glEnd();
+        width = qMax(segment.width, 0.0f);
+        glLineWidth(qMax(width, 1.0f));
+        glBegin(GL_LINES);
+      }
+      glColor4ubv(segment.color);
+      glVertex3fv(segment.from);
+      glVertex3fv(segment.to);
+    }
+    glEnd();
+    return;
+  }
+
+  GLfloat m[16];
+  glGetFloatv(GL_MODELVIEW_MATRIX, m);
+  const QMatrix4x4 modelView = QMatrix4x4(m).transposed();
+  glGetFloatv(GL_PROJECTION_MATRIX, m);
+  const QMatrix4x4 projection = QMatrix4x4(m).transposed();
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  draw(projection * modelView, QSize(viewport[2], viewport[3]));
+#else
+  qWarning("LineRenderer::draw: Use draw(mvp, viewportSize) with OpenGL ES");
+#endif
+}
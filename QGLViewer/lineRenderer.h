@@ -0,0 +1,145 @@
+#ifndef QGLVIEWER_LINE_RENDERER_H
+#define QGLVIEWER_LINE_RENDERER_H
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+#include <QVector>
+
+#include "frameRingBuffer.h"
+#include "vec.h"
+
+class QOpenGLContext;
+
+namespace qglviewer {
+/*! \brief Draws batches of wide, anti-aliased line segments with a single
+  draw call.
+  \class LineRenderer lineRenderer.h QGLViewer/lineRenderer.h
+
+  \c glLineWidth() is deprecated, limited to 1 pixel by many core profile
+  implementations, and \c GL_LINE_SMOOTH is often slow or ignored. A
+  LineRenderer stores segments, each with its own width (in pixels) and color,
+  and draws them all with one instanced draw call: each segment is an instance,
+  expanded by the vertex shader into a screen-space quad whose edges are
+  anti-aliased by the fragment shader.
+  \code
+  void Viewer::init() {
+    lines_.initialize();
+    for (const Edge &edge : mesh.edges())
+      lines_.addSegment(edge.from, edge.to, edge.isSharp ? 3.0f : 1.0f,
+                        edge.isSharp ? Qt::red : Qt::black);
+  }
+
+  void Viewer::draw() {
+    lines_.draw(); // The current modelView and projection matrices are used
+  }
+  \endcode
+
+  The segments are uploaded by the first draw() that follows their
+  modification, and then stay on the GPU: a static wireframe of millions of
+  segments costs a single draw call per frame. Each segment uses 32 bytes of
+  GPU memory.
+
+  QGLViewer::drawGrid() and qglviewer::Camera::draw() use the current()
+  LineRenderer, made current by QGLViewer::paintGL(), with the current \c
+  glLineWidth and color. They replace its segments at each call: the viewer's
+  renderer hence writes them in the QGLViewer::frameRingBuffer() rather than
+  in its own buffer, see setFrameRingBuffer(). A
+  qglviewer::KeyFrameInterpolator::drawPath() keeps its segments in a
+  LineRenderer of the interpolator.
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. The OpenGL methods (initialize(),
+  draw() and cleanupGL()) must be called with the same context() current. The
+  destructor releases the OpenGL resources when this context is current: call
+  cleanupGL() before otherwise.
+*/
+class QGLVIEWER_EXPORT LineRenderer {
+public:
+  LineRenderer();
+  ~LineRenderer();
+
+  static LineRenderer *current();
+  static LineRenderer *setCurrent(LineRenderer *renderer);
+
+  /*! @name Creation */
+  //@{
+public:
+  bool initialize();
+  void cleanupGL();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return program_.isLinked(); }
+  /*! Returns the context that was current when initialize() succeeded, in
+  which draw() must be called. \c nullptr when isInitialized() is \c false.
+  */
+  QOpenGLContext *context() const { return context_; }
+  //@}
+
+  /*! @name Segments */
+  //@{
+public:
+  void clear();
+  void reserve(int nbSegments);
+  void addSegment(const Vec &from, const Vec &to, float width,
+                  const QColor &color);
+  void addLines(const QVector<Vec> &points, float width, const QColor &color);
+  void addLineStrip(const QVector<Vec> &points, float width,
+                    const QColor &color, bool closed = false);
+
+  /*! Returns the number of segments of the batch. */
+  int nbSegments() const { return segments_.size(); }
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  void draw(const QMatrix4x4 &mvp, const QSize &viewportSize);
+  void draw();
+
+  /*! Sets the FrameRingBuffer in which draw() writes the segments, when there
+  is room in its current frame. Use it for a renderer whose segments are
+  replaced at each frame, which otherwise reallocates its vertex buffer at
+  each draw(). The segments are then written again by each draw(), even when
+  they are not modified. Default is \c nullptr. */
+  void setFrameRingBuffer(FrameRingBuffer *ring) { ringBuffer_ = ring; }
+
+  /*! Returns \c true when the segment edges are anti-aliased (default). They
+  are then blended with \c GL_ONE_MINUS_SRC_ALPHA. */
+  bool isAntialiased() const { return antialiased_; }
+  /*! Sets isAntialiased(). */
+  void setAntialiased(bool antialiased) { antialiased_ = antialiased; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(LineRenderer)
+
+  struct Segment {
+    GLfloat from[3];
+    GLfloat to[3];
+    GLfloat width;
+    GLubyte color[4];
+  };
+
+  void bindSegments(GLuint buffer, quintptr offset);
+
+  QVector<Segment> segments_;
+  bool modified_; // since the last upload
+  bool antialiased_;
+  FrameRingBuffer *ringBuffer_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLShaderProgram program_;
+  int mvpMatrixLocation_;
+  int viewportSizeLocation_;
+  int antialiasedLocation_;
+  QOpenGLVertexArrayObject vao_;
+  QOpenGLBuffer cornerVBO_;  // the four corners of the quad
+  QOpenGLBuffer segmentVBO_; // one instance per segment
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_LINE_RENDERER_H
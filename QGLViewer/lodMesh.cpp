@@ -0,0 +1,797 @@
+#include "lodMesh.h"
+#include "camera.h"
+#include "frame.h"
+#include "meshCache.h"
+
+#include <QMutexLocker>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <vector>
+
+using namespace qglviewer;
+
+// Weight of the planes that preserve the boundary edges, relative to the
+// planes of the triangles
+static const double boundaryWeight = 100.0;
+// Collapses between two tests of an abort request
+static const int abortCheckPeriod = 4096;
+// Smallest number of triangles of a simplified level
+static const int minimumNbTriangles = 8;
+// A level is dropped when it does not remove this fraction of the triangles of
+// the previous one: the remaining edges can not be collapsed
+static const qreal minimumReduction = 0.1;
+// Floats per vertex of a Level: position and normal
+static const int floatsPerVertex = 6;
+
+namespace {
+// Sum of the squared distances to a set of planes, weighted by the areas of
+// their triangles: x^T A x + 2 b.x + c
+struct Quadric {
+  double a[6]; // xx, xy, xz, yy, yz, zz
+  double b[3];
+  double c;
+  double area; // sum of the plane weights, boundary planes excluded
+
+  Quadric() : c(0.0), area(0.0) {
+    std::fill(a, a + 6, 0.0);
+    std::fill(b, b + 3, 0.0);
+  }
+
+  void addPlane(const double n[3], double d, double weight) {
+    a[0] += weight * n[0] * n[0];
+    a[1] += weight * n[0] * n[1];
+    a[2] += weight * n[0] * n[2];
+    a[3] += weight * n[1] * n[1];
+    a[4] += weight * n[1] * n[2];
+    a[5] += weight * n[2] * n[2];
+    for (int i = 0; i < 3; ++i)
+      b[i] += weight * n[i] * d;
+    c += weight * d * d;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    for (int i = 0; i < 6; ++i)
+      a[i] += other.a[i];
+    for (int i = 0; i < 3; ++i)
+      b[i] += other.b[i];
+    c += other.c;
+    area += other.area;
+    return *this;
+  }
+
+  double error(const double x[3]) const {
+    return a[0] * x[0] * x[0] + a[3] * x[1] * x[1] + a[5] * x[2] * x[2] +
+           2.0 * (a[1] * x[0] * x[1] + a[2] * x[0] * x[2] +
+                  a[4] * x[1] * x[2] + b[0] * x[0] + b[1] * x[1] +
+                  b[2] * x[2]) +
+           c;
+  }
+
+  // The position that minimizes error(), false when A is singular (flat or
+  // linear neighborhoods)
+  bool minimum(double x[3]) const {
+    const double c00 = a[3] * a[5] - a[4] * a[4];
+    const double c01 = a[2] * a[4] - a[1] * a[5];
+    const double c02 = a[1] * a[4] - a[2] * a[3];
+    const double det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+    const double trace = a[0] + a[3] + a[5];
+    if (std::fabs(det) <= 1e-9 * trace * trace * trace)
+      return false;
+    const double c11 = a[0] * a[5] - a[2] * a[2];
+    const double c12 = a[1] * a[2] - a[0] * a[4];
+    const double c22 = a[0] * a[3] - a[1] * a[1];
+    x[0] = -(c00 * b[0] + c01 * b[1] + c02 * b[2]) / det;
+    x[1] = -(c01 * b[0] + c11 * b[1] + c12 * b[2]) / det;
+    x[2] = -(c02 * b[0] + c12 * b[1] + c22 * b[2]) / det;
+    return true;
+  }
+};
+
+// The collapse of the edge (v0, v1) in v0, moved to position. Entries of
+// modified vertices are invalidated by their versions.
+struct Collapse {
+  double cost;
+  double error; // root mean square distance to the planes
+  int v0, v1;
+  unsigned int version0, version1;
+  double position[3];
+
+  bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+void cross(const double *a, const double *b, const double *c, double n[3]) {
+  const double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  const double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  n[0] = u[1] * v[2] - u[2] * v[1];
+  n[1] = u[2] * v[0] - u[0] * v[2];
+  n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+double dot(const double u[3], const double v[3]) {
+  return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+// Greedy quadric error edge collapses of an indexed triangle mesh
+class Simplifier {
+public:
+  Simplifier(const QVector<double> &positions,
+             const QVector<quint32> &triangles);
+
+  bool simplify(int target, const QAtomicInt &revision, int expected);
+  void triangles(QVector<quint32> &triangles) const;
+
+  const double *positions() const { return positions_.constData(); }
+  int nbVertices() const { return positions_.size() / 3; }
+  int nbTriangles() const { return nbTriangles_; }
+  double error() const { return error_; }
+
+private:
+  typedef QVarLengthArray<int, 32> Neighbors;
+
+  void pushCollapse(int v0, int v1);
+  bool collapse(const Collapse &c);
+  bool flips(int v, int other, const double position[3]) const;
+  void neighbors(int v, Neighbors &result) const;
+  bool contains(int t, int v) const {
+    return (triangles_[3 * t] == quint32(v)) ||
+           (triangles_[3 * t + 1] == quint32(v)) ||
+           (triangles_[3 * t + 2] == quint32(v));
+  }
+
+  QVector<double> positions_;
+  QVector<Quadric> quadrics_;
+  QVector<unsigned int> versions_;
+  QVector<bool> vertexIsRemoved_;
+  QVector<QVector<int> > vertexTriangles_;
+  QVector<quint32> triangles_;
+  QVector<bool> triangleIsRemoved_;
+  int nbTriangles_;
+  double error_;
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> >
+      heap_;
+};
+
+// An edge of a triangle, sorted by key to find the shared and boundary edges
+struct EdgeRef {
+  quint64 key; // smallest vertex index in the high bits
+  int triangle;
+  bool operator<(const EdgeRef &other) const { return key < other.key; }
+};
+} // namespace
+
+Simplifier::Simplifier(const QVector<double> &positions,
+                       const QVector<quint32> &triangles)
+    : positions_(positions), triangles_(triangles), error_(0.0) {
+  const int nbVertices = positions_.size() / 3;
+  nbTriangles_ = triangles_.size() / 3;
+  quadrics_.resize(nbVertices);
+  versions_.fill(0, nbVertices);
+  vertexIsRemoved_.fill(false, nbVertices);
+  vertexTriangles_.resize(nbVertices);
+  triangleIsRemoved_.fill(false, nbTriangles_);
+
+  // 1 - plane of each triangle, weighted by its area
+  QVector<EdgeRef> edges;
+  edges.reserve(3 * nbTriangles_);
+  for (int t = 0; t < nbTriangles_; ++t) {
+    const quint32 *v = triangles_.constData() + 3 * t;
+    double n[3];
+    cross(&positions_[3 * v[0]], &positions_[3 * v[1]], &positions_[3 * v[2]],
+          n);
+    const double norm = std::sqrt(dot(n, n));
+    for (int i = 0; i < 3; ++i) {
+      vertexTriangles_[v[i]].append(t);
+      EdgeRef edge;
+      const quint32 a = v[i], b = v[(i + 1) % 3];
+      edge.key = (quint64(qMin(a, b)) << 32) | qMax(a, b);
+      edge.triangle = t;
+      edges.append(edge);
+    }
+    if (norm <= 0.0)
+      continue;
+    for (int i = 0; i < 3; ++i)
+      n[i] /= norm;
+    const double d = -dot(n, &positions_[3 * v[0]]);
+    for (int i = 0; i < 3; ++i) {
+      quadrics_[v[i]].addPlane(n, d, norm / 2.0);
+      quadrics_[v[i]].area += norm / 2.0;
+    }
+  }
+
+  // 2 - boundary edges, used by a single triangle, are kept in place by a
+  // plane orthogonal to their triangle
+  std::sort(edges.begin(), edges.end());
+  QVector<quint64> keys;
+  for (int e = 0; e < edges.size();) {
+    int end = e + 1;
+    while ((end < edges.size()) && (edges[end].key == edges[e].key))
+      ++end;
+    const int a = int(edges[e].key >> 32);
+    const int b = int(edges[e].key & 0xFFFFFFFF);
+
+    if (end == e + 1) {
+      const quint32 *v = triangles_.constData() + 3 * edges[e].triangle;
+      double faceNormal[3];
+      cross(&positions_[3 * v[0]], &positions_[3 * v[1]],
+            &positions_[3 * v[2]], faceNormal);
+      const double *pa = &positions_[3 * a], *pb = &positions_[3 * b];
+      const double edge[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+      double n[3] = {edge[1] * faceNormal[2] - edge[2] * faceNormal[1],
+                     edge[2] * faceNormal[0] - edge[0] * faceNormal[2],
+                     edge[0] * faceNormal[1] - edge[1] * faceNormal[0]};
+      const double norm = std::sqrt(dot(n, n));
+      if (norm > 0.0) {
+        for (int i = 0; i < 3; ++i)
+          n[i] /= norm;
+        const double weight = boundaryWeight * dot(edge, edge);
+        quadrics_[a].addPlane(n, -dot(n, pa), weight);
+        quadrics_[b].addPlane(n, -dot(n, pa), weight);
+      }
+    }
+
+    keys.append(edges[e].key);
+    e = end;
+  }
+
+  // 3 - each edge is a collapse candidate
+  for (quint64 key : keys)
+    pushCollapse(int(key >> 32), int(key & 0xFFFFFFFF));
+}
+
+// Collapses edges until at most target triangles remain. Returns false when
+// no edge can be collapsed anymore, or when revision is no longer expected.
+bool Simplifier::simplify(int target, const QAtomicInt &revision,
+                          int expected) {
+  int nbCollapses = 0;
+  while (nbTriangles_ > target) {
+    if (heap_.empty())
+      return false;
+    const Collapse c = heap_.top();
+    heap_.pop();
+    if (collapse(c) && (++nbCollapses % abortCheckPeriod == 0) &&
+        (revision.loadRelaxed() != expected))
+      return false;
+  }
+  return true;
+}
+
+// The remaining triangles, indexed in positions()
+void Simplifier::triangles(QVector<quint32> &triangles) const {
+  triangles.clear();
+  triangles.reserve(3 * nbTriangles_);
+  for (int t = 0; t < triangleIsRemoved_.size(); ++t)
+    if (!triangleIsRemoved_[t])
+      for (int i = 0; i < 3; ++i)
+        triangles.append(triangles_[3 * t + i]);
+}
+
+void Simplifier::pushCollapse(int v0, int v1) {
+  Quadric q = quadrics_[v0];
+  q += quadrics_[v1];
+
+  Collapse c;
+  c.v0 = v0;
+  c.v1 = v1;
+  c.version0 = versions_[v0];
+  c.version1 = versions_[v1];
+
+  if (!q.minimum(c.position)) {
+    // The best of the end points and of the middle of the edge
+    const double *p0 = &positions_[3 * v0], *p1 = &positions_[3 * v1];
+    const double middle[3] = {(p0[0] + p1[0]) / 2.0, (p0[1] + p1[1]) / 2.0,
+                              (p0[2] + p1[2]) / 2.0};
+    const double *best = p0;
+    if (q.error(p1) < q.error(best))
+      best = p1;
+    if (q.error(middle) < q.error(best))
+      best = middle;
+    std::copy(best, best + 3, c.position);
+  }
+
+  c.cost = qMax(q.error(c.position), 0.0);
+  c.error = (q.area > 0.0) ? std::sqrt(c.cost / q.area) : 0.0;
+  heap_.push(c);
+}
+
+// The vertices that share a remaining triangle with v
+void Simplifier::neighbors(int v, Neighbors &result) const {
+  result.clear();
+  for (int t : vertexTriangles_[v]) {
+    if (triangleIsRemoved_[t])
+      continue;
+    for (int i = 0; i < 3; ++i) {
+      const int n = int(triangles_[3 * t + i]);
+      if ((n != v) && !std::count(result.begin(), result.end(), n))
+        result.append(n);
+    }
+  }
+}
+
+// True when moving v to position flips one of its triangles that does not
+// contain other, or makes it degenerate
+bool Simplifier::flips(int v, int other, const double position[3]) const {
+  for (int t : vertexTriangles_[v]) {
+    if (triangleIsRemoved_[t] || contains(t, other))
+      continue;
+    const double *p[3], *moved[3];
+    for (int i = 0; i < 3; ++i) {
+      p[i] = &positions_[3 * triangles_[3 * t + i]];
+      moved[i] = (int(triangles_[3 * t + i]) == v) ? position : p[i];
+    }
+    double before[3], after[3];
+    cross(p[0], p[1], p[2], before);
+    cross(moved[0], moved[1], moved[2], after);
+    if ((dot(before, after) <= 0.0) && (dot(before, before) > 0.0))
+      return true;
+  }
+  return false;
+}
+
+bool Simplifier::collapse(const Collapse &c) {
+  const int v0 = c.v0, v1 = c.v1;
+  if (vertexIsRemoved_[v0] || vertexIsRemoved_[v1] ||
+      (versions_[v0] != c.version0) || (versions_[v1] != c.version1))
+    return false;
+
+  // Link condition: the end points only share the opposite vertices of the
+  // triangles of the edge, otherwise the collapse pinches the surface
+  Neighbors n0, n1;
+  neighbors(v0, n0);
+  neighbors(v1, n1);
+  int nbShared = 0;
+  for (int n : n0)
+    if (std::count(n1.begin(), n1.end(), n))
+      ++nbShared;
+  int nbEdgeTriangles = 0;
+  for (int t : vertexTriangles_[v1])
+    if (!triangleIsRemoved_[t] && contains(t, v0))
+      ++nbEdgeTriangles;
+  if ((nbShared != nbEdgeTriangles) || flips(v0, v1, c.position) ||
+      flips(v1, v0, c.position))
+    return false;
+
+  // The triangles of the edge are removed, the other ones of v1 use v0
+  QVector<int> &triangles0 = vertexTriangles_[v0];
+  for (int t : vertexTriangles_[v1]) {
+    if (triangleIsRemoved_[t])
+      continue;
+    if (contains(t, v0)) {
+      triangleIsRemoved_[t] = true;
+      --nbTriangles_;
+    } else {
+      for (int i = 0; i < 3; ++i)
+        if (triangles_[3 * t + i] == quint32(v1))
+          triangles_[3 * t + i] = quint32(v0);
+      triangles0.append(t);
+    }
+  }
+  triangles0.erase(std::remove_if(triangles0.begin(), triangles0.end(),
+                                  [this](int t) {
+                                    return triangleIsRemoved_[t];
+                                  }),
+                   triangles0.end());
+  vertexTriangles_[v1].clear();
+  vertexIsRemoved_[v1] = true;
+
+  std::copy(c.position, c.position + 3, &positions_[3 * v0]);
+  quadrics_[v0] += quadrics_[v1];
+  ++versions_[v0];
+  ++versions_[v1];
+  error_ = qMax(error_, c.error);
+
+  neighbors(v0, n0);
+  for (int n : n0)
+    pushCollapse(v0, n);
+  return true;
+}
+
+/*! Creates an empty LodMesh. Use setMesh() to define its triangles. */
+LodMesh::LodMesh(QObject *parent)
+    : QObject(parent), radius_(0.0), maximumNumberOfLevels_(5),
+      reductionRatio_(0.25), maximumScreenSpaceError_(2.0), drawnLevel_(-1),
+      threadPool_(nullptr), revision_(0), simplificationIsRunning_(false),
+      simplifiedLevelsAreReady_(false) {}
+
+/*! Destructor. Aborts a running simplification. The vertex buffers are
+released if an OpenGL context is current, see cleanupGL(). */
+LodMesh::~LodMesh() {
+  revision_.ref();
+  if (threadPool_)
+    threadPool_->waitForDone();
+  delete threadPool_;
+  if (QOpenGLContext::currentContext())
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                    Mesh                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the triangles of the mesh: \p indices lists three \p vertices indices
+per triangle.
+
+Level 0 is available as soon as this method returns. The simplified levels
+are computed on a background thread, and levelsReady() is emitted when they
+are available. The previous levels are released: the OpenGL context of their
+vertex buffers must be current. */
+void LodMesh::setMesh(const QVector<Vec> &vertices,
+                      const QVector<quint32> &indices) {
+  QVector<float> positions;
+  positions.reserve(3 * vertices.size());
+  for (const Vec &v : vertices) {
+    positions.append(float(v.x));
+    positions.append(float(v.y));
+    positions.append(float(v.z));
+  }
+  setMesh(positions.constData(), 3, vertices.size(), indices.constData(),
+          indices.size());
+}
+
+/*! Sets the triangles of the mesh from a loaded MeshCache. Its normals and
+texture coordinates are ignored. See the other setMesh() method. */
+void LodMesh::setMesh(const MeshCache &mesh) {
+  // Local copies keep a mapped cache alive during the read
+  const QByteArray vertexData = mesh.vertexData();
+  const QByteArray indexData = mesh.indexData();
+  setMesh(reinterpret_cast<const float *>(vertexData.constData()),
+          MeshCache::VERTEX_STRIDE / int(sizeof(float)), mesh.nbVertices(),
+          reinterpret_cast<const quint32 *>(indexData.constData()),
+          mesh.nbIndices());
+}
+
+// stride is the number of floats between two vertices
+void LodMesh::setMesh(const float *positions, int stride, int nbVertices,
+                      const quint32 *indices, int nbIndices) {
+  clear();
+
+  for (int i = 0; i < nbIndices; ++i)
+    if (indices[i] >= quint32(nbVertices)) {
+      qWarning("LodMesh::setMesh: invalid vertex index %u", indices[i]);
+      return;
+    }
+
+  // 1 - vertices with the same position are merged, so that the texture and
+  // normal seams do not open during the simplification
+  QVector<int> order(nbVertices);
+  for (int i = 0; i < nbVertices; ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [positions, stride](int a, int b) {
+    return std::lexicographical_compare(
+        positions + a * stride, positions + a * stride + 3,
+        positions + b * stride, positions + b * stride + 3);
+  });
+
+  QVector<quint32> merged(nbVertices);
+  QVector<double> welded;
+  welded.reserve(3 * nbVertices);
+  for (int i = 0; i < nbVertices; ++i) {
+    const float *p = positions + order[i] * stride;
+    if ((i == 0) || !std::equal(p, p + 3, positions + order[i - 1] * stride))
+      for (int k = 0; k < 3; ++k)
+        welded.append(p[k]);
+    merged[order[i]] = quint32(welded.size() / 3 - 1);
+  }
+
+  // 2 - triangles, without the degenerate ones
+  QVector<quint32> triangles;
+  triangles.reserve(nbIndices - nbIndices % 3);
+  for (int t = 0; t + 2 < nbIndices; t += 3) {
+    const quint32 a = merged[indices[t]], b = merged[indices[t + 1]],
+                  c = merged[indices[t + 2]];
+    if ((a != b) && (b != c) && (a != c)) {
+      triangles.append(a);
+      triangles.append(b);
+      triangles.append(c);
+    }
+  }
+  if (triangles.isEmpty())
+    return;
+
+  // 3 - bounding sphere of the bounding box
+  Vec min = Vec(welded[0], welded[1], welded[2]), max = min;
+  for (int i = 0; i < welded.size(); i += 3) {
+    const Vec p(welded[i], welded[i + 1], welded[i + 2]);
+    min = Vec(qMin(min.x, p.x), qMin(min.y, p.y), qMin(min.z, p.z));
+    max = Vec(qMax(max.x, p.x), qMax(max.y, p.y), qMax(max.z, p.z));
+  }
+  center_ = (min + max) / 2.0;
+  radius_ = (max - min).norm() / 2.0;
+
+  Level level;
+  makeLevel(welded.constData(), welded.size() / 3, triangles.constData(),
+            triangles.size() / 3, 0.0, level);
+  levels_.append(level);
+
+  if ((maximumNumberOfLevels_ > 1) &&
+      (triangles.size() / 3 * reductionRatio_ >= minimumNbTriangles))
+    startSimplification(welded, triangles);
+}
+
+/*! Removes all the levels and aborts a running simplification. The OpenGL
+context of their vertex buffers must be current. */
+void LodMesh::clear() {
+  revision_.ref();
+  {
+    QMutexLocker locker(&simplifiedMutex_);
+    simplifiedLevels_.clear();
+    simplifiedLevelsAreReady_ = false;
+  }
+  simplificationIsRunning_ = false;
+
+  for (Level &level : levels_)
+    releaseLevel(level);
+  levels_.clear();
+  center_ = Vec();
+  radius_ = 0.0;
+  drawnLevel_ = -1;
+}
+
+// Compacts the vertices used by triangles, and computes their area weighted
+// normals
+void LodMesh::makeLevel(const double *positions, int nbVertices,
+                        const quint32 *triangles, int nbTriangles, qreal error,
+                        Level &level) {
+  QVector<int> index(nbVertices, -1);
+  level.vertices.clear();
+  level.indices.resize(3 * nbTriangles);
+  for (int i = 0; i < 3 * nbTriangles; ++i) {
+    const quint32 v = triangles[i];
+    if (index[v] < 0) {
+      index[v] = level.vertices.size() / floatsPerVertex;
+      for (int k = 0; k < 3; ++k)
+        level.vertices.append(float(positions[3 * v + k]));
+      for (int k = 0; k < 3; ++k)
+        level.vertices.append(0.0f);
+    }
+    level.indices[i] = quint32(index[v]);
+  }
+
+  float *const vertices = level.vertices.data();
+  for (int t = 0; t < nbTriangles; ++t) {
+    const quint32 *v = triangles + 3 * t;
+    double n[3];
+    cross(positions + 3 * v[0], positions + 3 * v[1], positions + 3 * v[2], n);
+    for (int i = 0; i < 3; ++i)
+      for (int k = 0; k < 3; ++k)
+        vertices[floatsPerVertex * level.indices[3 * t + i] + 3 + k] +=
+            float(n[k]);
+  }
+  for (int i = 0; i < level.vertices.size(); i += floatsPerVertex) {
+    float *n = vertices + i + 3;
+    const float norm = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (norm > 0.0f)
+      for (int k = 0; k < 3; ++k)
+        n[k] /= norm;
+  }
+
+  level.error = error;
+  level.vertexBuffer = nullptr;
+  level.indexBuffer = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Simplification                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the maximumNumberOfLevels(). Values smaller than 1 are clamped. */
+void LodMesh::setMaximumNumberOfLevels(int nb) {
+  maximumNumberOfLevels_ = qMax(1, nb);
+}
+
+/*! Sets the reductionRatio(), which must be in ]0, 1[. */
+void LodMesh::setReductionRatio(qreal ratio) {
+  if ((ratio <= 0.0) || (ratio >= 1.0)) {
+    qWarning("LodMesh::setReductionRatio: ratio must be in ]0, 1[");
+    return;
+  }
+  reductionRatio_ = ratio;
+}
+
+// Simplifies the welded mesh on the simplification thread, each level
+// starting from the previous one
+void LodMesh::startSimplification(const QVector<double> &positions,
+                                  const QVector<quint32> &triangles) {
+  if (!threadPool_) {
+    threadPool_ = new QThreadPool();
+    threadPool_->setMaxThreadCount(1);
+  }
+
+  simplificationIsRunning_ = true;
+  const int revision = revision_.loadRelaxed();
+  const int nbLevels = maximumNumberOfLevels_;
+  const qreal ratio = reductionRatio_;
+  threadPool_->start(QRunnable::create([this, positions, triangles, revision,
+                                        nbLevels, ratio]() {
+    Simplifier simplifier(positions, triangles);
+    QVector<Level> levels;
+    QVector<quint32> simplified;
+    int previous = simplifier.nbTriangles();
+
+    while (levels.size() < nbLevels - 1) {
+      const int target = int(previous * ratio);
+      if (target < minimumNbTriangles)
+        break;
+      const bool completed = simplifier.simplify(target, revision_, revision);
+      if (revision_.loadRelaxed() != revision)
+        return;
+      if (simplifier.nbTriangles() > (1.0 - minimumReduction) * previous)
+        break;
+
+      simplifier.triangles(simplified);
+      Level level;
+      makeLevel(simplifier.positions(), simplifier.nbVertices(),
+                simplified.constData(), simplifier.nbTriangles(),
+                simplifier.error(), level);
+      levels.append(level);
+      previous = simplifier.nbTriangles();
+      if (!completed)
+        break;
+    }
+
+    {
+      QMutexLocker locker(&simplifiedMutex_);
+      if (revision_.loadRelaxed() != revision)
+        return;
+      std::swap(simplifiedLevels_, levels);
+      simplifiedLevelsAreReady_ = true;
+    }
+    Q_EMIT levelsReady();
+  }));
+}
+
+// Appends the levels of a completed simplification after level 0
+void LodMesh::adoptSimplifiedLevels() {
+  if (!simplificationIsRunning_)
+    return;
+  QMutexLocker locker(&simplifiedMutex_);
+  if (!simplifiedLevelsAreReady_)
+    return;
+  levels_ += simplifiedLevels_;
+  simplifiedLevels_.clear();
+  simplifiedLevelsAreReady_ = false;
+  simplificationIsRunning_ = false;
+}
+
+/*! Returns \c true when all the levels of the mesh are available, i.e. when
+the simplification started by setMesh() is completed. */
+bool LodMesh::levelsAreReady() {
+  adoptSimplifiedLevels();
+  return !simplificationIsRunning_;
+}
+
+/*! Blocks until the simplification started by setMesh() is completed. */
+void LodMesh::waitForLevels() {
+  if (threadPool_)
+    threadPool_->waitForDone();
+  adoptSimplifiedLevels();
+}
+
+/*! Returns the number of triangles of \p level, 0 if it is not available. */
+int LodMesh::nbTriangles(int level) const {
+  if ((level < 0) || (level >= levels_.size()))
+    return 0;
+  return levels_[level].indices.size() / 3;
+}
+
+/*! Returns the deviation of \p level from the original mesh, in the mesh
+coordinates: the largest root mean square distance of a collapsed vertex to
+its original planes. Level 0 has no error. Returns -1.0 if \p level is not
+available. */
+qreal LodMesh::levelError(int level) const {
+  if ((level < 0) || (level >= levels_.size()))
+    return -1.0;
+  return levels_[level].error;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the level drawn by draw() for \p camera: the coarsest one which
+levelError(), projected at the nearest point of the bounding sphere, is
+smaller than maximumScreenSpaceError() pixels. Returns 0 when \p camera is
+inside the bounding sphere.
+
+The mesh coordinates are those of \p frame, which is the Frame in which the
+mesh is drawn (see Frame::matrix()). They are the world coordinates when \p
+frame is \c nullptr, as for the QGLViewer::lodMeshes(). */
+int LodMesh::selectLevel(const Camera *camera, const Frame *frame) {
+  adoptSimplifiedLevels();
+  if (!camera || (levels_.size() <= 1))
+    return 0;
+
+  // Frames have no scaling: only the center is converted
+  const Vec center = frame ? frame->inverseCoordinatesOf(center_) : center_;
+  const Vec toCenter = center - camera->position();
+  const qreal distance = toCenter.norm();
+  if (distance <= radius_)
+    return 0;
+
+  const Vec nearest = camera->position() + (distance - radius_) / distance *
+                                               toCenter;
+  const qreal ratio = camera->pixelGLRatio(nearest);
+  if (ratio <= 0.0)
+    return 0;
+
+  for (int level = levels_.size() - 1; level > 0; --level)
+    if (levels_[level].error / ratio <= maximumScreenSpaceError_)
+      return level;
+  return 0;
+}
+
+/*! Draws the level of the mesh selected by selectLevel() for \p camera, whose
+matrices must be loaded. \p frame is the Frame in which the mesh is drawn, or
+\c nullptr when it is in world coordinates. */
+void LodMesh::draw(const Camera *camera, const Frame *frame) {
+  drawLevel(selectLevel(camera, frame));
+}
+
+/*! Draws \p level, clamped to the available levels, with \c GL_TRIANGLES. The
+vertex buffers of a level are created by its first drawLevel(). */
+void LodMesh::drawLevel(int level) {
+  adoptSimplifiedLevels();
+  if (levels_.isEmpty()) {
+    drawnLevel_ = -1;
+    return;
+  }
+
+  level = qBound(0, level, levels_.size() - 1);
+  Level &l = levels_[level];
+  if (!l.vertexBuffer) {
+    l.vertexBuffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    l.vertexBuffer->create();
+    l.vertexBuffer->bind();
+    l.vertexBuffer->allocate(l.vertices.constData(),
+                             l.vertices.size() * int(sizeof(float)));
+    l.vertexBuffer->release();
+    l.indexBuffer = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    l.indexBuffer->create();
+    l.indexBuffer->bind();
+    l.indexBuffer->allocate(l.indices.constData(),
+                            l.indices.size() * int(sizeof(quint32)));
+    l.indexBuffer->release();
+  }
+
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  const GLsizei stride = floatsPerVertex * sizeof(GLfloat);
+  l.vertexBuffer->bind();
+  glVertexPointer(3, GL_FLOAT, stride, nullptr);
+  glNormalPointer(GL_FLOAT, stride,
+                  reinterpret_cast<const void *>(3 * sizeof(GLfloat)));
+  l.indexBuffer->bind();
+  glDrawElements(GL_TRIANGLES, l.indices.size(), GL_UNSIGNED_INT, nullptr);
+  l.indexBuffer->release();
+  l.vertexBuffer->release();
+
+  glPopClientAttrib();
+  drawnLevel_ = level;
+}
+
+/*! Releases the vertex buffers of the levels, which are uploaded again by the
+next drawLevel(). The OpenGL context must be current. */
+void LodMesh::cleanupGL() {
+  for (Level &level : levels_)
+    releaseLevel(level);
+}
+
+void LodMesh::releaseLevel(Level &level) {
+  if (level.vertexBuffer) {
+    level.vertexBuffer->destroy();
+    level.indexBuffer->destroy();
+  }
+  delete level.vertexBuffer;
+  delete level.indexBuffer;
+  level.vertexBuffer = nullptr;
+  level.indexBuffer = nullptr;
+}
@@ -0,0 +1,173 @@
+#ifndef QGLVIEWER_LOD_MESH_H
+#define QGLVIEWER_LOD_MESH_H
+
+#include "vec.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+class QOpenGLBuffer;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+class Frame;
+class MeshCache;
+
+/*! \brief A triangle mesh and its automatically simplified levels of detail.
+  \class LodMesh lodMesh.h QGLViewer/lodMesh.h
+
+  QGLViewer::fastDraw() is meant to draw a simplified version of the scene, but
+  writing this simplified version by hand is tedious. A LodMesh instead
+  computes a chain of simplified versions of a triangle mesh, on a background
+  thread, as soon as setMesh() is called. Each level keeps reductionRatio() of
+  the triangles of the previous one, up to maximumNumberOfLevels() levels.
+
+  Register it in your viewer with QGLViewer::addLodMesh(): the default
+  QGLViewer::draw() then draws it at full detail, and at a reduced level of
+  detail when it is called from QGLViewer::fastDraw():
+  \code
+  void Viewer::init() {
+    mesh_.setMesh(meshCache_);
+    addLodMesh(&mesh_);
+    showEntireScene();
+  }
+
+  void Viewer::draw() {
+    // Other objects...
+    QGLViewer::draw();
+  }
+  \endcode
+
+  The levels of detail are computed with edge collapses ordered by a quadric
+  error metric (Garland and Heckbert): each vertex accumulates the planes of
+  its original triangles, and the edge which collapse moves its vertex the
+  least with respect to these planes is collapsed first. The boundary edges are
+  preserved, and collapses that would flip a triangle or make the mesh non
+  manifold are rejected. levelError() records the resulting deviation.
+
+  draw() selects the coarsest level which levelError(), once projected on
+  screen at the distance of the mesh, is smaller than maximumScreenSpaceError()
+  pixels: distant meshes are hence drawn with fewer triangles. Only level 0 is
+  available until the simplification is completed, which emits levelsReady().
+
+  Vertices with the same position are merged, and each level has smooth
+  per-vertex normals. The texture coordinates are not kept. The levels are
+  drawn from vertex buffers with \c glVertexPointer() and \c glNormalPointer(),
+  which requires a compatibility profile. The OpenGL methods must be called
+  with the same context current: call cleanupGL() before it is destroyed (the
+  viewer does it for its QGLViewer::lodMeshes()). */
+class QGLVIEWER_EXPORT LodMesh : public QObject {
+  Q_OBJECT
+
+public:
+  explicit LodMesh(QObject *parent = nullptr);
+  virtual ~LodMesh();
+
+  /*! @name Mesh */
+  //@{
+public:
+  void setMesh(const QVector<Vec> &vertices, const QVector<quint32> &indices);
+  void setMesh(const MeshCache &mesh);
+  void clear();
+
+  /*! Returns the center of the bounding sphere of the mesh. */
+  Vec center() const { return center_; }
+  /*! Returns the radius of the bounding sphere of the mesh. */
+  qreal radius() const { return radius_; }
+  //@}
+
+  /*! @name Simplification */
+  //@{
+public:
+  /*! Returns the maximum number of levels, including the full detail level 0.
+  Default value is 5. Takes effect at the next setMesh(). */
+  int maximumNumberOfLevels() const { return maximumNumberOfLevels_; }
+  void setMaximumNumberOfLevels(int nb);
+  /*! Returns the fraction of the triangles of a level kept by the next one.
+  Default value is 0.25. Takes effect at the next setMesh(). */
+  qreal reductionRatio() const { return reductionRatio_; }
+  void setReductionRatio(qreal ratio);
+
+  bool levelsAreReady();
+  void waitForLevels();
+
+  /*! Returns the number of levels currently available. Only level 0 is
+  available until the simplification is completed. */
+  int nbLevels() const { return levels_.size(); }
+  int nbTriangles(int level) const;
+  qreal levelError(int level) const;
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  /*! Returns the projected levelError(), in pixels, tolerated by draw().
+  Default value is 2.0. Larger values draw fewer triangles. */
+  qreal maximumScreenSpaceError() const { return maximumScreenSpaceError_; }
+  /*! Sets the maximumScreenSpaceError(). */
+  void setMaximumScreenSpaceError(qreal error) {
+    maximumScreenSpaceError_ = qMax(error, qreal(0.0));
+  }
+
+  int selectLevel(const Camera *camera, const Frame *frame = nullptr);
+  void draw(const Camera *camera, const Frame *frame = nullptr);
+  void drawLevel(int level);
+  void cleanupGL();
+
+  /*! Returns the level drawn by the last draw() or drawLevel(), -1 if none. */
+  int drawnLevel() const { return drawnLevel_; }
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted, from the simplification thread, when the simplified
+  levels are computed. The next draw() will use them: connect this signal to
+  your viewer's \c update() slot (QGLViewer::addLodMesh() does it). */
+  void levelsReady();
+
+private:
+  Q_DISABLE_COPY(LodMesh)
+
+  struct Level {
+    QVector<float> vertices; // position and normal, six floats per vertex
+    QVector<quint32> indices;
+    qreal error;
+    QOpenGLBuffer *vertexBuffer; // nullptr until the first drawLevel()
+    QOpenGLBuffer *indexBuffer;
+  };
+
+  void setMesh(const float *positions, int stride, int nbVertices,
+               const quint32 *indices, int nbIndices);
+  void startSimplification(const QVector<double> &positions,
+                           const QVector<quint32> &triangles);
+  void adoptSimplifiedLevels();
+  static void makeLevel(const double *positions, int nbVertices,
+                        const quint32 *triangles, int nbTriangles, qreal error,
+                        Level &level);
+  static void releaseLevel(Level &level);
+
+  QVector<Level> levels_;
+  Vec center_;
+  qreal radius_;
+
+  int maximumNumberOfLevels_;
+  qreal reductionRatio_;
+  qreal maximumScreenSpaceError_;
+  int drawnLevel_;
+
+  // S i m p l i f i c a t i o n   t h r e a d
+  QThreadPool *threadPool_;
+  // Incremented by setMesh() and clear(): a running simplification of a
+  // previous revision is aborted
+  QAtomicInt revision_;
+  bool simplificationIsRunning_;
+  QMutex simplifiedMutex_;
+  QVector<Level> simplifiedLevels_; // protected by simplifiedMutex_
+  bool simplifiedLevelsAreReady_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_LOD_MESH_H
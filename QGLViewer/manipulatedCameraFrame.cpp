@@ -2,11 +2,16 @@
 #include "domUtils.h"
 #include "qglviewer.h"
 
+#include <QDataStream>
 #include <QMouseEvent>
 
 using namespace qglviewer;
 using namespace std;
 
+// Period of the fly mode motion, in milliseconds. flySpeed() is the
+// displacement per period.
+static const int flyUpdateInterval = 10;
+
 /*! Default constructor.
 
  flySpeed() is set to 0.0 and sceneUpVector() is (0,1,0). The pivotPoint() is
@@ -14,7 +19,7 @@ using namespace std;
 
   \attention Created object is removeFromMouseGrabberPool(). */
 ManipulatedCameraFrame::ManipulatedCameraFrame()
-    : driveSpeed_(0.0), sceneUpVector_(0.0, 1.0, 0.0),
+    : driveSpeed_(0.0), sceneUpVector_(0.0, 1.0, 0.0), isFlying_(false),
       rotatesAroundUpVector_(false), zoomsOnPivotPoint_(false) {
   setFlySpeed(0.0);
   removeFromMouseGrabberPool();
@@ -38,7 +43,7 @@ operator=(const ManipulatedCameraFrame &mcf) {
 /*! Copy constructor. Performs a deep copy of all members using operator=(). */
 ManipulatedCameraFrame::ManipulatedCameraFrame(
     const ManipulatedCameraFrame &mcf)
-    : ManipulatedFrame(mcf) {
+    : ManipulatedFrame(mcf), isFlying_(false) {
   removeFromMouseGrabberPool();
   connect(&flyTimer_, SIGNAL(timeout()), SLOT(flyUpdate()));
   (*this) = (mcf);
@@ -54,29 +59,51 @@ void ManipulatedCameraFrame::spin() {
   rotateAroundPoint(spinningQuaternion(), pivotPoint());
 }
 
-#ifndef DOXYGEN
-/*! Called for continuous frame motion in fly mode (see
-  QGLViewer::MOVE_FORWARD). Emits manipulated(). */
-void ManipulatedCameraFrame::flyUpdate() {
-  static Vec flyDisp(0.0, 0.0, 0.0);
+/*! Overloading of ManipulatedFrame::isAnimated(). Also returns \c true
+during the fly mode motions (QGLViewer::MOVE_FORWARD, QGLViewer::MOVE_BACKWARD
+and QGLViewer::DRIVE). */
+bool ManipulatedCameraFrame::isAnimated() const {
+  return isFlying_ || ManipulatedFrame::isAnimated();
+}
+
+/*! Overloading of ManipulatedFrame::advance(). The fly mode motion is
+advanced by \p elapsed milliseconds, at the same speed as with the frame own
+timer, and manipulated() is emitted. */
+void ManipulatedCameraFrame::advance(int elapsed) {
+  ManipulatedFrame::advance(elapsed);
+
+  if (isFlying_ && animationClock()) {
+    fly(qreal(elapsed) / flyUpdateInterval);
+    Q_EMIT manipulated();
+  }
+}
+
+// Moves the frame by nbUpdates fly mode updates
+void ManipulatedCameraFrame::fly(qreal nbUpdates) {
+  Vec flyDisp(0.0, 0.0, 0.0);
   switch (action_) {
   case QGLViewer::MOVE_FORWARD:
     flyDisp.z = -flySpeed();
-    translate(localInverseTransformOf(flyDisp));
     break;
   case QGLViewer::MOVE_BACKWARD:
     flyDisp.z = flySpeed();
-    translate(localInverseTransformOf(flyDisp));
     break;
   case QGLViewer::DRIVE:
     flyDisp.z = flySpeed() * driveSpeed_;
-    translate(localInverseTransformOf(flyDisp));
     break;
   default:
-    break;
+    return;
   }
+  translate(localInverseTransformOf(nbUpdates * flyDisp));
+}
+
+#ifndef DOXYGEN
+/*! Called for continuous frame motion in fly mode (see
+  QGLViewer::MOVE_FORWARD). Emits manipulated(). */
+void ManipulatedCameraFrame::flyUpdate() {
+  fly(1.0);
 
-  // Needs to be out of the switch since ZOOM/fastDraw()/wheelEvent use this
+  // Needs to be out of fly() since ZOOM/fastDraw()/wheelEvent use this
   // callback to trigger a final draw(). #CONNECTION# wheelEvent.
   Q_EMIT manipulated();
 }
@@ -162,6 +189,33 @@ void ManipulatedCameraFrame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the ManipulatedCameraFrame state in \p stream, appending its
+specific parameters to ManipulatedFrame::writeBinary(). Binary equivalent of
+domElement(). */
+void ManipulatedCameraFrame::writeBinary(QDataStream &stream) const {
+  ManipulatedFrame::writeBinary(stream);
+  stream << double(flySpeed()) << rotatesAroundUpVector() << zoomsOnPivotPoint()
+         << sceneUpVector();
+}
+
+/*! Restores the ManipulatedCameraFrame state from a \p stream written by
+writeBinary(). Binary equivalent of initFromDOMElement(). */
+void ManipulatedCameraFrame::readBinary(QDataStream &stream) {
+  ManipulatedFrame::readBinary(stream);
+
+  double speed;
+  bool aroundUpVector, onPivotPoint;
+  Vec upVector;
+  stream >> speed >> aroundUpVector >> onPivotPoint >> upVector;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setFlySpeed(speed);
+  setRotatesAroundUpVector(aroundUpVector);
+  setZoomsOnPivotPoint(onPivotPoint);
+  setSceneUpVector(upVector);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                 M o u s e    h a n d l i n g                               //
 ////////////////////////////////////////////////////////////////////////////////
@@ -175,8 +229,13 @@ void ManipulatedCameraFrame::startAction(int ma, bool withConstraint) {
   case QGLViewer::MOVE_FORWARD:
   case QGLViewer::MOVE_BACKWARD:
   case QGLViewer::DRIVE:
-    flyTimer_.setSingleShot(false);
-    flyTimer_.start(10);
+    isFlying_ = true;
+    if (animationClock())
+      updateAnimationClock();
+    else {
+      flyTimer_.setSingleShot(false);
+      flyTimer_.start(flyUpdateInterval);
+    }
     break;
   case QGLViewer::ROTATE:
     constrainedRotationIsReversed_ = transformOf(sceneUpVector_).y < 0.0;
@@ -194,7 +253,8 @@ void ManipulatedCameraFrame::zoom(qreal delta, const Camera *const camera) {
       translate(delta * direction);
   } else {
     const qreal coef =
-        qMax(fabs((camera->frame()->coordinatesOf(camera->pivotPoint())).z),
+        qMax(qreal(fabs(
+                 (camera->frame()->coordinatesOf(camera->pivotPoint())).z)),
              qreal(0.2) * sceneRadius);
     Vec trans(0.0, 0.0, -coef * delta);
     translate(inverseTransformOf(trans));
@@ -414,8 +474,11 @@ void ManipulatedCameraFrame::mouseMoveEvent(QMouseEvent *const event,
 void ManipulatedCameraFrame::mouseReleaseEvent(QMouseEvent *const event,
                                                Camera *const camera) {
   if ((action_ == QGLViewer::MOVE_FORWARD) ||
-      (action_ == QGLViewer::MOVE_BACKWARD) || (action_ == QGLViewer::DRIVE))
+      (action_ == QGLViewer::MOVE_BACKWARD) || (action_ == QGLViewer::DRIVE)) {
     flyTimer_.stop();
+    isFlying_ = false;
+    updateAnimationClock();
+  }
 
   if (action_ == QGLViewer::ZOOM_ON_REGION)
     camera->fitScreenRegion(QRect(pressPos_, event->pos()));
@@ -194,6 +194,14 @@ protected Q_SLOTS:
   virtual void spin();
   //@}
 
+  /*! @name Animation clock */
+  //@{
+protected:
+  virtual bool isAnimated() const;
+protected Q_SLOTS:
+  virtual void advance(int elapsed);
+  //@}
+
   /*! @name XML representation */
   //@{
 public:
@@ -201,6 +209,13 @@ public:
                                  QDomDocument &document) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  //@}
+
+  /*! @name Binary representation */
+  //@{
+public:
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
 //@}
 
 #ifndef DOXYGEN
@@ -214,6 +229,7 @@ private Q_SLOTS:
   virtual void flyUpdate();
 
 private:
+  void fly(qreal nbUpdates);
   void updateSceneUpVector();
   Quaternion turnQuaternion(int x, const Camera *const camera);
   Quaternion pitchYawQuaternion(int x, int y, const Camera *const camera);
@@ -224,6 +240,7 @@ private:
   qreal driveSpeed_;
   Vec sceneUpVector_;
   QTimer flyTimer_;
+  bool isFlying_;
 
   bool rotatesAroundUpVector_;
   // Inverse the direction of an horizontal mouse motion. Depends on the
@@ -4,6 +4,8 @@
 #include "manipulatedCameraFrame.h"
 #include "qglviewer.h"
 
+#include <QDataStream>
+
 #include <cstdlib>
 
 #include <QMouseEvent>
@@ -11,6 +13,9 @@
 using namespace qglviewer;
 using namespace std;
 
+// Half size, in pixels, of the square mouse grabbing region
+static const int mouseGrabThreshold = 10;
+
 /*! Default constructor.
 
   The translation is set to (0,0,0), with an identity rotation (0,0,0,1) (see
@@ -20,7 +25,8 @@ using namespace std;
   rotationSensitivity(), translationSensitivity(), spinningSensitivity() and
   wheelSensitivity()). */
 ManipulatedFrame::ManipulatedFrame()
-    : action_(QGLViewer::NO_MOUSE_ACTION), keepsGrabbingMouse_(false) {
+    : action_(QGLViewer::NO_MOUSE_ACTION), spinningInterval_(0),
+      spinningTime_(0), keepsGrabbingMouse_(false) {
   // #CONNECTION# initFromDOMElement and accessor docs
   setRotationSensitivity(1.0);
   setTranslationSensitivity(1.0);
@@ -32,6 +38,7 @@ ManipulatedFrame::ManipulatedFrame()
   previousConstraint_ = nullptr;
 
   connect(&spinningTimer_, SIGNAL(timeout()), SLOT(spinUpdate()));
+  connect(this, SIGNAL(modified()), SLOT(invalidateMouseGrabRegion()));
 }
 
 /*! Equal operator. Calls Frame::operator=() and then copy attributes. */
@@ -55,7 +62,7 @@ ManipulatedFrame &ManipulatedFrame::operator=(const ManipulatedFrame &mf) {
 /*! Copy constructor. Performs a deep copy of all attributes using operator=().
  */
 ManipulatedFrame::ManipulatedFrame(const ManipulatedFrame &mf)
-    : Frame(mf), MouseGrabber() {
+    : Frame(mf), MouseGrabber(), spinningInterval_(0), spinningTime_(0) {
   (*this) = mf;
 }
 
@@ -70,10 +77,33 @@ See the <a href="../examples/mouseGrabber.html">mouseGrabber example</a> for an
 illustration. */
 void ManipulatedFrame::checkIfGrabsMouse(int x, int y,
                                          const Camera *const camera) {
-  const int thresold = 10;
   const Vec proj = camera->projectedCoordinatesOf(position());
-  setGrabsMouse(keepsGrabbingMouse_ || ((fabs(x - proj.x) < thresold) &&
-                                        (fabs(y - proj.y) < thresold)));
+  setGrabsMouse(keepsGrabbingMouse_ ||
+                ((fabs(x - proj.x) < mouseGrabThreshold) &&
+                 (fabs(y - proj.y) < mouseGrabThreshold)));
+}
+
+/*! Returns the square region tested by checkIfGrabsMouse(), centered on the
+Camera::projectedCoordinatesOf() position().
+
+Returns \c false while the ManipulatedFrame keeps grabbing the mouse after a
+press, since it then grabs the mouse anywhere.
+
+\attention The modified() signal is not emitted when a referenceFrame() is
+moved: call mouseGrabRegionModified() in that case if the ManipulatedFrame is
+indexed (see QGLViewer::mouseGrabberIndexIsEnabled()). Overload this method
+when you overload checkIfGrabsMouse(). */
+bool ManipulatedFrame::mouseGrabRegion(const Camera *const camera,
+                                       QRect &region) const {
+  if (keepsGrabbingMouse_)
+    return false;
+
+  const Vec proj = camera->projectedCoordinatesOf(position());
+  region = QRect(QPoint(int(floor(proj.x)) - mouseGrabThreshold,
+                        int(floor(proj.y)) - mouseGrabThreshold),
+                 QPoint(int(ceil(proj.x)) + mouseGrabThreshold,
+                        int(ceil(proj.y)) + mouseGrabThreshold));
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -139,6 +169,35 @@ void ManipulatedFrame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the ManipulatedFrame state in \p stream, appending the
+ManipulatedFrame sensitivities to Frame::writeBinary(). Binary equivalent of
+domElement(). */
+void ManipulatedFrame::writeBinary(QDataStream &stream) const {
+  Frame::writeBinary(stream);
+  stream << double(rotationSensitivity()) << double(translationSensitivity())
+         << double(spinningSensitivity()) << double(wheelSensitivity())
+         << double(zoomSensitivity());
+}
+
+/*! Restores the ManipulatedFrame state from a \p stream written by
+writeBinary(). Binary equivalent of initFromDOMElement(). */
+void ManipulatedFrame::readBinary(QDataStream &stream) {
+  Frame::readBinary(stream);
+
+  stopSpinning();
+
+  double rotSens, transSens, spinSens, wheelSens, zoomSens;
+  stream >> rotSens >> transSens >> spinSens >> wheelSens >> zoomSens;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setRotationSensitivity(rotSens);
+  setTranslationSensitivity(transSens);
+  setSpinningSensitivity(spinSens);
+  setWheelSensitivity(wheelSens);
+  setZoomSensitivity(zoomSens);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                 M o u s e    h a n d l i n g                               //
 ////////////////////////////////////////////////////////////////////////////////
@@ -161,10 +220,26 @@ bool ManipulatedFrame::isManipulated() const {
 
 This method starts a timer that will call spin() every \p updateInterval
 milliseconds. The ManipulatedFrame isSpinning() until you call stopSpinning().
-*/
+
+With an animationClock(), spin() is instead called at each clock tick, as many
+times as \p updateInterval fits in the elapsed time, so that the spinning
+speed is preserved. */
 void ManipulatedFrame::startSpinning(int updateInterval) {
   isSpinning_ = true;
-  spinningTimer_.start(updateInterval);
+  spinningInterval_ = updateInterval;
+  spinningTime_ = 0;
+  if (animationClock_)
+    updateAnimationClock();
+  else
+    spinningTimer_.start(updateInterval);
+}
+
+/*! Stops the spinning motion started using startSpinning(). isSpinning() will
+  return \c false after this call. */
+void ManipulatedFrame::stopSpinning() {
+  spinningTimer_.stop();
+  isSpinning_ = false;
+  updateAnimationClock();
 }
 
 /*! Rotates the ManipulatedFrame by its spinningQuaternion(). Called by a timer
@@ -180,6 +255,70 @@ void ManipulatedFrame::spinUpdate() {
   Q_EMIT spun();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//                 A n i m a t i o n   c l o c k                              //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the animationClock(). Use \c nullptr to use a timer owned by the
+ManipulatedFrame instead. A current spinning continues with the new clock. */
+void ManipulatedFrame::setAnimationClock(AnimationClock *clock) {
+  if (clock == animationClock_)
+    return;
+
+  if (animationClock_) {
+    disconnect(animationClock_, SIGNAL(tick(int)), this, SLOT(advance(int)));
+    animationClock_->stop(this);
+  }
+
+  animationClock_ = clock;
+
+  if (clock)
+    connect(clock, SIGNAL(tick(int)), SLOT(advance(int)));
+
+  if (isSpinning()) {
+    if (clock)
+      spinningTimer_.stop();
+    else
+      spinningTimer_.start(spinningInterval_);
+  }
+  updateAnimationClock();
+}
+
+/*! Starts or stops the animationClock() according to isAnimated(). Call this
+method when the result of your isAnimated() overload changes. */
+void ManipulatedFrame::updateAnimationClock() {
+  if (!animationClock_)
+    return;
+
+  if (isAnimated())
+    animationClock_->start(this);
+  else
+    animationClock_->stop(this);
+}
+
+/*! Advances the motions of the ManipulatedFrame by \p elapsed milliseconds.
+Called at each animationClock() tick.
+
+When it isSpinning(), spin() is called once per spinning update interval (see
+startSpinning()) contained in \p elapsed, and spun() is emitted once. */
+void ManipulatedFrame::advance(int elapsed) {
+  if (!isSpinning() || !animationClock_)
+    return;
+
+  int nbSpins = 1;
+  if (spinningInterval_ > 0) {
+    spinningTime_ += elapsed;
+    nbSpins = spinningTime_ / spinningInterval_;
+    spinningTime_ -= nbSpins * spinningInterval_;
+  }
+
+  if (nbSpins > 0) {
+    for (int i = 0; i < nbSpins; ++i)
+      spin();
+    Q_EMIT spun();
+  }
+}
+
 #ifndef DOXYGEN
 /*! Protected internal method used to handle mouse events. */
 void ManipulatedFrame::startAction(int ma, bool withConstraint) {
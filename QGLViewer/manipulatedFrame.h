@@ -1,13 +1,15 @@
 #ifndef QGLVIEWER_MANIPULATED_FRAME_H
 #define QGLVIEWER_MANIPULATED_FRAME_H
 
+#include "animationClock.h"
 #include "frame.h"
 #include "mouseGrabber.h"
 #include "qglviewer.h"
 
 #include <QDateTime>
-#include <QString>
 #include <QElapsedTimer>
+#include <QPointer>
+#include <QString>
 
 namespace qglviewer {
 /*! \brief A ManipulatedFrame is a Frame that can be rotated and translated
@@ -239,16 +241,35 @@ public Q_SLOTS:
     spinningQuaternion_ = spinningQuaternion;
   }
   virtual void startSpinning(int updateInterval);
-  /*! Stops the spinning motion started using startSpinning(). isSpinning() will
-    return \c false after this call. */
-  virtual void stopSpinning() {
-    spinningTimer_.stop();
-    isSpinning_ = false;
-  }
+  virtual void stopSpinning();
 protected Q_SLOTS:
   virtual void spin();
 private Q_SLOTS:
   void spinUpdate();
+  void invalidateMouseGrabRegion() { mouseGrabRegionModified(); }
+  //@}
+
+  /*! @name Animation clock */
+  //@{
+public:
+  /*! Returns the AnimationClock that drives the spinning of the
+  ManipulatedFrame, or \c nullptr (default) when it uses its own timer.
+
+  The ManipulatedFrame is attached to the QGLViewer::animationClock() by
+  QGLViewer::setManipulatedFrame() (and by QGLViewer::setCamera() when it is a
+  Camera::frame()). */
+  AnimationClock *animationClock() const { return animationClock_; }
+public Q_SLOTS:
+  void setAnimationClock(AnimationClock *clock);
+
+protected:
+  /*! Returns \c true when the ManipulatedFrame needs the animationClock()
+  ticks. Default implementation returns isSpinning(). Overload this method
+  together with advance() for other continuous motions. */
+  virtual bool isAnimated() const { return isSpinning(); }
+  void updateAnimationClock();
+protected Q_SLOTS:
+  virtual void advance(int elapsed);
   //@}
 
   /*! @name Mouse event handlers */
@@ -284,6 +305,8 @@ public:
   //@{
 public:
   virtual void checkIfGrabsMouse(int x, int y, const Camera *const camera);
+  virtual bool mouseGrabRegion(const Camera *const camera,
+                               QRect &region) const;
   //@}
 
   /*! @name XML representation */
@@ -293,6 +316,13 @@ public:
                                  QDomDocument &document) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  //@}
+
+  /*! @name Binary representation */
+  //@{
+public:
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
 //@}
 
 #ifndef DOXYGEN
@@ -339,6 +369,11 @@ private:
   bool isSpinning_;
   QTimer spinningTimer_;
   Quaternion spinningQuaternion_;
+  // startSpinning() interval, and time not yet spun with the animationClock()
+  int spinningInterval_;
+  int spinningTime_;
+
+  QPointer<AnimationClock> animationClock_;
 
   // Whether the SCREEN_TRANS direction (horizontal or vertical) is fixed or
   // not.
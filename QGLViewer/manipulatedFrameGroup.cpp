@@ -0,0 +1,78 @@
+#include "manipulatedFrameGroup.h"
+#include "frame.h"
+#include "hotPathCounters.h"
+
+using namespace qglviewer;
+
+/*! Creates an empty ManipulatedFrameGroup, which blocksFrameSignals(). */
+ManipulatedFrameGroup::ManipulatedFrameGroup(QObject *parent)
+    : QObject(parent), blocksFrameSignals_(true) {}
+
+/*! Appends \p frame to the group. \c nullptr and already present frames are
+silently ignored. */
+void ManipulatedFrameGroup::addFrame(Frame *const frame) {
+  if (frame && !frames_.contains(frame))
+    frames_.append(frame);
+}
+
+/*! Removes \p frame from the group. The frame is not deleted. */
+void ManipulatedFrameGroup::removeFrame(Frame *const frame) {
+  frames_.removeOne(frame);
+}
+
+/*! Applies \p translation, expressed in the leading \p frame reference
+coordinate system, to all the frames of the group. \p translation is not
+modified. */
+void ManipulatedFrameGroup::constrainTranslation(Vec &translation,
+                                                 Frame *const frame) {
+  const Vec worldTranslation =
+      frame->referenceFrame()
+          ? frame->referenceFrame()->inverseTransformOf(translation)
+          : translation;
+  applyDisplacement(frame, Quaternion(), Vec(), worldTranslation);
+}
+
+/*! Applies \p rotation, expressed in the leading \p frame coordinate system,
+to all the frames of the group. The rotation is centered on the \p frame
+position(). \p rotation is not modified. */
+void ManipulatedFrameGroup::constrainRotation(Quaternion &rotation,
+                                              Frame *const frame) {
+  const Quaternion worldRotation(frame->inverseTransformOf(rotation.axis()),
+                                 rotation.angle());
+  applyDisplacement(frame, worldRotation, frame->position(), Vec());
+}
+
+// Rotates the frames by rotation around center, then translates them, all in
+// world coordinates. The rotation matrix is computed once for the set.
+void ManipulatedFrameGroup::applyDisplacement(const Frame *const leader,
+                                              const Quaternion &rotation,
+                                              const Vec &center,
+                                              const Vec &translation) {
+  qreal m[3][3];
+  rotation.getRotationMatrix(m);
+  const Vec offset = center + translation;
+
+  for (int i = 0; i < frames_.size(); ++i) {
+    Frame *const fr = frames_[i];
+    if (fr == leader)
+      continue;
+
+    const Vec p = fr->position() - center;
+    const Vec position(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z,
+                       m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z,
+                       m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z);
+    Quaternion orientation = rotation * fr->orientation();
+    orientation.normalize(); // Prevents numerical drift
+
+    const bool wasBlocked = blocksFrameSignals_ && fr->blockSignals(true);
+    if (fr->referenceFrame())
+      fr->setPositionAndOrientation(offset + position, orientation);
+    else
+      fr->setTranslationAndRotation(offset + position, orientation);
+    if (blocksFrameSignals_)
+      fr->blockSignals(wasBlocked);
+  }
+
+  QGLVIEWER_COUNT(FRAME_MODIFIED);
+  Q_EMIT modified();
+}
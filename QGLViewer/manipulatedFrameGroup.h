@@ -0,0 +1,102 @@
+#ifndef QGLVIEWER_MANIPULATED_FRAME_GROUP_H
+#define QGLVIEWER_MANIPULATED_FRAME_GROUP_H
+
+#include <QObject>
+#include <QVector>
+
+#include "constraint.h"
+
+namespace qglviewer {
+/*! \brief Applies the displacements of a ManipulatedFrame to a set of Frames.
+  \class ManipulatedFrameGroup manipulatedFrameGroup.h
+  QGLViewer/manipulatedFrameGroup.h
+
+  A ManipulatedFrameGroup is a Constraint that is set to a leading
+  ManipulatedFrame, typically the QGLViewer::manipulatedFrame(). Each
+  translation or rotation of the leading frame is then applied to all the
+  frames of the group, as a rigid motion of the set. The rotations are centered
+  on the leading frame position.
+  \code
+  // In the viewer init()
+  setManipulatedFrame(new ManipulatedFrame());
+  group = new ManipulatedFrameGroup(this);
+  manipulatedFrame()->setConstraint(group);
+
+  // When the selection changes
+  group->clear();
+  Q_FOREACH (Object *o, selectedObjects)
+    group->addFrame(&o->frame);
+  \endcode
+
+  The displacement is converted once to the world coordinate system and
+  applied in a single loop. When blocksFrameSignals() is \c true (default),
+  the frames of the group do not emit their Frame::modified() signal: a single
+  modified() signal is emitted by the group once all its frames have moved,
+  and the leading ManipulatedFrame emits one ManipulatedFrame::manipulated()
+  per mouse event, that the QGLViewer connects to its update() slot.
+
+  The leading frame is never included in the displacement, even if it belongs
+  to the group. The Frame::constraint() of the frames of the group are
+  ignored. See the <a href="../examples/multiSelect.html">multiSelect
+  example</a> for an illustration. */
+class QGLVIEWER_EXPORT ManipulatedFrameGroup : public QObject,
+                                               public Constraint {
+  Q_OBJECT
+
+public:
+  ManipulatedFrameGroup(QObject *parent = nullptr);
+  /*! Virtual destructor. The frames of the group are not deleted. */
+  virtual ~ManipulatedFrameGroup() {}
+
+  /*! @name Frames of the group */
+  //@{
+public:
+  void addFrame(Frame *const frame);
+  void removeFrame(Frame *const frame);
+  /*! Removes all the frames of the group. They are not deleted. */
+  void clear() { frames_.clear(); }
+
+  /*! Returns the number of frames of the group. */
+  int numberOfFrames() const { return frames_.size(); }
+  /*! Returns the \p index-th frame of the group, in insertion order. */
+  Frame *frame(int index) const { return frames_.at(index); }
+  //@}
+
+  /*! @name Signals of the frames */
+  //@{
+public:
+  /*! Returns \c true when the Frame::modified() signals of the frames of the
+  group are blocked while they are displaced. Default value is \c true.
+
+  Objects connected to these signals, such as the KeyFrameInterpolators that
+  use these frames as keyFrames, are then not notified of the displacement.
+  Connect them to the modified() signal of the group instead, or set this
+  value to \c false. */
+  bool blocksFrameSignals() const { return blocksFrameSignals_; }
+  /*! Sets the blocksFrameSignals() value. */
+  void setBlocksFrameSignals(bool blocks) { blocksFrameSignals_ = blocks; }
+  //@}
+
+Q_SIGNALS:
+  /*! This signal is emitted once all the frames of the group have been
+  displaced, i.e. once per translation or rotation of the leading frame. */
+  void modified();
+
+  /*! @name Constraint implementation */
+  //@{
+public:
+  virtual void constrainTranslation(Vec &translation, Frame *const frame);
+  virtual void constrainRotation(Quaternion &rotation, Frame *const frame);
+  //@}
+
+private:
+  void applyDisplacement(const Frame *const leader, const Quaternion &rotation,
+                         const Vec &center, const Vec &translation);
+
+  QVector<Frame *> frames_;
+  bool blocksFrameSignals_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MANIPULATED_FRAME_GROUP_H
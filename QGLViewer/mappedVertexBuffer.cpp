@@ -0,0 +1,194 @@
+#include "mappedVertexBuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <cstring>
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+using namespace qglviewer;
+
+/*! Creates an empty MappedVertexBuffer. Use create() to allocate it. */
+MappedVertexBuffer::MappedVertexBuffer()
+    : context_(nullptr), functions_(nullptr), buffer_(0), mapped_(nullptr),
+      size_(0), regionSize_(0), writeRegion_(0), drawRegion_(-1) {
+  for (int i = 0; i < nbRegions; ++i)
+    fences_[i] = nullptr;
+}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+create() is current. Call cleanupGL() before otherwise. */
+MappedVertexBuffer::~MappedVertexBuffer() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Allocates a buffer of \p size bytes, initialized to zero. An OpenGL context
+must be current. The previous content of the buffer is lost.
+
+Returns \c false when no context is current or when \p size is not positive.
+The buffer then uses client memory when the persistent mapping is not
+available (see isMapped()). */
+bool MappedVertexBuffer::create(int size) {
+  cleanupGL();
+  clientData_.clear();
+  size_ = 0;
+
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context || (size <= 0)) {
+    qWarning("MappedVertexBuffer::create: invalid size or no current OpenGL "
+             "context");
+    return false;
+  }
+  context_ = context;
+  size_ = size;
+
+  typedef void(QOPENGLF_APIENTRYP BufferStorage)(
+      GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+  BufferStorage bufferStorage = nullptr;
+  if (!context->isOpenGLES() &&
+      ((context->format().version() >= qMakePair(4, 4)) ||
+       context->hasExtension("GL_ARB_buffer_storage")))
+    bufferStorage = reinterpret_cast<BufferStorage>(
+        context->getProcAddress("glBufferStorage"));
+
+  if (bufferStorage) {
+    functions_ = context->extraFunctions();
+    // Regions are aligned for any vertex attribute type
+    regionSize_ = (size + 255) & ~255;
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    functions_->glGenBuffers(1, &buffer_);
+    functions_->glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    bufferStorage(GL_ARRAY_BUFFER, nbRegions * regionSize_, nullptr, flags);
+    mapped_ = static_cast<char *>(functions_->glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, nbRegions * regionSize_, flags));
+    functions_->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mapped_)
+      memset(mapped_, 0, nbRegions * regionSize_);
+    else {
+      qWarning("MappedVertexBuffer::create: unable to map the buffer, using "
+               "client memory");
+      functions_->glDeleteBuffers(1, &buffer_);
+      buffer_ = 0;
+    }
+  }
+
+  if (!mapped_)
+    clientData_.fill(0, size);
+  writeRegion_ = 0;
+  drawRegion_ = -1;
+  return true;
+}
+
+/*! Releases the OpenGL buffer. The context used by create() must be current.
+size() is then 0 until the next create(). */
+void MappedVertexBuffer::cleanupGL() {
+  if (functions_) {
+    for (int i = 0; i < nbRegions; ++i)
+      if (fences_[i])
+        functions_->glDeleteSync(fences_[i]);
+    // Deleting the buffer also unmaps it
+    if (buffer_)
+      functions_->glDeleteBuffers(1, &buffer_);
+  }
+
+  for (int i = 0; i < nbRegions; ++i)
+    fences_[i] = nullptr;
+  buffer_ = 0;
+  mapped_ = nullptr;
+  clientData_.clear();
+  functions_ = nullptr;
+  context_ = nullptr;
+  size_ = 0;
+  drawRegion_ = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Write and draw                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the memory where the next vertices should be written, size() bytes
+long. The OpenGL context must be current, unless isMapped() is \c false.
+
+The returned memory is not read by OpenGL until endWrite() is called: bind()
+still uses the previously written vertices. Several beginWrite() calls before
+endWrite() return the same memory, which keeps its content. Returns \c nullptr
+before create(). */
+void *MappedVertexBuffer::beginWrite() {
+  if (!mapped_)
+    return clientData_.isEmpty() ? nullptr : clientData_.data();
+
+  waitForRegion(writeRegion_);
+  return mapped_ + writeRegion_ * regionSize_;
+}
+
+/*! Makes the vertices written since beginWrite() the ones used by the next
+bind(). The next beginWrite() returns a different memory region, whose content
+is not preserved. */
+void MappedVertexBuffer::endWrite() {
+  if (!mapped_)
+    return;
+
+  drawRegion_ = writeRegion_;
+  writeRegion_ = (writeRegion_ + 1) % nbRegions;
+}
+
+/*! Binds the buffer as the current \c GL_ARRAY_BUFFER and returns the pointer
+to give to \c glVertexPointer() (or other OpenGL array pointer functions) to
+use the last vertices completed by endWrite(). This is an offset in the
+buffer, or a client memory pointer when isMapped() is \c false.
+
+Call release() once the draw calls that use the vertices are issued. */
+const void *MappedVertexBuffer::bind() {
+  if (!mapped_)
+    return clientData_.isEmpty() ? nullptr : clientData_.constData();
+
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+  return reinterpret_cast<const void *>(
+      static_cast<quintptr>(qMax(drawRegion_, 0) * regionSize_));
+}
+
+/*! Unbinds the buffer. The drawn region will not be returned by beginWrite()
+before OpenGL has finished reading it. */
+void MappedVertexBuffer::release() {
+  if (!mapped_)
+    return;
+
+  if (drawRegion_ >= 0) {
+    // Commands complete in order: the last fence covers all the draws
+    if (fences_[drawRegion_])
+      functions_->glDeleteSync(fences_[drawRegion_]);
+    fences_[drawRegion_] =
+        functions_->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Blocks until the draws that read region are completed. Usually immediate,
+// the region having been drawn two frames ago.
+void MappedVertexBuffer::waitForRegion(int region) {
+  if (!fences_[region])
+    return;
+
+  GLenum status = GL_TIMEOUT_EXPIRED;
+  while (status == GL_TIMEOUT_EXPIRED)
+    status = functions_->glClientWaitSync(
+        fences_[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 second
+  if (status == GL_WAIT_FAILED)
+    qWarning("MappedVertexBuffer::beginWrite: wait for OpenGL failed");
+
+  functions_->glDeleteSync(fences_[region]);
+  fences_[region] = nullptr;
+}
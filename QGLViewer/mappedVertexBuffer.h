@@ -0,0 +1,110 @@
+#ifndef QGLVIEWER_MAPPED_VERTEX_BUFFER_H
+#define QGLVIEWER_MAPPED_VERTEX_BUFFER_H
+
+#include <QByteArray>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+/*! \brief A vertex buffer that stays mapped in memory, written by
+  QGLViewer::animate() and drawn without copy.
+  \class MappedVertexBuffer mappedVertexBuffer.h QGLViewer/mappedVertexBuffer.h
+
+  Animated vertices (particles, deformed meshes...) are usually computed in
+  animate() and then sent to OpenGL one by one in draw(). A MappedVertexBuffer
+  is an OpenGL buffer that is persistently mapped in the application memory:
+  animate() writes the vertices directly in the buffer memory (possibly from
+  several threads, see QGLViewer::parallelFor()), and draw() renders them in a
+  single call:
+  \code
+  void Viewer::init() {
+    buffer_.create(nbParticles * 3 * sizeof(GLfloat));
+  }
+
+  void Viewer::animate() {
+    makeCurrent();
+    GLfloat *vertices = static_cast<GLfloat *>(buffer_.beginWrite());
+    parallelFor(nbParticles, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        particle_[i].animate();
+        particle_[i].getPosition(vertices + 3 * i);
+      }
+    });
+    buffer_.endWrite();
+    doneCurrent();
+  }
+
+  void Viewer::draw() {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, buffer_.bind());
+    glDrawArrays(GL_POINTS, 0, nbParticles);
+    buffer_.release();
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+  \endcode
+
+  The buffer memory is divided into three regions, so that a region is written
+  while the previously written ones are possibly still read by the GPU. Fences
+  ensure that a region is no longer used when beginWrite() returns it.
+
+  The persistent mapping requires OpenGL 4.4 or the \c GL_ARB_buffer_storage
+  extension. Otherwise, the vertices are stored in client memory, and bind()
+  returns a client memory pointer that can be used the same way.
+
+  The OpenGL methods (create(), beginWrite(), bind(), release() and cleanupGL())
+  must be called with the same context current. Call cleanupGL() with this
+  context current before the MappedVertexBuffer is destroyed. */
+class QGLVIEWER_EXPORT MappedVertexBuffer {
+public:
+  MappedVertexBuffer();
+  ~MappedVertexBuffer();
+
+  /*! @name Creation */
+  //@{
+public:
+  bool create(int size);
+  void cleanupGL();
+
+  /*! Returns the size of the buffer, in bytes, as given to create(). Returns 0
+  before create(). */
+  int size() const { return size_; }
+  /*! Returns \c true when the buffer is persistently mapped, and \c false when
+  client memory is used instead. */
+  bool isMapped() const { return mapped_ != nullptr; }
+  //@}
+
+  /*! @name Write and draw */
+  //@{
+public:
+  void *beginWrite();
+  void endWrite();
+
+  const void *bind();
+  void release();
+  //@}
+
+private:
+  Q_DISABLE_COPY(MappedVertexBuffer)
+
+  void waitForRegion(int region);
+
+  static const int nbRegions = 3;
+
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  GLuint buffer_;
+  char *mapped_;          // nullptr when clientData_ is used
+  QByteArray clientData_; // without persistent mapping
+  GLsync fences_[nbRegions];
+  int size_;
+  int regionSize_;
+  int writeRegion_;
+  int drawRegion_; // -1 until the first endWrite()
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MAPPED_VERTEX_BUFFER_H
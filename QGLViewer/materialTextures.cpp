@@ -0,0 +1,607 @@
+#include "materialTextures.h"
+#include "camera.h"
+
+#include <QMutexLocker>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+#ifndef GL_MAX_ARRAY_TEXTURE_LAYERS
+#define GL_MAX_ARRAY_TEXTURE_LAYERS 0x88FF
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+#ifndef GL_ARRAY_BUFFER_BINDING
+#define GL_ARRAY_BUFFER_BINDING 0x8894
+#endif
+
+using namespace qglviewer;
+
+namespace {
+typedef quint64(QOPENGLF_APIENTRYP GetTextureHandle)(GLuint texture);
+typedef void(QOPENGLF_APIENTRYP MakeTextureHandleResident)(quint64 handle);
+
+// Number of mipmap levels of a texture of this size, down to 1x1
+int nbLevels(const QSize &size) {
+  int nb = 1;
+  for (int s = qMax(size.width(), size.height()); s > 1; s /= 2)
+    ++nb;
+  return nb;
+}
+
+QSize levelSize(const QSize &size, int level) {
+  return QSize(qMax(size.width() >> level, 1), qMax(size.height() >> level, 1));
+}
+} // namespace
+
+/*! Creates an empty MaterialTextures. No OpenGL resource is created before the
+first update(). */
+MaterialTextures::MaterialTextures(QObject *parent)
+    : QObject(parent), memoryBudget_(128 * 1024 * 1024),
+      layerSize_(256, 256), maximumUploadsPerFrame_(4), frame_(0),
+      generation_(0), context_(nullptr), functions_(nullptr),
+      isSupported_(false), bindlessTexturesAreEnabled_(false),
+      textureArray_(0), materialBuffer_(0), materialBufferIsModified_(true),
+      maximumSlots_(0), whiteTexture_(0), whiteHandle_(0),
+      getTextureHandle_(nullptr), makeTextureHandleResident_(nullptr),
+      makeTextureHandleNonResident_(nullptr) {
+  threadPool_ = new QThreadPool(this);
+  threadPool_->setMaxThreadCount(2);
+}
+
+/*! Destructor. The images being decoded are waited for. The OpenGL resources
+are only released when the context used by update() is current. Call
+cleanupGL() before otherwise. */
+MaterialTextures::~MaterialTextures() {
+  threadPool_->clear();
+  threadPool_->waitForDone();
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Materials                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds a material whose texture is the image file \p fileName, and returns
+its id, the index of its MaterialEntry in the materialBuffer(). The file is
+only read, in a worker thread, when the material is first requested. */
+int MaterialTextures::addMaterial(const QString &fileName) {
+  Material material;
+  material.fileName = fileName;
+  material.distance = -1.0;
+  material.lastRequest = -1;
+  material.slot = -1;
+  material.isDecoding = false;
+  material.hasFailed = fileName.isEmpty();
+  materials_.append(material);
+  materialBufferIsModified_ = true;
+  return materials_.size() - 1;
+}
+
+/*! Same as addMaterial(), with an image already in memory. The \p image data
+is shared: do not modify it in place. */
+int MaterialTextures::addMaterial(const QImage &image) {
+  const int id = addMaterial(QString());
+  materials_[id].image = image;
+  materials_[id].hasFailed = image.isNull();
+  return id;
+}
+
+/*! Removes all the materials. The images being decoded are discarded, and the
+layers of the texture array are reused by the next materials. */
+void MaterialTextures::clear() {
+  threadPool_->clear();
+  {
+    QMutexLocker locker(&mutex_);
+    ++generation_;
+    decoded_.clear();
+  }
+  materials_.clear();
+  slotMaterials_.fill(-1);
+  materialBufferIsModified_ = true;
+}
+
+bool MaterialTextures::isValidMaterial(int material, const char *method) const {
+  if ((material < 0) || (material >= materials_.size())) {
+    qWarning("MaterialTextures::%s: invalid material %d", method, material);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Residency                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Requests the texture of \p material for the next update(), at \p distance
+from the camera. Call it for each visible object before update(): the nearest
+requested materials are made resident first. Requesting the same material
+several times keeps its smallest distance. */
+void MaterialTextures::requestMaterial(int material, qreal distance) {
+  if (!isValidMaterial(material, "requestMaterial"))
+    return;
+  Material &m = materials_[material];
+  distance = qMax(distance, qreal(0.0));
+  if ((m.distance < 0.0) || (distance < m.distance))
+    m.distance = distance;
+  m.lastRequest = frame_;
+}
+
+/*! Same as requestMaterial(), with the distance from \p position (in the world
+coordinate system) to the \p camera position. */
+void MaterialTextures::requestMaterial(int material, const Vec &position,
+                                       const Camera *camera) {
+  requestMaterial(material, (position - camera->position()).norm());
+}
+
+/*! Returns \c true when the texture of \p material is uploaded: its
+MaterialEntry refers to its own layer (or handle) instead of the white one. */
+bool MaterialTextures::isResident(int material) const {
+  return isValidMaterial(material, "isResident") &&
+         (materials_[material].slot >= 0);
+}
+
+/*! Returns the number of materials whose texture is resident. It is at most
+the number of layers that fit in the memoryBudget(). */
+int MaterialTextures::nbResidentMaterials() const {
+  int nb = 0;
+  for (int i = 0; i < slotMaterials_.size(); ++i)
+    if (slotMaterials_[i] >= 0)
+      ++nb;
+  return nb;
+}
+
+/*! Sets the memoryBudget(), in bytes. Must be called before the first
+update(). */
+void MaterialTextures::setMemoryBudget(qint64 bytes) {
+  if (context_) {
+    qWarning("MaterialTextures::setMemoryBudget: must be called before the "
+             "first update()");
+    return;
+  }
+  memoryBudget_ = qMax(bytes, qint64(0));
+}
+
+/*! Sets the layerSize(). Must be called before the first update(). */
+void MaterialTextures::setLayerSize(const QSize &size) {
+  if (context_) {
+    qWarning("MaterialTextures::setLayerSize: must be called before the first "
+             "update()");
+    return;
+  }
+  if (size.isEmpty()) {
+    qWarning("MaterialTextures::setLayerSize: invalid size");
+    return;
+  }
+  layerSize_ = size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Decoding                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+// Called by the worker threads. The image is scaled to the layer size, and its
+// mipmaps are computed here rather than with glGenerateMipmap(), which would
+// regenerate the whole texture array.
+void MaterialTextures::decode(int generation, int material,
+                              const QString &fileName, const QImage &image,
+                              const QSize &size) {
+  const QImage source = fileName.isEmpty() ? image : QImage(fileName);
+  QVector<QImage> levels;
+  if (source.isNull())
+    qWarning("MaterialTextures::update: unable to decode %s",
+             fileName.isEmpty() ? "image" : fileName.toLatin1().constData());
+  else {
+    QImage level = source.scaled(size, Qt::IgnoreAspectRatio,
+                                 Qt::SmoothTransformation)
+                       .convertToFormat(QImage::Format_RGBA8888);
+    levels.append(level);
+    for (int i = 1; i < nbLevels(size); ++i) {
+      level = level
+                  .scaled(levelSize(size, i), Qt::IgnoreAspectRatio,
+                          Qt::SmoothTransformation)
+                  .convertToFormat(QImage::Format_RGBA8888);
+      levels.append(level);
+    }
+  }
+
+  {
+    QMutexLocker locker(&mutex_);
+    if (generation != generation_)
+      return;
+    Decoded decoded;
+    decoded.material = material;
+    decoded.levels = levels;
+    decoded_.append(decoded);
+  }
+  Q_EMIT materialDecoded();
+}
+
+// Moves the images decoded by the worker threads to their materials
+void MaterialTextures::fetchDecoded() {
+  QList<Decoded> decoded;
+  {
+    QMutexLocker locker(&mutex_);
+    decoded.swap(decoded_);
+  }
+
+  for (int i = 0; i < decoded.size(); ++i) {
+    Material &m = materials_[decoded[i].material];
+    m.isDecoding = false;
+    m.levels = decoded[i].levels;
+    m.hasFailed = m.levels.isEmpty();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   OpenGL                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// Creates the texture array or the bindless functions with the current
+// context. Returns false when the textures cannot be created.
+bool MaterialTextures::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("MaterialTextures::update: No current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return isSupported_;
+  if (context_) {
+    qWarning("MaterialTextures::update: OpenGL context changed, textures are "
+             "lost");
+    textureArray_ = materialBuffer_ = whiteTexture_ = 0;
+    whiteHandle_ = 0;
+    slotMaterials_.clear();
+    slotTextures_.clear();
+    slotHandles_.clear();
+    for (int i = 0; i < materials_.size(); ++i)
+      materials_[i].slot = -1;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  const QPair<int, int> version = context->format().version();
+  isSupported_ = (version >= qMakePair(3, 0)) ||
+                 (!context->isOpenGLES() &&
+                  context->hasExtension("GL_EXT_texture_array"));
+  if (!isSupported_) {
+    qWarning("MaterialTextures::update: texture arrays are not supported");
+    return false;
+  }
+
+  // Number of layers within the budget
+  qint64 slotBytes = 0;
+  for (int i = 0; i < nbLevels(layerSize_); ++i) {
+    const QSize size = levelSize(layerSize_, i);
+    slotBytes += 4 * qint64(size.width()) * size.height();
+  }
+  maximumSlots_ = int(qMin(memoryBudget_ / slotBytes, qint64(1 << 20)));
+
+  getTextureHandle_ = nullptr;
+  if (bindlessTexturesAreEnabled_ && !context->isOpenGLES() &&
+      context->hasExtension("GL_ARB_bindless_texture")) {
+    getTextureHandle_ = context->getProcAddress("glGetTextureHandleARB");
+    makeTextureHandleResident_ =
+        context->getProcAddress("glMakeTextureHandleResidentARB");
+    makeTextureHandleNonResident_ =
+        context->getProcAddress("glMakeTextureHandleNonResidentARB");
+    if (!makeTextureHandleResident_ || !makeTextureHandleNonResident_)
+      getTextureHandle_ = nullptr;
+  }
+
+  if (usesBindlessTextures()) {
+    const quint32 white = 0xFFFFFFFF;
+    functions_->glGenTextures(1, &whiteTexture_);
+    functions_->glBindTexture(GL_TEXTURE_2D, whiteTexture_);
+    functions_->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, &white);
+    functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                GL_NEAREST);
+    functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                GL_NEAREST);
+    functions_->glBindTexture(GL_TEXTURE_2D, 0);
+    whiteHandle_ =
+        reinterpret_cast<GetTextureHandle>(getTextureHandle_)(whiteTexture_);
+    reinterpret_cast<MakeTextureHandleResident>(makeTextureHandleResident_)(
+        whiteHandle_);
+  } else {
+    // Layer 0 is the white one
+    GLint maxLayers = 0;
+    functions_->glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    maximumSlots_ = qMax(qMin(maximumSlots_, int(maxLayers) - 1), 0);
+  }
+
+  functions_->glGenBuffers(1, &materialBuffer_);
+  materialBufferIsModified_ = true;
+  return true;
+}
+
+/*! Releases the textures and the material buffer. The context used by update()
+must be current. The materials are kept, and are streamed again by the next
+update(). */
+void MaterialTextures::cleanupGL() {
+  if (functions_) {
+    if (usesBindlessTextures()) {
+      MakeTextureHandleResident makeNonResident =
+          reinterpret_cast<MakeTextureHandleResident>(
+              makeTextureHandleNonResident_);
+      for (int i = 0; i < slotHandles_.size(); ++i)
+        if (slotHandles_[i])
+          makeNonResident(slotHandles_[i]);
+      makeNonResident(whiteHandle_);
+      for (int i = 0; i < slotTextures_.size(); ++i)
+        if (slotTextures_[i])
+          functions_->glDeleteTextures(1, &slotTextures_[i]);
+      functions_->glDeleteTextures(1, &whiteTexture_);
+    }
+    if (textureArray_)
+      functions_->glDeleteTextures(1, &textureArray_);
+    if (materialBuffer_)
+      functions_->glDeleteBuffers(1, &materialBuffer_);
+  }
+
+  textureArray_ = materialBuffer_ = whiteTexture_ = 0;
+  whiteHandle_ = 0;
+  slotMaterials_.clear();
+  slotTextures_.clear();
+  slotHandles_.clear();
+  for (int i = 0; i < materials_.size(); ++i)
+    materials_[i].slot = -1;
+  getTextureHandle_ = nullptr;
+  makeTextureHandleResident_ = makeTextureHandleNonResident_ = nullptr;
+  isSupported_ = false;
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+// Grows the number of slots. The texture array is reallocated, and its
+// materials are streamed again. Bindless slots are simply added.
+void MaterialTextures::allocateSlots(int nbSlots) {
+  if (usesBindlessTextures()) {
+    const int previous = slotMaterials_.size();
+    slotMaterials_.resize(nbSlots);
+    slotTextures_.resize(nbSlots);
+    slotHandles_.resize(nbSlots);
+    for (int i = previous; i < nbSlots; ++i) {
+      slotMaterials_[i] = -1;
+      slotTextures_[i] = 0;
+      slotHandles_[i] = 0;
+    }
+    return;
+  }
+
+  if (textureArray_)
+    functions_->glDeleteTextures(1, &textureArray_);
+  functions_->glGenTextures(1, &textureArray_);
+  functions_->glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray_);
+  const int nb = nbLevels(layerSize_);
+  for (int i = 0; i < nb; ++i) {
+    const QSize size = levelSize(layerSize_, i);
+    functions_->glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, size.width(),
+                             size.height(), nbSlots + 1, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, nullptr);
+  }
+  functions_->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                              GL_LINEAR_MIPMAP_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                              GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+                              GL_REPEAT);
+  functions_->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+                              GL_REPEAT);
+  functions_->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                              nb - 1);
+
+  const QVector<quint32> white(layerSize_.width() * layerSize_.height(),
+                               0xFFFFFFFF);
+  functions_->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int i = 0; i < nb; ++i) {
+    const QSize size = levelSize(layerSize_, i);
+    functions_->glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, 0, size.width(),
+                                size.height(), 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                white.constData());
+  }
+  functions_->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  slotMaterials_.fill(-1, nbSlots);
+  for (int i = 0; i < materials_.size(); ++i)
+    materials_[i].slot = -1;
+  materialBufferIsModified_ = true;
+}
+
+// Returns a free slot, or the slot of the resident material that is the least
+// needed: not requested for the longest time, or else the farthest one which
+// is not wanted.
+int MaterialTextures::freeSlot(const QVector<bool> &isWanted) const {
+  int best = -1;
+  for (int i = 0; i < slotMaterials_.size(); ++i) {
+    const int material = slotMaterials_[i];
+    if (material < 0)
+      return i;
+    if (isWanted[material])
+      continue;
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+    const Material &m = materials_[material];
+    const Material &b = materials_[slotMaterials_[best]];
+    if ((m.lastRequest < b.lastRequest) ||
+        ((m.lastRequest == b.lastRequest) && (m.distance > b.distance)))
+      best = i;
+  }
+  return best;
+}
+
+// Uploads the decoded levels of material in slot, evicting its previous
+// material
+void MaterialTextures::upload(int material, int slot) {
+  Material &m = materials_[material];
+  functions_->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (usesBindlessTextures()) {
+    GLuint &texture = slotTextures_[slot];
+    if (texture) {
+      functions_->glBindTexture(GL_TEXTURE_2D, texture);
+      for (int i = 0; i < m.levels.size(); ++i)
+        functions_->glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0,
+                                    m.levels[i].width(), m.levels[i].height(),
+                                    GL_RGBA, GL_UNSIGNED_BYTE,
+                                    m.levels[i].constBits());
+    } else {
+      // A texture handle makes the texture parameters immutable
+      functions_->glGenTextures(1, &texture);
+      functions_->glBindTexture(GL_TEXTURE_2D, texture);
+      for (int i = 0; i < m.levels.size(); ++i)
+        functions_->glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8,
+                                 m.levels[i].width(), m.levels[i].height(), 0,
+                                 GL_RGBA, GL_UNSIGNED_BYTE,
+                                 m.levels[i].constBits());
+      functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                  GL_LINEAR_MIPMAP_LINEAR);
+      functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                  GL_LINEAR);
+      functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                                  m.levels.size() - 1);
+      slotHandles_[slot] =
+          reinterpret_cast<GetTextureHandle>(getTextureHandle_)(texture);
+      reinterpret_cast<MakeTextureHandleResident>(makeTextureHandleResident_)(
+          slotHandles_[slot]);
+    }
+    functions_->glBindTexture(GL_TEXTURE_2D, 0);
+  } else {
+    functions_->glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray_);
+    for (int i = 0; i < m.levels.size(); ++i)
+      functions_->glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, slot + 1,
+                                  m.levels[i].width(), m.levels[i].height(), 1,
+                                  GL_RGBA, GL_UNSIGNED_BYTE,
+                                  m.levels[i].constBits());
+    functions_->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  if (slotMaterials_[slot] >= 0)
+    materials_[slotMaterials_[slot]].slot = -1;
+  slotMaterials_[slot] = material;
+  m.slot = slot;
+  // The decoded images are only needed again after an eviction
+  m.levels.clear();
+  materialBufferIsModified_ = true;
+}
+
+void MaterialTextures::uploadMaterialBuffer() {
+  QVector<MaterialEntry> entries(qMax(materials_.size(), 1));
+  for (int i = 0; i < entries.size(); ++i) {
+    const int slot = (i < materials_.size()) ? materials_[i].slot : -1;
+    entries[i].layer = slot + 1;
+    entries[i].isResident = (slot >= 0) ? 1 : 0;
+    if (usesBindlessTextures())
+      entries[i].handle = (slot >= 0) ? slotHandles_[slot] : whiteHandle_;
+    else
+      entries[i].handle = 0;
+  }
+
+  GLint previous = 0;
+  functions_->glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous);
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, materialBuffer_);
+  functions_->glBufferData(GL_ARRAY_BUFFER,
+                           entries.size() * int(sizeof(MaterialEntry)),
+                           entries.constData(), GL_DYNAMIC_DRAW);
+  functions_->glBindBuffer(GL_ARRAY_BUFFER, GLuint(previous));
+  materialBufferIsModified_ = false;
+}
+
+/*! Streams the textures of the materials requested since the previous
+update(), and updates the materialBuffer(). Call it in your \c draw() method,
+after the requestMaterial() of the visible objects, and before the
+textureArray() and materialBuffer() are bound.
+
+The nearest requested materials which fit in the memoryBudget() are decoded in
+a worker thread, and at most maximumUploadsPerFrame() of the decoded ones are
+uploaded. Returns \c true when decoded textures are still waiting for an
+upload: call update() again in the next frame. The materialDecoded() signal is
+emitted when the other ones are ready. */
+bool MaterialTextures::update() {
+  const int frame = frame_++;
+  if (!initializeGL())
+    return false;
+  fetchDecoded();
+
+  // Grows the slots by steps, so that the texture array is rarely reallocated
+  const int nbNeeded = qMin(materials_.size(), maximumSlots_);
+  if (nbNeeded > slotMaterials_.size())
+    allocateSlots(qMin(qMax(nbNeeded, 2 * slotMaterials_.size()),
+                       maximumSlots_));
+
+  // Requested materials, nearest first, as long as they fit
+  QVector<QPair<qreal, int>> requested;
+  for (int i = 0; i < materials_.size(); ++i)
+    if ((materials_[i].lastRequest == frame) && !materials_[i].hasFailed)
+      requested.append(qMakePair(materials_[i].distance, i));
+  std::sort(requested.begin(), requested.end());
+  requested.resize(qMin(requested.size(), slotMaterials_.size()));
+  QVector<bool> isWanted(materials_.size(), false);
+  for (int i = 0; i < requested.size(); ++i)
+    isWanted[requested[i].second] = true;
+
+  int nbDecoding = 0;
+  for (int i = 0; i < materials_.size(); ++i)
+    if (materials_[i].isDecoding)
+      ++nbDecoding;
+
+  bool pending = false;
+  int nbUploads = 0;
+  int generation;
+  {
+    QMutexLocker locker(&mutex_);
+    generation = generation_;
+  }
+  for (int i = 0; i < requested.size(); ++i) {
+    const int material = requested[i].second;
+    Material &m = materials_[material];
+    if (m.slot >= 0)
+      continue;
+    if (!m.levels.isEmpty()) {
+      if (nbUploads < maximumUploadsPerFrame_) {
+        upload(material, freeSlot(isWanted));
+        ++nbUploads;
+      } else
+        pending = true;
+    } else if (!m.isDecoding && (nbDecoding < 2 * maximumUploadsPerFrame_)) {
+      // The next ones are started when these are decoded
+      m.isDecoding = true;
+      ++nbDecoding;
+      const QString fileName = m.fileName;
+      const QImage image = m.image;
+      const QSize size = layerSize_;
+      threadPool_->start(QRunnable::create(
+          [this, generation, material, fileName, image, size]() {
+            decode(generation, material, fileName, image, size);
+          }));
+    }
+  }
+
+  // Decoded images which are no longer wanted are dropped
+  for (int i = 0; i < materials_.size(); ++i) {
+    if (!isWanted[i])
+      materials_[i].levels.clear();
+    materials_[i].distance = -1.0;
+  }
+
+  if (materialBufferIsModified_)
+    uploadMaterialBuffer();
+  return pending;
+}
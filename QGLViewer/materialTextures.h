@@ -0,0 +1,224 @@
+#ifndef QGLVIEWER_MATERIAL_TEXTURES_H
+#define QGLVIEWER_MATERIAL_TEXTURES_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "vec.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Keeps the textures of many materials in a single texture array,
+  streamed by camera distance within a memory budget.
+  \class MaterialTextures materialTextures.h QGLViewer/materialTextures.h
+
+  Binding a texture per material in draw() prevents the batching of the
+  objects: a DrawList can draw thousands of objects in a single indirect
+  call, but only if they do not need different texture bindings. A
+  MaterialTextures instead stores the texture of each material in a layer of
+  a single \c GL_TEXTURE_2D_ARRAY, bound once. The shaders find the layer of a
+  material in the materialBuffer(), indexed by the material id returned by
+  addMaterial():
+  \code
+  void Viewer::init() {
+    for (int i = 0; i < nbObjects; ++i)
+      objectMaterial[i] = textures_.addMaterial(object[i].textureFileName);
+    connect(&textures_, SIGNAL(materialDecoded()), SLOT(update()));
+  }
+
+  void Viewer::draw() {
+    drawList_.cull(camera());
+    for (int i = 0; i < drawList_.visibleObjects().size(); ++i) {
+      const int id = drawList_.visibleObjects()[i];
+      textures_.requestMaterial(objectMaterial[id], object[id].center,
+                                camera());
+    }
+    if (textures_.update())
+      update(); // more textures to upload
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textures_.textureArray());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, textures_.materialBuffer());
+    drawList_.draw(GL_TRIANGLES);
+  }
+  \endcode
+
+  The shader reads the material of the object from its own per object buffer,
+  indexed by \c gl_BaseInstance (the DrawList object id), and then the layer of
+  the material in the materialBuffer(). Each entry of this buffer is a
+  MaterialEntry.
+
+  Only the textures of the materials requested by requestMaterial() since the
+  previous update() are made resident, nearest first, as long as they fit in
+  the memoryBudget(). A material which is not resident is displayed with layer
+  0, which is white. The images are decoded and scaled to layerSize() in a
+  worker thread, and at most maximumUploadsPerFrame() are uploaded by each
+  update(), so that streaming never stalls the display. The least recently
+  requested textures are evicted first when the budget is full.
+
+  When bindlessTexturesAreEnabled() and the \c GL_ARB_bindless_texture
+  extension is available, each resident material instead has its own texture
+  with a resident handle, stored in MaterialEntry::handle: shaders can then
+  sample them without any binding, and the number of materials is not limited
+  by \c GL_MAX_ARRAY_TEXTURE_LAYERS.
+
+  Texture arrays require OpenGL 3.0 or OpenGL ES 3.0. All the OpenGL methods
+  must be called with the same context current. Call cleanupGL() with this
+  context current before the MaterialTextures is destroyed. */
+class QGLVIEWER_EXPORT MaterialTextures : public QObject {
+  Q_OBJECT
+
+public:
+  /*! The layout of the entries of the materialBuffer(), 16 bytes each. */
+  struct MaterialEntry {
+    /*! Layer of the material in the textureArray(), 0 when not resident. */
+    qint32 layer;
+    /*! 1 when the material texture is resident, 0 otherwise. */
+    qint32 isResident;
+    /*! Bindless handle of the material texture (or of a white texture when
+    not resident). 0 when usesBindlessTextures() is \c false. */
+    quint64 handle;
+  };
+
+  explicit MaterialTextures(QObject *parent = nullptr);
+  virtual ~MaterialTextures();
+
+  /*! @name Materials */
+  //@{
+public:
+  int addMaterial(const QString &fileName);
+  int addMaterial(const QImage &image);
+  void clear();
+  /*! Returns the number of materials added since the last clear(). */
+  int nbMaterials() const { return materials_.size(); }
+  //@}
+
+  /*! @name Residency */
+  //@{
+public:
+  void requestMaterial(int material, qreal distance);
+  void requestMaterial(int material, const Vec &position, const Camera *camera);
+  bool isResident(int material) const;
+  int nbResidentMaterials() const;
+
+  /*! Returns the video memory used by the textures, in bytes, mipmaps
+  included. Default value is 128 MB. */
+  qint64 memoryBudget() const { return memoryBudget_; }
+  void setMemoryBudget(qint64 bytes);
+  /*! Returns the size of the layers, in pixels. All the images are scaled to
+  this size. Default value is 256x256. */
+  QSize layerSize() const { return layerSize_; }
+  void setLayerSize(const QSize &size);
+  /*! Returns the maximum number of textures uploaded by each update(). Default
+  value is 4. */
+  int maximumUploadsPerFrame() const { return maximumUploadsPerFrame_; }
+  /*! Sets maximumUploadsPerFrame(). */
+  void setMaximumUploadsPerFrame(int nb) {
+    maximumUploadsPerFrame_ = qMax(nb, 1);
+  }
+  //@}
+
+  /*! @name OpenGL */
+  //@{
+public:
+  bool update();
+  void cleanupGL();
+
+  /*! Returns the \c GL_TEXTURE_2D_ARRAY texture, 0 before the first update()
+  or when usesBindlessTextures(). */
+  GLuint textureArray() const { return textureArray_; }
+  /*! Returns the buffer of the MaterialEntry of each material, indexed by
+  material id. Bind it as a shader storage, uniform or texture buffer. 0
+  before the first update(). */
+  GLuint materialBuffer() const { return materialBuffer_; }
+
+  /*! Returns \c true when bindless textures are used if supported. Default
+  value is \c false. Must be set before the first update(). */
+  bool bindlessTexturesAreEnabled() const {
+    return bindlessTexturesAreEnabled_;
+  }
+  /*! Sets bindlessTexturesAreEnabled(). */
+  void setBindlessTexturesEnabled(bool enabled = true) {
+    bindlessTexturesAreEnabled_ = enabled;
+  }
+  /*! Returns \c true when the textures are bindless. Only meaningful after the
+  first update(). */
+  bool usesBindlessTextures() const { return getTextureHandle_ != nullptr; }
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted, from the worker thread, when the image of a requested
+  material is decoded. Connect it to your viewer's \c update() slot, so that
+  update() uploads it. */
+  void materialDecoded();
+
+private:
+  Q_DISABLE_COPY(MaterialTextures)
+
+  struct Material {
+    QString fileName;
+    QImage image;     // when not loaded from a file
+    qreal distance;   // of this frame requests, negative when not requested
+    int lastRequest;  // update() number
+    int slot;         // -1 when not resident
+    bool isDecoding;
+    bool hasFailed; // the image could not be decoded
+    QVector<QImage> levels; // decoded, waiting for an upload
+  };
+
+  bool isValidMaterial(int material, const char *method) const;
+  void decode(int generation, int material, const QString &fileName,
+              const QImage &image, const QSize &size);
+  bool initializeGL();
+  void fetchDecoded();
+  void allocateSlots(int nbSlots);
+  int freeSlot(const QVector<bool> &isWanted) const;
+  void upload(int material, int slot);
+  void uploadMaterialBuffer();
+
+  QVector<Material> materials_;
+  qint64 memoryBudget_;
+  QSize layerSize_;
+  int maximumUploadsPerFrame_;
+  int frame_; // update() number
+
+  // L o a d e r   t h r e a d
+  QThreadPool *threadPool_;
+  QMutex mutex_;
+  int generation_; // incremented by clear(), protected by mutex_
+  struct Decoded {
+    int material;
+    QVector<QImage> levels;
+  };
+  QList<Decoded> decoded_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  bool isSupported_;
+  bool bindlessTexturesAreEnabled_;
+  GLuint textureArray_;
+  GLuint materialBuffer_;
+  bool materialBufferIsModified_;
+  int maximumSlots_;            // within the memoryBudget()
+  QVector<int> slotMaterials_; // -1 for a free slot
+  QVector<GLuint> slotTextures_;   // bindless textures, 0 until used
+  QVector<quint64> slotHandles_;   // idem
+  GLuint whiteTexture_;            // bindless fallback
+  quint64 whiteHandle_;
+  QFunctionPointer getTextureHandle_; // nullptr without bindless textures
+  QFunctionPointer makeTextureHandleResident_;
+  QFunctionPointer makeTextureHandleNonResident_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MATERIAL_TEXTURES_H
@@ -0,0 +1,1074 @@
+#include "meshCache.h"
+#include "meshOptimizer.h"
+#include "taskScheduler.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QSaveFile>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+using namespace qglviewer;
+
+// A cache file is a MeshCacheHeader followed by the vertices and the indices,
+// in native byte order
+struct MeshCacheHeader {
+  char magic[8];
+  quint32 version; // Also detects files written with another byte order
+  quint32 flags;
+  qint64 sourceSize;
+  qint64 sourceModified; // in ms since the epoch
+  quint32 nbVertices;
+  quint32 nbIndices;
+  float boundingBox[6];
+};
+
+static const char meshCacheMagic[8] = {'Q', 'G', 'L', 'V', 'M', 'E', 'S', 'H'};
+static const quint32 meshCacheVersion = 1;
+static const quint32 hasTexCoordsFlag = 1;
+static const quint32 optimizedFlag = 2;
+
+// Floats per vertex
+static const int vertexFloats = MeshCache::VERTEX_STRIDE / sizeof(float);
+// Bytes of text parsed by each task of the OBJ import
+static const qint64 minimumChunkSize = 1 << 20;
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Parsing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static inline bool isSpace(char c) {
+  return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static inline bool isDigit(char c) { return (c >= '0') && (c <= '9'); }
+
+static const char *skipSpaces(const char *p, const char *end) {
+  while ((p < end) && isSpace(*p))
+    ++p;
+  return p;
+}
+
+// Returns the end of the line that starts at p: its '\n', or end
+static const char *lineEnd(const char *p, const char *end) {
+  const void *newLine = memchr(p, '\n', size_t(end - p));
+  return newLine ? static_cast<const char *>(newLine) : end;
+}
+
+// Parses a decimal number in the C locale, and moves p after it. Much faster
+// than strtod(), whose decimal separator also depends on the locale.
+static bool parseDouble(const char *&p, const char *end, double &value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *c = skipSpaces(p, end);
+  bool negative = false;
+  if ((c < end) && ((*c == '-') || (*c == '+')))
+    negative = (*c++ == '-');
+
+  // The digits beyond the precision of a double only change the exponent
+  const quint64 maxMantissa = quint64(1) << 60;
+  quint64 mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  for (; (c < end) && isDigit(*c); ++c, digits = true)
+    if (mantissa < maxMantissa)
+      mantissa = 10 * mantissa + quint64(*c - '0');
+    else
+      ++exponent;
+  if ((c < end) && (*c == '.'))
+    for (++c; (c < end) && isDigit(*c); ++c, digits = true)
+      if (mantissa < maxMantissa) {
+        mantissa = 10 * mantissa + quint64(*c - '0');
+        --exponent;
+      }
+  if (!digits)
+    return false;
+
+  if ((c < end) && ((*c == 'e') || (*c == 'E'))) {
+    const char *e = c + 1;
+    bool negativeExponent = false;
+    if ((e < end) && ((*e == '-') || (*e == '+')))
+      negativeExponent = (*e++ == '-');
+    int power = 0;
+    bool powerDigits = false;
+    for (; (e < end) && isDigit(*e); ++e, powerDigits = true)
+      if (power < 10000)
+        power = 10 * power + (*e - '0');
+    if (powerDigits) {
+      exponent += negativeExponent ? -power : power;
+      c = e;
+    }
+  }
+
+  // Exact powers of ten keep the result correctly rounded
+  value = double(mantissa);
+  if ((exponent >= 0) && (exponent <= 22))
+    value *= powers[exponent];
+  else if ((exponent < 0) && (exponent >= -22))
+    value /= powers[-exponent];
+  else
+    value *= pow(10.0, exponent);
+  if (negative)
+    value = -value;
+  p = c;
+  return true;
+}
+
+// Parses a decimal integer, and moves p after it
+static bool parseInt(const char *&p, const char *end, int &value) {
+  const char *c = skipSpaces(p, end);
+  bool negative = false;
+  if ((c < end) && ((*c == '-') || (*c == '+')))
+    negative = (*c++ == '-');
+  if ((c == end) || !isDigit(*c))
+    return false;
+  qint64 v = 0;
+  for (; (c < end) && isDigit(*c); ++c)
+    if (v <= INT_MAX)
+      v = 10 * v + (*c - '0');
+  if (v > INT_MAX)
+    return false;
+  value = negative ? -int(v) : int(v);
+  p = c;
+  return true;
+}
+
+// Returns the area weighted average of the normals of the triangles around
+// each of the nbPositions positions, whose coordinates are stride floats
+// apart
+static QVector<float> smoothNormals(const float *positions, int stride,
+                                    int nbPositions, const quint32 *indices,
+                                    int nbIndices) {
+  QVector<float> normals(3 * nbPositions, 0.0f);
+  float *const n = normals.data();
+  for (int i = 0; i + 2 < nbIndices; i += 3) {
+    const float *a = positions + stride * indices[i];
+    const float *b = positions + stride * indices[i + 1];
+    const float *c = positions + stride * indices[i + 2];
+    const float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    const float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    // Its length is twice the area of the triangle
+    const float cross[3] = {u[1] * v[2] - u[2] * v[1],
+                            u[2] * v[0] - u[0] * v[2],
+                            u[0] * v[1] - u[1] * v[0]};
+    for (int k = 0; k < 3; ++k)
+      for (int j = 0; j < 3; ++j)
+        n[3 * indices[i + k] + j] += cross[j];
+  }
+
+  TaskScheduler::parallelFor(
+      nbPositions,
+      [n](int begin, int end) {
+        for (float *normal = n + 3 * begin; normal < n + 3 * end;
+             normal += 3) {
+          const float length = sqrt(normal[0] * normal[0] +
+                                    normal[1] * normal[1] +
+                                    normal[2] * normal[2]);
+          if (length > 0.0f)
+            for (int j = 0; j < 3; ++j)
+              normal[j] /= length;
+        }
+      },
+      4096);
+  return normals;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                    OBJ                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+// The position, texture coordinates and normal indices of a face corner, -1
+// when absent
+struct Corner {
+  int v, t, n;
+};
+
+bool operator==(const Corner &a, const Corner &b) {
+  return (a.v == b.v) && (a.t == b.t) && (a.n == b.n);
+}
+
+uint qHash(const Corner &c, uint seed = 0) {
+  return seed ^ (uint(c.v) * 73856093u) ^ (uint(c.t) * 19349663u) ^
+         (uint(c.n) * 83492791u);
+}
+
+enum ObjLine { OBJ_OTHER, OBJ_POSITION, OBJ_TEX_COORD, OBJ_NORMAL, OBJ_FACE };
+
+// Returns the type of the line that starts at p, and moves p after its
+// keyword
+ObjLine objLine(const char *&p, const char *end) {
+  const char *c = skipSpaces(p, end);
+  if (end - c < 2)
+    return OBJ_OTHER;
+
+  ObjLine type = OBJ_OTHER;
+  int length = 1;
+  if ((c[0] == 'f') && isSpace(c[1]))
+    type = OBJ_FACE;
+  else if (c[0] == 'v') {
+    if (isSpace(c[1]))
+      type = OBJ_POSITION;
+    else if ((end - c > 2) && isSpace(c[2])) {
+      length = 2;
+      if (c[1] == 't')
+        type = OBJ_TEX_COORD;
+      else if (c[1] == 'n')
+        type = OBJ_NORMAL;
+    }
+  }
+  p = c + length;
+  return type;
+}
+
+// A range of lines of an OBJ file, parsed by one task
+struct ObjChunk {
+  const char *begin, *end;
+  // Counted by the first pass, which gives the indices of the first ones
+  int nbPositions, nbTexCoords, nbNormals;
+  int firstPosition, firstTexCoord, firstNormal;
+  QVector<float> positions, texCoords, normals;
+  QVector<Corner> corners; // three per triangle
+  bool isValid;
+
+  void count();
+  void parse();
+  bool parseIndex(const char *&p, const char *end, int first, int nb,
+                  int &index) const;
+};
+
+void ObjChunk::count() {
+  nbPositions = nbTexCoords = nbNormals = 0;
+  for (const char *p = begin; p < end;) {
+    const char *e = lineEnd(p, end);
+    switch (objLine(p, e)) {
+    case OBJ_POSITION:
+      ++nbPositions;
+      break;
+    case OBJ_TEX_COORD:
+      ++nbTexCoords;
+      break;
+    case OBJ_NORMAL:
+      ++nbNormals;
+      break;
+    default:
+      break;
+    }
+    p = e + 1;
+  }
+}
+
+// Converts a 1-based (or negative, relative to the current count) index in
+// a 0-based one. first is the index of the first element of the chunk, nb
+// the number of ones parsed so far.
+bool ObjChunk::parseIndex(const char *&p, const char *end, int first, int nb,
+                          int &index) const {
+  int value;
+  if (!parseInt(p, end, value) || (value == 0))
+    return false;
+  index = (value > 0) ? value - 1 : first + nb + value;
+  return index >= 0;
+}
+
+void ObjChunk::parse() {
+  isValid = true;
+  positions.reserve(3 * nbPositions);
+  texCoords.reserve(2 * nbTexCoords);
+  normals.reserve(3 * nbNormals);
+
+  QVarLengthArray<Corner, 8> polygon;
+  for (const char *p = begin; isValid && (p < end);) {
+    const char *e = lineEnd(p, end);
+    double x, y, z;
+    switch (objLine(p, e)) {
+    case OBJ_POSITION:
+      isValid = parseDouble(p, e, x) && parseDouble(p, e, y) &&
+                parseDouble(p, e, z);
+      positions << float(x) << float(y) << float(z);
+      break;
+    case OBJ_TEX_COORD:
+      isValid = parseDouble(p, e, x);
+      if (!parseDouble(p, e, y))
+        y = 0.0;
+      texCoords << float(x) << float(y);
+      break;
+    case OBJ_NORMAL:
+      isValid = parseDouble(p, e, x) && parseDouble(p, e, y) &&
+                parseDouble(p, e, z);
+      normals << float(x) << float(y) << float(z);
+      break;
+    case OBJ_FACE:
+      polygon.clear();
+      for (p = skipSpaces(p, e); isValid && (p < e); p = skipSpaces(p, e)) {
+        // v, v/t, v//n or v/t/n
+        Corner corner = {-1, -1, -1};
+        isValid = parseIndex(p, e, firstPosition, positions.size() / 3,
+                             corner.v);
+        if (isValid && (p < e) && (*p == '/')) {
+          ++p;
+          if ((p < e) && (*p != '/'))
+            isValid = parseIndex(p, e, firstTexCoord, texCoords.size() / 2,
+                                 corner.t);
+          if (isValid && (p < e) && (*p == '/')) {
+            ++p;
+            isValid = parseIndex(p, e, firstNormal, normals.size() / 3,
+                                 corner.n);
+          }
+        }
+        isValid = isValid && ((p == e) || isSpace(*p));
+        polygon.append(corner);
+      }
+      isValid = isValid && (polygon.size() >= 3);
+      for (int i = 1; i + 1 < polygon.size(); ++i)
+        corners << polygon[0] << polygon[i] << polygon[i + 1];
+      break;
+    default:
+      break;
+    }
+    p = e + 1;
+  }
+}
+} // namespace
+
+// Parses the file in chunks of lines, in two parallel passes: the first one
+// counts the vertex attributes of each chunk, so that the second one knows
+// the indices of the first attributes of its chunk. The face corners are
+// then merged in unique vertices.
+bool MeshCache::importOBJ(const char *begin, const char *end) {
+  const qint64 size = end - begin;
+  const int nbChunks = int(qBound(
+      qint64(1), size / minimumChunkSize,
+      qint64(4 * TaskScheduler::maxThreadCount())));
+  QVector<ObjChunk> chunks(nbChunks);
+  for (int i = 0; i < nbChunks; ++i) {
+    ObjChunk &chunk = chunks[i];
+    chunk.begin = (i == 0) ? begin : chunks[i - 1].end;
+    if (i == nbChunks - 1)
+      chunk.end = end;
+    else {
+      // After the end of the line of the split point
+      const char *split = qMax(begin + (i + 1) * size / nbChunks, chunk.begin);
+      chunk.end = qMin(lineEnd(split, end) + 1, end);
+    }
+  }
+
+  ObjChunk *const c = chunks.data();
+  TaskScheduler::parallelFor(nbChunks, [c](int first, int last) {
+    for (int i = first; i < last; ++i)
+      c[i].count();
+  });
+  int nbPositions = 0, nbTexCoords = 0, nbNormals = 0;
+  for (ObjChunk &chunk : chunks) {
+    chunk.firstPosition = nbPositions;
+    chunk.firstTexCoord = nbTexCoords;
+    chunk.firstNormal = nbNormals;
+    nbPositions += chunk.nbPositions;
+    nbTexCoords += chunk.nbTexCoords;
+    nbNormals += chunk.nbNormals;
+  }
+  TaskScheduler::parallelFor(nbChunks, [c](int first, int last) {
+    for (int i = first; i < last; ++i)
+      c[i].parse();
+  });
+
+  // Concatenated attributes, and validated corners
+  QVector<float> positions(3 * nbPositions);
+  QVector<float> texCoords(2 * nbTexCoords);
+  QVector<float> normals(3 * nbNormals);
+  float *const p = positions.data();
+  float *const t = texCoords.data();
+  float *const n = normals.data();
+  QAtomicInt hasAttributes(0), lacksNormals(0);
+  TaskScheduler::parallelFor(nbChunks, [&](int first, int last) {
+    for (int i = first; i < last; ++i) {
+      ObjChunk &chunk = c[i];
+      std::copy(chunk.positions.constBegin(), chunk.positions.constEnd(),
+                p + 3 * chunk.firstPosition);
+      std::copy(chunk.texCoords.constBegin(), chunk.texCoords.constEnd(),
+                t + 2 * chunk.firstTexCoord);
+      std::copy(chunk.normals.constBegin(), chunk.normals.constEnd(),
+                n + 3 * chunk.firstNormal);
+      for (const Corner &corner : chunk.corners) {
+        if ((corner.v >= nbPositions) || (corner.t >= nbTexCoords) ||
+            (corner.n >= nbNormals))
+          chunk.isValid = false;
+        if ((corner.t >= 0) || (corner.n >= 0))
+          hasAttributes.storeRelaxed(1);
+        if (corner.n < 0)
+          lacksNormals.storeRelaxed(1);
+      }
+    }
+  });
+
+  int line = 1;
+  QVector<Corner> corners;
+  for (const ObjChunk &chunk : chunks) {
+    if (!chunk.isValid) {
+      // Not the exact line, but the start of the invalid chunk
+      qWarning("MeshCache::import: Invalid OBJ line or index after line %d",
+               line);
+      return false;
+    }
+    line += int(std::count(chunk.begin, chunk.end, '\n'));
+    corners += chunk.corners;
+  }
+  chunks.clear();
+  if (corners.isEmpty()) {
+    qWarning("MeshCache::import: No face in OBJ file");
+    return false;
+  }
+
+  // Unique vertices, unless the faces only use positions
+  indexData_.resize(corners.size() * int(sizeof(quint32)));
+  quint32 *const indices = reinterpret_cast<quint32 *>(indexData_.data());
+  QVector<Corner> vertices;
+  if (hasAttributes.loadRelaxed()) {
+    QHash<Corner, quint32> uniqueVertices;
+    uniqueVertices.reserve(corners.size() / 2);
+    for (int i = 0; i < corners.size(); ++i) {
+      QHash<Corner, quint32>::const_iterator it =
+          uniqueVertices.constFind(corners[i]);
+      if (it == uniqueVertices.constEnd()) {
+        it = uniqueVertices.insert(corners[i], quint32(vertices.size()));
+        vertices.append(corners[i]);
+      }
+      indices[i] = it.value();
+    }
+  } else
+    for (int i = 0; i < corners.size(); ++i)
+      indices[i] = quint32(corners[i].v);
+
+  QVector<float> smooth;
+  if (lacksNormals.loadRelaxed()) {
+    QVector<quint32> positionIndices(corners.size());
+    for (int i = 0; i < corners.size(); ++i)
+      positionIndices[i] = quint32(corners[i].v);
+    smooth = smoothNormals(p, 3, nbPositions, positionIndices.constData(),
+                           positionIndices.size());
+  }
+
+  const int nbVertices =
+      hasAttributes.loadRelaxed() ? vertices.size() : nbPositions;
+  vertexData_.fill('\0', nbVertices * VERTEX_STRIDE);
+  float *const out = reinterpret_cast<float *>(vertexData_.data());
+  const Corner *const v = vertices.constData();
+  const float *const s = smooth.constData();
+  const bool indexed = hasAttributes.loadRelaxed();
+  TaskScheduler::parallelFor(
+      nbVertices,
+      [=](int first, int last) {
+        for (int i = first; i < last; ++i) {
+          const Corner corner = indexed ? v[i] : Corner{i, -1, -1};
+          float *vertex = out + vertexFloats * i;
+          const float *normal =
+              (corner.n >= 0) ? n + 3 * corner.n : s + 3 * corner.v;
+          for (int k = 0; k < 3; ++k) {
+            vertex[k] = p[3 * corner.v + k];
+            vertex[3 + k] = normal[k];
+          }
+          if (corner.t >= 0) {
+            vertex[6] = t[2 * corner.t];
+            vertex[7] = t[2 * corner.t + 1];
+          }
+        }
+      },
+      4096);
+
+  hasTexCoords_ = (nbTexCoords > 0) && hasAttributes.loadRelaxed();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                    PLY                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LITTLE_ENDIAN, PLY_BINARY_BIG_ENDIAN };
+
+enum PlyType {
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64,
+  PLY_INVALID
+};
+
+const int plyTypeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+struct PlyProperty {
+  QByteArray name;
+  PlyType type; // of the items for a list
+  PlyType countType;
+  bool isList;
+};
+
+struct PlyElement {
+  QByteArray name;
+  qint64 count;
+  QVector<PlyProperty> properties;
+};
+
+PlyType plyType(const QByteArray &name) {
+  static const char *const names[][2] = {
+      {"char", "int8"},   {"uchar", "uint8"},   {"short", "int16"},
+      {"ushort", "uint16"}, {"int", "int32"},   {"uint", "uint32"},
+      {"float", "float32"}, {"double", "float64"}};
+  for (int i = 0; i < PLY_INVALID; ++i)
+    if ((name == names[i][0]) || (name == names[i][1]))
+      return PlyType(i);
+  return PLY_INVALID;
+}
+
+// The float of the vertex layout where a vertex property is stored, or -1
+int plyVertexSlot(const QByteArray &name) {
+  static const char *const names[] = {"x", "y", "z", "nx", "ny", "nz"};
+  for (int i = 0; i < 6; ++i)
+    if (name == names[i])
+      return i;
+  if ((name == "s") || (name == "u") || (name == "texture_u") ||
+      (name == "texture_s"))
+    return 6;
+  if ((name == "t") || (name == "v") || (name == "texture_v") ||
+      (name == "texture_t"))
+    return 7;
+  return -1;
+}
+
+template <typename T> T fromEndian(const char *p, bool bigEndian) {
+  return bigEndian ? qFromBigEndian<T>(p) : qFromLittleEndian<T>(p);
+}
+
+double binaryValue(const char *p, PlyType type, bool bigEndian) {
+  switch (type) {
+  case PLY_INT8:
+    return qint8(*p);
+  case PLY_UINT8:
+    return uchar(*p);
+  case PLY_INT16:
+    return qint16(fromEndian<quint16>(p, bigEndian));
+  case PLY_UINT16:
+    return fromEndian<quint16>(p, bigEndian);
+  case PLY_INT32:
+    return qint32(fromEndian<quint32>(p, bigEndian));
+  case PLY_UINT32:
+    return fromEndian<quint32>(p, bigEndian);
+  case PLY_FLOAT32: {
+    const quint32 bits = fromEndian<quint32>(p, bigEndian);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  default: {
+    const quint64 bits = fromEndian<quint64>(p, bigEndian);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  }
+}
+
+// Reads the next value of the body, and moves p after it
+bool readPlyValue(const char *&p, const char *end, PlyFormat format,
+                  PlyType type, double &value) {
+  if (format == PLY_ASCII) {
+    while ((p < end) && (isSpace(*p) || (*p == '\n')))
+      ++p;
+    return parseDouble(p, end, value);
+  }
+  if (end - p < plyTypeSizes[type])
+    return false;
+  value = binaryValue(p, type, format == PLY_BINARY_BIG_ENDIAN);
+  p += plyTypeSizes[type];
+  return true;
+}
+
+// Reads the records of a face element, and appends their triangulated
+// vertex indices to indices. Other elements are skipped with a null indices.
+bool readPlyFaces(const PlyElement &element, PlyFormat format,
+                  const char *&p, const char *end, int nbVertices,
+                  QVector<quint32> *indices) {
+  QVarLengthArray<quint32, 16> polygon;
+  for (qint64 record = 0; record < element.count; ++record)
+    for (const PlyProperty &property : element.properties) {
+      double value;
+      if (!property.isList) {
+        if (!readPlyValue(p, end, format, property.type, value))
+          return false;
+        continue;
+      }
+
+      if (!readPlyValue(p, end, format, property.countType, value) ||
+          (value < 0.0))
+        return false;
+      const bool isPolygon = indices && ((property.name == "vertex_indices") ||
+                                         (property.name == "vertex_index"));
+      const int nbItems = int(value);
+      polygon.clear();
+      for (int i = 0; i < nbItems; ++i) {
+        if (!readPlyValue(p, end, format, property.type, value))
+          return false;
+        if (isPolygon) {
+          if ((value < 0.0) || (value >= nbVertices))
+            return false;
+          polygon.append(quint32(value));
+        }
+      }
+      for (int i = 1; i + 1 < polygon.size(); ++i)
+        *indices << polygon[0] << polygon[i] << polygon[i + 1];
+    }
+  return true;
+}
+} // namespace
+
+// Parses the header, decodes the vertices in parallel (their records have a
+// fixed size in binary, and are lines in ASCII) and the faces sequentially
+bool MeshCache::importPLY(const char *begin, const char *end) {
+  PlyFormat format = PLY_ASCII;
+  QVector<PlyElement> elements;
+  const char *p = begin;
+  bool headerIsComplete = false;
+  while (!headerIsComplete && (p < end)) {
+    const char *e = lineEnd(p, end);
+    const QList<QByteArray> words =
+        QByteArray(p, int(e - p)).simplified().split(' ');
+    p = qMin(e + 1, end);
+
+    const QByteArray &keyword = words.first();
+    if (keyword == "end_header")
+      headerIsComplete = true;
+    else if ((keyword == "format") && (words.size() >= 2)) {
+      if (words[1] == "binary_little_endian")
+        format = PLY_BINARY_LITTLE_ENDIAN;
+      else if (words[1] == "binary_big_endian")
+        format = PLY_BINARY_BIG_ENDIAN;
+      else if (words[1] != "ascii") {
+        qWarning("MeshCache::import: Unknown PLY format %s",
+                 words[1].constData());
+        return false;
+      }
+    } else if ((keyword == "element") && (words.size() >= 3)) {
+      PlyElement element;
+      element.name = words[1];
+      element.count = words[2].toLongLong();
+      elements.append(element);
+    } else if ((keyword == "property") && !elements.isEmpty()) {
+      PlyProperty property;
+      property.isList = (words.size() >= 5) && (words[1] == "list");
+      property.countType = property.isList ? plyType(words[2]) : PLY_UINT8;
+      property.type = plyType(words[property.isList ? 3 : 1]);
+      property.name = words.last();
+      if ((words.size() < 3) || (property.type == PLY_INVALID) ||
+          (property.countType == PLY_INVALID)) {
+        qWarning("MeshCache::import: Invalid PLY property");
+        return false;
+      }
+      elements.last().properties.append(property);
+    }
+  }
+  if (!headerIsComplete) {
+    qWarning("MeshCache::import: Incomplete PLY header");
+    return false;
+  }
+
+  const bool bigEndian = (format == PLY_BINARY_BIG_ENDIAN);
+  QVector<quint32> indices;
+  int nbVertices = -1;
+  bool hasNormals = false;
+  for (const PlyElement &element : elements) {
+    if ((element.name != "vertex") || (nbVertices >= 0)) {
+      const bool isFace = (element.name == "face");
+      if (isFace && (nbVertices < 0)) {
+        qWarning("MeshCache::import: PLY faces listed before the vertices");
+        return false;
+      }
+      if (!readPlyFaces(element, format, p, end, nbVertices,
+                        isFace ? &indices : nullptr)) {
+        qWarning("MeshCache::import: Invalid PLY %s element",
+                 element.name.constData());
+        return false;
+      }
+      continue;
+    }
+
+    // The vertex element
+    if (element.count > INT_MAX / VERTEX_STRIDE) {
+      qWarning("MeshCache::import: Too many PLY vertices");
+      return false;
+    }
+    nbVertices = int(element.count);
+    const int nbProperties = element.properties.size();
+    QVector<int> slots(nbProperties), offsets(nbProperties);
+    int recordSize = 0, nbNormalSlots = 0, nbTexCoordSlots = 0;
+    for (int k = 0; k < nbProperties; ++k) {
+      const PlyProperty &property = element.properties[k];
+      if (property.isList) {
+        qWarning("MeshCache::import: PLY vertex lists are not supported");
+        return false;
+      }
+      slots[k] = plyVertexSlot(property.name);
+      offsets[k] = recordSize;
+      recordSize += plyTypeSizes[property.type];
+      nbNormalSlots += ((slots[k] >= 3) && (slots[k] < 6)) ? 1 : 0;
+      nbTexCoordSlots += (slots[k] >= 6) ? 1 : 0;
+    }
+    hasNormals = (nbNormalSlots == 3);
+    hasTexCoords_ = (nbTexCoordSlots == 2);
+
+    vertexData_.fill('\0', nbVertices * VERTEX_STRIDE);
+    float *const out = reinterpret_cast<float *>(vertexData_.data());
+    const PlyProperty *const properties = element.properties.constData();
+    const int *const s = slots.constData();
+    QAtomicInt isValid(1);
+
+    if (format == PLY_ASCII) {
+      // One line per vertex
+      QVector<const char *> lines;
+      lines.reserve(nbVertices);
+      while ((lines.size() < nbVertices) && (p < end)) {
+        const char *e = lineEnd(p, end);
+        if (skipSpaces(p, e) != e)
+          lines.append(p);
+        p = qMin(e + 1, end);
+      }
+      if (lines.size() < nbVertices) {
+        qWarning("MeshCache::import: Missing PLY vertices");
+        return false;
+      }
+      const char *const *const l = lines.constData();
+      TaskScheduler::parallelFor(
+          nbVertices,
+          [=, &isValid](int first, int last) {
+            for (int i = first; i < last; ++i) {
+              const char *q = l[i];
+              const char *e = lineEnd(q, end);
+              for (int k = 0; k < nbProperties; ++k) {
+                double value;
+                if (!parseDouble(q, e, value)) {
+                  isValid.storeRelaxed(0);
+                  return;
+                }
+                if (s[k] >= 0)
+                  out[vertexFloats * i + s[k]] = float(value);
+              }
+            }
+          },
+          1024);
+    } else {
+      if (qint64(end - p) < qint64(nbVertices) * recordSize) {
+        qWarning("MeshCache::import: Missing PLY vertices");
+        return false;
+      }
+      const char *const records = p;
+      const int *const o = offsets.constData();
+      TaskScheduler::parallelFor(
+          nbVertices,
+          [=](int first, int last) {
+            for (int i = first; i < last; ++i) {
+              const char *record = records + qint64(i) * recordSize;
+              for (int k = 0; k < nbProperties; ++k)
+                if (s[k] >= 0)
+                  out[vertexFloats * i + s[k]] = float(binaryValue(
+                      record + o[k], properties[k].type, bigEndian));
+            }
+          },
+          1024);
+      p += qint64(nbVertices) * recordSize;
+    }
+
+    if (!isValid.loadRelaxed()) {
+      qWarning("MeshCache::import: Invalid PLY vertex");
+      return false;
+    }
+  }
+
+  if ((nbVertices < 0) || indices.isEmpty()) {
+    qWarning("MeshCache::import: No vertex or no face in PLY file");
+    return false;
+  }
+
+  if (!hasNormals) {
+    const QVector<float> normals = smoothNormals(
+        reinterpret_cast<const float *>(vertexData_.constData()),
+        vertexFloats, nbVertices, indices.constData(), indices.size());
+    float *const out = reinterpret_cast<float *>(vertexData_.data());
+    for (int i = 0; i < nbVertices; ++i)
+      for (int k = 0; k < 3; ++k)
+        out[vertexFloats * i + 3 + k] = normals[3 * i + k];
+  }
+
+  indexData_ = QByteArray(reinterpret_cast<const char *>(indices.constData()),
+                          indices.size() * int(sizeof(quint32)));
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Loading                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates an empty MeshCache. Use load() to fill it. */
+MeshCache::MeshCache()
+    : hasTexCoords_(false), optimized_(false), optimizesOnImport_(false),
+      mappedFile_(nullptr), sourceSize_(0), sourceModified_(0) {}
+
+/*! Destructor. Unmaps the cache file: the vertexData() and indexData() of a
+mapped mesh are then no longer valid. */
+MeshCache::~MeshCache() { clear(); }
+
+/*! Loads the mesh of the OBJ or PLY \p fileName.
+
+When the cacheFileName() of \p fileName exists and was created from its
+current version, it is mapped (see mapCache()). Otherwise, \p fileName is
+import()ed and the cache is written by saveCache(), so that the next load()
+maps it. A cache that cannot be written (read-only directory) only costs an
+import() at each load().
+
+When optimizesOnImport(), the imported mesh is optimize()d before it is
+saved, and a cache that is not isOptimized() is ignored.
+
+Returns \c false (and the MeshCache is empty) when \p fileName cannot be
+imported. */
+bool MeshCache::load(const QString &fileName) {
+  const QFileInfo source(fileName);
+  const QString cache = cacheFileName(fileName);
+  if (source.exists() && QFileInfo::exists(cache) && map(cache, &source)) {
+    if (optimized_ || !optimizesOnImport_)
+      return true;
+    clear();
+  }
+
+  if (!import(fileName))
+    return false;
+  if (optimizesOnImport_)
+    optimize();
+  saveCache(cache);
+  return true;
+}
+
+/*! Parses the OBJ or PLY file \p fileName, without using nor writing a cache
+file. The file is memory-mapped, and parsed in parallel by the
+TaskScheduler::threadPool().
+
+The format is given by the file content (PLY files start with \c "ply"), and
+the \c .obj suffix otherwise. Returns \c false (and the MeshCache is empty)
+when the file cannot be read or is not valid. */
+bool MeshCache::import(const QString &fileName) {
+  clear();
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning("MeshCache::import: Unable to open %s", qPrintable(fileName));
+    return false;
+  }
+
+  // Mapping avoids a copy of the file; large files are read otherwise
+  QByteArray content;
+  const char *begin = nullptr;
+  if (file.size() > 0)
+    begin = reinterpret_cast<const char *>(file.map(0, file.size()));
+  if (!begin) {
+    content = file.readAll();
+    begin = content.constData();
+  }
+  const char *const end = begin + (content.isNull() ? file.size()
+                                                    : content.size());
+
+  const bool isPLY = (end - begin >= 4) && (memcmp(begin, "ply", 3) == 0) &&
+                     ((begin[3] == '\n') || (begin[3] == '\r'));
+  bool ok;
+  if (isPLY)
+    ok = importPLY(begin, end);
+  else if (fileName.endsWith(".obj", Qt::CaseInsensitive))
+    ok = importOBJ(begin, end);
+  else {
+    qWarning("MeshCache::import: %s is neither a PLY nor an OBJ file",
+             qPrintable(fileName));
+    ok = false;
+  }
+
+  if (!ok) {
+    qWarning("MeshCache::import: Unable to import %s", qPrintable(fileName));
+    clear();
+    return false;
+  }
+
+  const QFileInfo source(fileName);
+  sourceSize_ = source.size();
+  sourceModified_ = source.lastModified().toMSecsSinceEpoch();
+  computeBoundingBox();
+  return true;
+}
+
+void MeshCache::computeBoundingBox() {
+  const float *vertex =
+      reinterpret_cast<const float *>(vertexData_.constData());
+  const float *const end = vertex + vertexFloats * nbVertices();
+  if (vertex == end) {
+    min_ = max_ = Vec();
+    return;
+  }
+  min_ = max_ = Vec(vertex[0], vertex[1], vertex[2]);
+  for (; vertex < end; vertex += vertexFloats)
+    for (int k = 0; k < 3; ++k) {
+      min_[k] = qMin(min_[k], qreal(vertex[k]));
+      max_[k] = qMax(max_[k], qreal(vertex[k]));
+    }
+}
+
+/*! Writes the mesh in \p cacheFileName, that mapCache() can map without any
+parsing. The size and modification date of the file given to import() are
+recorded, for load(). Returns \c false (and displays a warning) when the file
+cannot be written.
+
+The file is replaced atomically, so that a concurrent mapCache() never sees a
+partial file. */
+bool MeshCache::saveCache(const QString &cacheFileName) const {
+  MeshCacheHeader header;
+  memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+  header.version = meshCacheVersion;
+  header.flags = (hasTexCoords_ ? hasTexCoordsFlag : 0) |
+                 (optimized_ ? optimizedFlag : 0);
+  header.sourceSize = sourceSize_;
+  header.sourceModified = sourceModified_;
+  header.nbVertices = quint32(nbVertices());
+  header.nbIndices = quint32(nbIndices());
+  for (int k = 0; k < 3; ++k) {
+    header.boundingBox[k] = float(min_[k]);
+    header.boundingBox[3 + k] = float(max_[k]);
+  }
+
+  QSaveFile file(cacheFileName);
+  if (!file.open(QIODevice::WriteOnly) ||
+      (file.write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+       qint64(sizeof(header))) ||
+      (file.write(vertexData_) != vertexData_.size()) ||
+      (file.write(indexData_) != indexData_.size()) || !file.commit()) {
+    qWarning("MeshCache::saveCache: Unable to write %s: %s",
+             qPrintable(cacheFileName), qPrintable(file.errorString()));
+    return false;
+  }
+  return true;
+}
+
+/*! Replaces the mesh by the one of \p cacheFileName, a file written by
+saveCache(). Returns \c false (and displays a warning) when it is not a valid
+cache file, in which case the mesh is not modified.
+
+The file is memory-mapped and read-only: its pages are only read when the
+vertexData() and indexData() are used, for instance by a buffer upload.
+
+\attention The file should not be modified while it is mapped. */
+bool MeshCache::mapCache(const QString &cacheFileName) {
+  return map(cacheFileName, nullptr);
+}
+
+// Same as mapCache(). When source is not null, the cache must have been
+// created from its current version, and no warning is displayed.
+bool MeshCache::map(const QString &cacheFileName, const QFileInfo *source) {
+  QFile *file = new QFile(cacheFileName);
+  const uchar *data = nullptr;
+  if (file->open(QIODevice::ReadOnly) &&
+      (file->size() >= qint64(sizeof(MeshCacheHeader))))
+    data = file->map(0, file->size());
+
+  const MeshCacheHeader *const header =
+      reinterpret_cast<const MeshCacheHeader *>(data);
+  if (!header ||
+      (memcmp(header->magic, meshCacheMagic, sizeof(header->magic)) != 0) ||
+      (header->version != meshCacheVersion) ||
+      (header->nbVertices > quint32(INT_MAX / VERTEX_STRIDE)) ||
+      (header->nbIndices > quint32(INT_MAX / sizeof(quint32))) ||
+      (file->size() !=
+       qint64(sizeof(MeshCacheHeader)) +
+           qint64(header->nbVertices) * VERTEX_STRIDE +
+           qint64(header->nbIndices) * qint64(sizeof(quint32)))) {
+    if (!source)
+      qWarning("MeshCache::mapCache: %s is not a valid mesh cache file",
+               qPrintable(cacheFileName));
+    delete file; // Also unmaps the file
+    return false;
+  }
+
+  if (source &&
+      ((header->sourceSize != source->size()) ||
+       (header->sourceModified !=
+        source->lastModified().toMSecsSinceEpoch()))) {
+    delete file;
+    return false;
+  }
+
+  clear();
+  mappedFile_ = file;
+  const char *const vertices =
+      reinterpret_cast<const char *>(data + sizeof(MeshCacheHeader));
+  const int vertexSize = int(header->nbVertices) * VERTEX_STRIDE;
+  vertexData_ = QByteArray::fromRawData(vertices, vertexSize);
+  indexData_ = QByteArray::fromRawData(
+      vertices + vertexSize, int(header->nbIndices * sizeof(quint32)));
+  min_ = Vec(header->boundingBox[0], header->boundingBox[1],
+             header->boundingBox[2]);
+  max_ = Vec(header->boundingBox[3], header->boundingBox[4],
+             header->boundingBox[5]);
+  hasTexCoords_ = header->flags & hasTexCoordsFlag;
+  optimized_ = header->flags & optimizedFlag;
+  sourceSize_ = header->sourceSize;
+  sourceModified_ = header->sourceModified;
+  return true;
+}
+
+/*! Removes the mesh, and unmaps the cache file when isMapped(). */
+void MeshCache::clear() {
+  // The raw data arrays must not outlive the mapping
+  vertexData_ = QByteArray();
+  indexData_ = QByteArray();
+  delete mappedFile_;
+  mappedFile_ = nullptr;
+  min_ = max_ = Vec();
+  hasTexCoords_ = false;
+  optimized_ = false;
+  sourceSize_ = sourceModified_ = 0;
+}
+
+/*! Reorders the triangles with MeshOptimizer::optimizeVertexCache() and
+MeshOptimizer::optimizeOverdraw(). The vertices are not modified, and the
+mesh looks the same.
+
+When isMapped(), the indices are copied first: the cache file is unchanged
+until the next saveCache(). Build the MeshOptimizer::buildMeshlets() after
+this method, since they are ranges of the indexData(). */
+void MeshCache::optimize() {
+  if (nbIndices() == 0) {
+    optimized_ = true;
+    return;
+  }
+  // data() detaches the indices from the mapped file
+  quint32 *const indices = reinterpret_cast<quint32 *>(indexData_.data());
+  const float *const positions =
+      reinterpret_cast<const float *>(vertexData_.constData());
+  MeshOptimizer::optimizeVertexCache(indices, nbIndices(), nbVertices());
+  MeshOptimizer::optimizeOverdraw(indices, nbIndices(), positions,
+                                  VERTEX_STRIDE, nbVertices());
+  optimized_ = true;
+}
+
+/*! Returns the name of the cache file used by load() for \p fileName: \p
+fileName followed by a \c .qglmesh suffix. */
+QString MeshCache::cacheFileName(const QString &fileName) {
+  return fileName + ".qglmesh";
+}
@@ -0,0 +1,140 @@
+#ifndef QGLVIEWER_MESH_CACHE_H
+#define QGLVIEWER_MESH_CACHE_H
+
+#include "vec.h"
+
+#include <QByteArray>
+#include <QString>
+
+class QFile;
+class QFileInfo;
+
+namespace qglviewer {
+/*! \brief Imports a triangle mesh once, and maps it from a binary cache file
+  afterwards.
+  \class MeshCache meshCache.h QGLViewer/meshCache.h
+
+  Parsing a large OBJ or PLY file at each start of an application takes much
+  longer than reading the same triangles in binary. load() parses the file
+  the first time, in parallel on the TaskScheduler threads, and writes a cache
+  file next to it, with the vertices already interleaved in their GPU layout.
+  The next load()s memory-map this cache: nothing is parsed or copied, and the
+  mapped vertexData() and indexData() can be given as is to a vertex buffer
+  upload:
+  \code
+  void Viewer::init() {
+    if (mesh_.load("statue.ply")) {
+      qglviewer::BufferUploader *uploader = bufferUploader();
+      vertexUpload_ = uploader->submit(mesh_.vertexData());
+      indexUpload_ = uploader->submit(mesh_.indexData());
+    }
+  }
+  \endcode
+
+  Each vertex is made of \c VERTEX_STRIDE bytes: three \c float coordinates,
+  three \c float normal coordinates at \c NORMAL_OFFSET and two \c float
+  texture coordinates at \c TEX_COORD_OFFSET. The mesh is drawn with \c
+  GL_TRIANGLES, using nbIndices() \c GL_UNSIGNED_INT indices.
+
+  The import accepts:
+  - Wavefront OBJ files: \c v, \c vt, \c vn and \c f lines (including
+    negative indices). Polygons are triangulated as fans, and the other lines
+    (materials, groups) are ignored.
+  - PLY files, in ASCII or binary format: the \c x, \c y, \c z, \c nx, \c ny,
+    \c nz and \c s, \c t (or \c u, \c v) properties of the \c vertex element,
+    and the \c vertex_indices list of the \c face element.
+
+  Smooth normals are computed when the file does not provide them, and the
+  texture coordinates are 0 when it has none.
+
+  The cache file is cacheFileName(). It records the size and modification
+  date of the file it was imported from, so that load() imports a modified
+  file again. Values are in native byte order.
+
+  The triangles are kept in the order of the file. Use
+  setOptimizesOnImport() to reorder them with optimize() before the cache is
+  saved: the vertex cache and overdraw optimizations of MeshOptimizer then
+  cost nothing at the next load()s. */
+class QGLVIEWER_EXPORT MeshCache {
+public:
+  /*! The interleaved layout of the vertexData(), in bytes. */
+  enum { VERTEX_STRIDE = 32, NORMAL_OFFSET = 12, TEX_COORD_OFFSET = 24 };
+
+  MeshCache();
+  ~MeshCache();
+
+  /*! @name Loading */
+  //@{
+public:
+  bool load(const QString &fileName);
+  bool import(const QString &fileName);
+  bool saveCache(const QString &cacheFileName) const;
+  bool mapCache(const QString &cacheFileName);
+  void clear();
+
+  static QString cacheFileName(const QString &fileName);
+
+  /*! Returns \c true when load() optimize()s the imported meshes before they
+  are saved in the cache file. Default value is \c false. */
+  bool optimizesOnImport() const { return optimizesOnImport_; }
+  /*! Sets optimizesOnImport(). A cache file written by a load() without
+  optimization is then imported and optimized again. */
+  void setOptimizesOnImport(bool optimize) { optimizesOnImport_ = optimize; }
+
+  /*! Returns \c true when the vertexData() and indexData() are read from a
+  mapped cache file. */
+  bool isMapped() const { return mappedFile_ != nullptr; }
+  //@}
+
+  /*! @name Mesh */
+  //@{
+public:
+  /*! Returns the number of vertices, of \c VERTEX_STRIDE bytes each. */
+  int nbVertices() const { return vertexData_.size() / VERTEX_STRIDE; }
+  /*! Returns the number of indices, three per triangle. */
+  int nbIndices() const { return indexData_.size() / int(sizeof(quint32)); }
+
+  /*! Returns the interleaved vertices. When isMapped(), the array shares the
+  mapped memory, which remains valid until clear() or the MeshCache
+  destruction: complete the uploads that use it before. */
+  QByteArray vertexData() const { return vertexData_; }
+  /*! Returns the \c quint32 triangle indices. Same as vertexData(), the
+  memory is mapped when isMapped(). */
+  QByteArray indexData() const { return indexData_; }
+
+  /*! Returns the lower corner of the bounding box of the vertices. */
+  Vec boundingBoxMin() const { return min_; }
+  /*! Returns the upper corner of the bounding box of the vertices. */
+  Vec boundingBoxMax() const { return max_; }
+  /*! Returns \c true when the imported file had texture coordinates. */
+  bool hasTexCoords() const { return hasTexCoords_; }
+
+  void optimize();
+  /*! Returns \c true when the triangles were reordered by optimize(), or
+  read from a cache file saved after an optimize(). */
+  bool isOptimized() const { return optimized_; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(MeshCache)
+
+  bool map(const QString &cacheFileName, const QFileInfo *source);
+  bool importOBJ(const char *begin, const char *end);
+  bool importPLY(const char *begin, const char *end);
+  void computeBoundingBox();
+
+  QByteArray vertexData_;
+  QByteArray indexData_;
+  Vec min_, max_;
+  bool hasTexCoords_;
+  bool optimized_;
+  bool optimizesOnImport_;
+  QFile *mappedFile_;
+  // The file given to import(), recorded by saveCache()
+  qint64 sourceSize_;
+  qint64 sourceModified_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MESH_CACHE_H
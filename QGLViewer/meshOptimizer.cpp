@@ -0,0 +1,509 @@
+#include "meshOptimizer.h"
+#include "meshCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace qglviewer;
+
+// Size of the LRU cache simulated by optimizeVertexCache()
+static const int scoredCacheSize = 32;
+// Size of the FIFO cache simulated by optimizeOverdraw()
+static const int overdrawCacheSize = 16;
+
+namespace {
+bool isValidMesh(const quint32 *indices, int nbIndices, int nbVertices,
+                 const char *method) {
+  if ((nbIndices < 0) || (nbIndices % 3 != 0)) {
+    qWarning("MeshOptimizer::%s: The number of indices (%d) is not a multiple "
+             "of 3",
+             method, nbIndices);
+    return false;
+  }
+  for (int i = 0; i < nbIndices; ++i)
+    if (indices[i] >= quint32(nbVertices)) {
+      qWarning("MeshOptimizer::%s: Index %u is out of range", method,
+               indices[i]);
+      return false;
+    }
+  return true;
+}
+
+Vec position(const float *positions, int stride, quint32 vertex) {
+  const float *p = reinterpret_cast<const float *>(
+      reinterpret_cast<const char *>(positions) + qint64(stride) * vertex);
+  return Vec(p[0], p[1], p[2]);
+}
+
+// Counter clockwise, its norm is twice the triangle area
+Vec triangleNormal(const quint32 *triangle, const float *positions,
+                   int stride) {
+  const Vec a = position(positions, stride, triangle[0]);
+  return cross(position(positions, stride, triangle[1]) - a,
+               position(positions, stride, triangle[2]) - a);
+}
+
+// Simulates a FIFO post-transform cache: a hit does not move the vertex.
+class FifoCache {
+public:
+  FifoCache(int nbVertices, int size)
+      : timestamps_(nbVertices, 0), size_(size), time_(size + 1) {}
+
+  // Returns the number of vertices of triangle that were not in the cache
+  int addTriangle(const quint32 *triangle) {
+    int misses = 0;
+    for (int k = 0; k < 3; ++k) {
+      int &timestamp = timestamps_[triangle[k]];
+      if (time_ - timestamp > size_) {
+        timestamp = time_++;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+
+  void flush() { time_ += size_ + 1; }
+
+private:
+  QVector<int> timestamps_;
+  int size_;
+  int time_;
+};
+
+// Forsyth's vertex score. Vertices recently used, and vertices with few
+// remaining triangles, are preferred.
+float vertexScore(int cachePosition, int nbRemainingTriangles) {
+  if (nbRemainingTriangles == 0)
+    return -1.0f;
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    // The last triangle vertices are equally good: there is no preferred order
+    if (cachePosition < 3)
+      score = 0.75f;
+    else
+      score = powf(1.0f - float(cachePosition - 3) / (scoredCacheSize - 3),
+                   1.5f);
+  }
+  return score + 2.0f / sqrtf(float(nbRemainingTriangles));
+}
+
+struct Cluster {
+  int first, nbTriangles;
+  qreal sortKey;
+};
+
+bool isDrawnBefore(const Cluster &a, const Cluster &b) {
+  return a.sortKey > b.sortKey;
+}
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Triangle order                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Reorders the triangles of \p indices so that consecutive triangles share
+their vertices, which are then transformed once by the GPU.
+
+Each vertex has a score that increases with its position in a simulated
+cache of the last used vertices, and when few of its triangles remain. The
+next triangle is the one with the largest sum of vertex scores among the
+triangles of the cached vertices: the time is linear in the number of
+triangles. When all the triangles of the cached vertices are drawn, the
+first triangle not drawn yet restarts the order.
+
+The vertex order of each triangle is kept. Displays a warning and does
+nothing when an index is not smaller than \p nbVertices. */
+void MeshOptimizer::optimizeVertexCache(quint32 *indices, int nbIndices,
+                                        int nbVertices) {
+  if (!isValidMesh(indices, nbIndices, nbVertices, "optimizeVertexCache"))
+    return;
+  const int nbTriangles = nbIndices / 3;
+  if (nbTriangles == 0)
+    return;
+
+  // The triangles of each vertex, in compressed rows. The first
+  // nbRemaining[v] ones of vertex v are the ones not emitted yet.
+  QVector<int> nbRemaining(nbVertices, 0);
+  for (int i = 0; i < nbIndices; ++i)
+    ++nbRemaining[indices[i]];
+  QVector<int> offsets(nbVertices + 1);
+  offsets[0] = 0;
+  for (int v = 0; v < nbVertices; ++v)
+    offsets[v + 1] = offsets[v] + nbRemaining[v];
+  QVector<int> vertexTriangles(nbIndices);
+  {
+    QVector<int> end = offsets;
+    for (int i = 0; i < nbIndices; ++i)
+      vertexTriangles[end[indices[i]]++] = i / 3;
+  }
+
+  QVector<int> cachePosition(nbVertices, -1);
+  QVector<float> scores(nbVertices);
+  for (int v = 0; v < nbVertices; ++v)
+    scores[v] = vertexScore(-1, nbRemaining[v]);
+
+  int bestTriangle = 0;
+  float bestScore = -1.0f;
+  for (int t = 0; t < nbTriangles; ++t) {
+    const quint32 *triangle = indices + 3 * t;
+    const float score =
+        scores[triangle[0]] + scores[triangle[1]] + scores[triangle[2]];
+    if (score > bestScore) {
+      bestScore = score;
+      bestTriangle = t;
+    }
+  }
+
+  QVector<quint32> result(nbIndices);
+  QVector<bool> emitted(nbTriangles, false);
+  int cache[scoredCacheSize + 3], newCache[scoredCacheSize + 3];
+  int cacheSize = 0;
+  int nextNotEmitted = 0;
+
+  for (int out = 0; out < nbTriangles; ++out) {
+    if (bestTriangle < 0) {
+      while (emitted[nextNotEmitted])
+        ++nextNotEmitted;
+      bestTriangle = nextNotEmitted;
+    }
+
+    const quint32 *triangle = indices + 3 * bestTriangle;
+    memcpy(result.data() + 3 * out, triangle, 3 * sizeof(quint32));
+    emitted[bestTriangle] = true;
+
+    for (int k = 0; k < 3; ++k) {
+      const int v = int(triangle[k]);
+      int *const triangles = vertexTriangles.data() + offsets[v];
+      int &nb = nbRemaining[v];
+      for (int i = 0; i < nb; ++i)
+        if (triangles[i] == bestTriangle) {
+          triangles[i] = triangles[nb - 1];
+          triangles[nb - 1] = bestTriangle;
+          --nb;
+          break;
+        }
+    }
+
+    // The triangle vertices move to the front of the cache
+    int newSize = 0;
+    for (int k = 0; k < 3; ++k)
+      newCache[newSize++] = int(triangle[k]);
+    for (int i = 0; i < cacheSize; ++i)
+      if ((cache[i] != newCache[0]) && (cache[i] != newCache[1]) &&
+          (cache[i] != newCache[2]))
+        newCache[newSize++] = cache[i];
+
+    cacheSize = qMin(newSize, scoredCacheSize);
+    for (int i = 0; i < newSize; ++i) {
+      const int v = newCache[i];
+      cachePosition[v] = (i < cacheSize) ? i : -1;
+      scores[v] = vertexScore(cachePosition[v], nbRemaining[v]);
+      if (i < cacheSize)
+        cache[i] = v;
+    }
+
+    // Only the scores of the triangles of these vertices changed
+    bestTriangle = -1;
+    bestScore = -1.0f;
+    for (int i = 0; i < newSize; ++i) {
+      const int v = newCache[i];
+      const int *const triangles = vertexTriangles.constData() + offsets[v];
+      for (int j = 0; j < nbRemaining[v]; ++j) {
+        const quint32 *candidate = indices + 3 * triangles[j];
+        const float score = scores[candidate[0]] + scores[candidate[1]] +
+                            scores[candidate[2]];
+        if (score > bestScore) {
+          bestScore = score;
+          bestTriangle = triangles[j];
+        }
+      }
+    }
+  }
+
+  memcpy(indices, result.constData(), nbIndices * sizeof(quint32));
+}
+
+/*! Returns the average number of vertices transformed per triangle when \p
+indices are drawn with a FIFO post-transform cache of \p cacheSize vertices.
+It is between 0.5 (on a large regular mesh) and 3.
+
+Use it to measure the effect of optimizeVertexCache() and
+optimizeOverdraw(). Returns 0 when there is no triangle. */
+qreal MeshOptimizer::averageCacheMissRatio(const quint32 *indices,
+                                           int nbIndices, int nbVertices,
+                                           int cacheSize) {
+  if (!isValidMesh(indices, nbIndices, nbVertices, "averageCacheMissRatio") ||
+      (nbIndices == 0))
+    return 0.0;
+
+  FifoCache cache(nbVertices, qMax(cacheSize, 3));
+  qint64 misses = 0;
+  for (int i = 0; i < nbIndices; i += 3)
+    misses += cache.addTriangle(indices + i);
+  return qreal(misses) / (nbIndices / 3);
+}
+
+/*! Reorders the clusters of the triangles of \p indices so that the outward
+facing parts of the mesh are drawn first. Call it after optimizeVertexCache().
+
+Clusters start where the simulated cache misses the three vertices of a
+triangle. They are further split whenever the average cache miss ratio of
+the current sub-cluster falls under \p threshold times the one of its
+cluster: the vertex cache efficiency decreases by at most this ratio (1.05
+by default), while the smaller clusters are sorted more precisely.
+
+The clusters are sorted by decreasing distance of their plane to the center
+of the mesh: on a convex part, the clusters facing the viewer are then
+drawn before the ones they hide. The \p positions of the \p nbVertices
+vertices are \p stride bytes apart. */
+void MeshOptimizer::optimizeOverdraw(quint32 *indices, int nbIndices,
+                                     const float *positions, int stride,
+                                     int nbVertices, qreal threshold) {
+  if (!isValidMesh(indices, nbIndices, nbVertices, "optimizeOverdraw"))
+    return;
+  const int nbTriangles = nbIndices / 3;
+  if (nbTriangles == 0)
+    return;
+
+  FifoCache cache(nbVertices, overdrawCacheSize);
+  QVector<int> hardBoundaries;
+  for (int t = 0; t < nbTriangles; ++t)
+    if ((cache.addTriangle(indices + 3 * t) == 3) || (t == 0))
+      hardBoundaries.append(t);
+
+  QVector<int> boundaries;
+  for (int h = 0; h < hardBoundaries.size(); ++h) {
+    const int begin = hardBoundaries[h];
+    const int end = (h + 1 < hardBoundaries.size()) ? hardBoundaries[h + 1]
+                                                    : nbTriangles;
+    cache.flush();
+    int misses = 0;
+    for (int t = begin; t < end; ++t)
+      misses += cache.addTriangle(indices + 3 * t);
+    const qreal target = threshold * misses / (end - begin);
+
+    boundaries.append(begin);
+    cache.flush();
+    int runningMisses = 0, runningTriangles = 0;
+    for (int t = begin; t < end; ++t) {
+      runningMisses += cache.addTriangle(indices + 3 * t);
+      ++runningTriangles;
+      if (runningMisses <= target * runningTriangles) {
+        boundaries.append(t + 1);
+        cache.flush();
+        runningMisses = runningTriangles = 0;
+      }
+    }
+    // The last sub-cluster has a poor ratio: it is merged with the previous
+    // one (this also removes a boundary at end)
+    if (boundaries.last() != begin)
+      boundaries.removeLast();
+  }
+
+  Vec meshCenter;
+  for (int v = 0; v < nbVertices; ++v)
+    meshCenter += position(positions, stride, quint32(v));
+  meshCenter /= qMax(nbVertices, 1);
+
+  QVector<Cluster> clusters(boundaries.size());
+  for (int c = 0; c < clusters.size(); ++c) {
+    Cluster &cluster = clusters[c];
+    cluster.first = boundaries[c];
+    cluster.nbTriangles =
+        ((c + 1 < boundaries.size()) ? boundaries[c + 1] : nbTriangles) -
+        cluster.first;
+
+    // Area weighted center and normal
+    Vec center, normal;
+    qreal area = 0.0;
+    for (int t = cluster.first; t < cluster.first + cluster.nbTriangles;
+         ++t) {
+      const quint32 *triangle = indices + 3 * t;
+      const Vec n = triangleNormal(triangle, positions, stride);
+      const qreal a = n.norm();
+      center += a *
+                (position(positions, stride, triangle[0]) +
+                 position(positions, stride, triangle[1]) +
+                 position(positions, stride, triangle[2])) /
+                3.0;
+      normal += n;
+      area += a;
+    }
+    if ((area > 0.0) && (normal.norm() > 0.0))
+      cluster.sortKey = (center / area - meshCenter) * normal.unit();
+    else
+      cluster.sortKey = 0.0;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), isDrawnBefore);
+
+  QVector<quint32> result(nbIndices);
+  quint32 *out = result.data();
+  for (int c = 0; c < clusters.size(); ++c) {
+    const int n = 3 * clusters[c].nbTriangles;
+    memcpy(out, indices + 3 * clusters[c].first, n * sizeof(quint32));
+    out += n;
+  }
+  memcpy(indices, result.constData(), nbIndices * sizeof(quint32));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Meshlets                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static void computeBounds(MeshOptimizer::Meshlet &meshlet,
+                          const quint32 *indices, const float *positions,
+                          int stride) {
+  const quint32 *const begin = indices + meshlet.firstIndex;
+  const quint32 *const end = begin + meshlet.nbIndices;
+
+  Vec min = position(positions, stride, begin[0]), max = min;
+  for (const quint32 *i = begin; i != end; ++i) {
+    const Vec p = position(positions, stride, *i);
+    for (int k = 0; k < 3; ++k) {
+      min[k] = qMin(qreal(min[k]), p[k]);
+      max[k] = qMax(qreal(max[k]), p[k]);
+    }
+  }
+  meshlet.center = (min + max) / 2.0;
+  meshlet.radius = 0.0;
+  for (const quint32 *i = begin; i != end; ++i)
+    meshlet.radius = qMax(
+        meshlet.radius,
+        (position(positions, stride, *i) - meshlet.center).norm());
+
+  // The axis is the average of the unit normals
+  QVector<Vec> normals;
+  normals.reserve(meshlet.nbIndices / 3);
+  Vec axis;
+  for (const quint32 *t = begin; t != end; t += 3) {
+    const Vec n = triangleNormal(t, positions, stride);
+    if (n.norm() > 0.0) {
+      normals.append(n.unit());
+      axis += normals.last();
+    }
+  }
+
+  meshlet.coneAxis = Vec(0.0, 0.0, 1.0);
+  meshlet.coneCutoff = 1.0;
+  if (axis.norm() == 0.0)
+    return;
+  meshlet.coneAxis = axis.unit();
+  qreal minDot = 1.0;
+  for (int i = 0; i < normals.size(); ++i)
+    minDot = qMin(minDot, normals[i] * meshlet.coneAxis);
+  // A cone wider than a half space always has front faces
+  if (minDot > 0.0)
+    meshlet.coneCutoff = sqrt(1.0 - minDot * minDot);
+}
+
+/*! Splits the triangles of \p indices in meshlets: consecutive ranges of at
+most \p maxTriangles triangles, which use at most \p maxVertices vertices.
+Call it after optimizeVertexCache() and optimizeOverdraw(), so that the
+meshlets are compact: the triangles are not reordered.
+
+The Meshlet bounding spheres contain their vertices, and the cones contain
+the normals of their non degenerate triangles. The \p positions of the \p
+nbVertices vertices are \p stride bytes apart. Returns an empty list (and
+displays a warning) when an index is not smaller than \p nbVertices. */
+QVector<MeshOptimizer::Meshlet>
+MeshOptimizer::buildMeshlets(const quint32 *indices, int nbIndices,
+                             const float *positions, int stride,
+                             int nbVertices, int maxVertices,
+                             int maxTriangles) {
+  QVector<Meshlet> meshlets;
+  if (!isValidMesh(indices, nbIndices, nbVertices, "buildMeshlets"))
+    return meshlets;
+  if ((maxVertices < 3) || (maxTriangles < 1)) {
+    qWarning("MeshOptimizer::buildMeshlets: A meshlet must contain at least "
+             "3 vertices and a triangle");
+    return meshlets;
+  }
+
+  // The meshlet in which each vertex was last used
+  QVector<int> meshletOf(nbVertices, -1);
+  Meshlet current;
+  current.firstIndex = current.nbIndices = current.nbVertices = 0;
+
+  for (int i = 0; i < nbIndices; i += 3) {
+    const quint32 *triangle = indices + i;
+    int nbNew = 0;
+    for (int k = 0; k < 3; ++k)
+      if ((meshletOf[triangle[k]] != meshlets.size()) &&
+          ((k == 0) || (triangle[k] != triangle[0])) &&
+          ((k < 2) || (triangle[k] != triangle[1])))
+        ++nbNew;
+
+    if ((current.nbIndices > 0) &&
+        ((current.nbVertices + nbNew > maxVertices) ||
+         (current.nbIndices == 3 * maxTriangles))) {
+      computeBounds(current, indices, positions, stride);
+      meshlets.append(current);
+      current.firstIndex = i;
+      current.nbIndices = current.nbVertices = 0;
+      // All the vertices are new in the next meshlet
+      nbNew = 1 + int(triangle[1] != triangle[0]) +
+              int((triangle[2] != triangle[0]) && (triangle[2] != triangle[1]));
+    }
+
+    for (int k = 0; k < 3; ++k)
+      meshletOf[triangle[k]] = meshlets.size();
+    current.nbVertices += nbNew;
+    current.nbIndices += 3;
+  }
+
+  if (current.nbIndices > 0) {
+    computeBounds(current, indices, positions, stride);
+    meshlets.append(current);
+  }
+  return meshlets;
+}
+
+/*! Same as the other buildMeshlets(), using the vertices and indices of \p
+mesh. */
+QVector<MeshOptimizer::Meshlet>
+MeshOptimizer::buildMeshlets(const MeshCache &mesh, int maxVertices,
+                             int maxTriangles) {
+  const QByteArray vertices = mesh.vertexData();
+  const QByteArray indices = mesh.indexData();
+  return buildMeshlets(reinterpret_cast<const quint32 *>(indices.constData()),
+                       mesh.nbIndices(),
+                       reinterpret_cast<const float *>(vertices.constData()),
+                       MeshCache::VERTEX_STRIDE, mesh.nbVertices(),
+                       maxVertices, maxTriangles);
+}
+
+/*! Returns \c true when all the triangles of \p meshlet are back facing, as
+seen from \p viewpoint, for any position of its vertices in its bounding
+sphere. The test is conservative: some back facing meshlets are not
+detected.
+
+\p viewpoint is in the coordinate system of the mesh, for instance
+Frame::coordinatesOf() of the Camera::position() when the mesh is drawn in a
+Frame. The mesh must be drawn with back face culling, or the culled
+meshlets would be visible. */
+bool MeshOptimizer::isBackFacing(const Meshlet &meshlet,
+                                 const Vec &viewpoint) {
+  if (meshlet.coneCutoff >= 1.0)
+    return false;
+  const Vec direction = meshlet.center - viewpoint;
+  return direction * meshlet.coneAxis >=
+         meshlet.coneCutoff * direction.norm() + meshlet.radius;
+}
+
+/*! Removes the isBackFacing() meshlets from \p visible, a list of indices in
+\p meshlets. The order of the other ones is kept.
+
+\p visible is typically filled by FrustumCuller::computeVisibleObjects(),
+the Meshlet spheres having been registered with FrustumCuller::addSphere()
+in the \p meshlets order, in an otherwise empty FrustumCuller. */
+void MeshOptimizer::cullBackFacingMeshlets(const QVector<Meshlet> &meshlets,
+                                           const Vec &viewpoint,
+                                           QVector<int> &visible) {
+  int nb = 0;
+  for (int i = 0; i < visible.size(); ++i)
+    if (!isBackFacing(meshlets[visible[i]], viewpoint))
+      visible[nb++] = visible[i];
+  visible.resize(nb);
+}
@@ -0,0 +1,113 @@
+#ifndef QGLVIEWER_MESH_OPTIMIZER_H
+#define QGLVIEWER_MESH_OPTIMIZER_H
+
+#include "vec.h"
+
+#include <QVector>
+
+namespace qglviewer {
+class MeshCache;
+
+/*! \brief Reorders the triangles of an indexed mesh for faster rendering, and
+  splits it in meshlets that can be culled.
+  \class MeshOptimizer meshOptimizer.h QGLViewer/meshOptimizer.h
+
+  The triangles of an imported mesh are usually listed in the order of the
+  modeling tool, which makes the GPU transform the same vertex several times:
+  a vertex shared by several triangles only stays in the post-transform vertex
+  cache for a few triangles. optimizeVertexCache() reorders the triangles so
+  that those that share vertices are drawn together, with Forsyth's linear
+  speed algorithm. averageCacheMissRatio() measures the result: less than
+  0.8 transformed vertices per triangle after optimization on regular
+  meshes, instead of up to 3.
+
+  optimizeOverdraw() then splits this order in clusters of a few hundred
+  triangles and draws the outward facing clusters first, so that the depth
+  test rejects more of the hidden fragments (Sander, Nehab and Barczak). The
+  clusters are cut where the vertex cache is flushed anyway, so that the
+  cache efficiency is mostly preserved.
+
+  These passes only permute whole triangles and keep their vertex order: the
+  drawn image and the vertex buffer are unchanged. They take a few hundred
+  milliseconds on a million triangles and are meant to be run once, offline:
+  MeshCache::setOptimizesOnImport() runs them when a mesh is imported, and
+  saves the optimized order in the cache file.
+
+  Finally, buildMeshlets() splits the triangles in contiguous Meshlet ranges
+  of at most 64 vertices, with a bounding sphere and a normal cone. The
+  spheres can be registered in a FrustumCuller, and isBackFacing() rejects
+  the meshlets whose triangles all face away from the camera:
+  \code
+  // In init(), after the mesh optimization
+  meshlets_ = qglviewer::MeshOptimizer::buildMeshlets(mesh_);
+  for (int i = 0; i < meshlets_.size(); ++i)
+    culler_.addSphere(meshlets_[i].center, meshlets_[i].radius);
+
+  // In draw()
+  culler_.computeVisibleObjects(camera(), visible);
+  qglviewer::MeshOptimizer::cullBackFacingMeshlets(meshlets_,
+                                                   camera()->position(),
+                                                   visible);
+  for (int i = 0; i < visible.size(); ++i)
+    glDrawElements(GL_TRIANGLES, meshlets_[visible[i]].nbIndices,
+                   GL_UNSIGNED_INT, indexOffset(meshlets_[visible[i]]));
+  \endcode
+
+  Indices are \c quint32 vertex indices, three per triangle, and positions
+  are three \c float at the beginning of each vertex, \p stride bytes apart
+  (use MeshCache::VERTEX_STRIDE for a MeshCache). Front faces are counter
+  clockwise, as with the OpenGL default \c glFrontFace(). */
+class QGLVIEWER_EXPORT MeshOptimizer {
+public:
+  /*! @name Triangle order */
+  //@{
+public:
+  static void optimizeVertexCache(quint32 *indices, int nbIndices,
+                                  int nbVertices);
+  static void optimizeOverdraw(quint32 *indices, int nbIndices,
+                               const float *positions, int stride,
+                               int nbVertices, qreal threshold = 1.05);
+  static qreal averageCacheMissRatio(const quint32 *indices, int nbIndices,
+                                     int nbVertices, int cacheSize = 16);
+  //@}
+
+  /*! @name Meshlets */
+  //@{
+public:
+  /*! \brief A contiguous range of triangles of a mesh, with the volumes that
+  cull it.
+
+  The triangles are the \c nbIndices indices starting at \c firstIndex in the
+  index buffer: a Meshlet is drawn with a single \c glDrawElements(). They use
+  \c nbVertices different vertices, which are all in the sphere of radius \c
+  radius centered on \c center. The normals of the triangles are within the
+  cone of axis \c coneAxis whose cutoff is \c coneCutoff, see isBackFacing().
+  All the coordinates are in the coordinate system of the mesh vertices. */
+  struct Meshlet {
+    int firstIndex;
+    int nbIndices;
+    int nbVertices;
+    Vec center;
+    qreal radius;
+    Vec coneAxis;
+    qreal coneCutoff;
+  };
+
+  static QVector<Meshlet> buildMeshlets(const quint32 *indices, int nbIndices,
+                                        const float *positions, int stride,
+                                        int nbVertices, int maxVertices = 64,
+                                        int maxTriangles = 124);
+  static QVector<Meshlet> buildMeshlets(const MeshCache &mesh,
+                                        int maxVertices = 64,
+                                        int maxTriangles = 124);
+
+  static bool isBackFacing(const Meshlet &meshlet, const Vec &viewpoint);
+  static void cullBackFacingMeshlets(const QVector<Meshlet> &meshlets,
+                                     const Vec &viewpoint,
+                                     QVector<int> &visible);
+  //@}
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MESH_OPTIMIZER_H
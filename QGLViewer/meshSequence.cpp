@@ -0,0 +1,632 @@
+#include "meshSequence.h"
+#include "animationClock.h"
+#include "meshCache.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+using namespace qglviewer;
+
+// A sequence file is a MeshSequenceHeader followed by the indices shared by all
+// the timesteps and by the vertices of each timestep, in native byte order
+struct MeshSequenceHeader {
+  char magic[8];
+  quint32 version; // Also detects files written with another byte order
+  quint32 nbFrames;
+  quint32 nbVertices;
+  quint32 nbIndices;
+  float boundingBox[6];
+};
+
+static const char meshSequenceMagic[8] = {'Q', 'G', 'L', 'V', 'M', 'S',
+                                          'E', 'Q'};
+static const quint32 meshSequenceVersion = 1;
+
+static const int vertexStride = MeshCache::VERTEX_STRIDE;
+// Changed vertex ranges separated by fewer unchanged vertices are merged, so
+// that an upload is not split in too many writes
+static const int mergedGap = 64;
+// Fraction of changed vertices above which the whole vertex buffer is written
+static const double maximumDeltaRatio = 0.5;
+
+// Sets ranges to the (first, count) ranges of vertices that differ between
+// vertices and previous. Returns false when more than maximumDeltaRatio of the
+// vertices changed.
+static bool findChangedRanges(const char *vertices, const char *previous,
+                              int nbVertices, QVector<int> &ranges) {
+  ranges.clear();
+  int nbChanged = 0;
+  int i = 0;
+  while (i < nbVertices) {
+    if (memcmp(vertices + i * vertexStride, previous + i * vertexStride,
+               vertexStride) == 0) {
+      ++i;
+      continue;
+    }
+
+    const int first = i;
+    int last = i;
+    for (++i; (i < nbVertices) && (i - last <= mergedGap); ++i)
+      if (memcmp(vertices + i * vertexStride, previous + i * vertexStride,
+                 vertexStride) != 0)
+        last = i;
+    ranges << first << last + 1 - first;
+    nbChanged += last + 1 - first;
+  }
+  return nbChanged <= maximumDeltaRatio * nbVertices;
+}
+
+/*! Constructs an empty sequence, attached to the
+AnimationClock::applicationClock(). */
+MeshSequence::MeshSequence(QObject *parent)
+    : QObject(parent), mappedFile_(nullptr), mappedVertices_(nullptr),
+      nbFrames_(0), nbVertices_(0), frameRate_(25.0), playing_(false),
+      time_(0.0), bufferSize_(8), nbStalls_(0), threadPool_(nullptr),
+      stopDecoding_(false), currentFrame_(0), loop_(true),
+      vertexBuffer_(nullptr), indexBuffer_(nullptr), uploadedFrame_(-1),
+      uploadedTopology_(-2), uploadedNbVertices_(0), uploadedNbIndices_(0),
+      lastUploadSize_(0) {
+  setAnimationClock(AnimationClock::applicationClock());
+}
+
+/*! Stops the decoding thread. The vertex buffers are released when an OpenGL
+context is current. */
+MeshSequence::~MeshSequence() {
+  clear();
+  delete threadPool_;
+  if (QOpenGLContext::currentContext())
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Sequence                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the sequence to the meshes of \p fileNames, one per timestep, read by
+the decoding thread with MeshCache::load(): their cache files are created by
+the first playback, and memory-mapped by the next ones.
+
+The first mesh is loaded by this method, which returns \c false (and keeps the
+current sequence) when it can not be read. A timestep that can not be read is
+not displayed. */
+bool MeshSequence::setFrameFiles(const QStringList &fileNames) {
+  if (fileNames.isEmpty()) {
+    qWarning("MeshSequence::setFrameFiles: No file name");
+    return false;
+  }
+  MeshCache first;
+  if (!first.load(fileNames.first()))
+    return false;
+
+  clear();
+  fileNames_ = fileNames;
+  nbFrames_ = fileNames.size();
+  nbVertices_ = first.nbVertices();
+  // A copy, the mapping of first does not outlive it
+  indices_ =
+      QByteArray(first.indexData().constData(), first.indexData().size());
+  min_ = first.boundingBoxMin();
+  max_ = first.boundingBoxMax();
+  startDecoding();
+  return true;
+}
+
+/*! Sets the sequence to the timesteps of \p sequenceFileName, a file written
+by saveSequence(). Returns \c false (and displays a warning) when it is not a
+valid sequence file, in which case the sequence is not modified.
+
+The file is memory-mapped and read-only: the vertices of a timestep are only
+read from disk by the decoding thread, when it is about to be displayed.
+
+\attention The file should not be modified while it is mapped. */
+bool MeshSequence::mapSequence(const QString &sequenceFileName) {
+  QFile *file = new QFile(sequenceFileName);
+  const uchar *data = nullptr;
+  if (file->open(QIODevice::ReadOnly) &&
+      (file->size() >= qint64(sizeof(MeshSequenceHeader))))
+    data = file->map(0, file->size());
+
+  const MeshSequenceHeader *const header =
+      reinterpret_cast<const MeshSequenceHeader *>(data);
+  if (!header ||
+      (memcmp(header->magic, meshSequenceMagic, sizeof(header->magic)) !=
+       0) ||
+      (header->version != meshSequenceVersion) || (header->nbFrames == 0) ||
+      (header->nbFrames > quint32(INT_MAX)) ||
+      (header->nbVertices > quint32(INT_MAX / vertexStride)) ||
+      (header->nbIndices > quint32(INT_MAX / sizeof(quint32))) ||
+      (file->size() != qint64(sizeof(MeshSequenceHeader)) +
+                           qint64(header->nbIndices) * qint64(sizeof(quint32)) +
+                           qint64(header->nbFrames) *
+                               qint64(header->nbVertices) * vertexStride)) {
+    qWarning("MeshSequence::mapSequence: %s is not a valid sequence file",
+             qPrintable(sequenceFileName));
+    delete file; // Also unmaps the file
+    return false;
+  }
+
+  clear();
+  mappedFile_ = file;
+  const char *const indices =
+      reinterpret_cast<const char *>(data + sizeof(MeshSequenceHeader));
+  const int indexSize = int(header->nbIndices * sizeof(quint32));
+  indices_ = QByteArray::fromRawData(indices, indexSize);
+  mappedVertices_ = indices + indexSize;
+  nbFrames_ = int(header->nbFrames);
+  nbVertices_ = int(header->nbVertices);
+  min_ = Vec(header->boundingBox[0], header->boundingBox[1],
+             header->boundingBox[2]);
+  max_ = Vec(header->boundingBox[3], header->boundingBox[4],
+             header->boundingBox[5]);
+  startDecoding();
+  return true;
+}
+
+/*! Writes the meshes of \p fileNames, read with MeshCache::load(), in the
+sequence file \p sequenceFileName, to be played with mapSequence().
+
+All the meshes must have the triangles and the number of vertices of the
+first one, only their vertices being stored. Returns \c false (and displays a
+warning) otherwise, or when a mesh can not be read. */
+bool MeshSequence::saveSequence(const QStringList &fileNames,
+                                const QString &sequenceFileName) {
+  if (fileNames.isEmpty()) {
+    qWarning("MeshSequence::saveSequence: No file name");
+    return false;
+  }
+  MeshCache first;
+  if (!first.load(fileNames.first()))
+    return false;
+
+  MeshSequenceHeader header;
+  memcpy(header.magic, meshSequenceMagic, sizeof(header.magic));
+  header.version = meshSequenceVersion;
+  header.nbFrames = quint32(fileNames.size());
+  header.nbVertices = quint32(first.nbVertices());
+  header.nbIndices = quint32(first.nbIndices());
+  Vec min = first.boundingBoxMin();
+  Vec max = first.boundingBoxMax();
+
+  QSaveFile file(sequenceFileName);
+  bool written =
+      file.open(QIODevice::WriteOnly) &&
+      (file.write(reinterpret_cast<const char *>(&header), sizeof(header)) ==
+       qint64(sizeof(header))) &&
+      (file.write(first.indexData()) == first.indexData().size()) &&
+      (file.write(first.vertexData()) == first.vertexData().size());
+
+  for (int i = 1; written && (i < fileNames.size()); ++i) {
+    MeshCache mesh;
+    if (!mesh.load(fileNames[i]))
+      return false;
+    if ((mesh.nbVertices() != first.nbVertices()) ||
+        (mesh.indexData() != first.indexData())) {
+      qWarning("MeshSequence::saveSequence: %s does not have the triangles "
+               "of %s",
+               qPrintable(fileNames[i]), qPrintable(fileNames.first()));
+      return false;
+    }
+    for (int k = 0; k < 3; ++k) {
+      min[k] = std::min(qreal(min[k]), qreal(mesh.boundingBoxMin()[k]));
+      max[k] = std::max(qreal(max[k]), qreal(mesh.boundingBoxMax()[k]));
+    }
+    written = (file.write(mesh.vertexData()) == mesh.vertexData().size());
+  }
+
+  // The bounding box of all the timesteps is only known now
+  for (int k = 0; k < 3; ++k) {
+    header.boundingBox[k] = float(min[k]);
+    header.boundingBox[3 + k] = float(max[k]);
+  }
+  written = written && file.seek(0) &&
+            (file.write(reinterpret_cast<const char *>(&header),
+                        sizeof(header)) == qint64(sizeof(header))) &&
+            file.commit();
+  if (!written) {
+    qWarning("MeshSequence::saveSequence: Unable to write %s: %s",
+             qPrintable(sequenceFileName), qPrintable(file.errorString()));
+    return false;
+  }
+  return true;
+}
+
+/*! Removes the sequence, and unmaps the sequence file when isMapped(). Stops
+the playback. */
+void MeshSequence::clear() {
+  stop();
+  stopDecoding();
+  slots_.clear();
+  fileNames_.clear();
+  // The raw data array must not outlive the mapping
+  indices_ = QByteArray();
+  delete mappedFile_;
+  mappedFile_ = nullptr;
+  mappedVertices_ = nullptr;
+  nbFrames_ = 0;
+  nbVertices_ = 0;
+  min_ = max_ = Vec();
+  currentFrame_ = 0;
+  time_ = 0.0;
+  nbStalls_ = 0;
+  uploadedFrame_ = -1;
+  uploadedTopology_ = -2;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Playback                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the animationClock(). The playback is not advanced when \p clock is
+\c nullptr. */
+void MeshSequence::setAnimationClock(AnimationClock *clock) {
+  if (clock == animationClock_)
+    return;
+
+  if (animationClock_) {
+    animationClock_->stop(this);
+    disconnect(animationClock_, SIGNAL(tick(int)), this, SLOT(advance(int)));
+  }
+
+  animationClock_ = clock;
+
+  if (clock) {
+    connect(clock, SIGNAL(tick(int)), SLOT(advance(int)));
+    if (playing_)
+      clock->start(this);
+  }
+}
+
+/*! Sets the frameRate(). Values that are not positive are ignored. */
+void MeshSequence::setFrameRate(qreal rate) {
+  if (rate <= 0.0) {
+    qWarning("MeshSequence::setFrameRate: rate must be positive");
+    return;
+  }
+  frameRate_ = rate;
+}
+
+/*! Sets loopIsEnabled(). */
+void MeshSequence::setLoopEnabled(bool enabled) {
+  QMutexLocker locker(&mutex_);
+  loop_ = enabled;
+  frameRequested_.wakeAll();
+}
+
+/*! Sets the bufferSize(), at least 2. Larger buffers absorb longer disk
+latencies, at the price of bufferSize() decoded timesteps in memory. The
+decoded timesteps are discarded. */
+void MeshSequence::setBufferSize(int nbFrames) {
+  nbFrames = std::max(nbFrames, 2);
+  if (nbFrames == bufferSize_)
+    return;
+  stopDecoding();
+  bufferSize_ = nbFrames;
+  startDecoding();
+}
+
+/*! Starts the playback from the currentFrame(), or from the first timestep
+when the last one is displayed and loopIsEnabled() is \c false. */
+void MeshSequence::play() {
+  if (playing_ || (nbFrames_ == 0))
+    return;
+  if (!loop_ && (currentFrame_ == nbFrames_ - 1))
+    setCurrentFrame(0);
+  playing_ = true;
+  time_ = 0.0;
+  if (animationClock_)
+    animationClock_->start(this);
+}
+
+/*! Stops the playback, at the currentFrame(). */
+void MeshSequence::stop() {
+  if (!playing_)
+    return;
+  playing_ = false;
+  if (animationClock_)
+    animationClock_->stop(this);
+}
+
+/*! Displays the timestep \p frame, clamped to the sequence. The decoding
+thread is redirected to the timesteps that follow it: frameChanged() is emitted
+again once it is decoded. */
+void MeshSequence::setCurrentFrame(int frame) {
+  if (nbFrames_ == 0)
+    return;
+  frame = qBound(0, frame, nbFrames_ - 1);
+  time_ = 0.0;
+  if (frame != currentFrame_)
+    showFrame(frame);
+}
+
+// Advances the playback by elapsed milliseconds. The timesteps that are not
+// decoded yet are waited for.
+void MeshSequence::advance(int elapsed) {
+  if (!playing_ || (nbFrames_ == 0))
+    return;
+
+  const qreal period = 1000.0 / frameRate_;
+  time_ += elapsed;
+  int frame = currentFrame_;
+  while (time_ >= period) {
+    int next = frame + 1;
+    if (next == nbFrames_) {
+      if (!loop_) {
+        stop();
+        break;
+      }
+      next = 0;
+    }
+    if (!isDecoded(next)) {
+      ++nbStalls_;
+      time_ = period;
+      break;
+    }
+    time_ -= period;
+    frame = next;
+  }
+
+  if (frame != currentFrame_)
+    showFrame(frame);
+}
+
+void MeshSequence::showFrame(int frame) {
+  {
+    QMutexLocker locker(&mutex_);
+    currentFrame_ = frame;
+    frameRequested_.wakeAll();
+  }
+  Q_EMIT frameChanged(frame);
+}
+
+bool MeshSequence::isDecoded(int frame) const {
+  QMutexLocker locker(&mutex_);
+  const Slot &slot = slots_[frame % slots_.size()];
+  return (slot.frame == frame) && slot.ready;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Decoding thread                               //
+////////////////////////////////////////////////////////////////////////////////
+
+// Starts the decoding thread, with an empty ring buffer
+void MeshSequence::startDecoding() {
+  if (nbFrames_ == 0)
+    return;
+
+  if (!threadPool_) {
+    threadPool_ = new QThreadPool();
+    threadPool_->setMaxThreadCount(1);
+  }
+
+  slots_ = QVector<Slot>(std::min(bufferSize_, nbFrames_));
+  for (Slot &slot : slots_) {
+    slot.frame = -1;
+    slot.ready = false;
+    slot.deltaFrom = -1;
+  }
+  stopDecoding_ = false;
+  threadPool_->start(QRunnable::create([this]() { decode(); }));
+}
+
+// Waits for the end of the decoding thread
+void MeshSequence::stopDecoding() {
+  if (!threadPool_)
+    return;
+  {
+    QMutexLocker locker(&mutex_);
+    stopDecoding_ = true;
+    frameRequested_.wakeAll();
+  }
+  threadPool_->waitForDone();
+}
+
+// The first of the timesteps that follow the current one (current one
+// included) that is not in the ring buffer, or -1 when they all are. Called
+// with mutex_ locked.
+int MeshSequence::nextFrameToDecode() const {
+  const int nbSlots = slots_.size();
+  for (int i = 0; i < nbSlots; ++i) {
+    int frame = currentFrame_ + i;
+    if (frame >= nbFrames_) {
+      if (!loop_)
+        break;
+      frame -= nbFrames_;
+    }
+    if (slots_[frame % nbSlots].frame != frame)
+      return frame;
+  }
+  return -1;
+}
+
+// The timestep played before frame, or -1. Called with mutex_ locked.
+int MeshSequence::previousFrame(int frame) const {
+  if (frame > 0)
+    return frame - 1;
+  return (loop_ && (nbFrames_ > 1)) ? nbFrames_ - 1 : -1;
+}
+
+// The loop of the decoding thread, which fills the ring buffer ahead of the
+// currentFrame()
+void MeshSequence::decode() {
+  QMutexLocker locker(&mutex_);
+  for (;;) {
+    int frame = -1;
+    while (!stopDecoding_ && ((frame = nextFrameToDecode()) < 0))
+      frameRequested_.wait(&mutex_);
+    if (stopDecoding_)
+      return;
+
+    const int index = frame % slots_.size();
+    Slot &slot = slots_[index];
+    slot.frame = frame;
+    slot.ready = false;
+    slot.vertices.clear();
+    slot.indices.clear();
+
+    // The vertices of the previous timestep, to find the changed ones
+    const int previous = previousFrame(frame);
+    QByteArray previousVertices;
+    if (previous >= 0) {
+      const Slot &p = slots_[previous % slots_.size()];
+      if ((p.frame == previous) && p.ready && p.indices.isEmpty())
+        previousVertices = p.vertices;
+    }
+    locker.unlock();
+
+    // The sequence is only modified while this thread is stopped
+    QByteArray vertices, indices;
+    if (mappedFile_) {
+      const qint64 frameSize = qint64(nbVertices_) * vertexStride;
+      // The pages of the mapping are read from disk by this copy
+      vertices = QByteArray(mappedVertices_ + frame * frameSize,
+                            int(frameSize));
+      if ((previous >= 0) && previousVertices.isEmpty())
+        previousVertices = QByteArray::fromRawData(
+            mappedVertices_ + previous * frameSize, int(frameSize));
+    } else {
+      MeshCache mesh;
+      if (mesh.load(fileNames_[frame])) {
+        vertices = QByteArray(mesh.vertexData().constData(),
+                              mesh.vertexData().size());
+        if ((mesh.nbVertices() != nbVertices_) ||
+            (mesh.indexData() != indices_))
+          indices = QByteArray(mesh.indexData().constData(),
+                               mesh.indexData().size());
+      }
+    }
+
+    QVector<int> deltas;
+    const bool hasDeltas =
+        !vertices.isEmpty() && indices.isEmpty() &&
+        (previousVertices.size() == vertices.size()) &&
+        findChangedRanges(vertices.constData(), previousVertices.constData(),
+                          nbVertices_, deltas);
+
+    locker.relock();
+    Slot &decoded = slots_[index];
+    if (decoded.frame == frame) {
+      decoded.vertices = vertices;
+      decoded.indices = indices;
+      decoded.deltas = deltas;
+      decoded.deltaFrom = hasDeltas ? previous : -1;
+      decoded.ready = true;
+    }
+    if (frame == currentFrame_) {
+      locker.unlock();
+      Q_EMIT frameChanged(frame);
+      locker.relock();
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Draws the currentFrame() with \c GL_TRIANGLES, or the previously drawn
+timestep when it is not decoded yet.
+
+Only the vertices that differ from the previously drawn timestep are uploaded
+when it precedes the currentFrame() and has the same triangles. */
+void MeshSequence::draw() {
+  lastUploadSize_ = 0;
+  if (nbFrames_ == 0)
+    return;
+
+  Slot slot;
+  slot.frame = -1;
+  {
+    QMutexLocker locker(&mutex_);
+    const Slot &current = slots_[currentFrame_ % slots_.size()];
+    if ((current.frame == currentFrame_) && current.ready)
+      slot = current;
+  }
+
+  if ((slot.frame >= 0) && (slot.frame != uploadedFrame_) &&
+      !slot.vertices.isEmpty()) {
+    if (!vertexBuffer_) {
+      vertexBuffer_ = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+      vertexBuffer_->create();
+      vertexBuffer_->setUsagePattern(QOpenGLBuffer::StreamDraw);
+      indexBuffer_ = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+      indexBuffer_->create();
+    }
+
+    const int topology = slot.indices.isEmpty() ? -1 : slot.frame;
+    if (topology != uploadedTopology_) {
+      const QByteArray &indices = (topology < 0) ? indices_ : slot.indices;
+      indexBuffer_->bind();
+      indexBuffer_->allocate(indices.constData(), indices.size());
+      indexBuffer_->release();
+      uploadedTopology_ = topology;
+      uploadedNbIndices_ = indices.size() / int(sizeof(quint32));
+      lastUploadSize_ += indices.size();
+    }
+
+    const int nbVertices = slot.vertices.size() / vertexStride;
+    vertexBuffer_->bind();
+    if ((uploadedFrame_ >= 0) && (slot.deltaFrom == uploadedFrame_) &&
+        (nbVertices == uploadedNbVertices_)) {
+      for (int i = 0; i < slot.deltas.size(); i += 2) {
+        const int offset = slot.deltas[i] * vertexStride;
+        const int size = slot.deltas[i + 1] * vertexStride;
+        vertexBuffer_->write(offset, slot.vertices.constData() + offset, size);
+        lastUploadSize_ += size;
+      }
+    } else {
+      if (nbVertices == uploadedNbVertices_)
+        vertexBuffer_->write(0, slot.vertices.constData(),
+                             slot.vertices.size());
+      else
+        vertexBuffer_->allocate(slot.vertices.constData(),
+                                slot.vertices.size());
+      uploadedNbVertices_ = nbVertices;
+      lastUploadSize_ += slot.vertices.size();
+    }
+    vertexBuffer_->release();
+    uploadedFrame_ = slot.frame;
+  }
+
+  if (uploadedFrame_ < 0)
+    return;
+
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  vertexBuffer_->bind();
+  glVertexPointer(3, GL_FLOAT, vertexStride, nullptr);
+  glNormalPointer(GL_FLOAT, vertexStride,
+                  reinterpret_cast<const void *>(MeshCache::NORMAL_OFFSET));
+  indexBuffer_->bind();
+  glDrawElements(GL_TRIANGLES, uploadedNbIndices_, GL_UNSIGNED_INT, nullptr);
+  indexBuffer_->release();
+  vertexBuffer_->release();
+
+  glPopClientAttrib();
+}
+
+/*! Releases the vertex buffers, which are uploaded again by the next draw().
+The OpenGL context must be current. */
+void MeshSequence::cleanupGL() {
+  if (vertexBuffer_) {
+    vertexBuffer_->destroy();
+    indexBuffer_->destroy();
+  }
+  delete vertexBuffer_;
+  delete indexBuffer_;
+  vertexBuffer_ = nullptr;
+  indexBuffer_ = nullptr;
+  uploadedFrame_ = -1;
+  uploadedTopology_ = -2;
+  uploadedNbVertices_ = 0;
+}
@@ -0,0 +1,203 @@
+#ifndef QGLVIEWER_MESH_SEQUENCE_H
+#define QGLVIEWER_MESH_SEQUENCE_H
+
+#include "vec.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QVector>
+#include <QWaitCondition>
+
+class QFile;
+class QOpenGLBuffer;
+class QThreadPool;
+
+namespace qglviewer {
+class AnimationClock;
+
+/*! \brief Plays a sequence of meshes, such as the timesteps of a simulation.
+  \class MeshSequence meshSequence.h QGLViewer/meshSequence.h
+
+  Loading a timestep from disk when it is drawn makes the playback stutter. A
+  MeshSequence instead decodes the bufferSize() timesteps that follow the
+  currentFrame() in a ring buffer, filled by a background thread ahead of the
+  playback, which is advanced by an AnimationClock:
+  \code
+  void Viewer::init() {
+    sequence_ = new qglviewer::MeshSequence(this);
+    sequence_->mapSequence("simulation.qms");
+    sequence_->setFrameRate(30.0);
+    sequence_->setAnimationClock(animationClock());
+    connect(sequence_, SIGNAL(frameChanged(int)), SLOT(update()));
+    sequence_->play();
+  }
+
+  void Viewer::draw() { sequence_->draw(); }
+  \endcode
+
+  The timesteps come either from a list of mesh files (setFrameFiles()), each
+  read with MeshCache::load(), or from a single sequence file, created by
+  saveSequence() and memory-mapped by mapSequence(). The timesteps of a
+  sequence file share the same triangles: only their vertices are stored.
+
+  When two consecutive timesteps have the same triangles, draw() only uploads
+  the ranges of vertices that differ, found by the decoding thread: the
+  static parts of a simulation cost no bandwidth. A timestep that is not
+  decoded yet when it should be displayed delays the playback, counted by
+  nbStalls(), instead of blocking the drawing.
+
+  draw() uses vertex arrays and hence requires a compatibility profile. Call
+  cleanupGL() with the viewer's context current before it is destroyed. */
+class QGLVIEWER_EXPORT MeshSequence : public QObject {
+  Q_OBJECT
+
+public:
+  explicit MeshSequence(QObject *parent = nullptr);
+  virtual ~MeshSequence();
+
+  /*! @name Sequence */
+  //@{
+public:
+  bool setFrameFiles(const QStringList &fileNames);
+  bool mapSequence(const QString &sequenceFileName);
+  static bool saveSequence(const QStringList &fileNames,
+                           const QString &sequenceFileName);
+  void clear();
+
+  /*! Returns the number of timesteps of the sequence. */
+  int nbFrames() const { return nbFrames_; }
+  /*! Returns \c true when the sequence is a memory-mapped sequence file. */
+  bool isMapped() const { return mappedFile_ != nullptr; }
+
+  /*! Returns the lower corner of the bounding box of all the timesteps of a
+  sequence file, or of the first timestep of setFrameFiles(). */
+  Vec boundingBoxMin() const { return min_; }
+  /*! Returns the upper corner of the bounding box, see boundingBoxMin(). */
+  Vec boundingBoxMax() const { return max_; }
+  //@}
+
+  /*! @name Playback */
+  //@{
+public:
+  /*! Returns the AnimationClock that advances the playback. Default value is
+  the AnimationClock::applicationClock(). */
+  AnimationClock *animationClock() const { return animationClock_; }
+  void setAnimationClock(AnimationClock *clock);
+
+  /*! Returns the number of timesteps played per second. Default value is 25.
+  */
+  qreal frameRate() const { return frameRate_; }
+  void setFrameRate(qreal rate);
+
+  /*! Returns \c true when the playback starts again from the first timestep
+  after the last one. Default value is \c true. */
+  bool loopIsEnabled() const { return loop_; }
+  void setLoopEnabled(bool enabled = true);
+
+  /*! Returns \c true between play() and stop(). */
+  bool isPlaying() const { return playing_; }
+  /*! Returns the index of the displayed timestep. */
+  int currentFrame() const { return currentFrame_; }
+
+  /*! Returns the number of timesteps decoded ahead of the playback, current
+  one included. Default value is 8. */
+  int bufferSize() const { return bufferSize_; }
+  void setBufferSize(int nbFrames);
+
+  /*! Returns the number of clock ticks at which the next timestep should have
+  been displayed, but was not decoded yet. Reset by setFrameFiles() and
+  mapSequence(). */
+  int nbStalls() const { return nbStalls_; }
+
+public Q_SLOTS:
+  void play();
+  void stop();
+  void setCurrentFrame(int frame);
+
+Q_SIGNALS:
+  /*! Signal emitted when the currentFrame() changes, and when it is decoded,
+  possibly from the decoding thread. Connect it to your viewer's \c update()
+  slot. */
+  void frameChanged(int frame);
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  void draw();
+  void cleanupGL();
+
+  /*! Returns the number of bytes uploaded by the last draw(). */
+  int lastUploadSize() const { return lastUploadSize_; }
+  //@}
+
+private Q_SLOTS:
+  void advance(int elapsed);
+
+private:
+  Q_DISABLE_COPY(MeshSequence)
+
+  // A decoded timestep of the ring buffer
+  struct Slot {
+    int frame; // -1 when unused
+    bool ready;
+    QByteArray vertices;
+    QByteArray indices; // empty when they are indices_
+    // Vertex ranges (first, count) that differ from the timestep deltaFrom,
+    // or -1 when unknown
+    QVector<int> deltas;
+    int deltaFrom;
+  };
+
+  void startDecoding();
+  void stopDecoding();
+  void decode();
+  int nextFrameToDecode() const;
+  int previousFrame(int frame) const;
+  bool isDecoded(int frame) const;
+  void showFrame(int frame);
+
+  // S e q u e n c e
+  QStringList fileNames_; // of setFrameFiles()
+  QFile *mappedFile_;     // of mapSequence()
+  const char *mappedVertices_;
+  int nbFrames_;
+  int nbVertices_;     // of the first timestep
+  QByteArray indices_; // of the first timestep
+  Vec min_, max_;
+
+  // P l a y b a c k
+  QPointer<AnimationClock> animationClock_;
+  qreal frameRate_;
+  bool playing_;
+  qreal time_; // since the currentFrame() was displayed, in milliseconds
+  int bufferSize_;
+  int nbStalls_;
+
+  // D e c o d i n g   t h r e a d
+  QThreadPool *threadPool_;
+  // Protected by mutex_
+  mutable QMutex mutex_;
+  QWaitCondition frameRequested_;
+  bool stopDecoding_;
+  int currentFrame_; // only modified by the main thread
+  QVector<Slot> slots_; // frame f is in slot f % slots_.size()
+  bool loop_;
+
+  // O p e n G L
+  QOpenGLBuffer *vertexBuffer_; // nullptr before the first upload
+  QOpenGLBuffer *indexBuffer_;
+  int uploadedFrame_;
+  // -1 for indices_, the frame of its own indices otherwise, -2 when none
+  int uploadedTopology_;
+  int uploadedNbVertices_;
+  int uploadedNbIndices_;
+  int lastUploadSize_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MESH_SEQUENCE_H
@@ -0,0 +1,107 @@
+#include "modificationBatch.h"
+#include "keyFrameInterpolator.h"
+
+#include <QSet>
+#include <QVector>
+
+using namespace qglviewer;
+
+namespace {
+// The modifications deferred by the ModificationBatches of a thread.
+// Vectors keep the order of the first modification, sets avoid duplicates.
+struct DeferredSignals {
+  DeferredSignals() : depth(0) {}
+
+  int depth;
+  QVector<Frame *> frames;
+  QSet<Frame *> frameSet;
+  QVector<KeyFrameInterpolator *> interpolators;
+  QSet<KeyFrameInterpolator *> interpolatorSet;
+};
+
+DeferredSignals &deferredSignals() {
+  static thread_local DeferredSignals deferred;
+  return deferred;
+}
+} // namespace
+
+/*! Starts deferring the Frame::modified() and
+KeyFrameInterpolator::interpolated() signals of the current thread. */
+ModificationBatch::ModificationBatch() { ++deferredSignals().depth; }
+
+/*! Ends the batch. When it is the outermost batch, each Frame modified during
+the batch emits Frame::modified() once, and each interpolated
+KeyFrameInterpolator emits KeyFrameInterpolator::interpolated() once.
+
+The Frames are notified before the KeyFrameInterpolators. Modifications made
+by the connected slots are not deferred. */
+ModificationBatch::~ModificationBatch() {
+  DeferredSignals &deferred = deferredSignals();
+  if (--deferred.depth > 0)
+    return;
+
+  // The slots may delete the recorded objects (see forget()), or create a
+  // new batch that flushes the remaining ones.
+  for (int i = 0; i < deferred.frames.size(); ++i) {
+    Frame *const frame = deferred.frames[i];
+    if (!frame)
+      continue;
+    deferred.frames[i] = nullptr;
+    deferred.frameSet.remove(frame);
+    Q_EMIT frame->modified();
+  }
+  deferred.frames.clear();
+
+  for (int i = 0; i < deferred.interpolators.size(); ++i) {
+    KeyFrameInterpolator *const interpolator = deferred.interpolators[i];
+    if (!interpolator)
+      continue;
+    deferred.interpolators[i] = nullptr;
+    deferred.interpolatorSet.remove(interpolator);
+    Q_EMIT interpolator->interpolated();
+  }
+  deferred.interpolators.clear();
+}
+
+/*! Returns \c true when a ModificationBatch exists in the current thread. */
+bool ModificationBatch::isActive() { return deferredSignals().depth > 0; }
+
+// Records frame when a batch is active. Returns false when the signal must be
+// emitted immediately.
+bool ModificationBatch::deferModified(Frame *frame) {
+  DeferredSignals &deferred = deferredSignals();
+  if (deferred.depth == 0)
+    return false;
+
+  if (!deferred.frameSet.contains(frame)) {
+    deferred.frameSet.insert(frame);
+    deferred.frames.append(frame);
+  }
+  return true;
+}
+
+bool ModificationBatch::deferInterpolated(KeyFrameInterpolator *interpolator) {
+  DeferredSignals &deferred = deferredSignals();
+  if (deferred.depth == 0)
+    return false;
+
+  if (!deferred.interpolatorSet.contains(interpolator)) {
+    deferred.interpolatorSet.insert(interpolator);
+    deferred.interpolators.append(interpolator);
+  }
+  return true;
+}
+
+// Called by the destructors, so that no signal is emitted by deleted objects
+void ModificationBatch::forget(Frame *frame) {
+  DeferredSignals &deferred = deferredSignals();
+  if (deferred.frameSet.remove(frame))
+    deferred.frames[deferred.frames.indexOf(frame)] = nullptr;
+}
+
+void ModificationBatch::forget(KeyFrameInterpolator *interpolator) {
+  DeferredSignals &deferred = deferredSignals();
+  if (deferred.interpolatorSet.remove(interpolator))
+    deferred.interpolators[deferred.interpolators.indexOf(interpolator)] =
+        nullptr;
+}
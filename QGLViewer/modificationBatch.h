@@ -0,0 +1,67 @@
+#ifndef QGLVIEWER_MODIFICATION_BATCH_H
+#define QGLVIEWER_MODIFICATION_BATCH_H
+
+#include "config.h"
+
+namespace qglviewer {
+class Frame;
+class KeyFrameInterpolator;
+
+/*! \brief Defers and merges the Frame::modified() and
+  KeyFrameInterpolator::interpolated() signals of a block of code.
+  \class ModificationBatch modificationBatch.h QGLViewer/modificationBatch.h
+
+  Each Frame::setPosition(), Frame::translate(), Frame::rotate()... emits a
+  Frame::modified() signal, and each KeyFrameInterpolator::interpolateAtTime()
+  emits an KeyFrameInterpolator::interpolated() signal. A script that updates
+  thousands of Frames several times each then calls the connected slots (such
+  as Camera matrices invalidation or QGLViewer::update()) for every single
+  modification.
+
+  While a ModificationBatch exists, these signals are not emitted. The modified
+  Frames and the interpolated KeyFrameInterpolators are recorded instead, and
+  each of them emits its signal once, in the order of their first
+  modification, when the ModificationBatch is destroyed:
+  \code
+  {
+    ModificationBatch batch;
+    for (int i = 0; i < nbObjects; ++i) {
+      object[i].frame.translate(offset);
+      object[i].frame.rotate(rotation);
+    }
+  } // Each frame emits modified() once here
+  \endcode
+
+  Batches can be nested: the signals are emitted when the outermost
+  ModificationBatch is destroyed. Batches are local to a thread: only the
+  modifications made in the thread that created the ModificationBatch are
+  deferred. The Frame world transformation caches are updated immediately,
+  so that position() and orientation() remain valid inside the batch.
+
+  \attention The slots connected to the deferred signals are only called at
+  the end of the batch. In particular, a Camera whose Camera::frame() is
+  modified inside the batch only updates its cached matrices at the end of the
+  batch. ManipulatedFrame::manipulated() and ManipulatedFrame::spun() are not
+  deferred. */
+class QGLVIEWER_EXPORT ModificationBatch {
+public:
+  ModificationBatch();
+  ~ModificationBatch();
+
+  static bool isActive();
+
+private:
+  Q_DISABLE_COPY(ModificationBatch)
+
+  friend class Frame;
+  friend class KeyFrameInterpolator;
+
+  static bool deferModified(Frame *frame);
+  static bool deferInterpolated(KeyFrameInterpolator *interpolator);
+  static void forget(Frame *frame);
+  static void forget(KeyFrameInterpolator *interpolator);
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_MODIFICATION_BATCH_H
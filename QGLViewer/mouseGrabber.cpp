@@ -3,27 +3,30 @@
 using namespace qglviewer;
 
 // Static private variable
-QList<MouseGrabber *> MouseGrabber::MouseGrabberPool_;
+unsigned int MouseGrabber::poolRevision_ = 0;
 
 /*! Default constructor.
 
 Adds the created MouseGrabber in the MouseGrabberPool(). grabsMouse() is set to
 \c false. */
-MouseGrabber::MouseGrabber() : grabsMouse_(false) { addInMouseGrabberPool(); }
+MouseGrabber::MouseGrabber()
+    : grabsMouse_(false), group_(nullptr), previous_(nullptr), next_(nullptr) {
+  addInMouseGrabberPool();
+}
 
 /*! Adds the MouseGrabber in the MouseGrabberPool().
 
 All created MouseGrabber are automatically added in the MouseGrabberPool() by
 the constructor. Trying to add a MouseGrabber that already
-isInMouseGrabberPool() has no effect.
+isInMouseGrabberPool() has no effect. A MouseGrabber that belongs to an other
+MouseGrabberGroup is removed from it.
 
 Use removeFromMouseGrabberPool() to remove the MouseGrabber from the list, so
 that it is no longer tested with checkIfGrabsMouse() by the QGLViewer, and hence
 can no longer grab mouse focus. Use isInMouseGrabberPool() to know the current
 state of the MouseGrabber. */
 void MouseGrabber::addInMouseGrabberPool() {
-  if (!isInMouseGrabberPool())
-    MouseGrabber::MouseGrabberPool_.append(this);
+  defaultMouseGrabberGroup()->add(this);
 }
 
 /*! Removes the MouseGrabber from the MouseGrabberPool().
@@ -31,8 +34,7 @@ void MouseGrabber::addInMouseGrabberPool() {
 See addInMouseGrabberPool() for details. Removing a MouseGrabber that is not in
 MouseGrabberPool() has no effect. */
 void MouseGrabber::removeFromMouseGrabberPool() {
-  if (isInMouseGrabberPool())
-    MouseGrabber::MouseGrabberPool_.removeAll(const_cast<MouseGrabber *>(this));
+  defaultMouseGrabberGroup()->remove(this);
 }
 
 /*! Clears the MouseGrabberPool().
@@ -45,7 +47,112 @@ void MouseGrabber::removeFromMouseGrabberPool() {
  When \p autoDelete is \c true, the MouseGrabbers of the MouseGrabberPool() are
  actually deleted (use this only if you're sure of what you do). */
 void MouseGrabber::clearMouseGrabberPool(bool autoDelete) {
-  if (autoDelete)
-    qDeleteAll(MouseGrabber::MouseGrabberPool_);
-  MouseGrabber::MouseGrabberPool_.clear();
+  defaultMouseGrabberGroup()->clear(autoDelete);
+}
+
+/*! Moves the MouseGrabber to \p group, which may be \c nullptr. See
+MouseGrabberGroup::add(). */
+void MouseGrabber::setMouseGrabberGroup(MouseGrabberGroup *const group) {
+  if (group)
+    group->add(this);
+  else if (group_)
+    group_->remove(this);
+}
+
+/*! Returns the MouseGrabberGroup that holds the MouseGrabberPool(), tested by
+the QGLViewers which QGLViewer::mouseGrabberGroup() was not changed. */
+MouseGrabberGroup *MouseGrabber::defaultMouseGrabberGroup() {
+  // Constructed on first use, since MouseGrabbers may be static objects
+  static MouseGrabberGroup pool;
+  return &pool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                       MouseGrabberGroup                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates an empty MouseGrabberGroup. */
+MouseGrabberGroup::MouseGrabberGroup()
+    : first_(nullptr), last_(nullptr), size_(0), listIsValid_(true) {}
+
+/*! Destructor. Removes all the MouseGrabbers, which are not deleted. */
+MouseGrabberGroup::~MouseGrabberGroup() { clear(); }
+
+/*! Appends \p mouseGrabber to the group, after removing it from its previous
+MouseGrabberGroup. Adding a MouseGrabber that is already in the group has no
+effect. */
+void MouseGrabberGroup::add(MouseGrabber *const mouseGrabber) {
+  if (!mouseGrabber || (mouseGrabber->group_ == this))
+    return;
+
+  if (mouseGrabber->group_)
+    mouseGrabber->group_->remove(mouseGrabber);
+
+  mouseGrabber->group_ = this;
+  mouseGrabber->previous_ = last_;
+  mouseGrabber->next_ = nullptr;
+  if (last_)
+    last_->next_ = mouseGrabber;
+  else
+    first_ = mouseGrabber;
+  last_ = mouseGrabber;
+
+  ++size_;
+  listIsValid_ = false;
+  ++MouseGrabber::poolRevision_;
+}
+
+/*! Removes \p mouseGrabber from the group. Has no effect if \p mouseGrabber
+is not in the group. */
+void MouseGrabberGroup::remove(MouseGrabber *const mouseGrabber) {
+  if (!mouseGrabber || (mouseGrabber->group_ != this))
+    return;
+
+  if (mouseGrabber->previous_)
+    mouseGrabber->previous_->next_ = mouseGrabber->next_;
+  else
+    first_ = mouseGrabber->next_;
+  if (mouseGrabber->next_)
+    mouseGrabber->next_->previous_ = mouseGrabber->previous_;
+  else
+    last_ = mouseGrabber->previous_;
+
+  mouseGrabber->group_ = nullptr;
+  mouseGrabber->previous_ = nullptr;
+  mouseGrabber->next_ = nullptr;
+
+  --size_;
+  listIsValid_ = false;
+  ++MouseGrabber::poolRevision_;
+}
+
+/*! Removes all the MouseGrabbers of the group. They are also deleted when \p
+autoDelete is \c true. */
+void MouseGrabberGroup::clear(bool autoDelete) {
+  while (first_) {
+    MouseGrabber *const mg = first_;
+    // The MouseGrabber destructor removes it from the group
+    if (autoDelete)
+      delete mg;
+    else
+      remove(mg);
+  }
+}
+
+/*! Returns \c true if \p mouseGrabber belongs to the group. */
+bool MouseGrabberGroup::contains(const MouseGrabber *const mouseGrabber) const {
+  return mouseGrabber && (mouseGrabber->group_ == this);
+}
+
+/*! Returns the MouseGrabbers of the group, in insertion order. The list is
+rebuilt after the group was modified. */
+const QList<MouseGrabber *> &MouseGrabberGroup::mouseGrabbers() const {
+  if (!listIsValid_) {
+    list_.clear();
+    list_.reserve(size_);
+    for (MouseGrabber *mg = first_; mg; mg = mg->next_)
+      list_.append(mg);
+    listIsValid_ = true;
+  }
+  return list_;
 }
@@ -4,11 +4,64 @@
 #include "config.h"
 
 #include <QEvent>
+#include <QRect>
 
 class QGLViewer;
 
 namespace qglviewer {
 class Camera;
+class MouseGrabber;
+
+/*! \brief A list of MouseGrabbers, tested by the QGLViewers that use it.
+  \class MouseGrabberGroup mouseGrabber.h QGLViewer/mouseGrabber.h
+
+  Each MouseGrabber belongs to at most one MouseGrabberGroup. The created
+  MouseGrabbers are added to the MouseGrabber::defaultMouseGrabberGroup(), which
+  holds the MouseGrabber::MouseGrabberPool() tested by all the QGLViewers.
+
+  With several viewers displaying different scenes, create a MouseGrabberGroup
+  per scene (or per viewer), move the scene MouseGrabbers to it and use
+  QGLViewer::setMouseGrabberGroup(): the viewers then only test the
+  MouseGrabbers of their own scene.
+  \code
+  MouseGrabberGroup *sceneGrabbers = new MouseGrabberGroup();
+  Q_FOREACH (ManipulatedFrame *handle, sceneHandles)
+    sceneGrabbers->add(handle);
+  viewer1->setMouseGrabberGroup(sceneGrabbers);
+  viewer2->setMouseGrabberGroup(sceneGrabbers);
+  \endcode
+
+  The MouseGrabbers are linked together: add() and remove() are constant time
+  operations. The MouseGrabberGroup must outlive the QGLViewers that use it.
+  Its destructor removes (but does not delete) its MouseGrabbers. */
+class QGLVIEWER_EXPORT MouseGrabberGroup {
+public:
+  MouseGrabberGroup();
+  ~MouseGrabberGroup();
+
+  void add(MouseGrabber *const mouseGrabber);
+  void remove(MouseGrabber *const mouseGrabber);
+  void clear(bool autoDelete = false);
+  bool contains(const MouseGrabber *const mouseGrabber) const;
+
+  /*! Returns the number of MouseGrabbers of the group. */
+  int size() const { return size_; }
+  /*! Returns \c true when the group has no MouseGrabber. */
+  bool isEmpty() const { return size_ == 0; }
+
+  const QList<MouseGrabber *> &mouseGrabbers() const;
+
+private:
+  MouseGrabberGroup(const MouseGrabberGroup &);
+  MouseGrabberGroup &operator=(const MouseGrabberGroup &);
+
+  MouseGrabber *first_, *last_;
+  int size_;
+
+  // List returned by mouseGrabbers(), updated on demand
+  mutable QList<MouseGrabber *> list_;
+  mutable bool listIsValid_;
+};
 
 /*! \brief Abstract class for objects that grab mouse focus in a QGLViewer.
   \class MouseGrabber mouseGrabber.h QGLViewer/mouseGrabber.h
@@ -23,6 +76,10 @@ class Camera;
   QGLViewers parse this pool, calling all the MouseGrabbers' checkIfGrabsMouse()
   methods that setGrabsMouse() if desired.
 
+  This pool is the defaultMouseGrabberGroup(). A MouseGrabber can instead be
+  moved to a MouseGrabberGroup (see setMouseGrabberGroup()) that is only
+  tested by the QGLViewers that use it (see QGLViewer::setMouseGrabberGroup()).
+
   When a MouseGrabber grabsMouse(), it becomes the QGLViewer::mouseGrabber().
   All the mouse events (mousePressEvent(), mouseReleaseEvent(),
   mouseMoveEvent(), mouseDoubleClickEvent() and wheelEvent()) are then
@@ -112,13 +169,14 @@ class Camera;
 class QGLVIEWER_EXPORT MouseGrabber {
 #ifndef DOXYGEN
   friend class ::QGLViewer;
+  friend class MouseGrabberGroup;
 #endif
 
 public:
   MouseGrabber();
-  /*! Virtual destructor. Removes the MouseGrabber from the MouseGrabberPool().
-   */
-  virtual ~MouseGrabber() { MouseGrabber::MouseGrabberPool_.removeAll(this); }
+  /*! Virtual destructor. Removes the MouseGrabber from its
+  mouseGrabberGroup(). */
+  virtual ~MouseGrabber() { setMouseGrabberGroup(nullptr); }
 
   /*! @name Mouse grabbing detection */
   //@{
@@ -161,9 +219,30 @@ public:
   This flag is set with setGrabsMouse() by the checkIfGrabsMouse() method. */
   bool grabsMouse() const { return grabsMouse_; }
 
+  /*! Returns \c true and sets \p region to the screen region (Qt coordinate
+  system) outside of which checkIfGrabsMouse() never grabs the mouse.
+
+  This region is only used by the QGLViewers that
+  QGLViewer::mouseGrabberIndexIsEnabled(), in order to only call
+  checkIfGrabsMouse() on the MouseGrabbers which region contains the mouse
+  cursor. The default implementation returns \c false, meaning that
+  checkIfGrabsMouse() is always called.
+
+  Call mouseGrabRegionModified() when the region changes for a reason
+  unrelated to the \p camera (typically when the MouseGrabber moves). */
+  virtual bool mouseGrabRegion(const Camera *const camera,
+                               QRect &region) const {
+    Q_UNUSED(camera);
+    Q_UNUSED(region);
+    return false;
+  }
+
 protected:
   /*! Sets the grabsMouse() flag. Normally used by checkIfGrabsMouse(). */
   void setGrabsMouse(bool grabs) { grabsMouse_ = grabs; }
+  /*! Tells the QGLViewers that the mouseGrabRegion() of a MouseGrabber has
+  been modified, so that their mouse grabber index is rebuilt. */
+  static void mouseGrabRegionModified() { ++MouseGrabber::poolRevision_; }
   //@}
 
   /*! @name MouseGrabber pool */
@@ -180,7 +259,7 @@ public:
   \attention This method returns a \c QPtrList<MouseGrabber> with Qt 3 and a \c
   QList<MouseGrabber> with Qt 2. */
   static const QList<MouseGrabber *> &MouseGrabberPool() {
-    return MouseGrabber::MouseGrabberPool_;
+    return defaultMouseGrabberGroup()->mouseGrabbers();
   }
 
   /*! Returns \c true if the MouseGrabber is currently in the MouseGrabberPool()
@@ -190,12 +269,17 @@ public:
   removeFromMouseGrabberPool(), the QGLViewers no longer checkIfGrabsMouse() on
   this MouseGrabber. Use addInMouseGrabberPool() to insert it back. */
   bool isInMouseGrabberPool() const {
-    return MouseGrabber::MouseGrabberPool_.contains(
-        const_cast<MouseGrabber *>(this));
+    return group_ == defaultMouseGrabberGroup();
   }
   void addInMouseGrabberPool();
   void removeFromMouseGrabberPool();
   void clearMouseGrabberPool(bool autoDelete = false);
+
+  /*! Returns the MouseGrabberGroup the MouseGrabber belongs to, or \c nullptr
+  when it belongs to none. Default value is the defaultMouseGrabberGroup(). */
+  MouseGrabberGroup *mouseGrabberGroup() const { return group_; }
+  void setMouseGrabberGroup(MouseGrabberGroup *const group);
+  static MouseGrabberGroup *defaultMouseGrabberGroup();
   //@}
 
   /*! @name Mouse event handlers */
@@ -267,8 +351,12 @@ private:
 
   bool grabsMouse_;
 
-  // Q G L V i e w e r   p o o l
-  static QList<MouseGrabber *> MouseGrabberPool_;
+  // M o u s e G r a b b e r G r o u p   l i n k s
+  MouseGrabberGroup *group_;
+  MouseGrabber *previous_, *next_;
+
+  // Incremented when a group or a mouseGrabRegion() is modified
+  static unsigned int poolRevision_;
 };
 
 } // namespace qglviewer
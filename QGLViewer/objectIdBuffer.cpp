@@ -0,0 +1,180 @@
+#include "objectIdBuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+using namespace qglviewer;
+
+/*! Creates an uninitialized ObjectIdBuffer. Call initialize() once the OpenGL
+context is current. */
+ObjectIdBuffer::ObjectIdBuffer()
+    : context_(nullptr), functions_(nullptr), texture_(0), readFramebuffer_(0),
+      attachedFramebuffer_(0), pixelBuffer_(0), fence_(nullptr) {}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+initialize() is current. Call cleanupGL() before otherwise. */
+ObjectIdBuffer::~ObjectIdBuffer() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Checks that the current context supports integer color attachments and
+fences. Returns \c false (and isInitialized() remains \c false) otherwise, in
+which case QGLViewer has no object ID buffer. */
+bool ObjectIdBuffer::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("ObjectIdBuffer::initialize: No current OpenGL context");
+    return false;
+  }
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 32)) {
+    qWarning("ObjectIdBuffer::initialize: Requires OpenGL 3.2 or OpenGL ES "
+             "3.0");
+    return false;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  functions_->glGenTextures(1, &texture_);
+  functions_->glGenFramebuffers(1, &readFramebuffer_);
+  functions_->glGenBuffers(1, &pixelBuffer_);
+  functions_->glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer_);
+  // A GL_RGBA_INTEGER pixel, the read back format supported everywhere
+  functions_->glBufferData(GL_PIXEL_PACK_BUFFER, 4 * sizeof(GLint), nullptr,
+                           GL_STREAM_READ);
+  functions_->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+/*! Attaches the ID texture, resized to \p size pixels, as the \c
+GL_COLOR_ATTACHMENT1 of \p framebuffer, which must be bound. The texture is
+cleared to -1 and the draw buffers are set to the two attachments.
+
+Returns \c false (and leaves the framebuffer unchanged) when the framebuffer
+is incomplete with this attachment, which is the case when it is
+multisampled. */
+bool ObjectIdBuffer::attach(GLuint framebuffer, const QSize &size) {
+  if (!isInitialized() || size.isEmpty())
+    return false;
+
+  QOpenGLExtraFunctions *f = functions_;
+  if (size != size_) {
+    GLint previousTexture = 0;
+    f->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+    f->glBindTexture(GL_TEXTURE_2D, texture_);
+    f->glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, size.width(), size.height(), 0,
+                    GL_RED_INTEGER, GL_INT, nullptr);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    f->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+    size_ = size;
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, readFramebuffer_);
+    f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_TEXTURE_2D, texture_, 0);
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  }
+
+  f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                            GL_TEXTURE_2D, texture_, 0);
+  attachedFramebuffer_ = framebuffer;
+  if (f->glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    detach();
+    return false;
+  }
+
+  const GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  f->glDrawBuffers(2, buffers);
+  const GLint background[4] = {-1, 0, 0, 0};
+  f->glClearBufferiv(GL_COLOR, 1, background);
+  return true;
+}
+
+/*! Removes the ID texture from the framebuffer given to attach(), and restores
+its draw buffer. The texture keeps the IDs for requestId(). */
+void ObjectIdBuffer::detach() {
+  if (!attachedFramebuffer_)
+    return;
+
+  const GLenum buffer = GL_COLOR_ATTACHMENT0;
+  functions_->glDrawBuffers(1, &buffer);
+  functions_->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                                     GL_TEXTURE_2D, 0, 0);
+  attachedFramebuffer_ = 0;
+}
+
+/*! Queues the read back of the ID of \p pixel, in OpenGL coordinates (from the
+lower left corner of the texture). Returns immediately: the result is given by
+retrieveId(). A pending request is replaced. Pixels outside of the size() are
+ignored. */
+void ObjectIdBuffer::requestId(const QPoint &pixel) {
+  if (!isInitialized() || (pixel.x() < 0) || (pixel.y() < 0) ||
+      (pixel.x() >= size_.width()) || (pixel.y() >= size_.height()))
+    return;
+
+  QOpenGLExtraFunctions *f = functions_;
+  if (fence_)
+    f->glDeleteSync(fence_);
+
+  GLint previousFramebuffer = 0;
+  f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer_);
+  f->glReadBuffer(GL_COLOR_ATTACHMENT0);
+  // With a bound pixel pack buffer, glReadPixels returns immediately
+  f->glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer_);
+  f->glReadPixels(pixel.x(), pixel.y(), 1, 1, GL_RGBA_INTEGER, GL_INT,
+                  nullptr);
+  f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousFramebuffer));
+  fence_ = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/*! Sets \p id to the result of the last requestId() and returns \c true, when
+its read back is completed. Returns \c false without waiting otherwise, or
+when there is no pending request (see hasPendingId()). */
+bool ObjectIdBuffer::retrieveId(int &id) {
+  if (!fence_)
+    return false;
+
+  QOpenGLExtraFunctions *f = functions_;
+  const GLenum status =
+      f->glClientWaitSync(fence_, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+    return false;
+  f->glDeleteSync(fence_);
+  fence_ = nullptr;
+
+  id = -1;
+  f->glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer_);
+  const GLint *const data = static_cast<const GLint *>(f->glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, 4 * sizeof(GLint), GL_MAP_READ_BIT));
+  if (data) {
+    id = data[0];
+    f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+/*! Releases the texture, the framebuffer and the pixel buffer. The context
+used by initialize() must be current. */
+void ObjectIdBuffer::cleanupGL() {
+  if (!functions_)
+    return;
+
+  detach();
+  if (fence_)
+    functions_->glDeleteSync(fence_);
+  functions_->glDeleteTextures(1, &texture_);
+  functions_->glDeleteFramebuffers(1, &readFramebuffer_);
+  functions_->glDeleteBuffers(1, &pixelBuffer_);
+  fence_ = nullptr;
+  texture_ = readFramebuffer_ = pixelBuffer_ = 0;
+  size_ = QSize();
+  functions_ = nullptr;
+  context_ = nullptr;
+}
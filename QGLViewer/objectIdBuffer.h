@@ -0,0 +1,76 @@
+#ifndef QGLVIEWER_OBJECT_ID_BUFFER_H
+#define QGLVIEWER_OBJECT_ID_BUFFER_H
+
+#include <QPoint>
+#include <QSize>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+/*! \brief An integer color attachment where draw() writes the object ID of
+  each pixel.
+  \class ObjectIdBuffer objectIdBuffer.h
+
+  This internal class is used by QGLViewer when
+  QGLViewer::objectIdBufferIsEnabled(). attach() adds a \c GL_R32I texture as
+  the second color attachment of the widget framebuffer, cleared to -1, and
+  makes it the second draw buffer: the fragment shaders write their object ID
+  in their output location 1. detach() restores the framebuffer.
+
+  The texture is kept until the next attach(), so that requestId() can read
+  the ID of any pixel of the last frame, in a pixel buffer object. The result
+  is retrieved without stalling the pipeline by retrieveId(), once a fence
+  tells that the read back is completed.
+
+  Requires OpenGL 3.2 or OpenGL ES 3.0. All the methods but the destructor
+  must be called with the context used by initialize() current. Call
+  cleanupGL() with this context current before the ObjectIdBuffer is
+  destroyed. */
+class ObjectIdBuffer {
+public:
+  ObjectIdBuffer();
+  ~ObjectIdBuffer();
+
+  bool initialize();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return functions_ != nullptr; }
+
+  bool attach(GLuint framebuffer, const QSize &size);
+  void detach();
+  /*! Returns the size of the texture, in pixels. Empty before the first
+  attach(). */
+  QSize size() const { return size_; }
+  /*! Returns the number of bytes of the 32 bit ID texture. See
+  QGLViewer::memoryUsage(). */
+  qint64 memoryUsage() const {
+    return 4 * qint64(size_.width()) * size_.height();
+  }
+
+  void requestId(const QPoint &pixel);
+  /*! Returns \c true when a requestId() was not retrieved yet. */
+  bool hasPendingId() const { return fence_ != nullptr; }
+  bool retrieveId(int &id);
+
+  void cleanupGL();
+
+private:
+  Q_DISABLE_COPY(ObjectIdBuffer)
+
+  QSize size_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  GLuint texture_;
+  GLuint readFramebuffer_;     // texture_ as its only attachment
+  GLuint attachedFramebuffer_; // 0 when detached
+  GLuint pixelBuffer_;
+  GLsync fence_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_OBJECT_ID_BUFFER_H
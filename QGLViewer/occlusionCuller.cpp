@@ -0,0 +1,380 @@
+#include "occlusionCuller.h"
+#include "camera.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <cmath>
+
+#ifndef GL_SAMPLES_PASSED
+#define GL_SAMPLES_PASSED 0x8914
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_ANY_SAMPLES_PASSED
+#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#endif
+
+using namespace qglviewer;
+
+// Each box is drawn with 12 triangles
+static const int boxVertices = 36;
+
+/*! Creates an empty OcclusionCuller. No OpenGL call is made before
+beginFrame(). */
+OcclusionCuller::OcclusionCuller()
+    : visibleQueryInterval_(4), frame_(0), camera_(nullptr), activeQuery_(-1),
+      context_(nullptr), functions_(nullptr), queryTarget_(GL_SAMPLES_PASSED),
+      boxesAreUpToDate_(true), vbo_(QOpenGLBuffer::VertexBuffer) {}
+
+/*! Destructor. The OpenGL resources are released if the context used by
+beginFrame() is current. Call cleanupGL() before otherwise. */
+OcclusionCuller::~OcclusionCuller() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                           Registered objects                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an axis aligned box, defined by its \p min and \p max corners, and
+returns its id. The object is visible until a query proves it hidden. Ids of
+removed objects (see removeObject()) are reused. */
+int OcclusionCuller::addBox(const Vec &min, const Vec &max) {
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = objects_.size();
+    objects_.append(Object());
+    objects_[id].query = 0;
+  } else
+    id = freeIds_.takeLast();
+
+  Object &object = objects_[id];
+  object.used = true;
+  object.visible = true;
+  object.queryPending = false;
+  setBox(id, min, max);
+  return id;
+}
+
+/*! Moves or resizes the box of the object \p id. Its visibility is not
+modified. */
+void OcclusionCuller::setBox(int id, const Vec &min, const Vec &max) {
+  if (!isValidId(id, "setBox"))
+    return;
+  Object &object = objects_[id];
+  for (int i = 0; i < 3; ++i) {
+    object.min[i] = Real(qMin(min[i], max[i]));
+    object.max[i] = Real(qMax(min[i], max[i]));
+  }
+  boxesAreUpToDate_ = false;
+}
+
+/*! Unregisters the object \p id. Its id may be returned by the next addBox()
+call. */
+void OcclusionCuller::removeObject(int id) {
+  if (!isValidId(id, "removeObject"))
+    return;
+  objects_[id].used = false;
+  freeIds_.append(id);
+}
+
+/*! Unregisters all the objects. Their queries are kept for the next ones. */
+void OcclusionCuller::clear() {
+  freeIds_.clear();
+  for (int i = objects_.size() - 1; i >= 0; --i) {
+    objects_[i].used = false;
+    freeIds_.append(i);
+  }
+}
+
+bool OcclusionCuller::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= objects_.size()) || !objects_[id].used) {
+    qWarning("OcclusionCuller::%s: invalid object id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Visibility                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns \c true when the object \p id should be drawn: during the last
+retrieved query, at least one sample of the object was visible. */
+bool OcclusionCuller::isVisible(int id) const {
+  if (!isValidId(id, "isVisible"))
+    return false;
+  return objects_[id].visible || !functions_;
+}
+
+/*! Fills \p visible with the ids of the visible objects, in increasing order.
+See isVisible(). */
+void OcclusionCuller::visibleObjects(QVector<int> &visible) const {
+  visible.clear();
+  for (int i = 0; i < objects_.size(); ++i)
+    if (objects_[i].used && (objects_[i].visible || !functions_))
+      visible.append(i);
+}
+
+/*! Sets the visibleQueryInterval(). Values smaller than 1 are replaced by 1. */
+void OcclusionCuller::setVisibleQueryInterval(int interval) {
+  visibleQueryInterval_ = qMax(interval, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Queries                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+// Resolves the query functions of the current context. Returns false when
+// queries cannot be used.
+bool OcclusionCuller::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (context == context_)
+    return functions_ != nullptr;
+
+  if (context_)
+    qWarning("OcclusionCuller::initializeGL: OpenGL context changed, previous "
+             "queries are lost");
+  context_ = context;
+  functions_ = nullptr;
+  for (int i = 0; i < objects_.size(); ++i) {
+    objects_[i].query = 0;
+    objects_[i].queryPending = false;
+  }
+  if (vbo_.isCreated())
+    vbo_ = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  if (!context)
+    return false;
+
+  // Bounding boxes are drawn with the fixed pipeline
+  const QSurfaceFormat format = context->format();
+  if (context->isOpenGLES() || (format.profile() == QSurfaceFormat::CoreProfile))
+    return false;
+  if ((format.version() < qMakePair(1, 5)) &&
+      !context->hasExtension("GL_ARB_occlusion_query"))
+    return false;
+
+  functions_ = context->extraFunctions();
+  queryTarget_ = ((format.version() >= qMakePair(3, 3)) ||
+                  context->hasExtension("GL_ARB_occlusion_query2"))
+                     ? GL_ANY_SAMPLES_PASSED
+                     : GL_SAMPLES_PASSED;
+  return true;
+}
+
+/*! Starts a new frame, seen from \p camera. Called by QGLViewer::preDraw(),
+with the OpenGL context current.
+
+The results of the previous queries that are available are retrieved, without
+waiting for the others. Objects whose box contains the \p camera near plane
+are made visible. */
+void OcclusionCuller::beginFrame(const Camera *camera) {
+  camera_ = camera;
+  ++frame_;
+  if (!initializeGL())
+    return;
+
+  for (int i = 0; i < objects_.size(); ++i) {
+    Object &object = objects_[i];
+    if (!object.used || !object.queryPending)
+      continue;
+    GLuint available = 0;
+    functions_->glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE,
+                                    &available);
+    if (available) {
+      GLuint samples = 0;
+      functions_->glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &samples);
+      object.visible = (samples > 0);
+      object.queryPending = false;
+    }
+  }
+
+  // The box faces may be clipped by the near plane: distance to its corners
+  const qreal t = tan(camera->fieldOfView() / 2.0);
+  const qreal ht = tan(camera->horizontalFieldOfView() / 2.0);
+  const qreal margin = camera->zNear() * sqrt(1.0 + t * t + ht * ht);
+  const Vec pos = camera->position();
+  for (int i = 0; i < objects_.size(); ++i) {
+    Object &object = objects_[i];
+    if (!object.used || object.visible)
+      continue;
+    bool inside = true;
+    for (int k = 0; k < 3; ++k)
+      inside = inside && (pos[k] >= object.min[k] - margin) &&
+               (pos[k] <= object.max[k] + margin);
+    if (inside)
+      object.visible = true;
+  }
+}
+
+// Returns true when a query should be issued for id in this frame. Hidden
+// objects are tested at each frame, visible ones every visibleQueryInterval_.
+bool OcclusionCuller::needsQuery(int id) const {
+  const Object &object = objects_[id];
+  if (!functions_ || (activeQuery_ >= 0) || !object.used ||
+      object.queryPending)
+    return false;
+  return !object.visible ||
+         (((frame_ + unsigned(id)) % unsigned(visibleQueryInterval_)) == 0);
+}
+
+// Begins the query of id, created when needed.
+void OcclusionCuller::issueQuery(int id) {
+  Object &object = objects_[id];
+  if (!object.query)
+    functions_->glGenQueries(1, &object.query);
+  functions_->glBeginQuery(queryTarget_, object.query);
+  activeQuery_ = id;
+}
+
+/*! Starts the query of the visible object \p id, which is then drawn by the
+QGLViewer::draw() method, before endQuery() is called.
+
+Does nothing when the object does not need to be tested in this frame (see
+visibleQueryInterval()). Queries cannot be nested. */
+void OcclusionCuller::beginQuery(int id) {
+  if (!isValidId(id, "beginQuery"))
+    return;
+  if (activeQuery_ >= 0) {
+    qWarning("OcclusionCuller::beginQuery: endQuery() was not called for "
+             "object %d",
+             activeQuery_);
+    return;
+  }
+  if (needsQuery(id))
+    issueQuery(id);
+}
+
+/*! Ends the query started by beginQuery(). Its result is retrieved by a next
+beginFrame(). */
+void OcclusionCuller::endQuery() {
+  if (activeQuery_ < 0)
+    return;
+  functions_->glEndQuery(queryTarget_);
+  objects_[activeQuery_].queryPending = true;
+  activeQuery_ = -1;
+}
+
+// Fills boxes_ with the triangles of each box.
+void OcclusionCuller::updateBoxes() {
+  // Corner indexes (bit 0: x, bit 1: y, bit 2: z) of the 12 triangles
+  static const int corners[boxVertices] = {
+      0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+      2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+
+  boxes_.resize(objects_.size() * boxVertices * 3);
+  GLfloat *v = boxes_.data();
+  for (int i = 0; i < objects_.size(); ++i) {
+    const Object &object = objects_[i];
+    for (int c = 0; c < boxVertices; ++c) {
+      const int corner = corners[c];
+      *v++ = GLfloat((corner & 1) ? object.max[0] : object.min[0]);
+      *v++ = GLfloat((corner & 2) ? object.max[1] : object.min[1]);
+      *v++ = GLfloat((corner & 4) ? object.max[2] : object.min[2]);
+    }
+  }
+  boxesAreUpToDate_ = true;
+}
+
+/*! Ends the frame: the boxes of the hidden objects are tested against the
+depth buffer, with color and depth writes disabled. Called by
+QGLViewer::postDraw(), before the visual hints are drawn.
+
+The OpenGL state and matrices are preserved. */
+void OcclusionCuller::endFrame() {
+  if (activeQuery_ >= 0) {
+    qWarning("OcclusionCuller::endFrame: endQuery() was not called for object "
+             "%d",
+             activeQuery_);
+    endQuery();
+  }
+  if (!functions_ || !camera_ ||
+      (QOpenGLContext::currentContext() != context_))
+    return;
+
+  QVector<int> hidden;
+  for (int i = 0; i < objects_.size(); ++i)
+    if (!objects_[i].visible && needsQuery(i))
+      hidden.append(i);
+  if (hidden.isEmpty())
+    return;
+
+  const int size = objects_.size() * boxVertices * 3;
+  if (!boxesAreUpToDate_ || (boxes_.size() != size)) {
+    updateBoxes();
+    if (vbo_.isCreated() && vbo_.bind()) {
+      vbo_.allocate(boxes_.constData(), int(size * sizeof(GLfloat)));
+      vbo_.release();
+    }
+  }
+
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+               GL_POLYGON_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glDisable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  camera_->loadProjectionMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  camera_->loadModelViewMatrix();
+
+  // Client memory is used when the buffer is not available in this context
+  bool useVBO = vbo_.isCreated();
+  if (!useVBO && vbo_.create() && vbo_.bind()) {
+    vbo_.allocate(boxes_.constData(), int(size * sizeof(GLfloat)));
+    vbo_.release();
+    useVBO = true;
+  }
+  useVBO = useVBO && vbo_.bind();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, useVBO ? nullptr : boxes_.constData());
+
+  for (int i = 0; i < hidden.size(); ++i) {
+    issueQuery(hidden[i]);
+    glDrawArrays(GL_TRIANGLES, hidden[i] * boxVertices, boxVertices);
+    endQuery();
+  }
+
+  if (useVBO)
+    vbo_.release();
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+
+  glPopClientAttrib();
+  glPopAttrib();
+}
+
+/*! Releases the queries and the buffer. The context used by beginFrame() must
+be current. All the objects become visible. */
+void OcclusionCuller::cleanupGL() {
+  if (functions_)
+    for (int i = 0; i < objects_.size(); ++i)
+      if (objects_[i].query)
+        functions_->glDeleteQueries(1, &objects_[i].query);
+  for (int i = 0; i < objects_.size(); ++i) {
+    objects_[i].query = 0;
+    objects_[i].queryPending = false;
+    objects_[i].visible = true;
+  }
+  vbo_.destroy();
+  functions_ = nullptr;
+  context_ = nullptr;
+  activeQuery_ = -1;
+}
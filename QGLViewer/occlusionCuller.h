@@ -0,0 +1,130 @@
+#ifndef QGLVIEWER_OCCLUSION_CULLER_H
+#define QGLVIEWER_OCCLUSION_CULLER_H
+
+#include "vec.h"
+
+#include <QOpenGLBuffer>
+#include <QVector>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Hardware occlusion queries with temporal coherence.
+  \class OcclusionCuller occlusionCuller.h QGLViewer/occlusionCuller.h
+
+  Register the bounding boxes of your objects with addBox(), and attach the
+  OcclusionCuller to your viewer with QGLViewer::setOcclusionCuller(). Only the
+  visibleObjects() are then drawn, each of them between a beginQuery() and an
+  endQuery() call:
+  \code
+  void Viewer::draw() {
+    culler.visibleObjects(visible);
+    for (int i = 0; i < visible.size(); ++i) {
+      culler.beginQuery(visible[i]);
+      object[visible[i]].draw();
+      culler.endQuery();
+    }
+  }
+  \endcode
+
+  Drawing the objects from front to back (see FrustumCuller) gives the best
+  results. QGLViewer::preDraw() calls beginFrame(), which retrieves the query
+  results that are available. QGLViewer::postDraw() calls endFrame(), which
+  tests the bounding boxes of the hidden objects against the depth buffer of
+  the frame, in a single batch.
+
+  Query results are never waited for: an object keeps its previous visibility
+  until the result of its query is available, usually one frame later. An
+  object that becomes visible is hence drawn with one frame of latency. Visible
+  objects are assumed to remain visible, and are only tested every
+  visibleQueryInterval() frames (spread over the frames according to their
+  id). New objects, and objects whose box contains the Camera position(), are
+  visible.
+
+  \c GL_ANY_SAMPLES_PASSED queries are used when available (OpenGL 3.3), \c
+  GL_SAMPLES_PASSED otherwise. With a core profile context, or when queries are
+  not supported, all the objects are visible.
+
+  An OcclusionCuller should only be used with one Camera, and its OpenGL
+  methods with the same context. Call cleanupGL() with this context current
+  before it is destroyed. */
+class QGLVIEWER_EXPORT OcclusionCuller {
+public:
+  OcclusionCuller();
+  ~OcclusionCuller();
+
+  /*! @name Registered objects */
+  //@{
+public:
+  int addBox(const Vec &min, const Vec &max);
+  void setBox(int id, const Vec &min, const Vec &max);
+  void removeObject(int id);
+  void clear();
+
+  /*! Returns the number of registered objects. */
+  int nbObjects() const { return objects_.size() - freeIds_.size(); }
+  //@}
+
+  /*! @name Visibility */
+  //@{
+public:
+  bool isVisible(int id) const;
+  void visibleObjects(QVector<int> &visible) const;
+
+  /*! Returns the number of frames between two queries of a visible object.
+  Default value is 4. A value of 1 tests all the visible objects at each
+  frame. */
+  int visibleQueryInterval() const { return visibleQueryInterval_; }
+  void setVisibleQueryInterval(int interval);
+  //@}
+
+  /*! @name Queries */
+  //@{
+public:
+  void beginFrame(const Camera *camera);
+  void beginQuery(int id);
+  void endQuery();
+  void endFrame();
+  void cleanupGL();
+  //@}
+
+private:
+  struct Object {
+    Real min[3];
+    Real max[3];
+    bool used;
+    bool visible;
+    GLuint query;      // 0 before its first query
+    bool queryPending; // result not retrieved yet
+  };
+
+  bool isValidId(int id, const char *method) const;
+  bool initializeGL();
+  bool needsQuery(int id) const;
+  void issueQuery(int id);
+  void updateBoxes();
+
+  QVector<Object> objects_;
+  QVector<int> freeIds_;
+  int visibleQueryInterval_;
+  unsigned int frame_;
+
+  // State of the current frame
+  const Camera *camera_;
+  int activeQuery_; // between beginQuery() and endQuery(), -1 otherwise
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_; // nullptr when queries are not supported
+  GLenum queryTarget_;
+  QVector<GLfloat> boxes_; // 36 vertices per object, GL_TRIANGLES
+  bool boxesAreUpToDate_;
+  QOpenGLBuffer vbo_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_OCCLUSION_CULLER_H
@@ -0,0 +1,271 @@
+#include "offscreenRenderer.h"
+#include "camera.h"
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QThread>
+#include <QVector>
+
+#include <cstring>
+
+using namespace qglviewer;
+
+/*! Creates an OffscreenRenderer that renders images of \p size pixels, with an
+OpenGL context of the given \p format.
+
+Must be called in the GUI thread, which creates the \c QOffscreenSurface. No
+OpenGL call is made before the first render(). */
+OffscreenRenderer::OffscreenRenderer(const QSize &size,
+                                     const QSurfaceFormat &format,
+                                     QObject *parent)
+    : QObject(parent), size_(size), format_(format), camera_(new Camera()),
+      backgroundColor_(QColor(51, 51, 51)), context_(nullptr), fbo_(nullptr),
+      resolveFbo_(nullptr) {
+  surface_ = new QOffscreenSurface();
+  surface_->setFormat(format_);
+  surface_->create();
+  if (!surface_->isValid())
+    qWarning("OffscreenRenderer: Unable to create an offscreen surface");
+
+  camera_->setScreenWidthAndHeight(size_.width(), size_.height());
+}
+
+/*! Destructor. Must be called in the GUI thread. The OpenGL resources are
+released if the rendering thread is the GUI thread. Call cleanupGL() in the
+rendering thread before otherwise. */
+OffscreenRenderer::~OffscreenRenderer() {
+  if (context_) {
+    if (context_->thread() == QThread::currentThread())
+      cleanupGL();
+    else
+      qWarning("OffscreenRenderer::~OffscreenRenderer: cleanupGL() was not "
+               "called in the rendering thread");
+  }
+  delete camera_;
+  delete surface_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Render target                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the size() of the rendered images. The framebuffer objects are
+re-created by the next render(), and the camera() screen size is updated. */
+void OffscreenRenderer::setSize(const QSize &size) {
+  size_ = size;
+  camera_->setScreenWidthAndHeight(size_.width(), size_.height());
+}
+
+/*! Makes the context() current in the calling thread. The context is created
+(and init() is called) the first time. Returns \c false when the context could
+not be created or made current.
+
+Use this method to create or release your own OpenGL resources outside of
+render(). */
+bool OffscreenRenderer::makeCurrent() {
+  if (!context_)
+    return initializeGL();
+
+  if (!context_->makeCurrent(surface_)) {
+    qWarning("OffscreenRenderer::makeCurrent: Unable to make the context "
+             "current");
+    return false;
+  }
+  return true;
+}
+
+/*! Releases the context() in the calling thread. */
+void OffscreenRenderer::doneCurrent() {
+  if (context_)
+    context_->doneCurrent();
+}
+
+/*! Deletes the framebuffer objects and the context(). Must be called in the
+rendering thread (the one that called the first render()).
+
+The next render() creates a new context, possibly in an other thread, and
+calls init() again. */
+void OffscreenRenderer::cleanupGL() {
+  if (!context_)
+    return;
+
+  if (context_->thread() != QThread::currentThread()) {
+    qWarning("OffscreenRenderer::cleanupGL: Must be called in the rendering "
+             "thread");
+    return;
+  }
+
+  if (context_->makeCurrent(surface_)) {
+    delete fbo_;
+    delete resolveFbo_;
+    context_->doneCurrent();
+  }
+  fbo_ = nullptr;
+  resolveFbo_ = nullptr;
+
+  delete context_;
+  context_ = nullptr;
+}
+
+// Creates the context in the calling thread, sets the same OpenGL state as
+// QGLViewer::initializeGL() and calls init(). The context is left current.
+bool OffscreenRenderer::initializeGL() {
+  context_ = new QOpenGLContext();
+  context_->setFormat(format_);
+  if (!context_->create() || !context_->makeCurrent(surface_)) {
+    qWarning("OffscreenRenderer: Unable to create an OpenGL context");
+    delete context_;
+    context_ = nullptr;
+    return false;
+  }
+
+  if (context_->format().profile() != QSurfaceFormat::CoreProfile) {
+    glEnable(GL_LIGHT0);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_COLOR_MATERIAL);
+  }
+  glEnable(GL_DEPTH_TEST);
+
+  init();
+  return true;
+}
+
+// (Re-)creates the framebuffer objects when the size() changed. A
+// multisampled framebuffer object is resolved in resolveFbo_ before read back.
+bool OffscreenRenderer::updateFramebufferObjects() {
+  if (fbo_ && (fbo_->size() == size_))
+    return true;
+
+  delete fbo_;
+  delete resolveFbo_;
+  resolveFbo_ = nullptr;
+
+  QOpenGLFramebufferObjectFormat fboFormat;
+  fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  if (format_.samples() > 0)
+    fboFormat.setSamples(format_.samples());
+  fbo_ = new QOpenGLFramebufferObject(size_, fboFormat);
+  if (fbo_->format().samples() > 0)
+    resolveFbo_ = new QOpenGLFramebufferObject(size_);
+
+  if (!fbo_->isValid() || (resolveFbo_ && !resolveFbo_->isValid())) {
+    qWarning("OffscreenRenderer: Unable to create a %dx%d framebuffer object",
+             size_.width(), size_.height());
+    delete fbo_;
+    delete resolveFbo_;
+    fbo_ = nullptr;
+    resolveFbo_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Rendering                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Renders an image of size() pixels. Returns a null image when the rendering
+failed. See render(uchar*, int). */
+QImage OffscreenRenderer::render() {
+  QImage image(size_, QImage::Format_RGBA8888);
+  if (image.isNull() || !render(image.bits(), int(image.bytesPerLine())))
+    return QImage();
+  return image;
+}
+
+/*! Renders an image of size() pixels and copies it in \p pixels, as 4 bytes
+RGBA pixels, the top row first. Returns \c false when the rendering failed.
+
+\p bytesPerLine is the size of a row in \p pixels. It must be a multiple of 4,
+larger than \c 4*size().width(). The default 0 value means that the rows are
+contiguous.
+
+See renderToFramebufferObject(). The context is left current. */
+bool OffscreenRenderer::render(uchar *pixels, int bytesPerLine) {
+  const int width = size_.width();
+  const int height = size_.height();
+  if (bytesPerLine == 0)
+    bytesPerLine = 4 * width;
+
+  if (!pixels || size_.isEmpty() || (bytesPerLine < 4 * width) ||
+      (bytesPerLine % 4 != 0)) {
+    qWarning("OffscreenRenderer::render: Invalid image buffer");
+    return false;
+  }
+
+  if (!renderToFramebufferObject())
+    return false;
+
+  QOpenGLFramebufferObject *const source = framebufferObject();
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glPixelStorei(GL_PACK_ROW_LENGTH, bytesPerLine / 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+  source->release();
+
+  // OpenGL rows are stored bottom up
+  QVector<uchar> row(4 * width);
+  for (int y = 0; y < height / 2; ++y) {
+    uchar *const top = pixels + y * bytesPerLine;
+    uchar *const bottom = pixels + (height - 1 - y) * bytesPerLine;
+    memcpy(row.data(), top, row.size());
+    memcpy(top, bottom, row.size());
+    memcpy(bottom, row.data(), row.size());
+  }
+
+  return true;
+}
+
+/*! Renders an image of size() pixels in the framebufferObject(), and leaves
+it bound with the context() current. Returns \c false when the rendering
+failed.
+
+Calls preDraw(), draw() and postDraw() with the context() current and a
+framebuffer object bound. A multisampled image is then resolved in the
+framebufferObject(). */
+bool OffscreenRenderer::renderToFramebufferObject() {
+  if (!makeCurrent() || !updateFramebufferObjects())
+    return false;
+
+  fbo_->bind();
+  glViewport(0, 0, GLint(size_.width()), GLint(size_.height()));
+
+  preDraw();
+  draw();
+  postDraw();
+
+  if (resolveFbo_) {
+    QOpenGLFramebufferObject::blitFramebuffer(resolveFbo_, fbo_);
+    resolveFbo_->bind();
+  }
+  return true;
+}
+
+/*! Returns the framebuffer object that holds the image rendered by
+renderToFramebufferObject(). It is kept as long as the size() is unchanged.
+\c nullptr before the first rendering. */
+QOpenGLFramebufferObject *OffscreenRenderer::framebufferObject() const {
+  return resolveFbo_ ? resolveFbo_ : fbo_;
+}
+
+/*! Sets OpenGL state before draw().
+
+Default behavior is the same as QGLViewer::preDraw(): the image is cleared
+with the backgroundColor() and the camera() projection and modelView matrices
+are loaded (except with a core profile context). The camera() state is then
+published and the drawNeeded() signal is emitted. */
+void OffscreenRenderer::preDraw() {
+  glClearColor(backgroundColor_.redF(), backgroundColor_.greenF(),
+               backgroundColor_.blueF(), backgroundColor_.alphaF());
+  camera()->loadDepthState();
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  if (context_->format().profile() != QSurfaceFormat::CoreProfile) {
+    camera()->loadProjectionMatrix();
+    camera()->loadModelViewMatrix();
+  }
+
+  camera()->publishState();
+  Q_EMIT drawNeeded();
+}
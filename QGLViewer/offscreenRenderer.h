@@ -0,0 +1,146 @@
+#ifndef QGLVIEWER_OFFSCREEN_RENDERER_H
+#define QGLVIEWER_OFFSCREEN_RENDERER_H
+
+#include <QColor>
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QSurfaceFormat>
+
+#include "config.h"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief A headless render target that draws a scene in an offscreen buffer.
+  \class OffscreenRenderer offscreenRenderer.h QGLViewer/offscreenRenderer.h
+
+  An OffscreenRenderer has no window: it renders in a framebuffer object of an
+  arbitrary size(), bound to a \c QOffscreenSurface. It can hence be used on a
+  server without display (with the \c offscreen or \c eglfs Qt platform
+  plugins, or any platform that provides offscreen surfaces).
+
+  Like QGLViewer, it is used by overloading draw() (and optionally init()):
+  \code
+  class ThumbnailRenderer : public qglviewer::OffscreenRenderer {
+  protected:
+    virtual void draw() { model->draw(); }
+  };
+
+  ThumbnailRenderer renderer;
+  renderer.setSize(QSize(256, 256));
+  renderer.camera()->setSceneRadius(model->radius());
+  renderer.camera()->showEntireScene();
+  renderer.render().save("thumbnail.png");
+  \endcode
+
+  Each render() calls preDraw(), draw() and postDraw(), in that order. init()
+  is called once, before the first render(), when the OpenGL context has been
+  created. Use render(uchar*, int) to read the pixels in your own buffer
+  instead of a \c QImage, or renderToFramebufferObject() to read them back
+  yourself (asynchronously, with a pixel buffer object for instance).
+
+  <h3>Threads</h3>
+
+  Each OffscreenRenderer has its own OpenGL context, so that several renderers
+  can render in parallel, each of them in its own thread. The OffscreenRenderer
+  must be created in the GUI thread (the \c QOffscreenSurface is created by the
+  constructor). Its OpenGL context is created by the first render(), in the
+  calling thread: all the next render() calls must be made in this thread.
+  Call cleanupGL() in this thread before the OffscreenRenderer is destroyed in
+  the GUI thread.
+
+  Signals emitted during render() are emitted in the rendering thread: use a
+  \c Qt::DirectConnection to draw in the connected slots. */
+class QGLVIEWER_EXPORT OffscreenRenderer : public QObject {
+  Q_OBJECT
+
+public:
+  OffscreenRenderer(const QSize &size = QSize(600, 400),
+                    const QSurfaceFormat &format =
+                        QSurfaceFormat::defaultFormat(),
+                    QObject *parent = nullptr);
+  virtual ~OffscreenRenderer();
+
+  /*! @name Render target */
+  //@{
+public:
+  /*! Returns the size of the rendered images, in pixels. Set using
+  setSize(). */
+  QSize size() const { return size_; }
+  void setSize(const QSize &size);
+  /*! Returns the format of the OpenGL context, as given to the constructor.
+  Its \c samples() define the number of samples of the multisampled
+  framebuffer object. */
+  QSurfaceFormat format() const { return format_; }
+  /*! Returns the OpenGL context of the OffscreenRenderer. \c nullptr before
+  the first render(), and after cleanupGL(). */
+  QOpenGLContext *context() const { return context_; }
+
+  bool makeCurrent();
+  void doneCurrent();
+  void cleanupGL();
+  //@}
+
+  /*! @name Rendering */
+  //@{
+public:
+  QImage render();
+  bool render(uchar *pixels, int bytesPerLine = 0);
+  bool renderToFramebufferObject();
+  QOpenGLFramebufferObject *framebufferObject() const;
+  //@}
+
+  /*! @name Display parameters */
+  //@{
+public:
+  /*! Returns the Camera used by preDraw(). Its screen size is the size(). */
+  Camera *camera() const { return camera_; }
+  /*! Returns the background color, used to clear the image in preDraw().
+  Default value is (51, 51, 51), as in QGLViewer. */
+  QColor backgroundColor() const { return backgroundColor_; }
+  /*! Sets the backgroundColor(). */
+  void setBackgroundColor(const QColor &color) { backgroundColor_ = color; }
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted by the default preDraw(), once the camera() matrices are
+  loaded. Same as QGLViewer::drawNeeded(). */
+  void drawNeeded();
+
+protected:
+  /*! Initializes the OpenGL state of the context. Called once, before the
+  first draw(), with the context current. Default implementation is empty.
+  The OpenGL state is set as in QGLViewer::initializeGL() before. */
+  virtual void init() {}
+  virtual void preDraw();
+  /*! The scene drawing method, called by render(). Default implementation is
+  empty. */
+  virtual void draw() {}
+  /*! Called after draw(). Default implementation is empty (there are no visual
+  hints). */
+  virtual void postDraw() {}
+
+private:
+  bool initializeGL();
+  bool updateFramebufferObjects();
+
+  QSize size_;
+  QSurfaceFormat format_;
+  Camera *camera_;
+  QColor backgroundColor_;
+
+  // O p e n G L
+  QOffscreenSurface *surface_;
+  QOpenGLContext *context_;
+  QOpenGLFramebufferObject *fbo_;
+  QOpenGLFramebufferObject *resolveFbo_; // nullptr without multisampling
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_OFFSCREEN_RENDERER_H
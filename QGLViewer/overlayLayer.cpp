@@ -0,0 +1,112 @@
+#include "overlayLayer.h"
+#include "camera.h"
+
+using namespace qglviewer;
+
+/*! Creates a layer of \p size pixels, updated when one of its \p dependencies
+changes (see Dependency). No OpenGL resource is created before the layer is
+displayed. */
+OverlayLayer::OverlayLayer(const QSize &size, int dependencies)
+    : size_(size), corner_(Qt::BottomLeftCorner), isVisible_(true),
+      dependencies_(dependencies), isValid_(false), devicePixelRatio_(0.0) {
+  for (int i = 0; i < 16; ++i)
+    projection_[i] = 0.0;
+}
+
+/*! Virtual destructor. The OpenGL resources are only released when the viewer
+context is current (see cleanupGL()). */
+OverlayLayer::~OverlayLayer() {}
+
+/*! Sets the size() of the layer. The texture is redrawn at its next display. */
+void OverlayLayer::setSize(const QSize &size) {
+  if (size == size_)
+    return;
+  size_ = size;
+  invalidate();
+}
+
+/*! Returns the rectangle covered by the layer in a viewer of \p viewerSize,
+according to its corner() and offset(). Coordinates are expressed in pixels,
+with the origin in the upper left corner of the viewer. */
+QRect OverlayLayer::rectangle(const QSize &viewerSize) const {
+  int x = offset_.x();
+  int y = offset_.y();
+  if ((corner_ == Qt::TopRightCorner) || (corner_ == Qt::BottomRightCorner))
+    x = viewerSize.width() - size_.width() - x;
+  if ((corner_ == Qt::BottomLeftCorner) || (corner_ == Qt::BottomRightCorner))
+    y = viewerSize.height() - size_.height() - y;
+  return QRect(QPoint(x, y), size_);
+}
+
+/*! Releases the texture of the layer. The viewer context must be current. The
+texture is recreated and redrawn at the next display. */
+void OverlayLayer::cleanupGL() {
+  target_.cleanupGL();
+  invalidate();
+}
+
+// Returns true when the texture is outdated
+bool OverlayLayer::needsUpdate(const Camera *camera, const QSize &viewerSize,
+                               qreal devicePixelRatio) const {
+  if (!isValid_ || (devicePixelRatio != devicePixelRatio_))
+    return true;
+
+  if (dependencies_ & CAMERA_ORIENTATION) {
+    const Quaternion q = camera->orientation();
+    for (int i = 0; i < 4; ++i)
+      if (q[i] != orientation_[i])
+        return true;
+  }
+
+  if ((dependencies_ & CAMERA_POSITION) && (camera->position() != position_))
+    return true;
+
+  if (dependencies_ & CAMERA_PROJECTION) {
+    GLdouble projection[16];
+    camera->getProjectionMatrix(projection);
+    for (int i = 0; i < 16; ++i)
+      if (projection[i] != projection_[i])
+        return true;
+  }
+
+  return (dependencies_ & VIEWER_SIZE) && (viewerSize != viewerSize_);
+}
+
+// Draws the layer in its texture. The viewer context must be current.
+bool OverlayLayer::update(const Camera *camera, const QSize &viewerSize,
+                          qreal devicePixelRatio) {
+  target_.setSize(size_ * devicePixelRatio);
+  if (!target_.bind())
+    return false;
+
+  // The state changed by draw() is restored
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(0.0, 0.0, 0.0, 0.0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  draw(camera);
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glPopAttrib();
+
+  target_.release();
+
+  orientation_ = camera->orientation();
+  position_ = camera->position();
+  camera->getProjectionMatrix(projection_);
+  viewerSize_ = viewerSize;
+  devicePixelRatio_ = devicePixelRatio;
+  isValid_ = true;
+  return true;
+}
@@ -0,0 +1,155 @@
+#ifndef QGLVIEWER_OVERLAY_LAYER_H
+#define QGLVIEWER_OVERLAY_LAYER_H
+
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+
+#include "quaternion.h"
+#include "renderTarget.h"
+
+class QGLViewer;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief A small head-up display drawn once in a texture and composited over
+  the viewer's frames.
+  \class OverlayLayer overlayLayer.h QGLViewer/overlayLayer.h
+
+  Corner axes, compasses or legends are usually re-drawn in a dedicated
+  viewport at each frame, even when they did not change. An OverlayLayer is
+  instead drawn in its own texture of size() pixels, which is only updated when
+  one of its dependencies() changed. QGLViewer::postDraw() then composites it
+  over the frame with a single textured quad, in the corner() of the viewer.
+
+  Implement draw() and declare the needed dependencies:
+  \code
+  class CornerAxis : public qglviewer::OverlayLayer {
+  public:
+    CornerAxis() : OverlayLayer(QSize(150, 150), CAMERA_ORIENTATION) {}
+
+  protected:
+    virtual void draw(const qglviewer::Camera *camera) {
+      glMatrixMode(GL_PROJECTION);
+      glOrtho(-1, 1, -1, 1, -1, 1);
+      glMatrixMode(GL_MODELVIEW);
+      glMultMatrixd(camera->orientation().inverse().matrix());
+      // Draw the axes
+    }
+  };
+
+  // In your viewer's constructor
+  addOverlayLayer(new CornerAxis());
+  \endcode
+
+  Call invalidate() when the layer content changes for another reason (a
+  displayed text for instance). Changing the size() or the device pixel ratio
+  of the viewer also updates the texture.
+
+  Layers are owned by the QGLViewer they are added to. They are drawn with the
+  fixed function pipeline, and are hence not displayed when
+  QGLViewer::visualHintsUseCoreProfile(). */
+class QGLVIEWER_EXPORT OverlayLayer {
+  friend class ::QGLViewer;
+
+public:
+  /*! Changes of the viewer that require a new draw() of the layer. */
+  enum Dependency {
+    CAMERA_ORIENTATION = 1, /*!< Camera::orientation(). */
+    CAMERA_POSITION = 2, /*!< Camera::position(). */
+    CAMERA_PROJECTION = 4, /*!< Camera projection matrix. */
+    VIEWER_SIZE = 8 /*!< Size of the viewer window. */
+  };
+
+  explicit OverlayLayer(const QSize &size = QSize(150, 150),
+                        int dependencies = CAMERA_ORIENTATION);
+  virtual ~OverlayLayer();
+
+  /*! @name Layout */
+  //@{
+public:
+  /*! Returns the size of the layer, in (device independent) pixels. The
+  texture is created with the viewer's device pixel ratio. */
+  QSize size() const { return size_; }
+  void setSize(const QSize &size);
+
+  /*! Returns the corner of the viewer where the layer is displayed. Default
+  value is \c Qt::BottomLeftCorner. */
+  Qt::Corner corner() const { return corner_; }
+  /*! Sets the corner(). */
+  void setCorner(Qt::Corner corner) { corner_ = corner; }
+
+  /*! Returns the distance, in pixels, between the layer and the corner() of
+  the viewer, along each axis. Default value is (0,0). */
+  QPoint offset() const { return offset_; }
+  /*! Sets the offset(). */
+  void setOffset(const QPoint &offset) { offset_ = offset; }
+
+  /*! Returns \c true when the layer is displayed. Default value is \c true. */
+  bool isVisible() const { return isVisible_; }
+  /*! Sets isVisible(). */
+  void setVisible(bool visible = true) { isVisible_ = visible; }
+
+  QRect rectangle(const QSize &viewerSize) const;
+  //@}
+
+  /*! @name Updates */
+  //@{
+public:
+  /*! Returns the Dependency flags of the layer: the texture is updated when
+  one of them changed since the last draw(). Set in the constructor or with
+  setDependencies(). */
+  int dependencies() const { return dependencies_; }
+  /*! Sets the dependencies(). */
+  void setDependencies(int dependencies) { dependencies_ = dependencies; }
+
+  /*! Forces a new draw() before the next composition of the layer. */
+  void invalidate() { isValid_ = false; }
+  //@}
+
+  /*! @name Drawing */
+  //@{
+protected:
+  /*! Draws the content of the layer.
+
+  The layer texture is bound and cleared to a transparent color, the viewport
+  covers its size() and the projection and modelview matrices are identities.
+  The texture is composited with premultiplied alpha blending: draw opaque
+  primitives, or blend them with \c glBlendFunc(GL_SRC_ALPHA,
+  GL_ONE_MINUS_SRC_ALPHA). \p camera is the viewer's camera. */
+  virtual void draw(const Camera *camera) = 0;
+
+public:
+  void cleanupGL();
+  //@}
+
+private:
+  Q_DISABLE_COPY(OverlayLayer)
+
+  bool needsUpdate(const Camera *camera, const QSize &viewerSize,
+                   qreal devicePixelRatio) const;
+  bool update(const Camera *camera, const QSize &viewerSize,
+              qreal devicePixelRatio);
+  GLuint texture() const { return target_.colorTexture(); }
+
+  QSize size_;
+  Qt::Corner corner_;
+  QPoint offset_;
+  bool isVisible_;
+  int dependencies_;
+  bool isValid_;
+
+  // State of the last draw()
+  Quaternion orientation_;
+  Vec position_;
+  GLdouble projection_[16];
+  QSize viewerSize_;
+  qreal devicePixelRatio_;
+
+  RenderTarget target_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_OVERLAY_LAYER_H
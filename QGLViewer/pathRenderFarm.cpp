@@ -0,0 +1,389 @@
+#include "pathRenderFarm.h"
+#include "camera.h"
+#include "domUtils.h"
+#include "keyFrameInterpolator.h"
+#include "manipulatedCameraFrame.h"
+#include "qglviewer.h"
+
+#include <QCoreApplication>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include <math.h>
+
+using namespace qglviewer;
+
+// Command line arguments of the worker processes
+static const char *const jobArgument = "--qglviewer-render-job";
+static const char *const framesArgument = "--qglviewer-render-frames";
+
+/*! Creates a PathRenderFarm without a path. */
+PathRenderFarm::PathRenderFarm(QObject *parent)
+    : QObject(parent), firstTime_(0.0), duration_(0.0), frameRate_(25.0),
+      firstFrame_(0), lastFrame_(-1), imageSize_(1920, 1080),
+      outputPattern_("frame-#####.png"), nbWorkers_(1), chunkSize_(25),
+      maxRetries_(2), running_(false), success_(false), nbRenderedFrames_(0) {}
+
+/*! Virtual destructor. The running workers are killed, without emitting
+finished(). */
+PathRenderFarm::~PathRenderFarm() {
+  for (QProcess *worker : workers_) {
+    worker->disconnect(this);
+    worker->kill();
+    worker->waitForFinished();
+    delete worker;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                    Job                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the rendered path. Its keyFrames are copied: the path can be modified
+or deleted once this method returns.
+
+When \p camera is not \c nullptr, its parameters (field of view, clipping
+planes coefficients, scene radius...) are also restored by the workers before
+the path is rendered. The camera of their viewer is used otherwise. */
+void PathRenderFarm::setPath(const KeyFrameInterpolator &path,
+                             const Camera *camera) {
+  QDomDocument document;
+  QDomElement root = document.createElement("Scene");
+  root.appendChild(path.domElement("Path", document));
+  if (camera)
+    root.appendChild(camera->domElement("Camera", document));
+  document.appendChild(root);
+  path_ = document.toString();
+  firstTime_ = path.firstTime();
+  duration_ = path.duration();
+}
+
+/*! Returns the last rendered frame. Default value is the frame of the end of
+the path (see setPath()). */
+int PathRenderFarm::lastFrame() const {
+  if (lastFrame_ >= 0)
+    return lastFrame_;
+  return int(floor(duration_ * frameRate_ + 1e-6));
+}
+
+/*! Sets the range of frames rendered by start(), \p first and \p last
+included. A negative \p last (default) is the end of the path. */
+void PathRenderFarm::setFrameRange(int first, int last) {
+  firstFrame_ = qMax(0, first);
+  lastFrame_ = last;
+}
+
+/*! Returns the name of the file of \p frame, from the outputPattern(). When
+the pattern has no \c #, a four digits number is appended to its base name, as
+done by QGLViewer::saveSnapshot(). */
+QString PathRenderFarm::outputFileName(int frame) const {
+  QString name = outputPattern_;
+  int start = name.indexOf('#');
+  if (start < 0) {
+    const QFileInfo info(name);
+    name = info.path() + '/' + info.completeBaseName() + "-####";
+    if (!info.suffix().isEmpty())
+      name += '.' + info.suffix();
+    start = name.indexOf('#');
+  }
+  int end = start;
+  while ((end < name.size()) && (name[end] == '#'))
+    ++end;
+  return name.replace(start, end - start,
+                      QString("%1").arg(frame, end - start, 10, QChar('0')));
+}
+
+// Next to the outputs, so that remote workers share it
+QString PathRenderFarm::jobFileName() const {
+  return QFileInfo(outputFileName(0)).absolutePath() + "/pathRenderJob.xml";
+}
+
+bool PathRenderFarm::writeJobFile() const {
+  QDomDocument document;
+  document.setContent(path_);
+  QDomElement root = document.documentElement();
+  root.setTagName("PathRenderJob");
+  root.setAttribute("frameRate", QString::number(frameRate_));
+  root.setAttribute("width", QString::number(imageSize_.width()));
+  root.setAttribute("height", QString::number(imageSize_.height()));
+  // The workers may run in another directory
+  root.setAttribute("outputPattern",
+                    QFileInfo(outputPattern_).absoluteFilePath());
+
+  QSaveFile file(jobFileName());
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  QTextStream out(&file);
+  document.save(out, 2);
+  out.flush();
+  return file.commit();
+}
+
+bool PathRenderFarm::readJobFile(const QString &fileName) {
+  QFile file(fileName);
+  QDomDocument document;
+  if (!file.open(QIODevice::ReadOnly) || !document.setContent(&file))
+    return false;
+
+  const QDomElement root = document.documentElement();
+  if (root.tagName() != "PathRenderJob")
+    return false;
+  frameRate_ = DomUtils::qrealFromDom(root, "frameRate", 25.0);
+  imageSize_ = QSize(DomUtils::intFromDom(root, "width", 1920),
+                     DomUtils::intFromDom(root, "height", 1080));
+  outputPattern_ = root.attribute("outputPattern", outputPattern_);
+  path_ = document.toString();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Coordinator                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the program that renders the chunks. It is started with \p arguments,
+followed by the arguments that describe its chunk, which are recognized by
+isWorker(). */
+void PathRenderFarm::setWorkerProgram(const QString &program,
+                                      const QStringList &arguments) {
+  workerProgram_ = program;
+  workerArguments_ = arguments;
+}
+
+/*! Starts the render of the frames from firstFrame() to lastFrame().
+
+The job file (\c pathRenderJob.xml, in the directory of the outputPattern())
+is written. The frames that are already saved are reported by frameRendered()
+and skipped: the chunks that have no frame left are not started. Returns
+immediately, finished() is emitted at the end of the render.
+
+Returns \c false if the render is already running, if there is no path or
+workerProgram(), or if the job file cannot be written. */
+bool PathRenderFarm::start() {
+  if (running_) {
+    qWarning("PathRenderFarm::start: Render is already running");
+    return false;
+  }
+  if (path_.isEmpty() || workerProgram_.isEmpty()) {
+    qWarning("PathRenderFarm::start: No path or worker program");
+    return false;
+  }
+  if (!writeJobFile()) {
+    qWarning("PathRenderFarm::start: Unable to write %s",
+             jobFileName().toLocal8Bit().constData());
+    return false;
+  }
+
+  pendingChunks_.clear();
+  nbRenderedFrames_ = 0;
+  const int last = lastFrame();
+  for (int first = firstFrame_; first <= last; first += chunkSize_) {
+    Chunk chunk;
+    chunk.first = first;
+    chunk.last = qMin(first + chunkSize_ - 1, last);
+    chunk.nbFailures = 0;
+    bool rendered = true;
+    for (int frame = chunk.first; frame <= chunk.last; ++frame)
+      if (QFileInfo::exists(outputFileName(frame))) {
+        ++nbRenderedFrames_;
+        Q_EMIT frameRendered(frame);
+      } else
+        rendered = false;
+    if (!rendered)
+      pendingChunks_.append(chunk);
+  }
+
+  running_ = true;
+  success_ = true;
+  startWorkers();
+  return true;
+}
+
+/*! Stops the render: the workers are killed and finished() is emitted with \c
+false. The saved frames are kept, and skipped by the next start(). */
+void PathRenderFarm::cancel() {
+  if (!running_)
+    return;
+  running_ = false;
+  pendingChunks_.clear();
+  for (QProcess *worker : workers_) {
+    worker->disconnect(this);
+    worker->kill();
+    worker->waitForFinished();
+    worker->deleteLater();
+  }
+  workers_.clear();
+  workerChunks_.clear();
+  Q_EMIT finished(false);
+}
+
+// Starts pending chunks while there are less than nbWorkers() workers, and
+// emits finished() when there is nothing left to do.
+void PathRenderFarm::startWorkers() {
+  while (running_ && (workers_.size() < nbWorkers_) &&
+         !pendingChunks_.isEmpty()) {
+    Chunk chunk = pendingChunks_.takeFirst();
+    QProcess *worker = new QProcess(this);
+    worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(worker, SIGNAL(readyReadStandardOutput()), this,
+            SLOT(readWorkerOutput()));
+    connect(worker, SIGNAL(finished(int, QProcess::ExitStatus)), this,
+            SLOT(workerFinished(int, QProcess::ExitStatus)));
+
+    QStringList arguments = workerArguments_;
+    arguments << jobArgument << jobFileName() << framesArgument
+              << QString("%1:%2").arg(chunk.first).arg(chunk.last);
+    worker->start(workerProgram_, arguments);
+    if (!worker->waitForStarted()) {
+      // No finished() signal: the program cannot be run, do not retry
+      qWarning("PathRenderFarm::startWorkers: Unable to start %s",
+               workerProgram_.toLocal8Bit().constData());
+      delete worker;
+      success_ = false;
+      Q_EMIT chunkFailed(chunk.first, chunk.last);
+      continue;
+    }
+    workers_.append(worker);
+    workerChunks_.append(chunk);
+  }
+
+  if (running_ && workers_.isEmpty() && pendingChunks_.isEmpty()) {
+    running_ = false;
+    Q_EMIT finished(success_);
+  }
+}
+
+// Workers print a "frame <n>" line when frame n is saved
+void PathRenderFarm::readWorkerOutput() {
+  QProcess *worker = qobject_cast<QProcess *>(sender());
+  if (!worker)
+    return;
+  while (worker->canReadLine()) {
+    const QString line = QString::fromLatin1(worker->readLine()).trimmed();
+    if (line.startsWith("frame ")) {
+      ++nbRenderedFrames_;
+      Q_EMIT frameRendered(line.mid(6).toInt());
+    }
+  }
+}
+
+void PathRenderFarm::workerFinished(int exitCode,
+                                    QProcess::ExitStatus exitStatus) {
+  QProcess *worker = qobject_cast<QProcess *>(sender());
+  const int index = workers_.indexOf(worker);
+  if (index < 0)
+    return;
+  readWorkerOutput();
+  Chunk chunk = workerChunks_.takeAt(index);
+  workers_.removeAt(index);
+  worker->deleteLater();
+
+  // The frames are checked too, in case the worker lost some of them
+  if ((exitStatus != QProcess::NormalExit) || (exitCode != 0) ||
+      !chunkIsRendered(chunk)) {
+    ++chunk.nbFailures;
+    if (chunk.nbFailures <= maxRetries_)
+      pendingChunks_.append(chunk);
+    else {
+      success_ = false;
+      Q_EMIT chunkFailed(chunk.first, chunk.last);
+    }
+  }
+  startWorkers();
+}
+
+bool PathRenderFarm::chunkIsRendered(const Chunk &chunk) const {
+  for (int frame = chunk.first; frame <= chunk.last; ++frame)
+    if (!QFileInfo::exists(outputFileName(frame)))
+      return false;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Worker                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns \c true when the application was started by a PathRenderFarm, as
+one of its workers. Its command line arguments then describe a job file and a
+chunk of frames to render, see renderWorkerFrames(). */
+bool PathRenderFarm::isWorker() {
+  const QStringList arguments = QCoreApplication::arguments();
+  return arguments.contains(jobArgument) && arguments.contains(framesArgument);
+}
+
+/*! Renders the chunk of frames given on the command line of a worker (see
+isWorker()) with \p viewer, and saves them. Returns the exit code of the
+worker, \c 0 when all the frames are saved.
+
+The camera of \p viewer is initialized from the job file, and moved along the
+path. The viewer does not need to be shown: it is resized to the imageSize()
+and its frames are rendered using \c QOpenGLWidget::grabFramebuffer(). The
+frames that already exist are skipped. */
+int PathRenderFarm::renderWorkerFrames(QGLViewer *viewer) {
+  const QStringList arguments = QCoreApplication::arguments();
+  const int jobIndex = arguments.indexOf(jobArgument) + 1;
+  const int framesIndex = arguments.indexOf(framesArgument) + 1;
+  if ((jobIndex == 0) || (framesIndex == 0) ||
+      (jobIndex >= arguments.size()) || (framesIndex >= arguments.size())) {
+    qWarning("PathRenderFarm::renderWorkerFrames: Not a worker");
+    return 1;
+  }
+  if (!readJobFile(arguments[jobIndex])) {
+    qWarning("PathRenderFarm::renderWorkerFrames: Invalid job file %s",
+             arguments[jobIndex].toLocal8Bit().constData());
+    return 1;
+  }
+  const QStringList range = arguments[framesIndex].split(':');
+  bool firstIsValid = false, lastIsValid = false;
+  const int first = range.value(0).toInt(&firstIsValid);
+  const int last = range.value(1).toInt(&lastIsValid);
+  if (!firstIsValid || !lastIsValid) {
+    qWarning("PathRenderFarm::renderWorkerFrames: Invalid frame range");
+    return 1;
+  }
+
+  QDomDocument document;
+  document.setContent(path_);
+  const QDomElement root = document.documentElement();
+  const QDomElement cameraElement = root.firstChildElement("Camera");
+  if (!cameraElement.isNull())
+    viewer->camera()->initFromDOMElement(cameraElement);
+  KeyFrameInterpolator path;
+  path.initFromDOMElement(root.firstChildElement("Path"));
+  path.setFrame(viewer->camera()->frame());
+
+  const qreal ratio = viewer->devicePixelRatioF();
+  viewer->resize(qRound(imageSize_.width() / ratio),
+                 qRound(imageSize_.height() / ratio));
+
+  QTextStream out(stdout);
+  for (int frame = first; frame <= last; ++frame) {
+    const QString fileName = outputFileName(frame);
+    if (QFileInfo::exists(fileName))
+      continue;
+
+    const qreal time = path.firstTime() + frame / frameRate_;
+    path.interpolateAtTime(time);
+    Q_EMIT frameAboutToBeRendered(frame, time);
+    QImage image = viewer->grabFramebuffer();
+    if (image.size() != imageSize_)
+      image = image.scaled(imageSize_, Qt::IgnoreAspectRatio,
+                           Qt::SmoothTransformation);
+
+    // Only complete frames are renamed to their name
+    QSaveFile file(fileName);
+    QImageWriter writer(&file, QFileInfo(fileName).suffix().toLatin1());
+    if (!file.open(QIODevice::WriteOnly) || !writer.write(image) ||
+        !file.commit()) {
+      qWarning("PathRenderFarm::renderWorkerFrames: Unable to save %s",
+               fileName.toLocal8Bit().constData());
+      return 1;
+    }
+    out << "frame " << frame << '\n';
+    out.flush();
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+#ifndef QGLVIEWER_PATH_RENDER_FARM_H
+#define QGLVIEWER_PATH_RENDER_FARM_H
+
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QSize>
+#include <QStringList>
+
+#include "config.h"
+
+class QGLViewer;
+
+namespace qglviewer {
+class Camera;
+class KeyFrameInterpolator;
+
+/*! \brief Renders the frames of a KeyFrameInterpolator path in several worker
+  processes.
+  \class PathRenderFarm pathRenderFarm.h QGLViewer/pathRenderFarm.h
+
+  The coordinator is given the path (setPath()), the frameRate() and the
+  frames to render (setFrameRange()). start() writes them in a job file,
+  splits the frames in chunks of chunkSize() frames and runs up to
+  nbWorkers() workerProgram() processes at a time, each one rendering a chunk:
+  \code
+  qglviewer::PathRenderFarm farm;
+  farm.setPath(*viewer->camera()->keyFrameInterpolator(1), viewer->camera());
+  farm.setImageSize(QSize(3840, 2160));
+  farm.setOutputPattern("/shared/flythrough/frame-#####.png");
+  farm.setWorkerProgram(QCoreApplication::applicationFilePath(),
+                        QStringList() << "-platform" << "offscreen");
+  farm.setNbWorkers(4);
+  farm.start();
+  \endcode
+
+  The worker program is the application itself, or any program that creates
+  its QGLViewer and hands it to renderWorkerFrames() when isWorker():
+  \code
+  int main(int argc, char **argv) {
+    QApplication application(argc, argv);
+    Viewer viewer;
+    qglviewer::PathRenderFarm farm;
+    if (farm.isWorker())
+      return farm.renderWorkerFrames(&viewer);
+    ...
+  }
+  \endcode
+  The viewer does not need to be shown. Each frame number \c n is rendered at
+  time \c firstTime() \c + \c n \c / \c frameRate() of the path (see
+  KeyFrameInterpolator::interpolateAtTime()), and saved in the file of the
+  outputPattern() where the \c # characters are replaced by \c n, padded with
+  zeros. Connect to frameAboutToBeRendered() to set the state of an animated
+  scene at this time: the frames then only depend on their number.
+
+  Render nodes are used with a workerProgram() that starts the worker remotely
+  (such as \c ssh), provided that the job file and the outputs are in a shared
+  directory. The files are written atomically: an existing output is a
+  complete frame. A failed chunk is started again (at most maxRetries()
+  times) and its existing frames are skipped. An interrupted render is
+  similarly resumed by a new start(). */
+class QGLVIEWER_EXPORT PathRenderFarm : public QObject {
+  Q_OBJECT
+
+public:
+  explicit PathRenderFarm(QObject *parent = nullptr);
+  virtual ~PathRenderFarm();
+
+  /*! @name Job */
+  //@{
+public:
+  void setPath(const KeyFrameInterpolator &path,
+               const Camera *camera = nullptr);
+  /*! Returns the number of frames per second of the rendered path. Default
+  value is 25. */
+  qreal frameRate() const { return frameRate_; }
+  /*! Sets the frameRate(). */
+  void setFrameRate(qreal rate) { frameRate_ = rate; }
+  /*! Returns the first rendered frame. See setFrameRange(). */
+  int firstFrame() const { return firstFrame_; }
+  int lastFrame() const;
+  void setFrameRange(int first, int last);
+  /*! Returns the size of the rendered images, in pixels. Default value is
+  1920x1080. */
+  QSize imageSize() const { return imageSize_; }
+  /*! Sets the imageSize(). */
+  void setImageSize(const QSize &size) { imageSize_ = size; }
+  /*! Returns the name of the rendered frames. Its run of \c # characters is
+  replaced by the frame number and its suffix defines the image format.
+  Default value is \c "frame-#####.png". */
+  QString outputPattern() const { return outputPattern_; }
+  /*! Sets the outputPattern(). Relative names are relative to the working
+  directory of the coordinator. */
+  void setOutputPattern(const QString &pattern) { outputPattern_ = pattern; }
+  QString outputFileName(int frame) const;
+  //@}
+
+  /*! @name Coordinator */
+  //@{
+public:
+  /*! Returns the program started by each worker process, and its arguments.
+  Set using setWorkerProgram(). */
+  QString workerProgram() const { return workerProgram_; }
+  /*! Returns the arguments given to the workerProgram(), before the ones that
+  describe its chunk. */
+  QStringList workerArguments() const { return workerArguments_; }
+  void setWorkerProgram(const QString &program,
+                        const QStringList &arguments = QStringList());
+  /*! Returns the maximum number of simultaneous worker processes. Default
+  value is 1. */
+  int nbWorkers() const { return nbWorkers_; }
+  /*! Sets nbWorkers(). */
+  void setNbWorkers(int nb) { nbWorkers_ = qMax(1, nb); }
+  /*! Returns the number of frames rendered by each worker process. Default
+  value is 25. */
+  int chunkSize() const { return chunkSize_; }
+  /*! Sets chunkSize(). Smaller chunks balance the work and lose less of it on
+  a failure, larger ones spend less time in the workers start up. */
+  void setChunkSize(int size) { chunkSize_ = qMax(1, size); }
+  /*! Returns the number of times a failed chunk is started again before
+  chunkFailed() is emitted. Default value is 2. */
+  int maxRetries() const { return maxRetries_; }
+  /*! Sets maxRetries(). */
+  void setMaxRetries(int retries) { maxRetries_ = qMax(0, retries); }
+
+  bool start();
+  void cancel();
+  /*! Returns \c true between start() and finished(). */
+  bool isRunning() const { return running_; }
+  /*! Returns the number of frames of the range that are rendered. */
+  int nbRenderedFrames() const { return nbRenderedFrames_; }
+
+Q_SIGNALS:
+  /*! Signal emitted when a frame is saved by a worker, or found saved by
+  start(). */
+  void frameRendered(int frame);
+  /*! Signal emitted when the frames from \p first to \p last still failed
+  after maxRetries() new starts. */
+  void chunkFailed(int first, int last);
+  /*! Signal emitted when all the chunks are completed or failed, or when the
+  render is cancel()ed. \p success is \c true when all the frames are
+  rendered. */
+  void finished(bool success);
+  //@}
+
+  /*! @name Worker */
+  //@{
+public:
+  static bool isWorker();
+  int renderWorkerFrames(QGLViewer *viewer);
+
+Q_SIGNALS:
+  /*! Signal emitted by renderWorkerFrames() before each frame is rendered, once
+  the camera is set at the path \p time. */
+  void frameAboutToBeRendered(int frame, qreal time);
+  //@}
+
+private Q_SLOTS:
+  void readWorkerOutput();
+  void workerFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+  // Frames rendered by one worker process
+  struct Chunk {
+    int first, last;
+    int nbFailures;
+  };
+
+  QString jobFileName() const;
+  bool writeJobFile() const;
+  bool readJobFile(const QString &fileName);
+  void startWorkers();
+  bool chunkIsRendered(const Chunk &chunk) const;
+
+  // J o b
+  QString path_;   // KeyFrameInterpolator and Camera, as XML
+  qreal firstTime_, duration_;
+  qreal frameRate_;
+  int firstFrame_, lastFrame_; // lastFrame_ < 0 means until the path end
+  QSize imageSize_;
+  QString outputPattern_;
+
+  // C o o r d i n a t o r
+  QString workerProgram_;
+  QStringList workerArguments_;
+  int nbWorkers_;
+  int chunkSize_;
+  int maxRetries_;
+  bool running_;
+  bool success_;
+  int nbRenderedFrames_;
+  QList<Chunk> pendingChunks_;
+  QList<QProcess *> workers_;
+  QList<Chunk> workerChunks_; // same indices as workers_
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_PATH_RENDER_FARM_H
@@ -0,0 +1,285 @@
+#include "pathTable.h"
+#include "keyFrameInterpolator.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+
+using namespace qglviewer;
+
+// Texels per row of the texture. The paths are laid out one after the other,
+// wrapped on these rows, so that their number is not limited by the maximum
+// texture size. Must match vertexShaderCode().
+static const int textureWidth = 4096;
+// Floats per texel
+static const int texelSize = 4;
+
+/*! Creates an empty PathTable. No OpenGL resource is created before the first
+update(). */
+PathTable::PathTable()
+    : nbPaths_(0), nbSamples_(256), firstModifiedRow_(0),
+      lastModifiedRow_(-1), context_(nullptr), functions_(nullptr),
+      texture_(0), textureHeight_(0) {}
+
+/*! Destructor. The texture is only released when the context used by update()
+is current. Call cleanupGL() before otherwise. */
+PathTable::~PathTable() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Paths                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Samples the path of \p interpolator and returns its id, which the vertex
+shaders give to \c qglPathState(). Returns -1 when \p interpolator has no
+keyFrame.
+
+The samples are copied: modifying the \p interpolator afterwards has no effect
+until setPath() is called. */
+int PathTable::addPath(KeyFrameInterpolator &interpolator) {
+  if (interpolator.numberOfKeyFrames() == 0) {
+    qWarning("PathTable::addPath: the interpolator has no keyFrame");
+    return -1;
+  }
+  texels_.resize(texelSize * (nbPaths_ + 1) * (1 + 2 * nbSamples_));
+  samplePath(nbPaths_, interpolator);
+  return nbPaths_++;
+}
+
+/*! Samples \p interpolator again in \p path, typically after a modification of
+its keyFrames. Only the samples of this path are uploaded by the next
+update(). Returns \c false when \p path is invalid or \p interpolator has no
+keyFrame. */
+bool PathTable::setPath(int path, KeyFrameInterpolator &interpolator) {
+  if ((path < 0) || (path >= nbPaths_)) {
+    qWarning("PathTable::setPath: Invalid path %d", path);
+    return false;
+  }
+  if (interpolator.numberOfKeyFrames() == 0) {
+    qWarning("PathTable::setPath: the interpolator has no keyFrame");
+    return false;
+  }
+  return samplePath(path, interpolator);
+}
+
+/*! Removes all the paths. The texture is released by the next update(). */
+void PathTable::clear() {
+  nbPaths_ = 0;
+  texels_.clear();
+  firstModifiedRow_ = 0;
+  lastModifiedRow_ = -1;
+}
+
+/*! Sets nbSamples(), clamped to at least 2. Since the shaders find the
+samples of a path from its id, all the paths have the same number of samples:
+this can only be changed before the first addPath(). */
+void PathTable::setNbSamples(int nb) {
+  if (nbPaths_ > 0) {
+    qWarning("PathTable::setNbSamples: paths were already added");
+    return;
+  }
+  nbSamples_ = std::max(nb, 2);
+}
+
+// Fills the texels of path, and marks their rows as modified
+bool PathTable::samplePath(int path, KeyFrameInterpolator &interpolator) {
+  const qreal firstTime = interpolator.firstTime();
+  const qreal duration = interpolator.duration();
+
+  QVector<qreal> times(nbSamples_);
+  for (int i = 0; i < nbSamples_; ++i)
+    times[i] = firstTime + duration * i / (nbSamples_ - 1);
+  QVector<Vec> positions(nbSamples_);
+  QVector<Quaternion> orientations(nbSamples_);
+  if (!interpolator.getInterpolatedStates(times.constData(), nbSamples_,
+                                          positions.data(),
+                                          orientations.data()))
+    return false;
+
+  const int firstTexel = path * (1 + 2 * nbSamples_);
+  float *texel = texels_.data() + texelSize * firstTexel;
+  *texel++ = float(firstTime);
+  *texel++ = float(duration);
+  *texel++ = interpolator.loopInterpolation() ? 1.0f : 0.0f;
+  *texel++ = 0.0f;
+
+  Quaternion previous = orientations[0];
+  for (int i = 0; i < nbSamples_; ++i) {
+    for (int j = 0; j < 3; ++j)
+      *texel++ = float(positions[i][j]);
+    *texel++ = 1.0f;
+
+    // Same hemisphere as the previous sample, so that the linear
+    // interpolation of the shader takes the shortest arc
+    Quaternion q = orientations[i];
+    if (q[0] * previous[0] + q[1] * previous[1] + q[2] * previous[2] +
+            q[3] * previous[3] <
+        0.0)
+      q.negate();
+    previous = q;
+    for (int j = 0; j < 4; ++j)
+      *texel++ = float(q[j]);
+  }
+
+  const int lastTexel = firstTexel + 2 * nbSamples_;
+  if (lastModifiedRow_ < firstModifiedRow_) {
+    firstModifiedRow_ = firstTexel / textureWidth;
+    lastModifiedRow_ = lastTexel / textureWidth;
+  } else {
+    firstModifiedRow_ = std::min(firstModifiedRow_, firstTexel / textureWidth);
+    lastModifiedRow_ = std::max(lastModifiedRow_, lastTexel / textureWidth);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  OpenGL                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+// Gets the functions of the current context. Returns false when floating
+// point textures cannot be fetched.
+bool PathTable::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("PathTable::update: No current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return true;
+  if (context_) {
+    qWarning("PathTable::update: OpenGL context changed, texture is lost");
+    texture_ = 0;
+    textureHeight_ = 0;
+  }
+  if (context->format().version() < qMakePair(3, 0)) {
+    qWarning("PathTable::update: OpenGL 3.0 is required");
+    return false;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  return true;
+}
+
+/*! Uploads the paths added or modified since the previous update(). Must be
+called with the OpenGL context current, typically at the beginning of your
+viewer's \c draw(). Returns \c false when the texture cannot be created. */
+bool PathTable::update() {
+  if (!initializeGL())
+    return false;
+
+  const int nbTexels = nbPaths_ * (1 + 2 * nbSamples_);
+  const int height = (nbTexels + textureWidth - 1) / textureWidth;
+
+  if (height == 0) {
+    if (texture_)
+      functions_->glDeleteTextures(1, &texture_);
+    texture_ = 0;
+    textureHeight_ = 0;
+    lastModifiedRow_ = -1;
+    return true;
+  }
+
+  // The last row is padded, since texImage2D reads whole rows
+  if (texels_.size() < texelSize * textureWidth * height)
+    texels_.resize(texelSize * textureWidth * height);
+
+  if (height > textureHeight_) {
+    // Grows by a quarter, so that adding paths one by one does not
+    // reallocate the texture at each update()
+    const int capacity = height + height / 4;
+    if (!texture_)
+      functions_->glGenTextures(1, &texture_);
+    functions_->glBindTexture(GL_TEXTURE_2D, texture_);
+    functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                GL_NEAREST);
+    functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                GL_NEAREST);
+    functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, textureWidth,
+                             capacity, 0, GL_RGBA, GL_FLOAT, nullptr);
+    textureHeight_ = capacity;
+    firstModifiedRow_ = 0;
+    lastModifiedRow_ = height - 1;
+  } else
+    functions_->glBindTexture(GL_TEXTURE_2D, texture_);
+
+  lastModifiedRow_ = std::min(lastModifiedRow_, height - 1);
+  if (lastModifiedRow_ >= firstModifiedRow_)
+    functions_->glTexSubImage2D(
+        GL_TEXTURE_2D, 0, 0, firstModifiedRow_, textureWidth,
+        lastModifiedRow_ - firstModifiedRow_ + 1, GL_RGBA, GL_FLOAT,
+        texels_.constData() + texelSize * textureWidth * firstModifiedRow_);
+  functions_->glBindTexture(GL_TEXTURE_2D, 0);
+
+  firstModifiedRow_ = 0;
+  lastModifiedRow_ = -1;
+  return true;
+}
+
+/*! Releases the texture. Must be called with the context of update() current.
+The next update() uploads all the paths again. */
+void PathTable::cleanupGL() {
+  if (functions_ && texture_)
+    functions_->glDeleteTextures(1, &texture_);
+  texture_ = 0;
+  textureHeight_ = 0;
+  firstModifiedRow_ = 0;
+  lastModifiedRow_ = -1;
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+/*! Binds the texture() to \p textureUnit and sets the \c qglPathTable and \c
+qglPathSamples uniforms of vertexShaderCode() in \p program, which must be
+bound. */
+void PathTable::setUniforms(QOpenGLShaderProgram *program,
+                            int textureUnit) const {
+  if (functions_) {
+    functions_->glActiveTexture(GL_TEXTURE0 + textureUnit);
+    functions_->glBindTexture(GL_TEXTURE_2D, texture_);
+    functions_->glActiveTexture(GL_TEXTURE0);
+  }
+  program->setUniformValue("qglPathTable", textureUnit);
+  program->setUniformValue("qglPathSamples", nbSamples_);
+}
+
+/*! Returns the GLSL declarations that evaluate the paths in a vertex shader:
+the \c qglPathTable and \c qglPathSamples uniforms, set by setUniforms(), the
+\c qglPathState(int path, float time, out vec3 position, out vec4
+orientation) function, and the \c qglRotate(vec4 orientation, vec3 v)
+function, which rotates \p v by a quaternion. Requires GLSL 1.30 or GLSL ES
+3.00 or later. */
+const char *PathTable::vertexShaderCode() {
+  return "uniform highp sampler2D qglPathTable;\n"
+         "uniform int qglPathSamples;\n"
+         "highp vec4 qglPathTexel(int index) {\n"
+         "  return texelFetch(qglPathTable,\n"
+         "                    ivec2(index % 4096, index / 4096), 0);\n"
+         "}\n"
+         "void qglPathState(int path, float time, out vec3 position,\n"
+         "                  out vec4 orientation) {\n"
+         "  int first = path * (2 * qglPathSamples + 1);\n"
+         "  highp vec4 header = qglPathTexel(first);\n"
+         "  float t = time - header.x;\n"
+         "  if ((header.z > 0.5) && (header.y > 0.0))\n"
+         "    t = mod(t, header.y);\n"
+         "  else\n"
+         "    t = clamp(t, 0.0, header.y);\n"
+         "  float s = (header.y > 0.0)\n"
+         "      ? t / header.y * float(qglPathSamples - 1) : 0.0;\n"
+         "  int i = min(int(s), qglPathSamples - 2);\n"
+         "  float alpha = s - float(i);\n"
+         "  int texel = first + 1 + 2 * i;\n"
+         "  position = mix(qglPathTexel(texel).xyz,\n"
+         "                 qglPathTexel(texel + 2).xyz, alpha);\n"
+         "  orientation = normalize(mix(qglPathTexel(texel + 1),\n"
+         "                              qglPathTexel(texel + 3), alpha));\n"
+         "}\n"
+         "vec3 qglRotate(vec4 q, vec3 v) {\n"
+         "  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n"
+         "}\n";
+}
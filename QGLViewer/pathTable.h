@@ -0,0 +1,114 @@
+#ifndef QGLVIEWER_PATH_TABLE_H
+#define QGLVIEWER_PATH_TABLE_H
+
+#include "config.h"
+
+#include <QVector>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+
+namespace qglviewer {
+class KeyFrameInterpolator;
+
+/*! \brief Samples KeyFrameInterpolator paths in a texture, so that vertex
+  shaders can animate many instances along them.
+  \class PathTable pathTable.h QGLViewer/pathTable.h
+
+  Even when getInterpolatedStates() evaluates the paths of thousands of
+  instances in a single call, writing and uploading their transformations
+  at each frame costs more than drawing them. A PathTable instead samples
+  each path once, nbSamples() times at regular intervals between its
+  KeyFrameInterpolator::firstTime() and KeyFrameInterpolator::lastTime(),
+  and stores the samples in a floating point texture. Each instance then only
+  needs a path id (returned by addPath()) and a time offset as vertex
+  attributes: the vertex shader interpolates the position and orientation of
+  its instance from the texture, and the CPU cost per frame is a uniform:
+  \code
+  void Viewer::init() {
+    for (int i = 0; i < nbPaths; ++i)
+      pathId[i] = paths_.addPath(interpolator[i]);
+    program_.addShaderFromSourceCode(QOpenGLShader::Vertex,
+        QByteArray("#version 330 core\n") +
+        qglviewer::PathTable::vertexShaderCode() + vertexShaderSource);
+    // In the vertex shader main():
+    //   vec3 position; vec4 orientation;
+    //   qglPathState(pathId, time + timeOffset, position, orientation);
+    //   vec3 world = position + qglRotate(orientation, vertex);
+  }
+
+  void Viewer::draw() {
+    paths_.update();
+    program_.bind();
+    paths_.setUniforms(&program_, 0);
+    program_.setUniformValue("time", GLfloat(animationTime));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, nbVertices, nbInstances);
+  }
+  \endcode
+
+  The positions and orientations are expressed in the coordinate system of
+  the KeyFrames (see getInterpolatedStates()). The loopInterpolation() of a
+  path is sampled with it: its instances then loop, the others stop at the end
+  of their path. The interpolation between samples is linear, as with
+  KeyFrameInterpolator::bakedInterpolation(): increase nbSamples() if needed.
+
+  Requires OpenGL 3.0 or OpenGL ES 3.0. Call cleanupGL() with the context of
+  update() current before the PathTable is destroyed. */
+class QGLVIEWER_EXPORT PathTable {
+public:
+  PathTable();
+  ~PathTable();
+
+  /*! @name Paths */
+  //@{
+public:
+  int addPath(KeyFrameInterpolator &interpolator);
+  bool setPath(int path, KeyFrameInterpolator &interpolator);
+  void clear();
+
+  /*! Returns the number of paths added since the last clear(). */
+  int nbPaths() const { return nbPaths_; }
+
+  /*! Returns the number of samples of each path. Default value is 256. */
+  int nbSamples() const { return nbSamples_; }
+  void setNbSamples(int nb);
+  //@}
+
+  /*! @name OpenGL */
+  //@{
+public:
+  bool update();
+  void cleanupGL();
+
+  /*! Returns the \c GL_TEXTURE_2D of the samples, 0 before the first
+  update(). */
+  GLuint texture() const { return texture_; }
+
+  void setUniforms(QOpenGLShaderProgram *program, int textureUnit) const;
+  static const char *vertexShaderCode();
+  //@}
+
+private:
+  Q_DISABLE_COPY(PathTable)
+
+  bool samplePath(int path, KeyFrameInterpolator &interpolator);
+  bool initializeGL();
+
+  int nbPaths_;
+  int nbSamples_;
+  // 4 floats per texel: for each path, its firstTime(), duration() and
+  // loopInterpolation(), and then the position and orientation of each sample
+  QVector<float> texels_;
+  int firstModifiedRow_; // texture rows to upload, none when last < first
+  int lastModifiedRow_;
+
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  GLuint texture_;
+  int textureHeight_; // rows of texture_
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_PATH_TABLE_H
@@ -0,0 +1,486 @@
+#include "pointCloud.h"
+#include "camera.h"
+#include "domUtils.h"
+#include "pointIndex.h"
+
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QHash>
+#include <QMutexLocker>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+using namespace qglviewer;
+
+// Bytes per point: three floats and an RGBA color
+static const int bytesPerPoint = 16;
+// Nodes read simultaneously: more requests would delay the most needed ones
+static const int maximumNbLoading = 4;
+// Bytes uploaded per draw(), so that a burst of loads does not stall a frame
+static const qint64 maximumUploadSize = 16 << 20;
+
+/*! Creates an empty PointCloud. Use load() to open an octree. */
+PointCloud::PointCloud(QObject *parent)
+    : QObject(parent), spacing_(1.0), nbPoints_(0),
+      maximumScreenSpaceError_(2.0), pointBudget_(5000000),
+      gpuMemoryBudget_(qint64(512) << 20), pointSize_(2.0),
+      pointSizeAdaptation_(true), frame_(0), nbDrawnPoints_(0),
+      gpuMemoryUsage_(0), pointIndex_(nullptr), loaderThreadPool_(nullptr),
+      nbLoading_(0) {}
+
+/*! Destructor. Waits for the loader threads. The vertex buffers are released
+if an OpenGL context is current, see cleanupGL(). */
+PointCloud::~PointCloud() {
+  if (loaderThreadPool_) {
+    loaderThreadPool_->clear();
+    loaderThreadPool_->waitForDone();
+  }
+  delete loaderThreadPool_;
+  if (QOpenGLContext::currentContext())
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Hierarchy                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Reads the \c cloud.xml hierarchy of the octree stored in \p directory (see
+the on-disk format in the class documentation). No point is read: the nodes
+are loaded on demand by draw().
+
+Returns \c false (and the PointCloud is empty) when the hierarchy file cannot
+be read or is invalid. */
+bool PointCloud::load(const QString &directory) {
+  clear();
+
+  QFile file(QDir(directory).filePath("cloud.xml"));
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning("PointCloud::load: Unable to open %s",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  QDomDocument document;
+  if (!document.setContent(&file)) {
+    qWarning("PointCloud::load: %s is not a valid XML file",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  const QDomElement root = document.documentElement();
+  if (root.tagName() != "PointCloud") {
+    qWarning("PointCloud::load: %s is not a point cloud hierarchy",
+             qPrintable(file.fileName()));
+    return false;
+  }
+  spacing_ = DomUtils::qrealFromDom(root, "spacing", 1.0);
+
+  QHash<QString, int> indices;
+  QDomElement child = root.firstChild().toElement();
+  while (!child.isNull()) {
+    if (child.tagName() == "BoundingBoxMin")
+      min_ = Vec(child);
+    else if (child.tagName() == "BoundingBoxMax")
+      max_ = Vec(child);
+    else if (child.tagName() == "Node") {
+      Node node;
+      node.name = child.attribute("name");
+      node.level = node.name.length() - 1;
+      node.nbPoints = DomUtils::intFromDom(child, "nbPoints", 0);
+      std::fill(node.children, node.children + 8, -1);
+      node.state = ON_DISK;
+      node.buffer = nullptr;
+      node.lastDrawnFrame = 0;
+      node.indexed = false;
+
+      const int index = nodes_.size();
+      if (node.name == "r") {
+        if (index != 0) {
+          qWarning("PointCloud::load: The root node must be listed first");
+          clear();
+          return false;
+        }
+        node.min = min_;
+        node.max = max_;
+      } else {
+        const QChar digit = node.name.at(node.name.length() - 1);
+        const int position = digit.digitValue();
+        const int parent = indices.value(node.name.left(node.level), -1);
+        if ((parent < 0) || (position < 0) || (position > 7)) {
+          qWarning("PointCloud::load: Invalid node name %s, or parent not "
+                   "listed before it",
+                   qPrintable(node.name));
+          clear();
+          return false;
+        }
+
+        // Child box: one half of the parent box along each axis
+        const Node &p = nodes_[parent];
+        const Vec center = (p.min + p.max) / 2.0;
+        for (int k = 0; k < 3; ++k) {
+          const bool upper = position & (4 >> k);
+          node.min[k] = upper ? center[k] : p.min[k];
+          node.max[k] = upper ? p.max[k] : center[k];
+        }
+        nodes_[parent].children[position] = index;
+      }
+
+      indices.insert(node.name, index);
+      nbPoints_ += node.nbPoints;
+      nodes_.append(node);
+    }
+    child = child.nextSibling().toElement();
+  }
+
+  if (nodes_.isEmpty()) {
+    qWarning("PointCloud::load: No root node in %s",
+             qPrintable(file.fileName()));
+    return false;
+  }
+
+  directory_ = directory;
+  return true;
+}
+
+/*! Removes all the nodes. Waits for the running loads. The vertex buffers are
+released: the viewer's context must be current when nodes were drawn. */
+void PointCloud::clear() {
+  if (loaderThreadPool_) {
+    loaderThreadPool_->clear();
+    loaderThreadPool_->waitForDone();
+  }
+  cleanupGL();
+
+  nodes_.clear();
+  directory_.clear();
+  min_ = max_ = Vec();
+  spacing_ = 1.0;
+  nbPoints_ = 0;
+  nbDrawnPoints_ = 0;
+  nbLoading_ = 0;
+  inMemoryNodes_.clear();
+  if (pointIndex_)
+    pointIndex_->clear();
+
+  QMutexLocker locker(&loadedMutex_);
+  loadedNodes_.clear();
+  loadedData_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Level of detail                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the maximumScreenSpaceError(), in pixels. */
+void PointCloud::setMaximumScreenSpaceError(qreal error) {
+  maximumScreenSpaceError_ = qMax(error, qreal(0.1));
+}
+
+/*! Sets the pointBudget(). The root node is always drawn. */
+void PointCloud::setPointBudget(qint64 budget) {
+  pointBudget_ = qMax(budget, qint64(0));
+}
+
+/*! Sets the gpuMemoryBudget(), in bytes. */
+void PointCloud::setGpuMemoryBudget(qint64 budget) {
+  gpuMemoryBudget_ = qMax(budget, qint64(0));
+}
+
+// The point spacing of node, in pixels, at its closest point to the camera
+qreal PointCloud::projectedSpacing(const Node &node,
+                                   const Camera *camera) const {
+  const Vec eye = camera->position();
+  Vec closest;
+  for (int k = 0; k < 3; ++k)
+    closest[k] = qBound(node.min[k], eye[k], node.max[k]);
+
+  const qreal ratio = camera->pixelGLRatio(closest);
+  if (ratio <= 0.0)
+    return std::numeric_limits<qreal>::max();
+  return ldexp(spacing_, -node.level) / ratio;
+}
+
+// Same test as FrustumCuller: the box is outside of one of the planes
+bool PointCloud::isCulled(const Node &node, const GLdouble planes[6][4]) {
+  const Vec center = (node.min + node.max) / 2.0;
+  const Vec extent = (node.max - node.min) / 2.0;
+  for (int i = 0; i < 6; ++i) {
+    const GLdouble *p = planes[i];
+    const qreal distance =
+        p[0] * center.x + p[1] * center.y + p[2] * center.z - p[3];
+    const qreal radius = fabs(p[0]) * extent.x +
+                         fabs(p[1]) * extent.y +
+                         fabs(p[2]) * extent.z;
+    if (distance > radius)
+      return true;
+  }
+  return false;
+}
+
+// Fills selected with the visible resident nodes to draw, and wanted with the
+// visible nodes that should be loaded. Nodes are refined by decreasing
+// projected spacing, until pointBudget() points are selected.
+void PointCloud::selectNodes(const Camera *camera,
+                             QVector<Selection> &selected,
+                             QVector<Selection> &wanted) const {
+  GLdouble planes[6][4];
+  camera->getFrustumPlanesCoefficients(planes);
+
+  std::priority_queue<Selection> queue;
+  if (!isCulled(nodes_[0], planes))
+    queue.push({0, projectedSpacing(nodes_[0], camera)});
+
+  qint64 nbPoints = 0;
+  while (!queue.empty()) {
+    const Selection selection = queue.top();
+    queue.pop();
+    const Node &node = nodes_[selection.node];
+
+    if (node.state != RESIDENT) {
+      // Its parent is drawn until it is loaded
+      if (node.state == ON_DISK)
+        wanted.append(selection);
+      continue;
+    }
+
+    if (!selected.isEmpty() && (nbPoints + node.nbPoints > pointBudget_))
+      break;
+    selected.append(selection);
+    nbPoints += node.nbPoints;
+
+    if (selection.error <= maximumScreenSpaceError_)
+      continue;
+    for (int c = 0; c < 8; ++c) {
+      const int child = node.children[c];
+      if ((child >= 0) && !isCulled(nodes_[child], planes))
+        queue.push({child, projectedSpacing(nodes_[child], camera)});
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Loader threads                               //
+////////////////////////////////////////////////////////////////////////////////
+
+// Starts the loads of the most needed wanted nodes
+void PointCloud::requestLoads(QVector<Selection> &wanted) {
+  if (nbLoading_ >= maximumNbLoading)
+    return;
+
+  std::sort(wanted.begin(), wanted.end(),
+            [](const Selection &a, const Selection &b) { return b < a; });
+
+  if (!loaderThreadPool_) {
+    loaderThreadPool_ = new QThreadPool();
+    loaderThreadPool_->setMaxThreadCount(2);
+  }
+
+  for (int i = 0; (i < wanted.size()) && (nbLoading_ < maximumNbLoading);
+       ++i) {
+    const int index = wanted[i].node;
+    Node &node = nodes_[index];
+    node.state = LOADING;
+    ++nbLoading_;
+
+    const QString fileName = QDir(directory_).filePath(node.name + ".bin");
+    const int nbPoints = node.nbPoints;
+    loaderThreadPool_->start(QRunnable::create([this, index, fileName,
+                                                nbPoints]() {
+      loadNode(index, fileName, nbPoints);
+    }));
+  }
+}
+
+// Reads the points of a node. Called in a loader thread.
+void PointCloud::loadNode(int index, const QString &fileName, int nbPoints) {
+  const qint64 size = qint64(nbPoints) * bytesPerPoint;
+  QByteArray data;
+  QFile file(fileName);
+  if (file.open(QIODevice::ReadOnly))
+    data = file.read(size);
+  if (data.size() != size) {
+    qWarning("PointCloud: Unable to read %d points from %s", nbPoints,
+             qPrintable(fileName));
+    data.clear();
+  }
+
+  {
+    QMutexLocker locker(&loadedMutex_);
+    loadedNodes_.append(index);
+    loadedData_.append(data);
+  }
+  Q_EMIT nodeLoaded();
+}
+
+// Collects the nodes read by the loader threads, and uploads some of them in
+// vertex buffers.
+void PointCloud::uploadNodes() {
+  {
+    QMutexLocker locker(&loadedMutex_);
+    for (int i = 0; i < loadedNodes_.size(); ++i) {
+      Node &node = nodes_[loadedNodes_[i]];
+      --nbLoading_;
+      if (loadedData_[i].isEmpty() && (node.nbPoints > 0))
+        node.state = FAILED;
+      else {
+        node.state = IN_MEMORY;
+        node.data = loadedData_[i];
+        if (pointIndex_ && !node.indexed) {
+          pointIndex_->addPoints(
+              reinterpret_cast<const float *>(node.data.constData()),
+              node.nbPoints, bytesPerPoint);
+          node.indexed = true;
+        }
+        inMemoryNodes_.append(loadedNodes_[i]);
+      }
+    }
+    loadedNodes_.clear();
+    loadedData_.clear();
+  }
+
+  qint64 uploaded = 0;
+  int i = 0;
+  for (; (i < inMemoryNodes_.size()) && (uploaded < maximumUploadSize); ++i) {
+    Node &node = nodes_[inMemoryNodes_[i]];
+    node.buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    if (!node.buffer->create()) {
+      qWarning("PointCloud::draw: Unable to create a vertex buffer");
+      delete node.buffer;
+      node.buffer = nullptr;
+      node.state = FAILED;
+      node.data.clear();
+      continue;
+    }
+    node.buffer->bind();
+    node.buffer->allocate(node.data.constData(), node.data.size());
+    node.buffer->release();
+
+    uploaded += node.data.size();
+    gpuMemoryUsage_ += node.data.size();
+    node.data.clear();
+    node.state = RESIDENT;
+    node.lastDrawnFrame = frame_;
+  }
+  inMemoryNodes_.remove(0, i);
+}
+
+// Releases the least recently drawn vertex buffers while the
+// gpuMemoryBudget() is exceeded. The nodes of the current frame are kept.
+void PointCloud::releaseNodes() {
+  if (gpuMemoryUsage_ <= gpuMemoryBudget_)
+    return;
+
+  QVector<int> resident;
+  for (int i = 0; i < nodes_.size(); ++i)
+    if ((nodes_[i].state == RESIDENT) && (nodes_[i].lastDrawnFrame != frame_))
+      resident.append(i);
+  std::sort(resident.begin(), resident.end(), [this](int a, int b) {
+    return nodes_[a].lastDrawnFrame < nodes_[b].lastDrawnFrame;
+  });
+
+  for (int i = 0; (i < resident.size()) && (gpuMemoryUsage_ > gpuMemoryBudget_);
+       ++i) {
+    Node &node = nodes_[resident[i]];
+    gpuMemoryUsage_ -= qint64(node.nbPoints) * bytesPerPoint;
+    node.buffer->destroy();
+    delete node.buffer;
+    node.buffer = nullptr;
+    node.state = ON_DISK;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Draws the nodes of the octree selected for \p camera, and requests the
+loading of the missing ones. Call this method in your viewer's draw() (and
+fastDraw()) with its camera(). The modelView matrix must correspond to the
+world coordinate system.
+
+The points are drawn with their colors, without lighting. The OpenGL state is
+not modified. */
+void PointCloud::draw(const Camera *camera) {
+  if (!isLoaded())
+    return;
+  if (QOpenGLContext::currentContext()->format().profile() ==
+      QSurfaceFormat::CoreProfile)
+    return;
+
+  ++frame_;
+  uploadNodes();
+
+  QVector<Selection> selected, wanted;
+  selectNodes(camera, selected, wanted);
+  requestLoads(wanted);
+  for (const Selection &selection : selected)
+    nodes_[selection.node].lastDrawnFrame = frame_;
+  releaseNodes();
+
+  glPushAttrib(GL_ENABLE_BIT | GL_POINT_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glDisable(GL_LIGHTING);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  nbDrawnPoints_ = 0;
+  for (const Selection &selection : selected) {
+    const Node &node = nodes_[selection.node];
+    qreal size = pointSize_;
+    if (pointSizeAdaptation_ && (selection.error > maximumScreenSpaceError_))
+      size = qMin(pointSize_ * selection.error / maximumScreenSpaceError_,
+                  4.0 * pointSize_);
+    glPointSize(GLfloat(size));
+
+    node.buffer->bind();
+    glVertexPointer(3, GL_FLOAT, bytesPerPoint, nullptr);
+    glColorPointer(4, GL_UNSIGNED_BYTE, bytesPerPoint,
+                   reinterpret_cast<const void *>(3 * sizeof(GLfloat)));
+    glDrawArrays(GL_POINTS, 0, node.nbPoints);
+    node.buffer->release();
+    nbDrawnPoints_ += node.nbPoints;
+  }
+
+  glPopClientAttrib();
+  glPopAttrib();
+
+  // Uploads postponed by maximumUploadSize
+  if (!inMemoryNodes_.isEmpty())
+    Q_EMIT nodeLoaded();
+}
+
+/*! Releases the vertex buffers of the loaded nodes, which will be read again
+from disk when needed. The viewer's context must be current. */
+void PointCloud::cleanupGL() {
+  for (Node &node : nodes_)
+    if (node.buffer) {
+      node.buffer->destroy();
+      delete node.buffer;
+      node.buffer = nullptr;
+      node.state = ON_DISK;
+    }
+  gpuMemoryUsage_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Snapping                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the pointIndex(), to which the points of each node are added when it
+is first read from disk: the index contains the points of the levels of detail
+that were drawn, at their finest resolution where the camera went closest.
+\code
+index_ = new qglviewer::PointIndex(this);
+cloud_->setPointIndex(index_);
+cloud_->load("/data/scan");
+\endcode
+The \p index is not owned by the PointCloud, which clear()s it in clear().
+Set it before load(): the nodes that are already loaded are not added. */
+void PointCloud::setPointIndex(PointIndex *index) { pointIndex_ = index; }
@@ -0,0 +1,235 @@
+#ifndef QGLVIEWER_POINT_CLOUD_H
+#define QGLVIEWER_POINT_CLOUD_H
+
+#include "vec.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class QOpenGLBuffer;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+class PointIndex;
+
+/*! \brief Streams and draws a large point cloud stored as an on-disk octree.
+  \class PointCloud pointCloud.h QGLViewer/pointCloud.h
+
+  Scans made of billions of points do not fit in memory. A PointCloud only
+  loads and draws the nodes of an octree that are needed for the current
+  Camera, at the resolution that the screen can display:
+  \code
+  // In your viewer's init()
+  cloud = new qglviewer::PointCloud(this);
+  cloud->load("/data/scan");
+  connect(cloud, SIGNAL(nodeLoaded()), SLOT(update()));
+  setSceneBoundingBox(cloud->boundingBoxMin(), cloud->boundingBoxMax());
+
+  // In draw() (and fastDraw())
+  cloud->draw(camera());
+  \endcode
+
+  Each node of the octree holds a subsample of the points of its box, with an
+  average point spacing that is halved at each level (as in Potree). draw()
+  traverses the octree from the root and refines the visible nodes whose
+  spacing, projected on screen (see Camera::pixelGLRatio()), is larger than
+  maximumScreenSpaceError() pixels. The nodes with the largest projected
+  spacing are refined first, until pointBudget() points are selected.
+
+  The needed nodes that are not in memory are read by background threads, and
+  the nodeLoaded() signal is emitted when one of them can be drawn. Their
+  parent nodes are drawn in the meantime. Loaded nodes are kept in vertex
+  buffers, the least recently drawn ones being released when
+  gpuMemoryBudget() is exceeded.
+
+  The points of the loaded nodes can be added to a PointIndex, for point
+  snapping under the cursor: see setPointIndex().
+
+  <h3>On-disk format</h3>
+
+  The load() directory contains a \c cloud.xml hierarchy file:
+  \code
+  <PointCloud spacing="0.5">
+    <BoundingBoxMin x="0" y="0" z="0"/>
+    <BoundingBoxMax x="100" y="100" z="20"/>
+    <Node name="r" nbPoints="65536"/>
+    <Node name="r0" nbPoints="60310"/>
+    <Node name="r07" nbPoints="18220"/>
+    ...
+  </PointCloud>
+  \endcode
+  \c spacing is the point spacing of the root node \c r. Each additional digit
+  of a node name is the index of a child in its parent box: bit 2 is set for
+  the upper half along X, bit 1 along Y and bit 0 along Z. The parent of a node
+  must be listed before it.
+
+  The points of each node are stored in the \c <name>.bin file, as \c nbPoints
+  packed records of 16 bytes: three little endian \c float world coordinates
+  followed by an 8 bit RGBA color.
+
+  draw() uses vertex arrays and hence requires a compatibility profile. All
+  the OpenGL methods require the viewer's context to be current: call
+  cleanupGL() before it is destroyed. */
+class QGLVIEWER_EXPORT PointCloud : public QObject {
+  Q_OBJECT
+
+public:
+  explicit PointCloud(QObject *parent = nullptr);
+  virtual ~PointCloud();
+
+  /*! @name Hierarchy */
+  //@{
+public:
+  bool load(const QString &directory);
+  void clear();
+
+  /*! Returns \c true when a hierarchy was successfully load()ed. */
+  bool isLoaded() const { return !nodes_.isEmpty(); }
+  /*! Returns the directory given to load(). */
+  QString directory() const { return directory_; }
+  /*! Returns the lower corner of the point cloud bounding box. */
+  Vec boundingBoxMin() const { return min_; }
+  /*! Returns the upper corner of the point cloud bounding box. */
+  Vec boundingBoxMax() const { return max_; }
+  /*! Returns the number of nodes of the octree. */
+  int nbNodes() const { return nodes_.size(); }
+  /*! Returns the total number of points of the octree nodes. */
+  qint64 nbPoints() const { return nbPoints_; }
+  //@}
+
+  /*! @name Level of detail */
+  //@{
+public:
+  /*! Returns the projected point spacing, in pixels, above which a node is
+  refined by its children. Default value is 2.0. Smaller values draw more
+  points. */
+  qreal maximumScreenSpaceError() const { return maximumScreenSpaceError_; }
+  void setMaximumScreenSpaceError(qreal error);
+
+  /*! Returns the maximum number of points drawn per frame. Default value is
+  5 million. */
+  qint64 pointBudget() const { return pointBudget_; }
+  void setPointBudget(qint64 budget);
+
+  /*! Returns the maximum size, in bytes, of the vertex buffers of the loaded
+  nodes. Default value is 512 MiB. The nodes needed by the current frame are
+  kept even when they exceed it. */
+  qint64 gpuMemoryBudget() const { return gpuMemoryBudget_; }
+  void setGpuMemoryBudget(qint64 budget);
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  void draw(const Camera *camera);
+  void cleanupGL();
+
+  /*! Returns the size of the points, in pixels. Default value is 2.0. */
+  qreal pointSize() const { return pointSize_; }
+  /*! Sets the pointSize(). */
+  void setPointSize(qreal size) { pointSize_ = qMax(size, qreal(1.0)); }
+
+  /*! Returns \c true when the point size of each node is adapted to its
+  projected point spacing. Default value is \c true.
+
+  A node whose children are not refined (because their data is not loaded yet,
+  or because of the pointBudget()) has a sparser point spacing than the
+  maximumScreenSpaceError(). Its points are then enlarged (up to four times
+  the pointSize()) to fill the holes. */
+  bool pointSizeAdaptationIsEnabled() const { return pointSizeAdaptation_; }
+  /*! Sets pointSizeAdaptationIsEnabled(). */
+  void setPointSizeAdaptationIsEnabled(bool enabled = true) {
+    pointSizeAdaptation_ = enabled;
+  }
+
+  /*! Returns the number of points drawn by the last draw(). */
+  qint64 nbDrawnPoints() const { return nbDrawnPoints_; }
+  /*! Returns the size, in bytes, of the vertex buffers of the loaded nodes. */
+  qint64 gpuMemoryUsage() const { return gpuMemoryUsage_; }
+  //@}
+
+  /*! @name Snapping */
+  //@{
+public:
+  /*! Returns the PointIndex that indexes the points of the loaded nodes, or
+  \c nullptr (default). */
+  PointIndex *pointIndex() const { return pointIndex_; }
+  void setPointIndex(PointIndex *index);
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted when the data of a node was read from disk, possibly from
+  a loader thread. The next draw() will use it: connect this signal to your
+  viewer's \c update() slot. */
+  void nodeLoaded();
+
+private:
+  Q_DISABLE_COPY(PointCloud)
+
+  enum State { ON_DISK, LOADING, IN_MEMORY, RESIDENT, FAILED };
+
+  struct Node {
+    QString name;
+    int level;
+    Vec min, max;
+    int nbPoints;
+    int children[8]; // -1 when absent
+    State state;
+    QByteArray data;       // IN_MEMORY points, waiting for the upload
+    QOpenGLBuffer *buffer; // RESIDENT points
+    unsigned int lastDrawnFrame;
+    bool indexed; // its points were added to the pointIndex_
+  };
+
+  // A node selected by the traversal, with its projected spacing
+  struct Selection {
+    int node;
+    qreal error;
+    bool operator<(const Selection &other) const {
+      return error < other.error;
+    }
+  };
+
+  qreal projectedSpacing(const Node &node, const Camera *camera) const;
+  static bool isCulled(const Node &node, const GLdouble planes[6][4]);
+  void selectNodes(const Camera *camera, QVector<Selection> &selected,
+                   QVector<Selection> &wanted) const;
+  void requestLoads(QVector<Selection> &wanted);
+  void loadNode(int index, const QString &fileName, int nbPoints);
+  void uploadNodes();
+  void releaseNodes();
+
+  QString directory_;
+  QVector<Node> nodes_;
+  Vec min_, max_;
+  qreal spacing_; // of the root node
+  qint64 nbPoints_;
+
+  qreal maximumScreenSpaceError_;
+  qint64 pointBudget_;
+  qint64 gpuMemoryBudget_;
+  qreal pointSize_;
+  bool pointSizeAdaptation_;
+
+  unsigned int frame_;
+  qint64 nbDrawnPoints_;
+  qint64 gpuMemoryUsage_;
+  PointIndex *pointIndex_;
+
+  // L o a d e r   t h r e a d s
+  QThreadPool *loaderThreadPool_;
+  int nbLoading_;
+  // Protected by loadedMutex_: nodes read by the loader threads
+  QMutex loadedMutex_;
+  QVector<int> loadedNodes_;
+  QVector<QByteArray> loadedData_;
+  QVector<int> inMemoryNodes_; // waiting for their upload, in load order
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_POINT_CLOUD_H
@@ -0,0 +1,506 @@
+#include "pointIndex.h"
+#include "camera.h"
+#include "taskScheduler.h"
+
+#include <QMutexLocker>
+#include <QPoint>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace qglviewer;
+
+// Maximum number of points of a leaf of the kd-trees
+static const int leafSize = 16;
+// Levels of a kd-tree split by the indexing thread, above the subtrees built in
+// parallel by the TaskScheduler::threadPool()
+static const int sequentialLevels = 6;
+// Smallest range of points reordered by a parallelFor() task
+static const int minimumReorderChunk = 16384;
+
+namespace {
+// A node of a kd-tree whose descendants are built in parallel
+struct Subtree {
+  int node;
+  int begin;
+  int end;
+  int level;
+};
+
+// Sets the bounding box of the points order[begin..end[: its min corner, and
+// then its max corner
+void computeBounds(const float *coordinates, const int *order, int begin,
+                   int end, float *box) {
+  for (int j = 0; j < 3; ++j) {
+    box[j] = std::numeric_limits<float>::max();
+    box[3 + j] = -std::numeric_limits<float>::max();
+  }
+  for (int i = begin; i < end; ++i) {
+    const float *p = coordinates + 3 * order[i];
+    for (int j = 0; j < 3; ++j) {
+      box[j] = std::min(box[j], p[j]);
+      box[3 + j] = std::max(box[3 + j], p[j]);
+    }
+  }
+}
+
+// Builds the node of the points order[begin..end[ and its descendants, which
+// are stored in heap order in bounds. The nodes of stopLevel are appended to
+// subtrees instead.
+void buildNodes(const float *coordinates, int *order, float *bounds, int node,
+                int begin, int end, int level, int depth, int stopLevel,
+                QVector<Subtree> *subtrees) {
+  if (level == stopLevel) {
+    const Subtree subtree = {node, begin, end, level};
+    subtrees->append(subtree);
+    return;
+  }
+
+  float *box = bounds + 6 * node;
+  computeBounds(coordinates, order, begin, end, box);
+  if (level == depth)
+    return;
+
+  // Median split along the largest extent
+  int axis = 0;
+  for (int j = 1; j < 3; ++j)
+    if (box[3 + j] - box[j] > box[3 + axis] - box[axis])
+      axis = j;
+  const int middle = (begin + end) / 2;
+  std::nth_element(order + begin, order + middle, order + end,
+                   [coordinates, axis](int a, int b) {
+                     return coordinates[3 * a + axis] <
+                            coordinates[3 * b + axis];
+                   });
+
+  buildNodes(coordinates, order, bounds, 2 * node + 1, begin, middle,
+             level + 1, depth, stopLevel, subtrees);
+  buildNodes(coordinates, order, bounds, 2 * node + 2, middle, end, level + 1,
+             depth, stopLevel, subtrees);
+}
+
+inline Vec vecOf(const float *p) { return Vec(p[0], p[1], p[2]); }
+} // namespace
+
+// A kd-tree, whose nodes split their points at the median: their ranges are
+// implicit, and their bounding boxes are stored in heap order
+struct PointIndex::Tree {
+  QVector<float> coordinates; // of the points, in the order of the leaves
+  QVector<int> ids;
+  QVector<float> bounds; // min and max corners of the nodes
+  int depth;             // of the leaves
+};
+
+// The state of a query: its shape and the best points found so far
+struct PointIndex::Query {
+  enum Type { POINT, RAY, CONE };
+  Type type;
+  Vec origin;
+  Vec direction; // normalized
+  int k;
+  qreal maximum;
+  QVector<Neighbor> neighbors; // at most k, sorted by increasing distance
+
+  qreal angle(const Vec &v) const {
+    const qreal along = v * direction;
+    return std::atan2((v - along * direction).norm(), along);
+  }
+
+  qreal distance(const float *p) const {
+    const Vec v = vecOf(p) - origin;
+    switch (type) {
+    case POINT:
+      return v.norm();
+    case RAY: {
+      const qreal along = v * direction;
+      return (along > 0.0) ? (v - along * direction).norm() : v.norm();
+    }
+    case CONE:
+      return angle(v);
+    }
+    return 0.0;
+  }
+
+  // A lower bound of the distance of the points of a bounding box
+  qreal bound(const float *box) const {
+    if (type == POINT) {
+      qreal squaredDistance = 0.0;
+      for (int j = 0; j < 3; ++j) {
+        const qreal d = std::max(
+            {qreal(box[j]) - origin[j], qreal(0.0), origin[j] - box[3 + j]});
+        squaredDistance += d * d;
+      }
+      return std::sqrt(squaredDistance);
+    }
+
+    // The distance and the angle vary at most like the distance to the center
+    // of the box, within its bounding sphere
+    const Vec center = (vecOf(box) + vecOf(box + 3)) / 2.0;
+    const qreal radius = (vecOf(box + 3) - vecOf(box)).norm() / 2.0;
+    if (type == RAY) {
+      const float c[3] = {float(center.x), float(center.y), float(center.z)};
+      return std::max(distance(c) - radius, qreal(0.0));
+    }
+    const Vec v = center - origin;
+    const qreal length = v.norm();
+    if (length <= radius)
+      return 0.0;
+    return std::max(angle(v) - std::asin(radius / length), qreal(0.0));
+  }
+
+  bool prunes(qreal distance) const {
+    return (distance > maximum) ||
+           ((neighbors.size() == k) && (distance >= neighbors.last().distance));
+  }
+
+  void offer(int id, const float *p) {
+    const qreal d = distance(p);
+    if (prunes(d))
+      return;
+    int i = neighbors.size();
+    if (i == k)
+      neighbors.removeLast();
+    i = neighbors.size();
+    while ((i > 0) && (neighbors[i - 1].distance > d))
+      --i;
+    const Neighbor neighbor = {id, vecOf(p), d};
+    neighbors.insert(i, neighbor);
+  }
+
+  void scan(const QVector<float> &coordinates, int firstId) {
+    const float *p = coordinates.constData();
+    for (int i = 0; i < coordinates.size() / 3; ++i)
+      offer(firstId + i, p + 3 * i);
+  }
+};
+
+/*! Constructs an empty PointIndex. */
+PointIndex::PointIndex(QObject *parent)
+    : QObject(parent), pendingFirstId_(0), indexingFirstId_(0), nbPoints_(0),
+      indexing_(false), threadPool_(nullptr) {}
+
+/*! Waits for the indexing thread. */
+PointIndex::~PointIndex() {
+  revision_.ref();
+  if (threadPool_)
+    threadPool_->waitForDone();
+  delete threadPool_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Points                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p nbPoints points, whose ids follow the ones of the points already
+added. \p coordinates points to the \c x, \c y and \c z coordinates of the
+first point, and the next ones are \p stride bytes apart: the points of
+interleaved vertex data are added without a copy by the caller.
+
+The points are scanned by the queries until the indexing thread indexes them.
+*/
+void PointIndex::addPoints(const float *coordinates, int nbPoints, int stride) {
+  if (nbPoints <= 0)
+    return;
+  QMutexLocker locker(&mutex_);
+  const int size = pendingCoordinates_.size();
+  pendingCoordinates_.resize(size + 3 * nbPoints);
+  float *destination = pendingCoordinates_.data() + size;
+  const char *source = reinterpret_cast<const char *>(coordinates);
+  for (int i = 0; i < nbPoints; ++i, source += stride)
+    std::copy_n(reinterpret_cast<const float *>(source), 3,
+                destination + 3 * i);
+  nbPoints_ += nbPoints;
+  startIndexing();
+}
+
+/*! Adds \p points, whose ids follow the ones of the points already added. */
+void PointIndex::addPoints(const QVector<Vec> &points) {
+  QVector<float> coordinates(3 * points.size());
+  for (int i = 0; i < points.size(); ++i)
+    for (int j = 0; j < 3; ++j)
+      coordinates[3 * i + j] = float(points[i][j]);
+  addPoints(coordinates.constData(), points.size());
+}
+
+/*! Removes all the points. The ids of the next added points start from 0. */
+void PointIndex::clear() {
+  QMutexLocker locker(&mutex_);
+  revision_.ref();
+  trees_.clear();
+  pendingCoordinates_.clear();
+  indexingCoordinates_.clear();
+  pendingFirstId_ = 0;
+  nbPoints_ = 0;
+  indexing_ = false;
+}
+
+/*! Returns the number of points added by addPoints(). */
+int PointIndex::nbPoints() const {
+  QMutexLocker locker(&mutex_);
+  return nbPoints_;
+}
+
+/*! Returns the number of points indexed by the kd-trees. The other nbPoints()
+are scanned by the queries. */
+int PointIndex::nbIndexedPoints() const {
+  QMutexLocker locker(&mutex_);
+  int nb = 0;
+  for (const TreePointer &tree : trees_)
+    nb += tree->ids.size();
+  return nb;
+}
+
+/*! Returns \c true while the indexing thread indexes added points. */
+bool PointIndex::isIndexing() const {
+  QMutexLocker locker(&mutex_);
+  return indexing_;
+}
+
+/*! Blocks until all the added points are indexed. */
+void PointIndex::waitForIndexing() {
+  if (threadPool_)
+    threadPool_->waitForDone();
+}
+
+// Starts the indexing of the pending points, merged with the trees that are not
+// larger than them, so that the sizes of the trees grow geometrically. Called
+// with mutex_ locked.
+void PointIndex::startIndexing() {
+  if (indexing_ || pendingCoordinates_.isEmpty())
+    return;
+
+  if (!threadPool_) {
+    threadPool_ = new QThreadPool();
+    threadPool_->setMaxThreadCount(1);
+  }
+
+  indexing_ = true;
+  std::swap(indexingCoordinates_, pendingCoordinates_);
+  pendingCoordinates_.clear();
+  indexingFirstId_ = pendingFirstId_;
+  pendingFirstId_ = nbPoints_;
+
+  QVector<TreePointer> merged = trees_;
+  std::sort(merged.begin(), merged.end(),
+            [](const TreePointer &a, const TreePointer &b) {
+              return a->ids.size() < b->ids.size();
+            });
+  int size = indexingCoordinates_.size() / 3;
+  int nbMerged = 0;
+  while ((nbMerged < merged.size()) && (merged[nbMerged]->ids.size() <= size))
+    size += merged[nbMerged++]->ids.size();
+  merged.resize(nbMerged);
+
+  const QVector<float> pending = indexingCoordinates_;
+  const int firstId = indexingFirstId_;
+  const int revision = revision_.loadRelaxed();
+  threadPool_->start(QRunnable::create([this, pending, firstId, merged, size,
+                                        revision]() {
+    QVector<float> coordinates = pending;
+    QVector<int> ids(pending.size() / 3);
+    for (int i = 0; i < ids.size(); ++i)
+      ids[i] = firstId + i;
+    for (const TreePointer &tree : merged) {
+      coordinates += tree->coordinates;
+      ids += tree->ids;
+    }
+
+    QSharedPointer<Tree> tree(new Tree);
+    tree->depth = 0;
+    while ((size >> tree->depth) > leafSize)
+      ++tree->depth;
+    tree->bounds.resize(6 * ((2 << tree->depth) - 1));
+
+    QVector<int> order(size);
+    for (int i = 0; i < size; ++i)
+      order[i] = i;
+    QVector<Subtree> subtrees;
+    const float *c = coordinates.constData();
+    float *bounds = tree->bounds.data();
+    buildNodes(c, order.data(), bounds, 0, 0, size, 0, tree->depth,
+               std::min(sequentialLevels, tree->depth), &subtrees);
+    TaskScheduler::parallelFor(subtrees.size(), [&](int first, int last) {
+      for (int i = first; i < last; ++i) {
+        const Subtree &s = subtrees[i];
+        buildNodes(c, order.data(), bounds, s.node, s.begin, s.end, s.level,
+                   tree->depth, -1, nullptr);
+      }
+    });
+
+    tree->coordinates.resize(3 * size);
+    tree->ids.resize(size);
+    TaskScheduler::parallelFor(
+        size,
+        [&](int first, int last) {
+          for (int i = first; i < last; ++i) {
+            std::copy_n(c + 3 * order[i], 3, tree->coordinates.data() + 3 * i);
+            tree->ids[i] = ids[order[i]];
+          }
+        },
+        minimumReorderChunk);
+
+    {
+      QMutexLocker locker(&mutex_);
+      if (revision_.loadRelaxed() != revision)
+        return;
+      for (const TreePointer &m : merged)
+        trees_.removeOne(m);
+      trees_.append(tree);
+      indexingCoordinates_.clear();
+      indexing_ = false;
+      startIndexing();
+    }
+    Q_EMIT pointsIndexed();
+  }));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Queries                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// Searches the trees, and scans the points that are not indexed yet
+void PointIndex::search(Query &query) const {
+  QVector<TreePointer> trees;
+  {
+    QMutexLocker locker(&mutex_);
+    trees = trees_;
+    query.scan(indexingCoordinates_, indexingFirstId_);
+    query.scan(pendingCoordinates_, pendingFirstId_);
+  }
+
+  for (const TreePointer &tree : trees)
+    if (!query.prunes(query.bound(tree->bounds.constData())))
+      searchNode(*tree, 0, 0, tree->ids.size(), 0, query);
+}
+
+// Searches the points of node, nearest child first
+void PointIndex::searchNode(const Tree &tree, int node, int begin, int end,
+                            int level, Query &query) {
+  if (level == tree.depth) {
+    const float *coordinates = tree.coordinates.constData();
+    for (int i = begin; i < end; ++i)
+      query.offer(tree.ids[i], coordinates + 3 * i);
+    return;
+  }
+
+  const int middle = (begin + end) / 2;
+  int first = 2 * node + 1;
+  int second = first + 1;
+  qreal firstBound = query.bound(tree.bounds.constData() + 6 * first);
+  qreal secondBound = query.bound(tree.bounds.constData() + 6 * second);
+  const bool swapped = secondBound < firstBound;
+  if (swapped) {
+    std::swap(first, second);
+    std::swap(firstBound, secondBound);
+  }
+
+  if (!query.prunes(firstBound)) {
+    if (swapped)
+      searchNode(tree, first, middle, end, level + 1, query);
+    else
+      searchNode(tree, first, begin, middle, level + 1, query);
+  }
+  if (!query.prunes(secondBound)) {
+    if (swapped)
+      searchNode(tree, second, begin, middle, level + 1, query);
+    else
+      searchNode(tree, second, middle, end, level + 1, query);
+  }
+}
+
+/*! Returns the point nearest to \p point, at most \p maximumDistance away. Its
+\c id is -1 when there is none. */
+PointIndex::Neighbor PointIndex::nearest(const Vec &point,
+                                         qreal maximumDistance) const {
+  const QVector<Neighbor> neighbors = kNearest(point, 1, maximumDistance);
+  if (neighbors.isEmpty()) {
+    const Neighbor none = {-1, Vec(), 0.0};
+    return none;
+  }
+  return neighbors.first();
+}
+
+/*! Returns the \p k points nearest to \p point, at most \p maximumDistance
+away, sorted by increasing distance. Fewer points are returned when there are
+not enough of them. */
+QVector<PointIndex::Neighbor>
+PointIndex::kNearest(const Vec &point, int k, qreal maximumDistance) const {
+  if (k <= 0)
+    return QVector<Neighbor>();
+  Query query;
+  query.type = Query::POINT;
+  query.origin = point;
+  query.k = k;
+  query.maximum = maximumDistance;
+  search(query);
+  return query.neighbors;
+}
+
+/*! Returns the point nearest to the ray that starts at \p origin along \p
+direction, at most \p maximumDistance away from it. Its \c distance is its
+distance to the ray, and its \c id is -1 when there is none.
+
+This is the snapping query of an orthographic Camera, whose rays are parallel:
+\p maximumDistance is then a number of pixels times Camera::pixelGLRatio(). */
+PointIndex::Neighbor PointIndex::nearestToRay(const Vec &origin,
+                                              const Vec &direction,
+                                              qreal maximumDistance) const {
+  Query query;
+  query.type = Query::RAY;
+  query.origin = origin;
+  query.direction = direction.unit();
+  query.k = 1;
+  query.maximum = maximumDistance;
+  search(query);
+  if (query.neighbors.isEmpty()) {
+    const Neighbor none = {-1, Vec(), 0.0};
+    return none;
+  }
+  return query.neighbors.first();
+}
+
+/*! Returns the point that makes the smallest angle with the \p direction axis
+of the cone whose apex is \p apex, at most \p maximumAngle (in radians). Its \c
+distance is this angle, and its \c id is -1 when there is none.
+
+This is the snapping query of a perspective Camera: the cone of the pixels at
+most \c n pixels away from the cursor has an angle of about \c n times the
+Camera::fieldOfView() divided by the Camera::screenHeight(). */
+PointIndex::Neighbor PointIndex::nearestInCone(const Vec &apex,
+                                               const Vec &direction,
+                                               qreal maximumAngle) const {
+  Query query;
+  query.type = Query::CONE;
+  query.origin = apex;
+  query.direction = direction.unit();
+  query.k = 1;
+  query.maximum = maximumAngle;
+  search(query);
+  if (query.neighbors.isEmpty()) {
+    const Neighbor none = {-1, Vec(), 0.0};
+    return none;
+  }
+  return query.neighbors.first();
+}
+
+/*! Returns the point nearest to the ray of \p pixel, given by
+Camera::convertClickToLine(), whose projection is at most \p radius pixels away
+from \p pixel. Its \c id is -1 when there is none.
+
+Uses nearestInCone() with a perspective \p camera, and nearestToRay() with an
+orthographic one. */
+PointIndex::Neighbor PointIndex::pointUnderPixel(const Camera *camera,
+                                                 const QPoint &pixel,
+                                                 int radius) const {
+  Vec origin, direction;
+  camera->convertClickToLine(pixel, origin, direction);
+  if (camera->type() == Camera::PERSPECTIVE)
+    return nearestInCone(origin, direction,
+                         radius * camera->fieldOfView() /
+                             camera->screenHeight());
+  return nearestToRay(origin, direction,
+                      radius * camera->pixelGLRatio(origin));
+}
@@ -0,0 +1,135 @@
+#ifndef QGLVIEWER_POINT_INDEX_H
+#define QGLVIEWER_POINT_INDEX_H
+
+#include "vec.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+class QPoint;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief A kd-tree of points, for nearest point and point snapping queries.
+  \class PointIndex pointIndex.h QGLViewer/pointIndex.h
+
+  A PointIndex answers, in logarithmic time, the queries of point picking and
+  measurement tools: the nearest() point or the kNearest() points of a
+  position, the point nearest to a ray (nearestToRay()) or inside a cone
+  (nearestInCone()), and the point under the cursor, which combines the two
+  with Camera::convertClickToLine():
+  \code
+  void Viewer::init() {
+    index_ = new qglviewer::PointIndex(this);
+    index_->addPoints(positions); // QVector<Vec>, indexed in the background
+  }
+
+  void Viewer::mouseMoveEvent(QMouseEvent *e) {
+    // The nearest point at most 6 pixels away from the cursor
+    const qglviewer::PointIndex::Neighbor snapped =
+        index_->pointUnderPixel(camera(), e->pos(), 6);
+    if (snapped.id >= 0)
+      measureTool_.setEnd(snapped.position);
+    QGLViewer::mouseMoveEvent(e);
+  }
+  \endcode
+
+  The points are identified by their \c id, their rank in the order of the
+  addPoints() calls. The index is updated incrementally: the added points are
+  indexed by a background thread, which builds a kd-tree with the
+  TaskScheduler::parallelFor() worker threads, and emits pointsIndexed() when
+  they are. Small trees are merged as points stream in, so that the index is
+  made of a logarithmic number of trees. The points that are not indexed yet
+  are scanned by the queries, which are always exact.
+
+  The PointCloud::setPointIndex() of a PointCloud adds the points of its nodes
+  as they are read from disk.
+
+  All the methods are thread safe. The queries can run concurrently with
+  addPoints() and with the background indexing. */
+class QGLVIEWER_EXPORT PointIndex : public QObject {
+  Q_OBJECT
+
+public:
+  /*! A point returned by the queries: its \c id (-1 when no point was found),
+  its \c position and its \c distance to the query, whose unit depends on the
+  query. */
+  struct Neighbor {
+    int id;
+    Vec position;
+    qreal distance;
+  };
+
+  explicit PointIndex(QObject *parent = nullptr);
+  virtual ~PointIndex();
+
+  /*! @name Points */
+  //@{
+public:
+  void addPoints(const float *coordinates, int nbPoints,
+                 int stride = 3 * sizeof(float));
+  void addPoints(const QVector<Vec> &points);
+  void clear();
+
+  int nbPoints() const;
+  int nbIndexedPoints() const;
+  bool isIndexing() const;
+  void waitForIndexing();
+  //@}
+
+  /*! @name Queries */
+  //@{
+public:
+  Neighbor nearest(const Vec &point, qreal maximumDistance = 1.0e30) const;
+  QVector<Neighbor> kNearest(const Vec &point, int k,
+                             qreal maximumDistance = 1.0e30) const;
+  Neighbor nearestToRay(const Vec &origin, const Vec &direction,
+                        qreal maximumDistance) const;
+  Neighbor nearestInCone(const Vec &apex, const Vec &direction,
+                         qreal maximumAngle) const;
+  Neighbor pointUnderPixel(const Camera *camera, const QPoint &pixel,
+                           int radius = 5) const;
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted, from the indexing thread, when points added by
+  addPoints() are indexed. The queries are exact anyway, this signal only
+  reports that they are faster. */
+  void pointsIndexed();
+
+private:
+  Q_DISABLE_COPY(PointIndex)
+
+  struct Tree;
+  struct Query;
+  typedef QSharedPointer<const Tree> TreePointer;
+
+  void startIndexing();
+  void search(Query &query) const;
+  static void searchNode(const Tree &tree, int node, int begin, int end,
+                         int level, Query &query);
+
+  // Protected by mutex_
+  mutable QMutex mutex_;
+  QVector<TreePointer> trees_;
+  QVector<float> pendingCoordinates_; // not indexed yet, from pendingFirstId_
+  int pendingFirstId_;
+  QVector<float> indexingCoordinates_; // being indexed, from indexingFirstId_
+  int indexingFirstId_;
+  int nbPoints_;
+  bool indexing_;
+
+  // I n d e x i n g   t h r e a d
+  QThreadPool *threadPool_;
+  // Incremented by clear(): the trees of a previous revision are discarded
+  QAtomicInt revision_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_POINT_INDEX_H
@@ -0,0 +1,90 @@
+#include "poseInput.h"
+#include "qglviewer.h"
+
+#include <QElapsedTimer>
+#include <QMetaObject>
+
+using namespace qglviewer;
+
+// Shared monotonic clock of the publication times, in nanoseconds
+static qint64 currentTime() {
+  static const QElapsedTimer clock = []() {
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+  }();
+  return clock.nsecsElapsed();
+}
+
+/*! Creates a PoseInput that applies the latched poses to \p frame. */
+PoseInput::PoseInput(Frame *frame)
+    : state_(1), writeIndex_(0), readIndex_(2), nbDroppedPoses_(0),
+      latchedPoseAge_(0.0), frame_(frame), usesConstraint_(true),
+      receiver_(nullptr), updateIsRequested_(0) {
+  for (int i = 0; i < 3; ++i)
+    buffer_[i].time = 0;
+}
+
+/*! Destructor. The PoseInput is removed from its QGLViewer (see
+QGLViewer::addPoseInput()). */
+PoseInput::~PoseInput() {
+  QGLViewer *const viewer = qobject_cast<QGLViewer *>(receiver_.loadAcquire());
+  if (viewer)
+    viewer->removePoseInput(this);
+}
+
+/*! Sets the frame() that receives the latched poses. */
+void PoseInput::setFrame(Frame *frame) { frame_ = frame; }
+
+/*! Publishes a new pose, that replaces the previous one if it was not latched
+yet. Lock free and wait free: the pose is written in a buffer that is only
+used by the publishing thread, which is then swapped with the published one.
+
+When the PoseInput was added to a QGLViewer, the first publish() after each
+latch() posts an update request to the viewer. */
+void PoseInput::publish(const Vec &position, const Quaternion &orientation) {
+  Pose &pose = buffer_[writeIndex_];
+  pose.position = position;
+  pose.orientation = orientation;
+  pose.time = currentTime();
+
+  const int previous =
+      state_.fetchAndStoreAcquireRelease(writeIndex_ | NEW_POSE);
+  writeIndex_ = previous & INDEX_MASK;
+  if (previous & NEW_POSE)
+    nbDroppedPoses_.fetchAndAddRelaxed(1);
+
+  QObject *const receiver = receiver_.loadAcquire();
+  if (receiver && updateIsRequested_.testAndSetAcquire(0, 1))
+    QMetaObject::invokeMethod(receiver, "update", Qt::QueuedConnection);
+}
+
+/*! Returns \c true when a pose was published since the last latch(). */
+bool PoseInput::hasNewPose() const {
+  return (state_.loadAcquire() & NEW_POSE) != 0;
+}
+
+/*! Retrieves the last published pose and applies it to the frame(). Returns \c
+false (and does nothing) when no pose was published since the previous
+latch(). Called by QGLViewer::paintGL() for the PoseInputs of the viewer. */
+bool PoseInput::latch() {
+  // A publish() from now on requests a new update
+  updateIsRequested_.storeRelease(0);
+  if (!hasNewPose())
+    return false;
+
+  const int previous = state_.fetchAndStoreAcquireRelease(readIndex_);
+  readIndex_ = previous & INDEX_MASK;
+
+  const Pose &pose = buffer_[readIndex_];
+  latchedPoseAge_ = (currentTime() - pose.time) / 1.0e6;
+  if (frame_) {
+    Vec position = pose.position;
+    Quaternion orientation = pose.orientation;
+    if (usesConstraint())
+      frame_->setPositionAndOrientationWithConstraint(position, orientation);
+    else
+      frame_->setPositionAndOrientation(position, orientation);
+  }
+  return true;
+}
@@ -0,0 +1,125 @@
+#ifndef QGLVIEWER_POSE_INPUT_H
+#define QGLVIEWER_POSE_INPUT_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QPointer>
+
+#include "frame.h"
+
+class QGLViewer;
+class QObject;
+
+namespace qglviewer {
+
+/*! \brief Feeds the position and orientation of a Frame from another thread,
+  without any lock or event per sample.
+  \class PoseInput poseInput.h QGLViewer/poseInput.h
+
+  A Frame is a QObject that can only be modified in the GUI thread. Tracking
+  devices sampled at hundreds of Hz in worker threads would otherwise post one
+  queued signal per sample, which costs an event each and delivers samples
+  late. A PoseInput is a triple buffer instead: the worker thread publish()es
+  each sample in a buffer of its own, and the GUI thread latch()es the most
+  recent one, which is applied to the frame(). The intermediate samples are
+  simply overwritten (see nbDroppedPoses()).
+
+  When the PoseInput is added to a QGLViewer with QGLViewer::addPoseInput(),
+  the viewer latches it at the beginning of each QGLViewer::paintGL(), before
+  draw(), so that the displayed pose is the latest sample. publish() also
+  requests an update of the viewer, with at most one pending event per frame:
+  \code
+  // In the GUI thread
+  input_ = new PoseInput(trackedFrame);
+  viewer->addPoseInput(input_);
+
+  // In the tracking thread, at 500 Hz
+  input_->publish(tracker.position(), tracker.orientation());
+  \endcode
+
+  The pose is given in world coordinates, as with Frame::setPosition() and
+  Frame::setOrientation(). When usesConstraint() is \c true (default), the
+  Frame::constraint() of the frame() filters it.
+
+  publish() may be called from any thread, but from a single thread at a time.
+  The other methods must be called from the GUI thread. The PoseInput must not
+  be deleted while a thread publishes into it. */
+class QGLVIEWER_EXPORT PoseInput {
+public:
+  explicit PoseInput(Frame *frame = nullptr);
+  ~PoseInput();
+
+  /*! @name Frame */
+  //@{
+public:
+  /*! Returns the Frame that receives the latched poses. Set using setFrame()
+  or with the constructor. A \c nullptr frame() is allowed: latch() then only
+  updates latchedPosition() and latchedOrientation(). */
+  Frame *frame() const { return frame_; }
+  void setFrame(Frame *frame);
+  /*! Returns \c true when the latched poses are applied with
+  Frame::setPositionAndOrientationWithConstraint(). Default value is \c
+  true. */
+  bool usesConstraint() const { return usesConstraint_; }
+  /*! Sets the usesConstraint() value. */
+  void setUsesConstraint(bool use) { usesConstraint_ = use; }
+  //@}
+
+  /*! @name Publication */
+  //@{
+public:
+  void publish(const Vec &position, const Quaternion &orientation);
+  bool hasNewPose() const;
+  /*! Returns the number of poses that were overwritten by a newer publish()
+  before being latched. Counted since the creation of the PoseInput. */
+  int nbDroppedPoses() const { return nbDroppedPoses_.loadRelaxed(); }
+  //@}
+
+  /*! @name Latching */
+  //@{
+public:
+  bool latch();
+  /*! Returns the position of the last latched pose. */
+  Vec latchedPosition() const { return buffer_[readIndex_].position; }
+  /*! Returns the orientation of the last latched pose. */
+  Quaternion latchedOrientation() const {
+    return buffer_[readIndex_].orientation;
+  }
+  /*! Returns the time (in milliseconds) elapsed between the publish() and the
+  latch() of the last latched pose. Combined with the known latency of the
+  device, this gives the age of the displayed pose. */
+  qreal latchedPoseAge() const { return latchedPoseAge_; }
+  //@}
+
+private:
+  Q_DISABLE_COPY(PoseInput)
+  friend class ::QGLViewer;
+
+  struct Pose {
+    Vec position;
+    Quaternion orientation;
+    qint64 time; // in nanoseconds, see publish()
+  };
+
+  // Index of the published buffer, and NEW_POSE when it was not latched yet
+  enum { INDEX_MASK = 3, NEW_POSE = 4 };
+
+  Pose buffer_[3];
+  QAtomicInt state_;
+  int writeIndex_; // only used by the publishing thread
+  int readIndex_;  // only used by the GUI thread
+  QAtomicInt nbDroppedPoses_;
+  qreal latchedPoseAge_;
+
+  QPointer<Frame> frame_;
+  bool usesConstraint_;
+
+  // Updated by the first publish() after each latch(), see
+  // QGLViewer::addPoseInput()
+  QAtomicPointer<QObject> receiver_;
+  QAtomicInt updateIsRequested_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_POSE_INPUT_H
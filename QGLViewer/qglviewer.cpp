@@ -1,29 +1,71 @@
 #include "qglviewer.h"
+#include "bufferUploader.h"
 #include "camera.h"
+#include "clippingRegion.h"
+#include "coreProfileRenderer.h"
+#include "depthCache.h"
+#include "displayWall.h"
 #include "domUtils.h"
+#include "frameCapture.h"
+#include "frameGraph.h"
+#include "frameProfiler.h"
+#include "frameRingBuffer.h"
+#include "glStateCache.h"
+#include "glyphRenderer.h"
+#include "hotPathCounters.h"
 #include "keyFrameInterpolator.h"
+#include "lineRenderer.h"
+#include "lodMesh.h"
 #include "manipulatedCameraFrame.h"
+#include "modificationBatch.h"
+#include "objectIdBuffer.h"
+#include "occlusionCuller.h"
+#include "overlayLayer.h"
+#include "poseInput.h"
+#include "rayPicker.h"
+#include "renderTarget.h"
+#include "renderThread.h"
+#include "sceneBounds.h"
+#include "sceneResources.h"
+#include "simulationThread.h"
+#include "taskScheduler.h"
+#include "temporalReprojector.h"
+#include "textRenderer.h"
+#include "traceRecorder.h"
 
 #include <QApplication>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
 #include <QGLContext>
 #endif
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QImage>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QOpenGLFramebufferObject>
 #include <QPainter>
 #include <QPushButton>
+#include <QRunnable>
 #include <QScreen>
 #include <QTabWidget>
 #include <QTextEdit>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QTimer>
 #include <QUrl>
+#include <QWindow>
+#include <QXmlStreamReader>
 #include <QtAlgorithms>
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 # define MidButton MiddleButton
 #endif
@@ -31,6 +73,47 @@
 using namespace std;
 using namespace qglviewer;
 
+// Size, in pixels, of the cells of the mouse grabber index
+static const int mouseGrabberCellSize = 32;
+
+// Makes a GLStateCache current() until the end of the scope
+class CurrentGLStateCache {
+public:
+  explicit CurrentGLStateCache(GLStateCache *cache)
+      : previous_(GLStateCache::setCurrent(cache)) {}
+  ~CurrentGLStateCache() { GLStateCache::setCurrent(previous_); }
+
+private:
+  GLStateCache *const previous_;
+};
+
+// Makes a LineRenderer current() until the end of the scope
+class CurrentLineRenderer {
+public:
+  explicit CurrentLineRenderer(LineRenderer *renderer)
+      : previous_(LineRenderer::setCurrent(renderer)) {}
+  ~CurrentLineRenderer() { LineRenderer::setCurrent(previous_); }
+
+private:
+  LineRenderer *const previous_;
+};
+
+// Hands out a frame of a FrameRingBuffer until the end of the scope
+class CurrentRingBufferFrame {
+public:
+  explicit CurrentRingBufferFrame(FrameRingBuffer *ring) : ring_(ring) {
+    if (ring_)
+      ring_->beginFrame();
+  }
+  ~CurrentRingBufferFrame() {
+    if (ring_)
+      ring_->endFrame();
+  }
+
+private:
+  FrameRingBuffer *const ring_;
+};
+
 // Static private variable
 QList<QGLViewer *> QGLViewer::QGLViewerPool_;
 
@@ -61,6 +144,8 @@ void QGLViewer::defaultConstructor() {
   // qWarning("Unable to get OpenGL version, context may not be available -
   // Check your configuration");
 
+  startupTimer_.start();
+
   int poolIndex = QGLViewer::QGLViewerPool_.indexOf(nullptr);
   setFocusPolicy(Qt::StrongFocus);
 
@@ -69,22 +154,81 @@ void QGLViewer::defaultConstructor() {
   else
     QGLViewer::QGLViewerPool_.append(this);
 
+  // Requires the animationClock_
+  animationClock_ = new AnimationClock(this);
+  connect(animationClock_, SIGNAL(tick(int)), SLOT(advanceAnimation(int)));
+  // Attached to the camera by setCamera()
+  depthCache_ = new DepthCache();
+  depthCacheIsEnabled_ = false;
+  depthFitFramePending_ = false;
+  depthFitSceneIsModified_ = false;
+  renderThread_ = nullptr;
+  renderThreadFrameIsReady_ = false;
+  renderThreadSceneIsValid_ = false;
+  bufferUploader_ = nullptr;
+  bufferUploaderIsSupported_ = true;
+  frameRingBuffer_ = nullptr;
+  frameRingBufferIsSupported_ = true;
+  frameGraph_ = nullptr;
+  frameCapture_ = new FrameCapture();
   camera_ = new Camera();
   setCamera(camera());
+  recordStartupTime("camera");
 
   setDefaultShortcuts();
+  recordStartupTime("shortcuts");
   setDefaultMouseBindings();
+  recordStartupTime("mouseBindings");
 
+  // Snapshot formats are listed by the first snapshot
   setSnapshotFileName(tr("snapshot", "Default snapshot file name"));
-  initializeSnapshotFormats();
   setSnapshotCounter(0);
   setSnapshotQuality(95);
+  setSnapshotUsesFramebufferObject(false);
+  snapshotTileRenderer_ = nullptr;
+  snapshotIsAsynchronous_ = false;
+  maximumSnapshotQueueSize_ = 8;
+  snapshotThreadPool_ = nullptr;
+  snapshotQueueSlots_ = nullptr;
+  snapshotBuffer_[0] = snapshotBuffer_[1] = nullptr;
+  snapshotBufferIndex_ = 0;
+  snapshotFBO_ = nullptr;
+  snapshotBufferIsVideoFrame_[0] = snapshotBufferIsVideoFrame_[1] = false;
+  snapshotVideoFrameRate_ = 25;
+  snapshotVideoCodec_ = "libx264";
+  snapshotVideoEncoder_ = "ffmpeg";
+  videoEncoder_ = nullptr;
+
+  frameSink_ = nullptr;
+  frameSinkBuffer_[0] = frameSinkBuffer_[1] = nullptr;
+  frameSinkBufferIndex_ = 0;
+  frameSinkFBO_ = nullptr;
+  for (int i = 0; i < 2; ++i) {
+    memoryBudget_[i] = 0;
+    memoryBudgetExceeded_[i] = false;
+  }
+  frameSinkHashedTileSize_ = 0;
 
   fpsTime_.start();
   fpsCounter_ = 0;
   f_p_s_ = 0.0;
   fpsString_ = tr("%1Hz", "Frames per seconds, in Hertz").arg("?");
+  frameTimingGraphIsDisplayed_ = false;
+  hotPathCountersAreDisplayed_ = false;
+  frameProfiler_ = new FrameProfiler(this);
+  connect(this, SIGNAL(frameSwapped()), frameProfiler_, SLOT(frameSwapped()));
   visualHint_ = 0;
+  visualHintsUseCoreProfile_ = false;
+  shaderWarmUpIsEnabled_ = true;
+  coreProfileRenderer_ = nullptr;
+  glyphRenderer_ = nullptr;
+  glyphRendererIsSupported_ = true;
+  lineRenderer_ = nullptr;
+  lineRendererIsSupported_ = true;
+  textIsBatched_ = false;
+  textRenderer_ = nullptr;
+  glStateCache_ = new GLStateCache();
+  glStateIsTracked_ = false;
   previousPathId_ = 0;
   // prevPos_ is not initialized since pos() is not meaningful here.
   // It will be set when setFullScreen(false) is called after
@@ -93,8 +237,67 @@ void QGLViewer::defaultConstructor() {
   // #CONNECTION# default values in initFromDOMElement()
   manipulatedFrame_ = nullptr;
   manipulatedFrameIsACamera_ = false;
+  sceneResources_ = nullptr;
+  occlusionCuller_ = nullptr;
+  clippingRegion_ = nullptr;
+  sceneBounds_ = nullptr;
+  ownCamera_ = nullptr;
+  currentViewport_ = -1;
+  paintedViewport_ = -1;
+  viewportEventIsLocal_ = false;
   mouseGrabberIsAManipulatedFrame_ = false;
   mouseGrabberIsAManipulatedCameraFrame_ = false;
+  mouseGrabberGroup_ = MouseGrabber::defaultMouseGrabberGroup();
+  mouseGrabberIndexIsEnabled_ = false;
+  mouseGrabberIndexIsValid_ = false;
+  mouseGrabberIndexRevision_ = 0;
+  mouseGrabberIndexColumns_ = 0;
+  mouseGrabberIndexRows_ = 0;
+  previousMouseGrabberCell_ = -1;
+  frameTimeBudget_ = 0.0;
+  levelOfDetail_ = 0;
+  levelOfDetailTimes_.fill(-1.0, 2);
+  levelOfDetailRefining_ = false;
+  levelOfDetailTimer_.setSingleShot(true);
+  connect(&levelOfDetailTimer_, SIGNAL(timeout()),
+          SLOT(refineLevelOfDetail()));
+  numberOfRefinementPasses_ = 0;
+  refinementPass_ = 0;
+  refinementFrame_ = false;
+  refinementTimer_.setSingleShot(true);
+  connect(&refinementTimer_, SIGNAL(timeout()),
+          SLOT(drawNextRefinementPass()));
+  dynamicResolutionIsEnabled_ = false;
+  dynamicResolutionFrameTime_ = 16.0;
+  minimumResolutionScale_ = 0.5;
+  resolutionScale_ = 1.0;
+  dynamicResolutionTimer_.setSingleShot(true);
+  connect(&dynamicResolutionTimer_, SIGNAL(timeout()), SLOT(update()));
+  reprojectionIsEnabled_ = false;
+  reprojectionRefreshInterval_ = 8;
+  temporalReprojector_ = nullptr;
+  reprojectionIsSupported_ = true;
+  reprojectionTimer_.setSingleShot(true);
+  connect(&reprojectionTimer_, SIGNAL(timeout()), SLOT(update()));
+  interactionQualityIsEnabled_ = false;
+  qualityIsReduced_ = false;
+  sceneSamples_ = 0;
+  interactionSceneSamples_ = 0;
+  interactionQualityTimer_.setSingleShot(true);
+  connect(&interactionQualityTimer_, SIGNAL(timeout()),
+          SLOT(restoreInteractionQuality()));
+  retainedModeIsEnabled_ = false;
+  retainedSceneIsValid_ = false;
+  framePacingIsEnabled_ = false;
+  framePending_ = false;
+  redrawDeferred_ = false;
+  latencyStart_ = -1;
+  inputLatency_ = -1.0;
+  hasPendingMouseMove_ = false;
+  pendingMouseMoveTime_ = 0;
+  framePresentedTimer_.setSingleShot(true);
+  connect(&framePresentedTimer_, SIGNAL(timeout()), SLOT(framePresented()));
+  connect(this, SIGNAL(frameSwapped()), SLOT(framePresented()));
   displayMessage_ = false;
   connect(&messageTimer_, SIGNAL(timeout()), SLOT(hideMessage()));
   messageTimer_.setSingleShot(true);
@@ -104,6 +307,10 @@ void QGLViewer::defaultConstructor() {
   setSceneRadius(1.0);
   showEntireScene();
   setStateFileName(".qglviewer.xml");
+  stateFileIsBinary_ = false;
+  stateRestorationIsDeferred_ = false;
+  deferredStateRequest_ = 0;
+  stateThreadPool_ = nullptr;
 
   // #CONNECTION# default values in initFromDOMElement()
   setAxisIsDrawn(false);
@@ -112,11 +319,21 @@ void QGLViewer::defaultConstructor() {
   setCameraIsEdited(false);
   setTextIsEnabled(true);
   setStereoDisplay(false);
+  stereoIsSinglePass_ = false;
   // Make sure move() is not called, which would call initializeGL()
   fullScreen_ = false;
   setFullScreen(false);
 
   animationTimerId_ = 0;
+  animationTime_ = 0;
+  simulationThread_ = nullptr;
+  powerSavingIsEnabled_ = false;
+  suspended_ = false;
+  idle_ = false;
+  idleDelay_ = 2000;
+  idleAnimationPeriod_ = 500;
+  frameModifications_ = qglviewer::Frame::nbModifications();
+  connect(&powerTimer_, SIGNAL(timeout()), SLOT(updatePowerState()));
   stopAnimation();
   setAnimationPeriod(40); // 25Hz
 
@@ -125,6 +342,24 @@ void QGLViewer::defaultConstructor() {
   setSelectRegionWidth(3);
   setSelectRegionHeight(3);
   setSelectedName(-1);
+  setSelectionMode(BUFFER_SELECTION);
+  setSelectBufferGrowthIsEnabled(true);
+  selectionNameOperations_ = 0;
+  selectionNameDepth_ = selectionMaxNameDepth_ = 0;
+  selectionFBO_ = nullptr;
+  rayPicker_ = nullptr;
+  lodMeshesAreSimplified_ = false;
+  objectIdBufferIsEnabled_ = false;
+  objectIdBufferIsSupported_ = true;
+  objectIdBuffer_ = nullptr;
+  objectIdCursor_ = QPoint(-1, -1);
+  objectIdUnderCursor_ = -1;
+  connect(&objectIdTimer_, SIGNAL(timeout()),
+          SLOT(retrieveObjectIdUnderCursor()));
+  refinementFBO_ = nullptr;
+  scaledFBO_ = nullptr;
+  multisampleFBO_ = nullptr;
+  retainedFBO_ = nullptr;
 
   bufferTextureId_ = 0;
   bufferTextureMaxU_ = 0.0;
@@ -133,11 +368,19 @@ void QGLViewer::defaultConstructor() {
   bufferTextureHeight_ = 0;
   previousBufferTextureFormat_ = 0;
   previousBufferTextureInternalFormat_ = 0;
+  renderTarget_ = new RenderTarget();
   currentlyPressedKey_ = Qt::Key(0);
 
   setAttribute(Qt::WA_NoSystemBackground);
 
   tileRegion_ = nullptr;
+  recordStartupTime("constructor");
+}
+
+// Records the time elapsed since the previous stage in startupTimes().
+void QGLViewer::recordStartupTime(const QString &stage) {
+  startupTimes_[stage] = startupTimer_.nsecsElapsed() / 1.0e6;
+  startupTimer_.restart();
 }
 
 /*! Constructor. See \c QGLWidget documentation for details.
@@ -216,7 +459,83 @@ QGLViewer::~QGLViewer() {
   QGLViewer::QGLViewerPool_.replace(QGLViewer::QGLViewerPool_.indexOf(this),
                                     nullptr);
 
+  // A pending deferred state restoration is discarded
+  if (stateThreadPool_) {
+    stateThreadPool_->waitForDone();
+    delete stateThreadPool_;
+  }
+
+  // Its context shares the objects of this one
+  setRenderThread(nullptr);
+  // May release the shared resources, with this context current
+  setSceneResources(nullptr);
+  // The viewports' cameras are not deleted
+  clearViewports();
+  // The pose inputs no longer request updates
+  while (!poseInputs_.isEmpty())
+    removePoseInput(poseInputs_.last());
+  delete glStateCache_;
+
+  // Pending asynchronous snapshots are written before the viewer is deleted
+  makeCurrent();
+  closeSnapshotVideo();
+  setSnapshotAsynchronous(false);
+  // The vertex buffers of the simplified meshes belong to this context
+  while (!lodMeshes_.isEmpty()) {
+    lodMeshes_.last()->cleanupGL();
+    removeLodMesh(lodMeshes_.last());
+  }
+  // Also used by the video frames of synchronous snapshots
+  delete snapshotBuffer_[0];
+  delete snapshotBuffer_[1];
+  delete snapshotFBO_;
+  delete selectionFBO_;
+  delete refinementFBO_;
+  delete scaledFBO_;
+  delete multisampleFBO_;
+  delete retainedFBO_;
+  delete frameSinkBuffer_[0];
+  delete frameSinkBuffer_[1];
+  delete frameSinkFBO_;
+  delete coreProfileRenderer_;
+  delete glyphRenderer_;
+  if (lineRenderer_)
+    lineRenderer_->cleanupGL();
+  delete lineRenderer_;
+  delete textRenderer_;
+  if (temporalReprojector_)
+    temporalReprojector_->cleanupGL();
+  delete temporalReprojector_;
+  if (objectIdBuffer_)
+    objectIdBuffer_->cleanupGL();
+  delete objectIdBuffer_;
+  if (bufferUploader_) {
+    bufferUploader_->stop();
+    bufferUploader_->cleanupGL();
+  }
+  if (frameRingBuffer_)
+    frameRingBuffer_->cleanupGL();
+  delete frameRingBuffer_;
+  if (frameGraph_)
+    frameGraph_->cleanupGL();
+  delete frameGraph_;
+  frameCapture_->cleanupGL();
+  delete frameCapture_;
+  frameProfiler_->cleanupGL();
+  if (occlusionCuller_)
+    occlusionCuller_->cleanupGL();
+  renderTarget_->cleanupGL();
+  depthCache_->cleanupGL();
+  for (OverlayLayer *layer : overlayLayers_) {
+    layer->cleanupGL();
+    delete layer;
+  }
+  doneCurrent();
+  delete renderTarget_;
+
+  camera()->setDepthCache(nullptr);
   delete camera();
+  delete depthCache_;
   delete[] selectBuffer_;
   if (helpWidget()) {
     // Needed for Qt 4 which has no main widget.
@@ -259,12 +578,35 @@ glEnable(GL_COLOR_MATERIAL);
 
 If you port an existing application to QGLViewer and your display changes, you
 probably want to disable these flags in init() to get back to a standard OpenGL
-state. */
+state.
+
+When visualHintsUseCoreProfile(), the shader program and the vertex buffers
+used by postDraw() are also created here. Only \c GL_DEPTH_TEST is enabled with
+a \c QSurfaceFormat::CoreProfile context. */
 void QGLViewer::initializeGL() {
-  glEnable(GL_LIGHT0);
-  glEnable(GL_LIGHTING);
+  startupTimer_.restart();
+  const bool coreProfile = format().profile() == QSurfaceFormat::CoreProfile;
+  if (coreProfile)
+    visualHintsUseCoreProfile_ = true;
+
+  if (visualHintsUseCoreProfile() && !coreProfileRenderer_) {
+    coreProfileRenderer_ = new CoreProfileRenderer();
+    if (!coreProfileRenderer_->initialize()) {
+      qWarning("QGLViewer::initializeGL: Unable to initialize core profile "
+               "visual hints, using the fixed function pipeline");
+      delete coreProfileRenderer_;
+      coreProfileRenderer_ = nullptr;
+      visualHintsUseCoreProfile_ = false;
+    } else
+      coreProfileRenderer_->setFrameRingBuffer(frameRingBuffer());
+  }
+
+  if (!coreProfile) {
+    glEnable(GL_LIGHT0);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_COLOR_MATERIAL);
+  }
   glEnable(GL_DEPTH_TEST);
-  glEnable(GL_COLOR_MATERIAL);
 
   // Default colors
   setForegroundColor(QColor(180, 180, 180));
@@ -279,12 +621,29 @@ void QGLViewer::initializeGL() {
   } else
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  // Shared resources are created with the first initialized viewer
+  if (sceneResources_)
+    sceneResources_->viewerInitialized(this);
+  recordStartupTime("initializeGL");
+
   // Calls user defined method. Default emits a signal.
   init();
+  recordStartupTime("init");
+  if (shaderWarmUpIsEnabled())
+    warmUpShaders();
+  recordStartupTime("shaderWarmUp");
 
   // Give time to glInit to finish and then call setFullScreen().
   if (isFullScreen())
     QTimer::singleShot(100, this, SLOT(delayedFullScreen()));
+
+  // Once the window is displayed, and only by the first viewer
+  static bool benchmarkIsRequested =
+      QCoreApplication::arguments().contains("--benchmark");
+  if (benchmarkIsRequested) {
+    benchmarkIsRequested = false;
+    QTimer::singleShot(0, this, SLOT(runCommandLineBenchmark()));
+  }
 }
 
 /*! Main paint method, inherited from \c QOpenGLWidget.
@@ -293,59 +652,301 @@ Calls the following methods, in that order:
 \arg preDraw() (or preDrawStereo() if viewer displaysInStereo()) : places the
 camera in the world coordinate system. \arg draw() (or fastDraw() when the
 camera is manipulated) : main drawing method. Should be overloaded. \arg
-postDraw() : display of visual hints (world axis, FPS...) */
+postDraw() : display of visual hints (world axis, FPS...)
+
+When numberOfViewports() is positive, this sequence is repeated for each
+viewport instead (see addViewport()). When frameTimeBudget() is positive,
+drawLevelOfDetail() replaces draw() and fastDraw(). When
+numberOfRefinementPasses() is positive, the still frames are
+drawn in an offscreen buffer and completed by drawRefinementPass(). When
+retainedModeIsEnabled(), the scene drawn by a previous frame may be reused. When
+dynamicResolutionIsEnabled(), the scene of the frames drawn in motion may be
+drawn at a lower resolution. When interactionQualityIsEnabled(), the frames
+drawn in motion use the interaction quality. The complete frame is finally read
+back for the frameSink(), if any. The poseInputs() are latched first. The
+displayWall(), if any, synchronizes the frame with the other nodes of the wall.
+*/
 void QGLViewer::paintGL() {
-  if (displaysInStereo()) {
+  QGLVIEWER_TRACE_SCOPE("viewer", "paintGL");
+  frameProfiler_->beginFrame();
+  // The state may have been modified since the previous frame
+  glStateCache_->invalidate();
+  const CurrentGLStateCache stateCache(glStateIsTracked() ? glStateCache_
+                                                          : nullptr);
+  // Wide lines of drawGrid(), Camera::draw() and the KeyFrameInterpolator paths
+  const CurrentLineRenderer lines(lineRenderer());
+  // Allocations of the batched renderers, once one of them created the buffer
+  const CurrentRingBufferFrame ringFrame(frameRingBuffer_);
+  // Latest poses of the tracked frames, before anything uses them
+  latchPoseInputs();
+  // The master of a display wall sends the camera of this frame
+  if (displayWall_)
+    displayWall_->beginFrame();
+  updateQualityReduction();
+  checkMemoryBudgets();
+
+  // Previous frame's asynchronous depth read is now available
+  if (camera()->hasPendingPointUnderPixel())
+    camera()->retrievePointUnderPixel();
+  if (depthCacheIsEnabled())
+    depthCache_->retrieve();
+  // Clipping planes fitted to the retrieved depths, see
+  // Camera::fitClippingPlanesToDepth()
+  const bool depthFitFrame = depthFitFramePending_;
+  depthFitFramePending_ = false;
+  // The animated or invalidated scene may have left the retrieved depth range
+  const bool sceneIsStill = !animationIsStarted() && !depthFitSceneIsModified_;
+  depthFitSceneIsModified_ = false;
+  if (camera()->clippingPlanesAreFittedToDepth())
+    camera()->fitClippingPlanesToDepth(sceneIsStill);
+
+  if (!viewports_.isEmpty()) {
+    paintViewports();
+    // Each viewport has its own camera
+    depthCache_->invalidate();
+    if (frameSink_)
+      streamFrame();
+    if (displayWall_)
+      displayWall_->endFrame();
+    frameProfiler_->endFrame();
+    Q_EMIT drawFinished(true);
+    return;
+  }
+
+  if (usesRetainedMode()) {
+    paintRetainedFrame();
+    captureDepthCache();
+    if (frameSink_)
+      streamFrame();
+    if (displayWall_)
+      displayWall_->endFrame();
+    frameProfiler_->endFrame();
+    Q_EMIT drawFinished(true);
+    return;
+  }
+
+  if ((numberOfRefinementPasses() > 0) && !displaysInStereo()) {
+    const bool refinementFrame = refinementFrame_;
+    refinementFrame_ = false;
+    if (!refinementFrame)
+      refinementPass_ = 0;
+
+    if (refinementFrame || !viewIsInMotion()) {
+      paintRefinementFrame();
+      captureDepthCache();
+      if (frameSink_)
+        streamFrame();
+      if (displayWall_)
+        displayWall_->endFrame();
+      frameProfiler_->endFrame();
+      Q_EMIT drawFinished(true);
+      return;
+    }
+
+    // Regular frame while in motion. Refinement starts once still.
+    refinementTimer_.start(100);
+  }
+
+  const bool lod = (frameTimeBudget() > 0.0) && !renderThread_;
+  const bool scaledFrame = usesDynamicResolution();
+  const int samples = currentSceneSamples();
+  const bool offscreenFrame = scaledFrame || (samples > 0);
+  const bool reprojectedFrame = !offscreenFrame && usesReprojection();
+  // A new motion starts from a fully drawn frame
+  if (temporalReprojector_ && !reprojectedFrame)
+    temporalReprojector_->invalidate();
+  if (lod) {
+    levelOfDetail_ = selectLevelOfDetail();
+    levelOfDetailFrameTimer_.start();
+  }
+
+  // Interaction quality hints, restored after postDraw()
+  const bool fastHints =
+      qualityIsReduced_ && (format().profile() != QSurfaceFormat::CoreProfile);
+  if (fastHints) {
+    glStateCache_->pushAttrib(GL_ENABLE_BIT | GL_HINT_BIT);
+    if (samples == 0)
+      glStateCache_->disable(GL_MULTISAMPLE);
+    glHint(GL_POINT_SMOOTH_HINT, GL_FASTEST);
+    glHint(GL_LINE_SMOOTH_HINT, GL_FASTEST);
+    glHint(GL_POLYGON_SMOOTH_HINT, GL_FASTEST);
+    glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
+  }
+
+  if (displaysInStereo() && stereoIsSinglePass()) {
+    // Both back buffers are cleared, scene is traversed once
+    glDrawBuffer(GL_BACK);
+    frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
+    preDraw();
+    frameProfiler_->beginStage(FrameTiming::DRAW);
+    drawStereo();
+    frameProfiler_->beginStage(FrameTiming::POST_DRAW);
+    for (int view = 1; view >= 0; --view) {
+      selectStereoBuffer(view);
+      camera()->loadProjectionMatrixStereo(view);
+      camera()->loadModelViewMatrixStereo(view);
+      postDraw();
+    }
+  } else if (displaysInStereo()) {
     for (int view = 1; view >= 0; --view) {
       // Clears screen, set model view matrix with shifted matrix for ith buffer
+      frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
       preDrawStereo(view);
       // Used defined method. Default is empty
-      if (camera()->frame()->isManipulated())
+      frameProfiler_->beginStage(FrameTiming::DRAW);
+      if (lod)
+        drawLevelOfDetail(levelOfDetail_);
+      else if (camera()->frame()->isManipulated())
         fastDraw();
       else
         draw();
+      frameProfiler_->beginStage(FrameTiming::POST_DRAW);
       postDraw();
     }
+  } else if (offscreenFrame) {
+    // Scene drawn at a lower resolution or multisampled, visual hints at
+    // native resolution
+    paintOffscreenScene(lod, scaledFrame ? resolutionScale_ : 1.0, samples);
+    frameProfiler_->beginStage(FrameTiming::POST_DRAW);
+    postDraw();
+  } else if (reprojectedFrame) {
+    // Previous frame warped to the new camera, scene drawn in the holes
+    paintReprojectedScene(lod);
+    frameProfiler_->beginStage(FrameTiming::POST_DRAW);
+    postDraw();
   } else {
     // Clears screen, set model view matrix...
+    frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
     preDraw();
+    bool capturedFrame = false;
+    if (!frameCaptureFileName_.isEmpty() && !renderThread_) {
+      capturedFrame = frameCapture_->beginCapture();
+      // beginCapture() warned: the next frames would fail the same way
+      if (!capturedFrame)
+        frameCaptureFileName_.clear();
+    }
+    // Object IDs written by draw() in a second draw buffer
+    const bool objectIdFrame = attachObjectIdBuffer();
     // Used defined method. Default calls draw()
-    if (camera()->frame()->isManipulated())
+    frameProfiler_->beginStage(FrameTiming::DRAW);
+    if (renderThread_)
+      drawRenderThreadFrame();
+    else if (lod)
+      drawLevelOfDetail(levelOfDetail_);
+    else if (camera()->frame()->isManipulated())
       fastDraw();
     else
       draw();
+    if (objectIdFrame) {
+      objectIdBuffer_->detach();
+      requestObjectIdUnderCursor();
+    }
     // Add visual hints: axis, camera, grid...
+    frameProfiler_->beginStage(FrameTiming::POST_DRAW);
     postDraw();
+    if (capturedFrame)
+      saveFrameCapture();
+  }
+
+  if (fastHints)
+    glStateCache_->popAttrib();
+
+  if (lod) {
+    glFinish();
+    const qreal time = levelOfDetailFrameTimer_.nsecsElapsed() / 1.0e6;
+    qreal &average = levelOfDetailTimes_[levelOfDetail_];
+    average = (average < 0.0) ? time : 0.7 * average + 0.3 * time;
+
+    // Refinement starts once no motion happened for 100 ms
+    if (levelOfDetail_ > 0)
+      levelOfDetailTimer_.start(levelOfDetailRefining_ ? 0 : 100);
+    levelOfDetailRefining_ = false;
+  }
+
+  // The depth buffer of a composited frame is empty. That of a scaled frame has
+  // a lower resolution.
+  if ((renderThread_ && !displaysInStereo()) || scaledFrame ||
+      reprojectedFrame)
+    depthCache_->invalidate();
+  else
+    captureDepthCache();
+  // Once the view is still, one more frame uses the planes fitted to this one
+  if (camera()->clippingPlanesAreFittedToDepth() && depthCacheIsEnabled() &&
+      !camera()->fittedClippingPlanesAreUsed() && !depthFitFrame &&
+      !viewIsInMotion() && !animationIsStarted()) {
+    depthFitFramePending_ = true;
+    update();
   }
+  // Read back for the frameSink(), once the frame is complete
+  if (frameSink_)
+    streamFrame();
+  // Barrier of the display wall, before the frame is presented
+  if (displayWall_)
+    displayWall_->endFrame();
+
+  frameProfiler_->endFrame();
   Q_EMIT drawFinished(true);
 }
 
 /*! Sets OpenGL state before draw().
 
-Default behavior clears screen and sets the projection and modelView matrices:
+The qglviewer::FrameGraph::PRE_DRAW passes of the frameGraph() are first
+executed, when it was created. Default behavior then clears screen and sets the projection and modelView matrices:
 \code
+camera()->loadDepthState();
 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 camera()->loadProjectionMatrix();
 camera()->loadModelViewMatrix();
 \endcode
 
-Emits the drawNeeded() signal once this is done (see the <a
+The camera() state is then published for the other threads (see
+qglviewer::Camera::publishState()). Emits the drawNeeded() signal once this is done (see the <a
 href="../examples/callback.html">callback example</a>). */
 void QGLViewer::preDraw() {
+  // Shadow maps and other targets read by draw()
+  if (frameGraph_)
+    frameGraph_->execute(FrameGraph::PRE_DRAW, size() * devicePixelRatioF());
+
+  // The displayed state of the simulation
+  if (simulationThread_)
+    simulationThread_->interpolate();
+
+  // zNear() and zFar() of the moving objects
+  if (sceneBounds_)
+    sceneBounds_->updateCamera(camera());
+
+  // Depth clear value and test of qglviewer::Camera::reverseZIsEnabled()
+  camera()->loadDepthState();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // GL_PROJECTION matrix
-  camera()->loadProjectionMatrix();
-  // GL_MODELVIEW matrix
-  camera()->loadModelViewMatrix();
+  // There is no matrix stack in a core profile context: use
+  // camera()->getModelViewProjectionMatrix() in your shaders instead.
+  if (format().profile() != QSurfaceFormat::CoreProfile) {
+    // GL_PROJECTION matrix
+    camera()->loadProjectionMatrix();
+    // GL_MODELVIEW matrix
+    camera()->loadModelViewMatrix();
+  }
+
+  // The fixed function clip planes are transformed by the modelview matrix
+  if (clippingRegion_)
+    clippingRegion_->enable();
+
+  // For the worker threads that use camera()->publishedState()
+  camera()->publishState();
+
+  // Retrieves the available occlusion queries of the previous frames
+  if (occlusionCuller_)
+    occlusionCuller_->beginFrame(camera());
 
   Q_EMIT drawNeeded();
 }
 
 /*! Called after draw() to draw viewer visual hints.
 
-Default implementation displays axis, grid, FPS... when the respective flags are
+Default implementation executes the qglviewer::FrameGraph::POST_DRAW passes of
+the frameGraph(), and displays axis, grid, FPS... when the respective flags are
 sets.
 
 See the <a href="../examples/multiSelect.html">multiSelect</a> and <a
@@ -357,6 +958,27 @@ that in draw(), the user can rely on the OpenGL context he defined. Respect this
 convention (by pushing/popping the different attributes) if you overload this
 method. */
 void QGLViewer::postDraw() {
+  // The visual hints and the post draw passes are not clipped
+  if (clippingRegion_)
+    clippingRegion_->disable();
+
+  // Hidden objects are tested against the depth buffer of draw()
+  if (occlusionCuller_)
+    occlusionCuller_->endFrame();
+
+  if (frameGraph_)
+    frameGraph_->execute(FrameGraph::POST_DRAW, size() * devicePixelRatioF());
+
+  if (coreProfileRenderer_) {
+    postDrawCoreProfile();
+    return;
+  }
+
+  // draw() may have modified the state without the cache
+  if (!glStateIsTracked())
+    glStateCache_->invalidate();
+  const CurrentGLStateCache stateCache(glStateCache_);
+
   // Reset model view matrix to world coordinates origin
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
@@ -364,25 +986,25 @@ void QGLViewer::postDraw() {
   // TODO restore model loadProjectionMatrixStereo
 
   // Save OpenGL state
-  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  glStateCache_->pushAttrib(GL_ALL_ATTRIB_BITS);
 
   // Set neutral GL state
-  glDisable(GL_TEXTURE_1D);
-  glDisable(GL_TEXTURE_2D);
+  glStateCache_->disable(GL_TEXTURE_1D);
+  glStateCache_->disable(GL_TEXTURE_2D);
 #ifdef GL_TEXTURE_3D // OpenGL 1.2 Only...
-  glDisable(GL_TEXTURE_3D);
+  glStateCache_->disable(GL_TEXTURE_3D);
 #endif
 
-  glDisable(GL_TEXTURE_GEN_Q);
-  glDisable(GL_TEXTURE_GEN_R);
-  glDisable(GL_TEXTURE_GEN_S);
-  glDisable(GL_TEXTURE_GEN_T);
+  glStateCache_->disable(GL_TEXTURE_GEN_Q);
+  glStateCache_->disable(GL_TEXTURE_GEN_R);
+  glStateCache_->disable(GL_TEXTURE_GEN_S);
+  glStateCache_->disable(GL_TEXTURE_GEN_T);
 
 #ifdef GL_RESCALE_NORMAL // OpenGL 1.2 Only...
-  glEnable(GL_RESCALE_NORMAL);
+  glStateCache_->enable(GL_RESCALE_NORMAL);
 #endif
 
-  glDisable(GL_COLOR_MATERIAL);
+  glStateCache_->disable(GL_COLOR_MATERIAL);
   glColor4f(foregroundColor().redF(), foregroundColor().greenF(),
             foregroundColor().blueF(), foregroundColor().alphaF());
 
@@ -393,22 +1015,18 @@ void QGLViewer::postDraw() {
   drawVisualHints();
 
   if (gridIsDrawn()) {
-    glLineWidth(1.0);
+    glStateCache_->setLineWidth(1.0f);
     drawGrid(camera()->sceneRadius());
   }
   if (axisIsDrawn()) {
-    glLineWidth(2.0);
+    glStateCache_->setLineWidth(2.0f);
     drawAxis(camera()->sceneRadius());
   }
 
-  // FPS computation
-  const unsigned int maxCounter = 20;
-  if (++fpsCounter_ == maxCounter) {
-    f_p_s_ = 1000.0 * maxCounter / fpsTime_.restart();
-    fpsString_ = tr("%1Hz", "Frames per seconds, in Hertz")
-                     .arg(f_p_s_, 0, 'f', ((f_p_s_ < 10.0) ? 1 : 0));
-    fpsCounter_ = 0;
-  }
+  // Frame rate and message are handled once per frame, by the last viewport
+  const bool lastViewport = paintedViewport_ >= numberOfViewports() - 1;
+  if (lastViewport)
+    updateFPS();
 
   // Restore foregroundColor
   float color[4];
@@ -417,19 +1035,113 @@ void QGLViewer::postDraw() {
   color[2] = foregroundColor().blue() / 255.0f;
   color[3] = 1.0f;
   glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, color);
-  glDisable(GL_LIGHTING);
-  glDisable(GL_DEPTH_TEST);
+  glStateCache_->disable(GL_LIGHTING);
+  glStateCache_->disable(GL_DEPTH_TEST);
 
-  if (FPSIsDisplayed())
+  if (!overlayLayers_.isEmpty() && lastViewport)
+    drawOverlayLayers();
+
+  if (FPSIsDisplayed() && lastViewport)
     displayFPS();
-  if (displayMessage_)
-    drawText(10, height() - 10, message_);
+  if (hotPathCountersAreDisplayed() && lastViewport)
+    displayHotPathCounters();
+  if (frameTimingGraphIsDisplayed() && lastViewport)
+    frameProfiler_->drawGraph(width(), height());
+  if (displayMessage_ && lastViewport)
+    drawText(10, camera()->screenHeight() - 10, message_);
+
+  // All the batched texts of the frame
+  if (textRenderer_)
+    textRenderer_->draw(width(), height());
 
   // Restore GL state
-  glPopAttrib();
+  glStateCache_->popAttrib();
   glPopMatrix();
 }
 
+/*! postDraw() implementation used when visualHintsUseCoreProfile(). No fixed
+function call is made: the grid, the axis and the visual hints are drawn by the
+CoreProfileRenderer created in initializeGL(). */
+void QGLViewer::postDrawCoreProfile() {
+  GLfloat m[16];
+  camera()->getModelViewMatrix(m);
+  const QMatrix4x4 modelView = QMatrix4x4(m).transposed();
+  camera()->getProjectionMatrix(m);
+  const QMatrix4x4 projection = QMatrix4x4(m).transposed();
+
+  const QColor color = foregroundColor();
+
+  // Pivot point, line when camera rolls, zoom region. Same as drawVisualHints()
+  QVector<QVector2D> lines;
+  if (visualHint_ & 1) {
+    const float size = 15.0f;
+    const Vec proj = camera()->projectedCoordinatesOf(camera()->pivotPoint());
+    lines << QVector2D(proj.x - size, proj.y) << QVector2D(proj.x + size, proj.y)
+          << QVector2D(proj.x, proj.y - size) << QVector2D(proj.x, proj.y + size);
+  }
+
+  ManipulatedFrame *mf = nullptr;
+  Vec pnt;
+  if (camera()->frame()->action_ == SCREEN_ROTATE) {
+    mf = camera()->frame();
+    pnt = camera()->pivotPoint();
+  }
+  if (manipulatedFrame() && (manipulatedFrame()->action_ == SCREEN_ROTATE)) {
+    mf = manipulatedFrame();
+    pnt = manipulatedFrame()->position();
+  }
+  if (mf) {
+    pnt = camera()->projectedCoordinatesOf(pnt);
+    lines << QVector2D(pnt.x, pnt.y) << QVector2D(mf->prevPos_);
+  }
+
+  glDisable(GL_DEPTH_TEST);
+  coreProfileRenderer_->drawScreenLines(lines, GL_LINES, color, width(),
+                                        height());
+
+  if (camera()->frame()->action_ == ZOOM_ON_REGION) {
+    const QPoint press = camera()->frame()->pressPos_;
+    const QPoint prev = camera()->frame()->prevPos_;
+    QVector<QVector2D> region;
+    region << QVector2D(press) << QVector2D(prev.x(), press.y())
+           << QVector2D(prev) << QVector2D(press.x(), prev.y());
+    coreProfileRenderer_->drawScreenLines(region, GL_LINE_LOOP, color, width(),
+                                          height());
+  }
+  glEnable(GL_DEPTH_TEST);
+
+  if (gridIsDrawn())
+    coreProfileRenderer_->drawGrid(projection * modelView,
+                                   float(camera()->sceneRadius()), 10, color);
+  if (axisIsDrawn())
+    coreProfileRenderer_->drawAxis(modelView, projection,
+                                   float(camera()->sceneRadius()), color);
+
+  const bool lastViewport = paintedViewport_ >= numberOfViewports() - 1;
+  if (lastViewport)
+    updateFPS();
+
+  glDisable(GL_DEPTH_TEST);
+  if (FPSIsDisplayed() && lastViewport)
+    displayFPS();
+  if (hotPathCountersAreDisplayed() && lastViewport)
+    displayHotPathCounters();
+  if (displayMessage_ && lastViewport)
+    drawText(10, camera()->screenHeight() - 10, message_);
+  glEnable(GL_DEPTH_TEST);
+}
+
+/*! Updates currentFPS() every 20 frames. Called by postDraw(). */
+void QGLViewer::updateFPS() {
+  const unsigned int maxCounter = 20;
+  if (++fpsCounter_ == maxCounter) {
+    f_p_s_ = 1000.0 * maxCounter / fpsTime_.restart();
+    fpsString_ = tr("%1Hz", "Frames per seconds, in Hertz")
+                     .arg(f_p_s_, 0, 'f', ((f_p_s_ < 10.0) ? 1 : 0));
+    fpsCounter_ = 0;
+  }
+}
+
 /*! Called before draw() (instead of preDraw()) when viewer displaysInStereo().
 
 Same as preDraw() except that the glDrawBuffer() is set to \c GL_BACK_LEFT or \c
@@ -438,35 +1150,452 @@ qglviewer::Camera::loadProjectionMatrixStereo() and
 qglviewer::Camera::loadModelViewMatrixStereo() instead. */
 void QGLViewer::preDrawStereo(bool leftBuffer) {
   // Set buffer to draw in
-  // Seems that SGI and Crystal Eyes are not synchronized correctly !
-  // That's why we don't draw in the appropriate buffer...
-  if (!leftBuffer)
-    glDrawBuffer(GL_BACK_LEFT);
-  else
-    glDrawBuffer(GL_BACK_RIGHT);
+  selectStereoBuffer(leftBuffer);
+
+  // See preDraw()
+  if (simulationThread_ && leftBuffer)
+    simulationThread_->interpolate();
+  if (sceneBounds_ && leftBuffer)
+    sceneBounds_->updateCamera(camera());
 
   // Clear the buffer where we're going to draw
+  camera()->loadDepthState();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   // GL_PROJECTION matrix
   camera()->loadProjectionMatrixStereo(leftBuffer);
   // GL_MODELVIEW matrix
   camera()->loadModelViewMatrixStereo(leftBuffer);
 
+  // Mono-vision state, see preDraw()
+  if (leftBuffer)
+    camera()->publishState();
+
   Q_EMIT drawNeeded();
 }
 
+// Binds the back buffer of the leftBuffer eye.
+void QGLViewer::selectStereoBuffer(bool leftBuffer) {
+  // Seems that SGI and Crystal Eyes are not synchronized correctly !
+  // That's why we don't draw in the appropriate buffer...
+  if (!leftBuffer)
+    glDrawBuffer(GL_BACK_LEFT);
+  else
+    glDrawBuffer(GL_BACK_RIGHT);
+}
+
+/*! Draws the scene for both eyes when stereoIsSinglePass().
+
+Called by paintGL() after preDraw() has cleared both back buffers. Default
+implementation is not single pass: for each eye, the back buffer is selected,
+the qglviewer::Camera::loadProjectionMatrixStereo() and
+qglviewer::Camera::loadModelViewMatrixStereo() matrices are loaded, and draw()
+(or fastDraw() when the camera is manipulated) is called.
+
+Overload this method to draw both eyes with a single scene traversal, using
+qglviewer::Camera::getStereoMatrices() and instanced draw calls. */
+void QGLViewer::drawStereo() {
+  for (int view = 1; view >= 0; --view) {
+    selectStereoBuffer(view);
+    camera()->loadProjectionMatrixStereo(view);
+    camera()->loadModelViewMatrixStereo(view);
+    if (camera()->frame()->isManipulated())
+      fastDraw();
+    else
+      draw();
+  }
+}
+
+/*! Draws the lodMeshes(), see draw(). */
+void QGLViewer::draw() { drawLodMeshes(lodMeshesAreSimplified_); }
+
 /*! Draws a simplified version of the scene to guarantee interactive camera
 displacements.
 
 This method is called instead of draw() when the qglviewer::Camera::frame() is
 qglviewer::ManipulatedCameraFrame::isManipulated(). Default implementation
-simply calls draw().
+simply calls draw(), in which the lodMeshes() are drawn at a reduced level of
+detail.
 
 Overload this method if your scene is too complex to allow for interactive
 camera manipulation. See the <a href="../examples/fastDraw.html">fastDraw
 example</a> for an illustration. */
-void QGLViewer::fastDraw() { draw(); }
+void QGLViewer::fastDraw() {
+  lodMeshesAreSimplified_ = true;
+  draw();
+  lodMeshesAreSimplified_ = false;
+}
+
+/*! Draws the scene with the level of detail \p level, when frameTimeBudget()
+is positive.
+
+\p level ranges from 0 (full quality) to numberOfLevelsOfDetail()-1 (the
+fastest). Default implementation calls draw() for level 0 and fastDraw()
+otherwise. Overload this method and setNumberOfLevelsOfDetail() to provide
+intermediate levels. */
+void QGLViewer::drawLevelOfDetail(int level) {
+  if (level == 0)
+    draw();
+  else
+    fastDraw();
+}
+
+/*! Sets the frameTimeBudget(), in milliseconds. 0.0 disables the levels of
+detail. */
+void QGLViewer::setFrameTimeBudget(qreal budget) {
+  frameTimeBudget_ = qMax(qreal(0.0), budget);
+  if (frameTimeBudget_ == 0.0) {
+    levelOfDetailTimer_.stop();
+    levelOfDetail_ = 0;
+  }
+}
+
+/*! Sets the numberOfLevelsOfDetail(). \p nb is clamped to 1. The measured
+frame times are reset. */
+void QGLViewer::setNumberOfLevelsOfDetail(int nb) {
+  levelOfDetailTimes_.fill(-1.0, qMax(1, nb));
+  levelOfDetail_ = 0;
+}
+
+/*! Sets the numberOfRefinementPasses(). 0 disables progressive refinement. */
+void QGLViewer::setNumberOfRefinementPasses(int nb) {
+  numberOfRefinementPasses_ = qMax(0, nb);
+  refinementPass_ = 0;
+  if (numberOfRefinementPasses_ == 0) {
+    refinementTimer_.stop();
+    makeCurrent();
+    delete refinementFBO_;
+    refinementFBO_ = nullptr;
+    doneCurrent();
+  }
+  update();
+}
+
+// Called by refinementTimer_. Interrupted by any new regular frame.
+void QGLViewer::drawNextRefinementPass() {
+  if (viewIsInMotion()) {
+    refinementTimer_.start(100);
+    return;
+  }
+  refinementFrame_ = true;
+  update();
+}
+
+// Input events postpone the pending refinement passes, which are discarded if
+// the view is modified.
+void QGLViewer::postponeRefinement() {
+  if (refinementTimer_.isActive())
+    refinementTimer_.start(100);
+}
+
+// Draws draw() (refinementPass_ is 0) or the next drawRefinementPass() in
+// refinementFBO_, which is then copied to the widget framebuffer.
+void QGLViewer::paintRefinementFrame() {
+  const QSize size = this->size() * devicePixelRatioF();
+  if (!refinementFBO_ || (refinementFBO_->size() != size)) {
+    delete refinementFBO_;
+    // Same attachments and samples as the widget framebuffer, for the blit
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setSamples(qMax(0, format().samples()));
+    refinementFBO_ = new QOpenGLFramebufferObject(size, fboFormat);
+    refinementPass_ = 0;
+  }
+
+  refinementFBO_->bind();
+  if (refinementPass_ == 0) {
+    preDraw();
+    draw();
+  } else {
+    camera()->loadProjectionMatrix();
+    camera()->loadModelViewMatrix();
+    drawRefinementPass(refinementPass_);
+  }
+  refinementFBO_->release();
+
+  const QRect rect(QPoint(0, 0), size);
+  QOpenGLFramebufferObject::blitFramebuffer(
+      nullptr, rect, refinementFBO_, rect,
+      GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT,
+      GL_NEAREST);
+
+  // Visual hints are not accumulated
+  camera()->loadProjectionMatrix();
+  camera()->loadModelViewMatrix();
+  postDraw();
+
+  if (refinementPass_ < numberOfRefinementPasses()) {
+    ++refinementPass_;
+    refinementTimer_.start(0);
+  } else
+    refinementPass_ = numberOfRefinementPasses() + 1;
+}
+
+/*! Sets the retainedModeIsEnabled() value. The cached scene is released when
+the retained mode is disabled. */
+void QGLViewer::setRetainedModeEnabled(bool enabled) {
+  retainedModeIsEnabled_ = enabled;
+  retainedSceneIsValid_ = false;
+  if (!enabled) {
+    makeCurrent();
+    delete retainedFBO_;
+    retainedFBO_ = nullptr;
+    doneCurrent();
+  }
+  update();
+}
+
+/*! Discards the scene cached by the retained mode, so that the next frame
+calls draw() again. Also calls \c update().
 
+Call this method when your scene is modified, unless it is modified by a frame
+given to addSceneFrame(). Also makes a renderThread() draw a new frame, and the
+next frame use the sceneRadius() clipping planes (see
+qglviewer::Camera::clippingPlanesAreFittedToDepth()). */
+void QGLViewer::invalidateScene() {
+  retainedSceneIsValid_ = false;
+  renderThreadSceneIsValid_ = false;
+  depthFitSceneIsModified_ = true;
+  update();
+}
+
+/*! Adds \p frame to the scene frames: its modifications (see
+qglviewer::Frame::modified()) call invalidateScene(). Use
+removeSceneFrame() before \p frame is deleted.
+
+Small objects moved by a frame should rather be drawn in postDraw(), so that
+their motion does not invalidate the complete scene. */
+void QGLViewer::addSceneFrame(const Frame *frame) {
+  // Already added with its bounding box
+  if (sceneFrameBounds_.contains(frame))
+    return;
+  connect(frame, SIGNAL(modified()), this, SLOT(invalidateScene()),
+          Qt::UniqueConnection);
+}
+
+/*! Adds \p frame to the scene frames, with the bounding box (\p min, \p max)
+of the objects it moves, defined in the \p frame coordinate system.
+
+While the camera is still, a modification of \p frame only redraws the region
+of the screen covered by this box before and after the modification, over the
+scene cached by the retained mode. draw() is called with a scissor test
+restricted to this region: see partialRedrawRect() to skip the objects outside
+of it. This is typically used for the manipulatedFrame() of an editor, for
+which dragging an object no longer redraws the complete scene.
+
+The objects drawn outside of the box are not updated: call the method again
+when they grow. */
+void QGLViewer::addSceneFrame(const Frame *frame, const Vec &min,
+                              const Vec &max) {
+  if (!frame)
+    return;
+  disconnect(frame, SIGNAL(modified()), this, SLOT(invalidateScene()));
+  connect(frame, SIGNAL(modified()), this, SLOT(sceneFrameModified()),
+          Qt::UniqueConnection);
+
+  SceneFrameBounds &bounds = sceneFrameBounds_[frame];
+  // The previous box is redrawn with the new one
+  const QRect drawnRect = bounds.frame ? bounds.drawnRect : QRect();
+  bounds.frame = frame;
+  bounds.min = min;
+  bounds.max = max;
+  bounds.drawnRect = drawnRect;
+  bounds.isModified = true;
+  update();
+}
+
+/*! Removes \p frame from the scene frames, see addSceneFrame(). */
+void QGLViewer::removeSceneFrame(const Frame *frame) {
+  disconnect(frame, SIGNAL(modified()), this, SLOT(invalidateScene()));
+  disconnect(frame, SIGNAL(modified()), this, SLOT(sceneFrameModified()));
+  sceneFrameBounds_.remove(frame);
+}
+
+// Marks the scene frame that sent modified() for a partial redraw
+void QGLViewer::sceneFrameModified() {
+  const Frame *const frame = qobject_cast<const Frame *>(sender());
+  QMap<const Frame *, SceneFrameBounds>::iterator it =
+      sceneFrameBounds_.find(frame);
+  if (it == sceneFrameBounds_.end())
+    return;
+  it->isModified = true;
+  update();
+}
+
+// Region of the widget covered by the projection of the (min, max) box of
+// frame, with a margin for the line widths and antialiasing. The whole widget
+// when the box is not entirely between the near and far planes.
+QRect QGLViewer::sceneFrameRect(const Frame *frame, const Vec &min,
+                                const Vec &max) const {
+  const QRect widgetRect(0, 0, width(), height());
+  qreal xMin = 0.0, yMin = 0.0, xMax = 0.0, yMax = 0.0;
+  for (int i = 0; i < 8; ++i) {
+    const Vec corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y,
+                     (i & 4) ? max.z : min.z);
+    const Vec proj = camera()->projectedCoordinatesOf(corner, frame);
+    if ((proj.z < 0.0) || (proj.z > 1.0))
+      return widgetRect;
+    xMin = (i == 0) ? proj.x : qMin(xMin, qreal(proj.x));
+    yMin = (i == 0) ? proj.y : qMin(yMin, qreal(proj.y));
+    xMax = (i == 0) ? proj.x : qMax(xMax, qreal(proj.x));
+    yMax = (i == 0) ? proj.y : qMax(yMax, qreal(proj.y));
+  }
+
+  const int margin = 2;
+  const QRect rect(QPoint(int(floor(xMin)) - margin, int(floor(yMin)) - margin),
+                   QPoint(int(ceil(xMax)) + margin, int(ceil(yMax)) + margin));
+  return rect & widgetRect;
+}
+
+// Returns the union of the previous and current regions of the modified scene
+// frames (all of them when allFrames is true), whose current region becomes the
+// drawn one. The scene frames deleted since the last call are discarded.
+QRect QGLViewer::updateSceneFrameRects(bool allFrames) {
+  QRect modifiedRect;
+  QMap<const Frame *, SceneFrameBounds>::iterator it =
+      sceneFrameBounds_.begin();
+  while (it != sceneFrameBounds_.end()) {
+    if (!it->frame) {
+      // Its objects are no longer drawn
+      modifiedRect |= it->drawnRect;
+      it = sceneFrameBounds_.erase(it);
+      continue;
+    }
+    if (it->isModified || allFrames) {
+      const QRect rect = sceneFrameRect(it->frame, it->min, it->max);
+      modifiedRect |= it->drawnRect | rect;
+      it->drawnRect = rect;
+      it->isModified = false;
+    }
+    ++it;
+  }
+  return modifiedRect;
+}
+
+// Retained mode is only used with a single, monoscopic and complete frame.
+bool QGLViewer::usesRetainedMode() const {
+  return retainedModeIsEnabled() && viewports_.isEmpty() &&
+         !displaysInStereo() && (numberOfRefinementPasses() == 0) &&
+         (frameTimeBudget() <= 0.0);
+}
+
+// Draws the scene in retainedFBO_ when it changed, and copies it in the widget
+// framebuffer. postDraw() is always drawn on top of it.
+void QGLViewer::paintRetainedFrame() {
+  const QSize size = this->size() * devicePixelRatioF();
+  if (!retainedFBO_ || (retainedFBO_->size() != size)) {
+    delete retainedFBO_;
+    // Same attachments and samples as the widget framebuffer, for the blit
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setSamples(qMax(0, format().samples()));
+    retainedFBO_ = new QOpenGLFramebufferObject(size, fboFormat);
+    retainedSceneIsValid_ = false;
+  }
+
+  // Any change of the camera position or projection
+  GLdouble matrix[16];
+  camera()->getModelViewProjectionMatrix(matrix);
+  if (memcmp(matrix, retainedMatrix_, sizeof(matrix)) != 0)
+    retainedSceneIsValid_ = false;
+
+  const bool motion = camera()->frame()->isManipulated();
+  const bool fullRedraw =
+      !retainedSceneIsValid_ || motion || animationIsStarted();
+  // Only the regions of the modified scene frames, see addSceneFrame()
+  const QRect partialRect = updateSceneFrameRects(fullRedraw);
+  if (fullRedraw || !partialRect.isNull()) {
+    retainedFBO_->bind();
+    if (!fullRedraw) {
+      const qreal ratio = devicePixelRatioF();
+      const QRect scissor(
+          QPoint(int(floor(partialRect.left() * ratio)),
+                 int(floor(partialRect.top() * ratio))),
+          QPoint(int(ceil((partialRect.right() + 1) * ratio)) - 1,
+                 int(ceil((partialRect.bottom() + 1) * ratio)) - 1));
+      glEnable(GL_SCISSOR_TEST);
+      glScissor(scissor.x(), size.height() - scissor.bottom() - 1,
+                scissor.width(), scissor.height());
+      partialRedrawRect_ = partialRect;
+    }
+    frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
+    preDraw();
+    frameProfiler_->beginStage(FrameTiming::DRAW);
+    if (motion)
+      fastDraw();
+    else
+      draw();
+    if (!fullRedraw) {
+      glDisable(GL_SCISSOR_TEST);
+      partialRedrawRect_ = QRect();
+    }
+    retainedFBO_->release();
+    memcpy(retainedMatrix_, matrix, sizeof(matrix));
+    // fastDraw() is an approximation of the scene
+    retainedSceneIsValid_ = !motion;
+  } else if (format().profile() != QSurfaceFormat::CoreProfile) {
+    camera()->loadProjectionMatrix();
+    camera()->loadModelViewMatrix();
+  }
+
+  const QRect rect(QPoint(0, 0), size);
+  QOpenGLFramebufferObject::blitFramebuffer(
+      nullptr, rect, retainedFBO_, rect,
+      GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT,
+      GL_NEAREST);
+
+  frameProfiler_->beginStage(FrameTiming::POST_DRAW);
+  postDraw();
+}
+
+// Called by levelOfDetailTimer_ when no motion happened since the last frame
+void QGLViewer::refineLevelOfDetail() {
+  levelOfDetailRefining_ = true;
+  update();
+}
+
+// Returns true when the camera or the manipulatedFrame() are moving.
+bool QGLViewer::viewIsInMotion() const {
+  return camera()->frame()->isManipulated() ||
+         camera()->frame()->isSpinning() ||
+         camera()->interpolationKfi_->interpolationIsStarted() ||
+         (manipulatedFrame() && (manipulatedFrame()->isManipulated() ||
+                                 manipulatedFrame()->isSpinning())) ||
+         animationIsStarted();
+}
+
+// Level of detail of the next frame. While in motion, the finest level that
+// fits in frameTimeBudget() is selected, starting from the current one. The
+// level is refined by one at each refinement frame, and full quality is used
+// after a still period.
+int QGLViewer::selectLevelOfDetail() {
+  const int nb = numberOfLevelsOfDetail();
+  int level = qMin(levelOfDetail_, nb - 1);
+
+  if (levelOfDetailRefining_)
+    return qMax(0, level - 1);
+
+  // Redraws within 100 ms of the previous one are also considered as a
+  // motion (wheel events, keyFrame interpolations...)
+  const bool motion = viewIsInMotion() ||
+                      (levelOfDetailLastMotion_.isValid() &&
+                       (levelOfDetailLastMotion_.elapsed() < 100));
+  levelOfDetailLastMotion_.start();
+
+  if (!motion)
+    return 0;
+
+  const qreal budget = frameTimeBudget();
+  if ((levelOfDetailTimes_[level] > budget) && (level < nb - 1))
+    ++level; // Too slow, coarser
+  else if (level > 0) {
+    // Finer if it is known to fit, or if the current one is much faster
+    const qreal finer = levelOfDetailTimes_[level - 1];
+    if ((finer >= 0.0) ? (finer < 0.8 * budget)
+                       : (levelOfDetailTimes_[level] < 0.5 * budget))
+      --level;
+  }
+  return level;
+}
 /*! Starts (\p edit = \c true, default) or stops (\p edit=\c false) the edition
 of the camera().
 
@@ -491,6 +1620,20 @@ void QGLViewer::setCameraIsEdited(bool edit) {
   update();
 }
 
+/*! Sets visualHintsUseCoreProfile().
+
+The shader program and vertex buffers are created in initializeGL(): this
+method has no effect once the viewer has been initialized, and should be called
+in your viewer's constructor. */
+void QGLViewer::setVisualHintsUseCoreProfile(bool useCoreProfile) {
+  if (isValid()) {
+    qWarning("QGLViewer::setVisualHintsUseCoreProfile: Must be called before "
+             "the viewer is initialized");
+    return;
+  }
+  visualHintsUseCoreProfile_ = useCoreProfile;
+}
+
 // Key bindings. 0 means not defined
 void QGLViewer::setDefaultShortcuts() {
   // D e f a u l t   a c c e l e r a t o r s
@@ -650,7 +1793,8 @@ QGLViewer values.
 All the \p camera qglviewer::Camera::keyFrameInterpolator()
 qglviewer::KeyFrameInterpolator::interpolated() signals are connected to the
 viewer update() slot. The connections with the previous viewer's camera are
-removed. */
+removed. The animationClock() is set as the \p camera
+qglviewer::Camera::animationClock(). */
 void QGLViewer::setCamera(Camera *const camera) {
   if (!camera)
     return;
@@ -661,8 +1805,12 @@ void QGLViewer::setCamera(Camera *const camera) {
   disconnect(this->camera()->frame(), SIGNAL(spun()), this, SLOT(update()));
   disconnect(screen(), SIGNAL(physicalDotsPerInchChanged(qreal)), this->camera(), SLOT(setDevicePixelRatio(qreal)));
   connectAllCameraKFIInterpolatedSignals(false);
+  this->camera()->setDepthCache(nullptr);
+  depthCache_->invalidate();
 
   camera_ = camera;
+  if (depthCacheIsEnabled())
+    camera->setDepthCache(depthCache_);
 
   camera->setSceneRadius(sceneRadius());
   camera->setSceneCenter(sceneCenter());
@@ -674,6 +1822,7 @@ void QGLViewer::setCamera(Camera *const camera) {
   connect(camera->frame(), SIGNAL(spun()), SLOT(update()));
   connect(screen(), SIGNAL(physicalDotsPerInchChanged(qreal)), camera, SLOT(setDevicePixelRatio(qreal)));
   connectAllCameraKFIInterpolatedSignals();
+  camera->setAnimationClock(animationClock());
 
   previousCameraZClippingCoefficient_ = this->camera()->zClippingCoefficient();
 }
@@ -721,10 +1870,7 @@ void QGLViewer::drawLight(GLenum light, qreal scale) const {
 
   const qreal length = sceneRadius() / 5.0 * scale;
 
-  GLboolean lightIsOn;
-  glGetBooleanv(light, &lightIsOn);
-
-  if (lightIsOn) {
+  if (GLStateCache::current()->isEnabled(light)) {
     // All light values are given in eye coordinates
     glPushMatrix();
     glLoadIdentity();
@@ -768,12 +1914,34 @@ void QGLViewer::drawLight(GLenum light, qreal scale) const {
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
 void QGLViewer::renderText(int x, int y, const QString &str,
-                           const QFont &font) {
-  // Retrieve last OpenGL color to use as a font color
-  GLdouble glColor[4];
-  glGetDoublev(GL_CURRENT_COLOR, glColor);
-  QColor fontColor = QColor(255 * glColor[0], 255 * glColor[1],
-                            255 * glColor[2], 255 * glColor[3]);
+                           const QFont &font, const QColor &color) {
+  // Retrieve last OpenGL color to use as a font color when none is given.
+  // There is no current color in a core profile context.
+  const bool coreProfile = format().profile() == QSurfaceFormat::CoreProfile;
+  QColor fontColor = color;
+  if (!fontColor.isValid()) {
+    fontColor = foregroundColor();
+    if (!coreProfile) {
+      GLdouble glColor[4];
+      glGetDoublev(GL_CURRENT_COLOR, glColor);
+      fontColor = QColor(255 * glColor[0], 255 * glColor[1], 255 * glColor[2],
+                         255 * glColor[3]);
+    }
+  }
+
+  // Coordinates are relative to the viewport being drawn
+  x += viewportOffset_.x();
+  y += viewportOffset_.y();
+
+  if (textIsBatched() && !coreProfile) {
+    if (!textRenderer_) {
+      textRenderer_ = new TextRenderer();
+      textRenderer_->setFrameRingBuffer(frameRingBuffer());
+    }
+    textRenderer_->setResolution(logicalDpiY(), devicePixelRatioF());
+    textRenderer_->addText(x, y, str, font, fontColor);
+    return;
+  }
 
   // Render text
   QPainter painter(this);
@@ -781,20 +1949,62 @@ void QGLViewer::renderText(int x, int y, const QString &str,
   painter.setFont(font);
   painter.drawText(x, y, str);
   painter.end();
+  // QPainter modifies the OpenGL state
+  glStateCache_->invalidate();
+
+  // QPainter resets the viewport
+  if (paintedViewport_ >= 0)
+    applyViewport(paintedViewport_);
 }
 
 void QGLViewer::renderText(double x, double y, double z, const QString &str,
-                           const QFont &font) {
+                           const QFont &font, const QColor &color) {
   const Vec proj = camera_->projectedCoordinatesOf(Vec(x, y, z));
-  renderText(proj.x, proj.y, str, font);
+  renderText(proj.x, proj.y, str, font, color);
 }
 #endif
 
+/*! Sets the textIsBatched() value. */
+void QGLViewer::setTextIsBatched(bool batched) {
+  textIsBatched_ = batched;
+  if (!batched && textRenderer_) {
+    makeCurrent();
+    delete textRenderer_;
+    textRenderer_ = nullptr;
+    doneCurrent();
+  }
+  update();
+}
+
+/*! Sets the state of frameTimingGraphIsDisplayed(). Displaying the graph
+enables the frameProfiler(). Emits the frameTimingGraphIsDisplayedChanged()
+signal. */
+void QGLViewer::setFrameTimingGraphIsDisplayed(bool display) {
+  frameTimingGraphIsDisplayed_ = display;
+  if (display)
+    frameProfiler_->setEnabled(true);
+  Q_EMIT frameTimingGraphIsDisplayedChanged(display);
+  update();
+}
+
+/*! Sets the state of hotPathCountersAreDisplayed(). Displaying the counters
+enables the frameProfiler(). Emits the hotPathCountersAreDisplayedChanged()
+signal. */
+void QGLViewer::setHotPathCountersAreDisplayed(bool display) {
+  hotPathCountersAreDisplayed_ = display;
+  if (display)
+    frameProfiler_->setEnabled(true);
+  Q_EMIT hotPathCountersAreDisplayedChanged(display);
+  update();
+}
+
 /*! Draws \p text at position \p x, \p y (expressed in screen coordinates
 pixels, origin in the upper left corner of the widget).
 
 The default QApplication::font() is used to render the text when no \p fnt is
-specified. Use QApplication::setFont() to define this default font.
+specified. Use QApplication::setFont() to define this default font. The text
+uses \p color, or the current OpenGL color when \p color is not valid
+(default).
 
 You should disable \c GL_LIGHTING and \c GL_DEPTH_TEST before this method so
 that colors are properly rendered.
@@ -821,7 +2031,8 @@ facing the camera).
 The \c GL_MODELVIEW and \c GL_PROJECTION matrices are not modified by this
 method.
 */
-void QGLViewer::drawText(int x, int y, const QString &text, const QFont &fnt) {
+void QGLViewer::drawText(int x, int y, const QString &text, const QFont &fnt,
+                         const QColor &color) {
   if (!textIsEnabled())
     return;
 
@@ -830,9 +2041,9 @@ void QGLViewer::drawText(int x, int y, const QString &text, const QFont &fnt) {
                    (tileRegion_->xMax - tileRegion_->xMin)),
                int((y - tileRegion_->yMin) * height() /
                    (tileRegion_->yMax - tileRegion_->yMin)),
-               text, scaledFont(fnt));
+               text, scaledFont(fnt), color);
   } else
-    renderText(x, y, text, fnt);
+    renderText(x, y, text, fnt, color);
 }
 
 /*! Briefly displays a message in the lower left corner of the widget.
@@ -880,6 +2091,26 @@ void QGLViewer::displayFPS() {
            fpsString_);
 }
 
+/*! Displays the qglviewer::HotPathCounters counts of the previous frame, one
+per line under the frame rate. Called by postDraw() when
+hotPathCountersAreDisplayed().
+
+The counts are those of qglviewer::FrameProfiler::lastFrameCount(): the
+events of the current frame are only known once it is ended. */
+void QGLViewer::displayHotPathCounters() {
+  const int lineHeight =
+      int(1.5 * ((QApplication::font().pixelSize() > 0)
+                     ? QApplication::font().pixelSize()
+                     : QApplication::font().pointSize()));
+  for (int i = 0; i < HotPathCounters::NB_COUNTERS; ++i) {
+    const HotPathCounters::Counter counter = HotPathCounters::Counter(i);
+    drawText(10, (i + 2) * lineHeight,
+             QString("%1 %2")
+                 .arg(HotPathCounters::name(counter))
+                 .arg(frameProfiler_->lastFrameCount(counter)));
+  }
+}
+
 /*! Modify the projection matrix so that drawing can be done directly with 2D
 screen coordinates.
 
@@ -929,9 +2160,9 @@ void QGLViewer::startScreenCoordinatesSystem(bool upward) const {
       glOrtho(tileRegion_->xMin, tileRegion_->xMax, tileRegion_->yMax,
               tileRegion_->yMin, 0.0, -1.0);
   else if (upward)
-    glOrtho(0, width(), 0, height(), 0.0, -1.0);
+    glOrtho(0, camera()->screenWidth(), 0, camera()->screenHeight(), 0.0, -1.0);
   else
-    glOrtho(0, width(), height(), 0, 0.0, -1.0);
+    glOrtho(0, camera()->screenWidth(), camera()->screenHeight(), 0, 0.0, -1.0);
 
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
@@ -954,25 +2185,330 @@ void QGLViewer::stopScreenCoordinatesSystem() const {
 
 /*! Overloading of the \c QObject method.
 
-If animationIsStarted(), calls animate() and draw(). */
+If animationIsStarted(), calls animate() (unless there is a
+simulationThread()) and draw(). Only used when there is no animationClock(). */
 void QGLViewer::timerEvent(QTimerEvent *) {
   if (animationIsStarted()) {
-    animate();
+    if (!simulationThread_)
+      animate();
+    update();
+  }
+}
+
+/*! Sets the framePacingIsEnabled() value. */
+void QGLViewer::setFramePacingIsEnabled(bool enabled) {
+  framePacingIsEnabled_ = enabled;
+  if (enabled) {
+    if (!inputTime_.isValid())
+      inputTime_.start();
+  } else {
+    flushPendingMouseMove();
+    framePresented();
+  }
+}
+
+/*! Overloading of the \c QOpenGLWidget method.
+
+When framePacingIsEnabled() and a frame is pending, the redraw is deferred
+until this frame is presented. */
+void QGLViewer::paintEvent(QPaintEvent *e) {
+  // Painted, hence probably visible again
+  if (suspended_)
+    updatePowerState();
+
+  if (framePacingIsEnabled() && framePending_) {
+    redrawDeferred_ = true;
+    return;
+  }
+
+  QOpenGLWidget::paintEvent(e);
+
+  if (framePacingIsEnabled()) {
+    framePending_ = true;
+    // Hidden or obscured windows may not swap: do not wait for ever
+    framePresentedTimer_.start(100);
+  }
+}
+
+// Called when the pending frame has been presented. Measures the input
+// latency, then processes the coalesced input and redraw requests.
+void QGLViewer::framePresented() {
+  if (!framePending_)
+    return;
+
+  framePending_ = false;
+  framePresentedTimer_.stop();
+
+  if (latencyStart_ >= 0) {
+    inputLatency_ = (inputTime_.nsecsElapsed() - latencyStart_) / 1.0e6;
+    latencyStart_ = -1;
+  }
+
+  flushPendingMouseMove();
+
+  if (redrawDeferred_) {
+    redrawDeferred_ = false;
     update();
   }
 }
 
-/*! Starts the animation loop. See animationIsStarted(). */
+// Processes the coalesced mouse move event, if any.
+void QGLViewer::flushPendingMouseMove() {
+  if (!hasPendingMouseMove_)
+    return;
+
+  hasPendingMouseMove_ = false;
+  if (latencyStart_ < 0)
+    latencyStart_ = pendingMouseMoveTime_;
+
+  QMouseEvent event(QEvent::MouseMove, pendingMouseMovePos_, Qt::NoButton,
+                    pendingMouseMoveButtons_, pendingMouseMoveModifiers_);
+  // Not virtual: overloaded mouseMoveEvent() already saw the original events.
+  // The position was already made relative to the current viewport.
+  const bool eventIsLocal = viewportEventIsLocal_;
+  viewportEventIsLocal_ = true;
+  QGLViewer::mouseMoveEvent(&event);
+  viewportEventIsLocal_ = eventIsLocal;
+}
+
+/*! Starts the animation loop, and the simulationThread() if any. See
+animationIsStarted().
+
+When the viewer isSuspended(), they are only started once it is visible
+again. */
 void QGLViewer::startAnimation() {
-  animationTimerId_ = startTimer(animationPeriod());
+  animationTime_ = 0;
   animationStarted_ = true;
+  if (!suspended_)
+    startAnimationTimers();
 }
 
-/*! Stops animation. See animationIsStarted(). */
+/*! Stops animation, and the simulationThread() if any. See
+animationIsStarted(). */
 void QGLViewer::stopAnimation() {
   animationStarted_ = false;
-  if (animationTimerId_ != 0)
+  stopAnimationTimers();
+}
+
+void QGLViewer::startAnimationTimers() {
+  if (simulationThread_)
+    simulationThread_->start();
+  if (animationClock_)
+    animationClock_->start(this);
+  else if (animationTimerId_ == 0)
+    animationTimerId_ = startTimer(currentAnimationPeriod());
+}
+
+void QGLViewer::stopAnimationTimers() {
+  if (simulationThread_)
+    simulationThread_->stop();
+  if (animationClock_)
+    animationClock_->stop(this);
+  if (animationTimerId_ != 0) {
+    killTimer(animationTimerId_);
+    animationTimerId_ = 0;
+  }
+}
+
+/*! Sets the animationClock(). The camera() (and the viewport cameras) and
+the manipulatedFrame() use \p clock from now on, and a started animation
+continues with it.
+
+The previous clock is not deleted. Several viewers can share the same
+qglviewer::AnimationClock::applicationClock(). */
+void QGLViewer::setAnimationClock(AnimationClock *clock) {
+  if (clock == animationClock_)
+    return;
+
+  if (animationClock_) {
+    disconnect(animationClock_, SIGNAL(tick(int)), this,
+               SLOT(advanceAnimation(int)));
+    animationClock_->stop(this);
+  }
+  if (animationTimerId_ != 0) {
     killTimer(animationTimerId_);
+    animationTimerId_ = 0;
+  }
+
+  animationClock_ = clock;
+
+  if (clock)
+    connect(clock, SIGNAL(tick(int)), SLOT(advanceAnimation(int)));
+  if (animationIsStarted() && !suspended_) {
+    if (clock)
+      clock->start(this);
+    else
+      animationTimerId_ = startTimer(currentAnimationPeriod());
+  }
+
+  camera()->setAnimationClock(clock);
+  if (ownCamera_)
+    ownCamera_->setAnimationClock(clock);
+  for (int i = 0; i < viewports_.size(); ++i)
+    viewports_.at(i).camera->setAnimationClock(clock);
+  if (manipulatedFrame() && (manipulatedFrame() != camera()->frame()))
+    manipulatedFrame()->setAnimationClock(clock);
+}
+
+// Calls animate() when an animationPeriod() has elapsed since the last call,
+// at most once per animationClock() tick.
+void QGLViewer::advanceAnimation(int elapsed) {
+  if (!animationIsStarted())
+    return;
+
+  const int period = currentAnimationPeriod();
+  animationTime_ += elapsed;
+  if (animationTime_ < period)
+    return;
+
+  // A late tick does not trigger several animate()
+  animationTime_ = qMin(animationTime_ - period, period);
+  if (!simulationThread_)
+    animate();
+  // An idle animation which moves Frames resumes its animationPeriod()
+  if (idle_ && (qglviewer::Frame::nbModifications() != frameModifications_))
+    updatePowerState();
+  update();
+}
+
+/*! Sets the simulationThread(). The previous one is stopped, and \p thread
+is started when animationIsStarted(). Use \c nullptr to animate the scene
+with animate() again. */
+void QGLViewer::setSimulationThread(SimulationThread *thread) {
+  if (thread == simulationThread_)
+    return;
+
+  if (simulationThread_)
+    simulationThread_->stop();
+  simulationThread_ = thread;
+  if (simulationThread_ && animationIsStarted() && !suspended_)
+    simulationThread_->start();
+  update();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Power saving                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the powerSavingIsEnabled() value. When disabled, a suspended
+animation resumes at once, at the animationPeriod(). */
+void QGLViewer::setPowerSavingIsEnabled(bool enabled) {
+  if (enabled == powerSavingIsEnabled_)
+    return;
+
+  powerSavingIsEnabled_ = enabled;
+  if (enabled) {
+    lastActivity_.start();
+    frameModifications_ = qglviewer::Frame::nbModifications();
+    powerTimer_.start(250);
+  } else
+    powerTimer_.stop();
+  updatePowerState();
+}
+
+/*! Sets the idleAnimationPeriod(), in milliseconds. */
+void QGLViewer::setIdleAnimationPeriod(int period) {
+  idleAnimationPeriod_ = qMax(period, 0);
+  if (idle_)
+    updatePowerState();
+}
+
+/*! Declares an activity in the viewer: it is no longer isIdle() for
+idleDelay() milliseconds. Called by the default mouse, wheel and keyboard
+event handlers, and when a qglviewer::Frame was modified. Call it when the
+scene changes in a way that should be animated at the full animationPeriod()
+without modifying a Frame, for instance when new data arrives. */
+void QGLViewer::wakeUp() {
+  if (!powerSavingIsEnabled_)
+    return;
+  lastActivity_.start();
+  if (idle_)
+    updatePowerState();
+}
+
+// Visible in a shown and exposed window, and not entirely covered by other
+// widgets of the window
+bool QGLViewer::isShownOnScreen() const {
+  if (!isVisible() || visibleRegion().isEmpty() || window()->isMinimized())
+    return false;
+  const QWindow *const handle = window()->windowHandle();
+  return !handle || handle->isExposed();
+}
+
+// The animationPeriod(), or the idleAnimationPeriod() when idle
+int QGLViewer::currentAnimationPeriod() const {
+  return idle_ ? qMax(animationPeriod(), idleAnimationPeriod_)
+               : animationPeriod();
+}
+
+// Suspends or resumes the animation, and switches the idle period
+void QGLViewer::updatePowerState() {
+  // A modified Frame is an activity, which is polled by the powerTimer_
+  const int frameModifications = qglviewer::Frame::nbModifications();
+  if (powerSavingIsEnabled_ && (frameModifications != frameModifications_)) {
+    frameModifications_ = frameModifications;
+    lastActivity_.start();
+  }
+
+  const bool suspended = powerSavingIsEnabled_ && !isShownOnScreen();
+  const bool idle = powerSavingIsEnabled_ &&
+                    (lastActivity_.elapsed() >= qint64(idleDelay_));
+
+  if (idle != idle_) {
+    idle_ = idle;
+    // The clock ticks are filtered by advanceAnimation()
+    if (animationTimerId_ != 0) {
+      killTimer(animationTimerId_);
+      animationTimerId_ = startTimer(currentAnimationPeriod());
+    }
+  }
+
+  if (suspended == suspended_)
+    return;
+  suspended_ = suspended;
+  if (animationIsStarted()) {
+    if (suspended)
+      stopAnimationTimers();
+    else {
+      animationTime_ = 0;
+      startAnimationTimers();
+      update();
+    }
+  }
+  Q_EMIT suspendedChanged(suspended);
+}
+
+/*! Calls \p function on consecutive ranges of [0, \p nbElements), split between
+several threads. Each call evaluates the elements of [\c begin, \c end). This
+method returns when all the elements are evaluated.
+
+Use it in animate() to update many independent elements, such as the
+particles of the <a href="../examples/animation.html">animation example</a>:
+\code
+void Viewer::animate() {
+  parallelFor(nbPart_, [this](int begin, int end) {
+    for (int i = begin; i < end; ++i)
+      particle_[i].animate();
+  });
+}
+\endcode
+
+Ranges contain at least \p minChunkSize elements, so that small arrays are not
+split: the cost of the synchronization must remain small compared to the
+evaluation. The calling thread evaluates one of the ranges. The other ones are
+evaluated by the threads shared by the library, see qglviewer::TaskScheduler.
+
+\p function is called concurrently: it must not modify shared data, emit
+signals or issue OpenGL calls. Write the results in a
+qglviewer::MappedVertexBuffer to draw them without copy. parallelFor() must be
+called from the viewer thread, and not from \p function. */
+void QGLViewer::parallelFor(int nbElements,
+                            const std::function<void(int, int)> &function,
+                            int minChunkSize) {
+  if (nbElements <= 0)
+    return;
+
+  qglviewer::TaskScheduler::parallelFor(nbElements, function, minChunkSize);
 }
 
 /*! Overloading of the \c QWidget method.
@@ -1084,14 +2620,33 @@ example</a> for an illustration.
 region. Use qglviewer::Camera::convertClickToLine() to transform these
 coordinates in a 3D ray if you want to perform an analytical intersection.
 
+When selectionMode() is QGLViewer::RAY_SELECTION, beginSelection(),
+drawWithNames() and endSelection() are not called: the ray of \p point is
+intersected with the rayPicker() geometry (see qglviewer::RayPicker::pick()),
+which sets selectedName() and selectionHits(). postSelection() is then called.
+
 \attention \c GL_SELECT mode seems to report wrong results when used in
 conjunction with backface culling. If you encounter problems try to \c
 glDisable(GL_CULL_FACE). */
 void QGLViewer::select(const QPoint &point) {
-  beginSelection(point);
-  drawWithNames();
-  endSelection(point);
+  QGLVIEWER_TRACE_SCOPE("viewer", "select");
+  QGLVIEWER_COUNT(SELECTION);
+  QElapsedTimer timer;
+  if (frameProfiler_->isEnabled())
+    timer.start();
+
+  if (selectionMode() == RAY_SELECTION)
+    selectWithRay(point);
+  else {
+    beginSelection(point);
+    drawWithNames();
+    endSelection(point);
+  }
   postSelection(point);
+
+  if (timer.isValid())
+    frameProfiler_->addStageTime(FrameTiming::SELECTION,
+                                 timer.nsecsElapsed() / 1.0e6);
 }
 
 /*! This method should prepare the selection. It is called by select() before
@@ -1105,6 +2660,12 @@ GL_MODELVIEW matrix is set to the world coordinate system using
 qglviewer::Camera::loadModelViewMatrix(). See the gluPickMatrix() documentation
 for details.
 
+When selectionMode() is QGLViewer::COLOR_SELECTION, an offscreen framebuffer
+object of size selectRegionWidth() x selectRegionHeight() is bound instead and
+the OpenGL state is set so that the colors set by pushSelectionName() are
+written unmodified in it (no lighting, texturing, blending...). The same pick
+matrix is used, so that only the selection region is rasterized.
+
 You should not need to redefine this method (if you use the \c GL_SELECT mode to
 perform your selection), since this code is fairly classical and can be tuned.
 You are more likely to overload endSelection() if you want to use a more complex
@@ -1113,18 +2674,59 @@ void QGLViewer::beginSelection(const QPoint &point) {
   // Make OpenGL context current (may be needed with several viewers ?)
   makeCurrent();
 
-  // Prepare the selection mode
-  glSelectBuffer(selectBufferSize(), selectBuffer());
-  glRenderMode(GL_SELECT);
-  glInitNames();
+  static GLint viewport[4];
+  QPoint pickPoint = point;
+
+  if (selectionMode() == COLOR_SELECTION) {
+    const int w = qMax(1, selectRegionWidth());
+    const int h = qMax(1, selectRegionHeight());
+    if (!selectionFBO_ || (selectionFBO_->width() != w) ||
+        (selectionFBO_->height() != h)) {
+      delete selectionFBO_;
+      selectionFBO_ = new QOpenGLFramebufferObject(
+          w, h, QOpenGLFramebufferObject::Depth);
+    }
+    selectionFBO_->bind();
+
+    // Restored in endSelection()
+    glPushAttrib(GL_ALL_ATTRIB_BITS);
+    glViewport(0, 0, w, h);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_COLOR_MATERIAL);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    glDisable(GL_ALPHA_TEST);
+    glDisable(GL_FOG);
+    glDisable(GL_DITHER);
+    glDisable(GL_MULTISAMPLE);
+    glEnable(GL_DEPTH_TEST);
+    glShadeModel(GL_FLAT);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    selectionNameStack_.clear();
+    glColor4ub(0, 0, 0, 0);
+
+    // Use a non flipped viewport, so that back face culling is preserved.
+    viewport[0] = 0;
+    viewport[1] = 0;
+    viewport[2] = camera()->screenWidth();
+    viewport[3] = camera()->screenHeight();
+    pickPoint.setY(camera()->screenHeight() - point.y());
+  } else {
+    // Prepare the selection mode
+    glSelectBuffer(selectBufferSize(), selectBuffer());
+    glRenderMode(GL_SELECT);
+    glInitNames();
+    selectionNameOperations_ = 0;
+    selectionNameDepth_ = selectionMaxNameDepth_ = 0;
+    camera()->getViewport(viewport);
+  }
 
   // Loads the matrices
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
-  static GLint viewport[4];
-  camera()->getViewport(viewport);
-  gluPickMatrix(point.x(), point.y(), selectRegionWidth(), selectRegionHeight(),
-                viewport);
+  gluPickMatrix(pickPoint.x(), pickPoint.y(), selectRegionWidth(),
+                selectRegionHeight(), viewport);
 
   // loadProjectionMatrix() first resets the GL_PROJECTION matrix with a
   // glLoadIdentity(). The false parameter prevents this and hence multiplies
@@ -1140,11 +2742,15 @@ object is actually selected.
 
 The default implementation relies on \c GL_SELECT mode (see beginSelection()).
 It assumes that names were pushed and popped in drawWithNames(), and analyzes
-the selectBuffer() to find the name that corresponds to the closer (z min)
-object. It then setSelectedName() to this value, or to -1 if the selectBuffer()
-is empty (no object drawn in selection region). Use selectedName() (probably in
-the postSelection() method) to retrieve this value and update your data
-structure accordingly.
+the selectBuffer() to fill selectionHits(), sorted from front to back. It then
+setSelectedName() to the name of the closer (z min) object, or to -1 if the
+selectBuffer() is empty (no object drawn in selection region). Use
+selectedName() (probably in the postSelection() method) to retrieve this value
+and update your data structure accordingly.
+
+When the selectBuffer() overflows and selectBufferGrowthIsEnabled(), the buffer
+is enlarged and the selection is performed again from \p point, before the hits
+are analyzed.
 
 This default implementation, although sufficient for many cases is however
 limited and you may have to overload this method. This will be the case if
@@ -1172,34 +2778,247 @@ setSelectedName((selectBuffer())[i*4+3])
 }
 \endcode
 
-See the <a href="../examples/multiSelect.html">multiSelect example</a> for
-a multi-object selection implementation of this method. */
+When selectionMode() is QGLViewer::COLOR_SELECTION, the colors and depths of
+the selection region are read back from the offscreen framebuffer object and
+the name of the closest pixel is selected. The selectBuffer() is not used in
+that case.
+
+If you simply need all the selected objects, overload this method to call \c
+QGLViewer::endSelection() and use selectionHits(), as is done in the <a
+href="../examples/multiSelect.html">multiSelect example</a>. */
 void QGLViewer::endSelection(const QPoint &point) {
-  Q_UNUSED(point)
+  selectionHits_.clear();
+
+  if (selectionMode() == COLOR_SELECTION) {
+    const int w = selectionFBO_->width();
+    const int h = selectionFBO_->height();
+    QVector<GLubyte> colors(4 * w * h);
+    QVector<GLfloat> depths(w * h);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+    glReadPixels(0, 0, w, h, GL_DEPTH_COMPONENT, GL_FLOAT, depths.data());
+    glPopAttrib();
+    selectionFBO_->release();
+
+    // Depth range of each name of the region. A null color is the
+    // background. See pushSelectionName().
+    QHash<int, int> hitIndex;
+    for (int i = 0; i < w * h; ++i) {
+      const int id = colors[4 * i] | (colors[4 * i + 1] << 8) |
+                     (colors[4 * i + 2] << 16);
+      if (id == 0)
+        continue;
+      QHash<int, int>::const_iterator it = hitIndex.constFind(id);
+      if (it == hitIndex.constEnd()) {
+        hitIndex.insert(id, selectionHits_.size());
+        const SelectionHit hit = {id - 1, depths[i], depths[i]};
+        selectionHits_.append(hit);
+      } else {
+        SelectionHit &hit = selectionHits_[it.value()];
+        hit.zMin = qMin(hit.zMin, depths[i]);
+        hit.zMax = qMax(hit.zMax, depths[i]);
+      }
+    }
+  } else {
+    // Flush GL buffers
+    glFlush();
+
+    // Get the number of objects that were seen through the pick matrix
+    // frustum. Reset GL_RENDER mode. A negative value means an overflow.
+    GLint nbHits = glRenderMode(GL_RENDER);
+    while ((nbHits < 0) && selectBufferGrowthIsEnabled() &&
+           growSelectBuffer()) {
+      beginSelection(point);
+      drawWithNames();
+      glFlush();
+      nbHits = glRenderMode(GL_RENDER);
+    }
+    if (nbHits < 0)
+      qWarning("QGLViewer::endSelection: select buffer overflow, some hits are "
+               "lost. Use setSelectBufferSize()");
+
+    // Interpret results: each hit record is made of the number of names on the
+    // stack, the minimum and maximum depths of the object and the names. See
+    // glSelectBuffer() man page. The complete records of an overflowed buffer
+    // are kept.
+    const GLuint *buffer = selectBuffer();
+    const int size = selectBufferSize();
+    int index = 0;
+    for (int i = 0; (nbHits < 0) || (i < nbHits); ++i) {
+      if (index + 3 > size)
+        break;
+      const int nbNames = int(buffer[index]);
+      if (index + 3 + nbNames > size)
+        break;
+      if (nbNames > 0) {
+        const SelectionHit hit = {int(buffer[index + 2 + nbNames]),
+                                  float(buffer[index + 1] / 4294967295.0),
+                                  float(buffer[index + 2] / 4294967295.0)};
+        selectionHits_.append(hit);
+      }
+      index += 3 + nbNames;
+    }
+  }
+
+  // Of all the objects that were projected in the pick region, we select the
+  // closest one (zMin comparison).
+  std::stable_sort(selectionHits_.begin(), selectionHits_.end(),
+                   [](const SelectionHit &a, const SelectionHit &b) {
+                     return a.zMin < b.zMin;
+                   });
+  setSelectedName(selectionHits_.isEmpty() ? -1 : selectionHits_.first().name);
+}
+
+// The RAY_SELECTION implementation of select(), without any OpenGL call.
+void QGLViewer::selectWithRay(const QPoint &point) {
+  selectionHits_.clear();
+  setSelectedName(-1);
+  if (!rayPicker_) {
+    qWarning("QGLViewer::select: RAY_SELECTION mode requires a rayPicker()");
+    return;
+  }
 
-  // Flush GL buffers
-  glFlush();
+  RayPicker::Hit hit;
+  if (rayPicker_->pick(camera(), point, hit)) {
+    const float z = float(camera()->projectedCoordinatesOf(hit.point).z);
+    const SelectionHit selectionHit = {hit.name, z, z};
+    selectionHits_.append(selectionHit);
+    setSelectedName(hit.name);
+  }
+}
 
-  // Get the number of objects that were seen through the pick matrix frustum.
-  // Reset GL_RENDER mode.
-  GLint nbHits = glRenderMode(GL_RENDER);
+// Enlarges the select buffer after an overflow. Returns false when it already
+// has its maximum size.
+bool QGLViewer::growSelectBuffer() {
+  static const int maximumSize = 1 << 24;
+  if (selectBufferSize() >= maximumSize)
+    return false;
 
-  if (nbHits <= 0)
-    setSelectedName(-1);
-  else {
-    // Interpret results: each object created 4 values in the selectBuffer().
-    // selectBuffer[4*i+1] is the object minimum depth value, while
-    // selectBuffer[4*i+3] is the id pushed on the stack. Of all the objects
-    // that were projected in the pick region, we select the closest one (zMin
-    // comparison). This code needs to be modified if you use several stack
-    // levels. See glSelectBuffer() man page.
-    GLuint zMin = (selectBuffer())[1];
-    setSelectedName(int((selectBuffer())[3]));
-    for (int i = 1; i < nbHits; ++i)
-      if ((selectBuffer())[4 * i + 1] < zMin) {
-        zMin = (selectBuffer())[4 * i + 1];
-        setSelectedName(int((selectBuffer())[4 * i + 3]));
-      }
+  // Each name stack operation closes at most one hit record, made of 3 values
+  // and the names. When names were pushed with glPushName(), simply double.
+  qint64 size = 2 * qint64(selectBufferSize());
+  if (selectionNameOperations_ > 0)
+    size = qMax(size, qint64(selectionNameOperations_ + 1) *
+                          (3 + selectionMaxNameDepth_));
+  setSelectBufferSize(int(qMin(size, qint64(maximumSize))));
+  return true;
+}
+
+// Encodes a selection name as a unique non null color. See endSelection().
+static void setSelectionNameColor(int name) {
+  const unsigned int id = static_cast<unsigned int>(name + 1);
+  glColor4ub(GLubyte(id & 0xff), GLubyte((id >> 8) & 0xff),
+             GLubyte((id >> 16) & 0xff), 255);
+}
+
+/*! Tags the entities drawn in drawWithNames() with \p name, until
+popSelectionName() is called.
+
+In QGLViewer::BUFFER_SELECTION selectionMode(), this simply calls \c
+glPushName(). In QGLViewer::COLOR_SELECTION mode, the current color is set to a
+unique color that encodes \p name. Do not modify the current color until the
+associated popSelectionName().
+
+\p name must be in the [0, 2^24-2] range in QGLViewer::COLOR_SELECTION mode. */
+void QGLViewer::pushSelectionName(int name) {
+  if (selectionMode() == COLOR_SELECTION) {
+    selectionNameStack_.append(name);
+    setSelectionNameColor(name);
+  } else {
+    glPushName(GLuint(name));
+    ++selectionNameOperations_;
+    ++selectionNameDepth_;
+    selectionMaxNameDepth_ = qMax(selectionMaxNameDepth_, selectionNameDepth_);
+  }
+}
+
+/*! Ends the block started by pushSelectionName(). The previously pushed name
+(if any) is restored. */
+void QGLViewer::popSelectionName() {
+  if (selectionMode() == COLOR_SELECTION) {
+    if (!selectionNameStack_.isEmpty())
+      selectionNameStack_.removeLast();
+    if (selectionNameStack_.isEmpty())
+      glColor4ub(0, 0, 0, 0);
+    else
+      setSelectionNameColor(selectionNameStack_.last());
+  } else {
+    glPopName();
+    ++selectionNameOperations_;
+    --selectionNameDepth_;
+  }
+}
+
+/*! Sets objectIdBufferIsEnabled(). */
+void QGLViewer::setObjectIdBufferIsEnabled(bool enabled) {
+  if (enabled == objectIdBufferIsEnabled_)
+    return;
+
+  objectIdBufferIsEnabled_ = enabled;
+  if (!enabled) {
+    objectIdTimer_.stop();
+    if (objectIdUnderCursor_ != -1) {
+      objectIdUnderCursor_ = -1;
+      Q_EMIT objectIdUnderCursorChanged(-1);
+    }
+  }
+  update();
+}
+
+// Attaches the ID buffer to the widget framebuffer, after preDraw(). Returns
+// false when the frame draws no IDs.
+bool QGLViewer::attachObjectIdBuffer() {
+  if (!objectIdBufferIsEnabled_ || !objectIdBufferIsSupported_ || renderThread_)
+    return false;
+
+  if (!objectIdBuffer_) {
+    objectIdBuffer_ = new ObjectIdBuffer();
+    if (!objectIdBuffer_->initialize()) {
+      objectIdBufferIsSupported_ = false;
+      return false;
+    }
+  }
+
+  const qreal ratio = devicePixelRatioF();
+  const QSize size(int(ratio * width()), int(ratio * height()));
+  if (!objectIdBuffer_->attach(defaultFramebufferObject(), size)) {
+    qWarning("QGLViewer::setObjectIdBufferIsEnabled: Unable to attach the ID "
+             "buffer, the widget framebuffer is probably multisampled");
+    objectIdBufferIsSupported_ = false;
+    return false;
+  }
+  return true;
+}
+
+// Queues the read back of the ID under the last mouse position. The context
+// must be current.
+void QGLViewer::requestObjectIdUnderCursor() {
+  if ((objectIdCursor_.x() < 0) || !objectIdBuffer_ ||
+      !objectIdBuffer_->isInitialized())
+    return;
+
+  // Qt uses upper corner for its origin while GL uses the lower corner
+  const qreal ratio = devicePixelRatioF();
+  const QPoint pixel(int(ratio * objectIdCursor_.x()),
+                     int(ratio * (height() - objectIdCursor_.y())) - 1);
+  objectIdBuffer_->requestId(pixel);
+  if (objectIdBuffer_->hasPendingId() && !objectIdTimer_.isActive())
+    objectIdTimer_.start(1);
+}
+
+// Polled by objectIdTimer_ until the pending read back is completed.
+void QGLViewer::retrieveObjectIdUnderCursor() {
+  makeCurrent();
+  int id = -1;
+  const bool retrieved = objectIdBuffer_ && objectIdBuffer_->retrieveId(id);
+  const bool pending = objectIdBuffer_ && objectIdBuffer_->hasPendingId();
+  doneCurrent();
+  if (!pending)
+    objectIdTimer_.stop();
+
+  if (retrieved && objectIdBufferIsEnabled_ && (id != objectIdUnderCursor_)) {
+    objectIdUnderCursor_ = id;
+    Q_EMIT objectIdUnderCursorChanged(id);
   }
 }
 
@@ -1306,6 +3125,14 @@ behavior customization using overloading.
 taken into account. This allows for a direct manipulation of the
 manipulatedFrame() when the mouse hovers, which is probably what is expected. */
 void QGLViewer::mousePressEvent(QMouseEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "mousePressEvent");
+  if (routeViewportEvent(e))
+    return;
+
+  postponeRefinement();
+  wakeUp();
+  flushPendingMouseMove();
+
   //#CONNECTION# mouseDoubleClickEvent has the same structure
   //#CONNECTION# mouseString() concatenates bindings description in inverse
   // order.
@@ -1403,7 +3230,37 @@ else
 }
 \endcode */
 void QGLViewer::mouseMoveEvent(QMouseEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "mouseMoveEvent");
+  if (routeViewportEvent(e))
+    return;
+
+  postponeRefinement();
+  wakeUp();
+  // The IDs of the last frame are read back, nothing is drawn
+  if (objectIdBufferIsEnabled_ && objectIdBuffer_) {
+    objectIdCursor_ = e->pos();
+    makeCurrent();
+    requestObjectIdUnderCursor();
+    doneCurrent();
+  }
+  if (framePacingIsEnabled()) {
+    const qint64 time = inputTime_.nsecsElapsed();
+    if (framePending_) {
+      // Coalesced with the following moves until the frame is presented
+      if (!hasPendingMouseMove_)
+        pendingMouseMoveTime_ = time;
+      hasPendingMouseMove_ = true;
+      pendingMouseMovePos_ = e->pos();
+      pendingMouseMoveButtons_ = e->buttons();
+      pendingMouseMoveModifiers_ = e->modifiers();
+      return;
+    }
+    if (latencyStart_ < 0)
+      latencyStart_ = time;
+  }
+
   if (mouseGrabber()) {
+    QGLVIEWER_COUNT(MOUSE_GRABBER_TEST);
     mouseGrabber()->checkIfGrabsMouse(e->x(), e->y(), camera());
     if (mouseGrabber()->grabsMouse())
       if (mouseGrabberIsAManipulatedCameraFrame_)
@@ -1430,19 +3287,115 @@ void QGLViewer::mouseMoveEvent(QMouseEvent *e) {
         manipulatedFrame()->ManipulatedFrame::mouseMoveEvent(e, camera());
       else
         manipulatedFrame()->mouseMoveEvent(e, camera());
-    else if (hasMouseTracking()) {
-      Q_FOREACH (MouseGrabber *mg, MouseGrabber::MouseGrabberPool()) {
-        mg->checkIfGrabsMouse(e->x(), e->y(), camera());
-        if (mg->grabsMouse()) {
-          setMouseGrabber(mg);
-          // Check that MouseGrabber is not disabled
-          if (mouseGrabber() == mg) {
-            update();
-            break;
-          }
+    else if (hasMouseTracking())
+      checkMouseGrabberPool(e->x(), e->y());
+  }
+}
+
+// Sets the first MouseGrabber of the mouseGrabberGroup() that grabs the mouse at (x,y) as
+// the mouseGrabber(). Only the indexed candidates are tested when
+// mouseGrabberIndexIsEnabled(), in the same pool order.
+void QGLViewer::checkMouseGrabberPool(int x, int y) {
+  if (!mouseGrabberIndexIsEnabled()) {
+    Q_FOREACH (MouseGrabber *mg, mouseGrabberGroup()->mouseGrabbers()) {
+      QGLVIEWER_COUNT(MOUSE_GRABBER_TEST);
+      mg->checkIfGrabsMouse(x, y, camera());
+      if (mg->grabsMouse()) {
+        setMouseGrabber(mg);
+        // Check that MouseGrabber is not disabled
+        if (mouseGrabber() == mg) {
+          update();
+          break;
         }
       }
     }
+    return;
+  }
+
+  updateMouseGrabberIndex();
+
+  int cell = -1;
+  if ((x >= 0) && (y >= 0) && (x < width()) && (y < height()))
+    cell = (y / mouseGrabberCellSize) * mouseGrabberIndexColumns_ +
+           x / mouseGrabberCellSize;
+
+  // The candidates of the previous cell are tested again so that they can
+  // release their grabsMouse() flag.
+  const QVector<int> empty;
+  const QVector<int> &current = (cell >= 0) ? mouseGrabberCells_[cell] : empty;
+  const QVector<int> &previous =
+      ((previousMouseGrabberCell_ >= 0) && (previousMouseGrabberCell_ != cell))
+          ? mouseGrabberCells_[previousMouseGrabberCell_]
+          : empty;
+  previousMouseGrabberCell_ = cell;
+
+  QVector<int> bounded, candidates;
+  std::set_union(current.begin(), current.end(), previous.begin(),
+                 previous.end(), std::back_inserter(bounded));
+  std::set_union(bounded.begin(), bounded.end(),
+                 unboundedMouseGrabbers_.begin(), unboundedMouseGrabbers_.end(),
+                 std::back_inserter(candidates));
+
+  Q_FOREACH (int index, candidates) {
+    MouseGrabber *const mg = indexedMouseGrabbers_[index];
+    QGLVIEWER_COUNT(MOUSE_GRABBER_TEST);
+    mg->checkIfGrabsMouse(x, y, camera());
+    if (mg->grabsMouse()) {
+      setMouseGrabber(mg);
+      // Check that MouseGrabber is not disabled
+      if (mouseGrabber() == mg) {
+        update();
+        break;
+      }
+    }
+  }
+}
+
+// Rebuilds the grid of mouseGrabberCells_ when the pool, a mouseGrabRegion(),
+// the camera matrices or the viewer size changed since the last build.
+void QGLViewer::updateMouseGrabberIndex() {
+  GLdouble matrix[16];
+  camera()->getModelViewProjectionMatrix(matrix);
+
+  const int columns = (width() + mouseGrabberCellSize - 1) / mouseGrabberCellSize;
+  const int rows = (height() + mouseGrabberCellSize - 1) / mouseGrabberCellSize;
+
+  if (mouseGrabberIndexIsValid_ &&
+      (mouseGrabberIndexRevision_ == MouseGrabber::poolRevision_) &&
+      (columns == mouseGrabberIndexColumns_) &&
+      (rows == mouseGrabberIndexRows_) &&
+      std::equal(matrix, matrix + 16, mouseGrabberIndexMatrix_))
+    return;
+
+  std::copy(matrix, matrix + 16, mouseGrabberIndexMatrix_);
+  mouseGrabberIndexRevision_ = MouseGrabber::poolRevision_;
+  mouseGrabberIndexColumns_ = columns;
+  mouseGrabberIndexRows_ = rows;
+  mouseGrabberIndexIsValid_ = true;
+  previousMouseGrabberCell_ = -1;
+
+  indexedMouseGrabbers_ = mouseGrabberGroup()->mouseGrabbers().toVector();
+  mouseGrabberCells_.fill(QVector<int>(), columns * rows);
+  unboundedMouseGrabbers_.clear();
+
+  const QRect viewport(0, 0, width(), height());
+  for (int i = 0; i < indexedMouseGrabbers_.size(); ++i) {
+    QRect region;
+    if (!indexedMouseGrabbers_[i]->mouseGrabRegion(camera(), region)) {
+      unboundedMouseGrabbers_.append(i);
+      continue;
+    }
+
+    region &= viewport;
+    if (region.isEmpty())
+      continue;
+
+    // Indexes are appended in pool order: cells remain sorted
+    for (int y = region.top() / mouseGrabberCellSize;
+         y <= region.bottom() / mouseGrabberCellSize; ++y)
+      for (int x = region.left() / mouseGrabberCellSize;
+           x <= region.right() / mouseGrabberCellSize; ++x)
+        mouseGrabberCells_[y * columns + x].append(i);
   }
 }
 
@@ -1454,12 +3407,19 @@ method.
 See the mouseMoveEvent() documentation for an example of mouse behavior
 customization. */
 void QGLViewer::mouseReleaseEvent(QMouseEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "mouseReleaseEvent");
+  if (routeViewportEvent(e))
+    return;
+
+  flushPendingMouseMove();
+
   if (mouseGrabber()) {
     if (mouseGrabberIsAManipulatedCameraFrame_)
       (dynamic_cast<ManipulatedFrame *>(mouseGrabber()))
           ->ManipulatedFrame::mouseReleaseEvent(e, camera());
     else
       mouseGrabber()->mouseReleaseEvent(e, camera());
+    QGLVIEWER_COUNT(MOUSE_GRABBER_TEST);
     mouseGrabber()->checkIfGrabsMouse(e->x(), e->y(), camera());
     if (!(mouseGrabber()->grabsMouse()))
       setMouseGrabber(nullptr);
@@ -1486,6 +3446,12 @@ void QGLViewer::mouseReleaseEvent(QMouseEvent *e) {
 If defined, the wheel event is sent to the mouseGrabber(). It is otherwise sent
 according to wheel bindings (see setWheelBinding()). */
 void QGLViewer::wheelEvent(QWheelEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "wheelEvent");
+  if (routeViewportEvent(e))
+    return;
+
+  postponeRefinement();
+  wakeUp();
   if (mouseGrabber()) {
     if (mouseGrabberIsAManipulatedFrame_) {
       for (QMap<WheelBindingPrivate, MouseActionPrivate>::ConstIterator
@@ -1542,6 +3508,10 @@ void QGLViewer::wheelEvent(QWheelEvent *e) {
 The behavior of the mouse double click depends on the mouse binding. See
 setMouseBinding() and the <a href="../mouse.html">mouse page</a>. */
 void QGLViewer::mouseDoubleClickEvent(QMouseEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "mouseDoubleClickEvent");
+  if (routeViewportEvent(e))
+    return;
+
   //#CONNECTION# mousePressEvent has the same structure
   ClickBindingPrivate cbp(e->modifiers(), e->button(), true,
                           static_cast<Qt::MouseButtons>(e->buttons() & ~(e->button())),
@@ -1580,6 +3550,12 @@ void QGLViewer::setStereoDisplay(bool stereo) {
     stereo_ = false;
 }
 
+/*! Sets the stereoIsSinglePass() value. */
+void QGLViewer::setStereoIsSinglePass(bool singlePass) {
+  stereoIsSinglePass_ = singlePass;
+  update();
+}
+
 /*! Sets the isFullScreen() state.
 
 If the QGLViewer is embedded in an other QWidget (see
@@ -1623,6 +3599,33 @@ void QGLViewer::setMouseGrabber(MouseGrabber *mouseGrabber) {
   Q_EMIT mouseGrabberChanged(mouseGrabber);
 }
 
+/*! Sets the mouseGrabberGroup(). A \c nullptr \p group restores the
+qglviewer::MouseGrabber::defaultMouseGrabberGroup().
+
+The current mouseGrabber() is released if it does not belong to \p group.
+\p group must outlive the viewer, or be replaced before it is deleted. */
+void QGLViewer::setMouseGrabberGroup(MouseGrabberGroup *group) {
+  if (!group)
+    group = MouseGrabber::defaultMouseGrabberGroup();
+
+  mouseGrabberGroup_ = group;
+  mouseGrabberIndexIsValid_ = false;
+
+  if (mouseGrabber() && !group->contains(mouseGrabber()))
+    setMouseGrabber(nullptr);
+}
+
+/*! Sets the mouseGrabberIndexIsEnabled() state. */
+void QGLViewer::setMouseGrabberIndexIsEnabled(bool enabled) {
+  mouseGrabberIndexIsEnabled_ = enabled;
+  mouseGrabberIndexIsValid_ = false;
+  if (!enabled) {
+    indexedMouseGrabbers_.clear();
+    mouseGrabberCells_.clear();
+    unboundedMouseGrabbers_.clear();
+  }
+}
+
 /*! Sets the mouseGrabberIsEnabled() state. */
 void QGLViewer::setMouseGrabberIsEnabled(
     const qglviewer::MouseGrabber *const mouseGrabber, bool enabled) {
@@ -2245,6 +4248,9 @@ illustration.
 
 See also QOpenGLWidget::keyReleaseEvent(). */
 void QGLViewer::keyPressEvent(QKeyEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "keyPressEvent");
+  postponeRefinement();
+  wakeUp();
   if (e->key() == 0) {
     e->ignore();
     return;
@@ -2324,6 +4330,7 @@ void QGLViewer::keyPressEvent(QKeyEvent *e) {
 }
 
 void QGLViewer::keyReleaseEvent(QKeyEvent *e) {
+  QGLVIEWER_TRACE_SCOPE("input", "keyReleaseEvent");
   if (isValidShortcutKey(e->key()))
     currentlyPressedKey_ = Qt::Key(0);
 }
@@ -2411,7 +4418,10 @@ the widget is created, before its first display. */
 void QGLViewer::resizeGL(int width, int height) {
   QOpenGLWidget::resizeGL(width, height);
   glViewport(0, 0, GLint(width), GLint(height));
-  camera()->setScreenWidthAndHeight(this->width(), this->height());
+  if (viewports_.isEmpty())
+    camera()->setScreenWidthAndHeight(this->width(), this->height());
+  else
+    updateViewports();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -3359,14 +5369,338 @@ void QGLViewer::toggleCameraMode() {
 //              M a n i p u l a t e d   f r a m e s                           //
 ////////////////////////////////////////////////////////////////////////////////
 
-/*! Sets the viewer's manipulatedFrame().
+/*! Sets the sceneResources() shared with the other viewers. Use \c nullptr
+to stop sharing. See qglviewer::SceneResources::addViewer(). */
+void QGLViewer::setSceneResources(SceneResources *resources) {
+  if (resources)
+    resources->addViewer(this);
+  else if (sceneResources_)
+    sceneResources_->removeViewer(this);
+}
 
-Several objects can be manipulated simultaneously, as is done the <a
-href="../examples/multiSelect.html">multiSelect example</a>.
+/*! Sets the occlusionCuller(). Its beginFrame() method is then called by
+preDraw(), and its endFrame() method by postDraw(). The culler is not owned by
+the viewer, but its OpenGL resources are released with the viewer context. Use
+\c nullptr to stop using occlusion queries.
 
-Defining the \e own viewer's camera()->frame() as the manipulatedFrame() is
-possible and will result in a classical camera manipulation. See the <a
-href="../examples/luxo.html">luxo example</a> for an illustration.
+The culler must only be used by one viewer, without viewports (see
+addViewport()) nor stereo. See the qglviewer::OcclusionCuller documentation. */
+void QGLViewer::setOcclusionCuller(OcclusionCuller *culler) {
+  if (culler == occlusionCuller_)
+    return;
+  if (occlusionCuller_ && isValid()) {
+    makeCurrent();
+    occlusionCuller_->cleanupGL();
+    doneCurrent();
+  }
+  occlusionCuller_ = culler;
+  update();
+}
+
+/*! Sets the clippingRegion(). Its planes are then enabled by preDraw() for
+draw(), and disabled by postDraw(). The region is not owned by the viewer. Use
+\c nullptr to stop clipping.
+
+In a core profile context, the shaders of draw() compute the clip distances:
+see qglviewer::ClippingRegion::vertexShaderCode(). Use
+qglviewer::FrustumCuller::computeVisibleObjects() with the region to skip the
+objects that are entirely clipped. */
+void QGLViewer::setClippingRegion(ClippingRegion *region) {
+  if (region == clippingRegion_)
+    return;
+  if (clippingRegion_ && isValid()) {
+    makeCurrent();
+    clippingRegion_->disable();
+    doneCurrent();
+  }
+  clippingRegion_ = region;
+  update();
+}
+
+/*! Sets the sceneBounds(). preDraw() then calls
+qglviewer::SceneBounds::updateCamera() before the camera() matrices are
+loaded, so that sceneCenter() and sceneRadius() follow the moving objects. The
+bounds are not owned by the viewer. Use \c nullptr to set the scene radius
+and center manually again. */
+void QGLViewer::setSceneBounds(SceneBounds *bounds) {
+  sceneBounds_ = bounds;
+  update();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Viewports                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds a viewport, where \p camera displays the scene in \p region. Returns
+the index of the new viewport, or -1 if \p camera is \c nullptr.
+
+\p region is expressed in normalized widget coordinates: (0,0) is the upper
+left corner of the widget and (1,1) its lower right corner, so that the layout
+follows the widget size. For instance, a classical four views layout is given
+by:
+\code
+addViewport(topCamera, QRectF(0.0, 0.0, 0.5, 0.5));
+addViewport(frontCamera, QRectF(0.5, 0.0, 0.5, 0.5));
+addViewport(sideCamera, QRectF(0.0, 0.5, 0.5, 0.5));
+addViewport(perspectiveCamera, QRectF(0.5, 0.5, 0.5, 0.5));
+\endcode
+
+All the viewports are drawn by a single paintGL(), in the same framebuffer:
+preDraw(), draw() (or fastDraw()) and postDraw() are called for each viewport,
+with a \c glViewport and \c glScissor restricted to its region, and with
+camera() returning its Camera. Stereo display, levels of detail and
+progressive refinement are not used with viewports. The frame rate and the
+displayMessage() are displayed in the last viewport.
+
+The mouse events are sent to the viewport under the cursor, which becomes the
+currentViewport(): camera() then returns its Camera, and event coordinates are
+relative to the upper left corner of the viewport. Keyboard events are sent to
+the currentViewport().
+
+The Camera screen dimensions and qglviewer::Camera::screenOffsetX() are fitted
+to the viewport region. A Camera can hence be used by at most one viewport.
+Cameras are not deleted by the viewer. */
+int QGLViewer::addViewport(Camera *camera, const QRectF &region) {
+  if (!camera)
+    return -1;
+
+  if (viewports_.isEmpty())
+    ownCamera_ = camera_;
+
+  Viewport viewport;
+  viewport.camera = camera;
+  viewport.region = region;
+  viewports_.append(viewport);
+
+  connect(camera->frame(), SIGNAL(manipulated()), SLOT(update()),
+          Qt::UniqueConnection);
+  connect(camera->frame(), SIGNAL(spun()), SLOT(update()),
+          Qt::UniqueConnection);
+  connect(camera->interpolationKfi_, SIGNAL(interpolated()), SLOT(update()),
+          Qt::UniqueConnection);
+  camera->setDevicePixelRatio(screen()->devicePixelRatio());
+  camera->setAnimationClock(animationClock());
+
+  if (currentViewport_ < 0) {
+    currentViewport_ = 0;
+    camera_ = camera;
+  }
+
+  updateViewports();
+  update();
+  return viewports_.size() - 1;
+}
+
+/*! Removes the viewport \p index. Its Camera is not deleted. When the last
+viewport is removed, camera() returns the viewer's camera again. */
+void QGLViewer::removeViewport(int index) {
+  if ((index < 0) || (index >= viewports_.size()))
+    return;
+
+  Camera *const camera = viewports_.at(index).camera;
+  viewports_.removeAt(index);
+
+  bool used = (camera == ownCamera_);
+  for (int i = 0; i < viewports_.size(); ++i)
+    used = used || (viewports_.at(i).camera == camera);
+  if (!used) {
+    disconnect(camera->frame(), SIGNAL(manipulated()), this, SLOT(update()));
+    disconnect(camera->frame(), SIGNAL(spun()), this, SLOT(update()));
+    disconnect(camera->interpolationKfi_, SIGNAL(interpolated()), this,
+               SLOT(update()));
+  }
+
+  if (viewports_.isEmpty()) {
+    camera_ = ownCamera_;
+    currentViewport_ = -1;
+    camera_->setScreenWidthAndHeight(width(), height());
+    camera_->setScreenOffset(0, 0);
+  } else {
+    if ((currentViewport_ >= index) && (currentViewport_ > 0))
+      --currentViewport_;
+    camera_ = viewports_.at(currentViewport_).camera;
+    updateViewports();
+  }
+
+  update();
+}
+
+/*! Removes all the viewports. See removeViewport(). */
+void QGLViewer::clearViewports() {
+  while (!viewports_.isEmpty())
+    removeViewport(viewports_.size() - 1);
+}
+
+/*! Returns the region of the viewport \p index in the widget, in pixels. An
+empty rectangle is returned for an invalid \p index. */
+QRect QGLViewer::viewportRegion(int index) const {
+  if ((index < 0) || (index >= viewports_.size()))
+    return QRect();
+
+  const QRectF &r = viewports_.at(index).region;
+  const int left = qRound(r.left() * width());
+  const int right = qRound(r.right() * width());
+  const int top = qRound(r.top() * height());
+  const int bottom = qRound(r.bottom() * height());
+  return QRect(left, top, right - left, bottom - top);
+}
+
+/*! Returns the index of the viewport that contains \p pos (in widget
+coordinates), or -1. The last added viewport is returned when several
+overlap. */
+int QGLViewer::viewportAt(const QPoint &pos) const {
+  for (int i = viewports_.size() - 1; i >= 0; --i)
+    if (viewportRegion(i).contains(pos))
+      return i;
+  return -1;
+}
+
+/*! Makes \p index the currentViewport(): camera() then returns its Camera.
+
+This is automatically done when a mouse event occurs in a viewport. Invalid
+indexes are ignored. */
+void QGLViewer::setCurrentViewport(int index) {
+  if ((index < 0) || (index >= viewports_.size()) ||
+      (index == currentViewport_))
+    return;
+
+  currentViewport_ = index;
+  camera_ = viewports_.at(index).camera;
+}
+
+// Fits the viewports' cameras to their region. Called when the widget or the
+// layout are modified.
+void QGLViewer::updateViewports() {
+  for (int i = 0; i < viewports_.size(); ++i) {
+    const QRect region = viewportRegion(i);
+    viewports_.at(i).camera->setScreenWidthAndHeight(region.width(),
+                                                     region.height());
+    viewports_.at(i).camera->setScreenOffset(
+        region.x(), height() - region.y() - region.height());
+  }
+}
+
+// Restricts the OpenGL viewport and scissor to the viewport index.
+void QGLViewer::applyViewport(int index) {
+  const QRect region = viewportRegion(index);
+  const qreal ratio = devicePixelRatioF();
+  const GLint x = qRound(ratio * region.x());
+  const GLint y = qRound(ratio * (height() - region.y() - region.height()));
+  const GLsizei w = qRound(ratio * region.width());
+  const GLsizei h = qRound(ratio * region.height());
+  glViewport(x, y, w, h);
+  glScissor(x, y, w, h);
+  viewportOffset_ = region.topLeft();
+}
+
+// Draws all the viewports. Called by paintGL().
+void QGLViewer::paintViewports() {
+  Camera *const current = camera_;
+  const qreal ratio = devicePixelRatioF();
+
+  // Space between the viewports
+  glDisable(GL_SCISSOR_TEST);
+  glViewport(0, 0, qRound(ratio * width()), qRound(ratio * height()));
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glEnable(GL_SCISSOR_TEST);
+  for (int i = 0; i < viewports_.size(); ++i) {
+    paintedViewport_ = i;
+    camera_ = viewports_.at(i).camera;
+    applyViewport(i);
+
+    // Clears the viewport, set its model view matrix...
+    preDraw();
+    if (camera()->frame()->isManipulated())
+      fastDraw();
+    else
+      draw();
+    postDraw();
+  }
+  glDisable(GL_SCISSOR_TEST);
+  glViewport(0, 0, qRound(ratio * width()), qRound(ratio * height()));
+
+  paintedViewport_ = -1;
+  viewportOffset_ = QPoint();
+  camera_ = current;
+}
+
+// Sends e to the QGLViewer handler of its type, with a position relative to
+// the current viewport, which is first updated. Returns false when there are
+// no viewports, or when e is already relative.
+bool QGLViewer::routeViewportEvent(QMouseEvent *e) {
+  if (viewports_.isEmpty() || viewportEventIsLocal_)
+    return false;
+
+  // The viewport under the cursor becomes current, unless a drag is in
+  // progress in the current one
+  const Qt::MouseButtons otherButtons =
+      (e->type() == QEvent::MouseMove) ? e->buttons()
+                                        : (e->buttons() & ~e->button());
+  if ((e->type() != QEvent::MouseButtonRelease) &&
+      (otherButtons == Qt::NoButton))
+    setCurrentViewport(viewportAt(e->pos()));
+
+  const QPoint offset = viewportRegion(currentViewport_).topLeft();
+  QMouseEvent local(e->type(), QPointF(e->pos() - offset), e->button(),
+                    e->buttons(), e->modifiers());
+
+  // Not virtual: overloaded handlers already saw the original event
+  viewportEventIsLocal_ = true;
+  switch (e->type()) {
+  case QEvent::MouseButtonPress:
+    QGLViewer::mousePressEvent(&local);
+    break;
+  case QEvent::MouseButtonRelease:
+    QGLViewer::mouseReleaseEvent(&local);
+    break;
+  case QEvent::MouseButtonDblClick:
+    QGLViewer::mouseDoubleClickEvent(&local);
+    break;
+  default:
+    QGLViewer::mouseMoveEvent(&local);
+    break;
+  }
+  viewportEventIsLocal_ = false;
+
+  e->setAccepted(local.isAccepted());
+  return true;
+}
+
+bool QGLViewer::routeViewportEvent(QWheelEvent *e) {
+  if (viewports_.isEmpty() || viewportEventIsLocal_)
+    return false;
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  const QPoint pos = e->pos();
+  const QPointF globalPos = e->globalPosF();
+#else
+  const QPoint pos = e->position().toPoint();
+  const QPointF globalPos = e->globalPosition();
+#endif
+  setCurrentViewport(viewportAt(pos));
+
+  const QPoint offset = viewportRegion(currentViewport_).topLeft();
+  QWheelEvent local(QPointF(pos - offset), globalPos, e->pixelDelta(),
+                    e->angleDelta(), e->buttons(), e->modifiers(), e->phase(),
+                    e->inverted());
+
+  viewportEventIsLocal_ = true;
+  QGLViewer::wheelEvent(&local);
+  viewportEventIsLocal_ = false;
+
+  e->setAccepted(local.isAccepted());
+  return true;
+}
+
+/*! Sets the viewer's manipulatedFrame().
+
+Several objects can be manipulated simultaneously, as is done the <a
+href="../examples/multiSelect.html">multiSelect example</a>.
+
+Defining the \e own viewer's camera()->frame() as the manipulatedFrame() is
+possible and will result in a classical camera manipulation. See the <a
+href="../examples/luxo.html">luxo example</a> for an illustration.
 
 Note that a qglviewer::ManipulatedCameraFrame can be set as the
 manipulatedFrame(): it is possible to manipulate the camera of a first viewer in
@@ -3379,6 +5713,9 @@ void QGLViewer::setManipulatedFrame(ManipulatedFrame *frame) {
       disconnect(manipulatedFrame(), SIGNAL(manipulated()), this,
                  SLOT(update()));
       disconnect(manipulatedFrame(), SIGNAL(spun()), this, SLOT(update()));
+      // Unless its bounding box was given by the application
+      if (!sceneFrameBounds_.contains(manipulatedFrame()))
+        removeSceneFrame(manipulatedFrame());
     }
   }
 
@@ -3394,6 +5731,9 @@ void QGLViewer::setManipulatedFrame(ManipulatedFrame *frame) {
     if (manipulatedFrame() != camera()->frame()) {
       connect(manipulatedFrame(), SIGNAL(manipulated()), SLOT(update()));
       connect(manipulatedFrame(), SIGNAL(spun()), SLOT(update()));
+      // Its motion modifies the cached scene of the retained mode
+      addSceneFrame(manipulatedFrame());
+      manipulatedFrame()->setAnimationClock(animationClock());
     }
   }
 }
@@ -3424,16 +5764,16 @@ void QGLViewer::drawVisualHints() {
     const qreal size = 15.0;
     Vec proj = camera()->projectedCoordinatesOf(camera()->pivotPoint());
     startScreenCoordinatesSystem();
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(3.0);
+    glStateCache_->disable(GL_LIGHTING);
+    glStateCache_->disable(GL_DEPTH_TEST);
+    glStateCache_->setLineWidth(3.0f);
     glBegin(GL_LINES);
     glVertex2d(proj.x - size, proj.y);
     glVertex2d(proj.x + size, proj.y);
     glVertex2d(proj.x, proj.y - size);
     glVertex2d(proj.x, proj.y + size);
     glEnd();
-    glEnable(GL_DEPTH_TEST);
+    glStateCache_->enable(GL_DEPTH_TEST);
     stopScreenCoordinatesSystem();
   }
 
@@ -3457,23 +5797,23 @@ void QGLViewer::drawVisualHints() {
   if (mf) {
     pnt = camera()->projectedCoordinatesOf(pnt);
     startScreenCoordinatesSystem();
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(3.0);
+    glStateCache_->disable(GL_LIGHTING);
+    glStateCache_->disable(GL_DEPTH_TEST);
+    glStateCache_->setLineWidth(3.0f);
     glBegin(GL_LINES);
     glVertex2d(pnt.x, pnt.y);
     glVertex2i(mf->prevPos_.x(), mf->prevPos_.y());
     glEnd();
-    glEnable(GL_DEPTH_TEST);
+    glStateCache_->enable(GL_DEPTH_TEST);
     stopScreenCoordinatesSystem();
   }
 
   // Zoom on region: draw a rectangle
   if (camera()->frame()->action_ == ZOOM_ON_REGION) {
     startScreenCoordinatesSystem();
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(2.0);
+    glStateCache_->disable(GL_LIGHTING);
+    glStateCache_->disable(GL_DEPTH_TEST);
+    glStateCache_->setLineWidth(2.0f);
     glBegin(GL_LINE_LOOP);
     glVertex2i(camera()->frame()->pressPos_.x(),
                camera()->frame()->pressPos_.y());
@@ -3484,7 +5824,7 @@ void QGLViewer::drawVisualHints() {
     glVertex2i(camera()->frame()->pressPos_.x(),
                camera()->frame()->prevPos_.y());
     glEnd();
-    glEnable(GL_DEPTH_TEST);
+    glStateCache_->enable(GL_DEPTH_TEST);
     stopScreenCoordinatesSystem();
   }
 }
@@ -3507,6 +5847,155 @@ void QGLViewer::resetVisualHints() { visualHint_ = 0; }
 //       A x i s   a n d   G r i d   d i s p l a y   l i s t s                //
 ////////////////////////////////////////////////////////////////////////////////
 
+/*! Draws an axis (see drawAxis()) for each of the \p matrices, which are
+multiplied to the current modelView matrix, the way \c glMultMatrix would.
+
+This is equivalent to the following code, but all the axes are drawn by a few
+instanced draw calls, which is much faster for thousands of axes:
+\code
+for (const QMatrix4x4 &matrix : matrices) {
+  glPushMatrix();
+  glMultMatrixf(matrix.constData());
+  QGLViewer::drawAxis(length);
+  glPopMatrix();
+}
+\endcode
+
+Instanced rendering requires OpenGL 3.3 (or OpenGL ES 3.0), otherwise the
+above loop is used. The current color is used for the X, Y and Z characters
+(foregroundColor() in a core profile). The OpenGL state is not modified. */
+void QGLViewer::drawAxes(const QVector<QMatrix4x4> &matrices, qreal length) {
+  GlyphRenderer *renderer = glyphRenderer();
+  if (!renderer) {
+    if (format().profile() == QSurfaceFormat::CoreProfile)
+      return;
+    for (const QMatrix4x4 &matrix : matrices) {
+      glPushMatrix();
+      glMultMatrixf(matrix.constData());
+      QGLViewer::drawAxis(length);
+      glPopMatrix();
+    }
+    return;
+  }
+
+  QMatrix4x4 modelView, projection;
+  QColor color;
+  getCurrentMatrices(modelView, projection, color);
+  renderer->drawAxes(modelView, projection, matrices, float(length), color,
+                     true);
+}
+
+/*! Draws each of the \p cameras (see qglviewer::Camera::draw()) with the same
+\p drawFarPlane and \p scale parameters. The current modelView matrix should
+correspond to the world coordinate system.
+
+The frustums of all the cameras are drawn by a few instanced draw calls, which
+is much faster than calling qglviewer::Camera::draw() for each of them. Unlike
+qglviewer::Camera::draw(), the up arrow uses the current polygon mode.
+
+Instanced rendering requires OpenGL 3.3 (or OpenGL ES 3.0), otherwise
+qglviewer::Camera::draw() is called for each camera. The current color is used
+(foregroundColor() in a core profile), with a head light when \c GL_LIGHTING
+is enabled. */
+void QGLViewer::drawCameras(const QVector<const Camera *> &cameras,
+                            bool drawFarPlane, qreal scale) {
+  GlyphRenderer *renderer = glyphRenderer();
+  if (!renderer) {
+    if (format().profile() == QSurfaceFormat::CoreProfile)
+      return;
+    for (const Camera *camera : cameras)
+      camera->draw(drawFarPlane, scale);
+    return;
+  }
+
+  QMatrix4x4 modelView, projection;
+  QColor color;
+  getCurrentMatrices(modelView, projection, color);
+  const bool lit = (format().profile() == QSurfaceFormat::CoreProfile) ||
+                   GLStateCache::current()->isEnabled(GL_LIGHTING);
+  renderer->drawCameras(modelView, projection, cameras, drawFarPlane,
+                        float(scale), color, lit);
+}
+
+// Builds the shader programs that the next frames will use, after init() since
+// it may enable them. Called by initializeGL().
+void QGLViewer::warmUpShaders() {
+  // Silently, the helpers warn about unsupported contexts
+  const QSurfaceFormat format = context()->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context()->isOpenGLES() ? 30 : 33))
+    return;
+
+  glyphRenderer();
+  lineRenderer();
+  if (reprojectionIsEnabled() && !temporalReprojector_) {
+    temporalReprojector_ = new TemporalReprojector();
+    if (!temporalReprojector_->initialize())
+      reprojectionIsSupported_ = false;
+  }
+}
+
+// Returns the GlyphRenderer used by drawAxes() and drawCameras(), created on
+// first use. Returns nullptr when instanced rendering is not supported.
+GlyphRenderer *QGLViewer::glyphRenderer() {
+  if (!glyphRenderer_ && glyphRendererIsSupported_) {
+    glyphRenderer_ = new GlyphRenderer();
+    if (!glyphRenderer_->initialize()) {
+      delete glyphRenderer_;
+      glyphRenderer_ = nullptr;
+      glyphRendererIsSupported_ = false;
+    } else
+      glyphRenderer_->setFrameRingBuffer(frameRingBuffer());
+  }
+  return glyphRenderer_;
+}
+
+// Returns the LineRenderer made current() during paintGL(), for drawGrid() and
+// the other helpers, created on first use. Returns nullptr, silently, when the
+// context does not support it: the helpers then use GL_LINES.
+LineRenderer *QGLViewer::lineRenderer() {
+  if (!lineRenderer_ && lineRendererIsSupported_) {
+    const QSurfaceFormat format = context()->format();
+    const int version = 10 * format.majorVersion() + format.minorVersion();
+    lineRendererIsSupported_ = version >= (context()->isOpenGLES() ? 30 : 33);
+    if (lineRendererIsSupported_) {
+      lineRenderer_ = new LineRenderer();
+      if (!lineRenderer_->initialize()) {
+        delete lineRenderer_;
+        lineRenderer_ = nullptr;
+        lineRendererIsSupported_ = false;
+      } else {
+        // The helpers replace its segments at each call
+        lineRenderer_->setFrameRingBuffer(frameRingBuffer());
+      }
+    }
+  }
+  return lineRenderer_;
+}
+
+// The matrices and color that drawAxis() would use: the current fixed
+// function state, or the camera() and foregroundColor() in a core profile.
+void QGLViewer::getCurrentMatrices(QMatrix4x4 &modelView,
+                                   QMatrix4x4 &projection,
+                                   QColor &color) const {
+  GLfloat m[16];
+  if (format().profile() == QSurfaceFormat::CoreProfile) {
+    camera()->getModelViewMatrix(m);
+    modelView = QMatrix4x4(m).transposed();
+    camera()->getProjectionMatrix(m);
+    projection = QMatrix4x4(m).transposed();
+    color = foregroundColor();
+    return;
+  }
+
+  glGetFloatv(GL_MODELVIEW_MATRIX, m);
+  modelView = QMatrix4x4(m).transposed();
+  glGetFloatv(GL_PROJECTION_MATRIX, m);
+  projection = QMatrix4x4(m).transposed();
+  glGetFloatv(GL_CURRENT_COLOR, m);
+  color = QColor::fromRgbF(m[0], m[1], m[2], m[3]);
+}
+
 /*! Draws a 3D arrow along the positive Z axis.
 
 \p length, \p radius and \p nbSubdivisions define its geometry. If \p radius is
@@ -3570,11 +6059,11 @@ void QGLViewer::drawAxis(qreal length) {
   const qreal charHeight = length / 30.0;
   const qreal charShift = 1.04 * length;
 
-  GLboolean lighting, colorMaterial;
-  glGetBooleanv(GL_LIGHTING, &lighting);
-  glGetBooleanv(GL_COLOR_MATERIAL, &colorMaterial);
+  GLStateCache *const state = GLStateCache::current();
+  const bool lighting = state->isEnabled(GL_LIGHTING);
+  const bool colorMaterial = state->isEnabled(GL_COLOR_MATERIAL);
 
-  glDisable(GL_LIGHTING);
+  state->disable(GL_LIGHTING);
 
   glBegin(GL_LINES);
   // The X
@@ -3598,8 +6087,8 @@ void QGLViewer::drawAxis(qreal length) {
   glVertex3d(charWidth, -charHeight, charShift);
   glEnd();
 
-  glEnable(GL_LIGHTING);
-  glDisable(GL_COLOR_MATERIAL);
+  state->enable(GL_LIGHTING);
+  state->disable(GL_COLOR_MATERIAL);
 
   float color[4];
   color[0] = 0.7f;
@@ -3630,9 +6119,9 @@ void QGLViewer::drawAxis(qreal length) {
   glPopMatrix();
 
   if (colorMaterial)
-    glEnable(GL_COLOR_MATERIAL);
+    state->enable(GL_COLOR_MATERIAL);
   if (!lighting)
-    glDisable(GL_LIGHTING);
+    state->disable(GL_LIGHTING);
 }
 
 /*! Draws a grid in the XY plane, centered on (0,0,0) (defined in the current
@@ -3642,12 +6131,36 @@ coordinate system).
 GL_MODELVIEW matrix to place and orientate the grid in 3D space (see the
 drawAxis() documentation).
 
+The current color and line width are used. The lines are drawn by the
+qglviewer::LineRenderer::current() renderer, anti-aliased and not limited by the
+implementation line widths, when there is one (during QGLViewer::paintGL()).
+
 The OpenGL state is not modified by this method. */
 void QGLViewer::drawGrid(qreal size, int nbSubdivisions) {
-  GLboolean lighting;
-  glGetBooleanv(GL_LIGHTING, &lighting);
+  GLStateCache *const state = GLStateCache::current();
+  LineRenderer *const lines = LineRenderer::current();
+  if (lines) {
+    GLfloat color[4];
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    const QColor lineColor =
+        QColor::fromRgbF(color[0], color[1], color[2], color[3]);
+    const float width = state->lineWidth();
+    lines->clear();
+    lines->reserve(2 * (nbSubdivisions + 1));
+    for (int i = 0; i <= nbSubdivisions; ++i) {
+      const qreal pos = size * (2.0 * i / nbSubdivisions - 1.0);
+      lines->addSegment(Vec(pos, -size, 0.0), Vec(pos, size, 0.0), width,
+                        lineColor);
+      lines->addSegment(Vec(-size, pos, 0.0), Vec(size, pos, 0.0), width,
+                        lineColor);
+    }
+    lines->draw();
+    return;
+  }
 
-  glDisable(GL_LIGHTING);
+  const bool lighting = state->isEnabled(GL_LIGHTING);
+
+  state->disable(GL_LIGHTING);
 
   glBegin(GL_LINES);
   for (int i = 0; i <= nbSubdivisions; ++i) {
@@ -3660,7 +6173,7 @@ void QGLViewer::drawGrid(qreal size, int nbSubdivisions) {
   glEnd();
 
   if (lighting)
-    glEnable(GL_LIGHTING);
+    state->enable(GL_LIGHTING);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3711,20 +6224,39 @@ QString QGLViewer::stateFileName() const {
   return name;
 }
 
+// Binary state files start with this magic number ("QGLB") and format version.
+// Since the magic number is not valid XML, restoreStateFromFile() uses it to
+// detect the format of the file.
+static const quint32 binaryStateMagic = 0x51474C42;
+static const quint16 binaryStateVersion = 1;
+
+// Sets the stream version and floating point precision of the binary state
+// files, so that they do not depend on the Qt version nor on the Real type.
+static void setBinaryStateStreamFormat(QDataStream &stream) {
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
 /*! Saves in stateFileName() an XML representation of the QGLViewer state,
-obtained from domElement().
+obtained from domElement(). A compact binary representation, obtained from
+writeBinary(), is saved instead when stateFileIsBinary().
 
 Use restoreStateFromFile() to restore this viewer state.
 
 This method is automatically called when a viewer is closed (using Escape or
 using the window's upper right \c x close button). setStateFileName() to \c
-QString::null to prevent this. */
+QString::null to prevent this.
+
+The camera() keyFrame paths of a pending deferred restoreStateFromFile() (see
+stateRestorationIsDeferred()) are applied first, so that they are saved. */
 void QGLViewer::saveStateToFile() {
   QString name = stateFileName();
 
   if (name.isEmpty())
     return;
 
+  flushDeferredState();
+
   QFileInfo fileInfo(name);
 
   if (fileInfo.isDir()) {
@@ -3746,13 +6278,20 @@ void QGLViewer::saveStateToFile() {
     }
   }
 
-  // Write the DOM tree to file
+  // Write the DOM tree (or the binary state) to file
   QFile f(name);
   if (f.open(QIODevice::WriteOnly)) {
-    QTextStream out(&f);
-    QDomDocument doc("QGLVIEWER");
-    doc.appendChild(domElement("QGLViewer", doc));
-    doc.save(out, 2);
+    if (stateFileIsBinary()) {
+      QDataStream out(&f);
+      out << binaryStateMagic << binaryStateVersion;
+      setBinaryStateStreamFormat(out);
+      writeBinary(out);
+    } else {
+      QTextStream out(&f);
+      QDomDocument doc("QGLVIEWER");
+      doc.appendChild(domElement("QGLViewer", doc));
+      doc.save(out, 2);
+    }
     f.flush();
     f.close();
   } else
@@ -3761,8 +6300,85 @@ void QGLViewer::saveStateToFile() {
         tr("Unable to save to file %1").arg(name) + ":\n" + f.errorString());
 }
 
+// Carries the state document parsed by a DeferredStateReader to the viewer.
+class DeferredStateEvent : public QEvent {
+public:
+  DeferredStateEvent(int request) : QEvent(eventType()), request(request) {}
+
+  static QEvent::Type eventType() {
+    static const QEvent::Type type = QEvent::Type(QEvent::registerEventType());
+    return type;
+  }
+
+  QDomDocument document;
+  const int request;
+};
+
+// Parses a state file in a worker thread, and posts the resulting document to
+// the viewer, which applies it in QGLViewer::customEvent().
+class DeferredStateReader : public QRunnable {
+public:
+  DeferredStateReader(QObject *viewer, const QString &fileName, int request)
+      : viewer_(viewer), fileName_(fileName), request_(request) {}
+
+  void run() {
+    // The document is only referenced by the event once posted
+    DeferredStateEvent *event = new DeferredStateEvent(request_);
+    QFile f(fileName_);
+    if (f.open(QIODevice::ReadOnly))
+      event->document.setContent(&f);
+    QCoreApplication::postEvent(viewer_, event);
+  }
+
+private:
+  QObject *viewer_;
+  QString fileName_;
+  int request_;
+};
+
+// Copies the state file in a QDomDocument, except for the KeyFrameInterpolator
+// children of the main Camera element, whose restoration is deferred. hasPaths
+// is set when such elements were skipped. The skipped elements are only
+// tokenized, which is much faster than creating their DOM nodes and KeyFrames.
+static QDomDocument essentialStateDocument(QIODevice *device, bool &hasPaths) {
+  QDomDocument doc;
+  QDomNode current = doc;
+  hasPaths = false;
+
+  QXmlStreamReader reader(device);
+  while (!reader.atEnd()) {
+    reader.readNext();
+    if (reader.isStartElement()) {
+      if ((reader.name() == QLatin1String("KeyFrameInterpolator")) &&
+          (current.toElement().tagName() == "Camera") &&
+          (current.parentNode().parentNode().isDocument())) {
+        hasPaths = true;
+        reader.skipCurrentElement();
+        continue;
+      }
+      QDomElement element = doc.createElement(reader.name().toString());
+      Q_FOREACH (const QXmlStreamAttribute &attribute, reader.attributes())
+        element.setAttribute(attribute.name().toString(),
+                             attribute.value().toString());
+      current = current.appendChild(element);
+    } else if (reader.isEndElement())
+      current = current.parentNode();
+    else if (reader.isCharacters() && !reader.isWhitespace())
+      current.appendChild(doc.createTextNode(reader.text().toString()));
+  }
+
+  if (reader.hasError())
+    qWarning("QGLViewer::restoreStateFromFile: XML error in state file: %s",
+             reader.errorString().toLatin1().constData());
+  return doc;
+}
+
 /*! Restores the QGLViewer state from the stateFileName() file using
-initFromDOMElement().
+initFromDOMElement(), or readBinary() when the file was saved with
+stateFileIsBinary(). The format is detected from the file content.
+
+When stateRestorationIsDeferred(), the camera() keyFrame paths are restored
+later on (see stateRestored()).
 
 States are saved using saveStateToFile(), which is automatically called on
 viewer exit.
@@ -3803,14 +6419,46 @@ bool QGLViewer::restoreStateFromFile() {
     return false;
   }
 
-  // Read the DOM tree form file
+  // Read the DOM tree (or the binary state) form file
+  bool deferred = false;
   QFile f(name);
   if (f.open(QIODevice::ReadOnly)) {
-    QDomDocument doc;
-    doc.setContent(&f);
-    f.close();
-    QDomElement main = doc.documentElement();
-    initFromDOMElement(main);
+    QDataStream in(&f);
+    quint32 magic = 0;
+    in >> magic;
+    if (magic == binaryStateMagic) {
+      quint16 version = 0;
+      in >> version;
+      if (version > binaryStateVersion) {
+        qWarning("QGLViewer::restoreStateFromFile: unsupported binary state "
+                 "file version %d",
+                 version);
+        return false;
+      }
+      setBinaryStateStreamFormat(in);
+      readBinary(in);
+      f.close();
+      if (in.status() != QDataStream::Ok) {
+        qWarning("QGLViewer::restoreStateFromFile: truncated or corrupted "
+                 "binary state file %s",
+                 name.toLatin1().constData());
+        return false;
+      }
+    } else if (stateRestorationIsDeferred()) {
+      f.seek(0);
+      bool hasPaths;
+      QDomDocument doc = essentialStateDocument(&f, hasPaths);
+      f.close();
+      initFromDOMElement(doc.documentElement());
+      deferred = hasPaths;
+    } else {
+      f.seek(0);
+      QDomDocument doc;
+      doc.setContent(&f);
+      f.close();
+      QDomElement main = doc.documentElement();
+      initFromDOMElement(main);
+    }
   } else {
     QMessageBox::warning(
         this, tr("Open file error", "Message box window title"),
@@ -3818,9 +6466,73 @@ bool QGLViewer::restoreStateFromFile() {
     return false;
   }
 
+  // Discards the result of a previous deferred restoration
+  ++deferredStateRequest_;
+  if (deferred) {
+    if (!stateThreadPool_) {
+      stateThreadPool_ = new QThreadPool();
+      stateThreadPool_->setMaxThreadCount(1);
+    }
+    stateThreadPool_->start(
+        new DeferredStateReader(this, name, deferredStateRequest_));
+  } else
+    Q_EMIT stateRestored();
+
   return true;
 }
 
+/*! Overloading of the \c QObject method.
+
+Applies the keyFrame paths parsed by a deferred restoreStateFromFile() (see
+stateRestorationIsDeferred()). */
+void QGLViewer::customEvent(QEvent *e) {
+  if (e->type() != DeferredStateEvent::eventType()) {
+    QOpenGLWidget::customEvent(e);
+    return;
+  }
+
+  const DeferredStateEvent *const event =
+      static_cast<const DeferredStateEvent *>(e);
+  // Superseded by a more recent restoreStateFromFile()
+  if (event->request == deferredStateRequest_)
+    applyDeferredState(event->document);
+}
+
+// Waits for a pending deferred restoration and applies its keyFrame paths now,
+// instead of when the event loop delivers its DeferredStateEvent.
+void QGLViewer::flushDeferredState() {
+  if (!stateThreadPool_)
+    return;
+  stateThreadPool_->waitForDone();
+  QCoreApplication::sendPostedEvents(this, DeferredStateEvent::eventType());
+}
+
+// Restores the camera() keyFrame paths skipped by essentialStateDocument().
+void QGLViewer::applyDeferredState(const QDomDocument &document) {
+  connectAllCameraKFIInterpolatedSignals(false);
+  QDomElement child = document.documentElement().firstChild().toElement();
+  while (!child.isNull()) {
+    if (child.tagName() == "Camera") {
+      QDomElement path = child.firstChild().toElement();
+      while (!path.isNull()) {
+        if (path.tagName() == "KeyFrameInterpolator") {
+          // Same code as in Camera::initFromDOMElement()
+          unsigned int index = DomUtils::uintFromDom(path, "index", 0);
+          camera()->setKeyFrameInterpolator(
+              index, new KeyFrameInterpolator(camera()->frame()));
+          if (camera()->keyFrameInterpolator(index))
+            camera()->keyFrameInterpolator(index)->initFromDOMElement(path);
+        }
+        path = path.nextSibling().toElement();
+      }
+    }
+    child = child.nextSibling().toElement();
+  }
+  connectAllCameraKFIInterpolatedSignals();
+
+  Q_EMIT stateRestored();
+}
+
 /*! Returns an XML \c QDomElement that represents the QGLViewer.
 
 Used by saveStateToFile(). restoreStateFromFile() uses initFromDOMElement() to
@@ -4027,55 +6739,189 @@ void QGLViewer::initFromDOMElement(const QDomElement &element) {
   }
 }
 
-#ifndef DOXYGEN
-/*! This method is deprecated since version 1.3.9-5. Use saveStateToFile() and
-setStateFileName() instead. */
-void QGLViewer::saveToFile(const QString &fileName) {
-  if (!fileName.isEmpty())
-    setStateFileName(fileName);
+/*! Writes the QGLViewer state in \p stream. Compact binary equivalent of
+domElement(), used by saveStateToFile() when stateFileIsBinary().
 
-  qWarning("saveToFile() is deprecated, use saveStateToFile() instead.");
-  saveStateToFile();
+The same values are saved: state values, viewer geometry, camera() (see
+qglviewer::Camera::writeBinary()) and manipulatedFrame() states.
+
+Overload this method to add your own data to the state file. Call the
+QGLViewer implementation first, and read your data back in the same order in
+readBinary():
+\code
+void Viewer::writeBinary(QDataStream& stream) const
+{
+QGLViewer::writeBinary(stream);
+stream << lightIsOn();
+lightManipulatedFrame()->writeBinary(stream);
 }
+\endcode
 
-/*! This function is deprecated since version 1.3.9-5. Use
-restoreStateFromFile() and setStateFileName() instead. */
-bool QGLViewer::restoreFromFile(const QString &fileName) {
-  if (!fileName.isEmpty())
-    setStateFileName(fileName);
+\attention The format of the file is versioned (saveStateToFile() writes a
+magic number followed by a format version), but values are read in the order
+they were written: a file saved by an overloaded writeBinary() can only be read
+back by the matching readBinary(). */
+void QGLViewer::writeBinary(QDataStream &stream) const {
+  stream << QGLViewerVersionString();
 
-  qWarning(
-      "restoreFromFile() is deprecated, use restoreStateFromFile() instead.");
-  return restoreStateFromFile();
-}
-#endif
+  // State
+  stream << foregroundColor() << backgroundColor() << displaysInStereo();
 
-/*! Makes a copy of the current buffer into a texture.
+  // Display
+  stream << axisIsDrawn() << gridIsDrawn() << FPSIsDisplayed()
+         << cameraIsEdited();
 
-Creates a texture (when needed) and uses glCopyTexSubImage2D() to directly copy
-the buffer in it.
+  // Geometry
+  stream << isFullScreen();
+  if (isFullScreen())
+    stream << prevPos_;
+  else {
+    QWidget *tlw = topLevelWidget();
+    stream << tlw->size() << tlw->pos();
+  }
 
-Use \p internalFormat and \p format to define the texture format and hence which
-and how components of the buffer are copied into the texture. See the
-glTexImage2D() documentation for details.
+  // Restore original Camera zClippingCoefficient before saving.
+  if (cameraIsEdited())
+    camera()->setZClippingCoefficient(previousCameraZClippingCoefficient_);
+  camera()->writeBinary(stream);
+  if (cameraIsEdited())
+    // #CONNECTION# 5.0 from setCameraIsEdited()
+    camera()->setZClippingCoefficient(5.0);
 
-When \p format is c GL_NONE (default), its value is set to \p internalFormat,
-which fits most cases. Typical \p internalFormat (and \p format) values are \c
-GL_DEPTH_COMPONENT and \c GL_RGBA. Use \c GL_LUMINANCE as the \p internalFormat
-and \c GL_RED, \c GL_GREEN or \c GL_BLUE as \p format to capture a single color
-component as a luminance (grey scaled) value. Note that \c GL_STENCIL is not
-supported as a format.
+  // The manipulatedFrame() is saved as a separate block, so that it can be
+  // skipped when the restored viewer has no manipulatedFrame().
+  QByteArray frameBlock;
+  if (manipulatedFrame()) {
+    QDataStream frameStream(&frameBlock, QIODevice::WriteOnly);
+    setBinaryStateStreamFormat(frameStream);
+    manipulatedFrame()->writeBinary(frameStream);
+  }
+  stream << frameBlock;
+}
 
-The texture has dimensions which are powers of two. It is as small as possible
-while always being larger or equal to the current size of the widget. The buffer
-image hence does not entirely fill the texture: it is stuck to the lower left
-corner (corresponding to the (0,0) texture coordinates). Use bufferTextureMaxU()
-and bufferTextureMaxV() to get the upper right corner maximum u and v texture
-coordinates. Use bufferTextureId() to retrieve the id of the created texture.
+/*! Restores the QGLViewer state from a \p stream written by writeBinary().
 
-Here is how to display a grey-level image of the z-buffer:
-\code
-copyBufferToTexture(GL_DEPTH_COMPONENT);
+Binary equivalent of initFromDOMElement(), used by restoreStateFromFile().
+Reading stops at the first corrupted value, and \p stream status is then no
+longer \c QDataStream::Ok.
+
+\note The manipulatedFrame() \e pointer is not modified by this method. If
+defined, its state is simply set from the \p stream values. */
+void QGLViewer::readBinary(QDataStream &stream) {
+  QString version;
+  stream >> version;
+  if (stream.status() != QDataStream::Ok)
+    return;
+  if (!version.startsWith('2'))
+    qWarning("State file created using QGLViewer version %s may not be "
+             "correctly read.",
+             version.toLatin1().constData());
+
+  QColor foreground, background;
+  bool stereo;
+  stream >> foreground >> background >> stereo;
+
+  bool axis, grid, fps, tmpCameraIsEdited;
+  stream >> axis >> grid >> fps >> tmpCameraIsEdited;
+
+  bool fullScreen;
+  QPoint pos;
+  QSize size;
+  stream >> fullScreen;
+  if (fullScreen)
+    stream >> pos;
+  else
+    stream >> size >> pos;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setForegroundColor(foreground);
+  setBackgroundColor(background);
+  setStereoDisplay(stereo);
+  setAxisIsDrawn(axis);
+  setGridIsDrawn(grid);
+  setFPSIsDisplayed(fps);
+
+  setFullScreen(fullScreen);
+  if (isFullScreen())
+    prevPos_ = pos;
+  else {
+    topLevelWidget()->resize(size);
+    camera()->setScreenWidthAndHeight(this->width(), this->height());
+    topLevelWidget()->move(pos);
+  }
+
+  connectAllCameraKFIInterpolatedSignals(false);
+  camera()->readBinary(stream);
+  connectAllCameraKFIInterpolatedSignals();
+
+  QByteArray frameBlock;
+  stream >> frameBlock;
+  if ((stream.status() == QDataStream::Ok) && !frameBlock.isEmpty() &&
+      (manipulatedFrame())) {
+    QDataStream frameStream(frameBlock);
+    setBinaryStateStreamFormat(frameStream);
+    manipulatedFrame()->readBinary(frameStream);
+  }
+
+  // See the delayed cameraIsEdited comment in initFromDOMElement().
+  cameraIsEdited_ = tmpCameraIsEdited;
+  if (cameraIsEdited_) {
+    previousCameraZClippingCoefficient_ = camera()->zClippingCoefficient();
+    // #CONNECTION# 5.0 from setCameraIsEdited.
+    camera()->setZClippingCoefficient(5.0);
+  }
+}
+
+#ifndef DOXYGEN
+/*! This method is deprecated since version 1.3.9-5. Use saveStateToFile() and
+setStateFileName() instead. */
+void QGLViewer::saveToFile(const QString &fileName) {
+  if (!fileName.isEmpty())
+    setStateFileName(fileName);
+
+  qWarning("saveToFile() is deprecated, use saveStateToFile() instead.");
+  saveStateToFile();
+}
+
+/*! This function is deprecated since version 1.3.9-5. Use
+restoreStateFromFile() and setStateFileName() instead. */
+bool QGLViewer::restoreFromFile(const QString &fileName) {
+  if (!fileName.isEmpty())
+    setStateFileName(fileName);
+
+  qWarning(
+      "restoreFromFile() is deprecated, use restoreStateFromFile() instead.");
+  return restoreStateFromFile();
+}
+#endif
+
+/*! Makes a copy of the current buffer into a texture.
+
+Creates a texture (when needed) and uses glCopyTexSubImage2D() to directly copy
+the buffer in it.
+
+Use \p internalFormat and \p format to define the texture format and hence which
+and how components of the buffer are copied into the texture. See the
+glTexImage2D() documentation for details.
+
+When \p format is c GL_NONE (default), its value is set to \p internalFormat,
+which fits most cases. Typical \p internalFormat (and \p format) values are \c
+GL_DEPTH_COMPONENT and \c GL_RGBA. Use \c GL_LUMINANCE as the \p internalFormat
+and \c GL_RED, \c GL_GREEN or \c GL_BLUE as \p format to capture a single color
+component as a luminance (grey scaled) value. Note that \c GL_STENCIL is not
+supported as a format.
+
+The texture has dimensions which are powers of two. It is as small as possible
+while always being larger or equal to the current size of the widget. The buffer
+image hence does not entirely fill the texture: it is stuck to the lower left
+corner (corresponding to the (0,0) texture coordinates). Use bufferTextureMaxU()
+and bufferTextureMaxV() to get the upper right corner maximum u and v texture
+coordinates. Use bufferTextureId() to retrieve the id of the created texture.
+
+Here is how to display a grey-level image of the z-buffer:
+\code
+copyBufferToTexture(GL_DEPTH_COMPONENT);
 
 glMatrixMode(GL_TEXTURE);
 glLoadIdentity();
@@ -4107,7 +6953,11 @@ needed.
 \note The \c GL_DEPTH_COMPONENT format may not be supported by all hardware. It
 may sometimes be emulated in software, resulting in poor performances.
 
-\note The bufferTextureId() texture is binded at the end of this method. */
+\note The bufferTextureId() texture is binded at the end of this method.
+
+\note This method copies the whole widget buffer at each call, in a padded
+texture. Use drawToRenderTarget() instead to draw the scene directly in
+textures of the widget size. */
 void QGLViewer::copyBufferToTexture(GLint internalFormat, GLenum format) {
   int h = 16;
   int w = 16;
@@ -4167,3 +7017,1212 @@ GLuint QGLViewer::bufferTextureId() const {
   else
     return 0;
 }
+
+/*! Draws the scene in the renderTarget() textures instead of the widget.
+
+The renderTarget() is resized to the widget size (in device pixels). While it
+is bound, it is cleared, the camera() matrices are loaded and draw() is called.
+The rest of preDraw() is not repeated, and postDraw() is not called:
+the visual hints are not part of the textures. The textures are then used
+without any copy, with (0,0) to (1,1) texture coordinates:
+\code
+void Viewer::draw() {
+  // Called by drawToRenderTarget()
+  if (renderTarget()->isBound()) {
+    drawScene();
+    return;
+  }
+
+  drawToRenderTarget();
+  glBindTexture(GL_TEXTURE_2D, renderTarget()->colorTexture());
+  drawPostProcessedImage();
+}
+\endcode
+
+draw() must test qglviewer::RenderTarget::isBound() as above when it calls
+drawToRenderTarget(): recursive calls are ignored.
+
+Call makeCurrent() before this method to make the OpenGL context active if
+needed. */
+void QGLViewer::drawToRenderTarget() {
+  if (renderTarget_->isBound()) {
+    qWarning("QGLViewer::drawToRenderTarget: recursive call ignored");
+    return;
+  }
+
+  renderTarget_->setSize(size() * devicePixelRatioF());
+  if (!renderTarget_->bind())
+    return;
+
+  // The rest of preDraw() (frame graph passes, simulation, published camera
+  // state...) was already done for this frame, before draw()
+  camera()->loadDepthState();
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  if (format().profile() != QSurfaceFormat::CoreProfile) {
+    camera()->loadProjectionMatrix();
+    camera()->loadModelViewMatrix();
+  }
+  draw();
+  renderTarget_->release();
+}
+
+/*! Adds \p layer to the overlayLayers(), drawn over the previous ones. The
+viewer takes ownership of \p layer, which is deleted with the viewer. Does
+nothing if \p layer is already added. */
+void QGLViewer::addOverlayLayer(OverlayLayer *layer) {
+  if (!layer || overlayLayers_.contains(layer))
+    return;
+  overlayLayers_.append(layer);
+  update();
+}
+
+/*! Removes \p layer from the overlayLayers(). Its OpenGL resources are
+released, and its ownership is given back to the caller. */
+void QGLViewer::removeOverlayLayer(OverlayLayer *layer) {
+  if (!overlayLayers_.removeOne(layer))
+    return;
+  makeCurrent();
+  layer->cleanupGL();
+  update();
+}
+
+// Called by postDraw(): updates the outdated layers in their textures and
+// composites them over the frame.
+void QGLViewer::drawOverlayLayers() {
+  const qreal dpr = devicePixelRatioF();
+  for (OverlayLayer *layer : overlayLayers_)
+    if (layer->isVisible() && layer->needsUpdate(camera(), size(), dpr))
+      layer->update(camera(), size(), dpr);
+
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_TEXTURE_2D);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  startScreenCoordinatesSystem();
+  for (OverlayLayer *layer : overlayLayers_) {
+    if (!layer->isVisible() || !layer->texture())
+      continue;
+    // The texture rows are bottom-up
+    const QRect rect = layer->rectangle(size());
+    glBindTexture(GL_TEXTURE_2D, layer->texture());
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 1.0);
+    glVertex2i(rect.left(), rect.top());
+    glTexCoord2f(1.0, 1.0);
+    glVertex2i(rect.left() + rect.width(), rect.top());
+    glTexCoord2f(1.0, 0.0);
+    glVertex2i(rect.left() + rect.width(), rect.top() + rect.height());
+    glTexCoord2f(0.0, 0.0);
+    glVertex2i(rect.left(), rect.top() + rect.height());
+    glEnd();
+  }
+  stopScreenCoordinatesSystem();
+
+  glPopAttrib();
+}
+
+/*! Sets the depthCacheIsEnabled() value. The depthCache() is set as the
+camera() qglviewer::Camera::depthCache() when enabled. The cached depths are
+invalidated when disabled. */
+void QGLViewer::setDepthCacheIsEnabled(bool enabled) {
+  depthCacheIsEnabled_ = enabled;
+  camera()->setDepthCache(enabled ? depthCache_ : nullptr);
+  if (!enabled)
+    depthCache_->invalidate();
+}
+
+// Called at the end of paintGL(), with the widget framebuffer bound
+void QGLViewer::captureDepthCache() {
+  if (!depthCacheIsEnabled())
+    return;
+
+  if (displaysInStereo())
+    depthCache_->invalidate();
+  else
+    depthCache_->capture(camera());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Render thread                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the renderThread(). The previous one is stopped (see
+qglviewer::RenderThread::stop()), and \p thread is started with a context
+shared with the viewer's one, as soon as it is created. Use \c nullptr to draw
+in the GUI thread again.
+
+The qglviewer::RenderThread::frameReady() signal of \p thread updates the
+viewer. */
+void QGLViewer::setRenderThread(RenderThread *thread) {
+  if (thread == renderThread_)
+    return;
+
+  if (renderThread_) {
+    disconnect(renderThread_, SIGNAL(frameReady()), this,
+               SLOT(renderThreadFrameReady()));
+    renderThread_->stop();
+  }
+
+  renderThread_ = thread;
+  if (renderThread_) {
+    connect(renderThread_, SIGNAL(frameReady()), this,
+            SLOT(renderThreadFrameReady()));
+    renderThreadSceneIsValid_ = false;
+    // Otherwise started by the first paintGL()
+    if (context())
+      renderThread_->start(context());
+  }
+  update();
+}
+
+// Connected to qglviewer::RenderThread::frameReady(). The paint it causes only
+// composites the new frame, see drawRenderThreadFrame().
+void QGLViewer::renderThreadFrameReady() {
+  renderThreadFrameIsReady_ = true;
+  update();
+}
+
+// Composites the last frame of the renderThread() and requests the next one.
+// Called by paintGL() in place of draw(), after preDraw().
+void QGLViewer::drawRenderThreadFrame() {
+  if (!renderThread_->isRunning() && !renderThread_->start(context()))
+    return;
+
+  // preDraw() has just published the current camera state
+  const CameraState state = camera()->publishedState();
+  const qreal ratio = devicePixelRatioF();
+  const QSize size(int(ratio * width()), int(ratio * height()));
+
+  // The paint of a new frame does not request the same frame again. Other
+  // paints (update() calls) always do.
+  const bool frameIsReady = renderThreadFrameIsReady_;
+  renderThreadFrameIsReady_ = false;
+  if (!frameIsReady || !renderThreadSceneIsValid_ || animationIsStarted() ||
+      (memcmp(state.modelViewProjectionMatrix, renderThreadMatrix_,
+              sizeof(renderThreadMatrix_)) != 0) ||
+      (size != renderThreadSize_) ||
+      (backgroundColor() != renderThreadBackground_)) {
+    renderThread_->requestFrame(state, size, backgroundColor());
+    memcpy(renderThreadMatrix_, state.modelViewProjectionMatrix,
+           sizeof(renderThreadMatrix_));
+    renderThreadSize_ = size;
+    renderThreadBackground_ = backgroundColor();
+    renderThreadSceneIsValid_ = true;
+  }
+
+  QSize frameSize;
+  const GLuint texture = renderThread_->acquireFrame(frameSize);
+  // The frame may have the previous size of the widget while it is resized
+  if (texture)
+    drawScreenTexture(texture);
+}
+
+// Draws texture over the whole window, with a linear filtering. Used to
+// composite the renderThread() and dynamic resolution frames.
+void QGLViewer::drawScreenTexture(GLuint texture) {
+  if (format().profile() == QSurfaceFormat::CoreProfile) {
+    // No immediate mode: a shader draws the texture instead
+    if (coreProfileRenderer_)
+      coreProfileRenderer_->drawScreenTexture(texture);
+    return;
+  }
+
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  startScreenCoordinatesSystem(true);
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0, 0.0);
+  glVertex2i(0, 0);
+  glTexCoord2f(1.0, 0.0);
+  glVertex2i(width(), 0);
+  glTexCoord2f(1.0, 1.0);
+  glVertex2i(width(), height());
+  glTexCoord2f(0.0, 1.0);
+  glVertex2i(0, height());
+  glEnd();
+  stopScreenCoordinatesSystem();
+
+  glPopAttrib();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Buffer uploads                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the qglviewer::BufferUploader that loads buffer objects in a worker
+thread, with a context shared with the viewer's one. It is created and
+started by the first call, which must be done once the viewer is initialized
+(in init() or draw(), for instance). Its qglviewer::BufferUploader::uploaded()
+signal is connected to update(), so that draw() can use each buffer as soon
+as it is ready.
+
+Returns \c nullptr when the context does not support fences (OpenGL 3.2 or
+OpenGL ES 3.0 is required), or before initializeGL(). The remaining buffers
+are deleted by the viewer destructor. */
+qglviewer::BufferUploader *QGLViewer::bufferUploader() {
+  if (!bufferUploader_ && bufferUploaderIsSupported_ && context()) {
+    bufferUploader_ = new BufferUploader(this);
+    if (bufferUploader_->start(context()))
+      connect(bufferUploader_, SIGNAL(uploaded(int)), this, SLOT(update()));
+    else {
+      delete bufferUploader_;
+      bufferUploader_ = nullptr;
+      bufferUploaderIsSupported_ = false;
+    }
+  }
+  return bufferUploader_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Frame ring buffer                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the qglviewer::FrameRingBuffer in which the vertices regenerated
+at each frame can be written. It is created by the first call, which must be
+done with the viewer's context current (in init() or draw(), for instance).
+The viewer calls qglviewer::FrameRingBuffer::beginFrame() and
+qglviewer::FrameRingBuffer::endFrame() around each paintGL(): allocations are
+valid in draw() and the other drawing methods it calls.
+
+The same buffer is used by the batched texts (see textIsBatched()), the
+instanced axes and cameras, the core profile visual hints and the wide lines of
+drawGrid() and qglviewer::Camera::draw().
+
+Returns \c nullptr when persistent mappings are not supported (OpenGL 4.4 or
+\c GL_ARB_buffer_storage is required), or before initializeGL(). */
+qglviewer::FrameRingBuffer *QGLViewer::frameRingBuffer() {
+  if (!frameRingBuffer_ && frameRingBufferIsSupported_ && context()) {
+    frameRingBuffer_ = new FrameRingBuffer();
+    if (!frameRingBuffer_->initialize()) {
+      delete frameRingBuffer_;
+      frameRingBuffer_ = nullptr;
+      frameRingBufferIsSupported_ = false;
+    }
+  }
+  return frameRingBuffer_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Frame graph                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the qglviewer::FrameGraph whose passes are executed by preDraw()
+and postDraw(). It is created by the first call, and is empty: the viewer
+then only executes the passes added by the application. Its RenderTargets are
+released by the viewer destructor. */
+qglviewer::FrameGraph *QGLViewer::frameGraph() {
+  if (!frameGraph_)
+    frameGraph_ = new FrameGraph();
+  return frameGraph_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Frame capture                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Records the OpenGL commands of the next frame in \p fileName, and emits
+frameCaptured() once it is saved. See qglviewer::FrameCapture for the commands
+that are recorded: draw() must issue them through frameCapture().
+
+The capture is done by the next frame drawn directly in the viewer: the frames
+drawn with stereo, viewports, retainedModeIsEnabled(), dynamic resolution,
+sceneSamples(), reprojection or a renderThread() are not captured. Requires
+OpenGL 3.0 or OpenGL ES 3.0: otherwise the request is dropped with a warning,
+and frameCaptured() is not emitted. The captured file is replayed by the \c
+frameReplay benchmark. */
+void QGLViewer::captureFrame(const QString &fileName) {
+  frameCaptureFileName_ = fileName;
+  update();
+}
+
+// Ends the capture of the frame requested by captureFrame() and saves it
+void QGLViewer::saveFrameCapture() {
+  frameCapture_->endCapture();
+  const QString fileName = frameCaptureFileName_;
+  frameCaptureFileName_.clear();
+  if (frameCapture_->save(fileName))
+    Q_EMIT frameCaptured(fileName);
+  // The recorded data may be large
+  frameCapture_->clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Dynamic resolution                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets dynamicResolutionIsEnabled(). Enabling it also enables the
+frameProfiler(), which measures the GPU frame times used to adapt the
+resolutionScale(). */
+void QGLViewer::setDynamicResolutionIsEnabled(bool enabled) {
+  if (enabled == dynamicResolutionIsEnabled_)
+    return;
+
+  dynamicResolutionIsEnabled_ = enabled;
+  if (enabled) {
+    frameProfiler_->setEnabled(true);
+    connect(frameProfiler_,
+            SIGNAL(frameTimingAvailable(const qglviewer::FrameTiming&)),
+            SLOT(adaptResolutionScale(const qglviewer::FrameTiming&)));
+  } else {
+    disconnect(frameProfiler_,
+               SIGNAL(frameTimingAvailable(const qglviewer::FrameTiming&)),
+               this, SLOT(adaptResolutionScale(const qglviewer::FrameTiming&)));
+    dynamicResolutionTimer_.stop();
+    resolutionScale_ = 1.0;
+  }
+  update();
+}
+
+/*! Sets the minimumResolutionScale(), clamped to [0.1, 1]. A value of 1.0
+always draws at the native resolution. */
+void QGLViewer::setMinimumResolutionScale(qreal scale) {
+  minimumResolutionScale_ = qBound(qreal(0.1), scale, qreal(1.0));
+  resolutionScale_ = qMax(resolutionScale_, minimumResolutionScale_);
+}
+
+// Adapts resolutionScale() to the GPU time of a frame drawn while in motion.
+// The fill cost grows as the square of the scale.
+void QGLViewer::adaptResolutionScale(const FrameTiming &timing) {
+  // Timings arrive a few frames late: still frames are at native resolution
+  if ((timing.gpuTime <= 0.0) || !viewIsInMotion())
+    return;
+
+  const qreal ideal =
+      resolutionScale_ * sqrt(dynamicResolutionFrameTime_ / timing.gpuTime);
+  resolutionScale_ = qBound(minimumResolutionScale_,
+                            0.7 * resolutionScale_ + 0.3 * ideal, qreal(1.0));
+}
+
+// Whether paintGL() draws the current frame with the resolutionScale()
+bool QGLViewer::usesDynamicResolution() const {
+  return dynamicResolutionIsEnabled_ && (resolutionScale_ < 1.0) &&
+         !renderThread_ && !displaysInStereo() &&
+         (format().profile() != QSurfaceFormat::CoreProfile) &&
+         viewIsInMotion();
+}
+
+// Draws preDraw() and the scene in scaledFBO_, with scale times the window
+// size, upscaled in the window by drawScreenTexture(). When samples is
+// positive, the scene is drawn in multisampleFBO_ and resolved in scaledFBO_.
+// The depth of scaledFBO_ is copied in the window depth buffer.
+// Called by paintGL() in place of preDraw() and draw().
+void QGLViewer::paintOffscreenScene(bool lod, qreal scale, int samples) {
+  const qreal ratio = devicePixelRatioF();
+  const QSize fullSize(int(ratio * width()), int(ratio * height()));
+  const QSize size(qMax(int(scale * fullSize.width()), 1),
+                   qMax(int(scale * fullSize.height()), 1));
+  if (!scaledFBO_ || (scaledFBO_->size() != size)) {
+    delete scaledFBO_;
+    scaledFBO_ = new QOpenGLFramebufferObject(
+        size, QOpenGLFramebufferObject::CombinedDepthStencil);
+  }
+  if (samples <= 0) {
+    delete multisampleFBO_;
+    multisampleFBO_ = nullptr;
+  } else if (!multisampleFBO_ || (multisampleFBO_->size() != size) ||
+             (multisampleFBO_->format().samples() != samples)) {
+    delete multisampleFBO_;
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setSamples(samples);
+    multisampleFBO_ = new QOpenGLFramebufferObject(size, fboFormat);
+  }
+
+  QOpenGLFramebufferObject *const target =
+      (multisampleFBO_ && multisampleFBO_->isValid()) ? multisampleFBO_
+                                                       : scaledFBO_;
+  if (target->isValid()) {
+    target->bind();
+    glViewport(0, 0, size.width(), size.height());
+  }
+  frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
+  preDraw();
+  frameProfiler_->beginStage(FrameTiming::DRAW);
+  if (lod)
+    drawLevelOfDetail(levelOfDetail_);
+  else if (camera()->frame()->isManipulated())
+    fastDraw();
+  else
+    draw();
+  if (!target->isValid())
+    return;
+  target->release();
+  const QRect rect(QPoint(0, 0), size);
+  if (target != scaledFBO_)
+    QOpenGLFramebufferObject::blitFramebuffer(
+        scaledFBO_, rect, target, rect,
+        GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+  // The resolved depth of the scene, for the postDraw() hints, the depthCache()
+  // and pointUnderPixel(). Depth can only be blitted with GL_NEAREST.
+  QOpenGLFramebufferObject::blitFramebuffer(
+      nullptr, QRect(QPoint(0, 0), fullSize), scaledFBO_, rect,
+      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glViewport(0, 0, fullSize.width(), fullSize.height());
+  drawScreenTexture(scaledFBO_->texture());
+
+  // Redrawn at native resolution if no motion happens for 100 ms
+  if (scale < 1.0)
+    dynamicResolutionTimer_.start(100);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                         Temporal reprojection                              //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets reprojectionIsEnabled(). */
+void QGLViewer::setReprojectionIsEnabled(bool enabled) {
+  if (enabled == reprojectionIsEnabled_)
+    return;
+
+  reprojectionIsEnabled_ = enabled;
+  if (!enabled)
+    reprojectionTimer_.stop();
+  update();
+}
+
+// Whether the frame being drawn reuses the previous one: only the camera
+// moves, and the context supports the reprojection shaders.
+bool QGLViewer::usesReprojection() const {
+  if (!reprojectionIsEnabled_ || !reprojectionIsSupported_ || renderThread_ ||
+      displaysInStereo() ||
+      (format().profile() == QSurfaceFormat::CoreProfile) ||
+      animationIsStarted())
+    return false;
+
+  const ManipulatedFrame *const mf = manipulatedFrame();
+  if (mf && (mf != camera()->frame()) &&
+      (mf->isManipulated() || mf->isSpinning()))
+    return false;
+
+  return camera()->frame()->isManipulated() ||
+         camera()->frame()->isSpinning() ||
+         camera()->interpolationKfi_->interpolationIsStarted();
+}
+
+// Draws preDraw() and the scene in the next target of temporalReprojector_,
+// over the previous frame warped to the current camera when it is recent
+// enough, and displays it with drawScreenTexture(). Called by paintGL() in
+// place of preDraw() and draw().
+void QGLViewer::paintReprojectedScene(bool lod) {
+  if (!temporalReprojector_) {
+    temporalReprojector_ = new TemporalReprojector();
+    if (!temporalReprojector_->initialize())
+      reprojectionIsSupported_ = false;
+  }
+
+  const qreal ratio = devicePixelRatioF();
+  const QSize size(int(ratio * width()), int(ratio * height()));
+  const bool reproject = reprojectionIsSupported_ &&
+                         temporalReprojector_->hasPreviousFrame(size) &&
+                         (temporalReprojector_->nbReprojectedFrames() <
+                          reprojectionRefreshInterval());
+  const bool bound = temporalReprojector_->bind(size);
+
+  frameProfiler_->beginStage(FrameTiming::PRE_DRAW);
+  preDraw();
+  if (bound && reproject) {
+    // Warped pixels are given the near depth, which rejects the scene there
+    temporalReprojector_->drawPreviousFrame(camera(),
+                                            TemporalReprojector::COLOR_PASS);
+    temporalReprojector_->drawPreviousFrame(camera(),
+                                            TemporalReprojector::MASK_PASS);
+  }
+  frameProfiler_->beginStage(FrameTiming::DRAW);
+  if (lod)
+    drawLevelOfDetail(levelOfDetail_);
+  else if (camera()->frame()->isManipulated())
+    fastDraw();
+  else
+    draw();
+  if (!bound)
+    return;
+  // Depths of the warped pixels, used by the next frame
+  if (reproject)
+    temporalReprojector_->drawPreviousFrame(camera(),
+                                            TemporalReprojector::DEPTH_PASS);
+  temporalReprojector_->release(camera(), reproject);
+
+  // postDraw() hints are depth tested against an empty depth buffer
+  glClear(GL_DEPTH_BUFFER_BIT);
+  drawScreenTexture(temporalReprojector_->colorTexture());
+
+  // Fully drawn again if no motion happens for 100 ms
+  reprojectionTimer_.start(100);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Interaction quality                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets interactionQualityIsEnabled(). */
+void QGLViewer::setInteractionQualityEnabled(bool enabled) {
+  if (enabled == interactionQualityIsEnabled_)
+    return;
+
+  interactionQualityIsEnabled_ = enabled;
+  if (!enabled)
+    interactionQualityTimer_.stop();
+  update();
+}
+
+/*! Sets the sceneSamples(). Negative values are replaced by 0. */
+void QGLViewer::setSceneSamples(int samples) {
+  sceneSamples_ = qMax(0, samples);
+  update();
+}
+
+/*! Sets the interactionSceneSamples(). Negative values are replaced by 0. The
+sceneSamples() are used in motion when they are fewer. */
+void QGLViewer::setInteractionSceneSamples(int samples) {
+  interactionSceneSamples_ = qMax(0, samples);
+  update();
+}
+
+/*! Registers a quality setting of your scene, and returns its id.
+
+\p value is the full quality value, and \p interactionValue the one used while
+the view is in motion, when interactionQualityIsEnabled(). Read them in draw()
+with qualitySetting():
+\code
+void Viewer::init() {
+  shadowMapSize_ = addQualitySetting(2048, 512);
+  lodBias_ = addQualitySetting(0.0, 2.0);
+  setInteractionQualityEnabled();
+}
+
+void Viewer::draw() {
+  renderShadowMap(int(qualitySetting(shadowMapSize_)));
+  drawMeshes(qualitySetting(lodBias_));
+}
+\endcode
+
+See also setQualitySetting() and removeQualitySetting(). */
+int QGLViewer::addQualitySetting(qreal value, qreal interactionValue) {
+  QualitySetting setting;
+  setting.value = value;
+  setting.interactionValue = interactionValue;
+  setting.used = true;
+
+  if (!freeQualitySettings_.isEmpty()) {
+    const int id = freeQualitySettings_.takeLast();
+    qualitySettings_[id] = setting;
+    return id;
+  }
+  qualitySettings_.append(setting);
+  return qualitySettings_.size() - 1;
+}
+
+/*! Changes the values of the quality setting \p id, returned by
+addQualitySetting(). */
+void QGLViewer::setQualitySetting(int id, qreal value,
+                                  qreal interactionValue) {
+  if (!isValidQualitySetting(id, "setQualitySetting"))
+    return;
+  qualitySettings_[id].value = value;
+  qualitySettings_[id].interactionValue = interactionValue;
+  update();
+}
+
+/*! Unregisters the quality setting \p id. Its id may be returned by a next
+addQualitySetting(). */
+void QGLViewer::removeQualitySetting(int id) {
+  if (!isValidQualitySetting(id, "removeQualitySetting"))
+    return;
+  qualitySettings_[id].used = false;
+  freeQualitySettings_.append(id);
+}
+
+/*! Returns the current value of the quality setting \p id: its interaction
+value when qualityIsReduced(), its full quality value otherwise. Returns 0.0
+for an invalid \p id. */
+qreal QGLViewer::qualitySetting(int id) const {
+  if (!isValidQualitySetting(id, "qualitySetting"))
+    return 0.0;
+  const QualitySetting &setting = qualitySettings_.at(id);
+  return qualityIsReduced_ ? setting.interactionValue : setting.value;
+}
+
+bool QGLViewer::isValidQualitySetting(int id, const char *method) const {
+  if ((id < 0) || (id >= qualitySettings_.size()) ||
+      !qualitySettings_.at(id).used) {
+    qWarning("QGLViewer::%s: invalid quality setting id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+// Motions that use the interaction quality: viewIsInMotion() and the camera()
+// keyFrame paths played back
+bool QGLViewer::interactionIsInProgress() const {
+  if (viewIsInMotion())
+    return true;
+  for (KeyFrameInterpolator *kfi : camera()->kfi_)
+    if (kfi->interpolationIsStarted())
+      return true;
+  return false;
+}
+
+// Sets qualityIsReduced() for the frame drawn by paintGL()
+void QGLViewer::updateQualityReduction() {
+  const bool reduced =
+      interactionQualityIsEnabled_ && interactionIsInProgress();
+  // The full quality frame is drawn once the motion stops
+  if (reduced)
+    interactionQualityTimer_.start(100);
+  if (reduced == qualityIsReduced_)
+    return;
+
+  qualityIsReduced_ = reduced;
+  Q_EMIT qualityReductionChanged(reduced);
+}
+
+// Draws an idle frame at full quality, or waits for the end of the motion
+void QGLViewer::restoreInteractionQuality() {
+  if (interactionIsInProgress())
+    interactionQualityTimer_.start(100);
+  else if (qualityIsReduced_)
+    update();
+}
+
+// Samples of the offscreen scene of the frame drawn by paintGL(), 0 when the
+// scene is drawn in the widget framebuffer
+int QGLViewer::currentSceneSamples() const {
+  const int samples =
+      qualityIsReduced_ ? qMin(interactionSceneSamples_, sceneSamples_)
+                        : sceneSamples_;
+  if ((samples == 0) || renderThread_ || displaysInStereo() ||
+      (format().profile() == QSurfaceFormat::CoreProfile) ||
+      !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit())
+    return 0;
+  return samples;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Benchmark                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+// The mean, median, 95th and 99th percentiles and maximum of values, sorted by
+// this function.
+static QJsonObject benchmarkStatistics(QVector<qreal> &values) {
+  QJsonObject statistics;
+  if (values.isEmpty())
+    return statistics;
+
+  std::sort(values.begin(), values.end());
+  qreal sum = 0.0;
+  for (const qreal value : values)
+    sum += value;
+  // Nearest rank percentiles
+  const auto percentile = [&values](qreal p) {
+    const int rank = int(ceil(p * values.size())) - 1;
+    return values[qBound(0, rank, int(values.size()) - 1)];
+  };
+
+  statistics["mean"] = sum / values.size();
+  statistics["p50"] = percentile(0.50);
+  statistics["p95"] = percentile(0.95);
+  statistics["p99"] = percentile(0.99);
+  statistics["max"] = values.last();
+  return statistics;
+}
+
+/*! Plays the camera() keyFrameInterpolator() \p index and measures the frames,
+for performance regression tests. Writes the results to \p fileName, in JSON
+format. Returns \c false when the path does not exist, when the viewer is not
+initialized yet or when the file cannot be written.
+
+The path is not played in real time: it is sampled every \p timeStep seconds
+(of path time) from its qglviewer::KeyFrameInterpolator::firstTime() to its
+qglviewer::KeyFrameInterpolator::lastTime(), so that the drawn frames only
+depend on the path. Each frame is rendered by paintGL() and completed with \c
+glFinish(), without being displayed. A few frames are first drawn from the
+first key frame to warm up the caches and shaders.
+
+The output reports the mean, median, 95th and 99th percentiles and maximum of
+the \c cpuTime (paintGL() duration), \c frameTime (until \c glFinish()
+returns), \c gpuTime (from the frameProfiler() \c GL_TIMESTAMP queries, when
+supported) and of the \c preDraw, \c draw and \c postDraw stages, in
+milliseconds:
+\code
+{
+  "path": 1, "timeStep": 0.0167, "nbFrames": 601, "width": 800, "height": 600,
+  "cpuTime": { "mean": 3.1, "p50": 2.9, "p95": 4.2, "p99": 5.0, "max": 6.3 },
+  ...
+  "stages": { "preDraw": { ... }, "draw": { ... }, "postDraw": { ... } }
+}
+\endcode
+
+The camera() is restored at the end of the benchmark, and the
+frameProfiler() keeps the records of its last frames. The benchmark can also be
+run from the command line, in which case the application exits with a
+non-zero status on failure:
+\code
+myViewer --benchmark 1 --benchmark-output results.json --benchmark-step 0.02
+\endcode
+The path (whose key is given, see setPathKey()) must then be defined by your
+init() method, typically restored by restoreStateFromFile(). */
+bool QGLViewer::runBenchmark(unsigned int index, const QString &fileName,
+                             qreal timeStep) {
+  KeyFrameInterpolator *kfi = camera()->keyFrameInterpolator(index);
+  if (!kfi || (kfi->numberOfKeyFrames() == 0)) {
+    qWarning("QGLViewer::runBenchmark: No camera path %u", index);
+    return false;
+  }
+  if (!isValid()) {
+    qWarning("QGLViewer::runBenchmark: The viewer is not initialized");
+    return false;
+  }
+  if (timeStep <= 0.0) {
+    qWarning("QGLViewer::runBenchmark: Invalid time step %f", timeStep);
+    return false;
+  }
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning("QGLViewer::runBenchmark: Unable to write %s",
+             fileName.toLatin1().constData());
+    return false;
+  }
+
+  if (kfi->interpolationIsStarted())
+    kfi->stopInterpolation();
+  const Vec position = camera()->position();
+  const Quaternion orientation = camera()->orientation();
+
+  // All the records of the benchmark are kept by the frameProfiler()
+  const int nbFrames =
+      int(floor((kfi->lastTime() - kfi->firstTime()) / timeStep + 1.0e-6)) + 1;
+  const bool profilerWasEnabled = frameProfiler_->isEnabled();
+  const int historySize = frameProfiler_->historySize();
+  frameProfiler_->setEnabled(true);
+  frameProfiler_->setHistorySize(nbFrames);
+
+  const int nbWarmupFrames = 5;
+  QVector<qreal> cpuTimes, frameTimes;
+  QElapsedTimer timer;
+  makeCurrent();
+  for (int i = -nbWarmupFrames; i < nbFrames; ++i) {
+    kfi->interpolateAtTime(kfi->firstTime() + qMax(i, 0) * timeStep);
+
+    timer.start();
+    paintGL();
+    const qint64 cpuTime = timer.nsecsElapsed();
+    glFinish();
+    const qint64 frameTime = timer.nsecsElapsed();
+
+    if (i < 0) {
+      // Warm-up records are discarded
+      frameProfiler_->flush();
+      frameProfiler_->clear();
+      continue;
+    }
+    cpuTimes.append(cpuTime / 1.0e6);
+    frameTimes.append(frameTime / 1.0e6);
+  }
+  frameProfiler_->flush();
+  doneCurrent();
+
+  const QVector<FrameTiming> timings = frameProfiler_->frameTimings();
+  frameProfiler_->setHistorySize(historySize);
+  frameProfiler_->setEnabled(profilerWasEnabled);
+  camera()->setPosition(position);
+  camera()->setOrientation(orientation);
+  update();
+
+  QVector<qreal> gpuTimes;
+  QVector<qreal> stageTimes[3];
+  for (const FrameTiming &timing : timings) {
+    if (timing.gpuTime >= 0.0)
+      gpuTimes.append(timing.gpuTime);
+    stageTimes[0].append(timing.cpuTime[FrameTiming::PRE_DRAW]);
+    stageTimes[1].append(timing.cpuTime[FrameTiming::DRAW]);
+    stageTimes[2].append(timing.cpuTime[FrameTiming::POST_DRAW]);
+  }
+
+  QJsonObject stages;
+  stages["preDraw"] = benchmarkStatistics(stageTimes[0]);
+  stages["draw"] = benchmarkStatistics(stageTimes[1]);
+  stages["postDraw"] = benchmarkStatistics(stageTimes[2]);
+
+  QJsonObject results;
+  results["path"] = int(index);
+  results["timeStep"] = timeStep;
+  results["nbFrames"] = int(frameTimes.size());
+  results["width"] = width();
+  results["height"] = height();
+  results["cpuTime"] = benchmarkStatistics(cpuTimes);
+  results["frameTime"] = benchmarkStatistics(frameTimes);
+  if (gpuTimes.isEmpty())
+    results["gpuTime"] = QJsonValue();
+  else
+    results["gpuTime"] = benchmarkStatistics(gpuTimes);
+  results["stages"] = stages;
+
+  file.write(QJsonDocument(results).toJson());
+  return true;
+}
+
+// Runs the runBenchmark() requested by the --benchmark command line option,
+// and exits the application.
+void QGLViewer::runCommandLineBenchmark() {
+  const QStringList arguments = QCoreApplication::arguments();
+  const auto option = [&arguments](const QString &name,
+                                   const QString &defaultValue) {
+    const int i = arguments.indexOf(name);
+    return ((i >= 0) && (i + 1 < arguments.size())) ? arguments[i + 1]
+                                                     : defaultValue;
+  };
+
+  bool ok = false;
+  const unsigned int index = option("--benchmark", QString()).toUInt(&ok);
+  if (!ok) {
+    qWarning("Usage: --benchmark <path key> [--benchmark-output <file.json>] "
+             "[--benchmark-step <seconds>]");
+    QCoreApplication::exit(1);
+    return;
+  }
+
+  const QString fileName = option("--benchmark-output", "benchmark.json");
+  const qreal timeStep = option("--benchmark-step", "0").toDouble();
+  const bool success = runBenchmark(index, fileName,
+                                    (timeStep > 0.0) ? timeStep : 1.0 / 60.0);
+  QCoreApplication::exit(success ? 0 : 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Resource accounting                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers a resource allocated by your application for this viewer (display
+lists, textures, vertex buffers, caches...) and returns its id. \p bytes is its
+size in the \p type memory.
+
+The resources of the viewer itself (selectBuffer(), bufferTextureId(),
+snapshot and offscreen buffers...) are always accounted. Use setResourceSize()
+when the resource is reallocated, and removeResource() when it is released.
+Resources with the same \p name are summed in memoryUsageByResource(). */
+int QGLViewer::addResource(const QString &name, MemoryType type,
+                           qint64 bytes) {
+  Resource resource;
+  resource.name = name;
+  resource.type = type;
+  resource.bytes = qMax(qint64(0), bytes);
+  resource.used = true;
+
+  int id;
+  if (!freeResources_.isEmpty()) {
+    id = freeResources_.takeLast();
+    resources_[id] = resource;
+  } else {
+    id = resources_.size();
+    resources_.append(resource);
+  }
+  checkMemoryBudgets();
+  return id;
+}
+
+/*! Changes the size of the resource \p id, returned by addResource(). */
+void QGLViewer::setResourceSize(int id, qint64 bytes) {
+  if (!isValidResource(id, "setResourceSize"))
+    return;
+  resources_[id].bytes = qMax(qint64(0), bytes);
+  checkMemoryBudgets();
+}
+
+/*! Unregisters the resource \p id. Its id may be returned by a next
+addResource(). */
+void QGLViewer::removeResource(int id) {
+  if (!isValidResource(id, "removeResource"))
+    return;
+  resources_[id].used = false;
+  resources_[id].name.clear();
+  freeResources_.append(id);
+  checkMemoryBudgets();
+}
+
+bool QGLViewer::isValidResource(int id, const char *method) const {
+  if ((id < 0) || (id >= resources_.size()) || !resources_.at(id).used) {
+    qWarning("QGLViewer::%s: invalid resource id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+// Estimated size of a framebuffer object: 32 bits RGBA color and 32 bits depth
+// and stencil per sample
+static qint64 framebufferObjectBytes(const QOpenGLFramebufferObject *fbo) {
+  if (!fbo)
+    return 0;
+  const qint64 pixels = qint64(fbo->width()) * fbo->height();
+  const int samples = qMax(1, fbo->format().samples());
+  const int depth =
+      (fbo->attachment() == QOpenGLFramebufferObject::NoAttachment) ? 0 : 4;
+  return pixels * samples * (4 + depth);
+}
+
+/*! Returns the number of bytes of \p type memory used by this viewer and
+by the resources registered with addResource(). Estimated from the sizes and
+formats of the buffers: drivers may use more memory. */
+qint64 QGLViewer::memoryUsage(MemoryType type) const {
+  qint64 total = 0;
+  const QMap<QString, qint64> usage = memoryUsageByResource(type);
+  for (QMap<QString, qint64>::const_iterator it = usage.begin(),
+                                             end = usage.end();
+       it != end; ++it)
+    total += it.value();
+  return total;
+}
+
+/*! Returns the memoryUsage() of \p type, detailed by resource name. The
+resources of the viewer are named after their attributes (\c
+"QGLViewer::selectBuffer"...), the ones of addResource() are grouped by name.
+Resources that are not allocated are not listed.
+
+The GPU_MEMORY lists the framebuffer objects, pixel buffers and textures of
+the viewer and of its helpers (renderTarget(), depthCache(), object ID buffer,
+temporal reprojection and frame ring buffer). The small vertex buffers of the
+visual hints renderers, and the objects of the sceneResources(), frameGraph()
+and renderThread(), are not included: use addResource() for them. */
+QMap<QString, qint64> QGLViewer::memoryUsageByResource(MemoryType type) const {
+  QMap<QString, qint64> usage;
+  if (type == CPU_MEMORY) {
+    if (selectBuffer_)
+      usage["QGLViewer::selectBuffer"] =
+          qint64(selectBufferSize_) * qint64(sizeof(GLuint));
+  } else {
+    if (bufferTextureId_ != 0)
+      usage["QGLViewer::bufferTexture"] =
+          4 * qint64(bufferTextureWidth_) * bufferTextureHeight_;
+
+    const struct {
+      const char *name;
+      const QOpenGLFramebufferObject *fbo;
+    } fbos[] = {{"QGLViewer::selectionFBO", selectionFBO_},
+                {"QGLViewer::refinementFBO", refinementFBO_},
+                {"QGLViewer::scaledFBO", scaledFBO_},
+                {"QGLViewer::multisampleFBO", multisampleFBO_},
+                {"QGLViewer::retainedFBO", retainedFBO_},
+                {"QGLViewer::frameSinkFBO", frameSinkFBO_},
+                {"QGLViewer::snapshotFBO", snapshotFBO_}};
+    for (const auto &f : fbos)
+      if (f.fbo)
+        usage[f.name] = framebufferObjectBytes(f.fbo);
+
+    // Pixel buffers of 32 bits per pixel
+    qint64 snapshotBytes = 0;
+    for (int i = 0; i < 2; ++i)
+      if (snapshotBuffer_[i])
+        snapshotBytes += 4 * qint64(snapshotBufferSize_[i].width()) *
+                         snapshotBufferSize_[i].height();
+    if (snapshotBytes > 0)
+      usage["QGLViewer::snapshotBuffers"] = snapshotBytes;
+
+    // Allocated with the size of the frames
+    const qreal ratio = devicePixelRatioF();
+    const qint64 frameBytes =
+        4 * qint64(ratio * width()) * qint64(ratio * height());
+    for (int i = 0; i < 2; ++i)
+      if (frameSinkBuffer_[i])
+        usage["QGLViewer::frameSinkBuffers"] += frameBytes;
+
+    // Owned helpers that allocate buffers of the size of the frames
+    const struct {
+      const char *name;
+      qint64 bytes;
+    } helpers[] = {
+        {"QGLViewer::renderTarget", renderTarget_->memoryUsage()},
+        {"QGLViewer::depthCache", depthCache_->memoryUsage()},
+        {"QGLViewer::objectIdBuffer",
+         objectIdBuffer_ ? objectIdBuffer_->memoryUsage() : 0},
+        {"QGLViewer::temporalReprojector",
+         temporalReprojector_ ? temporalReprojector_->memoryUsage() : 0},
+        {"QGLViewer::frameRingBuffer",
+         frameRingBuffer_ ? frameRingBuffer_->memoryUsage() : 0}};
+    for (const auto &h : helpers)
+      if (h.bytes > 0)
+        usage[h.name] = h.bytes;
+  }
+
+  for (QVector<Resource>::const_iterator it = resources_.begin(),
+                                         end = resources_.end();
+       it != end; ++it)
+    if (it->used && (it->type == type))
+      usage[it->name] += it->bytes;
+  return usage;
+}
+
+/*! Returns the sum of the memoryUsage() of all the viewers of the
+QGLViewerPool(). */
+qint64 QGLViewer::totalMemoryUsage(MemoryType type) {
+  qint64 total = 0;
+  for (const QGLViewer *viewer : QGLViewer::QGLViewerPool())
+    if (viewer)
+      total += viewer->memoryUsage(type);
+  return total;
+}
+
+/*! Sets the memoryBudget() of \p type, in bytes. Use 0 to disable the
+memoryBudgetExceeded() signal. The budget is checked at each frame and when a
+resource is added or resized. */
+void QGLViewer::setMemoryBudget(MemoryType type, qint64 bytes) {
+  memoryBudget_[type] = qMax(qint64(0), bytes);
+  memoryBudgetExceeded_[type] = false;
+  checkMemoryBudgets();
+}
+
+// Emits memoryBudgetExceeded() when a memoryBudget() is crossed
+void QGLViewer::checkMemoryBudgets() {
+  for (int i = 0; i < 2; ++i) {
+    if (memoryBudget_[i] <= 0)
+      continue;
+
+    const MemoryType type = MemoryType(i);
+    const qint64 bytes = memoryUsage(type);
+    const bool exceeded = bytes > memoryBudget_[i];
+    if (exceeded && !memoryBudgetExceeded_[i]) {
+      qWarning("QGLViewer: %s memory usage (%lld bytes) exceeds its budget "
+               "(%lld bytes)",
+               (type == GPU_MEMORY) ? "GPU" : "CPU", (long long)bytes,
+               (long long)memoryBudget_[i]);
+      memoryBudgetExceeded_[i] = true;
+      Q_EMIT memoryBudgetExceeded(type, bytes);
+    } else if (!exceeded)
+      memoryBudgetExceeded_[i] = false;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Pose inputs                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p input to the poseInputs() of the viewer. Its last published pose is
+applied to its qglviewer::PoseInput::frame() at the beginning of each
+paintGL(), before draw() is called, and each qglviewer::PoseInput::publish()
+requests an update(), with at most one pending request per frame.
+
+A PoseInput belongs to a single viewer: it is removed from its previous one.
+It is not owned by the viewer, and is removed when deleted. */
+void QGLViewer::addPoseInput(qglviewer::PoseInput *input) {
+  if (!input || poseInputs_.contains(input))
+    return;
+  QGLViewer *const previous =
+      qobject_cast<QGLViewer *>(input->receiver_.loadAcquire());
+  if (previous)
+    previous->removePoseInput(input);
+  poseInputs_.append(input);
+  input->receiver_.storeRelease(this);
+  // Applies the pending pose, if any
+  update();
+}
+
+/*! Removes \p input from the poseInputs(). Its poses are no longer latched by
+the viewer. */
+void QGLViewer::removePoseInput(qglviewer::PoseInput *input) {
+  if (!poseInputs_.removeOne(input))
+    return;
+  input->receiver_.storeRelease(nullptr);
+}
+
+// Called at the beginning of paintGL(). The frames modifications are merged.
+void QGLViewer::latchPoseInputs() {
+  if (poseInputs_.isEmpty())
+    return;
+  ModificationBatch batch;
+  for (QList<PoseInput *>::const_iterator it = poseInputs_.constBegin(),
+                                          end = poseInputs_.constEnd();
+       it != end; ++it)
+    (*it)->latch();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Simplified meshes                              //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p mesh to the lodMeshes() of the viewer. The default draw() draws it
+at full detail, and fastDraw() at the level selected by
+qglviewer::LodMesh::draw() for the camera(). Its
+qglviewer::LodMesh::levelsReady() signal requests an update().
+
+The mesh is not owned by the viewer, and is removed when deleted. Its vertex
+buffers are released by the viewer destructor. */
+void QGLViewer::addLodMesh(qglviewer::LodMesh *mesh) {
+  if (!mesh || lodMeshes_.contains(mesh))
+    return;
+  lodMeshes_.append(mesh);
+  connect(mesh, SIGNAL(levelsReady()), this, SLOT(update()));
+  connect(mesh, SIGNAL(destroyed(QObject *)), this,
+          SLOT(lodMeshDestroyed(QObject *)));
+  update();
+}
+
+/*! Removes \p mesh from the lodMeshes(). Its vertex buffers are not released,
+see qglviewer::LodMesh::cleanupGL(). */
+void QGLViewer::removeLodMesh(qglviewer::LodMesh *mesh) {
+  if (!lodMeshes_.removeOne(mesh))
+    return;
+  disconnect(mesh, SIGNAL(levelsReady()), this, SLOT(update()));
+  disconnect(mesh, SIGNAL(destroyed(QObject *)), this,
+             SLOT(lodMeshDestroyed(QObject *)));
+  update();
+}
+
+/*! Draws the lodMeshes(), with the current OpenGL state and matrices. Each
+mesh is drawn at full detail, or, when \p simplified is \c true, at the level
+of detail that fits the projected size of the mesh (see
+qglviewer::LodMesh::selectLevel()).
+
+Called by the default draw(). Call it from your fastDraw() or draw() methods
+when they are overloaded. */
+void QGLViewer::drawLodMeshes(bool simplified) {
+  for (QList<LodMesh *>::const_iterator it = lodMeshes_.constBegin(),
+                                        end = lodMeshes_.constEnd();
+       it != end; ++it)
+    if (simplified)
+      (*it)->draw(camera());
+    else
+      (*it)->drawLevel(0);
+}
+
+// The QObject is being destroyed: only its pointer is still valid
+void QGLViewer::lodMeshDestroyed(QObject *mesh) {
+  lodMeshes_.removeOne(static_cast<LodMesh *>(mesh));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Display wall                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the qglviewer::DisplayWall that synchronizes the frames of this
+viewer with the other nodes of a display wall. Default value is \c nullptr.
+Set using setDisplayWall(). */
+qglviewer::DisplayWall *QGLViewer::displayWall() const { return displayWall_; }
+
+/*! Sets the displayWall() that synchronizes the frames of the viewer. Use \c
+nullptr to leave the wall. \p wall is not owned by the viewer, and is removed
+when deleted. A qglviewer::DisplayWall is used by a single viewer: it is first
+removed from its previous one. The viewer displays the qglviewer::Camera::tile()
+of the wall. */
+void QGLViewer::setDisplayWall(qglviewer::DisplayWall *wall) {
+  if (wall == displayWall_)
+    return;
+  if (displayWall_)
+    displayWall_->viewer_ = nullptr;
+  if (wall && wall->viewer_)
+    wall->viewer_->setDisplayWall(nullptr);
+  displayWall_ = wall;
+  if (wall)
+    wall->viewer_ = this;
+  update();
+}
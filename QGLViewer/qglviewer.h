@@ -8,13 +8,51 @@
 #  include <QGL>
 #endif
 #include <QMap>
+#include <QMatrix4x4>
 #include <QElapsedTimer>
+#include <QPointer>
+
+#include <functional>
 
 class QTabWidget;
+class QOpenGLBuffer;
+class QOpenGLFramebufferObject;
+class QProcess;
+class QSemaphore;
+class QThreadPool;
 
 namespace qglviewer {
+class BufferUploader;
+class CoreProfileRenderer;
+class DepthCache;
+class DisplayWall;
+class FrameCapture;
+class FrameGraph;
+class FrameProfiler;
+class FrameRingBuffer;
+class FrameSink;
+class GLStateCache;
+class PoseInput;
+class GlyphRenderer;
+class LineRenderer;
+struct FrameTiming;
+class LodMesh;
 class MouseGrabber;
+class MouseGrabberGroup;
 class ManipulatedFrame;
+class ObjectIdBuffer;
+class OcclusionCuller;
+class ClippingRegion;
+class OverlayLayer;
+class RayPicker;
+class RenderTarget;
+class RenderThread;
+class SceneBounds;
+class SceneResources;
+class SimulationThread;
+class SnapshotTileRenderer;
+class TemporalReprojector;
+class TextRenderer;
 class ManipulatedCameraFrame;
 } // namespace qglviewer
 
@@ -82,12 +120,44 @@ public:
   Set by setFPSIsDisplayed() or toggleFPSIsDisplayed(). Use currentFPS() to get
   the current FPS. Default value is \c false. */
   bool FPSIsDisplayed() const { return FPSIsDisplayed_; }
+  /*! Returns \c true if the viewer displays a graph of the recent frame times
+  (see qglviewer::FrameProfiler::drawGraph()).
+
+  Set by setFrameTimingGraphIsDisplayed() or toggleFrameTimingGraphIsDisplayed(),
+  which also enable the frameProfiler(). Ignored with a core profile context.
+  Default value is \c false. */
+  bool frameTimingGraphIsDisplayed() const {
+    return frameTimingGraphIsDisplayed_;
+  }
+  /*! Returns \c true if the viewer displays, under the frame rate, the
+  qglviewer::HotPathCounters counts of the last frame (see
+  qglviewer::FrameProfiler::lastFrameCount()).
+
+  Set by setHotPathCountersAreDisplayed(), which also enables the
+  frameProfiler(). Default value is \c false. */
+  bool hotPathCountersAreDisplayed() const {
+    return hotPathCountersAreDisplayed_;
+  }
   /*! Returns \c true if text display (see drawText()) is enabled.
 
   Set by setTextIsEnabled() or toggleTextIsEnabled(). This feature conveniently
   removes all the possibly displayed text, cleaning display. Default value is \c
   true. */
   bool textIsEnabled() const { return textIsEnabled_; }
+  /*! Returns \c true if the texts are drawn in batches.
+
+  When \c false (default), each renderText() call (and hence each drawText())
+  draws its text immediately, using a \c QPainter on the widget.
+
+  When \c true, the glyphs are rasterized once in a texture atlas, and all the
+  texts of a frame are drawn with a single OpenGL call at the end of postDraw().
+  Texts hence appear on top of the scene, whatever the order of the draw()
+  calls. Use the \p color parameter of drawText() to avoid a \c
+  GL_CURRENT_COLOR read back per text. Characters are laid out with their
+  advance only, without kerning nor complex text shaping.
+
+  Ignored with a core profile context. Set by setTextIsBatched(). */
+  bool textIsBatched() const { return textIsBatched_; }
 
   /*! Returns \c true if the camera() is being edited in the viewer.
 
@@ -100,6 +170,32 @@ public:
   implemented in the future. */
   bool cameraIsEdited() const { return cameraIsEdited_; }
 
+  /*! Returns \c true when the grid, the axis and the visual hints are drawn
+  with vertex buffers and a shader program instead of the fixed function
+  pipeline.
+
+  This lets the viewer run in an OpenGL 3.3+ core profile context: it is
+  automatically set to \c true by initializeGL() when the format() profile is
+  \c QSurfaceFormat::CoreProfile. Camera paths (see cameraIsEdited()) are not
+  drawn in that mode.
+
+  Set by setVisualHintsUseCoreProfile(), which must be called before the
+  viewer is first shown (typically in your viewer's constructor). Default
+  value is \c false. */
+  bool visualHintsUseCoreProfile() const { return visualHintsUseCoreProfile_; }
+  /*! Returns \c true when the shader programs of the viewer (the instanced
+  axes and cameras, and the temporal reprojection when reprojectionIsEnabled())
+  are built after init(), instead of when they are first used, so that these
+  frames do not stall on shader compilation.
+
+  The linked programs are stored by Qt in its program binary cache, keyed by
+  the driver and the shader sources: the next runs of the application load
+  them instead of compiling them. Set the \c Qt::AA_DisableShaderDiskCache
+  application attribute to disable this cache. Nothing is built by contexts
+  older than OpenGL 3.3 (OpenGL ES 3.0), which use the fixed function
+  pipeline. Default value is \c true. */
+  bool shaderWarmUpIsEnabled() const { return shaderWarmUpIsEnabled_; }
+
 public Q_SLOTS:
   /*! Sets the state of axisIsDrawn(). Emits the axisIsDrawnChanged() signal.
    * See also toggleAxisIsDrawn(). */
@@ -130,6 +226,12 @@ public Q_SLOTS:
     update();
   }
   void setCameraIsEdited(bool edit = true);
+  void setVisualHintsUseCoreProfile(bool useCoreProfile = true);
+  /*! Sets shaderWarmUpIsEnabled(). Must be called before the viewer is first
+  shown to have an effect. */
+  void setShaderWarmUpIsEnabled(bool enabled = true) {
+    shaderWarmUpIsEnabled_ = enabled;
+  }
 
   /*! Toggles the state of axisIsDrawn(). See also setAxisIsDrawn(). */
   void toggleAxisIsDrawn() { setAxisIsDrawn(!axisIsDrawn()); }
@@ -137,6 +239,17 @@ public Q_SLOTS:
   void toggleGridIsDrawn() { setGridIsDrawn(!gridIsDrawn()); }
   /*! Toggles the state of FPSIsDisplayed(). See also setFPSIsDisplayed(). */
   void toggleFPSIsDisplayed() { setFPSIsDisplayed(!FPSIsDisplayed()); }
+  void setFrameTimingGraphIsDisplayed(bool display = true);
+  /*! Toggles the state of frameTimingGraphIsDisplayed(). */
+  void toggleFrameTimingGraphIsDisplayed() {
+    setFrameTimingGraphIsDisplayed(!frameTimingGraphIsDisplayed());
+  }
+  void setHotPathCountersAreDisplayed(bool display = true);
+  /*! Toggles the state of hotPathCountersAreDisplayed(). */
+  void toggleHotPathCountersAreDisplayed() {
+    setHotPathCountersAreDisplayed(!hotPathCountersAreDisplayed());
+  }
+  void setTextIsBatched(bool batched = true);
   /*! Toggles the state of textIsEnabled(). See also setTextIsEnabled(). */
   void toggleTextIsEnabled() { setTextIsEnabled(!textIsEnabled()); }
   /*! Toggles the state of cameraIsEdited(). See also setCameraIsEdited(). */
@@ -185,6 +298,7 @@ public Q_SLOTS:
      also setForegroundColor(). */
   void setBackgroundColor(const QColor &color) {
     backgroundColor_ = color;
+    retainedSceneIsValid_ = false;
     glClearColor(color.redF(), color.greenF(), color.blueF(), color.alphaF());
   }
   /*! Sets the foregroundColor() of the viewer, used to draw visual hints. See
@@ -277,10 +391,59 @@ public:
   qglviewer::ManipulatedFrame *manipulatedFrame() const {
     return manipulatedFrame_;
   }
+  /*! Returns the qglviewer::SceneResources shared with the other viewers that
+  display the same scene. Default value is \c nullptr. */
+  qglviewer::SceneResources *sceneResources() const { return sceneResources_; }
+  /*! Returns the qglviewer::OcclusionCuller updated by preDraw() and
+  postDraw(). Default value is \c nullptr. */
+  qglviewer::OcclusionCuller *occlusionCuller() const {
+    return occlusionCuller_;
+  }
+  /*! Returns the qglviewer::ClippingRegion enabled by preDraw() and disabled
+  by postDraw(). Default value is \c nullptr. */
+  qglviewer::ClippingRegion *clippingRegion() const { return clippingRegion_; }
+  /*! Returns the qglviewer::SceneBounds that preDraw() uses to update the
+  sceneCenter() and sceneRadius(). Default value is \c nullptr. */
+  qglviewer::SceneBounds *sceneBounds() const { return sceneBounds_; }
 
 public Q_SLOTS:
   void setCamera(qglviewer::Camera *const camera);
   void setManipulatedFrame(qglviewer::ManipulatedFrame *frame);
+  void setSceneResources(qglviewer::SceneResources *resources);
+  void setOcclusionCuller(qglviewer::OcclusionCuller *culler);
+  void setClippingRegion(qglviewer::ClippingRegion *region);
+  void setSceneBounds(qglviewer::SceneBounds *bounds);
+  //@}
+
+  /*! @name Viewports */
+  //@{
+public:
+  int addViewport(qglviewer::Camera *camera, const QRectF &region);
+  /*! Returns the number of viewports. Default value is 0: camera() is
+  displayed in the whole widget. See addViewport(). */
+  int numberOfViewports() const { return viewports_.size(); }
+  /*! Returns the Camera of the viewport \p index. */
+  qglviewer::Camera *viewportCamera(int index) const {
+    return viewports_.at(index).camera;
+  }
+  QRect viewportRegion(int index) const;
+  int viewportAt(const QPoint &pos) const;
+  /*! Returns the index of the viewport that receives the mouse and keyboard
+  events, and which Camera is returned by camera(). -1 when there are no
+  viewports. */
+  int currentViewport() const { return currentViewport_; }
+
+public Q_SLOTS:
+  void removeViewport(int index);
+  void clearViewports();
+  void setCurrentViewport(int index);
+
+private:
+  void updateViewports();
+  void applyViewport(int index);
+  void paintViewports();
+  bool routeViewportEvent(QMouseEvent *e);
+  bool routeViewportEvent(QWheelEvent *e);
   //@}
 
   /*! @name Mouse grabbers */
@@ -322,8 +485,35 @@ public:
     return !disabledMouseGrabbers_.contains(
         reinterpret_cast<size_t>(mouseGrabber));
   }
+  /*! Returns \c true when the MouseGrabbers are indexed in a screen space
+  grid.
+
+  With mouse tracking, mouseMoveEvent() otherwise calls
+  qglviewer::MouseGrabber::checkIfGrabsMouse() on every MouseGrabber of the
+  pool at each mouse displacement. When indexed, only the MouseGrabbers which
+  qglviewer::MouseGrabber::mouseGrabRegion() overlaps the grid cell of the
+  mouse cursor are tested. The grid is lazily rebuilt when the camera() or a
+  mouseGrabRegion() is modified.
+
+  Default value is \c false. Enable it with many MouseGrabbers, such as
+  thousands of qglviewer::ManipulatedFrame handles. */
+  bool mouseGrabberIndexIsEnabled() const {
+    return mouseGrabberIndexIsEnabled_;
+  }
+  /*! Returns the qglviewer::MouseGrabberGroup which MouseGrabbers are tested
+  by mouseMoveEvent().
+
+  Default value is the qglviewer::MouseGrabber::defaultMouseGrabberGroup(),
+  that holds the qglviewer::MouseGrabber::MouseGrabberPool() shared by all the
+  viewers. Viewers that display different scenes should rather use a group
+  per scene: see setMouseGrabberGroup(). */
+  qglviewer::MouseGrabberGroup *mouseGrabberGroup() const {
+    return mouseGrabberGroup_;
+  }
 public Q_SLOTS:
   void setMouseGrabber(qglviewer::MouseGrabber *mouseGrabber);
+  void setMouseGrabberIndexIsEnabled(bool enabled = true);
+  void setMouseGrabberGroup(qglviewer::MouseGrabberGroup *group);
   //@}
 
   /*! @name State of the viewer */
@@ -343,6 +533,21 @@ public:
   \c QTimer, when animationIsStarted() or when the camera is manipulated with
   the mouse.  */
   qreal currentFPS() { return f_p_s_; }
+  /*! Returns the qglviewer::FrameProfiler that measures the CPU and GPU time
+  of the frames, never \c nullptr. It is disabled by default. */
+  qglviewer::FrameProfiler *frameProfiler() const { return frameProfiler_; }
+  /*! Returns the time (in milliseconds) spent in the different stages of the
+  creation of the viewer, to monitor the startup time of an application.
+
+  The keys are \c "camera", \c "shortcuts" (setDefaultShortcuts()), \c
+  "mouseBindings" (setDefaultMouseBindings()) and \c "constructor" (the rest
+  of the constructor), available once the viewer is created, and \c
+  "initializeGL", \c "init" (your init() method) and \c "shaderWarmUp" (see
+  shaderWarmUpIsEnabled()), available after the first display.
+
+  Snapshot formats, the help() window and the snapshot dialogs are only
+  created when they are first needed. */
+  QMap<QString, qreal> startupTimes() const { return startupTimes_; }
   /*! Returns \c true if the viewer is in fullScreen mode.
 
   Default value is \c false. Set by setFullScreen() or toggleFullScreen().
@@ -370,6 +575,25 @@ public:
   qglviewer::Camera::setPhysicalScreenWidth() and
   qglviewer::Camera::setFocusDistance(). */
   bool displaysInStereo() const { return stereo_; }
+  /*! Returns \c true if the stereo images are drawn in a single pass.
+
+  When \c false (default), paintGL() calls preDrawStereo(), draw() and
+  postDraw() for each eye, and the scene is hence traversed twice.
+
+  When \c true, paintGL() clears both buffers with preDraw() and calls
+  drawStereo() once. Overload drawStereo() to render both eyes with a single
+  traversal: qglviewer::Camera::getStereoMatrices() provides the two eye
+  matrices as uniform arrays, and an instanced draw call (or the \c
+  GL_OVR_multiview extension) selects the eye of each instance and its layered
+  or side-by-side render target. postDraw() is then called for each eye.
+
+  drawStereo() can also draw() the scene only once in a
+  qglviewer::StereoReprojector, and synthesize the qglviewer::StereoReprojector
+  ::LEFT_VIEW and qglviewer::StereoReprojector::RIGHT_VIEW in each buffer
+  (see selectStereoBuffer()), for a preview at half the cost.
+
+  Set by setStereoIsSinglePass(). */
+  bool stereoIsSinglePass() const { return stereoIsSinglePass_; }
   /*! Returns the recommended size for the QGLViewer. Default value is 600x400
    * pixels. */
   virtual QSize sizeHint() const { return QSize(600, 400); }
@@ -377,6 +601,7 @@ public:
 public Q_SLOTS:
   void setFullScreen(bool fullScreen = true);
   void setStereoDisplay(bool stereo = true);
+  void setStereoIsSinglePass(bool singlePass = true);
   /*! Toggles the state of isFullScreen(). See also setFullScreen(). */
   void toggleFullScreen() { setFullScreen(!isFullScreen()); }
   /*! Toggles the state of displaysInStereo(). See setStereoDisplay(). */
@@ -385,6 +610,7 @@ public Q_SLOTS:
 
 private:
   bool cameraIsInRotateMode() const;
+  void selectStereoBuffer(bool leftBuffer);
   //@}
 
   /*! @name Display methods */
@@ -396,11 +622,15 @@ public:
                         qreal radius = -1.0, int nbSubdivisions = 12);
   static void drawAxis(qreal length = 1.0);
   static void drawGrid(qreal size = 1.0, int nbSubdivisions = 10);
+  void drawAxes(const QVector<QMatrix4x4> &matrices, qreal length = 1.0);
+  void drawCameras(const QVector<const qglviewer::Camera *> &cameras,
+                   bool drawFarPlane = true, qreal scale = 1.0);
 
   virtual void startScreenCoordinatesSystem(bool upward = false) const;
   virtual void stopScreenCoordinatesSystem() const;
 
-  void drawText(int x, int y, const QString &text, const QFont &fnt = QFont());
+  void drawText(int x, int y, const QString &text, const QFont &fnt = QFont(),
+                const QColor &color = QColor());
   void displayMessage(const QString &message, int delay = 2000);
   // void draw3DText(const qglviewer::Vec& pos, const qglviewer::Vec& normal,
   // const QString& string, GLfloat height=0.1);
@@ -410,6 +640,8 @@ protected:
 
 private:
   void displayFPS();
+  void displayHotPathCounters();
+  void updateFPS();
   /*! Vectorial rendering callback method. */
   void drawVectorial() { paintGL(); }
 
@@ -482,8 +714,9 @@ public:
   \endcode
 
   If the library was compiled with the vectorial rendering option (default),
-  three additional vectorial formats are available: \c "EPS", \c "PS" and \c
-  "XFIG". \c "SVG" and \c "PDF" formats should soon be available. The <a
+  four additional vectorial formats are available: \c "EPS", \c "PS", \c
+  "XFIG" and \c "PDF" (compressed). \c "SVG" format should soon be available.
+  The <a
   href="http://artis.imag.fr/Software/VRender">VRender library</a> was created
   by Cyril Soler.
 
@@ -491,7 +724,16 @@ public:
   not reproduced and \c PASS_THROUGH tokens are not handled so one can not
   change point and line size in the middle of a drawing.
 
-  Default value is the first supported among "JPEG, PNG, EPS, PS, PPM, BMP", in
+  When the \c "TIFF" format is selected in the saveSnapshot() dialog, the
+  image is streamed to disk as its rows of tiles are rendered, so that memory
+  stays bounded by one row of tiles whatever the image size. An uncompressed
+  RGBA file is written, using the BigTIFF variant beyond 4 GB.
+
+  The \c "VIDEO" format appends the frames to a single video file instead,
+  piped to an external encoder: see snapshotVideoFrameRate().
+
+  Default value is the first supported among "JPEG, PNG, EPS, PS, PPM, BMP,
+  TIFF", in
   that order.
 
   This value is set using setSnapshotFormat() or with
@@ -499,7 +741,7 @@ public:
 
   \attention No verification is performed on the provided format validity. The
   next call to saveSnapshot() may fail if the format string is not supported. */
-  const QString &snapshotFormat() const { return snapshotFormat_; }
+  const QString &snapshotFormat() const;
   /*! Returns the value of the counter used to name snapshots in saveSnapshot()
   when \p automatic is \c true.
 
@@ -516,6 +758,83 @@ public:
 
   \note This value has no impact on the images produced in vectorial format. */
   int snapshotQuality() { return snapshotQuality_; }
+  /*! Returns \c true when the tiles of the large image snapshots created by
+  saveSnapshot() are rendered in an offscreen framebuffer object.
+
+  Tiles are then as large as \c GL_MAX_RENDERBUFFER_SIZE allows (instead of
+  the widget size), the oversampling factor of the snapshot dialog is
+  converted into a number of multisampling samples, and pixels are directly
+  copied in the resulting image. This is much faster for very large images.
+
+  Default value is \c false. Set using setSnapshotUsesFramebufferObject().
+
+  \attention Text drawn with drawText() uses a \c QPainter on the widget
+  itself and is hence not rendered in the offscreen tiles. */
+  bool snapshotUsesFramebufferObject() const {
+    return snapshotUsesFramebufferObject_;
+  }
+  /*! Returns the qglviewer::SnapshotTileRenderer that renders the tiles of
+  the large image snapshots. Default value is \c nullptr, meaning that the
+  tiles are rendered one after the other by draw(), on the viewer's context.
+
+  When set, and when snapshotUsesFramebufferObject(), saveSnapshot() computes
+  the tiles sub-frustums and gives them to its
+  qglviewer::SnapshotTileRenderer::renderTiles(), which renders them in
+  parallel in several contexts. The tiles are then made small enough for each
+  context to have at least one of them. The renderer is not owned by the
+  viewer. */
+  qglviewer::SnapshotTileRenderer *snapshotTileRenderer() const {
+    return snapshotTileRenderer_;
+  }
+  /*! Returns \c true when the \p automatic saveSnapshot() encodes and writes
+  images in background threads.
+
+  The frame buffer is then read back in one of two alternated pixel buffer
+  objects, and only retrieved at the next automatic saveSnapshot() call, so
+  that the read back does not stall the pipeline. The image is then encoded and
+  written by a worker thread. File names are defined when saveSnapshot() is
+  called, so that the snapshotCounter() numbering is preserved.
+
+  Use snapshotQueueSize() to monitor the number of images waiting to be
+  written and flushSnapshotQueue() to wait for all of them (for instance at
+  the end of an animation capture). saveSnapshot() blocks when
+  maximumSnapshotQueueSize() is reached.
+
+  Default value is \c false. Vectorial formats are always saved synchronously.
+  Set using setSnapshotAsynchronous(). */
+  bool snapshotIsAsynchronous() const { return snapshotIsAsynchronous_; }
+  int snapshotQueueSize() const;
+  /*! Returns the maximum number of images that can be waiting to be encoded
+  when snapshotIsAsynchronous(). Default value is 8. */
+  int maximumSnapshotQueueSize() const { return maximumSnapshotQueueSize_; }
+  /*! Returns the number of frames per second of the video created when
+  snapshotFormat() is \c "VIDEO". Default value is 25.
+
+  Each saveSnapshot() call then appends the current frame to a single video
+  file, named after snapshotFileName(), that is encoded on the fly. A
+  snapshotCounter() is only appended when the \p automatic saveSnapshot() would
+  otherwise overwrite an existing file. The frame buffer is read back in the
+  pixel buffer objects of the asynchronous snapshots (see
+  snapshotIsAsynchronous()), and its raw pixels are piped to an external
+  snapshotVideoEncoder() process: no image file is written or compressed. Call closeSnapshotVideo() at the end of
+  the animation to complete the file.
+
+  All the frames of a video must have the same size. Set using
+  setSnapshotVideoFrameRate(). */
+  int snapshotVideoFrameRate() const { return snapshotVideoFrameRate_; }
+  /*! Returns the codec used to encode the \c "VIDEO" snapshots, as an \c
+  ffmpeg \c -c:v argument. Default value is \c "libx264". snapshotQuality()
+  is not used: use setSnapshotVideoCodec() with an encoder specific codec
+  instead (\c "libx264rgb" or \c "ffv1" for lossless videos for instance). */
+  const QString &snapshotVideoCodec() const { return snapshotVideoCodec_; }
+  /*! Returns the program started to encode the \c "VIDEO" snapshots. Default
+  value is \c "ffmpeg", found in the \c PATH. Any program that accepts the
+  \c ffmpeg command line options can be used. Set using
+  setSnapshotVideoEncoder(). */
+  const QString &snapshotVideoEncoder() const { return snapshotVideoEncoder_; }
+  /*! Returns \c true while a \c "VIDEO" snapshot is being recorded, between
+  the first saveSnapshot() and closeSnapshotVideo(). */
+  bool isRecordingSnapshotVideo() const { return videoEncoder_ != nullptr; }
 
   // Qt 2.3 does not support qreal default value parameters in slots.
   // Remove "Q_SLOTS" from the following line to compile with Qt 2.3
@@ -532,9 +851,31 @@ public Q_SLOTS:
   void setSnapshotCounter(int counter) { snapshotCounter_ = counter; }
   /*! Sets the snapshotQuality(). */
   void setSnapshotQuality(int quality) { snapshotQuality_ = quality; }
+  /*! Sets the snapshotUsesFramebufferObject() value. */
+  void setSnapshotUsesFramebufferObject(bool enable) {
+    snapshotUsesFramebufferObject_ = enable;
+  }
+  void setSnapshotTileRenderer(qglviewer::SnapshotTileRenderer *renderer);
+  void setSnapshotAsynchronous(bool asynchronous);
+  void setMaximumSnapshotQueueSize(int size);
+  void flushSnapshotQueue();
+  void setSnapshotVideoFrameRate(int frameRate);
+  /*! Sets the snapshotVideoCodec(). Applies to the next video. */
+  void setSnapshotVideoCodec(const QString &codec) {
+    snapshotVideoCodec_ = codec;
+  }
+  /*! Sets the snapshotVideoEncoder(). Applies to the next video. */
+  void setSnapshotVideoEncoder(const QString &program) {
+    snapshotVideoEncoder_ = program;
+  }
+  bool closeSnapshotVideo();
   bool openSnapshotFormatDialog();
   void snapshotToClipboard();
 
+public:
+  bool saveDeepZoomSnapshot(const QString &fileName, const QSize &size,
+                            int tileSize = 256, int overlap = 1);
+
 private:
   bool saveImageSnapshot(const QString &fileName);
 
@@ -587,6 +928,78 @@ public:
   }
   //@}
 
+  /*! @name Frame streaming */
+  //@{
+public:
+  /*! Returns the qglviewer::FrameSink that receives the frames drawn by the
+  viewer. Default value is \c nullptr. Set using setFrameSink(). */
+  qglviewer::FrameSink *frameSink() const { return frameSink_; }
+
+public Q_SLOTS:
+  void setFrameSink(qglviewer::FrameSink *sink);
+  //@}
+
+  /*! @name Display wall */
+  //@{
+public:
+  qglviewer::DisplayWall *displayWall() const;
+
+public Q_SLOTS:
+  void setDisplayWall(qglviewer::DisplayWall *wall);
+  //@}
+
+  /*! @name Pose inputs */
+  //@{
+public:
+  void addPoseInput(qglviewer::PoseInput *input);
+  void removePoseInput(qglviewer::PoseInput *input);
+  /*! Returns the qglviewer::PoseInput latched at the beginning of each
+  paintGL(). See addPoseInput(). */
+  const QList<qglviewer::PoseInput *> &poseInputs() const {
+    return poseInputs_;
+  }
+  //@}
+
+  /*! @name Simplified meshes */
+  //@{
+public:
+  void addLodMesh(qglviewer::LodMesh *mesh);
+  void removeLodMesh(qglviewer::LodMesh *mesh);
+  /*! Returns the qglviewer::LodMesh drawn by the default draw(). See
+  addLodMesh(). */
+  const QList<qglviewer::LodMesh *> &lodMeshes() const { return lodMeshes_; }
+  void drawLodMeshes(bool simplified);
+
+private Q_SLOTS:
+  void lodMeshDestroyed(QObject *mesh);
+  //@}
+
+  /*! @name OpenGL state cache */
+  //@{
+public:
+  /*! Returns the qglviewer::GLStateCache used by the drawing helpers of the
+  viewer (postDraw(), drawAxis(), drawGrid()...) to skip redundant OpenGL state
+  changes and queries. It is qglviewer::GLStateCache::current() during
+  postDraw(), and during the whole paintGL() when glStateIsTracked(). */
+  qglviewer::GLStateCache *glStateCache() const { return glStateCache_; }
+  /*! Returns \c true when draw() only modifies the recorded OpenGL states
+  through glStateCache().
+
+  When \c false (default), the cache is invalidated before postDraw(), since
+  draw() may call \c glEnable() directly, and the drawing helpers called by
+  draw() query the OpenGL state as usual.
+
+  When \c true, glStateCache() is qglviewer::GLStateCache::current() for the
+  whole paintGL(), and is only invalidated at the beginning of each frame and
+  after each \c QPainter use. The states set in draw() are then known by
+  postDraw(). Set using setGLStateIsTracked(). */
+  bool glStateIsTracked() const { return glStateIsTracked_; }
+
+public Q_SLOTS:
+  /*! Sets the glStateIsTracked() value. */
+  void setGLStateIsTracked(bool tracked = true) { glStateIsTracked_ = tracked; }
+  //@}
+
   /*! @name Buffer to texture */
   //@{
 public:
@@ -609,15 +1022,145 @@ public:
   // As of version 2.7.0, the use of QOpenGLWidget instead means that they have
   // to be provided for backward compatibility.
   void renderText(int x, int y, const QString &str,
-                  const QFont &font = QFont());
+                  const QFont &font = QFont(), const QColor &color = QColor());
   void renderText(double x, double y, double z, const QString &str,
-                  const QFont &font = QFont());
+                  const QFont &font = QFont(), const QColor &color = QColor());
 #endif
 
 public Q_SLOTS:
   void copyBufferToTexture(GLint internalFormat, GLenum format = GL_NONE);
   //@}
 
+  /*! @name Render to texture */
+  //@{
+public:
+  /*! Returns the qglviewer::RenderTarget used by drawToRenderTarget(). Its
+  qglviewer::RenderTarget::colorTexture() and
+  qglviewer::RenderTarget::depthTexture() contain the scene drawn by the last
+  drawToRenderTarget().
+
+  It is owned by the viewer, and its OpenGL resources are released with the
+  viewer context. */
+  qglviewer::RenderTarget *renderTarget() const { return renderTarget_; }
+
+public Q_SLOTS:
+  void drawToRenderTarget();
+  //@}
+
+  /*! @name Overlay layers */
+  //@{
+public:
+  /*! Returns the qglviewer::OverlayLayer list composited over the frames by
+  postDraw(), in drawing order. See addOverlayLayer(). */
+  QList<qglviewer::OverlayLayer *> overlayLayers() const {
+    return overlayLayers_;
+  }
+  void addOverlayLayer(qglviewer::OverlayLayer *layer);
+  void removeOverlayLayer(qglviewer::OverlayLayer *layer);
+
+private:
+  void drawOverlayLayers();
+  //@}
+
+  /*! @name Depth cache */
+  //@{
+public:
+  /*! Returns \c true when the depth buffer of each frame is copied in the
+  depthCache(). Default value is \c false.
+
+  The camera() qglviewer::Camera::pointUnderPixel() then reads the depths of
+  the last frame from memory, so that any number of pixel queries (hover
+  feedback, setPivotPointFromPixel()...) can be made without stalling OpenGL.
+  Use depthCache() to query the depths and unproject points directly, and
+  qglviewer::DepthCache::setReduction() to capture a smaller depth buffer.
+
+  The depths are captured at the end of paintGL() and available from the next
+  frame. Frames drawn in stereo or with viewports are not captured. They are
+  also used to fit the camera() clipping planes, see
+  qglviewer::Camera::setClippingPlanesFittedToDepth(). */
+  bool depthCacheIsEnabled() const { return depthCacheIsEnabled_; }
+  /*! Returns the qglviewer::DepthCache filled when depthCacheIsEnabled(). It is
+  owned by the viewer, and never \c nullptr. */
+  qglviewer::DepthCache *depthCache() const { return depthCache_; }
+
+public Q_SLOTS:
+  void setDepthCacheIsEnabled(bool enabled = true);
+
+private:
+  void captureDepthCache();
+  //@}
+
+  /*! @name Render thread */
+  //@{
+public:
+  /*! Returns the qglviewer::RenderThread that draws the scene of the viewer.
+  Default value is \c nullptr, meaning that draw() is called by paintGL() in
+  the GUI thread.
+
+  When set, paintGL() calls preDraw(), composites the last frame completed by
+  the render thread, requests a new frame with the current camera() state and
+  calls postDraw(). draw(), fastDraw() and drawLevelOfDetail() are not called.
+  The GUI thread hence never waits for the scene drawing, and the interaction
+  remains responsive whatever its cost.
+
+  The paint that composites a new frame only requests another one when the
+  camera(), the size or the backgroundColor() changed, after invalidateScene()
+  or while animationIsStarted(): a still scene is not drawn again and again.
+  Call invalidateScene() when your scene is modified, since an \c update()
+  merged with the paint of a new frame does not request one.
+
+  Stereo, viewports, retainedModeIsEnabled() and refinement passes are not
+  supported by the render thread: these frames are drawn with draw(), in the
+  GUI thread. The render thread is not owned by the viewer. */
+  qglviewer::RenderThread *renderThread() const { return renderThread_; }
+
+public Q_SLOTS:
+  void setRenderThread(qglviewer::RenderThread *thread);
+
+private Q_SLOTS:
+  void renderThreadFrameReady();
+
+private:
+  void drawRenderThreadFrame();
+  //@}
+
+  /*! @name Buffer uploads */
+  //@{
+public:
+  qglviewer::BufferUploader *bufferUploader();
+  //@}
+
+  /*! @name Frame ring buffer */
+  //@{
+public:
+  qglviewer::FrameRingBuffer *frameRingBuffer();
+  //@}
+
+  /*! @name Frame graph */
+  //@{
+public:
+  qglviewer::FrameGraph *frameGraph();
+  //@}
+
+  /*! @name Frame capture */
+  //@{
+public:
+  /*! Returns the qglviewer::FrameCapture through which draw() issues the
+  draw calls and buffer updates to record. Never \c nullptr. */
+  qglviewer::FrameCapture *frameCapture() const { return frameCapture_; }
+
+public Q_SLOTS:
+  void captureFrame(const QString &fileName);
+
+Q_SIGNALS:
+  /*! Signal emitted when the frame requested by captureFrame() has been saved
+  in \p fileName. */
+  void frameCaptured(const QString &fileName);
+
+private:
+  void saveFrameCapture();
+  //@}
+
   /*! @name Animation */
   //@{
 public:
@@ -630,6 +1173,10 @@ public:
   Use startAnimation(), stopAnimation() or toggleAnimation() to change this
   value.
 
+  With an animationClock() (default), animate() is called at the first clock
+  tick after each animationPeriod(), at most once per tick, and in the same
+  tick as the other animations of the viewer.
+
   See the <a href="../examples/animation.html">animation example</a> for
   illustration. */
   bool animationIsStarted() const { return animationStarted_; }
@@ -650,12 +1197,25 @@ public:
   startAnimation(). If animationIsStarted(), you should stopAnimation() first.
 */
   int animationPeriod() const { return animationPeriod_; }
+  /*! Returns the qglviewer::SimulationThread that advances the scene in place
+  of animate(). Default value is \c nullptr.
+
+  When set, startAnimation() and stopAnimation() also start and stop the
+  simulation thread. The animation loop no longer calls animate(): it only
+  calls update(), every animationPeriod(), and preDraw() interpolates the
+  displayed scene between the last two simulated states (see
+  qglviewer::SimulationThread::interpolate()). The simulation thread is not
+  owned by the viewer. */
+  qglviewer::SimulationThread *simulationThread() const {
+    return simulationThread_;
+  }
 
 public Q_SLOTS:
   /*! Sets the animationPeriod(), in milliseconds. */
   void setAnimationPeriod(int period) { animationPeriod_ = period; }
   virtual void startAnimation();
   virtual void stopAnimation();
+  void setSimulationThread(qglviewer::SimulationThread *thread);
   /*! Scene animation method.
 
     When animationIsStarted(), this method is in charge of the scene update
@@ -668,6 +1228,8 @@ public Q_SLOTS:
     not use this method to animate a Frame, but rather rely on a QTimer
     signal-slot mechanism.
 
+    Use parallelFor() to update a large number of independent elements.
+
     See the <a href="../examples/animation.html">animation example</a> for an
     illustration. */
   virtual void animate() { Q_EMIT animateNeeded(); }
@@ -679,6 +1241,141 @@ public Q_SLOTS:
     else
       startAnimation();
   }
+
+public:
+  void parallelFor(int nbElements,
+                   const std::function<void(int begin, int end)> &function,
+                   int minChunkSize = 256);
+  //@}
+
+  /*! @name Animation clock */
+  //@{
+public:
+  /*! Returns the qglviewer::AnimationClock that drives the animation loop,
+  the spinning and flying of the camera() and manipulatedFrame(), and the
+  camera() paths and interpolations.
+
+  All these animations are advanced by the same clock tick, with the same
+  elapsed time, and result in a single repaint per tick. Each viewer creates
+  its own clock. Use setAnimationClock() to share a clock between viewers,
+  or to go back (with \c nullptr) to one timer per animated object. */
+  qglviewer::AnimationClock *animationClock() const { return animationClock_; }
+public Q_SLOTS:
+  void setAnimationClock(qglviewer::AnimationClock *clock);
+private Q_SLOTS:
+  void advanceAnimation(int elapsed);
+  //@}
+
+  /*! @name Frame pacing */
+  //@{
+public:
+  /*! Returns \c true when the redraws are paced by the display.
+
+  The camera() manipulation, spinning, KeyFrameInterpolators and the
+  animation loop all call update(). With fast mice, spinning and animation
+  combined, paintGL() may then be called more often than the display can
+  present the frames, and each intermediate mouseMoveEvent() is fully
+  processed.
+
+  When paced, at most one paintGL() is performed per presented frame (see the
+  \c QOpenGLWidget::frameSwapped() signal). Redraw requests received while a
+  frame is pending are merged into a single redraw, and the mouse
+  displacements are merged into a single mouseMoveEvent(), processed when the
+  pending frame is presented. Default value is \c false. */
+  bool framePacingIsEnabled() const { return framePacingIsEnabled_; }
+  /*! Returns the input latency of the last presented frame, in milliseconds.
+
+  This is the delay between the reception of the oldest mouse event that
+  frame reflects and the presentation of the frame. Only measured when
+  framePacingIsEnabled(). Returns -1.0 until a frame was measured. */
+  qreal inputLatency() const { return inputLatency_; }
+
+public Q_SLOTS:
+  void setFramePacingIsEnabled(bool enabled = true);
+
+private Q_SLOTS:
+  void framePresented();
+
+private:
+  void flushPendingMouseMove();
+  //@}
+
+  /*! @name Power saving */
+  //@{
+public:
+  /*! Returns \c true when the viewer saves resources when it is not seen, or
+  when nothing happens in it.
+
+  A hidden viewer (in a hidden tab, or in a minimized or entirely covered
+  window) is then isSuspended(): its animation loop and its
+  simulationThread() are paused until it is visible again. A viewer which
+  had no user input, no wakeUp() and no qglviewer::Frame modification for
+  idleDelay() milliseconds isIdle(): its animation loop is slowed down to
+  idleAnimationPeriod(). The redraws requested by update() are not affected.
+
+  A started animation which moves Frames, in animate() or with the
+  simulationThread(), hence keeps its animationPeriod(). The modifications of
+  all the Frames of the application are counted (see
+  qglviewer::Frame::nbModifications()). An animate() that changes the scene
+  without modifying a Frame should call wakeUp().
+
+  Default value is \c false. With many viewers, enable it for all of them:
+  \code
+  foreach (QGLViewer *viewer, QGLViewer::QGLViewerPool())
+    if (viewer)
+      viewer->setPowerSavingIsEnabled();
+  \endcode
+
+  The visibility is checked four times per second, and when the viewer is
+  repainted: a viewer displayed again resumes at once. */
+  bool powerSavingIsEnabled() const { return powerSavingIsEnabled_; }
+  /*! Returns \c true when the animation loop is paused because the viewer is
+  not visible. Only set when powerSavingIsEnabled(). See also
+  suspendedChanged(). */
+  bool isSuspended() const { return suspended_; }
+  /*! Returns \c true when the animation loop is slowed down to
+  idleAnimationPeriod(), because there was no user input, no wakeUp() and no
+  Frame modification for idleDelay() milliseconds. Only set when
+  powerSavingIsEnabled(). */
+  bool isIdle() const { return idle_; }
+  /*! Returns the delay without input after which the viewer isIdle(), in
+  milliseconds. Default value is 2000. */
+  int idleDelay() const { return idleDelay_; }
+  /*! Returns the animationPeriod() used when the viewer isIdle(), in
+  milliseconds. It is not used when animationPeriod() is longer. Default value
+  is 500 (2 Hz). */
+  int idleAnimationPeriod() const { return idleAnimationPeriod_; }
+
+public Q_SLOTS:
+  void setPowerSavingIsEnabled(bool enabled = true);
+  /*! Sets the idleDelay(), in milliseconds. */
+  void setIdleDelay(int delay) { idleDelay_ = qMax(delay, 0); }
+  void setIdleAnimationPeriod(int period);
+  void wakeUp();
+
+Q_SIGNALS:
+  /*! Signal emitted when isSuspended() changes. Connect it to pause the
+  other processing of the viewer's scene, such as a data feed. */
+  void suspendedChanged(bool suspended);
+
+private Q_SLOTS:
+  void updatePowerState();
+
+private:
+  bool isShownOnScreen() const;
+  int currentAnimationPeriod() const;
+  void startAnimationTimers();
+  void stopAnimationTimers();
+  //@}
+
+  /*! @name Benchmark */
+  //@{
+public:
+  bool runBenchmark(unsigned int index, const QString &fileName,
+                    qreal timeStep = 1.0 / 60.0);
+
+private Q_SLOTS:
+  void runCommandLineBenchmark();
   //@}
 
 public:
@@ -725,6 +1422,12 @@ Q_SIGNALS:
   void gridIsDrawnChanged(bool drawn);
   /*! This signal is emitted whenever FPSIsDisplayed() changes value. */
   void FPSIsDisplayedChanged(bool displayed);
+  /*! This signal is emitted whenever frameTimingGraphIsDisplayed() changes
+  value. */
+  void frameTimingGraphIsDisplayedChanged(bool displayed);
+  /*! This signal is emitted whenever hotPathCountersAreDisplayed() changes
+  value. */
+  void hotPathCountersAreDisplayedChanged(bool displayed);
   /*! This signal is emitted whenever textIsEnabled() changes value. */
   void textIsEnabledChanged(bool enabled);
   /*! This signal is emitted whenever cameraIsEdited() changes value.. */
@@ -817,6 +1520,7 @@ protected:
   virtual void paintGL();
   virtual void preDraw();
   virtual void preDrawStereo(bool leftBuffer = true);
+  virtual void drawStereo();
 
   /*! The core method of the viewer, that draws the scene.
 
@@ -834,12 +1538,320 @@ protected:
   to correctly display visual hints (axis, grid, FPS...) in postDraw(). Use
   push/pop or call camera()->loadProjectionMatrix() at the end of draw() if you
   need to change the projection matrix (unlikely). On the other hand, the \c
-  GL_MODELVIEW matrix can be modified and left in a arbitrary state. */
-  virtual void draw() {}
+  GL_MODELVIEW matrix can be modified and left in a arbitrary state.
+
+  Default implementation draws the lodMeshes(), at a reduced level of detail
+  when it is called by fastDraw(). Call it from your own implementation to keep
+  drawing them. */
+  virtual void draw();
   virtual void fastDraw();
+  virtual void drawLevelOfDetail(int level);
+  /*! Adds the refinement pass \p pass to the image drawn by draw(), when
+  numberOfRefinementPasses() is positive.
+
+  Passes are numbered from 1 to numberOfRefinementPasses(). Each one is drawn
+  during a different idle frame, on top of the content (color and depth) left by
+  draw() and by the previous passes. The camera() matrices are loaded. Default
+  implementation is empty.
+
+  Use the \p pass index to add the costly parts of your scene (high resolution
+  meshes, transparent objects, ambient occlusion...) in successive steps. */
+  virtual void drawRefinementPass(int pass) { Q_UNUSED(pass); }
   virtual void postDraw();
   //@}
 
+  /*! @name Level of detail */
+  //@{
+public:
+  /*! Returns the frame time budget, in milliseconds. Default value is 0.0,
+  which disables the levels of detail: draw() is used, or fastDraw() while the
+  camera() is manipulated.
+
+  When positive, the duration of each frame is measured and paintGL() uses
+  drawLevelOfDetail() instead. The finest level of detail which measured frame
+  time fits in this budget is used during interactions and animations. Once
+  the motion stops, the level of detail is refined over successive frames, up
+  to the full quality level 0.
+
+  \attention The measure calls \c glFinish() at the end of each frame, which
+  prevents the CPU and the GPU from working in parallel. */
+  qreal frameTimeBudget() const { return frameTimeBudget_; }
+  /*! Returns the number of levels of detail given to drawLevelOfDetail().
+  Default value is 2: level 0 calls draw() and level 1 calls fastDraw(). */
+  int numberOfLevelsOfDetail() const { return levelOfDetailTimes_.size(); }
+  /*! Returns the level of detail used by the last frame. 0 is the full
+  quality level. */
+  int currentLevelOfDetail() const { return levelOfDetail_; }
+  /*! Returns the measured frame time of \p level, in milliseconds, or -1.0
+  if this level has not been used yet. Average of the last frames. */
+  qreal levelOfDetailFrameTime(int level) const {
+    return levelOfDetailTimes_.value(level, -1.0);
+  }
+
+public Q_SLOTS:
+  void setFrameTimeBudget(qreal budget);
+  void setNumberOfLevelsOfDetail(int nb);
+
+private Q_SLOTS:
+  void refineLevelOfDetail();
+
+private:
+  int selectLevelOfDetail();
+  bool viewIsInMotion() const;
+  //@}
+
+  /*! @name Progressive refinement */
+  //@{
+public:
+  /*! Returns the number of refinement passes drawn by drawRefinementPass()
+  once the view is still. Default value is 0, which disables progressive
+  refinement.
+
+  When positive, the still frames are drawn in an offscreen buffer: draw() is
+  first displayed, and each following idle frame adds the next
+  drawRefinementPass() and displays the partial result. Any mouse, wheel or
+  keyboard event postpones the pending passes, and the refinement restarts
+  from draw() as soon as the view is redrawn (camera motion, update()...).
+
+  Progressive refinement is not available when displaysInStereo(). */
+  int numberOfRefinementPasses() const { return numberOfRefinementPasses_; }
+  /*! Returns the index of the last drawn refinement pass. 0 means that only
+  draw() has been displayed since the last view modification. */
+  int currentRefinementPass() const { return qMax(0, refinementPass_ - 1); }
+
+public Q_SLOTS:
+  void setNumberOfRefinementPasses(int nb);
+
+private Q_SLOTS:
+  void drawNextRefinementPass();
+
+private:
+  void paintRefinementFrame();
+  void postponeRefinement();
+  //@}
+
+  /*! @name Dynamic resolution */
+  //@{
+public:
+  /*! Returns \c true when the frames drawn while the view is in motion are
+  rendered at a lower resolution. Default value is \c false.
+
+  While the camera() or the manipulatedFrame() are manipulated, spinning or
+  interpolated, or while an animation is started, preDraw() and draw() (or
+  fastDraw() and drawLevelOfDetail()) are drawn in an offscreen buffer of
+  resolutionScale() times the window size, which is then upscaled to the
+  window with a linear filtering. postDraw() is drawn at full resolution. The
+  native resolution is used again as soon as the motion stops.
+
+  The resolutionScale() adapts to the GPU time of the frames, measured by the
+  frameProfiler() (enabled by setDynamicResolutionIsEnabled()), so that the
+  frames fit in dynamicResolutionFrameTime(). The fill rate of fragment bound
+  scenes is divided by the square of resolutionScale().
+
+  Dynamic resolution is not used in stereo, with viewports, in retained mode,
+  for refinement frames, with a renderThread() or with a core profile context.
+  The depth buffer of the window is not filled by the scaled frames, so that
+  the depthCache() is invalidated. */
+  bool dynamicResolutionIsEnabled() const {
+    return dynamicResolutionIsEnabled_;
+  }
+  /*! Returns the GPU frame time, in milliseconds, that the resolutionScale()
+  adaptation targets when dynamicResolutionIsEnabled(). Default value is 16
+  ms (60Hz). */
+  qreal dynamicResolutionFrameTime() const {
+    return dynamicResolutionFrameTime_;
+  }
+  /*! Returns the lower bound of resolutionScale(). Default value is 0.5. */
+  qreal minimumResolutionScale() const { return minimumResolutionScale_; }
+  /*! Returns the ratio between the resolution of the frames drawn while in
+  motion and the native resolution, in [minimumResolutionScale(), 1]. Adapted
+  from the measured frame times when dynamicResolutionIsEnabled(). */
+  qreal resolutionScale() const { return resolutionScale_; }
+
+public Q_SLOTS:
+  void setDynamicResolutionIsEnabled(bool enabled = true);
+  /*! Sets the dynamicResolutionFrameTime(), in milliseconds. */
+  void setDynamicResolutionFrameTime(qreal time) {
+    dynamicResolutionFrameTime_ = qMax(time, qreal(1.0));
+  }
+  void setMinimumResolutionScale(qreal scale);
+
+private Q_SLOTS:
+  void adaptResolutionScale(const qglviewer::FrameTiming &timing);
+
+private:
+  bool usesDynamicResolution() const;
+  void paintOffscreenScene(bool lod, qreal scale, int samples);
+  void drawScreenTexture(GLuint texture);
+  //@}
+
+  /*! @name Temporal reprojection */
+  //@{
+public:
+  /*! Returns \c true when the frames drawn while the camera() moves reuse the
+  previous frame. Default value is \c false.
+
+  While only the camera() is manipulated, spinning or interpolated,
+  consecutive views mostly overlap. The color and depth of each frame are then
+  kept, and warped to the new camera by the next frame, using the model view
+  and projection matrices of both frames. The depth test restricts draw() (or
+  fastDraw() and drawLevelOfDetail()) to the disoccluded pixels and to the
+  parts of the view that were not visible before. The scene is still
+  traversed, but the fill cost of fragment bound scenes is mostly saved.
+
+  The warped pixels become stale, since the lighting, the view dependent
+  effects and the sampling change with the view: the scene is fully drawn
+  again every reprojectionRefreshInterval() frames, at the first frame of a
+  motion, when the window is resized and once the motion stops. Reprojection
+  assumes that the scene is static: it is not used while the
+  manipulatedFrame() moves or while an animation is started.
+
+  Reprojection requires OpenGL 3.3 or OpenGL ES 3.0. It is not used in
+  stereo, with viewports, in retained mode, for refinement frames, with
+  dynamic resolution or sceneSamples(), with a renderThread() or with a core
+  profile context. The depth buffer of the window is not filled by the
+  reprojected frames, so that the depthCache() is invalidated. */
+  bool reprojectionIsEnabled() const { return reprojectionIsEnabled_; }
+  /*! Returns the maximum number of consecutive reprojected frames, after which
+  the scene is fully drawn. Default value is 8. */
+  int reprojectionRefreshInterval() const {
+    return reprojectionRefreshInterval_;
+  }
+
+public Q_SLOTS:
+  void setReprojectionIsEnabled(bool enabled = true);
+  /*! Sets the reprojectionRefreshInterval(). Clamped to at least 1. */
+  void setReprojectionRefreshInterval(int nbFrames) {
+    reprojectionRefreshInterval_ = qMax(1, nbFrames);
+  }
+
+private:
+  bool usesReprojection() const;
+  void paintReprojectedScene(bool lod);
+  //@}
+
+  /*! @name Interaction quality */
+  //@{
+public:
+  /*! Returns \c true when the rendering quality is reduced while the view is
+  in motion. Default value is \c false.
+
+  While the camera() or the manipulatedFrame() are manipulated or spinning,
+  while a camera() KeyFrameInterpolator is played or an animation is started,
+  qualityIsReduced() is \c true during paintGL(): the interactionSceneSamples()
+  replace the sceneSamples(), the interaction values of the quality settings
+  (see addQualitySetting()) are returned by qualitySetting(), \c
+  GL_MULTISAMPLE is disabled and the smoothing and perspective correction
+  hints are set to \c GL_FASTEST. The full quality is restored by an idle
+  frame, drawn once the motion has stopped for 100 ms.
+
+  The quality difference is hardly visible in motion, while motion frames are
+  the ones that need to be drawn fast. */
+  bool interactionQualityIsEnabled() const {
+    return interactionQualityIsEnabled_;
+  }
+  /*! Returns \c true when the frame being drawn uses the interaction quality.
+  Always \c false when interactionQualityIsEnabled() is \c false. Use it in
+  draw() to reduce your own costly effects. */
+  bool qualityIsReduced() const { return qualityIsReduced_; }
+
+  /*! Returns the number of samples per pixel of the offscreen buffer where
+  preDraw() and draw() are drawn. Default value is 0: the scene is drawn in
+  the widget framebuffer, with the samples of its format().
+
+  When positive, the scene is drawn in a multisampled framebuffer object,
+  resolved and copied (color and depth) in the widget before postDraw(), so
+  that the visual hints, the depthCache() and pointUnderPixel() use the depth
+  of the scene. Create the widget
+  without multisampling so that only the scene is antialiased: the
+  interactionSceneSamples() are then used in motion. The offscreen scene is
+  not used in stereo, with viewports, in retained mode, for refinement
+  frames, with a renderThread() or with a core profile context. */
+  int sceneSamples() const { return sceneSamples_; }
+  /*! Returns the sceneSamples() used when qualityIsReduced(). Default value is
+  0, which draws the frames in motion without multisampling. */
+  int interactionSceneSamples() const { return interactionSceneSamples_; }
+
+  int addQualitySetting(qreal value, qreal interactionValue);
+  void setQualitySetting(int id, qreal value, qreal interactionValue);
+  void removeQualitySetting(int id);
+  qreal qualitySetting(int id) const;
+
+public Q_SLOTS:
+  void setInteractionQualityEnabled(bool enabled = true);
+  void setSceneSamples(int samples);
+  void setInteractionSceneSamples(int samples);
+
+Q_SIGNALS:
+  /*! Signal emitted by paintGL() when qualityIsReduced() changes, before the
+  scene is drawn. Connect it to the methods that update the resources that
+  depend on a qualitySetting() (shadow maps, levels of detail...). */
+  void qualityReductionChanged(bool reduced);
+
+private Q_SLOTS:
+  void restoreInteractionQuality();
+
+private:
+  bool interactionIsInProgress() const;
+  void updateQualityReduction();
+  bool isValidQualitySetting(int id, const char *method) const;
+  int currentSceneSamples() const;
+  //@}
+
+  /*! @name Retained mode */
+  //@{
+public:
+  /*! Returns \c true when the 3D scene is cached in an offscreen buffer, and
+  only drawn again when it changes. Default value is \c false.
+
+  In retained mode, preDraw() and draw() (or fastDraw()) are drawn in a
+  framebuffer object. The next frames simply copy this buffer (colors and
+  depth) in the widget and draw postDraw() on top of it, as long as:
+  \arg the camera() view and projection are unchanged,
+  \arg none of the scene frames is modified (see addSceneFrame(); the
+  manipulatedFrame() is always a scene frame),
+  \arg invalidateScene() is not called, and no animation is started.
+
+  Updates of the visual hints, of the displayMessage() or of the FPS display
+  hence no longer draw the scene. Call invalidateScene() when your scene is
+  modified by other means.
+
+  A scene frame added with a bounding box (see addSceneFrame()) only
+  invalidates a part of the scene: while the camera is still, its
+  modifications redraw the screen region of the box at its previous and new
+  positions (see partialRedrawRect()), over the cached colors and depths.
+
+  \attention Texts drawn in draw() with drawText() are not cached: draw them
+  in postDraw(). The retained mode is not used with viewports, in stereo,
+  with progressive refinement or with a positive frameTimeBudget(). */
+  bool retainedModeIsEnabled() const { return retainedModeIsEnabled_; }
+  void addSceneFrame(const qglviewer::Frame *frame, const qglviewer::Vec &min,
+                     const qglviewer::Vec &max);
+  /*! Returns the region of the widget (in pixels, origin in the upper left
+  corner) redrawn by the current draw(), when the retained mode only redraws a
+  part of the scene. Returns a null \c QRect when the whole scene is drawn.
+
+  draw() can skip the objects whose projection does not intersect this
+  region: only their fill cost is saved otherwise. See addSceneFrame(). */
+  QRect partialRedrawRect() const { return partialRedrawRect_; }
+
+public Q_SLOTS:
+  void setRetainedModeEnabled(bool enabled = true);
+  void invalidateScene();
+  void addSceneFrame(const qglviewer::Frame *frame);
+  void removeSceneFrame(const qglviewer::Frame *frame);
+
+private Q_SLOTS:
+  void sceneFrameModified();
+
+private:
+  bool usesRetainedMode() const;
+  void paintRetainedFrame();
+  QRect sceneFrameRect(const qglviewer::Frame *frame, const qglviewer::Vec &min,
+                       const qglviewer::Vec &max) const;
+  QRect updateSceneFrameRects(bool allFrames);
+  //@}
+
   /*! @name Mouse, keyboard and event handlers */
   //@{
 protected:
@@ -852,6 +1864,8 @@ protected:
   virtual void keyReleaseEvent(QKeyEvent *);
   virtual void timerEvent(QTimerEvent *);
   virtual void closeEvent(QCloseEvent *);
+  virtual void paintEvent(QPaintEvent *);
+  virtual void customEvent(QEvent *);
   //@}
 
   /*! @name Object selection */
@@ -873,9 +1887,22 @@ public:
   change this value.
 
   Default value is 4000 (i.e. 1000 objects in selection region, since each
-  object pushes 4 values). This size should be over estimated to prevent a
-  buffer overflow when many objects are drawn under the mouse cursor. */
+  object pushes 4 values). When selectBufferGrowthIsEnabled(), the default
+  endSelection() enlarges the buffer and selects again when it overflows, so
+  that this value only has to be over estimated when you overload
+  endSelection(). */
   int selectBufferSize() const { return selectBufferSize_; }
+  /*! Returns \c true when the default endSelection() automatically enlarges the
+  selectBuffer() when it overflows. Default value is \c true.
+
+  A \c GL_SELECT buffer overflow loses hits. When it happens, the
+  selectBufferSize() is increased and beginSelection(), drawWithNames() and
+  endSelection() are called again. The new size is deduced from the number of
+  pushSelectionName() and popSelectionName() calls of the overflowed pass, which
+  bounds the number of hits: a single new pass is then needed. The buffer is
+  doubled instead when names are pushed with \c glPushName(). It never grows
+  over 2^24 values. */
+  bool selectBufferGrowthIsEnabled() const { return selectBufferGrowth_; }
 
   /*! Returns the width (in pixels) of a selection frustum, centered on the
   mouse cursor, that is used to select objects.
@@ -905,11 +1932,72 @@ public:
   \c glSelectBuffer() man page for details. */
   GLuint *selectBuffer() { return selectBuffer_; }
 
+  /*! An object drawn in the selection region by drawWithNames(). See
+  selectionHits(). */
+  struct SelectionHit {
+    /*! The name of the object. The innermost name when several names were
+    pushed. */
+    int name;
+    /*! Minimum and maximum window depths (in [0,1]) of the object in the
+    selection region. */
+    float zMin, zMax;
+  };
+
+  /*! Returns all the objects drawn in the selection region during the last
+  select(), sorted by increasing SelectionHit::zMin. The first one is hence the
+  selectedName().
+
+  This is filled by the default endSelection(), with both selectionMode(). With
+  QGLViewer::BUFFER_SELECTION, an object appears once per name block. Use this
+  method to implement a rectangular selection of many objects in a single
+  pass, as in the <a href="../examples/multiSelect.html">multiSelect
+  example</a>. */
+  const QVector<SelectionHit> &selectionHits() const { return selectionHits_; }
+
+  /*! Returns the qglviewer::RayPicker used by select() when selectionMode() is
+  QGLViewer::RAY_SELECTION. Default value is \c nullptr. The RayPicker is not
+  owned by the viewer. */
+  qglviewer::RayPicker *rayPicker() const { return rayPicker_; }
+
+  /*! Defines the different selection backends used by select(). See
+  setSelectionMode().
+
+  \c BUFFER_SELECTION is the classical \c GL_SELECT mode, that uses the
+  selectBuffer(). \c COLOR_SELECTION renders drawWithNames() in an offscreen
+  framebuffer object, where each name is encoded as a unique color. It does not
+  rely on the (usually software emulated) \c GL_SELECT mode and is hence much
+  faster on large scenes. \c RAY_SELECTION intersects the ray of the clicked
+  pixel with the geometry registered in the rayPicker(), on the CPU: nothing is
+  drawn and drawWithNames() is not called. */
+  enum SelectionMode { BUFFER_SELECTION, COLOR_SELECTION, RAY_SELECTION };
+
+  /*! Returns the selection backend used by beginSelection() and
+  endSelection(). Default value is QGLViewer::BUFFER_SELECTION.
+
+  With QGLViewer::COLOR_SELECTION, drawWithNames() should use
+  pushSelectionName() and popSelectionName() instead of \c glPushName() and \c
+  glPopName(). These methods also work in QGLViewer::BUFFER_SELECTION mode, so
+  that your drawWithNames() implementation does not depend on the selected
+  backend. selectedName() has the same semantic with both modes. */
+  SelectionMode selectionMode() const { return selectionMode_; }
+
+  void pushSelectionName(int name);
+  void popSelectionName();
+
 public Q_SLOTS:
   virtual void select(const QMouseEvent *event);
   virtual void select(const QPoint &point);
 
+  /*! Sets the selectionMode(). */
+  void setSelectionMode(SelectionMode mode) { selectionMode_ = mode; }
+  /*! Sets the rayPicker(). */
+  void setRayPicker(qglviewer::RayPicker *picker) { rayPicker_ = picker; }
+
   void setSelectBufferSize(int size);
+  /*! Sets the selectBufferGrowthIsEnabled() value. */
+  void setSelectBufferGrowthIsEnabled(bool enabled = true) {
+    selectBufferGrowth_ = enabled;
+  }
   /*! Sets the selectRegionWidth(). */
   void setSelectRegionWidth(int width) { selectRegionWidth_ = width; }
   /*! Sets the selectRegionHeight(). */
@@ -958,6 +2046,66 @@ compatible with raster mode): use \c glRasterPos3fv() instead. */
   virtual void postSelection(const QPoint &point) { Q_UNUSED(point); }
   //@}
 
+  /*! @name Object ID buffer */
+  //@{
+public:
+  /*! Returns \c true when draw() also writes the ID of the drawn objects in an
+  integer buffer, used for hover picking. Default value is \c false.
+
+  select() draws the scene again with drawWithNames() for each query, which
+  is too costly for a continuous hover feedback. When enabled, an integer
+  texture is attached to the widget framebuffer during draw(), as a second
+  draw buffer cleared to -1. Your fragment shaders write the ID of their
+  object in their output location 1:
+  \code
+  // GLSL 3.30 or GLSL ES 3.00
+  uniform int id;
+  layout(location = 0) out vec4 fragColor;
+  layout(location = 1) out int objectId;
+
+  void main() {
+    fragColor = ...;
+    objectId = id; // -1 for the objects that cannot be picked
+  }
+  \endcode
+
+  All the fragments drawn by draw() must write this output, the value of the
+  buffer is undefined otherwise: the ID buffer cannot be used with the fixed
+  function pipeline. postDraw() is not drawn in the ID buffer.
+
+  When the mouse moves (enable \c QWidget::setMouseTracking() to track it
+  when no button is pressed), the ID of the pixel under the cursor in the last
+  frame is read back without stalling the pipeline, and
+  objectIdUnderCursorChanged() is emitted once it is available. Nothing is
+  drawn again: hover picking is free.
+
+  Requires OpenGL 3.2 or OpenGL ES 3.0, and a widget format without
+  multisampling. The IDs are only drawn by the regular frames, and not in
+  stereo, with viewports, in retained mode, for refinement frames, with
+  dynamic resolution, sceneSamples() or reprojection, or with a
+  renderThread(). */
+  bool objectIdBufferIsEnabled() const { return objectIdBufferIsEnabled_; }
+  /*! Returns the object ID of the pixel under the cursor, retrieved since the
+  last mouse move or frame. Returns -1 when there is no object or when the
+  objectIdBufferIsEnabled() is \c false. */
+  int objectIdUnderCursor() const { return objectIdUnderCursor_; }
+
+public Q_SLOTS:
+  void setObjectIdBufferIsEnabled(bool enabled = true);
+
+Q_SIGNALS:
+  /*! Signal emitted when objectIdUnderCursor() changes. Connect it to the
+  update of your hover highlighting. */
+  void objectIdUnderCursorChanged(int id);
+
+private Q_SLOTS:
+  void retrieveObjectIdUnderCursor();
+
+private:
+  bool attachObjectIdBuffer();
+  void requestObjectIdUnderCursor();
+  //@}
+
   /*! @name Keyboard customization */
   //@{
 public:
@@ -1178,6 +2326,29 @@ public:
   QString stateFileName() const;
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeBinary(QDataStream &stream) const;
+  virtual void readBinary(QDataStream &stream);
+
+  /*! Returns \c true when saveStateToFile() writes a compact binary state
+  file (see writeBinary()) instead of an XML one. Default value is \c false.
+
+  restoreStateFromFile() detects the format of the file, whatever the value of
+  this flag. Binary files are smaller and faster to parse, which matters when
+  many keyFrame paths are saved, but they are not human readable. */
+  bool stateFileIsBinary() const { return stateFileIsBinary_; }
+  /*! Returns \c true when restoreStateFromFile() defers the restoration of
+  the camera() keyFrame paths. Default value is \c false.
+
+  restoreStateFromFile() then only restores the essential state (viewer state
+  and geometry, camera() and manipulatedFrame()) before returning. The
+  keyFrameInterpolator paths, whose size is not bounded, are parsed by a
+  worker thread and applied later on, in the GUI thread, at which time the
+  stateRestored() signal is emitted. The time spent before the first frame no
+  longer depends on the number of saved paths. Binary state files (see
+  stateFileIsBinary()) are always restored at once. */
+  bool stateRestorationIsDeferred() const {
+    return stateRestorationIsDeferred_;
+  }
 
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
@@ -1199,6 +2370,20 @@ public Q_SLOTS:
     setStateFileName(QDir::homeDirPath + "/.config/myApp.xml");
     \endcode */
   void setStateFileName(const QString &name) { stateFileName_ = name; }
+  /*! Sets the stateFileIsBinary() flag. */
+  void setStateFileIsBinary(bool binary = true) {
+    stateFileIsBinary_ = binary;
+  }
+  /*! Sets the stateRestorationIsDeferred() flag. */
+  void setStateRestorationDeferred(bool deferred = true) {
+    stateRestorationIsDeferred_ = deferred;
+  }
+
+Q_SIGNALS:
+  /*! Signal emitted when restoreStateFromFile() has completely restored the
+  state, i.e. when the deferred part is applied when
+  stateRestorationIsDeferred(). */
+  void stateRestored();
 
 #ifndef DOXYGEN
   void saveToFile(const QString &fileName = QString());
@@ -1207,6 +2392,8 @@ public Q_SLOTS:
 
 private:
   static void saveStateToFileForAllViewers();
+  void applyDeferredState(const QDomDocument &document);
+  void flushDeferredState();
   //@}
 
   /*! @name QGLViewer pool */
@@ -1241,6 +2428,45 @@ public:
   }
 //@}
 
+  /*! @name Resource accounting */
+  //@{
+public:
+  /*! The memories where the accounted resources are stored. */
+  enum MemoryType {
+    CPU_MEMORY, /*!< Main memory. */
+    GPU_MEMORY  /*!< Video memory (textures, buffers, framebuffer objects). */
+  };
+
+  int addResource(const QString &name, MemoryType type, qint64 bytes);
+  void setResourceSize(int id, qint64 bytes);
+  void removeResource(int id);
+
+  qint64 memoryUsage(MemoryType type) const;
+  QMap<QString, qint64> memoryUsageByResource(MemoryType type) const;
+  static qint64 totalMemoryUsage(MemoryType type);
+
+  /*! Returns the memoryUsage() above which memoryBudgetExceeded() is emitted,
+  in bytes. Default value is 0, meaning that the \p type memory usage is not
+  checked. */
+  qint64 memoryBudget(MemoryType type) const { return memoryBudget_[type]; }
+
+public Q_SLOTS:
+  void setMemoryBudget(MemoryType type, qint64 bytes);
+
+Q_SIGNALS:
+  /*! Signal emitted when the memoryUsage() of \p type becomes larger than its
+  memoryBudget(). \p bytes is the current usage. Emitted once, until the usage
+  goes below the budget again.
+
+  Connect it to a method that releases your caches, see
+  memoryUsageByResource(). */
+  void memoryBudgetExceeded(QGLViewer::MemoryType type, qint64 bytes);
+
+private:
+  bool isValidResource(int id, const char *method) const;
+  void checkMemoryBudgets();
+  //@}
+
 #ifndef DOXYGEN
   /*! @name Visual hints */
   //@{
@@ -1272,6 +2498,9 @@ private:
 
   void handleKeyboardAction(KeyboardAction id);
 
+  void checkMouseGrabberPool(int x, int y);
+  void updateMouseGrabberIndex();
+
   // C a m e r a
   qglviewer::Camera *camera_;
   bool cameraIsEdited_;
@@ -1286,8 +2515,14 @@ private:
   bool axisIsDrawn_;    // world axis
   bool gridIsDrawn_;    // world XY grid
   bool FPSIsDisplayed_; // Frame Per Seconds
+  bool frameTimingGraphIsDisplayed_;
+  bool hotPathCountersAreDisplayed_;
+  qglviewer::FrameProfiler *frameProfiler_;
   bool textIsEnabled_;  // drawText() actually draws text or not
+  bool textIsBatched_;  // renderText() uses textRenderer_
+  qglviewer::TextRenderer *textRenderer_;
   bool stereo_;         // stereo display
+  bool stereoIsSinglePass_;
   bool fullScreen_;     // full screen mode
   QPoint prevPos_;      // Previous window position, used for full screen mode
 
@@ -1295,6 +2530,93 @@ private:
   bool animationStarted_; // animation mode started
   int animationPeriod_;   // period in msecs
   int animationTimerId_;
+  QPointer<qglviewer::AnimationClock> animationClock_;
+  int animationTime_; // not yet animated time, with the animationClock_
+  qglviewer::SimulationThread *simulationThread_;
+
+  // P o w e r   s a v i n g
+  bool powerSavingIsEnabled_;
+  bool suspended_;
+  bool idle_;
+  int idleDelay_;
+  int idleAnimationPeriod_;
+  QElapsedTimer lastActivity_;
+  int frameModifications_; // Frame::nbModifications() at the last check
+  QTimer powerTimer_; // polls the visibility and the Frame modifications
+
+  // L e v e l   o f   d e t a i l
+  qreal frameTimeBudget_;
+  int levelOfDetail_;
+  QVector<qreal> levelOfDetailTimes_;
+  bool levelOfDetailRefining_;
+  QElapsedTimer levelOfDetailFrameTimer_;
+  QElapsedTimer levelOfDetailLastMotion_; // previous non refinement frame
+  QTimer levelOfDetailTimer_;
+
+  // P r o g r e s s i v e   r e f i n e m e n t
+  int numberOfRefinementPasses_;
+  int refinementPass_;     // next pass to draw, 0 for draw()
+  bool refinementFrame_;   // set by drawNextRefinementPass()
+  QTimer refinementTimer_;
+  QOpenGLFramebufferObject *refinementFBO_; // accumulation buffer
+
+  // D y n a m i c   r e s o l u t i o n
+  bool dynamicResolutionIsEnabled_;
+  qreal dynamicResolutionFrameTime_;
+  qreal minimumResolutionScale_;
+  qreal resolutionScale_;
+  QOpenGLFramebufferObject *scaledFBO_;
+  QTimer dynamicResolutionTimer_; // draws at native resolution once still
+
+  // T e m p o r a l   r e p r o j e c t i o n
+  bool reprojectionIsEnabled_;
+  int reprojectionRefreshInterval_;
+  qglviewer::TemporalReprojector *temporalReprojector_; // created on first use
+  bool reprojectionIsSupported_;
+  QTimer reprojectionTimer_; // fully draws the scene once still
+
+  // I n t e r a c t i o n   q u a l i t y
+  bool interactionQualityIsEnabled_;
+  bool qualityIsReduced_;
+  int sceneSamples_;
+  int interactionSceneSamples_;
+  struct QualitySetting {
+    qreal value, interactionValue;
+    bool used;
+  };
+  QVector<QualitySetting> qualitySettings_;
+  QVector<int> freeQualitySettings_;
+  QOpenGLFramebufferObject *multisampleFBO_; // resolved in scaledFBO_
+  QTimer interactionQualityTimer_; // draws at full quality once still
+
+  // R e t a i n e d   m o d e
+  bool retainedModeIsEnabled_;
+  bool retainedSceneIsValid_;
+  GLdouble retainedMatrix_[16]; // camera of the cached scene
+  QOpenGLFramebufferObject *retainedFBO_;
+  struct SceneFrameBounds {
+    QPointer<const qglviewer::Frame> frame;
+    qglviewer::Vec min, max; // in the frame coordinate system
+    QRect drawnRect; // in the cached scene, null when unknown or invisible
+    bool isModified;
+  };
+  QMap<const qglviewer::Frame *, SceneFrameBounds> sceneFrameBounds_;
+  QRect partialRedrawRect_; // null when the whole scene is drawn
+
+  // F r a m e   p a c i n g
+  bool framePacingIsEnabled_;
+  bool framePending_;  // a frame was rendered but is not presented yet
+  bool redrawDeferred_;
+  QTimer framePresentedTimer_; // in case frameSwapped() is not emitted
+  QElapsedTimer inputTime_;
+  qint64 latencyStart_;  // ns, oldest input displayed by the pending frame
+  qreal inputLatency_;
+  // Coalesced mouse move, processed when the pending frame is presented
+  bool hasPendingMouseMove_;
+  qint64 pendingMouseMoveTime_;
+  QPoint pendingMouseMovePos_;
+  Qt::MouseButtons pendingMouseMoveButtons_;
+  Qt::KeyboardModifiers pendingMouseMoveModifiers_;
 
   // F P S    d i s p l a y
   QElapsedTimer fpsTime_;
@@ -1311,20 +2633,82 @@ private:
   qglviewer::ManipulatedFrame *manipulatedFrame_;
   bool manipulatedFrameIsACamera_;
 
+  // V i e w p o r t s
+  struct Viewport {
+    qglviewer::Camera *camera;
+    QRectF region; // normalized widget coordinates
+  };
+  QList<Viewport> viewports_;
+  qglviewer::Camera *ownCamera_; // camera_ when there are no viewports
+  int currentViewport_;
+  int paintedViewport_;  // -1 outside of paintViewports()
+  QPoint viewportOffset_; // added to renderText() coordinates
+  bool viewportEventIsLocal_;
+
+  // S c e n e   r e s o u r c e s
+  friend class qglviewer::SceneResources;
+  qglviewer::SceneResources *sceneResources_;
+  qglviewer::OcclusionCuller *occlusionCuller_;
+  qglviewer::ClippingRegion *clippingRegion_;
+  qglviewer::SceneBounds *sceneBounds_;
+
   // M o u s e   G r a b b e r
   qglviewer::MouseGrabber *mouseGrabber_;
   bool mouseGrabberIsAManipulatedFrame_;
   bool mouseGrabberIsAManipulatedCameraFrame_;
   QMap<size_t, bool> disabledMouseGrabbers_;
+  qglviewer::MouseGrabberGroup *mouseGrabberGroup_;
+
+  // M o u s e   G r a b b e r   i n d e x
+  bool mouseGrabberIndexIsEnabled_;
+  bool mouseGrabberIndexIsValid_;
+  unsigned int mouseGrabberIndexRevision_;
+  GLdouble mouseGrabberIndexMatrix_[16];
+  int mouseGrabberIndexColumns_, mouseGrabberIndexRows_;
+  int previousMouseGrabberCell_;
+  QVector<qglviewer::MouseGrabber *> indexedMouseGrabbers_;
+  QVector<QVector<int> > mouseGrabberCells_;
+  QVector<int> unboundedMouseGrabbers_;
 
   // S e l e c t i o n
   int selectRegionWidth_, selectRegionHeight_;
   int selectBufferSize_;
   GLuint *selectBuffer_;
   int selectedObjectId_;
+  SelectionMode selectionMode_;
+  QOpenGLFramebufferObject *selectionFBO_;
+  QList<int> selectionNameStack_;
+  bool selectBufferGrowth_;
+  int selectionNameOperations_; // push and pop calls, bound the hit count
+  int selectionNameDepth_, selectionMaxNameDepth_;
+  QVector<SelectionHit> selectionHits_;
+  bool growSelectBuffer();
+  qglviewer::RayPicker *rayPicker_;
+  void selectWithRay(const QPoint &point);
+
+  // O b j e c t   I D   b u f f e r
+  bool objectIdBufferIsEnabled_;
+  bool objectIdBufferIsSupported_;
+  qglviewer::ObjectIdBuffer *objectIdBuffer_; // created on first use
+  QPoint objectIdCursor_; // of the last mouse move, (-1,-1) before
+  int objectIdUnderCursor_;
+  QTimer objectIdTimer_; // polls the pending read back
 
   // V i s u a l   h i n t s
   int visualHint_;
+  bool visualHintsUseCoreProfile_;
+  bool shaderWarmUpIsEnabled_;
+  void warmUpShaders();
+  qglviewer::CoreProfileRenderer *coreProfileRenderer_;
+  void postDrawCoreProfile();
+  qglviewer::GlyphRenderer *glyphRenderer_;
+  bool glyphRendererIsSupported_;
+  qglviewer::GlyphRenderer *glyphRenderer();
+  qglviewer::LineRenderer *lineRenderer_;
+  bool lineRendererIsSupported_;
+  qglviewer::LineRenderer *lineRenderer();
+  void getCurrentMatrices(QMatrix4x4 &modelView, QMatrix4x4 &projection,
+                          QColor &color) const;
 
   // S h o r t c u t   k e y s
   void setDefaultShortcuts();
@@ -1345,6 +2729,41 @@ private:
   unsigned int previousBufferTextureFormat_;
   int previousBufferTextureInternalFormat_;
 
+  // R e n d e r   t a r g e t
+  qglviewer::RenderTarget *renderTarget_;
+
+  // O v e r l a y   l a y e r s
+  QList<qglviewer::OverlayLayer *> overlayLayers_;
+
+  // D e p t h   c a c h e
+  qglviewer::DepthCache *depthCache_;
+  bool depthCacheIsEnabled_;
+  bool depthFitFramePending_; // redraw with the clipping planes of a still view
+  bool depthFitSceneIsModified_; // by invalidateScene(), since the capture
+
+  // R e n d e r   t h r e a d
+  qglviewer::RenderThread *renderThread_;
+  bool renderThreadFrameIsReady_;   // the paint was caused by frameReady()
+  bool renderThreadSceneIsValid_;   // cleared by invalidateScene()
+  GLdouble renderThreadMatrix_[16]; // of the last requested frame
+  QSize renderThreadSize_;
+  QColor renderThreadBackground_;
+
+  // B u f f e r   u p l o a d s
+  qglviewer::BufferUploader *bufferUploader_;
+  bool bufferUploaderIsSupported_;
+
+  // F r a m e   r i n g   b u f f e r
+  qglviewer::FrameRingBuffer *frameRingBuffer_;
+  bool frameRingBufferIsSupported_;
+
+  // F r a m e   g r a p h
+  qglviewer::FrameGraph *frameGraph_;
+
+  // F r a m e   c a p t u r e
+  qglviewer::FrameCapture *frameCapture_;
+  QString frameCaptureFileName_; // of the pending capture, or empty
+
 #ifndef DOXYGEN
   // M o u s e   a c t i o n s
   struct MouseActionPrivate {
@@ -1427,18 +2846,88 @@ private:
   QMap<ClickBindingPrivate, ClickAction> clickBinding_;
   Qt::Key currentlyPressedKey_;
 
+  // S t a r t u p   t i m e s
+  void recordStartupTime(const QString &stage);
+  QElapsedTimer startupTimer_;
+  QMap<QString, qreal> startupTimes_;
+
   // S n a p s h o t s
-  void initializeSnapshotFormats();
+  void initializeSnapshotFormats() const;
   QImage frameBufferSnapshot();
-  QString snapshotFileName_, snapshotFormat_;
+  QString snapshotFileName_;
+  mutable QString snapshotFormat_; // empty until initializeSnapshotFormats()
   int snapshotCounter_, snapshotQuality_;
+  bool snapshotUsesFramebufferObject_;
+  qglviewer::SnapshotTileRenderer *snapshotTileRenderer_;
+  bool snapshotIsAsynchronous_;
+  int maximumSnapshotQueueSize_;
+  QThreadPool *snapshotThreadPool_;
+  QSemaphore *snapshotQueueSlots_;
+  QOpenGLBuffer *snapshotBuffer_[2];
+  QString snapshotBufferFileName_[2];
+  QSize snapshotBufferSize_[2];
+  bool snapshotBufferIsVideoFrame_[2];
+  int snapshotBufferIndex_;
+  QOpenGLFramebufferObject *snapshotFBO_; // resolves multisampled frames
+  void queueFrameBufferSnapshot(const QString &fileName,
+                                bool videoFrame = false);
+  void retrieveQueuedSnapshot(int index);
+  bool saveVideoFrame(bool overwrite);
+  void writeVideoFrame(const uchar *pixels, const QSize &size);
+  int snapshotVideoFrameRate_;
+  QString snapshotVideoCodec_, snapshotVideoEncoder_;
+  QProcess *videoEncoder_; // nullptr when no video is recorded
+  QString videoFileName_;
+  QSize videoFrameSize_;
   TileRegion *tileRegion_;
 
+  // P o s e   i n p u t s
+  void latchPoseInputs();
+  QList<qglviewer::PoseInput *> poseInputs_;
+
+  // S i m p l i f i e d   m e s h e s
+  QList<qglviewer::LodMesh *> lodMeshes_;
+  bool lodMeshesAreSimplified_; // while fastDraw() calls draw()
+
+  // G L   s t a t e   c a c h e
+  qglviewer::GLStateCache *glStateCache_;
+  bool glStateIsTracked_;
+
+  // F r a m e   s i n k
+  void streamFrame();
+  qglviewer::FrameSink *frameSink_;
+  QOpenGLBuffer *frameSinkBuffer_[2];
+  QSize frameSinkBufferSize_[2]; // empty when no read back is pending
+  int frameSinkBufferIndex_;
+  QOpenGLFramebufferObject *frameSinkFBO_; // resolves multisampled frames
+  QVector<uint> frameSinkTileHashes_;      // of the previous frame
+  QSize frameSinkHashedSize_;
+  int frameSinkHashedTileSize_;
+
+  // D i s p l a y   w a l l
+  QPointer<qglviewer::DisplayWall> displayWall_;
+
   // Q G L V i e w e r   p o o l
   static QList<QGLViewer *> QGLViewerPool_;
 
+  // R e s o u r c e   a c c o u n t i n g
+  struct Resource {
+    QString name;
+    MemoryType type;
+    qint64 bytes;
+    bool used;
+  };
+  QVector<Resource> resources_;
+  QVector<int> freeResources_;
+  qint64 memoryBudget_[2];
+  bool memoryBudgetExceeded_[2]; // memoryBudgetExceeded() was emitted
+
   // S t a t e   F i l e
   QString stateFileName_;
+  bool stateFileIsBinary_;
+  bool stateRestorationIsDeferred_;
+  int deferredStateRequest_; // incremented by each deferred restoration
+  QThreadPool *stateThreadPool_;
 
   // H e l p   w i n d o w
   QTabWidget *helpWidget_;
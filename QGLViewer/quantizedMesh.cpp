@@ -0,0 +1,464 @@
+#include "quantizedMesh.h"
+#include "meshCache.h"
+
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QVector3D>
+
+#include <math.h>
+#include <string.h>
+
+using namespace qglviewer;
+
+// Floats per MeshCache vertex
+static const int meshCacheFloats = MeshCache::VERTEX_STRIDE / sizeof(float);
+// Maximum number of vertices per chunk, addressed by 16-bit indices
+static const int maximumChunkVertices = 65536;
+// The quantization error is half a step
+static const qreal stepsPerPrecision = 2.0 * 65535.0;
+
+// Uniforms set by draw() for each chunk, and the decoding functions.
+static const char *decodingSource =
+    "uniform vec3 positionOffset;\n"
+    "uniform vec3 positionScale;\n"
+    "uniform vec2 texCoordOffset;\n"
+    "uniform vec2 texCoordScale;\n"
+    "vec3 decodePosition(vec4 q) {\n"
+    "  return positionOffset + q.xyz * positionScale;\n"
+    "}\n"
+    "vec3 decodeNormal(vec2 e) {\n"
+    "  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+    "  float t = max(-n.z, 0.0);\n"
+    "  n.x += (n.x >= 0.0) ? -t : t;\n"
+    "  n.y += (n.y >= 0.0) ? -t : t;\n"
+    "  return normalize(n);\n"
+    "}\n"
+    "vec2 decodeTexCoord(vec2 q) {\n"
+    "  return texCoordOffset + q * texCoordScale;\n"
+    "}\n";
+
+static const char *vertexShaderSource =
+    "in vec4 quantizedPosition;\n"
+    "in vec2 quantizedNormal;\n"
+    "uniform mat4 modelViewMatrix;\n"
+    "uniform mat4 projectionMatrix;\n"
+    "uniform vec4 color;\n"
+    "out vec4 vertexColor;\n"
+    "void main() {\n"
+    "  vec3 position = decodePosition(quantizedPosition);\n"
+    "  vec4 eye = modelViewMatrix * vec4(position, 1.0);\n"
+    "  gl_Position = projectionMatrix * eye;\n"
+    "  // Default GL_LIGHT0 head light, with the default global ambient\n"
+    "  vec3 normal = mat3(modelViewMatrix) * decodeNormal(quantizedNormal);\n"
+    "  float diffuse = abs(normalize(normal).z);\n"
+    "  vertexColor = vec4(min(color.rgb * (0.2 + diffuse), 1.0), color.a);\n"
+    "}\n";
+
+static const char *fragmentShaderSource =
+    "in vec4 vertexColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = vertexColor; }\n";
+
+// Rounds value, expected in [0, 1], to a normalized 16-bit unsigned integer
+static quint16 toUnsignedShort(qreal value) {
+  return quint16(qBound(0.0, floor(value * 65535.0 + 0.5), 65535.0));
+}
+
+// Rounds value, expected in [-1, 1], to a normalized 16-bit signed integer
+static qint16 toShort(qreal value) {
+  return qint16(qBound(-32767.0, floor(value * 32767.0 + 0.5), 32767.0));
+}
+
+// Octahedral encoding of the unit vector n: its projection on the octahedron,
+// of which the lower half is folded over the upper one
+static void encodeNormal(const float *n, qint16 *e) {
+  const qreal l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+  if (l1 <= 0.0) {
+    e[0] = e[1] = 0;
+    return;
+  }
+  qreal x = n[0] / l1, y = n[1] / l1;
+  if (n[2] < 0.0f) {
+    const qreal fx = (1.0 - fabs(y)) * ((x >= 0.0) ? 1.0 : -1.0);
+    const qreal fy = (1.0 - fabs(x)) * ((y >= 0.0) ? 1.0 : -1.0);
+    x = fx;
+    y = fy;
+  }
+  e[0] = toShort(x);
+  e[1] = toShort(y);
+}
+
+/*! Creates an empty QuantizedMesh. */
+QuantizedMesh::QuantizedMesh()
+    : precision_(0.0), vertexArray_(nullptr), vertexBuffer_(nullptr),
+      indexBuffer_(nullptr), program_(nullptr) {
+  texCoordMin_[0] = texCoordMin_[1] = 0.0f;
+  texCoordMax_[0] = texCoordMax_[1] = 0.0f;
+}
+
+/*! Destructor. Call cleanupGL() before, with the context of initialize()
+current. */
+QuantizedMesh::~QuantizedMesh() {
+  delete vertexArray_;
+  delete vertexBuffer_;
+  delete indexBuffer_;
+  delete program_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Encoding                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Encodes the vertices and triangles of \p mesh.
+
+The triangles are added, in the order of \p mesh, to a chunk until its
+bounding box grows larger than 131070 times \p precision or it reaches 65536
+vertices: the quantization error of the positions is then at most \p precision.
+When \p precision is 0.0 (default), it is derived from the bounding box of the
+mesh, which is then made of as few chunks as the 16-bit indices permit.
+
+The texture coordinates are quantized in the range of those of the mesh, the
+normals with an error smaller than 0.005 degrees. The vertices are kept in
+vertexData(), uploaded by the next initialize(): \p mesh is not used after this
+call. */
+void QuantizedMesh::setMesh(const MeshCache &mesh, qreal precision) {
+  clear();
+  const QByteArray vertexBytes = mesh.vertexData();
+  const QByteArray indexBytes = mesh.indexData();
+  const float *vertices =
+      reinterpret_cast<const float *>(vertexBytes.constData());
+  const quint32 *indices =
+      reinterpret_cast<const quint32 *>(indexBytes.constData());
+  const int nbMeshVertices = mesh.nbVertices();
+  const int nbMeshIndices = mesh.nbIndices() - mesh.nbIndices() % 3;
+  if (nbMeshIndices == 0)
+    return;
+
+  if (precision <= 0.0) {
+    const Vec extent = mesh.boundingBoxMax() - mesh.boundingBoxMin();
+    precision = qMax(qMax(extent.x, extent.y), extent.z) / stepsPerPrecision;
+  }
+  precision_ = precision;
+  const qreal maximumExtent = stepsPerPrecision * precision;
+
+  for (int v = 0; v < nbMeshVertices; ++v) {
+    const float *texCoord =
+        vertices + v * meshCacheFloats + MeshCache::TEX_COORD_OFFSET / 4;
+    for (int k = 0; k < 2; ++k) {
+      texCoordMin_[k] = (v == 0) ? texCoord[k] : qMin(texCoordMin_[k],
+                                                      texCoord[k]);
+      texCoordMax_[k] = (v == 0) ? texCoord[k] : qMax(texCoordMax_[k],
+                                                      texCoord[k]);
+    }
+  }
+
+  // Index of the mesh vertices in the current chunk, -1 when absent
+  QVector<int> local(nbMeshVertices, -1);
+  QVector<quint32> chunkVertices;
+  QVector<quint16> chunkIndices;
+  chunkVertices.reserve(maximumChunkVertices);
+  QVector<quint16> allIndices;
+  allIndices.reserve(nbMeshIndices);
+  Vec chunkMin, chunkMax;
+
+  // Appends the vertices of the current chunk, quantized in its bounding box
+  auto finishChunk = [&]() {
+    Chunk chunk;
+    chunk.firstIndex = allIndices.size();
+    chunk.nbIndices = chunkIndices.size();
+    chunk.firstVertex = nbVertices();
+    chunk.nbVertices = chunkVertices.size();
+    chunk.boundingBoxMin = chunkMin;
+    chunk.boundingBoxMax = chunkMax;
+    chunks_.append(chunk);
+    allIndices += chunkIndices;
+
+    const Vec extent = chunkMax - chunkMin;
+    const int offset = vertexData_.size();
+    vertexData_.resize(offset + chunkVertices.size() * VERTEX_STRIDE);
+    char *data = vertexData_.data() + offset;
+    for (const quint32 v : chunkVertices) {
+      const float *vertex = vertices + v * meshCacheFloats;
+      quint16 position[4] = {0, 0, 0, 0};
+      for (int k = 0; k < 3; ++k)
+        if (extent[k] > 0.0)
+          position[k] = toUnsignedShort((vertex[k] - chunkMin[k]) / extent[k]);
+      qint16 normal[2];
+      encodeNormal(vertex + MeshCache::NORMAL_OFFSET / 4, normal);
+      const float *texCoord = vertex + MeshCache::TEX_COORD_OFFSET / 4;
+      quint16 quantizedTexCoord[2] = {0, 0};
+      for (int k = 0; k < 2; ++k) {
+        const float range = texCoordMax_[k] - texCoordMin_[k];
+        if (range > 0.0f)
+          quantizedTexCoord[k] =
+              toUnsignedShort((texCoord[k] - texCoordMin_[k]) / range);
+      }
+      memcpy(data, position, sizeof(position));
+      memcpy(data + NORMAL_OFFSET, normal, sizeof(normal));
+      memcpy(data + TEX_COORD_OFFSET, quantizedTexCoord,
+             sizeof(quantizedTexCoord));
+      data += VERTEX_STRIDE;
+      local[v] = -1;
+    }
+    chunkVertices.clear();
+    chunkIndices.clear();
+  };
+
+  for (int i = 0; i < nbMeshIndices; i += 3) {
+    // The chunk that would include this triangle
+    Vec triangleMin, triangleMax;
+    for (int c = 0; c < 3; ++c) {
+      const quint32 v = indices[i + c];
+      const float *p = vertices + v * meshCacheFloats;
+      const Vec position(p[0], p[1], p[2]);
+      if (c == 0)
+        triangleMin = triangleMax = position;
+      for (int k = 0; k < 3; ++k) {
+        triangleMin[k] = qMin(triangleMin[k], position[k]);
+        triangleMax[k] = qMax(triangleMax[k], position[k]);
+      }
+    }
+    const quint32 *t = indices + i;
+    const int nbNewVertices =
+        int(local[t[0]] < 0) + int((local[t[1]] < 0) && (t[1] != t[0])) +
+        int((local[t[2]] < 0) && (t[2] != t[0]) && (t[2] != t[1]));
+    Vec newMin = triangleMin, newMax = triangleMax;
+    if (!chunkIndices.isEmpty())
+      for (int k = 0; k < 3; ++k) {
+        newMin[k] = qMin(newMin[k], chunkMin[k]);
+        newMax[k] = qMax(newMax[k], chunkMax[k]);
+      }
+    const Vec newExtent = newMax - newMin;
+    if (!chunkIndices.isEmpty() &&
+        ((qMax(qMax(newExtent.x, newExtent.y), newExtent.z) > maximumExtent) ||
+         (chunkVertices.size() + nbNewVertices > maximumChunkVertices))) {
+      finishChunk();
+      newMin = triangleMin;
+      newMax = triangleMax;
+    }
+    chunkMin = newMin;
+    chunkMax = newMax;
+
+    for (int c = 0; c < 3; ++c) {
+      const quint32 v = indices[i + c];
+      if (local[v] < 0) {
+        local[v] = chunkVertices.size();
+        chunkVertices.append(v);
+      }
+      chunkIndices.append(quint16(local[v]));
+    }
+  }
+  finishChunk();
+
+  indexData_ =
+      QByteArray(reinterpret_cast<const char *>(allIndices.constData()),
+                 allIndices.size() * int(sizeof(quint16)));
+}
+
+/*! Removes the mesh. The OpenGL buffers are kept until the next initialize()
+or cleanupGL(). */
+void QuantizedMesh::clear() {
+  vertexData_.clear();
+  indexData_.clear();
+  chunks_.clear();
+  precision_ = 0.0;
+  texCoordMin_[0] = texCoordMin_[1] = 0.0f;
+  texCoordMax_[0] = texCoordMax_[1] = 0.0f;
+}
+
+/*! Returns the GLSL declarations of the uniforms that draw(QOpenGLShaderProgram
+&) sets for each chunk, and of the functions that decode the attributes:
+\code
+vec3 decodePosition(vec4 quantizedPosition);
+vec3 decodeNormal(vec2 quantizedNormal);
+vec2 decodeTexCoord(vec2 quantizedTexCoord);
+\endcode
+Insert it after the \c #version line of your vertex shader. */
+QByteArray QuantizedMesh::decodingShaderSource() { return decodingSource; }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Drawing                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Uploads the vertexData() and indexData() in vertex buffers. Returns \c false
+(and isInitialized() remains \c false) if the current context does not support
+them. Call it again after setMesh() to upload the new mesh. */
+bool QuantizedMesh::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("QuantizedMesh::initialize: No current OpenGL context");
+    return false;
+  }
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("QuantizedMesh::initialize: Requires OpenGL 3.3 or OpenGL ES 3.0");
+    return false;
+  }
+
+  if (!vertexArray_) {
+    vertexArray_ = new QOpenGLVertexArrayObject();
+    vertexBuffer_ = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    indexBuffer_ = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    if (!vertexArray_->create() || !vertexBuffer_->create() ||
+        !indexBuffer_->create()) {
+      qWarning("QuantizedMesh::initialize: Unable to create vertex buffers");
+      cleanupGL();
+      return false;
+    }
+  }
+
+  vertexBuffer_->bind();
+  vertexBuffer_->allocate(vertexData_.constData(), vertexData_.size());
+  vertexBuffer_->release();
+  // The element array binding is part of the vertex array state
+  vertexArray_->bind();
+  indexBuffer_->bind();
+  indexBuffer_->allocate(indexData_.constData(), indexData_.size());
+  vertexArray_->release();
+  indexBuffer_->release();
+  return true;
+}
+
+/*! Releases the OpenGL resources. The context that was current when
+initialize() was called must be current. */
+void QuantizedMesh::cleanupGL() {
+  if (vertexArray_)
+    vertexArray_->destroy();
+  if (vertexBuffer_)
+    vertexBuffer_->destroy();
+  if (indexBuffer_)
+    indexBuffer_->destroy();
+  delete vertexArray_;
+  delete vertexBuffer_;
+  delete indexBuffer_;
+  delete program_;
+  vertexArray_ = nullptr;
+  vertexBuffer_ = nullptr;
+  indexBuffer_ = nullptr;
+  program_ = nullptr;
+}
+
+// Creates program_, the shaders used by draw()
+bool QuantizedMesh::createProgram() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision highp float;\n"
+                                : "#version 330\n";
+  program_ = new QOpenGLShaderProgram();
+  // Compiled by link(), unless the program binary cache has them
+  if (!program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Vertex,
+          header + decodingSource + vertexShaderSource) ||
+      !program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource) ||
+      !program_->link()) {
+    qWarning("QuantizedMesh::draw: Unable to build shaders: %s",
+             qPrintable(program_->log()));
+    delete program_;
+    program_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+/*! Draws the mesh with the \p modelView and \p projection matrices, in \p
+color, lit by a head light (see QGLViewer::drawCameras()). Does nothing when
+isInitialized() is \c false. */
+void QuantizedMesh::draw(const QMatrix4x4 &modelView,
+                         const QMatrix4x4 &projection, const QColor &color) {
+  if (!isInitialized() || (!program_ && !createProgram()))
+    return;
+
+  program_->bind();
+  program_->setUniformValue("modelViewMatrix", modelView);
+  program_->setUniformValue("projectionMatrix", projection);
+  program_->setUniformValue("color", color);
+  draw(*program_);
+  program_->release();
+}
+
+/*! Draws the mesh with the current \c GL_MODELVIEW and \c GL_PROJECTION
+matrices and the current color. Not available with OpenGL ES. */
+void QuantizedMesh::draw() {
+#ifndef QT_OPENGL_ES_2
+  GLfloat m[16];
+  glGetFloatv(GL_MODELVIEW_MATRIX, m);
+  const QMatrix4x4 modelView = QMatrix4x4(m).transposed();
+  glGetFloatv(GL_PROJECTION_MATRIX, m);
+  const QMatrix4x4 projection = QMatrix4x4(m).transposed();
+  glGetFloatv(GL_CURRENT_COLOR, m);
+  draw(modelView, projection, QColor::fromRgbF(m[0], m[1], m[2], m[3]));
+#else
+  qWarning("QuantizedMesh::draw: Give the matrices with OpenGL ES");
+#endif
+}
+
+/*! Draws the chunks of the mesh with \p program, which must be bound, and
+whose vertex shader decodes the \c quantizedPosition, \c quantizedNormal and \c
+quantizedTexCoord attributes with the decodingShaderSource() functions. The
+attributes that \p program does not use are skipped. */
+void QuantizedMesh::draw(QOpenGLShaderProgram &program) {
+  if (!isInitialized() || chunks_.isEmpty())
+    return;
+
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+  const int positionLocation = program.attributeLocation("quantizedPosition");
+  const int normalLocation = program.attributeLocation("quantizedNormal");
+  const int texCoordLocation = program.attributeLocation("quantizedTexCoord");
+  const int offsetLocation = program.uniformLocation("positionOffset");
+  const int scaleLocation = program.uniformLocation("positionScale");
+
+  program.setUniformValue("texCoordOffset", texCoordMin_[0], texCoordMin_[1]);
+  program.setUniformValue("texCoordScale", texCoordMax_[0] - texCoordMin_[0],
+                          texCoordMax_[1] - texCoordMin_[1]);
+
+  vertexArray_->bind();
+  vertexBuffer_->bind();
+  if (positionLocation >= 0)
+    f->glEnableVertexAttribArray(positionLocation);
+  if (normalLocation >= 0)
+    f->glEnableVertexAttribArray(normalLocation);
+  if (texCoordLocation >= 0)
+    f->glEnableVertexAttribArray(texCoordLocation);
+
+  for (const Chunk &chunk : chunks_) {
+    // The attributes start at the first vertex of the chunk
+    const char *first =
+        reinterpret_cast<const char *>(qintptr(chunk.firstVertex) *
+                                       VERTEX_STRIDE);
+    if (positionLocation >= 0)
+      f->glVertexAttribPointer(positionLocation, 4, GL_UNSIGNED_SHORT, GL_TRUE,
+                               VERTEX_STRIDE, first);
+    if (normalLocation >= 0)
+      f->glVertexAttribPointer(normalLocation, 2, GL_SHORT, GL_TRUE,
+                               VERTEX_STRIDE, first + NORMAL_OFFSET);
+    if (texCoordLocation >= 0)
+      f->glVertexAttribPointer(texCoordLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+                               VERTEX_STRIDE, first + TEX_COORD_OFFSET);
+
+    const Vec extent = chunk.boundingBoxMax - chunk.boundingBoxMin;
+    program.setUniformValue(offsetLocation,
+                            QVector3D(chunk.boundingBoxMin.x,
+                                      chunk.boundingBoxMin.y,
+                                      chunk.boundingBoxMin.z));
+    program.setUniformValue(scaleLocation,
+                            QVector3D(extent.x, extent.y, extent.z));
+    f->glDrawElements(GL_TRIANGLES, chunk.nbIndices, GL_UNSIGNED_SHORT,
+                      reinterpret_cast<const void *>(
+                          qintptr(chunk.firstIndex) * sizeof(quint16)));
+  }
+
+  if (positionLocation >= 0)
+    f->glDisableVertexAttribArray(positionLocation);
+  if (normalLocation >= 0)
+    f->glDisableVertexAttribArray(normalLocation);
+  if (texCoordLocation >= 0)
+    f->glDisableVertexAttribArray(texCoordLocation);
+  vertexBuffer_->release();
+  vertexArray_->release();
+}
@@ -0,0 +1,153 @@
+#ifndef QGLVIEWER_QUANTIZED_MESH_H
+#define QGLVIEWER_QUANTIZED_MESH_H
+
+#include "vec.h"
+
+#include <QByteArray>
+#include <QColor>
+#include <QMatrix4x4>
+#include <QVector>
+
+class QOpenGLBuffer;
+class QOpenGLShaderProgram;
+class QOpenGLVertexArrayObject;
+
+namespace qglviewer {
+class MeshCache;
+
+/*! \brief A triangle mesh stored on the GPU with quantized vertex attributes.
+  \class QuantizedMesh quantizedMesh.h QGLViewer/quantizedMesh.h
+
+  The MeshCache vertices use 32 bytes each: \c float positions, normals and
+  texture coordinates. A QuantizedMesh encodes them in 16 bytes, decoded by the
+  vertex shader:
+  - the positions are three 16-bit integers, relative to the bounding box of a
+    chunk of the mesh,
+  - the normals are two 16-bit integers, octahedral encoded,
+  - the texture coordinates are two 16-bit integers, relative to their range.
+
+  The indices are 16-bit too, relative to their chunk, which halves their size
+  as well. The mesh is split into chunks of at most 65536 vertices, whose
+  bounding box is small enough for the quantization error to stay below the
+  precision() given to setMesh(). A precision derived from the scene bounds,
+  such as \c 1.0e-5 times the QGLViewer::sceneRadius(), is invisible whenever
+  the whole scene fits in the window:
+  \code
+  void Viewer::init() {
+    meshCache_.load("city.obj");
+    mesh_.setMesh(meshCache_, 1.0e-5 * sceneRadius());
+    // The vertex and index data are uploaded, and can be freed
+    mesh_.initialize();
+    meshCache_.clear();
+  }
+
+  void Viewer::draw() {
+    mesh_.draw(); // current matrices and color, head light
+  }
+  \endcode
+
+  Your shaders can decode the vertices too: prepend decodingShaderSource() to
+  their source, declare the \c quantizedPosition, \c quantizedNormal and \c
+  quantizedTexCoord attributes, and call the \c decodePosition(), \c
+  decodeNormal() and \c decodeTexCoord() functions. draw(QOpenGLShaderProgram
+  &) sets their attributes and uniforms for each chunk.
+
+  The triangles are kept in the order of the MeshCache: optimize() it first, so
+  that consecutive triangles are close, and the chunks compact. The chunks are
+  drawn by a \c glDrawElements() call each.
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. The OpenGL methods (initialize(),
+  draw() and cleanupGL()) must be called with the same context current. Call
+  cleanupGL() with this context current before the QuantizedMesh is
+  destroyed. */
+class QGLVIEWER_EXPORT QuantizedMesh {
+public:
+  /*! The interleaved layout of the vertexData(), in bytes: four \c
+  GL_UNSIGNED_SHORT position coordinates (the last one is 0), two \c GL_SHORT
+  normal coordinates and two \c GL_UNSIGNED_SHORT texture coordinates, all
+  normalized. */
+  enum { VERTEX_STRIDE = 16, NORMAL_OFFSET = 8, TEX_COORD_OFFSET = 12 };
+
+  /*! A range of the mesh, decoded with its own bounding box. */
+  struct Chunk {
+    int firstIndex; // in the indexData(), whose values are relative to
+    int nbIndices;  // firstVertex
+    int firstVertex;
+    int nbVertices;
+    Vec boundingBoxMin;
+    Vec boundingBoxMax;
+  };
+
+  QuantizedMesh();
+  ~QuantizedMesh();
+
+  /*! @name Encoding */
+  //@{
+public:
+  void setMesh(const MeshCache &mesh, qreal precision = 0.0);
+  void clear();
+
+  /*! Returns the maximum distance between an encoded position and the
+  original one, as set by setMesh(). A chunk made of a single triangle larger
+  than 131070 times precision() is less precise. */
+  qreal precision() const { return precision_; }
+
+  /*! Returns the number of vertices, of \c VERTEX_STRIDE bytes each. Vertices
+  shared by several chunks are duplicated. */
+  int nbVertices() const { return vertexData_.size() / VERTEX_STRIDE; }
+  /*! Returns the number of indices, three per triangle. */
+  int nbIndices() const { return indexData_.size() / int(sizeof(quint16)); }
+  /*! Returns the chunks of the mesh. */
+  const QVector<Chunk> &chunks() const { return chunks_; }
+
+  /*! Returns the interleaved quantized vertices of all the chunks. */
+  QByteArray vertexData() const { return vertexData_; }
+  /*! Returns the \c quint16 indices of all the chunks. */
+  QByteArray indexData() const { return indexData_; }
+  /*! Returns the size of the vertexData() and indexData(), in bytes. */
+  int dataSize() const { return vertexData_.size() + indexData_.size(); }
+
+  /*! Returns the lower corner of the texture coordinates range. */
+  const float *texCoordMin() const { return texCoordMin_; }
+  /*! Returns the upper corner of the texture coordinates range. */
+  const float *texCoordMax() const { return texCoordMax_; }
+  //@}
+
+  /*! @name Drawing */
+  //@{
+public:
+  bool initialize();
+  void cleanupGL();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return vertexArray_ != nullptr; }
+
+  void draw(const QMatrix4x4 &modelView, const QMatrix4x4 &projection,
+            const QColor &color);
+  void draw();
+  void draw(QOpenGLShaderProgram &program);
+
+  static QByteArray decodingShaderSource();
+  //@}
+
+private:
+  Q_DISABLE_COPY(QuantizedMesh)
+
+  bool createProgram();
+
+  QByteArray vertexData_;
+  QByteArray indexData_;
+  QVector<Chunk> chunks_;
+  qreal precision_;
+  float texCoordMin_[2];
+  float texCoordMax_[2];
+
+  // O p e n G L
+  QOpenGLVertexArrayObject *vertexArray_; // nullptr before initialize()
+  QOpenGLBuffer *vertexBuffer_;
+  QOpenGLBuffer *indexBuffer_;
+  QOpenGLShaderProgram *program_; // of draw(), created on first use
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_QUANTIZED_MESH_H
@@ -1,5 +1,6 @@
 #include "quaternion.h"
 #include "domUtils.h"
+#include <QDataStream>
 #include <stdlib.h> // RAND_MAX
 
 // All the methods are declared inline in Quaternion.h
@@ -42,30 +43,22 @@ Quaternion::Quaternion(const Vec &from, const Vec &to) {
 
 rotate() performs an inverse transformation. Same as inverse().rotate(v). */
 Vec Quaternion::inverseRotate(const Vec &v) const {
-  return inverse().rotate(v);
+  // Same as rotate(), with a negated axis. Avoids the inverse() temporary.
+  const Vec u(-q[0], -q[1], -q[2]);
+  const Vec t = 2.0 * cross(u, v);
+  return v + q[3] * t + cross(u, t);
 }
 
 /*! Returns the image of \p v by the Quaternion rotation.
 
 See also inverseRotate() and operator*(const Quaternion&, const Vec&). */
 Vec Quaternion::rotate(const Vec &v) const {
-  const qreal q00 = 2.0 * q[0] * q[0];
-  const qreal q11 = 2.0 * q[1] * q[1];
-  const qreal q22 = 2.0 * q[2] * q[2];
-
-  const qreal q01 = 2.0 * q[0] * q[1];
-  const qreal q02 = 2.0 * q[0] * q[2];
-  const qreal q03 = 2.0 * q[0] * q[3];
-
-  const qreal q12 = 2.0 * q[1] * q[2];
-  const qreal q13 = 2.0 * q[1] * q[3];
-
-  const qreal q23 = 2.0 * q[2] * q[3];
-
-  return Vec((1.0 - q11 - q22) * v[0] + (q01 - q23) * v[1] + (q02 + q13) * v[2],
-             (q01 + q23) * v[0] + (1.0 - q22 - q00) * v[1] + (q12 - q03) * v[2],
-             (q02 - q13) * v[0] + (q12 + q03) * v[1] +
-                 (1.0 - q11 - q00) * v[2]);
+  // v' = v + 2w (u x v) + 2 u x (u x v), with u the vector part of the unit
+  // Quaternion and w its scalar part. Uses 15 multiplications instead of the 27
+  // of the matrix form.
+  const Vec u(q[0], q[1], q[2]);
+  const Vec t = 2.0 * cross(u, v);
+  return v + q[3] * t + cross(u, t);
 }
 
 /*! Set the Quaternion from a (supposedly correct) 3x3 rotation matrix.
@@ -378,6 +371,69 @@ void Quaternion::getInverseRotationMatrix(qreal m[3][3]) const {
       m[i][j] = qreal(mat[j][i]);
 }
 
+namespace {
+// Eberly, "A Fast and Accurate Algorithm for Computing SLERP": the series of
+// sin(t*angle) / sin(angle) in powers of cos(angle) - 1, truncated to eight
+// terms, the last one scaled by mu to compensate for the truncation
+const qreal slerpMu = 1.90110745351730037;
+const qreal slerpU[8] = {1.0 / 3.0,  1.0 / 10.0, 1.0 / 21.0,
+                         1.0 / 36.0, 1.0 / 55.0, 1.0 / 78.0,
+                         1.0 / 105.0, slerpMu / 136.0};
+const qreal slerpV[8] = {1.0 / 3.0, 2.0 / 5.0,  3.0 / 7.0,
+                         4.0 / 9.0, 5.0 / 11.0, 6.0 / 13.0,
+                         7.0 / 15.0, slerpMu * 8.0 / 17.0};
+
+inline qreal polynomialCoefficient(qreal cosAngleMinusOne, qreal t) {
+  const qreal t2 = t * t;
+  qreal c = 1.0;
+  for (int i = 7; i >= 0; --i)
+    c = 1.0 + (slerpU[i] * t2 - slerpV[i]) * cosAngleMinusOne * c;
+  return t * c;
+}
+
+// Kapoulkine, "Approximating slerp": the time of a normalized linear
+// interpolation, corrected by a cubic fitted on the slerp angle
+inline qreal correctedNlerpTime(qreal cosAngle, qreal t) {
+  const qreal ca =
+      1.0904 + cosAngle * (-3.2452 + cosAngle * (3.55645 - cosAngle * 1.43519));
+  const qreal cb = 0.848013 + cosAngle * (-1.06021 + cosAngle * 0.215638);
+  const qreal k = ca * (t - 0.5) * (t - 0.5) + cb;
+  return t + t * (t - 0.5) * (t - 1.0) * k;
+}
+
+// Same conventions as Quaternion::slerp(), without branches so that the batch
+// loops are vectorized
+template <int Precision>
+inline Quaternion approximateSlerp(const Quaternion &a, const Quaternion &b,
+                                   qreal t, bool allowFlip) {
+  const qreal cosAngle = Quaternion::dot(a, b);
+  const qreal x = fabs(cosAngle);
+  qreal c1, c2;
+  if (Precision == Quaternion::POLYNOMIAL_SLERP) {
+    c1 = polynomialCoefficient(x - 1.0, 1.0 - t);
+    c2 = polynomialCoefficient(x - 1.0, t);
+  } else {
+    c2 = correctedNlerpTime(x, t);
+    c1 = 1.0 - c2;
+  }
+  c1 = (allowFlip && (cosAngle < 0.0)) ? -c1 : c1;
+
+  Quaternion res(c1 * a[0] + c2 * b[0], c1 * a[1] + c2 * b[1],
+                 c1 * a[2] + c2 * b[2], c1 * a[3] + c2 * b[3]);
+  res.normalize();
+  return res;
+}
+
+template <int Precision>
+inline Quaternion approximateSquad(const Quaternion &a, const Quaternion &tgA,
+                                   const Quaternion &tgB, const Quaternion &b,
+                                   qreal t) {
+  const Quaternion ab = approximateSlerp<Precision>(a, b, t, true);
+  const Quaternion tg = approximateSlerp<Precision>(tgA, tgB, t, false);
+  return approximateSlerp<Precision>(ab, tg, 2.0 * t * (1.0 - t), false);
+}
+} // namespace
+
 /*! Returns the slerp interpolation of Quaternions \p a and \p b, at time \p t.
 
  \p t should range in [0,1]. Result is \p a when \p t=0 and \p b when \p t=1.
@@ -425,6 +481,84 @@ Quaternion Quaternion::squad(const Quaternion &a, const Quaternion &tgA,
   return Quaternion::slerp(ab, tg, 2.0 * t * (1.0 - t), false);
 }
 
+/*! Same as slerp(const Quaternion&, const Quaternion&, qreal, bool), computed
+with the given \p precision. See SlerpPrecision for the resulting errors. */
+Quaternion Quaternion::slerp(const Quaternion &a, const Quaternion &b, qreal t,
+                             bool allowFlip, SlerpPrecision precision) {
+  switch (precision) {
+  case POLYNOMIAL_SLERP:
+    return approximateSlerp<POLYNOMIAL_SLERP>(a, b, t, allowFlip);
+  case CORRECTED_NLERP:
+    return approximateSlerp<CORRECTED_NLERP>(a, b, t, allowFlip);
+  default:
+    return slerp(a, b, t, allowFlip);
+  }
+}
+
+/*! Same as squad(const Quaternion&, const Quaternion&, const Quaternion&,
+const Quaternion&, qreal), computed with the given \p precision. The three
+slerps add their errors: the angular error is at most three times the one given
+in SlerpPrecision. */
+Quaternion Quaternion::squad(const Quaternion &a, const Quaternion &tgA,
+                             const Quaternion &tgB, const Quaternion &b,
+                             qreal t, SlerpPrecision precision) {
+  switch (precision) {
+  case POLYNOMIAL_SLERP:
+    return approximateSquad<POLYNOMIAL_SLERP>(a, tgA, tgB, b, t);
+  case CORRECTED_NLERP:
+    return approximateSquad<CORRECTED_NLERP>(a, tgA, tgB, b, t);
+  default:
+    return squad(a, tgA, tgB, b, t);
+  }
+}
+
+/*! Batch version of slerp(), which interpolates \p a[i] and \p b[i] at time
+\p t[i] in \p res[i], for the \p nb first elements of the arrays.
+
+This is the fastest way to evaluate many independent interpolations: with an
+approximate \p precision, the loop has no branch and no transcendental
+function. \p res may be \p a or \p b. */
+void Quaternion::slerp(const Quaternion *a, const Quaternion *b,
+                       const qreal *t, Quaternion *res, int nb, bool allowFlip,
+                       SlerpPrecision precision) {
+  switch (precision) {
+  case POLYNOMIAL_SLERP:
+    for (int i = 0; i < nb; ++i)
+      res[i] = approximateSlerp<POLYNOMIAL_SLERP>(a[i], b[i], t[i], allowFlip);
+    break;
+  case CORRECTED_NLERP:
+    for (int i = 0; i < nb; ++i)
+      res[i] = approximateSlerp<CORRECTED_NLERP>(a[i], b[i], t[i], allowFlip);
+    break;
+  default:
+    for (int i = 0; i < nb; ++i)
+      res[i] = slerp(a[i], b[i], t[i], allowFlip);
+  }
+}
+
+/*! Batch version of squad(), see slerp(const Quaternion*, const Quaternion*,
+const qreal*, Quaternion*, int, bool, SlerpPrecision). */
+void Quaternion::squad(const Quaternion *a, const Quaternion *tgA,
+                       const Quaternion *tgB, const Quaternion *b,
+                       const qreal *t, Quaternion *res, int nb,
+                       SlerpPrecision precision) {
+  switch (precision) {
+  case POLYNOMIAL_SLERP:
+    for (int i = 0; i < nb; ++i)
+      res[i] =
+          approximateSquad<POLYNOMIAL_SLERP>(a[i], tgA[i], tgB[i], b[i], t[i]);
+    break;
+  case CORRECTED_NLERP:
+    for (int i = 0; i < nb; ++i)
+      res[i] =
+          approximateSquad<CORRECTED_NLERP>(a[i], tgA[i], tgB[i], b[i], t[i]);
+    break;
+  default:
+    for (int i = 0; i < nb; ++i)
+      res[i] = squad(a[i], tgA[i], tgB[i], b[i], t[i]);
+  }
+}
+
 /*! Returns the logarithm of the Quaternion. See also exp(). */
 Quaternion Quaternion::log() {
   qreal len = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
@@ -481,6 +615,19 @@ ostream &operator<<(ostream &o, const Quaternion &Q) {
   return o << Q[0] << '\t' << Q[1] << '\t' << Q[2] << '\t' << Q[3];
 }
 
+QDataStream &operator<<(QDataStream &stream, const Quaternion &Q) {
+  return stream << double(Q[0]) << double(Q[1]) << double(Q[2])
+                << double(Q[3]);
+}
+
+QDataStream &operator>>(QDataStream &stream, Quaternion &Q) {
+  double q0, q1, q2, q3;
+  stream >> q0 >> q1 >> q2 >> q3;
+  if (stream.status() == QDataStream::Ok)
+    Q.setValue(q0, q1, q2, q3);
+  return stream;
+}
+
 /*! Returns a random unit Quaternion.
 
 You can create a randomly directed unit vector using:
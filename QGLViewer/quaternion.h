@@ -134,7 +134,7 @@ public:
 
   /*! Bracket operator returning an l-value. \p i must range in [0..3]. See the
    * Quaternion(qreal, qreal, qreal, qreal) documentation. */
-  qreal &operator[](int i) { return q[i]; }
+  Real &operator[](int i) { return q[i]; }
   //@}
 
   /*! @name Rotation computations */
@@ -153,11 +153,35 @@ public:
      normalized. Use normalize() in case of numerical drift with small rotation
      composition. */
   friend Quaternion operator*(const Quaternion &a, const Quaternion &b) {
+#ifdef QGLVIEWER_SIMD_SSE2
+    const __m128d a01 = _mm_load_pd(a.q), a23 = _mm_load_pd(a.q + 2);
+    const __m128d b01 = _mm_load_pd(b.q), b23 = _mm_load_pd(b.q + 2);
+    const __m128d a12 = _mm_shuffle_pd(a01, a23, 1);
+    // (q[0], q[1]) components
+    __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_unpackhi_pd(a23, a23), b01),
+                            _mm_mul_pd(_mm_unpackhi_pd(b23, b23), a01));
+    lo = _mm_add_pd(lo, _mm_mul_pd(a12, _mm_shuffle_pd(b23, b01, 0)));
+    lo = _mm_sub_pd(lo, _mm_mul_pd(_mm_shuffle_pd(a23, a01, 0),
+                                   _mm_shuffle_pd(b01, b23, 1)));
+    // (q[2], q[3]) components
+    const __m128d a0ma1 = _mm_mul_pd(a01, _mm_set_pd(-1.0, 1.0));
+    __m128d hi = _mm_mul_pd(_mm_unpackhi_pd(a23, a23), b23);
+    const __m128d minusA01 = _mm_sub_pd(_mm_setzero_pd(), a01);
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_shuffle_pd(b23, minusA01, 1),
+                                   _mm_shuffle_pd(a23, b01, 0)));
+    hi = _mm_add_pd(hi, _mm_mul_pd(a0ma1, _mm_unpackhi_pd(b01, b01)));
+    hi = _mm_sub_pd(hi, _mm_mul_pd(a12, _mm_unpacklo_pd(b01, b23)));
+    Quaternion res;
+    _mm_store_pd(res.q, lo);
+    _mm_store_pd(res.q + 2, hi);
+    return res;
+#else
     return Quaternion(
         a.q[3] * b.q[0] + b.q[3] * a.q[0] + a.q[1] * b.q[2] - a.q[2] * b.q[1],
         a.q[3] * b.q[1] + b.q[3] * a.q[1] + a.q[2] * b.q[0] - a.q[0] * b.q[2],
         a.q[3] * b.q[2] + b.q[3] * a.q[2] + a.q[0] * b.q[1] - a.q[1] * b.q[0],
         a.q[3] * b.q[3] - b.q[0] * a.q[0] - a.q[1] * b.q[1] - a.q[2] * b.q[2]);
+#endif
   }
 
   /*! Quaternion rotation is composed with \p q.
@@ -224,23 +248,30 @@ public:
      Quaternions. This is however useful to prevent numerical drifts, especially
      with small rotational increments. See also normalized(). */
   qreal normalize() {
+#ifdef QGLVIEWER_SIMD_SSE2
+    const __m128d q01 = _mm_load_pd(q), q23 = _mm_load_pd(q + 2);
+    const __m128d s = _mm_add_pd(_mm_mul_pd(q01, q01), _mm_mul_pd(q23, q23));
+    const __m128d n = _mm_sqrt_pd(_mm_add_pd(s, _mm_unpackhi_pd(s, s)));
+    const __m128d norm2 = _mm_unpacklo_pd(n, n);
+    _mm_store_pd(q, _mm_div_pd(q01, norm2));
+    _mm_store_pd(q + 2, _mm_div_pd(q23, norm2));
+    return _mm_cvtsd_f64(n);
+#else
     const qreal norm =
         sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
     for (int i = 0; i < 4; ++i)
       q[i] /= norm;
     return norm;
+#endif
   }
 
   /*! Returns a normalized version of the Quaternion.
 
           See also normalize(). */
   Quaternion normalized() const {
-    qreal Q[4];
-    const qreal norm =
-        sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
-    for (int i = 0; i < 4; ++i)
-      Q[i] = q[i] / norm;
-    return Quaternion(Q[0], Q[1], Q[2], Q[3]);
+    Quaternion res(*this);
+    res.normalize();
+    return res;
   }
   //@}
 
@@ -261,10 +292,40 @@ public:
 
   /*! @name Slerp interpolation */
   //@{
+  /*! The precision of the slerp() and squad() interpolations. The angular
+  errors are the maximum deviations of the interpolated rotation, over all the
+  pairs of rotations and interpolation times. They are much smaller for close
+  rotations: a few degrees apart, all the modes are exact to the display
+  precision.
+
+  The approximate modes only use multiplications, additions and a square root:
+  their batch versions (see slerp(const Quaternion*, const Quaternion*, const
+  qreal*, Quaternion*, int, bool, SlerpPrecision)) have no branch and are
+  vectorized by the compiler. */
+  enum SlerpPrecision {
+    EXACT_SLERP,      /*!< Uses \c acos() and \c sin() (default). */
+    POLYNOMIAL_SLERP, /*!< Polynomial approximation of the slerp coefficients
+                        (Eberly), maximum angular error 2e-5 radians. */
+    CORRECTED_NLERP   /*!< Normalized linear interpolation with a cubic time
+                        correction, maximum angular error 1e-3 radians. */
+  };
+
   static Quaternion slerp(const Quaternion &a, const Quaternion &b, qreal t,
                           bool allowFlip = true);
+  static Quaternion slerp(const Quaternion &a, const Quaternion &b, qreal t,
+                          bool allowFlip, SlerpPrecision precision);
   static Quaternion squad(const Quaternion &a, const Quaternion &tgA,
                           const Quaternion &tgB, const Quaternion &b, qreal t);
+  static Quaternion squad(const Quaternion &a, const Quaternion &tgA,
+                          const Quaternion &tgB, const Quaternion &b, qreal t,
+                          SlerpPrecision precision);
+  static void slerp(const Quaternion *a, const Quaternion *b, const qreal *t,
+                    Quaternion *res, int nb, bool allowFlip = true,
+                    SlerpPrecision precision = POLYNOMIAL_SLERP);
+  static void squad(const Quaternion *a, const Quaternion *tgA,
+                    const Quaternion *tgB, const Quaternion *b,
+                    const qreal *t, Quaternion *res, int nb,
+                    SlerpPrecision precision = POLYNOMIAL_SLERP);
   /*! Returns the "dot" product of \p a and \p b: a[0]*b[0] + a[1]*b[1] +
    * a[2]*b[2] + a[3]*b[3]. */
   static qreal dot(const Quaternion &a, const Quaternion &b) {
@@ -301,16 +362,30 @@ public:
           \endcode */
   std::ostream &operator<<(std::ostream &o, const qglviewer::Vec &);
 //@}
+
+  /*! @name Binary representation */
+  //@{
+  /*! Writes the four values of the Quaternion in \p stream. Used by
+  Frame::writeBinary(). */
+  QDataStream &operator<<(QDataStream &stream, const qglviewer::Quaternion &);
+  /*! Reads a Quaternion written by operator<<(QDataStream&, const
+  Quaternion&). */
+  QDataStream &operator>>(QDataStream &stream, qglviewer::Quaternion &);
+//@}
 #endif
 
 private:
   /*! The internal data representation is private, use operator[] to access
-   * values. */
-  qreal q[4];
+   * values. Aligned when SIMD kernels are enabled (see config.h). */
+  QGLVIEWER_SIMD_ALIGN Real q[4];
 };
 
 } // namespace qglviewer
 
 std::ostream &operator<<(std::ostream &o, const qglviewer::Quaternion &);
+QGLVIEWER_EXPORT QDataStream &operator<<(QDataStream &stream,
+                                         const qglviewer::Quaternion &);
+QGLVIEWER_EXPORT QDataStream &operator>>(QDataStream &stream,
+                                         qglviewer::Quaternion &);
 
 #endif // QGLVIEWER_QUATERNION_H
@@ -0,0 +1,940 @@
+#include "rayPicker.h"
+#include "camera.h"
+#include "frame.h"
+#include "taskScheduler.h"
+
+#include <QImage>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPolygon>
+#include <QRect>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace qglviewer;
+
+/*! Creates an empty RayPicker. */
+RayPicker::RayPicker()
+    : revision_(0), boundsAreModified_(false), maximumLeafSize_(4),
+      asynchronousBuild_(true), buildThreadPool_(nullptr),
+      buildIsRunning_(false), builtHierarchyIsReady_(false) {
+  hierarchy_.revision = 0;
+  builtHierarchy_.revision = 0;
+}
+
+/*! Destructor. Waits for the completion of a running background build. */
+RayPicker::~RayPicker() {
+  if (buildThreadPool_)
+    buildThreadPool_->waitForDone();
+  delete buildThreadPool_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Registered primitives                             //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers the triangle \p a, \p b, \p c and returns its id. Triangles are
+two sided. \p name is the name returned by pick() when this triangle is hit.
+
+The coordinates are expressed in \p frame, or in the world coordinate system
+when \p frame is \c nullptr. Ids of removed primitives (see removePrimitive())
+are reused. */
+int RayPicker::addTriangle(const Vec &a, const Vec &b, const Vec &c, int name,
+                           const Frame *frame) {
+  const int id = addPrimitive(TRIANGLE, name, frame);
+  setTriangle(id, a, b, c);
+  return id;
+}
+
+/*! Registers an axis aligned box (in \p frame coordinates), defined by its \p
+min and \p max corners, and returns its id. See addTriangle(). */
+int RayPicker::addBox(const Vec &min, const Vec &max, int name,
+                      const Frame *frame) {
+  const int id = addPrimitive(BOX, name, frame);
+  setBox(id, min, max);
+  return id;
+}
+
+/*! Moves the triangle \p id. Its Frame and name are unchanged. The hierarchy
+is refitted, not rebuilt. */
+void RayPicker::setTriangle(int id, const Vec &a, const Vec &b, const Vec &c) {
+  if (!isValidId(id, "setTriangle"))
+    return;
+  Primitive &primitive = primitives_[id];
+  if (primitive.type != TRIANGLE) {
+    qWarning("RayPicker::setTriangle: primitive %d is not a triangle", id);
+    return;
+  }
+  for (int i = 0; i < 3; ++i) {
+    primitive.local[0][i] = a[i];
+    primitive.local[1][i] = b[i];
+    primitive.local[2][i] = c[i];
+  }
+  updateWorldCoordinates(primitive);
+  boundsAreModified_ = true;
+}
+
+/*! Moves or resizes the box \p id. See setTriangle(). */
+void RayPicker::setBox(int id, const Vec &min, const Vec &max) {
+  if (!isValidId(id, "setBox"))
+    return;
+  Primitive &primitive = primitives_[id];
+  if (primitive.type != BOX) {
+    qWarning("RayPicker::setBox: primitive %d is not a box", id);
+    return;
+  }
+  for (int i = 0; i < 3; ++i) {
+    primitive.local[0][i] = std::min(min[i], max[i]);
+    primitive.local[1][i] = std::max(min[i], max[i]);
+  }
+  updateWorldCoordinates(primitive);
+  boundsAreModified_ = true;
+}
+
+/*! Unregisters the primitive \p id. Its id may be returned by the next
+addTriangle() or addBox() call. */
+void RayPicker::removePrimitive(int id) {
+  if (!isValidId(id, "removePrimitive"))
+    return;
+  Primitive &primitive = primitives_[id];
+  if (primitive.frame >= 0)
+    --frames_[primitive.frame].nbPrimitives;
+  primitive.used = false;
+  freeIds_.append(id);
+  setModified();
+}
+
+/*! Unregisters all the primitives. */
+void RayPicker::clear() {
+  primitives_.clear();
+  freeIds_.clear();
+  frames_.clear();
+  setModified();
+}
+
+/*! Sets the maximumLeafSize() of the hierarchy, which is rebuilt. */
+void RayPicker::setMaximumLeafSize(int size) {
+  maximumLeafSize_ = std::max(1, size);
+  setModified();
+}
+
+/*! Sets the asynchronousBuildIsEnabled() value. */
+void RayPicker::setAsynchronousBuildIsEnabled(bool enabled) {
+  if (!enabled)
+    waitForHierarchy();
+  asynchronousBuild_ = enabled;
+}
+
+bool RayPicker::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= primitives_.size()) || !primitives_[id].used) {
+    qWarning("RayPicker::%s: Invalid primitive id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+int RayPicker::addPrimitive(Type type, int name, const Frame *frame) {
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = primitives_.size();
+    primitives_.append(Primitive());
+  } else
+    id = freeIds_.takeLast();
+
+  Primitive &primitive = primitives_[id];
+  primitive.type = type;
+  primitive.name = name;
+  primitive.frame = frame ? frameIndex(frame) : -1;
+  primitive.used = true;
+  setModified();
+  return id;
+}
+
+// Index of frame in frames_, which is appended if needed.
+int RayPicker::frameIndex(const Frame *frame) {
+  int index = -1;
+  for (int i = 0; i < frames_.size(); ++i)
+    if (frames_[i].frame == frame)
+      index = i;
+    else if ((index < 0) && (frames_[i].nbPrimitives == 0))
+      index = i; // Reuse the slot of an unused frame
+
+  if ((index < 0) || (frames_[index].frame != frame)) {
+    FrameState state;
+    state.frame = frame;
+    state.nbPrimitives = 0;
+    if (index < 0) {
+      index = frames_.size();
+      frames_.append(state);
+    } else
+      frames_[index] = state;
+  }
+
+  FrameState &state = frames_[index];
+  if (state.nbPrimitives == 0) {
+    state.position = frame->position();
+    state.orientation = frame->orientation();
+  }
+  ++state.nbPrimitives;
+  return index;
+}
+
+// Computes the world vertices and bounding box of primitive from its local
+// coordinates.
+void RayPicker::updateWorldCoordinates(Primitive &primitive) const {
+  const Frame *frame =
+      (primitive.frame >= 0) ? frames_[primitive.frame].frame : nullptr;
+
+  for (int i = 0; i < 3; ++i) {
+    primitive.min[i] = std::numeric_limits<Real>::max();
+    primitive.max[i] = -std::numeric_limits<Real>::max();
+  }
+
+  // The 3 vertices of a triangle, or the 8 corners of a box
+  const int nbPoints = (primitive.type == TRIANGLE) ? 3 : 8;
+  for (int p = 0; p < nbPoints; ++p) {
+    Vec point;
+    if (primitive.type == TRIANGLE)
+      point = Vec(primitive.local[p]);
+    else
+      point = Vec(primitive.local[p & 1][0], primitive.local[(p >> 1) & 1][1],
+                  primitive.local[(p >> 2) & 1][2]);
+    if (frame)
+      point = frame->inverseCoordinatesOf(point);
+
+    for (int i = 0; i < 3; ++i) {
+      if (primitive.type == TRIANGLE)
+        primitive.world[p][i] = point[i];
+      primitive.min[i] = std::min(primitive.min[i], Real(point[i]));
+      primitive.max[i] = std::max(primitive.max[i], Real(point[i]));
+    }
+  }
+}
+
+// The registered primitives changed: a new hierarchy is needed.
+void RayPicker::setModified() {
+  ++revision_;
+  boundsAreModified_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Hierarchy                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns \c true when pick() uses a hierarchy built from the current
+primitives. */
+bool RayPicker::hierarchyIsUpToDate() const {
+  return hierarchy_.revision == revision_;
+}
+
+/*! Blocks until the hierarchy of the current primitives is built. */
+void RayPicker::waitForHierarchy() {
+  updateHierarchy();
+  while (!hierarchyIsUpToDate()) {
+    buildThreadPool_->waitForDone();
+    updateHierarchy();
+  }
+}
+
+// Adopts the result of a completed build, and starts a new one when the
+// primitives have changed in the meantime.
+void RayPicker::updateHierarchy() {
+  if (buildIsRunning_) {
+    QMutexLocker locker(&buildMutex_);
+    if (builtHierarchyIsReady_) {
+      std::swap(hierarchy_, builtHierarchy_);
+      builtHierarchyIsReady_ = false;
+      buildIsRunning_ = false;
+      // Primitives may have moved during the build
+      boundsAreModified_ = true;
+    }
+  }
+
+  if (!hierarchyIsUpToDate() && !buildIsRunning_) {
+    if (asynchronousBuild_)
+      startBuild();
+    else {
+      QVector<Bounds> bounds;
+      collectBounds(bounds);
+      buildHierarchy(bounds, maximumLeafSize_, hierarchy_);
+      hierarchy_.revision = revision_;
+      boundsAreModified_ = false;
+    }
+  }
+}
+
+// Copies the bounding boxes of the used primitives, the input of a build.
+void RayPicker::collectBounds(QVector<Bounds> &bounds) const {
+  bounds.clear();
+  bounds.reserve(nbPrimitives());
+  for (int id = 0; id < primitives_.size(); ++id)
+    if (primitives_[id].used) {
+      const Primitive &p = primitives_[id];
+      Bounds b;
+      b.id = id;
+      for (int i = 0; i < 3; ++i) {
+        b.min[i] = p.min[i];
+        b.max[i] = p.max[i];
+        b.center[i] = (p.min[i] + p.max[i]) / 2.0;
+      }
+      bounds.append(b);
+    }
+}
+
+// Builds the hierarchy of the current primitives on the build thread.
+void RayPicker::startBuild() {
+  QVector<Bounds> bounds;
+  collectBounds(bounds);
+
+  if (!buildThreadPool_) {
+    buildThreadPool_ = new QThreadPool();
+    buildThreadPool_->setMaxThreadCount(1);
+  }
+
+  buildIsRunning_ = true;
+  const unsigned int revision = revision_;
+  const int maximumLeafSize = maximumLeafSize_;
+  buildThreadPool_->start(
+      QRunnable::create([this, bounds, revision, maximumLeafSize]() mutable {
+        Hierarchy hierarchy;
+        buildHierarchy(bounds, maximumLeafSize, hierarchy);
+        hierarchy.revision = revision;
+
+        QMutexLocker locker(&buildMutex_);
+        std::swap(builtHierarchy_, hierarchy);
+        builtHierarchyIsReady_ = true;
+      }));
+}
+
+void RayPicker::buildHierarchy(QVector<Bounds> &bounds, int maximumLeafSize,
+                               Hierarchy &hierarchy) {
+  hierarchy.nodes.clear();
+  hierarchy.order.clear();
+  hierarchy.nodes.reserve(2 * (bounds.size() / maximumLeafSize + 1));
+  if (!bounds.isEmpty())
+    buildNode(bounds, 0, bounds.size(), maximumLeafSize, hierarchy.nodes);
+
+  hierarchy.order.reserve(bounds.size());
+  for (int b = 0; b < bounds.size(); ++b)
+    hierarchy.order.append(bounds[b].id);
+}
+
+static Real halfArea(const Real min[3], const Real max[3]) {
+  const Real dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+  return dx * dy + dy * dz + dz * dx;
+}
+
+// Builds the node of the bounds[first..first+count[ primitives and returns its
+// index. The split is chosen with the surface area heuristic, evaluated on
+// nbBins bins of the centers' bounding box along each axis.
+int RayPicker::buildNode(QVector<Bounds> &bounds, int first, int count,
+                         int maximumLeafSize, QVector<Node> &nodes) {
+  const int index = nodes.size();
+  nodes.append(Node());
+
+  const Real big = std::numeric_limits<Real>::max();
+  Node node;
+  Real centerMin[3] = {big, big, big}, centerMax[3] = {-big, -big, -big};
+  for (int i = 0; i < 3; ++i) {
+    node.min[i] = big;
+    node.max[i] = -big;
+  }
+  for (int b = first; b < first + count; ++b)
+    for (int i = 0; i < 3; ++i) {
+      node.min[i] = std::min(node.min[i], bounds[b].min[i]);
+      node.max[i] = std::max(node.max[i], bounds[b].max[i]);
+      centerMin[i] = std::min(centerMin[i], bounds[b].center[i]);
+      centerMax[i] = std::max(centerMax[i], bounds[b].center[i]);
+    }
+  node.first = first;
+  node.count = count;
+  node.right = -1;
+
+  static const int nbBins = 16;
+  int bestAxis = -1, bestBin = 0;
+  // Cost of a leaf, with a node traversal cost of 1 intersection
+  Real bestCost = count - 1.0;
+  const Real area = halfArea(node.min, node.max);
+
+  if ((count > 1) && (area > 0.0))
+    for (int axis = 0; axis < 3; ++axis) {
+      const Real extent = centerMax[axis] - centerMin[axis];
+      if (extent <= 0.0)
+        continue;
+
+      int binCount[nbBins] = {0};
+      Real binMin[nbBins][3], binMax[nbBins][3];
+      for (int k = 0; k < nbBins; ++k)
+        for (int i = 0; i < 3; ++i) {
+          binMin[k][i] = big;
+          binMax[k][i] = -big;
+        }
+      for (int b = first; b < first + count; ++b) {
+        const int k = std::min(
+            nbBins - 1,
+            int(nbBins * (bounds[b].center[axis] - centerMin[axis]) / extent));
+        ++binCount[k];
+        for (int i = 0; i < 3; ++i) {
+          binMin[k][i] = std::min(binMin[k][i], bounds[b].min[i]);
+          binMax[k][i] = std::max(binMax[k][i], bounds[b].max[i]);
+        }
+      }
+
+      // Areas of the bins on the right of each split, swept from the right
+      Real rightArea[nbBins];
+      int rightCount[nbBins];
+      Real min[3] = {big, big, big}, max[3] = {-big, -big, -big};
+      int n = 0;
+      for (int k = nbBins - 1; k > 0; --k) {
+        for (int i = 0; i < 3; ++i) {
+          min[i] = std::min(min[i], binMin[k][i]);
+          max[i] = std::max(max[i], binMax[k][i]);
+        }
+        n += binCount[k];
+        rightCount[k] = n;
+        rightArea[k] = n ? halfArea(min, max) : 0.0;
+      }
+
+      for (int i = 0; i < 3; ++i) {
+        min[i] = big;
+        max[i] = -big;
+      }
+      n = 0;
+      for (int k = 1; k < nbBins; ++k) {
+        for (int i = 0; i < 3; ++i) {
+          min[i] = std::min(min[i], binMin[k - 1][i]);
+          max[i] = std::max(max[i], binMax[k - 1][i]);
+        }
+        n += binCount[k - 1];
+        if ((n == 0) || (rightCount[k] == 0))
+          continue;
+        const Real cost =
+            (n * halfArea(min, max) + rightCount[k] * rightArea[k]) / area;
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = k;
+        }
+      }
+    }
+
+  int half = -1;
+  if (bestAxis >= 0) {
+    const Real extent = centerMax[bestAxis] - centerMin[bestAxis];
+    const Real origin = centerMin[bestAxis];
+    half = int(std::partition(bounds.begin() + first,
+                              bounds.begin() + first + count,
+                              [=](const Bounds &b) {
+                                return std::min(nbBins - 1,
+                                                int(nbBins *
+                                                    (b.center[bestAxis] -
+                                                     origin) /
+                                                    extent)) < bestBin;
+                              }) -
+               (bounds.begin() + first));
+  } else if (count > maximumLeafSize) {
+    // No split reduces the cost (identical centers): split in the middle to
+    // respect the maximum leaf size.
+    half = count / 2;
+  }
+
+  if (half > 0) {
+    // Left child is index+1
+    buildNode(bounds, first, half, maximumLeafSize, nodes);
+    node.right =
+        buildNode(bounds, first + half, count - half, maximumLeafSize, nodes);
+  }
+
+  nodes[index] = node;
+  return index;
+}
+
+// Updates the world coordinates of the primitives whose frame moved, and the
+// bounding boxes of the nodes.
+void RayPicker::refit() {
+  QVector<bool> moved(frames_.size(), false);
+  bool someFrameMoved = false;
+  for (int f = 0; f < frames_.size(); ++f) {
+    FrameState &state = frames_[f];
+    if (state.nbPrimitives == 0)
+      continue;
+    const Vec position = state.frame->position();
+    const Quaternion orientation = state.frame->orientation();
+    bool same = position == state.position;
+    for (int i = 0; same && (i < 4); ++i)
+      same = orientation[i] == state.orientation[i];
+    if (!same) {
+      state.position = position;
+      state.orientation = orientation;
+      moved[f] = someFrameMoved = true;
+    }
+  }
+
+  if (someFrameMoved) {
+    for (int id = 0; id < primitives_.size(); ++id) {
+      Primitive &primitive = primitives_[id];
+      if (primitive.used && (primitive.frame >= 0) && moved[primitive.frame])
+        updateWorldCoordinates(primitive);
+    }
+    boundsAreModified_ = true;
+  }
+
+  if (!boundsAreModified_ || !hierarchyIsUpToDate())
+    return;
+
+  // Children have larger indices than their parent
+  const Real big = std::numeric_limits<Real>::max();
+  for (int n = hierarchy_.nodes.size() - 1; n >= 0; --n) {
+    Node &node = hierarchy_.nodes[n];
+    for (int i = 0; i < 3; ++i) {
+      node.min[i] = big;
+      node.max[i] = -big;
+    }
+    if (node.right < 0)
+      for (int o = node.first; o < node.first + node.count; ++o) {
+        const Primitive &primitive = primitives_[hierarchy_.order[o]];
+        for (int i = 0; i < 3; ++i) {
+          node.min[i] = std::min(node.min[i], primitive.min[i]);
+          node.max[i] = std::max(node.max[i], primitive.max[i]);
+        }
+      }
+    else {
+      const Node &left = hierarchy_.nodes[n + 1];
+      const Node &right = hierarchy_.nodes[node.right];
+      for (int i = 0; i < 3; ++i) {
+        node.min[i] = std::min(left.min[i], right.min[i]);
+        node.max[i] = std::max(left.max[i], right.max[i]);
+      }
+    }
+  }
+  boundsAreModified_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Picking                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Intersects the ray starting at \p orig, along \p dir (world coordinates),
+with the registered primitives. Returns \c false when no primitive is hit.
+Otherwise, \p hit is set to the closest intersection in front of \p orig, along
+\p dir.
+
+The hierarchy is refitted first when Frames or primitives have moved. Before
+the first build, or when primitives were added or removed, the hierarchy is
+built (see asynchronousBuildIsEnabled()). */
+bool RayPicker::pick(const Vec &orig, const Vec &dir, Hit &hit) {
+  updateHierarchy();
+  refit();
+
+  const Real o[3] = {Real(orig.x), Real(orig.y), Real(orig.z)};
+  const Real d[3] = {Real(dir.x), Real(dir.y), Real(dir.z)};
+  Real invDir[3];
+  for (int i = 0; i < 3; ++i)
+    invDir[i] = (d[i] != 0.0) ? Real(1.0) / d[i]
+                              : std::numeric_limits<Real>::infinity();
+
+  Real tMax = std::numeric_limits<Real>::max();
+  int closest = -1;
+
+  if (!hierarchyIsUpToDate()) {
+    // The build is running: test all the primitives
+    for (int id = 0; id < primitives_.size(); ++id) {
+      Real t;
+      if (primitives_[id].used && intersect(primitives_[id], o, d, t) &&
+          (t < tMax)) {
+        tMax = t;
+        closest = id;
+      }
+    }
+  } else if (!hierarchy_.nodes.isEmpty()) {
+    const QVector<Node> &nodes = hierarchy_.nodes;
+    QVarLengthArray<int, 64> stack;
+    Real t;
+    if (intersectBox(nodes[0].min, nodes[0].max, o, invDir, tMax, t))
+      stack.append(0);
+
+    while (!stack.isEmpty()) {
+      const int index = stack.last();
+      stack.removeLast();
+      const Node &node = nodes[index];
+      if (node.right < 0) {
+        for (int p = node.first; p < node.first + node.count; ++p) {
+          const int id = hierarchy_.order[p];
+          if (intersect(primitives_[id], o, d, t) && (t < tMax)) {
+            tMax = t;
+            closest = id;
+          }
+        }
+        continue;
+      }
+
+      // Visit the closest child first: it is pushed last
+      Real tLeft, tRight;
+      const bool left = intersectBox(nodes[index + 1].min, nodes[index + 1].max,
+                                     o, invDir, tMax, tLeft);
+      const bool right = intersectBox(nodes[node.right].min,
+                                      nodes[node.right].max, o, invDir, tMax,
+                                      tRight);
+      if (left && right) {
+        if (tLeft < tRight) {
+          stack.append(node.right);
+          stack.append(index + 1);
+        } else {
+          stack.append(index + 1);
+          stack.append(node.right);
+        }
+      } else if (left)
+        stack.append(index + 1);
+      else if (right)
+        stack.append(node.right);
+    }
+  }
+
+  if (closest < 0)
+    return false;
+
+  hit.name = primitives_[closest].name;
+  hit.primitive = closest;
+  hit.distance = tMax;
+  hit.point = orig + qreal(tMax) * dir;
+  return true;
+}
+
+/*! Same as pick(), with the ray of \p pixel, as given by
+Camera::convertClickToLine(). */
+bool RayPicker::pick(const Camera *camera, const QPoint &pixel, Hit &hit) {
+  Vec orig, dir;
+  camera->convertClickToLine(pixel, orig, dir);
+  return pick(orig, dir, hit);
+}
+
+// Ray / primitive intersection. t is the ray parameter of the closest
+// intersection, which must be positive.
+bool RayPicker::intersect(const Primitive &primitive, const Real orig[3],
+                          const Real dir[3], Real &t) const {
+  if (primitive.type == BOX) {
+    Real o[3], d[3];
+    if (primitive.frame >= 0) {
+      // Test in the Frame coordinate system, where the box is axis aligned.
+      // Frames are rigid: the ray parameter is unchanged.
+      const Frame *frame = frames_[primitive.frame].frame;
+      const Vec lo = frame->coordinatesOf(Vec(orig[0], orig[1], orig[2]));
+      const Vec ld = frame->transformOf(Vec(dir[0], dir[1], dir[2]));
+      for (int i = 0; i < 3; ++i) {
+        o[i] = lo[i];
+        d[i] = ld[i];
+      }
+    } else
+      for (int i = 0; i < 3; ++i) {
+        o[i] = orig[i];
+        d[i] = dir[i];
+      }
+
+    Real invDir[3];
+    for (int i = 0; i < 3; ++i)
+      invDir[i] = (d[i] != 0.0) ? Real(1.0) / d[i]
+                                : std::numeric_limits<Real>::infinity();
+    return intersectBox(primitive.local[0], primitive.local[1], o, invDir,
+                        std::numeric_limits<Real>::max(), t);
+  }
+
+  // Moller-Trumbore, on the world vertices
+  const Real *a = primitive.world[0];
+  Real e1[3], e2[3], s[3];
+  for (int i = 0; i < 3; ++i) {
+    e1[i] = primitive.world[1][i] - a[i];
+    e2[i] = primitive.world[2][i] - a[i];
+    s[i] = orig[i] - a[i];
+  }
+  const Real p[3] = {dir[1] * e2[2] - dir[2] * e2[1],
+                     dir[2] * e2[0] - dir[0] * e2[2],
+                     dir[0] * e2[1] - dir[1] * e2[0]};
+  const Real det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  if (std::fabs(det) < std::numeric_limits<Real>::min())
+    return false;
+  const Real invDet = Real(1.0) / det;
+
+  const Real u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+  if ((u < 0.0) || (u > 1.0))
+    return false;
+  const Real q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2],
+                     s[0] * e1[1] - s[1] * e1[0]};
+  const Real v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * invDet;
+  if ((v < 0.0) || (u + v > 1.0))
+    return false;
+
+  t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+  return t >= 0.0;
+}
+
+// Slab test. tMin is the entry parameter, clamped to 0 when orig is inside the
+// box. Returns false when the box is behind orig or farther than tMax.
+bool RayPicker::intersectBox(const Real min[3], const Real max[3],
+                             const Real orig[3], const Real invDir[3],
+                             Real tMax, Real &tMin) {
+  tMin = 0.0;
+  for (int i = 0; i < 3; ++i) {
+    Real t0 = (min[i] - orig[i]) * invDir[i];
+    Real t1 = (max[i] - orig[i]) * invDir[i];
+    // 0 * inf: the ray is parallel to and on a slab plane
+    if (t0 != t0)
+      t0 = -std::numeric_limits<Real>::max();
+    if (t1 != t1)
+      t1 = std::numeric_limits<Real>::max();
+    if (t0 > t1)
+      std::swap(t0, t1);
+    tMin = std::max(tMin, t0);
+    tMax = std::min(tMax, t1);
+    if (tMin > tMax)
+      return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Region picking                                //
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+// Side, in pixels, of the tiles of the region depth test
+const int depthTileSize = 8;
+// Primitives per task of the parallel projection
+const int pickChunkSize = 1024;
+} // namespace
+
+/*! Returns the sorted names of the primitives seen in \p rectangle, in screen
+coordinates (pixels, origin in the upper left corner, see
+Camera::projectedCoordinatesOf()). Nothing is drawn: the primitive bounds are
+projected with the \p camera matrices, in parallel on the TaskScheduler
+threads.
+
+A primitive is picked when the screen bounding rectangle of its projection
+intersects \p rectangle, or, when \p contained is \c true, when it is inside
+\p rectangle. Each name is returned once, whatever its number of picked
+primitives.
+
+The primitives hidden by others are picked too, unless a \p depthBuffer is
+provided: \c Camera::screenWidth() \c * \c Camera::screenHeight() depths,
+bottom row first, as read by \c glReadPixels() with \c GL_DEPTH_COMPONENT and
+\c GL_FLOAT after draw(). A primitive is then only picked when its closest
+point is in front of the farthest depth of the region pixels it covers,
+evaluated on 8x8 pixel tiles: the test is conservative, a hidden primitive
+close to a visible one may be picked. The depths are compared as they were
+written with the \p camera, including its Camera::reverseZIsEnabled().
+
+The bounds of the primitives attached to moved Frames are updated first, as
+with pick(). The hierarchy is not used. */
+QVector<int> RayPicker::pickRectangle(const Camera *camera,
+                                      const QRect &rectangle, bool contained,
+                                      const float *depthBuffer) {
+  return pickRegion(camera, rectangle.normalized(), nullptr, contained,
+                    depthBuffer);
+}
+
+/*! Same as pickRectangle(), with the region inside the \p lasso polygon
+(odd-even fill rule). The polygon is rasterized once, and the inside pixels
+of each projected rectangle are then counted in constant time. */
+QVector<int> RayPicker::pickLasso(const Camera *camera, const QPolygon &lasso,
+                                  bool contained, const float *depthBuffer) {
+  const QRect region = lasso.boundingRect().intersected(
+      QRect(0, 0, camera->screenWidth(), camera->screenHeight()));
+  if ((lasso.size() < 3) || region.isEmpty())
+    return QVector<int>();
+
+  QImage mask(region.size(), QImage::Format_ARGB32_Premultiplied);
+  mask.fill(Qt::transparent);
+  QPainter painter(&mask);
+  painter.translate(-region.topLeft());
+  painter.setPen(Qt::NoPen);
+  painter.setBrush(Qt::white);
+  painter.drawPolygon(lasso, Qt::OddEvenFill);
+  painter.end();
+  return pickRegion(camera, region, &mask, contained, depthBuffer);
+}
+
+// Picks the primitives whose projection intersects (or is inside when
+// contained) the pixels of region, or only its pixels set in mask when it is
+// not nullptr. mask has the size of region.
+QVector<int> RayPicker::pickRegion(const Camera *camera, const QRect &rectangle,
+                                   const QImage *mask, bool contained,
+                                   const float *depthBuffer) {
+  refit();
+  const int screenWidth = camera->screenWidth();
+  const int screenHeight = camera->screenHeight();
+  const QRect region =
+      rectangle.intersected(QRect(0, 0, screenWidth, screenHeight));
+  if (region.isEmpty())
+    return QVector<int>();
+  const int x0 = region.left(), y0 = region.top();
+  const int width = region.width(), height = region.height();
+
+  // Summed area table of the mask: the number of inside pixels of the
+  // [x0, x0 + x) x [y0, y0 + y) rectangle is at x + (width + 1) * y
+  QVector<int> inside;
+  const int tableWidth = width + 1;
+  if (mask) {
+    const QImage &m = *mask;
+    inside.fill(0, tableWidth * (height + 1));
+    for (int y = 0; y < height; ++y) {
+      const QRgb *line = reinterpret_cast<const QRgb *>(m.constScanLine(y));
+      int row = 0;
+      for (int x = 0; x < width; ++x) {
+        row += (qAlpha(line[x]) > 127) ? 1 : 0;
+        inside[x + 1 + tableWidth * (y + 1)] =
+            inside[x + 1 + tableWidth * y] + row;
+      }
+    }
+  }
+  // Inside pixels of the rectangle of corners (left, top) and (right, bottom),
+  // included, clipped to region
+  auto nbInside = [&](int left, int top, int right, int bottom) {
+    left = std::max(left, x0) - x0;
+    top = std::max(top, y0) - y0;
+    right = std::min(right, x0 + width - 1) - x0 + 1;
+    bottom = std::min(bottom, y0 + height - 1) - y0 + 1;
+    if ((left >= right) || (top >= bottom))
+      return 0;
+    if (!mask)
+      return (right - left) * (bottom - top);
+    return inside[right + tableWidth * bottom] -
+           inside[left + tableWidth * bottom] -
+           inside[right + tableWidth * top] + inside[left + tableWidth * top];
+  };
+
+  // Depths decrease with the distance when reverseZ, and are the NDC z when
+  // the clip control gives a [0,1] NDC depth range (see DepthCache)
+  const bool reverseZ = camera->reverseZIsEnabled();
+  const bool clipControl = camera->clipControlIsUsed_;
+
+  // Farthest depth of the region pixels of each tile, -1 (2 when reverseZ)
+  // without such pixel
+  const int nbTilesX = (width + depthTileSize - 1) / depthTileSize;
+  const int nbTilesY = (height + depthTileSize - 1) / depthTileSize;
+  QVector<float> tileDepths;
+  if (depthBuffer) {
+    tileDepths.fill(reverseZ ? 2.0f : -1.0f, nbTilesX * nbTilesY);
+    for (int y = 0; y < height; ++y) {
+      const float *depths =
+          depthBuffer + screenWidth * (screenHeight - 1 - (y0 + y)) + x0;
+      const QRgb *line =
+          mask ? reinterpret_cast<const QRgb *>(mask->constScanLine(y))
+               : nullptr;
+      float *tiles = tileDepths.data() + nbTilesX * (y / depthTileSize);
+      for (int x = 0; x < width; ++x)
+        if (!line || (qAlpha(line[x]) > 127)) {
+          float &tile = tiles[x / depthTileSize];
+          tile = reverseZ ? std::min(tile, depths[x])
+                          : std::max(tile, depths[x]);
+        }
+    }
+  }
+
+  GLdouble m[16];
+  camera->getModelViewProjectionMatrix(m);
+  GLint viewport[4];
+  camera->getViewport(viewport);
+  const qreal vx = viewport[0], vy = viewport[1];
+  const qreal vw = viewport[2], vh = viewport[3];
+
+  QVector<char> picked(primitives_.size(), 0);
+  const QVector<Primitive> &primitives = primitives_;
+  TaskScheduler::parallelFor(
+      primitives.size(),
+      [&](int first, int last) {
+        for (int id = first; id < last; ++id) {
+          const Primitive &primitive = primitives[id];
+          if (!primitive.used)
+            continue;
+
+          // Screen bounding rectangle and closest depth of the projection
+          qreal xMin = std::numeric_limits<qreal>::max(), xMax = -xMin;
+          qreal yMin = xMin, yMax = xMax, zNearest = reverseZ ? 0.0 : 1.0;
+          int nbInFront = 0;
+          const int nbPoints = (primitive.type == TRIANGLE) ? 3 : 8;
+          for (int p = 0; p < nbPoints; ++p) {
+            qreal x, y, z;
+            if (primitive.type == TRIANGLE) {
+              x = primitive.world[p][0];
+              y = primitive.world[p][1];
+              z = primitive.world[p][2];
+            } else {
+              x = (p & 1) ? primitive.max[0] : primitive.min[0];
+              y = (p & 2) ? primitive.max[1] : primitive.min[1];
+              z = (p & 4) ? primitive.max[2] : primitive.min[2];
+            }
+            const qreal w = m[3] * x + m[7] * y + m[11] * z + m[15];
+            if (w <= 0.0)
+              continue;
+            ++nbInFront;
+            const qreal invW = 1.0 / w;
+            const qreal px = (m[0] * x + m[4] * y + m[8] * z + m[12]) * invW;
+            const qreal py = (m[1] * x + m[5] * y + m[9] * z + m[13]) * invW;
+            const qreal pz = (m[2] * x + m[6] * y + m[10] * z + m[14]) * invW;
+            const qreal sx = vx + vw * (px * 0.5 + 0.5);
+            const qreal sy = vy + vh * (py * 0.5 + 0.5);
+            xMin = std::min(xMin, sx);
+            xMax = std::max(xMax, sx);
+            yMin = std::min(yMin, sy);
+            yMax = std::max(yMax, sy);
+            const qreal sz = clipControl ? pz : pz * 0.5 + 0.5;
+            zNearest = reverseZ ? std::max(zNearest, sz)
+                                : std::min(zNearest, sz);
+          }
+          if (nbInFront == 0)
+            continue;
+
+          int left, top, right, bottom;
+          if (nbInFront < nbPoints) {
+            // Crosses the camera plane: may cover the whole screen
+            if (contained)
+              continue;
+            left = top = 0;
+            right = screenWidth - 1;
+            bottom = screenHeight - 1;
+            zNearest = reverseZ ? 1.0 : 0.0;
+          } else {
+            left = int(std::floor(std::max(xMin, qreal(-1.0))));
+            top = int(std::floor(std::max(yMin, qreal(-1.0))));
+            right = int(std::floor(std::min(xMax, qreal(screenWidth))));
+            bottom = int(std::floor(std::min(yMax, qreal(screenHeight))));
+          }
+
+          const int nb = nbInside(left, top, right, bottom);
+          if ((nb == 0) ||
+              (contained && (nb != (right - left + 1) * (bottom - top + 1))))
+            continue;
+
+          if (depthBuffer) {
+            const int tx0 = (std::max(left, x0) - x0) / depthTileSize;
+            const int ty0 = (std::max(top, y0) - y0) / depthTileSize;
+            const int tx1 =
+                (std::min(right, x0 + width - 1) - x0) / depthTileSize;
+            const int ty1 =
+                (std::min(bottom, y0 + height - 1) - y0) / depthTileSize;
+            bool visible = false;
+            for (int ty = ty0; !visible && (ty <= ty1); ++ty)
+              for (int tx = tx0; !visible && (tx <= tx1); ++tx)
+                visible = reverseZ
+                              ? tileDepths[tx + nbTilesX * ty] <= zNearest
+                              : tileDepths[tx + nbTilesX * ty] >= zNearest;
+            if (!visible)
+              continue;
+          }
+          picked[id] = 1;
+        }
+      },
+      pickChunkSize);
+
+  QVector<int> names;
+  for (int id = 0; id < picked.size(); ++id)
+    if (picked[id])
+      names.append(primitives_[id].name);
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return names;
+}
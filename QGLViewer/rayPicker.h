@@ -0,0 +1,212 @@
+#ifndef QGLVIEWER_RAY_PICKER_H
+#define QGLVIEWER_RAY_PICKER_H
+
+#include "quaternion.h"
+#include "vec.h"
+
+#include <QMutex>
+#include <QPoint>
+#include <QVector>
+
+class QImage;
+class QPolygon;
+class QRect;
+class QThreadPool;
+
+namespace qglviewer {
+class Camera;
+class Frame;
+
+/*! \brief Analytical picking of triangles and boxes, using a bounding volume
+  hierarchy.
+  \class RayPicker rayPicker.h QGLViewer/rayPicker.h
+
+  Register the geometry of your scene with addTriangle() and addBox(), tagged
+  with the name of the object they belong to (the name that would be pushed by
+  QGLViewer::drawWithNames()). pick() then intersects a ray with this geometry
+  on the CPU, without any OpenGL call or redraw:
+  \code
+  // In your viewer's init()
+  for (int i = 0; i < nbObjects; ++i)
+    picker.addBox(object[i].min, object[i].max, i, object[i].frame);
+  setRayPicker(&picker);
+  setSelectionMode(QGLViewer::RAY_SELECTION);
+  \endcode
+
+  With QGLViewer::RAY_SELECTION, QGLViewer::select() casts the ray of the
+  clicked pixel (see Camera::convertClickToLine()) and sets
+  QGLViewer::selectedName() to the name of the closest hit primitive.
+
+  Primitives may be attached to a Frame, in which case their coordinates are
+  expressed in this Frame. The Frame must outlive the primitive. Moving a Frame
+  (or calling setTriangle() or setBox()) does not rebuild the hierarchy: the
+  bounding volumes of the moved primitives and of their ancestor nodes are
+  refitted by the next pick(). Only the Frame positions and orientations are
+  compared, so this costs nothing when nothing moved.
+
+  Adding or removing primitives requires a new hierarchy, built with the
+  surface area heuristic (SAH). The build runs on a background thread when
+  asynchronousBuildIsEnabled(): pick() then tests all the primitives, without
+  any hierarchy, until the build is completed.
+
+  pickRectangle() and pickLasso() return the names of all the primitives seen
+  in a screen region: the CPU counterpart of a rectangular selection with
+  QGLViewer::drawWithNames() (see the <a
+  href="../examples/multiSelect.html">multiSelect example</a>), whose cost
+  does not depend on the size of the region. */
+class QGLVIEWER_EXPORT RayPicker {
+public:
+  RayPicker();
+  ~RayPicker();
+
+  /*! @name Registered primitives */
+  //@{
+public:
+  int addTriangle(const Vec &a, const Vec &b, const Vec &c, int name,
+                  const Frame *frame = nullptr);
+  int addBox(const Vec &min, const Vec &max, int name,
+             const Frame *frame = nullptr);
+  void setTriangle(int id, const Vec &a, const Vec &b, const Vec &c);
+  void setBox(int id, const Vec &min, const Vec &max);
+  void removePrimitive(int id);
+  void clear();
+
+  /*! Returns the number of registered primitives. */
+  int nbPrimitives() const { return primitives_.size() - freeIds_.size(); }
+  //@}
+
+  /*! @name Picking */
+  //@{
+public:
+  /*! The result of a pick(). */
+  struct Hit {
+    /*! The name given to addTriangle() or addBox(). */
+    int name;
+    /*! The id of the hit primitive. */
+    int primitive;
+    /*! The ray parameter of the hit: \c point is \c orig + \c distance \c *
+    \c dir. */
+    qreal distance;
+    /*! The intersection point, in world coordinates. */
+    Vec point;
+  };
+
+  bool pick(const Vec &orig, const Vec &dir, Hit &hit);
+  bool pick(const Camera *camera, const QPoint &pixel, Hit &hit);
+  //@}
+
+  /*! @name Region picking */
+  //@{
+public:
+  QVector<int> pickRectangle(const Camera *camera, const QRect &rectangle,
+                             bool contained = false,
+                             const float *depthBuffer = nullptr);
+  QVector<int> pickLasso(const Camera *camera, const QPolygon &lasso,
+                         bool contained = false,
+                         const float *depthBuffer = nullptr);
+  //@}
+
+  /*! @name Hierarchy */
+  //@{
+public:
+  /*! Returns \c true when the hierarchy is built on a background thread.
+  Default value is \c true. When \c false, pick() builds it when needed. */
+  bool asynchronousBuildIsEnabled() const { return asynchronousBuild_; }
+  void setAsynchronousBuildIsEnabled(bool enabled);
+
+  /*! Returns the maximum number of primitives stored in a leaf of the
+  hierarchy. Default value is 4. */
+  int maximumLeafSize() const { return maximumLeafSize_; }
+  void setMaximumLeafSize(int size);
+
+  bool hierarchyIsUpToDate() const;
+  void waitForHierarchy();
+  //@}
+
+private:
+  Q_DISABLE_COPY(RayPicker)
+
+  enum Type { TRIANGLE, BOX };
+
+  struct Primitive {
+    Type type;
+    int name;
+    int frame; // index in frames_, -1 for world coordinates
+    bool used;
+    Real local[3][3]; // triangle vertices, or box min and max
+    Real world[3][3]; // world triangle vertices
+    Real min[3], max[3]; // world bounding box
+  };
+
+  struct FrameState {
+    const Frame *frame;
+    Vec position;
+    Quaternion orientation;
+    int nbPrimitives;
+  };
+
+  struct Node {
+    Real min[3], max[3];
+    // Range of the node primitives in order. The left child is the next node.
+    int first, count;
+    int right; // -1 for leaves
+  };
+
+  struct Hierarchy {
+    QVector<Node> nodes;
+    QVector<int> order;
+    unsigned int revision; // of the primitives it was built from
+  };
+
+  // Input of a build: the bounding boxes of the used primitives
+  struct Bounds {
+    int id;
+    Real min[3], max[3], center[3];
+  };
+
+  bool isValidId(int id, const char *method) const;
+  int addPrimitive(Type type, int name, const Frame *frame);
+  int frameIndex(const Frame *frame);
+  void updateWorldCoordinates(Primitive &primitive) const;
+  void setModified();
+
+  void collectBounds(QVector<Bounds> &bounds) const;
+  void updateHierarchy();
+  void startBuild();
+  static void buildHierarchy(QVector<Bounds> &bounds, int maximumLeafSize,
+                             Hierarchy &hierarchy);
+  static int buildNode(QVector<Bounds> &bounds, int first, int count,
+                       int maximumLeafSize, QVector<Node> &nodes);
+  void refit();
+
+  bool intersect(const Primitive &primitive, const Real orig[3],
+                 const Real dir[3], Real &t) const;
+  static bool intersectBox(const Real min[3], const Real max[3],
+                           const Real orig[3], const Real invDir[3], Real tMax,
+                           Real &tMin);
+  QVector<int> pickRegion(const Camera *camera, const QRect &rectangle,
+                          const QImage *mask, bool contained,
+                          const float *depthBuffer);
+
+  QVector<Primitive> primitives_;
+  QVector<int> freeIds_;
+  QVector<FrameState> frames_;
+  unsigned int revision_; // incremented when primitives are added or removed
+  bool boundsAreModified_;
+  int maximumLeafSize_;
+  bool asynchronousBuild_;
+
+  // Used by pick(), up to date when its revision is revision_
+  Hierarchy hierarchy_;
+
+  // B a c k g r o u n d   b u i l d
+  QThreadPool *buildThreadPool_;
+  QMutex buildMutex_;
+  bool buildIsRunning_;
+  Hierarchy builtHierarchy_; // result of the build, protected by buildMutex_
+  bool builtHierarchyIsReady_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_RAY_PICKER_H
@@ -0,0 +1,164 @@
+#include "renderTarget.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+using namespace qglviewer;
+
+/*! Creates a RenderTarget of \p size pixels. No OpenGL resource is created
+before the first bind(). */
+RenderTarget::RenderTarget(const QSize &size)
+    : size_(size), isBound_(false), context_(nullptr), functions_(nullptr),
+      framebuffer_(0), colorTexture_(0), depthTexture_(0),
+      previousFramebuffer_(0) {
+  for (int i = 0; i < 4; ++i)
+    previousViewport_[i] = 0;
+}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+bind() is current. Call cleanupGL() before otherwise. */
+RenderTarget::~RenderTarget() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Sets the size() of the textures, in pixels. They are reallocated by the
+next bind(), and their content is then lost. */
+void RenderTarget::setSize(const QSize &size) { size_ = size; }
+
+/*! Releases the framebuffer object and the textures. The context used by
+bind() must be current. */
+void RenderTarget::cleanupGL() {
+  if (isBound_)
+    release();
+
+  if (functions_) {
+    if (framebuffer_)
+      functions_->glDeleteFramebuffers(1, &framebuffer_);
+    if (colorTexture_)
+      functions_->glDeleteTextures(1, &colorTexture_);
+    if (depthTexture_)
+      functions_->glDeleteTextures(1, &depthTexture_);
+  }
+
+  framebuffer_ = colorTexture_ = depthTexture_ = 0;
+  allocatedSize_ = QSize();
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+// Creates the framebuffer object and (re)allocates its textures to size_
+bool RenderTarget::allocate() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("RenderTarget::bind: no current OpenGL context");
+    return false;
+  }
+  if (context_ && (context != context_)) {
+    qWarning("RenderTarget::bind: OpenGL context changed, textures are lost");
+    framebuffer_ = colorTexture_ = depthTexture_ = 0;
+    allocatedSize_ = QSize();
+  }
+  context_ = context;
+  functions_ = context->functions();
+
+  if (allocatedSize_ == size_)
+    return true;
+
+  if (!framebuffer_) {
+    functions_->glGenFramebuffers(1, &framebuffer_);
+    functions_->glGenTextures(1, &colorTexture_);
+    functions_->glGenTextures(1, &depthTexture_);
+  }
+
+  GLint previousTexture = 0;
+  functions_->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  // Nearest filtering, so that depths and pixels are read unchanged
+  functions_->glBindTexture(GL_TEXTURE_2D, colorTexture_);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size_.width(),
+                           size_.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                           nullptr);
+
+  functions_->glBindTexture(GL_TEXTURE_2D, depthTexture_);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24,
+                           size_.width(), size_.height(), 0,
+                           GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+
+  functions_->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  functions_->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                     GL_TEXTURE_2D, colorTexture_, 0);
+  functions_->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                     GL_TEXTURE_2D, depthTexture_, 0);
+  const GLenum status = functions_->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer_));
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    qWarning("RenderTarget::bind: incomplete framebuffer object (0x%x)",
+             status);
+    return false;
+  }
+  allocatedSize_ = size_;
+  return true;
+}
+
+/*! Redirects the rendering to the textures. An OpenGL context must be current.
+
+The textures are (re)allocated when needed, and the viewport is set to the
+whole size(). Their content is not cleared. Returns \c false, and leaves the
+current framebuffer unchanged, when size() is empty or when the framebuffer
+object cannot be created.
+
+Call release() to restore the previous framebuffer and viewport. */
+bool RenderTarget::bind() {
+  if (isBound_)
+    return true;
+  if (size_.isEmpty()) {
+    qWarning("RenderTarget::bind: empty size");
+    return false;
+  }
+
+  // Read first, as allocate() restores it
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer_);
+  if (!allocate())
+    return false;
+
+  glGetIntegerv(GL_VIEWPORT, previousViewport_);
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  functions_->glViewport(0, 0, size_.width(), size_.height());
+  isBound_ = true;
+  return true;
+}
+
+/*! Restores the framebuffer and viewport that were current before bind().
+The colorTexture() and depthTexture() can then be used. */
+void RenderTarget::release() {
+  if (!isBound_)
+    return;
+
+  functions_->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer_));
+  functions_->glViewport(previousViewport_[0], previousViewport_[1],
+                         previousViewport_[2], previousViewport_[3]);
+  isBound_ = false;
+}
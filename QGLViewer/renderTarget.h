@@ -0,0 +1,102 @@
+#ifndef QGLVIEWER_RENDER_TARGET_H
+#define QGLVIEWER_RENDER_TARGET_H
+
+#include <QSize>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLFunctions;
+
+namespace qglviewer {
+/*! \brief An offscreen framebuffer whose color and depth buffers are
+  textures.
+  \class RenderTarget renderTarget.h QGLViewer/renderTarget.h
+
+  A RenderTarget is a framebuffer object with a colorTexture() and a
+  depthTexture() attachment, of exactly size() pixels. What is drawn between
+  bind() and release() is directly stored in these textures, which can then
+  be used as any other texture: there is no copy of the window content and no
+  power of two padding, as with QGLViewer::copyBufferToTexture().
+  \code
+  target.setSize(QSize(512, 512));
+  if (target.bind()) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drawReflectedScene();
+    target.release();
+  }
+
+  glBindTexture(GL_TEXTURE_2D, target.colorTexture());
+  // Use (0,0) to (1,1) texture coordinates
+  \endcode
+
+  Use QGLViewer::drawToRenderTarget() to render the viewer's scene in its
+  QGLViewer::renderTarget().
+
+  The textures are created by the first bind(), and reallocated by the next
+  bind() when the size() was changed. The OpenGL methods must always be called
+  with the same context current. Call cleanupGL() with this context current
+  before the RenderTarget is destroyed. */
+class QGLVIEWER_EXPORT RenderTarget {
+public:
+  explicit RenderTarget(const QSize &size = QSize());
+  ~RenderTarget();
+
+  /*! @name Size */
+  //@{
+public:
+  /*! Returns the size of the textures, in pixels. Set using setSize(). */
+  QSize size() const { return size_; }
+  void setSize(const QSize &size);
+  //@}
+
+  /*! @name Rendering */
+  //@{
+public:
+  bool bind();
+  void release();
+  /*! Returns \c true between bind() and release(). */
+  bool isBound() const { return isBound_; }
+  void cleanupGL();
+  //@}
+
+  /*! @name Textures */
+  //@{
+public:
+  /*! Returns the \c GL_RGBA8 texture where the colors are drawn. Returns 0
+  before the first bind(). */
+  GLuint colorTexture() const { return colorTexture_; }
+  /*! Returns the \c GL_DEPTH_COMPONENT24 texture where the depths are drawn.
+  Returns 0 before the first bind(). */
+  GLuint depthTexture() const { return depthTexture_; }
+  /*! Returns the number of bytes of the allocated textures, 0 before the
+  first bind(). See QGLViewer::memoryUsage(). */
+  qint64 memoryUsage() const {
+    return 8 * qint64(allocatedSize_.width()) * allocatedSize_.height();
+  }
+  //@}
+
+private:
+  Q_DISABLE_COPY(RenderTarget)
+
+  bool allocate();
+
+  QSize size_;
+  QSize allocatedSize_; // empty until allocated
+  bool isBound_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLFunctions *functions_;
+  GLuint framebuffer_;
+  GLuint colorTexture_;
+  GLuint depthTexture_;
+
+  // State restored by release()
+  GLint previousFramebuffer_;
+  GLint previousViewport_[4];
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_RENDER_TARGET_H
@@ -0,0 +1,274 @@
+#include "renderThread.h"
+#include "renderThreadGroup.h"
+
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QThread>
+
+#include <utility>
+
+using namespace qglviewer;
+
+/*! Creates a RenderThread. Must be called in the GUI thread. The thread is
+started by start(). */
+RenderThread::RenderThread(QObject *parent)
+    : QObject(parent), thread_(nullptr), ownerThread_(nullptr), quit_(false),
+      requestIsPending_(false), rendering_(false), readyIsNew_(false),
+      group_(nullptr), readyIsReleased_(false), back_(0), ready_(1),
+      front_(2), surface_(nullptr), context_(nullptr) {
+  for (int i = 0; i < 3; ++i)
+    fbos_[i] = nullptr;
+}
+
+/*! Destructor. Removes the thread from its RenderThreadGroup.
+
+The destructor of a derived class must call stop() (see the class
+documentation). A thread still running here is stopped with a warning. */
+RenderThread::~RenderThread() {
+  if (isRunning()) {
+    qWarning("RenderThread::~RenderThread: the derived class destructor must "
+             "call stop()");
+    stop();
+  }
+  if (group_)
+    group_->removeRenderThread(this);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Thread                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates the OpenGL context of the render thread, sharing its objects with
+\p shareContext, and starts the thread. Must be called in the GUI thread.
+Returns \c false when the context could not be created.
+
+Called by QGLViewer::setRenderThread() with the viewer's context. The thread
+then waits for the first requestFrame(). */
+bool RenderThread::start(QOpenGLContext *shareContext) {
+  if (isRunning())
+    return true;
+  if (!shareContext) {
+    qWarning("RenderThread::start: no OpenGL context to share with");
+    return false;
+  }
+
+  // The surface must be created in the GUI thread
+  surface_ = new QOffscreenSurface();
+  surface_->setFormat(shareContext->format());
+  surface_->create();
+
+  context_ = new QOpenGLContext();
+  context_->setFormat(shareContext->format());
+  context_->setShareContext(shareContext);
+  if (!surface_->isValid() || !context_->create()) {
+    qWarning("RenderThread::start: Unable to create a shared OpenGL context");
+    delete context_;
+    delete surface_;
+    context_ = nullptr;
+    surface_ = nullptr;
+    return false;
+  }
+
+  quit_ = false;
+  requestIsPending_ = false;
+  readyIsNew_ = false;
+  ownerThread_ = QThread::currentThread();
+  thread_ = QThread::create([this]() { run(); });
+  context_->moveToThread(thread_);
+  thread_->start();
+  return true;
+}
+
+/*! Stops the thread, once its current frame is completed. cleanup() is called
+in the render thread and the OpenGL context is destroyed. Must be called in the
+GUI thread. */
+void RenderThread::stop() {
+  if (!isRunning())
+    return;
+
+  {
+    QMutexLocker locker(&mutex_);
+    quit_ = true;
+    condition_.wakeAll();
+  }
+  thread_->wait();
+  delete thread_;
+  thread_ = nullptr;
+
+  delete context_;
+  context_ = nullptr;
+  delete surface_;
+  surface_ = nullptr;
+}
+
+// The render thread loop: draws the last requested frame, until stop().
+void RenderThread::run() {
+  if (!context_->makeCurrent(surface_))
+    qWarning("RenderThread: Unable to make the context current");
+  else {
+    if (context_->format().profile() != QSurfaceFormat::CoreProfile) {
+      glEnable(GL_LIGHT0);
+      glEnable(GL_LIGHTING);
+      glEnable(GL_COLOR_MATERIAL);
+    }
+    glEnable(GL_DEPTH_TEST);
+    init();
+
+    Q_FOREVER {
+      Request request;
+      {
+        QMutexLocker locker(&mutex_);
+        while (!requestIsPending_ && !quit_)
+          condition_.wait(&mutex_);
+        if (quit_)
+          break;
+        request = request_;
+        requestIsPending_ = false;
+        rendering_ = true;
+      }
+
+      const bool rendered = renderFrame(request);
+      RenderThreadGroup *group;
+      {
+        QMutexLocker locker(&mutex_);
+        rendering_ = false;
+        group = group_;
+        // The group is notified of failures too: it no longer waits for us
+        if (group)
+          QMetaObject::invokeMethod(group, "frameCompleted",
+                                    Qt::QueuedConnection);
+      }
+      if (rendered && !group)
+        Q_EMIT frameReady();
+    }
+
+    cleanup();
+    for (int i = 0; i < 3; ++i) {
+      delete fbos_[i];
+      fbos_[i] = nullptr;
+    }
+    context_->doneCurrent();
+  }
+
+  // So that stop() can delete it
+  context_->moveToThread(ownerThread_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Frames                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Requests a frame of \p size pixels, seen from \p state and cleared with \p
+backgroundColor. Called by QGLViewer::paintGL(), in the GUI thread.
+
+Returns immediately. A request that was not started yet by the render thread
+is replaced: only the latest one is drawn. */
+void RenderThread::requestFrame(const CameraState &state, const QSize &size,
+                                const QColor &backgroundColor) {
+  QMutexLocker locker(&mutex_);
+  request_.state = state;
+  request_.size = size;
+  request_.backgroundColor = backgroundColor;
+  requestIsPending_ = true;
+  condition_.wakeAll();
+}
+
+/*! Returns the color texture of the last completed frame, and sets \p size to
+its size in pixels. Returns 0 before the first frame is completed. Must be
+called in the thread of the context given to start(), which can then use the
+texture until the next acquireFrame() call. */
+GLuint RenderThread::acquireFrame(QSize &size) {
+  QMutexLocker locker(&mutex_);
+  // In a group, the frame is displayed once released with the others
+  if (readyIsNew_ && (!group_ || readyIsReleased_)) {
+    std::swap(ready_, front_);
+    readyIsNew_ = false;
+  }
+
+  const QOpenGLFramebufferObject *fbo = fbos_[front_];
+  if (!fbo) {
+    size = QSize();
+    return 0;
+  }
+  size = fbo->size();
+  return fbo->texture();
+}
+
+// Draws request in the back buffer, which then becomes the ready one. Called
+// in the render thread.
+bool RenderThread::renderFrame(const Request &request) {
+  if (request.size.isEmpty())
+    return false;
+
+  // The back buffer is neither displayed nor ready: it can be reallocated
+  QOpenGLFramebufferObject *&fbo = fbos_[back_];
+  if (!fbo || (fbo->size() != request.size)) {
+    delete fbo;
+    fbo = new QOpenGLFramebufferObject(
+        request.size, QOpenGLFramebufferObject::CombinedDepthStencil);
+    if (!fbo->isValid()) {
+      qWarning("RenderThread: Unable to create a %dx%d framebuffer object",
+               request.size.width(), request.size.height());
+      delete fbo;
+      fbo = nullptr;
+      return false;
+    }
+  }
+
+  fbo->bind();
+  glViewport(0, 0, request.size.width(), request.size.height());
+  const QColor &color = request.backgroundColor;
+  glClearColor(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  if (context_->format().profile() != QSurfaceFormat::CoreProfile) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixd(request.state.projectionMatrix);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixd(request.state.modelViewMatrix);
+  }
+
+  draw(request.state);
+  fbo->release();
+
+  // The texture is read by the viewer's context: it must be complete
+  glFinish();
+
+  QMutexLocker locker(&mutex_);
+  std::swap(back_, ready_);
+  readyIsNew_ = true;
+  // A released frame that was not acquired yet is replaced
+  readyIsReleased_ = false;
+  return true;
+}
+
+void RenderThread::setGroup(RenderThreadGroup *group) {
+  QMutexLocker locker(&mutex_);
+  group_ = group;
+  // A frame held by the previous group is displayed
+  readyIsReleased_ = readyIsNew_;
+}
+
+// Returns true when a requested frame is not completed yet
+bool RenderThread::isBusy() {
+  QMutexLocker locker(&mutex_);
+  return isRunning() && (requestIsPending_ || rendering_);
+}
+
+bool RenderThread::hasUnreleasedFrame() {
+  QMutexLocker locker(&mutex_);
+  return readyIsNew_ && !readyIsReleased_;
+}
+
+// Lets acquireFrame() display the completed frame, and emits frameReady()
+void RenderThread::releaseFrame() {
+  {
+    QMutexLocker locker(&mutex_);
+    if (!readyIsNew_ || readyIsReleased_)
+      return;
+    readyIsReleased_ = true;
+  }
+  Q_EMIT frameReady();
+}
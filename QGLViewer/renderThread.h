@@ -0,0 +1,159 @@
+#ifndef QGLVIEWER_RENDER_THREAD_H
+#define QGLVIEWER_RENDER_THREAD_H
+
+#include <QColor>
+#include <QMutex>
+#include <QObject>
+#include <QSize>
+#include <QWaitCondition>
+
+#include "cameraState.h"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class QThread;
+
+namespace qglviewer {
+class RenderThreadGroup;
+
+/*! \brief Draws a scene in a dedicated thread, from immutable camera
+  snapshots.
+  \class RenderThread renderThread.h QGLViewer/renderThread.h
+
+  QGLViewer::paintGL() runs in the GUI thread: an expensive draw() delays the
+  processing of the mouse and keyboard events, and the Camera interaction
+  becomes jerky. A RenderThread moves the scene drawing in its own thread,
+  with its own OpenGL context (shared with the viewer's one). Overload draw()
+  to draw your scene:
+  \code
+  class SceneRenderer : public qglviewer::RenderThread {
+  public:
+    // While draw() and cleanup() below still exist
+    ~SceneRenderer() { stop(); }
+
+  protected:
+    virtual void draw(const qglviewer::CameraState &state) {
+      // Only use data that is not modified by the GUI thread, or a copy of it
+      scene->draw();
+    }
+  };
+
+  viewer->setRenderThread(new SceneRenderer());
+  \endcode
+
+  Once attached with QGLViewer::setRenderThread(), each viewer paintGL()
+  composites the last completed frame and requests a new one with the current
+  Camera state (see requestFrame()). The render thread only draws the latest
+  request: the GUI thread never waits for it, whatever the cost of draw(). The
+  viewer's visual hints are drawn by the GUI thread, over the composited
+  frame.
+
+  draw() is called in the render thread and hence must not use the QGLViewer
+  or its Camera (which are QObjects of the GUI thread): use the given
+  CameraState instead. The scene data shared with the GUI thread must be
+  protected or copied by your application. The signals emitted in the render
+  thread are queued to the objects of the other threads.
+
+  Three framebuffer objects are used: one is drawn by the render thread, one
+  holds the last completed frame and one is displayed by the viewer.
+
+  Each viewer can have its own RenderThread: the viewers then draw their
+  scenes concurrently. Add their render threads to a RenderThreadGroup so
+  that their frames are displayed together.
+
+  \attention The destructor of a derived class must call stop(), as in the
+  example above: when the RenderThread destructor is reached, the derived
+  members used by draw() are already destroyed, the render thread may still
+  be inside draw(), and the derived cleanup() would never be called. */
+class QGLVIEWER_EXPORT RenderThread : public QObject {
+  Q_OBJECT
+
+public:
+  explicit RenderThread(QObject *parent = nullptr);
+  virtual ~RenderThread();
+
+  /*! @name Thread */
+  //@{
+public:
+  bool start(QOpenGLContext *shareContext);
+  void stop();
+  /*! Returns \c true between start() and stop(). */
+  bool isRunning() const { return thread_ != nullptr; }
+  //@}
+
+  /*! @name Frames */
+  //@{
+public:
+  void requestFrame(const CameraState &state, const QSize &size,
+                    const QColor &backgroundColor);
+  GLuint acquireFrame(QSize &size);
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted in the render thread when a frame is completed. It can
+  then be retrieved using acquireFrame(). QGLViewer::setRenderThread() connects
+  it to QGLViewer::update().
+
+  In a RenderThreadGroup, it is instead emitted in the GUI thread, when the
+  group releases the completed frames of all its threads. */
+  void frameReady();
+
+protected:
+  /*! Called once in the render thread, with its context current, before the
+  first draw(). Default implementation is empty. Lighting and depth test are
+  enabled as in QGLViewer::initializeGL() before. */
+  virtual void init() {}
+  /*! Draws the scene of the requested frame. Called in the render thread,
+  with the framebuffer cleared and the \p state matrices loaded (in a
+  compatibility profile). Default implementation is empty. */
+  virtual void draw(const CameraState &state) { Q_UNUSED(state); }
+  /*! Called in the render thread by stop(), with the context current, to
+  release the OpenGL resources created by init() and draw(). Default
+  implementation is empty. */
+  virtual void cleanup() {}
+
+private:
+  Q_DISABLE_COPY(RenderThread)
+  friend class RenderThreadGroup;
+
+  struct Request {
+    CameraState state;
+    QSize size; // in pixels
+    QColor backgroundColor;
+  };
+
+  void run();
+  bool renderFrame(const Request &request);
+  // Used by the RenderThreadGroup, in the GUI thread
+  void setGroup(RenderThreadGroup *group);
+  bool isBusy();
+  bool hasUnreleasedFrame();
+  void releaseFrame();
+
+  QThread *thread_;
+  QThread *ownerThread_; // where the context is moved back by run()
+
+  // Protected by mutex_
+  QMutex mutex_;
+  QWaitCondition condition_;
+  bool quit_;
+  bool requestIsPending_;
+  Request request_;
+  bool rendering_;
+  bool readyIsNew_; // the ready buffer was not acquired yet
+  RenderThreadGroup *group_;
+  bool readyIsReleased_; // by the group_, when there is one
+
+  // Buffer indices, exchanged under mutex_
+  int back_, ready_, front_;
+
+  // O p e n G L
+  QOffscreenSurface *surface_;
+  QOpenGLContext *context_;
+  QOpenGLFramebufferObject *fbos_[3]; // created and deleted by run()
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_RENDER_THREAD_H
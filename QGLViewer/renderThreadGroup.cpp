@@ -0,0 +1,79 @@
+#include "renderThreadGroup.h"
+#include "renderThread.h"
+
+using namespace qglviewer;
+
+/*! Creates an empty RenderThreadGroup. Must be called in the GUI thread. */
+RenderThreadGroup::RenderThreadGroup(QObject *parent)
+    : QObject(parent), maximumDelay_(50) {
+  delayTimer_.setSingleShot(true);
+  connect(&delayTimer_, SIGNAL(timeout()), SLOT(releaseFrames()));
+}
+
+/*! Destructor. The held frames are released, and the threads display their
+frames independently again. */
+RenderThreadGroup::~RenderThreadGroup() {
+  while (!threads_.isEmpty())
+    removeRenderThread(threads_.last());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Render threads                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p thread to the group. It is first removed from its previous group,
+if any. Must be called in the GUI thread, like all the methods of the
+group. */
+void RenderThreadGroup::addRenderThread(RenderThread *thread) {
+  if (!thread || threads_.contains(thread))
+    return;
+  if (thread->group_)
+    thread->group_->removeRenderThread(thread);
+  thread->setGroup(this);
+  threads_.append(thread);
+}
+
+/*! Removes \p thread from the group. Its held frame, if any, is released. A
+deleted RenderThread is automatically removed. */
+void RenderThreadGroup::removeRenderThread(RenderThread *thread) {
+  if (!threads_.removeOne(thread))
+    return;
+  // Before setGroup(), which would mark the held frame as released without
+  // emitting RenderThread::frameReady()
+  thread->releaseFrame();
+  thread->setGroup(nullptr);
+  // The others may have been waiting for this one
+  frameCompleted();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Synchronization                               //
+////////////////////////////////////////////////////////////////////////////////
+
+// Called in the GUI thread each time a thread of the group completes (or
+// fails) a frame.
+void RenderThreadGroup::frameCompleted() {
+  bool busy = false, held = false;
+  for (int i = 0; i < threads_.size(); ++i) {
+    busy = busy || threads_[i]->isBusy();
+    held = held || threads_[i]->hasUnreleasedFrame();
+  }
+
+  if (!held)
+    delayTimer_.stop();
+  else if (!busy)
+    releaseFrames();
+  else if (!delayTimer_.isActive())
+    delayTimer_.start(maximumDelay_);
+}
+
+/*! Releases the completed frames of all the threads, which emit their
+RenderThread::frameReady() signal: their viewers are updated and display
+these frames. Called when no thread of the group has a frame in progress, or
+maximumDelay() after the first frame completion. */
+void RenderThreadGroup::releaseFrames() {
+  delayTimer_.stop();
+  for (int i = 0; i < threads_.size(); ++i)
+    threads_[i]->releaseFrame();
+  Q_EMIT framesReleased();
+}
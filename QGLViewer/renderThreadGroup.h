@@ -0,0 +1,87 @@
+#ifndef QGLVIEWER_RENDER_THREAD_GROUP_H
+#define QGLVIEWER_RENDER_THREAD_GROUP_H
+
+#include <QList>
+#include <QObject>
+#include <QTimer>
+
+#include "config.h"
+
+namespace qglviewer {
+class RenderThread;
+
+/*! \brief Displays the frames of several RenderThreads together.
+  \class RenderThreadGroup renderThreadGroup.h QGLViewer/renderThreadGroup.h
+
+  Without a RenderThread, the QGLViewer::paintGL() of the viewers of a
+  dashboard are called one after the other in the GUI thread: the frame time
+  grows with the number of viewers. Each viewer can instead draw its scene in
+  its own RenderThread, with its own OpenGL context: the viewers then draw in
+  parallel, on as many cores as there are viewers.
+
+  Each render thread however completes its frames at its own pace, and the
+  viewers would display frames that do not correspond to the same time. In a
+  RenderThreadGroup, the completed frames are held until all the threads of
+  the group have completed the frames they were asked for, and are then all
+  released at once: the viewers are updated in the same event loop iteration,
+  and present their new frames together.
+  \code
+  foreach (QGLViewer *viewer, QGLViewer::QGLViewerPool())
+    if (viewer) {
+      viewer->setRenderThread(new SceneRenderer(viewer));
+      group->addRenderThread(viewer->renderThread());
+    }
+  \endcode
+
+  So that a slow or continuously redrawn viewer does not freeze the others,
+  the completed frames are released anyway maximumDelay() milliseconds after
+  the first of them was completed. The group does not own its threads. */
+class QGLVIEWER_EXPORT RenderThreadGroup : public QObject {
+  Q_OBJECT
+
+public:
+  explicit RenderThreadGroup(QObject *parent = nullptr);
+  virtual ~RenderThreadGroup();
+
+  /*! @name Render threads */
+  //@{
+public:
+  void addRenderThread(RenderThread *thread);
+  void removeRenderThread(RenderThread *thread);
+  /*! Returns the render threads of the group, in the addRenderThread() order.
+   */
+  const QList<RenderThread *> &renderThreads() const { return threads_; }
+  //@}
+
+  /*! @name Synchronization */
+  //@{
+public:
+  /*! Returns the maximum time a completed frame is held, waiting for the
+  other threads, in milliseconds. Default value is 50. */
+  int maximumDelay() const { return maximumDelay_; }
+  /*! Sets the maximumDelay(), in milliseconds. */
+  void setMaximumDelay(int delay) { maximumDelay_ = qMax(delay, 0); }
+
+public Q_SLOTS:
+  void releaseFrames();
+
+Q_SIGNALS:
+  /*! Signal emitted by releaseFrames(), after the RenderThread::frameReady()
+  signals of the released threads. */
+  void framesReleased();
+  //@}
+
+private Q_SLOTS:
+  void frameCompleted();
+
+private:
+  Q_DISABLE_COPY(RenderThreadGroup)
+
+  QList<RenderThread *> threads_;
+  int maximumDelay_;
+  QTimer delayTimer_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_RENDER_THREAD_GROUP_H
@@ -5,13 +5,28 @@
 #include "ui_VRenderInterface.h"
 #endif
 
+#include "frameSink.h"
+#include "snapshotTileRenderer.h"
+#include "taskScheduler.h"
+#include "traceRecorder.h"
 #include "ui_ImageInterface.h"
 
 // Output format list
+#include <QDataStream>
+#include <QDir>
+#include <QHash>
 #include <QImageWriter>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+#include <QProcess>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThreadPool>
 
 #include <qapplication.h>
 #include <qcursor.h>
+#include <qfile.h>
 #include <qfiledialog.h>
 #include <qfileinfo.h>
 #include <qinputdialog.h>
@@ -20,6 +35,8 @@
 #include <qprogressdialog.h>
 #include <qscreen.h>
 
+#include <cstring>
+
 using namespace std;
 
 ////// Static global variables - local to this file //////
@@ -31,6 +48,8 @@ static QMap<QString, QString> Qtformat;
 static QMap<QString, QString> FDFormatString;
 // Converts snapshotFormat to file extension
 static QMap<QString, QString> extension;
+// First available format, default snapshotFormat()
+static QString defaultFormat;
 
 /*! Sets snapshotFileName(). */
 void QGLViewer::setSnapshotFileName(const QString &name) {
@@ -51,6 +70,7 @@ Then calls setSnapshotFormat() with the selected one (unless the user cancels).
 
 Returns \c false if the user presses the Cancel button and \c true otherwise. */
 bool QGLViewer::openSnapshotFormatDialog() {
+  initializeSnapshotFormats();
   bool ok = false;
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
   QStringList list = formats.split(";;", QString::SkipEmptyParts);
@@ -66,9 +86,24 @@ bool QGLViewer::openSnapshotFormatDialog() {
   return ok;
 }
 
+// Supported formats are listed on first use, since QImageWriter loads the
+// image plugins.
+const QString &QGLViewer::snapshotFormat() const {
+  if (snapshotFormat_.isEmpty())
+    initializeSnapshotFormats();
+  return snapshotFormat_;
+}
+
 // Finds all available Qt output formats, so that they can be available in
-// saveSnapshot dialog. Initialize snapshotFormat() to the first one.
-void QGLViewer::initializeSnapshotFormats() {
+// saveSnapshot dialog. The lists are shared by all the viewers and created
+// once. Initializes an empty snapshotFormat() to the first one.
+void QGLViewer::initializeSnapshotFormats() const {
+  if (!formats.isEmpty()) {
+    if (snapshotFormat_.isEmpty())
+      snapshotFormat_ = defaultFormat;
+    return;
+  }
+
   QList<QByteArray> list = QImageWriter::supportedImageFormats();
   QStringList formatList;
   for (int i = 0; i < list.size(); ++i)
@@ -80,11 +115,17 @@ void QGLViewer::initializeSnapshotFormats() {
 //  QString
 
 #ifndef NO_VECTORIAL_RENDER
-  // We add the 3 vectorial formats to the list
+  // We add the 4 vectorial formats to the list
   formatList += "EPS";
   formatList += "PS";
   formatList += "XFIG";
+  formatList += "PDF";
 #endif
+  // Written by a TiffStripWriter, which does not need the Qt TIFF plugin
+  if (!formatList.contains("TIFF"))
+    formatList += "TIFF";
+  // Piped to snapshotVideoEncoder(), available when it is installed
+  formatList += "VIDEO";
 
   // Check that the interesting formats are available and add them in "formats"
   // Unused formats: XPM XBM PBM PGM
@@ -110,6 +151,15 @@ void QGLViewer::initializeSnapshotFormats() {
   QtText += "XFIG";
   MenuText += "XFig (*.fig)";
   Ext += "fig";
+  QtText += "PDF";
+  MenuText += "Portable Document Format (*.pdf)";
+  Ext += "pdf";
+  QtText += "TIFF";
+  MenuText += "Tagged Image File Format (*.tif)";
+  Ext += "tif";
+  QtText += "VIDEO";
+  MenuText += "Video (*.mp4)";
+  Ext += "mp4";
 
   QStringList::iterator itText = QtText.begin();
   QStringList::iterator itMenu = MenuText.begin();
@@ -121,7 +171,7 @@ void QGLViewer::initializeSnapshotFormats() {
       // QMessageBox::information(this, "Snapshot ", "Recognized
       // format\n"+(*itText));
       if (formats.isEmpty())
-        setSnapshotFormat(*itText);
+        defaultFormat = *itText;
       else
         formats += ";;";
       formats += (*itMenu);
@@ -134,6 +184,9 @@ void QGLViewer::initializeSnapshotFormats() {
     itMenu++;
     itExt++;
   }
+
+  if (snapshotFormat_.isEmpty())
+    snapshotFormat_ = defaultFormat;
 }
 
 // Returns false if the user refused to use the fileName
@@ -180,25 +233,34 @@ void drawVectorial(void *param) { ((QGLViewer *)param)->drawVectorial(); }
 #ifndef DOXYGEN
 class ProgressDialog {
 public:
-  static void showProgressDialog(QOpenGLWidget *parent);
+  static void showProgressDialog(QOpenGLWidget *parent,
+                                 vrender::VRenderParams *vparams);
   static void updateProgress(float progress, const QString &stepString);
   static void hideProgressDialog();
 
 private:
   static QProgressDialog *progressDialog;
+  static vrender::VRenderParams *params;
 };
 
 QProgressDialog *ProgressDialog::progressDialog = nullptr;
+vrender::VRenderParams *ProgressDialog::params = nullptr;
 
-void ProgressDialog::showProgressDialog(QOpenGLWidget *parent) {
+void ProgressDialog::showProgressDialog(QOpenGLWidget *parent,
+                                        vrender::VRenderParams *vparams) {
+  params = vparams;
   progressDialog = new QProgressDialog(parent);
   progressDialog->setWindowTitle("Image rendering progress");
   progressDialog->setMinimumSize(300, 40);
-  progressDialog->setCancelButton(nullptr);
+  progressDialog->setWindowModality(Qt::WindowModal);
   progressDialog->show();
 }
 
+// Called in the GUI thread, even if the export itself runs in background.
 void ProgressDialog::updateProgress(float progress, const QString &stepString) {
+  if (progressDialog->wasCanceled())
+    params->cancel();
+
   progressDialog->setValue(int(progress * 100));
   QString message(stepString);
   if (message.length() > 33)
@@ -212,6 +274,7 @@ void ProgressDialog::hideProgressDialog() {
   progressDialog->close();
   delete progressDialog;
   progressDialog = nullptr;
+  params = nullptr;
 }
 
 class VRenderInterface : public QDialog, public Ui::VRenderInterface {
@@ -252,6 +315,8 @@ static int saveVectorialSnapshot(const QString &fileName, QOpenGLWidget *widget,
     vparams.setFormat(vrender::VRenderParams::PS);
   if (snapshotFormat == "XFIG")
     vparams.setFormat(vrender::VRenderParams::XFIG);
+  if (snapshotFormat == "PDF")
+    vparams.setFormat(vrender::VRenderParams::PDF);
 
   vparams.setOption(vrender::VRenderParams::CullHiddenFaces,
                     !(VRinterface->includeHidden->isChecked()));
@@ -277,15 +342,40 @@ static int saveVectorialSnapshot(const QString &fileName, QOpenGLWidget *widget,
   case 3:
     vparams.setSortMethod(vrender::VRenderParams::AdvancedTopologicalSort);
     break;
+  case 4:
+    vparams.setSortMethod(vrender::VRenderParams::DepthBucketSort);
+    break;
   default:
     qWarning("VRenderInterface::saveVectorialSnapshot: Unknown SortMethod");
   }
 
+  // Sorting and export run in background, so that the progress dialog stays
+  // responsive and can cancel the export.
+  vparams.setOption(vrender::VRenderParams::ProcessInBackground, true);
+
   vparams.setProgressFunction(&ProgressDialog::updateProgress);
-  ProgressDialog::showProgressDialog(widget);
+  ProgressDialog::showProgressDialog(widget, &vparams);
   widget->makeCurrent();
   widget->raise();
-  vrender::VectorialRender(drawVectorial, (void *)widget, vparams);
+  try {
+    vrender::VectorialRender(drawVectorial, (void *)widget, vparams);
+  } catch (vrender::VRenderCanceled &) {
+    ProgressDialog::hideProgressDialog();
+    widget->setCursor(QCursor(Qt::ArrowCursor));
+    // Remove the incomplete file
+    QFile::remove(fileName);
+    return -1;
+  } catch (std::exception &e) {
+    // Thrown by the background export, but reported here in the GUI thread
+    ProgressDialog::hideProgressDialog();
+    widget->setCursor(QCursor(Qt::ArrowCursor));
+    QFile::remove(fileName);
+    QMessageBox::warning(widget,
+                         QGLViewer::tr("Exporter error",
+                                       "Message box window title"),
+                         QString::fromUtf8(e.what()));
+    return -1;
+  }
   ProgressDialog::hideProgressDialog();
   widget->setCursor(QCursor(Qt::ArrowCursor));
 
@@ -294,11 +384,216 @@ static int saveVectorialSnapshot(const QString &fileName, QOpenGLWidget *widget,
 }
 #endif // NO_VECTORIAL_RENDER
 
+////////////////////////////////////////////////////////////////////////////////
+//       S t r e a m e d   T I F F   s n a p s h o t s                        //
+////////////////////////////////////////////////////////////////////////////////
+
+// Writes an uncompressed RGBA TIFF file, one strip of rows at a time, so that
+// images much larger than the available memory can be saved. The strips are
+// written in order and the image directory is appended by close(). The
+// BigTIFF variant (64 bit offsets) is used when the file exceeds 4 GB.
+class TiffStripWriter {
+public:
+  TiffStripWriter(const QString &fileName, const QSize &size)
+      : file_(fileName), size_(size), rowsPerStrip_(0) {
+    const quint64 dataSize = quint64(4) * size.width() * size.height();
+    // Leaves room for the directory and the strip arrays
+    bigTiff_ = dataSize + 16 * quint64(size.height()) + 1024 > 0xFFFFFFFFull;
+  }
+
+  bool open() {
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+      return false;
+    QDataStream out(&file_);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("II", 2);
+    if (bigTiff_)
+      out << quint16(43) << quint16(8) << quint16(0) << quint64(0);
+    else
+      out << quint16(42) << quint32(0);
+    return out.status() == QDataStream::Ok;
+  }
+
+  // Appends the nbRows first rows of strip, top to bottom. All strips but the
+  // last one must have the same number of rows.
+  bool writeStrip(const QImage &strip, int nbRows) {
+    const QImage rgba = (strip.format() == QImage::Format_RGBA8888)
+                            ? strip
+                            : strip.convertToFormat(QImage::Format_RGBA8888);
+    if (rowsPerStrip_ == 0)
+      rowsPerStrip_ = nbRows;
+    stripOffsets_.append(file_.pos());
+    stripByteCounts_.append(quint64(4) * size_.width() * nbRows);
+    for (int row = 0; row < nbRows; ++row)
+      if (file_.write(reinterpret_cast<const char *>(rgba.constScanLine(row)),
+                      4 * size_.width()) != 4 * size_.width())
+        return false;
+    return true;
+  }
+
+  // Writes the image directory and closes the file.
+  bool close() {
+    QDataStream out(&file_);
+    out.setByteOrder(QDataStream::LittleEndian);
+    if (file_.pos() % 2)
+      out << quint8(0); // Directories are word aligned
+
+    // Arrays that do not fit in their directory entry
+    const quint64 bitsPerSampleOffset = file_.pos();
+    if (!bigTiff_) // 4 shorts are inlined in BigTIFF entries
+      out << quint16(8) << quint16(8) << quint16(8) << quint16(8);
+    const quint64 stripOffsetsOffset = writeArray(out, stripOffsets_);
+    const quint64 stripByteCountsOffset = writeArray(out, stripByteCounts_);
+
+    const quint64 directoryOffset = file_.pos();
+    const quint16 shortType = 3, longType = 4;
+    const quint16 offsetType = bigTiff_ ? 16 : longType; // LONG8 in BigTIFF
+    const quint64 nbStrips = stripOffsets_.size();
+    const int nbEntries = 11;
+    if (bigTiff_)
+      out << quint64(nbEntries);
+    else
+      out << quint16(nbEntries);
+    // Tags are sorted in increasing order
+    writeEntry(out, 256, longType, 1, size_.width()); // ImageWidth
+    writeEntry(out, 257, longType, 1, size_.height()); // ImageLength
+    writeEntry(out, 258, shortType, 4, // BitsPerSample
+               bigTiff_ ? 0x0008000800080008ull : bitsPerSampleOffset);
+    writeEntry(out, 259, shortType, 1, 1); // Compression: none
+    writeEntry(out, 262, shortType, 1, 2); // PhotometricInterpretation: RGB
+    writeEntry(out, 273, offsetType, nbStrips,
+               (nbStrips == 1) ? stripOffsets_[0] : stripOffsetsOffset);
+    writeEntry(out, 277, shortType, 1, 4); // SamplesPerPixel
+    writeEntry(out, 278, longType, 1, rowsPerStrip_); // RowsPerStrip
+    writeEntry(out, 279, offsetType, nbStrips,
+               (nbStrips == 1) ? stripByteCounts_[0] : stripByteCountsOffset);
+    writeEntry(out, 284, shortType, 1, 1); // PlanarConfiguration: chunky
+    writeEntry(out, 338, shortType, 1, 2); // ExtraSamples: unassociated alpha
+    // No next directory
+    if (bigTiff_)
+      out << quint64(0);
+    else
+      out << quint32(0);
+
+    // Patches the first directory offset of the header
+    file_.seek(bigTiff_ ? 8 : 4);
+    if (bigTiff_)
+      out << directoryOffset;
+    else
+      out << quint32(directoryOffset);
+
+    const bool ok = (out.status() == QDataStream::Ok);
+    file_.close();
+    return ok && (file_.error() == QFileDevice::NoError);
+  }
+
+private:
+  // Returns the offset of the written values, which are only written when
+  // they do not fit in a directory entry.
+  quint64 writeArray(QDataStream &out, const QVector<quint64> &values) {
+    const quint64 offset = file_.pos();
+    if (values.size() > 1)
+      for (const quint64 value : values)
+        if (bigTiff_)
+          out << value;
+        else
+          out << quint32(value);
+    return offset;
+  }
+
+  // value is either the (left justified) value of a single element, or the
+  // offset of the values in the file.
+  void writeEntry(QDataStream &out, quint16 tag, quint16 type, quint64 count,
+                  quint64 value) {
+    out << tag << type;
+    if (bigTiff_)
+      out << count << value;
+    else
+      out << quint32(count) << quint32(value);
+  }
+
+  QFile file_;
+  QSize size_;
+  bool bigTiff_;
+  int rowsPerStrip_;
+  QVector<quint64> stripOffsets_, stripByteCounts_;
+};
+
+// Saves image in fileName. TIFF images are written by a TiffStripWriter, as by
+// saveImageSnapshot(), since the TIFF format is listed even without the Qt
+// plugin.
+static bool saveImage(const QImage &image, const QString &fileName,
+                      const QString &format, int quality) {
+  if (format != "TIFF")
+    return image.save(fileName, format.toLatin1().constData(), quality);
+
+  TiffStripWriter writer(fileName, image.size());
+  const bool saveOK = writer.open() &&
+                      writer.writeStrip(image, image.height()) &&
+                      writer.close();
+  if (!saveOK)
+    QFile::remove(fileName);
+  return saveOK;
+}
+
 class ImageInterface : public QDialog, public Ui::ImageInterface {
 public:
   ImageInterface(QWidget *parent) : QDialog(parent) { setupUi(this); }
 };
 
+// Restricts the projection of state to the glFrustum() or glOrtho() volume of
+// a tile, and updates its combined matrix and frustum planes.
+static void setTileProjection(qglviewer::CameraState &state, bool perspective,
+                              qreal left, qreal right, qreal bottom, qreal top,
+                              qreal zNear, qreal zFar) {
+  GLdouble *const p = state.projectionMatrix;
+  for (int i = 0; i < 16; ++i)
+    p[i] = 0.0;
+  if (perspective) {
+    p[0] = 2.0 * zNear / (right - left);
+    p[5] = 2.0 * zNear / (top - bottom);
+    p[8] = (right + left) / (right - left);
+    p[9] = (top + bottom) / (top - bottom);
+    p[10] = -(zFar + zNear) / (zFar - zNear);
+    p[11] = -1.0;
+    p[14] = -2.0 * zFar * zNear / (zFar - zNear);
+  } else {
+    p[0] = 2.0 / (right - left);
+    p[5] = 2.0 / (top - bottom);
+    p[10] = -2.0 / (zFar - zNear);
+    p[12] = -(right + left) / (right - left);
+    p[13] = -(top + bottom) / (top - bottom);
+    p[14] = -(zFar + zNear) / (zFar - zNear);
+    p[15] = 1.0;
+  }
+
+  const GLdouble *const mv = state.modelViewMatrix;
+  GLdouble *const mvp = state.modelViewProjectionMatrix;
+  for (int column = 0; column < 4; ++column)
+    for (int row = 0; row < 4; ++row) {
+      GLdouble sum = 0.0;
+      for (int k = 0; k < 4; ++k)
+        sum += p[4 * k + row] * mv[4 * column + k];
+      mvp[4 * column + row] = sum;
+    }
+
+  // Left, right, near, far, top and bottom planes, as in
+  // Camera::getFrustumPlanesCoefficients(): the inside of plane (row 3 + sign
+  // * row axis) of the matrix is where it is positive.
+  static const int axis[6] = {0, 0, 2, 2, 1, 1};
+  static const GLdouble sign[6] = {1.0, -1.0, 1.0, -1.0, -1.0, 1.0};
+  for (int i = 0; i < 6; ++i) {
+    GLdouble plane[4];
+    for (int j = 0; j < 4; ++j)
+      plane[j] = mvp[4 * j + 3] + sign[i] * mvp[4 * j + axis[i]];
+    const GLdouble norm =
+        sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    for (int j = 0; j < 3; ++j)
+      state.frustumPlanes[i][j] = -plane[j] / norm;
+    state.frustumPlanes[i][3] = plane[3] / norm;
+  }
+}
+
 // Pops-up an image settings dialog box and save to fileName.
 // Returns false in case of problem.
 bool QGLViewer::saveImageSnapshot(const QString &fileName) {
@@ -362,7 +657,58 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
       yMin = xMin / newAspectRatio;
   }
 
-  QImage image(finalSize.width(), finalSize.height(), QImage::Format_ARGB32);
+  makeCurrent();
+
+  // TIFF images are written one row of tiles at a time instead of being
+  // assembled in memory
+  const bool streamed = (snapshotFormat() == "TIFF");
+
+  // Offscreen tiles are as large as the hardware allows, and oversampling is
+  // replaced by multisampling. Pixels are then read back in RGBA byte order.
+  const bool offscreen = snapshotUsesFramebufferObject() &&
+                         QOpenGLFramebufferObject::hasOpenGLFramebufferObjects();
+  int samples = 0;
+  if (offscreen) {
+    GLint maxRenderbufferSize = 0;
+    GLint maxViewportDims[2] = {0, 0};
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+    subSize.setWidth(qMax(1, qMin(finalSize.width(),
+                                  qMin(int(maxRenderbufferSize),
+                                       int(maxViewportDims[0])))));
+    subSize.setHeight(qMax(1, qMin(finalSize.height(),
+                                   qMin(int(maxRenderbufferSize),
+                                        int(maxViewportDims[1])))));
+    // Rows of tiles are limited to about 64 MB when they are streamed
+    if (streamed)
+      subSize.setHeight(qMax(1, qMin(subSize.height(),
+                                     (1 << 24) / finalSize.width())));
+
+    if ((oversampling > 1.0) &&
+        QOpenGLFramebufferObject::hasOpenGLFramebufferBlit()) {
+      GLint maxSamples = 0;
+      glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+      samples = qMin(int(oversampling * oversampling), int(maxSamples));
+    }
+  }
+
+  // Tiles rendered in parallel: each context has at least one of them
+  qglviewer::SnapshotTileRenderer *const tileRenderer =
+      (offscreen && snapshotTileRenderer_ &&
+       (snapshotTileRenderer_->isRunning() ||
+        snapshotTileRenderer_->start(context())))
+          ? snapshotTileRenderer_
+          : nullptr;
+  if (tileRenderer) {
+    const int nbContexts = tileRenderer->nbContexts();
+    subSize.setWidth(qMin(subSize.width(),
+                          (finalSize.width() + nbContexts - 1) / nbContexts));
+  }
+
+  // The whole image, or a single row of tiles when streamed
+  QImage image(finalSize.width(),
+               streamed ? subSize.height() : finalSize.height(),
+               offscreen ? QImage::Format_RGBA8888 : QImage::Format_ARGB32);
 
   if (image.isNull()) {
     QMessageBox::warning(this, "Image saving error",
@@ -389,7 +735,21 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
   if (nbY * subSize.height() < finalSize.height())
     nbY++;
 
-  makeCurrent();
+  // Reused for all the tiles. tileFBO is multisampled and resolved in
+  // resolveFBO when samples is not null.
+  QOpenGLFramebufferObject *tileFBO = nullptr;
+  QOpenGLFramebufferObject *resolveFBO = nullptr;
+  QVector<uchar> tilePixels;
+  if (offscreen && !tileRenderer) {
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    format.setSamples(samples);
+    tileFBO = new QOpenGLFramebufferObject(subSize, format);
+    if (samples > 0)
+      resolveFBO = new QOpenGLFramebufferObject(subSize);
+    tilePixels.resize(4 * subSize.width() * subSize.height());
+    glPushAttrib(GL_VIEWPORT_BIT);
+  }
 
   // tileRegion_ is used by startScreenCoordinatesSystem to appropriately set
   // the local coordinate system when tiling
@@ -412,61 +772,155 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
     tileRegion_->textScale = 1.0 / scaleX;
   }
 
+  TiffStripWriter *writer = nullptr;
+  bool saveOK = true;
+  if (streamed) {
+    writer = new TiffStripWriter(fileName, finalSize);
+    saveOK = writer->open();
+  }
+
+  // Seen by the tiles of the tileRenderer
+  const qglviewer::CameraState state = camera()->currentState();
+
   int count = 0;
-  for (int i = 0; i < nbX; i++)
-    for (int j = 0; j < nbY; j++) {
-      preDraw();
-
-      // Change projection matrix
-      glMatrixMode(GL_PROJECTION);
-      glLoadIdentity();
-      if (camera()->type() == qglviewer::Camera::PERSPECTIVE)
-        glFrustum(-xMin + i * deltaX, -xMin + (i + 1) * deltaX,
+  for (int j = 0; (j < nbY) && saveOK; j++) {
+    // First row of the image of this row of tiles
+    const int imageRow = streamed ? 0 : j * subSize.height();
+    if (tileRenderer) {
+      const bool perspective =
+          camera()->type() == qglviewer::Camera::PERSPECTIVE;
+      QVector<qglviewer::SnapshotTileRenderer::Tile> tiles(nbX);
+      for (int i = 0; i < nbX; i++) {
+        // Border tiles are clipped, with their frustum
+        const int nbCols =
+            qMin(subSize.width(), image.width() - i * subSize.width());
+        const int nbRows =
+            qMin(subSize.height(), finalSize.height() - j * subSize.height());
+        const qreal fracX = nbCols / static_cast<qreal>(subSize.width());
+        const qreal fracY = nbRows / static_cast<qreal>(subSize.height());
+
+        qglviewer::SnapshotTileRenderer::Tile &tile = tiles[i];
+        tile.rect = QRect(i * subSize.width(), imageRow, nbCols, nbRows);
+        tile.state = state;
+        setTileProjection(tile.state, perspective, -xMin + i * deltaX,
+                          -xMin + (i + fracX) * deltaX,
+                          yMin - (j + fracY) * deltaY, yMin - j * deltaY,
+                          zNear, zFar);
+        tile.state.viewport[0] = tile.state.viewport[1] = 0;
+        tile.state.viewport[2] = tile.state.screenWidth = nbCols;
+        tile.state.viewport[3] = tile.state.screenHeight = nbRows;
+        tile.xMin = tileXMin + i * tileWidth;
+        tile.xMax = tileXMin + (i + fracX) * tileWidth;
+        tile.yMin = tileYMin + j * tileHeight;
+        tile.yMax = tileYMin + (j + fracY) * tileHeight;
+        tile.textScale = tileRegion_->textScale;
+      }
+      saveOK = tileRenderer->renderTiles(tiles, image, backgroundColor(),
+                                         samples);
+      count += nbX;
+    } else
+      for (int i = 0; i < nbX; i++) {
+        if (offscreen) {
+          tileFBO->bind();
+          glViewport(0, 0, subSize.width(), subSize.height());
+        }
+
+        preDraw();
+
+        // Change projection matrix
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        if (camera()->type() == qglviewer::Camera::PERSPECTIVE)
+          glFrustum(-xMin + i * deltaX, -xMin + (i + 1) * deltaX,
+                    yMin - (j + 1) * deltaY, yMin - j * deltaY, zNear, zFar);
+        else
+          glOrtho(-xMin + i * deltaX, -xMin + (i + 1) * deltaX,
                   yMin - (j + 1) * deltaY, yMin - j * deltaY, zNear, zFar);
-      else
-        glOrtho(-xMin + i * deltaX, -xMin + (i + 1) * deltaX,
-                yMin - (j + 1) * deltaY, yMin - j * deltaY, zNear, zFar);
-      glMatrixMode(GL_MODELVIEW);
-
-      tileRegion_->xMin = tileXMin + i * tileWidth;
-      tileRegion_->xMax = tileXMin + (i + 1) * tileWidth;
-      tileRegion_->yMin = tileYMin + j * tileHeight;
-      tileRegion_->yMax = tileYMin + (j + 1) * tileHeight;
-
-      draw();
-      postDraw();
-
-      // ProgressDialog::hideProgressDialog();
-      // qApp->processEvents();
-
-      QImage snapshot = QOpenGLWidget::grabFramebuffer();
-
-      // ProgressDialog::showProgressDialog(this);
-      // ProgressDialog::updateProgress(count / (qreal)(nbX*nbY),
-      // "Generating image
-      // ["+QString::number(count)+"/"+QString::number(nbX*nbY)+"]");
-      // qApp->processEvents();
-
-      QImage subImage = snapshot.scaled(subSize, Qt::IgnoreAspectRatio,
-                                        Qt::SmoothTransformation);
-
-      // Copy subImage in image
-      for (int ii = 0; ii < subSize.width(); ii++) {
-        int fi = i * subSize.width() + ii;
-        if (fi == image.width())
-          break;
-        for (int jj = 0; jj < subSize.height(); jj++) {
-          int fj = j * subSize.height() + jj;
-          if (fj == image.height())
+        glMatrixMode(GL_MODELVIEW);
+
+        tileRegion_->xMin = tileXMin + i * tileWidth;
+        tileRegion_->xMax = tileXMin + (i + 1) * tileWidth;
+        tileRegion_->yMin = tileYMin + j * tileHeight;
+        tileRegion_->yMax = tileYMin + (j + 1) * tileHeight;
+
+        draw();
+        postDraw();
+
+        if (offscreen) {
+          QOpenGLFramebufferObject *readFBO = tileFBO;
+          if (resolveFBO) {
+            QOpenGLFramebufferObject::blitFramebuffer(resolveFBO, tileFBO);
+            readFBO = resolveFBO;
+          }
+          readFBO->bind();
+          glPixelStorei(GL_PACK_ALIGNMENT, 1);
+          glReadPixels(0, 0, subSize.width(), subSize.height(), GL_RGBA,
+                       GL_UNSIGNED_BYTE, tilePixels.data());
+          readFBO->release();
+
+          // OpenGL rows are bottom-up. Border tiles may be clipped.
+          const int nbCols =
+              qMin(subSize.width(), image.width() - i * subSize.width());
+          const int nbRows =
+              qMin(subSize.height(), finalSize.height() - j * subSize.height());
+          for (int row = 0; row < nbRows; ++row)
+            memcpy(image.scanLine(imageRow + row) +
+                       4 * i * subSize.width(),
+                   tilePixels.constData() +
+                       4 * (subSize.height() - 1 - row) * subSize.width(),
+                   4 * nbCols);
+          count++;
+          continue;
+        }
+
+        // ProgressDialog::hideProgressDialog();
+        // qApp->processEvents();
+
+        QImage snapshot = QOpenGLWidget::grabFramebuffer();
+
+        // ProgressDialog::showProgressDialog(this);
+        // ProgressDialog::updateProgress(count / (qreal)(nbX*nbY),
+        // "Generating image
+        // ["+QString::number(count)+"/"+QString::number(nbX*nbY)+"]");
+        // qApp->processEvents();
+
+        QImage subImage = snapshot.scaled(subSize, Qt::IgnoreAspectRatio,
+                                          Qt::SmoothTransformation);
+
+        // Copy subImage in image
+        for (int ii = 0; ii < subSize.width(); ii++) {
+          int fi = i * subSize.width() + ii;
+          if (fi == image.width())
             break;
-          image.setPixel(fi, fj, subImage.pixel(ii, jj));
+          for (int jj = 0; jj < subSize.height(); jj++) {
+            if (j * subSize.height() + jj == finalSize.height())
+              break;
+            image.setPixel(fi, imageRow + jj, subImage.pixel(ii, jj));
+          }
         }
+        count++;
       }
-      count++;
-    }
 
-  bool saveOK = image.save(fileName, snapshotFormat().toLatin1().constData(),
-                           snapshotQuality());
+    if (streamed)
+      saveOK = writer->writeStrip(
+          image, qMin(subSize.height(),
+                      finalSize.height() - j * subSize.height()));
+  }
+
+  if (offscreen && !tileRenderer) {
+    glPopAttrib();
+    delete tileFBO;
+    delete resolveFBO;
+  }
+
+  if (streamed) {
+    saveOK = writer->close() && saveOK;
+    delete writer;
+    if (!saveOK)
+      QFile::remove(fileName);
+  } else
+    saveOK = image.save(fileName, snapshotFormat().toLatin1().constData(),
+                        snapshotQuality());
 
   // ProgressDialog::hideProgressDialog();
   // setCursor(QCursor(Qt::ArrowCursor));
@@ -531,6 +985,9 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
  \note In order to correctly grab the frame buffer, the QGLViewer window is
  raised in front of other windows by this method. */
 void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
+  QGLVIEWER_TRACE_SCOPE("snapshot", "saveSnapshot");
+  initializeSnapshotFormats();
+
   // Ask for file name
   if (snapshotFileName().isEmpty() || !automatic) {
     QString fileName;
@@ -548,6 +1005,14 @@ void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
       return;
   }
 
+  if (snapshotFormat() == "VIDEO") {
+    if (!saveVideoFrame(overwrite || !automatic))
+      QMessageBox::warning(this, "Snapshot problem",
+                           "Unable to start the video encoder for\n" +
+                               snapshotFileName());
+    return;
+  }
+
   QFileInfo fileInfo(snapshotFileName());
 
   if ((automatic) && (snapshotCounter() >= 0)) {
@@ -572,17 +1037,19 @@ void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
   bool saveOK;
 #ifndef NO_VECTORIAL_RENDER
   if ((snapshotFormat() == "EPS") || (snapshotFormat() == "PS") ||
-      (snapshotFormat() == "XFIG"))
+      (snapshotFormat() == "XFIG") || (snapshotFormat() == "PDF"))
     // Vectorial snapshot. -1 means cancel, 0 is ok, >0 (should be) an error
     saveOK = (saveVectorialSnapshot(fileInfo.filePath(), this,
                                     snapshotFormat()) <= 0);
   else
 #endif
-  if (automatic) {
+  if (automatic && snapshotIsAsynchronous()) {
+    queueFrameBufferSnapshot(fileInfo.filePath());
+    saveOK = true;
+  } else if (automatic) {
     QImage snapshot = frameBufferSnapshot();
-    saveOK = snapshot.save(fileInfo.filePath(),
-                           snapshotFormat().toLatin1().constData(),
-                           snapshotQuality());
+    saveOK = saveImage(snapshot, fileInfo.filePath(), snapshotFormat(),
+                       snapshotQuality());
   } else
     saveOK = saveImageSnapshot(fileInfo.filePath());
 
@@ -603,6 +1070,338 @@ QImage QGLViewer::frameBufferSnapshot() {
   return QOpenGLWidget::grabFramebuffer();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//       A s y n c h r o n o u s   s n a p s h o t s                          //
+////////////////////////////////////////////////////////////////////////////////
+
+// Encodes and writes an image in a worker thread. Releases a slot of the
+// snapshot queue when done.
+class SnapshotWriter : public QRunnable {
+public:
+  SnapshotWriter(const QImage &image, const QString &fileName,
+                 const QString &format, int quality, QSemaphore *slots)
+      : image_(image), fileName_(fileName), format_(format), quality_(quality),
+        slots_(slots) {}
+
+  void run() {
+    QGLVIEWER_TRACE_SCOPE("snapshot", "encode");
+    if (!saveImage(image_, fileName_, format_, quality_))
+      qWarning("QGLViewer::saveSnapshot: unable to save snapshot in %s",
+               fileName_.toLatin1().constData());
+    slots_->release();
+  }
+
+private:
+  QImage image_;
+  QString fileName_, format_;
+  int quality_;
+  QSemaphore *slots_;
+};
+
+/*! Returns the number of snapshots waiting to be encoded and written when
+snapshotIsAsynchronous(). This includes the (at most one) frame whose read back
+is still pending. Use this value to apply a back-pressure on your animation
+capture. */
+int QGLViewer::snapshotQueueSize() const {
+  int size = 0;
+  if (snapshotQueueSlots_)
+    size = maximumSnapshotQueueSize() - snapshotQueueSlots_->available();
+  for (int i = 0; i < 2; ++i)
+    if (!snapshotBufferFileName_[i].isEmpty())
+      ++size;
+  return size;
+}
+
+/*! Sets the snapshotTileRenderer(). It is started with the viewer's context
+when it is not running yet, or else by the next saveSnapshot(). */
+void QGLViewer::setSnapshotTileRenderer(
+    qglviewer::SnapshotTileRenderer *renderer) {
+  snapshotTileRenderer_ = renderer;
+  if (renderer && !renderer->isRunning() && context())
+    renderer->start(context());
+}
+
+/*! Sets the snapshotIsAsynchronous() value.
+
+Setting it to \c false calls flushSnapshotQueue() and releases the associated
+resources. An OpenGL context must be current when pending snapshots remain. */
+void QGLViewer::setSnapshotAsynchronous(bool asynchronous) {
+  if (asynchronous == snapshotIsAsynchronous_)
+    return;
+
+  if (!asynchronous) {
+    flushSnapshotQueue();
+    for (int i = 0; i < 2; ++i) {
+      delete snapshotBuffer_[i];
+      snapshotBuffer_[i] = nullptr;
+    }
+    delete snapshotThreadPool_;
+    snapshotThreadPool_ = nullptr;
+    delete snapshotQueueSlots_;
+    snapshotQueueSlots_ = nullptr;
+  } else {
+    snapshotThreadPool_ = new QThreadPool();
+    snapshotThreadPool_->setMaxThreadCount(
+        qglviewer::TaskScheduler::maxThreadCount());
+    snapshotQueueSlots_ = new QSemaphore(maximumSnapshotQueueSize());
+  }
+  snapshotIsAsynchronous_ = asynchronous;
+}
+
+/*! Sets the maximumSnapshotQueueSize(). Pending snapshots are first written
+using flushSnapshotQueue(). */
+void QGLViewer::setMaximumSnapshotQueueSize(int size) {
+  if (size < 1) {
+    qWarning("QGLViewer::setMaximumSnapshotQueueSize: size must be positive");
+    return;
+  }
+  flushSnapshotQueue();
+  maximumSnapshotQueueSize_ = size;
+  if (snapshotQueueSlots_) {
+    delete snapshotQueueSlots_;
+    snapshotQueueSlots_ = new QSemaphore(size);
+  }
+}
+
+/*! Retrieves the pending frame buffer read back (if any) and waits until all
+the snapshots queued by the asynchronous saveSnapshot() are written.
+
+Call this method at the end of an animation capture. An OpenGL context must be
+current when a read back is pending (see makeCurrent()). */
+void QGLViewer::flushSnapshotQueue() {
+  if (!snapshotIsAsynchronous())
+    return;
+
+  retrieveQueuedSnapshot(snapshotBufferIndex_);
+  retrieveQueuedSnapshot(1 - snapshotBufferIndex_);
+  snapshotThreadPool_->waitForDone();
+}
+
+// Reads the current frame buffer into one of the two pixel buffer objects, and
+// hands the image read in the other one (at the previous call) to the thread
+// pool.
+void QGLViewer::queueFrameBufferSnapshot(const QString &fileName,
+                                         bool videoFrame) {
+  makeCurrent();
+
+  const int index = snapshotBufferIndex_;
+  // Previous use of this buffer must be retrieved first
+  retrieveQueuedSnapshot(index);
+
+  const qreal dpr = camera()->devicePixelRatio();
+  const QSize size(int(dpr * width()), int(dpr * height()));
+
+  if (!snapshotBuffer_[index]) {
+    snapshotBuffer_[index] = new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+    snapshotBuffer_[index]->setUsagePattern(QOpenGLBuffer::StreamRead);
+    snapshotBuffer_[index]->create();
+  }
+
+  // A multisampled frame buffer cannot be read: it is resolved first
+  const bool resolved = format().samples() > 0;
+  if (resolved) {
+    if (!snapshotFBO_ || (snapshotFBO_->size() != size)) {
+      delete snapshotFBO_;
+      snapshotFBO_ = new QOpenGLFramebufferObject(size);
+    }
+    const QRect rect(QPoint(0, 0), size);
+    QOpenGLFramebufferObject::blitFramebuffer(snapshotFBO_, rect, nullptr,
+                                              rect);
+    snapshotFBO_->bind();
+  }
+
+  snapshotBuffer_[index]->bind();
+  if (snapshotBufferSize_[index] != size)
+    snapshotBuffer_[index]->allocate(4 * size.width() * size.height());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+               nullptr);
+  snapshotBuffer_[index]->release();
+  if (resolved)
+    QOpenGLFramebufferObject::bindDefault();
+
+  snapshotBufferSize_[index] = size;
+  snapshotBufferFileName_[index] = fileName;
+  snapshotBufferIsVideoFrame_[index] = videoFrame;
+  snapshotBufferIndex_ = 1 - index;
+
+  // Previous frame read back is now completed
+  retrieveQueuedSnapshot(snapshotBufferIndex_);
+}
+
+void QGLViewer::retrieveQueuedSnapshot(int index) {
+  if (snapshotBufferFileName_[index].isEmpty())
+    return;
+
+  const QSize size = snapshotBufferSize_[index];
+  const bool videoFrame = snapshotBufferIsVideoFrame_[index];
+  QImage image;
+  snapshotBuffer_[index]->bind();
+  const uchar *pixels = static_cast<const uchar *>(
+      snapshotBuffer_[index]->map(QOpenGLBuffer::ReadOnly));
+  if (pixels) {
+    if (videoFrame)
+      // Piped as is, the encoder flips the rows
+      writeVideoFrame(pixels, size);
+    else {
+      image = QImage(size, QImage::Format_RGBA8888);
+      // OpenGL rows are bottom-up
+      for (int row = 0; row < size.height(); ++row)
+        memcpy(image.scanLine(row),
+               pixels + 4 * (size.height() - 1 - row) * size.width(),
+               4 * size.width());
+    }
+    snapshotBuffer_[index]->unmap();
+  } else
+    qWarning("QGLViewer::saveSnapshot: unable to map pixel buffer object");
+  snapshotBuffer_[index]->release();
+
+  // Blocks when maximumSnapshotQueueSize() images are waiting
+  if (pixels && !videoFrame) {
+    snapshotQueueSlots_->acquire();
+    snapshotThreadPool_->start(
+        new SnapshotWriter(image, snapshotBufferFileName_[index],
+                           snapshotFormat(), snapshotQuality(),
+                           snapshotQueueSlots_));
+  }
+  snapshotBufferFileName_[index].clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                    V i d e o   s n a p s h o t s                           //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the snapshotVideoFrameRate(). Applies to the next video. */
+void QGLViewer::setSnapshotVideoFrameRate(int frameRate) {
+  if (frameRate < 1) {
+    qWarning("QGLViewer::setSnapshotVideoFrameRate: frame rate must be "
+             "positive");
+    return;
+  }
+  snapshotVideoFrameRate_ = frameRate;
+}
+
+// Appends the current frame to the video named after snapshotFileName(),
+// started by the first call. Returns false if the encoder cannot be started.
+bool QGLViewer::saveVideoFrame(bool overwrite) {
+  // A new file name starts a new video
+  if (videoEncoder_ && (videoFileName_ != snapshotFileName()))
+    closeSnapshotVideo();
+
+  const qreal dpr = camera()->devicePixelRatio();
+  const QSize size(int(dpr * width()), int(dpr * height()));
+
+  if (!videoEncoder_) {
+    QFileInfo fileInfo(snapshotFileName());
+    QString suffix = fileInfo.suffix();
+    if (suffix.isEmpty())
+      suffix = extension["VIDEO"];
+    fileInfo.setFile(fileInfo.absolutePath() + '/' + fileInfo.baseName() + '.' +
+                     suffix);
+    // Same numbering as the image snapshots, only to preserve existing files
+    if (!overwrite && (snapshotCounter() >= 0))
+      while (fileInfo.exists()) {
+        const QString count =
+            QString("%1").arg(snapshotCounter_++, 4, 10, QChar('0'));
+        fileInfo.setFile(fileInfo.absolutePath() + '/' + fileInfo.baseName() +
+                         '-' + count + '.' + suffix);
+      }
+
+    // Raw bottom-up RGBA frames on the standard input. Even dimensions are
+    // required by the 4:2:0 chroma subsampling.
+    QStringList arguments;
+    arguments << "-y"
+              << "-loglevel"
+              << "error"
+              << "-f"
+              << "rawvideo"
+              << "-pixel_format"
+              << "rgba"
+              << "-video_size"
+              << QString("%1x%2").arg(size.width()).arg(size.height())
+              << "-framerate" << QString::number(snapshotVideoFrameRate())
+              << "-i"
+              << "-"
+              << "-vf"
+              << "vflip,pad=ceil(iw/2)*2:ceil(ih/2)*2"
+              << "-c:v" << snapshotVideoCodec();
+    // Most players only support 4:2:0 H.264 and H.265 streams
+    if ((snapshotVideoCodec() == "libx264") ||
+        (snapshotVideoCodec() == "libx265"))
+      arguments << "-pix_fmt"
+                << "yuv420p";
+    arguments << fileInfo.filePath();
+
+    videoEncoder_ = new QProcess();
+    videoEncoder_->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    videoEncoder_->start(snapshotVideoEncoder(), arguments);
+    if (!videoEncoder_->waitForStarted()) {
+      qWarning("QGLViewer::saveSnapshot: unable to start %s",
+               snapshotVideoEncoder().toLatin1().constData());
+      delete videoEncoder_;
+      videoEncoder_ = nullptr;
+      return false;
+    }
+    videoFileName_ = snapshotFileName();
+    videoFrameSize_ = size;
+  }
+
+  if (size != videoFrameSize_) {
+    qWarning("QGLViewer::saveSnapshot: frame size changed during the video, "
+             "frame skipped");
+    return true;
+  }
+
+  queueFrameBufferSnapshot(videoFileName_, true);
+  return true;
+}
+
+// Pipes a frame read back by queueFrameBufferSnapshot() to the encoder. Blocks
+// when maximumSnapshotQueueSize() frames are waiting to be written.
+void QGLViewer::writeVideoFrame(const uchar *pixels, const QSize &size) {
+  QGLVIEWER_TRACE_SCOPE("snapshot", "writeVideoFrame");
+  if (!videoEncoder_ || (size != videoFrameSize_))
+    return;
+  if (videoEncoder_->state() != QProcess::Running) {
+    qWarning("QGLViewer::saveSnapshot: video encoder stopped, frame skipped");
+    return;
+  }
+
+  const qint64 frameBytes = 4 * qint64(size.width()) * size.height();
+  videoEncoder_->write(reinterpret_cast<const char *>(pixels), frameBytes);
+  while (videoEncoder_->bytesToWrite() >
+         maximumSnapshotQueueSize() * frameBytes)
+    if (!videoEncoder_->waitForBytesWritten(-1))
+      break;
+}
+
+/*! Completes the \c "VIDEO" snapshot being recorded (see
+snapshotVideoFrameRate()): the pending frame is read back, and the encoder
+finishes the file. Returns \c false when the encoder failed.
+
+The next saveSnapshot() starts a new video. This method is called when the
+viewer is deleted. An OpenGL context must be current when a read back is
+pending (see makeCurrent()). */
+bool QGLViewer::closeSnapshotVideo() {
+  if (!videoEncoder_)
+    return true;
+
+  retrieveQueuedSnapshot(snapshotBufferIndex_);
+  retrieveQueuedSnapshot(1 - snapshotBufferIndex_);
+
+  videoEncoder_->closeWriteChannel();
+  const bool ok = videoEncoder_->waitForFinished(-1) &&
+                  (videoEncoder_->exitStatus() == QProcess::NormalExit) &&
+                  (videoEncoder_->exitCode() == 0);
+  if (!ok)
+    qWarning("QGLViewer::closeSnapshotVideo: unable to encode %s",
+             videoFileName_.toLatin1().constData());
+  delete videoEncoder_;
+  videoEncoder_ = nullptr;
+  videoFileName_.clear();
+  return ok;
+}
+
 /*! Same as saveSnapshot(), except that it uses \p fileName instead of
  snapshotFileName().
 
@@ -635,3 +1434,359 @@ void QGLViewer::snapshotToClipboard() {
   QClipboard *cb = QApplication::clipboard();
   cb->setImage(frameBufferSnapshot());
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//       D e e p   z o o m   s n a p s h o t s                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Saves a multi-resolution tile pyramid of the scene, in the Deep Zoom (\c
+.dzi) format used by web viewers such as OpenSeadragon.
+
+\p size is the size of the full resolution image. \p fileName is the \c .dzi
+descriptor, and the tiles are written in the \c <name>_files directory next to
+it, in \c <level>/<column>_<row> files. Level \c n images are \c 2^n pixels
+large (along their largest dimension), the last level having \p size. Each
+tile is \p tileSize pixels large, plus \p overlap pixels shared with each of
+its neighbors.
+
+Each level is rendered at its own resolution in an offscreen framebuffer
+object, by blocks of tiles (using the sub-frustum tiling of saveSnapshot()), so
+that no intermediate image of the full resolution is needed and the lower
+levels are not downsampled. The tiles are encoded in snapshotFormat() (\c
+"PNG" or \c "JPEG" are recommended) by a pool of threads, while the next
+blocks are rendered.
+
+The camera() vertical field of view (or height, for an orthographic camera) is
+preserved, the horizontal one is adapted to the aspect ratio of \p size.
+
+Returns \c false if the descriptor or the directories could not be written, or
+if framebuffer objects are not supported. Tiles that cannot be written are
+reported by warnings. */
+bool QGLViewer::saveDeepZoomSnapshot(const QString &fileName, const QSize &size,
+                                     int tileSize, int overlap) {
+  if (size.isEmpty() || (tileSize < 1) || (overlap < 0)) {
+    qWarning("QGLViewer::saveDeepZoomSnapshot: invalid size, tile size or "
+             "overlap");
+    return false;
+  }
+
+  makeCurrent();
+  if (!QOpenGLFramebufferObject::hasOpenGLFramebufferObjects()) {
+    qWarning("QGLViewer::saveDeepZoomSnapshot: framebuffer objects are not "
+             "supported");
+    return false;
+  }
+
+  initializeSnapshotFormats();
+  const QString format = snapshotFormat();
+  if (!QImageWriter::supportedImageFormats().contains(
+          format.toLower().toLatin1())) {
+    qWarning("QGLViewer::saveDeepZoomSnapshot: %s is not an image format",
+             format.toLatin1().constData());
+    return false;
+  }
+  const QString suffix = extension.value(format, format.toLower());
+
+  QFileInfo info(fileName);
+  const QString tilesDirectory =
+      info.absolutePath() + '/' + info.completeBaseName() + "_files";
+
+  // Half sizes of the full frustum on the near plane
+  const qreal zNear = camera()->zNear();
+  const qreal zFar = camera()->zFar();
+  const qreal aspectRatio = size.width() / static_cast<qreal>(size.height());
+  qreal xMin, yMin;
+  if (camera()->type() == qglviewer::Camera::PERSPECTIVE)
+    yMin = zNear * tan(camera()->fieldOfView() / 2.0);
+  else {
+    GLdouble width, height;
+    camera()->getOrthoWidthHeight(width, height);
+    yMin = qreal(height);
+  }
+  xMin = aspectRatio * yMin;
+
+  // Blocks of tiles, as large as the hardware allows up to 4096 pixels
+  GLint maxRenderbufferSize = 0;
+  GLint maxViewportDims[2] = {0, 0};
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+  const int maxSize = qMin(4096, qMin(int(maxRenderbufferSize),
+                                      qMin(int(maxViewportDims[0]),
+                                           int(maxViewportDims[1])))) -
+                      2 * overlap;
+  const int nbBlockTiles = qMax(1, maxSize / tileSize);
+  const int blockSize = nbBlockTiles * tileSize;
+
+  QOpenGLFramebufferObjectFormat fboFormat;
+  fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  QOpenGLFramebufferObject fbo(
+      QSize(qMin(blockSize, size.width()) + 2 * overlap,
+            qMin(blockSize, size.height()) + 2 * overlap),
+      fboFormat);
+  glPushAttrib(GL_VIEWPORT_BIT);
+
+  // See saveImageSnapshot()
+  const qreal dpr = screen()->devicePixelRatio();
+  const qreal dipWidth = dpr * width();
+  const qreal dipHeight = dpr * height();
+  const qreal regionTotalWidth = aspectRatio * dipHeight;
+  const qreal regionXMin = (dipWidth - regionTotalWidth) / 2.0;
+  tileRegion_ = new TileRegion();
+
+  // Renders the region pixels of an image of levelSize
+  auto renderRegion = [&](const QRect &region, const QSize &levelSize) {
+    fbo.bind();
+    glViewport(0, 0, region.width(), region.height());
+    preDraw();
+
+    const qreal left = -xMin + 2.0 * xMin * region.left() / levelSize.width();
+    const qreal right =
+        -xMin + 2.0 * xMin * (region.right() + 1) / levelSize.width();
+    const qreal top = yMin - 2.0 * yMin * region.top() / levelSize.height();
+    const qreal bottom =
+        yMin - 2.0 * yMin * (region.bottom() + 1) / levelSize.height();
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    if (camera()->type() == qglviewer::Camera::PERSPECTIVE)
+      glFrustum(left, right, bottom, top, zNear, zFar);
+    else
+      glOrtho(left, right, bottom, top, zNear, zFar);
+    glMatrixMode(GL_MODELVIEW);
+
+    tileRegion_->xMin =
+        regionXMin + regionTotalWidth * region.left() / levelSize.width();
+    tileRegion_->xMax = regionXMin + regionTotalWidth *
+                                         (region.right() + 1) /
+                                         levelSize.width();
+    tileRegion_->yMin = dipHeight * region.top() / levelSize.height();
+    tileRegion_->yMax = dipHeight * (region.bottom() + 1) / levelSize.height();
+    tileRegion_->textScale = levelSize.height() / dipHeight;
+
+    draw();
+    postDraw();
+
+    QImage image(region.size(), QImage::Format_RGBA8888);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, region.width(), region.height(), GL_RGBA,
+                 GL_UNSIGNED_BYTE, image.bits());
+    fbo.release();
+    // OpenGL rows are bottom-up
+    return image.mirrored();
+  };
+
+  // At most two tiles per thread are waiting to be encoded
+  QThreadPool encoders;
+  encoders.setMaxThreadCount(qglviewer::TaskScheduler::maxThreadCount());
+  QSemaphore slots(2 * encoders.maxThreadCount());
+
+  int maxLevel = 0;
+  while ((1 << maxLevel) < qMax(size.width(), size.height()))
+    ++maxLevel;
+
+  bool saveOK = true;
+  for (int level = maxLevel; (level >= 0) && saveOK; --level) {
+    const int shift = maxLevel - level;
+    const QSize levelSize(qMax(1, (size.width() + (1 << shift) - 1) >> shift),
+                          qMax(1, (size.height() + (1 << shift) - 1) >> shift));
+    const QString levelDirectory =
+        tilesDirectory + '/' + QString::number(level);
+    if (!QDir().mkpath(levelDirectory)) {
+      qWarning("QGLViewer::saveDeepZoomSnapshot: unable to create %s",
+               levelDirectory.toLatin1().constData());
+      saveOK = false;
+      continue;
+    }
+
+    const QRect levelRect(QPoint(0, 0), levelSize);
+    const int nbTilesX = (levelSize.width() + tileSize - 1) / tileSize;
+    const int nbTilesY = (levelSize.height() + tileSize - 1) / tileSize;
+
+    for (int blockY = 0; blockY < nbTilesY; blockY += nbBlockTiles)
+      for (int blockX = 0; blockX < nbTilesX; blockX += nbBlockTiles) {
+        // The block tiles, with the overlap of the border ones
+        const QRect block =
+            QRect(blockX * tileSize - overlap, blockY * tileSize - overlap,
+                  blockSize + 2 * overlap, blockSize + 2 * overlap)
+                .intersected(levelRect);
+        const QImage blockImage = renderRegion(block, levelSize);
+
+        for (int y = blockY; y < qMin(blockY + nbBlockTiles, nbTilesY); ++y)
+          for (int x = blockX; x < qMin(blockX + nbBlockTiles, nbTilesX);
+               ++x) {
+            const QRect tile =
+                QRect(x * tileSize - overlap, y * tileSize - overlap,
+                      tileSize + 2 * overlap, tileSize + 2 * overlap)
+                    .intersected(levelRect);
+            slots.acquire();
+            encoders.start(new SnapshotWriter(
+                blockImage.copy(tile.translated(-block.topLeft())),
+                levelDirectory + '/' + QString::number(x) + '_' +
+                    QString::number(y) + '.' + suffix,
+                format, snapshotQuality(), &slots));
+          }
+      }
+  }
+
+  glPopAttrib();
+  delete tileRegion_;
+  tileRegion_ = nullptr;
+
+  encoders.waitForDone();
+
+  QFile file(fileName);
+  if (!saveOK || !file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  QTextStream out(&file);
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" "
+      << "Format=\"" << suffix << "\" Overlap=\"" << overlap
+      << "\" TileSize=\"" << tileSize << "\">\n"
+      << "  <Size Width=\"" << size.width() << "\" Height=\"" << size.height()
+      << "\"/>\n"
+      << "</Image>\n";
+  out.flush();
+  return file.error() == QFileDevice::NoError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                         F r a m e   s i n k                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the frameSink() that receives the frames drawn by the viewer. Use \c
+nullptr to stop the streaming. \p sink is not owned by the viewer: it must be
+removed before it is deleted.
+
+The frame read back that is pending is discarded, and the complete next frame
+is listed in the qglviewer::FrameSink::processFrame() dirty rectangles. */
+void QGLViewer::setFrameSink(qglviewer::FrameSink *sink) {
+  frameSink_ = sink;
+  frameSinkBufferSize_[0] = frameSinkBufferSize_[1] = QSize();
+  frameSinkTileHashes_.clear();
+}
+
+// Compares a hash of each tile of a frame with the one of the previous frame
+// and lists the tiles that changed. Consecutive tiles of a row are merged.
+// hashes are cleared when the frame or tile size changes.
+static void dirtyTiles(const uchar *pixels, const QSize &size, int tileSize,
+                       QVector<uint> &hashes, QVector<QRect> &rectangles) {
+  const int nbTilesX = (size.width() + tileSize - 1) / tileSize;
+  const int nbTilesY = (size.height() + tileSize - 1) / tileSize;
+  const bool complete = hashes.size() != nbTilesX * nbTilesY;
+  if (complete)
+    hashes.fill(0, nbTilesX * nbTilesY);
+
+  QVector<uint> band(nbTilesX);
+  for (int tileY = 0; tileY < nbTilesY; ++tileY) {
+    // Rows are bottom up: the hashes are accumulated row by row in the band
+    const int firstRow = tileY * tileSize;
+    const int lastRow = qMin(firstRow + tileSize, size.height());
+    band.fill(0);
+    for (int row = firstRow; row < lastRow; ++row) {
+      const uchar *const line = pixels + 4 * row * size.width();
+      for (int tileX = 0; tileX < nbTilesX; ++tileX) {
+        const int x = tileX * tileSize;
+        const int width = qMin(tileSize, size.width() - x);
+        band[tileX] = uint(qHashBits(line + 4 * x, 4 * width, band[tileX]));
+      }
+    }
+
+    const int top = size.height() - lastRow;
+    int runStart = -1;
+    for (int tileX = 0; tileX <= nbTilesX; ++tileX) {
+      bool changed = false;
+      if (tileX < nbTilesX) {
+        uint &hash = hashes[tileY * nbTilesX + tileX];
+        changed = complete || (hash != band[tileX]);
+        hash = band[tileX];
+      }
+
+      if (changed && (runStart < 0))
+        runStart = tileX;
+      else if (!changed && (runStart >= 0)) {
+        const int left = runStart * tileSize;
+        const int right = qMin(tileX * tileSize, size.width());
+        rectangles.append(QRect(left, top, right - left, lastRow - firstRow));
+        runStart = -1;
+      }
+    }
+  }
+}
+
+// Reads the frame that was just drawn in one of the two pixel buffer objects,
+// and gives the frame read in the other one (at the previous frame) to the
+// frameSink(). The read back is hence never waited for.
+void QGLViewer::streamFrame() {
+  const int index = frameSinkBufferIndex_;
+  if (!frameSinkBuffer_[index]) {
+    frameSinkBuffer_[index] = new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+    frameSinkBuffer_[index]->setUsagePattern(QOpenGLBuffer::StreamRead);
+    if (!frameSinkBuffer_[index]->create()) {
+      qWarning("QGLViewer::setFrameSink: pixel buffer objects are not "
+               "supported");
+      delete frameSinkBuffer_[index];
+      frameSinkBuffer_[index] = nullptr;
+      frameSink_ = nullptr;
+      return;
+    }
+  }
+
+  const qreal dpr = camera()->devicePixelRatio();
+  const QSize size(int(dpr * width()), int(dpr * height()));
+
+  // A multisampled frame buffer cannot be read: it is resolved first
+  const bool resolved = format().samples() > 0;
+  if (resolved) {
+    if (!frameSinkFBO_ || (frameSinkFBO_->size() != size)) {
+      delete frameSinkFBO_;
+      frameSinkFBO_ = new QOpenGLFramebufferObject(size);
+    }
+    const QRect rect(QPoint(0, 0), size);
+    QOpenGLFramebufferObject::blitFramebuffer(frameSinkFBO_, rect, nullptr,
+                                              rect);
+    frameSinkFBO_->bind();
+  }
+
+  frameSinkBuffer_[index]->bind();
+  if (frameSinkBuffer_[index]->size() != 4 * size.width() * size.height())
+    frameSinkBuffer_[index]->allocate(4 * size.width() * size.height());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+               nullptr);
+  frameSinkBuffer_[index]->release();
+  if (resolved)
+    QOpenGLFramebufferObject::bindDefault();
+  frameSinkBufferSize_[index] = size;
+
+  // The previous frame read back is completed by now
+  const int previous = 1 - index;
+  frameSinkBufferIndex_ = previous;
+  const QSize previousSize = frameSinkBufferSize_[previous];
+  if (previousSize.isEmpty())
+    return;
+
+  frameSinkBuffer_[previous]->bind();
+  const uchar *pixels = static_cast<const uchar *>(
+      frameSinkBuffer_[previous]->map(QOpenGLBuffer::ReadOnly));
+  if (pixels) {
+    QVector<QRect> dirtyRectangles;
+    const int tileSize = frameSink_->tileSize();
+    if ((previousSize != frameSinkHashedSize_) ||
+        (tileSize != frameSinkHashedTileSize_))
+      frameSinkTileHashes_.clear();
+    frameSinkHashedSize_ = previousSize;
+    frameSinkHashedTileSize_ = tileSize;
+
+    if (tileSize > 0)
+      dirtyTiles(pixels, previousSize, tileSize, frameSinkTileHashes_,
+                 dirtyRectangles);
+    else
+      dirtyRectangles.append(QRect(QPoint(0, 0), previousSize));
+
+    frameSink_->processFrame(pixels, previousSize, 4 * previousSize.width(),
+                             dirtyRectangles);
+    frameSinkBuffer_[previous]->unmap();
+  } else
+    qWarning("QGLViewer::setFrameSink: unable to map pixel buffer object");
+  frameSinkBuffer_[previous]->release();
+  frameSinkBufferSize_[previous] = QSize();
+}
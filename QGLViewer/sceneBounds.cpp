@@ -0,0 +1,303 @@
+#include "sceneBounds.h"
+#include "camera.h"
+#include "frame.h"
+
+#include <cfloat>
+
+using namespace qglviewer;
+
+/*! Creates a SceneBounds without objects. */
+SceneBounds::SceneBounds(QObject *parent)
+    : QObject(parent), capacity_(0), fedCamera_(nullptr),
+      boundsChanged_(false) {
+  resizeTree(64);
+}
+
+bool SceneBounds::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= objects_.size()) || !objects_[id].used) {
+    qWarning("SceneBounds::%s: Invalid object id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Registered objects                             //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an object whose bounding box is defined by \p min and \p max in
+the coordinate system of \p frame, and returns its id. Use a \c nullptr \p
+frame for a static box defined in the world coordinate system.
+
+The ids of the removed objects are reused. */
+int SceneBounds::addBox(const Frame *frame, const Vec &min, const Vec &max) {
+  Object object;
+  object.frame = nullptr;
+  object.used = true;
+  object.modified = false;
+
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = objects_.size();
+    objects_.append(object);
+    if (id >= capacity_)
+      resizeTree(2 * capacity_);
+  } else {
+    id = freeIds_.last();
+    freeIds_.removeLast();
+    objects_[id] = object;
+  }
+
+  setBox(id, frame, min, max);
+  return id;
+}
+
+/*! Replaces the box and the Frame of the object \p id, see addBox(). */
+void SceneBounds::setBox(int id, const Frame *frame, const Vec &min,
+                         const Vec &max) {
+  if (!isValidId(id, "setBox"))
+    return;
+  unwatch(id);
+  Object &object = objects_[id];
+  object.frame = frame;
+  object.min = min;
+  object.max = max;
+  watch(id);
+  setModified(id);
+}
+
+/*! Unregisters the object \p id. Its id may be returned by the next
+addBox(). Called when the Frame of the object is destroyed. */
+void SceneBounds::removeObject(int id) {
+  if (!isValidId(id, "removeObject"))
+    return;
+  unwatch(id);
+  objects_[id].used = false;
+  objects_[id].modified = false;
+  objects_[id].frame = nullptr;
+  freeIds_.append(id);
+
+  Box empty;
+  for (int i = 0; i < 3; ++i) {
+    empty.min[i] = FLT_MAX;
+    empty.max[i] = -FLT_MAX;
+  }
+  setLeaf(id, empty);
+}
+
+/*! Unregisters all the objects. */
+void SceneBounds::clear() {
+  for (QHash<const Frame *, QVector<int> >::const_iterator it =
+           watchers_.constBegin();
+       it != watchers_.constEnd(); ++it)
+    disconnect(it.key(), nullptr, this, nullptr);
+  watchers_.clear();
+  objects_.clear();
+  freeIds_.clear();
+  modified_.clear();
+  resizeTree(64);
+  boundsChanged_ = true;
+}
+
+/*! Marks the object \p id as modified: its world box is recomputed by the
+next update(). Called when one of the Frames of the object emits
+Frame::modified(). */
+void SceneBounds::setModified(int id) {
+  if (!isValidId(id, "setModified"))
+    return;
+  Object &object = objects_[id];
+  if (!object.modified) {
+    object.modified = true;
+    modified_.append(id);
+  }
+}
+
+// Connects the Frames that move the object id
+void SceneBounds::watch(int id) {
+  Object &object = objects_[id];
+  for (const Frame *f = object.frame; f; f = f->referenceFrame()) {
+    QVector<int> &ids = watchers_[f];
+    if (ids.isEmpty()) {
+      connect(f, SIGNAL(modified()), this, SLOT(frameModified()));
+      connect(f, SIGNAL(destroyed(QObject *)), this,
+              SLOT(frameDestroyed(QObject *)));
+    }
+    ids.append(id);
+    object.chain.append(f);
+  }
+}
+
+// Uses the recorded chain: the current one may have changed, and some of its
+// Frames may be destroyed (removed from watchers_ by frameDestroyed())
+void SceneBounds::unwatch(int id) {
+  Object &object = objects_[id];
+  for (int i = 0; i < object.chain.size(); ++i) {
+    const Frame *f = object.chain[i];
+    QHash<const Frame *, QVector<int> >::iterator it = watchers_.find(f);
+    if (it == watchers_.end())
+      continue;
+    it.value().removeOne(id);
+    if (it.value().isEmpty()) {
+      disconnect(f, nullptr, this, nullptr);
+      watchers_.erase(it);
+    }
+  }
+  object.chain.clear();
+}
+
+// Whether the referenceFrame() chain of the object id is the watched one
+bool SceneBounds::chainIsCurrent(int id) const {
+  const Object &object = objects_[id];
+  int i = 0;
+  for (const Frame *f = object.frame; f; f = f->referenceFrame(), ++i)
+    if ((i >= object.chain.size()) || (object.chain[i] != f))
+      return false;
+  return i == object.chain.size();
+}
+
+// Also emitted by a Frame::setReferenceFrame(), which may modify the chains
+void SceneBounds::frameModified() {
+  const Frame *frame = qobject_cast<const Frame *>(sender());
+  const QVector<int> ids = watchers_.value(frame);
+  for (int i = 0; i < ids.size(); ++i) {
+    if (!chainIsCurrent(ids[i])) {
+      unwatch(ids[i]);
+      watch(ids[i]);
+    }
+    setModified(ids[i]);
+  }
+}
+
+// The Frame is being destroyed: only its pointer is still valid. Its children
+// already have no referenceFrame().
+void SceneBounds::frameDestroyed(QObject *frame) {
+  const Frame *destroyed = static_cast<Frame *>(frame);
+  const QVector<int> ids = watchers_.take(destroyed);
+  for (int i = 0; i < ids.size(); ++i) {
+    const int id = ids[i];
+    if (!objects_[id].used)
+      continue;
+    if (objects_[id].frame == destroyed)
+      removeObject(id);
+    else {
+      unwatch(id);
+      watch(id);
+      setModified(id);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Scene bounding box                             //
+////////////////////////////////////////////////////////////////////////////////
+
+// Resets the tree with capacity leaves, all the objects being modified
+void SceneBounds::resizeTree(int capacity) {
+  capacity_ = capacity;
+  Box empty;
+  for (int i = 0; i < 3; ++i) {
+    empty.min[i] = FLT_MAX;
+    empty.max[i] = -FLT_MAX;
+  }
+  tree_.fill(empty, 2 * capacity_);
+  for (int id = 0; id < objects_.size(); ++id)
+    if (objects_[id].used)
+      setModified(id);
+}
+
+// Sets the leaf of object id and updates its ancestors, until one of them is
+// unchanged. O(log(capacity_)).
+void SceneBounds::setLeaf(int id, const Box &box) {
+  Box *const tree = tree_.data();
+  int node = capacity_ + id;
+  tree[node] = box;
+  for (node /= 2; node >= 1; node /= 2) {
+    const Box &left = tree[2 * node], &right = tree[2 * node + 1];
+    Box b;
+    for (int i = 0; i < 3; ++i) {
+      b.min[i] = qMin(left.min[i], right.min[i]);
+      b.max[i] = qMax(left.max[i], right.max[i]);
+    }
+    bool unchanged = true;
+    for (int i = 0; i < 3; ++i)
+      unchanged = unchanged && (b.min[i] == tree[node].min[i]) &&
+                  (b.max[i] == tree[node].max[i]);
+    if (unchanged)
+      return;
+    tree[node] = b;
+  }
+  boundsChanged_ = true;
+}
+
+// The world axis aligned box of the object local box
+SceneBounds::Box SceneBounds::worldBox(const Object &object) const {
+  Vec center = (object.min + object.max) / 2.0;
+  Vec extent = (object.max - object.min) / 2.0;
+  if (object.frame) {
+    const Quaternion q = object.frame->orientation();
+    const Vec axes[3] = {q.rotate(Vec(1.0, 0.0, 0.0)),
+                         q.rotate(Vec(0.0, 1.0, 0.0)),
+                         q.rotate(Vec(0.0, 0.0, 1.0))};
+    Vec e;
+    for (int i = 0; i < 3; ++i)
+      e[i] = fabs(axes[0][i]) * extent.x + fabs(axes[1][i]) * extent.y +
+             fabs(axes[2][i]) * extent.z;
+    center = object.frame->inverseCoordinatesOf(center);
+    extent = e;
+  }
+
+  Box box;
+  for (int i = 0; i < 3; ++i) {
+    box.min[i] = Real(center[i] - extent[i]);
+    box.max[i] = Real(center[i] + extent[i]);
+  }
+  return box;
+}
+
+/*! Recomputes the world boxes of the objects modified since the last call,
+and the global bounding box. Called by getBoundingBox() and updateCamera(). */
+void SceneBounds::update() {
+  for (int i = 0; i < modified_.size(); ++i) {
+    Object &object = objects_[modified_[i]];
+    // Removed since its modification
+    if (!object.modified)
+      continue;
+    object.modified = false;
+    if (object.used)
+      setLeaf(modified_[i], worldBox(object));
+  }
+  modified_.clear();
+}
+
+/*! Fills \p min and \p max with the world bounding box of the registered
+objects, after an update(). Returns \c false, and leaves them unchanged, when
+there is no object. */
+bool SceneBounds::getBoundingBox(Vec &min, Vec &max) {
+  update();
+  const Box &root = tree_[1];
+  if (root.min[0] > root.max[0])
+    return false;
+  min = Vec(root.min[0], root.min[1], root.min[2]);
+  max = Vec(root.max[0], root.max[1], root.max[2]);
+  return true;
+}
+
+/*! Calls Camera::setSceneBoundingBox() with the getBoundingBox(), when it
+changed since the last call or when \p camera is a different Camera. Called by
+QGLViewer::preDraw() with the QGLViewer::camera().
+
+The Camera::pivotPoint(), which Camera::setSceneCenter() moves, is kept: the
+scene can be turned around the same point while it moves. Nothing is done
+when there is no object. */
+void SceneBounds::updateCamera(Camera *camera) {
+  Vec min, max;
+  if (!getBoundingBox(min, max) || (!boundsChanged_ && camera == fedCamera_))
+    return;
+
+  const Vec pivot = camera->pivotPoint();
+  // A point box would have a null radius
+  camera->setSceneBoundingBox(min, max + Vec(1E-10, 1E-10, 1E-10));
+  camera->setPivotPoint(pivot);
+  fedCamera_ = camera;
+  boundsChanged_ = false;
+}
@@ -0,0 +1,121 @@
+#ifndef QGLVIEWER_SCENE_BOUNDS_H
+#define QGLVIEWER_SCENE_BOUNDS_H
+
+#include <QHash>
+#include <QObject>
+#include <QVector>
+
+#include "vec.h"
+
+namespace qglviewer {
+class Camera;
+class Frame;
+
+/*! \brief Keeps the bounding box of a dynamic scene up to date, and feeds it
+  to the Camera.
+  \class SceneBounds sceneBounds.h QGLViewer/sceneBounds.h
+
+  The Camera::sceneRadius() and Camera::sceneCenter() define the near and far
+  planes (see Camera::zNear()) and the result of Camera::showEntireScene().
+  They are usually set once with Camera::setSceneBoundingBox(). When objects
+  move, recomputing the bounding box of the whole scene at each frame is
+  expensive.
+
+  Register the bounding box of each object instead, in the coordinate system of
+  the Frame it moves with, using addBox(). The SceneBounds connects to the
+  Frame::modified() signal of the Frame and of its Frame::referenceFrame()
+  chain, and only updates the boxes of the modified objects:
+  \code
+  // In your viewer's init()
+  for (int i = 0; i < nbObjects; ++i)
+    bounds.addBox(&object[i].frame, object[i].min, object[i].max);
+  setSceneBounds(&bounds);
+  \endcode
+
+  Once attached with QGLViewer::setSceneBounds(), QGLViewer::preDraw() calls
+  updateCamera() before the Camera matrices are loaded. The boxes are the
+  leaves of a complete binary tree whose nodes contain the box of their
+  sub-tree: an object update only recomputes the nodes above its leaf, and the
+  global box is the root of the tree.
+
+  The world boxes are the axis aligned boxes of the rotated local boxes, and
+  may hence be larger than the objects. The Frame::referenceFrame() chains are
+  followed when a Frame::setReferenceFrame() modifies them, or when one of
+  their Frames is destroyed. An object is removed when its own Frame is
+  destroyed, and its id may then be reused by addBox(). */
+class QGLVIEWER_EXPORT SceneBounds : public QObject {
+  Q_OBJECT
+
+public:
+  explicit SceneBounds(QObject *parent = nullptr);
+
+  /*! @name Registered objects */
+  //@{
+public:
+  int addBox(const Frame *frame, const Vec &min, const Vec &max);
+  void setBox(int id, const Frame *frame, const Vec &min, const Vec &max);
+  void removeObject(int id);
+  void clear();
+  /*! Returns the number of registered objects. */
+  int nbObjects() const { return objects_.size() - freeIds_.size(); }
+
+public Q_SLOTS:
+  void setModified(int id);
+  //@}
+
+  /*! @name Scene bounding box */
+  //@{
+public:
+  void update();
+  bool getBoundingBox(Vec &min, Vec &max);
+  void updateCamera(Camera *camera);
+  //@}
+
+private Q_SLOTS:
+  void frameModified();
+  void frameDestroyed(QObject *frame);
+
+private:
+  Q_DISABLE_COPY(SceneBounds)
+
+  struct Box {
+    // Empty when min > max
+    Real min[3], max[3];
+  };
+  struct Object {
+    const Frame *frame;
+    // The watched Frames: frame and its referenceFrame() chain
+    QVector<const Frame *> chain;
+    Vec min, max;
+    bool used, modified;
+  };
+
+  bool isValidId(int id, const char *method) const;
+  void watch(int id);
+  void unwatch(int id);
+  bool chainIsCurrent(int id) const;
+  void resizeTree(int capacity);
+  void setLeaf(int id, const Box &box);
+  Box worldBox(const Object &object) const;
+
+  QVector<Object> objects_;
+  QVector<int> freeIds_;
+  QVector<int> modified_;
+
+  // The objects of the Frames of the referenceFrame() chains
+  QHash<const Frame *, QVector<int> > watchers_;
+
+  // Complete binary tree. Node 1 is the root, nodes 2i and 2i+1 are the
+  // children of node i, and the leaf of object id is node capacity_ + id.
+  QVector<Box> tree_;
+  int capacity_;
+
+  // The Camera of the last updateCamera(), and whether the root box changed
+  // since then
+  const Camera *fedCamera_;
+  bool boundsChanged_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_SCENE_BOUNDS_H
@@ -0,0 +1,139 @@
+#include "sceneResources.h"
+#include "camera.h"
+#include "qglviewer.h"
+
+#include <QOpenGLContext>
+#include <QSet>
+
+using namespace qglviewer;
+
+/*! Creates SceneResources that are not used by any viewer yet. */
+SceneResources::SceneResources(QObject *parent)
+    : QObject(parent), shareGroup_(nullptr), initialized_(false) {}
+
+/*! Virtual destructor. The viewers no longer use these resources, and
+cleanupGL() is called if needed. */
+SceneResources::~SceneResources() {
+  while (!viewers_.isEmpty())
+    removeViewer(viewers_.last());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Viewers                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Adds \p viewer to the viewers() that use these resources. Same as
+QGLViewer::setSceneResources().
+
+A QGLViewer uses at most one SceneResources: it is first removed from its
+previous one. initializeGL() is called if needed when \p viewer is already
+initialized. \c nullptr pointers are silently ignored. */
+void SceneResources::addViewer(QGLViewer *viewer) {
+  if (!viewer || (viewer->sceneResources_ == this))
+    return;
+
+  if (viewer->sceneResources_)
+    viewer->sceneResources_->removeViewer(viewer);
+
+  viewers_.append(viewer);
+  viewer->sceneResources_ = this;
+
+  if (viewer->isValid()) {
+    viewer->makeCurrent();
+    viewerInitialized(viewer);
+    viewer->doneCurrent();
+  }
+}
+
+/*! Removes \p viewer from the viewers(). When it was the last one,
+cleanupGL() is called with its context current. */
+void SceneResources::removeViewer(QGLViewer *viewer) {
+  if (!viewer || (viewer->sceneResources_ != this))
+    return;
+
+  viewers_.removeOne(viewer);
+  viewer->sceneResources_ = nullptr;
+  cameraTraversals_.remove(viewer->camera());
+
+  if (viewers_.isEmpty() && initialized_) {
+    if (viewer->isValid())
+      viewer->makeCurrent();
+    cleanupGL();
+    if (viewer->isValid())
+      viewer->doneCurrent();
+    initialized_ = false;
+    shareGroup_ = nullptr;
+    traversalKeys_.clear();
+    cameraTraversals_.clear();
+  }
+}
+
+// Called by QGLViewer::initializeGL() and addViewer(), with the viewer context
+// current.
+void SceneResources::viewerInitialized(QGLViewer *viewer) {
+  QOpenGLContextGroup *shareGroup = viewer->context()->shareGroup();
+  if (!initialized_) {
+    shareGroup_ = shareGroup;
+    initializeGL();
+    initialized_ = true;
+  } else if (shareGroup != shareGroup_)
+    qWarning("SceneResources::viewerInitialized: Viewer context is not shared "
+             "with the other viewers. Set Qt::AA_ShareOpenGLContexts");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Shared traversals                               //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the index of the traversal of \p camera, calling traverse() only
+when no other camera shares the same point of view.
+
+Cameras with identical modelView and projection matrices and screen
+dimensions (for instance the cameras of a stereo wall, or viewers that display
+the same camera) share the same index. The result of the previous traverse()
+of \p camera is also reused when its point of view did not change since, and
+invalidateTraversals() was not called. */
+int SceneResources::traversal(const Camera *camera) {
+  GLdouble matrices[32];
+  camera->getModelViewMatrix(matrices);
+  camera->getProjectionMatrix(matrices + 16);
+  const int size[2] = {camera->screenWidth(), camera->screenHeight()};
+  QByteArray key(reinterpret_cast<const char *>(matrices), sizeof(matrices));
+  key.append(reinterpret_cast<const char *>(size), sizeof(size));
+
+  for (int i = 0; i < traversalKeys_.size(); ++i)
+    if (traversalKeys_[i] == key) {
+      cameraTraversals_[camera] = i;
+      return i;
+    }
+
+  // Indexes used by the other cameras are preserved
+  QSet<int> used;
+  for (QHash<const Camera *, int>::const_iterator
+           it = cameraTraversals_.constBegin(),
+           end = cameraTraversals_.constEnd();
+       it != end; ++it)
+    if (it.key() != camera)
+      used.insert(it.value());
+
+  int index = cameraTraversals_.value(camera, -1);
+  if ((index < 0) || used.contains(index)) {
+    index = 0;
+    while (used.contains(index))
+      ++index;
+  }
+  if (index >= traversalKeys_.size())
+    traversalKeys_.resize(index + 1);
+
+  traversalKeys_[index] = key;
+  cameraTraversals_[camera] = index;
+  traverse(camera, index);
+  return index;
+}
+
+/*! Discards all the traversal() results, so that traverse() is called again
+for each Camera. Call this method when the scene is modified. */
+void SceneResources::invalidateTraversals() {
+  for (int i = 0; i < traversalKeys_.size(); ++i)
+    traversalKeys_[i].clear();
+}
@@ -0,0 +1,117 @@
+#ifndef QGLVIEWER_SCENE_RESOURCES_H
+#define QGLVIEWER_SCENE_RESOURCES_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+#include "config.h"
+
+class QGLViewer;
+class QOpenGLContextGroup;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Scene OpenGL resources shared by several QGLViewers.
+  \class SceneResources sceneResources.h QGLViewer/sceneResources.h
+
+  When several viewers display the same scene (see the <a
+  href="../examples/multiView.html">multiView example</a>), each of them
+  usually uploads its own copy of the scene geometry and traverses the whole
+  scene at each frame. A SceneResources is shared by these viewers instead (see
+  QGLViewer::setSceneResources()).
+
+  Overload initializeGL() to create the vertex buffers and textures of the
+  scene: it is called once, with the context of the first initialized viewer
+  current. cleanupGL() is called when the last viewer is removed. The viewers'
+  draw() methods then all use these resources:
+  \code
+  class Scene : public qglviewer::SceneResources {
+  protected:
+    virtual void initializeGL() { vbo_.create(); ... }
+    virtual void cleanupGL() { vbo_.destroy(); }
+  };
+
+  // For each viewer
+  viewer->setSceneResources(scene);
+  \endcode
+
+  The viewers' OpenGL contexts must share their resources. This is the case for
+  the QGLViewers of a same top level window. Otherwise, set the \c
+  Qt::AA_ShareOpenGLContexts application attribute before creating the \c
+  QApplication. A warning is displayed when a viewer does not share the context
+  of the first one.
+
+  Culling and scene traversals can also be shared. Overload traverse() to
+  compute the visible objects of a Camera, and call traversal() in your draw()
+  method: traverse() is only called once for identical points of view, and the
+  returned index identifies the result that the viewers can reuse. Call
+  invalidateTraversals() when the scene is modified. */
+class QGLVIEWER_EXPORT SceneResources : public QObject {
+  Q_OBJECT
+
+public:
+  SceneResources(QObject *parent = nullptr);
+  virtual ~SceneResources();
+
+  /*! @name Viewers */
+  //@{
+public:
+  void addViewer(QGLViewer *viewer);
+  void removeViewer(QGLViewer *viewer);
+  /*! Returns the QGLViewers that use these resources. */
+  const QList<QGLViewer *> &viewers() const { return viewers_; }
+  /*! Returns \c true when initializeGL() has been called, and cleanupGL() has
+  not been called since. */
+  bool isInitialized() const { return initialized_; }
+  //@}
+
+  /*! @name Shared traversals */
+  //@{
+public:
+  int traversal(const Camera *camera);
+  /*! Returns the number of traversal() results. Indexes returned by traversal()
+  are smaller than this value. */
+  int numberOfTraversals() const { return traversalKeys_.size(); }
+
+public Q_SLOTS:
+  void invalidateTraversals();
+  //@}
+
+protected:
+  /*! Creates the OpenGL resources of the scene. Called once, with the viewer
+  context current, when the first viewer is initialized. Default implementation
+  is empty. */
+  virtual void initializeGL() {}
+  /*! Releases the OpenGL resources created by initializeGL(). Called with a
+  viewer context current when the last viewer is removed. Default
+  implementation is empty. */
+  virtual void cleanupGL() {}
+  /*! Computes the scene traversal (visible objects, sorted primitives...) of
+  \p camera, and stores its result at \p index. Called by traversal(). Default
+  implementation is empty. */
+  virtual void traverse(const Camera *camera, int index) {
+    Q_UNUSED(camera);
+    Q_UNUSED(index);
+  }
+
+private:
+  friend class ::QGLViewer;
+
+  void viewerInitialized(QGLViewer *viewer);
+
+  QList<QGLViewer *> viewers_;
+  QOpenGLContextGroup *shareGroup_;
+  bool initialized_;
+
+  // Point of view of each traversal, empty when invalidated
+  QVector<QByteArray> traversalKeys_;
+  QHash<const Camera *, int> cameraTraversals_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_SCENE_RESOURCES_H
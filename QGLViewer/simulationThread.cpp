@@ -0,0 +1,172 @@
+#include "simulationThread.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+using namespace qglviewer;
+
+/*! Creates a SimulationThread. The thread is started by start(). */
+SimulationThread::SimulationThread()
+    : thread_(nullptr), timeStep_(0.01), maximumCatchUpSteps_(5),
+      quit_(false), nbSteps_(0), previous_(0), current_(0),
+      readPrevious_(0), readCurrent_(0) {
+  for (int i = 0; i < 4; ++i)
+    slotTime_[i] = 0;
+}
+
+/*! Destructor. The thread must already be stopped by the destructor of the
+derived class, see the class documentation. Otherwise a warning is issued and
+stop() is called, too late to be safe. */
+SimulationThread::~SimulationThread() {
+  if (isRunning()) {
+    qWarning("SimulationThread::~SimulationThread: the derived class "
+             "destructor must call stop()");
+    stop();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Thread                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets timeStep(), in seconds. Applies to the next start(). */
+void SimulationThread::setTimeStep(qreal timeStep) {
+  if (timeStep <= 0.0) {
+    qWarning("SimulationThread::setTimeStep: time step must be positive");
+    return;
+  }
+  timeStep_ = timeStep;
+}
+
+/*! Returns the number of step() performed since the first start(). */
+qint64 SimulationThread::nbSteps() const {
+  QMutexLocker locker(&mutex_);
+  return nbSteps_;
+}
+
+/*! Starts the simulation thread. The simulation continues from its current
+state: the real time elapsed while the thread was stopped is not simulated.
+
+The current state is published before the thread starts, so that
+interpolate() always has a state to display. */
+void SimulationThread::start() {
+  if (isRunning())
+    return;
+
+  clock_.start();
+  {
+    QMutexLocker locker(&mutex_);
+    quit_ = false;
+    readPrevious_ = readCurrent_ = -1;
+  }
+  // Displayed by interpolate() until the first step() is published
+  publish(qint64(timeStep_ * 1.0e9));
+  {
+    // The first state is both the previous and the current one
+    QMutexLocker locker(&mutex_);
+    previous_ = current_;
+  }
+
+  thread_ = QThread::create([this]() { run(); });
+  thread_->start();
+}
+
+/*! Stops the simulation thread, once the current step() is completed. */
+void SimulationThread::stop() {
+  if (!isRunning())
+    return;
+
+  {
+    QMutexLocker locker(&mutex_);
+    quit_ = true;
+    condition_.wakeAll();
+  }
+  thread_->wait();
+  delete thread_;
+  thread_ = nullptr;
+}
+
+// Publishes the current state in a slot that is neither the current one nor
+// an interpolated one, and whose display time is dueTime.
+void SimulationThread::publish(qint64 dueTime) {
+  QMutexLocker locker(&mutex_);
+  int slot = 0;
+  while ((slot == current_) || (slot == readPrevious_) ||
+         (slot == readCurrent_))
+    ++slot;
+  // Under the lock, so that interpolate() never gets a partial state
+  publishState(slot);
+  slotTime_[slot] = dueTime;
+  previous_ = current_;
+  current_ = slot;
+}
+
+// The simulation loop: steps at fixed times, timeStep() apart, until stop().
+void SimulationThread::run() {
+  const qreal timeStep = timeStep_;
+  const qint64 period = qint64(timeStep * 1.0e9);
+  qint64 nextStep = period;
+
+  Q_FOREVER {
+    int nbCatchUpSteps = 0;
+    while (clock_.nsecsElapsed() >= nextStep) {
+      {
+        QMutexLocker locker(&mutex_);
+        if (quit_)
+          return;
+      }
+
+      step(timeStep);
+      {
+        QMutexLocker locker(&mutex_);
+        ++nbSteps_;
+      }
+      // Displayed one step later, see interpolate()
+      publish(nextStep + period);
+      nextStep += period;
+
+      // Too slow: the lost time is not simulated
+      if (++nbCatchUpSteps >= maximumCatchUpSteps_) {
+        nextStep = qMax(nextStep, clock_.nsecsElapsed());
+        break;
+      }
+    }
+
+    QMutexLocker locker(&mutex_);
+    if (quit_)
+      return;
+    const qint64 wait = (nextStep - clock_.nsecsElapsed()) / 1000000;
+    if (wait > 0)
+      condition_.wait(&mutex_, (unsigned long)wait);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            State interpolation                             //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Calls interpolateState() with the two most recently published states, and
+the position of the current time between their display times. Must be called
+in the GUI thread, before each frame: QGLViewer::preDraw() calls it when the
+SimulationThread is the QGLViewer::simulationThread().
+
+Returns \c false, without calling interpolateState(), when the thread is not
+running. Until the next interpolate(), the two slots are not overwritten. */
+bool SimulationThread::interpolate() {
+  if (!isRunning())
+    return false;
+
+  int previous, current;
+  qreal alpha = 1.0;
+  {
+    QMutexLocker locker(&mutex_);
+    previous = readPrevious_ = previous_;
+    current = readCurrent_ = current_;
+    const qint64 span = slotTime_[current] - slotTime_[previous];
+    if (span > 0)
+      alpha = qreal(clock_.nsecsElapsed() - slotTime_[previous]) / span;
+  }
+
+  interpolateState(previous, current, qBound(qreal(0.0), alpha, qreal(1.0)));
+  return true;
+}
@@ -0,0 +1,138 @@
+#ifndef QGLVIEWER_SIMULATION_THREAD_H
+#define QGLVIEWER_SIMULATION_THREAD_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "config.h"
+
+class QThread;
+
+namespace qglviewer {
+/*! \brief Advances a simulation at a fixed time step in a dedicated thread.
+  \class SimulationThread simulationThread.h QGLViewer/simulationThread.h
+
+  QGLViewer::animate() is called in the GUI thread, once per animation tick:
+  the simulation rate depends on the rendering and event processing load, and
+  a slow physics step makes the interface sluggish. A SimulationThread calls
+  step() in its own thread instead, timeStep() seconds apart in real time, and
+  always with the same timeStep(): the simulation is deterministic, whatever
+  the frame rate.
+
+  After each step(), the thread copies the state of the simulation in one of
+  four slots with publishState(). Before each frame, the GUI thread calls
+  interpolate(), which gives the two most recent states to interpolateState(),
+  with the interpolation factor of the display time. Overload these three
+  methods:
+  \code
+  class Physics : public qglviewer::SimulationThread {
+  public:
+    // Before world is destroyed, and while the overloads below still exist
+    ~Physics() { stop(); }
+
+  protected:
+    virtual void step(qreal dt) { world.step(dt); }
+    virtual void publishState(int slot) { positions[slot] = world.positions(); }
+    virtual void interpolateState(int previous, int current, qreal alpha) {
+      for (int i = 0; i < nbBodies; ++i)
+        body[i].frame.setPosition((1.0 - alpha) * positions[previous][i] +
+                                  alpha * positions[current][i]);
+    }
+  };
+
+  viewer->setSimulationThread(&physics);
+  viewer->startAnimation();
+  \endcode
+
+  Once attached with QGLViewer::setSimulationThread(), the viewer starts and
+  stops the thread with its animation (see QGLViewer::startAnimation()),
+  calls interpolate() in QGLViewer::preDraw(), and no longer calls
+  QGLViewer::animate(). The displayed scene is one timeStep() behind the
+  simulation, so that there are always two states to interpolate.
+
+  step() and publishState() are called in the simulation thread and must not
+  use the objects of the GUI thread. The slots given to interpolateState() are
+  not written by publishState() until the next interpolate().
+
+  \attention The destructor of a derived class must call stop(), as in the
+  example above: when the SimulationThread destructor is reached, the derived
+  members used by step() are already destroyed, and the thread would call the
+  base class step() while its virtual table is changed. */
+class QGLVIEWER_EXPORT SimulationThread {
+public:
+  SimulationThread();
+  virtual ~SimulationThread();
+
+  /*! @name Thread */
+  //@{
+public:
+  void start();
+  void stop();
+  /*! Returns \c true between start() and stop(). */
+  bool isRunning() const { return thread_ != nullptr; }
+
+  /*! Returns the duration of a step(), in seconds. Default value is 0.01 (100
+  steps per second). */
+  qreal timeStep() const { return timeStep_; }
+  void setTimeStep(qreal timeStep);
+  /*! Returns the maximum number of step() performed in a row to catch up
+  with real time. When the steps are slower than real time, the simulation
+  slows down instead of falling further and further behind. Default value is
+  5. */
+  int maximumCatchUpSteps() const { return maximumCatchUpSteps_; }
+  /*! Sets maximumCatchUpSteps(). */
+  void setMaximumCatchUpSteps(int nb) { maximumCatchUpSteps_ = qMax(1, nb); }
+
+  qint64 nbSteps() const;
+  //@}
+
+  /*! @name State interpolation */
+  //@{
+public:
+  bool interpolate();
+  //@}
+
+protected:
+  /*! Advances the simulation by \p timeStep seconds. Called in the
+  simulation thread. Default implementation is empty. */
+  virtual void step(qreal timeStep) { Q_UNUSED(timeStep); }
+  /*! Copies the current state of the simulation in \p slot, in [0,4[. Called
+  in the simulation thread after each step(), and once by start(), in the
+  calling thread, before the first step(). Default implementation is empty. */
+  virtual void publishState(int slot) { Q_UNUSED(slot); }
+  /*! Sets the displayed scene to the state at \p alpha (in [0,1]) between the
+  states of the \p previous and \p current slots. Called in the GUI thread by
+  interpolate(). Default implementation is empty. */
+  virtual void interpolateState(int previous, int current, qreal alpha) {
+    Q_UNUSED(previous);
+    Q_UNUSED(current);
+    Q_UNUSED(alpha);
+  }
+
+private:
+  Q_DISABLE_COPY(SimulationThread)
+
+  void run();
+  void publish(qint64 dueTime);
+
+  QThread *thread_;
+  qreal timeStep_;
+  int maximumCatchUpSteps_;
+  QElapsedTimer clock_;
+
+  // Protected by mutex_
+  mutable QMutex mutex_;
+  QWaitCondition condition_;
+  bool quit_;
+  qint64 nbSteps_;
+  // The two most recently published slots, and the ones interpolated
+  int previous_, current_;
+  int readPrevious_, readCurrent_;
+  // Real time (clock_ nanoseconds) each slot state is displayed at
+  qint64 slotTime_[4];
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_SIMULATION_THREAD_H
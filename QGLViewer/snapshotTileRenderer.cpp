@@ -0,0 +1,288 @@
+#include "snapshotTileRenderer.h"
+
+#include <QImage>
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QThread>
+
+#include <cstring>
+
+using namespace qglviewer;
+
+// A render thread and its context
+struct SnapshotTileRenderer::Worker {
+  QThread *thread;
+  QThread *ownerThread; // where the context is moved back by run()
+  QOffscreenSurface *surface;
+  QOpenGLContext *context;
+  // Created and deleted by run(). fbo is resolved in resolveFbo when it is
+  // multisampled.
+  QOpenGLFramebufferObject *fbo, *resolveFbo;
+  QVector<uchar> pixels;
+};
+
+/*! Creates a SnapshotTileRenderer. Must be called in the GUI thread. The
+render threads are started by start(). */
+SnapshotTileRenderer::SnapshotTileRenderer()
+    : nbContexts_(2), quit_(false), tiles_(nullptr), nextTile_(0),
+      nbPendingTiles_(0), failed_(false), bits_(nullptr), bytesPerLine_(0),
+      samples_(0) {}
+
+/*! Destructor. Calls stop(). */
+SnapshotTileRenderer::~SnapshotTileRenderer() { stop(); }
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Contexts                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates the nbContexts() contexts and starts their render threads. Must be
+called in the GUI thread. Returns \c false when no context could be created.
+
+The contexts have the format of \p shareContext, and share their objects with
+it when they are on its screen. Called by QGLViewer::setSnapshotTileRenderer()
+with the viewer's context. */
+bool SnapshotTileRenderer::start(QOpenGLContext *shareContext) {
+  if (isRunning())
+    return true;
+  if (!shareContext) {
+    qWarning("SnapshotTileRenderer::start: no OpenGL context to share with");
+    return false;
+  }
+
+  quit_ = false;
+  for (int i = 0; i < nbContexts_; ++i) {
+    QScreen *screen = screens_.isEmpty() ? shareContext->screen()
+                                         : screens_[i % screens_.size()];
+
+    // The surface must be created in the GUI thread
+    Worker *worker = new Worker();
+    worker->surface = new QOffscreenSurface(screen);
+    worker->surface->setFormat(shareContext->format());
+    worker->surface->create();
+
+    worker->context = new QOpenGLContext();
+    worker->context->setFormat(shareContext->format());
+    worker->context->setScreen(screen);
+    if (screen == shareContext->screen())
+      worker->context->setShareContext(shareContext);
+    if (!worker->surface->isValid() || !worker->context->create()) {
+      qWarning("SnapshotTileRenderer::start: Unable to create OpenGL context "
+               "%d",
+               i);
+      delete worker->context;
+      delete worker->surface;
+      delete worker;
+      continue;
+    }
+
+    worker->fbo = nullptr;
+    worker->resolveFbo = nullptr;
+    worker->ownerThread = QThread::currentThread();
+    worker->thread = QThread::create([this, worker]() { run(worker); });
+    worker->context->moveToThread(worker->thread);
+    worker->thread->start();
+    workers_.append(worker);
+  }
+  return isRunning();
+}
+
+/*! Stops the render threads, once the current renderTiles() is completed.
+cleanup() is called in each render thread and the contexts are destroyed. Must
+be called in the GUI thread. */
+void SnapshotTileRenderer::stop() {
+  if (!isRunning())
+    return;
+
+  {
+    QMutexLocker locker(&mutex_);
+    quit_ = true;
+    tilesAvailable_.wakeAll();
+  }
+  for (int i = 0; i < workers_.size(); ++i) {
+    Worker *worker = workers_[i];
+    worker->thread->wait();
+    delete worker->thread;
+    delete worker->context;
+    delete worker->surface;
+    delete worker;
+  }
+  workers_.clear();
+}
+
+// The render thread loop: renders the next tile of renderTiles(), until
+// stop().
+void SnapshotTileRenderer::run(Worker *worker) {
+  // Without a context, the tiles of this thread are failed
+  const bool current = worker->context->makeCurrent(worker->surface);
+  if (!current)
+    qWarning("SnapshotTileRenderer: Unable to make the context current");
+  else {
+    if (worker->context->format().profile() != QSurfaceFormat::CoreProfile) {
+      glEnable(GL_LIGHT0);
+      glEnable(GL_LIGHTING);
+      glEnable(GL_COLOR_MATERIAL);
+    }
+    glEnable(GL_DEPTH_TEST);
+    init();
+  }
+
+  Q_FOREVER {
+    const Tile *tile;
+    int samples;
+    QColor backgroundColor;
+    uchar *bits;
+    int bytesPerLine;
+    {
+      QMutexLocker locker(&mutex_);
+      while (!quit_ && (!tiles_ || (nextTile_ == tiles_->size())))
+        tilesAvailable_.wait(&mutex_);
+      if (quit_)
+        break;
+      tile = &tiles_->at(nextTile_++);
+      samples = samples_;
+      backgroundColor = backgroundColor_;
+      bits = bits_;
+      bytesPerLine = bytesPerLine_;
+    }
+
+    const bool rendered = current && renderTile(worker, *tile, samples,
+                                                backgroundColor, bits,
+                                                bytesPerLine);
+
+    QMutexLocker locker(&mutex_);
+    failed_ = failed_ || !rendered;
+    if (--nbPendingTiles_ == 0)
+      tilesDone_.wakeAll();
+  }
+
+  if (current) {
+    cleanup();
+    delete worker->fbo;
+    delete worker->resolveFbo;
+    worker->fbo = worker->resolveFbo = nullptr;
+    worker->context->doneCurrent();
+  }
+
+  // So that stop() can delete it
+  worker->context->moveToThread(worker->ownerThread);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Tiles                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Renders \p tiles in the render threads, which copy each Tile::rect in \p
+image. \p image must have the \c QImage::Format_RGBA8888 format and contain
+all the tiles. The tiles are cleared with \p backgroundColor and multisampled
+with \p samples samples per pixel when it is not null.
+
+Blocks until all the tiles are rendered. Returns \c false when the renderer is
+not running or when a tile could not be rendered. Must be called in the GUI
+thread. */
+bool SnapshotTileRenderer::renderTiles(const QVector<Tile> &tiles,
+                                       QImage &image,
+                                       const QColor &backgroundColor,
+                                       int samples) {
+  if (!isRunning()) {
+    qWarning("SnapshotTileRenderer::renderTiles: not started");
+    return false;
+  }
+  if (image.format() != QImage::Format_RGBA8888) {
+    qWarning("SnapshotTileRenderer::renderTiles: image must be RGBA8888");
+    return false;
+  }
+  if (tiles.isEmpty())
+    return true;
+
+  // Detaches image before the render threads write in it
+  uchar *bits = image.bits();
+  QMutexLocker locker(&mutex_);
+  tiles_ = &tiles;
+  nextTile_ = 0;
+  nbPendingTiles_ = tiles.size();
+  failed_ = false;
+  bits_ = bits;
+  bytesPerLine_ = image.bytesPerLine();
+  samples_ = samples;
+  backgroundColor_ = backgroundColor;
+  tilesAvailable_.wakeAll();
+  while (nbPendingTiles_ > 0)
+    tilesDone_.wait(&mutex_);
+  tiles_ = nullptr;
+  return !failed_;
+}
+
+// Renders tile and copies it in the image. Called in the render threads.
+bool SnapshotTileRenderer::renderTile(Worker *worker, const Tile &tile,
+                                      int samples,
+                                      const QColor &backgroundColor,
+                                      uchar *bits, int bytesPerLine) {
+  const QSize size = tile.rect.size();
+  if (size.isEmpty())
+    return true;
+
+  // Reused by the next tiles of the same size or smaller
+  QOpenGLFramebufferObject *&fbo = worker->fbo;
+  if (!fbo || (fbo->width() < size.width()) ||
+      (fbo->height() < size.height()) || (fbo->format().samples() != samples)) {
+    delete fbo;
+    delete worker->resolveFbo;
+    worker->resolveFbo = nullptr;
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    format.setSamples(samples);
+    fbo = new QOpenGLFramebufferObject(size, format);
+    if (samples > 0)
+      worker->resolveFbo = new QOpenGLFramebufferObject(size);
+    if (!fbo->isValid() ||
+        (worker->resolveFbo && !worker->resolveFbo->isValid())) {
+      qWarning("SnapshotTileRenderer: Unable to create a %dx%d framebuffer "
+               "object",
+               size.width(), size.height());
+      delete fbo;
+      delete worker->resolveFbo;
+      fbo = worker->resolveFbo = nullptr;
+      return false;
+    }
+  }
+
+  fbo->bind();
+  glViewport(0, 0, size.width(), size.height());
+  glClearColor(backgroundColor.redF(), backgroundColor.greenF(),
+               backgroundColor.blueF(), backgroundColor.alphaF());
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  if (worker->context->format().profile() != QSurfaceFormat::CoreProfile) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixd(tile.state.projectionMatrix);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixd(tile.state.modelViewMatrix);
+  }
+
+  draw(tile);
+
+  QOpenGLFramebufferObject *readFbo = fbo;
+  if (worker->resolveFbo) {
+    const QRect rect(QPoint(0, 0), size);
+    QOpenGLFramebufferObject::blitFramebuffer(worker->resolveFbo, rect, fbo,
+                                              rect);
+    readFbo = worker->resolveFbo;
+  }
+  readFbo->bind();
+  worker->pixels.resize(4 * size.width() * size.height());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+               worker->pixels.data());
+  readFbo->release();
+
+  // OpenGL rows are bottom-up. The tiles do not overlap.
+  for (int row = 0; row < size.height(); ++row)
+    memcpy(bits + (tile.rect.top() + row) * bytesPerLine +
+               4 * tile.rect.left(),
+           worker->pixels.constData() +
+               4 * (size.height() - 1 - row) * size.width(),
+           4 * size.width());
+  return true;
+}
@@ -0,0 +1,140 @@
+#ifndef QGLVIEWER_SNAPSHOT_TILE_RENDERER_H
+#define QGLVIEWER_SNAPSHOT_TILE_RENDERER_H
+
+#include <QColor>
+#include <QList>
+#include <QMutex>
+#include <QRect>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "cameraState.h"
+
+class QImage;
+class QOpenGLContext;
+class QScreen;
+
+namespace qglviewer {
+/*! \brief Renders the tiles of large image snapshots in several OpenGL
+  contexts, in parallel.
+  \class SnapshotTileRenderer snapshotTileRenderer.h
+  QGLViewer/snapshotTileRenderer.h
+
+  QGLViewer::saveSnapshot() renders the images larger than the viewer tile by
+  tile, each tile with its own sub-frustum of the camera() frustum, one after
+  the other on the viewer's context. Once a SnapshotTileRenderer is attached
+  with QGLViewer::setSnapshotTileRenderer(), the tiles are instead distributed
+  among nbContexts() offscreen contexts, each one with its own thread, which
+  also copy their tiles in the resulting image. Overload draw() to draw your
+  scene:
+  \code
+  class PosterRenderer : public qglviewer::SnapshotTileRenderer {
+  protected:
+    virtual void draw(const Tile &tile) {
+      // Called concurrently by the render threads: only read the scene
+      scene->draw(tile.state);
+    }
+  };
+
+  renderer_.setNbContexts(4);
+  renderer_.setScreens(QGuiApplication::screens());
+  viewer->setSnapshotTileRenderer(&renderer_);
+  \endcode
+
+  draw() is called in the render threads, with the tile framebuffer cleared
+  and the Tile::state matrices loaded (in a compatibility profile). It must
+  not use the QGLViewer or its Camera, and may be called by several threads at
+  the same time. The viewer's visual hints (axis, grid...) are not drawn.
+
+  The contexts share their OpenGL objects with the viewer's one, unless they
+  are created on a different screen (see setScreens()): on platforms where
+  each GPU drives its own screens, the contexts of the other GPUs then create
+  their own objects in init(). */
+class QGLVIEWER_EXPORT SnapshotTileRenderer {
+public:
+  SnapshotTileRenderer();
+  virtual ~SnapshotTileRenderer();
+
+  /*! @name Contexts */
+  //@{
+public:
+  /*! Returns the number of contexts, and hence of render threads, created by
+  start(). Default value is 2. */
+  int nbContexts() const { return nbContexts_; }
+  /*! Sets nbContexts(). Applies to the next start(). */
+  void setNbContexts(int nb) { nbContexts_ = qMax(1, nb); }
+  /*! Returns the screens the contexts are created on, in turn. Default value
+  is an empty list, meaning the screen of the viewer's context. */
+  QList<QScreen *> screens() const { return screens_; }
+  /*! Sets screens(). Applies to the next start(). */
+  void setScreens(const QList<QScreen *> &screens) { screens_ = screens; }
+
+  bool start(QOpenGLContext *shareContext);
+  void stop();
+  /*! Returns \c true between start() and stop(). */
+  bool isRunning() const { return !workers_.isEmpty(); }
+  //@}
+
+  /*! @name Tiles */
+  //@{
+public:
+  /*! A tile of the image, and the camera it is seen from. */
+  struct Tile {
+    /*! The pixels of the tile in the image, (0,0) being its upper left
+    corner. */
+    QRect rect;
+    /*! The camera state, whose projection is restricted to the tile, with a
+    matching viewport. */
+    CameraState state;
+    /*! The part of the viewer window the tile covers, in the coordinates of
+    QGLViewer::startScreenCoordinatesSystem(). */
+    qreal xMin, yMin, xMax, yMax;
+    /*! The scale factor of the texts of the tile, see
+    QGLViewer::scaledFont(). */
+    qreal textScale;
+  };
+
+  bool renderTiles(const QVector<Tile> &tiles, QImage &image,
+                   const QColor &backgroundColor, int samples = 0);
+  //@}
+
+protected:
+  /*! Called once in each render thread, with its context current, before the
+  first draw(). Default implementation is empty. */
+  virtual void init() {}
+  /*! Draws the scene of \p tile. Default implementation is empty. */
+  virtual void draw(const Tile &tile) { Q_UNUSED(tile); }
+  /*! Called in each render thread by stop(), with the context current, to
+  release the OpenGL resources created by init() and draw(). Default
+  implementation is empty. */
+  virtual void cleanup() {}
+
+private:
+  Q_DISABLE_COPY(SnapshotTileRenderer)
+
+  struct Worker;
+  void run(Worker *worker);
+  bool renderTile(Worker *worker, const Tile &tile, int samples,
+                  const QColor &backgroundColor, uchar *bits,
+                  int bytesPerLine);
+
+  int nbContexts_;
+  QList<QScreen *> screens_;
+  QList<Worker *> workers_;
+
+  // Protected by mutex_
+  QMutex mutex_;
+  QWaitCondition tilesAvailable_, tilesDone_;
+  bool quit_;
+  const QVector<Tile> *tiles_;
+  int nextTile_, nbPendingTiles_;
+  bool failed_;
+  uchar *bits_;
+  int bytesPerLine_;
+  int samples_;
+  QColor backgroundColor_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_SNAPSHOT_TILE_RENDERER_H
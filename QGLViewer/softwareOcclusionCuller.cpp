@@ -0,0 +1,526 @@
+#include "softwareOcclusionCuller.h"
+#include "camera.h"
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QGLVIEWER_RASTERIZER_SSE2
+#endif
+
+using namespace qglviewer;
+
+// Size of the tiles rasterized in parallel, in pixels. Levels 1 to 5 of the
+// depth hierarchy are also computed tile by tile.
+static const int tileSize = 32;
+static const int tileLevels = 5;
+
+// Depth of the pixels that are not covered by an occluder
+static const float noOccluder = -FLT_MAX;
+
+/*! Creates a SoftwareOcclusionCuller without occluders: every box is visible
+until rasterizeOccluders() is called. */
+SoftwareOcclusionCuller::SoftwareOcclusionCuller()
+    : resolution_(256, 128), parallelRasterization_(true),
+      isRasterized_(false), perspective_(true), zNear_(0.0), nbTilesX_(0),
+      nbTilesY_(0) {
+  for (int i = 0; i < 16; ++i)
+    mvp_[i] = modelView_[i] = 0.0;
+}
+
+/*! Destructor. */
+SoftwareOcclusionCuller::~SoftwareOcclusionCuller() {}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Occluders                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Registers an occluder mesh and returns its id. \p triangles holds three
+indices in \p vertices per triangle. Vertices are expressed in the world
+coordinate system. Ids of removed occluders (see removeOccluder()) are reused.
+
+The occluder is taken into account by the next rasterizeOccluders(). */
+int SoftwareOcclusionCuller::addOccluder(const QVector<Vec> &vertices,
+                                         const QVector<int> &triangles) {
+  int id;
+  if (freeIds_.isEmpty()) {
+    id = occluders_.size();
+    occluders_.append(Occluder());
+  } else
+    id = freeIds_.takeLast();
+
+  occluders_[id].used = true;
+  setOccluder(id, vertices, triangles);
+  return id;
+}
+
+/*! Replaces the mesh of the occluder \p id. See addOccluder(). Triangles with
+an invalid vertex index are ignored. */
+void SoftwareOcclusionCuller::setOccluder(int id, const QVector<Vec> &vertices,
+                                          const QVector<int> &triangles) {
+  if (!isValidId(id, "setOccluder"))
+    return;
+
+  Occluder &occluder = occluders_[id];
+  occluder.vertices = vertices;
+  occluder.triangles.clear();
+  occluder.triangles.reserve(triangles.size());
+  bool valid = (triangles.size() % 3 == 0);
+  for (int t = 0; t + 2 < triangles.size(); t += 3) {
+    bool inRange = true;
+    for (int k = 0; k < 3; ++k)
+      inRange = inRange && (triangles[t + k] >= 0) &&
+                (triangles[t + k] < vertices.size());
+    if (inRange)
+      for (int k = 0; k < 3; ++k)
+        occluder.triangles.append(triangles[t + k]);
+    valid = valid && inRange;
+  }
+
+  if (!valid)
+    qWarning("SoftwareOcclusionCuller::setOccluder: invalid triangles ignored");
+}
+
+/*! Unregisters the occluder \p id. Its id may be returned by the next
+addOccluder() call. */
+void SoftwareOcclusionCuller::removeOccluder(int id) {
+  if (!isValidId(id, "removeOccluder"))
+    return;
+  occluders_[id].used = false;
+  occluders_[id].vertices.clear();
+  occluders_[id].triangles.clear();
+  freeIds_.append(id);
+}
+
+/*! Unregisters all the occluders. */
+void SoftwareOcclusionCuller::clear() {
+  occluders_.clear();
+  freeIds_.clear();
+}
+
+bool SoftwareOcclusionCuller::isValidId(int id, const char *method) const {
+  if ((id < 0) || (id >= occluders_.size()) || !occluders_[id].used) {
+    qWarning("SoftwareOcclusionCuller::%s: invalid occluder id %d", method, id);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Depth buffer                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Sets the resolution() of the depth buffer. Boxes are visible until the next
+rasterizeOccluders(). */
+void SoftwareOcclusionCuller::setResolution(const QSize &resolution) {
+  resolution_ = resolution.expandedTo(QSize(1, 1));
+  isRasterized_ = false;
+}
+
+/*! Sets the parallelRasterization() value. */
+void SoftwareOcclusionCuller::setParallelRasterization(bool parallel) {
+  parallelRasterization_ = parallel;
+}
+
+/*! Renders the occluders in the depth buffer, as seen from \p camera, and
+builds its depth hierarchy. The next isVisible() calls use this \p camera
+position and matrices. Call it again when the camera or the occluders move. */
+void SoftwareOcclusionCuller::rasterizeOccluders(const Camera *camera) {
+  camera->getModelViewProjectionMatrix(mvp_);
+  camera->getModelViewMatrix(modelView_);
+  perspective_ = (camera->type() == Camera::PERSPECTIVE);
+  zNear_ = camera->zNear();
+
+  // The levels covered by the tiles
+  nbTilesX_ = (resolution_.width() + tileSize - 1) / tileSize;
+  nbTilesY_ = (resolution_.height() + tileSize - 1) / tileSize;
+  levelSizes_.clear();
+  QSize size(nbTilesX_ * tileSize, nbTilesY_ * tileSize);
+  for (int l = 0; l <= tileLevels; ++l)
+    levelSizes_.append(size / (1 << l));
+  // The upper levels, down to a single texel
+  size = levelSizes_.last();
+  while ((size.width() > 1) || (size.height() > 1)) {
+    size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+    levelSizes_.append(size);
+  }
+  levels_.resize(levelSizes_.size());
+  for (int l = 0; l < levels_.size(); ++l)
+    levels_[l].resize(levelSizes_[l].width() * levelSizes_[l].height());
+
+  projectOccluders();
+  binTriangles();
+
+  const int nbTiles = nbTilesX_ * nbTilesY_;
+  if (parallelRasterization_) {
+    // Minimum number of triangles rasterized by a thread, as a number of tiles
+    const int minChunkTriangles = 256;
+    const int minChunkSize =
+        qMax(1, int(qint64(nbTiles) * minChunkTriangles /
+                    qMax(1, int(triangles_.size()))));
+    TaskScheduler::parallelFor(
+        nbTiles,
+        [this](int b, int e) {
+          for (int t = b; t < e; ++t)
+            rasterizeTile(t);
+        },
+        minChunkSize);
+  } else
+    for (int t = 0; t < nbTiles; ++t)
+      rasterizeTile(t);
+
+  buildUpperLevels();
+  isRasterized_ = true;
+}
+
+// Distance to the camera plane, positive in front of the camera
+GLdouble SoftwareOcclusionCuller::eyeDepth(const Vec &p) const {
+  return -(modelView_[2] * p.x + modelView_[6] * p.y + modelView_[10] * p.z +
+           modelView_[14]);
+}
+
+void SoftwareOcclusionCuller::projectOccluders() {
+  triangles_.clear();
+  QVector<GLdouble> clip, z;
+
+  for (int o = 0; o < occluders_.size(); ++o) {
+    const Occluder &occluder = occluders_[o];
+    if (!occluder.used)
+      continue;
+
+    const int nbVertices = occluder.vertices.size();
+    clip.resize(4 * nbVertices);
+    z.resize(nbVertices);
+    for (int v = 0; v < nbVertices; ++v) {
+      const Vec &p = occluder.vertices[v];
+      for (int i = 0; i < 4; ++i)
+        clip[4 * v + i] = mvp_[i] * p.x + mvp_[4 + i] * p.y +
+                          mvp_[8 + i] * p.z + mvp_[12 + i];
+      z[v] = eyeDepth(p);
+    }
+
+    GLdouble c[3][4], d[3];
+    for (int t = 0; t < occluder.triangles.size(); t += 3) {
+      for (int k = 0; k < 3; ++k) {
+        const int v = occluder.triangles[t + k];
+        for (int i = 0; i < 4; ++i)
+          c[k][i] = clip[4 * v + i];
+        d[k] = z[v];
+      }
+      addTriangle(c, d);
+    }
+  }
+}
+
+// Clips the triangle by the near plane. The clip coordinates and the depth z
+// are affine functions of the position, and are interpolated alike.
+void SoftwareOcclusionCuller::addTriangle(const GLdouble clip[3][4],
+                                          const GLdouble z[3]) {
+  int nbInside = 0;
+  for (int k = 0; k < 3; ++k)
+    if (z[k] >= zNear_)
+      ++nbInside;
+
+  if (nbInside == 3) {
+    addProjectedTriangle(clip, z);
+    return;
+  }
+  if (nbInside == 0)
+    return;
+
+  GLdouble polygonClip[4][4], polygonZ[4];
+  int n = 0;
+  for (int a = 0; a < 3; ++a) {
+    const int b = (a + 1) % 3;
+    const bool aInside = (z[a] >= zNear_);
+    if (aInside) {
+      for (int i = 0; i < 4; ++i)
+        polygonClip[n][i] = clip[a][i];
+      polygonZ[n++] = z[a];
+    }
+    if (aInside != (z[b] >= zNear_)) {
+      const GLdouble t = (zNear_ - z[a]) / (z[b] - z[a]);
+      for (int i = 0; i < 4; ++i)
+        polygonClip[n][i] = clip[a][i] + t * (clip[b][i] - clip[a][i]);
+      polygonZ[n++] = zNear_;
+    }
+  }
+
+  GLdouble c[3][4], d[3];
+  for (int k = 1; k + 1 < n; ++k) {
+    const int v[3] = {0, k, k + 1};
+    for (int j = 0; j < 3; ++j) {
+      for (int i = 0; i < 4; ++i)
+        c[j][i] = polygonClip[v[j]][i];
+      d[j] = polygonZ[v[j]];
+    }
+    addProjectedTriangle(c, d);
+  }
+}
+
+void SoftwareOcclusionCuller::addProjectedTriangle(const GLdouble clip[3][4],
+                                                   const GLdouble z[3]) {
+  Triangle triangle;
+  for (int k = 0; k < 3; ++k) {
+    const GLdouble w = clip[k][3];
+    if (w <= 0.0)
+      return;
+    triangle.x[k] = float((0.5 * clip[k][0] / w + 0.5) * resolution_.width());
+    triangle.y[k] = float((0.5 * clip[k][1] / w + 0.5) * resolution_.height());
+    triangle.depth[k] = float(perspective_ ? 1.0 / z[k] : -z[k]);
+  }
+
+  const float area = (triangle.x[1] - triangle.x[0]) *
+                         (triangle.y[2] - triangle.y[0]) -
+                     (triangle.x[2] - triangle.x[0]) *
+                         (triangle.y[1] - triangle.y[0]);
+  if (!(area != 0.0f) || !std::isfinite(area))
+    return;
+  if (area < 0.0f) {
+    std::swap(triangle.x[1], triangle.x[2]);
+    std::swap(triangle.y[1], triangle.y[2]);
+    std::swap(triangle.depth[1], triangle.depth[2]);
+  }
+  triangles_.append(triangle);
+}
+
+// Returns the pixels whose center is in [min, max]
+static void coveredPixels(float min, float max, int size, int &first,
+                          int &last) {
+  first = int(std::ceil(qBound(0.0f, min - 0.5f, float(size))));
+  last = int(std::floor(qBound(-1.0f, max - 0.5f, float(size - 1))));
+}
+
+void SoftwareOcclusionCuller::binTriangles() {
+  bins_.resize(nbTilesX_ * nbTilesY_);
+  for (int b = 0; b < bins_.size(); ++b)
+    bins_[b].clear();
+
+  for (int t = 0; t < triangles_.size(); ++t) {
+    const Triangle &triangle = triangles_[t];
+    int x0, x1, y0, y1;
+    coveredPixels(qMin(triangle.x[0], qMin(triangle.x[1], triangle.x[2])),
+                  qMax(triangle.x[0], qMax(triangle.x[1], triangle.x[2])),
+                  resolution_.width(), x0, x1);
+    coveredPixels(qMin(triangle.y[0], qMin(triangle.y[1], triangle.y[2])),
+                  qMax(triangle.y[0], qMax(triangle.y[1], triangle.y[2])),
+                  resolution_.height(), y0, y1);
+    if ((x0 > x1) || (y0 > y1))
+      continue;
+
+    for (int ty = y0 / tileSize; ty <= y1 / tileSize; ++ty)
+      for (int tx = x0 / tileSize; tx <= x1 / tileSize; ++tx)
+        bins_[ty * nbTilesX_ + tx].append(t);
+  }
+}
+
+// Rasterizes the triangles of a tile in level 0, and computes the tile texels
+// of the levels 1 to tileLevels.
+void SoftwareOcclusionCuller::rasterizeTile(int tile) {
+  const int tileX = (tile % nbTilesX_) * tileSize;
+  const int tileY = (tile / nbTilesX_) * tileSize;
+  const int width = levelSizes_[0].width();
+  float *const buffer = levels_[0].data();
+
+  for (int y = tileY; y < tileY + tileSize; ++y)
+    std::fill(buffer + y * width + tileX,
+              buffer + y * width + tileX + tileSize, noOccluder);
+
+  const QVector<int> &bin = bins_[tile];
+  for (int b = 0; b < bin.size(); ++b) {
+    const Triangle &t = triangles_[bin[b]];
+
+    int x0, x1, y0, y1;
+    coveredPixels(qMin(t.x[0], qMin(t.x[1], t.x[2])),
+                  qMax(t.x[0], qMax(t.x[1], t.x[2])), resolution_.width(), x0,
+                  x1);
+    coveredPixels(qMin(t.y[0], qMin(t.y[1], t.y[2])),
+                  qMax(t.y[0], qMax(t.y[1], t.y[2])), resolution_.height(), y0,
+                  y1);
+    x0 = qMax(x0, tileX);
+    x1 = qMin(x1, tileX + tileSize - 1);
+    y0 = qMax(y0, tileY);
+    y1 = qMin(y1, tileY + tileSize - 1);
+
+    // Edge functions, positive inside: e = a * (x - xr) + b * (y - yr). The
+    // reference (xr, yr) is the smallest end of the edge, so that the two
+    // triangles of a shared edge compute opposite values, without cracks.
+    float a[3], b2[3], xr[3], yr[3];
+    for (int k = 0; k < 3; ++k) {
+      const int n = (k + 1) % 3;
+      a[k] = t.y[k] - t.y[n];
+      b2[k] = t.x[n] - t.x[k];
+      const bool first = (t.x[k] < t.x[n]) ||
+                         ((t.x[k] == t.x[n]) && (t.y[k] < t.y[n]));
+      xr[k] = t.x[first ? k : n];
+      yr[k] = t.y[first ? k : n];
+    }
+
+    // Depth plane
+    const float area = b2[0] * (t.y[2] - t.y[0]) + a[0] * (t.x[2] - t.x[0]);
+    const float dx = ((t.depth[1] - t.depth[0]) * (t.y[2] - t.y[0]) -
+                      (t.depth[2] - t.depth[0]) * (t.y[1] - t.y[0])) /
+                     area;
+    const float dy = ((t.depth[2] - t.depth[0]) * (t.x[1] - t.x[0]) -
+                      (t.depth[1] - t.depth[0]) * (t.x[2] - t.x[0])) /
+                     area;
+
+    // Rows start at a multiple of 4 pixels, which stays in the tile
+    const int xStart = x0 & ~3;
+
+    for (int y = y0; y <= y1; ++y) {
+      const float py = y + 0.5f;
+      float rowE[3];
+      for (int k = 0; k < 3; ++k)
+        rowE[k] = b2[k] * (py - yr[k]);
+      const float rowDepth = t.depth[0] + dy * (py - t.y[0]);
+      float *const row = buffer + y * width;
+
+#ifdef QGLVIEWER_RASTERIZER_SSE2
+      // Four pixels at a time
+      const __m128 first = _mm_set1_ps(float(x0));
+      const __m128 last = _mm_set1_ps(float(x1));
+      const __m128 zero = _mm_setzero_ps();
+      __m128 x = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+      x = _mm_add_ps(x, _mm_set1_ps(float(xStart)));
+
+      for (int i = xStart; i <= x1; i += 4) {
+        const __m128 center = _mm_add_ps(x, _mm_set1_ps(0.5f));
+        __m128 inside =
+            _mm_and_ps(_mm_cmpge_ps(x, first), _mm_cmple_ps(x, last));
+        for (int k = 0; k < 3; ++k) {
+          const __m128 e = _mm_add_ps(
+              _mm_mul_ps(_mm_set1_ps(a[k]),
+                         _mm_sub_ps(center, _mm_set1_ps(xr[k]))),
+              _mm_set1_ps(rowE[k]));
+          inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+        }
+        if (_mm_movemask_ps(inside) != 0) {
+          const __m128 d = _mm_add_ps(
+              _mm_set1_ps(rowDepth),
+              _mm_mul_ps(_mm_set1_ps(dx),
+                         _mm_sub_ps(center, _mm_set1_ps(t.x[0]))));
+          const __m128 old = _mm_loadu_ps(row + i);
+          const __m128 nearest = _mm_max_ps(old, d);
+          _mm_storeu_ps(row + i, _mm_or_ps(_mm_and_ps(inside, nearest),
+                                           _mm_andnot_ps(inside, old)));
+        }
+        x = _mm_add_ps(x, _mm_set1_ps(4.0f));
+      }
+#else
+      for (int i = x0; i <= x1; ++i) {
+        const float center = i + 0.5f;
+        bool inside = true;
+        for (int k = 0; k < 3; ++k)
+          inside = inside && (a[k] * (center - xr[k]) + rowE[k] >= 0.0f);
+        if (inside)
+          row[i] = qMax(row[i], rowDepth + dx * (center - t.x[0]));
+      }
+#endif
+    }
+  }
+
+  // Farthest depths of the tile
+  for (int l = 1; l <= tileLevels; ++l) {
+    const int size = tileSize >> l;
+    const int x = tileX >> l, y = tileY >> l;
+    const int w = levelSizes_[l].width();
+    const int fw = levelSizes_[l - 1].width();
+    const float *const fine = levels_[l - 1].constData();
+    float *const coarse = levels_[l].data();
+    for (int j = y; j < y + size; ++j)
+      for (int i = x; i < x + size; ++i) {
+        const float *f = fine + 2 * j * fw + 2 * i;
+        coarse[j * w + i] = qMin(qMin(f[0], f[1]), qMin(f[fw], f[fw + 1]));
+      }
+  }
+}
+
+// Levels above tileLevels, whose texels may have less than 4 children
+void SoftwareOcclusionCuller::buildUpperLevels() {
+  for (int l = tileLevels + 1; l < levels_.size(); ++l) {
+    const QSize size = levelSizes_[l];
+    const QSize fineSize = levelSizes_[l - 1];
+    const float *const fine = levels_[l - 1].constData();
+    float *const coarse = levels_[l].data();
+    for (int j = 0; j < size.height(); ++j)
+      for (int i = 0; i < size.width(); ++i) {
+        float depth = FLT_MAX;
+        for (int fj = 2 * j; fj < qMin(2 * j + 2, fineSize.height()); ++fj)
+          for (int fi = 2 * i; fi < qMin(2 * i + 2, fineSize.width()); ++fi)
+            depth = qMin(depth, fine[fj * fineSize.width() + fi]);
+        coarse[j * size.width() + i] = depth;
+      }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                             Occlusion tests                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns \c false when the axis aligned box defined by its \p min and \p max
+corners is hidden by the occluders, or outside of the field of view of the
+camera of the last rasterizeOccluders() call. Returns \c true otherwise, and
+when rasterizeOccluders() has not been called.
+
+The screen bounding rectangle of the box is compared to a level of the depth
+hierarchy that covers it with at most 3x3 texels: the test is conservative, and
+its cost does not depend on the size of the box. */
+bool SoftwareOcclusionCuller::isVisible(const Vec &min, const Vec &max) const {
+  if (!isRasterized_)
+    return true;
+
+  double minX = DBL_MAX, maxX = -DBL_MAX, minY = DBL_MAX, maxY = -DBL_MAX;
+  float nearest = -FLT_MAX;
+  for (int c = 0; c < 8; ++c) {
+    const Vec p((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y,
+                (c & 4) ? max.z : min.z);
+    const GLdouble z = eyeDepth(p);
+    // Crosses the near plane
+    if (z < zNear_)
+      return true;
+
+    const GLdouble w =
+        mvp_[3] * p.x + mvp_[7] * p.y + mvp_[11] * p.z + mvp_[15];
+    const double x =
+        (mvp_[0] * p.x + mvp_[4] * p.y + mvp_[8] * p.z + mvp_[12]) / w;
+    const double y =
+        (mvp_[1] * p.x + mvp_[5] * p.y + mvp_[9] * p.z + mvp_[13]) / w;
+    minX = qMin(minX, x);
+    maxX = qMax(maxX, x);
+    minY = qMin(minY, y);
+    maxY = qMax(maxY, y);
+    nearest = qMax(nearest, float(perspective_ ? 1.0 / z : -z));
+  }
+
+  const int width = resolution_.width(), height = resolution_.height();
+  minX = (0.5 * minX + 0.5) * width;
+  maxX = (0.5 * maxX + 0.5) * width;
+  minY = (0.5 * minY + 0.5) * height;
+  maxY = (0.5 * maxY + 0.5) * height;
+  if ((maxX < 0.0) || (maxY < 0.0) || (minX >= width) || (minY >= height))
+    return false;
+
+  // The pixels the rectangle overlaps
+  const int x0 = int(qMax(0.0, minX));
+  const int x1 = int(qMin(width - 1.0, maxX));
+  const int y0 = int(qMax(0.0, minY));
+  const int y1 = int(qMin(height - 1.0, maxY));
+
+  int l = 0;
+  while ((l + 1 < levels_.size()) &&
+         (((x1 >> l) - (x0 >> l) > 2) || ((y1 >> l) - (y0 >> l) > 2)))
+    ++l;
+
+  const float *const level = levels_[l].constData();
+  const int w = levelSizes_[l].width();
+  for (int j = y0 >> l; j <= (y1 >> l); ++j)
+    for (int i = x0 >> l; i <= (x1 >> l); ++i)
+      if (level[j * w + i] <= nearest)
+        return true;
+  return false;
+}
@@ -0,0 +1,140 @@
+#ifndef QGLVIEWER_SOFTWARE_OCCLUSION_CULLER_H
+#define QGLVIEWER_SOFTWARE_OCCLUSION_CULLER_H
+
+#include "vec.h"
+
+#include <QSize>
+#include <QVector>
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Occlusion culling with a CPU rasterized hierarchical depth buffer.
+  \class SoftwareOcclusionCuller softwareOcclusionCuller.h
+  QGLViewer/softwareOcclusionCuller.h
+
+  Unlike the hardware queries of the OcclusionCuller, which are only available
+  one frame later, a SoftwareOcclusionCuller has no latency and needs no OpenGL
+  context: it can also be used in batch jobs or worker threads.
+
+  Register a few large and simple triangle meshes (walls, terrain, buildings)
+  as occluders with addOccluder(). rasterizeOccluders() renders them, with the
+  Camera::getModelViewProjectionMatrix(), in a low resolution() depth buffer,
+  from which a hierarchy of conservative (farthest) depths is built. The
+  bounding boxes of the other objects are then tested with isVisible(),
+  typically after the FrustumCuller:
+  \code
+  void Viewer::draw() {
+    frustumCuller.computeVisibleObjects(camera(), visible);
+    occlusionCuller.rasterizeOccluders(camera());
+    for (int i = 0; i < visible.size(); ++i) {
+      const Object &o = object[visible[i]];
+      if (occlusionCuller.isVisible(o.min, o.max))
+        o.draw();
+    }
+  }
+  \endcode
+
+  The depth buffer is divided into 32x32 pixel tiles, rasterized in parallel
+  when parallelRasterization() is \c true. Four pixels are processed at once
+  with SSE2 instructions when they are available.
+
+  Occluder depths are sampled at the pixel centers: an occluder should be
+  inside the object it stands for, so that its silhouette does not hide the
+  objects seen around it. Both faces of the occluder triangles are rasterized.
+  isVisible() tests the bounding boxes against the depth hierarchy, using the
+  camera given to the last rasterizeOccluders() call. */
+class QGLVIEWER_EXPORT SoftwareOcclusionCuller {
+public:
+  SoftwareOcclusionCuller();
+  ~SoftwareOcclusionCuller();
+
+private:
+  Q_DISABLE_COPY(SoftwareOcclusionCuller)
+
+  /*! @name Occluders */
+  //@{
+public:
+  int addOccluder(const QVector<Vec> &vertices, const QVector<int> &triangles);
+  void setOccluder(int id, const QVector<Vec> &vertices,
+                   const QVector<int> &triangles);
+  void removeOccluder(int id);
+  void clear();
+
+  /*! Returns the number of registered occluders. */
+  int nbOccluders() const { return occluders_.size() - freeIds_.size(); }
+  //@}
+
+  /*! @name Depth buffer */
+  //@{
+public:
+  void rasterizeOccluders(const Camera *camera);
+
+  /*! Returns the size of the depth buffer, in pixels. Default value is 256x128.
+  A resolution with the aspect ratio of the viewer gives the most even
+  results. */
+  QSize resolution() const { return resolution_; }
+  void setResolution(const QSize &resolution);
+
+  /*! Returns \c true when the tiles of the depth buffer are rasterized in
+  parallel, over the TaskScheduler threads. Default value is \c true. */
+  bool parallelRasterization() const { return parallelRasterization_; }
+  void setParallelRasterization(bool parallel = true);
+  //@}
+
+  /*! @name Occlusion tests */
+  //@{
+public:
+  bool isVisible(const Vec &min, const Vec &max) const;
+  //@}
+
+private:
+  struct Occluder {
+    QVector<Vec> vertices;
+    QVector<int> triangles;
+    bool used;
+  };
+
+  // A triangle in depth buffer pixels, counter clockwise. The depth is
+  // 1/z for a perspective camera, -z for an orthographic one, z being the
+  // distance to the camera plane: it is affine in screen space, and larger
+  // for closer points.
+  struct Triangle {
+    float x[3], y[3], depth[3];
+  };
+
+  bool isValidId(int id, const char *method) const;
+  void projectOccluders();
+  void addTriangle(const GLdouble clip[3][4], const GLdouble z[3]);
+  void addProjectedTriangle(const GLdouble clip[3][4], const GLdouble z[3]);
+  void binTriangles();
+  void rasterizeTile(int tile);
+  void buildUpperLevels();
+  GLdouble eyeDepth(const Vec &p) const;
+
+  QVector<Occluder> occluders_;
+  QVector<int> freeIds_;
+  QSize resolution_;
+  bool parallelRasterization_;
+
+  // Camera of the last rasterizeOccluders()
+  bool isRasterized_;
+  bool perspective_;
+  GLdouble zNear_;
+  GLdouble mvp_[16];
+  GLdouble modelView_[16];
+
+  // Screen space triangles, and their indices in each tile
+  QVector<Triangle> triangles_;
+  QVector<QVector<int> > bins_;
+  int nbTilesX_, nbTilesY_;
+
+  // Level 0 is the depth buffer (rounded up to whole tiles), each texel of
+  // level l+1 holding the farthest depth of the 2x2 texels of level l.
+  QVector<QVector<float> > levels_;
+  QVector<QSize> levelSizes_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_SOFTWARE_OCCLUSION_CULLER_H
@@ -0,0 +1,254 @@
+#ifndef QGLVIEWER_STATIC_CONSTRAINT_H
+#define QGLVIEWER_STATIC_CONSTRAINT_H
+
+#include "camera.h"
+#include "constraint.h"
+#include "frame.h"
+#include "manipulatedCameraFrame.h"
+
+namespace qglviewer {
+
+/*! \brief The coordinate system of the directions of a StaticConstraint: the
+  Frame local coordinate system, as for a LocalConstraint.
+  \class LocalAxes staticConstraint.h QGLViewer/staticConstraint.h */
+struct LocalAxes {
+  /*! Returns the translation constraint \p direction, expressed in the
+  coordinate system of the \p frame translation. */
+  Vec translationDirection(const Vec &direction, const Frame *frame) const {
+    return frame->rotation().rotate(direction);
+  }
+  /*! Returns the rotation constraint \p direction, expressed in the \p frame
+  coordinate system. */
+  Vec rotationDirection(const Vec &direction, const Frame *) const {
+    return direction;
+  }
+};
+
+/*! \brief The coordinate system of the directions of a StaticConstraint: the
+  world coordinate system, as for a WorldConstraint.
+  \class WorldAxes staticConstraint.h QGLViewer/staticConstraint.h */
+struct WorldAxes {
+  /*! Same as LocalAxes::translationDirection(), for a world \p direction. */
+  Vec translationDirection(const Vec &direction, const Frame *frame) const {
+    if (frame->referenceFrame())
+      return frame->referenceFrame()->transformOf(direction);
+    return direction;
+  }
+  /*! Same as LocalAxes::rotationDirection(), for a world \p direction. */
+  Vec rotationDirection(const Vec &direction, const Frame *frame) const {
+    return frame->transformOf(direction);
+  }
+};
+
+/*! \brief The coordinate system of the directions of a StaticConstraint: the
+  coordinate system of a Camera, as for a CameraConstraint.
+  \class CameraAxes staticConstraint.h QGLViewer/staticConstraint.h */
+class CameraAxes {
+public:
+  /*! The directions are expressed in the \p camera coordinate system. */
+  explicit CameraAxes(const Camera *const camera) : camera_(camera) {}
+
+  /*! Returns the associated Camera. */
+  const Camera *camera() const { return camera_; }
+
+  /*! Same as LocalAxes::translationDirection(), for a camera() \p direction. */
+  Vec translationDirection(const Vec &direction, const Frame *frame) const {
+    const Vec proj = camera_->frame()->inverseTransformOf(direction);
+    if (frame->referenceFrame())
+      return frame->referenceFrame()->transformOf(proj);
+    return proj;
+  }
+  /*! Same as LocalAxes::rotationDirection(), for a camera() \p direction. */
+  Vec rotationDirection(const Vec &direction, const Frame *frame) const {
+    return frame->transformOf(camera_->frame()->inverseTransformOf(direction));
+  }
+
+private:
+  const Camera *camera_;
+};
+
+/*! \brief An AxisPlaneConstraint whose types are template parameters.
+  \class StaticConstraint staticConstraint.h QGLViewer/staticConstraint.h
+
+  The AxisPlaneConstraint classes are applied through the virtual
+  Constraint::constrainTranslation() and Constraint::constrainRotation()
+  methods, which then test their translationConstraintType() and
+  rotationConstraintType(). This is negligible for mouse interaction, but not
+  when a device updates many Frames at a high frequency.
+
+  A StaticConstraint is defined by its \p TranslationType, its \p RotationType
+  and the \p Axes of its directions (LocalAxes, WorldAxes or CameraAxes,
+  equivalent to a LocalConstraint, a WorldConstraint or a CameraConstraint).
+  These are known at compile time: filterTranslation() and filterRotation()
+  are inlined and reduced to the computation of their type.
+
+  Use its translate(), rotate(), setTranslationWithConstraint() and
+  setRotationWithConstraint() methods instead of the Frame ones to constrain
+  the Frame without virtual call. The StaticConstraint can also be the
+  Frame::constraint() of the Frame, so that it also applies to the mouse
+  manipulation of a ManipulatedFrame:
+  \code
+  // Translation along the world vertical axis, no rotation
+  typedef StaticConstraint<AxisPlaneConstraint::AXIS,
+                           AxisPlaneConstraint::FORBIDDEN, WorldAxes>
+      VerticalConstraint;
+
+  VerticalConstraint constraint(Vec(0.0, 0.0, 1.0));
+  manipulatedFrame->setConstraint(&constraint);
+
+  // Device input, at 1 kHz
+  Vec translation = device.translation();
+  constraint.setTranslationWithConstraint(*manipulatedFrame, translation);
+  \endcode
+
+  The \p RotationType cannot be AxisPlaneConstraint::PLANE. */
+template <AxisPlaneConstraint::Type TranslationType,
+          AxisPlaneConstraint::Type RotationType, class Axes = LocalAxes>
+class StaticConstraint : public Constraint {
+  static_assert(RotationType != AxisPlaneConstraint::PLANE,
+                "the PLANE type cannot be used for a rotation constraint");
+
+public:
+  /*! Creates a StaticConstraint. The directions are normalized, and are only
+  used by the AxisPlaneConstraint::AXIS and AxisPlaneConstraint::PLANE types.
+  \p axes defines their coordinate system (see CameraAxes). */
+  explicit StaticConstraint(const Vec &translationDirection = Vec(),
+                            const Vec &rotationDirection = Vec(),
+                            const Axes &axes = Axes())
+      : axes_(axes) {
+    setTranslationConstraintDirection(translationDirection);
+    setRotationConstraintDirection(rotationDirection);
+  }
+  /*! Virtual destructor. Empty. */
+  virtual ~StaticConstraint() {}
+
+  /*! @name Constraint types and directions */
+  //@{
+  /*! Returns the \p TranslationType template parameter. */
+  static AxisPlaneConstraint::Type translationConstraintType() {
+    return TranslationType;
+  }
+  /*! Returns the \p RotationType template parameter. */
+  static AxisPlaneConstraint::Type rotationConstraintType() {
+    return RotationType;
+  }
+
+  /*! Returns the direction of the translation constraint. See
+  AxisPlaneConstraint::translationConstraintDirection(). */
+  Vec translationConstraintDirection() const {
+    return translationConstraintDir_;
+  }
+  /*! Returns the direction of the rotation constraint. See
+  AxisPlaneConstraint::rotationConstraintDirection(). */
+  Vec rotationConstraintDirection() const { return rotationConstraintDir_; }
+
+  /*! Sets the translationConstraintDirection(). */
+  void setTranslationConstraintDirection(const Vec &direction) {
+    translationConstraintDir_ =
+        normalizedDirection(direction, TranslationType, "translation");
+  }
+  /*! Sets the rotationConstraintDirection(). */
+  void setRotationConstraintDirection(const Vec &direction) {
+    rotationConstraintDir_ =
+        normalizedDirection(direction, RotationType, "rotation");
+  }
+
+  /*! Returns the coordinate system of the directions. */
+  const Axes &axes() const { return axes_; }
+  //@}
+
+  /*! @name Filtering */
+  //@{
+  /*! Non virtual version of constrainTranslation(). \p translation is
+  expressed in the \p frame local coordinate system. */
+  void filterTranslation(Vec &translation, const Frame *const frame) const {
+    if (TranslationType == AxisPlaneConstraint::FORBIDDEN)
+      translation = Vec(0.0, 0.0, 0.0);
+    else if (TranslationType == AxisPlaneConstraint::AXIS)
+      translation.projectOnAxis(
+          axes_.translationDirection(translationConstraintDir_, frame));
+    else if (TranslationType == AxisPlaneConstraint::PLANE)
+      translation.projectOnPlane(
+          axes_.translationDirection(translationConstraintDir_, frame));
+  }
+
+  /*! Non virtual version of constrainRotation(). \p rotation is expressed in
+  the \p frame local coordinate system. */
+  void filterRotation(Quaternion &rotation, const Frame *const frame) const {
+    if (RotationType == AxisPlaneConstraint::FORBIDDEN)
+      rotation = Quaternion(); // identity
+    else if (RotationType == AxisPlaneConstraint::AXIS) {
+      Vec quat(rotation[0], rotation[1], rotation[2]);
+      quat.projectOnAxis(axes_.rotationDirection(rotationConstraintDir_, frame));
+      rotation = Quaternion(quat, 2.0 * acos(rotation[3]));
+    }
+  }
+
+  /*! Overloading of Constraint::constrainTranslation(), used by the Frame
+  methods. Calls filterTranslation(). */
+  virtual void constrainTranslation(Vec &translation, Frame *const frame) {
+    filterTranslation(translation, frame);
+  }
+  /*! Overloading of Constraint::constrainRotation(), used by the Frame
+  methods. Calls filterRotation(). */
+  virtual void constrainRotation(Quaternion &rotation, Frame *const frame) {
+    filterRotation(rotation, frame);
+  }
+  //@}
+
+  /*! @name Constrained Frame displacement */
+  //@{
+  /*! Same as Frame::translate(Vec&), with this constraint instead of the
+  Frame::constraint(). */
+  void translate(Frame &frame, Vec &translation) const {
+    filterTranslation(translation, &frame);
+    frame.setTranslation(frame.translation() + translation);
+  }
+  /*! Same as Frame::rotate(Quaternion&), with this constraint instead of the
+  Frame::constraint(). */
+  void rotate(Frame &frame, Quaternion &rotation) const {
+    filterRotation(rotation, &frame);
+    Quaternion q = frame.rotation() * rotation;
+    q.normalize(); // Prevents numerical drift
+    frame.setRotation(q);
+  }
+  /*! Same as Frame::setTranslationWithConstraint(), with this constraint
+  instead of the Frame::constraint(). */
+  void setTranslationWithConstraint(Frame &frame, Vec &translation) const {
+    Vec deltaT = translation - frame.translation();
+    translate(frame, deltaT);
+    translation = frame.translation();
+  }
+  /*! Same as Frame::setRotationWithConstraint(), with this constraint instead
+  of the Frame::constraint(). */
+  void setRotationWithConstraint(Frame &frame, Quaternion &rotation) const {
+    Quaternion deltaQ = frame.rotation().inverse() * rotation;
+    rotate(frame, deltaQ);
+    rotation = frame.rotation();
+  }
+  //@}
+
+private:
+  static Vec normalizedDirection(const Vec &direction,
+                                 AxisPlaneConstraint::Type type,
+                                 const char *name) {
+    if ((type != AxisPlaneConstraint::AXIS) &&
+        (type != AxisPlaneConstraint::PLANE))
+      return direction;
+
+    const qreal norm = direction.norm();
+    if (norm < 1E-8) {
+      qWarning("StaticConstraint: null vector for %s constraint", name);
+      return direction;
+    }
+    return direction / norm;
+  }
+
+  Axes axes_;
+  Vec translationConstraintDir_;
+  Vec rotationConstraintDir_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_STATIC_CONSTRAINT_H
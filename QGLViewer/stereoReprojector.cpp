@@ -0,0 +1,225 @@
+#include "stereoReprojector.h"
+#include "camera.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+using namespace qglviewer;
+
+// A triangle that covers the viewport, generated from gl_VertexID
+static const char *vertexShaderSource =
+    "out vec2 texCoord;\n"
+    "void main() {\n"
+    "  texCoord = vec2(float((gl_VertexID << 1) & 2), "
+    "float(gl_VertexID & 2));\n"
+    "  gl_Position = vec4(2.0 * texCoord - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// The parallax of a center view pixel at distance z is eye * (1 - f / z),
+// where eye is the disparity of the background in texture units and f the
+// focus distance. 1 / z is an affine function of the depth buffer value.
+static const char *fragmentShaderSource =
+    "uniform sampler2D colorTexture;\n"
+    "uniform sampler2D depthTexture;\n"
+    "uniform vec2 inverseDistance;\n"
+    "uniform float focusDistance;\n"
+    "uniform float leftEye;\n"
+    "uniform int view;\n"
+    "uniform int nbSamples;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragColor;\n"
+    "\n"
+    "float parallax(float u) {\n"
+    "  float depth = texture(depthTexture, vec2(u, texCoord.y)).r;\n"
+    "  float inverseZ = inverseDistance.x * depth + inverseDistance.y;\n"
+    "  return 1.0 - focusDistance * inverseZ;\n"
+    "}\n"
+    "\n"
+    "vec3 reproject(float eye) {\n"
+    "  // Candidate parallaxes from the background (1) to a third of the\n"
+    "  // focus distance (-2)\n"
+    "  float step = 3.0 / float(nbSamples - 1);\n"
+    "  float tolerance = abs(eye) * 0.5 * step +\n"
+    "                    1.0 / float(textureSize(depthTexture, 0).x);\n"
+    "  float nearest = 0.0, nearestParallax = 2.0;\n"
+    "  float farthest = texCoord.x, farthestParallax = -1.0e30;\n"
+    "  for (int i = 0; i < nbSamples; ++i) {\n"
+    "    float source = texCoord.x - eye * (1.0 - float(i) * step);\n"
+    "    float p = parallax(source);\n"
+    "    if (abs(source + eye * p - texCoord.x) <= tolerance &&\n"
+    "        p < nearestParallax) {\n"
+    "      nearest = source;\n"
+    "      nearestParallax = p;\n"
+    "    }\n"
+    "    if (p > farthestParallax) {\n"
+    "      farthest = source;\n"
+    "      farthestParallax = p;\n"
+    "    }\n"
+    "  }\n"
+    "  // Refined match, or hole filled with the background\n"
+    "  float u = (nearestParallax < 2.0)\n"
+    "                ? texCoord.x - eye * parallax(nearest)\n"
+    "                : farthest;\n"
+    "  return texture(colorTexture, vec2(u, texCoord.y)).rgb;\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "  if (view == 0)\n"
+    "    fragColor = vec4(reproject(leftEye), 1.0);\n"
+    "  else if (view == 1)\n"
+    "    fragColor = vec4(reproject(-leftEye), 1.0);\n"
+    "  else\n"
+    "    fragColor = vec4(reproject(leftEye).r, reproject(-leftEye).gb, 1.0);\n"
+    "}\n";
+
+/*! Creates a StereoReprojector. No OpenGL resource is created before the first
+bind(). */
+StereoReprojector::StereoReprojector()
+    : nbSamples_(32), initialized_(false), context_(nullptr),
+      program_(nullptr), vao_(nullptr) {}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+draw() is current. Call cleanupGL() before otherwise. */
+StereoReprojector::~StereoReprojector() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Redirects the rendering to the renderTarget(), resized to \p size pixels
+(usually the viewer's size times its device pixel ratio). Draw the scene with
+the mono-vision camera matrices, then call release(). The buffers are not
+cleared. Returns \c false when the framebuffer object cannot be created. */
+bool StereoReprojector::bind(const QSize &size) {
+  target_.setSize(size);
+  return target_.bind();
+}
+
+/*! Restores the framebuffer and the viewport that were used before bind(). */
+void StereoReprojector::release() { target_.release(); }
+
+/*! Sets the numberOfSamples(). Clamped to at least 2. */
+void StereoReprojector::setNumberOfSamples(int nbSamples) {
+  nbSamples_ = qMax(2, nbSamples);
+}
+
+/*! Releases the renderTarget() and the shader program. The context used by
+draw() must be current. */
+void StereoReprojector::cleanupGL() {
+  target_.cleanupGL();
+  if (vao_)
+    vao_->destroy();
+  delete vao_;
+  vao_ = nullptr;
+  delete program_;
+  program_ = nullptr;
+  initialized_ = false;
+  context_ = nullptr;
+}
+
+// Creates the shader program. Returns false if the context cannot run it.
+bool StereoReprojector::initializeGL() {
+  initialized_ = true;
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("StereoReprojector::draw: No current OpenGL context");
+    return false;
+  }
+  context_ = context;
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("StereoReprojector::draw: Requires OpenGL 3.3 or OpenGL ES 3.0");
+    return false;
+  }
+
+  vao_ = new QOpenGLVertexArrayObject();
+  if (!vao_->create()) {
+    qWarning("StereoReprojector::draw: Vertex array objects are not "
+             "supported");
+    return false;
+  }
+
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision highp float;\n"
+                                : "#version 330\n";
+  program_ = new QOpenGLShaderProgram();
+  // The linked program may come from the program binary cache
+  if (!program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Vertex, header + vertexShaderSource) ||
+      !program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource) ||
+      !program_->link()) {
+    qWarning("StereoReprojector::draw: Unable to build shaders: %s",
+             qPrintable(program_->log()));
+    return false;
+  }
+  return true;
+}
+
+/*! Draws the \p view synthesized from the renderTarget() content, over the
+whole current viewport, using the stereo parameters of \p camera. \p camera
+must be the one used to draw the center view, with unchanged matrices.
+
+The depth test and blending are disabled while drawing, and restored. */
+void StereoReprojector::draw(const Camera *camera, View view) {
+  if (!initialized_)
+    initializeGL();
+  if (!program_ || !program_->isLinked() || !target_.colorTexture())
+    return;
+
+  // 1/z = a * depth + b, from the depths of two points of the view direction
+  const Vec position = camera->position();
+  const Vec direction = camera->viewDirection();
+  const qreal z1 = camera->focusDistance();
+  const qreal z2 = 2.0 * z1;
+  const qreal d1 = camera->projectedCoordinatesOf(position + z1 * direction).z;
+  const qreal d2 = camera->projectedCoordinatesOf(position + z2 * direction).z;
+  qreal a = 0.0, b = 1.0 / z1;
+  if (d1 != d2) {
+    a = (1.0 / z1 - 1.0 / z2) / (d1 - d2);
+    b = 1.0 / z1 - a * d1;
+  }
+
+  // Half the background separation, in texture units: the stereo frustums
+  // shift the points at infinity by IODistance() on the physical screen
+  qreal leftEye = 0.0;
+  if (camera->type() == Camera::PERSPECTIVE)
+    leftEye = camera->IODistance() / (2.0 * camera->physicalScreenWidth());
+
+  QOpenGLFunctions *f = context_->functions();
+  const GLboolean depthTest = f->glIsEnabled(GL_DEPTH_TEST);
+  const GLboolean blend = f->glIsEnabled(GL_BLEND);
+  f->glDisable(GL_DEPTH_TEST);
+  f->glDisable(GL_BLEND);
+
+  GLint previousTexture = 0;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, target_.depthTexture());
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, target_.colorTexture());
+
+  program_->bind();
+  program_->setUniformValue("colorTexture", 0);
+  program_->setUniformValue("depthTexture", 1);
+  program_->setUniformValue("inverseDistance", GLfloat(a), GLfloat(b));
+  program_->setUniformValue("focusDistance", GLfloat(z1));
+  program_->setUniformValue("leftEye", GLfloat(leftEye));
+  program_->setUniformValue("view", int(view));
+  program_->setUniformValue("nbSamples", nbSamples_);
+
+  vao_->bind();
+  f->glDrawArrays(GL_TRIANGLES, 0, 3);
+  vao_->release();
+  program_->release();
+
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, 0);
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+  if (depthTest)
+    f->glEnable(GL_DEPTH_TEST);
+  if (blend)
+    f->glEnable(GL_BLEND);
+}
@@ -0,0 +1,108 @@
+#ifndef QGLVIEWER_STEREO_REPROJECTOR_H
+#define QGLVIEWER_STEREO_REPROJECTOR_H
+
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+
+#include "renderTarget.h"
+
+class QOpenGLContext;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Synthesizes the stereo views from a single rendering of the scene.
+  \class StereoReprojector stereoReprojector.h QGLViewer/stereoReprojector.h
+
+  Stereo display (see QGLViewer::displaysInStereo(), or the anaglyph contrib
+  example) draws the scene twice, once per eye. A StereoReprojector instead
+  renders the scene once, from the mono-vision camera, in its renderTarget().
+  The left and right views are then reconstructed by a fragment shader from
+  this color image and its depths, using the Camera::IODistance(),
+  Camera::physicalScreenWidth() and Camera::focusDistance() stereo parameters:
+  \code
+  void Viewer::draw() {
+    if (reprojector_.bind(size() * devicePixelRatioF())) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      drawScene();
+      reprojector_.release();
+    }
+    reprojector_.draw(camera(), qglviewer::StereoReprojector::ANAGLYPH);
+  }
+  \endcode
+
+  Each synthesized pixel looks for the center view pixel that the eye shift
+  moves onto it, along the same row, among numberOfSamples() candidates. The
+  nearest one is kept. Areas that the center camera does not see
+  (disocclusions) are filled with the farthest candidate, that is to say with
+  the background of the hole. The result is an approximation of the two pass
+  stereo images: transparent or view dependent effects are those of the center
+  view, and objects closer than a third of the Camera::focusDistance() are
+  given a reduced parallax. It is well suited for previews of heavy scenes,
+  whose draw() cost is halved.
+
+  The depths of the renderTarget() must use the depth convention of the camera
+  (see Camera::reverseZIsEnabled()), which is the case when the scene is drawn
+  with the camera matrices loaded by QGLViewer::preDraw(). Only the
+  Camera::PERSPECTIVE type is supported: the views of an orthographic camera
+  are displayed without parallax.
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. All the OpenGL methods must be called
+  with the same context current. Call cleanupGL() with this context current
+  before the StereoReprojector is destroyed. */
+class QGLVIEWER_EXPORT StereoReprojector {
+public:
+  /*! The images synthesized by draw(). */
+  enum View {
+    LEFT_VIEW,  /*!< The left eye view. */
+    RIGHT_VIEW, /*!< The right eye view. */
+    ANAGLYPH /*!< The red channel of the left view and the green and blue
+                channels of the right one, for red and cyan glasses. */
+  };
+
+  StereoReprojector();
+  ~StereoReprojector();
+
+  /*! @name Center view */
+  //@{
+public:
+  bool bind(const QSize &size);
+  void release();
+  /*! Returns the RenderTarget where the center view is drawn between bind()
+  and release(). */
+  RenderTarget &renderTarget() { return target_; }
+  //@}
+
+  /*! @name Stereo views */
+  //@{
+public:
+  void draw(const Camera *camera, View view);
+
+  /*! Returns the number of candidate pixels tested for each synthesized pixel.
+  More samples reduce the artifacts on thin objects, at a higher cost. Default
+  value is 32. */
+  int numberOfSamples() const { return nbSamples_; }
+  void setNumberOfSamples(int nbSamples);
+
+  void cleanupGL();
+  //@}
+
+private:
+  Q_DISABLE_COPY(StereoReprojector)
+
+  bool initializeGL();
+
+  int nbSamples_;
+  RenderTarget target_;
+
+  // O p e n G L
+  bool initialized_; // initializeGL() was called, successfully or not
+  QOpenGLContext *context_;
+  QOpenGLShaderProgram *program_;
+  QOpenGLVertexArrayObject *vao_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_STEREO_REPROJECTOR_H
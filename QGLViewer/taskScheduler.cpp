@@ -0,0 +1,151 @@
+#include "taskScheduler.h"
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+
+using namespace qglviewer;
+
+namespace {
+// The threads are kept alive: their creation would otherwise be paid after
+// each idle period
+class LibraryThreadPool : public QThreadPool {
+public:
+  LibraryThreadPool() { setExpiryTimeout(-1); }
+};
+
+Q_GLOBAL_STATIC(LibraryThreadPool, libraryThreadPool)
+QAtomicPointer<QThreadPool> applicationThreadPool;
+QAtomicInt workerPriority(QThread::InheritPriority);
+
+// Called by the tasks, in the worker threads
+void applyThreadPriority() {
+  const QThread::Priority priority =
+      QThread::Priority(workerPriority.loadRelaxed());
+  QThread *const thread = QThread::currentThread();
+  if ((priority != QThread::InheritPriority) &&
+      (thread->priority() != priority))
+    thread->setPriority(priority);
+}
+
+// A chunk of a parallelFor(), deleted by the caller, which may take it back
+class Chunk : public QRunnable {
+public:
+  Chunk(const std::function<void(int, int)> &function, int begin, int end,
+        QSemaphore &done)
+      : function_(function), begin_(begin), end_(end), done_(done) {
+    setAutoDelete(false);
+  }
+
+  void run() {
+    applyThreadPriority();
+    evaluate();
+    done_.release();
+  }
+
+  void evaluate() { function_(begin_, end_); }
+
+private:
+  const std::function<void(int, int)> &function_;
+  const int begin_, end_;
+  QSemaphore &done_;
+};
+} // namespace
+
+/*! Returns the pool whose threads run the parallel algorithms of the library.
+It is the pool given to setThreadPool(), or a library pool by default. */
+QThreadPool *TaskScheduler::threadPool() {
+  QThreadPool *const pool = applicationThreadPool.loadAcquire();
+  return pool ? pool : libraryThreadPool();
+}
+
+/*! Sets the threadPool(). \p pool is not owned by the library: it must remain
+valid while algorithms use it, or be replaced before it is deleted. Use \c
+nullptr to restore the library pool.
+
+The tasks of the library are short, and parallelFor() takes back the chunks
+that are not started: a busy application pool delays them, but does not make
+them wait for the application tasks. */
+void TaskScheduler::setThreadPool(QThreadPool *pool) {
+  applicationThreadPool.storeRelease(pool);
+}
+
+/*! Returns the maximum number of threads of the threadPool(). Default value
+is \c QThread::idealThreadCount() for the library pool. */
+int TaskScheduler::maxThreadCount() { return threadPool()->maxThreadCount(); }
+
+/*! Sets the maxThreadCount() of the threadPool(). parallelFor() creates at
+most as many chunks. */
+void TaskScheduler::setMaxThreadCount(int nb) {
+  threadPool()->setMaxThreadCount(qMax(1, nb));
+}
+
+/*! Returns the priority of the threads while they run tasks of the library.
+Default value is \c QThread::InheritPriority, which leaves their priority
+unchanged. */
+QThread::Priority TaskScheduler::threadPriority() {
+  return QThread::Priority(workerPriority.loadRelaxed());
+}
+
+/*! Sets the threadPriority(). It is applied by each thread when it starts a
+task of the library. */
+void TaskScheduler::setThreadPriority(QThread::Priority priority) {
+  workerPriority.storeRelaxed(priority);
+}
+
+/*! Calls \p function on consecutive ranges \c [begin, end) that cover \c [0,
+\p nbElements), in parallel, and returns once all of them are evaluated.
+
+Ranges contain at least \p minChunkSize elements, and there are at most
+maxThreadCount() of them. The calling thread evaluates the first range, and
+then the ranges that were not started by the threadPool() threads.
+
+\p function is called concurrently: it must not modify shared data, emit
+signals or issue OpenGL calls. */
+void TaskScheduler::parallelFor(int nbElements,
+                                const std::function<void(int, int)> &function,
+                                int minChunkSize) {
+  if (nbElements <= 0)
+    return;
+
+  QThreadPool *const pool = threadPool();
+  const int nbChunks = qBound(1, nbElements / qMax(minChunkSize, 1),
+                              pool->maxThreadCount());
+  if (nbChunks == 1) {
+    function(0, nbElements);
+    return;
+  }
+
+  QSemaphore done;
+  QVector<Chunk *> chunks;
+  chunks.reserve(nbChunks - 1);
+  // In 64 bits: c * nbElements overflows an int for large ranges
+  for (int c = 1; c < nbChunks; ++c) {
+    chunks.append(new Chunk(function, int(qint64(c) * nbElements / nbChunks),
+                            int(qint64(c + 1) * nbElements / nbChunks), done));
+    pool->start(chunks.last());
+  }
+  function(0, nbElements / nbChunks);
+
+  // The last chunks are the most likely to be still queued
+  int nbStarted = 0;
+  for (int c = chunks.size() - 1; c >= 0; --c)
+    if (pool->tryTake(chunks[c]))
+      chunks[c]->evaluate();
+    else
+      ++nbStarted;
+  done.acquire(nbStarted);
+  qDeleteAll(chunks);
+}
+
+/*! Starts \p task on the threadPool(), with the threadPriority(). Returns
+immediately. */
+void TaskScheduler::start(const std::function<void()> &task) {
+  threadPool()->start(QRunnable::create([task]() {
+    applyThreadPriority();
+    task();
+  }));
+}
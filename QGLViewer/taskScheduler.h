@@ -0,0 +1,62 @@
+#ifndef QGLVIEWER_TASK_SCHEDULER_H
+#define QGLVIEWER_TASK_SCHEDULER_H
+
+#include <QThread>
+
+#include <functional>
+
+#include "config.h"
+
+class QThreadPool;
+
+namespace qglviewer {
+/*! \brief The worker threads shared by the parallel algorithms of the
+  library.
+  \class TaskScheduler taskScheduler.h QGLViewer/taskScheduler.h
+
+  QGLViewer::parallelFor(), the parallel evaluations of FramePool and
+  InterpolationScheduler, the parallel rasterization of
+  SoftwareOcclusionCuller and the sorting stages of the vectorial snapshots
+  all run on the same threadPool(), so that enabling several of them does not
+  create more threads than the machine has cores. The snapshot encoders and
+  the VRenderBatch workers, which wait for their own tasks, use at most
+  maxThreadCount() threads.
+
+  The threadPool() is a library pool by default, whose maxThreadCount() is
+  the number of cores. Reduce it on a shared render server, or give the pool
+  of your application to setThreadPool(), so that the library and the
+  application share their threads:
+  \code
+  qglviewer::TaskScheduler::setMaxThreadCount(4);
+  qglviewer::TaskScheduler::setThreadPriority(QThread::LowPriority);
+  \endcode
+
+  parallelFor() splits a range in chunks, started on the threadPool(). The
+  calling thread evaluates a chunk, and then takes back the chunks that no
+  worker has started yet: a parallelFor() called while the pool is busy,
+  including from one of its own threads, is evaluated by the calling thread
+  instead of waiting.
+
+  All the methods are thread safe. */
+class QGLVIEWER_EXPORT TaskScheduler {
+public:
+  static QThreadPool *threadPool();
+  static void setThreadPool(QThreadPool *pool);
+
+  static int maxThreadCount();
+  static void setMaxThreadCount(int nb);
+  static QThread::Priority threadPriority();
+  static void setThreadPriority(QThread::Priority priority);
+
+  static void parallelFor(int nbElements,
+                          const std::function<void(int, int)> &function,
+                          int minChunkSize = 1);
+  static void start(const std::function<void()> &task);
+
+private:
+  TaskScheduler();
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_TASK_SCHEDULER_H
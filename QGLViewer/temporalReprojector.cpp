@@ -0,0 +1,314 @@
+#include "temporalReprojector.h"
+#include "camera.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+using namespace qglviewer;
+
+// Pixels between two vertices of the warped grid
+static const int cellSize = 2;
+
+// Relative difference of the distances of the corners of a triangle above
+// which it straddles a depth discontinuity
+static const float discontinuityThreshold = 0.05f;
+
+// Two triangles per grid cell, generated from gl_VertexID. Each vertex fetches
+// the depths of the three corners of its triangle, so that all of them agree
+// on discarding it.
+static const char *vertexShaderSource =
+    "uniform sampler2D depthTexture;\n"
+    "uniform int nbColumns;\n"
+    "uniform int cellSize;\n"
+    "uniform mat4 previousProjection;\n"
+    "uniform mat4 reprojection;\n"
+    "uniform bool perspective;\n"
+    "uniform vec2 depthToDistance;\n"
+    "uniform float backgroundDepth;\n"
+    "uniform float threshold;\n"
+    "out vec2 texCoord;\n"
+    "\n"
+    "const ivec2 corners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0),\n"
+    "                                  ivec2(1, 1), ivec2(0, 0),\n"
+    "                                  ivec2(1, 1), ivec2(0, 1));\n"
+    "\n"
+    "float distanceOf(float depth) {\n"
+    "  float d = depthToDistance.x * depth + depthToDistance.y;\n"
+    "  return perspective ? 1.0 / d : d;\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "  ivec2 size = textureSize(depthTexture, 0);\n"
+    "  int cell = gl_VertexID / 6;\n"
+    "  int corner = gl_VertexID - 6 * cell;\n"
+    "  int first = (corner < 3) ? 0 : 3;\n"
+    "  int row = cell / nbColumns;\n"
+    "  ivec2 origin = cellSize * ivec2(cell - nbColumns * row, row);\n"
+    "\n"
+    "  bool valid = true;\n"
+    "  float nearest = 1.0e30, farthest = 0.0;\n"
+    "  for (int i = first; i < first + 3; ++i) {\n"
+    "    ivec2 p = min(origin + cellSize * corners[i], size - 1);\n"
+    "    float depth = texelFetch(depthTexture, p, 0).r;\n"
+    "    valid = valid && (depth != backgroundDepth);\n"
+    "    float d = distanceOf(depth);\n"
+    "    nearest = min(nearest, d);\n"
+    "    farthest = max(farthest, d);\n"
+    "  }\n"
+    "  if (!valid || (farthest - nearest > threshold * nearest)) {\n"
+    "    // Outside of the clipping volume: the triangle is discarded\n"
+    "    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+    "    texCoord = vec2(0.0);\n"
+    "    return;\n"
+    "  }\n"
+    "\n"
+    "  ivec2 pixel = min(origin + cellSize * corners[corner], size - 1);\n"
+    "  texCoord = (vec2(pixel) + 0.5) / vec2(size);\n"
+    "  // Eye coordinates of the pixel in the previous view\n"
+    "  float z = -distanceOf(texelFetch(depthTexture, pixel, 0).r);\n"
+    "  float w = previousProjection[2][3] * z + previousProjection[3][3];\n"
+    "  vec2 xy = ((2.0 * texCoord - 1.0) * w - previousProjection[2].xy * z -\n"
+    "             previousProjection[3].xy) /\n"
+    "            vec2(previousProjection[0][0], previousProjection[1][1]);\n"
+    "  gl_Position = reprojection * vec4(xy, z, 1.0);\n"
+    "}\n";
+
+static const char *fragmentShaderSource =
+    "uniform sampler2D colorTexture;\n"
+    "uniform bool mask;\n"
+    "uniform float maskDepth;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "  fragColor = texture(colorTexture, texCoord);\n"
+    "  gl_FragDepth = mask ? maskDepth : gl_FragCoord.z;\n"
+    "}\n";
+
+// Returns m, given in column-major order
+static QMatrix4x4 matrixOf(const GLfloat m[16]) {
+  return QMatrix4x4(m).transposed();
+}
+
+/*! Creates an uninitialized TemporalReprojector. Call initialize() once the
+OpenGL context is current. */
+TemporalReprojector::TemporalReprojector()
+    : current_(0), nbReprojectedFrames_(0), context_(nullptr),
+      program_(nullptr), vao_(nullptr) {
+  views_[0].isValid = views_[1].isValid = false;
+}
+
+/*! Destructor. The OpenGL resources are only released when the context used by
+initialize() is current. Call cleanupGL() before otherwise. */
+TemporalReprojector::~TemporalReprojector() {
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+/*! Redirects the rendering to the target that does not hold the previous
+frame, resized to \p size pixels. The buffers are not cleared. Returns \c
+false when the framebuffer object cannot be created. */
+bool TemporalReprojector::bind(const QSize &size) {
+  current_ = 1 - current_;
+  views_[current_].isValid = false;
+  targets_[current_].setSize(size);
+  return targets_[current_].bind();
+}
+
+/*! Restores the framebuffer and the viewport that were used before bind(), and
+records the view of \p camera, which drew the frame. \p reprojected tells
+whether drawPreviousFrame() was used, which is counted by
+nbReprojectedFrames(). */
+void TemporalReprojector::release(const Camera *camera, bool reprojected) {
+  targets_[current_].release();
+  nbReprojectedFrames_ = reprojected ? nbReprojectedFrames_ + 1 : 0;
+
+  View &view = views_[current_];
+  GLfloat m[16];
+  camera->getModelViewMatrix(m);
+  view.modelView = matrixOf(m);
+  camera->getProjectionMatrix(m);
+  view.projection = matrixOf(m);
+  view.perspective = (camera->type() == Camera::PERSPECTIVE);
+  view.backgroundDepth = camera->reverseZIsEnabled() ? 0.0f : 1.0f;
+
+  // The distance (or its inverse in perspective) is an affine function of the
+  // depth buffer value, fitted on two points of the view direction
+  const Vec position = camera->position();
+  const Vec direction = camera->viewDirection();
+  const qreal z1 = camera->zNear();
+  const qreal z2 = camera->zFar();
+  const qreal d1 = camera->projectedCoordinatesOf(position + z1 * direction).z;
+  const qreal d2 = camera->projectedCoordinatesOf(position + z2 * direction).z;
+  const qreal f1 = view.perspective ? 1.0 / z1 : z1;
+  const qreal f2 = view.perspective ? 1.0 / z2 : z2;
+  view.isValid = (d1 != d2);
+  if (view.isValid) {
+    const qreal a = (f1 - f2) / (d1 - d2);
+    view.depthToDistance[0] = GLfloat(a);
+    view.depthToDistance[1] = GLfloat(f1 - a * d1);
+  }
+}
+
+/*! Returns \c true when the last frame drawn between bind() and release() has
+\p size pixels, and can hence be warped by the drawPreviousFrame() of the next
+one. Call it before bind(). */
+bool TemporalReprojector::hasPreviousFrame(const QSize &size) const {
+  return views_[current_].isValid && (targets_[current_].size() == size) &&
+         (targets_[current_].colorTexture() != 0);
+}
+
+/*! Forgets the previous frame: the next frame is fully drawn. */
+void TemporalReprojector::invalidate() {
+  views_[0].isValid = views_[1].isValid = false;
+  nbReprojectedFrames_ = 0;
+}
+
+/*! Releases the render targets and the shader program. The context used by
+initialize() must be current. */
+void TemporalReprojector::cleanupGL() {
+  targets_[0].cleanupGL();
+  targets_[1].cleanupGL();
+  invalidate();
+  if (vao_)
+    vao_->destroy();
+  delete vao_;
+  vao_ = nullptr;
+  delete program_;
+  program_ = nullptr;
+  context_ = nullptr;
+}
+
+/*! Creates the shader program. Returns \c false (and isInitialized() remains
+\c false) if the current context cannot run it, in which case QGLViewer does
+not reproject its frames. */
+bool TemporalReprojector::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("TemporalReprojector::initialize: No current OpenGL "
+             "context");
+    return false;
+  }
+  context_ = context;
+
+  const QSurfaceFormat format = context->format();
+  const int version = 10 * format.majorVersion() + format.minorVersion();
+  if (version < (context->isOpenGLES() ? 30 : 33)) {
+    qWarning("TemporalReprojector::initialize: Requires OpenGL 3.3 or "
+             "OpenGL ES 3.0");
+    return false;
+  }
+
+  vao_ = new QOpenGLVertexArrayObject();
+  if (!vao_->create()) {
+    qWarning("TemporalReprojector::initialize: Vertex array objects "
+             "are not supported");
+    return false;
+  }
+
+  const QByteArray header = context->isOpenGLES()
+                                ? "#version 300 es\nprecision highp float;\n"
+                                : "#version 330\n";
+  program_ = new QOpenGLShaderProgram();
+  // The linked program may come from the program binary cache
+  if (!program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Vertex, header + vertexShaderSource) ||
+      !program_->addCacheableShaderFromSourceCode(
+          QOpenGLShader::Fragment, header + fragmentShaderSource) ||
+      !program_->link()) {
+    qWarning("TemporalReprojector::initialize: Unable to build "
+             "shaders: %s",
+             qPrintable(program_->log()));
+    return false;
+  }
+  return true;
+}
+
+/*! Draws the \p pass of the previous frame, warped to the current view of \p
+camera, in the current framebuffer (usually the target bound by bind()).
+Does nothing before a successful initialize().
+
+The blending and face culling are disabled while drawing. The depth test is
+enabled, with \c GL_ALWAYS for MASK_PASS and DEPTH_PASS. These states and the
+color mask are restored. */
+void TemporalReprojector::drawPreviousFrame(const Camera *camera, Pass pass) {
+  const int previous = 1 - current_;
+  if (!isInitialized() || !views_[previous].isValid)
+    return;
+
+  const View &view = views_[previous];
+  const RenderTarget &target = targets_[previous];
+  const int nbColumns = (target.size().width() + cellSize - 2) / cellSize;
+  const int nbRows = (target.size().height() + cellSize - 2) / cellSize;
+  if ((nbColumns <= 0) || (nbRows <= 0))
+    return;
+
+  GLfloat m[16];
+  camera->getProjectionMatrix(m);
+  QMatrix4x4 reprojection = matrixOf(m);
+  camera->getModelViewMatrix(m);
+  reprojection *= matrixOf(m) * view.modelView.inverted();
+
+  QOpenGLFunctions *f = context_->functions();
+  const GLboolean depthTest = f->glIsEnabled(GL_DEPTH_TEST);
+  const GLboolean blend = f->glIsEnabled(GL_BLEND);
+  const GLboolean cullFace = f->glIsEnabled(GL_CULL_FACE);
+  GLint depthFunc = GL_LESS;
+  f->glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+  GLboolean depthMask = GL_TRUE;
+  f->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+  GLboolean colorMask[4] = {GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE};
+  f->glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+
+  f->glEnable(GL_DEPTH_TEST);
+  f->glDisable(GL_BLEND);
+  f->glDisable(GL_CULL_FACE);
+  f->glDepthMask(GL_TRUE);
+  if (pass == COLOR_PASS)
+    f->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  else {
+    f->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    f->glDepthFunc(GL_ALWAYS);
+  }
+
+  GLint previousTexture = 0;
+  f->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, target.depthTexture());
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, target.colorTexture());
+
+  program_->bind();
+  program_->setUniformValue("colorTexture", 0);
+  program_->setUniformValue("depthTexture", 1);
+  program_->setUniformValue("nbColumns", nbColumns);
+  program_->setUniformValue("cellSize", cellSize);
+  program_->setUniformValue("previousProjection", view.projection);
+  program_->setUniformValue("reprojection", reprojection);
+  program_->setUniformValue("perspective", view.perspective);
+  program_->setUniformValue("depthToDistance", view.depthToDistance[0],
+                            view.depthToDistance[1]);
+  program_->setUniformValue("backgroundDepth", view.backgroundDepth);
+  program_->setUniformValue("threshold", discontinuityThreshold);
+  program_->setUniformValue("mask", pass == MASK_PASS);
+  // The nearest depth, which rejects all the fragments of the scene
+  program_->setUniformValue("maskDepth", 1.0f - view.backgroundDepth);
+
+  vao_->bind();
+  f->glDrawArrays(GL_TRIANGLES, 0, 6 * nbColumns * nbRows);
+  vao_->release();
+  program_->release();
+
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, 0);
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+  f->glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+  f->glDepthMask(depthMask);
+  f->glDepthFunc(GLenum(depthFunc));
+  if (!depthTest)
+    f->glDisable(GL_DEPTH_TEST);
+  if (blend)
+    f->glEnable(GL_BLEND);
+  if (cullFace)
+    f->glEnable(GL_CULL_FACE);
+}
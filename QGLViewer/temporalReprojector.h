@@ -0,0 +1,96 @@
+#ifndef QGLVIEWER_TEMPORAL_REPROJECTOR_H
+#define QGLVIEWER_TEMPORAL_REPROJECTOR_H
+
+#include <QMatrix4x4>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+
+#include "renderTarget.h"
+
+class QOpenGLContext;
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Warps the previous frame to the current camera, so that only the
+  disoccluded pixels are drawn again.
+  \class TemporalReprojector temporalReprojector.h
+
+  This internal class is used by QGLViewer when
+  QGLViewer::reprojectionIsEnabled(). The frames are rendered, in turn, in two
+  RenderTargets. The view of each frame (its camera matrices and depth
+  conventions) is recorded by release().
+
+  drawPreviousFrame() renders a grid mesh, one vertex every two pixels of the
+  previous frame, whose vertices are moved at the position of their depth
+  seen from the current camera. Triangles that straddle a depth discontinuity
+  or the background are discarded: these holes are the disocclusions, and the
+  parts of the view that were not seen before. The mesh is drawn three times:
+  - COLOR_PASS, with the regular depth test, which resolves the overlaps.
+  - MASK_PASS, which replaces the depths of the warped pixels by the near
+    plane, so that the depth test rejects the scene fragments drawn between
+    MASK_PASS and DEPTH_PASS everywhere but in the holes.
+  - DEPTH_PASS, that restores the warped depths, used by the next frame.
+
+  Requires OpenGL 3.3 or OpenGL ES 3.0. All the OpenGL methods must be called
+  with the same context current. Call cleanupGL() with this context current
+  before the TemporalReprojector is destroyed. */
+class TemporalReprojector {
+public:
+  /*! The draws of the previous frame made by drawPreviousFrame(). */
+  enum Pass { COLOR_PASS, MASK_PASS, DEPTH_PASS };
+
+  TemporalReprojector();
+  ~TemporalReprojector();
+
+  bool initialize();
+  /*! Returns \c true when initialize() succeeded. */
+  bool isInitialized() const { return program_ && program_->isLinked(); }
+
+  bool bind(const QSize &size);
+  void release(const Camera *camera, bool reprojected);
+  /*! Returns the color texture of the last frame drawn between bind() and
+  release(). */
+  GLuint colorTexture() const { return targets_[current_].colorTexture(); }
+
+  bool hasPreviousFrame(const QSize &size) const;
+  /*! Returns the number of consecutive reprojected frames (see release())
+  since the last frame that was fully drawn. */
+  int nbReprojectedFrames() const { return nbReprojectedFrames_; }
+  void drawPreviousFrame(const Camera *camera, Pass pass);
+  void invalidate();
+
+  void cleanupGL();
+  /*! Returns the number of bytes of the textures of the two stored frames.
+  See QGLViewer::memoryUsage(). */
+  qint64 memoryUsage() const {
+    return targets_[0].memoryUsage() + targets_[1].memoryUsage();
+  }
+
+private:
+  Q_DISABLE_COPY(TemporalReprojector)
+
+  // Camera of the frame drawn in a target
+  struct View {
+    bool isValid;
+    QMatrix4x4 modelView, projection;
+    bool perspective;
+    GLfloat depthToDistance[2]; // affine map to the distance (or its inverse)
+    GLfloat backgroundDepth;
+  };
+
+  RenderTarget targets_[2];
+  View views_[2];
+  int current_; // target of the last bind()
+  int nbReprojectedFrames_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLShaderProgram *program_;
+  QOpenGLVertexArrayObject *vao_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_TEMPORAL_REPROJECTOR_H
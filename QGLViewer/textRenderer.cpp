@@ -0,0 +1,269 @@
+#include "textRenderer.h"
+#include "config.h"
+#include "frameRingBuffer.h"
+
+#include <QFontMetricsF>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QPainter>
+#include <QtMath>
+
+#include <cstring>
+
+using namespace qglviewer;
+
+// Atlas width and maximum height. The height is doubled when needed.
+static const int atlasWidth = 512;
+static const int atlasMaxHeight = 4096;
+// Empty pixels around each glyph, avoids bleeding with linear filtering
+static const int glyphMargin = 1;
+
+/*! Creates an empty renderer. No OpenGL call is made before draw(). */
+TextRenderer::TextRenderer()
+    : atlasIsModified_(false), atlasIsFull_(false), devicePixelRatio_(1.0),
+      textureId_(0), vbo_(QOpenGLBuffer::VertexBuffer), ringBuffer_(nullptr) {
+  vbo_.setUsagePattern(QOpenGLBuffer::StreamDraw);
+  resetAtlas(256);
+}
+
+/*! Releases the OpenGL resources. The context used by draw() must be
+current. */
+TextRenderer::~TextRenderer() {
+  vbo_.destroy();
+  if (textureId_)
+    glDeleteTextures(1, &textureId_);
+}
+
+/*! Defines the resolution of the atlas: the logical \p dotsPerInch of the
+viewer and its \p devicePixelRatio. Glyphs are rasterized in device pixels, and
+are all discarded when the resolution changes. */
+void TextRenderer::setResolution(qreal dotsPerInch, qreal devicePixelRatio) {
+  const int dotsPerMeter = qRound(dotsPerInch * devicePixelRatio / 0.0254);
+  if ((atlas_.dotsPerMeterX() == dotsPerMeter) &&
+      (devicePixelRatio_ == devicePixelRatio))
+    return;
+
+  devicePixelRatio_ = devicePixelRatio;
+  resetAtlas(atlas_.height());
+  atlas_.setDotsPerMeterX(dotsPerMeter);
+  atlas_.setDotsPerMeterY(dotsPerMeter);
+}
+
+// Discards all the glyphs, and clears the atlas with the given height.
+void TextRenderer::resetAtlas(int height) {
+  const int dotsPerMeterX = atlas_.dotsPerMeterX();
+  const int dotsPerMeterY = atlas_.dotsPerMeterY();
+  atlas_ = QImage(atlasWidth, height, QImage::Format_ARGB32_Premultiplied);
+  atlas_.fill(Qt::transparent);
+  if (dotsPerMeterX > 0) {
+    atlas_.setDotsPerMeterX(dotsPerMeterX);
+    atlas_.setDotsPerMeterY(dotsPerMeterY);
+  }
+  glyphs_.clear();
+  atlasX_ = 0;
+  atlasY_ = 0;
+  atlasRowHeight_ = 0;
+  atlasIsModified_ = true;
+  atlasIsFull_ = false;
+}
+
+// Returns the glyph of c, rasterized in the atlas if needed. Returns nullptr
+// when the atlas is full.
+const TextRenderer::Glyph *TextRenderer::glyph(const QFont &font,
+                                               const QString &fontKey,
+                                               QChar c) {
+  QHash<ushort, Glyph> &glyphs = glyphs_[fontKey];
+  QHash<ushort, Glyph>::const_iterator it = glyphs.constFind(c.unicode());
+  if (it != glyphs.constEnd())
+    return &(it.value());
+
+  // Metrics are given in atlas pixels, thanks to its resolution
+  const QFontMetricsF metrics(font, &atlas_);
+  const QRectF bounds = metrics.boundingRect(c);
+  const int w = qCeil(bounds.width()) + 2 * glyphMargin;
+  const int h = qCeil(bounds.height()) + 2 * glyphMargin;
+
+  if (atlasX_ + w > atlas_.width()) {
+    atlasX_ = 0;
+    atlasY_ += atlasRowHeight_;
+    atlasRowHeight_ = 0;
+  }
+  if (atlasY_ + h > atlas_.height()) {
+    int height = atlas_.height();
+    while ((atlasY_ + h > height) && (height < atlasMaxHeight))
+      height *= 2;
+    if ((atlasY_ + h > height) || (w > atlas_.width())) {
+      // Reset after this frame
+      atlasIsFull_ = true;
+      return nullptr;
+    }
+    // Texture coordinates are in pixels: placed glyphs remain valid
+    QImage atlas(atlasWidth, height, QImage::Format_ARGB32_Premultiplied);
+    atlas.fill(Qt::transparent);
+    atlas.setDotsPerMeterX(atlas_.dotsPerMeterX());
+    atlas.setDotsPerMeterY(atlas_.dotsPerMeterY());
+    QPainter painter(&atlas);
+    painter.drawImage(0, 0, atlas_);
+    painter.end();
+    atlas_ = atlas;
+  }
+
+  Glyph g;
+  g.rect = QRect(atlasX_, atlasY_, w, h);
+  g.offset = QPointF(bounds.x() - glyphMargin, bounds.y() - glyphMargin) /
+             devicePixelRatio_;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+  g.advance = metrics.horizontalAdvance(c) / devicePixelRatio_;
+#else
+  g.advance = metrics.width(c) / devicePixelRatio_;
+#endif
+
+  if (!c.isSpace()) {
+    QPainter painter(&atlas_);
+    painter.setPen(Qt::white);
+    painter.setFont(font);
+    painter.drawText(QPointF(atlasX_ + glyphMargin - bounds.x(),
+                             atlasY_ + glyphMargin - bounds.y()),
+                     QString(c));
+    painter.end();
+    atlasIsModified_ = true;
+  }
+
+  atlasX_ += w;
+  atlasRowHeight_ = qMax(atlasRowHeight_, h);
+  return &(glyphs.insert(c.unicode(), g).value());
+}
+
+/*! Appends \p text, drawn with \p font and \p color at the \p x, \p y
+baseline position. Coordinates are expressed in logical pixels, origin in the
+upper left corner of the widget. */
+void TextRenderer::addText(qreal x, qreal y, const QString &text,
+                           const QFont &font, const QColor &color) {
+  const QString fontKey = font.key();
+  const GLfloat rgba[4] = {GLfloat(color.redF()), GLfloat(color.greenF()),
+                           GLfloat(color.blueF()), GLfloat(color.alphaF())};
+
+  qreal penX = x;
+  for (int i = 0; i < text.size(); ++i) {
+    const Glyph *g = glyph(font, fontKey, text.at(i));
+    if (!g)
+      continue;
+
+    if (!text.at(i).isSpace()) {
+      const GLfloat x0 = GLfloat(penX + g->offset.x());
+      const GLfloat y0 = GLfloat(y + g->offset.y());
+      const GLfloat x1 = x0 + GLfloat(g->rect.width() / devicePixelRatio_);
+      const GLfloat y1 = y0 + GLfloat(g->rect.height() / devicePixelRatio_);
+      const GLfloat u0 = GLfloat(g->rect.left());
+      const GLfloat v0 = GLfloat(g->rect.top());
+      const GLfloat u1 = u0 + GLfloat(g->rect.width());
+      const GLfloat v1 = v0 + GLfloat(g->rect.height());
+
+      const GLfloat corners[6][4] = {{x0, y0, u0, v0}, {x1, y0, u1, v0},
+                                     {x1, y1, u1, v1}, {x0, y0, u0, v0},
+                                     {x1, y1, u1, v1}, {x0, y1, u0, v1}};
+      for (int v = 0; v < 6; ++v) {
+        for (int k = 0; k < 4; ++k)
+          vertices_.append(corners[v][k]);
+        for (int k = 0; k < 4; ++k)
+          vertices_.append(rgba[k]);
+      }
+    }
+    penX += g->advance;
+  }
+}
+
+/*! Draws all the texts added since the previous call in a single draw call,
+for a viewer of \p width x \p height logical pixels. The OpenGL state and
+matrices are preserved. */
+void TextRenderer::draw(int width, int height) {
+  if (vertices_.isEmpty())
+    return;
+
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT |
+               GL_CURRENT_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+  if (!textureId_)
+    glGenTextures(1, &textureId_);
+  glBindTexture(GL_TEXTURE_2D, textureId_);
+  if (atlasIsModified_) {
+    const QImage image = atlas_.convertToFormat(QImage::Format_RGBA8888);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width(), image.height(), 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    atlasIsModified_ = false;
+  }
+
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_TEXTURE_2D);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // Texture coordinates are expressed in atlas pixels
+  glMatrixMode(GL_TEXTURE);
+  glPushMatrix();
+  glLoadIdentity();
+  glScaled(1.0 / atlas_.width(), 1.0 / atlas_.height(), 1.0);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, width, height, 0, -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  const int size = int(vertices_.size() * sizeof(GLfloat));
+  FrameRingBuffer::Allocation allocation;
+  if (ringBuffer_)
+    allocation = ringBuffer_->allocate(size);
+
+  // Client memory is used when no buffer is available in this context
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  const GLfloat *data = vertices_.constData();
+  bool useVBO = false;
+  if (allocation.isValid()) {
+    memcpy(allocation.data, data, size);
+    f->glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+    data = static_cast<const GLfloat *>(allocation.pointer());
+  } else if ((vbo_.isCreated() || vbo_.create()) && vbo_.bind()) {
+    vbo_.allocate(data, size);
+    data = nullptr;
+    useVBO = true;
+  }
+
+  const GLsizei stride = 8 * sizeof(GLfloat);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, stride, data);
+  glTexCoordPointer(2, GL_FLOAT, stride, data + 2);
+  glColorPointer(4, GL_FLOAT, stride, data + 4);
+  glDrawArrays(GL_TRIANGLES, 0, vertices_.size() / 8);
+
+  if (useVBO)
+    vbo_.release();
+  else if (allocation.isValid())
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glMatrixMode(GL_TEXTURE);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+
+  glPopClientAttrib();
+  glPopAttrib();
+
+  vertices_.clear();
+  if (atlasIsFull_)
+    resetAtlas(atlas_.height());
+}
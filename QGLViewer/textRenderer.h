@@ -0,0 +1,72 @@
+#ifndef QGLVIEWER_TEXT_RENDERER_H
+#define QGLVIEWER_TEXT_RENDERER_H
+
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QString>
+#include <QVector>
+
+namespace qglviewer {
+class FrameRingBuffer;
+
+/*! \brief Draws the QGLViewer texts in batches, using a glyph texture atlas.
+  \class TextRenderer textRenderer.h
+
+  This internal class is used by QGLViewer::renderText() when
+  QGLViewer::textIsBatched() is \c true. The glyphs are rasterized once by
+  Qt in a texture atlas. Each addText() call only appends textured quads to a
+  vertex array, which is drawn by a single draw() call at the end of the frame.
+
+  Characters are laid out one after the other, using their advance: kerning
+  and complex text shaping are not supported.
+
+  The vertices are written in the viewer's FrameRingBuffer when one was set
+  with setFrameRingBuffer(), and streamed in a vertex buffer otherwise.
+
+  draw() and the destructor require the viewer's OpenGL context to be
+  current. */
+class TextRenderer {
+public:
+  TextRenderer();
+  ~TextRenderer();
+
+  void setResolution(qreal dotsPerInch, qreal devicePixelRatio);
+  void addText(qreal x, qreal y, const QString &text, const QFont &font,
+               const QColor &color);
+  /*! Returns \c true when no text was added since the last draw(). */
+  bool isEmpty() const { return vertices_.isEmpty(); }
+  void draw(int width, int height);
+
+  /*! Makes draw() allocate its vertices in \p ring, nullptr to stream them
+  in a vertex buffer. */
+  void setFrameRingBuffer(FrameRingBuffer *ring) { ringBuffer_ = ring; }
+
+private:
+  struct Glyph {
+    QRect rect;     // in the atlas, in pixels
+    QPointF offset; // of the rect top left corner, from the pen position
+    qreal advance;
+  };
+
+  const Glyph *glyph(const QFont &font, const QString &fontKey, QChar c);
+  void resetAtlas(int height);
+
+  QHash<QString, QHash<ushort, Glyph> > glyphs_;
+  QImage atlas_;
+  int atlasX_, atlasY_, atlasRowHeight_;
+  bool atlasIsModified_;
+  bool atlasIsFull_;
+  qreal devicePixelRatio_;
+  GLuint textureId_;
+
+  QVector<GLfloat> vertices_; // x y u v r g b a, 6 vertices per glyph
+  QOpenGLBuffer vbo_;
+  FrameRingBuffer *ringBuffer_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_TEXT_RENDERER_H
@@ -0,0 +1,503 @@
+#include "textureStreamer.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include <cstring>
+#include <utility>
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER_BINDING
+#define GL_PIXEL_UNPACK_BUFFER_BINDING 0x88EF
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+// Block compressed formats
+#define COMPRESSED_RGBA_S3TC_DXT1 0x83F1
+#define COMPRESSED_RGBA_S3TC_DXT3 0x83F2
+#define COMPRESSED_RGBA_S3TC_DXT5 0x83F3
+#define COMPRESSED_RED_RGTC1 0x8DBB
+#define COMPRESSED_RG_RGTC2 0x8DBD
+#define COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+
+using namespace qglviewer;
+
+/*! Creates a TextureStreamer. No OpenGL resource is created before the first
+update(). */
+TextureStreamer::TextureStreamer(QObject *parent)
+    : QObject(parent), sequence_(0), decodedSequence_(0),
+      decodedIsPending_(false), context_(nullptr), functions_(nullptr),
+      displayed_(-1), uploading_(-1), uploadFence_(nullptr),
+      mipmapsAreEnabled_(true), buffer_(0), mapped_(nullptr), bufferSize_(0),
+      bufferStorage_(false) {
+  for (int i = 0; i < nbTextures; ++i) {
+    textures_[i] = 0;
+    textureFormats_[i] = 0;
+  }
+
+  threadPool_ = new QThreadPool(this);
+  threadPool_->setMaxThreadCount(2);
+}
+
+/*! Destructor. The images being decoded are waited for. The OpenGL resources
+are only released when the context used by update() is current. Call
+cleanupGL() before otherwise. */
+TextureStreamer::~TextureStreamer() {
+  threadPool_->clear();
+  threadPool_->waitForDone();
+  if (context_ && (QOpenGLContext::currentContext() == context_))
+    cleanupGL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Images                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Reads and decodes the image \p fileName in a worker thread. The
+imageDecoded() signal is emitted when it is ready for update().
+
+Any format supported by \c QImage can be used. \c .dds files are read by the
+TextureStreamer: they must contain a block compressed image (see the class
+documentation). When several images are loaded before update() is called,
+only the last one is uploaded. */
+void TextureStreamer::load(const QString &fileName) {
+  const int sequence = ++sequence_;
+  threadPool_->start(QRunnable::create([this, sequence, fileName]() {
+    decodeImage(sequence, fileName, QImage());
+  }));
+}
+
+/*! Same as load(), with an image already in memory (a video frame for
+instance). Its conversion to the texture format is done in a worker thread. The
+\p image data is shared until then: do not modify it in place. */
+void TextureStreamer::setImage(const QImage &image) {
+  const int sequence = ++sequence_;
+  threadPool_->start(QRunnable::create([this, sequence, image]() {
+    decodeImage(sequence, QString(), image);
+  }));
+}
+
+// Called by the worker threads. The result replaces the previous decoded image
+// unless a more recent one is already available.
+void TextureStreamer::decodeImage(int sequence, const QString &fileName,
+                                  const QImage &image) {
+  Decoded decoded;
+  bool ok;
+  if (fileName.isEmpty())
+    ok = decode(image, decoded);
+  else if (fileName.endsWith(".dds", Qt::CaseInsensitive)) {
+    QFile file(fileName);
+    ok = file.open(QIODevice::ReadOnly) && decodeDDS(file.readAll(), decoded);
+  } else
+    ok = decode(QImage(fileName), decoded);
+
+  if (!ok) {
+    qWarning("TextureStreamer::load: unable to decode %s",
+             fileName.isEmpty() ? "image" : fileName.toLatin1().constData());
+    return;
+  }
+
+  {
+    QMutexLocker locker(&mutex_);
+    if (sequence < decodedSequence_)
+      return;
+    decodedSequence_ = sequence;
+    decoded_ = decoded;
+    decodedIsPending_ = true;
+  }
+  Q_EMIT imageDecoded();
+}
+
+// Converts image in RGBA bytes
+bool TextureStreamer::decode(const QImage &image, Decoded &decoded) {
+  if (image.isNull())
+    return false;
+
+  const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+  decoded.size = rgba.size();
+  decoded.format = GL_RGBA8;
+  const int rowSize = 4 * rgba.width();
+  decoded.data.resize(rowSize * rgba.height());
+  for (int row = 0; row < rgba.height(); ++row)
+    memcpy(decoded.data.data() + row * rowSize, rgba.constScanLine(row),
+           rowSize);
+  decoded.levelOffsets = QVector<int>(1, 0);
+  decoded.levelSizes = QVector<int>(1, decoded.data.size());
+  return true;
+}
+
+static quint32 readUInt32(const QByteArray &data, int offset) {
+  return qFromLittleEndian<quint32>(
+      reinterpret_cast<const uchar *>(data.constData()) + offset);
+}
+
+static quint32 fourCC(const char code[4]) {
+  return quint32(uchar(code[0])) | (quint32(uchar(code[1])) << 8) |
+         (quint32(uchar(code[2])) << 16) | (quint32(uchar(code[3])) << 24);
+}
+
+// Extracts the block compressed mipmap levels of a DDS file
+bool TextureStreamer::decodeDDS(const QByteArray &file, Decoded &decoded) {
+  // Magic number, then a 124 bytes header
+  if ((file.size() < 128) || !file.startsWith("DDS "))
+    return false;
+
+  const int height = int(readUInt32(file, 12));
+  const int width = int(readUInt32(file, 16));
+  const bool hasMipmaps = readUInt32(file, 8) & 0x20000; // DDSD_MIPMAPCOUNT
+  const int nbLevels = hasMipmaps ? qMax(1, int(readUInt32(file, 28))) : 1;
+  const quint32 code = readUInt32(file, 84);
+
+  int offset = 128;
+  GLenum format = 0;
+  if (code == fourCC("DXT1"))
+    format = COMPRESSED_RGBA_S3TC_DXT1;
+  else if (code == fourCC("DXT3"))
+    format = COMPRESSED_RGBA_S3TC_DXT3;
+  else if (code == fourCC("DXT5"))
+    format = COMPRESSED_RGBA_S3TC_DXT5;
+  else if ((code == fourCC("ATI1")) || (code == fourCC("BC4U")))
+    format = COMPRESSED_RED_RGTC1;
+  else if ((code == fourCC("ATI2")) || (code == fourCC("BC5U")))
+    format = COMPRESSED_RG_RGTC2;
+  else if ((code == fourCC("DX10")) && (file.size() >= 148)) {
+    // Extended header, with a DXGI_FORMAT
+    switch (readUInt32(file, 128)) {
+    case 71: // BC1_UNORM
+      format = COMPRESSED_RGBA_S3TC_DXT1;
+      break;
+    case 74: // BC2_UNORM
+      format = COMPRESSED_RGBA_S3TC_DXT3;
+      break;
+    case 77: // BC3_UNORM
+      format = COMPRESSED_RGBA_S3TC_DXT5;
+      break;
+    case 80: // BC4_UNORM
+      format = COMPRESSED_RED_RGTC1;
+      break;
+    case 83: // BC5_UNORM
+      format = COMPRESSED_RG_RGTC2;
+      break;
+    case 98: // BC7_UNORM
+      format = COMPRESSED_RGBA_BPTC_UNORM;
+      break;
+    }
+    offset = 148;
+  }
+
+  if (!format || (width <= 0) || (height <= 0)) {
+    qWarning("TextureStreamer::load: unsupported DDS format");
+    return false;
+  }
+
+  // 4x4 pixel blocks
+  const bool halfBlocks = (format == COMPRESSED_RGBA_S3TC_DXT1) ||
+                          (format == COMPRESSED_RED_RGTC1);
+  const int blockSize = halfBlocks ? 8 : 16;
+
+  decoded.size = QSize(width, height);
+  decoded.format = format;
+  decoded.levelOffsets.clear();
+  decoded.levelSizes.clear();
+  int size = 0;
+  for (int level = 0; level < nbLevels; ++level) {
+    const int levelWidth = qMax(1, width >> level);
+    const int levelHeight = qMax(1, height >> level);
+    const int levelSize =
+        ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize;
+    if (offset + size + levelSize > file.size())
+      break;
+    decoded.levelOffsets.append(size);
+    decoded.levelSizes.append(levelSize);
+    size += levelSize;
+  }
+
+  if (decoded.levelSizes.isEmpty())
+    return false;
+  decoded.data = file.mid(offset, size);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Texture                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+// Creates the textures and the pixel buffer with the current context
+bool TextureStreamer::initializeGL() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context) {
+    qWarning("TextureStreamer::update: no current OpenGL context");
+    return false;
+  }
+  if (context == context_)
+    return true;
+  if (context_) {
+    qWarning("TextureStreamer::update: OpenGL context changed, textures are "
+             "lost");
+    for (int i = 0; i < nbTextures; ++i)
+      textures_[i] = 0;
+    buffer_ = 0;
+    mapped_ = nullptr;
+    uploadFence_ = nullptr;
+  }
+
+  context_ = context;
+  functions_ = context->extraFunctions();
+  functions_->glGenTextures(nbTextures, textures_);
+  for (int i = 0; i < nbTextures; ++i) {
+    textureSizes_[i] = QSize();
+    textureFormats_[i] = 0;
+  }
+  displayed_ = uploading_ = -1;
+
+  // Pixel buffers and fences
+  const QPair<int, int> version = context->format().version();
+  const bool pixelBuffers = context->isOpenGLES()
+                                ? (version >= qMakePair(3, 0))
+                                : ((version >= qMakePair(3, 2)) ||
+                                   context->hasExtension("GL_ARB_sync"));
+  if (pixelBuffers)
+    functions_->glGenBuffers(1, &buffer_);
+  bufferStorage_ = pixelBuffers && !context->isOpenGLES() &&
+                   ((version >= qMakePair(4, 4)) ||
+                    context->hasExtension("GL_ARB_buffer_storage"));
+  bufferSize_ = 0;
+  return true;
+}
+
+/*! Releases the textures and the pixel buffer. The context used by update()
+must be current. texture() is then 0 until the next upload completes. */
+void TextureStreamer::cleanupGL() {
+  if (functions_) {
+    if (uploadFence_)
+      functions_->glDeleteSync(uploadFence_);
+    // Deleting the buffer also unmaps it
+    if (buffer_)
+      functions_->glDeleteBuffers(1, &buffer_);
+    functions_->glDeleteTextures(nbTextures, textures_);
+  }
+
+  for (int i = 0; i < nbTextures; ++i)
+    textures_[i] = 0;
+  uploadFence_ = nullptr;
+  buffer_ = 0;
+  mapped_ = nullptr;
+  bufferSize_ = 0;
+  displayed_ = uploading_ = -1;
+  functions_ = nullptr;
+  context_ = nullptr;
+}
+
+// Returns true when the OpenGL implementation can use format
+bool TextureStreamer::isSupported(GLenum format) const {
+  const QPair<int, int> version = context_->format().version();
+  const bool desktop = !context_->isOpenGLES();
+  switch (format) {
+  case COMPRESSED_RGBA_S3TC_DXT1:
+  case COMPRESSED_RGBA_S3TC_DXT3:
+  case COMPRESSED_RGBA_S3TC_DXT5:
+    return context_->hasExtension("GL_EXT_texture_compression_s3tc");
+  case COMPRESSED_RED_RGTC1:
+  case COMPRESSED_RG_RGTC2:
+    return (desktop && (version >= qMakePair(3, 0))) ||
+           context_->hasExtension("GL_ARB_texture_compression_rgtc") ||
+           context_->hasExtension("GL_EXT_texture_compression_rgtc");
+  case COMPRESSED_RGBA_BPTC_UNORM:
+    return (desktop && (version >= qMakePair(4, 2))) ||
+           context_->hasExtension("GL_ARB_texture_compression_bptc") ||
+           context_->hasExtension("GL_EXT_texture_compression_bptc");
+  default:
+    return true;
+  }
+}
+
+/*! Updates the texture(). Call this method at each frame, with the OpenGL
+context current (typically in your \c draw() method).
+
+When the previous upload is completed by the GPU, texture() is replaced by the
+uploaded image. The last decoded image (see imageDecoded()) is then copied in
+the pixel buffer, and its transfer to the next texture is started.
+
+Returns \c true while an upload is in progress: the viewer should be updated
+again to display the new texture() once it is completed. */
+bool TextureStreamer::update() {
+  if (!initializeGL())
+    return false;
+
+  if (uploading_ >= 0) {
+    const GLenum status = functions_->glClientWaitSync(
+        uploadFence_, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      return true;
+    functions_->glDeleteSync(uploadFence_);
+    uploadFence_ = nullptr;
+    displayed_ = uploading_;
+    uploading_ = -1;
+  }
+
+  Decoded decoded;
+  {
+    QMutexLocker locker(&mutex_);
+    if (!decodedIsPending_)
+      return false;
+    std::swap(decoded, decoded_);
+    decodedIsPending_ = false;
+  }
+
+  if (!isSupported(decoded.format)) {
+    qWarning("TextureStreamer::update: compressed format 0x%x is not supported",
+             decoded.format);
+    return false;
+  }
+
+  upload(decoded);
+  return uploading_ >= 0;
+}
+
+// Copies data in the pixel buffer, left bound. Returns the address to give to
+// the texture functions: an offset in the buffer, or data without pixel
+// buffer.
+quintptr TextureStreamer::mapBuffer(const QByteArray &data) {
+  if (!buffer_)
+    return reinterpret_cast<quintptr>(data.constData());
+
+  const int size = data.size();
+  functions_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+  if (bufferStorage_) {
+    // The previous upload is completed: the mapped memory can be written
+    if (size > bufferSize_) {
+      typedef void(QOPENGLF_APIENTRYP BufferStorage)(
+          GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+      BufferStorage bufferStorage = reinterpret_cast<BufferStorage>(
+          context_->getProcAddress("glBufferStorage"));
+      const GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+      // Storage is immutable: a new buffer is created
+      functions_->glDeleteBuffers(1, &buffer_);
+      functions_->glGenBuffers(1, &buffer_);
+      functions_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+      bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+      mapped_ = static_cast<char *>(functions_->glMapBufferRange(
+          GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+      bufferSize_ = mapped_ ? size : 0;
+    }
+    if (mapped_) {
+      memcpy(mapped_, data.constData(), size);
+      return 0;
+    }
+    // Mapping failed, orphan instead
+    bufferStorage_ = false;
+    functions_->glDeleteBuffers(1, &buffer_);
+    functions_->glGenBuffers(1, &buffer_);
+    functions_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+  }
+
+  // Orphaning: the driver allocates new memory if the previous content is used
+  functions_->glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr,
+                           GL_STREAM_DRAW);
+  void *memory = functions_->glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (memory) {
+    memcpy(memory, data.constData(), size);
+    functions_->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return 0;
+  }
+
+  functions_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return reinterpret_cast<quintptr>(data.constData());
+}
+
+// Starts the transfer of decoded in the next texture
+void TextureStreamer::upload(const Decoded &decoded) {
+  // Neither the displayed texture, nor the one displayed by the previous frame
+  const int index = (displayed_ + 1) % nbTextures;
+
+  GLint previousTexture = 0;
+  functions_->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  functions_->glBindTexture(GL_TEXTURE_2D, textures_[index]);
+  functions_->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  const quintptr base = mapBuffer(decoded.data);
+  const int width = decoded.size.width();
+  const int height = decoded.size.height();
+  const bool compressed = (decoded.format != GL_RGBA8);
+
+  if (compressed)
+    for (int level = 0; level < decoded.levelSizes.size(); ++level)
+      functions_->glCompressedTexImage2D(
+          GL_TEXTURE_2D, level, decoded.format, qMax(1, width >> level),
+          qMax(1, height >> level), 0, decoded.levelSizes[level],
+          reinterpret_cast<const void *>(base + decoded.levelOffsets[level]));
+  else if ((textureSizes_[index] == decoded.size) &&
+           (textureFormats_[index] == decoded.format))
+    functions_->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+                                GL_UNSIGNED_BYTE,
+                                reinterpret_cast<const void *>(base));
+  else {
+    // Unsized formats only in OpenGL ES 2.0
+    const bool sized = !context_->isOpenGLES() ||
+                       (context_->format().majorVersion() >= 3);
+    functions_->glTexImage2D(GL_TEXTURE_2D, 0, sized ? GL_RGBA8 : GL_RGBA,
+                             width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             reinterpret_cast<const void *>(base));
+  }
+
+  if (buffer_)
+    functions_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  const bool mipmaps = compressed ? (decoded.levelSizes.size() > 1)
+                                  : mipmapsAreEnabled();
+  if (mipmaps && !compressed)
+    functions_->glGenerateMipmap(GL_TEXTURE_2D);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                              mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                              GL_CLAMP_TO_EDGE);
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                              GL_CLAMP_TO_EDGE);
+  // The compressed levels stop at the last one of the file
+  functions_->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                              compressed ? decoded.levelSizes.size() - 1
+                                         : 1000);
+  functions_->glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  textureSizes_[index] = decoded.size;
+  textureFormats_[index] = decoded.format;
+
+  if (buffer_) {
+    // texture() is replaced when the GPU is done with the transfer
+    uploadFence_ = functions_->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    uploading_ = index;
+  } else
+    displayed_ = index;
+}
@@ -0,0 +1,156 @@
+#ifndef QGLVIEWER_TEXTURE_STREAMER_H
+#define QGLVIEWER_TEXTURE_STREAMER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "config.h"
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QThreadPool;
+
+namespace qglviewer {
+/*! \brief Loads images in a texture without blocking the display.
+  \class TextureStreamer textureStreamer.h QGLViewer/textureStreamer.h
+
+  Loading an image with \c QImage and \c glTexImage2D() in the GUI thread
+  stalls the display during the decoding, the conversion and the transfer of
+  the pixels. A TextureStreamer decodes the images given to load() or
+  setImage() in a worker thread, and transfers them to the GPU through a pixel
+  buffer object, while the previous texture() is still displayed:
+  \code
+  void Viewer::init() {
+    streamer_ = new qglviewer::TextureStreamer(this);
+    connect(streamer_, SIGNAL(imageDecoded()), SLOT(update()));
+    streamer_->load("background.jpg");
+  }
+
+  void Viewer::draw() {
+    if (streamer_->update())
+      update(); // the new texture is uploading, draw again when it is ready
+    glBindTexture(GL_TEXTURE_2D, streamer_->texture());
+    // (0,0) to (1,1) texture coordinates, v=0 being the top of the image
+  }
+  \endcode
+
+  update() must be called at each frame: it starts the upload of the last
+  decoded image, and makes the texture() use it once the GPU is done with the
+  transfer. Three textures are used in turn, so that the texture being
+  displayed, the one being uploaded, and the one displayed by the previous
+  frame are never the same.
+
+  The pixel buffer is persistently mapped with OpenGL 4.4 or the \c
+  GL_ARB_buffer_storage extension, and orphaned at each upload otherwise. The
+  images are directly uploaded from the client memory when pixel buffers are
+  not available (OpenGL ES 2.0).
+
+  Images are uploaded as \c GL_RGBA8 textures, and their mipmaps are generated
+  by the GPU when mipmapsAreEnabled(). \c .dds files that contain block
+  compressed images (BC1 to BC5 and BC7) are uploaded as is, with their mipmap
+  levels, when the OpenGL implementation supports the format.
+
+  The rows of the images are uploaded in their order, the first (top) row
+  being at the \c v=0 texture coordinate.
+
+  All the OpenGL methods must be called with the same context current. Call
+  cleanupGL() with this context current before the TextureStreamer is
+  destroyed. */
+class QGLVIEWER_EXPORT TextureStreamer : public QObject {
+  Q_OBJECT
+
+public:
+  explicit TextureStreamer(QObject *parent = nullptr);
+  virtual ~TextureStreamer();
+
+  /*! @name Images */
+  //@{
+public:
+  void load(const QString &fileName);
+  void setImage(const QImage &image);
+  //@}
+
+  /*! @name Texture */
+  //@{
+public:
+  bool update();
+  void cleanupGL();
+
+  /*! Returns the texture of the last completely uploaded image. Returns 0
+  before the first image was uploaded by update(). */
+  GLuint texture() const {
+    return (displayed_ >= 0) ? textures_[displayed_] : 0;
+  }
+  /*! Returns the size, in pixels, of the texture(). */
+  QSize textureSize() const {
+    return (displayed_ >= 0) ? textureSizes_[displayed_] : QSize();
+  }
+
+  /*! Returns \c true when the mipmaps of the uncompressed images are generated
+  after their upload, and the texture uses a trilinear filtering. Default
+  value is \c true. */
+  bool mipmapsAreEnabled() const { return mipmapsAreEnabled_; }
+  /*! Sets mipmapsAreEnabled(). Applied to the next uploaded images. */
+  void setMipmapsEnabled(bool enabled = true) { mipmapsAreEnabled_ = enabled; }
+  //@}
+
+Q_SIGNALS:
+  /*! Signal emitted, from the worker thread, when an image given to load() or
+  setImage() is decoded. Connect it to your viewer's \c update() slot, so that
+  update() starts its upload. */
+  void imageDecoded();
+
+private:
+  Q_DISABLE_COPY(TextureStreamer)
+
+  // An image ready to be uploaded
+  struct Decoded {
+    QSize size;
+    GLenum format;   // GL_RGBA8 or a compressed format
+    QByteArray data; // all the mipmap levels
+    QVector<int> levelOffsets;
+    QVector<int> levelSizes;
+  };
+
+  static bool decode(const QImage &image, Decoded &decoded);
+  static bool decodeDDS(const QByteArray &file, Decoded &decoded);
+  void decodeImage(int sequence, const QString &fileName, const QImage &image);
+  bool isSupported(GLenum format) const;
+  bool initializeGL();
+  quintptr mapBuffer(const QByteArray &data);
+  void upload(const Decoded &decoded);
+
+  // L o a d e r   t h r e a d
+  QThreadPool *threadPool_;
+  QMutex mutex_;
+  int sequence_;        // of the last load() or setImage()
+  int decodedSequence_; // of decoded_, protected by mutex_
+  Decoded decoded_;
+  bool decodedIsPending_;
+
+  // O p e n G L
+  QOpenGLContext *context_;
+  QOpenGLExtraFunctions *functions_;
+  static const int nbTextures = 3;
+  GLuint textures_[nbTextures];
+  QSize textureSizes_[nbTextures];
+  GLenum textureFormats_[nbTextures];
+  int displayed_; // index of texture(), -1 before the first upload
+  int uploading_; // -1 when no upload is in progress
+  GLsync uploadFence_;
+  bool mipmapsAreEnabled_;
+
+  GLuint buffer_;     // pixel unpack buffer, 0 without pixel buffers
+  char *mapped_;      // persistent mapping, nullptr when orphaned
+  int bufferSize_;
+  bool bufferStorage_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_TEXTURE_STREAMER_H
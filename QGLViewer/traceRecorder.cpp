@@ -0,0 +1,451 @@
+#include "traceRecorder.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace qglviewer;
+
+QAtomicInt TraceRecorder::enabled_(0);
+
+namespace {
+struct TraceEvent {
+  enum Type { COMPLETE, INSTANT, COUNTER };
+
+  const char *category;
+  const char *name;
+  qint64 start, end; // ns, end == start for instant and counter events
+  qreal value;       // counter events only
+  int thread;
+  Type type;
+};
+
+// The ring of the events and the names of the threads, protected by mutex
+struct TraceBuffer {
+  TraceBuffer() : capacity(65536), next(0) {}
+
+  QMutex mutex;
+  QVector<TraceEvent> events; // ring, full once its size reaches capacity
+  int capacity;
+  int next; // oldest event once the ring is full
+  QVector<QString> threadNames;
+};
+} // namespace
+
+static TraceBuffer &traceBuffer() {
+  static TraceBuffer buffer;
+  return buffer;
+}
+
+// Index of the calling thread in TraceBuffer::threadNames, 0 when not
+// registered yet
+static thread_local int traceThread = 0;
+
+// Registers the calling thread. The buffer mutex must be locked.
+static int currentTraceThread(TraceBuffer &buffer) {
+  if (traceThread == 0) {
+    QString name;
+    QThread *const thread = QThread::currentThread();
+    if (thread)
+      name = thread->objectName();
+    if (name.isEmpty()) {
+      if (QCoreApplication::instance() &&
+          (thread == QCoreApplication::instance()->thread()))
+        name = "Main thread";
+      else
+        name = QString("Thread %1").arg(buffer.threadNames.size() + 1);
+    }
+    buffer.threadNames.append(name);
+    traceThread = buffer.threadNames.size();
+  }
+  return traceThread;
+}
+
+static void addEvent(const TraceEvent &event) {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  TraceEvent recorded = event;
+  recorded.thread = currentTraceThread(buffer);
+  if (buffer.events.size() < buffer.capacity)
+    buffer.events.append(recorded);
+  else {
+    buffer.events[buffer.next] = recorded;
+    buffer.next = (buffer.next + 1) % buffer.capacity;
+  }
+}
+
+// Copies the recorded events, the oldest first, and the thread names
+static QVector<TraceEvent> recordedEvents(QVector<QString> &threadNames) {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  QVector<TraceEvent> events;
+  events.reserve(buffer.events.size());
+  for (int i = 0; i < buffer.events.size(); ++i)
+    events.append(buffer.events[(buffer.next + i) % buffer.events.size()]);
+  threadNames = buffer.threadNames;
+  return events;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Recording                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Starts or stops the recording of the events. The recorded events are kept
+when the recording stops: save them or clear() them. */
+void TraceRecorder::setEnabled(bool enabled) {
+  if (enabled)
+    now(); // Starts the clock
+  enabled_.storeRelaxed(enabled ? 1 : 0);
+}
+
+/*! Returns the maximum number of events kept in the ring buffer. Default
+value is 65536. */
+int TraceRecorder::capacity() {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  return buffer.capacity;
+}
+
+/*! Sets the capacity(). The oldest events are discarded if needed. Values
+smaller than 1 are replaced by 1. */
+void TraceRecorder::setCapacity(int nbEvents) {
+  QVector<QString> threadNames;
+  QVector<TraceEvent> events = recordedEvents(threadNames);
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  buffer.capacity = qMax(nbEvents, 1);
+  buffer.events = events.mid(qMax(0, events.size() - buffer.capacity));
+  buffer.next = 0;
+}
+
+/*! Returns the number of events in the ring buffer, at most capacity(). */
+int TraceRecorder::nbEvents() {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  return buffer.events.size();
+}
+
+/*! Discards all the recorded events. */
+void TraceRecorder::clear() {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  buffer.events.clear();
+  buffer.next = 0;
+}
+
+/*! Sets the name of the calling thread in the exported traces. Default is the
+\c QThread::objectName(), or a generated name when empty. */
+void TraceRecorder::setThreadName(const QString &name) {
+  TraceBuffer &buffer = traceBuffer();
+  QMutexLocker locker(&buffer.mutex);
+  buffer.threadNames[currentTraceThread(buffer) - 1] = name;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Events                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the time of the trace clock, in nanoseconds. The clock is shared by
+all the threads, and starts with the first setEnabled(). */
+qint64 TraceRecorder::now() {
+  static const QElapsedTimer clock = []() {
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+  }();
+  return clock.nsecsElapsed();
+}
+
+/*! Records an event of the calling thread that lasted from \p start to \p end
+(see now()). Does nothing when isEnabled() is \c false. Used by TraceScope. */
+void TraceRecorder::addCompleteEvent(const char *category, const char *name,
+                                     qint64 start, qint64 end) {
+  if (!isEnabled())
+    return;
+  const TraceEvent event = {category, name,  start, qMax(start, end),
+                            0.0,      0,     TraceEvent::COMPLETE};
+  addEvent(event);
+}
+
+/*! Records an instantaneous event of the calling thread, such as an input
+event or a Frame::modified() signal. Does nothing when isEnabled() is \c
+false. */
+void TraceRecorder::addInstantEvent(const char *category, const char *name) {
+  if (!isEnabled())
+    return;
+  const qint64 time = now();
+  const TraceEvent event = {category, name, time, time,
+                            0.0,      0,    TraceEvent::INSTANT};
+  addEvent(event);
+}
+
+/*! Records the current \p value of the counter named \p name, displayed as a
+graph by trace viewers. Does nothing when isEnabled() is \c false. */
+void TraceRecorder::addCounterEvent(const char *category, const char *name,
+                                    qreal value) {
+  if (!isEnabled())
+    return;
+  const qint64 time = now();
+  const TraceEvent event = {category, name, time, time,
+                            value,    0,    TraceEvent::COUNTER};
+  addEvent(event);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Export                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the recorded events in the Chrome trace event JSON format. */
+QByteArray TraceRecorder::chromeTrace() {
+  QVector<QString> threadNames;
+  const QVector<TraceEvent> events = recordedEvents(threadNames);
+  const double pid = QCoreApplication::applicationPid();
+
+  QJsonArray traceEvents;
+  for (int i = 0; i < threadNames.size(); ++i) {
+    QJsonObject args;
+    args["name"] = threadNames[i];
+    QJsonObject metadata;
+    metadata["name"] = "thread_name";
+    metadata["ph"] = "M";
+    metadata["pid"] = pid;
+    metadata["tid"] = i + 1;
+    metadata["args"] = args;
+    traceEvents.append(metadata);
+  }
+
+  for (const TraceEvent &event : events) {
+    QJsonObject object;
+    object["name"] = QString::fromUtf8(event.name);
+    object["cat"] = QString::fromUtf8(event.category);
+    object["ts"] = event.start / 1000.0; // microseconds
+    object["pid"] = pid;
+    object["tid"] = event.thread;
+    switch (event.type) {
+    case TraceEvent::COMPLETE:
+      object["ph"] = "X";
+      object["dur"] = (event.end - event.start) / 1000.0;
+      break;
+    case TraceEvent::INSTANT:
+      object["ph"] = "i";
+      object["s"] = "t";
+      break;
+    case TraceEvent::COUNTER: {
+      QJsonObject args;
+      args[QString::fromUtf8(event.name)] = event.value;
+      object["ph"] = "C";
+      object["args"] = args;
+      break;
+    }
+    }
+    traceEvents.append(object);
+  }
+
+  QJsonObject trace;
+  trace["traceEvents"] = traceEvents;
+  trace["displayTimeUnit"] = "ms";
+  return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+// P r o t o b u f   e n c o d i n g
+
+namespace {
+enum WireType { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2 };
+
+void appendVarint(QByteArray &data, quint64 value) {
+  while (value >= 0x80) {
+    data.append(char((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  data.append(char(value));
+}
+
+void appendTag(QByteArray &data, int field, WireType type) {
+  appendVarint(data, (quint64(field) << 3) | type);
+}
+
+void appendVarintField(QByteArray &data, int field, quint64 value) {
+  appendTag(data, field, VARINT);
+  appendVarint(data, value);
+}
+
+void appendBytesField(QByteArray &data, int field, const QByteArray &bytes) {
+  appendTag(data, field, LENGTH_DELIMITED);
+  appendVarint(data, quint64(bytes.size()));
+  data.append(bytes);
+}
+
+void appendDoubleField(QByteArray &data, int field, double value) {
+  quint64 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  bits = qToLittleEndian(bits);
+  appendTag(data, field, FIXED64);
+  data.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+}
+
+// Field numbers of the perfetto.protos messages
+enum {
+  TRACE_PACKET = 1,               // Trace
+  PACKET_TIMESTAMP = 8,           // TracePacket
+  PACKET_SEQUENCE_ID = 10,        // TracePacket
+  PACKET_TRACK_EVENT = 11,        // TracePacket
+  PACKET_TRACK_DESCRIPTOR = 60,   // TracePacket
+  TRACK_UUID = 1,                 // TrackDescriptor
+  TRACK_NAME = 2,                 // TrackDescriptor
+  TRACK_THREAD = 4,               // TrackDescriptor
+  TRACK_COUNTER = 8,              // TrackDescriptor
+  THREAD_PID = 1,                 // ThreadDescriptor
+  THREAD_TID = 2,                 // ThreadDescriptor
+  THREAD_NAME = 5,                // ThreadDescriptor
+  EVENT_TYPE = 9,                 // TrackEvent
+  EVENT_TRACK_UUID = 11,          // TrackEvent
+  EVENT_CATEGORIES = 22,          // TrackEvent
+  EVENT_NAME = 23,                // TrackEvent
+  EVENT_DOUBLE_COUNTER_VALUE = 44 // TrackEvent
+};
+
+// TrackEvent::Type values
+enum { SLICE_BEGIN = 1, SLICE_END = 2, INSTANT = 3, COUNTER = 4 };
+
+// One TrackEvent of the Perfetto trace. A complete event gives a begin and an
+// end slice.
+struct PerfettoEvent {
+  qint64 time;
+  int type;
+  qint64 duration; // of the complete event, orders the simultaneous slices
+  const TraceEvent *event;
+};
+
+// Chronological order. At the same time, the slices end before the next ones
+// begin, the enclosing slices begin first and end last.
+bool operator<(const PerfettoEvent &a, const PerfettoEvent &b) {
+  if (a.time != b.time)
+    return a.time < b.time;
+  const bool aEnds = a.type == SLICE_END;
+  const bool bEnds = b.type == SLICE_END;
+  if (aEnds != bEnds)
+    return aEnds;
+  return aEnds ? (a.duration < b.duration) : (a.duration > b.duration);
+}
+
+void appendPacket(QByteArray &trace, const QByteArray &packet) {
+  appendBytesField(trace, TRACE_PACKET, packet);
+}
+} // namespace
+
+/*! Returns the recorded events as a Perfetto protobuf trace (a sequence of
+\c TracePacket with \c TrackEvent). Each thread and each counter has its own
+track. */
+QByteArray TraceRecorder::perfettoTrace() {
+  QVector<QString> threadNames;
+  const QVector<TraceEvent> events = recordedEvents(threadNames);
+  const qint64 pid = QCoreApplication::applicationPid();
+  const quint64 sequenceId = 1;
+  QByteArray trace;
+
+  // Thread tracks, whose uuid is the thread index
+  for (int i = 0; i < threadNames.size(); ++i) {
+    QByteArray thread;
+    appendVarintField(thread, THREAD_PID, quint64(pid));
+    appendVarintField(thread, THREAD_TID, quint64(i + 1));
+    appendBytesField(thread, THREAD_NAME, threadNames[i].toUtf8());
+    QByteArray track;
+    appendVarintField(track, TRACK_UUID, quint64(i + 1));
+    appendBytesField(track, TRACK_THREAD, thread);
+    QByteArray packet;
+    appendVarintField(packet, PACKET_SEQUENCE_ID, sequenceId);
+    appendBytesField(packet, PACKET_TRACK_DESCRIPTOR, track);
+    appendPacket(trace, packet);
+  }
+
+  // Counter tracks, after the thread ones
+  QHash<QByteArray, quint64> counterTracks;
+  for (const TraceEvent &event : events) {
+    if ((event.type != TraceEvent::COUNTER) ||
+        counterTracks.contains(QByteArray(event.name)))
+      continue;
+    const quint64 uuid = threadNames.size() + counterTracks.size() + 1;
+    counterTracks.insert(QByteArray(event.name), uuid);
+    QByteArray track;
+    appendVarintField(track, TRACK_UUID, uuid);
+    appendBytesField(track, TRACK_NAME, QByteArray(event.name));
+    appendBytesField(track, TRACK_COUNTER, QByteArray());
+    QByteArray packet;
+    appendVarintField(packet, PACKET_SEQUENCE_ID, sequenceId);
+    appendBytesField(packet, PACKET_TRACK_DESCRIPTOR, track);
+    appendPacket(trace, packet);
+  }
+
+  QVector<PerfettoEvent> perfettoEvents;
+  perfettoEvents.reserve(2 * events.size());
+  for (const TraceEvent &event : events) {
+    PerfettoEvent perfettoEvent = {event.start, INSTANT, 0, &event};
+    if (event.type == TraceEvent::COMPLETE) {
+      perfettoEvent.type = SLICE_BEGIN;
+      perfettoEvent.duration = event.end - event.start;
+      perfettoEvents.append(perfettoEvent);
+      perfettoEvent.time = event.end;
+      perfettoEvent.type = SLICE_END;
+    } else if (event.type == TraceEvent::COUNTER)
+      perfettoEvent.type = COUNTER;
+    perfettoEvents.append(perfettoEvent);
+  }
+  std::stable_sort(perfettoEvents.begin(), perfettoEvents.end());
+
+  for (const PerfettoEvent &perfettoEvent : perfettoEvents) {
+    const TraceEvent &event = *perfettoEvent.event;
+    QByteArray trackEvent;
+    appendVarintField(trackEvent, EVENT_TYPE, quint64(perfettoEvent.type));
+    if (perfettoEvent.type == COUNTER) {
+      appendVarintField(trackEvent, EVENT_TRACK_UUID,
+                        counterTracks.value(QByteArray(event.name)));
+      appendDoubleField(trackEvent, EVENT_DOUBLE_COUNTER_VALUE, event.value);
+    } else {
+      appendVarintField(trackEvent, EVENT_TRACK_UUID, quint64(event.thread));
+      if (perfettoEvent.type != SLICE_END) {
+        appendBytesField(trackEvent, EVENT_CATEGORIES,
+                         QByteArray(event.category));
+        appendBytesField(trackEvent, EVENT_NAME, QByteArray(event.name));
+      }
+    }
+    QByteArray packet;
+    appendVarintField(packet, PACKET_TIMESTAMP, quint64(perfettoEvent.time));
+    appendVarintField(packet, PACKET_SEQUENCE_ID, sequenceId);
+    appendBytesField(packet, PACKET_TRACK_EVENT, trackEvent);
+    appendPacket(trace, packet);
+  }
+  return trace;
+}
+
+// Writes data in fileName. Returns false and warns in case of error.
+static bool saveTrace(const QString &fileName, const QByteArray &data,
+                      const char *method) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly) || (file.write(data) != data.size())) {
+    qWarning("TraceRecorder::%s: unable to write %s", method,
+             fileName.toLocal8Bit().constData());
+    return false;
+  }
+  return true;
+}
+
+/*! Saves chromeTrace() in \p fileName. Returns \c false in case of error. */
+bool TraceRecorder::saveChromeTrace(const QString &fileName) {
+  return saveTrace(fileName, chromeTrace(), "saveChromeTrace");
+}
+
+/*! Saves perfettoTrace() in \p fileName. Returns \c false in case of error. */
+bool TraceRecorder::savePerfettoTrace(const QString &fileName) {
+  return saveTrace(fileName, perfettoTrace(), "savePerfettoTrace");
+}
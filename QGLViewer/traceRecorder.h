@@ -0,0 +1,121 @@
+#ifndef QGLVIEWER_TRACE_RECORDER_H
+#define QGLVIEWER_TRACE_RECORDER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+
+#include "config.h"
+
+namespace qglviewer {
+/*! \brief Records timeline events of the viewer, exported as Chrome or
+  Perfetto traces.
+  \class TraceRecorder traceRecorder.h QGLViewer/traceRecorder.h
+
+  The frame rate and the FrameProfiler give the cost of the frames, but not
+  their correlation with the input events, the Frame::modified() signals, the
+  KeyFrameInterpolator ticks, the snapshot encodings or the VRender export
+  phases, which happen in different threads. Once setEnabled(), the library
+  records these events, with their thread, in a ring buffer of capacity()
+  events. The oldest events are overwritten.
+
+  The buffer is saved with saveChromeTrace() (JSON, opened by \c
+  chrome://tracing or https://ui.perfetto.dev) or savePerfettoTrace()
+  (protobuf, opened by the Perfetto UI and \c trace_processor). Add your own
+  events with a TraceScope, or with the QGLVIEWER_TRACE_SCOPE() macro:
+  \code
+  qglviewer::TraceRecorder::setEnabled(true);
+
+  void Viewer::draw() {
+    QGLVIEWER_TRACE_SCOPE("scene", "drawTerrain");
+    drawTerrain();
+  }
+
+  // Later
+  qglviewer::TraceRecorder::saveChromeTrace("viewer.json");
+  \endcode
+
+  When disabled (default), each event costs a single relaxed atomic read.
+  When enabled, an event takes an uncontended lock. The \p name and \p
+  category of the events are not copied: use string literals, or strings that
+  outlive the recorder.
+
+  All the methods are static and thread safe. */
+class QGLVIEWER_EXPORT TraceRecorder {
+public:
+  /*! @name Recording */
+  //@{
+public:
+  /*! Returns \c true when the events are recorded. Default value is \c
+  false. */
+  static bool isEnabled() { return enabled_.loadRelaxed() != 0; }
+  static void setEnabled(bool enabled = true);
+  static int capacity();
+  static void setCapacity(int nbEvents);
+  static int nbEvents();
+  static void clear();
+  static void setThreadName(const QString &name);
+  //@}
+
+  /*! @name Events */
+  //@{
+public:
+  static qint64 now();
+  static void addCompleteEvent(const char *category, const char *name,
+                               qint64 start, qint64 end);
+  static void addInstantEvent(const char *category, const char *name);
+  static void addCounterEvent(const char *category, const char *name,
+                              qreal value);
+  //@}
+
+  /*! @name Export */
+  //@{
+public:
+  static QByteArray chromeTrace();
+  static QByteArray perfettoTrace();
+  static bool saveChromeTrace(const QString &fileName);
+  static bool savePerfettoTrace(const QString &fileName);
+  //@}
+
+private:
+  static QAtomicInt enabled_;
+};
+
+/*! \brief Records the duration of a scope in the TraceRecorder.
+  \class TraceScope traceRecorder.h QGLViewer/traceRecorder.h
+
+  The event starts with the TraceScope creation and ends with its destruction.
+  Nothing is measured when TraceRecorder::isEnabled() is \c false at creation.
+  See also the QGLVIEWER_TRACE_SCOPE() macro. */
+class TraceScope {
+public:
+  /*! Starts an event named \p name in \p category, which must outlive the
+  TraceRecorder (string literals are fine). */
+  TraceScope(const char *category, const char *name)
+      : category_(category), name_(name),
+        start_(TraceRecorder::isEnabled() ? TraceRecorder::now() : -1) {}
+  /*! Records the event. */
+  ~TraceScope() {
+    if (start_ >= 0)
+      TraceRecorder::addCompleteEvent(category_, name_, start_,
+                                      TraceRecorder::now());
+  }
+
+private:
+  Q_DISABLE_COPY(TraceScope)
+  const char *const category_;
+  const char *const name_;
+  const qint64 start_;
+};
+
+} // namespace qglviewer
+
+/*! Records the rest of the enclosing scope as a TraceRecorder event, see
+qglviewer::TraceScope. */
+#define QGLVIEWER_TRACE_SCOPE(category, name)                                 \
+  const qglviewer::TraceScope QGLVIEWER_TRACE_SCOPE_NAME(__LINE__)(category,  \
+                                                                   name)
+#define QGLVIEWER_TRACE_SCOPE_NAME(line) QGLVIEWER_TRACE_SCOPE_CONCAT(line)
+#define QGLVIEWER_TRACE_SCOPE_CONCAT(line) qglviewerTraceScope##line
+
+#endif // QGLVIEWER_TRACE_RECORDER_H
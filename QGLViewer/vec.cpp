@@ -1,6 +1,8 @@
 #include "vec.h"
 #include "domUtils.h"
 
+#include <QDataStream>
+
 // Most of the methods are declared inline in vec.h
 
 using namespace qglviewer;
@@ -140,3 +142,15 @@ void Vec::initFromDOMElement(const QDomElement &element) {
 ostream &operator<<(ostream &o, const Vec &v) {
   return o << v.x << '\t' << v.y << '\t' << v.z;
 }
+
+QDataStream &operator<<(QDataStream &stream, const Vec &v) {
+  return stream << double(v.x) << double(v.y) << double(v.z);
+}
+
+QDataStream &operator>>(QDataStream &stream, Vec &v) {
+  double x, y, z;
+  stream >> x >> y >> z;
+  if (stream.status() == QDataStream::Ok)
+    v.setValue(x, y, z);
+  return stream;
+}
@@ -6,6 +6,8 @@
 
 #include <QDomElement>
 
+class QDataStream;
+
 // Included by all files as vec.h is at the end of the include hierarchy
 #include "config.h" // Specific configuration options.
 
@@ -50,15 +52,16 @@ class QGLVIEWER_EXPORT Vec {
 
 public:
 /*! The internal data representation is public. One can use v.x, v.y, v.z. See
- * also operator[](). */
+ * also operator[](). Real is qreal, or float when the library is compiled with
+ * QGLVIEWER_SINGLE_PRECISION (see config.h). */
 #if defined(DOXYGEN) || defined(QGLVIEWER_UNION_NOT_SUPPORTED)
-  qreal x, y, z;
+  Real x, y, z;
 #else
   union {
     struct {
-      qreal x, y, z;
+      Real x, y, z;
     };
-    qreal v_[3];
+    Real v_[3];
   };
 #endif
 
@@ -133,7 +136,7 @@ and can hence be used in place of Vec. See also operator const qreal*() .*/
   }
 
   /*! Bracket operator returning an l-value. \p i must range in [0..2]. */
-  qreal &operator[](int i) {
+  Real &operator[](int i) {
 #ifdef QGLVIEWER_UNION_NOT_SUPPORTED
     return (&x)[i];
 #else
@@ -144,10 +147,10 @@ and can hence be used in place of Vec. See also operator const qreal*() .*/
 #ifndef DOXYGEN
   /*! This method is deprecated since version 2.0. Use operator const qreal*
    * instead. */
-  const qreal *address() const {
+  const Real *address() const {
     qWarning(
         "Vec::address() is deprecated, use operator const qreal* instead.");
-    return operator const qreal *();
+    return operator const Real *();
   }
 #endif
 
@@ -156,7 +159,7 @@ and can hence be used in place of Vec. See also operator const qreal*() .*/
 Very convenient to pass a Vec pointer as a parameter to \c GLdouble OpenGL
 functions: \code Vec pos, normal; glNormal3dv(normal); glVertex3dv(pos);
 \endcode */
-  operator const qreal *() const {
+  operator const Real *() const {
 #ifdef QGLVIEWER_UNION_NOT_SUPPORTED
     return &x;
 #else
@@ -168,7 +171,7 @@ functions: \code Vec pos, normal; glNormal3dv(normal); glVertex3dv(pos);
 
 Useful to pass a Vec to a method that requires and fills a \c qreal*, as
 provided by certain libraries. */
-  operator qreal *() {
+  operator Real *() {
 #ifdef QGLVIEWER_UNION_NOT_SUPPORTED
     return &x;
 #else
@@ -181,7 +184,10 @@ provided by certain libraries. */
 Very convenient to pass a Vec pointer as a \c float parameter to OpenGL
 functions: \code Vec pos, normal; glNormal3fv(normal); glVertex3fv(pos);
 \endcode
-\note The returned float array is a static shared by all \c Vec instances. */
+\note The returned float array is a static shared by all \c Vec instances,
+except with QGLVIEWER_SINGLE_PRECISION, where operator const Real*() already
+returns the vector address. */
+#ifndef QGLVIEWER_SINGLE_PRECISION
   operator const float *() const {
     static float *const result = new float[3];
     result[0] = (float)x;
@@ -189,6 +195,7 @@ functions: \code Vec pos, normal; glNormal3fv(normal); glVertex3fv(pos);
     result[2] = (float)z;
     return result;
   }
+#endif
   //@}
 
   /*! @name Algebraic computations */
@@ -352,11 +359,25 @@ cout << "Position=" << pos << endl;
 \endcode */
   std::ostream &operator<<(std::ostream &o, const qglviewer::Vec &);
 //@}
+
+  /*! @name Binary representation */
+  //@{
+  /*! Writes the three coordinates in \p stream, as doubles when the \c
+  QDataStream::floatingPointPrecision() is \c QDataStream::DoublePrecision. Used
+  by Frame::writeBinary(). */
+  QDataStream &operator<<(QDataStream &stream, const qglviewer::Vec &);
+  /*! Reads a Vec written by operator<<(QDataStream&, const Vec&). */
+  QDataStream &operator>>(QDataStream &stream, qglviewer::Vec &);
+//@}
 #endif
 };
 
 } // namespace qglviewer
 
 std::ostream &operator<<(std::ostream &o, const qglviewer::Vec &);
+QGLVIEWER_EXPORT QDataStream &operator<<(QDataStream &stream,
+                                         const qglviewer::Vec &);
+QGLVIEWER_EXPORT QDataStream &operator>>(QDataStream &stream,
+                                         qglviewer::Vec &);
 
 #endif // QGLVIEWER_VEC_H
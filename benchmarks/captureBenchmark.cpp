@@ -0,0 +1,413 @@
+// Benchmark of the snapshot and capture pipeline. A synthetic scene is
+// rendered by an OffscreenRenderer at each resolution, and the stages of a
+// capture are measured separately: rendering, synchronous read back, read
+// back through a pixel buffer object, conversion to a QImage, encoding in each
+// image format and disk write. The sustained frame rate of an animation
+// capture is then measured with all the stages in sequence, and with the
+// encoding and writing in a thread pool.
+//
+// The QGLViewer paths (saveSnapshot(), synchronous and asynchronous, and
+// snapshotToClipboard()) are measured at the size of a viewer window.
+//
+// Usage: captureBenchmark [720p|1080p|1440p|4k|8k|16k...] [formats...]
+//
+// All resolutions and all the formats supported by QImageWriter among PNG,
+// JPEG, BMP, PPM, TIFF and WEBP are used when none is specified. One CSV line
+// is printed per measure, with times in milliseconds.
+
+#include <QApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageWriter>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QSemaphore>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "camera.h"
+#include "offscreenRenderer.h"
+#include "qglviewer.h"
+
+using namespace qglviewer;
+using namespace std;
+
+struct Resolution {
+  const char *name;
+  int width, height;
+};
+
+static const Resolution resolutions[] = {
+    {"720p", 1280, 720},  {"1080p", 1920, 1080}, {"1440p", 2560, 1440},
+    {"4k", 3840, 2160},   {"8k", 7680, 4320},    {"16k", 15360, 8640}};
+static const int nbResolutions = sizeof(resolutions) / sizeof(resolutions[0]);
+
+static const char *defaultFormats[] = {"PNG", "JPEG", "BMP",
+                                       "PPM", "TIFF", "WEBP"};
+
+// Maximum duration of the repetitions of a measure, and of a capture
+static const qint64 timeBudget = 5000; // ms
+static const int maxRepetitions = 5;
+static const int maxCapturedFrames = 60;
+static const int snapshotQuality = 95;
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Scene                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+// A smooth shaded and lit torus, with a texture like color pattern, so that
+// the images are neither trivial nor random for the encoders.
+static void drawScene() {
+  const int nbRings = 256, nbSides = 128;
+  const qreal R = 1.0, r = 0.4;
+
+  glEnable(GL_LIGHTING);
+  glEnable(GL_COLOR_MATERIAL);
+  for (int i = 0; i < nbRings; ++i) {
+    glBegin(GL_QUAD_STRIP);
+    for (int j = 0; j <= nbSides; ++j)
+      for (int k = 1; k >= 0; --k) {
+        const qreal u = 2.0 * M_PI * (i + k) / nbRings;
+        const qreal v = 2.0 * M_PI * j / nbSides;
+        glColor3f(0.5f + 0.5f * float(sin(8.0 * u)),
+                  0.5f + 0.5f * float(cos(5.0 * v)), 0.6f);
+        glNormal3d(cos(v) * cos(u), cos(v) * sin(u), sin(v));
+        glVertex3d((R + r * cos(v)) * cos(u), (R + r * cos(v)) * sin(u),
+                   r * sin(v));
+      }
+    glEnd();
+  }
+  glDisable(GL_COLOR_MATERIAL);
+}
+
+class Renderer : public OffscreenRenderer {
+public:
+  Renderer() {
+    camera()->setSceneRadius(1.5);
+    camera()->showEntireScene();
+  }
+
+protected:
+  virtual void init() {
+    glEnable(GL_LIGHT0);
+    glEnable(GL_DEPTH_TEST);
+  }
+  virtual void draw() { drawScene(); }
+};
+
+class Viewer : public QGLViewer {
+protected:
+  virtual void init() {
+    setSceneRadius(1.5);
+    showEntireScene();
+  }
+  virtual void draw() { drawScene(); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Measures                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+// Prints a measure. times are in milliseconds. throughput is given in unit,
+// computed from the median time unless given.
+static void report(const char *source, const char *resolution,
+                   const QString &format, const char *stage,
+                   vector<qreal> times, qreal throughput, const char *unit) {
+  sort(times.begin(), times.end());
+  const qreal median = times.empty() ? 0.0 : times[times.size() / 2];
+  printf("%s,%s,%s,%s,%d,%.3f,%.3f,%.2f,%s\n", source, resolution,
+         format.toLatin1().constData(), stage, int(times.size()), median,
+         times.empty() ? 0.0 : times[0], throughput, unit);
+  fflush(stdout);
+}
+
+// Calls pass() up to maxRepetitions times, within the timeBudget, and
+// returns the time of each call.
+static vector<qreal> repeat(const function<void()> &pass) {
+  vector<qreal> times;
+  QElapsedTimer budget;
+  budget.start();
+  do {
+    QElapsedTimer timer;
+    timer.start();
+    pass();
+    times.push_back(timer.nsecsElapsed() / 1.0e6);
+  } while ((int(times.size()) < maxRepetitions) &&
+           (budget.elapsed() < timeBudget));
+  return times;
+}
+
+static qreal median(vector<qreal> times) {
+  sort(times.begin(), times.end());
+  return times.empty() ? 0.0 : times[times.size() / 2];
+}
+
+// Megabytes per second when bytes are processed in ms milliseconds
+static qreal megabytesPerSecond(qint64 bytes, qreal ms) {
+  return (ms > 0.0) ? bytes / (1024.0 * 1024.0) / (ms / 1.0e3) : 0.0;
+}
+
+// The conversion done by QOpenGLWidget::grabFramebuffer(): RGBA rows,
+// bottom up, to a top down QImage.
+static QImage convert(const vector<uchar> &pixels, int width, int height) {
+  return QImage(pixels.data(), width, height, QImage::Format_RGBA8888)
+      .mirrored()
+      .convertToFormat(QImage::Format_RGB32);
+}
+
+static QByteArray encode(const QImage &image, const QString &format) {
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  image.save(&buffer, format.toLatin1().constData(), snapshotQuality);
+  return data;
+}
+
+static bool writeFile(const QByteArray &data, const QString &fileName) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  const bool written = file.write(data) == data.size();
+  file.close();
+  QFile::remove(fileName);
+  return written;
+}
+
+static void readPixels(int width, int height, uchar *pixels) {
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static void benchmarkResolution(Renderer &renderer, const Resolution &res,
+                                const QStringList &formats,
+                                const QString &directory) {
+  const int width = res.width, height = res.height;
+  renderer.setSize(QSize(width, height));
+  if (!renderer.renderToFramebufferObject()) {
+    fprintf(stderr, "%s: unable to render %dx%d images\n", res.name, width,
+            height);
+    return;
+  }
+  glFinish();
+
+  const qint64 nbBytes = 4 * qint64(width) * height;
+  vector<uchar> pixels(nbBytes);
+
+  // Rendering, up to the end of the GPU work
+  vector<qreal> times = repeat([&]() {
+    renderer.renderToFramebufferObject();
+    glFinish();
+  });
+  report("offscreen", res.name, "-", "render", times, 1.0e3 / median(times),
+         "fps");
+
+  // Synchronous read back, the framebuffer object being already rendered
+  times = repeat([&]() { readPixels(width, height, pixels.data()); });
+  report("offscreen", res.name, "-", "readback", times,
+         megabytesPerSecond(nbBytes, median(times)), "MB/s");
+
+  // Read back in a pixel buffer object: only the map waits for the GPU
+  QOpenGLBuffer pbo(QOpenGLBuffer::PixelPackBuffer);
+  if (pbo.create()) {
+    pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+    pbo.bind();
+    pbo.allocate(int(nbBytes));
+    vector<qreal> issueTimes, mapTimes;
+    repeat([&]() {
+      QElapsedTimer timer;
+      timer.start();
+      readPixels(width, height, nullptr);
+      issueTimes.push_back(timer.nsecsElapsed() / 1.0e6);
+      timer.restart();
+      const void *data = pbo.map(QOpenGLBuffer::ReadOnly);
+      if (data)
+        memcpy(pixels.data(), data, nbBytes);
+      pbo.unmap();
+      mapTimes.push_back(timer.nsecsElapsed() / 1.0e6);
+    });
+    pbo.release();
+    pbo.destroy();
+    report("offscreen", res.name, "-", "readback-pbo-issue", issueTimes,
+           -1.0, "-");
+    report("offscreen", res.name, "-", "readback-pbo-map", mapTimes,
+           megabytesPerSecond(nbBytes, median(mapTimes)), "MB/s");
+  }
+
+  QImage image;
+  times = repeat([&]() { image = convert(pixels, width, height); });
+  report("offscreen", res.name, "-", "convert", times,
+         megabytesPerSecond(nbBytes, median(times)), "MB/s");
+
+  const QString fileName = directory + "/capture";
+  for (const QString &format : formats) {
+    QByteArray data;
+    times = repeat([&]() { data = encode(image, format); });
+    if (data.isEmpty()) {
+      fprintf(stderr, "%s: unable to encode %s images\n", res.name,
+              format.toLatin1().constData());
+      continue;
+    }
+    report("offscreen", res.name, format, "encode", times,
+           megabytesPerSecond(nbBytes, median(times)), "MB/s");
+
+    times = repeat([&]() { writeFile(data, fileName); });
+    report("offscreen", res.name, format, "write", times,
+           megabytesPerSecond(data.size(), median(times)), "MB/s");
+    report("offscreen", res.name, format, "size", vector<qreal>(),
+           data.size() / 1024.0, "KB");
+
+    // Animation capture, all the stages in sequence
+    QElapsedTimer timer;
+    timer.start();
+    int nbFrames = 0;
+    do {
+      renderer.renderToFramebufferObject();
+      readPixels(width, height, pixels.data());
+      writeFile(encode(convert(pixels, width, height), format), fileName);
+      ++nbFrames;
+    } while ((nbFrames < maxCapturedFrames) && (timer.elapsed() < timeBudget));
+    report("offscreen", res.name, format, "capture-sequential",
+           vector<qreal>(1, timer.nsecsElapsed() / 1.0e6 / nbFrames),
+           nbFrames * 1.0e3 / (timer.nsecsElapsed() / 1.0e6), "fps");
+
+    // Animation capture, conversion, encoding and writing in a thread pool.
+    // Frames wait for a free slot, as with QGLViewer::snapshotQueueSize().
+    QThreadPool pool;
+    QSemaphore slots(pool.maxThreadCount());
+    timer.restart();
+    nbFrames = 0;
+    do {
+      renderer.renderToFramebufferObject();
+      readPixels(width, height, pixels.data());
+      slots.acquire();
+      const QImage frame = convert(pixels, width, height);
+      const QString frameName = fileName + QString::number(nbFrames);
+      pool.start([frame, format, frameName, &slots]() {
+        writeFile(encode(frame, format), frameName);
+        slots.release();
+      });
+      ++nbFrames;
+    } while ((nbFrames < maxCapturedFrames) && (timer.elapsed() < timeBudget));
+    pool.waitForDone();
+    report("offscreen", res.name, format, "capture-pipelined",
+           vector<qreal>(1, timer.nsecsElapsed() / 1.0e6 / nbFrames),
+           nbFrames * 1.0e3 / (timer.nsecsElapsed() / 1.0e6), "fps");
+  }
+}
+
+// The QGLViewer snapshot methods, at the viewer window size
+static void benchmarkViewer(const QStringList &formats,
+                            const QString &directory) {
+  Viewer viewer;
+  viewer.setWindowTitle("captureBenchmark");
+  viewer.resize(1280, 720);
+  viewer.show();
+  QElapsedTimer timer;
+  timer.start();
+  while (!viewer.isValid() && (timer.elapsed() < 5000))
+    QCoreApplication::processEvents();
+  if (!viewer.isValid()) {
+    fprintf(stderr, "viewer: unable to create an OpenGL context\n");
+    return;
+  }
+
+  const qreal ratio = viewer.devicePixelRatioF();
+  const QByteArray size = QString("%1x%2")
+                              .arg(int(ratio * viewer.width()))
+                              .arg(int(ratio * viewer.height()))
+                              .toLatin1();
+
+  vector<qreal> times = repeat([&]() { viewer.snapshotToClipboard(); });
+  report("viewer", size.constData(), "-", "clipboard", times,
+         1.0e3 / median(times), "fps");
+
+  viewer.setSnapshotFileName(directory + "/snapshot");
+  viewer.setSnapshotQuality(snapshotQuality);
+  for (const QString &format : formats) {
+    viewer.setSnapshotFormat(format);
+    for (int asynchronous = 0; asynchronous < 2; ++asynchronous) {
+      viewer.setSnapshotAsynchronous(asynchronous == 1);
+      viewer.setSnapshotCounter(0);
+      timer.restart();
+      int nbFrames = 0;
+      do {
+        viewer.repaint();
+        viewer.saveSnapshot(true, true);
+        ++nbFrames;
+      } while ((nbFrames < maxCapturedFrames) &&
+               (timer.elapsed() < timeBudget));
+      if (asynchronous == 1)
+        viewer.flushSnapshotQueue();
+      report("viewer", size.constData(), format,
+             asynchronous ? "saveSnapshot-async" : "saveSnapshot",
+             vector<qreal>(1, timer.nsecsElapsed() / 1.0e6 / nbFrames),
+             nbFrames * 1.0e3 / (timer.nsecsElapsed() / 1.0e6), "fps");
+    }
+  }
+  viewer.setSnapshotAsynchronous(false);
+}
+
+int main(int argc, char **argv) {
+  QApplication application(argc, argv);
+
+  QStringList supported;
+  for (const QByteArray &format : QImageWriter::supportedImageFormats())
+    supported << QString(format).toUpper();
+
+  vector<Resolution> selected;
+  QStringList formats;
+  const QStringList arguments = application.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    bool found = false;
+    for (int r = 0; r < nbResolutions; ++r)
+      if (arguments[i] == resolutions[r].name) {
+        selected.push_back(resolutions[r]);
+        found = true;
+      }
+    if (!found && supported.contains(arguments[i].toUpper())) {
+      formats << arguments[i].toUpper();
+      found = true;
+    }
+    if (!found) {
+      fprintf(stderr,
+              "Usage: %s [720p|1080p|1440p|4k|8k|16k...] [formats...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (selected.empty())
+    selected.assign(resolutions, resolutions + nbResolutions);
+  if (formats.isEmpty())
+    for (const char *format : defaultFormats)
+      if (supported.contains(format))
+        formats << format;
+
+  QTemporaryDir directory;
+  if (!directory.isValid()) {
+    fprintf(stderr, "Unable to create a temporary directory.\n");
+    return 1;
+  }
+
+  printf("source,resolution,format,stage,samples,median,min,throughput,"
+         "unit\n");
+
+  Renderer renderer;
+  for (const Resolution &res : selected)
+    benchmarkResolution(renderer, res, formats, directory.path());
+  renderer.cleanupGL();
+
+  benchmarkViewer(formats, directory.path());
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Replay of a frame recorded by QGLViewer::captureFrame(). The OpenGL
+// commands of the frame are replayed in a loop, in an offscreen context of the
+// kind of the capture one, without the application that issued them. The GPU
+// time of each range of commands (see qglviewer::FrameCapture::marker()) is
+// measured with timer queries, or with glFinish() and the CPU clock when they
+// are not supported (OpenGL ES).
+//
+// Usage: frameReplay file [loops]
+//
+// 100 loops are replayed when none is specified. One CSV line is printed per
+// range, with times in milliseconds.
+
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLTimeMonitor>
+#include <QStringList>
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#include "frameCapture.h"
+
+using namespace qglviewer;
+using namespace std;
+
+static const int defaultLoops = 100;
+
+// Times of a range, in milliseconds
+struct RangeTimes {
+  double sum;
+  double min;
+};
+
+// The format of the context used by the capture
+static QSurfaceFormat captureFormat(const FrameCapture &capture) {
+  QSurfaceFormat format;
+  format.setRenderableType(capture.isOpenGLES() ? QSurfaceFormat::OpenGLES
+                                                : QSurfaceFormat::OpenGL);
+  format.setVersion(capture.openGLVersion() / 10,
+                    capture.openGLVersion() % 10);
+  format.setProfile(capture.isCoreProfile()
+                        ? QSurfaceFormat::CoreProfile
+                        : QSurfaceFormat::CompatibilityProfile);
+  format.setDepthBufferSize(24);
+  return format;
+}
+
+int main(int argc, char **argv) {
+  QGuiApplication application(argc, argv);
+
+  const QStringList arguments = application.arguments();
+  int loops = defaultLoops;
+  bool ok = (arguments.size() == 2) || (arguments.size() == 3);
+  if (arguments.size() == 3)
+    loops = arguments[2].toInt(&ok);
+  if (!ok || (loops <= 0)) {
+    fprintf(stderr, "Usage: %s file [loops]\n", argv[0]);
+    return 1;
+  }
+
+  FrameCapture capture;
+  if (!capture.load(arguments[1]))
+    return 1;
+
+  QOffscreenSurface surface;
+  surface.setFormat(captureFormat(capture));
+  surface.create();
+  QOpenGLContext context;
+  context.setFormat(surface.format());
+  if (!context.create() || !context.makeCurrent(&surface)) {
+    fprintf(stderr, "Unable to create an OpenGL%s %d.%d context\n",
+            capture.isOpenGLES() ? " ES" : "", capture.openGLVersion() / 10,
+            capture.openGLVersion() % 10);
+    return 1;
+  }
+
+  // The frame is drawn in a framebuffer of the size of the capture viewport
+  const QSize size = capture.viewportSize().expandedTo(QSize(1, 1));
+  QOpenGLFramebufferObject framebuffer(
+      size, QOpenGLFramebufferObject::CombinedDepthStencil);
+  framebuffer.bind();
+  if (!capture.prepareReplay())
+    return 1;
+
+  const int nbRanges = capture.nbRanges();
+  QOpenGLTimeMonitor monitor;
+  monitor.setSampleCount(nbRanges + 1);
+  const bool gpuTimes = monitor.create();
+  if (!gpuTimes)
+    fprintf(stderr, "Timer queries are not supported, measuring CPU times "
+                    "with glFinish()\n");
+
+  QOpenGLFunctions *f = context.functions();
+  vector<RangeTimes> times(nbRanges, RangeTimes{0.0, 1.0e30});
+  vector<double> rangeTimes(nbRanges);
+  QElapsedTimer timer;
+  // A first loop, not measured, to warm up the driver
+  for (int loop = -1; loop < loops; ++loop) {
+    if (gpuTimes) {
+      monitor.reset();
+      for (int i = 0; i < nbRanges; ++i) {
+        monitor.recordSample();
+        capture.replayRange(i);
+      }
+      monitor.recordSample();
+      const QVector<GLuint64> intervals = monitor.waitForIntervals();
+      for (int i = 0; i < nbRanges; ++i)
+        rangeTimes[i] = intervals[i] / 1.0e6;
+    } else {
+      f->glFinish();
+      for (int i = 0; i < nbRanges; ++i) {
+        timer.start();
+        capture.replayRange(i);
+        f->glFinish();
+        rangeTimes[i] = timer.nsecsElapsed() / 1.0e6;
+      }
+    }
+
+    if (loop < 0)
+      continue;
+    for (int i = 0; i < nbRanges; ++i) {
+      times[i].sum += rangeTimes[i];
+      times[i].min = min(times[i].min, rangeTimes[i]);
+    }
+  }
+
+  printf("range,commands,mean,min\n");
+  double mean = 0.0;
+  for (int i = 0; i < nbRanges; ++i) {
+    printf("%s,%d,%.4f,%.4f\n", capture.rangeName(i).toUtf8().constData(),
+           capture.rangeSize(i), times[i].sum / loops, times[i].min);
+    mean += times[i].sum / loops;
+  }
+  printf("total,%d,%.4f,\n", capture.nbCommands(), mean);
+
+  capture.cleanupGL();
+  monitor.destroy();
+  framebuffer.release();
+  context.doneCurrent();
+  return 0;
+}
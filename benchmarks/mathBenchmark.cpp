@@ -0,0 +1,277 @@
+// Benchmark of the QGLViewer math core: Quaternion, Frame and Camera
+// transformations. Each operation is measured on arrays of increasing sizes,
+// through the per element API (scalar) and the array API (batched) when the
+// class provides one. The best time per element of a few repetitions is
+// reported, in nanoseconds.
+//
+// Usage: mathBenchmark [sizes...]
+//
+// Default sizes are 16, 1024 and 65536 elements.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "camera.h"
+#include "frame.h"
+#include "manipulatedCameraFrame.h"
+#include "quaternion.h"
+
+using namespace qglviewer;
+using namespace std;
+
+// Repetitions of each measure, the best one is reported
+static const int nbRepetitions = 5;
+// Minimum duration of a repetition, in nanoseconds
+static const qint64 minimumDuration = 20000000;
+
+// Written by the measured code so that it is not optimized away
+static volatile qreal sink;
+
+////////////////////////////////////////////////////////////////////////////////
+//                                Measures                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static qreal randomValue(qreal min, qreal max) {
+  return min + (max - min) * (rand() / qreal(RAND_MAX));
+}
+
+static Vec randomVec() {
+  return Vec(randomValue(-1.0, 1.0), randomValue(-1.0, 1.0),
+             randomValue(-1.0, 1.0));
+}
+
+// Packed x, y, z coordinates, as expected by the array methods (Vec may be
+// stored in single precision)
+static vector<qreal> packed(const vector<Vec> &v) {
+  vector<qreal> result(3 * v.size());
+  for (size_t i = 0; i < v.size(); ++i)
+    for (int j = 0; j < 3; ++j)
+      result[3 * i + j] = v[i][j];
+  return result;
+}
+
+static Quaternion randomQuaternion() {
+  return Quaternion(randomVec(), randomValue(0.0, 2.0 * M_PI));
+}
+
+// Calls pass (which processes size elements) until minimumDuration elapsed,
+// and prints the best time per element of nbRepetitions such runs.
+template <class Pass>
+static void measure(const char *operation, const char *form, int size,
+                    int depth, Pass pass) {
+  qreal best = -1.0;
+  for (int r = 0; r < nbRepetitions; ++r) {
+    QElapsedTimer timer;
+    timer.start();
+    qint64 nbPasses = 0;
+    do {
+      pass();
+      ++nbPasses;
+    } while (timer.nsecsElapsed() < minimumDuration);
+    const qreal time = timer.nsecsElapsed() / qreal(nbPasses * size);
+    if ((best < 0.0) || (time < best))
+      best = time;
+  }
+
+  char depthString[8] = "-";
+  if (depth > 0)
+    snprintf(depthString, sizeof(depthString), "%d", depth);
+  printf("%-40s %-8s %8d %6s %12.2f %12.2f\n", operation, form, size,
+         depthString, best, 1.0e3 / best);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Benchmarks                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static void quaternionBenchmarks(int size) {
+  vector<Quaternion> q(size), tangent(size);
+  vector<Vec> v(size);
+  vector<qreal> t(size);
+  for (int i = 0; i < size; ++i) {
+    q[i] = randomQuaternion();
+    tangent[i] = randomQuaternion();
+    v[i] = randomVec();
+    t[i] = randomValue(0.0, 1.0);
+  }
+
+  measure("Quaternion::rotate", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    for (int i = 0; i < size; ++i)
+      sum += q[i].rotate(v[i]).x;
+    sink = sum;
+  });
+
+  // The same rotation for all the vectors, as done by Frame
+  measure("Quaternion::rotate (shared rotation)", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    const Quaternion &rotation = q[0];
+    for (int i = 0; i < size; ++i)
+      sum += rotation.rotate(v[i]).x;
+    sink = sum;
+  });
+
+  measure("Quaternion::slerp", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    for (int i = 0; i + 1 < size; ++i)
+      sum += Quaternion::slerp(q[i], q[i + 1], t[i])[0];
+    sink = sum;
+  });
+
+  measure("Quaternion::squad", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    for (int i = 0; i + 1 < size; ++i)
+      sum += Quaternion::squad(q[i], tangent[i], tangent[i + 1], q[i + 1],
+                               t[i])[0];
+    sink = sum;
+  });
+}
+
+static void frameBenchmarks(int size) {
+  vector<Vec> v(size);
+  for (int i = 0; i < size; ++i)
+    v[i] = randomVec();
+  const vector<qreal> src = packed(v);
+  vector<qreal> res(3 * size);
+
+  for (int depth = 1; depth <= 16; depth *= 2) {
+    // A chain of depth frames, the points are expressed in the deepest one
+    vector<Frame> frames(depth);
+    for (int d = 0; d < depth; ++d) {
+      frames[d].setTranslation(randomVec());
+      frames[d].setRotation(randomQuaternion());
+      if (d > 0)
+        frames[d].setReferenceFrame(&frames[d - 1]);
+    }
+    const Frame &frame = frames[depth - 1];
+
+    measure("Frame::inverseCoordinatesOf", "scalar", size, depth, [&]() {
+      qreal sum = 0.0;
+      for (int i = 0; i < size; ++i)
+        sum += frame.inverseCoordinatesOf(v[i]).x;
+      sink = sum;
+    });
+
+    measure("Frame::getInverseCoordinatesOf", "batched", size, depth, [&]() {
+      frame.getInverseCoordinatesOf(src.data(), res.data(), size);
+      sink = res[3 * size - 3];
+    });
+
+    measure("Frame::coordinatesOf", "scalar", size, depth, [&]() {
+      qreal sum = 0.0;
+      for (int i = 0; i < size; ++i)
+        sum += frame.coordinatesOf(v[i]).x;
+      sink = sum;
+    });
+
+    measure("Frame::getCoordinatesOf", "batched", size, depth, [&]() {
+      frame.getCoordinatesOf(src.data(), res.data(), size);
+      sink = res[3 * size - 3];
+    });
+  }
+}
+
+static void cameraBenchmarks(int size) {
+  Camera camera;
+  camera.setScreenWidthAndHeight(1920, 1080);
+  camera.setSceneRadius(2.0);
+  camera.setPosition(Vec(0.0, 0.0, 5.0));
+  camera.lookAt(Vec(0.0, 0.0, 0.0));
+
+  vector<Vec> v(size), screen(size);
+  for (int i = 0; i < size; ++i) {
+    v[i] = randomVec();
+    screen[i] = Vec(randomValue(0.0, 1920.0), randomValue(0.0, 1080.0),
+                    randomValue(0.0, 1.0));
+  }
+  const vector<qreal> src = packed(v);
+  vector<qreal> res(3 * size);
+
+  measure("Camera::projectedCoordinatesOf", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    for (int i = 0; i < size; ++i)
+      sum += camera.projectedCoordinatesOf(v[i]).x;
+    sink = sum;
+  });
+
+  measure("Camera::getProjectedCoordinatesOf", "batched", size, 0, [&]() {
+    camera.getProjectedCoordinatesOf(src.data(), res.data(), size);
+    sink = res[3 * size - 3];
+  });
+
+  measure("Camera::unprojectedCoordinatesOf", "scalar", size, 0, [&]() {
+    qreal sum = 0.0;
+    for (int i = 0; i < size; ++i)
+      sum += camera.unprojectedCoordinatesOf(screen[i]).x;
+    sink = sum;
+  });
+
+  // The matrices are cached: each call follows a move of the camera
+  vector<Vec> positions(size);
+  vector<Quaternion> orientations(size);
+  for (int i = 0; i < size; ++i) {
+    positions[i] = 5.0 * randomVec();
+    orientations[i] = randomQuaternion();
+  }
+
+  measure("Camera::computeModelViewMatrix (moved)", "scalar", size, 0, [&]() {
+    for (int i = 0; i < size; ++i) {
+      camera.frame()->setPositionAndOrientation(positions[i], orientations[i]);
+      camera.computeModelViewMatrix();
+    }
+    sink = camera.position().x;
+  });
+
+  measure("Camera::getFrustumPlanesCoefficients", "scalar", size, 0, [&]() {
+    GLdouble coef[6][4];
+    qreal sum = 0.0;
+    for (int i = 0; i < size; ++i) {
+      camera.getFrustumPlanesCoefficients(coef);
+      sum += coef[i % 6][3];
+    }
+    sink = sum;
+  });
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication application(argc, argv);
+
+  vector<int> sizes;
+  const QStringList arguments = application.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    bool ok;
+    const int size = arguments[i].toInt(&ok);
+    if (!ok || (size < 2)) {
+      fprintf(stderr, "Usage: %s [sizes...]\n", argv[0]);
+      return 1;
+    }
+    sizes.push_back(size);
+  }
+
+  if (sizes.empty()) {
+    sizes.push_back(16);
+    sizes.push_back(1024);
+    sizes.push_back(65536);
+  }
+
+#ifdef QGLVIEWER_SINGLE_PRECISION
+  printf("Single precision storage\n");
+#endif
+  printf("%-40s %-8s %8s %6s %12s %12s\n", "operation", "form", "size",
+         "depth", "ns/element", "Melements/s");
+
+  for (const int size : sizes) {
+    srand(size);
+    quaternionBenchmarks(size);
+    frameBenchmarks(size);
+    cameraBenchmarks(size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,443 @@
+// Benchmark of the QGLViewer selection backends. A grid of named quads is
+// picked with QGLViewer::BUFFER_SELECTION (GL_SELECT), COLOR_SELECTION,
+// RAY_SELECTION (RayPicker) and the object ID buffer (hover picking, see
+// QGLViewer::setObjectIdBufferIsEnabled()).
+//
+// For each backend, the latency between a click (or a mouse move for the ID
+// buffer) and the selectedName() update is measured on random objects, as well
+// as the throughput of rectangular selections (objects selected per second)
+// for the backends that support them. The ray backend picks the rectangles, and
+// circular lassos, with RayPicker::pickRectangle() and pickLasso(), without
+// drawing.
+//
+// Usage: selectionBenchmark [sizes...] [buffer|color|ray|idbuffer...]
+//
+// Default sizes are 1000, 10000, 100000 and 1000000 objects. All backends are
+// used when none is specified. One CSV line is printed per measure, with
+// times in milliseconds.
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QOpenGLShaderProgram>
+#include <QPolygon>
+#include <QStringList>
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "camera.h"
+#include "qglviewer.h"
+#include "rayPicker.h"
+
+using namespace qglviewer;
+using namespace std;
+
+enum Backend { BUFFER, COLOR, RAY, ID_BUFFER, NB_BACKENDS };
+static const char *backendNames[NB_BACKENDS] = {"buffer", "color", "ray",
+                                                "idbuffer"};
+
+// Measures of each backend, fewer when the time budget is exceeded
+static const int nbClicks = 200;
+static const int nbRectangles = 50;
+static const qint64 timeBudget = 10000; // ms, per backend and measure
+// Maximum wait for an ID buffer read back
+static const int idTimeout = 1000; // ms
+static const int windowSize = 800;
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Scene                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+// A square grid of nbObjects quads in the z=0 plane, the object of index i
+// being named i.
+class Viewer : public QGLViewer {
+public:
+  Viewer(int nbObjects)
+      : nbObjects_(nbObjects), idProgram_(nullptr), useIdProgram_(false) {
+    side_ = qMax(1, int(ceil(sqrt(double(nbObjects)))));
+  }
+
+  ~Viewer() {
+    makeCurrent();
+    delete idProgram_;
+    doneCurrent();
+  }
+
+  int nbObjects() const { return nbObjects_; }
+
+  Vec center(int i) const {
+    const qreal cell = 2.0 / side_;
+    return Vec(-1.0 + (i % side_ + 0.5) * cell, -1.0 + (i / side_ + 0.5) * cell,
+               0.0);
+  }
+
+  // Half the side of the quads
+  qreal halfSize() const { return 0.4 * 2.0 / side_; }
+
+  void fillRayPicker(RayPicker &picker) const {
+    const Vec h(halfSize(), halfSize(), 0.01 * halfSize());
+    for (int i = 0; i < nbObjects_; ++i)
+      picker.addBox(center(i) - h, center(i) + h, i);
+  }
+
+  // The shaders needed by the object ID buffer. Returns false when they are
+  // not supported.
+  bool useIdProgram(bool use) {
+    if (use && !idProgram_) {
+      makeCurrent();
+      idProgram_ = new QOpenGLShaderProgram();
+      const bool linked =
+          idProgram_->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                              "#version 330 compatibility\n"
+                                              "void main() {\n"
+                                              "  gl_Position = ftransform();\n"
+                                              "}\n") &&
+          idProgram_->addShaderFromSourceCode(
+              QOpenGLShader::Fragment,
+              "#version 330 compatibility\n"
+              "uniform int id;\n"
+              "layout(location = 0) out vec4 fragColor;\n"
+              "layout(location = 1) out int objectId;\n"
+              "void main() {\n"
+              "  fragColor = vec4(0.8, 0.8, 0.8, 1.0);\n"
+              "  objectId = id;\n"
+              "}\n") &&
+          idProgram_->link();
+      if (!linked) {
+        delete idProgram_;
+        idProgram_ = nullptr;
+      }
+      doneCurrent();
+      if (!idProgram_)
+        return false;
+    }
+    useIdProgram_ = use;
+    return true;
+  }
+
+protected:
+  virtual void init() {
+    setSceneRadius(1.5);
+    showEntireScene();
+    setSelectBufferGrowthIsEnabled(true);
+    setMouseTracking(true);
+    glDisable(GL_LIGHTING);
+  }
+
+  virtual void draw() {
+    if (useIdProgram_) {
+      idProgram_->bind();
+      const int location = idProgram_->uniformLocation("id");
+      for (int i = 0; i < nbObjects_; ++i) {
+        idProgram_->setUniformValue(location, i);
+        drawObject(i);
+      }
+      idProgram_->release();
+      return;
+    }
+
+    glColor3f(0.8f, 0.8f, 0.8f);
+    glBegin(GL_QUADS);
+    for (int i = 0; i < nbObjects_; ++i)
+      drawObjectVertices(i);
+    glEnd();
+  }
+
+  virtual void drawWithNames() {
+    for (int i = 0; i < nbObjects_; ++i) {
+      pushSelectionName(i);
+      drawObject(i);
+      popSelectionName();
+    }
+  }
+
+private:
+  void drawObject(int i) const {
+    glBegin(GL_QUADS);
+    drawObjectVertices(i);
+    glEnd();
+  }
+
+  void drawObjectVertices(int i) const {
+    const Vec c = center(i);
+    const qreal h = halfSize();
+    glVertex3d(c.x - h, c.y - h, 0.0);
+    glVertex3d(c.x + h, c.y - h, 0.0);
+    glVertex3d(c.x + h, c.y + h, 0.0);
+    glVertex3d(c.x - h, c.y + h, 0.0);
+  }
+
+  int nbObjects_;
+  int side_;
+  QOpenGLShaderProgram *idProgram_;
+  bool useIdProgram_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Measures                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+// Processes the events until condition() is true. Returns false after
+// timeout milliseconds.
+static bool waitFor(const function<bool()> &condition, int timeout) {
+  QElapsedTimer timer;
+  timer.start();
+  while (!condition()) {
+    if (timer.elapsed() > timeout)
+      return false;
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
+  }
+  return true;
+}
+
+static qreal percentile(const vector<qreal> &sorted, qreal p) {
+  if (sorted.empty())
+    return 0.0;
+  return sorted[min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5))];
+}
+
+// Prints the statistics of the times (in ms) of a measure. correct is the
+// fraction of the clicks that selected the expected object, hitsPerSecond
+// the rectangular selection throughput, -1 when not relevant.
+static void report(Backend backend, int nbObjects, const char *measure,
+                   vector<qreal> times, qreal hitsPerSecond, qreal correct) {
+  sort(times.begin(), times.end());
+  printf("%s,%d,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.3f\n",
+         backendNames[backend], nbObjects, measure, int(times.size()),
+         percentile(times, 0.0), percentile(times, 0.5),
+         percentile(times, 0.9), percentile(times, 0.99),
+         percentile(times, 1.0), hitsPerSecond, correct);
+  fflush(stdout);
+}
+
+static void sendMouseMove(Viewer &viewer, const QPoint &pixel) {
+  QMouseEvent event(QEvent::MouseMove, QPointF(pixel), Qt::NoButton,
+                    Qt::NoButton, Qt::NoModifier);
+  QCoreApplication::sendEvent(&viewer, &event);
+}
+
+// The pixel of the center of object i
+static QPoint pixelOf(const Viewer &viewer, int i) {
+  const Vec p = viewer.camera()->projectedCoordinatesOf(viewer.center(i));
+  return QPoint(int(p.x), int(p.y));
+}
+
+static void measureClicks(Viewer &viewer, Backend backend) {
+  const int nb = viewer.nbObjects();
+  vector<qreal> times;
+  int nbCorrect = 0;
+  QElapsedTimer budget;
+  budget.start();
+
+  if (backend == ID_BUFFER) {
+    int id = -1;
+    const QMetaObject::Connection connection =
+        QObject::connect(&viewer, &QGLViewer::objectIdUnderCursorChanged,
+                         [&id](int newId) { id = newId; });
+    // A first read back, which also tells whether the ID buffer works
+    viewer.repaint();
+    sendMouseMove(viewer, pixelOf(viewer, 0));
+    if (!waitFor([&]() { return id >= 0; }, idTimeout)) {
+      fprintf(stderr, "%s: the object ID buffer is not available\n",
+              backendNames[backend]);
+      QObject::disconnect(connection);
+      return;
+    }
+
+    for (int c = 0; (c < nbClicks) && (budget.elapsed() < timeBudget); ++c) {
+      // Background first, so that the next move changes the ID
+      sendMouseMove(viewer, QPoint(0, 0));
+      waitFor([&]() { return id < 0; }, idTimeout);
+
+      const int expected = rand() % nb;
+      QElapsedTimer timer;
+      timer.start();
+      sendMouseMove(viewer, pixelOf(viewer, expected));
+      const bool retrieved = waitFor([&]() { return id >= 0; }, idTimeout);
+      times.push_back(timer.nsecsElapsed() / 1.0e6);
+      if (retrieved && (id == expected))
+        ++nbCorrect;
+    }
+    QObject::disconnect(connection);
+  } else {
+    viewer.setSelectRegionWidth(3);
+    viewer.setSelectRegionHeight(3);
+    // Warm up: shaders, buffers and ray picker hierarchy
+    viewer.select(pixelOf(viewer, 0));
+
+    for (int c = 0; (c < nbClicks) && (budget.elapsed() < timeBudget); ++c) {
+      const int expected = rand() % nb;
+      const QPoint pixel = pixelOf(viewer, expected);
+      QElapsedTimer timer;
+      timer.start();
+      viewer.select(pixel);
+      times.push_back(timer.nsecsElapsed() / 1.0e6);
+      if (viewer.selectedName() == expected)
+        ++nbCorrect;
+    }
+  }
+
+  report(backend, nb, "click", times, -1.0,
+         times.empty() ? 0.0 : nbCorrect / qreal(times.size()));
+}
+
+// Rectangles of a quarter of the window side, at random positions
+static void measureRectangles(Viewer &viewer, Backend backend) {
+  const int side = windowSize / 4;
+  viewer.setSelectRegionWidth(side);
+  viewer.setSelectRegionHeight(side);
+
+  vector<qreal> times;
+  qint64 nbHits = 0;
+  QElapsedTimer budget;
+  budget.start();
+  for (int r = 0; (r < nbRectangles) && (budget.elapsed() < timeBudget); ++r) {
+    const QPoint center(side / 2 + rand() % (windowSize - side),
+                        side / 2 + rand() % (windowSize - side));
+    QElapsedTimer timer;
+    timer.start();
+    if (backend == RAY) {
+      const QRect rectangle(center - QPoint(side / 2, side / 2),
+                            QSize(side, side));
+      nbHits += viewer.rayPicker()->pickRectangle(viewer.camera(), rectangle)
+                    .size();
+    } else {
+      viewer.select(center);
+      nbHits += viewer.selectionHits().size();
+    }
+    times.push_back(timer.nsecsElapsed() / 1.0e6);
+  }
+
+  qreal total = 0.0;
+  for (const qreal t : times)
+    total += t;
+  report(backend, viewer.nbObjects(), "rectangle", times,
+         (total > 0.0) ? 1.0e3 * nbHits / total : 0.0, -1.0);
+}
+
+// Circles of 64 vertices, of the size of the rectangles, with the ray backend
+static void measureLassos(Viewer &viewer, Backend backend) {
+  const int side = windowSize / 4;
+  vector<qreal> times;
+  qint64 nbHits = 0;
+  QElapsedTimer budget;
+  budget.start();
+  for (int r = 0; (r < nbRectangles) && (budget.elapsed() < timeBudget); ++r) {
+    const QPoint center(side / 2 + rand() % (windowSize - side),
+                        side / 2 + rand() % (windowSize - side));
+    QPolygon lasso;
+    for (int i = 0; i < 64; ++i) {
+      const qreal angle = 2.0 * M_PI * i / 64;
+      lasso << center + QPoint(int(side / 2 * cos(angle)),
+                               int(side / 2 * sin(angle)));
+    }
+    QElapsedTimer timer;
+    timer.start();
+    nbHits += viewer.rayPicker()->pickLasso(viewer.camera(), lasso).size();
+    times.push_back(timer.nsecsElapsed() / 1.0e6);
+  }
+
+  qreal total = 0.0;
+  for (const qreal t : times)
+    total += t;
+  report(backend, viewer.nbObjects(), "lasso", times,
+         (total > 0.0) ? 1.0e3 * nbHits / total : 0.0, -1.0);
+}
+
+static void runBackend(Viewer &viewer, Backend backend) {
+  RayPicker picker;
+  switch (backend) {
+  case BUFFER:
+    viewer.setSelectionMode(QGLViewer::BUFFER_SELECTION);
+    break;
+  case COLOR:
+    viewer.setSelectionMode(QGLViewer::COLOR_SELECTION);
+    break;
+  case RAY:
+    viewer.fillRayPicker(picker);
+    viewer.setRayPicker(&picker);
+    viewer.setSelectionMode(QGLViewer::RAY_SELECTION);
+    break;
+  default:
+    if (!viewer.useIdProgram(true)) {
+      fprintf(stderr, "%s: GLSL 3.30 compatibility shaders are not supported\n",
+              backendNames[backend]);
+      return;
+    }
+    viewer.setObjectIdBufferIsEnabled(true);
+    break;
+  }
+
+  measureClicks(viewer, backend);
+  // Rectangles are not supported by the ID buffer
+  if (backend != ID_BUFFER)
+    measureRectangles(viewer, backend);
+  if (backend == RAY)
+    measureLassos(viewer, backend);
+
+  viewer.setRayPicker(nullptr);
+  viewer.setObjectIdBufferIsEnabled(false);
+  viewer.useIdProgram(false);
+}
+
+int main(int argc, char **argv) {
+  QApplication application(argc, argv);
+
+  vector<int> sizes;
+  vector<Backend> backends;
+  const QStringList arguments = application.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    bool ok;
+    const int size = arguments[i].toInt(&ok);
+    if (ok && (size > 0)) {
+      sizes.push_back(size);
+      continue;
+    }
+
+    bool found = false;
+    for (int b = 0; b < NB_BACKENDS; ++b)
+      if (arguments[i] == backendNames[b]) {
+        backends.push_back(Backend(b));
+        found = true;
+      }
+    if (!found) {
+      fprintf(stderr, "Usage: %s [sizes...] [buffer|color|ray|idbuffer...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (sizes.empty())
+    for (int size = 1000; size <= 1000000; size *= 10)
+      sizes.push_back(size);
+  if (backends.empty())
+    for (int b = 0; b < NB_BACKENDS; ++b)
+      backends.push_back(Backend(b));
+
+  printf("backend,objects,measure,samples,min,p50,p90,p99,max,hits_per_s,"
+         "correct\n");
+
+  for (const int size : sizes) {
+    Viewer viewer(size);
+    viewer.setWindowTitle("selectionBenchmark");
+    viewer.resize(windowSize, windowSize);
+    viewer.show();
+    if (!waitFor([&]() { return viewer.isValid(); }, 5000)) {
+      fprintf(stderr, "Unable to create an OpenGL context\n");
+      return 1;
+    }
+
+    for (const Backend backend : backends) {
+      // Same clicks for every backend
+      srand(size);
+      runBackend(viewer, backend);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,424 @@
+//  Benchmark of the VRender pipeline. Synthetic feedback buffers are sent
+// through ParserGL, the optimizers, each sort method and each exporter, and the
+// wall time, memory and number of primitives are reported for each stage.
+//
+// Usage: vrenderBenchmark [sizes...] [soup|planes|grid...] [none|bsp|topological|advanced|bsp-balanced|bsp-parallel...]
+//
+// Default sizes are 1000 and 10000 primitives. All scenes and sort methods are
+// used when none is specified.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#if defined(Q_OS_UNIX)
+# include <sys/resource.h>
+#endif
+
+#include "VRender/VRender.h"
+#include "VRender/ParserGL.h"
+#include "VRender/Exporter.h"
+#include "VRender/SortMethod.h"
+#include "VRender/Optimizer.h"
+#include "VRender/Arena.h"
+
+using namespace vrender ;
+using namespace std ;
+
+static const float WINDOW_SIZE = 1000.0f ;
+
+//////////////////////////////////////////////////////////////////////////////
+//                            Synthetic scenes                              //
+//////////////////////////////////////////////////////////////////////////////
+
+//  Scenes are generated directly in window coordinates, in the format of the
+// OpenGL feedback buffer (GL_3D_COLOR: x y z r g b a for each vertex).
+
+static float random01()
+{
+	return rand() / float(RAND_MAX) ;
+}
+
+static void addVertex(vector<GLfloat>& buffer,float x,float y,float z,float r,float g,float b)
+{
+	const GLfloat v[7] = { x, y, z, r, g, b, 1.0f } ;
+	buffer.insert(buffer.end(),v,v+7) ;
+}
+
+static void addTriangle(vector<GLfloat>& buffer,const float p[3][3],const float c[3][3])
+{
+	buffer.push_back(GL_POLYGON_TOKEN) ;
+	buffer.push_back(3) ;
+
+	for(int i=0;i<3;++i)
+		addVertex(buffer,p[i][0],p[i][1],p[i][2],c[i][0],c[i][1],c[i][2]) ;
+}
+
+static void addSegment(vector<GLfloat>& buffer,const float p[2][3],float r,float g,float b)
+{
+	buffer.push_back(GL_LINE_TOKEN) ;
+
+	for(int i=0;i<2;++i)
+		addVertex(buffer,p[i][0],p[i][1],p[i][2],r,g,b) ;
+}
+
+//  Random triangles, with random depths and orientations. Their size is such
+// that each triangle overlaps a few others.
+
+static void triangleSoup(int nb,vector<GLfloat>& buffer)
+{
+	const float size = 3.0f * WINDOW_SIZE / sqrt(float(nb)) ;
+
+	for(int i=0;i<nb;++i)
+	{
+		const float cx = random01()*WINDOW_SIZE ;
+		const float cy = random01()*WINDOW_SIZE ;
+		float p[3][3], c[3][3] ;
+
+		for(int j=0;j<3;++j)
+		{
+			p[j][0] = cx + (random01()-0.5f)*size ;
+			p[j][1] = cy + (random01()-0.5f)*size ;
+			p[j][2] = random01() ;
+
+			// Half of the triangles are smooth shaded
+
+			for(int k=0;k<3;++k)
+				c[j][k] = (i%2 == 0 || j == 0)?random01():c[0][k] ;
+		}
+
+		addTriangle(buffer,p,c) ;
+	}
+}
+
+//  A few tilted planes that all intersect each other, tessellated with
+// nb/8 triangles each. This is the worst case for the BSP (many splits) and
+// for the topological sort (cycles).
+
+static void intersectingPlanes(int nb,vector<GLfloat>& buffer)
+{
+	const int nb_planes = 8 ;
+	const int n = max(1,int(sqrt(nb/(2.0*nb_planes)))) ;
+
+	for(int k=0;k<nb_planes;++k)
+	{
+		const float angle = 3.14159265f * k / nb_planes ;
+		const float a = 0.8f*cos(angle) ;
+		const float b = 0.8f*sin(angle) ;
+		const float color[3] = { random01(), random01(), random01() } ;
+
+		float c[3][3] ;
+
+		for(int j=0;j<3;++j)
+			for(int l=0;l<3;++l)
+				c[j][l] = color[l] ;
+
+		for(int i=0;i<n;++i)
+			for(int j=0;j<n;++j)
+			{
+				const float x0 = (i  )*WINDOW_SIZE/n, y0 = (j  )*WINDOW_SIZE/n ;
+				const float x1 = (i+1)*WINDOW_SIZE/n, y1 = (j+1)*WINDOW_SIZE/n ;
+
+				// z = 0.5 + a*(x-0.5) + b*(y-0.5) in normalized coordinates
+
+#define PLANE_Z(x,y) (0.5f + a*((x)/WINDOW_SIZE-0.5f) + b*((y)/WINDOW_SIZE-0.5f))
+
+				const float p1[3][3] = { { x0,y0,PLANE_Z(x0,y0) }, { x1,y0,PLANE_Z(x1,y0) }, { x1,y1,PLANE_Z(x1,y1) } } ;
+				const float p2[3][3] = { { x0,y0,PLANE_Z(x0,y0) }, { x1,y1,PLANE_Z(x1,y1) }, { x0,y1,PLANE_Z(x0,y1) } } ;
+
+#undef PLANE_Z
+				addTriangle(buffer,p1,c) ;
+				addTriangle(buffer,p2,c) ;
+			}
+	}
+}
+
+//  A CAD like model: layers of regular grids of flat shaded quads, with the
+// edges of the quads drawn as segments on top of them.
+
+static void cadGrid(int nb,vector<GLfloat>& buffer)
+{
+	const int nb_layers = 4 ;
+	const int n = max(1,int(sqrt(nb/(4.0*nb_layers)))) ;
+
+	for(int k=0;k<nb_layers;++k)
+	{
+		const float z = 0.2f + 0.6f*k/nb_layers ;
+		const float offset = k*0.25f*WINDOW_SIZE/n ;
+
+		for(int i=0;i<n;++i)
+			for(int j=0;j<n;++j)
+			{
+				const float x0 = offset + (i  )*WINDOW_SIZE/n, y0 = offset + (j  )*WINDOW_SIZE/n ;
+				const float x1 = offset + (i+1)*WINDOW_SIZE/n, y1 = offset + (j+1)*WINDOW_SIZE/n ;
+				const float gray = ((i+j+k)%2 == 0)?0.8f:0.6f ;
+
+				const float c[3][3] = { { gray,gray,gray }, { gray,gray,gray }, { gray,gray,gray } } ;
+				const float p1[3][3] = { { x0,y0,z }, { x1,y0,z }, { x1,y1,z } } ;
+				const float p2[3][3] = { { x0,y0,z }, { x1,y1,z }, { x0,y1,z } } ;
+
+				addTriangle(buffer,p1,c) ;
+				addTriangle(buffer,p2,c) ;
+
+				const float s1[2][3] = { { x0,y0,z-0.001f }, { x1,y0,z-0.001f } } ;
+				const float s2[2][3] = { { x0,y0,z-0.001f }, { x0,y1,z-0.001f } } ;
+
+				addSegment(buffer,s1,0.0f,0.0f,0.0f) ;
+				addSegment(buffer,s2,0.0f,0.0f,0.0f) ;
+			}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//                               Measurements                               //
+//////////////////////////////////////////////////////////////////////////////
+
+// Peak resident memory of the process, in MB. -1 when not available.
+
+static double peakMemory()
+{
+#if defined(Q_OS_UNIX)
+	struct rusage usage ;
+
+	if(getrusage(RUSAGE_SELF,&usage) != 0)
+		return -1.0 ;
+# if defined(Q_OS_MAC)
+	return usage.ru_maxrss / (1024.0*1024.0) ;		// bytes
+# else
+	return usage.ru_maxrss / 1024.0 ;				// kilobytes
+# endif
+#else
+	return -1.0 ;
+#endif
+}
+
+class StageTimer
+{
+	public:
+		StageTimer(const char *scene,int size,const char *sort,const Arena& arena)
+			: _scene(scene), _size(size), _sort(sort), _arena(arena) {}
+
+		void start() { _timer.start() ; }
+
+		void report(const char *stage,size_t nb_primitives,const char *extra = "") const
+		{
+			printf("%-8s %8d  %-12s %-18s %10.1f %10zu %10.1f %10.1f  %s\n",
+					 _scene,_size,_sort,stage,_timer.nsecsElapsed()*1e-6,nb_primitives,
+					 _arena.allocatedSize()/(1024.0*1024.0),peakMemory(),extra) ;
+			fflush(stdout) ;
+		}
+
+	private:
+		const char *_scene ;
+		int _size ;
+		const char *_sort ;
+		const Arena& _arena ;
+		QElapsedTimer _timer ;
+};
+
+static void deletePrimitives(vector<PtrPrimitive>& primitive_tab)
+{
+	for(size_t i=0;i<primitive_tab.size();++i)
+		delete primitive_tab[i] ;
+
+	primitive_tab.clear() ;
+}
+
+//  Runs the whole pipeline on buffer, in the same order as VectorialRender()
+// with hidden faces culling, then exports the result in every format.
+
+static void runPipeline(const char *scene,int size,int sort,const vector<GLfloat>& buffer,const QString& directory)
+{
+	static const char *sort_names[] = { "none", "bsp", "topological", "advanced", "bsp-balanced", "bsp-parallel" } ;
+
+	Arena arena ;
+	Arena::Scope scope(arena) ;
+
+	VRenderParams vparams ;
+	vparams.setOption(VRenderParams::OptimizeBSPSplits,sort >= 4) ;
+	vparams.setOption(VRenderParams::ParallelBSPConstruction,sort == 5) ;
+	StageTimer timer(scene,size,sort_names[sort],arena) ;
+
+	vector<GLfloat> feedback(buffer) ;
+	vector<PtrPrimitive> primitive_tab ;
+
+	timer.start() ;
+	ParserGL parser ;
+	parser.parseFeedbackBuffer(&feedback[0],int(feedback.size()),primitive_tab,vparams) ;
+	timer.report("ParserGL",primitive_tab.size()) ;
+
+	timer.start() ;
+	BackFaceCullingOptimizer bfopt ;
+	bfopt.optimize(primitive_tab,vparams) ;
+	timer.report("BackFaceCulling",primitive_tab.size()) ;
+
+	SortMethod *sort_method = nullptr ;
+
+	switch(sort)
+	{
+		case 1:
+		case 4:
+		case 5: sort_method = new BSPSortMethod() ;
+				  break ;
+		case 2:
+		case 3: {
+					  TopologicalSortMethod *tsm = new TopologicalSortMethod() ;
+					  tsm->setBreakCycles(sort == 3) ;
+					  sort_method = tsm ;
+				  }
+				  break ;
+		default: sort_method = new DontSortMethod() ;
+	}
+
+	timer.start() ;
+	sort_method->sortPrimitives(primitive_tab,vparams) ;
+	timer.report("Sort",primitive_tab.size()) ;
+	delete sort_method ;
+
+	timer.start() ;
+	VisibilityOptimizer vopt ;
+	vopt.optimize(primitive_tab,vparams) ;
+	timer.report("Visibility",primitive_tab.size()) ;
+
+	static const char *format_names[] = { "EPS", "PS", "XFIG", "PDF" } ;
+
+	for(int f=0;f<4;++f)
+	{
+		Exporter *exporter = nullptr ;
+
+		switch(f)
+		{
+			case 0: exporter = new EPSExporter() ; break ;
+			case 1: exporter = new PSExporter() ; break ;
+			case 2: exporter = new FIGExporter() ; break ;
+			default: exporter = new PDFExporter() ; break ;
+		}
+
+		exporter->setBoundingBox(0,0,WINDOW_SIZE,WINDOW_SIZE) ;
+		exporter->setClearColor(1,1,1) ;
+		exporter->setClearBackground(true) ;
+
+		const QString filename = directory + "/benchmark." + QString(format_names[f]).toLower() ;
+		const QByteArray stage = QByteArray("Export ") + format_names[f] ;
+
+		timer.start() ;
+		exporter->exportToFile(filename,primitive_tab,vparams) ;
+
+		const QByteArray file_size = QString("%1 KB").arg(QFileInfo(filename).size()/1024).toLatin1() ;
+		timer.report(stage.constData(),primitive_tab.size(),file_size.constData()) ;
+
+		delete exporter ;
+	}
+
+	deletePrimitives(primitive_tab) ;
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication application(argc,argv) ;
+
+	static const char *scene_names[] = { "soup", "planes", "grid" } ;
+	static const char *sort_names[] = { "none", "bsp", "topological", "advanced", "bsp-balanced", "bsp-parallel" } ;
+
+	vector<int> sizes ;
+	vector<int> scenes ;
+	vector<int> sorts ;
+
+	const QStringList arguments = application.arguments() ;
+
+	for(int i=1;i<arguments.size();++i)
+	{
+		bool ok ;
+		const int size = arguments[i].toInt(&ok) ;
+
+		if(ok && size > 0)
+		{
+			sizes.push_back(size) ;
+			continue ;
+		}
+
+		bool found = false ;
+
+		for(int s=0;s<3;++s)
+			if(arguments[i] == scene_names[s])
+			{
+				scenes.push_back(s) ;
+				found = true ;
+			}
+
+		for(int s=0;s<6;++s)
+			if(arguments[i] == sort_names[s])
+			{
+				sorts.push_back(s) ;
+				found = true ;
+			}
+
+		if(!found)
+		{
+			fprintf(stderr,"Usage: %s [sizes...] [soup|planes|grid...] [none|bsp|topological|advanced|bsp-balanced|bsp-parallel...]\n",argv[0]) ;
+			return 1 ;
+		}
+	}
+
+	if(sizes.empty())
+	{
+		sizes.push_back(1000) ;
+		sizes.push_back(10000) ;
+	}
+
+	if(scenes.empty())
+		for(int s=0;s<3;++s)
+			scenes.push_back(s) ;
+
+	if(sorts.empty())
+		for(int s=0;s<6;++s)
+			sorts.push_back(s) ;
+
+	QTemporaryDir directory ;
+
+	if(!directory.isValid())
+	{
+		fprintf(stderr,"Unable to create a temporary directory.\n") ;
+		return 1 ;
+	}
+
+	printf("%-8s %8s  %-12s %-18s %10s %10s %10s %10s\n","scene","size","sort","stage","time (ms)","primitives","arena (MB)","peak (MB)") ;
+
+	for(size_t s=0;s<scenes.size();++s)
+		for(size_t i=0;i<sizes.size();++i)
+		{
+			// Same scene for every sort method
+
+			srand(sizes[i]) ;
+
+			vector<GLfloat> buffer ;
+
+			switch(scenes[s])
+			{
+				case 0: triangleSoup(sizes[i],buffer) ; break ;
+				case 1: intersectingPlanes(sizes[i],buffer) ; break ;
+				default: cadGrid(sizes[i],buffer) ; break ;
+			}
+
+			for(size_t m=0;m<sorts.size();++m)
+			{
+				try
+				{
+					runPipeline(scene_names[scenes[s]],sizes[i],sorts[m],buffer,directory.path()) ;
+				}
+				catch(exception& e)
+				{
+					fprintf(stderr,"%s %d %s: %s\n",scene_names[scenes[s]],sizes[i],sort_names[sorts[m]],e.what()) ;
+				}
+			}
+		}
+
+	return 0 ;
+}
@@ -28,12 +28,6 @@ void Viewer::draw() {
 
   glPushMatrix();
   glMultMatrixd(manipulatedFrame()->matrix());
-  // Since the Clipping Plane equation is multiplied by the current modelView,
-  // we can define a constant equation (plane normal along Z and passing by the
-  // origin) since we are here in the manipulatedFrame coordinates system (we
-  // glMultMatrixd() with the manipulatedFrame matrix()).
-  static const GLdouble equation[] = {0.0, 0.0, 1.0, 0.0};
-  glClipPlane(GL_CLIP_PLANE0, equation);
 
   // Draw a plane representation: Its normal...
   glColor3f(0.8f, 0.8f, 0.8f);
@@ -58,13 +52,15 @@ void Viewer::init() {
   // The ManipulatedFrame will be used to position the clipping plane
   setManipulatedFrame(new ManipulatedFrame());
 
-  // Enable plane clipping
-  glEnable(GL_CLIP_PLANE0);
+  // The plane follows the manipulatedFrame, and keeps its positive Z side.
+  // preDraw() enables it for draw().
+  clippingRegion_.setPlane(0, manipulatedFrame());
+  setClippingRegion(&clippingRegion_);
 }
 
 QString Viewer::helpString() const {
   QString text("<h2>C l i p p i n g P l a n e</h2>");
-  text += "The standard OpenGL <i>GL_CLIP_PLANE</i> feature is used to add an "
+  text += "A <b>ClippingRegion</b> uses the OpenGL clip distances to add an "
           "additionnal clipping ";
   text += "plane in the scene, which position and orientation are set by a "
           "<b>ManipulatedFrame</b>.<br><br>";
@@ -72,10 +68,10 @@ QString Viewer::helpString() const {
           "modify the plane orientation (left button) ";
   text += "and position (right button) and to interactively see the clipped "
           "result.<br><br>";
-  text += "Since the plane equation is defined with respect to the current "
-          "modelView matrix, a constant equation (normal";
-  text += "along the Z axis) can be used since we transformed the coordinates "
-          "system using the <b>matrix()</b> method.";
+  text += "The plane is the XY plane of the <b>ManipulatedFrame</b>: it "
+          "follows the frame and the <b>preDraw()</b> method updates its ";
+  text += "equation at each frame. The same region can be given to a "
+          "<b>FrustumCuller</b> to skip the clipped objects.";
 
   return text;
 }
@@ -1,3 +1,4 @@
+#include <QGLViewer/clippingRegion.h>
 #include <QGLViewer/qglviewer.h>
 
 class Viewer : public QGLViewer {
@@ -5,4 +6,7 @@ protected:
   virtual void draw();
   virtual void init();
   virtual QString helpString() const;
+
+private:
+  qglviewer::ClippingRegion clippingRegion_;
 };
@@ -1,6 +1,8 @@
 #include "3dsViewer.h"
 
 #include <QKeyEvent>
+#include <QTimerEvent>
+#include <QVector>
 #include <lib3ds/camera.h>
 #include <lib3ds/light.h>
 #include <lib3ds/material.h>
@@ -30,6 +32,10 @@ QString Viewer::helpString() const {
   text +=
       "This example uses the lib3ds library to load a 3ds object file.<br><br>";
   text += "Press <b>L</b>(oad) to open a 3ds file.<br><br>";
+  text += "The meshes are converted in vertex buffers, sorted by material. ";
+  text += "This conversion is saved in a <i>.cache</i> file next to the 3ds ";
+  text += "file, which makes the next loadings faster. Files are loaded in ";
+  text += "a separate thread, and the objects appear as they are ready.<br><br>";
   text += "Note that certain 3ds files contain animated sequences that can ";
   text += "be played using the <b>Return</b> (animate) key.";
   return text;
@@ -50,23 +56,31 @@ void Viewer::loadFile() {
   if (name.isEmpty())
     return;
 
-#if QT_VERSION < 0x040000
-  file = lib3ds_file_load(name.latin1());
-#else
-  file = lib3ds_file_load(name.toLatin1().constData());
-#endif
-  if (!file) {
-    qWarning("Error : Unable to open file ");
-    exit(1);
+  // The previous file is still read by a loading in progress
+  loader.cancel();
+  nodes.clear();
+  makeCurrent();
+  meshCache.clear();
+  if (file) {
+    lib3ds_file_free(file);
+    file = NULL;
   }
+  stopAnimation();
 
+  // Parsing and conversion are done in a worker thread. Meshes are displayed
+  // as soon as they are converted.
+  loader.start(name);
+  if (!loadTimerId)
+    loadTimerId = startTimer(20);
+}
+
+// Called once the file is parsed. Its meshes are added afterwards.
+void Viewer::fileLoaded() {
   if (file->cameras)
     camera_name = file->cameras->name;
   else
     camera_name = NULL;
 
-  lib3ds_file_eval(file, 0);
-
   initScene();
 
   float min[3], max[3];
@@ -76,9 +90,49 @@ void Viewer::loadFile() {
 
   if (!file->cameras)
     camera()->showEntireScene();
+}
+
+// GL upload per timer event, so that a large file does not block the display
+static const int uploadBytesPerEvent = 4 * 1024 * 1024;
+
+void Viewer::pollLoader() {
+  // Checked first: the meshes are all published when the loading ends
+  const bool loading = loader.isLoading();
+
+  makeCurrent();
+  if (!file) {
+    file = loader.takeFile();
+    if (file)
+      fileLoaded();
+    else if (loader.failed()) {
+      qWarning("Error : Unable to open file ");
+      killTimer(loadTimerId);
+      loadTimerId = 0;
+      return;
+    }
+  }
+
+  if (file) {
+    const QList<MeshData> meshes = loader.takeMeshes();
+    for (int i = 0; i < meshes.size(); ++i)
+      meshCache.add(meshes[i]);
+
+    if (meshCache.uploadPending(uploadBytesPerEvent))
+      updateNodes();
+  }
+  update();
+
+  if (!loading && !meshCache.hasPending()) {
+    killTimer(loadTimerId);
+    loadTimerId = 0;
+  }
+}
+
+void Viewer::timerEvent(QTimerEvent *e) {
+  if (e->timerId() == loadTimerId)
+    pollLoader();
   else
-    updateGL();
-  stopAnimation();
+    QGLViewer::timerEvent(e);
 }
 
 void Viewer::init() {
@@ -156,93 +210,73 @@ void Viewer::initScene() {
   camera()->setFieldOfView(M_PI / 180.0 * c->data.camera.fov);
 }
 
-void Viewer::renderNode(Lib3dsNode *node) {
+void Viewer::collectNodes(Lib3dsNode *node) {
   for (Lib3dsNode *p = node->childs; p != 0; p = p->next)
-    renderNode(p);
+    collectNodes(p);
 
-  if (node->type == LIB3DS_OBJECT_NODE) {
-    if (strcmp(node->name, "$$$DUMMY") == 0)
-      return;
+  if (node->type != LIB3DS_OBJECT_NODE || strcmp(node->name, "$$$DUMMY") == 0)
+    return;
 
-    if (!node->user.d) {
-      Lib3dsMesh *mesh = lib3ds_file_mesh_by_name(file, node->name);
-      if (!mesh)
-        return;
-
-      node->user.d = glGenLists(1);
-      glNewList(node->user.d, GL_COMPILE);
-
-      Lib3dsVector *normalL = new Lib3dsVector[3 * mesh->faces];
-
-      Lib3dsMatrix M;
-      lib3ds_matrix_copy(M, mesh->matrix);
-      lib3ds_matrix_inv(M);
-      glMultMatrixf(&M[0][0]);
-
-      lib3ds_mesh_calculate_normals(mesh, normalL);
-
-      for (unsigned int p = 0; p < mesh->faces; ++p) {
-        Lib3dsFace *f = &mesh->faceL[p];
-        Lib3dsMaterial *mat = 0;
-        if (f->material[0])
-          mat = lib3ds_file_material_by_name(file, f->material);
-
-        if (mat) {
-          static GLfloat a[4] = {0, 0, 0, 1};
-          float s;
-          glMaterialfv(GL_FRONT, GL_AMBIENT, a);
-          glMaterialfv(GL_FRONT, GL_DIFFUSE, mat->diffuse);
-          glMaterialfv(GL_FRONT, GL_SPECULAR, mat->specular);
-          s = pow(2, 10.0 * mat->shininess);
-          if (s > 128.0)
-            s = 128.0;
-          glMaterialf(GL_FRONT, GL_SHININESS, s);
-        } else {
-          Lib3dsRgba a = {0.2, 0.2, 0.2, 1.0};
-          Lib3dsRgba d = {0.8, 0.8, 0.8, 1.0};
-          Lib3dsRgba s = {0.0, 0.0, 0.0, 1.0};
-          glMaterialfv(GL_FRONT, GL_AMBIENT, a);
-          glMaterialfv(GL_FRONT, GL_DIFFUSE, d);
-          glMaterialfv(GL_FRONT, GL_SPECULAR, s);
-        }
-
-        glBegin(GL_TRIANGLES);
-        glNormal3fv(f->normal);
-        for (int i = 0; i < 3; ++i) {
-          glNormal3fv(normalL[3 * p + i]);
-          glVertex3fv(mesh->pointL[f->points[i]].pos);
-        }
-        glEnd();
-      }
-
-      delete[] normalL;
-
-      glEndList();
-    }
+  Lib3dsMesh *mesh = lib3ds_file_mesh_by_name(file, node->name);
+  CachedMesh *cached = meshCache.mesh(node->name);
+  if (!mesh || !cached)
+    return;
 
-    if (node->user.d) {
-      glPushMatrix();
-      Lib3dsObjectData *d = &node->data.object;
-      glMultMatrixf(&node->matrix[0][0]);
-      glTranslatef(-d->pivot[0], -d->pivot[1], -d->pivot[2]);
-      glCallList(node->user.d);
-      glPopMatrix();
-    }
-  }
+  // node matrix * pivot translation * inverse mesh matrix
+  DrawnNode drawn;
+  drawn.mesh = cached;
+  Lib3dsObjectData *d = &node->data.object;
+  lib3ds_matrix_copy(drawn.matrix, node->matrix);
+  lib3ds_matrix_translate_xyz(drawn.matrix, -d->pivot[0], -d->pivot[1],
+                              -d->pivot[2]);
+  Lib3dsMatrix M;
+  lib3ds_matrix_copy(M, mesh->matrix);
+  lib3ds_matrix_inv(M);
+  lib3ds_matrix_mult(drawn.matrix, M);
+  nodes.append(drawn);
 }
 
-void Viewer::draw() {
+void Viewer::updateNodes() {
+  nodes.clear();
   if (!file)
     return;
 
   for (Lib3dsNode *p = file->nodes; p != 0; p = p->next)
-    renderNode(p);
+    collectNodes(p);
+}
+
+void Viewer::draw() {
+  if (!file)
+    return;
+
+  // One draw call per material of each node
+  for (int i = 0; i < nodes.size(); ++i) {
+    glPushMatrix();
+    glMultMatrixf(&nodes[i].matrix[0][0]);
+    MeshCache::draw(nodes[i].mesh);
+    glPopMatrix();
+  }
 }
 
 void Viewer::animate() {
+  if (!file)
+    return;
+
   current_frame++;
   if (current_frame > file->frames)
     current_frame = 0;
   lib3ds_file_eval(file, current_frame);
+  updateNodes();
   initScene();
 }
+
+Viewer::~Viewer() {
+  loader.cancel();
+
+  // The vertex buffers are released with the context current
+  makeCurrent();
+  meshCache.clear();
+  doneCurrent();
+  if (file)
+    lib3ds_file_free(file);
+}
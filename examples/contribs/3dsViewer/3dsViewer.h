@@ -1,11 +1,16 @@
 #include <QGLViewer/qglviewer.h>
 
 #include <lib3ds/file.h>
+#include <lib3ds/matrix.h>
 #include <lib3ds/node.h>
 
+#include "meshCache.h"
+
 class Viewer : public QGLViewer {
 public:
-  Viewer() : file(NULL), current_frame(0.0), camera_name(NULL){};
+  Viewer()
+      : file(NULL), current_frame(0.0), camera_name(NULL), loadTimerId(0){};
+  virtual ~Viewer();
 
 protected:
   virtual void draw();
@@ -13,13 +18,32 @@ protected:
   virtual void init();
   virtual void keyPressEvent(QKeyEvent *e);
   virtual QString helpString() const;
+  virtual void timerEvent(QTimerEvent *e);
 
-  void renderNode(Lib3dsNode *node);
+  void updateNodes();
+  void collectNodes(Lib3dsNode *node);
   void loadFile();
+  void fileLoaded();
+  void pollLoader();
   void initScene();
 
 private:
   Lib3dsFile *file;
   float current_frame;
   char *camera_name;
+
+  // Meshes of the file, in vertex buffers
+  MeshCache meshCache;
+
+  // Loads the file in a worker thread, polled by a timer
+  MeshLoader loader;
+  int loadTimerId;
+
+  // An object node and its transformation, updated by updateNodes() after each
+  // lib3ds_file_eval()
+  struct DrawnNode {
+    CachedMesh *mesh;
+    Lib3dsMatrix matrix;
+  };
+  QVector<DrawnNode> nodes;
 };
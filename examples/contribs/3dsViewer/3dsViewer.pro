@@ -11,9 +11,11 @@
 # (or in <code>lib3ds/file.h</code>) :
 # <pre>extern "C" { LIB3DSAPI void lib3ds_file_bounding_box(Lib3dsFile *file, Lib3dsVector min, Lib3dsVector max); }</pre>
 
-# This example is simply a translation of a lib3ds example. Although it uses display lists, the
-# rendering speed does not seem to be as good as with other 3ds libraries (10 factor speed up). Note
-# however that this is due to the lib3ds library and not QGLViewer.
+# This example is originally a translation of a lib3ds example. The meshes are converted in vertex
+# buffers, with the faces sorted by material, so that each object only requires one draw call per
+# material. This conversion is saved in a <code>.cache</code> file next to the 3ds file.
+# Files are parsed and converted in a worker thread, and the objects are displayed (and uploaded
+# on the graphics card) progressively, so that the interface remains responsive on large models.
 
 # Press '<b>L</b>' (load) to load a new 3DS scene.
 
@@ -36,8 +38,8 @@ TARGET   = 3dsViewer
 
 # win32:LIBS  *= C:\code\lib\lib3ds.lib
 
-HEADERS  = 3dsViewer.h
-SOURCES  = 3dsViewer.cpp main.cpp
+HEADERS  = 3dsViewer.h meshCache.h
+SOURCES  = 3dsViewer.cpp meshCache.cpp main.cpp
 
 DISTFILES += *.3DS
 
@@ -0,0 +1,370 @@
+#include "meshCache.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <lib3ds/material.h>
+#include <lib3ds/mesh.h>
+#include <math.h>
+#include <qopengl.h>
+
+// Cache file header: "3DSC" followed by the format version
+static const quint32 cacheMagic = 0x33445343;
+static const quint32 cacheVersion = 1;
+
+// Position and normal of a vertex
+static const int vertexSize = 6;
+
+static void setColor(float *color, float r, float g, float b, float a) {
+  color[0] = r;
+  color[1] = g;
+  color[2] = b;
+  color[3] = a;
+}
+
+// Same material parameters as the ones of the original lib3ds example.
+static void setMaterial(MeshBatch &batch, const Lib3dsMaterial *mat) {
+  if (mat) {
+    setColor(batch.ambient, 0.0, 0.0, 0.0, 1.0);
+    setColor(batch.diffuse, mat->diffuse[0], mat->diffuse[1],
+             mat->diffuse[2], mat->diffuse[3]);
+    setColor(batch.specular, mat->specular[0], mat->specular[1],
+             mat->specular[2], mat->specular[3]);
+    batch.shininess = pow(2, 10.0 * mat->shininess);
+    if (batch.shininess > 128.0)
+      batch.shininess = 128.0;
+  } else {
+    setColor(batch.ambient, 0.2, 0.2, 0.2, 1.0);
+    setColor(batch.diffuse, 0.8, 0.8, 0.8, 1.0);
+    setColor(batch.specular, 0.0, 0.0, 0.0, 1.0);
+    batch.shininess = 0.0;
+  }
+}
+
+// Groups the faces of mesh by material. Face corners that have the same
+// position and normal share a vertex.
+static void convertMesh(Lib3dsFile *file, Lib3dsMesh *mesh, MeshData &data) {
+  data.name = QString::fromLatin1(mesh->name);
+
+  Lib3dsVector *normalL = new Lib3dsVector[3 * mesh->faces];
+  lib3ds_mesh_calculate_normals(mesh, normalL);
+
+  QMap<QByteArray, QVector<unsigned int> > faces;
+  for (unsigned int p = 0; p < mesh->faces; ++p)
+    faces[QByteArray(mesh->faceL[p].material)].append(p);
+
+  QHash<QByteArray, GLuint> vertexIndex;
+  for (QMap<QByteArray, QVector<unsigned int> >::const_iterator it =
+           faces.constBegin();
+       it != faces.constEnd(); ++it) {
+    MeshBatch batch;
+    Lib3dsMaterial *mat = 0;
+    if (!it.key().isEmpty())
+      mat = lib3ds_file_material_by_name(file, it.key().constData());
+    setMaterial(batch, mat);
+    batch.first = data.indices.size();
+
+    const QVector<unsigned int> &faceList = it.value();
+    for (int f = 0; f < faceList.size(); ++f) {
+      const unsigned int p = faceList[f];
+      for (int i = 0; i < 3; ++i) {
+        const float *pos = mesh->pointL[mesh->faceL[p].points[i]].pos;
+        const float *normal = normalL[3 * p + i];
+        const GLfloat v[vertexSize] = {pos[0],    pos[1],    pos[2],
+                                       normal[0], normal[1], normal[2]};
+        const QByteArray key(reinterpret_cast<const char *>(v), sizeof(v));
+
+        QHash<QByteArray, GLuint>::const_iterator found =
+            vertexIndex.constFind(key);
+        GLuint index;
+        if (found == vertexIndex.constEnd()) {
+          index = data.vertices.size() / vertexSize;
+          vertexIndex.insert(key, index);
+          for (int k = 0; k < vertexSize; ++k)
+            data.vertices.append(v[k]);
+        } else
+          index = found.value();
+        data.indices.append(index);
+      }
+    }
+
+    batch.count = data.indices.size() - batch.first;
+    data.batches.append(batch);
+  }
+
+  delete[] normalL;
+}
+
+static QString cacheFileName(const QString &fileName) {
+  return fileName + ".cache";
+}
+
+// The cache is only valid for the 3DS file it was created from.
+static void writeSource(QDataStream &stream, const QFileInfo &source) {
+  stream << cacheMagic << cacheVersion << qint64(source.size())
+         << qint64(source.lastModified().toMSecsSinceEpoch());
+}
+
+static bool readCache(const QString &fileName, QVector<MeshData> &meshes) {
+  QFile cache(cacheFileName(fileName));
+  if (!cache.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream in(&cache);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+  const QFileInfo source(fileName);
+  quint32 magic, version;
+  qint64 size, modified;
+  in >> magic >> version >> size >> modified;
+  if ((magic != cacheMagic) || (version != cacheVersion) ||
+      (size != source.size()) ||
+      (modified != source.lastModified().toMSecsSinceEpoch()))
+    return false;
+
+  qint32 nbMeshes;
+  in >> nbMeshes;
+  if (in.status() != QDataStream::Ok || nbMeshes < 0)
+    return false;
+  meshes.resize(nbMeshes);
+  for (int m = 0; m < nbMeshes; ++m) {
+    MeshData &data = meshes[m];
+    qint32 nbBatches;
+    in >> data.name >> data.vertices >> data.indices >> nbBatches;
+    if (in.status() != QDataStream::Ok || nbBatches < 0)
+      return false;
+    data.batches.resize(nbBatches);
+    for (int b = 0; b < nbBatches; ++b) {
+      MeshBatch &batch = data.batches[b];
+      qint32 first, count;
+      for (int i = 0; i < 4; ++i)
+        in >> batch.ambient[i] >> batch.diffuse[i] >> batch.specular[i];
+      in >> batch.shininess >> first >> count;
+      batch.first = first;
+      batch.count = count;
+      if (first < 0 || count < 0 || first + count > data.indices.size())
+        return false;
+    }
+  }
+  return in.status() == QDataStream::Ok;
+}
+
+static void writeCache(const QString &fileName,
+                       const QVector<MeshData> &meshes) {
+  QFile cache(cacheFileName(fileName));
+  if (!cache.open(QIODevice::WriteOnly)) {
+    qWarning("Unable to write mesh cache %s",
+             cache.fileName().toLatin1().constData());
+    return;
+  }
+
+  QDataStream out(&cache);
+  out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  writeSource(out, QFileInfo(fileName));
+
+  out << qint32(meshes.size());
+  for (int m = 0; m < meshes.size(); ++m) {
+    const MeshData &data = meshes[m];
+    out << data.name << data.vertices << data.indices
+        << qint32(data.batches.size());
+    for (int b = 0; b < data.batches.size(); ++b) {
+      const MeshBatch &batch = data.batches[b];
+      for (int i = 0; i < 4; ++i)
+        out << batch.ambient[i] << batch.diffuse[i] << batch.specular[i];
+      out << batch.shininess << qint32(batch.first) << qint32(batch.count);
+    }
+  }
+}
+
+bool MeshCache::uploadPending(int maxBytes) {
+  if (pending.isEmpty())
+    return false;
+
+  int bytes = 0;
+  while (!pending.isEmpty() && bytes < maxBytes) {
+    const MeshData data = pending.takeFirst();
+    CachedMesh *mesh = new CachedMesh();
+    mesh->batches = data.batches;
+
+    mesh->vertices.create();
+    mesh->vertices.bind();
+    mesh->vertices.allocate(data.vertices.constData(),
+                            data.vertices.size() * sizeof(GLfloat));
+    mesh->vertices.release();
+
+    mesh->indices.create();
+    mesh->indices.bind();
+    mesh->indices.allocate(data.indices.constData(),
+                           data.indices.size() * sizeof(GLuint));
+    mesh->indices.release();
+
+    delete meshes.value(data.name);
+    meshes.insert(data.name, mesh);
+    bytes += mesh->vertices.size() + mesh->indices.size();
+  }
+  return true;
+}
+
+void MeshCache::clear() {
+  qDeleteAll(meshes);
+  meshes.clear();
+  pending.clear();
+}
+
+CachedMesh *MeshCache::mesh(const char *name) const {
+  return meshes.value(QString::fromLatin1(name));
+}
+
+void MeshCache::draw(CachedMesh *mesh) {
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  mesh->vertices.bind();
+  glVertexPointer(3, GL_FLOAT, vertexSize * sizeof(GLfloat), 0);
+  glNormalPointer(GL_FLOAT, vertexSize * sizeof(GLfloat),
+                  reinterpret_cast<const GLvoid *>(3 * sizeof(GLfloat)));
+  mesh->indices.bind();
+
+  for (int b = 0; b < mesh->batches.size(); ++b) {
+    const MeshBatch &batch = mesh->batches[b];
+    glMaterialfv(GL_FRONT, GL_AMBIENT, batch.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, batch.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, batch.specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, batch.shininess);
+    glDrawElements(GL_TRIANGLES, batch.count, GL_UNSIGNED_INT,
+                   reinterpret_cast<const GLvoid *>(batch.first *
+                                                    sizeof(GLuint)));
+  }
+
+  mesh->indices.release();
+  mesh->vertices.release();
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               MeshLoader                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+class MeshLoaderTask : public QRunnable {
+public:
+  MeshLoaderTask(MeshLoader *loader, const QString &fileName)
+      : loader(loader), fileName(fileName) {}
+  virtual void run() { loader->run(fileName); }
+
+private:
+  MeshLoader *loader;
+  QString fileName;
+};
+
+MeshLoader::MeshLoader()
+    : file(NULL), fileTaken(false), loadFailed(false), loading(false),
+      canceled(false) {
+  pool.setMaxThreadCount(1);
+}
+
+/* Starts loading fileName. A previous loading is canceled first. */
+void MeshLoader::start(const QString &fileName) {
+  cancel();
+
+  QMutexLocker locker(&mutex);
+  file = NULL;
+  fileTaken = false;
+  loadFailed = false;
+  loading = true;
+  canceled = false;
+  meshes.clear();
+  pool.start(new MeshLoaderTask(this, fileName));
+}
+
+/* Stops the loading, and waits for the worker thread. A file that was not
+ taken yet is freed. */
+void MeshLoader::cancel() {
+  mutex.lock();
+  canceled = true;
+  mutex.unlock();
+  pool.waitForDone();
+
+  QMutexLocker locker(&mutex);
+  if (file && !fileTaken)
+    lib3ds_file_free(file);
+  file = NULL;
+  loading = false;
+  meshes.clear();
+}
+
+bool MeshLoader::isLoading() const {
+  QMutexLocker locker(&mutex);
+  return loading;
+}
+
+bool MeshLoader::isCanceled() const {
+  QMutexLocker locker(&mutex);
+  return canceled;
+}
+
+Lib3dsFile *MeshLoader::takeFile() {
+  QMutexLocker locker(&mutex);
+  if (!file || fileTaken)
+    return NULL;
+  fileTaken = true;
+  return file;
+}
+
+bool MeshLoader::failed() const {
+  QMutexLocker locker(&mutex);
+  return loadFailed;
+}
+
+QList<MeshData> MeshLoader::takeMeshes() {
+  QMutexLocker locker(&mutex);
+  QList<MeshData> taken = meshes;
+  meshes.clear();
+  return taken;
+}
+
+// In the worker thread. Meshes are published as soon as they are converted,
+// so that the GUI thread displays them progressively.
+void MeshLoader::run(const QString &fileName) {
+  Lib3dsFile *loaded = lib3ds_file_load(fileName.toLatin1().constData());
+  if (loaded)
+    lib3ds_file_eval(loaded, 0);
+
+  mutex.lock();
+  file = loaded;
+  loadFailed = (loaded == NULL);
+  if (!loaded)
+    loading = false;
+  mutex.unlock();
+  if (!loaded)
+    return;
+
+  QVector<MeshData> data;
+  if (readCache(fileName, data)) {
+    QMutexLocker locker(&mutex);
+    for (int m = 0; m < data.size(); ++m)
+      meshes.append(data[m]);
+    loading = false;
+    return;
+  }
+
+  data.clear();
+  for (Lib3dsMesh *mesh = loaded->meshes; mesh != 0; mesh = mesh->next) {
+    if (isCanceled())
+      return;
+    data.append(MeshData());
+    convertMesh(loaded, mesh, data.last());
+
+    QMutexLocker locker(&mutex);
+    meshes.append(data.last());
+  }
+  writeCache(fileName, data);
+
+  QMutexLocker locker(&mutex);
+  loading = false;
+}
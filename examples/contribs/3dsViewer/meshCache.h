@@ -0,0 +1,104 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QOpenGLBuffer>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include <lib3ds/file.h>
+
+// The faces of a mesh that share a material, drawn with one glDrawElements.
+struct MeshBatch {
+  float ambient[4], diffuse[4], specular[4];
+  float shininess;
+  int first, count; // Range of the batch in the index buffer
+};
+
+// A lib3ds mesh stored on the graphics card: an interleaved position/normal
+// vertex buffer and an index buffer sorted by material.
+struct CachedMesh {
+  CachedMesh()
+      : vertices(QOpenGLBuffer::VertexBuffer),
+        indices(QOpenGLBuffer::IndexBuffer) {}
+
+  QOpenGLBuffer vertices, indices;
+  QVector<MeshBatch> batches;
+};
+
+// CPU side copy of a CachedMesh, as converted or read from the cache file.
+struct MeshData {
+  QString name;
+  QVector<GLfloat> vertices;
+  QVector<GLuint> indices;
+  QVector<MeshBatch> batches;
+};
+
+// The meshes of a Lib3dsFile, in vertex buffers. They are queued by add()
+// and uploaded a few at a time by uploadPending(), so that large files do not
+// block the display.
+class MeshCache {
+public:
+  ~MeshCache() { clear(); }
+
+  void add(const MeshData &data) { pending.append(data); }
+  bool hasPending() const { return !pending.isEmpty(); }
+
+  // Both must be called with the OpenGL context current. uploadPending()
+  // uploads the queued meshes until maxBytes are sent (at least one mesh),
+  // and returns false when none was pending.
+  bool uploadPending(int maxBytes);
+  void clear();
+
+  // NULL when there is no mesh with this name, or when it is not uploaded yet.
+  CachedMesh *mesh(const char *name) const;
+
+  // Draws all the batches of mesh, with the current modelView matrix.
+  static void draw(CachedMesh *mesh);
+
+private:
+  QMap<QString, CachedMesh *> meshes;
+  QList<MeshData> pending;
+};
+
+// Loads a 3DS file in a worker thread: parsing, normal computation and
+// batching of the meshes. The conversion is saved in a binary file next to the
+// 3DS file (with a .cache extension), and reloaded from there as long as the
+// 3DS file is unchanged.
+//
+// The GUI thread polls takeFile() and takeMeshes(). Once taken, the
+// Lib3dsFile belongs to the caller, but its meshes are still read by the
+// worker: it must not be freed nor modified (except its nodes, by
+// lib3ds_file_eval()) before isLoading() returns false or cancel() returns.
+class MeshLoader {
+public:
+  MeshLoader();
+  ~MeshLoader() { cancel(); }
+
+  void start(const QString &fileName);
+  void cancel();
+  bool isLoading() const;
+
+  // The parsed file, evaluated at frame 0, returned once. Also NULL when the
+  // file could not be loaded: see failed().
+  Lib3dsFile *takeFile();
+  bool failed() const;
+  // The meshes converted since the previous call.
+  QList<MeshData> takeMeshes();
+
+private:
+  friend class MeshLoaderTask;
+  void run(const QString &fileName);
+  bool isCanceled() const;
+
+  QThreadPool pool; // a single loading thread
+  mutable QMutex mutex;
+  Lib3dsFile *file;
+  bool fileTaken, loadFailed, loading, canceled;
+  QList<MeshData> meshes;
+};
+
+#endif // MESH_CACHE_H
@@ -1,7 +1,7 @@
 TEMPLATE = app
 TARGET   = agoraAI 
 
-HEADERS = ../Viewer/board.h ../Viewer/move.h ../Viewer/undo.h ../Viewer/case.h
-SOURCES = ai.cpp ../Viewer/board.cpp ../Viewer/move.cpp ../Viewer/undo.cpp ../Viewer/case.cpp
+HEADERS = ../Viewer/board.h ../Viewer/engine.h ../Viewer/move.h ../Viewer/undo.h ../Viewer/case.h
+SOURCES = ai.cpp ../Viewer/board.cpp ../Viewer/engine.cpp ../Viewer/move.cpp ../Viewer/undo.cpp ../Viewer/case.cpp
 
 include( ../../../examples.pri )
@@ -1,4 +1,5 @@
 #include "../Viewer/board.h"
+#include "../Viewer/engine.h"
 #include <fstream>
 #include <stdio.h>
 
@@ -16,7 +17,12 @@ int main(int argc, char **argv) {
   file >> board;
   file.close();
 
-  std::cout << board.randomMove(QString(argv[2]).toInt() >= 0) << std::endl;
+  // The allowed time (in milliseconds) is negative when white plays. Keep
+  // some time for the process start and exit.
+  const int allowedTime = QString(argv[2]).toInt();
+  Engine engine;
+  engine.setBoard(board, allowedTime >= 0, QString(argv[3]).toInt());
+  std::cout << engine.bestMove(qAbs(allowedTime) * 9 / 10) << std::endl;
 
   return 0;
 }
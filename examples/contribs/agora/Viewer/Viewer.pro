@@ -3,11 +3,15 @@
 # <i>Agora</i> is a strategy game for two players. The rules are available in the help menu. The
 # two players can be human or computer.
 
+# Computer players use a built-in engine (an alpha-beta search with a transposition table, which
+# keeps on searching during the opponent's turn), unless an external program is selected in their
+# configuration. The AI directory provides the same engine as an external program.
+
 TEMPLATE = app
 TARGET   = agora
 
-HEADERS += agoraViewer.h   board.h   move.h   computerPlayer.h   undo.h   case.h
-SOURCES += agoraViewer.cpp board.cpp move.cpp computerPlayer.cpp undo.cpp case.cpp main.cpp
+HEADERS += agoraViewer.h   board.h   move.h   computerPlayer.h   engine.h   undo.h   case.h
+SOURCES += agoraViewer.cpp board.cpp move.cpp computerPlayer.cpp engine.cpp undo.cpp case.cpp main.cpp
 
 QT_VERSION=$$[QT_VERSION]
 contains( QT_VERSION, "^3.*" ) {
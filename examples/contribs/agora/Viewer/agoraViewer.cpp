@@ -69,21 +69,8 @@ AgoraViewer::AgoraViewer(QWidget *parent)
   computerPlayer_[0].setIsActive(false);
   computerPlayer_[1].setIsActive(false);
 
-  QStringList programFileNames;
-  programFileNames << "agoraAI"
-                   << "agoraAI.exe"
-                   << "../AI/agoraAI"
-                   << "../../AI/release/agoraAI.exe"
-                   << "../../AI/debug/agoraAI.exe"
-                   << "../AI/release/agoraAI.exe"
-                   << "../AI/debug/agoraAI.exe";
-  for (int i = 0; i < programFileNames.size(); ++i) {
-    if (QFileInfo(programFileNames.at(i)).isExecutable()) {
-      for (int c = 0; c < 2; ++c)
-        computerPlayer_[c].setProgramFileName(programFileNames.at(i));
-      break;
-    }
-  }
+  // Computer players use the built-in engine. An external program can be
+  // selected in the player configuration.
 }
 
 // I n i t i a l i z a t i o n   f u n c t i o n s
@@ -329,8 +316,7 @@ void AgoraViewer::playNextMove() {
     f << *board_;
     f.close();
 
-    computerPlayer_[board_->blackPlays()].play(
-        board_->blackPlays(), stateFileName, board_->nbMovesLeft());
+    computerPlayer_[board_->blackPlays()].play(*board_, stateFileName);
   }
 }
 
@@ -1,10 +1,15 @@
 #include "computerPlayer.h"
+#include "board.h"
+#include "engine.h"
 #include "qlineedit.h"
 #include "qprocess.h"
 #include "qpushbutton.h"
 #include "qspinbox.h"
 #include <qfiledialog.h>
 #include <qmessagebox.h>
+#include <QRunnable>
+#include <QThreadPool>
+#include <sstream>
 
 #if QT_VERSION >= 0x040000
 #include "ui_computerPlayerInterface.h"
@@ -25,8 +30,37 @@ public:
 
 static QTime Clock;
 
+// Runs the Engine out of the GUI thread. The move is sent back to the
+// ComputerPlayer with a queued call, then the engine ponders during the
+// opponent's turn, until ComputerPlayer::stopEngine().
+class EngineSearch : public QRunnable {
+public:
+  EngineSearch(ComputerPlayer *player, Engine *engine, int allowedTime)
+      : player_(player), engine_(engine), allowedTime_(allowedTime) {}
+  virtual void run() {
+    const Move move = engine_->bestMove(allowedTime_);
+    std::ostringstream text;
+    text << move;
+    QMetaObject::invokeMethod(
+        player_, "engineMoveMade", Qt::QueuedConnection,
+        Q_ARG(QString, QString::fromLatin1(text.str().c_str()).trimmed()));
+    engine_->ponder(move);
+  }
+
+private:
+  ComputerPlayer *player_;
+  Engine *engine_;
+  int allowedTime_;
+};
+
 ComputerPlayer::ComputerPlayer() : isActive_(false) {
   interface_ = new ComputerPlayerInterface();
+  interface_->programNameLineEdit->setPlaceholderText("Built-in engine");
+  engine_ = new Engine();
+  engineThread_ = new QThreadPool();
+  engineThread_->setMaxThreadCount(1);
+  // Keeps its thread between the moves
+  engineThread_->setExpiryTimeout(-1);
 
   connect(interface_->browseButton, SIGNAL(released()), this,
           SLOT(selectProgram()));
@@ -35,7 +69,18 @@ ComputerPlayer::ComputerPlayer() : isActive_(false) {
   setAllowedTime(3000);
 }
 
-ComputerPlayer::~ComputerPlayer() { delete interface_; }
+ComputerPlayer::~ComputerPlayer() {
+  stopEngine();
+  delete engineThread_;
+  delete engine_;
+  delete interface_;
+}
+
+// Interrupts the pondering (or the search) and waits for the engine thread.
+void ComputerPlayer::stopEngine() {
+  engine_->stopPondering();
+  engineThread_->waitForDone();
+}
 
 void ComputerPlayer::selectProgram() {
 #if QT_VERSION < 0x040000
@@ -52,8 +97,8 @@ void ComputerPlayer::selectProgram() {
 }
 
 void ComputerPlayer::setIsActive(bool on) {
-  if (on && (programFileName().isEmpty()))
-    configure();
+  if (!on)
+    stopEngine();
   isActive_ = on;
 }
 
@@ -83,11 +128,23 @@ void ComputerPlayer::setProgramFileName(const QString &name) {
   interface_->programNameLineEdit->setText(name);
 }
 
-void ComputerPlayer::play(bool black, const QString &stateFileName,
-                          int nbMovesLeft) {
+void ComputerPlayer::play(const Board &board, const QString &stateFileName) {
   if (!isActive_)
     return; // So that human user can play
 
+  const bool black = board.blackPlays();
+  const int nbMovesLeft = board.nbMovesLeft();
+
+  if (programFileName().isEmpty()) {
+    // The position is copied in the GUI thread, once the pondering on the
+    // previous position is stopped. The table it filled is kept.
+    stopEngine();
+    engine_->setBoard(board, black, nbMovesLeft);
+    Clock.start();
+    engineThread_->start(new EngineSearch(this, engine_, allowedTime()));
+    return;
+  }
+
   while (true) {
     const QFileInfo fi(programFileName());
 
@@ -146,3 +203,7 @@ void ComputerPlayer::readFromStdout() {
   process_->deleteLater();
 #endif
 }
+
+void ComputerPlayer::engineMoveMade(QString move) {
+  Q_EMIT moveMade(move, Clock.elapsed());
+}
@@ -0,0 +1,436 @@
+#include "engine.h"
+#include "board.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QtAlgorithms>
+
+static const int infiniteValue = 1000000;
+// Larger than any difference of number of pieces
+static const int winValue = 10000;
+static const int maxDepth = 64;
+// Transposition table entries, a power of 2
+static const int tableSize = 1 << 18;
+
+static const int exactBound = 0;
+static const int lowerBound = 1;
+static const int upperBound = 2;
+
+static quint64 bit(int square) { return quint64(1) << square; }
+static int firstSquare(quint64 b) { return int(qCountTrailingZeroBits(b)); }
+
+// SplitMix64 finalizer
+static quint64 mix(quint64 x) {
+  x += Q_UINT64_C(0x9E3779B97F4A7C15);
+  x = (x ^ (x >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+  x = (x ^ (x >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+  return x ^ (x >> 31);
+}
+
+// Zobrist keys, computed instead of stored in a table since the stacks have no
+// maximum height.
+static quint64 stackKey(int square, int top, int bottom, bool black) {
+  if (top == 0)
+    return 0;
+  return mix(quint64(square) | (quint64(top) << 8) | (quint64(bottom) << 24) |
+             (quint64(black) << 40));
+}
+
+static quint64 movesLeftKey(int nbMovesLeft) {
+  return mix((quint64(1) << 48) | quint64(nbMovesLeft));
+}
+
+static const quint64 blackPlaysKey = Q_UINT64_C(0x5DEECE66D1B0C3A7);
+
+class RootSearch : public QRunnable {
+public:
+  RootSearch(Engine *engine, int index, int depth)
+      : engine_(engine), index_(index), depth_(depth) {}
+  virtual void run() { engine_->searchRootMove(index_, depth_); }
+
+private:
+  Engine *engine_;
+  int index_, depth_;
+};
+
+Engine::Engine()
+    : sizeX_(0), sizeY_(0), canPlay_(false), table_(tableSize),
+      rootBestValue_(0), rootBestIndex_(0), allowedTime_(0),
+      interruptible_(false), depth_(0) {
+  for (int s = 0; s < 64; ++s) {
+    altitude_[s] = 0;
+    ring_[s] = 0;
+  }
+}
+
+bool Engine::setBoard(const Board &board, bool black, int nbMovesLeft) {
+  const int sizeX = board.size().width();
+  const int sizeY = board.size().height();
+
+  randomMove_ = board.randomMove(black);
+  canceled_.storeRelease(0);
+  canPlay_ = (sizeX * sizeY <= 64);
+  if (!canPlay_)
+    return false;
+
+  bool sameGeometry = (sizeX == sizeX_) && (sizeY == sizeY_);
+  Position &p = position_;
+  p.black = p.white = 0;
+  p.nbPieces[0] = p.nbPieces[1] = 0;
+  p.hash = 0;
+  for (int i = 0; i < sizeX; ++i)
+    for (int j = 0; j < sizeY; ++j) {
+      const int square = i * sizeY + j;
+      const Case &c = board.caseAt(QPoint(i, j));
+      const int altitude = c.topAltitude() - c.nbTop() - c.nbBottom();
+      if (altitude != altitude_[square])
+        sameGeometry = false;
+      altitude_[square] = altitude;
+
+      p.top[square] = c.nbTop();
+      p.bottom[square] = c.nbBottom();
+      p.topIsBlack[square] = c.topIsBlack();
+      addStack(p, square);
+    }
+  p.nbMovesLeft = nbMovesLeft;
+  p.blackPlays = black;
+  p.hash ^= movesLeftKey(nbMovesLeft) ^ (black ? blackPlaysKey : 0);
+
+  // The geometry only changes with the board: the table remains valid
+  // between the moves of a game
+  if (!sameGeometry) {
+    sizeX_ = sizeX;
+    sizeY_ = sizeY;
+    for (int s = 0; s < sizeX * sizeY; ++s) {
+      ring_[s] = 0;
+      for (int i = -1; i <= 1; ++i)
+        for (int j = -1; j <= 1; ++j) {
+          const int x = s / sizeY + i;
+          const int y = s % sizeY + j;
+          if ((x >= 0) && (y >= 0) && (x < sizeX) && (y < sizeY) &&
+              ((i != 0) || (j != 0)))
+            ring_[s] |= bit(x * sizeY + y);
+        }
+    }
+    table_.fill(Entry());
+  }
+  return true;
+}
+
+// removeStack() and addStack() surround the modifications of a stack, to keep
+// the bitboards, the numbers of pieces and the hash up to date.
+void Engine::removeStack(Position &p, int square) const {
+  if (p.top[square] == 0)
+    return;
+  const bool black = p.topIsBlack[square];
+  p.hash ^= stackKey(square, p.top[square], p.bottom[square], black);
+  p.nbPieces[black] -= p.top[square];
+  p.nbPieces[!black] -= p.bottom[square];
+  p.black &= ~bit(square);
+  p.white &= ~bit(square);
+}
+
+void Engine::addStack(Position &p, int square) const {
+  if (p.top[square] == 0)
+    return;
+  const bool black = p.topIsBlack[square];
+  p.hash ^= stackKey(square, p.top[square], p.bottom[square], black);
+  p.nbPieces[black] += p.top[square];
+  p.nbPieces[!black] += p.bottom[square];
+  if (black)
+    p.black |= bit(square);
+  else
+    p.white |= bit(square);
+}
+
+// Same rules as Move::isValid().
+void Engine::generateMoves(const Position &p, MoveList &moves) const {
+  const quint64 own = p.blackPlays ? p.black : p.white;
+  const quint64 other = p.blackPlays ? p.white : p.black;
+
+  for (quint64 s = own; s; s &= s - 1) {
+    const int start = firstSquare(s);
+    const int startAltitude = topAltitude(p, start);
+    for (quint64 e = ring_[start]; e; e &= e - 1) {
+      const int end = firstSquare(e);
+      if (own & bit(end))
+        continue;
+      const bool opponent = (other & bit(end)) != 0;
+      const int endAltitude = topAltitude(p, end);
+      if (!opponent || (startAltitude >= endAltitude)) {
+        const EngineMove m = {start, end, false};
+        moves.append(m);
+      }
+      if (opponent && (startAltitude <= endAltitude)) {
+        const EngineMove m = {start, end, true};
+        moves.append(m);
+      }
+    }
+  }
+}
+
+// Move of the transposition table first, then the moves that cover the
+// largest opponent stacks.
+void Engine::orderMoves(const Position &p, MoveList &moves,
+                        const Entry *hashMove) const {
+  QVarLengthArray<int, 256> keys(moves.size());
+  for (int i = 0; i < moves.size(); ++i) {
+    const EngineMove &m = moves[i];
+    if (hashMove && (m.start == hashMove->start) &&
+        (m.end == hashMove->end) && (m.under == hashMove->under))
+      keys[i] = infiniteValue;
+    else if (m.under)
+      keys[i] = 1;
+    else
+      keys[i] = 2 * (p.top[m.end] + p.bottom[m.end]);
+  }
+
+  for (int i = 1; i < moves.size(); ++i) {
+    const EngineMove m = moves[i];
+    const int key = keys[i];
+    int j = i;
+    for (; (j > 0) && (keys[j - 1] < key); --j) {
+      moves[j] = moves[j - 1];
+      keys[j] = keys[j - 1];
+    }
+    moves[j] = m;
+    keys[j] = key;
+  }
+}
+
+// Same as Move::updateBoard(), Case::removePiece() and Case::addPiece().
+void Engine::play(Position &p, const EngineMove &m) const {
+  const int s = m.start;
+  const int e = m.end;
+  removeStack(p, s);
+  removeStack(p, e);
+
+  p.top[s]--;
+  if ((p.top[s] == 0) && (p.bottom[s] > 0)) {
+    p.top[s] = p.bottom[s];
+    p.bottom[s] = 0;
+    p.topIsBlack[s] = !p.topIsBlack[s];
+  }
+  if (p.bottom[s] > p.top[s]) {
+    p.top[s] += p.bottom[s];
+    p.bottom[s] = 0;
+    p.topIsBlack[s] = !p.topIsBlack[s];
+  }
+
+  if (m.under) {
+    p.bottom[e]++;
+    if (p.bottom[e] > p.top[e]) {
+      p.top[e] += p.bottom[e];
+      p.bottom[e] = 0;
+      p.topIsBlack[e] = !p.topIsBlack[e];
+    }
+  } else {
+    p.top[e] += 1 + p.bottom[e];
+    p.bottom[e] = 0;
+    p.topIsBlack[e] = p.blackPlays;
+  }
+
+  addStack(p, s);
+  addStack(p, e);
+
+  p.hash ^= movesLeftKey(p.nbMovesLeft) ^ movesLeftKey(p.nbMovesLeft - 1) ^
+            blackPlaysKey;
+  p.nbMovesLeft--;
+  p.blackPlays = !p.blackPlays;
+}
+
+// Same rules as Board::statusMessage().
+int Engine::finalValue(const Position &p) const {
+  const int difference =
+      p.nbPieces[p.blackPlays] - p.nbPieces[!p.blackPlays];
+  if (difference > 0)
+    return winValue + difference;
+  if (difference < 0)
+    return -winValue + difference;
+  return 0;
+}
+
+bool Engine::stopped(int &nodes) {
+  if (canceled_.loadAcquire())
+    return true;
+  if (!interruptible_ || (allowedTime_ < 0))
+    return false;
+  if (((++nodes & 1023) == 0) && timer_.hasExpired(allowedTime_))
+    timeOut_.storeRelease(1);
+  return timeOut_.loadAcquire() != 0;
+}
+
+bool Engine::probe(quint64 hash, Entry &entry) {
+  QMutexLocker locker(&tableLocks_[hash & 63]);
+  const Entry &e = table_.constData()[hash & (tableSize - 1)];
+  if (e.hash != hash)
+    return false;
+  entry = e;
+  return true;
+}
+
+void Engine::store(const Entry &entry) {
+  QMutexLocker locker(&tableLocks_[entry.hash & 63]);
+  Entry &e = table_.data()[entry.hash & (tableSize - 1)];
+  if ((e.hash == entry.hash) && (e.depth > entry.depth))
+    return;
+  e = entry;
+}
+
+// Negamax alpha-beta. The returned value is meaningless when stopped().
+int Engine::search(const Position &p, int depth, int alpha, int beta,
+                   int &nodes) {
+  if (stopped(nodes))
+    return 0;
+
+  if (p.nbMovesLeft <= 0)
+    return finalValue(p);
+
+  if (depth == 0)
+    return p.nbPieces[p.blackPlays] - p.nbPieces[!p.blackPlays];
+
+  Entry entry;
+  const bool found = probe(p.hash, entry);
+  if (found && (entry.depth >= depth)) {
+    if ((entry.bound == exactBound) ||
+        ((entry.bound == lowerBound) && (entry.value >= beta)) ||
+        ((entry.bound == upperBound) && (entry.value <= alpha)))
+      return entry.value;
+  }
+
+  MoveList moves;
+  generateMoves(p, moves);
+  // The player cannot move: the game is over
+  if (moves.isEmpty())
+    return finalValue(p);
+  orderMoves(p, moves, found ? &entry : NULL);
+
+  const int originalAlpha = alpha;
+  int best = -infiniteValue;
+  EngineMove bestMove = moves[0];
+  for (int i = 0; i < moves.size(); ++i) {
+    Position child = p;
+    play(child, moves[i]);
+    const int value = -search(child, depth - 1, -beta, -alpha, nodes);
+    if (value > best) {
+      best = value;
+      bestMove = moves[i];
+    }
+    if (best > alpha)
+      alpha = best;
+    if (alpha >= beta)
+      break;
+  }
+
+  // Do not store the values of an interrupted search
+  if (stopped(nodes))
+    return 0;
+
+  entry.hash = p.hash;
+  entry.value = best;
+  entry.depth = depth;
+  if (best <= originalAlpha)
+    entry.bound = upperBound;
+  else if (best >= beta)
+    entry.bound = lowerBound;
+  else
+    entry.bound = exactBound;
+  entry.start = bestMove.start;
+  entry.end = bestMove.end;
+  entry.under = bestMove.under;
+  store(entry);
+
+  return best;
+}
+
+// Searched with the best value found so far as alpha. A move that does not
+// beat it fails low and is ignored.
+void Engine::searchRootMove(int index, int depth) {
+  rootMutex_.lock();
+  const int alpha = rootBestValue_;
+  rootMutex_.unlock();
+
+  int nodes = 0;
+  Position child = root_;
+  play(child, rootMoves_[index]);
+  const int value = -search(child, depth - 1, -infiniteValue, -alpha, nodes);
+
+  QMutexLocker locker(&rootMutex_);
+  if (value > rootBestValue_) {
+    rootBestValue_ = value;
+    rootBestIndex_ = index;
+  }
+}
+
+// Iterative deepening from root_. rootMoves_[0] is the best move of the last
+// completed depth. allowedTime is -1 when pondering.
+void Engine::searchRoot(int allowedTime) {
+  MoveList moves;
+  generateMoves(root_, moves);
+  orderMoves(root_, moves, NULL);
+  rootMoves_.clear();
+  for (int i = 0; i < moves.size(); ++i)
+    rootMoves_.append(moves[i]);
+  if (rootMoves_.isEmpty())
+    return;
+
+  allowedTime_ = allowedTime;
+  timer_.start();
+  timeOut_.storeRelease(0);
+  depth_ = 0;
+
+  for (int depth = 1; depth <= qMin(maxDepth, root_.nbMovesLeft); ++depth) {
+    interruptible_ = (depth > 1) || (allowedTime < 0);
+    rootBestValue_ = -infiniteValue;
+    rootBestIndex_ = 0;
+
+    // The first move, the best one of the previous depth, gives a bound to
+    // the others
+    searchRootMove(0, depth);
+    for (int i = 1; i < rootMoves_.size(); ++i)
+      pool_.start(new RootSearch(this, i, depth));
+    pool_.waitForDone();
+
+    // An interrupted depth is discarded
+    if (timeOut_.loadAcquire() || canceled_.loadAcquire())
+      break;
+
+    depth_ = depth;
+    rootMoves_.move(rootBestIndex_, 0);
+
+    if ((qAbs(rootBestValue_) >= winValue) ||
+        ((allowedTime >= 0) && timer_.hasExpired(allowedTime)))
+      break;
+  }
+}
+
+Move Engine::bestMove(int allowedTime) {
+  if (!canPlay_)
+    return randomMove_;
+
+  root_ = position_;
+  searchRoot(allowedTime);
+  if (rootMoves_.isEmpty())
+    return randomMove_;
+
+  const EngineMove &m = rootMoves_[0];
+  return Move(QPoint(m.start / sizeY_, m.start % sizeY_),
+              QPoint(m.end / sizeY_, m.end % sizeY_), m.under);
+}
+
+Engine::EngineMove Engine::engineMove(const Move &m) const {
+  const EngineMove em = {m.start().x() * sizeY_ + m.start().y(),
+                         m.end().x() * sizeY_ + m.end().y(), m.goesUnder()};
+  return em;
+}
+
+void Engine::ponder(const Move &m) {
+  // Nothing to search when bestMove() found no move
+  if (!canPlay_ || rootMoves_.isEmpty() || canceled_.loadAcquire())
+    return;
+
+  root_ = position_;
+  play(root_, engineMove(m));
+  searchRoot(-1);
+}
+
+void Engine::stopPondering() { canceled_.storeRelease(1); }
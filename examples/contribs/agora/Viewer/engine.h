@@ -0,0 +1,123 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "move.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVarLengthArray>
+#include <QVector>
+
+class Board;
+
+// In-process computer player. Positions are fixed size arrays of stacks and
+// bitboards of the stack colors, hashed with Zobrist keys, so that the search
+// does not allocate. The iterative deepening alpha-beta uses a transposition
+// table shared by the threads that search the root moves in parallel.
+//
+// After bestMove(), ponder() keeps on searching the position left to the
+// opponent, which fills the table for the next bestMove(), until
+// stopPondering() is called.
+class Engine {
+  friend class RootSearch;
+
+public:
+  Engine();
+
+  // Copies the position of the board, with black to play when black is true.
+  // Returns false when the board has more than 64 squares: bestMove() then
+  // plays Board::randomMove().
+  bool setBoard(const Board &board, bool black, int nbMovesLeft);
+
+  // Best move, searched during at most allowedTime milliseconds (the first
+  // depth is always completed). May be called from an other thread than
+  // setBoard(), which must not be called during the search.
+  Move bestMove(int allowedTime);
+
+  // Searches the position after move m, until stopPondering(). Blocks the
+  // calling thread: call it in the thread of bestMove(), after it.
+  void ponder(const Move &m);
+  // Stops ponder() and bestMove(). Wait for their thread before setBoard().
+  void stopPondering();
+
+  // Depth of the last completed iteration of bestMove().
+  int depth() const { return depth_; }
+
+private:
+  Engine(const Engine &);
+  Engine &operator=(const Engine &);
+
+  // Squares are indexed like Board::intFromPoint().
+  struct EngineMove {
+    int start, end;
+    bool under;
+  };
+  typedef QVarLengthArray<EngineMove, 256> MoveList;
+
+  // Same stacks as Case, without the altitudes which never change.
+  struct Position {
+    unsigned char top[64], bottom[64];
+    unsigned char topIsBlack[64];
+    quint64 black, white; // Squares with a black (resp. white) top
+    int nbPieces[2];      // White, black
+    int nbMovesLeft;
+    bool blackPlays;
+    quint64 hash;
+  };
+
+  struct Entry {
+    quint64 hash;
+    int value;
+    int depth;
+    int bound;
+    int start, end;
+    bool under;
+  };
+
+  int search(const Position &p, int depth, int alpha, int beta, int &nodes);
+  void generateMoves(const Position &p, MoveList &moves) const;
+  void orderMoves(const Position &p, MoveList &moves,
+                  const Entry *hashMove) const;
+  void play(Position &p, const EngineMove &m) const;
+  void removeStack(Position &p, int square) const;
+  void addStack(Position &p, int square) const;
+  int topAltitude(const Position &p, int square) const {
+    return altitude_[square] + p.top[square] + p.bottom[square];
+  }
+  int finalValue(const Position &p) const;
+  bool stopped(int &nodes);
+
+  bool probe(quint64 hash, Entry &entry);
+  void store(const Entry &entry);
+
+  void searchRoot(int allowedTime);
+  void searchRootMove(int index, int depth);
+  EngineMove engineMove(const Move &m) const;
+
+  // Geometry
+  int sizeX_, sizeY_;
+  bool canPlay_;
+  unsigned char altitude_[64];
+  quint64 ring_[64]; // Neighbors of each square
+
+  Position position_;
+  Move randomMove_;
+
+  QVector<Entry> table_;
+  QMutex tableLocks_[64];
+
+  // Root search
+  Position root_;
+  QVector<EngineMove> rootMoves_;
+  QMutex rootMutex_;
+  int rootBestValue_, rootBestIndex_;
+  QThreadPool pool_;
+  QElapsedTimer timer_;
+  int allowedTime_; // -1 when pondering
+  bool interruptible_;
+  QAtomicInt timeOut_, canceled_;
+  int depth_;
+};
+
+#endif // ENGINE_H
@@ -1,11 +1,38 @@
 #include "anaglyph.h"
 
+#if QT_VERSION >= 0x040000
+#include <QKeyEvent>
+#endif
+
 using namespace qglviewer;
 using namespace std;
 
+// The reprojector textures are released with the viewer context
+Viewer::~Viewer() {
+  makeCurrent();
+  reprojector_.cleanupGL();
+  doneCurrent();
+}
+
 void Viewer::draw() {
   static const bool left = true;
 
+  if (reprojected_) {
+    // The scene is drawn once, filled, with the mono-vision matrices
+    if (reprojector_.bind(size() * devicePixelRatioF())) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      glColor3f(1.0, 1.0, 1.0);
+      drawScene();
+      reprojector_.release();
+      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    }
+
+    // Red (left) and cyan (right) views, synthesized from colors and depths
+    reprojector_.draw(camera(), StereoReprojector::ANAGLYPH);
+    return;
+  }
+
   // Draw for left eye
   camera()->loadProjectionMatrixStereo(left);
   camera()->loadModelViewMatrixStereo(left);
@@ -46,12 +73,24 @@ void Viewer::init() {
   // between left and right images.
   glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+  setKeyDescription(Qt::Key_R, "Toggles the single rendering reprojected "
+                               "stereo");
+
   // Restore previous viewer state.
   restoreStateFromFile();
 
   help();
 }
 
+void Viewer::keyPressEvent(QKeyEvent *e) {
+  if (e->key() == Qt::Key_R) {
+    reprojected_ = !reprojected_;
+    displayMessage(reprojected_ ? "Reprojected stereo" : "Two pass stereo");
+    update();
+  } else
+    QGLViewer::keyPressEvent(e);
+}
+
 QString Viewer::helpString() const {
   QString text("<h2>A n a g l y p h</h2>");
   text += "The anaglyph stereo mode displays simultaneously two colored views "
@@ -65,6 +104,11 @@ QString Viewer::helpString() const {
   text += "Simply use the <i>loadModelViewMatrixStereo()</i> and";
   text +=
       "<i>loadProjectionMatrixStereo()</i> camera functions to set appropriate";
-  text += "<i>GL_MODELVIEW</i> and <i>GL_PROJECTION</i> stereo matrices.";
+  text += "<i>GL_MODELVIEW</i> and <i>GL_PROJECTION</i> stereo matrices."
+          "<br><br>";
+  text += "Press <b>R</b> to draw the scene only once: a "
+          "<i>qglviewer::StereoReprojector</i> then synthesizes the left (red) "
+          "and right (cyan) views from the colors and depths of this single "
+          "image. The scene no longer needs to be displayed in wireframe.";
   return text;
 }
@@ -1,11 +1,21 @@
 #include "QGLViewer/qglviewer.h"
+#include "QGLViewer/stereoReprojector.h"
 
 class Viewer : public QGLViewer {
+public:
+  Viewer() : reprojected_(false) {}
+  virtual ~Viewer();
+
 protected:
   virtual void draw();
   virtual void init();
+  virtual void keyPressEvent(QKeyEvent *e);
   virtual QString helpString() const;
 
 private:
   void drawScene();
+
+  // Single rendering of the scene, with synthesized left and right views
+  bool reprojected_;
+  qglviewer::StereoReprojector reprojector_;
 };
@@ -1,7 +1,8 @@
 #include "backgroundImage.h"
 
+#include <QGLViewer/textureStreamer.h>
+
 #include <qfiledialog.h>
-#include <qimage.h>
 
 #if QT_VERSION >= 0x040000
 #include <QKeyEvent>
@@ -10,19 +11,24 @@
 using namespace qglviewer;
 using namespace std;
 
+// The textures are released with the viewer context
+Viewer::~Viewer() {
+  if (!streamer_)
+    return;
+  makeCurrent();
+  streamer_->cleanupGL();
+  doneCurrent();
+}
+
 void Viewer::init() {
   restoreStateFromFile();
 
-  // Enable GL textures
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
   // Nice texture coordinate interpolation
   glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
 
-  u_max = 1.0;
-  v_max = 1.0;
-  ratio = 1.0;
+  // Images are decoded in a worker thread, which asks for a new frame when done
+  streamer_ = new TextureStreamer(this);
+  connect(streamer_, SIGNAL(imageDecoded()), SLOT(update()));
   background_ = true;
 
   setKeyDescription(Qt::Key_L, "Loads a new background image");
@@ -30,7 +36,6 @@ void Viewer::init() {
 
   loadImage();
   help();
-  qWarning("fin init");
 }
 
 void Viewer::draw() {
@@ -58,25 +63,30 @@ void Viewer::draw() {
 }
 
 void Viewer::drawBackground() {
-  if (!background_)
+  // Starts the upload of a decoded image, displayed once it is completed
+  if (streamer_->update())
+    update();
+
+  if (!background_ || !streamer_->texture())
     return;
 
   glDisable(GL_LIGHTING);
   glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, streamer_->texture());
   glColor3f(1, 1, 1);
 
   startScreenCoordinatesSystem(true);
 
-  // Draws the background quad
+  // Draws the background quad. The top row of the image is at v=0.
   glNormal3f(0.0, 0.0, 1.0);
   glBegin(GL_QUADS);
-  glTexCoord2f(0.0, 1.0 - v_max);
-  glVertex2i(0, 0);
   glTexCoord2f(0.0, 1.0);
+  glVertex2i(0, 0);
+  glTexCoord2f(0.0, 0.0);
   glVertex2i(0, height());
-  glTexCoord2f(u_max, 1.0);
+  glTexCoord2f(1.0, 0.0);
   glVertex2i(width(), height());
-  glTexCoord2f(u_max, 1.0 - v_max);
+  glTexCoord2f(1.0, 1.0);
   glVertex2i(width(), 0);
   glEnd();
 
@@ -86,57 +96,33 @@ void Viewer::drawBackground() {
   // draw the QUAD with a 0.999 z value (z ranges in [0, 1[ with
   // startScreenCoordinatesSystem()).
   glClear(GL_DEPTH_BUFFER_BIT);
+  glBindTexture(GL_TEXTURE_2D, 0);
   glDisable(GL_TEXTURE_2D);
   glEnable(GL_LIGHTING);
 }
 
 void Viewer::loadImage() {
 #if QT_VERSION < 0x040000
-  QString name = QFileDialog::getOpenFileName(
-      ".", "Images (*.png *.xpm *.jpg)", this, "Choose", "Select an image");
+  QString name =
+      QFileDialog::getOpenFileName(".", "Images (*.png *.xpm *.jpg *.dds)",
+                                   this, "Choose", "Select an image");
 #else
-  QString name = QFileDialog::getOpenFileName(this, "Select an image", ".",
-                                              "Images (*.png *.xpm *.jpg)");
+  QString name = QFileDialog::getOpenFileName(
+      this, "Select an image", ".", "Images (*.png *.xpm *.jpg *.dds)");
 #endif
 
   // In case of Cancel
   if (name.isEmpty())
     return;
 
-  QImage img(name);
-
-  if (img.isNull()) {
-    qWarning("Unable to load file, unsupported file format");
-    return;
-  }
-
 #if QT_VERSION < 0x040000
-  qWarning("Loading %s, %dx%d pixels", name.latin1(), img.width(),
-           img.height());
+  qWarning("Loading %s", name.latin1());
 #else
-  qWarning("Loading %s, %dx%d pixels", name.toLatin1().constData(), img.width(),
-           img.height());
+  qWarning("Loading %s", name.toLatin1().constData());
 #endif
 
-  // 1E-3 needed. Just try with width=128 and see !
-  int newWidth = 1 << (int)(1 + log(img.width() - 1 + 1E-3) / log(2.0));
-  int newHeight = 1 << (int)(1 + log(img.height() - 1 + 1E-3) / log(2.0));
-
-  u_max = img.width() / (float)newWidth;
-  v_max = img.height() / (float)newHeight;
-
-  if ((img.width() != newWidth) || (img.height() != newHeight)) {
-    qWarning("Image size set to %dx%d pixels", newWidth, newHeight);
-    img = img.copy(0, 0, newWidth, newHeight);
-  }
-
-  ratio = newWidth / float(newHeight);
-
-  QImage glImg = QGLWidget::convertToGLFormat(img); // flipped 32bit RGBA
-
-  // Bind the img texture...
-  glTexImage2D(GL_TEXTURE_2D, 0, 4, glImg.width(), glImg.height(), 0, GL_RGBA,
-               GL_UNSIGNED_BYTE, glImg.bits());
+  // Decoded in a worker thread, the current background is displayed meanwhile
+  streamer_->load(name);
 }
 
 void Viewer::keyPressEvent(QKeyEvent *e) {
@@ -158,6 +144,9 @@ QString Viewer::helpString() const {
   text += "This example is derivated from textureViewer.<br><br>";
   text +=
       "It displays a background image in the viewer using a texture.<br><br>";
+  text += "Images are decoded in a worker thread and uploaded by a "
+          "<i>qglviewer::TextureStreamer</i>, so that loading a new image "
+          "does not stall the display.<br><br>";
   text += "Press <b>L</b> to load a new image, and <b>B</b> to toggle the "
           "background display.";
   return text;
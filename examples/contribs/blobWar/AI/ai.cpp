@@ -1,6 +1,8 @@
 #include "../Viewer/board.h"
+#include "../Viewer/engine.h"
 #include <fstream>
 #include <stdio.h>
+#include <stdlib.h>
 
 int main(int argc, char **argv) {
   Board board;
@@ -16,7 +18,11 @@ int main(int argc, char **argv) {
   file >> board;
   file.close();
 
-  std::cout << board.bestMoveNumberOfNewPieces();
+  // The allowed time (in seconds) is negative when red plays. Keep some time
+  // for the process start and exit.
+  Engine engine;
+  engine.setBoard(board);
+  std::cout << engine.bestMove(900 * abs(atoi(argv[2])));
 
   return 0;
 }
@@ -7,13 +7,15 @@
 # time (which sign determines which player is to play). The output should be the x,y coordinates of
 # the start and end positions of the move to play.
 
-# A naive greedy computer player program is provided in the AI directory.
+# Leave the program name empty to use the built-in engine: an iterative deepening alpha-beta search
+# on bitboards, with a transposition table and a parallel search of the root moves. The AI directory
+# provides the same engine as an external program.
 
 TEMPLATE = app
 TARGET   = blobWar
 
-HEADERS += blobWarViewer.h board.h move.h computerPlayer.h undo.h
-SOURCES += main.cpp blobWarViewer.cpp board.cpp boardDraw.cpp move.cpp computerPlayer.cpp undo.cpp
+HEADERS += blobWarViewer.h board.h move.h computerPlayer.h engine.h undo.h
+SOURCES += main.cpp blobWarViewer.cpp board.cpp boardDraw.cpp move.cpp computerPlayer.cpp engine.cpp undo.cpp
 
 QT_VERSION=$$[QT_VERSION]
 contains( QT_VERSION, "^3.*" ) {
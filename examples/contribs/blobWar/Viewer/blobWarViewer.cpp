@@ -65,19 +65,9 @@ BlobWarViewer::BlobWarViewer(QWidget *parent)
     connect(&(computerPlayer_[i]), SIGNAL(moveMade(QString, int)), this,
             SLOT(playComputerMove(QString, int)));
 
-  QStringList programFileNames;
-  programFileNames << "blobWarAI"
-                   << "blobWarAI.exe"
-                   << "../AI/blobWarAI"
-                   << "../../AI/release/blobWarAI.exe"
-                   << "../../AI/debug/blobWarAI.exe";
-  for (int i = 0; i < programFileNames.size(); ++i) {
-    if (QFileInfo(programFileNames.at(i)).isExecutable()) {
-      computerPlayer_[0].setProgramFileName(programFileNames.at(i));
-      computerPlayer_[0].setIsActive(true);
-      break;
-    }
-  }
+  // Red is played by the built-in engine. An external program can be
+  // selected in the player configuration.
+  computerPlayer_[0].setIsActive(true);
 }
 
 // I n i t i a l i z a t i o n   f u n c t i o n s
@@ -255,8 +245,7 @@ void BlobWarViewer::playNextMove() {
     f << *board_;
     f.close();
 
-    computerPlayer_[board_->bluePlays()].play(board_->bluePlays(),
-                                              stateFileName);
+    computerPlayer_[board_->bluePlays()].play(*board_, stateFileName);
   }
 }
 
@@ -1,10 +1,14 @@
 #include "computerPlayer.h"
+#include "board.h"
+#include "engine.h"
 #include "qlineedit.h"
 #include "qprocess.h"
 #include "qpushbutton.h"
 #include "qspinbox.h"
 #include <qfiledialog.h>
 #include <qmessagebox.h>
+#include <QRunnable>
+#include <QThreadPool>
 
 #if QT_VERSION >= 0x040000
 #include "ui_computerPlayerInterface.h"
@@ -25,8 +29,38 @@ public:
 
 static QTime Clock;
 
+static QString moveString(const Move &m) {
+  return QString("(%1,%2) -> (%3,%4)")
+      .arg(m.start().x())
+      .arg(m.start().y())
+      .arg(m.end().x())
+      .arg(m.end().y());
+}
+
+// Runs the Engine search out of the GUI thread. The move is sent back to the
+// ComputerPlayer with a queued call.
+class EngineSearch : public QRunnable {
+public:
+  EngineSearch(ComputerPlayer *player, Engine *engine, int allowedTime)
+      : player_(player), engine_(engine), allowedTime_(allowedTime) {}
+  virtual void run() {
+    const QString move = moveString(engine_->bestMove(allowedTime_));
+    QMetaObject::invokeMethod(player_, "engineMoveMade", Qt::QueuedConnection,
+                              Q_ARG(QString, move));
+  }
+
+private:
+  ComputerPlayer *player_;
+  Engine *engine_;
+  int allowedTime_;
+};
+
 ComputerPlayer::ComputerPlayer() : isActive_(false) {
   interface_ = new ComputerPlayerInterface();
+  interface_->programNameLineEdit->setPlaceholderText("Built-in engine");
+  engine_ = new Engine();
+  searchThread_ = new QThreadPool();
+  searchThread_->setMaxThreadCount(1);
 
   connect(interface_->browseButton, SIGNAL(released()), this,
           SLOT(selectProgram()));
@@ -35,7 +69,12 @@ ComputerPlayer::ComputerPlayer() : isActive_(false) {
   setAllowedTime(3);
 }
 
-ComputerPlayer::~ComputerPlayer() { delete interface_; }
+ComputerPlayer::~ComputerPlayer() {
+  searchThread_->waitForDone();
+  delete searchThread_;
+  delete engine_;
+  delete interface_;
+}
 
 void ComputerPlayer::selectProgram() {
 #if QT_VERSION < 0x040000
@@ -51,11 +90,7 @@ void ComputerPlayer::selectProgram() {
     setProgramFileName(fileName);
 }
 
-void ComputerPlayer::setIsActive(bool on) {
-  if (on && (programFileName().isEmpty()))
-    configure();
-  isActive_ = on;
-}
+void ComputerPlayer::setIsActive(bool on) { isActive_ = on; }
 
 void ComputerPlayer::configure() {
   int previousAllowedTime = allowedTime();
@@ -83,10 +118,21 @@ void ComputerPlayer::setProgramFileName(const QString &name) {
   interface_->programNameLineEdit->setText(name);
 }
 
-void ComputerPlayer::play(bool blue, const QString &stateFileName) {
+void ComputerPlayer::play(const Board &board, const QString &stateFileName) {
   if (!isActive_)
     return; // So that human user can play
 
+  const bool blue = board.bluePlays();
+
+  if (programFileName().isEmpty()) {
+    // The position is copied in the GUI thread, searched in searchThread_
+    engine_->setBoard(board);
+    Clock.start();
+    searchThread_->start(
+        new EngineSearch(this, engine_, 1000 * allowedTime()));
+    return;
+  }
+
   while (true) {
     const QFileInfo fi(programFileName());
 
@@ -144,3 +190,7 @@ void ComputerPlayer::readFromStdout() {
   process_->deleteLater();
 #endif
 }
+
+void ComputerPlayer::engineMoveMade(QString move) {
+  Q_EMIT moveMade(move, Clock.elapsed());
+}
@@ -4,8 +4,11 @@
 #include "qobject.h"
 #include "qstring.h"
 
+class Board;
 class ComputerPlayerInterface;
+class Engine;
 class QProcess;
+class QThreadPool;
 
 class ComputerPlayer : public QObject {
   Q_OBJECT
@@ -25,7 +28,9 @@ public:
 
   void configure();
 
-  void play(bool blue, const QString &stateFileName);
+  // Plays with the built-in Engine when programFileName() is empty, and with
+  // the external program (which reads stateFileName) otherwise.
+  void play(const Board &board, const QString &stateFileName);
 
 public:
 Q_SIGNALS:
@@ -34,11 +39,14 @@ Q_SIGNALS:
 private Q_SLOTS:
   void selectProgram();
   void readFromStdout();
+  void engineMoveMade(QString move);
 
 private:
   bool isActive_;
   ComputerPlayerInterface *interface_;
   QProcess *process_;
+  Engine *engine_;
+  QThreadPool *searchThread_;
 };
 
 #endif // COMPUTER_PLAYER_H
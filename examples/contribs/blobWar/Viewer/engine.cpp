@@ -0,0 +1,338 @@
+#include "engine.h"
+#include "board.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QtAlgorithms>
+
+static const int infiniteValue = 1000000;
+// Larger than any difference of number of pieces
+static const int winValue = 10000;
+static const int maxDepth = 64;
+// Transposition table entries, a power of 2
+static const int tableSize = 1 << 18;
+
+static const int exactBound = 0;
+static const int lowerBound = 1;
+static const int upperBound = 2;
+
+static quint64 bit(int square) { return quint64(1) << square; }
+static int count(quint64 b) { return int(qPopulationCount(b)); }
+static int firstSquare(quint64 b) { return int(qCountTrailingZeroBits(b)); }
+
+// SplitMix64 finalizer
+static quint64 mix(quint64 x) {
+  x += Q_UINT64_C(0x9E3779B97F4A7C15);
+  x = (x ^ (x >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+  x = (x ^ (x >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+  return x ^ (x >> 31);
+}
+
+static quint64 hashOf(quint64 own, quint64 other) {
+  return mix(own ^ mix(other));
+}
+
+class RootSearch : public QRunnable {
+public:
+  RootSearch(Engine *engine, int index, int depth)
+      : engine_(engine), index_(index), depth_(depth) {}
+  virtual void run() { engine_->searchRootMove(index_, depth_); }
+
+private:
+  Engine *engine_;
+  int index_, depth_;
+};
+
+Engine::Engine()
+    : sizeX_(0), sizeY_(0), canPlay_(false), valid_(0), own_(0), other_(0),
+      table_(tableSize), rootBestValue_(0), rootBestIndex_(0),
+      allowedTime_(0), interruptible_(false), depth_(0) {}
+
+bool Engine::setBoard(const Board &board) {
+  const int sizeX = board.size().width();
+  const int sizeY = board.size().height();
+
+  greedyMove_ = board.bestMoveNumberOfNewPieces();
+  canPlay_ = (sizeX * sizeY <= 64);
+  if (!canPlay_)
+    return false;
+
+  quint64 valid = 0, blue = 0, red = 0;
+  for (int i = 0; i < sizeX; ++i)
+    for (int j = 0; j < sizeY; ++j) {
+      const int square = i * sizeY + j;
+      switch (board.stateOf(QPoint(i, j))) {
+      case Board::HOLE:
+        continue;
+      case Board::BLUE:
+        blue |= bit(square);
+        break;
+      case Board::RED:
+        red |= bit(square);
+        break;
+      case Board::EMPTY:
+        break;
+      }
+      valid |= bit(square);
+    }
+
+  // The geometry only changes with the board: the table remains valid
+  // between the moves of a game
+  if ((sizeX != sizeX_) || (sizeY != sizeY_) || (valid != valid_)) {
+    sizeX_ = sizeX;
+    sizeY_ = sizeY;
+    valid_ = valid;
+    for (int s = 0; s < sizeX * sizeY; ++s) {
+      ring1_[s] = ring2_[s] = 0;
+      for (int i = -2; i <= 2; ++i)
+        for (int j = -2; j <= 2; ++j) {
+          const int x = s / sizeY + i;
+          const int y = s % sizeY + j;
+          if ((x < 0) || (y < 0) || (x >= sizeX) || (y >= sizeY) ||
+              !(valid & bit(x * sizeY + y)))
+            continue;
+          const int distance = qMax(qAbs(i), qAbs(j));
+          if (distance == 1)
+            ring1_[s] |= bit(x * sizeY + y);
+          else if (distance == 2)
+            ring2_[s] |= bit(x * sizeY + y);
+        }
+    }
+    table_.fill(Entry());
+  }
+
+  own_ = board.bluePlays() ? blue : red;
+  other_ = board.bluePlays() ? red : blue;
+  return true;
+}
+
+void Engine::generateMoves(quint64 own, quint64 other, MoveList &moves) const {
+  const quint64 empty = valid_ & ~(own | other);
+
+  // All the clones to the same square lead to the same position
+  for (quint64 e = empty; e; e &= e - 1) {
+    const int end = firstSquare(e);
+    const quint64 starts = ring1_[end] & own;
+    if (starts) {
+      const EngineMove m = {firstSquare(starts), end};
+      moves.append(m);
+    }
+  }
+
+  for (quint64 s = own; s; s &= s - 1) {
+    const int start = firstSquare(s);
+    for (quint64 e = ring2_[start] & empty; e; e &= e - 1) {
+      const EngineMove m = {start, firstSquare(e)};
+      moves.append(m);
+    }
+  }
+}
+
+// Move of the transposition table first, then by number of new pieces.
+void Engine::orderMoves(MoveList &moves, quint64 other, int hashStart,
+                        int hashEnd) const {
+  QVarLengthArray<int, 128> keys(moves.size());
+  for (int i = 0; i < moves.size(); ++i) {
+    const EngineMove &m = moves[i];
+    if ((m.start == hashStart) && (m.end == hashEnd))
+      keys[i] = infiniteValue;
+    else
+      keys[i] = 2 * count(ring1_[m.end] & other) +
+                ((ring1_[m.start] & bit(m.end)) ? 1 : 0);
+  }
+
+  for (int i = 1; i < moves.size(); ++i) {
+    const EngineMove m = moves[i];
+    const int key = keys[i];
+    int j = i;
+    for (; (j > 0) && (keys[j - 1] < key); --j) {
+      moves[j] = moves[j - 1];
+      keys[j] = keys[j - 1];
+    }
+    moves[j] = m;
+    keys[j] = key;
+  }
+}
+
+void Engine::play(const EngineMove &m, quint64 &own, quint64 &other) const {
+  if (ring2_[m.start] & bit(m.end))
+    own &= ~bit(m.start);
+  own |= bit(m.end);
+
+  const quint64 captured = ring1_[m.end] & other;
+  own |= captured;
+  other &= ~captured;
+}
+
+// Same rules as Board::gameIsOver() and Board::statusMessage().
+int Engine::finalValue(quint64 own, quint64 other) const {
+  const int difference = count(own) - count(other);
+  if (difference > 0)
+    return winValue + difference;
+  if (difference < 0)
+    return -winValue + difference;
+  return 0;
+}
+
+bool Engine::stopped(int &nodes) {
+  if (!interruptible_)
+    return false;
+  if (((++nodes & 1023) == 0) && timer_.hasExpired(allowedTime_))
+    stop_.storeRelease(1);
+  return stop_.loadAcquire() != 0;
+}
+
+bool Engine::probe(quint64 own, quint64 other, Entry &entry) {
+  const quint64 hash = hashOf(own, other);
+  QMutexLocker locker(&tableLocks_[hash & 63]);
+  const Entry &e = table_.constData()[hash & (tableSize - 1)];
+  if ((e.own != own) || (e.other != other))
+    return false;
+  entry = e;
+  return true;
+}
+
+void Engine::store(const Entry &entry) {
+  const quint64 hash = hashOf(entry.own, entry.other);
+  QMutexLocker locker(&tableLocks_[hash & 63]);
+  Entry &e = table_.data()[hash & (tableSize - 1)];
+  if ((e.own == entry.own) && (e.other == entry.other) &&
+      (e.depth > entry.depth))
+    return;
+  e = entry;
+}
+
+// Negamax alpha-beta. The returned value is meaningless when stopped().
+int Engine::search(quint64 own, quint64 other, int depth, int alpha, int beta,
+                   int &nodes) {
+  if (stopped(nodes))
+    return 0;
+
+  if (!own || !other || !(valid_ & ~(own | other)))
+    return finalValue(own, other);
+
+  if (depth == 0)
+    return count(own) - count(other);
+
+  Entry entry;
+  int hashStart = -1, hashEnd = -1;
+  if (probe(own, other, entry)) {
+    if (entry.depth >= depth) {
+      if ((entry.bound == exactBound) ||
+          ((entry.bound == lowerBound) && (entry.value >= beta)) ||
+          ((entry.bound == upperBound) && (entry.value <= alpha)))
+        return entry.value;
+    }
+    hashStart = entry.start;
+    hashEnd = entry.end;
+  }
+
+  MoveList moves;
+  generateMoves(own, other, moves);
+  // The player cannot move: the game is over
+  if (moves.isEmpty())
+    return finalValue(own, other);
+  orderMoves(moves, other, hashStart, hashEnd);
+
+  const int originalAlpha = alpha;
+  int best = -infiniteValue;
+  EngineMove bestMove = moves[0];
+  for (int i = 0; i < moves.size(); ++i) {
+    quint64 o = own, t = other;
+    play(moves[i], o, t);
+    const int value = -search(t, o, depth - 1, -beta, -alpha, nodes);
+    if (value > best) {
+      best = value;
+      bestMove = moves[i];
+    }
+    if (best > alpha)
+      alpha = best;
+    if (alpha >= beta)
+      break;
+  }
+
+  // Do not store the values of an interrupted search
+  if (interruptible_ && stop_.loadAcquire())
+    return 0;
+
+  entry.own = own;
+  entry.other = other;
+  entry.value = best;
+  entry.depth = depth;
+  if (best <= originalAlpha)
+    entry.bound = upperBound;
+  else if (best >= beta)
+    entry.bound = lowerBound;
+  else
+    entry.bound = exactBound;
+  entry.start = bestMove.start;
+  entry.end = bestMove.end;
+  store(entry);
+
+  return best;
+}
+
+// Searched with the best value found so far as alpha. A move that does not
+// beat it fails low and is ignored.
+void Engine::searchRootMove(int index, int depth) {
+  rootMutex_.lock();
+  const int alpha = rootBestValue_;
+  rootMutex_.unlock();
+
+  int nodes = 0;
+  quint64 own = own_, other = other_;
+  play(rootMoves_[index], own, other);
+  const int value =
+      -search(other, own, depth - 1, -infiniteValue, -alpha, nodes);
+
+  QMutexLocker locker(&rootMutex_);
+  if (value > rootBestValue_) {
+    rootBestValue_ = value;
+    rootBestIndex_ = index;
+  }
+}
+
+Move Engine::bestMove(int allowedTime) {
+  if (!canPlay_)
+    return greedyMove_;
+
+  MoveList moves;
+  generateMoves(own_, other_, moves);
+  if (moves.isEmpty())
+    return greedyMove_;
+  orderMoves(moves, other_, -1, -1);
+  rootMoves_.clear();
+  for (int i = 0; i < moves.size(); ++i)
+    rootMoves_.append(moves[i]);
+
+  allowedTime_ = allowedTime;
+  timer_.start();
+  stop_.storeRelease(0);
+  depth_ = 0;
+
+  for (int depth = 1; depth <= maxDepth; ++depth) {
+    interruptible_ = (depth > 1);
+    rootBestValue_ = -infiniteValue;
+    rootBestIndex_ = 0;
+
+    // The first move, the best one of the previous depth, gives a bound to
+    // the others
+    searchRootMove(0, depth);
+    for (int i = 1; i < rootMoves_.size(); ++i)
+      pool_.start(new RootSearch(this, i, depth));
+    pool_.waitForDone();
+
+    // An interrupted depth is discarded
+    if (stop_.loadAcquire())
+      break;
+
+    depth_ = depth;
+    rootMoves_.move(rootBestIndex_, 0);
+
+    if ((qAbs(rootBestValue_) >= winValue) || timer_.hasExpired(allowedTime_))
+      break;
+  }
+
+  const EngineMove &m = rootMoves_[0];
+  return Move(QPoint(m.start / sizeY_, m.start % sizeY_),
+              QPoint(m.end / sizeY_, m.end % sizeY_));
+}
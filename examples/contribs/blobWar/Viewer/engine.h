@@ -0,0 +1,94 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "move.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVarLengthArray>
+#include <QVector>
+
+class Board;
+
+// In-process computer player. The board is stored in 64 bits bitboards, and
+// searched with an iterative deepening alpha-beta, using a transposition
+// table. At each depth, the first root move is searched alone, and the other
+// ones in parallel on a thread pool.
+class Engine {
+  friend class RootSearch;
+
+public:
+  Engine();
+
+  // Copies the position of the board. Returns false when the board has more
+  // than 64 squares: bestMove() then plays Board::bestMoveNumberOfNewPieces().
+  bool setBoard(const Board &board);
+
+  // Best move for the player of the setBoard(), searched during at most
+  // allowedTime milliseconds (the first depth is always completed). May be
+  // called from an other thread than setBoard().
+  Move bestMove(int allowedTime);
+
+  // Depth of the last completed iteration of bestMove().
+  int depth() const { return depth_; }
+
+private:
+  Engine(const Engine &);
+  Engine &operator=(const Engine &);
+
+  // Squares are indexed like Board::intFromPoint(). A clone move has start in
+  // the neighborhood of end, a jump is at distance 2.
+  struct EngineMove {
+    int start, end;
+  };
+  typedef QVarLengthArray<EngineMove, 128> MoveList;
+
+  struct Entry {
+    quint64 own, other;
+    int value;
+    int depth;
+    int bound;
+    int start, end;
+  };
+
+  int search(quint64 own, quint64 other, int depth, int alpha, int beta,
+             int &nodes);
+  void generateMoves(quint64 own, quint64 other, MoveList &moves) const;
+  void orderMoves(MoveList &moves, quint64 other, int hashStart,
+                  int hashEnd) const;
+  void play(const EngineMove &m, quint64 &own, quint64 &other) const;
+  int finalValue(quint64 own, quint64 other) const;
+  bool stopped(int &nodes);
+
+  bool probe(quint64 own, quint64 other, Entry &entry);
+  void store(const Entry &entry);
+
+  void searchRootMove(int index, int depth);
+
+  // Geometry
+  int sizeX_, sizeY_;
+  bool canPlay_;
+  quint64 valid_; // squares of the board, except holes
+  quint64 ring1_[64], ring2_[64];
+
+  // Position, from the point of view of the player to play
+  quint64 own_, other_;
+  Move greedyMove_;
+
+  QVector<Entry> table_;
+  QMutex tableLocks_[64];
+
+  // Root search
+  QVector<EngineMove> rootMoves_;
+  QMutex rootMutex_;
+  int rootBestValue_, rootBestIndex_;
+  QThreadPool pool_;
+  QElapsedTimer timer_;
+  int allowedTime_;
+  bool interruptible_;
+  QAtomicInt stop_;
+  int depth_;
+};
+
+#endif // ENGINE_H
@@ -7,7 +7,8 @@
 # time (which sign determines which player is to play). The output should be the x,y coordinates of
 # the start and end positions of the move to play.
 
-# A naive greedy AI program is provided in the AI directory.
+# Computer players use a built-in engine by default. The same engine is provided as an external
+# program in the AI directory.
 
 TEMPLATE = subdirs
 SUBDIRS = AI Viewer
@@ -0,0 +1,164 @@
+#include "pieceMesh.h"
+#include <math.h>
+
+using namespace std;
+
+void PieceMesh::addTriangle(Vertex a, Vertex b, Vertex c) {
+  // Counter clockwise when seen from the side of the normals
+  const float e1[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+  const float e2[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+  const float cross[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                          e1[2] * e2[0] - e1[0] * e2[2],
+                          e1[0] * e2[1] - e1[1] * e2[0]};
+  if (cross[0] * (a.nx + b.nx + c.nx) + cross[1] * (a.ny + b.ny + c.ny) +
+          cross[2] * (a.nz + b.nz + c.nz) <
+      0.0f)
+    swap(b, c);
+  vertices_.push_back(a);
+  vertices_.push_back(b);
+  vertices_.push_back(c);
+}
+
+void PieceMesh::addQuad(const float p0[3], const float p1[3],
+                        const float p2[3], const float p3[3],
+                        const float normal[3], float u0, float v0, float u1,
+                        float v1) {
+  const float *p[4] = {p0, p1, p2, p3};
+  const float uv[4][2] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+  Vertex v[4];
+  for (int i = 0; i < 4; ++i) {
+    const Vertex w = {uv[i][0], uv[i][1], normal[0], normal[1], normal[2],
+                      p[i][0],  p[i][1],  p[i][2]};
+    v[i] = w;
+  }
+  addTriangle(v[0], v[1], v[2]);
+  addTriangle(v[0], v[2], v[3]);
+}
+
+void PieceMesh::addCylinder(float radius, float zMin, float zMax, int slices,
+                            bool inwards, float bevel) {
+  const float sign = inwards ? -1.0f : 1.0f;
+  const float norm = sqrt(1.0f + bevel * bevel);
+  for (int i = 0; i < slices; ++i) {
+    Vertex v[4];
+    for (int j = 0; j < 4; ++j) {
+      const int slice = i + ((j == 1) || (j == 2) ? 1 : 0);
+      const bool top = (j >= 2);
+      const float angle = slice * 2.0 * M_PI / slices;
+      const Vertex w = {float(slice) / slices,
+                        top ? 1.0f : 0.0f,
+                        sign * cos(angle) / norm,
+                        sign * sin(angle) / norm,
+                        (top ? bevel : -bevel) / norm,
+                        radius * cos(angle),
+                        radius * sin(angle),
+                        top ? zMax : zMin};
+      v[j] = w;
+    }
+    addTriangle(v[0], v[1], v[2]);
+    addTriangle(v[0], v[2], v[3]);
+  }
+}
+
+void PieceMesh::addDisk(float rMin, float rMax, float z, int slices, bool up) {
+  const float nz = up ? 1.0f : -1.0f;
+  for (int i = 0; i < slices; ++i) {
+    Vertex v[4];
+    for (int j = 0; j < 4; ++j) {
+      const int slice = i + ((j == 1) || (j == 2) ? 1 : 0);
+      const float r = (j >= 2) ? rMax : rMin;
+      const float angle = slice * 2.0 * M_PI / slices;
+      const float x = r * cos(angle);
+      const float y = r * sin(angle);
+      const Vertex w = {x / (2.0f * rMax) + 0.5f,
+                        y / (2.0f * rMax) + 0.5f,
+                        0.0f,
+                        0.0f,
+                        nz,
+                        x,
+                        y,
+                        z};
+      v[j] = w;
+    }
+    if (rMin > 0.0f)
+      addTriangle(v[0], v[1], v[2]);
+    addTriangle(v[0], v[2], v[3]);
+  }
+}
+
+void PieceMesh::addSphere(float radius, float z, int slices, int stacks) {
+  for (int i = 0; i < slices; ++i)
+    for (int k = 0; k < stacks; ++k) {
+      Vertex v[4];
+      for (int j = 0; j < 4; ++j) {
+        const int slice = i + ((j == 1) || (j == 2) ? 1 : 0);
+        const int stack = k + ((j >= 2) ? 1 : 0);
+        const float theta = slice * 2.0 * M_PI / slices;
+        const float phi = stack * M_PI / stacks - M_PI / 2.0;
+        const float nx = cos(phi) * cos(theta);
+        const float ny = cos(phi) * sin(theta);
+        const float nz = sin(phi);
+        const Vertex w = {float(slice) / slices,
+                          float(stack) / stacks,
+                          nx,
+                          ny,
+                          nz,
+                          radius * nx,
+                          radius * ny,
+                          z + radius * nz};
+        v[j] = w;
+      }
+      // The poles have degenerated triangles
+      if (k > 0)
+        addTriangle(v[0], v[1], v[2]);
+      if (k < stacks - 1)
+        addTriangle(v[0], v[2], v[3]);
+    }
+}
+
+void PieceMesh::addBox(float x0, float y0, float z0, float x1, float y1,
+                       float z1) {
+  const float c[8][3] = {{x0, y0, z0}, {x1, y0, z0}, {x1, y1, z0},
+                         {x0, y1, z0}, {x0, y0, z1}, {x1, y0, z1},
+                         {x1, y1, z1}, {x0, y1, z1}};
+  static const float normals[6][3] = {{0, -1, 0}, {1, 0, 0}, {0, 1, 0},
+                                      {-1, 0, 0}, {0, 0, -1}, {0, 0, 1}};
+  // The four sides, turning around z, then the bottom and the top
+  static const int faces[6][4] = {{0, 1, 5, 4}, {1, 2, 6, 5}, {2, 3, 7, 6},
+                                  {3, 0, 4, 7}, {0, 1, 2, 3}, {4, 5, 6, 7}};
+  for (int f = 0; f < 6; ++f) {
+    const float u0 = (f < 4) ? 0.25f * f : 0.0f;
+    const float u1 = (f < 4) ? 0.25f * (f + 1) : 1.0f;
+    addQuad(c[faces[f][0]], c[faces[f][1]], c[faces[f][2]], c[faces[f][3]],
+            normals[f], u0, 0.0f, u1, 1.0f);
+  }
+}
+
+void PieceMesh::setArrays() const {
+  glInterleavedArrays(GL_T2F_N3F_V3F, 0, &vertices_[0]);
+}
+
+void PieceMesh::draw() const {
+  if (isEmpty())
+    return;
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  setArrays();
+  glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+  glPopClientAttrib();
+}
+
+void PieceMesh::drawInstances(const vector<Instance> &instances) const {
+  if (isEmpty() || instances.empty())
+    return;
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  setArrays();
+  for (vector<Instance>::const_iterator it = instances.begin();
+       it != instances.end(); ++it) {
+    glPushMatrix();
+    glTranslatef(it->x, it->y, it->z);
+    glColor4fv(it->color);
+    glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+    glPopMatrix();
+  }
+  glPopClientAttrib();
+}
@@ -0,0 +1,57 @@
+#ifndef PIECE_MESH_H
+#define PIECE_MESH_H
+
+#include <QGLViewer/config.h>
+#include <vector>
+
+// Geometry of a game piece, tessellated once into triangles with texture
+// coordinates and normals, and drawn from vertex arrays. The arrays are client
+// side: a mesh is shared by all the viewers of a game, whatever their OpenGL
+// contexts, and the same draw is used by the selection (GL_SELECT) passes.
+//
+// The add*() methods append primitives in the frame of the piece, z being up.
+// Triangles are turned so that they face the direction of their normals.
+class PieceMesh {
+public:
+  // Per piece translation and color of drawInstances()
+  struct Instance {
+    float x, y, z;
+    float color[4];
+  };
+
+  void addQuad(const float p0[3], const float p1[3], const float p2[3],
+               const float p3[3], const float normal[3], float u0 = 0.0f,
+               float v0 = 0.0f, float u1 = 1.0f, float v1 = 1.0f);
+  // Side of a cylinder around z. The normals point to the axis when inwards is
+  // set, and are tilted by bevel along z at the top (-bevel at the bottom).
+  void addCylinder(float radius, float zMin, float zMax, int slices,
+                   bool inwards = false, float bevel = 0.0f);
+  // Flat ring (a disk when rMin is 0) at height z, facing up or down.
+  void addDisk(float rMin, float rMax, float z, int slices, bool up = true);
+  void addSphere(float radius, float z, int slices, int stacks);
+  // The texture is wrapped around the four sides, each one taking a quarter of
+  // it, and repeated on the top and bottom faces.
+  void addBox(float x0, float y0, float z0, float x1, float y1, float z1);
+
+  bool isEmpty() const { return vertices_.empty(); }
+
+  void draw() const;
+  // Draws the mesh at each instance position, with its color. The arrays are
+  // only set once.
+  void drawInstances(const std::vector<Instance> &instances) const;
+
+private:
+  // Same layout as GL_T2F_N3F_V3F
+  struct Vertex {
+    float u, v;
+    float nx, ny, nz;
+    float x, y, z;
+  };
+
+  void addTriangle(Vertex a, Vertex b, Vertex c);
+  void setArrays() const;
+
+  std::vector<Vertex> vertices_;
+};
+
+#endif // PIECE_MESH_H
@@ -26,37 +26,20 @@ void Viewer::draw() {
   glEnd();
 }
 
-void Viewer::drawCornerAxis() {
-  int viewport[4];
-  int scissor[4];
-
-  // The viewport and the scissor are changed to fit the lower left
-  // corner. Original values are saved.
-  glGetIntegerv(GL_VIEWPORT, viewport);
-  glGetIntegerv(GL_SCISSOR_BOX, scissor);
-
-  // Axis viewport size, in pixels
-  const int size = 150;
-  glViewport(0, 0, size, size);
-  glScissor(0, 0, size, size);
-
-  // The Z-buffer is cleared to make the axis appear over the
-  // original image.
-  glClear(GL_DEPTH_BUFFER_BIT);
+// Axis layer size, in pixels
+CornerAxis::CornerAxis() : OverlayLayer(QSize(150, 150), CAMERA_ORIENTATION) {}
 
+// The layer viewport and its transparent background are set by QGLViewer.
+void CornerAxis::draw(const Camera *camera) {
   // Tune for best line rendering
   glDisable(GL_LIGHTING);
   glLineWidth(3.0);
 
   glMatrixMode(GL_PROJECTION);
-  glPushMatrix();
-  glLoadIdentity();
   glOrtho(-1, 1, -1, 1, -1, 1);
 
   glMatrixMode(GL_MODELVIEW);
-  glPushMatrix();
-  glLoadIdentity();
-  glMultMatrixd(camera()->orientation().inverse().matrix());
+  glMultMatrixd(camera->orientation().inverse().matrix());
 
   glBegin(GL_LINES);
   glColor3f(1.0, 0.0, 0.0);
@@ -71,28 +54,11 @@ void Viewer::drawCornerAxis() {
   glVertex3f(0.0, 0.0, 0.0);
   glVertex3f(0.0, 0.0, 1.0);
   glEnd();
-
-  glMatrixMode(GL_PROJECTION);
-  glPopMatrix();
-
-  glMatrixMode(GL_MODELVIEW);
-  glPopMatrix();
-
-  glEnable(GL_LIGHTING);
-
-  // The viewport and the scissor are restored.
-  glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
-  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-}
-
-// The thumbnail has to be drawn at the very end to allow a correct
-// display of the visual hints (axes, grid, etc).
-void Viewer::postDraw() {
-  QGLViewer::postDraw();
-  drawCornerAxis();
 }
 
 void Viewer::init() {
+  // The layer is owned and composited by the viewer in postDraw()
+  addOverlayLayer(new CornerAxis());
   restoreStateFromFile();
   help();
 }
@@ -102,9 +68,9 @@ QString Viewer::helpString() const {
   text += "A world axis representation is drawn in the lower left corner, so "
           "that one always sees how the scene is oriented.<br><br>";
 
-  text += "The axis is drawn in <code>postDraw()</code> with appropriate ortho "
-          "camera parameters. ";
-  text += "<code>glViewport</code> and <code>glScissor</code> are used to "
-          "restrict the drawing area.";
+  text += "The axis is drawn in a <code>qglviewer::OverlayLayer</code>, a "
+          "small texture that is only updated when the camera orientation "
+          "changes, and that <code>postDraw()</code> composites in the "
+          "corner of the window.";
   return text;
 }
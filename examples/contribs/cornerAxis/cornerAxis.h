@@ -1,12 +1,19 @@
+#include <QGLViewer/overlayLayer.h>
 #include <QGLViewer/qglviewer.h>
 
+// The axis is drawn in its own texture, only when the camera orientation
+// changed.
+class CornerAxis : public qglviewer::OverlayLayer {
+public:
+  CornerAxis();
+
+protected:
+  virtual void draw(const qglviewer::Camera *camera);
+};
+
 class Viewer : public QGLViewer {
 protected:
   virtual void draw();
-  virtual void postDraw();
   virtual void init();
   virtual QString helpString() const;
-
-private:
-  void drawCornerAxis();
 };
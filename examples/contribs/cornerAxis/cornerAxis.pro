@@ -2,8 +2,9 @@
 
 # A world axis representation is drawn in the lower left corner, so that one always sees how the scene is oriented.
 
-# The axis is drawn in <code>postDraw()</code> with appropriate ortho camera parameters.
-# <code>glViewport</code> and <code>glScissor</code> are used to restrict the drawing area.
+# The axis is drawn in a <code>qglviewer::OverlayLayer</code>, a small texture that is only
+# updated when the camera orientation changes, and that <code>postDraw()</code> composites
+# in the corner of the window.
 
 # This example is very similar to the thumbnail example.
 
@@ -7,6 +7,10 @@ using namespace std;
 using namespace dvonn;
 
 namespace {
+// Neighbors of a space, in turning order: two consecutive ones are neighbors
+const int neighborDx[6] = {1, 1, 0, -1, -1, 0};
+const int neighborDy[6] = {0, 1, 1, 0, -1, -1};
+const unsigned char unplacedSpace = 0xFF;
 void resetStatus(pair<Stack, int> &b) { b.second = -1; }
 void clearStacks(pair<Stack, int> &b) { b.first.clear(); }
 unsigned int hasLessPieces(const pair<Stack, int> &s,
@@ -86,26 +90,30 @@ unsigned int Board::nbPieces(Color c) {
   }
   return 0;
 }
-Board::Board() : spaces_(nbSpacesMaxOnRow() * nbRows()) {
-  reinit();
+Board::Board()
+    : spaces_(nbSpacesMaxOnRow() * nbRows()), statusValid_(false) {
+  // Never reallocated afterwards: the State refers to pieces by their index
+  pieces_.reserve(nbAllPieces);
   for (unsigned int n = 0; n < nbColors; ++n) {
     Color c = static_cast<Color>(n);
     for (unsigned int i = 0; i < nbPieces(c); ++i) {
       pieces_.push_back(Piece(c));
     }
   }
+  reinit();
 }
 void Board::reinit() {
   unplaced_[0] = stack<const Piece *>();
   unplaced_[1] = stack<const Piece *>();
   unplaced_[2] = stack<const Piece *>();
-  for (deque<Piece>::const_iterator iter = pieces_.begin();
+  for (vector<Piece>::const_iterator iter = pieces_.begin();
        iter != pieces_.end(); ++iter) {
     unplaced_[iter->color()].push(&(*iter));
   }
   for_each(spaces_.begin(), spaces_.end(), resetStatus);
   for_each(spaces_.begin(), spaces_.end(), clearStacks);
   redSpaces_.clear();
+  statusValid_ = false;
 }
 Board::~Board() {}
 unsigned int Board::coord2idx(Coord c) {
@@ -175,6 +183,23 @@ void Board::place(const Piece *p, Coord c) {
     if (p->color() == Red) {
       redSpaces_[p] = c;
     }
+    statusValid_ = false;
+  }
+}
+/*!
+ * Undoes the last place() at c: the top piece of c goes back to the unplaced
+ * pieces. Placements must be undone in the reverse order.
+ */
+void Board::unplace(Coord c) {
+  if (isValid(c) && spaces_[coord2idx(c)].first.hasPieces()) {
+    Stack &s = spaces_[coord2idx(c)].first;
+    const Piece *p = s.back();
+    s.pop_back();
+    unplaced_[p->color()].push(p);
+    if (p->color() == Red) {
+      redSpaces_.erase(p);
+    }
+    statusValid_ = false;
   }
 }
 /*!
@@ -188,55 +213,144 @@ Board::Ghosts Board::move(Coord src, Coord dst, bool killDeads) {
     // If the src destination was containing a red
     Stack::const_iterator fter =
         find_if(s.begin(), s.end(), mem_fun(&Piece::isRed));
-    if (fter != s.end()) {
-      redSpaces_[*fter] = dst;
+    const bool redMoved = (fter != s.end());
+    for (; fter != s.end(); ++fter) {
+      if ((*fter)->isRed()) {
+        redSpaces_[*fter] = dst;
+      }
     }
     // Move the pieces from src to dst
     d.insert(d.end(), s.begin(), s.end());
     s.clear();
-    updateStatus(ghosts, killDeads);
+    if (statusValid_)
+      updateStatus(ghosts, killDeads, coord2idx(src), coord2idx(dst),
+                   redMoved);
+    else
+      updateStatus(ghosts, killDeads);
   }
   return ghosts;
 }
+/*!
+ * Undoes move(src, dst, killDeads), which moved height pieces and returned
+ * ghosts. Moves must be undone in the reverse order.
+ */
+void Board::unmove(Coord src, Coord dst, unsigned int height,
+                   const Ghosts &ghosts) {
+  if (isValid(src) && isValid(dst)) {
+    // Bring back the dead, which may include dst
+    for (Ghosts::const_iterator iter = ghosts.begin(); iter != ghosts.end();
+         ++iter) {
+      Stack &g = spaces_[coord2idx(iter->coord)].first;
+      g.insert(g.end(), iter->stack.begin(), iter->stack.end());
+    }
+    Stack &s = spaces_[coord2idx(src)].first;
+    Stack &d = spaces_[coord2idx(dst)].first;
+    height = min(height, d.height());
+    const Stack::iterator first = d.end() - height;
+    for (Stack::const_iterator iter = first; iter != d.end(); ++iter) {
+      if ((*iter)->isRed()) {
+        redSpaces_[*iter] = src;
+      }
+    }
+    s.insert(s.end(), first, d.end());
+    d.erase(first, d.end());
+
+    Ghosts none;
+    if (statusValid_) {
+      // The ghosts were connected to src, and the reds moved back can only
+      // change the status of the stacks connected to dst
+      bool seen[nbAllSpaces] = {false};
+      floodRegion(coord2idx(src), seen, none, false);
+      if (!seen[coord2idx(dst)] && d.hasPieces())
+        floodRegion(coord2idx(dst), seen, none, false);
+    } else
+      updateStatus(none, false);
+  }
+}
+/*!
+ * Computes the status of all the stacks: the index of the space of a red
+ * piece connected to them, or -1 for the dead ones.
+ */
 void Board::updateStatus(Ghosts &ghosts, bool killDeads) {
-  // We now need to update the status of the cases
   for_each(spaces_.begin(), spaces_.end(), resetStatus);
-  stack<Coord> toVisit;
-  // Start from the reds...
-  for (map<const Piece *, Coord>::const_iterator iter = redSpaces_.begin();
-       iter != redSpaces_.end(); ++iter) {
-    int i = coord2idx(iter->second);
-    spaces_[i].second = i;
-    toVisit.push(iter->second);
+  bool seen[nbAllSpaces] = {false};
+  for (unsigned int i = 0; i < spaces_.size(); ++i) {
+    if (!seen[i] && spaces_[i].first.hasPieces())
+      floodRegion(i, seen, ghosts, killDeads);
   }
-  /// ...and propagate.
-  while (!toVisit.empty()) {
-    Coord c = toVisit.top();
-    toVisit.pop();
-    int l = spaces_[coord2idx(c)].second;
-    Coord n[6] = {Coord(c.x() - 1, c.y()),     Coord(c.x() + 1, c.y()),
-                  Coord(c.x(), c.y() - 1),     Coord(c.x(), c.y() + 1),
-                  Coord(c.x() - 1, c.y() - 1), Coord(c.x() + 1, c.y() + 1)};
-    for (unsigned int i = 0; i < 6; ++i) {
-      if (!isValid(n[i]))
+  statusValid_ = true;
+}
+/*!
+ * Same as updateStatus(ghosts, killDeads), after the stack of src moved to
+ * dst, when the status was valid before the move. Only the groups of stacks
+ * connected to src, and to dst when a red moved, can change.
+ */
+void Board::updateStatus(Ghosts &ghosts, bool killDeads, unsigned int src,
+                         unsigned int dst, bool redMoved) {
+  spaces_[src].second = -1;
+  const Coord c = idx2coord(src);
+  bool occupied[6];
+  for (unsigned int k = 0; k < 6; ++k) {
+    const Coord n(c.x() + neighborDx[k], c.y() + neighborDy[k]);
+    occupied[k] = isValid(n) && spaces_[coord2idx(n)].first.hasPieces();
+  }
+  // When the neighbors of src are consecutive, they remain connected to each
+  // other without src, and nothing changes unless a red moved.
+  unsigned int nbGroups = 0;
+  for (unsigned int k = 0; k < 6; ++k) {
+    if (occupied[k] && !occupied[(k + 5) % 6])
+      ++nbGroups;
+  }
+  if (nbGroups <= 1 && !redMoved)
+    return;
+
+  bool seen[nbAllSpaces] = {false};
+  for (unsigned int k = 0; k < 6; ++k) {
+    if (!occupied[k])
+      continue;
+    const unsigned int n =
+        coord2idx(Coord(c.x() + neighborDx[k], c.y() + neighborDy[k]));
+    if (!seen[n])
+      floodRegion(n, seen, ghosts, killDeads);
+  }
+  if (redMoved && !seen[dst])
+    floodRegion(dst, seen, ghosts, killDeads);
+}
+/*!
+ * Gives to the group of stacks connected to start the status of its first
+ * red, and kills it when it has none and killDeads is set. The spaces of the
+ * group get marked in seen.
+ */
+void Board::floodRegion(unsigned int start, bool *seen, Ghosts &ghosts,
+                        bool killDeads) {
+  unsigned int region[nbAllSpaces];
+  unsigned int nb = 0;
+  int status = -1;
+  region[nb++] = start;
+  seen[start] = true;
+  for (unsigned int r = 0; r < nb; ++r) {
+    const unsigned int i = region[r];
+    if (status == -1 && spaces_[i].first.hasRed())
+      status = i;
+    const Coord c = idx2coord(i);
+    for (unsigned int k = 0; k < 6; ++k) {
+      const Coord n(c.x() + neighborDx[k], c.y() + neighborDy[k]);
+      if (!isValid(n))
         continue;
-      unsigned int p = coord2idx(n[i]);
-      Space &s = spaces_[p];
-      if (s.second == -1 && s.first.hasPieces()) {
-        s.second = l;
-        toVisit.push(n[i]);
+      const unsigned int j = coord2idx(n);
+      if (!seen[j] && spaces_[j].first.hasPieces()) {
+        seen[j] = true;
+        region[nb++] = j;
       }
     }
   }
-  // Now get rid of the dead
-  if (killDeads) {
-    unsigned int i = 0;
-    for (vector<Space>::iterator iter = spaces_.begin(); iter != spaces_.end();
-         ++iter, ++i) {
-      if (iter->second == -1 && iter->first.hasPieces()) {
-        ghosts.push_back(Ghost(idx2coord(i), iter->first));
-        iter->first.clear();
-      }
+  for (unsigned int r = 0; r < nb; ++r) {
+    Space &s = spaces_[region[r]];
+    s.second = status;
+    // Now get rid of the dead
+    if (status == -1 && killDeads) {
+      ghosts.push_back(Ghost(idx2coord(region[r]), s.first));
+      s.first.clear();
     }
   }
 }
@@ -265,19 +379,50 @@ unsigned int Board::heightMax() const {
 }
 Board::State Board::state() const {
   State s;
-  s.spaces_ = spaces_;
-  s.redSpaces_ = redSpaces_;
-  s.unplaced_[0] = unplaced_[0];
-  s.unplaced_[1] = unplaced_[1];
-  s.unplaced_[2] = unplaced_[2];
+  fill(s.spaces_, s.spaces_ + nbAllPieces, unplacedSpace);
+  fill(s.levels_, s.levels_ + nbAllPieces, 0);
+  for (unsigned int i = 0; i < spaces_.size(); ++i) {
+    const Stack &t = spaces_[i].first;
+    for (unsigned int l = 0; l < t.size(); ++l) {
+      const unsigned int p = t[l] - &pieces_[0];
+      s.spaces_[p] = i;
+      s.levels_[p] = l;
+    }
+    s.status_[i] = spaces_[i].second;
+  }
+  s.statusValid_ = statusValid_;
   return s;
 }
+/*!
+ * The unplaced pieces of a color are always the first ones of pieces_, the
+ * last one on top, as after reinit().
+ */
 void Board::restore(State s) {
-  spaces_ = s.spaces_;
-  redSpaces_ = s.redSpaces_;
-  unplaced_[0] = s.unplaced_[0];
-  unplaced_[1] = s.unplaced_[1];
-  unplaced_[2] = s.unplaced_[2];
+  unsigned int heights[nbAllSpaces] = {0};
+  for (unsigned int p = 0; p < nbAllPieces; ++p) {
+    if (s.spaces_[p] != unplacedSpace)
+      heights[s.spaces_[p]] = max(heights[s.spaces_[p]], s.levels_[p] + 1u);
+  }
+  for (unsigned int i = 0; i < spaces_.size(); ++i) {
+    spaces_[i].first.resize(heights[i]);
+    spaces_[i].second = s.status_[i];
+  }
+  for (unsigned int n = 0; n < nbColors; ++n) {
+    while (!unplaced_[n].empty())
+      unplaced_[n].pop();
+  }
+  redSpaces_.clear();
+  for (unsigned int p = 0; p < nbAllPieces; ++p) {
+    const Piece *piece = &pieces_[p];
+    if (s.spaces_[p] == unplacedSpace) {
+      unplaced_[piece->color()].push(piece);
+      continue;
+    }
+    spaces_[s.spaces_[p]].first[s.levels_[p]] = piece;
+    if (piece->isRed())
+      redSpaces_[piece] = idx2coord(s.spaces_[p]);
+  }
+  statusValid_ = s.statusValid_;
 }
 //************************************************************
 // Implementation of Board::Coord
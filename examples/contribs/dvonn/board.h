@@ -73,12 +73,14 @@ public:
   unsigned int nbUnplacedPieces(Color c) const;
   const Piece *getUnplacedPiece(Color c) const;
   void place(const Piece *p, Coord c);
+  void unplace(Coord c);
 
   unsigned int heightMax() const;
 
   class Ghost;
   typedef std::deque<Ghost> Ghosts;
   Ghosts move(Coord src, Coord dst, bool killDeads);
+  void unmove(Coord src, Coord dst, unsigned int height, const Ghosts &ghosts);
 
   std::string prettyPrinted(const char *prefix = "") const;
 
@@ -89,21 +91,31 @@ private:
   friend class ConstStackIterator;
   static unsigned int coord2idx(Coord c);
   static Coord idx2coord(unsigned int);
+  enum { nbAllPieces = 49, nbAllSpaces = 55 };
   typedef std::pair<Stack, int> Space;
   std::vector<Space> spaces_;
-  std::deque<Piece> pieces_;
+  std::vector<Piece> pieces_;
   std::stack<const Piece *> unplaced_[3];
   std::map<const Piece *, Coord> redSpaces_;
+  bool statusValid_;
 
   void updateStatus(Ghosts &ghosts, bool killDeads);
+  void updateStatus(Ghosts &ghosts, bool killDeads, unsigned int src,
+                    unsigned int dst, bool redMoved);
+  void floodRegion(unsigned int start, bool *seen, Ghosts &ghosts,
+                   bool killDeads);
 
 public:
+  // Fixed size snapshot of the board, which does not allocate.
   class State {
   private:
     friend class Board;
-    std::vector<Space> spaces_;
-    std::stack<const Piece *> unplaced_[3];
-    std::map<const Piece *, Coord> redSpaces_;
+    // Space index and level in its stack of each piece of pieces_
+    // (unplacedSpace when unplaced), and status of each space.
+    unsigned char spaces_[nbAllPieces];
+    unsigned char levels_[nbAllPieces];
+    signed char status_[nbAllSpaces];
+    bool statusValid_;
   };
   State state() const;
   void restore(State);
@@ -1,4 +1,5 @@
 #include "drawer.h"
+#include "pieceMesh.h"
 #include <QGLViewer/qglviewer.h>
 #include <qimage.h>
 #include <qmessagebox.h>
@@ -65,53 +66,41 @@ void tessAndTexture(float x0, float y0, float x2, float y2, float u0 = 0.0f,
     glVertex2f(x0, y2);
   }
 }
-const Vec normal[5] = {Vec(-1.0, 0.0, 0.0), Vec(0.0, 1.0, 0.0),
-                       Vec(1.0, 0.0, 0.0), Vec(0.0, -1.0, 0.0),
-                       Vec(-1.0, 0.0, 0.0)};
-void drawHRing(const float rMin, const float rMax, const float height) {
-  // TODO : tabulate the cos and sin tables
-  const int nbSteps = 24;
-
-  glNormal3f(0.0, 0.0, 1.0);
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(rMin, 0.0, height);
-  glVertex3f(rMax, 0.0, height);
-  for (int i = 1; i <= nbSteps; ++i) {
-    const float angle = i * 2.0 * M_PI / nbSteps;
-    const float cosine = cos(angle);
-    const float sine = sin(angle);
-    glVertex3f(rMin * cosine, rMin * sine, height);
-    glVertex3f(rMax * cosine, rMax * sine, height);
+const int nbSteps = 24;
+// Tessellated once, shared by the draw and the selection passes
+const PieceMesh &pieceMesh() {
+  static PieceMesh mesh;
+  if (mesh.isEmpty()) {
+    mesh.addDisk(pieceRMin, pieceRMax, pieceH, nbSteps);
+    mesh.addCylinder(pieceRMax, 0.0f, pieceH, nbSteps, false, pieceC);
+    mesh.addCylinder(pieceRMin, 0.0f, pieceH, nbSteps, true, -pieceC);
   }
-  glEnd();
+  return mesh;
 }
-void drawVRing(const float hMin, const float hMax, const float r, bool in) {
-  const int nbSteps = 24;
-  const float normalSign = (in ? -1.0 : 1.0);
-  float thMin = hMin;
-  float thMax = hMax;
-  if (in)
-    swap(thMax, thMin);
-  glBegin(GL_QUAD_STRIP);
-  glNormal3f(normalSign, 0.0, 0.0);
-  for (int i = 0; i <= nbSteps; ++i) {
-    const float angle = i * 2.0 * M_PI / nbSteps;
-    const float cosine = cos(angle);
-    const float sine = sin(angle);
-    glNormal3fv(Vec(normalSign * cosine, normalSign * sine, +pieceC).unit());
-    glVertex3f(r * cosine, r * sine, thMax);
-    glNormal3fv(Vec(normalSign * cosine, normalSign * sine, -pieceC).unit());
-    glVertex3f(r * cosine, r * sine, thMin);
-  }
-  glEnd();
+const PieceMesh &highlightMesh() {
+  static PieceMesh mesh;
+  if (mesh.isEmpty())
+    mesh.addDisk(pieceRMin, 1.2f * pieceRMax, 0.0f, nbSteps);
+  return mesh;
 }
-void drawPiece(const Color &p, float a = 1.0f) {
+PieceMesh::Instance pieceInstance(const Color &p, float z, float a) {
   static const float *colors[3] = {redColor, whiteColor, blackColor};
   const float *c = colors[static_cast<int>(p)];
-  glColor4f(c[0] * a, c[1] * a, c[2] * a, a);
-  drawHRing(pieceRMin, pieceRMax, pieceH);
-  drawVRing(0.0f, pieceH, pieceRMax, false);
-  drawVRing(0.0f, pieceH, pieceRMin, true);
+  const PieceMesh::Instance i = {
+      0.0f, 0.0f, z, {c[0] * a, c[1] * a, c[2] * a, a}};
+  return i;
+}
+void drawPiece(const Color &p, float a = 1.0f) {
+  pieceMesh().drawInstances(
+      vector<PieceMesh::Instance>(1, pieceInstance(p, 0.0f, a)));
+}
+// The pieces of [first, last), piled up from the current position
+void drawStack(Stack::const_iterator first, Stack::const_iterator last,
+               float a = 1.0f) {
+  vector<PieceMesh::Instance> instances;
+  for (float z = 0.0f; first != last; ++first, z += pieceH)
+    instances.push_back(pieceInstance((*first)->color(), z, a));
+  pieceMesh().drawInstances(instances);
 }
 void drawHLabel(unsigned int i) {
   glBegin(GL_QUADS);
@@ -264,11 +253,7 @@ void Drawer::drawPieces(const Board::ConstStackHandle &s) const {
   glPushMatrix();
   translateTo(s.stackCoord());
   glTranslatef(0.5f * caseD, 0.5f * caseD, 0.0f);
-  for (Stack::const_iterator iter = s->begin(), istop = s->end(); iter != istop;
-       ++iter) {
-    drawPiece((*iter)->color());
-    glTranslatef(0.0f, 0.0f, pieceH);
-  }
+  drawStack(s->begin(), s->end());
   glPopMatrix();
   endTexture();
 }
@@ -300,10 +285,7 @@ void Drawer::drawTransparentPieces(Stack::const_iterator first,
   glPushMatrix();
   translateTo(c, h * pieceH);
   glTranslatef(0.5f * caseD, 0.5f * caseD, 0.0f);
-  while (first != last) {
-    drawPiece((*first++)->color(), a);
-    glTranslatef(0.0f, 0.0f, pieceH);
-  }
+  drawStack(first, last, a);
   glPopMatrix();
   endTexture();
 }
@@ -386,16 +368,16 @@ void Drawer::drawWhitePiecePools(const Board &b, bool lastTransparent) const {
   unsigned int nbR = b.nbUnplacedPieces(Red);
   unsigned int nbW = b.nbUnplacedPieces(White);
   unsigned int nbRed4White = nbR / 2 + nbR % 2;
+  vector<PieceMesh::Instance> instances;
   for (unsigned int istop = nbW + nbRed4White, i = 0; i < istop; ++i) {
-    const float x = boardB + vLabelW + (d + 1) * caseD / 2.0f + (i % e) * caseD;
-    static const float y = -poolB - caseD / 2.0f;
-    const float z = (i / e) * pieceH;
-    glPushMatrix();
-    glTranslatef(x, y, z);
-    drawPiece((i < nbW) ? White : Red,
-              (lastTransparent && i == nbW + nbRed4White - 1) ? 0.5f : 1.0f);
-    glPopMatrix();
+    PieceMesh::Instance p = pieceInstance(
+        (i < nbW) ? White : Red, (i / e) * pieceH,
+        (lastTransparent && i == nbW + nbRed4White - 1) ? 0.5f : 1.0f);
+    p.x = boardB + vLabelW + (d + 1) * caseD / 2.0f + (i % e) * caseD;
+    p.y = -poolB - caseD / 2.0f;
+    instances.push_back(p);
   }
+  pieceMesh().drawInstances(instances);
   endTexture();
 }
 void Drawer::drawBlackPiecePools(const Board &b, bool lastTransparent) const {
@@ -406,17 +388,17 @@ void Drawer::drawBlackPiecePools(const Board &b, bool lastTransparent) const {
   unsigned int nbR = b.nbUnplacedPieces(Red);
   unsigned int nbB = b.nbUnplacedPieces(Black);
   unsigned int nbRed4Black = nbR / 2;
+  vector<PieceMesh::Instance> instances;
   for (unsigned int istop = nbB + nbRed4Black, i = 0; i < istop; ++i) {
-    const float x =
-        boardW - (boardB + vLabelW + (d + 1) * caseD / 2.0f + (i % e) * caseD);
-    static const float y = boardH + poolB + caseD / 2.0f;
-    const float z = (i / e) * pieceH;
-    glPushMatrix();
-    glTranslatef(x, y, z);
-    drawPiece((i < nbB) ? Black : Red,
-              (lastTransparent && i == nbB + nbRed4Black - 1) ? 0.4f : 1.0f);
-    glPopMatrix();
+    PieceMesh::Instance p = pieceInstance(
+        (i < nbB) ? Black : Red, (i / e) * pieceH,
+        (lastTransparent && i == nbB + nbRed4Black - 1) ? 0.4f : 1.0f);
+    p.x = boardW -
+          (boardB + vLabelW + (d + 1) * caseD / 2.0f + (i % e) * caseD);
+    p.y = boardH + poolB + caseD / 2.0f;
+    instances.push_back(p);
   }
+  pieceMesh().drawInstances(instances);
   endTexture();
 }
 void Drawer::highlight(const Board::ConstStackHandle &c) const {
@@ -439,7 +421,7 @@ void Drawer::highlightPieces(const Board::ConstStackHandle &c) const {
   translateTo(c.stackCoord(), 0.01f);
   glTranslatef(0.5f * caseD, 0.5f * caseD, 0.0f);
   glColor4f(0.0f, 0.0f, 0.3f, 0.3f);
-  drawHRing(pieceRMin, 1.2f * pieceRMax, 0.0f);
+  highlightMesh().draw();
   glPopMatrix();
   endTexture();
   glPopAttrib();
@@ -459,11 +441,7 @@ void Drawer::drawMove(const Board &b, const Game::Move m, float t) const {
     float dstH = b.heightMax() * pieceH + pieceH;
     translateTo(m.src);
     glTranslatef(0.5f * caseD, 0.5f * caseD, (1 - t) * srcH + t * dstH);
-    for (Stack::const_iterator iter = src->begin(), istop = src->end();
-         iter != istop; ++iter) {
-      drawPiece((*iter)->color());
-      glTranslatef(0.0f, 0.0f, pieceH);
-    }
+    drawStack(src->begin(), src->end());
   } else if (t <= t1) {
     t = (t - t0) / (t1 - t0);
     static const float shifts[5] = {1.0f, 0.5f, 0.0f, -0.5f, -1.0f};
@@ -476,22 +454,14 @@ void Drawer::drawMove(const Board &b, const Game::Move m, float t) const {
     glTranslatef((1.0f - t) * srcX + t * dstX + 0.5f * caseD,
                  (1.0f - t) * srcY + t * dstY + 0.5f * caseD,
                  b.heightMax() * pieceH + pieceH);
-    for (Stack::const_iterator iter = src->begin(), istop = src->end();
-         iter != istop; ++iter) {
-      drawPiece((*iter)->color());
-      glTranslatef(0.0f, 0.0f, pieceH);
-    }
+    drawStack(src->begin(), src->end());
   } else {
     t = (t - t1) / (1.0f - t1);
     float srcH = b.heightMax() * pieceH + pieceH;
     float dstH = b.stackAt(m.dst)->height() * pieceH;
     translateTo(m.dst);
     glTranslatef(0.5f * caseD, 0.5f * caseD, (1 - t) * srcH + t * dstH);
-    for (Stack::const_iterator iter = src->begin(), istop = src->end();
-         iter != istop; ++iter) {
-      drawPiece((*iter)->color());
-      glTranslatef(0.0f, 0.0f, pieceH);
-    }
+    drawStack(src->begin(), src->end());
   }
   endTexture();
   glPopMatrix();
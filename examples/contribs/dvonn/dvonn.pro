@@ -13,6 +13,11 @@ TARGET   = dvonn
 HEADERS += board.h   game.h   drawer.h   dvonnviewer.h   dvonnwindowimpl.h
 SOURCES += board.cpp game.cpp drawer.cpp dvonnviewer.cpp dvonnwindowimpl.cpp main.cpp
 
+# Piece meshes shared with the other board games
+INCLUDEPATH *= ../common
+HEADERS += ../common/pieceMesh.h
+SOURCES += ../common/pieceMesh.cpp
+
 # "make dist" additionnal files
 DISTFILES += images/*.png rules/*.png rules/rules.html
 
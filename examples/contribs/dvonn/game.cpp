@@ -27,10 +27,11 @@ void Game::reinit() {
   score_[WhitePlayer] = -1;
   score_[BlackPlayer] = -1;
   time_ = 0;
-  historyStates_.clear();
+  knownTime_ = 0;
+  historySteps_.clear();
+  scoreMoves_.clear();
   historyPlayers_.clear();
   historyPhases_.clear();
-  historyStates_.push_back(board_.state());
   historyPlayers_.push_back(theOnePlaying());
   historyPhases_.push_back(phase());
 }
@@ -61,6 +62,9 @@ bool Game::doPlacement(Placement p) {
       (phase_ == PiecePlacementPhase && p.color == colorOf(theOnePlaying()))) {
     if (isLegalPlacement(p)) {
       board_.place(board_.getUnplacedPiece(p.color), p.dst);
+      Step step;
+      step.isMove = false;
+      step.placements.push_back(p);
 
       if (phase_ == RedPlacementPhase && board_.nbUnplacedPieces(Red) == 0) {
         phase_ = PiecePlacementPhase;
@@ -69,7 +73,7 @@ bool Game::doPlacement(Placement p) {
         phase_ = MovePhase;
       }
       switchPlayers(player_);
-      updateHistory();
+      updateHistory(step);
       return true;
     }
   }
@@ -80,14 +84,26 @@ bool Game::doMove(const Move m) {
   case RedPlacementPhase:
   case PiecePlacementPhase:
     return false;
-  case MovePhase:
+  case MovePhase: {
     if (!isLegalMove(m))
       return false;
-    ghosts_[m] = board_.move(m.src, m.dst, true);
+    Step step;
+    step.isMove = true;
+    step.move = m;
+    step.height = board_.stackAt(m.src)->height();
+    step.ghosts = ghosts_[m] = board_.move(m.src, m.dst, true);
     switchPlayers(player_);
-    updateHistory();
+    updateHistory(step);
     break;
+  }
   case GameOverPhase:
+    if (Board::isValid(m.src) && Board::isValid(m.dst)) {
+      Step step;
+      step.isMove = true;
+      step.move = m;
+      step.height = board_.stackAt(m.src)->height();
+      scoreMoves_.push_back(step);
+    }
     (void)board_.move(m.src, m.dst, false);
     break;
   }
@@ -153,16 +169,19 @@ void Game::randomlyFinishPlacement() {
 
   random_shuffle(s.begin(), s.end());
   deque<Color>::const_iterator pter = s.begin();
+  Step step;
+  step.isMove = false;
   for (Board::ConstStackIterator iter = board_.stacks_begin(),
                                  istop = board_.stacks_end();
        iter != istop; ++iter) {
     if (!(*iter).hasPieces()) {
+      step.placements.push_back(Placement(*pter, iter.stackCoord()));
       board_.place(board_.getUnplacedPiece(*pter++), iter.stackCoord());
     }
   }
   phase_ = MovePhase;
   player_ = WhitePlayer;
-  updateHistory();
+  updateHistory(step);
 }
 bool Game::getRandomMove(Player p, Game::Move &m) const {
   deque<Move> moves;
@@ -217,19 +236,32 @@ bool Game::saveAs(const QString &fileName) {
   fileName_ = fileName;
   return save();
 }
-void Game::updateHistory() {
+/*!
+ * Only the steps are stored, not the boards: undo() and redo() replay them
+ * backward or forward.
+ */
+void Game::updateHistory(const Step &step) {
+  if (time_ >= historySteps_.size()) // cannot be more than size() actually
+    historySteps_.push_back(step);
+  else
+    historySteps_[time_] = step;
   ++time_;
-  if (time_ >= historyStates_.size()) // cannot be more than size() actually
-  {
-    historyStates_.push_back(board_.state());
+  if (time_ >= historyPlayers_.size()) {
     historyPlayers_.push_back(theOnePlaying());
     historyPhases_.push_back(phase());
   } else {
-    historyStates_[time_] = board_.state();
     historyPlayers_[time_] = theOnePlaying();
     historyPhases_[time_] = phase();
   }
   knownTime_ = 0;
+  scoreMoves_.clear();
+}
+void Game::undoScoreMoves() {
+  while (!scoreMoves_.empty()) {
+    const Step &step = scoreMoves_.back();
+    board_.unmove(step.move.src, step.move.dst, step.height, step.ghosts);
+    scoreMoves_.pop_back();
+  }
 }
 bool Game::canUndo() const { return time_ > 0; }
 bool Game::canRedo() const { return time_ < knownTime_; }
@@ -237,16 +269,30 @@ void Game::undo() {
   if (canUndo()) {
     if (knownTime_ == 0)
       knownTime_ = time_;
+    undoScoreMoves();
     --time_;
-    board_.restore(historyStates_[time_]);
+    const Step &step = historySteps_[time_];
+    if (step.isMove)
+      board_.unmove(step.move.src, step.move.dst, step.height, step.ghosts);
+    else
+      for (deque<Placement>::const_reverse_iterator iter =
+               step.placements.rbegin();
+           iter != step.placements.rend(); ++iter)
+        board_.unplace(iter->dst);
     player_ = historyPlayers_[time_];
     phase_ = historyPhases_[time_];
   }
 }
 void Game::redo() {
   if (canRedo()) {
+    const Step &step = historySteps_[time_];
+    if (step.isMove)
+      (void)board_.move(step.move.src, step.move.dst, true);
+    else
+      for (deque<Placement>::const_iterator iter = step.placements.begin();
+           iter != step.placements.end(); ++iter)
+        board_.place(board_.getUnplacedPiece(iter->color), iter->dst);
     ++time_;
-    board_.restore(historyStates_[time_]);
     player_ = historyPlayers_[time_];
     phase_ = historyPhases_[time_];
   }
@@ -62,8 +62,10 @@ public:
   bool canRedo() const;
 
 private:
+  class Step;
   void switchPlayers(Player p);
-  void updateHistory();
+  void updateHistory(const Step &step);
+  void undoScoreMoves();
 
   QString fileName_;
   Board board_;
@@ -73,7 +75,10 @@ private:
   int score_[2];
   unsigned int time_;
   unsigned int knownTime_;
-  std::deque<Board::State> historyStates_;
+  // historySteps_[t] leads from time t to time t+1
+  std::deque<Step> historySteps_;
+  // Moves made once the game is over, to show the scores, out of the history
+  std::deque<Step> scoreMoves_;
   std::deque<Player> historyPlayers_;
   std::deque<Phase> historyPhases_;
 };
@@ -96,6 +101,19 @@ public:
   Board::Coord dst;
   bool operator<(const Move other) const;
 };
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Interface of Game::Step
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// What changed between two times of the history: some placements, or a
+// move and the stacks it killed.
+class Game::Step {
+public:
+  std::deque<Placement> placements;
+  bool isMove;
+  Move move;
+  unsigned int height; // Of the moved stack
+  Board::Ghosts ghosts;
+};
 } // namespace dvonn
 extern std::ostream &operator<<(std::ostream &, const dvonn::Game::Placement);
 extern std::ostream &operator<<(std::ostream &, const dvonn::Game::Move);
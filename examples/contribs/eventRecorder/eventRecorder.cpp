@@ -2,17 +2,36 @@
 #include "replayInterface.h"
 #include "viewer.h"
 #include <qcombobox.h>
+#include <qdatastream.h>
+#include <qfile.h>
 #include <qfiledialog.h>
 #include <qlabel.h>
 #include <qlineedit.h>
 #include <qmessagebox.h>
+#include <qopenglframebufferobject.h>
 #include <qpoint.h>
+#include <qprocess.h>
 #include <qpushbutton.h>
 #include <qradiobutton.h>
 #include <qspinbox.h>
 
+#include <climits>
+
 using namespace qglviewer;
 
+// Event stream files start with this magic number ("QGER") and version. The
+// duration and number of events that follow are written by stopRecording().
+static const quint32 streamMagic = 0x51474552;
+static const quint16 streamVersion = 1;
+static const qint64 streamHeaderDurationPos = 6;
+
+// Time differences larger than this value are followed by the complete time.
+static const quint16 streamLongTime = 0xFFFF;
+
+// Duration of a stream whose recording was interrupted: replayed up to its
+// last event.
+static const int interruptedStreamDuration = INT_MAX - 1;
+
 /*! Creates an EventRecorder associated to the provided \c qglviewer.
 
   All \p qglviewer events will then be filtered by the created EventRecorder.
@@ -30,6 +49,12 @@ EventRecorder::EventRecorder(Viewer *const qglviewer)
   isRecording_ = false;
   recordDuration_ = 0;
 
+  streamFile_ = NULL;
+  stream_ = NULL;
+  streamIsRecorded_ = false;
+  streamedEvent_.type = QEvent::None;
+  streamedEvent_.event.keyEvent = NULL;
+
   setCameraIsRestored();
   setManipulatedFrameIsRestored();
   setSavesSnapshots();
@@ -53,6 +78,8 @@ EventRecorder::~EventRecorder() {
   if (replayInterface_)
     delete replayInterface_;
 
+  closeEventStream();
+
   for (QValueVector<Event>::iterator it = eventRecords_.begin(),
                                      end = eventRecords_.end();
        it != end; ++it)
@@ -102,14 +129,47 @@ void EventRecorder::startRecording() {
   viewerWidth_ = qglviewer()->width();
   viewerHeight_ = qglviewer()->height();
 
+  closeEventStream();
+  if (!eventStreamFileName().isEmpty()) {
+    streamFile_ = new QFile(eventStreamFileName());
+    if (streamFile_->open(IO_WriteOnly)) {
+      stream_ = new QDataStream(streamFile_);
+      streamIsRecorded_ = true;
+      writeStreamHeader();
+    } else {
+      QMessageBox::warning(qglviewer(), "Event stream error",
+                           "Unable to create file " + eventStreamFileName() +
+                               ":\n" + streamFile_->errorString());
+      closeEventStream();
+    }
+  }
+
   time_.start();
 }
 
-/*! Stops a recording initiated with startRecording() or toggleRecording(). */
+/*! Stops a recording initiated with startRecording() or toggleRecording().
+
+  When the events are streamed (see eventStreamFileName()), the stream file is
+  completed and closed. */
 void EventRecorder::stopRecording() {
   isRecording_ = false;
   recordDuration_ = time_.elapsed();
 
+  if (stream_) {
+    // Same as below: the TOGGLE_RECORDING key press is removed from the file
+    if (lastKeyPressRecord_ >= 0) {
+      stream_->device()->seek(lastKeyPressRecord_);
+      streamFile_->resize(lastKeyPressRecord_);
+      streamNbEvents_--;
+    }
+
+    // Header was written with an unknown duration and number of events
+    stream_->device()->seek(streamHeaderDurationPos);
+    *stream_ << qint32(recordDuration_) << qint32(streamNbEvents_);
+    closeEventStream();
+    return;
+  }
+
   // Check that last record was the TOGGLE_RECORDING key press.
   // Give it a fake time so that it is never replayed back.
   if (eventRecords_[eventIndex_ - 1].type == QEvent::KeyPress) {
@@ -133,7 +193,44 @@ void EventRecorder::stopRecording() {
   Other specific events can be recorded using recordFrameState() and
   recordCustomEvent(). */
 bool EventRecorder::eventFilter(QObject *, QEvent *e) {
-  if (isRecording()) {
+  if (isRecording() && stream_) {
+    const int time = time_.elapsed();
+    const qint64 recordPos = streamFile_->pos();
+    switch (e->type()) {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease: {
+      QKeyEvent *ke = (QKeyEvent *)(e);
+      writeStreamRecord(e->type(), time);
+      *stream_ << qint32(ke->key()) << qint32(ke->ascii())
+               << qint32(ke->state());
+      if (e->type() == QEvent::KeyPress)
+        lastKeyPressRecord_ = recordPos;
+      break;
+    }
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove: {
+      QMouseEvent *me = (QMouseEvent *)(e);
+      writeStreamRecord(e->type(), time);
+      *stream_ << qint16(me->x()) << qint16(me->y())
+               << quint8(me->button()) << qint32(me->state());
+      break;
+    }
+    case QEvent::Wheel: {
+      QWheelEvent *we = (QWheelEvent *)(e);
+      writeStreamRecord(e->type(), time);
+      *stream_ << qint16(we->x()) << qint16(we->y())
+               << qint16(we->delta()) << qint32(we->state());
+      break;
+    }
+    case QEvent::Timer:
+      writeStreamRecord(e->type(), time);
+      break;
+    default:
+      break;
+    }
+  } else if (isRecording()) {
     bool record = true;
     switch (e->type()) {
     case QEvent::KeyPress:
@@ -200,6 +297,13 @@ void EventRecorder::saveEventRecord(const QString &filename) const {
   else
     name = filename;
 
+  if (stream_) {
+    qWarning("EventRecorder::saveEventRecord: the replayed event stream is "
+             "already saved in " +
+             streamFile_->fileName());
+    return;
+  }
+
   // Create the DOM document
   QDomDocument doc("EVENTRECORDER");
 
@@ -324,6 +428,9 @@ void EventRecorder::loadEventRecord(const QString &filename) {
   } else
     name = filename;
 
+  // Replays the loaded events instead of a previously loaded stream
+  closeEventStream();
+
   // Create the DOM document
   QDomDocument doc("EVENTRECORDER");
 
@@ -493,6 +600,11 @@ void EventRecorder::recordFrameState() {
       return;
     }
 
+    if (stream_) {
+      writeStreamFrameState(const_cast<Frame *>(frame), time_.elapsed());
+      return;
+    }
+
     eventRecords_[eventIndex_].type = QEvent::MaxUser; // Dummy
     eventRecords_[eventIndex_].time = time_.elapsed();
     eventRecords_[eventIndex_].event.frameState =
@@ -513,7 +625,10 @@ during replay(). During replay(), the replayCustomEvent() signal will be emitted
 when a custom event needs to be reproduced. Connect this signal to slots that
 are able to reproduce this event. */
 void EventRecorder::recordCustomEvent(int id) {
-  if (isRecording()) {
+  if (isRecording() && stream_) {
+    writeStreamRecord(QEvent::User, time_.elapsed());
+    *stream_ << qint32(id);
+  } else if (isRecording()) {
     eventRecords_[eventIndex_].type = QEvent::User;
     eventRecords_[eventIndex_].time = time_.elapsed();
     eventRecords_[eventIndex_].event.frameState = (FrameState *)(id);
@@ -657,9 +772,29 @@ void EventRecorder::openReplayInterfaceWindow() {
   milliseconds). This is useful to check the scenario before it is saved or
   rendered to image files using savesSnapshots(). */
 void EventRecorder::replay() {
-  if (isRecording())
+  if (isRecording() || !startReplay())
     return;
 
+  if (savesSnapshots()) {
+    if (saveAtGivenFrameRate()) {
+      nextEventIsSaveSnapshot_ = true;
+      QTimer::singleShot(0, this, SLOT(triggerNextEvent()));
+    } else {
+      connect(qglviewer(), SIGNAL(drawFinished()), this,
+              SLOT(saveNumberedSnapshot()));
+      QTimer::singleShot(nextEvent().time, this,
+                         SLOT(triggerNextEvent()));
+    }
+  } else
+    QTimer::singleShot(nextEvent().time, this,
+                       SLOT(triggerNextEvent()));
+
+  time_.start();
+}
+
+// Restores the initial state of the scenario and rewinds the records. Returns
+// false when there is no event to replay.
+bool EventRecorder::startReplay() {
   bool updateGLNeeded = false;
   if (cameraIsRestored()) {
     qglviewer()->camera()->frame()->setPosition(initialCameraFrame_.position());
@@ -685,21 +820,124 @@ void EventRecorder::replay() {
   nextReplayEvent_ = 0;
   nextEventIsSaveSnapshot_ = false;
 
-  if (savesSnapshots()) {
-    if (saveAtGivenFrameRate()) {
-      nextEventIsSaveSnapshot_ = true;
-      QTimer::singleShot(0, this, SLOT(triggerNextEvent()));
-    } else {
-      connect(qglviewer(), SIGNAL(drawFinished()), this,
-              SLOT(saveNumberedSnapshot()));
-      QTimer::singleShot(eventRecords_[nextReplayEvent_].time, this,
-                         SLOT(triggerNextEvent()));
+  if (stream_) {
+    // Rewind the replayed stream
+    stream_->resetStatus();
+    stream_->device()->seek(streamEventsStart_);
+    streamTime_ = 0;
+    streamNbEvents_ = 0;
+    frameStatesAreValid_[0] = frameStatesAreValid_[1] = false;
+    return readStreamRecord();
+  }
+
+  return true;
+}
+
+/*! Replays the recorded events offline, and returns \c true when all the
+  frames could be rendered and encoded.
+
+  The scenario is restored as in replay(), but the events are then replayed
+  synchronously, as fast as possible: each frame advances the scenario time by
+  1/snapshotFrameRate() second, replays the events recorded before this time
+  and renders the qglviewer() in an offscreen framebuffer object of the
+  qglviewer() size. The result does hence not depend on the rendering speed,
+  and replaySpeed() and saveAtGivenFrameRate() are meaningless.
+
+  Each frame is sent to the offlineFrameRendered() signal. When \p
+  encoderProgram is not empty, it is also started with \p encoderArguments and
+  the frames are written on its standard input, as raw RGBA pixels (4 bytes
+  per pixel, top row first), that can for instance be encoded by \c ffmpeg
+  (see the Detailed description section).
+
+  The application does not process events during offline replay. Animations
+  driven by a \c QTimer (spinning frames for instance) are only reproduced
+  when they were recorded with recordFrameState(). */
+bool EventRecorder::replayOffline(const QString &encoderProgram,
+                                  const QStringList &encoderArguments) {
+  if (isRecording() || (eventIndex_ == 0) || !startReplay())
+    return false;
+
+  Viewer *const viewer = qglviewer();
+  const int width = viewer->width();
+  const int height = viewer->height();
+
+  QProcess encoder;
+  bool encoderIsRunning = !encoderProgram.isEmpty();
+  if (encoderIsRunning) {
+    encoder.start(encoderProgram, encoderArguments, QIODevice::WriteOnly);
+    if (!encoder.waitForStarted()) {
+      QMessageBox::warning(viewer, "Encoder error",
+                           "Unable to start " + encoderProgram + ":\n" +
+                               encoder.errorString());
+      return false;
     }
-  } else
-    QTimer::singleShot(eventRecords_[nextReplayEvent_].time, this,
-                       SLOT(triggerNextEvent()));
+  }
 
-  time_.start();
+  viewer->makeCurrent();
+  QOpenGLFramebufferObjectFormat format;
+  format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  format.setSamples(viewer->format().samples());
+  QOpenGLFramebufferObject fbo(width, height, format);
+  if (!fbo.isValid()) {
+    qWarning("EventRecorder::replayOffline: unable to create a %dx%d "
+             "framebuffer object",
+             width, height);
+    return false;
+  }
+  fbo.bind();
+  viewer->resizeGL(width, height);
+
+  // Bounds the memory used by the frames waiting to be read by the encoder
+  const qint64 maxPendingBytes = 4 * qint64(width) * height * 4;
+
+  bool success = true;
+  for (int frame = 0;; ++frame) {
+    const int time = int(frame * 1000.0 / snapshotFrameRate());
+    if (time > recordDuration_)
+      break;
+
+    while (((stream_) || (nextReplayEvent_ < eventIndex_)) &&
+           (nextEvent().time <= time) && (nextEvent().time <= recordDuration_))
+      replayNextEvent();
+
+    fbo.bind();
+    viewer->paintGL();
+    const QImage image = fbo.toImage();
+    Q_EMIT offlineFrameRendered(image, time);
+
+    if (encoderIsRunning) {
+      const QImage pixels = image.convertToFormat(QImage::Format_RGBA8888);
+      encoder.write((const char *)pixels.constBits(),
+                    qint64(pixels.bytesPerLine()) * pixels.height());
+      while (encoderIsRunning && (encoder.bytesToWrite() > maxPendingBytes))
+        encoderIsRunning = encoder.waitForBytesWritten(-1);
+      if (!encoderIsRunning) {
+        qWarning("EventRecorder::replayOffline: encoder stopped at frame %d",
+                 frame);
+        success = false;
+        break;
+      }
+    }
+
+    // An interrupted stream ends with its last event
+    if ((recordDuration_ == interruptedStreamDuration) &&
+        (nextEvent().time > recordDuration_))
+      break;
+  }
+
+  fbo.release();
+  viewer->resizeGL(viewer->width(), viewer->height());
+
+  if (!encoderProgram.isEmpty()) {
+    encoder.closeWriteChannel();
+    encoder.waitForFinished(-1);
+    if ((encoder.exitStatus() != QProcess::NormalExit) ||
+        (encoder.exitCode() != 0))
+      success = false;
+  }
+
+  viewer->updateGL();
+  return success;
 }
 
 void EventRecorder::saveNumberedSnapshot() const {
@@ -712,13 +950,13 @@ void EventRecorder::triggerNextEvent() {
   // Speed
 
   int nextTime;
-  if ((eventRecords_[nextReplayEvent_].time > nextSnapshotTime_) &&
+  if ((nextEvent().time > nextSnapshotTime_) &&
       savesSnapshots() && saveAtGivenFrameRate()) {
     nextEventIsSaveSnapshot_ = true;
     nextTime = nextSnapshotTime_;
   } else {
     nextEventIsSaveSnapshot_ = false;
-    nextTime = eventRecords_[nextReplayEvent_].time;
+    nextTime = nextEvent().time;
   }
 
   if (nextTime <= recordDuration_)
@@ -742,55 +980,304 @@ void EventRecorder::replayNextEvent() {
     qglviewer()->saveSnapshot(true, true);
     nextSnapshotTime_ += 1000 / snapshotFrameRate();
   } else {
-    switch (eventRecords_[nextReplayEvent_].type) {
+    Event &event = nextEvent();
+    switch (event.type) {
     case QEvent::KeyPress:
-      qglviewer()->keyPressEvent(
-          eventRecords_[nextReplayEvent_].event.keyEvent);
+      qglviewer()->keyPressEvent(event.event.keyEvent);
       break;
     case QEvent::KeyRelease:
-      qglviewer()->keyReleaseEvent(
-          eventRecords_[nextReplayEvent_].event.keyEvent);
+      qglviewer()->keyReleaseEvent(event.event.keyEvent);
       break;
     case QEvent::MouseButtonPress:
-      qglviewer()->mousePressEvent(
-          eventRecords_[nextReplayEvent_].event.mouseEvent);
+      qglviewer()->mousePressEvent(event.event.mouseEvent);
       break;
     case QEvent::MouseButtonRelease:
-      qglviewer()->mouseReleaseEvent(
-          eventRecords_[nextReplayEvent_].event.mouseEvent);
+      qglviewer()->mouseReleaseEvent(event.event.mouseEvent);
       break;
     case QEvent::MouseButtonDblClick:
-      qglviewer()->mouseDoubleClickEvent(
-          eventRecords_[nextReplayEvent_].event.mouseEvent);
+      qglviewer()->mouseDoubleClickEvent(event.event.mouseEvent);
       break;
     case QEvent::MouseMove:
-      qglviewer()->mouseMoveEvent(
-          eventRecords_[nextReplayEvent_].event.mouseEvent);
+      qglviewer()->mouseMoveEvent(event.event.mouseEvent);
       break;
     case QEvent::Wheel:
-      qglviewer()->wheelEvent(eventRecords_[nextReplayEvent_].event.wheelEvent);
+      qglviewer()->wheelEvent(event.event.wheelEvent);
       break;
     case QEvent::Timer:
       qglviewer()->animate();
       qglviewer()->updateGL();
       break;
     case QEvent::MaxUser: // Actually means Frame state
-      eventRecords_[nextReplayEvent_].event.frameState->frame->setPosition(
-          eventRecords_[nextReplayEvent_]
-              .event.frameState->state.translation());
-      eventRecords_[nextReplayEvent_].event.frameState->frame->setOrientation(
-          eventRecords_[nextReplayEvent_].event.frameState->state.rotation());
+      event.event.frameState->frame->setPosition(
+          event.event.frameState->state.translation());
+      event.event.frameState->frame->setOrientation(
+          event.event.frameState->state.rotation());
       qglviewer()->updateGL();
       break;
     case QEvent::User:
-      Q_EMIT replayCustomEvent(
-          (int)(eventRecords_[nextReplayEvent_].event.frameState));
+      Q_EMIT replayCustomEvent((int)(event.event.frameState));
+      break;
+    case QEvent::None: // Frame state of a missing Frame in an event stream
       break;
     default:
-      qWarning("Unknown event type " +
-               QString::number(eventRecords_[nextReplayEvent_].type));
+      qWarning("Unknown event type " + QString::number(event.type));
       break;
     }
     nextReplayEvent_++;
+
+    // The end of the stream is after the end of the record
+    if (stream_ && !readStreamRecord())
+      streamedEvent_.time = recordDuration_ + 1;
+  }
+}
+
+/*! Loads an event stream recorded with an eventStreamFileName(). The next
+  replay() calls will read the events from this file, one at a time, instead
+  of replaying the events recorded in memory. Returns \c false when \p filename
+  is not a valid event stream.
+
+  A stream whose recording was interrupted (the application crashed for
+  instance) can still be replayed, up to its last complete event. Use
+  loadEventRecord() to replay an XML event record again. */
+bool EventRecorder::loadEventStream(const QString &filename) {
+  closeEventStream();
+
+  streamFile_ = new QFile(filename);
+  if (!streamFile_->open(IO_ReadOnly)) {
+    QMessageBox::warning(qglviewer(), "Open file error",
+                         "Unable to open file " + filename + ":\n" +
+                             streamFile_->errorString());
+    closeEventStream();
+    return false;
+  }
+
+  stream_ = new QDataStream(streamFile_);
+  streamIsRecorded_ = false;
+
+  quint32 magic;
+  quint16 version;
+  qint32 duration, nbEvents, width, height;
+  *stream_ >> magic >> version >> duration >> nbEvents >> width >> height;
+  if ((stream_->status() != QDataStream::Ok) || (magic != streamMagic) ||
+      (version > streamVersion)) {
+    qWarning("EventRecorder::loadEventStream: " + filename +
+             " is not a valid event stream");
+    closeEventStream();
+    return false;
+  }
+  initialCameraFrame_.readBinary(*stream_);
+  initialManipulatedFrame_.readBinary(*stream_);
+  streamEventsStart_ = streamFile_->pos();
+
+  viewerWidth_ = width;
+  viewerHeight_ = height;
+  eventIndex_ = nbEvents;
+  // An interrupted recording has no duration: replayed up to the end of file
+  recordDuration_ = (duration > 0) ? duration : interruptedStreamDuration;
+  return true;
+}
+
+// Returns the next event to replay, from the event stream or from the
+// in-memory record.
+EventRecorder::Event &EventRecorder::nextEvent() {
+  if (stream_)
+    return streamedEvent_;
+  return eventRecords_[nextReplayEvent_];
+}
+
+// Closes the recorded or replayed event stream, if any.
+void EventRecorder::closeEventStream() {
+  deleteStreamedEvent();
+  delete stream_;
+  stream_ = NULL;
+  delete streamFile_; // Also closes the file
+  streamFile_ = NULL;
+}
+
+// Writes the header of a recorded stream. The duration and the number of
+// events are unknown until stopRecording().
+void EventRecorder::writeStreamHeader() {
+  *stream_ << streamMagic << streamVersion << qint32(0) << qint32(0)
+           << qint32(viewerWidth_) << qint32(viewerHeight_);
+  initialCameraFrame_.writeBinary(*stream_);
+  initialManipulatedFrame_.writeBinary(*stream_);
+
+  streamTime_ = 0;
+  streamNbEvents_ = 0;
+  lastKeyPressRecord_ = -1;
+  frameStatesAreValid_[0] = frameStatesAreValid_[1] = false;
+}
+
+// Starts a new record of the recorded stream, whose payload is written by the
+// caller. Times are stored as a difference with the previous record.
+void EventRecorder::writeStreamRecord(QEvent::Type type, int time) {
+  const int elapsed = time - streamTime_;
+  *stream_ << quint16(type);
+  if ((elapsed >= 0) && (elapsed < streamLongTime))
+    *stream_ << quint16(elapsed);
+  else
+    *stream_ << streamLongTime << qint32(time);
+
+  streamTime_ = time;
+  streamNbEvents_++;
+  lastKeyPressRecord_ = -1;
+}
+
+// Frame states are delta compressed: a mask indicates which of the position
+// and orientation values changed since the previous state of the same Frame,
+// and only these values are written.
+void EventRecorder::writeStreamFrameState(Frame *const frame, int time) {
+  quint8 id;
+  if (frame == qglviewer()->camera()->frame())
+    id = 0;
+  else if ((frame == qglviewer()->manipulatedFrame()) &&
+           (qglviewer()->manipulatedFrame()))
+    id = 1;
+  else {
+    qWarning("Unable to record the state of an unknown Frame");
+    return;
+  }
+
+  const Vec pos = frame->position();
+  const Quaternion q = frame->orientation();
+  const float values[7] = {float(pos.x), float(pos.y), float(pos.z), float(q[0]),
+                           float(q[1]),  float(q[2]),  float(q[3])};
+
+  quint8 mask = 0;
+  for (int i = 0; i < 7; ++i)
+    if (!frameStatesAreValid_[id] || (values[i] != frameStates_[id][i]))
+      mask |= 1 << i;
+
+  writeStreamRecord(QEvent::MaxUser, time);
+  *stream_ << id << mask;
+  for (int i = 0; i < 7; ++i)
+    if (mask & (1 << i)) {
+      *stream_ << values[i];
+      frameStates_[id][i] = values[i];
+    }
+  frameStatesAreValid_[id] = true;
+}
+
+// Reads the next record of the replayed stream in streamedEvent_. Returns
+// false at the end of the stream (or of the record).
+bool EventRecorder::readStreamRecord() {
+  deleteStreamedEvent();
+
+  if ((recordDuration_ < interruptedStreamDuration) && (streamNbEvents_ >= eventIndex_))
+    return false;
+
+  quint16 type, elapsed;
+  *stream_ >> type >> elapsed;
+  if (elapsed == streamLongTime) {
+    qint32 time;
+    *stream_ >> time;
+    streamTime_ = time;
+  } else
+    streamTime_ += elapsed;
+
+  streamedEvent_.type = QEvent::Type(type);
+  streamedEvent_.time = streamTime_;
+
+  switch (streamedEvent_.type) {
+  case QEvent::KeyPress:
+  case QEvent::KeyRelease: {
+    qint32 key, ascii, state;
+    *stream_ >> key >> ascii >> state;
+    streamedEvent_.event.keyEvent =
+        new QKeyEvent(streamedEvent_.type, key, ascii, state);
+    break;
+  }
+  case QEvent::MouseButtonPress:
+  case QEvent::MouseButtonRelease:
+  case QEvent::MouseButtonDblClick:
+  case QEvent::MouseMove: {
+    qint16 posx, posy;
+    quint8 button;
+    qint32 state;
+    *stream_ >> posx >> posy >> button >> state;
+    streamedEvent_.event.mouseEvent = new QMouseEvent(
+        streamedEvent_.type, QPoint(posx, posy), button, state);
+    break;
+  }
+  case QEvent::Wheel: {
+    qint16 posx, posy, delta;
+    qint32 state;
+    *stream_ >> posx >> posy >> delta >> state;
+    streamedEvent_.event.wheelEvent =
+        new QWheelEvent(QPoint(posx, posy), delta, state);
+    break;
+  }
+  case QEvent::Timer:
+    break;
+  case QEvent::MaxUser: // Actually means Frame state
+  {
+    quint8 id, mask;
+    *stream_ >> id >> mask;
+    if (id > 1)
+      id = 1;
+    for (int i = 0; i < 7; ++i)
+      if (mask & (1 << i))
+        *stream_ >> frameStates_[id][i];
+
+    Frame *frame = (id == 0) ? qglviewer()->camera()->frame()
+                             : qglviewer()->manipulatedFrame();
+    if (!frame) {
+      qWarning("Unable to affect Frame state event record");
+      streamedEvent_.type = QEvent::None; // Skipped by replayNextEvent()
+      break;
+    }
+    const float *const v = frameStates_[id];
+    streamedEvent_.event.frameState = new EventRecorder::FrameState(frame);
+    streamedEvent_.event.frameState->state.setTranslation(Vec(v[0], v[1], v[2]));
+    streamedEvent_.event.frameState->state.setRotation(
+        Quaternion(v[3], v[4], v[5], v[6]));
+    break;
+  }
+  case QEvent::User: {
+    qint32 id;
+    *stream_ >> id;
+    streamedEvent_.event.frameState = (FrameState *)(id);
+    break;
+  }
+  default:
+    qWarning("Unknown event type " + QString::number(type));
+    break;
+  }
+
+  if (stream_->status() != QDataStream::Ok) {
+    // End of an interrupted recording
+    deleteStreamedEvent();
+    recordDuration_ = streamTime_;
+    eventIndex_ = streamNbEvents_;
+    return false;
+  }
+
+  streamNbEvents_++;
+  return true;
+}
+
+// Deletes the event allocated by readStreamRecord().
+void EventRecorder::deleteStreamedEvent() {
+  switch (streamedEvent_.type) {
+  case QEvent::KeyPress:
+  case QEvent::KeyRelease:
+    delete streamedEvent_.event.keyEvent;
+    break;
+  case QEvent::MouseButtonPress:
+  case QEvent::MouseButtonRelease:
+  case QEvent::MouseButtonDblClick:
+  case QEvent::MouseMove:
+    delete streamedEvent_.event.mouseEvent;
+    break;
+  case QEvent::Wheel:
+    delete streamedEvent_.event.wheelEvent;
+    break;
+  case QEvent::MaxUser:
+    delete streamedEvent_.event.frameState;
+    break;
+  default:
+    break;
   }
+  streamedEvent_.type = QEvent::None;
+  streamedEvent_.event.keyEvent = NULL;
 }
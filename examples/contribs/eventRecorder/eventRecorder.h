@@ -5,9 +5,13 @@
 
 #include <qdatetime.h>
 #include <qevent.h>
+#include <qstringlist.h>
 
 class Viewer;
 class ReplayInterface;
+class QDataStream;
+class QFile;
+class QImage;
 
 /*! \brief A QGLViewer event recorder, that allows for scenario recording and
  replay.
@@ -40,6 +44,15 @@ class ReplayInterface;
  save and load recorded events, and replay() the recorded events, with an
  optional snapshot saving.
 
+ <h3>Event streams</h3>
+
+ Long recordings can be streamed to disk instead of being kept in memory: when
+ an eventStreamFileName() is defined, the events are appended to this file as
+ soon as they are recorded, in a compact binary format where Frame states only
+ store the values that changed since the previous state of the same Frame. Use
+ loadEventStream() to replay such a file: the events are then read one at a
+ time during replay().
+
  Note that interaction with the viewer is still possible during and between
  replay(). This can be used to change the display mode during or between
  replay(), in order to generate several renderings of a given scenario.
@@ -62,6 +75,21 @@ class ReplayInterface;
  movie.avi -H 0 \endcode Replace \c 720x576 by your actual snapshot size, and 25
  by the frame rate you want. See the transcode man page for details.
 
+ <h3>Offline replay</h3>
+
+ replayOffline() renders the scenario in an offscreen framebuffer object, as
+ fast as possible, without any timer: the events are replayed according to
+ their recorded time, and a frame is rendered every 1/snapshotFrameRate()
+ second of the scenario. A 10 minutes scenario hence no longer needs 10 minutes
+ to be converted into a movie. The raw frames are sent to an encoder process
+ and to the offlineFrameRendered() signal:
+ \code
+ QStringList arguments;
+ arguments << "-y" << "-f" << "rawvideo" << "-pix_fmt" << "rgba" << "-s"
+           << "720x576" << "-r" << "25" << "-i" << "-" << "movie.mp4";
+ viewer->eventRecorder()->replayOffline("ffmpeg", arguments);
+ \endcode
+
  \nosubgrouping */
 class EventRecorder : public QObject {
 #ifndef DOXYGEN
@@ -85,11 +113,33 @@ public Q_SLOTS:
   void toggleRecording();
 
   void replay();
+  bool replayOffline(const QString &encoderProgram = "",
+                     const QStringList &encoderArguments = QStringList());
   void openReplayInterfaceWindow();
   void saveEventRecord(const QString &filename = "") const;
   void loadEventRecord(const QString &filename = "");
   //@}
 
+  /*! @name Event streams */
+  //@{
+public:
+  /*! Returns the name of the file in which the events are streamed during
+    recording. Default value is an empty string, meaning that the events are
+    recorded in memory (and can then be saved with saveEventRecord()).
+
+    When defined, startRecording() creates this file and the events are
+    appended to it one by one. stopRecording() completes the file, which can
+    then be replayed with loadEventStream(). */
+  QString eventStreamFileName() const { return eventStreamFileName_; };
+
+public Q_SLOTS:
+  /*! Sets the eventStreamFileName(). Only used by the next startRecording(). */
+  void setEventStreamFileName(const QString &filename) {
+    eventStreamFileName_ = filename;
+  };
+  bool loadEventStream(const QString &filename);
+  //@}
+
   /*! @name Replay parameters */
   //@{
 public:
@@ -207,6 +257,15 @@ Q_SIGNALS:
     by the slot to select which custom event to reproduce. */
   void replayCustomEvent(int id);
 
+  /*! This signal is emitted by replayOffline() after each rendered \p image.
+    \p time is the time of the scenario represented by \p image, in
+    milliseconds. Connect this signal to a frame sink (with a direct
+    connection) to process the frames as they are rendered.
+
+    The image is rendered in an offscreen framebuffer object. Text drawn with a
+    \c QPainter (see QGLViewer::drawText()) is hence missing. */
+  void offlineFrameRendered(const QImage &image, int time);
+
 public Q_SLOTS:
   void recordFrameState();
   void recordCustomEvent(int id = 0);
@@ -224,6 +283,7 @@ private Q_SLOTS:
 private:
   Viewer *const qglviewer() const { return qglviewer_; };
   int predefinedFormat();
+  bool startReplay();
   void replayNextEvent();
 
   class FrameState {
@@ -248,6 +308,14 @@ private:
     int time;
   };
 
+  Event &nextEvent();
+  void closeEventStream();
+  void writeStreamHeader();
+  void writeStreamRecord(QEvent::Type type, int time);
+  void writeStreamFrameState(qglviewer::Frame *const frame, int time);
+  bool readStreamRecord();
+  void deleteStreamedEvent();
+
   struct PredefinedSettings {
     PredefinedSettings(){};
     PredefinedSettings(int w, int h, int fr)
@@ -290,5 +358,18 @@ private:
   // R e p l a y   i n t e r f a c e
   ReplayInterface *replayInterface_;
   int originalWidth_, originalHeight_;
+
+  // E v e n t   s t r e a m
+  QString eventStreamFileName_;
+  QFile *streamFile_;     // NULL when the events are recorded in memory
+  QDataStream *stream_;   // writes while recording, reads during replay
+  bool streamIsRecorded_; // false when the stream is replayed
+  int streamTime_;        // time of the last written or read record
+  int streamNbEvents_;
+  qint64 streamEventsStart_;  // file position of the first record
+  qint64 lastKeyPressRecord_; // file position of the last KeyPress, or -1
+  float frameStates_[2][7];   // last camera and manipulatedFrame states
+  bool frameStatesAreValid_[2];
+  Event streamedEvent_; // next event to replay from the stream
 };
 #endif // EVENT_RECORDER_H
@@ -39,6 +39,9 @@ class GLViewPieces : public GLView {
 public:
   GLViewPieces(QWidget *parent) : GLView(parent) {}
 
+  // Selectionne la piece donnee a l'adversaire, comme un clic
+  void selectPiece(int piece) { applySelection(piece); }
+
 protected:
   virtual void draw();
   virtual void init();
@@ -59,6 +62,9 @@ public:
   ~GLViewJeu() { glDeleteLists(plateau, 1); }
 
   void reset() { jeu.init(); }
+  Jeu *getJeu() { return &jeu; }
+  // Place la piece selectionnee, comme un clic
+  void placeSelectedPiece(int select) { applySelection(select); }
 
 protected:
   virtual void draw();
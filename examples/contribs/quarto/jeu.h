@@ -2,6 +2,7 @@
 #define JEU_H
 
 #include "piece.h"
+#include "solver.h"
 
 struct cell {
   bool empty;
@@ -11,9 +12,14 @@ struct cell {
 class Jeu {
 protected:
   struct cell tab[16];
+  // Le meme plateau pour le Solver : le numero de la piece de chaque case
+  // dans un quartet, et le masque des cases occupees
+  quint64 cells;
+  int occupied;
+  Solver solver;
 
 public:
-  Jeu() {}
+  Jeu() { init(); }
   ~Jeu() {}
 
   void init() {
@@ -21,11 +27,18 @@ public:
       tab[i].empty = true;
       tab[i].piece = NULL;
     }
+    cells = 0;
+    occupied = 0;
   }
   bool needDrawing(int);
   void placePiece(int, Piece *);
-  bool caracCommune(Piece *pieces[4]);
   bool analyze();
+  // Vrai ssi toutes les cases sont occupees
+  bool isFull() const { return occupied == 0xFFFF; }
+  // Le meilleur coup pour la piece numero given (voir Solver::bestMove())
+  Solver::Move bestMove(int given, int maximumEmptyCells = 8) {
+    return solver.bestMove(cells, occupied, given, maximumEmptyCells);
+  }
 };
 
 #endif // JEU_H
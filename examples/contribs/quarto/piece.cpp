@@ -1,10 +1,28 @@
 #include "piece.h"
-
-#ifdef Q_OS_MAC
-#include <OpenGL/glu.h>
-#else
-#include <GL/glu.h>
-#endif
+#include "pieceMesh.h"
+
+/*
+ * Maillages des pieces, construits une seule fois et partages par toutes les
+ * pieces, l'affichage et la selection
+ */
+static const PieceMesh &meshOf(bool forme, bool taille, bool trou) {
+  static PieceMesh meshes[8];
+  PieceMesh &mesh = meshes[4 * forme + 2 * taille + trou];
+  if (mesh.isEmpty()) {
+    const float hauteur = 3 + 2 * taille;
+    if (forme)
+      mesh.addBox(-1.0, -1.0, 0.0, 1.0, 1.0, hauteur);
+    else {
+      // Corps du cylindre, disques inferieur et superieur
+      mesh.addCylinder(1.0, 0.0, hauteur, 20);
+      mesh.addDisk(0.0, 1.0, 0.0, 20, false);
+      mesh.addDisk(0.0, 1.0, hauteur, 20, true);
+    }
+    if (trou)
+      mesh.addSphere(0.8, 3.1 + 2 * taille, 20, 20);
+  }
+  return mesh;
+}
 
 SetOfPiece::SetOfPiece() {
   selected = -1;
@@ -79,10 +97,8 @@ void Piece::paint(bool fen) {
   glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, shininess);
 
   // On dessine la piece en fonction de sa forme
-  if (forme)
-    drawRectangle();
-  else
-    drawCylinder();
+  glBindTexture(GL_TEXTURE_2D, texture);
+  meshOf(forme, taille, trou).draw();
   // Si la piece est selectionnee et que l'on est dans la bonne fenetre, on
   // place une boite autour
   if (selected && !fenetre)
@@ -116,131 +132,3 @@ void Piece::drawBoite() {
   glEnable(GL_LIGHTING);
   glEnable(GL_TEXTURE_2D);
 }
-
-void Piece::drawBoule() {
-  float hauteur = 3.1 + 2 * taille;
-  static GLUquadricObj *obj = gluNewQuadric();
-  gluQuadricDrawStyle(obj, GLU_FILL);
-  gluQuadricNormals(obj, GLU_SMOOTH);
-  gluQuadricTexture(obj, GLU_TRUE);
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  glPushMatrix();
-  glTranslatef(0., 0., hauteur);
-  gluSphere(obj, 0.8, 20, 20);
-  glPopMatrix();
-}
-
-void Piece::drawRectangle() {
-  int hauteur = 3 + 2 * taille;
-  if (trou)
-    drawBoule();
-
-  glPushMatrix();
-  glTranslatef(-1.0, -1.0, 0.0);
-  // orientation des polygones pour cull face
-  glFrontFace(GL_CW);
-  // dessous de la piece
-  glNormal3d(0, 0, -1);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2i(0, 0);
-  glVertex3i(0, 0, 0);
-  glTexCoord2i(1, 0);
-  glVertex3i(2, 0, 0);
-  glTexCoord2i(0, 1);
-  glVertex3i(0, 2, 0);
-  glTexCoord2i(1, 1);
-  glVertex3i(2, 2, 0);
-  glEnd();
-  // cote droit
-  glNormal3d(0, 1, 0);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2f(0, 0);
-  glVertex3i(0, 2, 0);
-  glTexCoord2f(0.25, 0);
-  glVertex3i(2, 2, 0);
-  glTexCoord2f(0, 1);
-  glVertex3i(0, 2, hauteur);
-  glTexCoord2f(0.25, 1);
-  glVertex3i(2, 2, hauteur);
-  glEnd();
-  // derriere
-  glNormal3d(-1, 0, 0);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2f(0.75, 0);
-  glVertex3i(0, 0, 0);
-  glTexCoord2f(1, 0);
-  glVertex3i(0, 2, 0);
-  glTexCoord2f(0.75, 1);
-  glVertex3i(0, 0, hauteur);
-  glTexCoord2f(1, 1);
-  glVertex3i(0, 2, hauteur);
-  glEnd();
-
-  // orientation des polygones pour cull face
-  glFrontFace(GL_CCW);
-  // dessus de la piece
-  glNormal3d(0, 0, 1);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2f(0, 0);
-  glVertex3i(0, 0, hauteur);
-  glTexCoord2f(1, 0);
-  glVertex3i(2, 0, hauteur);
-  glTexCoord2f(0, 1);
-  glVertex3i(0, 2, hauteur);
-  glTexCoord2f(1, 1);
-  glVertex3i(2, 2, hauteur);
-  glEnd();
-  // cote gauche
-  glNormal3d(0, -1, 0);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2f(0.25, 0);
-  glVertex3i(0, 0, 0);
-  glTexCoord2f(0.5, 0);
-  glVertex3i(2, 0, 0);
-  glTexCoord2f(0.25, 1);
-  glVertex3i(0, 0, hauteur);
-  glTexCoord2f(0.5, 1);
-  glVertex3i(2, 0, hauteur);
-  glEnd();
-  // devant
-  glNormal3d(1, 0, 0);
-  glBegin(GL_QUAD_STRIP);
-  glTexCoord2f(0.5, 0);
-  glVertex3i(2, 0, 0);
-  glTexCoord2f(0.75, 0);
-  glVertex3i(2, 2, 0);
-  glTexCoord2f(0.5, 1);
-  glVertex3i(2, 0, hauteur);
-  glTexCoord2f(0.75, 1);
-  glVertex3i(2, 2, hauteur);
-  glEnd();
-
-  glPopMatrix();
-}
-
-void Piece::drawCylinder() {
-  int hauteur = 3 + 2 * taille;
-  if (trou)
-    drawBoule();
-
-  GLUquadricObj *obj;
-  obj = gluNewQuadric();
-  gluQuadricDrawStyle(obj, GLU_FILL);
-  gluQuadricNormals(obj, GLU_SMOOTH);
-  gluQuadricTexture(obj, GLU_TRUE);
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  // Corps du cylindre
-  gluCylinder(obj, 1., 1., hauteur, 20, 1);
-  // Disque inferieur
-  gluQuadricOrientation(obj, GLU_INSIDE);
-  gluDisk(obj, 0., 1., 20, 1);
-  // Disque superieur
-  glPushMatrix();
-  glTranslatef(0., 0., hauteur);
-  gluQuadricOrientation(obj, GLU_OUTSIDE);
-  gluDisk(obj, 0., 1., 20, 1);
-  glPopMatrix();
-  gluDeleteQuadric(obj);
-}
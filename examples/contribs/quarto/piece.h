@@ -23,10 +23,7 @@ private:
   GLfloat shininess;
   GLuint texture;
 
-  void drawRectangle();
-  void drawCylinder();
   void drawBoite();
-  void drawBoule();
 
 public:
   Piece(int, bool, bool, bool, bool, double, double);
@@ -65,6 +62,7 @@ public:
   void setTexture(GLuint);
   void placeSelectedPiece(int);
   Piece *getPiece() { return tab[selected]; }
+  int getSelected() const { return selected; }
 };
 
 #endif // PIECE_H
@@ -1,6 +1,7 @@
 #include "quarto.h"
 
 #include <qapplication.h>
+#include <qcheckbox.h>
 #include <qdialog.h>
 #include <qframe.h>
 #include <qgroupbox.h>
@@ -8,6 +9,7 @@
 #include <qlayout.h>
 #include <qmessagebox.h>
 #include <qpushbutton.h>
+#include <qtimer.h>
 #include <qtooltip.h>
 #include <qvariant.h>
 #include <qwidget.h>
@@ -88,6 +90,10 @@ Quarto::Quarto(QWidget *parent) : QMainWindow(parent) {
   NomLabel_font.setPointSize(14);
   NomLabel->setFont(NomLabel_font);
   HLayout2->addWidget(NomLabel);
+  // Le joueur 2 est joue par l'ordinateur
+  OrdinateurCheckBox = new QCheckBox(privateLayoutWidget);
+  OrdinateurCheckBox->setText(trUtf8("Computer"));
+  HLayout2->addWidget(OrdinateurCheckBox);
 
   VLayout2->addLayout(HLayout2);
 
@@ -141,7 +147,10 @@ Quarto::Quarto(QWidget *parent) : QMainWindow(parent) {
   connect(vuePlateau, SIGNAL(piecePlacee()), this, SLOT(piecePlacee()));
   connect(vuePieces, SIGNAL(changeJoueur()), this, SLOT(changeTour()));
   connect(vuePlateau, SIGNAL(endGame()), this, SLOT(finDeJeu()));
+  connect(OrdinateurCheckBox, SIGNAL(toggled(bool)), this,
+          SLOT(ordinateurJoue()));
   // On initialise l'interface
+  partie = 0;
   init(true);
 }
 
@@ -163,6 +172,7 @@ void Quarto::init(bool begin) {
   NomLabel->setText(trUtf8("Player 1"));
   joueur = true;
   pieceplacee = true;
+  ++partie;
 }
 
 void Quarto::New() {
@@ -182,6 +192,9 @@ void Quarto::changeTour() {
       NomLabel->setText(trUtf8("Player 1"));
     joueur = !joueur;
     pieceplacee = false;
+    // Apres l'affichage de la piece choisie par le joueur 1
+    if (!joueur && OrdinateurCheckBox->isChecked())
+      QTimer::singleShot(0, this, SLOT(ordinateurJoue()));
   }
 }
 
@@ -193,3 +206,20 @@ void Quarto::finDeJeu() {
   else
     Exit();
 }
+
+// L'ordinateur place la piece choisie par le joueur 1, puis lui choisit une
+// piece. Le Solver joue parfaitement a partir de huit cases vides.
+void Quarto::ordinateurJoue() {
+  if (joueur || pieceplacee || !OrdinateurCheckBox->isChecked())
+    return;
+  Jeu *jeu = vuePlateau->getJeu();
+  const Solver::Move coup = jeu->bestMove(setofpiece->getSelected());
+  if (coup.cell < 0)
+    return;
+  const int partieCourante = partie;
+  vuePlateau->placeSelectedPiece(coup.cell);
+  // La partie est terminee, et peut-etre deja recommencee par finDeJeu()
+  if ((partie != partieCourante) || (coup.nextPiece < 0))
+    return;
+  vuePieces->selectPiece(coup.nextPiece);
+}
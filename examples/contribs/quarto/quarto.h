@@ -13,6 +13,7 @@ class QGridLayout;
 class QPopupMenu;
 class QFrame;
 class QGroupBox;
+class QCheckBox;
 class QLabel;
 class QPushButton;
 class QWidget;
@@ -35,6 +36,7 @@ public:
   QGroupBox *GameGroupBox;
   QLabel *TourDeJeuLabel, *NomLabel;
   QPushButton *ResetButton, *QuitButton;
+  QCheckBox *OrdinateurCheckBox;
   QPopupMenu *GagnantPopUp;
 
 public Q_SLOTS:
@@ -43,6 +45,7 @@ public Q_SLOTS:
   virtual void changeTour();
   virtual void piecePlacee();
   virtual void finDeJeu();
+  virtual void ordinateurJoue();
 
 Q_SIGNALS:
   void updategl();
@@ -53,6 +56,8 @@ protected:
 
   bool joueur;
   bool pieceplacee;
+  // Incremente a chaque nouvelle partie
+  int partie;
   int width, height;
   GLViewJeu *vuePlateau;
   GLViewPieces *vuePieces;
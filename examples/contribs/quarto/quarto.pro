@@ -7,8 +7,13 @@
 TEMPLATE = app
 TARGET   = quarto
 
-HEADERS	+= glview.h jeu.h piece.h quarto.h
-SOURCES	+= glview.cpp jeu.cpp piece.cpp quarto.cpp main.cpp
+HEADERS	+= glview.h jeu.h piece.h quarto.h solver.h
+SOURCES	+= glview.cpp jeu.cpp piece.cpp quarto.cpp solver.cpp main.cpp
+
+# Piece meshes shared with the other board games
+INCLUDEPATH *= ../common
+HEADERS += ../common/pieceMesh.h
+SOURCES += ../common/pieceMesh.cpp
 
 DISTFILES += bois.jpg rules.txt
 
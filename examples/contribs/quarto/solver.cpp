@@ -0,0 +1,303 @@
+#include "solver.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QtAlgorithms>
+#include <algorithm>
+
+// Transposition table entries, a power of 2
+static const int tableSize = 1 << 20;
+static const quint32 validEntry = 1u << 31;
+// Placements searched in the positions that are not solved
+static const int shallowDepth = 3;
+
+// The 4 rows, the 4 columns and the 2 diagonals
+static const int lines[10][4] = {
+    {0, 1, 2, 3},   {4, 5, 6, 7},   {8, 9, 10, 11}, {12, 13, 14, 15},
+    {0, 4, 8, 12},  {1, 5, 9, 13},  {2, 6, 10, 14}, {3, 7, 11, 15},
+    {0, 5, 10, 15}, {3, 6, 9, 12}};
+
+static int lineMask(int line) {
+  int mask = 0;
+  for (int i = 0; i < 4; ++i)
+    mask |= 1 << lines[line][i];
+  return mask;
+}
+
+static int firstCell(int mask) {
+  return int(qCountTrailingZeroBits(uint(mask)));
+}
+
+static int pieceAt(quint64 cells, int cell) {
+  return int((cells >> (4 * cell)) & 0xF);
+}
+
+static quint64 place(quint64 cells, int cell, int piece) {
+  return cells | (quint64(piece) << (4 * cell));
+}
+
+// Mask of the pieces already on the board
+static int placedPieces(quint64 cells, int occupied) {
+  int placed = 0;
+  for (int o = occupied; o; o &= o - 1)
+    placed |= 1 << pieceAt(cells, firstCell(o));
+  return placed;
+}
+
+// SplitMix64 finalizer
+static quint64 mix(quint64 x) {
+  x += Q_UINT64_C(0x9E3779B97F4A7C15);
+  x = (x ^ (x >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+  x = (x ^ (x >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+  return x ^ (x >> 31);
+}
+
+class CandidateSearch : public QRunnable {
+public:
+  CandidateSearch(Solver *solver, int index)
+      : solver_(solver), index_(index) {}
+  virtual void run() { solver_->searchCandidate(index_); }
+
+private:
+  Solver *solver_;
+  int index_;
+};
+
+Solver::Solver() : table_(tableSize) {
+  // The permutations of the rows and of the columns, possibly followed by a
+  // transposition, that map each line onto a line.
+  int order[4] = {0, 1, 2, 3};
+  int rows[24][4], nbOrders = 0;
+  do {
+    for (int i = 0; i < 4; ++i)
+      rows[nbOrders][i] = order[i];
+    ++nbOrders;
+  } while (std::next_permutation(order, order + 4));
+
+  int nbSymmetries = 0;
+  for (int r = 0; r < nbOrders; ++r)
+    for (int c = 0; c < nbOrders; ++c)
+      for (int transpose = 0; transpose < 2; ++transpose) {
+        int permutation[16];
+        for (int cell = 0; cell < 16; ++cell) {
+          const int row = rows[r][cell / 4], column = rows[c][cell % 4];
+          permutation[cell] = transpose ? column * 4 + row : row * 4 + column;
+        }
+        bool preservesLines = true;
+        for (int l = 0; preservesLines && l < 10; ++l) {
+          int mask = 0;
+          for (int i = 0; i < 4; ++i)
+            mask |= 1 << permutation[lines[l][i]];
+          preservesLines = false;
+          for (int m = 0; m < 10; ++m)
+            if (mask == lineMask(m))
+              preservesLines = true;
+        }
+        if (preservesLines) {
+          Q_ASSERT(nbSymmetries < 32);
+          for (int cell = 0; cell < 16; ++cell)
+            symmetries_[nbSymmetries][cell] = permutation[cell];
+          ++nbSymmetries;
+        }
+      }
+  Q_ASSERT(nbSymmetries == 32);
+  clear();
+}
+
+void Solver::clear() {
+  const Entry empty = {0, 0, 0};
+  table_.fill(empty);
+}
+
+bool Solver::isWinning(quint64 cells, int occupied, int cell) {
+  for (int l = 0; l < 10; ++l) {
+    const int mask = lineMask(l);
+    if (!(mask & (1 << cell)) || ((occupied & mask) != mask))
+      continue;
+    int common = 0xF, complement = 0xF;
+    for (int i = 0; i < 4; ++i) {
+      const int piece = pieceAt(cells, lines[l][i]);
+      common &= piece;
+      complement &= ~piece;
+    }
+    if (common | complement)
+      return true;
+  }
+  return false;
+}
+
+bool Solver::hasLine(quint64 cells, int occupied) {
+  // Each line contains one of the cells of the first diagonal
+  for (int i = 0; i < 4; ++i)
+    if (isWinning(cells, occupied, 5 * i))
+      return true;
+  return isWinning(cells, occupied, 3);
+}
+
+// The smallest of the symmetric positions, where the characteristics are
+// complemented so that the piece of the first occupied cell is 0.
+void Solver::canonical(quint64 cells, int occupied, int given, quint64 &key,
+                       quint32 &rest) const {
+  bool first = true;
+  for (int s = 0; s < 32; ++s) {
+    quint64 c = 0, nibbles = 0;
+    int o = 0;
+    for (int e = occupied; e; e &= e - 1) {
+      const int cell = firstCell(e), image = symmetries_[s][cell];
+      c |= quint64(pieceAt(cells, cell)) << (4 * image);
+      nibbles |= quint64(0xF) << (4 * image);
+      o |= 1 << image;
+    }
+    const int complemented = o ? pieceAt(c, firstCell(o)) : given;
+    c ^= (Q_UINT64_C(0x1111111111111111) * quint64(complemented)) & nibbles;
+    const quint32 r = quint32(o) | (quint32(given ^ complemented) << 16);
+    if (first || (c < key) || ((c == key) && (r < rest))) {
+      key = c;
+      rest = r;
+      first = false;
+    }
+  }
+  rest |= validEntry;
+}
+
+bool Solver::probe(quint64 key, quint32 rest, int &value) {
+  const quint64 hash = mix(key ^ (quint64(rest) << 32));
+  QMutexLocker locker(&tableLocks_[hash & 63]);
+  const Entry &e = table_.constData()[(hash >> 6) & (tableSize - 1)];
+  if ((e.cells != key) || (e.rest != rest))
+    return false;
+  value = e.value;
+  return true;
+}
+
+void Solver::store(quint64 key, quint32 rest, int value) {
+  const quint64 hash = mix(key ^ (quint64(rest) << 32));
+  QMutexLocker locker(&tableLocks_[hash & 63]);
+  Entry &e = table_.data()[(hash >> 6) & (tableSize - 1)];
+  e.cells = key;
+  e.rest = rest;
+  e.value = value;
+}
+
+// Negamax value of the position for the player who places given, searched
+// depth placements deep. exact is false when a limited or stopped search makes
+// the value unknown, in which case it is 0.
+int Solver::search(quint64 cells, int occupied, int given, int available,
+                   int depth, bool &exact) {
+  const int empty = ~occupied & 0xFFFF;
+  exact = true;
+  for (int e = empty; e; e &= e - 1) {
+    const int cell = firstCell(e);
+    if (isWinning(place(cells, cell, given), occupied | (1 << cell), cell))
+      return 1;
+  }
+  // The last piece was placed without completing a line
+  if (!(empty & (empty - 1)))
+    return 0;
+
+  exact = false;
+  if ((depth <= 1) || stop_.loadAcquire())
+    return 0;
+
+  quint64 key;
+  quint32 rest;
+  canonical(cells, occupied, given, key, rest);
+  int value;
+  if (probe(key, rest, value)) {
+    exact = true;
+    return value;
+  }
+
+  int best = -1;
+  bool allExact = true;
+  for (int e = empty; e && (best < 1); e &= e - 1) {
+    const int cell = firstCell(e);
+    const quint64 c = place(cells, cell, given);
+    for (int a = available; a && (best < 1); a &= a - 1) {
+      const int piece = firstCell(a);
+      bool childExact;
+      const int v = -search(c, occupied | (1 << cell), piece,
+                            available & ~(1 << piece), depth - 1, childExact);
+      allExact = allExact && childExact;
+      best = qMax(best, v);
+    }
+  }
+
+  // A win is exact: only unknown outcomes are lost by the limited searches
+  exact = (best == 1) || allExact;
+  if (exact)
+    store(key, rest, best);
+  return exact ? best : 0;
+}
+
+void Solver::searchCandidate(int index) {
+  Candidate &candidate = candidates_[index];
+  bool exact;
+  const int value =
+      -search(place(rootCells_, candidate.cell, rootGiven_),
+              rootOccupied_ | (1 << candidate.cell), candidate.piece,
+              rootAvailable_ & ~(1 << candidate.piece), rootDepth_ - 1, exact);
+  candidate.value = value;
+  candidate.exact = exact;
+  if (value == 1)
+    stop_.storeRelease(1);
+}
+
+Solver::Move Solver::bestMove(quint64 cells, int occupied, int given,
+                              int maximumEmptyCells) {
+  Move move = {-1, -1, -1, true};
+  const int empty = ~occupied & 0xFFFF;
+  if (!empty || (given < 0) || (given > 15))
+    return move;
+
+  for (int e = empty; e; e &= e - 1) {
+    const int cell = firstCell(e);
+    if (isWinning(place(cells, cell, given), occupied | (1 << cell), cell)) {
+      move.cell = cell;
+      move.value = 1;
+      return move;
+    }
+  }
+  if (!(empty & (empty - 1))) {
+    move.cell = firstCell(empty);
+    move.value = 0;
+    return move;
+  }
+
+  const int available =
+      0xFFFF & ~placedPieces(cells, occupied) & ~(1 << given);
+  candidates_.clear();
+  for (int e = empty; e; e &= e - 1)
+    for (int a = available; a; a &= a - 1) {
+      const Candidate candidate = {firstCell(e), firstCell(a), -1, false};
+      candidates_.append(candidate);
+    }
+
+  rootCells_ = cells;
+  rootOccupied_ = occupied;
+  rootGiven_ = given;
+  rootAvailable_ = available;
+  const int nbEmptyCells = int(qPopulationCount(quint32(empty)));
+  rootDepth_ =
+      (nbEmptyCells <= maximumEmptyCells) ? nbEmptyCells : shallowDepth;
+  stop_.storeRelease(0);
+  for (int i = 0; i < candidates_.size(); ++i)
+    pool_.start(new CandidateSearch(this, i));
+  pool_.waitForDone();
+
+  // The first winning candidate, or the best exact one, or the best unknown
+  int bestIndex = 0;
+  for (int i = 1; i < candidates_.size(); ++i) {
+    const Candidate &c = candidates_[i], &best = candidates_[bestIndex];
+    if ((best.value == 1) && best.exact)
+      break;
+    if ((c.value > best.value) ||
+        ((c.value == best.value) && c.exact && !best.exact))
+      bestIndex = i;
+  }
+  const Candidate &best = candidates_[bestIndex];
+  move.cell = best.cell;
+  move.nextPiece = best.piece;
+  move.value = best.value;
+  move.exact = best.exact;
+  return move;
+}
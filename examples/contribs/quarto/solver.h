@@ -0,0 +1,94 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVector>
+
+// Quarto solver. A board is packed in a 64 bits word, the number of the piece
+// of each cell in a nibble, with a 16 bits mask of the occupied cells. The
+// number of a piece has one bit per characteristic (see piece()), so that the
+// four pieces of a line share a characteristic when the AND of their numbers,
+// or of their complements, is not null.
+//
+// The negamax search memoizes the solved positions in a transposition table,
+// shared by the threads that search the candidate moves in parallel. Before
+// they are hashed, the positions are reduced by the 32 cell permutations that
+// preserve the lines, and by the complement of the characteristics of the
+// first piece. The table is kept from one move to the next.
+class Solver {
+  friend class CandidateSearch;
+
+public:
+  Solver();
+
+  // Number of a piece: its index in SetOfPiece.
+  static int piece(bool couleur, bool taille, bool forme, bool trou) {
+    return (int(couleur) << 3) | (int(taille) << 2) | (int(forme) << 1) |
+           int(trou);
+  }
+
+  // True when a line through cell has four pieces with a common
+  // characteristic.
+  static bool isWinning(quint64 cells, int occupied, int cell);
+  // True when any line has four pieces with a common characteristic.
+  static bool hasLine(quint64 cells, int occupied);
+
+  struct Move {
+    int cell;      // Where the given piece is placed, -1 if the board is full
+    int nextPiece; // Given to the opponent, -1 when the game is over
+    int value;     // 1 (win), 0 (draw or unknown) or -1 (loss)
+    bool exact;    // False when the search was limited by maximumEmptyCells
+  };
+
+  // Best cell for the given piece, and best piece to give to the opponent.
+  // Positions with at most maximumEmptyCells empty cells are solved exactly:
+  // the others are only searched three placements deep, which avoids the
+  // losses on the next move, the unknown outcomes being draws. Blocks the
+  // calling thread.
+  Move bestMove(quint64 cells, int occupied, int given,
+                int maximumEmptyCells = 8);
+
+  // Forgets the memoized positions.
+  void clear();
+
+private:
+  Solver(const Solver &);
+  Solver &operator=(const Solver &);
+
+  struct Entry {
+    quint64 cells;
+    quint32 rest; // Occupied cells, given piece and a valid bit
+    int value;
+  };
+
+  struct Candidate {
+    int cell, piece;
+    int value;
+    bool exact;
+  };
+
+  int search(quint64 cells, int occupied, int given, int available, int depth,
+             bool &exact);
+  void canonical(quint64 cells, int occupied, int given, quint64 &key,
+                 quint32 &rest) const;
+  bool probe(quint64 key, quint32 rest, int &value);
+  void store(quint64 key, quint32 rest, int value);
+  void searchCandidate(int index);
+
+  // Cell permutations of the symmetries
+  int symmetries_[32][16];
+
+  QVector<Entry> table_;
+  QMutex tableLocks_[64];
+
+  // Root search
+  quint64 rootCells_;
+  int rootOccupied_, rootGiven_, rootAvailable_, rootDepth_;
+  QVector<Candidate> candidates_;
+  QThreadPool pool_;
+  QAtomicInt stop_; // Set when a winning candidate is found
+};
+
+#endif // SOLVER_H
@@ -7,6 +7,10 @@ int main(int argc, char **argv) {
 
   Viewer viewer;
 
+  // terrain <fichier>: afficher une carte en tuiles (voir la touche E)
+  if (argc > 1)
+    viewer.setTiledHeightMap(argv[1]);
+
 #if QT_VERSION < 0x040000
   application.setMainWidget(&viewer);
 #else
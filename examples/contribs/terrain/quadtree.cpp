@@ -1,78 +1,468 @@
 // TP OpenGL: Joerg Liebelt, Serigne Sow
 #include "quadtree.h"
 
+#include <QOpenGLBuffer>
+#include <QVector>
+
 #define SQR(number) (number * number)
 #define CUBE(number) (number * number * number)
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) < (b)) ? (b) : (a))
 
-// codes determinant le type de suite partielle de triangles a creer, selon la
-// position dans le quadtree
-static char suiteCode[] = {10, 8,  8, 12, 8,  0,  12, 14,
-                           8,  12, 0, 14, 12, 14, 14, 0};
-static char suiteStart[] = {3, 3, 0, 3, 1, 0, 0, 3, 2, 2, 0, 2, 1, 1, 0, 0};
-
 static bool debugger = false;
 
+// index du vertex (i,j) d'un niveau de detail de pas step (n quads par cote):
+// sur un bord cousu, les vertex impairs sont ramenes sur leur voisin pair,
+// pour suivre exactement le bord du bloc voisin moins detaille
+static GLushort StitchedIndex(int i, int j, int n, int step, int stitch,
+                              int chunkSize) {
+  if ((i & 1) && (((j == 0) && (stitch & QT_STITCH_BOTTOM)) ||
+                  ((j == n) && (stitch & QT_STITCH_TOP))))
+    i--;
+  if ((j & 1) && (((i == 0) && (stitch & QT_STITCH_LEFT)) ||
+                  ((i == n) && (stitch & QT_STITCH_RIGHT))))
+    j--;
+  return (GLushort)((j * step) * (chunkSize + 1) + i * step);
+}
+
+// generer les coordonnees de texture de l'unite active a partir de la position
+// (x,z) sur le terrain; les plans sont definis avant les transformations des
+// blocs, qui n'ont donc pas besoin de coordonnees de texture
+static void EnableTexGen(float scale) {
+  const GLfloat sPlane[4] = {scale, 0.0f, 0.0f, 0.0f};
+  const GLfloat tPlane[4] = {0.0f, 0.0f, scale, 0.0f};
+  glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+  glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+  glTexGenfv(GL_S, GL_EYE_PLANE, sPlane);
+  glTexGenfv(GL_T, GL_EYE_PLANE, tPlane);
+  glEnable(GL_TEXTURE_GEN_S);
+  glEnable(GL_TEXTURE_GEN_T);
+}
+
+static void DisableTexGen(void) {
+  glDisable(GL_TEXTURE_GEN_S);
+  glDisable(GL_TEXTURE_GEN_T);
+}
+
+// decouper la carte en blocs et charger leur geometrie sur la carte graphique.
+// A appeler (avec le contexte OpenGL courant) apres chaque changement de la
+// carte d'hauteurs; les ombrages sont recharges par Render() quand la
+// lightmap change
 bool QUADTREE::Init(void) {
-  int x, z;
+  int i, j;
 
-  quadMatrix = new unsigned char[SQR(sizeHeightMap)];
+  ReleaseChunks();
+  if (sizeHeightMap < 1)
+    return false;
 
-  for (z = 0; z < sizeHeightMap; z++) {
-    for (x = 0; x < sizeHeightMap; x++) {
-      quadMatrix[GetMatrixIndex(x, z)] = 1;
+  // un bloc ne peut pas etre plus grand que la carte (ou qu'une tuile)
+  chunkSize = MIN(QT_CHUNK_SIZE, sizeHeightMap);
+  if (heightTiles)
+    chunkSize = MIN(chunkSize, heightTiles->TileSize());
+  numChunks = sizeHeightMap / chunkSize;
+  numLods = 1;
+  while ((1 << numLods) <= chunkSize && numLods < QT_MAX_LODS)
+    numLods++;
+
+  chunks = new SQT_CHUNK[numChunks * numChunks];
+  for (j = 0; j < numChunks; j++) {
+    for (i = 0; i < numChunks; i++) {
+      SQT_CHUNK &chunk = GetChunk(i, j);
+      chunk.vertices = NULL;
+      chunk.colors = NULL;
+      chunk.lod = -1;
+      chunk.distance = 0.0f;
+      chunk.page = 0;
+      // carte en tuiles: le bloc sera construit quand sa tuile sera chargee
+      if (heightTiles)
+        continue;
+      // repartir les triangles pour que les regions detailles/moins lisses
+      // obtiennent plus de triangles
+      CalculateChunkErrors(chunk, i * chunkSize, j * chunkSize);
     }
   }
 
-  // repartir les triangles pour que les regions detailles/moins lisses
-  // obtiennent plus de triangles
-  PropagateRoughness();
+  if (!heightTiles)
+    UploadChunks();
+  BuildIndices();
+  chunksLightVersion = -1;
   return true;
 }
 
 void QUADTREE::Shutdown(void) {
-  if (quadMatrix)
-    delete[] quadMatrix;
+  ReleaseChunks();
+  virtualTexture.Shutdown();
+}
+
+void QUADTREE::ReleaseChunks(void) {
+  int i;
+  if (chunks) {
+    for (i = 0; i < numChunks * numChunks; i++) {
+      delete chunks[i].vertices;
+      delete chunks[i].colors;
+    }
+    delete[] chunks;
+    chunks = NULL;
+  }
+  uploadedChunks.clear();
+  numChunks = 0;
+  delete indices;
+  indices = NULL;
+}
+
+// erreur geometrique de chaque niveau de detail d'un bloc: l'ecart maximal
+// entre la hauteur reelle d'un vertex et celle des triangles du niveau
+void QUADTREE::CalculateChunkErrors(SQT_CHUNK &chunk, int x0, int z0) {
+  int i, j, lod, step, ci, cj;
+  float u, v, h, h00, h10, h01, h11, error;
+  unsigned char height;
+
+  chunk.minHeight = 255;
+  chunk.maxHeight = 0;
+  for (j = 0; j <= chunkSize; j++) {
+    for (i = 0; i <= chunkSize; i++) {
+      height = GetClampedHeightAtPoint(x0 + i, z0 + j);
+      chunk.minHeight = MIN(chunk.minHeight, height);
+      chunk.maxHeight = MAX(chunk.maxHeight, height);
+    }
+  }
+
+  chunk.error[0] = 0.0f;
+  for (lod = 1; lod < numLods; lod++) {
+    step = 1 << lod;
+    // un niveau plus grossier n'est jamais plus precis
+    error = chunk.error[lod - 1];
+    for (j = 0; j <= chunkSize; j++) {
+      for (i = 0; i <= chunkSize; i++) {
+        // quad du niveau contenant le vertex, et position dans ce quad
+        ci = MIN(i / step, chunkSize / step - 1) * step;
+        cj = MIN(j / step, chunkSize / step - 1) * step;
+        u = (float)(i - ci) / step;
+        v = (float)(j - cj) / step;
+
+        h00 = GetClampedHeightAtPoint(x0 + ci, z0 + cj);
+        h10 = GetClampedHeightAtPoint(x0 + ci + step, z0 + cj);
+        h01 = GetClampedHeightAtPoint(x0 + ci, z0 + cj + step);
+        h11 = GetClampedHeightAtPoint(x0 + ci + step, z0 + cj + step);
+
+        // meme decoupage en triangles que BuildIndices(): diagonale de (1,0)
+        // a (0,1)
+        if (u + v <= 1.0f)
+          h = h00 + u * (h10 - h00) + v * (h01 - h00);
+        else
+          h = h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+
+        error = MAX(error,
+                    (float)fabs(GetClampedHeightAtPoint(x0 + i, z0 + j) - h));
+      }
+    }
+    chunk.error[lod] = error;
+  }
+}
+
+// charger les vertex de chaque bloc: x,z entiers relatifs au bloc et hauteur
+// sans echelle, mis a l'echelle par RenderChunks()
+void QUADTREE::UploadChunks(void) {
+  int i, j;
+  for (j = 0; j < numChunks; j++) {
+    for (i = 0; i < numChunks; i++)
+      UploadChunk(i, j);
+  }
+}
+
+void QUADTREE::UploadChunk(int i, int j) {
+  int x, z, k = 0;
+  QVector<GLshort> data(4 * (chunkSize + 1) * (chunkSize + 1));
+
+  for (z = 0; z <= chunkSize; z++) {
+    for (x = 0; x <= chunkSize; x++) {
+      data[k++] = (GLshort)x;
+      data[k++] = GetClampedHeightAtPoint(i * chunkSize + x, j * chunkSize + z);
+      data[k++] = (GLshort)z;
+      data[k++] = 0; // alignement des vertex sur 8 octets
+    }
+  }
+
+  SQT_CHUNK &chunk = GetChunk(i, j);
+  chunk.vertices = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  chunk.vertices->create();
+  chunk.vertices->bind();
+  chunk.vertices->allocate(data.constData(), data.size() * sizeof(GLshort));
+  chunk.vertices->release();
+
+  // rempli par UploadChunkColors()
+  chunk.colors = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  chunk.colors->create();
+}
+
+// charger les ombrages de la lightmap dans les blocs
+void QUADTREE::UploadChunkColors(void) {
+  int i, j;
+  for (j = 0; j < numChunks; j++) {
+    for (i = 0; i < numChunks; i++)
+      UploadChunkColors(i, j);
+  }
+  chunksLightVersion = lightMapVersion;
+}
+
+void QUADTREE::UploadChunkColors(int i, int j) {
+  int x, z, k = 0, lightX, lightZ;
+  unsigned char color;
+  QVector<GLubyte> data(4 * (chunkSize + 1) * (chunkSize + 1));
+
+  SQT_CHUNK &chunk = GetChunk(i, j);
+  if (!chunk.colors)
+    return;
+
+  for (z = 0; z <= chunkSize; z++) {
+    for (x = 0; x <= chunkSize; x++) {
+      if (lightMap.arrayLightMap && lightMap.sizeLightMap > 0) {
+        lightX = MIN(i * chunkSize + x, lightMap.sizeLightMap - 1);
+        lightZ = MIN(j * chunkSize + z, lightMap.sizeLightMap - 1);
+        color = GetBrightnessAtPoint(lightX, lightZ);
+      } else
+        color = 255;
+      data[k++] = (GLubyte)(color * rLight);
+      data[k++] = (GLubyte)(color * gLight);
+      data[k++] = (GLubyte)(color * bLight);
+      data[k++] = 255;
+    }
+  }
+
+  chunk.colors->bind();
+  chunk.colors->allocate(data.constData(), data.size() * sizeof(GLubyte));
+  chunk.colors->release();
+}
+
+// carte en tuiles: liberer les blocs dont la tuile a ete dechargee, et
+// construire ceux des tuiles chargees, les plus recemment demandees (les plus
+// proches de la camera) en premier
+void QUADTREE::UpdateTiledChunks(void) {
+  const int chunksPerTile = heightTiles->TileSize() / chunkSize;
+  const QList<int> &tiles = heightTiles->ResidentTiles();
+  int i, j, k, ti, tj, index;
+  int uploads = 0;
+
+  for (k = uploadedChunks.size() - 1; k >= 0; k--) {
+    index = uploadedChunks[k];
+    if (heightTiles->IsResident((index % numChunks) / chunksPerTile,
+                                (index / numChunks) / chunksPerTile))
+      continue;
+    delete chunks[index].vertices;
+    delete chunks[index].colors;
+    chunks[index].vertices = NULL;
+    chunks[index].colors = NULL;
+    uploadedChunks.removeAt(k);
+  }
+
+  for (k = tiles.size() - 1; k >= 0 && uploads < QT_MAX_UPLOADS; k--) {
+    ti = tiles[k] % heightTiles->NumTiles();
+    tj = tiles[k] / heightTiles->NumTiles();
+    for (j = tj * chunksPerTile; j < (tj + 1) * chunksPerTile; j++) {
+      for (i = ti * chunksPerTile; i < (ti + 1) * chunksPerTile; i++) {
+        SQT_CHUNK &chunk = GetChunk(i, j);
+        if (chunk.vertices || uploads >= QT_MAX_UPLOADS)
+          continue;
+        CalculateChunkErrors(chunk, i * chunkSize, j * chunkSize);
+        UploadChunk(i, j);
+        UploadChunkColors(i, j);
+        uploadedChunks.append((j * numChunks) + i);
+        uploads++;
+      }
+    }
+  }
+}
+
+// creer les triangles de chaque niveau de detail, pour chacune des
+// combinaisons de coutures avec des voisins moins detailles. Tous les blocs
+// ont la meme organisation de vertex et partagent donc ces index
+void QUADTREE::BuildIndices(void) {
+  int lod, stitch, step, n, i, j, t;
+  GLushort quad[4]; // (i,j), (i+1,j), (i,j+1), (i+1,j+1)
+  static const int triangles[6] = {0, 2, 1, 1, 2, 3};
+  QVector<GLushort> data;
+
+  for (lod = 0; lod < numLods; lod++) {
+    step = 1 << lod;
+    n = chunkSize / step;
+    for (stitch = 0; stitch < QT_NUM_STITCHES; stitch++) {
+      indexOffset[lod][stitch] = data.size();
+      for (j = 0; j < n; j++) {
+        for (i = 0; i < n; i++) {
+          quad[0] = StitchedIndex(i, j, n, step, stitch, chunkSize);
+          quad[1] = StitchedIndex(i + 1, j, n, step, stitch, chunkSize);
+          quad[2] = StitchedIndex(i, j + 1, n, step, stitch, chunkSize);
+          quad[3] = StitchedIndex(i + 1, j + 1, n, step, stitch, chunkSize);
+          for (t = 0; t < 6; t += 3) {
+            // les triangles degeneres par les coutures sont omis
+            if (quad[triangles[t]] == quad[triangles[t + 1]] ||
+                quad[triangles[t + 1]] == quad[triangles[t + 2]] ||
+                quad[triangles[t + 2]] == quad[triangles[t]])
+              continue;
+            data.append(quad[triangles[t]]);
+            data.append(quad[triangles[t + 1]]);
+            data.append(quad[triangles[t + 2]]);
+          }
+        }
+      }
+      indexCount[lod][stitch] = data.size() - indexOffset[lod][stitch];
+    }
+  }
+
+  indices = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+  indices->create();
+  indices->bind();
+  indices->allocate(data.constData(), data.size() * sizeof(GLushort));
+  indices->release();
 }
 
 void QUADTREE::Update(float x, float y, float z) {
   float center;
+  int i;
   setCameraPosition(x, y, z);
+  if (!chunks)
+    return;
+
+  // carte en tuiles: paginer les tuiles autour de la camera
+  if (heightTiles) {
+    heightTiles->Update((int)(x * sizeHeightMap / scaleSize),
+                        (int)(z * sizeHeightMap / scaleSize), pagingRadius);
+    UpdateTiledChunks();
+  }
+
+  for (i = 0; i < numChunks * numChunks; i++)
+    chunks[i].lod = -1;
+
   // centre de la carte
   center = (sizeHeightMap) / 2.0f;
 
-  // reconstruire le "grid" par traversee top-down du quadtree
+  // choisir le niveau de detail des blocs par traversee top-down du quadtree
   RefineNode(center, center, sizeHeightMap);
+  RestrictLods();
+
+  // texture virtuelle: demander les pages des blocs retenus, charger celles
+  // qui sont pretes
+  if (paintTextures && virtualTexture.IsReady()) {
+    RequestPages();
+    virtualTexture.Update();
+  }
 }
 
-// rendering d'un seul vertex
-// params u,v deja normalises par rapport a sizeHeightMap
-void QUADTREE::RenderVertex(float x, float z, float u, float v,
-                            bool multiTextures) {
-  unsigned char color = GetBrightnessAtPoint((int)x, (int)z);
-  if (debugger)
-    printf("RenderVertex %f,%f - %f,%f\n", x, z, u, v);
-  if (paintLighting) {
-    glColor3ub((unsigned char)(color * rLight), (unsigned char)(color * gLight),
-               (unsigned char)(color * bLight));
-  } else
+// choisir la page de texture virtuelle de chaque bloc visible: la plus
+// grossiere qui a encore au moins un texel par pixel du bloc
+void QUADTREE::RequestPages(void) {
+  // taille d'un bloc sur le terrain
+  const float chunkExtent = chunkSize * scaleSize / sizeHeightMap;
+  const int topLevel = virtualTexture.NumLevels() - 1;
+  float texelsPerPixel;
+  int i, j, level;
+
+  for (j = 0; j < numChunks; j++) {
+    for (i = 0; i < numChunks; i++) {
+      SQT_CHUNK &chunk = GetChunk(i, j);
+      if (chunk.lod < 0)
+        continue;
+
+      // au niveau 0, puis divise par deux a chaque niveau
+      texelsPerPixel =
+          VT_PAGE_SIZE * chunk.distance / (chunkExtent * pageResolution);
+      level = 0;
+      while (level < topLevel && texelsPerPixel >= 2.0f) {
+        texelsPerPixel /= 2.0f;
+        level++;
+      }
+
+      chunk.page = level;
+      virtualTexture.Request(level, i >> level, j >> level, chunk.distance);
+    }
+  }
+}
+
+// afficher les blocs visibles, chacun avec l'index buffer de son niveau de
+// detail et des coutures avec ses voisins
+// colorPages: l'unite de texture 0 contient la texture virtuelle, dont les
+// coordonnees sont generees pour chaque bloc dans la page qui le couvre
+void QUADTREE::RenderChunks(bool colorPages) {
+  int i, j, lod, stitch;
+  const float scale = scaleSize / sizeHeightMap;
+  GLfloat sPlane[4], tPlane[4];
+
+  if (!indices->bind())
+    return;
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  if (paintLighting)
+    glEnableClientState(GL_COLOR_ARRAY);
+  else
     glColor3ub(255, 255, 255);
-  glMultiTexCoord2f(GL_TEXTURE0, u, v);
-  if (multiTextures)
-    glMultiTexCoord2f(GL_TEXTURE1, u * repeatDetailMap, v * repeatDetailMap);
-  glVertex3f(x / sizeHeightMap * scaleSize,
-             GetScaledHeightAtPoint((int)x, (int)z) / sizeHeightMap,
-             z / sizeHeightMap * scaleSize);
+
+  for (j = 0; j < numChunks; j++) {
+    for (i = 0; i < numChunks; i++) {
+      SQT_CHUNK &chunk = GetChunk(i, j);
+      lod = chunk.lod;
+      if (lod < 0)
+        continue;
+
+      // coudre les bords des voisins moins detailles (eviter "CRACKS")
+      stitch = 0;
+      if (j > 0 && GetChunk(i, j - 1).lod > lod)
+        stitch |= QT_STITCH_BOTTOM;
+      if (i < numChunks - 1 && GetChunk(i + 1, j).lod > lod)
+        stitch |= QT_STITCH_RIGHT;
+      if (j < numChunks - 1 && GetChunk(i, j + 1).lod > lod)
+        stitch |= QT_STITCH_TOP;
+      if (i > 0 && GetChunk(i - 1, j).lod > lod)
+        stitch |= QT_STITCH_LEFT;
+
+      chunk.vertices->bind();
+      glVertexPointer(3, GL_SHORT, 4 * sizeof(GLshort), NULL);
+      if (paintLighting) {
+        chunk.colors->bind();
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, NULL);
+      }
+
+      // plans en coordonnees du terrain, pas encore deplaces vers le bloc
+      if (colorPages) {
+        virtualTexture.GetPlanes(chunk.page, i >> chunk.page, j >> chunk.page,
+                                 sPlane, tPlane);
+        sPlane[0] /= scale;
+        tPlane[2] /= scale;
+        glActiveTexture(GL_TEXTURE0);
+        glTexGenfv(GL_S, GL_EYE_PLANE, sPlane);
+        glTexGenfv(GL_T, GL_EYE_PLANE, tPlane);
+      }
+
+      glPushMatrix();
+      glTranslatef(i * chunkSize * scale, 0.0f, j * chunkSize * scale);
+      glScalef(scale, scaleHeightMap / sizeHeightMap, scale);
+      glDrawElements(GL_TRIANGLES, indexCount[lod][stitch], GL_UNSIGNED_SHORT,
+                     reinterpret_cast<void *>(indexOffset[lod][stitch] *
+                                              sizeof(GLushort)));
+      glPopMatrix();
+    }
+  }
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  QOpenGLBuffer::release(QOpenGLBuffer::VertexBuffer);
+  indices->release();
 }
 
-// debut du rendering recursif
+// debut du rendering des blocs
 void QUADTREE::Render(void) {
-  float center;
   if (debugger)
     printf("Render\n");
-  // centre de la carte
-  center = (sizeHeightMap) / 2.0f;
+  if (!chunks)
+    return;
+
+  // texture virtuelle si elle a ete generee, sinon la texture complete
+  const bool colorPages = virtualTexture.IsReady();
+  const unsigned int colorID =
+      colorPages ? virtualTexture.TextureID() : textureColorID;
+
+  // la lightmap a change depuis le dernier chargement des ombrages
+  if (chunksLightVersion != lightMapVersion)
+    UploadChunkColors();
 
   // on fait le culling a travers le quadtree, pas avec le hardware
   glDisable(GL_CULL_FACE);
@@ -86,13 +476,15 @@ void QUADTREE::Render(void) {
     // selon hauteur)
     glActiveTexture(GL_TEXTURE0);
     glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, textureColorID);
+    glBindTexture(GL_TEXTURE_2D, colorID);
+    EnableTexGen(1.0f / scaleSize);
 
     // selectionner commer deuxieme unite de texture la texture de detail
     // (structure)
     glActiveTexture(GL_TEXTURE1);
     glEnable(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, textureDetailID);
+    EnableTexGen(repeatDetailMap / scaleSize);
 
     // definir la maniere dont les couleurs des triangles sont crees en fct. des
     // couleurs des textures
@@ -101,9 +493,7 @@ void QUADTREE::Render(void) {
     glTexEnvi(GL_TEXTURE_ENV, GL_RGB_SCALE,
               2); // augmenter la luminosite des couleurs
 
-    // render a partir du noeud principal au milieu de la carte (recursif a
-    // partir d'ici)
-    RenderNode(center, center, sizeHeightMap, true, true);
+    RenderChunks(colorPages);
   }
 
   // on a pas de multitextures mais on souhaite des textures
@@ -113,200 +503,46 @@ void QUADTREE::Render(void) {
     // hauteur)
     glActiveTexture(GL_TEXTURE0);
     glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, textureColorID);
+    glBindTexture(GL_TEXTURE_2D, colorID);
+    EnableTexGen(1.0f / scaleSize);
 
-    RenderNode(center, center, sizeHeightMap, false, false);
+    RenderChunks(colorPages);
 
     // DEUXIEME PARCOURS: DETAIL
     // preparer la texture de detail
     glActiveTexture(GL_TEXTURE0);
     glEnable(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, textureDetailID);
+    EnableTexGen(repeatDetailMap / scaleSize);
 
     // activer la combinaison entre couleur existant (premier parcours) et
     // couleur ajoutee (detail)
     glEnable(GL_BLEND);
     glBlendFunc(GL_ZERO, GL_SRC_COLOR);
 
-    RenderNode(center, center, sizeHeightMap, false, true);
+    RenderChunks(false);
 
     glDisable(GL_BLEND);
   }
 
   else // pas de textures du tout
   {
-    RenderNode(center, center, sizeHeightMap, false, false);
-    // sinon rendering brute force?
+    RenderChunks(false);
   }
 
   // liberer la deuxieme texture
   glActiveTexture(GL_TEXTURE1);
+  DisableTexGen();
   glDisable(GL_TEXTURE_2D);
   glBindTexture(GL_TEXTURE_2D, 0);
 
   // liberer la premiere texture
   glActiveTexture(GL_TEXTURE0);
+  DisableTexGen();
   glDisable(GL_TEXTURE_2D);
   glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-// gerer la repartition des triangles sur les parties moins lisses / plus
-// detaillees
-void QUADTREE::PropagateRoughness(void) {
-  float upperBound;
-  int dH, d2, localD2, localH;
-  int edgeLength, edgeOffset;
-  int childOffset;
-  int x, z;
-  if (debugger)
-    printf("PropagateRoughness\n");
-  // commencer au niveau de detail le plus elevee (taille de bloc la plus
-  // petite)
-  edgeLength = 2;
-  // jusqu'au niveau de detail le moins elevee (taille de bloc la plus petite)
-  // un bloc est defini par edgeLength*edgeLength
-  //.. ==> bottom-up!
-  while (edgeLength <= sizeHeightMap) {
-    edgeOffset = (edgeLength) >> 1;
-
-    childOffset = (edgeLength) >> 2;
-    // D2: valeur qui indique la difference maximale entre l'hauteur reelle et
-    //.. l'hauteur moyenne autour du point (calculee comme moyenne de deux
-    //points)  pour chaque noeud, calculer D2 a 9 endroits (milieu + 8 autour,
-    // sur un rectangle) pour 5 valeurs
-    for (z = edgeOffset; z < sizeHeightMap - edgeOffset; z += (edgeLength)) {
-      for (x = edgeOffset; x < sizeHeightMap - edgeOffset; x += (edgeLength)) {
-        // haut, milieu
-        localD2 = (int)ceil(
-            (int)(abs(((GetTrueHeightAtPoint(x - edgeOffset, z + edgeOffset) +
-                        GetTrueHeightAtPoint(x + edgeOffset, z + edgeOffset)) >>
-                       1) -
-                      GetTrueHeightAtPoint(x, z + edgeOffset))));
-        // a droite, milieu
-        dH = (int)ceil(
-            abs(((GetTrueHeightAtPoint(x + edgeOffset, z + edgeOffset) +
-                  GetTrueHeightAtPoint(x + edgeOffset, z - edgeOffset)) >>
-                 1) -
-                GetTrueHeightAtPoint(x + edgeOffset, z)));
-        localD2 = MAX(localD2, dH);
-
-        // en bas, milieu
-        dH = (int)ceil(
-            abs(((GetTrueHeightAtPoint(x - edgeOffset, z - edgeOffset) +
-                  GetTrueHeightAtPoint(x + edgeOffset, z - edgeOffset)) >>
-                 1) -
-                GetTrueHeightAtPoint(x, z - edgeOffset)));
-        localD2 = MAX(localD2, dH);
-
-        // a gauche, milieu
-        dH = (int)ceil(
-            abs(((GetTrueHeightAtPoint(x - edgeOffset, z + edgeOffset) +
-                  GetTrueHeightAtPoint(x - edgeOffset, z - edgeOffset)) >>
-                 1) -
-                GetTrueHeightAtPoint(x - edgeOffset, z)));
-        localD2 = MAX(localD2, dH);
-
-        // deux points sur la diagonale de bas gauche a haut droite
-        dH = (int)ceil(
-            abs(((GetTrueHeightAtPoint(x - edgeOffset, z - edgeOffset) +
-                  GetTrueHeightAtPoint(x + edgeOffset, z + edgeOffset)) >>
-                 1) -
-                GetTrueHeightAtPoint(x, z)));
-        localD2 = MAX(localD2, dH);
-
-        // deux points sur la diagonale de bas droite a haut gauche
-        dH = (int)ceil(
-            abs(((GetTrueHeightAtPoint(x + edgeOffset, z - edgeOffset) +
-                  GetTrueHeightAtPoint(x - edgeOffset, z + edgeOffset)) >>
-                 1) -
-                GetTrueHeightAtPoint(x, z)));
-        localD2 = MAX(localD2, dH);
-        // localD2 de 0 a 255, normaliser par la taille du bloc actuelle (de 3 a
-        // sizeHeightMap)
-        // ... donc multiplier par 3 pour obtenir une precision maximale de 0 a
-        // 255 pour d2
-        localD2 = (int)ceil((localD2 * 3.0f) / edgeLength);
-        // sur le niveau le plus bas, on calcule l'hauteur reelle maximale a la
-        // main
-        if (edgeLength == 2) {
-          d2 = localD2;
-          // haut, droite
-          localH = GetTrueHeightAtPoint(x + edgeOffset, z + edgeOffset);
-          // milieu, droite
-          localH = MAX(localH, GetTrueHeightAtPoint(x + edgeOffset, z));
-          // bas, droite
-          localH =
-              MAX(localH, GetTrueHeightAtPoint(x + edgeOffset, z - edgeOffset));
-          // bas milieu
-          localH = MAX(localH, GetTrueHeightAtPoint(x, z - edgeOffset));
-          // bas gauche
-          localH =
-              MAX(localH, GetTrueHeightAtPoint(x - edgeOffset, z - edgeOffset));
-          // gauche milieu
-          localH = MAX(localH, GetTrueHeightAtPoint(x - edgeOffset, z));
-          // gauche haut
-          localH =
-              MAX(localH, GetTrueHeightAtPoint(x - edgeOffset, z + edgeOffset));
-          // haut milieu
-          localH = MAX(localH, GetTrueHeightAtPoint(x, z + edgeOffset));
-          // centre
-          localH = MAX(localH, GetTrueHeightAtPoint(x, z));
-          // sauvegarder ce valeur dans la matrice (pour les pas recursifs
-          // suivants)
-          quadMatrix[GetMatrixIndex(x + 1, z)] = localH;
-        }
-        // sur les autres niveaux, on utilise la valeur sauvegarde dans la
-        // matrice
-        else {
-          upperBound = 1.0f * minResolution / (2.0f * (minResolution - 1.0f));
-
-          d2 = (int)ceil(
-              MAX(upperBound * (float)GetQuadMatrixData(x, z), (float)localD2));
-          d2 = (int)ceil(
-              MAX(upperBound * (float)GetQuadMatrixData(x - edgeOffset, z),
-                  (float)d2));
-          d2 = (int)ceil(
-              MAX(upperBound * (float)GetQuadMatrixData(x + edgeOffset, z),
-                  (float)d2));
-          d2 = (int)ceil(
-              MAX(upperBound * (float)GetQuadMatrixData(x, z + edgeOffset),
-                  (float)d2));
-          d2 = (int)ceil(
-              MAX(upperBound * (float)GetQuadMatrixData(x, z - edgeOffset),
-                  (float)d2));
-
-          localH = GetTrueHeightAtPoint(x + childOffset, z + childOffset);
-          localH = MAX(localH,
-                       GetTrueHeightAtPoint(x + childOffset, z - childOffset));
-          localH = MAX(localH,
-                       GetTrueHeightAtPoint(x - childOffset, z - childOffset));
-          localH = MAX(localH,
-                       GetTrueHeightAtPoint(x - childOffset, z + childOffset));
-
-          quadMatrix[GetMatrixIndex(x + 1, z)] = localH;
-        }
-
-        // sauvegarder les valeurs d2 dans la matrice
-        quadMatrix[GetMatrixIndex(x, z)] = d2;
-        quadMatrix[GetMatrixIndex(x - 1, z)] = d2;
-
-        // la valeur se propage vers les noeuds voisins
-        quadMatrix[GetMatrixIndex(x - edgeOffset, z - edgeOffset)] =
-            MAX(GetQuadMatrixData(x - edgeOffset, z - edgeOffset), d2);
-        quadMatrix[GetMatrixIndex(x - edgeOffset, z + edgeOffset)] =
-            MAX(GetQuadMatrixData(x - edgeOffset, z + edgeOffset), d2);
-        quadMatrix[GetMatrixIndex(x + edgeOffset, z + edgeOffset)] =
-            MAX(GetQuadMatrixData(x + edgeOffset, z + edgeOffset), d2);
-        quadMatrix[GetMatrixIndex(x + edgeOffset, z - edgeOffset)] =
-            MAX(GetQuadMatrixData(x + edgeOffset, z - edgeOffset), d2);
-      }
-    }
-    // monter un niveau (elargir la taille d'un bloc, reduire le niveau de
-    // detail)
-    edgeLength = (edgeLength << 1);
-  }
-}
-
 // on determine la region capturee par la camera (en fct. de modelview et
 // projection) idee pour le code: Chris Cookson, gamersdev.net
 void QUADTREE::ComputeView(void) {
@@ -490,491 +726,95 @@ bool QUADTREE::CubeViewTest(float x, float y, float z, float size) {
   return true;
 }
 
-// decider si on sous-divise un noeud (ameliorer l'affichage si pret de la
-// camera)
+// choisir le niveau de detail des blocs: le quadtree n'est parcouru que
+// jusqu'aux blocs, en eliminant les noeuds hors de la vue
 void QUADTREE::RefineNode(float x, float z, int edgeLength) {
-  float viewDistance, f;
+  const float scale = scaleSize / sizeHeightMap;
+  float viewDistance, dx, dy, dz, halfEdge;
   float childOffset;
   int childEdgeLength;
-  int blend;
+  int lod, step;
   if (debugger)
     printf("RefineNode: %f,%f:%d\n", x, z, edgeLength);
 
   // tester les bords d'un cube contenant le vertex actuel contre l'intersection
-  // avec la vue
+  // avec la vue (les blocs elimines restent a -1)
   if (!CubeViewTest(x * scaleSize / sizeHeightMap,
                     GetScaledHeightAtPoint((int)x, (int)z) / sizeHeightMap,
                     z * scaleSize / sizeHeightMap,
                     edgeLength * scaleSize / sizeHeightMap)) //*2
-  {
-    // desactiver ce noeud et ne plus continuer la recursion
-    quadMatrix[GetMatrixIndex((int)x, (int)z)] = 0;
     return;
-  }
-
-  // calculer la distance entre le vertex et la camera, norme L1
-
-  viewDistance = (float)(fabs(pX - (x * scaleSize / sizeHeightMap)) +
-                         fabs(pY - GetScaledHeightAtPoint((int)x + 1, (int)z) /
-                                       sizeHeightMap) +
-                         fabs(pZ - (z * scaleSize / sizeHeightMap)));
-
-  // f: valeur qui decide si on subdivise un noeud ou non (selon l'article de
-  // Stefan Röttger sur le quadtree algo)
-  f = viewDistance /
-      ((float)edgeLength * minResolution * /*/sizeHeightMap* */
-       MAX((float)GetQuadMatrixData((int)x - 1, (int)z) / 3 * detailLevel,
-           1.0f));
-  if (debugger)
-    printf("f: %f\n", f);
-  if (f < 1.0f)
-    blend = 255;
-  else
-    blend = 0;
-
-  quadMatrix[GetMatrixIndex((int)x, (int)z)] = blend;
-
-  if (blend != 0) {
-    // si on a deja atteint le niveau de taille de noeud le plus petit: plus de
-    // sousdivision possible
-    if (edgeLength <= 2)
-      return;
-
-    // sinon, continuer la recursion du quadtree
-    else {
-      childOffset = (float)((edgeLength) >> 2);
-      childEdgeLength = (edgeLength) >> 1;
-
-      // effectuer du "refinement" recursivement
-      // bas gauche
-      RefineNode(x - childOffset, z - childOffset, childEdgeLength);
-      // bas droite
-      RefineNode(x + childOffset, z - childOffset, childEdgeLength);
-      // haut gauche
-      RefineNode(x - childOffset, z + childOffset, childEdgeLength);
-      // haut droite
-      RefineNode(x + childOffset, z + childOffset, childEdgeLength);
-      return;
-    }
-  }
-}
 
-// rendering (pas final!) du noeud (feuille) a la position x,z
-void QUADTREE::RenderNode(float x, float z, int edgeLength, bool multiTextures,
-                          bool detail) {
-  float texLeft, texBottom, midX, midZ, texRight, texTop;
-  float childOffset;
-  float edgeOffset;
-  int start, code;
-  int childEdgeLength;
-  int ichildOffset;
-  int iedgeOffset;
-  int adjOffset;
-  int suiteLength;
-  int suitePosition;
-  int blend;
-  int iX, iZ;
-
-  iX = (int)x;
-  iZ = (int)z;
-  if (debugger)
-    printf("RenderNode: %f,%f:%d\n", x, z, edgeLength);
-  // noeud marque "desactive": ne pas render
-  if (GetQuadMatrixData(iX, iZ) == 0)
+  // continuer la recursion du quadtree jusqu'aux blocs
+  if (edgeLength > chunkSize) {
+    childOffset = (float)((edgeLength) >> 2);
+    childEdgeLength = (edgeLength) >> 1;
+
+    // bas gauche
+    RefineNode(x - childOffset, z - childOffset, childEdgeLength);
+    // bas droite
+    RefineNode(x + childOffset, z - childOffset, childEdgeLength);
+    // haut gauche
+    RefineNode(x - childOffset, z + childOffset, childEdgeLength);
+    // haut droite
+    RefineNode(x + childOffset, z + childOffset, childEdgeLength);
     return;
-
-  // offset: puissances de 2; la position dans le Quadtree
-  iedgeOffset = (edgeLength) / 2;
-  edgeOffset = (edgeLength) / 2.0f;
-
-  // offset vers voisins
-  adjOffset = edgeLength; //-1;
-
-  if (detail && !multiTextures) {
-    // coord. des textures
-    texLeft = ((float)fabs(x - edgeOffset) / sizeHeightMap) * repeatDetailMap;
-    texBottom = ((float)fabs(z - edgeOffset) / sizeHeightMap) * repeatDetailMap;
-    texRight = ((float)fabs(x + edgeOffset) / sizeHeightMap) * repeatDetailMap;
-    texTop = ((float)fabs(z + edgeOffset) / sizeHeightMap) * repeatDetailMap;
-
-    midX = ((texLeft + texRight) / 2.0f);
-    midZ = ((texBottom + texTop) / 2.0f);
   }
 
-  else // multitextures disponibles (un seul parcours) ou pas de detail souhaite
-  {
-    texLeft = ((float)fabs(x - edgeOffset) / sizeHeightMap);
-    texBottom = ((float)fabs(z - edgeOffset) / sizeHeightMap);
-    texRight = ((float)fabs(x + edgeOffset) / sizeHeightMap);
-    texTop = ((float)fabs(z + edgeOffset) / sizeHeightMap);
+  SQT_CHUNK &chunk = GetChunk((int)x / chunkSize, (int)z / chunkSize);
+  // carte en tuiles: bloc pas encore construit
+  if (!chunk.vertices)
+    return;
 
-    midX = ((texLeft + texRight) / 2.0f);
-    midZ = ((texBottom + texTop) / 2.0f);
+  // distance entre la camera et le point le plus proche du bloc, norme L1
+  halfEdge = edgeLength * scale / 2.0f;
+  dx = MAX((float)fabs(pX - x * scale) - halfEdge, 0.0f);
+  dz = MAX((float)fabs(pZ - z * scale) - halfEdge, 0.0f);
+  dy = MAX(chunk.minHeight * scaleHeightMap / sizeHeightMap - pY,
+           pY - chunk.maxHeight * scaleHeightMap / sizeHeightMap);
+  viewDistance = dx + MAX(dy, 0.0f) + dz;
+  chunk.distance = viewDistance;
+
+  // garder le niveau le plus grossier qui ne serait pas subdivise selon
+  // l'article de Stefan Röttger: f = distance / (d * minResolution *
+  // MAX(d2 * detailLevel, 1)), avec d = 2*step l'arete d'un noeud du niveau
+  // et d2 = erreur / d
+  for (lod = numLods - 1; lod > 0; lod--) {
+    step = 1 << lod;
+    if (viewDistance >=
+        minResolution * MAX(chunk.error[lod] * detailLevel, 2.0f * step))
+      break;
   }
+  if (debugger)
+    printf("lod: %d\n", lod);
+  chunk.lod = lod;
+}
 
-  blend = GetQuadMatrixData(iX, iZ);
-
-  if (blend > 0) {
-    // noeud sur le niveau le plus petit
-    if (edgeLength <= 2) {
-      glBegin(GL_TRIANGLE_FAN);
-      // vertex au milieu
-      RenderVertex(x, z, midX, midZ, multiTextures);
-
-      //..bas gauche
-      RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                   multiTextures);
-
-      // bas milieu, on n'affiche pas si voisin moins detaille (eviter "CRACKS")
-      if (((iZ - adjOffset) <= 0) ||
-          GetQuadMatrixData(iX, iZ - adjOffset) != 0) {
-        RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-      }
-
-      // bas droite
-      RenderVertex(x + edgeOffset, z - edgeOffset, texRight, texBottom,
-                   multiTextures);
-
-      // milieu droite, on n'affiche pas si voisin moins detaille (eviter
-      // "CRACKS")
-      if (((iX + adjOffset) >= sizeHeightMap) ||
-          GetQuadMatrixData(iX + adjOffset, iZ) != 0) {
-        RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-      }
-
-      // haut droite
-      RenderVertex(x + edgeOffset, z + edgeOffset, texRight, texTop,
-                   multiTextures);
-
-      // haut milieu,on n'affiche pas si voisin moins detaille (eviter "CRACKS")
-      if (((iZ + adjOffset) >= sizeHeightMap) ||
-          GetQuadMatrixData(iX, iZ + adjOffset) != 0) {
-        RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
-      }
-
-      // haut gauche
-      RenderVertex(x - edgeOffset, z + edgeOffset, texLeft, texTop,
-                   multiTextures);
-
-      // gauche milieu, on n'affiche pas si voisin moins detaille (eviter
-      // "CRACKS")
-      if (((iX - adjOffset) <= 0) ||
-          GetQuadMatrixData(iX - adjOffset, iZ) != 0) {
-        RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-      }
-
-      // bas gauche
-      RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                   multiTextures);
-      glEnd();
-      return;
-    }
-
-    else // sur les autres niveaux: recursion
-    {
-      // position dans le quadtree
-      ichildOffset = (edgeLength) / 4;
-      childOffset = (float)ichildOffset;
-
-      childEdgeLength = (edgeLength) / 2;
-
-      // on calcule un code indiquant le type de suite de triangles a creer
-      //.. en fonction des valeurs dans notre quadtree-matrice
-      // haut droite
-      code = (GetQuadMatrixData(iX + ichildOffset, iZ + ichildOffset) != 0) * 8;
-
-      // haut gauche
-      code |=
-          (GetQuadMatrixData(iX - ichildOffset, iZ + ichildOffset) != 0) * 4;
-
-      // bas gauche
-      code |=
-          (GetQuadMatrixData(iX - ichildOffset, iZ - ichildOffset) != 0) * 2;
-
-      // bas droite
-      code |= (GetQuadMatrixData(iX + ichildOffset, iZ - ichildOffset) != 0);
-
-      // pas d'affichage de ce noeud, car il est compose de 4 "enfants" qui
-      // seront affiches recursivement
-      if (code == QT_NO_FAN) {
-        // bas gauche
-        RenderNode(x - childOffset, z - childOffset, childEdgeLength);
-        // bas droite
-        RenderNode(x + childOffset, z - childOffset, childEdgeLength);
-        // haut gauche
-        RenderNode(x - childOffset, z + childOffset, childEdgeLength);
-        // haut droite
-        RenderNode(x + childOffset, z + childOffset, childEdgeLength);
-        return;
-      }
-
-      // a afficher: bas gauche, haut droite; les autres sont des enfants
-      if (code == QT_LL_UR) {
-        // suite de triangles en haut droite
-        glBegin(GL_TRIANGLE_FAN);
-        // milieu
-        RenderVertex(x, z, midX, midZ, multiTextures);
-
-        // droite milieu
-        RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-
-        // haut droite
-        RenderVertex(x + edgeOffset, z + edgeOffset, texRight, texTop,
-                     multiTextures);
-
-        // haut milieu
-        RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
-        glEnd();
-
-        // suite en bas gauche
-        glBegin(GL_TRIANGLE_FAN);
-        // milieu
-        RenderVertex(x, z, midX, midZ, multiTextures);
-
-        // gauche milieu
-        RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-
-        // bas gauche
-        RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                     multiTextures);
-
-        // bas milieu
-        RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-        glEnd();
-
-        // recursion haut gauche, bas droite
-        RenderNode(x - childOffset, z + childOffset, childEdgeLength);
-        RenderNode(x + childOffset, z - childOffset, childEdgeLength);
-        return;
-      }
-
-      // a afficher: triangles bas-droite, haut-gauche; les autres: enfants
-      if (code == QT_LR_UL) {
-        // haut gauche
-        glBegin(GL_TRIANGLE_FAN);
-        // milieu
-        RenderVertex(x, z, midX, midZ, multiTextures);
-
-        // haut milieu
-        RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
-
-        // haut gauche
-        RenderVertex(x - edgeOffset, z + edgeOffset, texLeft, texTop,
-                     multiTextures);
-
-        // milieu gauche
-        RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-        glEnd();
-
-        // bas droite
-        glBegin(GL_TRIANGLE_FAN);
-        // milieu
-        RenderVertex(x, z, midX, midZ, multiTextures);
-
-        // bas milieu
-        RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-
-        // bas droite
-        RenderVertex(x + edgeOffset, z - edgeOffset, texRight, texBottom,
-                     multiTextures);
-
-        // droite milieu
-        RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-        glEnd();
-
-        // recursion haut droite, bas gauche: enfants
-        RenderNode(x + childOffset, z + childOffset, childEdgeLength);
-        RenderNode(x - childOffset, z - childOffset, childEdgeLength);
-        return;
-      }
-
-      // feuille: pas d'enfants, rendering complet a faire
-      if (code == QT_COMPLETE_FAN) {
-        glBegin(GL_TRIANGLE_FAN);
-        // vertex au milieu
-        RenderVertex(x, z, midX, midZ, multiTextures);
-
-        //..bas gauche
-        RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                     multiTextures);
-
-        // bas milieu, on n'affiche pas si voisin moins detaille (eviter
-        // "CRACKS")
-        if (((iZ - adjOffset) <= 0) ||
-            GetQuadMatrixData(iX, iZ - adjOffset) != 0) {
-          RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-        }
-
-        // bas droite
-        RenderVertex(x + edgeOffset, z - edgeOffset, texRight, texBottom,
-                     multiTextures);
-
-        // milieu droite, on n'affiche pas si voisin moins detaille (eviter
-        // "CRACKS")
-        if (((iX + adjOffset) >= sizeHeightMap) ||
-            GetQuadMatrixData(iX + adjOffset, iZ) != 0) {
-          RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-        }
-
-        // haut droite
-        RenderVertex(x + edgeOffset, z + edgeOffset, texRight, texTop,
-                     multiTextures);
-
-        // haut milieu,on n'affiche pas si voisin moins detaille (eviter
-        // "CRACKS")
-        if (((iZ + adjOffset) >= sizeHeightMap) ||
-            GetQuadMatrixData(iX, iZ + adjOffset) != 0) {
-          RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
-        }
-
-        // haut gauche
-        RenderVertex(x - edgeOffset, z + edgeOffset, texLeft, texTop,
-                     multiTextures);
-
-        // gauche milieu, on n'affiche pas si voisin moins detaille (eviter
-        // "CRACKS")
-        if (((iX - adjOffset) <= 0) ||
-            GetQuadMatrixData(iX - adjOffset, iZ) != 0) {
-          RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-        }
-
-        // bas gauche
-        RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                     multiTextures);
-        glEnd();
-        return;
-      }
-
-      // il reste les suites partielles a afficher; on utilise les codes pour
-      // faciliter le choix de triang.  cette partie est quasiment directement
-      // copie de l'article de Stefan Röttger;
-      //.. les codes des suites partielles sont pas evidents.. (code binaire
-      //pour representer un quadtree)  suite partielle = repartition
-      // non-symmetrique entre enfants recursifs et feuilles
-      start = suiteStart[code];
-      suiteLength = 0;
-
-      // l'indice du permier bit non-null du code indique la taille de la suite
-      // a creer
-      while (!(((long)suiteCode[code]) & (1 << suiteLength)) && suiteLength < 8)
-        suiteLength++;
-
-      // rendering
-      glBegin(GL_TRIANGLE_FAN);
-      // milieu recursif
-      RenderVertex(x, z, midX, midZ, multiTextures);
-
-      for (suitePosition = suiteLength; suitePosition > 0; suitePosition--) {
-        switch (start) {
-        // bas droite
-        case QT_LR_NODE:
-          // bas milieu, ne pas afficher si voisin moins detaille
-          if (((iZ - adjOffset) <= 0) ||
-              GetQuadMatrixData(iX, iZ - adjOffset) != 0 ||
-              suitePosition == suiteLength) {
-            RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-          }
-
-          // bas droite
-          RenderVertex(x + edgeOffset, z - edgeOffset, texRight, texBottom,
-                       multiTextures);
-
-          // droit milieu
-          if (suitePosition == 1) {
-            RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-          }
-          break;
-
-        // bas gauche
-        case QT_LL_NODE:
-          // gauche milieu, ne pas afficher si voisin moins detaille
-          if (((x - adjOffset) <= 0) ||
-              GetQuadMatrixData(iX - adjOffset, iZ) != 0 ||
-              suitePosition == suiteLength) {
-            RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-          }
-
-          // bas gauche
-          RenderVertex(x - edgeOffset, z - edgeOffset, texLeft, texBottom,
-                       multiTextures);
-
-          // bas milieu
-          if (suitePosition == 1) {
-            RenderVertex(x, z - edgeOffset, midX, texBottom, multiTextures);
-          }
-          break;
-
-        // haut gauche
-        case QT_UL_NODE:
-          // haut milieu, ne pas afficher si voisin moins detaille
-          if (((iZ + adjOffset) >= sizeHeightMap) ||
-              GetQuadMatrixData(iX, iZ + adjOffset) != 0 ||
-              suitePosition == suiteLength) {
-            RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
-          }
-
-          // haut gauche
-          RenderVertex(x - edgeOffset, z + edgeOffset, texLeft, texTop,
-                       multiTextures);
-
-          // gauche milieu
-          if (suitePosition == 1) {
-            RenderVertex(x - edgeOffset, z, texLeft, midZ, multiTextures);
-          }
-          break;
-
-        // haut droite
-        case QT_UR_NODE:
-          // droit milieu, ne pas afficher si voisin moins detaille
-          if (((iX + adjOffset) >= sizeHeightMap) ||
-              GetQuadMatrixData(iX + adjOffset, iZ) != 0 ||
-              suitePosition == suiteLength) {
-            RenderVertex(x + edgeOffset, z, texRight, midZ, multiTextures);
-          }
-
-          // haut droite
-          RenderVertex(x + edgeOffset, z + edgeOffset, texRight, texTop,
-                       multiTextures);
-
-          // haut milieu
-          if (suitePosition == 1) {
-            RenderVertex(x, z + edgeOffset, midX, texTop, multiTextures);
+// les coutures ne relient que des blocs voisins dont les niveaux de detail
+// different d'au plus un: raffiner les blocs trop grossiers
+void QUADTREE::RestrictLods(void) {
+  int i, j, k, lod;
+  bool changed = true;
+  static const int neighbors[4][2] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+
+  while (changed) {
+    changed = false;
+    for (j = 0; j < numChunks; j++) {
+      for (i = 0; i < numChunks; i++) {
+        SQT_CHUNK &chunk = GetChunk(i, j);
+        if (chunk.lod < 0)
+          continue;
+        for (k = 0; k < 4; k++) {
+          if (i + neighbors[k][0] < 0 || i + neighbors[k][0] >= numChunks ||
+              j + neighbors[k][1] < 0 || j + neighbors[k][1] >= numChunks)
+            continue;
+          lod = GetChunk(i + neighbors[k][0], j + neighbors[k][1]).lod;
+          if (lod >= 0 && chunk.lod > lod + 1) {
+            chunk.lod = lod + 1;
+            changed = true;
           }
-          break;
-        }
-        start--;
-        start &= 3;
-      }
-      glEnd();
-
-      // pour les cas toujours pas traites, on continue la recursion
-      for (suitePosition = (4 - suiteLength); suitePosition > 0;
-           suitePosition--) {
-        switch (start) {
-        // bas droite
-        case QT_LR_NODE:
-          RenderNode(x + childOffset, z - childOffset, childEdgeLength);
-          break;
-
-        // bas gauche
-        case QT_LL_NODE:
-          RenderNode(x - childOffset, z - childOffset, childEdgeLength);
-          break;
-
-        // haut gauche
-        case QT_UL_NODE:
-          RenderNode(x - childOffset, z + childOffset, childEdgeLength);
-          break;
-
-        // haut droite
-        case QT_UR_NODE:
-          RenderNode(x + childOffset, z + childOffset, childEdgeLength);
-          break;
         }
-        start--;
-        start &= 3;
       }
-      return;
     }
   }
 }
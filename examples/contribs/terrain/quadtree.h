@@ -8,17 +8,7 @@
 #include <qgl.h>
 #include <stdio.h>
 
-#define QT_LR_NODE 0
-#define QT_LL_NODE 1
-#define QT_UL_NODE 2
-#define QT_UR_NODE 3
-
-// codes decrivant le type de suite de triangles a creer, selon la presence
-// d'enfants recursives
-#define QT_COMPLETE_FAN 0
-#define QT_LL_UR 5
-#define QT_LR_UL 10
-#define QT_NO_FAN 15
+class QOpenGLBuffer;
 
 #define VIEW_RIGHT 0
 #define VIEW_LEFT 1
@@ -27,14 +17,54 @@
 #define VIEW_FAR 4
 #define VIEW_NEAR 5
 
+// taille maximale d'un bloc (chunk) du terrain, en quads (puissance de 2)
+#define QT_CHUNK_SIZE 32
+// niveaux de detail d'un bloc: pas de 1 a QT_CHUNK_SIZE entre les vertex
+#define QT_MAX_LODS 6
+
+// coutures (stitching): un bit par bord dont le voisin est moins detaille
+#define QT_STITCH_BOTTOM 1 // z minimal
+#define QT_STITCH_RIGHT 2  // x maximal
+#define QT_STITCH_TOP 4    // z maximal
+#define QT_STITCH_LEFT 8   // x minimal
+#define QT_NUM_STITCHES 16
+
+// carte en tuiles: nombre maximal de blocs construits par image
+#define QT_MAX_UPLOADS 64
+
 struct SQT_VERTEX {
   float height;
 };
 
+// un bloc du terrain: sa geometrie reste sur la carte graphique
+struct SQT_CHUNK {
+  QOpenGLBuffer *vertices; // x,hauteur,z en GL_SHORT, relatifs au bloc
+  QOpenGLBuffer *colors;   // ombrages de la lightmap
+  unsigned char minHeight, maxHeight;
+  float error[QT_MAX_LODS]; // erreur geometrique maximale de chaque niveau
+  int lod;                  // niveau choisi par RefineNode, -1 si invisible
+  float distance;           // a la camera, calculee par RefineNode
+  int page; // niveau de la page de texture virtuelle, choisi par RequestPages
+};
+
 class QUADTREE : public TERRAIN {
 private:
-  // matrice quadtree
-  unsigned char *quadMatrix;
+  // blocs du terrain, numChunks*numChunks
+  SQT_CHUNK *chunks;
+  int numChunks; // par cote
+  int chunkSize; // en quads
+  int numLods;
+  int chunksLightVersion; // lightMapVersion des couleurs chargees
+
+  // carte en tuiles: blocs construits a partir des tuiles chargees
+  QList<int> uploadedChunks;
+  int pagingRadius; // en tuiles, autour de la camera
+
+  // un seul index buffer pour tous les blocs: toutes les combinaisons
+  // niveau de detail / coutures y sont rangees a la suite
+  QOpenGLBuffer *indices;
+  int indexOffset[QT_MAX_LODS][QT_NUM_STITCHES];
+  int indexCount[QT_MAX_LODS][QT_NUM_STITCHES];
 
   // matrice decrivant la region vue par la camera
   float viewMatrix[6][4];
@@ -44,14 +74,33 @@ private:
   // niveau de detail
   float detailLevel;   // souhaite
   float minResolution; // minimum
+  float pageResolution; // pixels par radian: densite des pages souhaitee
 
-  void PropagateRoughness(void);
+  void CalculateChunkErrors(SQT_CHUNK &chunk, int x0, int z0);
   void RefineNode(float x, float z, int edgeLength);
-  void RenderNode(float x, float z, int edgeLength, bool multiTextures = true,
-                  bool detail = true);
-  void RenderVertex(float x, float z, float u, float v, bool multiTextures);
+  void RestrictLods(void);
+  void UploadChunks(void);
+  void UploadChunk(int i, int j);
+  void UploadChunkColors(void);
+  void UploadChunkColors(int i, int j);
+  void UpdateTiledChunks(void);
+  void RequestPages(void);
+  void BuildIndices(void);
+  void ReleaseChunks(void);
+  void RenderChunks(bool colorPages);
+
+  inline SQT_CHUNK &GetChunk(int i, int j) {
+    return chunks[(j * numChunks) + i];
+  }
 
-  inline int GetMatrixIndex(int X, int Z) { return ((Z * sizeHeightMap) + X); }
+  // hauteur sans echelle, en repetant le dernier vertex au bord de la carte
+  inline unsigned char GetClampedHeightAtPoint(int X, int Z) {
+    if (X >= sizeHeightMap)
+      X = sizeHeightMap - 1;
+    if (Z >= sizeHeightMap)
+      Z = sizeHeightMap - 1;
+    return GetTrueHeightAtPoint(X, Z);
+  }
 
 public:
   bool Init(void);
@@ -73,17 +122,36 @@ public:
 
   inline void SetMinResolution(float res) { minResolution = res; }
 
-  inline unsigned char GetQuadMatrixData(int X, int Z) {
-    if ((X > sizeHeightMap) || (X < 0) || (Z > sizeHeightMap) || (Z < 0)) {
-      printf("Matrix limits exceeded: %d,%d\n", X, Z);
-      return 255;
-    }
-    return quadMatrix[(Z * sizeHeightMap) + X];
+  // texture virtuelle: une page par bloc au niveau le plus fin
+  inline void GenerateVirtualTexture(void) {
+    TERRAIN::GenerateVirtualTexture(chunkSize);
   }
 
+  // hauteur de la fenetre / (2 * tan(fov / 2)): les pages sont choisies pour
+  // avoir au moins un texel par pixel
+  inline void SetPageResolution(float res) { pageResolution = res; }
+
+  // blocs du terrain, pour les objets poses dessus (voir TREE)
+  inline int GetNumChunks(void) { return chunks ? numChunks : 0; }
+  inline int GetChunkSize(void) { return chunkSize; }
+
+  // apres Update(): le bloc (i, j) a ete retenu par RefineNode
+  inline bool IsChunkVisible(int i, int j) { return GetChunk(i, j).lod >= 0; }
+
+  // carte en tuiles: charger les tuiles jusqu'a radius tuiles de la camera
+  inline void SetPagingRadius(int radius) { pagingRadius = radius; }
+
   QUADTREE(void) {
     detailLevel = 2.5f;   // 50.0f;
     minResolution = 1.2f; // 10.0f;
+    pageResolution = 500.0f;
+    chunks = NULL;
+    numChunks = 0;
+    chunkSize = 0;
+    numLods = 0;
+    chunksLightVersion = -1;
+    indices = NULL;
+    pagingRadius = 2;
   }
 
   ~QUADTREE(void) {}
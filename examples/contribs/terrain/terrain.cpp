@@ -1,12 +1,33 @@
 // TP OpenGL: Joerg Liebelt, Serigne Sow
 #include "terrain.h"
 #include <math.h>
+#include <qcryptographichash.h>
+#include <qdir.h>
 #include <qfile.h>
+#include <qrunnable.h>
+#include <qstandardpaths.h>
+#include <qthread.h>
+#include <qthreadpool.h>
 #include <stdio.h>
 #include <time.h>
 
+// execute un intervalle de lignes d'un pre-calcul de TERRAIN dans un thread
+class TerrainRows : public QRunnable {
+public:
+  TerrainRows(TERRAIN *terrain, void (TERRAIN::*rows)(int, int), int firstRow,
+              int lastRow)
+      : terrain(terrain), rows(rows), firstRow(firstRow), lastRow(lastRow) {}
+
+  virtual void run() { (terrain->*rows)(firstRow, lastRow); }
+
+private:
+  TERRAIN *terrain;
+  void (TERRAIN::*rows)(int, int);
+  int firstRow, lastRow;
+};
+
 bool TERRAIN::LoadHeightMap(const QString &filename, int size) {
-  if (heightMap.arrayHeightMap)
+  if (heightMap.arrayHeightMap || heightTiles)
     UnloadHeightMap();
 
   QFile pFile(filename);
@@ -22,6 +43,8 @@ bool TERRAIN::LoadHeightMap(const QString &filename, int size) {
   if (heightMap.arrayHeightMap == NULL)
     return false;
 
+  sizeHeightMap = size;
+
   // lire la carte d'hauteurs, format RAW
   QDataStream in(&pFile);
   for (int i = 0; i < sizeHeightMap * sizeHeightMap; i++)
@@ -29,8 +52,6 @@ bool TERRAIN::LoadHeightMap(const QString &filename, int size) {
 
   pFile.close();
 
-  sizeHeightMap = size;
-
   return true;
 }
 
@@ -56,8 +77,19 @@ bool TERRAIN::SaveHeightMap(const QString &filename) {
 }
 
 bool TERRAIN::UnloadHeightMap(void) {
+  // les threads de la texture virtuelle lisent la carte
+  virtualTexture.Abort();
+
   if (heightMap.arrayHeightMap) {
     delete[] heightMap.arrayHeightMap;
+    heightMap.arrayHeightMap = NULL;
+
+    sizeHeightMap = 0;
+  }
+
+  if (heightTiles) {
+    delete heightTiles;
+    heightTiles = NULL;
 
     sizeHeightMap = 0;
   }
@@ -65,6 +97,29 @@ bool TERRAIN::UnloadHeightMap(void) {
   return true;
 }
 
+// projeter une carte en tuiles (creee par SaveTiledHeightMap()); au plus
+// maxResidentTiles tuiles sont chargees en meme temps
+bool TERRAIN::LoadTiledHeightMap(const QString &filename,
+                                 int maxResidentTiles) {
+  UnloadHeightMap();
+
+  heightTiles = new HEIGHTTILES();
+  if (!heightTiles->Open(filename, maxResidentTiles)) {
+    delete heightTiles;
+    heightTiles = NULL;
+    return false;
+  }
+
+  sizeHeightMap = heightTiles->Size();
+  return true;
+}
+
+// convertir la carte en memoire au format en tuiles
+bool TERRAIN::SaveTiledHeightMap(const QString &filename, int tileSize) {
+  return HEIGHTTILES::Save(filename, heightMap.arrayHeightMap, sizeHeightMap,
+                           tileSize);
+}
+
 void TERRAIN::Smooth1DTerrain(
     float *heightData, int kernelSize) // filtrage unidirectionel (moins lisse)
 {
@@ -160,7 +215,7 @@ bool TERRAIN::MakeTerrainFault(int size, int iterations, int min, int max,
   int i;
   srand(time(NULL));
 
-  if (heightMap.arrayHeightMap)
+  if (heightMap.arrayHeightMap || heightTiles)
     UnloadHeightMap();
 
   sizeHeightMap = size;
@@ -372,18 +427,62 @@ unsigned char TERRAIN::InterpolateHeight(int x, int z, float heightToTexRatio) {
   return ((unsigned char)((X + Z) / 2));
 }
 
-// creer une carte de texture en melangeant les quatres types de textures de
-// base
-void TERRAIN::GenerateTextureMap(unsigned int size) {
-  unsigned char Red, Green, Blue;
-  unsigned int tempID;
-  unsigned int x, z;
-  unsigned int TexX, TexZ;
+// calculer les lignes firstRow..lastRow-1 de la texture de couleur. Les
+// lignes sont ecrites directement (myTexture a ete detachee par
+// GenerateTextureMap(), constBits() evite un detach() dans chaque thread)
+void TERRAIN::GenerateTextureRows(int firstRow, int lastRow) {
+  const int size = myTexture.width();
+  const int bytesPerLine = myTexture.bytesPerLine();
+  unsigned char *const bits =
+      const_cast<unsigned char *>(myTexture.constBits());
+  // relation entre resolution de la carte d'hauteur et la res. de la texture
+  //.. en general, la texture aura une res. plus elevee
+  const float mapRatio = (float)sizeHeightMap / size;
   float totalRed, totalGreen, totalBlue;
-  float blend[4];
-  float mapRatio;
+  unsigned char height;
+  QRgb color;
+  int x, z, i;
+
+  for (z = firstRow; z < lastRow; z++) {
+    QRgb *line = reinterpret_cast<QRgb *>(bits + z * bytesPerLine);
+    for (x = 0; x < size; x++) {
+      totalRed = 0.0f;
+      totalGreen = 0.0f;
+      totalBlue = 0.0f;
+
+      // on interpole la vraie hauteur pour avoir des textures plus realistes
+      height = Limit(InterpolateHeight(x, z, mapRatio));
+
+      // pour chaque texture de base
+      for (i = 0; i < TRN_NUM_TILES; i++) {
+        const QImage &tile = textures.data[i];
+        if (tile.isNull())
+          continue;
+
+        // la texture de base est repetee sur toute la carte (GetTexCoords())
+        color = reinterpret_cast<const QRgb *>(
+            tile.constScanLine(z % tile.height()))[x % tile.width()];
+
+        // ajouter le pourcentage de cette texture de base a la couleur
+        totalRed += qRed(color) * regionBlend[i][height];
+        totalGreen += qGreen(color) * regionBlend[i][height];
+        totalBlue += qBlue(color) * regionBlend[i][height];
+      }
+
+      // limiter les valeurs a 0..255
+      line[x] = qRgb(Limit(totalRed), Limit(totalGreen), Limit(totalBlue));
+    }
+  }
+}
+
+// preparer le melange des textures de base, commun a GenerateTextureMap() et
+// aux pages de la texture virtuelle
+void TERRAIN::PrepareTextureBlend(void) {
   int lastHeight;
-  int i;
+  int i, h;
+
+  // les threads de la texture virtuelle lisent les textures de base
+  virtualTexture.Abort();
 
   // determiner le nombre de textures de bases presentes
   textures.numTextures = 0;
@@ -405,54 +504,63 @@ void TERRAIN::GenerateTextureMap(unsigned int size) {
     }
   }
 
+  // le pourcentage de chaque texture de base ne depend que de la hauteur:
+  // on le calcule une seule fois pour les 256 hauteurs
+  for (i = 0; i < TRN_NUM_TILES; i++) {
+    for (h = 0; h < 256; h++)
+      regionBlend[i][h] =
+          textures.data[i].isNull() ? 0.0f : RegionPercent(i, (unsigned char)h);
+  }
+
+  // acces direct aux lignes des textures de base (pixels de 32 bits)
+  for (i = 0; i < TRN_NUM_TILES; i++) {
+    if (!textures.data[i].isNull() &&
+        textures.data[i].format() != QImage::Format_RGB32 &&
+        textures.data[i].format() != QImage::Format_ARGB32)
+      textures.data[i] = textures.data[i].convertToFormat(QImage::Format_RGB32);
+  }
+}
+
+// creer une carte de texture en melangeant les quatres types de textures de
+// base
+void TERRAIN::GenerateTextureMap(unsigned int size) {
+  unsigned int tempID;
+  QCryptographicHash parameters(QCryptographicHash::Sha1);
+  QByteArray key;
+  int i;
+
+  // la texture couvrirait toute la carte
+  if (heightTiles) {
+    printf("No texture map for a tiled height map\n");
+    return;
+  }
+
+  PrepareTextureBlend();
+
+  // les textures de base caracterisent aussi la texture creee dans le cache
+  parameters.addData(QByteArray::number(size));
+  for (i = 0; i < TRN_NUM_TILES; i++) {
+    if (textures.data[i].isNull())
+      continue;
+    parameters.addData(
+        reinterpret_cast<const char *>(textures.data[i].constBits()),
+        textures.data[i].bytesPerLine() * textures.data[i].height());
+  }
+
 #if QT_VERSION < 0x040000
   myTexture.create(size, size, 32);
 #else
   myTexture = QImage(size, size, QImage::Format_ARGB32);
 #endif
 
-  // determiner relation entre resolution de la carte d'hauteur et la res. de la
-  // texture
-  //.. en general, la texture aura une res. plus elevee
-  mapRatio = (float)sizeHeightMap / size;
-
-  // creation de texture
-  for (z = 0; z < size; z++) {
-    for (x = 0; x < size; x++) {
-      totalRed = 0.0f;
-      totalGreen = 0.0f;
-      totalBlue = 0.0f;
-
-      // pour chaque texture de base
-      for (i = 0; i < TRN_NUM_TILES; i++) {
-        if (!textures.data[i].isNull()) {
-          TexX = x;
-          TexZ = z;
-
-          // quel pixel de texture a choisir pour cette position sur la carte?
-          GetTexCoords(textures.data[i], &TexX, &TexZ);
-
-          // quelle est la couleur actuelle a cet endroit?
-          GetColor(textures.data[i], TexX, TexZ, &Red, &Green, &Blue);
-
-          // combien de pourcent de cette texture de base faut-il ajouter a cet
-          // endroit?
-          //.. on interpole la vraie hauteur pour avoir des textures plus
-          //realistes
-          blend[i] = RegionPercent(i, Limit(InterpolateHeight(x, z, mapRatio)));
-
-          // ajouter ce pourcentage a la couleur
-          totalRed += Red * blend[i];
-          totalGreen += Green * blend[i];
-          totalBlue += Blue * blend[i];
-        }
-      }
-
-      // modifier la couleur de la texture a cet endroit, limiter les valeurs a
-      // 0..255
-      SetColor(myTexture, x, z, Limit(totalRed), Limit(totalGreen),
-               Limit(totalBlue));
-    }
+  // creation de texture, ligne par ligne sur tous les processeurs, sauf si
+  // elle est dans le cache
+  key = CacheKey(parameters.result());
+  if (!LoadCache("texture", key, myTexture.bits(),
+                 (qint64)myTexture.bytesPerLine() * myTexture.height())) {
+    RunRows(&TERRAIN::GenerateTextureRows, size);
+    SaveCache("texture", key, myTexture.constBits(),
+              (qint64)myTexture.bytesPerLine() * myTexture.height());
   }
 
   // construire la texture
@@ -485,6 +593,150 @@ void TERRAIN::GenerateTextureMap(unsigned int size) {
   myTexture.save("texture.bmp", "BMP");
 }
 
+// hauteur interpolee bilineairement au point (x,z) de la carte, en repetant
+// les hauteurs du bord au-dela
+float TERRAIN::InterpolateHeightAt(float x, float z) {
+  int x0, z0, x1, z1;
+  float low, high;
+
+  x = qBound(0.0f, x, (float)(sizeHeightMap - 1));
+  z = qBound(0.0f, z, (float)(sizeHeightMap - 1));
+  x0 = (int)x;
+  z0 = (int)z;
+  x1 = qMin(x0 + 1, sizeHeightMap - 1);
+  z1 = qMin(z0 + 1, sizeHeightMap - 1);
+  x -= x0;
+  z -= z0;
+
+  low = GetTrueHeightAtPoint(x0, z0) +
+        (GetTrueHeightAtPoint(x1, z0) - GetTrueHeightAtPoint(x0, z0)) * x;
+  high = GetTrueHeightAtPoint(x0, z1) +
+         (GetTrueHeightAtPoint(x1, z1) - GetTrueHeightAtPoint(x0, z1)) * x;
+  return low + (high - low) * z;
+}
+
+// couleur interpolee bilineairement au point (u,v) d'une texture de base, en
+// texels, la texture etant repetee sur toute la carte
+static QRgb SampleTile(const QImage &tile, float u, float v) {
+  const int width = tile.width();
+  const int height = tile.height();
+  const int x = (int)floorf(u - 0.5f);
+  const int y = (int)floorf(v - 0.5f);
+  const float fx = u - 0.5f - x;
+  const float fy = v - 0.5f - y;
+  const int x0 = ((x % width) + width) % width;
+  const int y0 = ((y % height) + height) % height;
+  const int x1 = (x0 + 1) % width;
+  const int y1 = (y0 + 1) % height;
+  const QRgb *line0 = reinterpret_cast<const QRgb *>(tile.constScanLine(y0));
+  const QRgb *line1 = reinterpret_cast<const QRgb *>(tile.constScanLine(y1));
+  const float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy);
+  const float w01 = (1.0f - fx) * fy, w11 = fx * fy;
+
+  return qRgb((int)(qRed(line0[x0]) * w00 + qRed(line0[x1]) * w10 +
+                    qRed(line1[x0]) * w01 + qRed(line1[x1]) * w11),
+              (int)(qGreen(line0[x0]) * w00 + qGreen(line0[x1]) * w10 +
+                    qGreen(line1[x0]) * w01 + qGreen(line1[x1]) * w11),
+              (int)(qBlue(line0[x0]) * w00 + qBlue(line0[x1]) * w10 +
+                    qBlue(line1[x0]) * w01 + qBlue(line1[x1]) * w11));
+}
+
+// remplacer la texture de couleur par la texture virtuelle: seules les pages
+// vues, avec une resolution selon leur distance, sont generees
+void TERRAIN::GenerateVirtualTexture(int pageSamples) {
+  QImage image;
+  int i;
+
+  // pas de pages pendant la pagination des tuiles d'hauteurs
+  if (heightTiles) {
+    printf("No virtual texture for a tiled height map\n");
+    return;
+  }
+
+  PrepareTextureBlend();
+
+  // les pages eloignees prennent leurs couleurs dans des textures de base
+  // reduites, sans quoi elles seraient pleines d'aliasing
+  for (i = 0; i < TRN_NUM_TILES; i++) {
+    tileMips[i].clear();
+    image = textures.data[i];
+    while (!image.isNull() && (image.width() > 1 || image.height() > 1)) {
+      image = image
+                  .scaled(qMax(1, image.width() / 2),
+                          qMax(1, image.height() / 2), Qt::IgnoreAspectRatio,
+                          Qt::SmoothTransformation)
+                  .convertToFormat(QImage::Format_RGB32);
+      tileMips[i].append(image);
+    }
+  }
+
+  if (!virtualTexture.Init(this, sizeHeightMap, pageSamples))
+    printf("Virtual texture init failed\n");
+}
+
+// meme melange que GenerateTextureRows(), aux positions des texels de la page
+void TERRAIN::GenerateTexturePage(QImage &page, int x0, int z0, int extent) {
+  const int size = page.width();
+  // hauteurs par texel de la page
+  const float step = (float)extent / VT_PAGE_SIZE;
+  const QImage *tiles[TRN_NUM_TILES];
+  float tileScaleX[TRN_NUM_TILES], tileScaleZ[TRN_NUM_TILES];
+  // texels des textures de base par texel de la page
+  float density = TRN_TILE_DENSITY * step;
+  float totalRed, totalGreen, totalBlue;
+  float x, z;
+  unsigned char height;
+  QRgb color;
+  int tx, tz, i;
+  int mip = 0;
+
+  // niveau des textures de base: pas plus d'un de leurs texels par texel
+  // de la page
+  while (density >= 2.0f) {
+    density /= 2.0f;
+    mip++;
+  }
+  for (i = 0; i < TRN_NUM_TILES; i++) {
+    if (textures.data[i].isNull()) {
+      tiles[i] = NULL;
+      continue;
+    }
+    if (mip == 0 || tileMips[i].isEmpty())
+      tiles[i] = &textures.data[i];
+    else
+      tiles[i] = &tileMips[i][qMin(mip, tileMips[i].size()) - 1];
+    // une texture reduite couvre la meme surface du terrain
+    tileScaleX[i] = (float)TRN_TILE_DENSITY * tiles[i]->width() /
+                    textures.data[i].width();
+    tileScaleZ[i] = (float)TRN_TILE_DENSITY * tiles[i]->height() /
+                    textures.data[i].height();
+  }
+
+  for (tz = 0; tz < size; tz++) {
+    QRgb *line = reinterpret_cast<QRgb *>(page.scanLine(tz));
+    z = z0 + (tz - VT_BORDER + 0.5f) * step;
+    for (tx = 0; tx < size; tx++) {
+      x = x0 + (tx - VT_BORDER + 0.5f) * step;
+      totalRed = 0.0f;
+      totalGreen = 0.0f;
+      totalBlue = 0.0f;
+
+      height = Limit(InterpolateHeightAt(x, z));
+
+      for (i = 0; i < TRN_NUM_TILES; i++) {
+        if (!tiles[i])
+          continue;
+        color = SampleTile(*tiles[i], x * tileScaleX[i], z * tileScaleZ[i]);
+        totalRed += qRed(color) * regionBlend[i][height];
+        totalGreen += qGreen(color) * regionBlend[i][height];
+        totalBlue += qBlue(color) * regionBlend[i][height];
+      }
+
+      line[tx] = qRgb(Limit(totalRed), Limit(totalGreen), Limit(totalBlue));
+    }
+  }
+}
+
 // on calcule les positions d'ombrages
 //..idee de la methode: si entre un point et la source de lumiere, dans la
 //direction
@@ -497,8 +749,16 @@ void TERRAIN::GenerateTextureMap(unsigned int size) {
 //.. et on ne tient pas compte de l'hauteur de la source de lumiere! (seulement
 //le vertex directement a cote compte)
 void TERRAIN::CalculateLighting(void) {
-  float shade;
-  int x, z;
+  QByteArray key;
+
+  // la lightmap couvrirait toute la carte: pas d'ombrages en tuiles
+  if (heightTiles) {
+    delete[] lightMap.arrayLightMap;
+    lightMap.arrayLightMap = NULL;
+    lightMap.sizeLightMap = 0;
+    lightMapVersion++;
+    return;
+  }
 
   if (lightMap.sizeLightMap != sizeHeightMap ||
       lightMap.arrayLightMap == NULL) {
@@ -507,15 +767,41 @@ void TERRAIN::CalculateLighting(void) {
     lightMap.sizeLightMap = sizeHeightMap;
   }
 
-  // pour chaque vertex
-  for (z = 0; z < sizeHeightMap; z++) {
+  // chaque direction de lumiere a sa propre lightmap dans le cache
+  key = CacheKey(QByteArray::number(directionX) + ' ' +
+                 QByteArray::number(directionZ) + ' ' +
+                 QByteArray::number(lightSoftness) + ' ' +
+                 QByteArray::number(minBrightness) + ' ' +
+                 QByteArray::number(maxBrightness));
+  if (!LoadCache("lighting", key, lightMap.arrayLightMap,
+                 (qint64)sizeHeightMap * sizeHeightMap)) {
+    RunRows(&TERRAIN::CalculateLightingRows, sizeHeightMap);
+    SaveCache("lighting", key, lightMap.arrayLightMap,
+              (qint64)sizeHeightMap * sizeHeightMap);
+  }
+  lightMapVersion++;
+}
+
+// calculer les lignes firstRow..lastRow-1 de la lightmap
+void TERRAIN::CalculateLightingRows(int firstRow, int lastRow) {
+  float shade;
+  int x, z;
+
+  for (z = firstRow; z < lastRow; z++) {
+    const unsigned char *heights = heightMap.arrayHeightMap + z * sizeHeightMap;
+    unsigned char *brightness = lightMap.arrayLightMap + z * sizeHeightMap;
+
+    // pour chaque vertex
     for (x = 0; x < sizeHeightMap; x++) {
       // pour ne pas depasser des bornes
-      if (z >= directionZ && x >= directionX) {
+      if (z - directionZ >= 0 && z - directionZ < sizeHeightMap &&
+          x - directionX >= 0 && x - directionX < sizeHeightMap) {
         // comparer les hauteurs, et on rend plus doux les frontieres
         // ici, on ne fait PAS de calcul genre "tracer les rayons"...
-        shade = 1.0f - (GetTrueHeightAtPoint(x - directionX, z - directionZ) -
-                        GetTrueHeightAtPoint(x, z)) /
+        shade = 1.0f - (heightMap.arrayHeightMap[(z - directionZ) *
+                                                     sizeHeightMap +
+                                                 x - directionX] -
+                        heights[x]) /
                            lightSoftness;
       } else
         shade = 1.0f;
@@ -525,11 +811,66 @@ void TERRAIN::CalculateLighting(void) {
       if (shade > maxBrightness)
         shade = maxBrightness;
 
-      SetBrightnessAtPoint(x, z, (unsigned char)(shade * 255));
+      brightness[x] = (unsigned char)(shade * 255);
     }
   }
 }
 
+// repartir les lignes 0..numRows-1 d'un pre-calcul en bandes traitees en
+// parallele, et attendre la fin du calcul
+void TERRAIN::RunRows(void (TERRAIN::*rows)(int, int), int numRows) {
+  QThreadPool pool;
+  // plus de bandes que de threads, pour equilibrer la charge
+  const int numBands = qMax(1, qMin(4 * QThread::idealThreadCount(), numRows));
+  int band;
+
+  for (band = 0; band < numBands; band++)
+    pool.start(new TerrainRows(this, rows, (band * numRows) / numBands,
+                               ((band + 1) * numRows) / numBands));
+  pool.waitForDone();
+}
+
+// cle du cache: empreinte de la carte d'hauteurs et des parametres du calcul
+QByteArray TERRAIN::CacheKey(const QByteArray &parameters) {
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(QByteArray::number(sizeHeightMap));
+  hash.addData(reinterpret_cast<const char *>(heightMap.arrayHeightMap),
+               sizeHeightMap * sizeHeightMap);
+  hash.addData(parameters);
+  return hash.result().toHex();
+}
+
+// lire un pre-calcul du cache; renvoie false s'il n'y est pas (ou plus)
+bool TERRAIN::LoadCache(const QString &name, const QByteArray &key,
+                        unsigned char *data, qint64 size) {
+  if (!useCache)
+    return false;
+
+  QFile file(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+             "/" + name + "-" + QString::fromLatin1(key) + ".raw");
+  if (file.size() != size || !file.open(QIODevice::ReadOnly))
+    return false;
+  return file.read(reinterpret_cast<char *>(data), size) == size;
+}
+
+// ecrire un pre-calcul dans le cache
+void TERRAIN::SaveCache(const QString &name, const QByteArray &key,
+                        const unsigned char *data, qint64 size) {
+  if (!useCache)
+    return;
+
+  const QString directory =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  QFile file(directory + "/" + name + "-" + QString::fromLatin1(key) +
+             ".raw");
+  if (!QDir().mkpath(directory) || !file.open(QIODevice::WriteOnly)) {
+    printf("Unable to write cache file %s\n", qPrintable(file.fileName()));
+    return;
+  }
+  if (file.write(reinterpret_cast<const char *>(data), size) != size)
+    file.remove();
+}
+
 // tourner la lumiere par un pas de 45°
 void TERRAIN::StepLightingDirection(void) {
   if ((directionX == -1) && (directionZ == -1)) {
@@ -8,7 +8,13 @@
 #include <qimage.h>
 #include <stdlib.h>
 
+#include "tiles.h"
+#include "vtexture.h"
+
 #define TRN_NUM_TILES 5
+// texels des textures de base par hauteur de la carte, comme la texture de
+// GenerateTextureMap(2 * sizeHeightMap)
+#define TRN_TILE_DENSITY 2
 
 // structure contenant le hauteur du terrain
 struct HEIGHTMAP {
@@ -49,6 +55,7 @@ struct TEXTURE {
 class TERRAIN {
 protected:
   HEIGHTMAP heightMap;
+  HEIGHTTILES *heightTiles; // carte en tuiles, NULL si la carte est en memoire
   float scaleHeightMap; // facteur d'echelle pour surelever le terrain
   float scaleSize;      // facteur d'echelle pour la taille du terrain
 
@@ -66,6 +73,7 @@ protected:
   float lightSoftness;
   int directionX, directionZ;
   bool paintLighting;
+  int lightMapVersion; // incremente a chaque changement des ombrages
 
   // fcts. d'aide pour la generation de terrain fractale (filtrage)
   void NormalizeTerrain(float *heightData);
@@ -76,6 +84,27 @@ protected:
   float RegionPercent(int type, unsigned char height);
   void GetTexCoords(QImage texture, unsigned int *x, unsigned int *y);
   unsigned char InterpolateHeight(int x, int z, float heightToTexRatio);
+  float InterpolateHeightAt(float x, float z);
+  void PrepareTextureBlend(void);
+
+  // texture virtuelle: les textures de base, reduites de moitie a chaque
+  // niveau, pour les pages moins detaillees que TRN_TILE_DENSITY
+  VIRTUALTEXTURE virtualTexture;
+  QList<QImage> tileMips[TRN_NUM_TILES];
+
+  // pre-calculs paralleles: les lignes sont reparties entre plusieurs threads
+  float regionBlend[TRN_NUM_TILES][256]; // RegionPercent() de chaque hauteur
+  void RunRows(void (TERRAIN::*rows)(int, int), int numRows);
+  void GenerateTextureRows(int firstRow, int lastRow);
+  void CalculateLightingRows(int firstRow, int lastRow);
+
+  // cache disque des pre-calculs, indexe par le contenu de la carte d'hauteurs
+  bool useCache;
+  QByteArray CacheKey(const QByteArray &parameters);
+  bool LoadCache(const QString &name, const QByteArray &key,
+                 unsigned char *data, qint64 size);
+  void SaveCache(const QString &name, const QByteArray &key,
+                 const unsigned char *data, qint64 size);
 
 public:
   int sizeHeightMap;
@@ -88,6 +117,11 @@ public:
   bool SaveHeightMap(const QString &szFilename);
   bool UnloadHeightMap(void);
 
+  // cartes en tuiles, plus grandes que la memoire: seules les tuiles autour de
+  // la camera sont chargees (voir HEIGHTTILES)
+  bool LoadTiledHeightMap(const QString &filename, int maxResidentTiles = 64);
+  bool SaveTiledHeightMap(const QString &filename, int tileSize = 256);
+
   // generation de terrain fractale
   bool MakeTerrainFault(int size, int iterations, int min, int max,
                         int smooth); // smooth=1,3,5,7
@@ -96,6 +130,12 @@ public:
   unsigned int textureColorID; // pour identifier les textures aupres de opengl
   unsigned int textureDetailID;
   void GenerateTextureMap(unsigned int size);
+  // texture virtuelle, generee par pages a la demande (voir VIRTUALTEXTURE):
+  // les pages les plus fines couvrent pageSamples hauteurs de cote
+  void GenerateVirtualTexture(int pageSamples);
+  // appele par les threads de la texture virtuelle: remplir page (avec ses
+  // bords) pour les hauteurs x0..x0+extent, z0..z0+extent de la carte
+  void GenerateTexturePage(QImage &page, int x0, int z0, int extent);
   bool LoadTexture(const QString &filename);
   bool LoadDetailMap(const QString &filename);
 
@@ -114,6 +154,8 @@ public:
 
   // renvoyer hauteur sans echelle
   inline unsigned char GetTrueHeightAtPoint(int X, int Z) {
+    if (heightTiles)
+      return heightTiles->GetHeight(X, Z);
     return (heightMap.arrayHeightMap[(Z * sizeHeightMap) + X]);
   }
 
@@ -122,8 +164,7 @@ public:
       X = sizeHeightMap - 1; // eviter les effets de bord
     if (Z >= sizeHeightMap)
       Z = sizeHeightMap - 1;
-    return ((float)(heightMap.arrayHeightMap[(Z * sizeHeightMap) + X]) *
-            scaleHeightMap);
+    return ((float)GetTrueHeightAtPoint(X, Z) * scaleHeightMap);
   }
 
   inline bool SaveTextureMap(const QString &filename) {
@@ -151,10 +192,15 @@ public:
 
   inline void DoLighting(bool doIt) { paintLighting = doIt; }
 
+  // garder la texture de couleur et la lightmap dans le repertoire de cache
+  inline void DoCaching(bool doIt) { useCache = doIt; }
+
   inline bool isTexture() { return paintTextures; }
 
   inline bool isLighted() { return paintLighting; }
 
+  inline bool isTiled() { return heightTiles != NULL; }
+
   inline bool LoadTile(TEXTURETYPE type, const QString &filename) {
     return textures.data[type].load(filename);
   }
@@ -210,6 +256,7 @@ public:
     rLight = r;
     gLight = g;
     bLight = b;
+    lightMapVersion++;
   }
 
   // avec ce modele d'ombrage simpliste, on a meme pas besoin de l'hauteur de la
@@ -234,6 +281,9 @@ public:
   }
 
   TERRAIN(void) {
+    heightTiles = NULL;
+    lightMapVersion = 0;
+    useCache = true;
     repeatDetailMap = 8; // A REVISER
     SetLightColor(1.0f, 1.0f, 1.0f);
     minBrightness = 0.2f; // valeurs qui marchent bien
@@ -245,7 +295,8 @@ public:
     scaleHeightMap = 0.25f;
     scaleSize = 1.0f; // 8.0f
   }
-  virtual ~TERRAIN(void) {}
+  // les threads de la texture virtuelle lisent les membres du terrain
+  virtual ~TERRAIN(void) { virtualTexture.Abort(); }
 };
 
 #endif //__TERRAIN_H__
@@ -9,8 +9,8 @@
 TEMPLATE = app
 TARGET   = terrain
 
-HEADERS  = quadtree.h   terrain.h   viewer.h   water.h   sky.h   tree.h
-SOURCES  = quadtree.cpp terrain.cpp viewer.cpp water.cpp sky.cpp tree.cpp main.cpp
+HEADERS  = quadtree.h   terrain.h   tiles.h   vtexture.h   viewer.h   water.h   sky.h   tree.h
+SOURCES  = quadtree.cpp terrain.cpp tiles.cpp vtexture.cpp viewer.cpp water.cpp sky.cpp tree.cpp main.cpp
 
 LIBS += -lGLU
 
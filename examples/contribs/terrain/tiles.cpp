@@ -0,0 +1,240 @@
+#include "tiles.h"
+
+#include <qdatastream.h>
+#include <qrunnable.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char tilesMagic[4] = {'H', 'T', 'I', 'L'};
+
+// charge une tuile dans le thread de pagination
+class TileLoader : public QRunnable {
+public:
+  TileLoader(HEIGHTTILES *tiles, int index) : tiles(tiles), index(index) {}
+  virtual void run() { tiles->LoadTile(index); }
+
+private:
+  HEIGHTTILES *tiles;
+  int index;
+};
+
+// lire un octet par page pour que le systeme les charge maintenant, dans ce
+// thread, et non au premier acces depuis le thread principal
+static void TouchPages(const unsigned char *data, qint64 size) {
+  volatile unsigned char sum = 0;
+  for (qint64 i = 0; i < size; i += 4096)
+    sum += data[i];
+  sum += data[size - 1];
+}
+
+HEIGHTTILES::HEIGHTTILES(void) {
+  size = 0;
+  tileSize = 0;
+  numTiles = 0;
+  tileOffset = 0;
+  tiles = NULL;
+  maxResident = 0;
+  pager.setMaxThreadCount(1);
+}
+
+HEIGHTTILES::~HEIGHTTILES(void) { Close(); }
+
+// ouvrir une carte en tuiles; au plus maxResidentTiles tuiles sont chargees
+bool HEIGHTTILES::Open(const QString &filename, int maxResidentTiles) {
+  char magic[4];
+  qint32 mapSize, mapTileSize;
+
+  Close();
+  file.setFileName(filename);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream in(&file);
+  if (in.readRawData(magic, 4) != 4 || memcmp(magic, tilesMagic, 4) != 0) {
+    printf("%s is not a tiled height map\n", qPrintable(filename));
+    file.close();
+    return false;
+  }
+  in >> mapSize >> mapTileSize;
+
+  if (in.status() != QDataStream::Ok || mapTileSize < 1 ||
+      mapSize < mapTileSize || mapSize % mapTileSize != 0) {
+    printf("Invalid tiled height map %s\n", qPrintable(filename));
+    file.close();
+    return false;
+  }
+
+  size = mapSize;
+  tileSize = mapTileSize;
+  numTiles = size / tileSize;
+  tileOffset = file.pos();
+  if (file.size() < tileOffset + (qint64)numTiles * numTiles *
+                                     (tileSize + 1) * (tileSize + 1)) {
+    printf("Truncated tiled height map %s\n", qPrintable(filename));
+    Close();
+    return false;
+  }
+
+  tiles = new QAtomicPointer<unsigned char>[numTiles * numTiles];
+  maxResident = qMax(1, maxResidentTiles);
+  return true;
+}
+
+void HEIGHTTILES::Close(void) {
+  int i;
+
+  // attendre la fin des chargements en cours
+  pager.clear();
+  pager.waitForDone();
+
+  if (tiles) {
+    for (i = 0; i < numTiles * numTiles; i++) {
+      if (tiles[i].loadAcquire())
+        file.unmap(tiles[i].loadAcquire());
+    }
+    delete[] tiles;
+    tiles = NULL;
+  }
+  lru.clear();
+  pending.clear();
+  loaded.clear();
+  file.close();
+  size = 0;
+  tileSize = 0;
+  numTiles = 0;
+}
+
+// ecrire une carte de size*size hauteurs en tuiles
+bool HEIGHTTILES::Save(const QString &filename, const unsigned char *heights,
+                       int size, int tileSize) {
+  int i, j, x, z, n;
+  QFile pFile(filename);
+
+  if (!heights || tileSize < 1 || size < tileSize || size % tileSize != 0)
+    return false;
+  if (!pFile.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream out(&pFile);
+  out.writeRawData(tilesMagic, 4);
+  out << (qint32)size << (qint32)tileSize;
+
+  QByteArray tile((tileSize + 1) * (tileSize + 1), 0);
+  n = size / tileSize;
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < n; i++) {
+      // le bord de la carte est repete dans la ligne et la colonne en plus
+      for (z = 0; z <= tileSize; z++) {
+        for (x = 0; x <= tileSize; x++)
+          tile[z * (tileSize + 1) + x] =
+              heights[qMin(j * tileSize + z, size - 1) * size +
+                      qMin(i * tileSize + x, size - 1)];
+      }
+      if (out.writeRawData(tile.constData(), tile.size()) != tile.size())
+        return false;
+    }
+  }
+  return true;
+}
+
+void HEIGHTTILES::LoadTile(int index) {
+  const qint64 bytes = (qint64)(tileSize + 1) * (tileSize + 1);
+  unsigned char *data;
+
+  fileMutex.lock();
+  data = file.map(tileOffset + index * bytes, bytes);
+  fileMutex.unlock();
+
+  if (data)
+    TouchPages(data, bytes);
+  else
+    printf("Unable to map tile %d of %s\n", index,
+           qPrintable(file.fileName()));
+
+  tiles[index].storeRelease(data);
+  QMutexLocker locker(&loadedMutex);
+  loaded.append(index);
+}
+
+void HEIGHTTILES::Update(int x, int z, int radius) {
+  int i, j, ci, cj, index;
+  unsigned char *data;
+
+  if (!tiles)
+    return;
+
+  // les tuiles demandees doivent tenir dans le budget
+  while (radius > 0 && (2 * radius + 1) * (2 * radius + 1) > maxResident)
+    radius--;
+
+  // tuiles chargees depuis le dernier appel
+  loadedMutex.lock();
+  QList<int> newTiles = loaded;
+  loaded.clear();
+  loadedMutex.unlock();
+  for (i = 0; i < newTiles.size(); i++) {
+    pending.remove(newTiles[i]);
+    if (tiles[newTiles[i]].loadAcquire())
+      lru.append(newTiles[i]);
+  }
+
+  // demander les tuiles autour de la camera, la plus proche en premier
+  ci = qBound(0, x / tileSize, numTiles - 1);
+  cj = qBound(0, z / tileSize, numTiles - 1);
+  for (int ring = 0; ring <= radius; ring++) {
+    for (j = cj - ring; j <= cj + ring; j++) {
+      for (i = ci - ring; i <= ci + ring; i++) {
+        if (qMax(qAbs(i - ci), qAbs(j - cj)) != ring || i < 0 ||
+            i >= numTiles || j < 0 || j >= numTiles)
+          continue;
+        index = (j * numTiles) + i;
+        if (tiles[index].loadAcquire()) {
+          // tuile utilisee: en fin de liste
+          lru.removeOne(index);
+          lru.append(index);
+        } else if (!pending.contains(index)) {
+          pending.insert(index);
+          pager.start(new TileLoader(this, index));
+        }
+      }
+    }
+  }
+
+  // liberer les tuiles les moins recemment utilisees au-dela du budget
+  while (lru.size() > maxResident) {
+    index = lru.takeFirst();
+    data = tiles[index].fetchAndStoreRelease(NULL);
+    QMutexLocker locker(&fileMutex);
+    file.unmap(data);
+  }
+}
+
+unsigned char HEIGHTTILES::GetHeight(int X, int Z) const {
+  int i, j, previousI, previousJ;
+  const unsigned char *data;
+
+  if (!tiles)
+    return 0;
+  X = qBound(0, X, size - 1);
+  Z = qBound(0, Z, size - 1);
+  i = X / tileSize;
+  j = Z / tileSize;
+
+  // sur un bord, le point est aussi dans la derniere ligne ou colonne de la
+  // tuile precedente
+  previousI = (i > 0 && X == i * tileSize) ? i - 1 : i;
+  previousJ = (j > 0 && Z == j * tileSize) ? j - 1 : j;
+
+  if ((data = GetTile(i, j)) == NULL && (data = GetTile(previousI, j)) != NULL)
+    i = previousI;
+  else if (!data && (data = GetTile(i, previousJ)) != NULL)
+    j = previousJ;
+  else if (!data && (data = GetTile(previousI, previousJ)) != NULL) {
+    i = previousI;
+    j = previousJ;
+  }
+  if (!data)
+    return 0;
+
+  return data[(Z - j * tileSize) * (tileSize + 1) + (X - i * tileSize)];
+}
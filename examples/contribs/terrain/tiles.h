@@ -0,0 +1,72 @@
+// carte d'hauteurs en tuiles, projetee en memoire (memory mapped) depuis un
+// fichier: seules les tuiles autour de la camera sont chargees, par un thread
+// en arriere-plan, dans la limite d'un budget de tuiles
+#ifndef __TILES_H__
+#define __TILES_H__
+
+#include <qatomic.h>
+#include <qfile.h>
+#include <qlist.h>
+#include <qmutex.h>
+#include <qset.h>
+#include <qthreadpool.h>
+
+// Format du fichier (QDataStream): "HTIL", taille de la carte, taille d'une
+// tuile (puissances de 2), puis les tuiles ligne par ligne. Chaque tuile
+// contient (tileSize+1)*(tileSize+1) hauteurs: la derniere ligne et la
+// derniere colonne repetent le bord des tuiles voisines, pour qu'un bloc du
+// terrain puisse etre construit a partir d'une seule tuile.
+class HEIGHTTILES {
+public:
+  HEIGHTTILES(void);
+  ~HEIGHTTILES(void);
+
+  bool Open(const QString &filename, int maxResidentTiles);
+  void Close(void);
+
+  static bool Save(const QString &filename, const unsigned char *heights,
+                   int size, int tileSize);
+
+  inline int Size(void) const { return size; }
+  inline int TileSize(void) const { return tileSize; }
+  inline int NumTiles(void) const { return numTiles; }
+
+  // demander les tuiles autour du point (x,z) de la carte, liberer les moins
+  // recemment utilisees. A appeler a chaque image, depuis le thread principal
+  void Update(int x, int z, int radius);
+
+  // tuiles chargees, de la moins a la plus recemment utilisee
+  inline const QList<int> &ResidentTiles(void) const { return lru; }
+
+  // hauteurs de la tuile (i,j), NULL si elle n'est pas encore chargee
+  inline const unsigned char *GetTile(int i, int j) const {
+    return tiles[(j * numTiles) + i].loadAcquire();
+  }
+
+  inline bool IsResident(int i, int j) const { return GetTile(i, j) != NULL; }
+
+  // hauteur au point (X,Z), 0 si sa tuile n'est pas chargee. Les points sur
+  // le bord d'une tuile sont aussi lus dans la tuile precedente
+  unsigned char GetHeight(int X, int Z) const;
+
+private:
+  friend class TileLoader;
+
+  // chargement d'une tuile dans le thread de pagination
+  void LoadTile(int index);
+
+  QFile file;
+  QMutex fileMutex; // map() et unmap() depuis les deux threads
+  int size, tileSize, numTiles;
+  qint64 tileOffset; // debut des tuiles dans le fichier
+
+  QAtomicPointer<unsigned char> *tiles; // projections des tuiles chargees
+  int maxResident;
+  QList<int> lru;     // tuiles chargees, ordre d'utilisation
+  QSet<int> pending;  // tuiles demandees au thread de pagination
+  QMutex loadedMutex; // protege loaded
+  QList<int> loaded;  // tuiles chargees depuis le dernier Update()
+  QThreadPool pager;  // un seul thread
+};
+
+#endif //__TILES_H__
@@ -1,5 +1,14 @@
 // TP OpenGL: Joerg Liebelt, Serigne Sow
 #include "tree.h"
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector3D>
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
 
 using namespace qglviewer;
 
@@ -26,71 +35,287 @@ bool TREE::LoadTexture(const QString &filename) {
   return true;
 }
 
-void TREE::initTrees(QUADTREE ter, int num, float waterLevel) {
+// les deux quads croises d'un arbre, en unites de sa taille: x, y, z, s, t
+static const GLfloat treeCorners[12][5] = {
+    {1.0f, 1.0f, 0.0f, 1.0f, 1.0f},   {1.0f, 0.0f, 0.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},   {1.0f, 1.0f, 0.0f, 1.0f, 1.0f},
+    {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},   {0.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+    {0.5f, 1.0f, -0.5f, 1.0f, 1.0f},  {0.5f, 0.0f, -0.5f, 1.0f, 0.0f},
+    {0.5f, 0.0f, 0.5f, 0.0f, 0.0f},   {0.5f, 1.0f, -0.5f, 1.0f, 1.0f},
+    {0.5f, 0.0f, 0.5f, 0.0f, 0.0f},   {0.5f, 1.0f, 0.5f, 0.0f, 1.0f}};
+
+// largeur du fondu, en rang: un arbre grandit de 0 a sa taille pendant que la
+// densite passe de son rang a son rang + TREE_FADE_WIDTH
+#define TREE_FADE_WIDTH 0.05f
+
+// un arbre par instance, retreci quand la densite a sa distance tombe sous son
+// rang. Meme calcul que TREE::Density() et TREE::RenderImmediate().
+static const char *treeVertexShader =
+    "#version 130\n"
+    "uniform vec3 camera;\n"
+    "uniform float fadeStart;\n"
+    "uniform float fadeEnd;\n"
+    "uniform float minDensity;\n"
+    "uniform float fadeWidth;\n"
+    "in vec3 corner;\n"
+    "in vec2 texCorner;\n"
+    "in vec4 instance;\n" // pied de l'arbre, taille
+    "in float rank;\n"
+    "out vec2 texCoord;\n"
+    "void main() {\n"
+    "  float d = distance(instance.xyz, camera);\n"
+    "  float density =\n"
+    "      mix(1.0, minDensity, smoothstep(fadeStart, fadeEnd, d));\n"
+    "  float scale = clamp((density - rank) / fadeWidth, 0.0, 1.0);\n"
+    "  vec3 vertex = instance.xyz + corner * (instance.w * scale);\n"
+    "  texCoord = texCorner;\n"
+    "  gl_Position = gl_ModelViewProjectionMatrix * vec4(vertex, 1.0);\n"
+    "}\n";
+
+// comme glAlphaFunc(GL_GREATER, 0.5)
+static const char *treeFragmentShader =
+    "#version 130\n"
+    "uniform sampler2D tree;\n"
+    "in vec2 texCoord;\n"
+    "void main() {\n"
+    "  vec4 color = texture(tree, texCoord);\n"
+    "  if (color.a <= 0.5)\n"
+    "    discard;\n"
+    "  gl_FragColor = color;\n"
+    "}\n";
+
+static float RandomUnit() { return rand() / (RAND_MAX + 1.0f); }
+
+// les arbres sont ranges par bloc du terrain, pour ne parcourir que les blocs
+// visibles, et par rang dans chaque bloc: les arbres gardes a une distance
+// donnee sont alors les premiers de leur bloc
+void TREE::initTrees(QUADTREE &ter, int num, float waterLevel) {
   int i;
-  myTerrain = ter;
+  myTerrain = &ter;
   numTrees = num;
-  treeInfo = new Vec[numTrees];
+  const int size = myTerrain->sizeHeightMap;
+  const int numChunks = myTerrain->GetNumChunks();
+  const int chunkSize = myTerrain->GetChunkSize();
+
+  QVector<TREE_INSTANCE> trees(numTrees);
+  QVector<int> chunkOf(numTrees);
+  chunkFirst.fill(0, numChunks * numChunks + 1);
   qsrand(QTime::currentTime().elapsed());
   for (i = 0; i < numTrees; i++) {
+    float x, z;
     do {
-      treeInfo[i].setValue(rand() % myTerrain.sizeHeightMap,
-                           rand() % myTerrain.sizeHeightMap,
-                           rand() % myTerrain.sizeHeightMap * treeSizeFactor /
-                               myTerrain.sizeHeightMap);
-    } while (myTerrain.GetScaledHeightAtPoint(
-                 (int)treeInfo[i].x, (int)treeInfo[i].y) <= waterLevel);
+      x = RandomUnit() * (size - 1);
+      z = RandomUnit() * (size - 1);
+    } while (myTerrain->GetScaledHeightAtPoint((int)x, (int)z) <= waterLevel);
+
+    // on place l'arbre a une hauteur reduit de 1%, car les surface n'ont
+    // souvent pas l'hauteur exact et
+    // .. les arbres ont tendance a "voler" dans l'air...
+    TREE_INSTANCE &tree = trees[i];
+    tree.x = x / size;
+    tree.y = myTerrain->GetScaledHeightAtPoint((int)x, (int)z) / size * 0.99f;
+    tree.z = z / size;
+    tree.size = RandomUnit() * treeSizeFactor;
+    tree.rank = RandomUnit();
+    if (numChunks > 0) {
+      const int ci = qMin((int)x / chunkSize, numChunks - 1);
+      const int cj = qMin((int)z / chunkSize, numChunks - 1);
+      chunkOf[i] = cj * numChunks + ci;
+      chunkFirst[chunkOf[i] + 1]++;
+    }
   }
+  if (numChunks == 0) // carte en tuiles: pas d'arbres
+    numTrees = 0;
+
+  // tri par bloc (comptage), puis par rang dans chaque bloc
+  for (i = 0; i < numChunks * numChunks; i++)
+    chunkFirst[i + 1] += chunkFirst[i];
+  QVector<int> next = chunkFirst;
+  instances.resize(numTrees);
+  for (i = 0; i < numTrees; i++)
+    instances[next[chunkOf[i]]++] = trees[i];
+  for (i = 0; i < numChunks * numChunks; i++)
+    std::sort(instances.begin() + chunkFirst[i],
+              instances.begin() + chunkFirst[i + 1],
+              [](const TREE_INSTANCE &a, const TREE_INSTANCE &b) {
+                return a.rank < b.rank;
+              });
+  visible.reserve(numTrees);
+
+  InitGPU();
 }
 
-void TREE::Render() {
-  float dim;
-  int i;
+// le quad des arbres et le buffer des instances. Sans OpenGL 3.3
+// (glVertexAttribDivisor), les arbres sont dessines en immediate mode.
+void TREE::InitGPU() {
+  Shutdown();
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context || context->isOpenGLES() ||
+      (context->format().version() < qMakePair(3, 3)))
+    return;
+
+  program = new QOpenGLShaderProgram();
+  // l'attribut 0 doit etre un tableau en profil compatibilite
+  program->bindAttributeLocation("corner", 0);
+  if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                        treeVertexShader) ||
+      !program->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                        treeFragmentShader) ||
+      !program->link()) {
+    qWarning("Tree shaders failed, using immediate mode");
+    Shutdown();
+    return;
+  }
+
+  cornerBuffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  cornerBuffer->create();
+  cornerBuffer->bind();
+  cornerBuffer->allocate(treeCorners, sizeof(treeCorners));
+  cornerBuffer->release();
+  instanceBuffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  instanceBuffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+  instanceBuffer->create();
+  instanced = true;
+}
+
+void TREE::Shutdown() {
+  delete program;
+  delete cornerBuffer;
+  delete instanceBuffer;
+  program = nullptr;
+  cornerBuffer = instanceBuffer = nullptr;
+  instanced = false;
+}
+
+// part des arbres gardes a la distance distance de la camera
+float TREE::Density(float distance) const {
+  float t = (distance - fadeStart) / (fadeEnd - fadeStart);
+  t = qBound(0.0f, t, 1.0f);
+  t = t * t * (3.0f - 2.0f * t); // smoothstep
+  return 1.0f + (minDensity - 1.0f) * t;
+}
+
+// les premiers arbres des blocs retenus par QUADTREE::Update(). La densite est
+// celle du point du bloc le plus proche de la camera: les arbres gardes
+// contiennent ceux que le shader ne reduit pas a rien.
+void TREE::CollectVisible(const Vec &camera) {
+  const int numChunks = myTerrain->GetNumChunks();
+  const float chunkWidth =
+      (float)myTerrain->GetChunkSize() / myTerrain->sizeHeightMap;
+  visible.clear();
+  for (int j = 0; j < numChunks; j++)
+    for (int i = 0; i < numChunks; i++) {
+      if (!myTerrain->IsChunkVisible(i, j))
+        continue;
+      const float dx = qMax(qMax(i * chunkWidth - (float)camera.x,
+                                 (float)camera.x - (i + 1) * chunkWidth),
+                            0.0f);
+      const float dz = qMax(qMax(j * chunkWidth - (float)camera.z,
+                                 (float)camera.z - (j + 1) * chunkWidth),
+                            0.0f);
+      TREE_INSTANCE limit;
+      limit.rank = Density(sqrtf(dx * dx + dz * dz));
+      const int c = j * numChunks + i;
+      const TREE_INSTANCE *first = instances.constData() + chunkFirst[c];
+      const TREE_INSTANCE *last = std::lower_bound(
+          first, instances.constData() + chunkFirst[c + 1], limit,
+          [](const TREE_INSTANCE &a, const TREE_INSTANCE &b) {
+            return a.rank < b.rank;
+          });
+      for (; first != last; ++first)
+        visible.append(*first);
+    }
+}
+
+void TREE::Render(const Vec &camera) {
+  const int numChunks = myTerrain ? myTerrain->GetNumChunks() : 0;
+  if (chunkFirst.size() != numChunks * numChunks + 1)
+    return; // terrain change sans initTrees()
+
+  CollectVisible(camera);
+  if (visible.isEmpty())
+    return;
+
   glDisable(GL_LIGHTING);
+  glBindTexture(GL_TEXTURE_2D, texID);
+  if (instanced)
+    RenderInstanced(camera);
+  else
+    RenderImmediate(camera);
+}
+
+// un seul dessin pour tous les arbres visibles
+void TREE::RenderInstanced(const Vec &camera) {
+  QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
 
+  program->bind();
+  program->setUniformValue("tree", 0);
+  program->setUniformValue("camera", QVector3D(camera.x, camera.y, camera.z));
+  program->setUniformValue("fadeStart", fadeStart);
+  program->setUniformValue("fadeEnd", fadeEnd);
+  program->setUniformValue("minDensity", minDensity);
+  program->setUniformValue("fadeWidth", TREE_FADE_WIDTH);
+
+  const int stride = 5 * sizeof(GLfloat);
+  cornerBuffer->bind();
+  program->enableAttributeArray("corner");
+  program->setAttributeBuffer("corner", GL_FLOAT, 0, 3, stride);
+  program->enableAttributeArray("texCorner");
+  program->setAttributeBuffer("texCorner", GL_FLOAT, 3 * sizeof(GLfloat), 2,
+                              stride);
+
+  instanceBuffer->bind();
+  instanceBuffer->allocate(visible.constData(),
+                           visible.size() * sizeof(TREE_INSTANCE));
+  const int instance = program->attributeLocation("instance");
+  const int rank = program->attributeLocation("rank");
+  program->enableAttributeArray(instance);
+  program->setAttributeBuffer(instance, GL_FLOAT, 0, 4, sizeof(TREE_INSTANCE));
+  program->enableAttributeArray(rank);
+  program->setAttributeBuffer(rank, GL_FLOAT, offsetof(TREE_INSTANCE, rank), 1,
+                              sizeof(TREE_INSTANCE));
+  f->glVertexAttribDivisor(instance, 1);
+  f->glVertexAttribDivisor(rank, 1);
+
+  f->glDrawArraysInstanced(GL_TRIANGLES, 0, 12, visible.size());
+
+  f->glVertexAttribDivisor(instance, 0);
+  f->glVertexAttribDivisor(rank, 0);
+  program->disableAttributeArray(instance);
+  program->disableAttributeArray(rank);
+  program->disableAttributeArray("corner");
+  program->disableAttributeArray("texCorner");
+  instanceBuffer->release();
+  program->release();
+}
+
+// sans shaders: meme fondu, calcule pour chaque arbre
+void TREE::RenderImmediate(const Vec &camera) {
   glAlphaFunc(GL_GREATER, 0.5); // on enleve automatiquement les pixels de la
                                 // texture marques "transparent"
   glEnable(GL_ALPHA_TEST);
 
   glEnable(GL_TEXTURE_2D);
 
-  for (i = 0; i < numTrees; i++) {
-    // on place l'arbre a une hauteur reduit de 5%, car les surface n'ont
-    // souvent pas l'hauteur exact et
-    // .. les arbres ont tendance a "voler" dans l'air...
-    glPushMatrix();
-
-    glTranslatef(treeInfo[i].x / myTerrain.sizeHeightMap,
-                 myTerrain.GetScaledHeightAtPoint((int)treeInfo[i].x,
-                                                  (int)treeInfo[i].y) /
-                     myTerrain.sizeHeightMap * 0.99,
-                 treeInfo[i].y / myTerrain.sizeHeightMap);
-    dim = treeInfo[i].z;
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glBegin(GL_TRIANGLE_FAN);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(dim, dim, 0);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(dim, 0, 0);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(0, 0, 0);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(0, dim, 0);
-    glEnd();
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glBegin(GL_TRIANGLE_FAN);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(dim / 2, dim, -dim / 2);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(dim / 2, 0, -dim / 2);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(dim / 2, 0, dim / 2);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(dim / 2, dim, dim / 2);
-    glEnd();
-
-    glPopMatrix();
+  glBegin(GL_TRIANGLES);
+  for (int i = 0; i < visible.size(); i++) {
+    const TREE_INSTANCE &tree = visible[i];
+    const Vec foot(tree.x, tree.y, tree.z);
+    const float scale =
+        qBound(0.0f,
+               (Density((foot - camera).norm()) - tree.rank) / TREE_FADE_WIDTH,
+               1.0f);
+    const float dim = tree.size * scale;
+    if (dim <= 0.0f)
+      continue;
+    for (int v = 0; v < 12; v++) {
+      glTexCoord2f(treeCorners[v][3], treeCorners[v][4]);
+      glVertex3f(tree.x + treeCorners[v][0] * dim,
+                 tree.y + treeCorners[v][1] * dim,
+                 tree.z + treeCorners[v][2] * dim);
+    }
   }
+  glEnd();
 
   glDisable(GL_ALPHA_TEST);
 }
@@ -5,6 +5,19 @@
 
 #include "quadtree.h"
 
+#include <QVector>
+
+class QOpenGLBuffer;
+class QOpenGLShaderProgram;
+
+// un arbre: position de son pied, taille, et rang dans [0,1) qui decide de sa
+// disparition avec la distance (les rangs faibles restent le plus loin)
+struct TREE_INSTANCE {
+  float x, y, z;
+  float size;
+  float rank;
+};
+
 class TREE {
 private:
   QImage texture;
@@ -12,24 +25,52 @@ private:
   bool iwanttrees;
   float treeSizeFactor;
   int numTrees;
-  qglviewer::Vec *treeInfo;
   // ici, je casse la beaute de mon architecture car avec la ligne suivante,
   //...TREE depend de QUADTREE et n'est plus independant de la maniere dont le
   //terrain a ete cree. dommage..
-  QUADTREE myTerrain; // pour recuperer l'hauteur du terrain
+  QUADTREE *myTerrain; // pour recuperer l'hauteur et les blocs visibles
+
+  // arbres ranges par bloc du terrain, par rang croissant dans chaque bloc
+  QVector<TREE_INSTANCE> instances;
+  QVector<int> chunkFirst; // premier arbre de chaque bloc, puis numTrees
+  QVector<TREE_INSTANCE> visible; // arbres dessines par l'image courante
+
+  // densite: tous les arbres jusqu'a fadeStart, minDensity au-dela de fadeEnd
+  float fadeStart, fadeEnd, minDensity;
+
+  // un seul dessin instancie (OpenGL 3.3), sinon immediate mode
+  bool instanced;
+  QOpenGLShaderProgram *program;
+  QOpenGLBuffer *cornerBuffer;   // les deux quads croises, statiques
+  QOpenGLBuffer *instanceBuffer; // visible, recharge a chaque image
+
+  void InitGPU();
+  float Density(float distance) const;
+  void CollectVisible(const qglviewer::Vec &camera);
+  void RenderInstanced(const qglviewer::Vec &camera);
+  void RenderImmediate(const qglviewer::Vec &camera);
 
 public:
   TREE() {
     iwanttrees = false;
-    treeSizeFactor = 0.05f;
+    treeSizeFactor = 0.02f;
     numTrees = 20;
+    myTerrain = nullptr;
+    fadeStart = 0.25f;
+    fadeEnd = 1.5f;
+    minDensity = 0.05f;
+    instanced = false;
+    program = nullptr;
+    cornerBuffer = instanceBuffer = nullptr;
   }
 
   bool LoadTexture(const QString &filename);
 
-  void initTrees(QUADTREE ter, int num, float waterLevel);
+  void initTrees(QUADTREE &ter, int num, float waterLevel);
+  void Shutdown();
 
-  void Render();
+  // apres QUADTREE::Update(), qui choisit les blocs visibles
+  void Render(const qglviewer::Vec &camera);
 
   void switchTree() { iwanttrees = !iwanttrees; }
 
@@ -26,19 +26,21 @@ int currentHeightmap = 0;
 const int scaleFactor = 1;
 const int mapSize = 128;
 const float waterLevel = 0.15f;
-const int numTrees = 100;
+const int numTrees = 100000;
 
 void Viewer::draw() {
   myQuadtree.ComputeView();
-  myQuadtree.Init();
   qglviewer::Vec v = camera()->position();
+  // pixels par radian, pour choisir la resolution des pages de texture
+  myQuadtree.SetPageResolution(height() /
+                               (2.0f * tan(camera()->fieldOfView() / 2.0f)));
   myQuadtree.Update(v.x, v.y, v.z);
 
   // render le terrain
   myQuadtree.Render();
 
   if (myTree.wantTree())
-    myTree.Render();
+    myTree.Render(v);
 
   if (mySky.wantSky()) {
     // le ciel
@@ -93,6 +95,7 @@ void Viewer::init() {
   setKeyDescription(Qt::Key_T, "Toggles trees");
   setKeyDescription(Qt::Key_L, "Change light direction");
   setKeyDescription(Qt::Key_X, "Toggles textures");
+  setKeyDescription(Qt::Key_E, "Export the height map as tiles");
 
   drawMesh = false;
 
@@ -119,11 +122,16 @@ bool Viewer::DrawInit(void) {
   // charger heightmap
   // bool res = myQuadtree.LoadHeightMap( "height128.raw", 128 );
 
-  // creer carte fractale
-  bool res = myQuadtree.MakeTerrainFault(mapSize, 32, 25, 150,
-                                         10); // terrain initial plus lisse
+  // carte en tuiles donnee en argument, sinon creer carte fractale
+  bool res = !tiledHeightMap.isEmpty() &&
+             myQuadtree.LoadTiledHeightMap(tiledHeightMap);
+  if (!res)
+    res = myQuadtree.MakeTerrainFault(mapSize, 32, 25, 150,
+                                      10); // terrain initial plus lisse
   myQuadtree.SetHeightScale(scaleFactor / 4.0f);
   myQuadtree.SetSizeScale(scaleFactor);
+  // decouper la carte en blocs, charges sur la carte graphique
+  myQuadtree.Init();
 
   // preparer les textures
 
@@ -138,9 +146,8 @@ bool Viewer::DrawInit(void) {
   if (!myQuadtree.LoadDetailMap("Data/detailMap.jpg"))
     printf("Detail Texture load failed\n");
 
-  // creer la texture complete, la sauvegarder
-  myQuadtree.GenerateTextureMap(
-      2 * mapSize); // double precision de la carte d'hauteur
+  // texture virtuelle: les pages visibles sont generees a la demande
+  myQuadtree.GenerateVirtualTexture();
 
   // creer la carte d'ombrages
   myQuadtree.CalculateLighting();
@@ -158,7 +165,8 @@ bool Viewer::DrawInit(void) {
     myQuadtree.DoMultitexturing(false);
     printf("No Multitexturing available on this card\n");
   }
-  myQuadtree.DoTexturing(true);
+  // pas de texture de couleur pour une carte en tuiles
+  myQuadtree.DoTexturing(!myQuadtree.isTiled());
   myQuadtree.DoLighting(true);
   myQuadtree.SetDetailLevel(50.0f / (mapSize / 3));
   myQuadtree.SetMinResolution(10.0f / (mapSize / 3));
@@ -178,7 +186,8 @@ bool Viewer::DrawInit(void) {
   mySky.LoadTexture(SKY_BOTTOM, "Data/skybottom.jpg");
 
   myTree.LoadTexture("Data/palmier.png");
-  myTree.initTrees(myQuadtree, numTrees, waterLevel * mapSize);
+  if (!myQuadtree.isTiled())
+    myTree.initTrees(myQuadtree, numTrees, waterLevel * mapSize);
 
   return res;
 }
@@ -187,7 +196,10 @@ bool Viewer::DrawShutdown() {
   myQuadtree.UnloadAllTextures(); //..de base
   myQuadtree.UnloadTexture();     //..texture complete
   bool res = myQuadtree.UnloadHeightMap();
+  makeCurrent(); // liberer les vertex buffers des blocs, des arbres et de l'eau
   myQuadtree.Shutdown();
+  myWater.Shutdown();
+  myTree.Shutdown();
   return res;
 }
 
@@ -203,9 +215,9 @@ void Viewer::keyPressEvent(QKeyEvent *e) {
       if (!myQuadtree.MakeTerrainFault(mapSize, 32, 0, 255, 3))
         printf("prob creer terrain\n");
       myQuadtree.SetHeightScale(scaleFactor / 4.0f);
-      // creer la texture complete, la sauvegarder
-      myQuadtree.GenerateTextureMap(
-          2 * mapSize); // double precision de la carte d'hauteur
+      makeCurrent();
+      myQuadtree.Init();
+      myQuadtree.GenerateVirtualTexture();
       myQuadtree.CalculateLighting();
       myTree.initTrees(myQuadtree, numTrees, waterLevel * mapSize);
       update();
@@ -214,9 +226,9 @@ void Viewer::keyPressEvent(QKeyEvent *e) {
       if (!myQuadtree.LoadHeightMap("height128.raw", mapSize))
         printf("prob charger carte\n");
       myQuadtree.SetHeightScale(scaleFactor / 4.0f);
-      // creer la texture complete, la sauvegarder
-      myQuadtree.GenerateTextureMap(
-          2 * mapSize); // double precision de la carte d'hauteur
+      makeCurrent();
+      myQuadtree.Init();
+      myQuadtree.GenerateVirtualTexture();
       myQuadtree.CalculateLighting();
       myTree.initTrees(myQuadtree, numTrees, waterLevel * mapSize);
       update();
@@ -253,15 +265,16 @@ void Viewer::keyPressEvent(QKeyEvent *e) {
       myQuadtree.CalculateLighting();
       update();
       break;
+    case Qt::Key_E: // sauvegarder la carte en tuiles (relire: terrain fichier)
+      if (myQuadtree.isTiled() ||
+          !myQuadtree.SaveTiledHeightMap("height.tiles"))
+        printf("prob sauvegarder carte en tuiles\n");
+      break;
     case Qt::Key_X: // switch affichage textures (detail+base)
       if (myQuadtree.isTexture())
         myQuadtree.DoTexturing(false);
-      else {
-        // creer la texture complete, la sauvegarder
-        myQuadtree.GenerateTextureMap(
-            2 * mapSize); // double precision de la carte d'hauteur
-        myQuadtree.DoTexturing(true);
-      }
+      else if (!myQuadtree.isTiled())
+        myQuadtree.DoTexturing(true); // les pages sont gardees
       update();
       break;
     default:
@@ -315,7 +328,9 @@ QString Viewer::helpString() const {
           "the camera position.<br>";
   text += "You can toggle the display of water (<b>W</b>), trees (<b>T</b>) "
           "and sky (<b>S</b>).<br><br>";
-  text += "Press <b>X</b> to switch texturing on and off.<br>";
+  text += "Press <b>X</b> to switch texturing on and off. The texture is "
+          "generated on demand by background threads, with a resolution that "
+          "depends on the distance to the camera.<br>";
   text += "Press <b>O</b> to switch shading on and off.<br>";
   text += "Press <b>L</b> to cycle through different light source positions "
           "(+45°).<br>";
@@ -326,5 +341,9 @@ QString Viewer::helpString() const {
   text += "Press <b>C</b> to create a new fractal terrain.<br>";
   text += "Press <b>H</b> to load a terrain from a heightmap-file "
           "height128.raw.<br>";
+  text += "Press <b>E</b> to export the terrain as a tiled height map "
+          "height.tiles, which is displayed with <code>terrain "
+          "height.tiles</code>. Only the tiles around the camera are then "
+          "loaded, in a background thread.<br>";
   return text;
 }
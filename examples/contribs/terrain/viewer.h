@@ -7,6 +7,7 @@
 class Viewer : public QGLViewer {
 private:
   bool drawMesh;
+  QString tiledHeightMap; // carte en tuiles a charger par DrawInit()
 
 protected:
   virtual void draw();
@@ -17,6 +18,9 @@ protected:
   bool CheckExtension(const QString &szExtensionName); // CODE EXTERNE
 
 public:
+  void setTiledHeightMap(const QString &filename) {
+    tiledHeightMap = filename;
+  }
   bool DrawInit(void);
   bool DrawShutdown(void);
   void keyPressEvent(QKeyEvent *e);
@@ -0,0 +1,230 @@
+#include "vtexture.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <qrunnable.h>
+#include <qthread.h>
+
+// genere une page de la texture virtuelle dans un thread
+class PageBuilder : public QRunnable {
+public:
+  PageBuilder(VIRTUALTEXTURE *texture, int key) : texture(texture), key(key) {}
+  virtual void run() { texture->BuildPage(key); }
+
+private:
+  VIRTUALTEXTURE *texture;
+  int key;
+};
+
+VIRTUALTEXTURE::VIRTUALTEXTURE(void) {
+  terrain = NULL;
+  mapSize = 0;
+  pageSamples = 0;
+  numLevels = 0;
+  atlasID = 0;
+  frame = 0;
+  // le thread principal reste libre pour l'affichage
+  builders.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+VIRTUALTEXTURE::~VIRTUALTEXTURE(void) { Abort(); }
+
+bool VIRTUALTEXTURE::Init(TERRAIN *t, int size, int samples) {
+  int i;
+
+  Abort();
+  terrain = t;
+  mapSize = size;
+  pageSamples = samples;
+  if (!terrain || mapSize < 1 || pageSamples < 1)
+    return false;
+
+  // la page racine couvre toute la carte
+  numLevels = 1;
+  while ((pageSamples << (numLevels - 1)) < mapSize)
+    numLevels++;
+
+  resident.clear();
+  for (i = 0; i < VT_ATLAS_SLOTS * VT_ATLAS_SLOTS; i++) {
+    slotKey[i] = -1;
+    slotFrame[i] = -1;
+  }
+  frame = 0;
+
+  if (!atlasID) {
+    glGenTextures(1, &atlasID);
+    glBindTexture(GL_TEXTURE_2D, atlasID);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VT_ATLAS_SLOTS * VT_SLOT_SIZE,
+                 VT_ATLAS_SLOTS * VT_SLOT_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  // la racine, generee ici, n'est jamais remplacee
+  BuildPage(Key(numLevels - 1, 0, 0));
+  UploadPage(0, ready.first().image);
+  ready.clear();
+  slotKey[0] = Key(numLevels - 1, 0, 0);
+  slotFrame[0] = INT_MAX;
+  resident.insert(slotKey[0], 0);
+  return true;
+}
+
+void VIRTUALTEXTURE::Abort(void) {
+  builders.clear();
+  builders.waitForDone();
+  readyMutex.lock();
+  ready.clear();
+  readyMutex.unlock();
+  pending.clear();
+  requests.clear();
+}
+
+void VIRTUALTEXTURE::Shutdown(void) {
+  Abort();
+  if (atlasID)
+    glDeleteTextures(1, &atlasID);
+  atlasID = 0;
+  resident.clear();
+  terrain = NULL;
+  numLevels = 0;
+}
+
+void VIRTUALTEXTURE::Request(int level, int x, int z, float priority) {
+  const int key = Key(level, x, z);
+  QHash<int, float>::iterator it = requests.find(key);
+
+  if (it == requests.end())
+    requests.insert(key, priority);
+  else if (priority < it.value())
+    it.value() = priority;
+}
+
+// page chargee la plus fine qui contient (level,x,z); la racine au pire
+int VIRTUALTEXTURE::ResidentAncestor(int level, int x, int z) const {
+  while (level < numLevels - 1 && !resident.contains(Key(level, x, z))) {
+    level++;
+    x >>= 1;
+    z >>= 1;
+  }
+  return Key(level, x, z);
+}
+
+void VIRTUALTEXTURE::Update(void) {
+  QList<QPair<float, int> > missing;
+  QList<VT_PAGE> pages;
+  QHash<int, float>::const_iterator it;
+  int i, slot, key, level;
+
+  if (!atlasID)
+    return;
+  frame++;
+
+  // les pages demandees, ou celles qui les remplacent en attendant, sont
+  // utilisees par cette image
+  for (it = requests.constBegin(); it != requests.constEnd(); ++it) {
+    key = it.key();
+    level = key >> 24;
+    slot = resident.value(
+        ResidentAncestor(level, key & 0xfff, (key >> 12) & 0xfff));
+    if (slot != 0)
+      slotFrame[slot] = frame;
+    if (!resident.contains(key) && !pending.contains(key))
+      missing.append(qMakePair(it.value(), key));
+  }
+  requests.clear();
+
+  // generer d'abord les pages les plus proches de la camera
+  std::sort(missing.begin(), missing.end());
+  for (i = 0; i < missing.size() && pending.size() < VT_MAX_PENDING; i++) {
+    pending.insert(missing[i].second);
+    builders.start(new PageBuilder(this, missing[i].second));
+  }
+
+  // charger quelques pages pretes par image, les autres attendent la suivante
+  readyMutex.lock();
+  for (i = 0; i < ready.size() && i < VT_MAX_UPLOADS; i++)
+    pages.append(ready[i]);
+  ready.erase(ready.begin(), ready.begin() + pages.size());
+  readyMutex.unlock();
+
+  for (i = 0; i < pages.size(); i++) {
+    pending.remove(pages[i].key);
+    // pas de place: les pages de l'atlas servent toutes a cette image, celle-ci
+    // sera demandee a nouveau
+    slot = FindSlot();
+    if (slot < 0)
+      continue;
+    if (slotKey[slot] >= 0)
+      resident.remove(slotKey[slot]);
+    UploadPage(slot, pages[i].image);
+    slotKey[slot] = pages[i].key;
+    slotFrame[slot] = frame;
+    resident.insert(pages[i].key, slot);
+  }
+}
+
+// emplacement libre, ou le moins recemment utilise qui ne sert pas a cette
+// image; -1 s'il n'y en a pas
+int VIRTUALTEXTURE::FindSlot(void) {
+  int slot = -1;
+  int i;
+
+  for (i = 1; i < VT_ATLAS_SLOTS * VT_ATLAS_SLOTS; i++) {
+    if (slotKey[i] < 0)
+      return i;
+    if (slotFrame[i] < frame && (slot < 0 || slotFrame[i] < slotFrame[slot]))
+      slot = i;
+  }
+  return slot;
+}
+
+void VIRTUALTEXTURE::UploadPage(int slot, const QImage &image) {
+  glBindTexture(GL_TEXTURE_2D, atlasID);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % VT_ATLAS_SLOTS) * VT_SLOT_SIZE,
+                  (slot / VT_ATLAS_SLOTS) * VT_SLOT_SIZE, VT_SLOT_SIZE,
+                  VT_SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VIRTUALTEXTURE::BuildPage(int key) {
+  const int level = key >> 24;
+  const int extent = pageSamples << level;
+  VT_PAGE page;
+
+  page.key = key;
+  page.image = QImage(VT_SLOT_SIZE, VT_SLOT_SIZE, QImage::Format_ARGB32);
+  terrain->GenerateTexturePage(page.image, (key & 0xfff) * extent,
+                               ((key >> 12) & 0xfff) * extent, extent);
+  // canaux dans l'ordre de GL_RGBA, comme dans GenerateTextureMap()
+  page.image = page.image.rgbSwapped();
+
+  readyMutex.lock();
+  ready.append(page);
+  readyMutex.unlock();
+}
+
+void VIRTUALTEXTURE::GetPlanes(int level, int x, int z, GLfloat sPlane[4],
+                               GLfloat tPlane[4]) const {
+  const float atlasSize = VT_ATLAS_SLOTS * VT_SLOT_SIZE;
+  const int key = ResidentAncestor(level, x, z);
+  const int slot = resident.value(key);
+  const int extent = pageSamples << (key >> 24);
+
+  // texel = bord de l'emplacement + (hauteur - debut de la page) * densite
+  sPlane[0] = VT_PAGE_SIZE / (extent * atlasSize);
+  sPlane[1] = 0.0f;
+  sPlane[2] = 0.0f;
+  sPlane[3] = ((slot % VT_ATLAS_SLOTS) * VT_SLOT_SIZE + VT_BORDER -
+               (key & 0xfff) * VT_PAGE_SIZE) /
+              atlasSize;
+  tPlane[0] = 0.0f;
+  tPlane[1] = 0.0f;
+  tPlane[2] = sPlane[0];
+  tPlane[3] = ((slot / VT_ATLAS_SLOTS) * VT_SLOT_SIZE + VT_BORDER -
+               ((key >> 12) & 0xfff) * VT_PAGE_SIZE) /
+              atlasSize;
+}
@@ -0,0 +1,104 @@
+// texture virtuelle du terrain: au lieu d'une seule texture de couleur pour
+// toute la carte, une pyramide de pages generees a la demande par des threads
+// en arriere-plan. Seules les pages demandees par les blocs visibles sont
+// gardees sur la carte graphique, dans un cache de pages (l'atlas)
+#ifndef __VTEXTURE_H__
+#define __VTEXTURE_H__
+
+#include <qhash.h>
+#include <qimage.h>
+#include <qlist.h>
+#include <qmutex.h>
+#include <qopengl.h>
+#include <qset.h>
+#include <qthreadpool.h>
+
+class TERRAIN;
+
+// texels par cote d'une page, sans ses bords
+#define VT_PAGE_SIZE 248
+// bords de chaque page, qui repetent les pages voisines: le filtrage lineaire
+// ne lit jamais les pages d'a cote dans l'atlas
+#define VT_BORDER 4
+#define VT_SLOT_SIZE (VT_PAGE_SIZE + 2 * VT_BORDER)
+// emplacements par cote de l'atlas (VT_ATLAS_SLOTS*VT_SLOT_SIZE texels)
+#define VT_ATLAS_SLOTS 8
+// pages chargees sur la carte graphique par image, pages en cours de
+// generation au maximum
+#define VT_MAX_UPLOADS 4
+#define VT_MAX_PENDING 8
+
+// Le niveau 0 est le plus fin: une page y couvre pageSamples hauteurs de
+// cote, et chaque niveau double cette etendue jusqu'a la page racine, qui
+// couvre toute la carte. La racine est generee par Init() et reste dans
+// l'atlas: une region dont la page n'est pas encore chargee est affichee avec
+// la page chargee la plus fine qui la contient.
+class VIRTUALTEXTURE {
+public:
+  VIRTUALTEXTURE(void);
+  ~VIRTUALTEXTURE(void);
+
+  // vider le cache et generer la page racine; le contexte OpenGL doit etre
+  // courant. Les pages sont generees par terrain->GenerateTexturePage()
+  bool Init(TERRAIN *terrain, int mapSize, int pageSamples);
+  // abandonner les pages en cours de generation, a appeler avant de modifier
+  // la carte d'hauteurs ou les textures de base
+  void Abort(void);
+  // liberer l'atlas (contexte OpenGL courant)
+  void Shutdown(void);
+
+  inline bool IsReady(void) const { return atlasID != 0; }
+  inline unsigned int TextureID(void) const { return atlasID; }
+  inline int NumLevels(void) const { return numLevels; }
+  inline int NumResidentPages(void) const { return resident.size(); }
+
+  // la page (level,x,z) est visible: plus priority est petite, plus elle est
+  // generee tot (distance a la camera)
+  void Request(int level, int x, int z, float priority);
+  // lancer la generation des pages demandees depuis le dernier Update(),
+  // charger les pages pretes. A appeler a chaque image, contexte courant
+  void Update(void);
+
+  // plans de glTexGen (GL_EYE_LINEAR, en coordonnees de la carte d'hauteurs)
+  // qui projettent la page (level,x,z), ou la page chargee la plus fine qui
+  // la contient, sur son emplacement de l'atlas
+  void GetPlanes(int level, int x, int z, GLfloat sPlane[4],
+                 GLfloat tPlane[4]) const;
+
+private:
+  friend class PageBuilder;
+
+  // une page generee, en attente de chargement
+  struct VT_PAGE {
+    int key;
+    QImage image;
+  };
+
+  static inline int Key(int level, int x, int z) {
+    return (level << 24) | (z << 12) | x;
+  }
+
+  // generation d'une page dans un thread
+  void BuildPage(int key);
+  void UploadPage(int slot, const QImage &image);
+  int FindSlot(void);
+  int ResidentAncestor(int level, int x, int z) const;
+
+  TERRAIN *terrain;
+  int mapSize, pageSamples, numLevels;
+  unsigned int atlasID;
+
+  QHash<int, int> resident; // page -> emplacement de l'atlas
+  int slotKey[VT_ATLAS_SLOTS * VT_ATLAS_SLOTS];   // -1 si libre
+  int slotFrame[VT_ATLAS_SLOTS * VT_ATLAS_SLOTS]; // derniere image utilisee
+  int frame;
+
+  QHash<int, float> requests; // demandes depuis le dernier Update()
+  QSet<int> pending;          // pages en cours de generation
+
+  QMutex readyMutex;    // protege ready
+  QList<VT_PAGE> ready; // pages generees, pas encore chargees
+  QThreadPool builders;
+};
+
+#endif //__VTEXTURE_H__
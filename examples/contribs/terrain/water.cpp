@@ -4,8 +4,95 @@
 #define GL_GLEXT_PROTOTYPES
 
 #include "water.h"
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
 #include <qimage.h>
 
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
+// nombre maximal de pas de simulation executes par une image
+#define WATER_MAX_STEPS 8
+
+// le quad qui couvre l'etat, sans matrices
+static const char *simulationVertexShader =
+    "#version 130\n"
+    "void main() {\n"
+    "  gl_Position = gl_Vertex;\n"
+    "}\n";
+
+// un pas de simulation: memes forces que WATER::Update(), rassemblees autour
+// de chaque vertex. La paire (c, n) contribue une fois par vertex interieur.
+static const char *simulationShader =
+    "#version 130\n"
+    "uniform sampler2D state;\n" // hauteur, vitesse
+    "uniform int resolution;\n"
+    "uniform float delta;\n"
+    "bool interior(ivec2 p) {\n"
+    "  return all(greaterThan(p, ivec2(0))) &&\n"
+    "         all(lessThan(p, ivec2(resolution - 1)));\n"
+    "}\n"
+    "void main() {\n"
+    "  ivec2 p = ivec2(gl_FragCoord.xy);\n"
+    "  vec2 s = texelFetch(state, p, 0).xy;\n"
+    "  float force = 0.0;\n"
+    "  for (int dz = -1; dz <= 1; ++dz)\n"
+    "    for (int dx = -1; dx <= 1; ++dx) {\n"
+    "      ivec2 n = p + ivec2(dx, dz);\n"
+    "      if (((dx == 0) && (dz == 0)) || any(lessThan(n, ivec2(0))) ||\n"
+    "          any(greaterThanEqual(n, ivec2(resolution))))\n"
+    "        continue;\n"
+    "      float weight = ((dx != 0) && (dz != 0)) ? 5.0 : 1.0;\n"
+    "      float pairs = float(interior(p)) + float(interior(n));\n"
+    "      force += weight * pairs * (texelFetch(state, n, 0).x - s.x);\n"
+    "    }\n"
+    "  float velocity = s.y + force * delta;\n"
+    "  gl_FragColor = vec4(s.x + velocity, velocity, 0.0, 0.0);\n"
+    "}\n";
+
+// le filet statique est deplace par les hauteurs; normales de
+// WATER::CalcNormals(), bords etendus, et coordonnees "sphere map"
+static const char *renderVertexShader =
+    "#version 130\n"
+    "uniform sampler2D state;\n"
+    "uniform int resolution;\n"
+    "uniform float cellSize;\n"
+    "in vec2 cell;\n" // (k, j)
+    "out vec2 texCoord;\n"
+    "ivec2 p;\n"
+    "float h(int dx, int dz) {\n"
+    "  ivec2 n = clamp(p + ivec2(dx, dz), ivec2(0), ivec2(resolution - 1));\n"
+    "  return texelFetch(state, n, 0).x;\n"
+    "}\n"
+    "void main() {\n"
+    "  p = ivec2(cell);\n"
+    "  vec4 vertex =\n"
+    "      vec4(cell.x * cellSize, h(0, 0), cell.y * cellSize, 1.0);\n"
+    "  float nx = h(-1, 1) + 2.0 * h(0, 1) + h(1, 1) - h(-1, -1) -\n"
+    "             2.0 * h(0, -1) - h(1, -1);\n"
+    "  float nz = h(1, -1) + 2.0 * h(1, 0) + h(1, 1) - h(-1, -1) -\n"
+    "             2.0 * h(-1, 0) - h(-1, 1);\n"
+    "  vec3 normal = normalize(gl_NormalMatrix * vec3(nx, 1.0, nz));\n"
+    "  vec3 u = normalize(vec3(gl_ModelViewMatrix * vertex));\n"
+    "  vec3 r = reflect(u, normal);\n"
+    "  float m = 2.0 * length(vec3(r.xy, r.z + 1.0));\n"
+    "  texCoord = r.xy / m + 0.5;\n"
+    "  gl_Position = gl_ModelViewProjectionMatrix * vertex;\n"
+    "}\n";
+
+static const char *renderFragmentShader =
+    "#version 130\n"
+    "uniform sampler2D reflectionMap;\n"
+    "uniform vec4 color;\n"
+    "in vec2 texCoord;\n"
+    "void main() {\n"
+    "  gl_FragColor = color * texture(reflectionMap, texCoord);\n"
+    "}\n";
+
 // initialiser le "filet" des vertex d'eau
 void WATER::Init(float myWorldSize, float scaleHeight) {
   Vec dx, dy;
@@ -58,13 +145,106 @@ void WATER::Init(float myWorldSize, float scaleHeight) {
   // changement de valeur d'hauteur
   vertArray[rand() % (SQR(WATER_RESOLUTION))][1] =
       1.0f * scaleHeight * 1.5; // quelques vagues...
+
+  InitGPU();
 }
 
-// mise a jour des vertex, pas de temps = delta
+// charger le filet et l'etat initial sur la carte graphique. L'eau reste
+// simulee par le CPU sans GLSL 1.30 ni textures flottantes.
+void WATER::InitGPU() {
+  Shutdown();
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context || context->isOpenGLES() ||
+      (context->format().version() < qMakePair(3, 0)))
+    return;
+
+  simulationProgram = new QOpenGLShaderProgram();
+  renderProgram = new QOpenGLShaderProgram();
+  if (!simulationProgram->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                  simulationVertexShader) ||
+      !simulationProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                                  simulationShader) ||
+      !simulationProgram->link() ||
+      !renderProgram->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                              renderVertexShader) ||
+      !renderProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                              renderFragmentShader) ||
+      !renderProgram->link()) {
+    qWarning("Water shaders failed, using the CPU simulation");
+    Shutdown();
+    return;
+  }
+
+  // hauteur et vitesse initiales
+  QVector<GLfloat> initial(4 * numVertices, 0.0f);
+  for (int v = 0; v < numVertices; v++)
+    initial[4 * v] = vertArray[v][1];
+  for (int i = 0; i < 2; i++) {
+    state[i] = new QOpenGLFramebufferObject(
+        WATER_RESOLUTION, WATER_RESOLUTION,
+        QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA32F);
+    glBindTexture(GL_TEXTURE_2D, state[i]->texture());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WATER_RESOLUTION, WATER_RESOLUTION,
+                    GL_RGBA, GL_FLOAT, initial.constData());
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (!state[0]->isValid() || !state[1]->isValid()) {
+    qWarning("Water state textures failed, using the CPU simulation");
+    Shutdown();
+    return;
+  }
+  currentState = 0;
+
+  QVector<GLfloat> cells(2 * numVertices);
+  for (int j = 0; j < WATER_RESOLUTION; j++)
+    for (int k = 0; k < WATER_RESOLUTION; k++) {
+      cells[2 * (j * WATER_RESOLUTION + k)] = k;
+      cells[2 * (j * WATER_RESOLUTION + k) + 1] = j;
+    }
+  gridBuffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  gridBuffer->create();
+  gridBuffer->bind();
+  gridBuffer->allocate(cells.constData(), cells.size() * sizeof(GLfloat));
+  gridBuffer->release();
+  indexBuffer = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+  indexBuffer->create();
+  indexBuffer->bind();
+  indexBuffer->allocate(polyIndexArray, numIndices * sizeof(int));
+  indexBuffer->release();
+
+  pendingSteps = 0;
+  gpu = true;
+}
+
+// liberer les ressources OpenGL, le contexte doit etre courant
+void WATER::Shutdown() {
+  delete state[0];
+  delete state[1];
+  delete simulationProgram;
+  delete renderProgram;
+  delete gridBuffer;
+  delete indexBuffer;
+  state[0] = state[1] = nullptr;
+  simulationProgram = renderProgram = nullptr;
+  gridBuffer = indexBuffer = nullptr;
+  gpu = false;
+}
+
+// mise a jour des vertex, pas de temps = delta. Sur la carte graphique, le pas
+// est execute par le prochain Render(), le contexte n'etant pas forcement
+// courant.
 void WATER::Update(float delta) {
   float d, tempF, vert;
   int x, z;
 
+  if (gpu) {
+    pendingSteps = qMin(pendingSteps + 1, WATER_MAX_STEPS);
+    pendingDelta = delta;
+    return;
+  }
+
   // calculer les forces qui influencent l'eau a chaque position
   for (z = 1; z < WATER_RESOLUTION - 1; z++) {
     for (x = 1; x < WATER_RESOLUTION - 1; x++) {
@@ -140,6 +320,10 @@ void WATER::CalcNormals() {
   float tmpf;
   int i, j;
 
+  // calculees par le vertex shader
+  if (gpu)
+    return;
+
   for (i = 0; i < WATER_RESOLUTION; i++) {
     for (j = 0; j < WATER_RESOLUTION; j++) {
       // initialiser
@@ -247,8 +431,80 @@ void WATER::CalcNormals() {
   }
 }
 
+// executer les pas de simulation en attente: rendu de l'etat courant dans
+// l'autre texture
+void WATER::Simulate() {
+  glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glViewport(0, 0, WATER_RESOLUTION, WATER_RESOLUTION);
+  simulationProgram->bind();
+  simulationProgram->setUniformValue("state", 0);
+  simulationProgram->setUniformValue("resolution", WATER_RESOLUTION);
+  simulationProgram->setUniformValue("delta", pendingDelta);
+  for (; pendingSteps > 0; pendingSteps--) {
+    state[1 - currentState]->bind();
+    glBindTexture(GL_TEXTURE_2D, state[currentState]->texture());
+    glBegin(GL_QUADS);
+    glVertex2f(-1.0f, -1.0f);
+    glVertex2f(1.0f, -1.0f);
+    glVertex2f(1.0f, 1.0f);
+    glVertex2f(-1.0f, 1.0f);
+    glEnd();
+    currentState = 1 - currentState;
+  }
+  simulationProgram->release();
+  // l'image du viewer
+  state[currentState]->release();
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glPopAttrib();
+}
+
+// rendering du filet statique par les shaders
+void WATER::RenderGPU() {
+  Simulate();
+
+  QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+  f->glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, refmapID);
+  f->glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, state[currentState]->texture());
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE); // fct. de transparence
+
+  renderProgram->bind();
+  renderProgram->setUniformValue("state", 0);
+  renderProgram->setUniformValue("reflectionMap", 1);
+  renderProgram->setUniformValue("resolution", WATER_RESOLUTION);
+  renderProgram->setUniformValue("cellSize",
+                                 worldSize / (WATER_RESOLUTION - 1));
+  renderProgram->setUniformValue("color", color);
+  gridBuffer->bind();
+  renderProgram->enableAttributeArray("cell");
+  renderProgram->setAttributeBuffer("cell", GL_FLOAT, 0, 2);
+  indexBuffer->bind();
+  glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, nullptr);
+  indexBuffer->release();
+  renderProgram->disableAttributeArray("cell");
+  gridBuffer->release();
+  renderProgram->release();
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  f->glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  f->glActiveTexture(GL_TEXTURE0);
+  glDisable(GL_BLEND);
+}
+
 // rendering de l'eau
 void WATER::Render() {
+  if (gpu) {
+    RenderGPU();
+    return;
+  }
+
   // activer la texture de l'eau
   glBindTexture(GL_TEXTURE_2D, refmapID);
   glEnable(GL_TEXTURE_2D);
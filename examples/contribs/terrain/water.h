@@ -7,6 +7,10 @@
 #include <math.h>
 #include <qcolor.h>
 
+class QOpenGLBuffer;
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+
 #define WATER_RESOLUTION 60
 #define SQR(number) (number * number)
 
@@ -33,13 +37,37 @@ private:
 
   unsigned int refmapID;
 
+  // simulation sur la carte graphique (GLSL 1.30), sinon par le CPU
+  bool gpu;
+  // hauteur et vitesse de chaque vertex, la simulation passe de l'une a
+  // l'autre a chaque pas
+  QOpenGLFramebufferObject *state[2];
+  int currentState;
+  QOpenGLShaderProgram *simulationProgram;
+  QOpenGLShaderProgram *renderProgram;
+  QOpenGLBuffer *gridBuffer;  // coordonnees (k, j) de chaque vertex, statiques
+  QOpenGLBuffer *indexBuffer; // polyIndexArray
+  // pas de simulation demandes par Update(), executes par Render()
+  int pendingSteps;
+  float pendingDelta;
+
+  void InitGPU();
+  void Simulate();
+  void RenderGPU();
+
 public:
   WATER() {
     SetColor(QColor("white"));
     iwantwater = false;
+    gpu = false;
+    state[0] = state[1] = nullptr;
+    simulationProgram = renderProgram = nullptr;
+    gridBuffer = indexBuffer = nullptr;
+    pendingSteps = 0;
   }
 
   void Init(float myWorldSize, float scaleHeight);
+  void Shutdown();
 
   void Update(float delta);
   void CalcNormals();
@@ -1,7 +1,8 @@
 #include "textureViewer.h"
 
+#include <QGLViewer/textureStreamer.h>
+
 #include <qfiledialog.h>
-#include <qimage.h>
 
 #if QT_VERSION >= 0x040000
 #include <QKeyEvent>
@@ -10,21 +11,27 @@
 using namespace qglviewer;
 using namespace std;
 
+// The textures are released with the viewer context
+Viewer::~Viewer() {
+  if (!streamer_)
+    return;
+  makeCurrent();
+  streamer_->cleanupGL();
+  doneCurrent();
+}
+
 void Viewer::init() {
   restoreStateFromFile();
 
   // Enable GL textures
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glEnable(GL_TEXTURE_2D);
 
   // Nice texture coordinate interpolation
   glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
 
-  // Texture parameters
-  u_max = 1.0;
-  v_max = 1.0;
-  ratio = 1.0;
+  // Images are decoded in a worker thread, which asks for a new frame when done
+  streamer_ = new TextureStreamer(this);
+  connect(streamer_, SIGNAL(imageDecoded()), SLOT(update()));
 
   setKeyDescription(Qt::Key_L, "Loads a new image");
 
@@ -33,67 +40,53 @@ void Viewer::init() {
 }
 
 void Viewer::draw() {
-  // Display the quad
+  // Starts the upload of a decoded image, displayed once it is completed
+  if (streamer_->update())
+    update();
+
+  if (!streamer_->texture())
+    return;
+
+  glBindTexture(GL_TEXTURE_2D, streamer_->texture());
+  const QSize size = streamer_->textureSize();
+  const float ratio = size.width() / float(size.height());
+
+  // Display the quad. The top row of the image is at v=0.
   glNormal3f(0.0, 0.0, 1.0);
   glBegin(GL_QUADS);
-  glTexCoord2f(0.0, 1.0 - v_max);
-  glVertex2f(-u_max * ratio, -v_max);
   glTexCoord2f(0.0, 1.0);
-  glVertex2f(-u_max * ratio, v_max);
-  glTexCoord2f(u_max, 1.0);
-  glVertex2f(u_max * ratio, v_max);
-  glTexCoord2f(u_max, 1.0 - v_max);
-  glVertex2f(u_max * ratio, -v_max);
+  glVertex2f(-ratio, -1.0);
+  glTexCoord2f(0.0, 0.0);
+  glVertex2f(-ratio, 1.0);
+  glTexCoord2f(1.0, 0.0);
+  glVertex2f(ratio, 1.0);
+  glTexCoord2f(1.0, 1.0);
+  glVertex2f(ratio, -1.0);
   glEnd();
 }
 
 void Viewer::loadImage() {
 #if QT_VERSION < 0x040000
   QString name = QFileDialog::getOpenFileName(
-      ".", "Images (*.png *.xpm *.jpg)", this, "Choose", "Select an image");
+      ".", "Images (*.png *.xpm *.jpg *.dds)", this, "Choose",
+      "Select an image");
 #else
-  QString name = QFileDialog::getOpenFileName(this, "Select an image", ".",
-                                              "Images (*.png *.xpm *.jpg)");
+  QString name = QFileDialog::getOpenFileName(
+      this, "Select an image", ".", "Images (*.png *.xpm *.jpg *.dds)");
 #endif
 
   // In case of Cancel
   if (name.isEmpty())
     return;
 
-  QImage img(name);
-
-  if (img.isNull()) {
-    qWarning("Unable to load file, unsupported file format");
-    return;
-  }
-
 #if QT_VERSION < 0x040000
-  qWarning("Loading %s, %dx%d pixels", name.latin1(), img.width(),
-           img.height());
+  qWarning("Loading %s", name.latin1());
 #else
-  qWarning("Loading %s, %dx%d pixels", name.toLatin1().constData(), img.width(),
-           img.height());
+  qWarning("Loading %s", name.toLatin1().constData());
 #endif
 
-  // 1E-3 needed. Just try with width=128 and see !
-  int newWidth = 1 << (int)(1 + log(img.width() - 1 + 1E-3) / log(2.0));
-  int newHeight = 1 << (int)(1 + log(img.height() - 1 + 1E-3) / log(2.0));
-
-  u_max = img.width() / (float)newWidth;
-  v_max = img.height() / (float)newHeight;
-
-  if ((img.width() != newWidth) || (img.height() != newHeight)) {
-    qWarning("Image size set to %dx%d pixels", newWidth, newHeight);
-    img = img.copy(0, 0, newWidth, newHeight);
-  }
-
-  ratio = newWidth / float(newHeight);
-
-  QImage glImg = QGLWidget::convertToGLFormat(img); // flipped 32bit RGBA
-
-  // Bind the img texture...
-  glTexImage2D(GL_TEXTURE_2D, 0, 4, glImg.width(), glImg.height(), 0, GL_RGBA,
-               GL_UNSIGNED_BYTE, glImg.bits());
+  // Decoded in a worker thread, the current image is displayed meanwhile
+  streamer_->load(name);
 }
 
 void Viewer::keyPressEvent(QKeyEvent *e) {
@@ -111,11 +104,10 @@ QString Viewer::helpString() const {
   QString text("<h2>T e x t u r e V i e w e r</h2>");
   text += "This pedagogical example illustrates how to texture map a "
           "polygon.<br><br>";
-  text += "The Qt <i>QImage</i> class and its <i>convertToGLFormat()</i> "
-          "function are used ";
-  text += "to load an image in any format. The image is resized so that its "
-          "dimensions ";
-  text += "are powers of two if needed. Feel free to cut and paste.<br><br>";
+  text += "A <i>qglviewer::TextureStreamer</i> loads the image (in any "
+          "format supported by <i>QImage</i>) in a worker thread and uploads "
+          "it in a texture without stalling the display. Feel free to cut "
+          "and paste.<br><br>";
   text += "Press <b>L</b>(oad) to load a new image.";
   return text;
 }
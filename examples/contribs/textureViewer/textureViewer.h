@@ -1,6 +1,13 @@
 #include <QGLViewer/qglviewer.h>
 
+namespace qglviewer {
+class TextureStreamer;
+}
+
 class Viewer : public QGLViewer {
+public:
+  virtual ~Viewer();
+
 protected:
   virtual void init();
   virtual void draw();
@@ -10,5 +17,6 @@ protected:
   void loadImage();
 
 private:
-  float ratio, u_max, v_max;
+  // Decodes and uploads the images without stalling the display
+  qglviewer::TextureStreamer *streamer_ = nullptr;
 };
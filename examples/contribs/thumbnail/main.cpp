@@ -1,9 +1,76 @@
 #include "thumbnail.h"
+#include "thumbnailBatch.h"
+#include <math.h>
 #include <qapplication.h>
+#include <qdir.h>
+
+// A spiral with a given number of turns, drawn by the batch jobs.
+class Spiral : public ThumbnailScene {
+public:
+  Spiral(float turns) : turns_(turns) {}
+
+  virtual void draw() const {
+    const float nbSteps = 200.0;
+    glBegin(GL_QUAD_STRIP);
+    for (float i = 0; i < nbSteps; ++i) {
+      float ratio = i / nbSteps;
+      float angle = 2.0 * M_PI * turns_ * ratio;
+      float c = cos(angle);
+      float s = sin(angle);
+      float r1 = 1.0 - 0.8 * ratio;
+      float r2 = 0.8 - 0.8 * ratio;
+      float alt = ratio - 0.5;
+      const float nor = 0.5;
+      const float up = sqrt(1.0 - nor * nor);
+      glColor3f(1.0 - ratio, 0.2f, ratio);
+      glNormal3f(nor * c, up, nor * s);
+      glVertex3f(r1 * c, alt, r1 * s);
+      glVertex3f(r2 * c, alt + 0.05, r2 * s);
+    }
+    glEnd();
+  }
+
+private:
+  float turns_;
+};
+
+// Renders nbThumbnails thumbnails of spirals seen from different directions in
+// directory, without any window.
+static int renderBatch(int nbThumbnails, const QString &directory) {
+  const int nbSpirals = 8;
+  QList<Spiral *> spirals;
+  for (int i = 0; i < nbSpirals; ++i)
+    spirals.append(new Spiral(1.0 + i));
+
+  ThumbnailBatch batch;
+  for (int i = 0; i < nbThumbnails; ++i) {
+    ThumbnailBatch::Job job;
+    job.scene = spirals[i % nbSpirals];
+    job.cameraOrientation = qglviewer::Quaternion(
+        qglviewer::Vec(0.0, 1.0, 0.0), 2.0 * M_PI * i / nbThumbnails);
+    job.cameraPosition =
+        job.cameraOrientation.rotate(qglviewer::Vec(0.0, 0.0, 3.0));
+    job.size = QSize(128, 128);
+    job.fileName = QDir(directory).filePath(
+        QString("thumbnail-%1.png").arg(i, 5, 10, QChar('0')));
+    batch.addJob(job);
+  }
+
+  const int nbSaved = batch.run();
+  qDeleteAll(spirals);
+  return (nbSaved == nbThumbnails) ? 0 : 1;
+}
 
 int main(int argc, char **argv) {
   QApplication application(argc, argv);
 
+  // thumbnail -batch <number> <directory> renders thumbnails offscreen. Add
+  // "-platform offscreen" on a server without display.
+  const QStringList arguments = application.arguments();
+  const int batch = arguments.indexOf("-batch");
+  if ((batch >= 0) && (batch + 2 < arguments.size()))
+    return renderBatch(arguments[batch + 1].toInt(), arguments[batch + 2]);
+
   Viewer viewer;
 
 #if QT_VERSION < 0x040000
@@ -5,14 +5,17 @@
 # illustrated here) or debugging. It uses <code>glViewport</code> and <code>glScissor</code> to
 # restrict the drawing area.
 
+# Run with <code>-batch number directory</code> to render a series of thumbnails offscreen,
+# back to back, with a <code>qglviewer::OffscreenRenderer</code>.
+
 # This example was created by Sylvain Paris.
 
 TEMPLATE = app
 TARGET   = thumbnail
 CONFIG  += qt opengl warn_on release thread
 
-HEADERS  = thumbnail.h
-SOURCES  = thumbnail.cpp main.cpp
+HEADERS  = thumbnail.h thumbnailBatch.h
+SOURCES  = thumbnail.cpp thumbnailBatch.cpp main.cpp
 
 include( ../../examples.pri )
 
@@ -0,0 +1,164 @@
+#include "thumbnailBatch.h"
+
+#include <QGLViewer/camera.h>
+
+#include <qopenglbuffer.h>
+#include <qopenglframebufferobject.h>
+#include <qrunnable.h>
+#include <qsemaphore.h>
+#include <qthreadpool.h>
+
+#include <cstring>
+
+using namespace qglviewer;
+
+// Encodes and writes a thumbnail in a worker thread. Releases a slot of the
+// writer queue when done.
+class ThumbnailWriter : public QRunnable {
+public:
+  ThumbnailWriter(const QImage &image, const QString &fileName,
+                  QSemaphore *slots, QAtomicInt *nbSaved)
+      : image_(image), fileName_(fileName), slots_(slots), nbSaved_(nbSaved) {}
+
+  void run() {
+    if (image_.save(fileName_))
+      nbSaved_->ref();
+    else
+      qWarning("ThumbnailBatch: unable to save %s",
+               fileName_.toLatin1().constData());
+    slots_->release();
+  }
+
+private:
+  QImage image_;
+  QString fileName_;
+  QSemaphore *slots_;
+  QAtomicInt *nbSaved_;
+};
+
+ThumbnailBatch::ThumbnailBatch() : scene_(NULL) {
+  for (int i = 0; i < NB_BUFFERS; ++i)
+    buffers_[i] = NULL;
+
+  writers_ = new QThreadPool();
+  // Bounds the memory used by the images waiting to be encoded
+  writerSlots_ = new QSemaphore(2 * writers_->maxThreadCount());
+
+  camera()->setSceneRadius(1.0);
+}
+
+ThumbnailBatch::~ThumbnailBatch() {
+  writers_->waitForDone();
+  delete writers_;
+  delete writerSlots_;
+
+  if (context() && makeCurrent())
+    for (int i = 0; i < NB_BUFFERS; ++i)
+      delete buffers_[i];
+}
+
+// Renders all the queued jobs and returns the number of saved thumbnails.
+// Waits for the end of the encodings.
+int ThumbnailBatch::run() {
+  nbSaved_.storeRelease(0);
+  if (!makeCurrent())
+    return 0;
+
+  bool usesBuffers = true;
+  for (int i = 0; i < NB_BUFFERS; ++i) {
+    if (!buffers_[i]) {
+      buffers_[i] = new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+      buffers_[i]->setUsagePattern(QOpenGLBuffer::StreamRead);
+      buffers_[i]->create();
+    }
+    usesBuffers = usesBuffers && buffers_[i]->isCreated();
+  }
+
+  int index = 0;
+  for (QList<Job>::const_iterator it = jobs_.begin(), end = jobs_.end();
+       it != end; ++it) {
+    setSize((*it).size);
+    camera()->setPosition((*it).cameraPosition);
+    camera()->setOrientation((*it).cameraOrientation);
+    scene_ = (*it).scene;
+
+    if (usesBuffers) {
+      // Read back started NB_BUFFERS jobs ago is completed by now
+      retrieve(index);
+      if (renderToFramebufferObject()) {
+        readBack(index, *it);
+        index = (index + 1) % NB_BUFFERS;
+      }
+    } else {
+      // Without pixel buffer objects, read back is synchronous
+      const QImage image = render();
+      if (!image.isNull())
+        queueImage(image, (*it).fileName);
+    }
+  }
+  scene_ = NULL;
+
+  // Oldest first
+  for (int i = 0; i < NB_BUFFERS; ++i)
+    retrieve((index + i) % NB_BUFFERS);
+
+  jobs_.clear();
+  writers_->waitForDone();
+  return nbSaved_.loadAcquire();
+}
+
+void ThumbnailBatch::draw() {
+  if (scene_)
+    scene_->draw();
+}
+
+// Starts the asynchronous read back of the rendered image in a pixel buffer
+// object.
+void ThumbnailBatch::readBack(int index, const Job &job) {
+  const QSize size = job.size;
+  buffers_[index]->bind();
+  if (bufferSize_[index] != size)
+    buffers_[index]->allocate(4 * size.width() * size.height());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+               NULL);
+  buffers_[index]->release();
+  framebufferObject()->release();
+
+  bufferSize_[index] = size;
+  bufferFileName_[index] = job.fileName;
+}
+
+// Maps the pixel buffer object of a previous read back and hands its image to
+// the writers. Does nothing if the buffer is free.
+void ThumbnailBatch::retrieve(int index) {
+  if (bufferFileName_[index].isEmpty())
+    return;
+
+  const QSize size = bufferSize_[index];
+  QImage image(size, QImage::Format_RGBA8888);
+  buffers_[index]->bind();
+  const uchar *pixels =
+      static_cast<const uchar *>(buffers_[index]->map(QOpenGLBuffer::ReadOnly));
+  if (pixels) {
+    // OpenGL rows are bottom-up
+    for (int row = 0; row < size.height(); ++row)
+      memcpy(image.scanLine(row),
+             pixels + 4 * (size.height() - 1 - row) * size.width(),
+             4 * size.width());
+    buffers_[index]->unmap();
+  } else
+    qWarning("ThumbnailBatch: unable to map pixel buffer object");
+  buffers_[index]->release();
+
+  if (pixels)
+    queueImage(image, bufferFileName_[index]);
+  bufferFileName_[index].clear();
+}
+
+// Blocks when all the writer slots are used.
+void ThumbnailBatch::queueImage(const QImage &image, const QString &fileName) {
+  writerSlots_->acquire();
+  writers_->start(
+      new ThumbnailWriter(image, fileName, writerSlots_, &nbSaved_));
+}
@@ -0,0 +1,68 @@
+#ifndef QGLVIEWER_THUMBNAIL_BATCH_H
+#define QGLVIEWER_THUMBNAIL_BATCH_H
+
+#include <QGLViewer/offscreenRenderer.h>
+#include <QGLViewer/quaternion.h>
+
+#include <qatomic.h>
+#include <qlist.h>
+#include <qstring.h>
+
+class QOpenGLBuffer;
+class QSemaphore;
+class QThreadPool;
+
+// A scene drawn by the ThumbnailBatch jobs. The same scene can be shared by
+// several jobs.
+class ThumbnailScene {
+public:
+  virtual ~ThumbnailScene() {}
+  virtual void draw() const = 0;
+};
+
+// Renders a queue of thumbnails back to back, with a single OpenGL context and
+// framebuffer object (as long as the thumbnails have the same size). Images are
+// read back through a ring of pixel buffer objects and compressed by worker
+// threads, so that rendering never waits for the image encoding.
+class ThumbnailBatch : public qglviewer::OffscreenRenderer {
+public:
+  class Job {
+  public:
+    const ThumbnailScene *scene;
+    qglviewer::Vec cameraPosition;
+    qglviewer::Quaternion cameraOrientation;
+    QSize size;
+    QString fileName; // the format is deduced from its suffix
+  };
+
+  ThumbnailBatch();
+  virtual ~ThumbnailBatch();
+
+  void addJob(const Job &job) { jobs_.append(job); }
+  int nbJobs() const { return jobs_.size(); }
+  int run();
+
+protected:
+  virtual void draw();
+
+private:
+  void readBack(int index, const Job &job);
+  void retrieve(int index);
+  void queueImage(const QImage &image, const QString &fileName);
+
+  QList<Job> jobs_;
+  const ThumbnailScene *scene_; // of the job being rendered
+
+  // R e a d   b a c k   r i n g
+  enum { NB_BUFFERS = 3 };
+  QOpenGLBuffer *buffers_[NB_BUFFERS];
+  QString bufferFileName_[NB_BUFFERS]; // empty when the buffer is free
+  QSize bufferSize_[NB_BUFFERS];
+
+  // E n c o d i n g
+  QThreadPool *writers_;
+  QSemaphore *writerSlots_;
+  QAtomicInt nbSaved_;
+};
+
+#endif // QGLVIEWER_THUMBNAIL_BATCH_H
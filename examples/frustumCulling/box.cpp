@@ -1,64 +1,161 @@
 #include "box.h"
 #include "cullingCamera.h"
 
+#include <QRunnable>
+#include <cmath>
+
 using namespace std;
 using namespace qglviewer;
 
 // Static member initialization
-Box *Box::Root;
-
-void Box::draw() const {
-  glColor3f(0.3 * level, 0.2f, 1.0 - 0.3 * level);
-  glLineWidth(level + 1);
-
-  glBegin(GL_LINE_STRIP);
-  glVertex3fv(Vec(p1.x, p1.y, p1.z));
-  glVertex3fv(Vec(p1.x, p2.y, p1.z));
-  glVertex3fv(Vec(p2.x, p2.y, p1.z));
-  glVertex3fv(Vec(p2.x, p1.y, p1.z));
-  glVertex3fv(Vec(p1.x, p1.y, p1.z));
-  glVertex3fv(Vec(p1.x, p1.y, p2.z));
-  glVertex3fv(Vec(p1.x, p2.y, p2.z));
-  glVertex3fv(Vec(p2.x, p2.y, p2.z));
-  glVertex3fv(Vec(p2.x, p1.y, p2.z));
-  glVertex3fv(Vec(p1.x, p1.y, p2.z));
-  glEnd();
-
-  glBegin(GL_LINES);
-  glVertex3fv(Vec(p1.x, p2.y, p1.z));
-  glVertex3fv(Vec(p1.x, p2.y, p2.z));
-  glVertex3fv(Vec(p2.x, p2.y, p1.z));
-  glVertex3fv(Vec(p2.x, p2.y, p2.z));
-  glVertex3fv(Vec(p2.x, p1.y, p1.z));
-  glVertex3fv(Vec(p2.x, p1.y, p2.z));
-  glEnd();
+BoxHierarchy *BoxHierarchy::Root;
+
+// The boxes that intersect the frustum at this depth have their subtree
+// culled by a separate task
+static const int taskDepth = 2;
+
+static const int edgeVertices = 24;
+
+// Culls the subtree of a box, its own result being merged afterwards in
+// subtree order.
+class CullTask : public QRunnable {
+public:
+  CullTask(const BoxHierarchy *boxes, int box, const float (*planes)[4],
+           QVector<int> *result)
+      : boxes_(boxes), box_(box), planes_(planes), result_(result) {}
+  virtual void run() {
+    boxes_->cull(box_ + 1, boxes_->subtreeEnd[box_], planes_, *result_, NULL);
+  }
+
+private:
+  const BoxHierarchy *boxes_;
+  int box_;
+  const float (*planes_)[4];
+  QVector<int> *result_;
+};
+
+BoxHierarchy::BoxHierarchy(const Vec &P1, const Vec &P2, int levels)
+    : nbLevels(levels + 1), visibleEdges(levels + 1) {
+  addBox(P1, P2, levels);
 }
 
-void Box::buildBoxHierarchy(int l) {
-  level = l;
+void BoxHierarchy::addBox(const Vec &p1, const Vec &p2, int l) {
+  const int box = level.size();
   const Vec middle = (p1 + p2) / 2.0;
-  for (unsigned int i = 0; i < 8; ++i) {
-    // point in one of the 8 box corners
-    const Vec point((i & 4) ? p1.x : p2.x, (i & 2) ? p1.y : p2.y,
-                    (i & 1) ? p1.z : p2.z);
-    if (level > 0) {
-      child[i] = new Box(point, middle);
-      child[i]->buildBoxHierarchy(level - 1);
+  centerX.append(middle.x);
+  centerY.append(middle.y);
+  centerZ.append(middle.z);
+  halfX.append(fabs(p2.x - p1.x) / 2.0);
+  halfY.append(fabs(p2.y - p1.y) / 2.0);
+  halfZ.append(fabs(p2.z - p1.z) / 2.0);
+  level.append(l);
+  subtreeEnd.append(box + 1);
+
+  // Edges join the corners that differ by one coordinate
+  for (unsigned int c = 0; c < 8; ++c)
+    for (unsigned int axis = 1; axis < 8; axis <<= 1)
+      if (!(c & axis)) {
+        const unsigned int ends[2] = {c, c | axis};
+        for (int e = 0; e < 2; ++e) {
+          vertices.append((ends[e] & 4) ? p1.x : p2.x);
+          vertices.append((ends[e] & 2) ? p1.y : p2.y);
+          vertices.append((ends[e] & 1) ? p1.z : p2.z);
+        }
+      }
+
+  if (l > 0) {
+    for (unsigned int i = 0; i < 8; ++i) {
+      // point in one of the 8 box corners
+      const Vec point((i & 4) ? p1.x : p2.x, (i & 2) ? p1.y : p2.y,
+                      (i & 1) ? p1.z : p2.z);
+      addBox(point, middle, l - 1);
+    }
+    subtreeEnd[box] = level.size();
+  }
+}
+
+// Returns 0 when the box is outside the frustum, 2 when it is entirely
+// inside, and 1 otherwise. Same test as CullingCamera::aaBoxIsVisible(), using
+// the distance of the center to the planes and the projected half size
+// instead of the eight corners.
+int BoxHierarchy::classify(int box, const float planes[6][4]) const {
+  bool entirely = true;
+  for (int i = 0; i < 6; ++i) {
+    const float *p = planes[i];
+    const float distance = p[0] * centerX[box] + p[1] * centerY[box] +
+                           p[2] * centerZ[box] - p[3];
+    const float radius = fabs(p[0]) * halfX[box] + fabs(p[1]) * halfY[box] +
+                         fabs(p[2]) * halfZ[box];
+    // The eight points are on the outside side of this plane
+    if (distance - radius > 0.0f)
+      return 0;
+    if (distance + radius > 0.0f)
+      entirely = false;
+  }
+  return entirely ? 2 : 1;
+}
+
+// Appends to result the boxes of [first, last) that are entirely visible, or
+// visible leaves. When subtrees is not NULL, the boxes at taskDepth that
+// intersect the frustum are appended to it instead of being traversed.
+void BoxHierarchy::cull(int first, int last, const float planes[6][4],
+                        QVector<int> &result, QVector<int> *subtrees) const {
+  int box = first;
+  while (box < last) {
+    const int visibility = classify(box, planes);
+    if (visibility == 0)
+      box = subtreeEnd[box];
+    else if ((visibility == 2) || (level[box] == 0)) {
+      result.append(box);
+      box = subtreeEnd[box];
+    } else if (subtrees && (nbLevels - 1 - level[box] == taskDepth)) {
+      subtrees->append(box);
+      box = subtreeEnd[box];
     } else
-      child[i] = NULL;
+      ++box;
+  }
+}
+
+void BoxHierarchy::update(const CullingCamera *camera) {
+  if (!camera->computeFrustumPlanesEquations())
+    return;
+
+  float planes[6][4];
+  camera->getFrustumPlanes(planes);
+
+  // The top of the hierarchy is culled here, and the subtrees below taskDepth
+  // in parallel
+  visible.clear();
+  QVector<int> subtrees;
+  cull(0, nbBoxes(), planes, visible, &subtrees);
+
+  QVector<QVector<int> > results(subtrees.size());
+  for (int i = 0; i < subtrees.size(); ++i)
+    pool.start(new CullTask(this, subtrees[i], planes, &results[i]));
+  pool.waitForDone();
+  for (int i = 0; i < results.size(); ++i)
+    visible += results[i];
+
+  for (int l = 0; l < nbLevels; ++l)
+    visibleEdges[l].clear();
+  for (int i = 0; i < visible.size(); ++i) {
+    const int box = visible[i];
+    QVector<GLuint> &edges = visibleEdges[level[box]];
+    for (int v = 0; v < edgeVertices; ++v)
+      edges.append(box * edgeVertices + v);
   }
 }
 
-void Box::drawIfAllChildrenAreVisible(const CullingCamera *camera) const {
-  static bool *entirely = new bool;
-
-  if (camera->aaBoxIsVisible(p1, p2, entirely)) {
-    if (*entirely)
-      draw();
-    else if (child[0])
-      for (int i = 0; i < 8; ++i)
-        child[i]->drawIfAllChildrenAreVisible(camera);
-    else
-      draw();
+void BoxHierarchy::draw() const {
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, vertices.constData());
+  for (int l = 0; l < nbLevels; ++l) {
+    if (visibleEdges[l].isEmpty())
+      continue;
+    glColor3f(0.3 * l, 0.2f, 1.0 - 0.3 * l);
+    glLineWidth(l + 1);
+    glDrawElements(GL_LINES, visibleEdges[l].size(), GL_UNSIGNED_INT,
+                   visibleEdges[l].constData());
   }
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
@@ -1,21 +1,46 @@
 #include <QGLViewer/camera.h>
+#include <QThreadPool>
+#include <QVector>
 
 class CullingCamera;
 
-// An Axis Aligned Bounding Box octree hierarchy element.
-class Box {
+// An Axis Aligned Bounding Box octree hierarchy, flattened in depth first
+// order: the subtree of box i is made of the boxes i to subtreeEnd[i]-1. The
+// boxes are stored as arrays of centers and half sizes, so that the culling
+// loops neither recurse nor follow pointers, and run in parallel on separate
+// subtrees.
+class BoxHierarchy {
+  friend class CullTask;
+
 public:
-  Box(const qglviewer::Vec &P1, const qglviewer::Vec &P2) : p1(P1), p2(P2){};
+  BoxHierarchy(const qglviewer::Vec &P1, const qglviewer::Vec &P2, int levels);
 
+  // Culls the hierarchy when the frustum of camera changed since the last
+  // call. Shared by viewers: only the first one to draw does the culling.
+  void update(const CullingCamera *camera);
+  // Draws the boxes kept by the last update(), with one call per level.
   void draw() const;
-  void drawIfAllChildrenAreVisible(const CullingCamera *camera) const;
-  void buildBoxHierarchy(int l);
+
+  int nbBoxes() const { return level.size(); }
+  int nbVisibleBoxes() const { return visible.size(); }
 
   // Lazy static member, so that it is shared by viewers
-  static Box *Root;
+  static BoxHierarchy *Root;
 
 private:
-  qglviewer::Vec p1, p2;
-  Box *child[8];
-  int level;
+  void addBox(const qglviewer::Vec &p1, const qglviewer::Vec &p2, int l);
+  int classify(int box, const float planes[6][4]) const;
+  void cull(int first, int last, const float planes[6][4],
+            QVector<int> &result, QVector<int> *subtrees) const;
+
+  int nbLevels;
+  QVector<float> centerX, centerY, centerZ;
+  QVector<float> halfX, halfY, halfZ;
+  QVector<int> level, subtreeEnd;
+  // Line vertices of the 12 edges of each box
+  QVector<float> vertices;
+
+  QVector<int> visible;
+  QVector<QVector<GLuint> > visibleEdges; // Per level
+  QThreadPool pool;
 };
@@ -2,6 +2,27 @@
 
 using namespace qglviewer;
 
+bool CullingCamera::computeFrustumPlanesEquations() const {
+  GLdouble coefficients[6][4];
+  getFrustumPlanesCoefficients(coefficients);
+
+  bool changed = !planesAreValid;
+  for (int i = 0; i < 6; ++i)
+    for (int j = 0; j < 4; ++j)
+      if (coefficients[i][j] != planeCoefficients[i][j]) {
+        planeCoefficients[i][j] = coefficients[i][j];
+        changed = true;
+      }
+  planesAreValid = true;
+  return changed;
+}
+
+void CullingCamera::getFrustumPlanes(float planes[6][4]) const {
+  for (int i = 0; i < 6; ++i)
+    for (int j = 0; j < 4; ++j)
+      planes[i][j] = planeCoefficients[i][j];
+}
+
 float CullingCamera::distanceToFrustumPlane(int index, const Vec &pos) const {
   return pos * Vec(planeCoefficients[index]) - planeCoefficients[index][3];
 }
@@ -2,9 +2,11 @@
 
 class CullingCamera : public qglviewer::Camera {
 public:
-  void computeFrustumPlanesEquations() const {
-    getFrustumPlanesCoefficients(planeCoefficients);
-  }
+  CullingCamera() : planesAreValid(false) {}
+
+  // Returns true when the planes changed since the previous call.
+  bool computeFrustumPlanesEquations() const;
+  void getFrustumPlanes(float planes[6][4]) const;
 
   float distanceToFrustumPlane(int index, const qglviewer::Vec &pos) const;
   bool sphereIsVisible(const qglviewer::Vec &center, float radius) const;
@@ -14,4 +16,5 @@ public:
 private:
   // F r u s t u m   p l a n e s
   mutable GLdouble planeCoefficients[6][4];
+  mutable bool planesAreValid;
 };
@@ -5,12 +5,11 @@
 using namespace qglviewer;
 
 void Viewer::draw() {
-  Box::Root->drawIfAllChildrenAreVisible(cullingCamera);
+  // The first viewer to draw after a move of cullingCamera culls the boxes
+  BoxHierarchy::Root->update(cullingCamera);
+  BoxHierarchy::Root->draw();
 
-  if (cullingCamera == camera())
-    // Main viewer computes its plane equation
-    cullingCamera->computeFrustumPlanesEquations();
-  else {
+  if (cullingCamera != camera()) {
     // Observer viewer draws cullingCamera
     glLineWidth(4.0);
     glColor4f(1.0, 1.0, 1.0, 0.5);
@@ -41,9 +40,10 @@ QString Viewer::helpString() const {
           "uses <code>drawCamera()</code> to ";
   text += "display an external view of the first viewer's camera.<br><br>";
 
-  text += "This frustum culling implementation is quite naive. Many "
-          "optimisation techniques are available in ";
-  text += "the litterature.";
+  text += "The octree is stored in flat arrays, culled only when the camera "
+          "moves, with its subtrees ";
+  text += "culled in parallel. The visible boxes are drawn with one call per "
+          "level of the octree.";
 
   return text;
 }
@@ -4,8 +4,9 @@
 # using <code>getFrustumPlanesCoefficients</code>. A second viewer displays an external view of the
 # scene that exhibits the clipping (using <code>drawCamera()</code> to display the frustum).
 
-# This frustum culling implementation is quite naive. Many optimisation techniques are available in
-# the litterature.
+# The octree is flattened in depth first arrays of box centers and half sizes. It is culled only when
+# the camera moves, the subtrees being culled in parallel on a thread pool, and the visible boxes are
+# drawn with one <code>glDrawElements</code> per level.
 
 TEMPLATE = app
 TARGET   = frustumCulling
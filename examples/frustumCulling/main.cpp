@@ -12,8 +12,7 @@ int main(int argc, char **argv) {
 
   // Create octree AABBox hierarchy
   const qglviewer::Vec p(1.0, 0.7f, 1.3f);
-  Box::Root = new Box(-p, p);
-  Box::Root->buildBoxHierarchy(4);
+  BoxHierarchy::Root = new BoxHierarchy(-p, p, 4);
 
   // Instantiate the two viewers.
   Viewer viewer, observer;
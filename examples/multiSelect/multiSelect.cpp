@@ -1,7 +1,7 @@
 #include "multiSelect.h"
-#include "manipulatedFrameSetConstraint.h"
 
 #include <QGLViewer/manipulatedFrame.h>
+#include <QGLViewer/manipulatedFrameGroup.h>
 
 #include <QMouseEvent>
 
@@ -11,20 +11,23 @@ Viewer::Viewer() {
   selectionMode_ = NONE;
 
   // Fill the scene with objects positionned on a regular grid.
-  // Consider increasing selectBufferSize() if you use more objects.
+  // The selectBuffer() automatically grows if you use more objects.
   const int nb = 10;
   for (int i = -nb; i <= nb; ++i)
     for (int j = -nb; j <= nb; ++j) {
       Object *o = new Object();
       o->frame.setPosition(Vec(i / float(nb), j / float(nb), 0.0));
+      // Sphere and cone bounding box, in the object frame
+      picker_.addBox(Vec(-0.03, -0.03, -0.03), Vec(0.03, 0.03, 0.09),
+                     objects_.size(), &o->frame);
       objects_.append(o);
     }
 }
 
 void Viewer::init() {
-  // A ManipulatedFrameSetConstraint will apply displacements to the selection
+  // A ManipulatedFrameGroup will apply displacements to the selection
   setManipulatedFrame(new ManipulatedFrame());
-  manipulatedFrame()->setConstraint(new ManipulatedFrameSetConstraint());
+  manipulatedFrame()->setConstraint(new ManipulatedFrameGroup(this));
 
   // Used to display semi-transparent relection rectangle
   glBlendFunc(GL_ONE, GL_ONE);
@@ -44,12 +47,13 @@ QString Viewer::helpString() const {
           "selection.<br><br>";
   text += "Individual objects (click on them) as well as rectangular regions "
           "(click and drag mouse) can be selected. ";
-  text += "To do this, the selection region size is modified and the "
-          "<code>endSelection()</code> function ";
-  text += "has been overloaded so that <i>all</i> the objects of the region "
-          "are taken into account ";
-  text +=
-      "(the default implementation only selects the closest object).<br><br>";
+  text += "The <code>endSelection()</code> function has been overloaded so "
+          "that <i>all</i> the objects of the clicked region are taken into "
+          "account ";
+  text += "(the default implementation only selects the closest object). ";
+  text += "Rectangular regions are not drawn again: the object bounding boxes "
+          "are projected by a <code>RayPicker</code>, whatever the rectangle "
+          "size.<br><br>";
   text += "The selected objects can then be manipulated by pressing the "
           "<b>Control</b> key. ";
   text += "Other set operations (parameter edition, deletion...) can also "
@@ -118,11 +122,17 @@ void Viewer::mouseReleaseEvent(QMouseEvent *e) {
     // Actual selection on the rectangular area.
     // Possibly swap left/right and top/bottom to make rectangle_ valid.
     rectangle_ = rectangle_.normalized();
-    // Define selection window dimensions
-    setSelectRegionWidth(rectangle_.width());
-    setSelectRegionHeight(rectangle_.height());
-    // Compute rectangle center and perform selection
-    select(rectangle_.center());
+    if ((rectangle_.width() > 3) || (rectangle_.height() > 3)) {
+      // The objects whose projected bounding box intersects the rectangle
+      for (int id : picker_.pickRectangle(camera(), rectangle_))
+        applySelectionMode(id);
+      selectionMode_ = NONE;
+    } else {
+      // A click: the objects drawn under the cursor
+      setSelectRegionWidth(3);
+      setSelectRegionHeight(3);
+      select(rectangle_.center());
+    }
     // Update display to show new selected objects
     update();
   } else
@@ -133,48 +143,32 @@ void Viewer::mouseReleaseEvent(QMouseEvent *e) {
 
 void Viewer::drawWithNames() {
   for (int i = 0; i < int(objects_.size()); i++) {
-    glPushName(i);
+    pushSelectionName(i);
     objects_.at(i)->draw();
-    glPopName();
+    popSelectionName();
   }
 }
 
-void Viewer::endSelection(const QPoint &) {
-  // Flush GL buffers
-  glFlush();
-
-  // Get the number of objects that were seen through the pick matrix frustum.
-  // Reset GL_RENDER mode.
-  GLint nbHits = glRenderMode(GL_RENDER);
-
-  if (nbHits > 0) {
-    // Interpret results : each object created 4 values in the selectBuffer().
-    // (selectBuffer())[4*i+3] is the id pushed on the stack.
-    for (int i = 0; i < nbHits; ++i)
-      switch (selectionMode_) {
-      case ADD:
-        addIdToSelection((selectBuffer())[4 * i + 3]);
-        break;
-      case REMOVE:
-        removeIdFromSelection((selectBuffer())[4 * i + 3]);
-        break;
-      default:
-        break;
-      }
-  }
+void Viewer::endSelection(const QPoint &point) {
+  // Analyzes the selectBuffer(), enlarged if it overflowed.
+  QGLViewer::endSelection(point);
+
+  // All the objects that were seen through the pick matrix frustum.
+  for (const SelectionHit &hit : selectionHits())
+    applySelectionMode(hit.name);
   selectionMode_ = NONE;
 }
 
 void Viewer::startManipulation() {
   Vec averagePosition;
-  ManipulatedFrameSetConstraint *mfsc =
-      (ManipulatedFrameSetConstraint *)(manipulatedFrame()->constraint());
-  mfsc->clearSet();
+  ManipulatedFrameGroup *group =
+      (ManipulatedFrameGroup *)(manipulatedFrame()->constraint());
+  group->clear();
 
   for (QList<int>::const_iterator it = selection_.begin(),
                                   end = selection_.end();
        it != end; ++it) {
-    mfsc->addObjectToSet(objects_[*it]);
+    group->addFrame(&objects_[*it]->frame);
     averagePosition += objects_[*it]->frame.position();
   }
 
@@ -191,6 +185,19 @@ void Viewer::addIdToSelection(int id) {
 
 void Viewer::removeIdFromSelection(int id) { selection_.removeAll(id); }
 
+void Viewer::applySelectionMode(int id) {
+  switch (selectionMode_) {
+  case ADD:
+    addIdToSelection(id);
+    break;
+  case REMOVE:
+    removeIdFromSelection(id);
+    break;
+  default:
+    break;
+  }
+}
+
 void Viewer::drawSelectionRectangle() const {
   startScreenCoordinatesSystem();
   glDisable(GL_LIGHTING);
@@ -1,4 +1,5 @@
 #include "QGLViewer/qglviewer.h"
+#include "QGLViewer/rayPicker.h"
 #include "object.h"
 
 class Viewer : public QGLViewer {
@@ -24,6 +25,7 @@ private:
   void drawSelectionRectangle() const;
   void addIdToSelection(int id);
   void removeIdFromSelection(int id);
+  void applySelectionMode(int id);
 
   // Current rectangular selection
   QRect rectangle_;
@@ -34,4 +36,7 @@ private:
 
   QList<Object *> objects_;
   QList<int> selection_;
+
+  // Bounding boxes of the objects, for the rectangular selections
+  qglviewer::RayPicker picker_;
 };
@@ -4,9 +4,10 @@
 # the selection, and <b>Alt</b> to remove objects from the selection.
 
 # Individual objects (click on them) as well as rectangular regions (click and drag mouse) can be
-# selected. To do this, the selection region size is modified and the <code>endSelection()</code>
-# function has been overloaded so that <i>all</i> the objects of the region are taken into account
-# (the default implementation only selects the closest object).
+# selected. The <code>endSelection()</code> function has been overloaded so that <i>all</i> the
+# objects of the clicked region are taken into account (the default implementation only selects the
+# closest object). Rectangular regions are not drawn again: the object bounding boxes are projected
+# by a <code>RayPicker</code>, whatever the rectangle size.
 
 # The selected objects can then be manipulated by pressing the <b>Control</b> key. Other set
 # operations (parameter edition, deletion...) can also easily be applied to the selected objects.
@@ -14,8 +15,8 @@
 TEMPLATE = app
 TARGET   = multiSelect
 
-HEADERS  = multiSelect.h manipulatedFrameSetConstraint.h object.h
-SOURCES  = multiSelect.cpp manipulatedFrameSetConstraint.cpp object.cpp main.cpp
+HEADERS  = multiSelect.h object.h
+SOURCES  = multiSelect.cpp object.cpp main.cpp
 
 # Since we use gluCylinder
 !macx|darwin-g++ {
@@ -5,8 +5,9 @@
 using namespace qglviewer;
 using namespace std;
 
-Viewer::Viewer(const Scene *const s, int type, QWidget *parent)
+Viewer::Viewer(Scene *const s, int type, QWidget *parent)
     : QGLViewer(parent), scene_(s) {
+  setSceneResources(s);
   setAxisIsDrawn();
   setGridIsDrawn();
 
@@ -30,10 +31,12 @@ Viewer::Viewer(const Scene *const s, int type, QWidget *parent)
 
 void Viewer::draw() { scene_->draw(); }
 
-// Draws a spiral
-void Scene::draw() const {
+Scene::Scene() : vbo_(QOpenGLBuffer::VertexBuffer), nbVertices_(0) {}
+
+// Uploads the spiral: color, normal and position of each vertex
+void Scene::initializeGL() {
   const float nbSteps = 200.0;
-  glBegin(GL_QUAD_STRIP);
+  QVector<GLfloat> data;
   for (float i = 0; i < nbSteps; ++i) {
     float ratio = i / nbSteps;
     float angle = 21.0 * ratio;
@@ -44,10 +47,39 @@ void Scene::draw() const {
     float alt = ratio - 0.5f;
     const float nor = 0.5f;
     const float up = sqrt(1.0 - nor * nor);
-    glColor3f(1.0 - ratio, 0.2f, ratio);
-    glNormal3f(nor * c, up, nor * s);
-    glVertex3f(r1 * c, alt, r1 * s);
-    glVertex3f(r2 * c, alt + 0.05f, r2 * s);
+    const GLfloat vertices[2][9] = {
+        {1.0f - ratio, 0.2f, ratio, nor * c, up, nor * s, r1 * c, alt, r1 * s},
+        {1.0f - ratio, 0.2f, ratio, nor * c, up, nor * s, r2 * c, alt + 0.05f,
+         r2 * s}};
+    for (int v = 0; v < 2; ++v)
+      for (int k = 0; k < 9; ++k)
+        data.append(vertices[v][k]);
   }
-  glEnd();
+  nbVertices_ = data.size() / 9;
+
+  vbo_.create();
+  vbo_.bind();
+  vbo_.allocate(data.constData(), data.size() * sizeof(GLfloat));
+  vbo_.release();
+}
+
+void Scene::cleanupGL() { vbo_.destroy(); }
+
+// Draws a spiral
+void Scene::draw() const {
+  if (!vbo_.bind())
+    return;
+
+  const GLsizei stride = 9 * sizeof(GLfloat);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glColorPointer(3, GL_FLOAT, stride, nullptr);
+  glNormalPointer(GL_FLOAT, stride, reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+  glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<void *>(6 * sizeof(GLfloat)));
+  glDrawArrays(GL_QUAD_STRIP, 0, nbVertices_);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  vbo_.release();
 }
@@ -1,13 +1,26 @@
 #include <QGLViewer/qglviewer.h>
+#include <QGLViewer/sceneResources.h>
 
-class Scene {
+#include <QOpenGLBuffer>
+
+// The spiral vertex buffer is uploaded once and shared by all the viewers.
+class Scene : public qglviewer::SceneResources {
 public:
+  Scene();
   void draw() const;
+
+protected:
+  virtual void initializeGL();
+  virtual void cleanupGL();
+
+private:
+  mutable QOpenGLBuffer vbo_;
+  int nbVertices_;
 };
 
 class Viewer : public QGLViewer {
 public:
-  Viewer(const Scene *const s, int type, QWidget *parent);
+  Viewer(Scene *const s, int type, QWidget *parent);
 
 protected:
   virtual void draw();
@@ -0,0 +1,89 @@
+// Test of the ModificationBatch: the Frame setters called inside a batch,
+// including the inline setTranslation() and setRotation() used by
+// setPosition(), emit a single Frame::modified() signal at the end of the
+// batch, and count a single HotPathCounters::FRAME_MODIFIED event.
+//
+// Usage: modificationBatchTest
+//
+// Returns 0 when all the checks pass.
+
+#include <QCoreApplication>
+
+#include <stdio.h>
+
+#include "frame.h"
+#include "hotPathCounters.h"
+#include "modificationBatch.h"
+
+using namespace qglviewer;
+
+static int nbFailures = 0;
+
+static void check(bool condition, const char *description) {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", description);
+    ++nbFailures;
+  }
+}
+
+// The counters are zero when the library is compiled with
+// QGLVIEWER_NO_HOT_PATH_COUNTERS
+static bool countsMatch(quint32 counted, int emitted) {
+  return (counted == 0) || (counted == quint32(emitted));
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication application(argc, argv);
+
+  Frame reference;
+  Frame frame;
+  int nbModified = 0;
+  QObject::connect(&frame, &Frame::modified, [&nbModified]() { ++nbModified; });
+
+  // Without a batch, each setter emits the signal
+  quint32 counted = HotPathCounters::value(HotPathCounters::FRAME_MODIFIED);
+  frame.setPosition(Vec(1.0, 2.0, 3.0));
+  frame.setTranslation(Vec(2.0, 3.0, 4.0));
+  frame.setRotation(Quaternion(Vec(0.0, 0.0, 1.0), 0.5));
+  counted = HotPathCounters::value(HotPathCounters::FRAME_MODIFIED) - counted;
+  check(nbModified == 3, "each unbatched setter emits modified()");
+  check(countsMatch(counted, 3), "each unbatched setter is counted");
+
+  // In a batch, the signal is deferred and merged
+  nbModified = 0;
+  counted = HotPathCounters::value(HotPathCounters::FRAME_MODIFIED);
+  {
+    ModificationBatch batch;
+    for (int i = 0; i < 10; ++i)
+      frame.setPosition(Vec(i, 0.0, 0.0));
+    frame.setTranslation(Vec(0.0, 1.0, 0.0));
+    frame.setRotation(Quaternion());
+    check(nbModified == 0, "modified() is deferred inside the batch");
+    check(frame.position() == Vec(0.0, 1.0, 0.0),
+          "position() is up to date inside the batch");
+  }
+  counted = HotPathCounters::value(HotPathCounters::FRAME_MODIFIED) - counted;
+  check(nbModified == 1, "the batch emits a single modified()");
+  check(countsMatch(counted, 1), "the batch counts a single modified()");
+
+  // setPosition() of a Frame with a referenceFrame() uses setTranslation()
+  frame.setReferenceFrame(&reference);
+  reference.setTranslation(Vec(1.0, 0.0, 0.0));
+  nbModified = 0;
+  {
+    ModificationBatch outer;
+    {
+      ModificationBatch inner;
+      frame.setPosition(Vec(2.0, 0.0, 0.0));
+      frame.setPosition(Vec(3.0, 0.0, 0.0));
+    }
+    check(nbModified == 0, "nested batches defer modified() to the outermost");
+  }
+  check(nbModified == 1, "nested batches emit a single modified()");
+  check(frame.translation() == Vec(2.0, 0.0, 0.0),
+        "setPosition() is defined in world coordinates");
+
+  if (nbFailures == 0)
+    printf("All ModificationBatch checks passed\n");
+  return (nbFailures == 0) ? 0 : 1;
+}